@@ -0,0 +1,59 @@
+;;
+;; bench/compare.scm - compare two benchmark results
+;;
+;;  gosh bench/compare.scm <base.json> <new.json>
+;;
+;; The files are the ones saved by 'bench/run.scm -o'.  For each benchmark
+;; that appears in both, shows the mean times and the ratio new/base.
+;; The ratio is marked with '*' if the confidence intervals of the two
+;; means don't overlap, that is, the difference is likely to be real.
+;;
+
+(add-load-path ".." :relative)
+(use rfc.json)
+
+(define (load-results file)
+  (let1 json (call-with-input-file file parse-json)
+    (map (^b (cons (cdr (assoc "name" b)) b))
+         (vector->list (cdr (assoc "benchmarks" json))))))
+
+(define (ref b key) (cdr (assoc key b)))
+
+(define (format-flonum val digs)
+  (let* ([scale (expt 10 digs)]
+         [n (round->exact (* val scale))])
+    (format "~d.~v,'0d" (quotient n scale) digs (remainder n scale))))
+
+(define (format-time secs)
+  (cond [(not (real? secs)) "-"]
+        [(< secs 1e-6) #"~(format-flonum (* secs 1e9) 2)ns"]
+        [(< secs 1e-3) #"~(format-flonum (* secs 1e6) 2)us"]
+        [(< secs 1)    #"~(format-flonum (* secs 1e3) 2)ms"]
+        [else          #"~(format-flonum secs 3)s"]))
+
+(define (main args)
+  (unless (= (length args) 3)
+    (exit 1 "usage: gosh ~a <base.json> <new.json>" (car args)))
+  (let* ([base (load-results (cadr args))]
+         [new  (load-results (caddr args))]
+         [names (filter (cut assoc <> base) (map car new))]
+         [w (fold (^[n w] (max w (string-length n))) 4 names)])
+    (format #t "~va  ~12@a  ~12@a  ratio\n" w "name" "base" "new")
+    (dolist [name names]
+      (let ([b (cdr (assoc name base))]
+            [n (cdr (assoc name new))])
+        (let* ([bm (ref b "mean")]
+               [nm (ref n "mean")]
+               [ratio (and (real? bm) (real? nm) (positive? bm) (/ nm bm))]
+               [significant? (and (real? (ref b "ci-high"))
+                                  (real? (ref n "ci-high"))
+                                  (or (< (ref n "ci-high") (ref b "ci-low"))
+                                      (< (ref b "ci-high") (ref n "ci-low"))))])
+          (format #t "~va  ~12@a  ~12@a  ~a~a\n" w name
+                  (format-time bm) (format-time nm)
+                  (if ratio (format-flonum ratio 3) "-")
+                  (if significant? " *" "")))))
+    (let1 missing (remove (cut assoc <> new) (map car base))
+      (unless (null? missing)
+        (format #t "Not in ~a: ~a\n" (caddr args) (string-join missing " "))))
+    0))
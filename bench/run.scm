@@ -0,0 +1,61 @@
+;;
+;; bench/run.scm - run the benchmark suite
+;;
+;;  gosh bench/run.scm [-o <output.json>] [-q] [-l] [<suite> ...]
+;;
+;;   -o <file>  Save the results in JSON to <file>.  Compare two of these
+;;              files with bench/compare.scm.
+;;   -q         Quick mode: fewer and shorter samples, for smoke testing.
+;;   -l         List available suites and exit.
+;;   <suite>    Run only the named suites (e.g. vm hash).  Default is all.
+;;
+;; Each suite is bench/suites/<suite>.scm, which defines a module
+;; bench.suites.<suite> exporting BENCHMARKS, a list of (<name> . <thunk>).
+;; In the report and the output, each benchmark is named <suite>/<name>.
+;;
+
+(add-load-path ".." :relative)
+(use gauche.benchmark)
+(use gauche.parseopt)
+(use file.util)
+
+(define *suite-dir*
+  (build-path (sys-dirname (current-load-path)) "suites"))
+
+(define (available-suites)
+  (sort (map path-sans-extension
+             (directory-list *suite-dir*
+                             :filter (^e (string-suffix? ".scm" e))))))
+
+(define (suite-benchmarks suite)
+  (load (build-path *suite-dir* #"~|suite|.scm"))
+  (global-variable-ref (find-module (string->symbol #"bench.suites.~suite"))
+                       'benchmarks))
+
+(define (main args)
+  (let-args (cdr args) ([output "o=s" #f]
+                        [quick  "q"]
+                        [list?  "l"]
+                        . suites)
+    (when list?
+      (for-each print (available-suites))
+      (exit 0))
+    (let* ([suites (if (null? suites) (available-suites) suites)]
+           [opts (if quick
+                   '(:samples 5 :sample-time 0.001 :warmup 1)
+                   '())]
+           [results
+            (append-map
+             (^[suite]
+               (format #t "~a:\n" suite)
+               (flush)
+               (rlet1 rs (map (^p (apply benchmark (cdr p)
+                                         :name #"~|suite|/~(car p)" opts))
+                              (suite-benchmarks suite))
+                 (report-benchmark-results rs)))
+             suites)])
+      (when output
+        (call-with-output-file output
+          (cut write-benchmark-results-json results <>))
+        (format #t "Results are saved in ~a\n" output))
+      0)))
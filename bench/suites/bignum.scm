@@ -0,0 +1,36 @@
+;;
+;; Bignum arithmetic.
+;;
+
+(define-module bench.suites.bignum
+  (export benchmarks))
+(select-module bench.suites.bignum)
+
+(define (factorial n)
+  (let loop ([i 1] [r 1])
+    (if (> i n) r (loop (+ i 1) (* r i)))))
+
+(define *a* (expt 3 10000))
+(define *b* (+ (expt 7 4000) 12345))
+
+;; Digits of pi by Machin's formula, in fixed point with bignums.
+(define (pi-digits digits)
+  (let1 unit (expt 10 (+ digits 10))
+    (define (arctan-inv x)
+      (let loop ([term (quotient unit x)] [k 1] [sum 0] [sign 1])
+        (if (zero? term)
+          sum
+          (loop (quotient term (* x x)) (+ k 2)
+                (+ sum (* sign (quotient term k))) (- sign)))))
+    (quotient (* 4 (- (* 4 (arctan-inv 5)) (arctan-inv 239)))
+              (expt 10 10))))
+
+(define benchmarks
+  `((factorial      . ,(^[] (factorial 1000)))
+    (multiply       . ,(^[] (* *a* *b*)))
+    (divide         . ,(^[] (quotient *a* *b*)))
+    (gcd            . ,(^[] (gcd *a* (* *b* 3))))
+    (number->string . ,(^[] (number->string *a*)))
+    (string->number . ,(let1 s (number->string *b*)
+                         (^[] (string->number s))))
+    (pi-digits      . ,(^[] (pi-digits 1000)))))
@@ -0,0 +1,57 @@
+;;
+;; Allocation-heavy workloads, to exercise the allocator and GC.
+;;
+
+(define-module bench.suites.gc
+  (export benchmarks))
+(select-module bench.suites.gc)
+
+;; Short-lived small objects.
+(define (cons-churn n)
+  (let loop ([i 0] [x '()])
+    (if (= i n)
+      (length x)
+      (loop (+ i 1) (if (= (modulo i 100) 0) '() (cons i x))))))
+
+;; Binary trees, as in the 'binary-trees' benchmark.
+(define (make-tree depth)
+  (if (zero? depth)
+    (cons #f #f)
+    (cons (make-tree (- depth 1)) (make-tree (- depth 1)))))
+
+(define (check-tree t)
+  (if (car t) (+ 1 (check-tree (car t)) (check-tree (cdr t))) 1))
+
+(define (binary-trees max-depth)
+  (let1 long-lived (make-tree max-depth)
+    (let loop ([d 4] [sum 0])
+      (if (> d max-depth)
+        (+ sum (check-tree long-lived))
+        (loop (+ d 2)
+              (+ sum (let1 iters (expt 2 (- max-depth d))
+                       (let loop2 ([i 0] [s 0])
+                         (if (= i iters)
+                           s
+                           (loop2 (+ i 1) (+ s (check-tree (make-tree d)))))))))))))
+
+;; Vectors and strings of various sizes; some are big enough to be
+;; allocated as large objects.
+(define (mixed-alloc n)
+  (dotimes [i n]
+    (make-vector (+ 1 (modulo i 50)))
+    (make-string (+ 1 (modulo i 200)))
+    (when (zero? (modulo i 100))
+      (make-vector 10000))))
+
+;; Closures and flonums.
+(define (closure-churn n)
+  (let loop ([i 0] [acc 0.0])
+    (if (= i n)
+      acc
+      (loop (+ i 1) ((^[x] (+ x (* i 0.5))) acc)))))
+
+(define benchmarks
+  `((cons-churn    . ,(^[] (cons-churn 100000)))
+    (binary-trees  . ,(^[] (binary-trees 14)))
+    (mixed-alloc   . ,(^[] (mixed-alloc 10000)))
+    (closure-churn . ,(^[] (closure-churn 100000)))))
@@ -0,0 +1,54 @@
+;;
+;; Hash table insertion and lookup across key types.
+;;
+
+(define-module bench.suites.hash
+  (use bench.util)
+  (export benchmarks))
+(select-module bench.suites.hash)
+
+(define *size* 10000)
+
+(define *fixnums* (random-list *size* 1000000000 3))
+(define *flonums* (map (cut / <> 7.0) *fixnums*))
+(define *strings* (map number->string *fixnums*))
+(define *symbols* (map string->symbol
+                       (map (cut string-append "k" <>) *strings*)))
+(define *lists*   (map (^k (list k (quotient k 3))) *fixnums*))
+
+(define (insert type keys)
+  (let1 ht (make-hash-table type)
+    (dolist [k keys] (hash-table-put! ht k #t))
+    ht))
+
+(define (lookup ht keys)
+  (let loop ([keys keys] [n 0])
+    (if (null? keys)
+      n
+      (loop (cdr keys) (if (hash-table-get ht (car keys) #f) (+ n 1) n)))))
+
+(define (insert+lookup label type keys)
+  (let1 ht (insert type keys)
+    `((,(symbol-append 'insert/ label) . ,(^[] (insert type keys)))
+      (,(symbol-append 'lookup/ label) . ,(^[] (lookup ht keys))))))
+
+;; Key-weak table, to compare with lookup/symbol
+(define (weak-lookup ht keys)
+  (let loop ([keys keys] [n 0])
+    (if (null? keys)
+      n
+      (loop (cdr keys)
+            (if (weak-hash-table-get ht (car keys) #f) (+ n 1) n)))))
+
+(define *weak-symbols*
+  (rlet1 ht (make-weak-hash-table 'eq? 'key)
+    (dolist [k *symbols*] (weak-hash-table-put! ht k #t))))
+
+(define benchmarks
+  (append `((weak-lookup/symbol . ,(^[] (weak-lookup *weak-symbols*
+                                                     *symbols*))))
+          (insert+lookup 'fixnum 'eqv? *fixnums*)
+          (insert+lookup 'flonum 'eqv? *flonums*)
+          (insert+lookup 'symbol 'eq? *symbols*)
+          (insert+lookup 'string 'string=? *strings*)
+          (insert+lookup 'list 'equal? *lists*)))
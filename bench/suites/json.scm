@@ -0,0 +1,27 @@
+;;
+;; JSON serialization and parsing, with rfc.json.
+;;
+
+(define-module bench.suites.json
+  (use rfc.json)
+  (use bench.util)
+  (export benchmarks))
+(select-module bench.suites.json)
+
+;; A list of records that looks like a typical API response.
+(define *data*
+  (let1 rand (make-lcg 13)
+    (list->vector
+     (list-tabulate 1000
+       (^i `(("id" . ,i)
+             ("name" . ,(random-string 12 rand))
+             ("score" . ,(/ (rand 100000) 100.0))
+             ("active" . ,(zero? (rand 2)))
+             ("tags" . ,(vector (random-string 5 rand)
+                                (random-string 7 rand)))
+             ("parent" . null)))))))
+(define *text* (construct-json-string *data*))
+
+(define benchmarks
+  `((write . ,(^[] (construct-json-string *data*)))
+    (read  . ,(^[] (parse-json-string *text*)))))
@@ -0,0 +1,62 @@
+;;
+;; Port read/write throughput.
+;;
+
+(define-module bench.suites.port
+  (use gauche.uvector)
+  (use bench.util)
+  (export benchmarks))
+(select-module bench.suites.port)
+
+(define *lines*
+  (let1 rand (make-lcg 11)
+    (list-tabulate 5000 (^_ (random-string (+ 10 (rand 70)) rand)))))
+(define *text* (string-join *lines* "\n" 'suffix))
+(define *data* (make-u8vector 1000000 65))
+
+(define (read-all-lines port)
+  (let loop ([n 0])
+    (if (eof-object? (read-line port)) n (loop (+ n 1)))))
+
+(define (read-all-fields port)
+  (let loop ([n 0])
+    (if (eof-object? (read-until-delimiter #[\sa] port))
+      n
+      (begin (read-char port) (loop (+ n 1))))))
+
+(define (read-all-chars port)
+  (let loop ([n 0])
+    (if (eof-object? (read-char port)) n (loop (+ n 1)))))
+
+(define (write-read-file)
+  (receive (out path) (sys-mkstemp (build-tmp-template))
+    (unwind-protect
+        (begin
+          (write-uvector *data* out)
+          (close-output-port out)
+          (call-with-input-file path
+            (^[in] (let1 buf (make-u8vector 65536)
+                     (let loop ([n 0])
+                       (let1 r (read-uvector! buf in)
+                         (if (eof-object? r) n (loop (+ n r)))))))))
+      (sys-unlink path))))
+
+(define (build-tmp-template)
+  (string-append (sys-tmpdir) "/gauche-benchXXXXXX"))
+
+(define benchmarks
+  `((write-string  . ,(^[] (call-with-output-string
+                             (^[out] (dolist [l *lines*]
+                                       (write-string l out)
+                                       (newline out))))))
+    (write-char    . ,(^[] (call-with-output-string
+                             (^[out] (string-for-each (cut write-char <> out)
+                                                      *text*)))))
+    (write-object  . ,(^[] (call-with-output-string
+                             (^[out] (write *lines* out)))))
+    (read-line     . ,(^[] (call-with-input-string *text* read-all-lines)))
+    (read-until    . ,(^[] (call-with-input-string *text* read-all-fields)))
+    (read-char     . ,(^[] (call-with-input-string *text* read-all-chars)))
+    (read-object   . ,(let1 s (write-to-string *lines*)
+                        (^[] (read-from-string s))))
+    (file-io       . ,write-read-file)))
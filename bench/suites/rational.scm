@@ -0,0 +1,41 @@
+;;
+;; Exact rational arithmetic.
+;;
+
+(define-module bench.suites.rational
+  (export benchmarks))
+(select-module bench.suites.rational)
+
+;; 1 + 1/2 + ... + 1/n; the denominator grows to lcm(1..n).
+(define (harmonic n)
+  (let loop ([i 1] [s 0])
+    (if (> i n) s (loop (+ i 1) (+ s (/ i))))))
+
+;; Bernoulli numbers B_0 .. B_n by Akiyama-Tanigawa algorithm.
+(define (bernoulli n)
+  (let1 a (make-vector (+ n 1) 0)
+    (dotimes [m (+ n 1)]
+      (vector-set! a m (/ (+ m 1)))
+      (do ([j m (- j 1)])
+          [(< j 1)]
+        (vector-set! a (- j 1)
+                     (* j (- (vector-ref a (- j 1)) (vector-ref a j))))))
+    (vector-ref a 0)))
+
+;; Monthly compound interest with an exact rate, like a loan schedule
+;; computed without rounding.
+(define (compound principal rate months)
+  (let1 r (+ 1 (/ rate 1200))
+    (let loop ([i 0] [p principal])
+      (if (= i months) p (loop (+ i 1) (* p r))))))
+
+(define *x* (/ (expt 3 500) (expt 7 300)))
+(define *y* (/ (expt 5 400) (+ (expt 11 250) 2)))
+
+(define benchmarks
+  `((harmonic  . ,(^[] (harmonic 2000)))
+    (bernoulli . ,(^[] (bernoulli 120)))
+    (compound  . ,(^[] (compound 100000 37/10 360)))
+    (mul       . ,(^[] (* *x* *y*)))
+    (add       . ,(^[] (+ *x* *y*)))
+    (gcd       . ,(^[] (gcd (numerator *x*) (* (denominator *y*) 3))))))
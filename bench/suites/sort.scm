@@ -0,0 +1,24 @@
+;;
+;; Sorting.
+;;
+
+(define-module bench.suites.sort
+  (use bench.util)
+  (export benchmarks))
+(select-module bench.suites.sort)
+
+(define *list* (random-list 20000 1000000 5))
+(define *vector* (list->vector *list*))
+(define *sorted* (sort *list*))
+(define *strings* (map number->string *list*))
+(define *flonums* (map (cut / <> 3.0) *list*))
+
+(define benchmarks
+  `((list/fixnum     . ,(^[] (sort *list*)))
+    (list/fixnum-<   . ,(^[] (sort *list* <)))
+    (vector/fixnum   . ,(^[] (sort *vector*)))
+    (vector!/fixnum  . ,(^[] (sort! (vector-copy *vector*))))
+    (list/flonum     . ,(^[] (sort *flonums*)))
+    (list/string     . ,(^[] (sort *strings* string<?)))
+    (list/sorted     . ,(^[] (sort *sorted*)))
+    (stable/key      . ,(^[] (stable-sort-by *list* (cut modulo <> 100))))))
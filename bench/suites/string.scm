@@ -0,0 +1,42 @@
+;;
+;; String and regexp throughput.
+;;
+
+(define-module bench.suites.string
+  (use bench.util)
+  (export benchmarks))
+(select-module bench.suites.string)
+
+;; About 100KB of text made of random words.
+(define *words*
+  (let1 rand (make-lcg 7)
+    (list-tabulate 16000 (^_ (random-string (+ 2 (rand 8)) rand)))))
+(define *text* (string-join *words* " "))
+
+(define (count-matches rx str)
+  (let loop ([start 0] [count 0])
+    (if-let1 m (rxmatch rx str start)
+      (loop (rxmatch-end m) (+ count 1))
+      count)))
+
+(define benchmarks
+  `((string-append    . ,(^[] (apply string-append *words*)))
+    (string-join      . ,(^[] (string-join *words* ",")))
+    (string-split     . ,(^[] (string-split *text* #\space)))
+    (string-scan      . ,(^[] (string-scan *text* "zzz" 'index)))
+    (string-ref       . ,(^[] (let1 len (string-length *text*)
+                                (let loop ([i 0] [n 0])
+                                  (if (= i len)
+                                    n
+                                    (loop (+ i 1)
+                                          (if (char=? (string-ref *text* i)
+                                                      #\a)
+                                            (+ n 1) n)))))))
+    (string->symbol   . ,(^[] (for-each string->symbol *words*)))
+    (regexp-literal   . ,(^[] (count-matches #/ing/ *text*)))
+    (regexp-class     . ,(^[] (count-matches #/[aeiou]{3,}/ *text*)))
+    (regexp-group     . ,(^[] (count-matches #/\b(\w)\w*\1\b/ *text*)))
+    (regexp-replace   . ,(^[] (regexp-replace-all #/[xyz]+/ *text* "_")))
+    (regexp-string    . ,(^[] (for-each (^w (rxmatch "q[aeiou]" w)) *words*)))
+    (regexp-matches?  . ,(^[] (length (filter (^w (regexp-matches? #/(\w)\1/ w))
+                                              *words*))))))
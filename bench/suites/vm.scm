@@ -0,0 +1,185 @@
+;;
+;; Classic Scheme benchmarks, mainly exercising the VM.
+;;
+;; boyer and earley are compact versions of the Gabriel/Gambit benchmarks
+;; of the same names; they have smaller lemma set and grammar, but the
+;; same kind of workload (term rewriting and chart parsing).
+;;
+
+(define-module bench.suites.vm
+  (use util.match)
+  (export benchmarks))
+(select-module bench.suites.vm)
+
+;; fib ------------------------------------------------
+
+(define (fib n)
+  (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))
+
+;; tak ------------------------------------------------
+
+(define (tak x y z)
+  (if (not (< y x))
+    z
+    (tak (tak (- x 1) y z) (tak (- y 1) z x) (tak (- z 1) x y))))
+
+;; boyer ----------------------------------------------
+
+(define *lemmas* (make-hash-table 'eq?))
+
+(define (add-lemma! lemma)              ; (equal lhs rhs)
+  (let1 key (car (cadr lemma))
+    (hash-table-put! *lemmas* key
+                     (append (hash-table-get *lemmas* key '()) (list lemma)))))
+
+(for-each
+ add-lemma!
+ '((equal (and p q) (if p (if q (t) (f)) (f)))
+   (equal (or p q) (if p (t) (if q (t) (f))))
+   (equal (not p) (if p (f) (t)))
+   (equal (implies p q) (if p (if q (t) (f)) (t)))
+   (equal (if (if a b c) d e) (if a (if b d e) (if c d e)))
+   (equal (zerop x) (or (equal x (zero)) (not (numberp x))))
+   (equal (fix x) (if (numberp x) x (zero)))
+   (equal (eqp x y) (equal (fix x) (fix y)))
+   (equal (plus (plus x y) z) (plus x (plus y z)))
+   (equal (equal (plus a b) (zero)) (and (zerop a) (zerop b)))
+   (equal (difference x x) (zero))
+   (equal (equal (plus a b) (plus a c)) (equal (fix b) (fix c)))
+   (equal (times x (plus y z)) (plus (times x y) (times x z)))
+   (equal (times (times x y) z) (times x (times y z)))
+   (equal (equal (times x y) (zero)) (or (zerop x) (zerop y)))
+   (equal (append (append x y) z) (append x (append y z)))
+   (equal (reverse (append a b)) (append (reverse b) (reverse a)))
+   (equal (length (reverse x)) (length x))
+   (equal (member x (append a b)) (or (member x a) (member x b)))
+   (equal (member x (reverse y)) (member x y))
+   (equal (lessp (remainder x y) y) (not (zerop y)))
+   (equal (remainder x x) (zero))
+   (equal (lessp (plus x y) (plus x z)) (lessp y z))
+   (equal (equal (difference x y) (difference z y))
+          (if (lessp x y) (not (lessp y z))
+              (if (lessp z y) (not (lessp y x))
+                  (equal (fix x) (fix z)))))))
+
+(define *unify-subst* '())
+
+(define (one-way-unify term1 term2)
+  (set! *unify-subst* '())
+  (one-way-unify1 term1 term2))
+
+(define (one-way-unify1 term1 term2)
+  (cond [(not (pair? term2))
+         (cond [(assq term2 *unify-subst*) => (^p (equal? term1 (cdr p)))]
+               [else (push! *unify-subst* (cons term2 term1)) #t])]
+        [(not (pair? term1)) #f]
+        [(eq? (car term1) (car term2))
+         (one-way-unify1-list (cdr term1) (cdr term2))]
+        [else #f]))
+
+(define (one-way-unify1-list l1 l2)
+  (cond [(null? l1) (null? l2)]
+        [(null? l2) #f]
+        [(one-way-unify1 (car l1) (car l2))
+         (one-way-unify1-list (cdr l1) (cdr l2))]
+        [else #f]))
+
+(define (apply-subst alist term)
+  (if (pair? term)
+    (cons (car term) (map (cut apply-subst alist <>) (cdr term)))
+    (cond [(assq term alist) => cdr]
+          [else term])))
+
+(define (rewrite term)
+  (if (pair? term)
+    (rewrite-with-lemmas (cons (car term) (map rewrite (cdr term)))
+                         (hash-table-get *lemmas* (car term) '()))
+    term))
+
+(define (rewrite-with-lemmas term lemmas)
+  (cond [(null? lemmas) term]
+        [(one-way-unify term (cadr (car lemmas)))
+         (rewrite (apply-subst *unify-subst* (caddr (car lemmas))))]
+        [else (rewrite-with-lemmas term (cdr lemmas))]))
+
+(define (truep x lst) (or (equal? x '(t)) (member x lst)))
+(define (falsep x lst) (or (equal? x '(f)) (member x lst)))
+
+(define (tautologyp x true-lst false-lst)
+  (cond [(truep x true-lst) #t]
+        [(falsep x false-lst) #f]
+        [(not (pair? x)) #f]
+        [(eq? (car x) 'if)
+         (match-let1 (_ test then els) x
+           (cond [(truep test true-lst) (tautologyp then true-lst false-lst)]
+                 [(falsep test false-lst) (tautologyp els true-lst false-lst)]
+                 [else (and (tautologyp then (cons test true-lst) false-lst)
+                            (tautologyp els true-lst
+                                        (cons test false-lst)))]))]
+        [else #f]))
+
+(define (boyer)
+  (let1 term (apply-subst
+              '((x f (plus (plus a b) (plus c (zero))))
+                (y f (times (times a b) (plus c d)))
+                (z f (reverse (append (append a b) (nil))))
+                (u equal (plus a b) (difference x y))
+                (w lessp (remainder a b) (member a (length b))))
+              '(implies (and (implies x y)
+                             (and (implies y z)
+                                  (and (implies z u)
+                                       (implies u w))))
+                        (implies x w)))
+    (tautologyp (rewrite term) '() '())))
+
+;; earley ---------------------------------------------
+
+;; A chart parser for a grammar given as ((<lhs> <rhs> ...) ...).
+;; Returns the total number of items in the chart.
+(define (earley grammar start input)
+  (let* ([n (vector-length input)]
+         [chart (make-vector (+ n 1) '())]
+         [pending (make-vector (+ n 1) '())]
+         [seen (make-vector (+ n 1) #f)])
+    (define (add! i item)
+      (unless (hash-table-get (vector-ref seen i) item #f)
+        (hash-table-put! (vector-ref seen i) item #t)
+        (vector-set! chart i (cons item (vector-ref chart i)))
+        (vector-set! pending i (cons item (vector-ref pending i)))))
+    (define (nonterminal? sym) (assq sym grammar))
+    (dotimes [i (+ n 1)]
+      (vector-set! seen i (make-hash-table 'equal?)))
+    (dolist [r grammar]
+      (when (eq? (car r) start) (add! 0 (list r 0 0))))
+    (dotimes [i (+ n 1)]
+      (let loop ()
+        (unless (null? (vector-ref pending i))
+          (match-let1 (rule dot origin) (car (vector-ref pending i))
+            (vector-set! pending i (cdr (vector-ref pending i)))
+            (let1 rest (list-tail (cdr rule) dot)
+              (cond
+               [(null? rest)            ;complete
+                ;; NB: the grammar has no empty rules, so origin < i.
+                (dolist [item (vector-ref chart origin)]
+                  (match-let1 (r d o) item
+                    (let1 rest2 (list-tail (cdr r) d)
+                      (when (and (pair? rest2) (eq? (car rest2) (car rule)))
+                        (add! i (list r (+ d 1) o))))))]
+               [(nonterminal? (car rest)) ;predict
+                (dolist [r grammar]
+                  (when (eq? (car r) (car rest)) (add! i (list r 0 i))))]
+               [(and (< i n) (eq? (car rest) (vector-ref input i))) ;scan
+                (add! (+ i 1) (list rule (+ dot 1) origin))])))
+          (loop))))
+    (fold (^[items sum] (+ (length items) sum)) 0 (vector->list chart))))
+
+(define *earley-grammar* '((s a) (s s s)))
+(define *earley-input* (make-vector 20 'a))
+
+;; ----------------------------------------------------
+
+(define benchmarks
+  `((fib    . ,(^[] (fib 25)))
+    (tak    . ,(^[] (tak 18 12 6)))
+    (boyer  . ,(^[] (boyer)))
+    (earley . ,(^[] (earley *earley-grammar* 's *earley-input*)))))
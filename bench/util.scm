@@ -0,0 +1,26 @@
+;;
+;; bench/util.scm - common utilities for the benchmark suites
+;;
+
+(define-module bench.util
+  (export make-lcg random-list random-string))
+(select-module bench.util)
+
+;; We don't use srfi-27, so that the workloads are the same across
+;; builds and platforms.  A plain linear congruential generator is
+;; enough for making test data.
+(define (make-lcg seed)
+  (let1 x seed
+    (^[range]
+      (set! x (modulo (+ (* x 1103515245) 12345) 2147483648))
+      (modulo (quotient x 65536) range))))
+
+(define (random-list n range :optional (seed 1))
+  (let1 rand (make-lcg seed)
+    (list-tabulate n (^_ (rand range)))))
+
+(define (random-string len rand)
+  (let1 s (make-string len)
+    (dotimes [i len]
+      (string-set! s i (integer->char (+ 97 (rand 26)))))
+    s))
@@ -527,3 +527,97 @@ void Scm_PutBinaryF64(ScmUVector *uv, int off, ScmObj val, ScmSymbol *e)
     SWAP_D(e, v);
     inject(uv, v.buf, off, 8);
 }
+
+/*===========================================================
+ * Bulk access
+ */
+
+/* Converts N elements of uvector type KLASS in BUF between the native
+   byte order and ENDIAN, in place.  The loops are simple enough for
+   the compiler to vectorize. */
+static void swap_elements(char *buf, ScmClass *klass, long n,
+                          ScmSymbol *endian)
+{
+    char tmp;
+
+    switch (Scm_UVectorElementSize(klass)) {
+    case 2:
+        if (!SWAP_REQUIRED(endian)) return;
+        for (; n > 0; n--, buf += 2) {
+            CSWAP(buf, tmp, 0, 1);
+        }
+        break;
+    case 4:
+        if (!SWAP_REQUIRED(endian)) return;
+        for (; n > 0; n--, buf += 4) {
+            CSWAP(buf, tmp, 0, 3); CSWAP(buf, tmp, 1, 2);
+        }
+        break;
+    case 8:
+        if (Scm_UVectorType(klass) == SCM_UVECTOR_F64) {
+            /* double may have arm-little-endian representation */
+            for (; n > 0; n--, buf += 8) {
+                swap_f64_t v;
+                memcpy(v.buf, buf, 8);
+                SWAP_D(endian, v);
+                memcpy(buf, v.buf, 8);
+            }
+        } else {
+            if (!SWAP_REQUIRED(endian)) return;
+            for (; n > 0; n--, buf += 8) {
+                CSWAP(buf, tmp, 0, 7); CSWAP(buf, tmp, 1, 6);
+                CSWAP(buf, tmp, 2, 5); CSWAP(buf, tmp, 3, 4);
+            }
+        }
+        break;
+    }
+}
+
+/* Returns a fresh uvector of KLASS that holds COUNT elements taken from
+   the bytes of UV beginning at OFF.  If COUNT is negative, takes as many
+   elements as fit. */
+ScmObj Scm_GetBinaryUVector(ScmClass *klass, ScmUVector *uv, int off,
+                            int count, ScmSymbol *endian)
+{
+    int size = Scm_UVectorSizeInBytes(uv), eltsize;
+    ScmObj r;
+
+    CHECK_ENDIAN(endian);
+    if (!Scm_SubtypeP(klass, SCM_CLASS_UVECTOR)) {
+        Scm_TypeError("class", "uniform vector class", SCM_OBJ(klass));
+    }
+    eltsize = Scm_UVectorElementSize(klass);
+    if (off < 0 || off > size) {
+        Scm_Error("offset %d is out of bound of the uvector.", off);
+    }
+    if (count < 0) count = (size - off) / eltsize;
+    if ((long)count * eltsize > size - off) {
+        Scm_Error("%d elements from offset %d don't fit in the uvector.",
+                  count, off);
+    }
+    r = Scm_MakeUVector(klass, count, NULL);
+    memcpy(SCM_UVECTOR_ELEMENTS(r),
+           (char*)SCM_UVECTOR_ELEMENTS(uv) + off, (size_t)count * eltsize);
+    swap_elements((char*)SCM_UVECTOR_ELEMENTS(r), klass, count, endian);
+    return r;
+}
+
+/* Stores all the elements of SRC into the bytes of UV beginning
+   at OFF. */
+void Scm_PutBinaryUVector(ScmUVector *uv, int off, ScmUVector *src,
+                          ScmSymbol *endian)
+{
+    int size = Scm_UVectorSizeInBytes(uv);
+    int nbytes = Scm_UVectorSizeInBytes(src);
+    char *d = (char*)SCM_UVECTOR_ELEMENTS(uv) + off;
+
+    SCM_UVECTOR_CHECK_MUTABLE(SCM_OBJ(uv));
+    CHECK_ENDIAN(endian);
+    if (off < 0 || off > size || nbytes > size - off) {
+        Scm_Error("%d bytes from offset %d don't fit in the uvector.",
+                  nbytes, off);
+    }
+    memmove(d, SCM_UVECTOR_ELEMENTS(src), nbytes);
+    swap_elements(d, Scm_ClassOf(SCM_OBJ(src)), SCM_UVECTOR_SIZE(src),
+                  endian);
+}
@@ -81,3 +81,8 @@ extern void Scm_PutBinaryS64(ScmUVector *uv, int off, ScmObj v, ScmSymbol *e);
 extern void Scm_PutBinaryF16(ScmUVector *uv, int off, ScmObj v, ScmSymbol *e);
 extern void Scm_PutBinaryF32(ScmUVector *uv, int off, ScmObj v, ScmSymbol *e);
 extern void Scm_PutBinaryF64(ScmUVector *uv, int off, ScmObj v, ScmSymbol *e);
+
+extern ScmObj Scm_GetBinaryUVector(ScmClass *klass, ScmUVector *uv, int off,
+                                   int count, ScmSymbol *e);
+extern void Scm_PutBinaryUVector(ScmUVector *uv, int off, ScmUVector *src,
+                                 ScmSymbol *e);
@@ -33,6 +33,7 @@
           put-u16be! put-u16le! put-u32be! put-u32le! put-u64be! put-u64le!
           put-s16be! put-s16le! put-s32be! put-s32le! put-s64be! put-s64le!
           put-f16be! put-f16le! put-f32be! put-f32le! put-f64be! put-f64le!
+          get-uvector put-uvector!
 
           ;; old names
           read-binary-uint
@@ -379,6 +380,15 @@
    (v::<uvector> off::<uint> val :optional (endian::<symbol>? #f))
    ::<void> Scm_PutBinaryF64)
 
+ ;; bulk version of get-* and put-*!
+ (define-cproc get-uvector
+   (klass::<class> v::<uvector> off::<uint>
+    :optional (count::<fixnum> -1) (endian::<symbol>? #f))
+   Scm_GetBinaryUVector)
+ (define-cproc put-uvector!
+   (v::<uvector> off::<uint> src::<uvector> :optional (endian::<symbol>? #f))
+   ::<void> Scm_PutBinaryUVector)
+
  (define-cproc get-u16be (v::<uvector> off::<uint>)
    (return (Scm_GetBinaryU16 v off (SCM_SYMBOL SCM_SYM_BIG_ENDIAN))))
  (define-cproc get-u16le (v::<uvector> off::<uint>)
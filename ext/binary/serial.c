@@ -0,0 +1,777 @@
+/*
+ * serial.c - compact binary encoding of Scheme data
+ *
+ *   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "serial.h"
+#include "gauche/priv/portP.h"
+#include <gauche/bytes_inline.h>
+#include <gauche/class.h>
+
+static ScmObj proc_make = SCM_UNDEFINED;
+static ScmObj proc_slot_ref = SCM_UNDEFINED;
+static ScmObj proc_slot_set = SCM_UNDEFINED;
+static ScmObj proc_slot_bound_p = SCM_UNDEFINED;
+static ScmObj proc_slot_exists_p = SCM_UNDEFINED;
+
+static void bind_procs(void)
+{
+    SCM_BIND_PROC(proc_make, "make", Scm_GaucheModule());
+    SCM_BIND_PROC(proc_slot_ref, "slot-ref", Scm_GaucheModule());
+    SCM_BIND_PROC(proc_slot_set, "slot-set!", Scm_GaucheModule());
+    SCM_BIND_PROC(proc_slot_bound_p, "slot-bound?", Scm_GaucheModule());
+    SCM_BIND_PROC(proc_slot_exists_p, "slot-exists?", Scm_GaucheModule());
+}
+
+/* Converts N elements of ESIZE bytes each between the native byte
+   order and little endian, in place.  The conversion is symmetric. */
+static void swap_elements(char *p, long n, int esize, int doublep)
+{
+#if WORDS_BIGENDIAN
+    for (long i = 0; i < n; i++, p += esize) {
+        for (int j = 0; j < esize/2; j++) {
+            char t = p[j]; p[j] = p[esize-j-1]; p[esize-j-1] = t;
+        }
+    }
+#elif defined(DOUBLE_ARMENDIAN)
+    if (doublep) {
+        for (long i = 0; i < n; i++, p += 8) {
+            swap_f64_t v;
+            memcpy(v.buf, p, 8);
+            SWAP_ARM2LE(v);
+            memcpy(p, v.buf, 8);
+        }
+    }
+#endif
+}
+
+static ScmClass *uvector_class(int type)
+{
+    switch (type) {
+    case SCM_UVECTOR_S8:  return SCM_CLASS_S8VECTOR;
+    case SCM_UVECTOR_U8:  return SCM_CLASS_U8VECTOR;
+    case SCM_UVECTOR_S16: return SCM_CLASS_S16VECTOR;
+    case SCM_UVECTOR_U16: return SCM_CLASS_U16VECTOR;
+    case SCM_UVECTOR_S32: return SCM_CLASS_S32VECTOR;
+    case SCM_UVECTOR_U32: return SCM_CLASS_U32VECTOR;
+    case SCM_UVECTOR_S64: return SCM_CLASS_S64VECTOR;
+    case SCM_UVECTOR_U64: return SCM_CLASS_U64VECTOR;
+    case SCM_UVECTOR_F16: return SCM_CLASS_F16VECTOR;
+    case SCM_UVECTOR_F32: return SCM_CLASS_F32VECTOR;
+    case SCM_UVECTOR_F64: return SCM_CLASS_F64VECTOR;
+    default: return NULL;
+    }
+}
+
+/* Objects that can be labelled.  Symbols and keywords are handled
+   by the symbol table instead. */
+static inline int shareable_p(ScmObj obj)
+{
+    return (SCM_PAIRP(obj) || SCM_VECTORP(obj) || SCM_STRINGP(obj)
+            || SCM_UVECTORP(obj) || SCM_HASH_TABLE_P(obj)
+            || SCM_ISA(obj, SCM_CLASS_OBJECT));
+}
+
+/*================================================================
+ * Writer
+ *
+ *  The writer makes two passes.  The first pass finds the objects
+ *  referenced more than once, and the second pass emits the bytes.
+ *  In the `shared' table, the value is 1 if the object is seen once,
+ *  2 if it is seen more than once, and 3+N after it is emitted
+ *  with the label N.
+ */
+
+#define WRITER_BUFSIZ 4096
+
+typedef struct SerialWriterRec {
+    ScmPort *port;
+    ScmObj slots_proc;
+    ScmHashCore shared;
+    ScmHashCore symbols;        /* symbol or keyword -> index */
+    ScmHashCore classes;        /* class -> (index . slot-names) */
+    long nlabels;
+    long nsymbols;
+    long nclasses;
+    int bufcnt;
+    char buf[WRITER_BUFSIZ];
+} SerialWriter;
+
+static void flush_buf(SerialWriter *w)
+{
+    if (w->bufcnt > 0) Scm_Putz(w->buf, w->bufcnt, w->port);
+    w->bufcnt = 0;
+}
+
+static inline void put_byte(SerialWriter *w, int b)
+{
+    if (w->bufcnt >= WRITER_BUFSIZ) flush_buf(w);
+    w->buf[w->bufcnt++] = (char)b;
+}
+
+static void put_bytes(SerialWriter *w, const char *p, long size)
+{
+    if (w->bufcnt + size > WRITER_BUFSIZ) {
+        flush_buf(w);
+        if (size > WRITER_BUFSIZ) {
+            Scm_Putz(p, (int)size, w->port);
+            return;
+        }
+    }
+    memcpy(w->buf + w->bufcnt, p, size);
+    w->bufcnt += (int)size;
+}
+
+static void put_varint(SerialWriter *w, u_long v)
+{
+    while (v >= 0x80) {
+        put_byte(w, (int)((v & 0x7f) | 0x80));
+        v >>= 7;
+    }
+    put_byte(w, (int)v);
+}
+
+static void put_double(SerialWriter *w, double d)
+{
+    swap_f64_t v;
+    v.val = d;
+    swap_elements(v.buf, 1, 8, TRUE);
+    put_bytes(w, v.buf, 8);
+}
+
+static void put_string_body(SerialWriter *w, ScmString *s)
+{
+    u_int size;
+    const char *p = Scm_GetStringContent(s, &size, NULL, NULL);
+    put_varint(w, size);
+    put_bytes(w, p, size);
+}
+
+/* Returns (index . slot-names), registering the class if needed.
+   *NEWP is set to TRUE if it's the first time. */
+static ScmObj class_info(SerialWriter *w, ScmObj obj, int *newp)
+{
+    ScmClass *klass = Scm_ClassOf(obj);
+    ScmDictEntry *e = Scm_HashCoreSearch(&w->classes, (intptr_t)klass,
+                                         SCM_DICT_GET);
+    if (e) {
+        if (newp) *newp = FALSE;
+        return SCM_DICT_VALUE(e);
+    }
+    ScmObj slots = Scm_ApplyRec1(w->slots_proc, obj);
+    if (Scm_Length(slots) < 0) {
+        Scm_Error("slot list must be a list of symbols, but got %S", slots);
+    }
+    ScmObj info = Scm_Cons(SCM_MAKE_INT(w->nclasses++), slots);
+    e = Scm_HashCoreSearch(&w->classes, (intptr_t)klass, SCM_DICT_CREATE);
+    (void)SCM_DICT_SET_VALUE(e, info);
+    if (newp) *newp = TRUE;
+    return info;
+}
+
+static void walk(SerialWriter *w, ScmObj obj)
+{
+    for (;;) {
+        if (!SCM_PTRP(obj) || !shareable_p(obj)) return;
+        ScmDictEntry *e = Scm_HashCoreSearch(&w->shared, (intptr_t)obj,
+                                             SCM_DICT_CREATE);
+        if (e->value) {
+            e->value = 2;
+            return;
+        }
+        e->value = 1;
+
+        if (SCM_PAIRP(obj)) {
+            walk(w, SCM_CAR(obj));
+            obj = SCM_CDR(obj);
+        } else if (SCM_VECTORP(obj)) {
+            ScmSmallInt n = SCM_VECTOR_SIZE(obj);
+            if (n == 0) return;
+            for (ScmSmallInt i = 0; i < n-1; i++) {
+                walk(w, SCM_VECTOR_ELEMENT(obj, i));
+            }
+            obj = SCM_VECTOR_ELEMENT(obj, n-1);
+        } else if (SCM_HASH_TABLE_P(obj)) {
+            ScmHashIter iter;
+            ScmDictEntry *he;
+            Scm_HashIterInit(&iter, SCM_HASH_TABLE_CORE(obj));
+            while ((he = Scm_HashIterNext(&iter)) != NULL) {
+                walk(w, SCM_DICT_KEY(he));
+                walk(w, SCM_DICT_VALUE(he));
+            }
+            return;
+        } else if (SCM_ISA(obj, SCM_CLASS_OBJECT)) {
+            ScmObj cp;
+            SCM_FOR_EACH(cp, SCM_CDR(class_info(w, obj, NULL))) {
+                ScmObj s = SCM_CAR(cp);
+                if (!SCM_FALSEP(Scm_ApplyRec2(proc_slot_bound_p, obj, s))) {
+                    walk(w, Scm_ApplyRec2(proc_slot_ref, obj, s));
+                }
+            }
+            return;
+        } else {
+            return;             /* strings and uvectors */
+        }
+    }
+}
+
+static inline int shared_p(SerialWriter *w, ScmObj obj)
+{
+    ScmDictEntry *e = Scm_HashCoreSearch(&w->shared, (intptr_t)obj,
+                                         SCM_DICT_GET);
+    return (e && e->value >= 2);
+}
+
+static void encode(SerialWriter *w, ScmObj obj);
+
+static void encode_symbol(SerialWriter *w, ScmObj obj)
+{
+    ScmDictEntry *e = Scm_HashCoreSearch(&w->symbols, (intptr_t)obj,
+                                         SCM_DICT_CREATE);
+    if (e->value) {
+        put_byte(w, SERIAL_SYMREF);
+        put_varint(w, (u_long)(e->value - 1));
+        return;
+    }
+    e->value = ++w->nsymbols;   /* index + 1 */
+    if (SCM_KEYWORDP(obj)) {
+        put_byte(w, SERIAL_KEYWORD);
+        put_string_body(w, SCM_KEYWORD_NAME(obj));
+    } else {
+        put_byte(w, SCM_SYMBOL_INTERNED(obj)? SERIAL_SYMBOL : SERIAL_USYMBOL);
+        put_string_body(w, SCM_SYMBOL_NAME(obj));
+    }
+}
+
+static void encode_number(SerialWriter *w, ScmObj obj)
+{
+    if (SCM_INTP(obj)) {
+        long v = SCM_INT_VALUE(obj);
+        put_byte(w, SERIAL_FIXNUM);
+        put_varint(w, ((u_long)v << 1) ^ (u_long)(v >> (SIZEOF_LONG*8-1)));
+    } else if (SCM_BIGNUMP(obj)) {
+        put_byte(w, SERIAL_BIGNUM);
+        put_string_body(w, SCM_STRING(Scm_NumberToString(obj, 16, 0)));
+    } else if (SCM_FLONUMP(obj)) {
+        put_byte(w, SERIAL_FLONUM);
+        put_double(w, SCM_FLONUM_VALUE(obj));
+    } else if (SCM_RATNUMP(obj)) {
+        put_byte(w, SERIAL_RATNUM);
+        encode_number(w, SCM_RATNUM_NUMER(obj));
+        encode_number(w, SCM_RATNUM_DENOM(obj));
+    } else if (SCM_COMPNUMP(obj)) {
+        put_byte(w, SERIAL_COMPNUM);
+        put_double(w, SCM_COMPNUM_REAL(obj));
+        put_double(w, SCM_COMPNUM_IMAG(obj));
+    } else {
+        Scm_Error("unserializable number: %S", obj);
+    }
+}
+
+static void encode_instance(SerialWriter *w, ScmObj obj)
+{
+    int newp;
+    ScmObj info = class_info(w, obj, &newp);
+    ScmObj cp;
+
+    put_byte(w, SERIAL_INSTANCE);
+    if (newp) {
+        ScmClass *klass = Scm_ClassOf(obj);
+        ScmObj mod = SCM_PAIRP(klass->modules)
+            ? SCM_MODULE(SCM_CAR(klass->modules))->name : SCM_FALSE;
+        if (!SCM_SYMBOLP(klass->name)) {
+            Scm_Error("can't serialize an instance of an anonymous class: %S",
+                      obj);
+        }
+        put_byte(w, SERIAL_CLASS);
+        encode(w, mod);
+        encode(w, klass->name);
+        put_varint(w, (u_long)Scm_Length(SCM_CDR(info)));
+        SCM_FOR_EACH(cp, SCM_CDR(info)) {
+            if (!SCM_SYMBOLP(SCM_CAR(cp))) {
+                Scm_Error("slot name must be a symbol, but got %S",
+                          SCM_CAR(cp));
+            }
+            encode(w, SCM_CAR(cp));
+        }
+    } else {
+        put_byte(w, SERIAL_CLASSREF);
+        put_varint(w, (u_long)SCM_INT_VALUE(SCM_CAR(info)));
+    }
+    SCM_FOR_EACH(cp, SCM_CDR(info)) {
+        ScmObj s = SCM_CAR(cp);
+        if (SCM_FALSEP(Scm_ApplyRec2(proc_slot_bound_p, obj, s))) {
+            put_byte(w, SERIAL_UNBOUND);
+        } else {
+            encode(w, Scm_ApplyRec2(proc_slot_ref, obj, s));
+        }
+    }
+}
+
+static void encode(SerialWriter *w, ScmObj obj)
+{
+  again:
+    if (SCM_PTRP(obj) && shareable_p(obj)) {
+        ScmDictEntry *e = Scm_HashCoreSearch(&w->shared, (intptr_t)obj,
+                                             SCM_DICT_GET);
+        if (e) {
+            if (e->value >= 3) {
+                put_byte(w, SERIAL_REF);
+                put_varint(w, (u_long)(e->value - 3));
+                return;
+            }
+            if (e->value == 2) {
+                e->value = 3 + w->nlabels++;
+                put_byte(w, SERIAL_LABEL);
+            }
+        }
+    }
+
+    if (SCM_NULLP(obj))        put_byte(w, SERIAL_NIL);
+    else if (SCM_FALSEP(obj))  put_byte(w, SERIAL_FALSE);
+    else if (SCM_TRUEP(obj))   put_byte(w, SERIAL_TRUE);
+    else if (SCM_EOFP(obj))    put_byte(w, SERIAL_EOF);
+    else if (SCM_UNDEFINEDP(obj)) put_byte(w, SERIAL_UNDEFINED);
+    else if (SCM_CHARP(obj)) {
+        put_byte(w, SERIAL_CHAR);
+        put_varint(w, (u_long)SCM_CHAR_VALUE(obj));
+    }
+    else if (SCM_NUMBERP(obj)) encode_number(w, obj);
+    else if (SCM_SYMBOLP(obj) || SCM_KEYWORDP(obj)) encode_symbol(w, obj);
+    else if (SCM_STRINGP(obj)) {
+        put_byte(w, SCM_STRING_INCOMPLETE_P(obj)? SERIAL_ISTRING:SERIAL_STRING);
+        put_string_body(w, SCM_STRING(obj));
+    }
+    else if (SCM_PAIRP(obj)) {
+        /* A run of pairs that aren't referenced from elsewhere is
+           emitted as a list.  The tail is emitted in the next round,
+           so that a long list doesn't consume the C stack. */
+        long n = 1;
+        ScmObj p = SCM_CDR(obj);
+        while (SCM_PAIRP(p) && !shared_p(w, p)) {
+            n++;
+            p = SCM_CDR(p);
+        }
+        put_byte(w, SERIAL_LIST);
+        put_varint(w, (u_long)n);
+        for (p = obj; n > 0; n--, p = SCM_CDR(p)) {
+            if (!SCM_PAIRP(p)) Scm_Error("list modified while serialized");
+            encode(w, SCM_CAR(p));
+        }
+        obj = p;
+        goto again;
+    }
+    else if (SCM_VECTORP(obj)) {
+        ScmSmallInt n = SCM_VECTOR_SIZE(obj);
+        put_byte(w, SERIAL_VECTOR);
+        put_varint(w, (u_long)n);
+        for (ScmSmallInt i = 0; i < n; i++) {
+            encode(w, SCM_VECTOR_ELEMENT(obj, i));
+        }
+    }
+    else if (SCM_UVECTORP(obj)) {
+        ScmClass *klass = Scm_ClassOf(obj);
+        int type = Scm_UVectorType(klass);
+        int esize = Scm_UVectorElementSize(klass);
+        ScmSmallInt n = SCM_UVECTOR_SIZE(obj);
+        put_byte(w, SERIAL_UVECTOR);
+        put_byte(w, type);
+        put_varint(w, (u_long)n);
+#if WORDS_BIGENDIAN || defined(DOUBLE_ARMENDIAN)
+        if (esize > 1) {
+            char *tmp = SCM_NEW_ATOMIC2(char*, n * esize);
+            memcpy(tmp, SCM_UVECTOR_ELEMENTS(obj), n * esize);
+            swap_elements(tmp, n, esize, type == SCM_UVECTOR_F64);
+            put_bytes(w, tmp, n * esize);
+        } else
+#endif
+        put_bytes(w, (const char*)SCM_UVECTOR_ELEMENTS(obj), n * esize);
+    }
+    else if (SCM_HASH_TABLE_P(obj)) {
+        ScmHashType type = Scm_HashTableType(SCM_HASH_TABLE(obj));
+        ScmHashIter iter;
+        ScmDictEntry *he;
+        if (type != SCM_HASH_EQ && type != SCM_HASH_EQV
+            && type != SCM_HASH_EQUAL && type != SCM_HASH_STRING) {
+            Scm_Error("can't serialize a hash table with a custom "
+                      "comparator: %S", obj);
+        }
+        put_byte(w, SERIAL_HASH_TABLE);
+        put_byte(w, type);
+        put_varint(w, (u_long)Scm_HashCoreNumEntries(SCM_HASH_TABLE_CORE(obj)));
+        Scm_HashIterInit(&iter, SCM_HASH_TABLE_CORE(obj));
+        while ((he = Scm_HashIterNext(&iter)) != NULL) {
+            encode(w, SCM_DICT_KEY(he));
+            encode(w, SCM_DICT_VALUE(he));
+        }
+    }
+    else if (SCM_ISA(obj, SCM_CLASS_OBJECT)) encode_instance(w, obj);
+    else Scm_Error("unserializable object: %S", obj);
+}
+
+void Scm_WriteBinaryDatum(ScmObj obj, ScmPort *port, ScmObj slots_proc)
+{
+    SerialWriter *w = SCM_NEW(SerialWriter);
+
+    bind_procs();
+    w->port = port;
+    w->slots_proc = slots_proc;
+    Scm_HashCoreInitSimple(&w->shared, SCM_HASH_EQ, 0, NULL);
+    Scm_HashCoreInitSimple(&w->symbols, SCM_HASH_EQ, 0, NULL);
+    Scm_HashCoreInitSimple(&w->classes, SCM_HASH_EQ, 0, NULL);
+    w->nlabels = w->nsymbols = w->nclasses = 0;
+    w->bufcnt = 0;
+
+    walk(w, obj);
+    encode(w, obj);
+    flush_buf(w);
+}
+
+/*================================================================
+ * Reader
+ *
+ *  The port is locked while we read a datum.  Labels are numbered
+ *  in the order they appear, and the slot for a label is reserved
+ *  before its object is read, so that a container can be referenced
+ *  from its elements.
+ */
+
+typedef struct SerialTableRec {
+    ScmObj *v;
+    long n;
+    long size;
+} SerialTable;
+
+typedef struct SerialReaderRec {
+    ScmPort *port;
+    SerialTable labels;
+    SerialTable symbols;
+    SerialTable classes;        /* (class . slot-names) */
+} SerialReader;
+
+static long table_add(SerialTable *t, ScmObj obj)
+{
+    if (t->n >= t->size) {
+        long newsize = (t->size == 0)? 16 : t->size * 2;
+        ScmObj *nv = SCM_NEW_ARRAY(ScmObj, newsize);
+        if (t->n > 0) memcpy(nv, t->v, t->n * sizeof(ScmObj));
+        t->v = nv;
+        t->size = newsize;
+    }
+    t->v[t->n] = obj;
+    return t->n++;
+}
+
+static ScmObj table_ref(SerialTable *t, u_long k, const char *what)
+{
+    if (k >= (u_long)t->n) Scm_Error("invalid %s reference: %lu", what, k);
+    return t->v[k];
+}
+
+static inline void set_label(SerialReader *r, long label, ScmObj obj)
+{
+    if (label >= 0) r->labels.v[label] = obj;
+}
+
+static int get_byte(SerialReader *r)
+{
+    int b = Scm_GetbUnsafe(r->port);
+    if (b == EOF) Scm_Error("premature end of binary datum: %S", r->port);
+    return b;
+}
+
+static void get_bytes(SerialReader *r, char *buf, long size)
+{
+    while (size > 0) {
+        int chunk = (size > INT_MAX)? INT_MAX : (int)size;
+        int n = Scm_GetzUnsafe(buf, chunk, r->port);
+        if (n <= 0) Scm_Error("premature end of binary datum: %S", r->port);
+        buf += n;
+        size -= n;
+    }
+}
+
+static u_long get_varint(SerialReader *r)
+{
+    u_long v = 0;
+    for (int shift = 0; ; shift += 7) {
+        int b = get_byte(r);
+        if (shift >= SIZEOF_LONG*8) Scm_Error("varint overflow");
+        v |= (u_long)(b & 0x7f) << shift;
+        if (!(b & 0x80)) return v;
+    }
+}
+
+static long get_count(SerialReader *r)
+{
+    u_long v = get_varint(r);
+    if (v > (u_long)SCM_SMALL_INT_MAX) Scm_Error("count too large: %lu", v);
+    return (long)v;
+}
+
+static double get_double(SerialReader *r)
+{
+    swap_f64_t v;
+    get_bytes(r, v.buf, 8);
+    swap_elements(v.buf, 1, 8, TRUE);
+    return v.val;
+}
+
+static ScmObj get_string_body(SerialReader *r, int flags)
+{
+    long size = get_count(r);
+    char *buf = SCM_NEW_ATOMIC2(char*, size+1);
+    get_bytes(r, buf, size);
+    buf[size] = '\0';
+    return Scm_MakeString(buf, size, -1, flags);
+}
+
+static ScmObj decode_tag(SerialReader *r, int tag, long label);
+
+static ScmObj decode(SerialReader *r)
+{
+    return decode_tag(r, get_byte(r), -1);
+}
+
+static ScmObj decode_symbol(SerialReader *r)
+{
+    ScmObj s = decode(r);
+    if (!SCM_SYMBOLP(s)) Scm_Error("symbol expected, but got %S", s);
+    return s;
+}
+
+static ScmObj decode_instance(SerialReader *r, long label)
+{
+    ScmObj info, obj, cp;
+    int tag = get_byte(r);
+
+    if (tag == SERIAL_CLASS) {
+        ScmObj modname = decode(r);
+        ScmObj name = decode_symbol(r);
+        long n = get_count(r);
+        ScmObj h = SCM_NIL, t = SCM_NIL, klass = SCM_FALSE;
+        for (long i = 0; i < n; i++) SCM_APPEND1(h, t, decode_symbol(r));
+        if (SCM_SYMBOLP(modname)) {
+            ScmModule *m = Scm_FindModule(SCM_SYMBOL(modname),
+                                          SCM_FIND_MODULE_QUIET);
+            if (m) klass = Scm_GlobalVariableRef(m, SCM_SYMBOL(name), 0);
+        }
+        if (!SCM_CLASSP(klass)) {
+            Scm_Error("can't find class %S in module %S", name, modname);
+        }
+        info = Scm_Cons(klass, h);
+        table_add(&r->classes, info);
+    } else if (tag == SERIAL_CLASSREF) {
+        info = table_ref(&r->classes, get_varint(r), "class");
+    } else {
+        Scm_Error("class expected, but got tag 0x%02x", tag);
+        info = SCM_UNDEFINED;   /* dummy */
+    }
+
+    obj = Scm_ApplyRec1(proc_make, SCM_CAR(info));
+    set_label(r, label, obj);
+    SCM_FOR_EACH(cp, SCM_CDR(info)) {
+        int vtag = get_byte(r);
+        if (vtag == SERIAL_UNBOUND) continue;
+        ScmObj v = decode_tag(r, vtag, -1);
+        /* The class may have been redefined. */
+        if (!SCM_FALSEP(Scm_ApplyRec2(proc_slot_exists_p, obj, SCM_CAR(cp)))) {
+            Scm_ApplyRec3(proc_slot_set, obj, SCM_CAR(cp), v);
+        }
+    }
+    return obj;
+}
+
+static ScmObj decode_list(SerialReader *r, long label)
+{
+    ScmObj head = SCM_NIL, last = SCM_NIL;
+
+    for (;;) {
+        long n = get_count(r);
+        if (n == 0) Scm_Error("invalid list length: 0");
+        ScmObj first = Scm_Cons(SCM_UNDEFINED, SCM_NIL), p = first;
+        for (long i = 1; i < n; i++) {
+            ScmObj q = Scm_Cons(SCM_UNDEFINED, SCM_NIL);
+            SCM_SET_CDR(p, q);
+            p = q;
+        }
+        if (SCM_NULLP(head)) head = first;
+        else SCM_SET_CDR(last, first);
+        last = p;
+        set_label(r, label, first);
+        for (p = first; SCM_PAIRP(p); p = SCM_CDR(p)) {
+            SCM_SET_CAR(p, decode(r));
+        }
+
+        /* The tail.  If it's another run, continue the loop. */
+        int tag = get_byte(r);
+        label = -1;
+        if (tag == SERIAL_LABEL) {
+            label = table_add(&r->labels, SCM_UNDEFINED);
+            tag = get_byte(r);
+        }
+        if (tag != SERIAL_LIST) {
+            SCM_SET_CDR(last, decode_tag(r, tag, label));
+            return head;
+        }
+    }
+}
+
+static ScmObj decode_tag(SerialReader *r, int tag, long label)
+{
+    ScmObj obj;
+
+    switch (tag) {
+    case SERIAL_NIL:       return SCM_NIL;
+    case SERIAL_FALSE:     return SCM_FALSE;
+    case SERIAL_TRUE:      return SCM_TRUE;
+    case SERIAL_EOF:       return SCM_EOF;
+    case SERIAL_UNDEFINED: return SCM_UNDEFINED;
+    case SERIAL_CHAR:      return SCM_MAKE_CHAR((ScmChar)get_varint(r));
+    case SERIAL_FIXNUM: {
+        u_long u = get_varint(r);
+        return Scm_MakeInteger((long)(u >> 1) ^ -(long)(u & 1));
+    }
+    case SERIAL_BIGNUM:
+        obj = Scm_StringToNumber(SCM_STRING(get_string_body(r, 0)), 16, 0);
+        if (!SCM_INTEGERP(obj)) Scm_Error("invalid bignum representation");
+        return obj;
+    case SERIAL_FLONUM:
+        return Scm_MakeFlonum(get_double(r));
+    case SERIAL_RATNUM: {
+        ScmObj n = decode(r);
+        ScmObj d = decode(r);
+        if (!SCM_INTEGERP(n) || !SCM_INTEGERP(d) || SCM_EQ(d, SCM_MAKE_INT(0))) {
+            Scm_Error("invalid rational representation");
+        }
+        return Scm_MakeRational(n, d);
+    }
+    case SERIAL_COMPNUM: {
+        double re = get_double(r);
+        double im = get_double(r);
+        return Scm_MakeComplex(re, im);
+    }
+    case SERIAL_STRING:
+    case SERIAL_ISTRING:
+        obj = get_string_body(r, (tag == SERIAL_ISTRING)?
+                              SCM_STRING_INCOMPLETE : 0);
+        set_label(r, label, obj);
+        return obj;
+    case SERIAL_SYMBOL:
+    case SERIAL_USYMBOL:
+    case SERIAL_KEYWORD: {
+        ScmString *name = SCM_STRING(get_string_body(r, 0));
+        if (tag == SERIAL_KEYWORD) obj = Scm_MakeKeyword(name);
+        else obj = Scm_MakeSymbol(name, tag == SERIAL_SYMBOL);
+        table_add(&r->symbols, obj);
+        return obj;
+    }
+    case SERIAL_SYMREF:
+        return table_ref(&r->symbols, get_varint(r), "symbol");
+    case SERIAL_LIST:
+        return decode_list(r, label);
+    case SERIAL_VECTOR: {
+        long n = get_count(r);
+        obj = Scm_MakeVector(n, SCM_FALSE);
+        set_label(r, label, obj);
+        for (long i = 0; i < n; i++) SCM_VECTOR_ELEMENT(obj, i) = decode(r);
+        return obj;
+    }
+    case SERIAL_UVECTOR: {
+        int type = get_byte(r);
+        ScmClass *klass = uvector_class(type);
+        if (klass == NULL) Scm_Error("invalid uvector type: %d", type);
+        long n = get_count(r);
+        int esize = Scm_UVectorElementSize(klass);
+        obj = Scm_MakeUVector(klass, n, NULL);
+        get_bytes(r, (char*)SCM_UVECTOR_ELEMENTS(obj), n * esize);
+        swap_elements((char*)SCM_UVECTOR_ELEMENTS(obj), n, esize,
+                      type == SCM_UVECTOR_F64);
+        set_label(r, label, obj);
+        return obj;
+    }
+    case SERIAL_HASH_TABLE: {
+        int type = get_byte(r);
+        if (type != SCM_HASH_EQ && type != SCM_HASH_EQV
+            && type != SCM_HASH_EQUAL && type != SCM_HASH_STRING) {
+            Scm_Error("invalid hash table type: %d", type);
+        }
+        long n = get_count(r);
+        obj = Scm_MakeHashTableSimple((ScmHashType)type, 0);
+        set_label(r, label, obj);
+        for (long i = 0; i < n; i++) {
+            ScmObj k = decode(r);
+            ScmObj v = decode(r);
+            Scm_HashTableSet(SCM_HASH_TABLE(obj), k, v, 0);
+        }
+        return obj;
+    }
+    case SERIAL_INSTANCE:
+        return decode_instance(r, label);
+    case SERIAL_LABEL:
+        if (label >= 0) Scm_Error("duplicate label");
+        label = table_add(&r->labels, SCM_UNDEFINED);
+        return decode_tag(r, get_byte(r), label);
+    case SERIAL_REF: {
+        obj = table_ref(&r->labels, get_varint(r), "label");
+        if (SCM_UNDEFINEDP(obj)) Scm_Error("reference to an incomplete object");
+        return obj;
+    }
+    default:
+        Scm_Error("invalid tag in binary datum: 0x%02x", tag);
+        return SCM_UNDEFINED;   /* dummy */
+    }
+}
+
+static ScmObj read_datum(SerialReader *r)
+{
+    int tag = Scm_GetbUnsafe(r->port);
+    if (tag == EOF) return SCM_EOF;
+    return decode_tag(r, tag, -1);
+}
+
+ScmObj Scm_ReadBinaryDatum(ScmPort *port)
+{
+    SerialReader r;
+    ScmVM *vm = Scm_VM();
+    ScmObj obj = SCM_UNDEFINED;
+
+    bind_procs();
+    r.port = port;
+    r.labels.v = r.symbols.v = r.classes.v = NULL;
+    r.labels.n = r.symbols.n = r.classes.n = 0;
+    r.labels.size = r.symbols.size = r.classes.size = 0;
+
+    PORT_LOCK(port, vm);
+    PORT_SAFE_CALL(port, obj = read_datum(&r), /*no cleanup*/);
+    PORT_UNLOCK(port);
+    return obj;
+}
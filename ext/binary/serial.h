@@ -0,0 +1,100 @@
+/*
+ * serial.h - compact binary encoding of Scheme data
+ *
+ *   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef GAUCHE_BINARY_SERIAL_H
+#define GAUCHE_BINARY_SERIAL_H
+
+#include <gauche.h>
+#include <gauche/extend.h>
+
+/* Each datum is encoded as a tag byte followed by its payload.
+   Counts, lengths and indices are unsigned LEB128 varints, and
+   fixnums are zigzag-encoded varints.  Multibyte numbers (flonums
+   and uvector elements) are little-endian.  Strings and symbol
+   names are in the native character encoding.
+
+   Objects referenced more than once within a datum (pairs, vectors,
+   strings, uvectors, hash tables and instances) are preceded by
+   a LABEL tag when they first appear, and later occurrences are
+   encoded as a REF to the label, so shared and circular structures
+   are preserved.  Symbols, keywords and classes get an index in
+   the tables when they first appear in a datum, and are referred
+   to by the index afterwards.
+
+   SLOTS_PROC is called with an instance, and returns the list of
+   the slot names to be serialized.  It is called once for each
+   class in a datum.  */
+
+enum {
+    SERIAL_NIL        = 0x00,
+    SERIAL_FALSE      = 0x01,
+    SERIAL_TRUE       = 0x02,
+    SERIAL_EOF        = 0x03,
+    SERIAL_UNDEFINED  = 0x04,
+    SERIAL_UNBOUND    = 0x05,   /* only as a slot value */
+    SERIAL_CHAR       = 0x08,   /* varint char code */
+
+    SERIAL_FIXNUM     = 0x10,   /* zigzag varint */
+    SERIAL_BIGNUM     = 0x11,   /* varint size, hexadecimal digits */
+    SERIAL_FLONUM     = 0x12,   /* 8 bytes */
+    SERIAL_RATNUM     = 0x13,   /* numerator, denominator */
+    SERIAL_COMPNUM    = 0x14,   /* 8 bytes real part, 8 bytes imaginary */
+
+    SERIAL_STRING     = 0x18,   /* varint size, bytes */
+    SERIAL_ISTRING    = 0x19,   /* incomplete string */
+
+    SERIAL_SYMBOL     = 0x20,   /* varint size, bytes */
+    SERIAL_USYMBOL    = 0x21,   /* uninterned symbol */
+    SERIAL_KEYWORD    = 0x22,
+    SERIAL_SYMREF     = 0x23,   /* varint index */
+
+    SERIAL_LIST       = 0x28,   /* varint count, elements, tail */
+    SERIAL_VECTOR     = 0x29,   /* varint count, elements */
+    SERIAL_UVECTOR    = 0x2a,   /* type byte, varint count, elements */
+    SERIAL_HASH_TABLE = 0x2b,   /* type byte, varint count, key+values */
+    SERIAL_INSTANCE   = 0x2c,   /* class, slot values */
+
+    SERIAL_CLASS      = 0x30,   /* module name, class name,
+                                   varint count, slot names */
+    SERIAL_CLASSREF   = 0x31,   /* varint index */
+
+    SERIAL_LABEL      = 0x38,   /* followed by the labelled object */
+    SERIAL_REF        = 0x39    /* varint label index */
+};
+
+extern void   Scm_WriteBinaryDatum(ScmObj obj, ScmPort *port,
+                                   ScmObj slots_proc);
+/* Returns EOF if the port is at the end. */
+extern ScmObj Scm_ReadBinaryDatum(ScmPort *port);
+
+#endif /*GAUCHE_BINARY_SERIAL_H*/
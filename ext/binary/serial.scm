@@ -0,0 +1,70 @@
+;;;
+;;; binary.serial - compact binary encoding of Scheme data
+;;;
+;;;   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+;;;
+;;;   Redistribution and use in source and binary forms, with or without
+;;;   modification, are permitted provided that the following conditions
+;;;   are met:
+;;;
+;;;   1. Redistributions of source code must retain the above copyright
+;;;      notice, this list of conditions and the following disclaimer.
+;;;
+;;;   2. Redistributions in binary form must reproduce the above copyright
+;;;      notice, this list of conditions and the following disclaimer in the
+;;;      documentation and/or other materials provided with the distribution.
+;;;
+;;;   3. Neither the name of the authors nor the names of its contributors
+;;;      may be used to endorse or promote products derived from this
+;;;      software without specific prior written permission.
+;;;
+;;;   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+;;;   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+;;;   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+;;;   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+;;;   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+;;;   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+;;;   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+;;;   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+;;;   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+;;;   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+;;;   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+;;;
+
+;; This module writes and reads Scheme data in a tagged, length-prefixed
+;; binary format.  Unlike write/read, shared and circular structures,
+;; hash tables, uvectors and instances of user-defined classes survive
+;; the round trip.  See serial.h for the details of the format.
+;;
+;; Each call of write-binary-datum produces a self-contained datum;
+;; labels, symbol table and class table aren't carried over to the
+;; next datum.
+
+(define-module binary.serial
+  (export write-binary-datum read-binary-datum))
+(select-module binary.serial)
+
+(inline-stub
+ (declcode "#include \"serial.h\"")
+
+ (define-cproc %write-binary-datum (obj port::<output-port> slots-proc)
+   ::<void>
+   (Scm_WriteBinaryDatum obj port slots-proc))
+
+ (define-cproc %read-binary-datum (port::<input-port>)
+   (return (Scm_ReadBinaryDatum port)))
+ )
+
+;; Default list of slots to be saved; same as get-serializable-slots
+;; in gauche.serializer.
+(define (default-slots obj)
+  (filter-map (^s (and (not (eqv? (slot-definition-allocation s) :virtual))
+                       (slot-definition-name s)))
+              (class-slots (class-of obj))))
+
+(define (write-binary-datum obj :optional (port (current-output-port))
+                                          (slots-proc default-slots))
+  (%write-binary-datum obj port slots-proc))
+
+(define (read-binary-datum :optional (port (current-input-port)))
+  (%read-binary-datum port))
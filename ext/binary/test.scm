@@ -534,6 +534,39 @@
          (put-f64! v 9 -1.0 'arm-little-endian)
          v))
 
+(test* "get-uvector u16 be" '#u16(#x0102 #x0304)
+       (get-uvector <u16vector> '#u8(0 1 2 3 4 5) 1 2 'big-endian))
+(test* "get-uvector u16 le" '#u16(#x0201 #x0403)
+       (get-uvector <u16vector> '#u8(0 1 2 3 4 5) 1 2 'little-endian))
+(test* "get-uvector s32 be, rest" '#s32(-2 #x01020304)
+       (get-uvector <s32vector> '#u8(0 255 255 255 254 1 2 3 4 5) 1 -1
+                    'big-endian))
+(test* "get-uvector u64 le" '#u64(#xf8f9fafbfcfdfeff)
+       (get-uvector <u64vector>
+                    '#u8(255 254 253 252 251 250 249 248) 0 1 'little-endian))
+(test* "get-uvector f64 arm" '#f64(1.0 -1.0)
+       (get-uvector <f64vector>
+                    '#u8(#x00 #x00 #xf0 #x3f #x00 #x00 #x00 #x00
+                         #x00 #x00 #xf0 #xbf #x00 #x00 #x00 #x00)
+                    0 2 'arm-little-endian))
+(test* "get-uvector out of range" (test-error)
+       (get-uvector <u32vector> '#u8(0 1 2 3 4 5) 4 1))
+
+(test* "put-uvector! u32 be" '#u8(0 1 2 3 4 252 253 254 255)
+       (let1 v (make-u8vector 9 0)
+         (put-uvector! v 1 '#u32(#x01020304 #xfcfdfeff) 'big-endian)
+         v))
+(test* "put-uvector! s16 le" '#u8(2 1 255 254 0)
+       (let1 v (make-u8vector 5 0)
+         (put-uvector! v 0 '#s16(#x0102 #x-0101) 'little-endian)
+         v))
+(test* "put-uvector! f32 be" '#u8(#x3f #x80 #x00 #x00 #xbf #x80 #x00 #x00)
+       (let1 v (make-u8vector 8 0)
+         (put-uvector! v 0 '#f32(1.0 -1.0) 'big-endian)
+         v))
+(test* "put-uvector! out of range" (test-error)
+       (put-uvector! (make-u8vector 7 0) 0 '#u32(1 2)))
+
 ;;----------------------------------------------------------
 (test-section "binary.ftype")
 
@@ -655,6 +688,59 @@
            (uvector-alias <u8vector> v 5)))
   )
 
+(test* "tail padding" '(8 4)
+       (let1 ft (make-fstruct-type 'ft `((a ,ftype:int32) (b ,ftype:int8))
+                                   #f #f)
+         (list (ftype-size ft) (ftype-alignment ft))))
+
+;; fixed endian and farray
+(define-fstruct-type ft4 #t #t
+  ((tag ftype:uint8)
+   (len ftype:uint16)
+   (val ftype:int32))
+  :endian 'big-endian)
+
+(test* "ft4 layout" '(8 0 2 4)
+       (list (ftype-size ft4)
+             (ftype:slot-position (cdr (assq 'tag (ftype:struct-slots ft4))))
+             (ftype:slot-position (cdr (assq 'len (ftype:struct-slots ft4))))
+             (ftype:slot-position (cdr (assq 'val (ftype:struct-slots ft4))))))
+
+(let1 v '#u8(0 0 0 0
+             1 0 0 2 255 255 255 254
+             2 0 1 0 0 0 1 0
+             3 0 0 3 0 0 0 3)
+  (test* "ft4 fixed endian accessors" '(1 2 -2)
+         (list (get-ft4-tag v 4) (get-ft4-len v 4) (get-ft4-val v 4)))
+  (test* "ft4 fixed endian, parameter ignored" '(256 256)
+         (parameterize ([default-endian 'little-endian])
+           (list (get-ft4-len v 12) (get-ft4-val v 12))))
+  (test* "ft4 via fobject" -2
+         (ft4-val (get-fobject ft4 v 4)))
+  (test* "farray-length" '(3 2)
+         (list (farray-length ft4 v 4) (farray-length ft4 v 12)))
+  (test* "farray-for-each" '((1 . 2) (2 . 256) (3 . 3))
+         (let1 r '()
+           (farray-for-each (^[uv pos]
+                              (push! r (cons (get-ft4-tag uv pos)
+                                             (get-ft4-len uv pos))))
+                            ft4 v 4)
+           (reverse r)))
+  (test* "farray-for-each count" '(1 2)
+         (let1 r '()
+           (farray-for-each (^[uv pos] (push! r (get-ft4-tag uv pos)))
+                            ft4 v 4 2)
+           (reverse r)))
+  (test* "farray-for-each too many" (test-error)
+         (farray-for-each (^[uv pos] #f) ft4 v 4 4)))
+
+(test* "ft4 put" '#u8(7 0 1 2 255 255 255 255)
+       (let1 v (make-u8vector 8 0)
+         (put-ft4-tag! v 0 7)
+         (put-ft4-len! v 0 #x0102)
+         (put-ft4-val! v 0 -1)
+         v))
+
 ;;----------------------------------------------------------
 (test-section "binary.pack")
 
@@ -943,4 +1029,131 @@
                   \x01\x01\x01\x01\
                   \x01\x01\x01\x01"))
 
+(test* "pack n3 N*" "\x00\x01\x00\x02\x00\x03\x00\x00\x01\x00"
+  (pack "n3 N*" '(1 2 3 256) :to-string? #t))
+
+(test* "unpack n3 N*" '(1 2 3 256 #x01020304)
+  (unpack "n3 N*" :from-string
+          #*"\x00\x01\x00\x02\x00\x03\x00\x00\x01\x00\x01\x02\x03\x04"))
+
+(test* "unpack v4, short input" `(1 2 ,(eof-object) ,(eof-object))
+  (unpack "v4" :from-string #*"\x01\x00\x02\x00\x03"))
+
+(test* "unpack many V*" (iota 10000)
+  (unpack "V*" :from-string (pack "V*" (iota 10000) :to-string? #t)))
+
+(test* "unpack-skip n2" '(3)
+  (call-with-input-string #*"\x00\x01\x00\x02\x03"
+    (^p (unpack-skip "n2" :input p)
+        (unpack "C" :input p))))
+
+;;----------------------------------------------------------
+(test-section "binary.serial")
+
+(use binary.serial)
+(test-module 'binary.serial)
+
+(define (serial-round-trip obj)
+  (read-binary-datum
+   (open-input-string
+    (call-with-output-string (cut write-binary-datum obj <>)))))
+
+(let ([data `(0 1 -1 ,(greatest-fixnum) ,(least-fixnum)
+              ,(expt 2 100) ,(- (expt 3 80)) 1/3 -22/7 3.14 -0.0 +inf.0
+              1+2i #\a #\null ,(integer->char 955)
+              #t #f () "" "abc"
+              #*"\xff\xfe" abc :key |a b|
+              (1 2 . 3) #(a #(b) ()) #u8(1 2 255) #s16(-1 2 -32768)
+              #u32(0 4294967295) #s64(-1) #f32(1.5 -2.0) #f64(1e300 -2.5)
+              ,(undefined) ,(eof-object))])
+  (test* "primitives" data (serial-round-trip data)))
+
+(test* "nan" #t (nan? (serial-round-trip +nan.0)))
+(test* "uninterned symbol" '(#f "foo" #t)
+       (let* ([s (string->uninterned-symbol "foo")]
+              [r (serial-round-trip (list s s))])
+         (list (symbol-interned? (car r))
+               (symbol->string (car r))
+               (eq? (car r) (cadr r)))))
+
+(test* "shared structure" '(#t #t #t #t)
+       (let* ([s (string-copy "shared")]
+              [v (vector s 1)]
+              [l (list 1 2 3)]
+              [r (serial-round-trip (list s v l s v (cdr l)))])
+         (list (eq? (list-ref r 0) (list-ref r 3))
+               (eq? (list-ref r 1) (list-ref r 4))
+               (eq? (vector-ref (list-ref r 1) 0) (list-ref r 0))
+               (eq? (cdr (list-ref r 2)) (list-ref r 5)))))
+
+(test* "circular list" '(1 2 3 1 2 3 #t)
+       (let* ([l (list 1 2 3)]
+              [_ (set-cdr! (cddr l) l)]
+              [r (serial-round-trip l)])
+         (append (take r 6) (list (eq? r (cdddr r))))))
+
+(test* "circular vector" #t
+       (let* ([v (vector 1 #f)]
+              [_ (vector-set! v 1 v)]
+              [r (serial-round-trip v)])
+         (eq? r (vector-ref r 1))))
+
+(test* "long list" 100000
+       (length (serial-round-trip (iota 100000))))
+
+(test* "hash table" '(eqv 3 (1 . a) ("b" . #(b)) ((c) . c))
+       (let* ([h (make-hash-table 'equal?)]
+              [_ (begin (hash-table-put! h 1 'a)
+                        (hash-table-put! h "b" #(b))
+                        (hash-table-put! h '(c) 'c))]
+              [r (serial-round-trip (list (make-hash-table 'eqv?) h))])
+         `(,(hash-table-type (car r))
+           ,(hash-table-num-entries (cadr r))
+           ,@(map (^k (cons k (hash-table-get (cadr r) k)))
+                  '(1 "b" (c))))))
+
+(define-class <serial-point> ()
+  ((x :init-keyword :x)
+   (y :init-keyword :y)
+   (z)
+   (norm :allocation :virtual
+         :slot-ref (^o (+ (slot-ref o 'x) (slot-ref o 'y)))
+         :slot-set! (^(o v) #f))))
+
+(test* "instances" '(3 4 #f #t)
+       (let* ([p (make <serial-point> :x 3 :y 4)]
+              [r (serial-round-trip (list p p))])
+         (list (slot-ref (car r) 'x)
+               (slot-ref (car r) 'y)
+               (slot-bound? (car r) 'z)
+               (eq? (car r) (cadr r)))))
+
+(test* "custom slots" '(3 #f)
+       (let* ([p (make <serial-point> :x 3 :y 4)]
+              [r (read-binary-datum
+                  (open-input-string
+                   (call-with-output-string
+                     (cut write-binary-datum p <> (^_ '(x))))))])
+         (list (slot-ref r 'x) (slot-bound? r 'y))))
+
+(test* "multiple data" '((a b) #(1) "x" #t)
+       (let* ([s (call-with-output-string
+                   (^p (write-binary-datum '(a b) p)
+                       (write-binary-datum '#(1) p)
+                       (write-binary-datum "x" p)))]
+              [in (open-input-string s)])
+         (let* ([a (read-binary-datum in)]
+                [b (read-binary-datum in)]
+                [c (read-binary-datum in)])
+           (list a b c (eof-object? (read-binary-datum in))))))
+
+(test* "premature end" (test-error)
+       (read-binary-datum
+        (open-input-string
+         (substring
+          (call-with-output-string (cut write-binary-datum '(1 2 3) <>))
+          0 3))))
+(test* "unserializable" (test-error)
+       (write-binary-datum car (open-output-string)))
+
 (test-end)
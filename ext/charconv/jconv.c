@@ -47,6 +47,10 @@
 #include <ctype.h>
 #include "charconv.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #define INCHK(n)   do{if ((int)inroom < (n)) return INPUT_NOT_ENOUGH;}while(0)
 #define OUTCHK(n)  do{if ((int)outroom < (n)) return OUTPUT_NOT_ENOUGH;}while(0)
 
@@ -1093,6 +1097,86 @@ static size_t pivot(ScmConvInfo *cinfo, const char *inptr, size_t inroom,
     return 0;
 }
 
+/*=================================================================
+ * ASCII runs
+ */
+
+/* EUC_JP, Shift_JIS and UTF-8 all map 0x00-0x7f to ASCII as is, and
+ * real text tends to be mostly ASCII.  When both sides of a conversion
+ * are among them, the handlers copy a run of ASCII bytes at once
+ * instead of calling the converters for every byte.
+ * Returns the number of bytes copied.
+ */
+#define ASCII_WORD_MASK  ((~0UL/0xff)*0x80)   /* 0x8080...80 */
+
+static size_t ascii_run(const char *inptr, size_t inroom,
+                        char *outptr, size_t outroom)
+{
+    size_t n = (inroom < outroom)? inroom : outroom;
+    size_t i = 0;
+#if defined(__SSE2__)
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(inptr + i));
+        if (_mm_movemask_epi8(v)) break;
+        _mm_storeu_si128((__m128i*)(outptr + i), v);
+    }
+#endif
+    for (; i + sizeof(unsigned long) <= n; i += sizeof(unsigned long)) {
+        unsigned long w;
+        memcpy(&w, inptr + i, sizeof(w));
+        if (w & ASCII_WORD_MASK) break;
+        memcpy(outptr + i, &w, sizeof(w));
+    }
+    for (; i < n && !((unsigned char)inptr[i] & 0x80); i++) {
+        outptr[i] = inptr[i];
+    }
+    return i;
+}
+
+/*=================================================================
+ * Shift_JIS <-> UTF-8
+ */
+
+/* These pairs go through EUC_JP, but we compose the two steps here
+ * so that they can be handled by jconv_1tier, without the indirect
+ * calls and the bookkeeping of jconv_2tier for each character.
+ */
+#define INTBUFSIZ 20            /* intermediate buffer size */
+
+static size_t sjis2utf(ScmConvInfo *cinfo, const char *inptr, size_t inroom,
+                       char *outptr, size_t outroom, size_t *outchars)
+{
+    char buf[INTBUFSIZ];
+    size_t bufchars;
+    size_t inchars = sjis2eucj(cinfo, inptr, inroom, buf, INTBUFSIZ,
+                               &bufchars);
+    if (ERRP(inchars)) return inchars;
+    if (bufchars == 0) {
+        *outchars = 0;
+        return inchars;
+    }
+    size_t r = eucj2utf(cinfo, buf, bufchars, outptr, outroom, outchars);
+    if (ERRP(r)) return r;
+    return inchars;
+}
+
+static size_t utf2sjis(ScmConvInfo *cinfo, const char *inptr, size_t inroom,
+                       char *outptr, size_t outroom, size_t *outchars)
+{
+    char buf[INTBUFSIZ];
+    size_t bufchars;
+    size_t inchars = utf2eucj(cinfo, inptr, inroom, buf, INTBUFSIZ,
+                              &bufchars);
+    if (ERRP(inchars)) return inchars;
+    if (bufchars == 0) {
+        *outchars = 0;
+        return inchars;
+    }
+    size_t r = eucj2sjis(cinfo, buf, bufchars, outptr, outroom, outchars);
+    if (ERRP(r)) return r;
+    return inchars;
+}
+
 /*=================================================================
  * JCONV - the entry
  */
@@ -1231,6 +1315,15 @@ static size_t jconv_1tier(ScmConvInfo *info, const char **iptr,
 #endif
     SCM_ASSERT(cvt != NULL);
     while (inr > 0 && outr > 0) {
+        if (info->asciiTransparent && !(*(const unsigned char*)inp & 0x80)) {
+            size_t n = ascii_run(inp, inr, outp, outr);
+            converted += n;
+            inp += n;
+            inr -= (int)n;
+            outp += n;
+            outr -= (int)n;
+            continue;
+        }
         size_t outchars;
         size_t inchars = cvt(info, inp, inr, outp, outr, &outchars);
         if (ERRP(inchars)) {
@@ -1252,7 +1345,6 @@ static size_t jconv_1tier(ScmConvInfo *info, const char **iptr,
 }
 
 /* case (4) */
-#define INTBUFSIZ 20            /* intermediate buffer size */
 static size_t jconv_2tier(ScmConvInfo *info, const char **iptr, size_t *iroom,
                           char **optr, size_t *oroom)
 {
@@ -1268,6 +1360,15 @@ static size_t jconv_2tier(ScmConvInfo *info, const char **iptr, size_t *iroom,
     fprintf(stderr, "jconv_2tier %s->%s\n", info->fromCode, info->toCode);
 #endif
     while (inr > 0 && outr > 0) {
+        if (info->asciiTransparent && !(*(const unsigned char*)inp & 0x80)) {
+            size_t n = ascii_run(inp, inr, outp, outr);
+            converted += n;
+            inp += n;
+            inr -= (int)n;
+            outp += n;
+            outr -= (int)n;
+            continue;
+        }
         size_t outchars, bufchars;
         size_t inchars = icvt(info, inp, inr, buf, INTBUFSIZ, &bufchars);
         if (ERRP(inchars)) {
@@ -1336,6 +1437,12 @@ static size_t jconv_iconv_reset(ScmConvInfo *info, char *optr, size_t oroom)
 }
 #endif /*HAVE_ICONV_H*/
 
+/* Whether the native code maps 0x00-0x7f to ASCII without state */
+static int ascii_transparent_p(int code)
+{
+    return (code == JCODE_EUCJ || code == JCODE_SJIS || code == JCODE_UTF8);
+}
+
 /*------------------------------------------------------------------
  * JCONV_OPEN
  *  Returns ScmConvInfo, setting up some fields.
@@ -1384,6 +1491,18 @@ ScmConvInfo *jconv_open(const char *toCode, const char *fromCode)
         convproc[0] = conv_converter[incode].inconv;
         convproc[1] = NULL;
         reset = NULL;
+    } else if (incode == JCODE_SJIS && outcode == JCODE_UTF8) {
+        /* pattern (4), composed directly */
+        handler = jconv_1tier;
+        convproc[0] = sjis2utf;
+        convproc[1] = NULL;
+        reset = NULL;
+    } else if (incode == JCODE_UTF8 && outcode == JCODE_SJIS) {
+        /* pattern (4), composed directly */
+        handler = jconv_1tier;
+        convproc[0] = utf2sjis;
+        convproc[1] = NULL;
+        reset = NULL;
     } else {
         /* pattern (4) */
         handler = jconv_2tier;
@@ -1401,6 +1520,8 @@ ScmConvInfo *jconv_open(const char *toCode, const char *fromCode)
     info->toCode = toCode;
     info->istate = info->ostate = JIS_ASCII;
     info->fromCode = fromCode;
+    info->asciiTransparent = (ascii_transparent_p(incode)
+                              && ascii_transparent_p(outcode));
     return info;
 }
 
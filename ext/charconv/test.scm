@@ -286,6 +286,26 @@
           '("EUCJP" "UTF-8" "SJIS" "ISO2022JP")
           '("EUCJP" "UTF-8" "SJIS" "ISO2022JP"))
 
+;; Long ASCII runs are copied in bulk; make sure the runs of various
+;; lengths and alignments are handled, as well as what comes after them.
+(define (test-string/ascii-runs file from to)
+  (let* ([pad (^n (make-string n #\a))]
+         [wrap (^s (string-complete->incomplete
+                    (string-append (pad 1037) s (pad 7) s (pad 16) s (pad 3))))]
+         [instr  (wrap (file->string (format #f "~a.~a" file from)))]
+         [outstr (wrap (file->string (format #f "~a.~a" file to)))])
+    (test (format #f "ascii runs(~a) ~a => ~a" file from to)
+          outstr
+          (lambda ()
+            (string-complete->incomplete (ces-convert instr from to))))))
+
+(map-test test-string/ascii-runs "data/jp1"
+          '("EUCJP" "UTF-8" "SJIS")
+          '("EUCJP" "UTF-8" "SJIS"))
+(map-test test-string/ascii-runs "data/jp3"
+          '("EUCJP" "UTF-8" "SJIS")
+          '("EUCJP" "UTF-8" "SJIS"))
+
 ;;--------------------------------------------------------------------
 (test-section "wrapping conversion")
 
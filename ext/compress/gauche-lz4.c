@@ -0,0 +1,394 @@
+/*
+ * gauche-lz4.c - lz4 compression ports
+ *
+ *   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "gauche-lz4.h"
+#include <gauche/class.h>
+
+#define DEFAULT_BUFFER_SIZE  (64*1024)
+#define MINIMUM_BUFFER_SIZE  1024
+
+/* We feed the compressor at most this many bytes at a time, so that
+   the output buffer can be sized by LZ4F_compressBound. */
+#define COMPRESS_CHUNK       (64*1024)
+
+/*================================================================
+ * Class stuff
+ */
+
+static ScmClass *port_cpl[] = {
+    SCM_CLASS_STATIC_PTR(Scm_PortClass),
+    SCM_CLASS_STATIC_PTR(Scm_TopClass),
+    NULL
+};
+
+SCM_DEFINE_BASE_CLASS(Scm_Lz4CompressingPortClass,
+                      ScmPort, /* instance type */
+                      NULL, NULL, NULL, NULL, port_cpl);
+
+SCM_DEFINE_BASE_CLASS(Scm_Lz4DecompressingPortClass,
+                      ScmPort, /* instance type */
+                      NULL, NULL, NULL, NULL, port_cpl);
+
+/*================================================================
+ * Common
+ */
+
+/* <lz4-error> is defined in lz4.scm. */
+static void lz4_error(size_t code, const char *what)
+{
+    Scm_RaiseCondition(SCM_SYMBOL_VALUE("compress.lz4", "<lz4-error>"),
+                       SCM_RAISE_CONDITION_MESSAGE,
+                       "%s failed: %s", what, LZ4F_getErrorName(code));
+}
+
+static int fix_buffer_size(int siz)
+{
+    if (siz <= 0) return DEFAULT_BUFFER_SIZE;
+    if (siz <= MINIMUM_BUFFER_SIZE) return MINIMUM_BUFFER_SIZE;
+    return siz;
+}
+
+static ScmObj port_name(const char *type, ScmPort *remote)
+{
+    ScmObj out = Scm_MakeOutputStringPort(TRUE);
+    Scm_Printf(SCM_PORT(out), "[%s %A]", type, Scm_PortName(remote));
+    return Scm_GetOutputStringUnsafe(SCM_PORT(out), 0);
+}
+
+static void dict_content(ScmObj dict, const void **start, size_t *size)
+{
+    if (SCM_U8VECTORP(dict)) {
+        *start = SCM_UVECTOR_ELEMENTS(dict);
+        *size = SCM_U8VECTOR_SIZE(dict);
+    } else if (SCM_STRINGP(dict)) {
+        const ScmStringBody *b = SCM_STRING_BODY(dict);
+        *start = SCM_STRING_BODY_START(b);
+        *size = SCM_STRING_BODY_SIZE(b);
+    } else {
+        Scm_Error("u8vector or string required for dictionary, but got: %S",
+                  dict);
+    }
+#if !defined(HAVE_LZ4F_CDICT)
+    Scm_Error("dictionary isn't supported by the lz4 library "
+              "Gauche is built with");
+#endif
+}
+
+static LZ4F_blockSizeID_t block_size_id(int size)
+{
+    switch (size) {
+    case 0:            return LZ4F_default;
+    case 64*1024:      return LZ4F_max64KB;
+    case 256*1024:     return LZ4F_max256KB;
+    case 1024*1024:    return LZ4F_max1MB;
+    case 4*1024*1024:  return LZ4F_max4MB;
+    default:
+        Scm_Error("lz4 block size must be one of 65536, 262144, 1048576 "
+                  "or 4194304, but got %d", size);
+    }
+    return LZ4F_default;        /* dummy */
+}
+
+static int lz4_fileno(ScmPort *port)
+{
+    return Scm_PortFileNo(SCM_PORT_LZ4_INFO(port)->remote);
+}
+
+/*================================================================
+ * Compressing port
+ */
+
+static void put_compressed(ScmLz4Info *info, size_t r, const char *what)
+{
+    if (LZ4F_isError(r)) lz4_error(r, what);
+    if (r > 0) {
+        Scm_Putz(info->outbuf, (int)r, info->remote);
+        info->total_out += r;
+    }
+}
+
+static int compress_flusher(ScmPort *port, int cnt, int forcep)
+{
+    ScmLz4Info *info = SCM_PORT_LZ4_INFO(port);
+    const char *p = port->src.buf.buffer;
+    int rest = cnt;
+
+    while (rest > 0) {
+        int chunk = (rest > COMPRESS_CHUNK) ? COMPRESS_CHUNK : rest;
+        size_t r = LZ4F_compressUpdate(info->cctx, info->outbuf,
+                                       info->outbufsiz, p, chunk, NULL);
+        put_compressed(info, r, "LZ4F_compressUpdate");
+        p += chunk;
+        rest -= chunk;
+    }
+    info->total_in += cnt;
+    /* An explicit flush emits the buffered block, so that the receiver
+       can decompress everything written so far. */
+    if (forcep) {
+        size_t r = LZ4F_flush(info->cctx, info->outbuf, info->outbufsiz, NULL);
+        put_compressed(info, r, "LZ4F_flush");
+    }
+    return cnt;
+}
+
+static void compress_closer(ScmPort *port)
+{
+    ScmLz4Info *info = SCM_PORT_LZ4_INFO(port);
+    if (info->cctx == NULL) return;
+    size_t r = LZ4F_compressEnd(info->cctx, info->outbuf, info->outbufsiz,
+                                NULL);
+    LZ4F_freeCompressionContext(info->cctx);
+    info->cctx = NULL;
+    put_compressed(info, r, "LZ4F_compressEnd");
+    Scm_Flush(info->remote);
+    if (info->ownerp) Scm_ClosePort(info->remote);
+}
+
+ScmObj Scm_MakeLz4CompressingPort(ScmPort *drain, int level,
+                                  ScmObj dict, int block_size,
+                                  int checksum, int bufsiz,
+                                  int ownerp)
+{
+    ScmLz4Info *info = SCM_NEW(ScmLz4Info);
+    LZ4F_preferences_t prefs;
+    const void *dstart = NULL;
+    size_t dsize = 0;
+
+    memset(&prefs, 0, sizeof(prefs));
+    prefs.compressionLevel = level;
+    prefs.frameInfo.blockSizeID = block_size_id(block_size);
+    prefs.frameInfo.contentChecksumFlag =
+        checksum ? LZ4F_contentChecksumEnabled : LZ4F_noContentChecksum;
+    if (!SCM_FALSEP(dict)) dict_content(dict, &dstart, &dsize);
+
+    info->remote = drain;
+    info->ownerp = ownerp;
+    info->stream_endp = FALSE;
+    info->frame_endp = TRUE;
+    info->inbufsiz = info->inpos = info->inlen = 0;
+    info->inbuf = NULL;
+    info->outbufsiz = LZ4F_compressBound(COMPRESS_CHUNK, &prefs);
+    if (info->outbufsiz < LZ4F_HEADER_SIZE_MAX) {
+        info->outbufsiz = LZ4F_HEADER_SIZE_MAX;
+    }
+    info->outbuf = SCM_NEW_ATOMIC2(char*, info->outbufsiz);
+    info->dict = NULL;
+    info->dictlen = 0;
+    info->total_in = info->total_out = 0;
+    info->dctx = NULL;
+
+    size_t r = LZ4F_createCompressionContext(&info->cctx, LZ4F_VERSION);
+    if (LZ4F_isError(r)) lz4_error(r, "LZ4F_createCompressionContext");
+
+    /* The frame header is written right away. */
+#if defined(HAVE_LZ4F_CDICT)
+    if (dstart) {
+        LZ4F_CDict *cdict = LZ4F_createCDict(dstart, dsize);
+        if (cdict == NULL) {
+            LZ4F_freeCompressionContext(info->cctx);
+            Scm_Error("LZ4F_createCDict failed");
+        }
+        r = LZ4F_compressBegin_usingCDict(info->cctx, info->outbuf,
+                                          info->outbufsiz, cdict, &prefs);
+        LZ4F_freeCDict(cdict);
+    } else
+#endif /*HAVE_LZ4F_CDICT*/
+    {
+        r = LZ4F_compressBegin(info->cctx, info->outbuf, info->outbufsiz,
+                               &prefs);
+    }
+    if (LZ4F_isError(r)) {
+        LZ4F_freeCompressionContext(info->cctx);
+        lz4_error(r, "LZ4F_compressBegin");
+    }
+    put_compressed(info, r, "LZ4F_compressBegin");
+
+    ScmPortBuffer bufrec;
+    memset(&bufrec, 0, sizeof(bufrec));
+    bufrec.size = fix_buffer_size(bufsiz);
+    bufrec.buffer = SCM_NEW_ATOMIC2(char *, bufrec.size);
+    bufrec.mode = SCM_PORT_BUFFER_FULL;
+    bufrec.flusher = compress_flusher;
+    bufrec.closer = compress_closer;
+    bufrec.filenum = lz4_fileno;
+    bufrec.data = (void*)info;
+
+    ScmObj name = port_name("lz4-compressing", drain);
+    return Scm_MakeBufferedPort(SCM_CLASS_LZ4_COMPRESSING_PORT, name,
+                                SCM_PORT_OUTPUT, TRUE, &bufrec);
+}
+
+/* When the port buffer is empty, Scm_Flush doesn't call the flusher,
+   but lz4 may still hold data we've fed.  This pushes it out. */
+void Scm_Lz4Flush(ScmPort *port)
+{
+    Scm_Flush(port);
+    ScmLz4Info *info = SCM_PORT_LZ4_INFO(port);
+    if (info->cctx) {
+        size_t r = LZ4F_flush(info->cctx, info->outbuf, info->outbufsiz, NULL);
+        put_compressed(info, r, "LZ4F_flush");
+    }
+    Scm_Flush(info->remote);
+}
+
+/*================================================================
+ * Decompressing port
+ */
+
+static int decompress_filler(ScmPort *port, int mincnt)
+{
+    ScmLz4Info *info = SCM_PORT_LZ4_INFO(port);
+    char *dst = port->src.buf.end;
+    size_t room = SCM_PORT_BUFFER_ROOM(port);
+    size_t produced = 0;
+    /* If the last call filled up the output, lz4 may have more to
+       give without further input. */
+    int pending = FALSE;
+
+    if (info->dctx == NULL) return 0;
+    while (produced == 0) {
+        if (info->inpos == info->inlen && !pending) {
+            if (info->stream_endp) break;
+            int nread = Scm_Getz(info->inbuf, (int)info->inbufsiz,
+                                 info->remote);
+            if (nread <= 0) {
+                info->stream_endp = TRUE;
+                if (!info->frame_endp) {
+                    Scm_RaiseCondition(SCM_SYMBOL_VALUE("compress.lz4",
+                                                        "<lz4-error>"),
+                                       SCM_RAISE_CONDITION_MESSAGE,
+                                       "truncated lz4 stream: %S",
+                                       info->remote);
+                }
+                break;
+            }
+            info->inpos = 0;
+            info->inlen = nread;
+        }
+        size_t dstsiz = room;
+        size_t srcsiz = info->inlen - info->inpos;
+        size_t r;
+#if defined(HAVE_LZ4F_CDICT)
+        if (info->dict) {
+            r = LZ4F_decompress_usingDict(info->dctx, dst, &dstsiz,
+                                          info->inbuf + info->inpos, &srcsiz,
+                                          info->dict, info->dictlen, NULL);
+        } else
+#endif /*HAVE_LZ4F_CDICT*/
+        {
+            r = LZ4F_decompress(info->dctx, dst, &dstsiz,
+                                info->inbuf + info->inpos, &srcsiz, NULL);
+        }
+        if (LZ4F_isError(r)) lz4_error(r, "LZ4F_decompress");
+        info->inpos += srcsiz;
+        info->total_in += srcsiz;
+        produced = dstsiz;
+        /* R == 0 means a frame is completely decoded.  Another frame
+           may follow; the context is ready for it. */
+        info->frame_endp = (r == 0);
+        pending = (dstsiz == room);
+    }
+    info->total_out += produced;
+    return (int)produced;
+}
+
+static void decompress_closer(ScmPort *port)
+{
+    ScmLz4Info *info = SCM_PORT_LZ4_INFO(port);
+    if (info->dctx == NULL) return;
+    LZ4F_freeDecompressionContext(info->dctx);
+    info->dctx = NULL;
+    if (info->ownerp) Scm_ClosePort(info->remote);
+}
+
+ScmObj Scm_MakeLz4DecompressingPort(ScmPort *source, ScmObj dict,
+                                    int bufsiz, int ownerp)
+{
+    ScmLz4Info *info = SCM_NEW(ScmLz4Info);
+    const void *dstart = NULL;
+    size_t dsize = 0;
+    if (!SCM_FALSEP(dict)) dict_content(dict, &dstart, &dsize);
+
+    info->cctx = NULL;
+    info->remote = source;
+    info->ownerp = ownerp;
+    info->stream_endp = FALSE;
+    info->frame_endp = TRUE;
+    info->inbufsiz = DEFAULT_BUFFER_SIZE;
+    info->inbuf = SCM_NEW_ATOMIC2(char*, info->inbufsiz);
+    info->inpos = info->inlen = 0;
+    info->outbufsiz = 0;
+    info->outbuf = NULL;
+    if (dstart) {
+        /* The decompressor refers to the dictionary throughout, so we
+           keep our own copy. */
+        char *d = SCM_NEW_ATOMIC2(char*, dsize);
+        memcpy(d, dstart, dsize);
+        info->dict = d;
+        info->dictlen = dsize;
+    } else {
+        info->dict = NULL;
+        info->dictlen = 0;
+    }
+    info->total_in = info->total_out = 0;
+
+    size_t r = LZ4F_createDecompressionContext(&info->dctx, LZ4F_VERSION);
+    if (LZ4F_isError(r)) lz4_error(r, "LZ4F_createDecompressionContext");
+
+    ScmPortBuffer bufrec;
+    memset(&bufrec, 0, sizeof(bufrec));
+    bufrec.size = fix_buffer_size(bufsiz);
+    bufrec.buffer = SCM_NEW_ATOMIC2(char *, bufrec.size);
+    bufrec.mode = SCM_PORT_BUFFER_FULL;
+    bufrec.filler = decompress_filler;
+    bufrec.closer = decompress_closer;
+    bufrec.filenum = lz4_fileno;
+    bufrec.data = (void*)info;
+
+    ScmObj name = port_name("lz4-decompressing", source);
+    return Scm_MakeBufferedPort(SCM_CLASS_LZ4_DECOMPRESSING_PORT, name,
+                                SCM_PORT_INPUT, TRUE, &bufrec);
+}
+
+/*
+ * Module initialization function.
+ */
+void Scm_Init_lz4(void)
+{
+    ScmModule *mod = SCM_MODULE(SCM_FIND_MODULE("compress.lz4", TRUE));
+
+    Scm_InitStaticClass(&Scm_Lz4CompressingPortClass,
+                        "<lz4-compressing-port>", mod, NULL, 0);
+    Scm_InitStaticClass(&Scm_Lz4DecompressingPortClass,
+                        "<lz4-decompressing-port>", mod, NULL, 0);
+}
@@ -0,0 +1,94 @@
+/*
+ * gauche-lz4.h - lz4 compression ports
+ *
+ *   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef GAUCHE_LZ4_H
+#define GAUCHE_LZ4_H
+
+#include <gauche.h>
+#include <gauche/extend.h>
+/* Dictionary API is in the "static linking only" section up to lz4 1.9;
+   configure checks if the library actually exports it. */
+#define LZ4F_STATIC_LINKING_ONLY
+#include <lz4frame.h>
+#include <lz4.h>
+
+#if defined(EXTCOMPRESS_EXPORTS)
+#define LIBGAUCHE_EXT_BODY
+#endif
+#include <gauche/extern.h>      /* redefine SCM_EXTERN */
+
+SCM_DECL_BEGIN
+
+typedef struct ScmLz4InfoRec {
+    LZ4F_cctx *cctx;            /* for compressing port */
+    LZ4F_dctx *dctx;            /* for decompressing port */
+    ScmPort *remote;            /* source or drain port */
+    int ownerp;
+    int stream_endp;            /* decompressing: remote reached EOF */
+    int frame_endp;             /* decompressing: at a frame boundary */
+    size_t inbufsiz;            /* decompressing: compressed data buffer */
+    char *inbuf;
+    size_t inpos;               /* consumed part of inbuf */
+    size_t inlen;               /* valid part of inbuf */
+    size_t outbufsiz;           /* compressing: compressed data buffer */
+    char *outbuf;
+    const char *dict;           /* decompressing: dictionary content */
+    size_t dictlen;
+    unsigned long long total_in;
+    unsigned long long total_out;
+} ScmLz4Info;
+
+#define SCM_PORT_LZ4_INFO(p) ((ScmLz4Info*)(p)->src.buf.data)
+
+SCM_CLASS_DECL(Scm_Lz4CompressingPortClass);
+#define SCM_CLASS_LZ4_COMPRESSING_PORT  (&Scm_Lz4CompressingPortClass)
+#define SCM_LZ4_COMPRESSING_PORT_P(obj) \
+    SCM_ISA(obj, SCM_CLASS_LZ4_COMPRESSING_PORT)
+SCM_CLASS_DECL(Scm_Lz4DecompressingPortClass);
+#define SCM_CLASS_LZ4_DECOMPRESSING_PORT  (&Scm_Lz4DecompressingPortClass)
+#define SCM_LZ4_DECOMPRESSING_PORT_P(obj) \
+    SCM_ISA(obj, SCM_CLASS_LZ4_DECOMPRESSING_PORT)
+
+extern ScmObj Scm_MakeLz4CompressingPort(ScmPort *drain, int level,
+                                         ScmObj dict, int block_size,
+                                         int checksum, int bufsiz,
+                                         int ownerp);
+extern ScmObj Scm_MakeLz4DecompressingPort(ScmPort *source, ScmObj dict,
+                                           int bufsiz, int ownerp);
+extern void   Scm_Lz4Flush(ScmPort *port);
+
+extern void Scm_Init_lz4(void);
+
+SCM_DECL_END
+
+#endif /*GAUCHE_LZ4_H*/
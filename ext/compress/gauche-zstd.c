@@ -0,0 +1,343 @@
+/*
+ * gauche-zstd.c - zstd compression ports
+ *
+ *   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "gauche-zstd.h"
+#include <gauche/class.h>
+
+/* The port buffer of a compressing port holds uncompressed data, and
+   that of a decompressing one holds decompressed data.  When the sizes
+   aren't given, we use the ones zstd recommends for streaming. */
+#define MINIMUM_BUFFER_SIZE 1024
+
+/*================================================================
+ * Class stuff
+ */
+
+static ScmClass *port_cpl[] = {
+    SCM_CLASS_STATIC_PTR(Scm_PortClass),
+    SCM_CLASS_STATIC_PTR(Scm_TopClass),
+    NULL
+};
+
+SCM_DEFINE_BASE_CLASS(Scm_ZstdCompressingPortClass,
+                      ScmPort, /* instance type */
+                      NULL, NULL, NULL, NULL, port_cpl);
+
+SCM_DEFINE_BASE_CLASS(Scm_ZstdDecompressingPortClass,
+                      ScmPort, /* instance type */
+                      NULL, NULL, NULL, NULL, port_cpl);
+
+/*================================================================
+ * Common
+ */
+
+/* <zstd-error> is defined in zstd.scm. */
+static void zstd_error(size_t code, const char *what)
+{
+    Scm_RaiseCondition(SCM_SYMBOL_VALUE("compress.zstd", "<zstd-error>"),
+                       SCM_RAISE_CONDITION_MESSAGE,
+                       "%s failed: %s", what, ZSTD_getErrorName(code));
+}
+
+static int fix_buffer_size(int siz, size_t dflt)
+{
+    if (siz <= 0) return (int)dflt;
+    if (siz <= MINIMUM_BUFFER_SIZE) return MINIMUM_BUFFER_SIZE;
+    return siz;
+}
+
+static ScmObj port_name(const char *type, ScmPort *remote)
+{
+    ScmObj out = Scm_MakeOutputStringPort(TRUE);
+    Scm_Printf(SCM_PORT(out), "[%s %A]", type, Scm_PortName(remote));
+    return Scm_GetOutputStringUnsafe(SCM_PORT(out), 0);
+}
+
+static void dict_content(ScmObj dict, const void **start, size_t *size)
+{
+    if (SCM_U8VECTORP(dict)) {
+        *start = SCM_UVECTOR_ELEMENTS(dict);
+        *size = SCM_U8VECTOR_SIZE(dict);
+    } else if (SCM_STRINGP(dict)) {
+        const ScmStringBody *b = SCM_STRING_BODY(dict);
+        *start = SCM_STRING_BODY_START(b);
+        *size = SCM_STRING_BODY_SIZE(b);
+    } else {
+        Scm_Error("u8vector or string required for dictionary, but got: %S",
+                  dict);
+    }
+}
+
+static int zstd_fileno(ScmPort *port)
+{
+    return Scm_PortFileNo(SCM_PORT_ZSTD_INFO(port)->remote);
+}
+
+/*================================================================
+ * Compressing port
+ */
+
+/* Feed LEN bytes from DATA to the compressor and write out whatever
+   it produces.  With ZSTD_e_flush or ZSTD_e_end, we loop until zstd
+   tells it has nothing left. */
+static void compress_chunk(ScmZstdInfo *info, const char *data, size_t len,
+                           ZSTD_EndDirective mode)
+{
+    ZSTD_inBuffer in = { data, len, 0 };
+    for (;;) {
+        ZSTD_outBuffer out = { info->outbuf, info->outbufsiz, 0 };
+        size_t r = ZSTD_compressStream2(info->cctx, &out, &in, mode);
+        if (ZSTD_isError(r)) zstd_error(r, "ZSTD_compressStream2");
+        if (out.pos > 0) {
+            Scm_Putz(info->outbuf, (int)out.pos, info->remote);
+            info->total_out += out.pos;
+        }
+        if (mode == ZSTD_e_continue ? (in.pos == in.size) : (r == 0)) break;
+    }
+    info->total_in += len;
+}
+
+static int compress_flusher(ScmPort *port, int cnt, int forcep)
+{
+    ScmZstdInfo *info = SCM_PORT_ZSTD_INFO(port);
+    /* zstd buffers input internally as needed, so we always consume
+       all of CNT bytes.  An explicit flush cuts the current block so
+       that the receiver can decompress everything written so far. */
+    compress_chunk(info, port->src.buf.buffer, cnt,
+                   forcep ? ZSTD_e_flush : ZSTD_e_continue);
+    return cnt;
+}
+
+static void compress_closer(ScmPort *port)
+{
+    ScmZstdInfo *info = SCM_PORT_ZSTD_INFO(port);
+    if (info->cctx == NULL) return;
+    compress_chunk(info, NULL, 0, ZSTD_e_end);
+    ZSTD_freeCCtx(info->cctx);
+    info->cctx = NULL;
+    Scm_Flush(info->remote);
+    if (info->ownerp) Scm_ClosePort(info->remote);
+}
+
+ScmObj Scm_MakeZstdCompressingPort(ScmPort *drain, int level,
+                                   ScmObj dict, int workers,
+                                   int checksum, int bufsiz,
+                                   int ownerp)
+{
+    ScmZstdInfo *info = SCM_NEW(ScmZstdInfo);
+    const void *dstart = NULL;
+    size_t dsize = 0;
+    if (!SCM_FALSEP(dict)) dict_content(dict, &dstart, &dsize);
+
+    ZSTD_CCtx *cctx = ZSTD_createCCtx();
+    if (cctx == NULL) Scm_Error("ZSTD_createCCtx failed");
+
+    const char *what = NULL;
+    size_t r = ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, level);
+    if (ZSTD_isError(r)) { what = "setting compression level"; goto err; }
+    r = ZSTD_CCtx_setParameter(cctx, ZSTD_c_checksumFlag, checksum);
+    if (ZSTD_isError(r)) { what = "setting checksum flag"; goto err; }
+    if (workers > 0) {
+        /* This fails if libzstd is built without multithread support. */
+        r = ZSTD_CCtx_setParameter(cctx, ZSTD_c_nbWorkers, workers);
+        if (ZSTD_isError(r)) { what = "setting number of workers"; goto err; }
+    }
+    if (dstart) {
+        r = ZSTD_CCtx_loadDictionary(cctx, dstart, dsize);
+        if (ZSTD_isError(r)) { what = "ZSTD_CCtx_loadDictionary"; goto err; }
+        info->dict_id = ZSTD_getDictID_fromDict(dstart, dsize);
+    } else {
+        info->dict_id = 0;
+    }
+
+    info->cctx = cctx;
+    info->dctx = NULL;
+    info->remote = drain;
+    info->ownerp = ownerp;
+    info->stream_endp = FALSE;
+    info->frame_endp = TRUE;
+    info->inbufsiz = info->inpos = info->inlen = 0;
+    info->inbuf = NULL;
+    info->outbufsiz = ZSTD_CStreamOutSize();
+    info->outbuf = SCM_NEW_ATOMIC2(char*, info->outbufsiz);
+    info->total_in = info->total_out = 0;
+
+    ScmPortBuffer bufrec;
+    memset(&bufrec, 0, sizeof(bufrec));
+    bufrec.size = fix_buffer_size(bufsiz, ZSTD_CStreamInSize());
+    bufrec.buffer = SCM_NEW_ATOMIC2(char *, bufrec.size);
+    bufrec.mode = SCM_PORT_BUFFER_FULL;
+    bufrec.flusher = compress_flusher;
+    bufrec.closer = compress_closer;
+    bufrec.filenum = zstd_fileno;
+    bufrec.data = (void*)info;
+
+    ScmObj name = port_name("zstd-compressing", drain);
+    return Scm_MakeBufferedPort(SCM_CLASS_ZSTD_COMPRESSING_PORT, name,
+                                SCM_PORT_OUTPUT, TRUE, &bufrec);
+  err:
+    ZSTD_freeCCtx(cctx);
+    zstd_error(r, what);
+    return SCM_UNDEFINED;       /* dummy */
+}
+
+/* When the port buffer is empty, Scm_Flush doesn't call the flusher,
+   but zstd may still hold data we've fed.  This pushes it out. */
+void Scm_ZstdFlush(ScmPort *port)
+{
+    Scm_Flush(port);
+    ScmZstdInfo *info = SCM_PORT_ZSTD_INFO(port);
+    if (info->cctx) compress_chunk(info, NULL, 0, ZSTD_e_flush);
+    Scm_Flush(info->remote);
+}
+
+/*================================================================
+ * Decompressing port
+ */
+
+static int decompress_filler(ScmPort *port, int mincnt)
+{
+    ScmZstdInfo *info = SCM_PORT_ZSTD_INFO(port);
+    ZSTD_outBuffer out = { port->src.buf.end, SCM_PORT_BUFFER_ROOM(port), 0 };
+    /* If the last call filled up the output, zstd may have more to
+       give without further input. */
+    int pending = FALSE;
+
+    if (info->dctx == NULL) return 0;
+    while (out.pos == 0) {
+        if (info->inpos == info->inlen && !pending) {
+            if (info->stream_endp) break;
+            int nread = Scm_Getz(info->inbuf, (int)info->inbufsiz,
+                                 info->remote);
+            if (nread <= 0) {
+                info->stream_endp = TRUE;
+                if (!info->frame_endp) {
+                    Scm_RaiseCondition(SCM_SYMBOL_VALUE("compress.zstd",
+                                                        "<zstd-error>"),
+                                       SCM_RAISE_CONDITION_MESSAGE,
+                                       "truncated zstd stream: %S",
+                                       info->remote);
+                }
+                break;
+            }
+            info->inpos = 0;
+            info->inlen = nread;
+        }
+        if (info->frame_endp && info->inpos < info->inlen) {
+            /* Beginning of a frame.  Record the dictionary it requires. */
+            info->dict_id =
+                ZSTD_getDictID_fromFrame(info->inbuf + info->inpos,
+                                         info->inlen - info->inpos);
+        }
+        ZSTD_inBuffer in = { info->inbuf, info->inlen, info->inpos };
+        size_t r = ZSTD_decompressStream(info->dctx, &out, &in);
+        if (ZSTD_isError(r)) zstd_error(r, "ZSTD_decompressStream");
+        info->total_in += in.pos - info->inpos;
+        info->inpos = in.pos;
+        /* R == 0 means a frame is completely decoded.  Another frame may
+           follow, as zstd allows concatenated frames. */
+        info->frame_endp = (r == 0);
+        pending = (out.pos == out.size);
+    }
+    info->total_out += out.pos;
+    return (int)out.pos;
+}
+
+static void decompress_closer(ScmPort *port)
+{
+    ScmZstdInfo *info = SCM_PORT_ZSTD_INFO(port);
+    if (info->dctx == NULL) return;
+    ZSTD_freeDCtx(info->dctx);
+    info->dctx = NULL;
+    if (info->ownerp) Scm_ClosePort(info->remote);
+}
+
+ScmObj Scm_MakeZstdDecompressingPort(ScmPort *source, ScmObj dict,
+                                     int bufsiz, int ownerp)
+{
+    ScmZstdInfo *info = SCM_NEW(ScmZstdInfo);
+    const void *dstart = NULL;
+    size_t dsize = 0;
+    if (!SCM_FALSEP(dict)) dict_content(dict, &dstart, &dsize);
+
+    ZSTD_DCtx *dctx = ZSTD_createDCtx();
+    if (dctx == NULL) Scm_Error("ZSTD_createDCtx failed");
+    if (dstart) {
+        size_t r = ZSTD_DCtx_loadDictionary(dctx, dstart, dsize);
+        if (ZSTD_isError(r)) {
+            ZSTD_freeDCtx(dctx);
+            zstd_error(r, "ZSTD_DCtx_loadDictionary");
+        }
+    }
+
+    info->cctx = NULL;
+    info->dctx = dctx;
+    info->remote = source;
+    info->ownerp = ownerp;
+    info->stream_endp = FALSE;
+    info->frame_endp = TRUE;
+    info->inbufsiz = ZSTD_DStreamInSize();
+    info->inbuf = SCM_NEW_ATOMIC2(char*, info->inbufsiz);
+    info->inpos = info->inlen = 0;
+    info->outbufsiz = 0;
+    info->outbuf = NULL;
+    info->dict_id = 0;
+    info->total_in = info->total_out = 0;
+
+    ScmPortBuffer bufrec;
+    memset(&bufrec, 0, sizeof(bufrec));
+    bufrec.size = fix_buffer_size(bufsiz, ZSTD_DStreamOutSize());
+    bufrec.buffer = SCM_NEW_ATOMIC2(char *, bufrec.size);
+    bufrec.mode = SCM_PORT_BUFFER_FULL;
+    bufrec.filler = decompress_filler;
+    bufrec.closer = decompress_closer;
+    bufrec.filenum = zstd_fileno;
+    bufrec.data = (void*)info;
+
+    ScmObj name = port_name("zstd-decompressing", source);
+    return Scm_MakeBufferedPort(SCM_CLASS_ZSTD_DECOMPRESSING_PORT, name,
+                                SCM_PORT_INPUT, TRUE, &bufrec);
+}
+
+/*
+ * Module initialization function.
+ */
+void Scm_Init_zstd(void)
+{
+    ScmModule *mod = SCM_MODULE(SCM_FIND_MODULE("compress.zstd", TRUE));
+
+    Scm_InitStaticClass(&Scm_ZstdCompressingPortClass,
+                        "<zstd-compressing-port>", mod, NULL, 0);
+    Scm_InitStaticClass(&Scm_ZstdDecompressingPortClass,
+                        "<zstd-decompressing-port>", mod, NULL, 0);
+}
@@ -0,0 +1,103 @@
+;;;
+;;; compress.lz4 - lz4 compression ports
+;;;
+;;;   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+;;;
+;;;   Redistribution and use in source and binary forms, with or without
+;;;   modification, are permitted provided that the following conditions
+;;;   are met:
+;;;
+;;;   1. Redistributions of source code must retain the above copyright
+;;;      notice, this list of conditions and the following disclaimer.
+;;;
+;;;   2. Redistributions in binary form must reproduce the above copyright
+;;;      notice, this list of conditions and the following disclaimer in the
+;;;      documentation and/or other materials provided with the distribution.
+;;;
+;;;   3. Neither the name of the authors nor the names of its contributors
+;;;      may be used to endorse or promote products derived from this
+;;;      software without specific prior written permission.
+;;;
+;;;   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+;;;   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+;;;   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+;;;   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+;;;   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+;;;   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+;;;   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+;;;   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+;;;   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+;;;   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+;;;   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+;;;
+
+;; Streaming LZ4 frame format compression and decompression ports.
+;; The interface is the same as compress.zstd.
+
+#!no-fold-case
+
+(define-module compress.lz4
+  (use gauche.uvector)
+  (export <lz4-error>
+          <lz4-compressing-port> <lz4-decompressing-port>
+          open-lz4-compressing-port open-lz4-decompressing-port
+          lz4-compress-string lz4-decompress-string
+          lz4-flush lz4-total-in lz4-total-out lz4-version))
+(select-module compress.lz4)
+
+(define-condition-type <lz4-error> <error> #f)
+
+(inline-stub
+ (declcode "#include \"gauche-lz4.h\"")
+ (initcode (Scm_Init_lz4))
+
+ (define-type <lz4-compressing-port> "ScmPort*" "lz4 compressing port"
+   "SCM_LZ4_COMPRESSING_PORT_P" "SCM_PORT")
+
+ "#define SCM_LZ4_PORT_P(x) \
+    (SCM_LZ4_COMPRESSING_PORT_P(x)||SCM_LZ4_DECOMPRESSING_PORT_P(x))"
+ ;; proxy type; <lz4-port> isn't really a Scheme class.
+ (define-type <lz4-port> "ScmPort*" "lz4 compressing or decompressing port"
+   "SCM_LZ4_PORT_P" "SCM_PORT")
+
+ (define-cproc lz4-version ()
+   (return (SCM_MAKE_STR (LZ4_versionString))))
+
+ (define-cproc open-lz4-compressing-port
+   (drain::<output-port>
+    :key (compression-level::<fixnum> 0)
+         (dictionary #f)
+         (block-size::<fixnum> 0)
+         (checksum?::<boolean> #f)
+         (buffer-size::<fixnum> 0)
+         (owner?::<boolean> #f))
+   (return (Scm_MakeLz4CompressingPort drain compression-level dictionary
+                                       block-size checksum? buffer-size
+                                       owner?)))
+
+ (define-cproc open-lz4-decompressing-port
+   (source::<input-port>
+    :key (dictionary #f)
+         (buffer-size::<fixnum> 0)
+         (owner?::<boolean> #f))
+   (return (Scm_MakeLz4DecompressingPort source dictionary buffer-size
+                                         owner?)))
+
+ (define-cproc lz4-flush (port::<lz4-compressing-port>) ::<void>
+   Scm_Lz4Flush)
+
+ (define-cproc lz4-total-in (port::<lz4-port>)
+   (return (Scm_MakeIntegerU64 (-> (SCM_PORT_LZ4_INFO port) total_in))))
+ (define-cproc lz4-total-out (port::<lz4-port>)
+   (return (Scm_MakeIntegerU64 (-> (SCM_PORT_LZ4_INFO port) total_out))))
+ )
+
+(define (lz4-compress-string str . args)
+  (call-with-output-string
+    (^p (let1 p2 (apply open-lz4-compressing-port p args)
+          (display str p2)
+          (close-output-port p2)))))
+
+(define (lz4-decompress-string str . args)
+  (port->string (apply open-lz4-decompressing-port
+                       (open-input-string str) args)))
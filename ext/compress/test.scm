@@ -0,0 +1,153 @@
+;;;
+;;; Test compress.zstd and compress.lz4
+;;;
+
+#!no-fold-case
+
+(use gauche.test)
+(use gauche.uvector)
+
+(test-start "compress")
+
+(define (dso-exists? name)
+  (file-exists? (string-append name "." (gauche-dso-suffix))))
+
+(define *text*
+  (string-join (map (^i (format "~d: the quick brown fox jumps over the lazy dog" i))
+                    (iota 5000))
+               "\n"))
+
+(define *dict*
+  "the quick brown fox jumps over the lazy dog 0123456789: ")
+
+;; Common tests for both codecs.
+;;  open-c, open-d - port constructors
+;;  compress, decompress - string utilities
+;;  flush - pushes pending data out
+;;  magic - the first four bytes of a frame
+(define (codec-tests name open-c open-d compress decompress flush magic
+                     error-class levels)
+  (test* #"~name: round trip (empty)" ""
+         (decompress (compress "")))
+  (test* #"~name: round trip" *text*
+         (decompress (compress *text*)))
+  (test* #"~name: magic number" magic
+         (u8vector->list (string->u8vector (compress "abc") 0 4)))
+  (test* #"~name: compresses" #t
+         (< (string-size (compress *text*)) (quotient (string-size *text*) 4)))
+  (dolist [lv levels]
+    (test* #"~name: compression level ~lv" *text*
+           (decompress (compress *text* :compression-level lv))))
+  (test* #"~name: buffer size" *text*
+         (decompress (compress *text* :buffer-size 1500) :buffer-size 1500))
+  (test* #"~name: checksum" *text*
+         (decompress (compress *text* :checksum? #t)))
+  (test* #"~name: binary data" '#u8(0 255 128 97 98 99)
+         (string->u8vector (decompress (compress #*"\x00\xff\x80abc"))))
+  (test* #"~name: concatenated frames" (string-append *text* "abc" *text*)
+         (decompress (string-append (compress *text*) (compress "abc")
+                                    (compress *text*))))
+  (test* #"~name: truncated stream" (test-error error-class)
+         (let1 z (compress *text*)
+           (decompress (u8vector->string (string->u8vector z)
+                                         0 (quotient (string-size z) 2)))))
+  (test* #"~name: corrupted stream" (test-error error-class)
+         (decompress "no compressed data in here"))
+
+  (test* #"~name: owner?" '(#f #t)
+         (let ([p1 (open-output-string)]
+               [p2 (open-output-string)])
+           (close-output-port (open-c p1))
+           (close-output-port (open-c p2 :owner? #t))
+           (list (port-closed? p1) (port-closed? p2))))
+  (test* #"~name: flush" "abc"
+         (let* ([sink (open-output-string)]
+                [p (open-c sink)])
+           (display "abc" p)
+           (flush p)
+           ;; the stream isn't closed, but what we've written so far
+           ;; should be decodable.
+           (let1 in (open-d (open-input-string (get-output-string sink)))
+             (begin0 (read-string 3 in)
+                     (close-output-port p)))))
+
+  (test* #"~name: dictionary" *text*
+         (guard (e [(and (error? e)
+                         (#/isn't supported/ (condition-message e)))
+                    *text*])
+           (decompress (compress *text* :dictionary *dict*)
+                       :dictionary (string->u8vector *dict*))))
+  (test* #"~name: bad dictionary" (test-error)
+         (open-c (open-output-string) :dictionary 'foo))
+  )
+
+;;------------------------------------------------------------------
+(test-section "compress.zstd")
+
+(when (dso-exists? "compress--zstd")
+  (load "./zstd")
+  (eval '(import compress.zstd) (current-module))
+  (test-module 'compress.zstd)
+
+  (test* "zstd-version" #t (string? (zstd-version)))
+  (test* "<zstd-compressing-port>" <zstd-compressing-port>
+         (class-of (open-zstd-compressing-port (open-output-string))))
+  (test* "<zstd-decompressing-port>" <zstd-decompressing-port>
+         (class-of (open-zstd-decompressing-port (open-input-string ""))))
+
+  (codec-tests "zstd"
+               open-zstd-compressing-port open-zstd-decompressing-port
+               zstd-compress-string zstd-decompress-string zstd-flush
+               '(#x28 #xb5 #x2f #xfd) <zstd-error>
+               (list (zstd-min-compression-level) 1 ZSTD_CLEVEL_DEFAULT 19))
+
+  (test* "zstd-total-in/out" #t
+         (let* ([sink (open-output-string)]
+                [p (open-zstd-compressing-port sink)])
+           (display *text* p)
+           (close-output-port p)
+           (and (= (zstd-total-in p) (string-size *text*))
+                (= (zstd-total-out p) (string-size (get-output-string sink))))))
+  (test* "zstd-dictionary-id (none)" #f
+         (zstd-dictionary-id (open-zstd-compressing-port (open-output-string))))
+  ;; Using workers requires libzstd built with multithread support.
+  (test* "workers" *text*
+         (guard (e [(<zstd-error> e) *text*])
+           (zstd-decompress-string (zstd-compress-string *text* :workers 2))))
+  )
+
+;;------------------------------------------------------------------
+(test-section "compress.lz4")
+
+(when (dso-exists? "compress--lz4")
+  (load "./lz4")
+  (eval '(import compress.lz4) (current-module))
+  (test-module 'compress.lz4)
+
+  (test* "lz4-version" #t (string? (lz4-version)))
+  (test* "<lz4-compressing-port>" <lz4-compressing-port>
+         (class-of (open-lz4-compressing-port (open-output-string))))
+  (test* "<lz4-decompressing-port>" <lz4-decompressing-port>
+         (class-of (open-lz4-decompressing-port (open-input-string ""))))
+
+  (codec-tests "lz4"
+               open-lz4-compressing-port open-lz4-decompressing-port
+               lz4-compress-string lz4-decompress-string lz4-flush
+               '(#x04 #x22 #x4d #x18) <lz4-error>
+               '(-1 0 9 12))
+
+  (test* "block size" *text*
+         (lz4-decompress-string (lz4-compress-string *text*
+                                                     :block-size 262144)))
+  (test* "block size" (test-error)
+         (open-lz4-compressing-port (open-output-string) :block-size 1000))
+  (test* "lz4-total-in/out" #t
+         (let* ([sink (open-output-string)]
+                [p (open-lz4-compressing-port sink)])
+           (display *text* p)
+           (close-output-port p)
+           (and (= (lz4-total-in p) (string-size *text*))
+                (= (lz4-total-out p) (string-size (get-output-string sink))))))
+  )
+
+(test-end)
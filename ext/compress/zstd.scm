@@ -0,0 +1,118 @@
+;;;
+;;; compress.zstd - zstd compression ports
+;;;
+;;;   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+;;;
+;;;   Redistribution and use in source and binary forms, with or without
+;;;   modification, are permitted provided that the following conditions
+;;;   are met:
+;;;
+;;;   1. Redistributions of source code must retain the above copyright
+;;;      notice, this list of conditions and the following disclaimer.
+;;;
+;;;   2. Redistributions in binary form must reproduce the above copyright
+;;;      notice, this list of conditions and the following disclaimer in the
+;;;      documentation and/or other materials provided with the distribution.
+;;;
+;;;   3. Neither the name of the authors nor the names of its contributors
+;;;      may be used to endorse or promote products derived from this
+;;;      software without specific prior written permission.
+;;;
+;;;   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+;;;   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+;;;   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+;;;   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+;;;   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+;;;   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+;;;   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+;;;   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+;;;   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+;;;   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+;;;   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+;;;
+
+;; Streaming Zstandard (RFC 8878) compression and decompression ports.
+;; The interface follows rfc.zlib's deflating and inflating ports.
+
+#!no-fold-case
+
+(define-module compress.zstd
+  (use gauche.uvector)
+  (export <zstd-error>
+          <zstd-compressing-port> <zstd-decompressing-port>
+          open-zstd-compressing-port open-zstd-decompressing-port
+          zstd-compress-string zstd-decompress-string
+          zstd-flush zstd-total-in zstd-total-out zstd-dictionary-id
+          zstd-version zstd-min-compression-level
+          zstd-max-compression-level ZSTD_CLEVEL_DEFAULT))
+(select-module compress.zstd)
+
+(define-condition-type <zstd-error> <error> #f)
+
+(inline-stub
+ (declcode "#include \"gauche-zstd.h\"")
+ (initcode (Scm_Init_zstd))
+
+ (define-type <zstd-compressing-port> "ScmPort*" "zstd compressing port"
+   "SCM_ZSTD_COMPRESSING_PORT_P" "SCM_PORT")
+
+ "#define SCM_ZSTD_PORT_P(x) \
+    (SCM_ZSTD_COMPRESSING_PORT_P(x)||SCM_ZSTD_DECOMPRESSING_PORT_P(x))"
+ ;; proxy type; <zstd-port> isn't really a Scheme class.
+ (define-type <zstd-port> "ScmPort*" "zstd compressing or decompressing port"
+   "SCM_ZSTD_PORT_P" "SCM_PORT")
+
+ (define-enum ZSTD_CLEVEL_DEFAULT)
+
+ (define-cproc zstd-version ()
+   (return (SCM_MAKE_STR (ZSTD_versionString))))
+ (define-cproc zstd-min-compression-level () ::<int>
+   (return (ZSTD_minCLevel)))
+ (define-cproc zstd-max-compression-level () ::<int>
+   (return (ZSTD_maxCLevel)))
+
+ (define-cproc open-zstd-compressing-port
+   (drain::<output-port>
+    :key (compression-level::<fixnum> 0)
+         (dictionary #f)
+         (workers::<fixnum> 0)
+         (checksum?::<boolean> #f)
+         (buffer-size::<fixnum> 0)
+         (owner?::<boolean> #f))
+   (return (Scm_MakeZstdCompressingPort drain compression-level dictionary
+                                        workers checksum? buffer-size
+                                        owner?)))
+
+ (define-cproc open-zstd-decompressing-port
+   (source::<input-port>
+    :key (dictionary #f)
+         (buffer-size::<fixnum> 0)
+         (owner?::<boolean> #f))
+   (return (Scm_MakeZstdDecompressingPort source dictionary buffer-size
+                                          owner?)))
+
+ (define-cproc zstd-flush (port::<zstd-compressing-port>) ::<void>
+   Scm_ZstdFlush)
+
+ (define-cproc zstd-total-in (port::<zstd-port>)
+   (return (Scm_MakeIntegerU64 (-> (SCM_PORT_ZSTD_INFO port) total_in))))
+ (define-cproc zstd-total-out (port::<zstd-port>)
+   (return (Scm_MakeIntegerU64 (-> (SCM_PORT_ZSTD_INFO port) total_out))))
+
+ ;; For a compressing port, the ID of the given dictionary; for a
+ ;; decompressing port, the ID the current frame requires.  #f if no
+ ;; dictionary is involved (or it's a raw-content dictionary).
+ (define-cproc zstd-dictionary-id (port::<zstd-port>)
+   (let* ([id::u_int (-> (SCM_PORT_ZSTD_INFO port) dict_id)])
+     (return (?: (== id 0) SCM_FALSE (Scm_MakeIntegerU id)))))
+ )
+
+(define (zstd-compress-string str . args)
+  (call-with-output-string
+    (^p (let1 p2 (apply open-zstd-compressing-port p args)
+          (display str p2)
+          (close-output-port p2)))))
+
+(define (zstd-decompress-string str . args)
+  (port->string (apply open-zstd-decompressing-port
+                       (open-input-string str) args)))
@@ -0,0 +1,198 @@
+/*
+ * binheap.c - min-max heap operations on flat storage
+ *
+ *   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include <gauche.h>
+#include "binheap.h"
+
+/* These are C versions of bh-bubble-up and bh-trickle-down in heap.scm,
+   for heaps whose storage is a uvector, or a vector with the default or
+   real comparator.  See heap.scm for the algorithm.  Indices are 1-based,
+   as in heap.scm.
+
+   Elements of uvectors are compared as C numbers.  Elements of vectors
+   are compared directly if both are fixnums or both are flonums;
+   otherwise the comparison procedure of the comparator is called. */
+
+/* Node i is on a min level iff (integer-length i) is odd. */
+static inline int min_node_p(u_long i)
+{
+    int n = 0;
+    for (; i; i >>= 1) n++;
+    return n & 1;
+}
+
+static inline int obj_cmp(ScmObj a, ScmObj b, ScmObj cmp)
+{
+    if (SCM_INTP(a) && SCM_INTP(b)) {
+        long x = SCM_INT_VALUE(a), y = SCM_INT_VALUE(b);
+        return (x < y)? -1 : (x > y)? 1 : 0;
+    }
+    if (SCM_FLONUMP(a) && SCM_FLONUMP(b)) {
+        double x = SCM_FLONUM_VALUE(a), y = SCM_FLONUM_VALUE(b);
+        return (x < y)? -1 : (x > y)? 1 : 0;
+    }
+    ScmObj r = Scm_ApplyRec2(cmp, a, b);
+    if (!SCM_INTP(r)) {
+        Scm_Error("comparison procedure returned non-fixnum: %S", r);
+    }
+    return (int)SCM_INT_VALUE(r);
+}
+
+#define NUM_CMP(a, b, cmp)  (((a) < (b))? -1 : ((a) > (b))? 1 : 0)
+
+/* ORDERED(maxp, a, b) is (>: a b) if maxp, (<: a b) otherwise. */
+#define DEFINE_HEAP_OPS(name, E, CMP)                                   \
+static inline int ordered_##name(int maxp, E a, E b, ScmObj cmp)        \
+{                                                                       \
+    int c = CMP(a, b, cmp);                                             \
+    return maxp? (c > 0) : (c < 0);                                     \
+}                                                                       \
+                                                                        \
+static void bubble_up_rec_##name(E *S, int maxp, long i, ScmObj cmp)    \
+{                                                                       \
+    while (i > 3) {                                                     \
+        long g = i >> 2;                                                \
+        if (ordered_##name(maxp, S[g-1], S[i-1], cmp)) break;           \
+        E t = S[g-1]; S[g-1] = S[i-1]; S[i-1] = t;                      \
+        i = g;                                                          \
+    }                                                                   \
+}                                                                       \
+                                                                        \
+static void bubble_up_##name(E *S, long i, ScmObj cmp)                  \
+{                                                                       \
+    long p = i >> 1;                                                    \
+    int maxp = !min_node_p(p);                                          \
+    if (ordered_##name(maxp, S[p-1], S[i-1], cmp)) {                    \
+        bubble_up_rec_##name(S, !maxp, i, cmp);                         \
+    } else {                                                            \
+        E t = S[p-1]; S[p-1] = S[i-1]; S[i-1] = t;                      \
+        bubble_up_rec_##name(S, maxp, p, cmp);                          \
+    }                                                                   \
+}                                                                       \
+                                                                        \
+static void trickle_down_##name(E *S, long i, long size, ScmObj cmp)    \
+{                                                                       \
+    int maxp = !min_node_p(i);                                          \
+    for (;;) {                                                          \
+        long pick = i;                                                  \
+        for (int n = 0; n < 6; n++) {                                   \
+            long d = (n < 2)? (i << 1) + n : (i << 2) + n - 2;          \
+            if (d >= size) break;                                       \
+            if (ordered_##name(maxp, S[d-1], S[pick-1], cmp)) pick = d; \
+        }                                                               \
+        if (pick == i) return;                                          \
+        E t = S[pick-1]; S[pick-1] = S[i-1]; S[i-1] = t;                \
+        if (pick < (i << 2)) return;                                    \
+        long p = pick >> 1;                                             \
+        if (!ordered_##name(maxp, S[pick-1], S[p-1], cmp)) {            \
+            t = S[p-1]; S[p-1] = S[pick-1]; S[pick-1] = t;              \
+        }                                                               \
+        i = pick;                                                       \
+    }                                                                   \
+}
+
+DEFINE_HEAP_OPS(obj, ScmObj, obj_cmp)
+DEFINE_HEAP_OPS(s8,  int8_t,   NUM_CMP)
+DEFINE_HEAP_OPS(u8,  uint8_t,  NUM_CMP)
+DEFINE_HEAP_OPS(s16, int16_t,  NUM_CMP)
+DEFINE_HEAP_OPS(u16, uint16_t, NUM_CMP)
+DEFINE_HEAP_OPS(s32, int32_t,  NUM_CMP)
+DEFINE_HEAP_OPS(u32, uint32_t, NUM_CMP)
+DEFINE_HEAP_OPS(s64, int64_t,  NUM_CMP)
+DEFINE_HEAP_OPS(u64, uint64_t, NUM_CMP)
+DEFINE_HEAP_OPS(f32, float,    NUM_CMP)
+DEFINE_HEAP_OPS(f64, double,   NUM_CMP)
+
+int Scm__BinaryHeapNativeP(ScmObj storage)
+{
+    if (SCM_VECTORP(storage)) return TRUE;
+    if (SCM_UVECTORP(storage)) {
+        return Scm_UVectorType(SCM_CLASS_OF(storage)) != SCM_UVECTOR_F16;
+    }
+    return FALSE;
+}
+
+static long storage_length(ScmObj storage)
+{
+    if (SCM_VECTORP(storage)) return SCM_VECTOR_SIZE(storage);
+    if (SCM_UVECTORP(storage)) return SCM_UVECTOR_SIZE(storage);
+    Scm_Error("vector or uvector required, but got: %S", storage);
+    return 0;                   /* dummy */
+}
+
+#define DISPATCH(storage, OP, args)                                     \
+    do {                                                                \
+        void *S_ = (SCM_VECTORP(storage)                                \
+                    ? (void*)SCM_VECTOR_ELEMENTS(storage)               \
+                    : SCM_UVECTOR_ELEMENTS(storage));                   \
+        if (SCM_VECTORP(storage)) { OP(obj, (ScmObj*)S_, args); break; } \
+        switch (Scm_UVectorType(SCM_CLASS_OF(storage))) {               \
+        case SCM_UVECTOR_S8:  OP(s8,  (int8_t*)S_,   args); break;      \
+        case SCM_UVECTOR_U8:  OP(u8,  (uint8_t*)S_,  args); break;      \
+        case SCM_UVECTOR_S16: OP(s16, (int16_t*)S_,  args); break;      \
+        case SCM_UVECTOR_U16: OP(u16, (uint16_t*)S_, args); break;      \
+        case SCM_UVECTOR_S32: OP(s32, (int32_t*)S_,  args); break;      \
+        case SCM_UVECTOR_U32: OP(u32, (uint32_t*)S_, args); break;      \
+        case SCM_UVECTOR_S64: OP(s64, (int64_t*)S_,  args); break;      \
+        case SCM_UVECTOR_U64: OP(u64, (uint64_t*)S_, args); break;      \
+        case SCM_UVECTOR_F32: OP(f32, (float*)S_,    args); break;      \
+        case SCM_UVECTOR_F64: OP(f64, (double*)S_,   args); break;      \
+        default: Scm_Error("unsupported heap storage: %S", storage);    \
+        }                                                               \
+    } while (0)
+
+#define BUBBLE_UP(name, S, args)     bubble_up_##name args(S)
+#define TRICKLE_DOWN(name, S, args)  trickle_down_##name args(S)
+
+void Scm__BinaryHeapBubbleUp(ScmObj storage, long index, ScmObj cmp)
+{
+    if (index < 2 || index > storage_length(storage)) {
+        Scm_Error("heap index out of range: %ld", index);
+    }
+#define ARGS(S) (S, index, cmp)
+    DISPATCH(storage, BUBBLE_UP, ARGS);
+#undef ARGS
+}
+
+void Scm__BinaryHeapTrickleDown(ScmObj storage, long index, long size,
+                                ScmObj cmp)
+{
+    if (index < 1 || size - 1 > storage_length(storage)) {
+        Scm_Error("heap index out of range: %ld", index);
+    }
+    if (index >= size) return;
+#define ARGS(S) (S, index, size, cmp)
+    DISPATCH(storage, TRICKLE_DOWN, ARGS);
+#undef ARGS
+}
@@ -0,0 +1,321 @@
+/*
+ * bloom.c - Bloom filter
+ *
+ *   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bloom.h"
+#include <math.h>
+#include <string.h>
+
+/* Serialized form:
+ *   offset  size
+ *     0      4    magic "GBF\1"
+ *     4      4    number of hashes
+ *     8      8    number of bits
+ *    16      8    seed
+ *    24           bits, as little-endian 64-bit words
+ */
+#define BLOOM_MAGIC       "GBF\1"
+#define BLOOM_HEADER_SIZE 24
+
+/* Number of items hashed at once by the batch operations. */
+#define BLOOM_BATCH 32
+
+#if defined(__GNUC__)
+#define BLOOM_PREFETCH(p, rw)  __builtin_prefetch((p), (rw))
+#define BLOOM_POPCOUNT(w)      __builtin_popcountll(w)
+#else
+#define BLOOM_PREFETCH(p, rw)  /* nothing */
+static int BLOOM_POPCOUNT(uint64_t w)
+{
+    int c = 0;
+    for (; w; w &= w - 1) c++;
+    return c;
+}
+#endif
+
+static void bloom_print(ScmObj obj, ScmPort *port,
+                        ScmWriteContext *ctx)
+{
+    ScmBloomFilter *bf = SCM_BLOOM_FILTER(obj);
+    Scm_Printf(port, "#<bloom-filter %llu bits %u hashes @%p>",
+               (unsigned long long)bf->nbits, bf->nhashes, obj);
+}
+
+static int bloom_compatible_p(ScmBloomFilter *a, ScmBloomFilter *b)
+{
+    return (a->nbits == b->nbits && a->nhashes == b->nhashes
+            && a->seed == b->seed);
+}
+
+static int bloom_compare(ScmObj x, ScmObj y, int equalp)
+{
+    ScmBloomFilter *a = SCM_BLOOM_FILTER(x), *b = SCM_BLOOM_FILTER(y);
+    if (!equalp) {
+        Scm_Error("can't order Bloom filters: %S and %S", x, y);
+    }
+    if (!bloom_compatible_p(a, b)) return 1;
+    return memcmp(a->bits, b->bits, (size_t)(a->nbits / 8)) != 0;
+}
+
+SCM_DEFINE_BUILTIN_CLASS(Scm_BloomFilterClass,
+                         bloom_print, bloom_compare, NULL, NULL,
+                         SCM_CLASS_DEFAULT_CPL);
+
+static ScmBloomFilter *make_bloom(uint64_t nbits, uint32_t nhashes,
+                                  uint64_t seed)
+{
+    if (nbits == 0) Scm_Error("Bloom filter size must be positive");
+    if (nhashes == 0) Scm_Error("Bloom filter needs at least one hash");
+    nbits = (nbits + 63) & ~(uint64_t)63;
+    if (nbits / 8 + BLOOM_HEADER_SIZE > (uint64_t)SCM_SMALL_INT_MAX) {
+        Scm_Error("Bloom filter size too big: %llu bits",
+                  (unsigned long long)nbits);
+    }
+    ScmBloomFilter *bf = SCM_NEW(ScmBloomFilter);
+    SCM_SET_CLASS(bf, SCM_CLASS_BLOOM_FILTER);
+    bf->nbits = nbits;
+    bf->nhashes = nhashes;
+    bf->seed = seed;
+    sketch_salts(seed, bf->salt);
+    bf->bits = SCM_NEW_ATOMIC_ARRAY(uint64_t, nbits / 64);
+    memset(bf->bits, 0, (size_t)(nbits / 8));
+    return bf;
+}
+
+ScmObj Scm_MakeBloomFilter(uint64_t nbits, uint32_t nhashes, uint64_t seed)
+{
+    return SCM_OBJ(make_bloom(nbits, nhashes, seed));
+}
+
+ScmObj Scm_BloomFilterCopy(ScmBloomFilter *bf)
+{
+    ScmBloomFilter *c = make_bloom(bf->nbits, bf->nhashes, bf->seed);
+    memcpy(c->bits, bf->bits, (size_t)(bf->nbits / 8));
+    return SCM_OBJ(c);
+}
+
+void Scm_BloomFilterClear(ScmBloomFilter *bf)
+{
+    memset(bf->bits, 0, (size_t)(bf->nbits / 8));
+}
+
+/*
+ * Bit positions
+ */
+
+/* First position and the step of ITEM. */
+static inline void bloom_hash(ScmBloomFilter *bf, ScmObj item,
+                              uint64_t *pos, uint64_t *step)
+{
+    uint64_t h = sketch_hash(item, bf->salt);
+    uint64_t d = sketch_mix64(h ^ 0x9e3779b97f4a7c15ULL) % bf->nbits;
+    *pos = h % bf->nbits;
+    *step = (d == 0)? 1 : d;
+}
+
+#define BLOOM_NEXT(bf, pos, step)                                       \
+    ((pos) = ((pos) >= (bf)->nbits - (step))                            \
+     ? (pos) - ((bf)->nbits - (step)) : (pos) + (step))
+
+#define BLOOM_WORD(bf, pos)  ((bf)->bits[(pos) >> 6])
+#define BLOOM_MASK(pos)      ((uint64_t)1 << ((pos) & 63))
+
+/* Sets the bits.  Returns TRUE if any of them was clear, i.e. the item
+   wasn't in the filter. */
+static inline int bloom_set(ScmBloomFilter *bf, uint64_t pos, uint64_t step)
+{
+    uint64_t fresh = 0;
+    for (uint32_t i = 0; i < bf->nhashes; i++) {
+        uint64_t m = BLOOM_MASK(pos);
+        fresh |= ~BLOOM_WORD(bf, pos) & m;
+        BLOOM_WORD(bf, pos) |= m;
+        BLOOM_NEXT(bf, pos, step);
+    }
+    return fresh != 0;
+}
+
+static inline int bloom_test(ScmBloomFilter *bf, uint64_t pos, uint64_t step)
+{
+    for (uint32_t i = 0; i < bf->nhashes; i++) {
+        if (!(BLOOM_WORD(bf, pos) & BLOOM_MASK(pos))) return FALSE;
+        BLOOM_NEXT(bf, pos, step);
+    }
+    return TRUE;
+}
+
+int Scm_BloomFilterAdd(ScmBloomFilter *bf, ScmObj item)
+{
+    uint64_t pos, step;
+    bloom_hash(bf, item, &pos, &step);
+    return bloom_set(bf, pos, step);
+}
+
+int Scm_BloomFilterContains(ScmBloomFilter *bf, ScmObj item)
+{
+    uint64_t pos, step;
+    bloom_hash(bf, item, &pos, &step);
+    return bloom_test(bf, pos, step);
+}
+
+/* Batch operations.  We hash a chunk of items first and prefetch
+   all the words their bits fall in, then set or test the bits.  When
+   the filter is much larger than the cache, this lets cache misses of
+   the chunk overlap instead of taking them one by one.
+   Returns the number of items for which set/test returned TRUE.
+   If HEAD is not NULL, a list of the results is accumulated to it. */
+static ScmSmallInt bloom_batch(ScmBloomFilter *bf, ScmObj items, int add,
+                               ScmObj *head, ScmObj *tail)
+{
+    uint64_t pos[BLOOM_BATCH], step[BLOOM_BATCH];
+    ScmSmallInt count = 0;
+    sketch_iter it;
+    sketch_iter_init(&it, items);
+
+    for (;;) {
+        int n = 0;
+        ScmObj item;
+        while (n < BLOOM_BATCH && sketch_iter_next(&it, &item)) {
+            bloom_hash(bf, item, &pos[n], &step[n]);
+            n++;
+        }
+        if (n == 0) break;
+        for (int j = 0; j < n; j++) {
+            uint64_t p = pos[j];
+            for (uint32_t i = 0; i < bf->nhashes; i++) {
+                if (add) BLOOM_PREFETCH(&BLOOM_WORD(bf, p), 1);
+                else     BLOOM_PREFETCH(&BLOOM_WORD(bf, p), 0);
+                BLOOM_NEXT(bf, p, step[j]);
+            }
+        }
+        for (int j = 0; j < n; j++) {
+            int r = add
+                ? bloom_set(bf, pos[j], step[j])
+                : bloom_test(bf, pos[j], step[j]);
+            if (r) count++;
+            if (head) SCM_APPEND1(*head, *tail, SCM_MAKE_BOOL(r));
+        }
+        if (n < BLOOM_BATCH) break;
+    }
+    return count;
+}
+
+/* Returns the number of items that weren't in the filter. */
+ScmSmallInt Scm_BloomFilterAddAll(ScmBloomFilter *bf, ScmObj items)
+{
+    return bloom_batch(bf, items, TRUE, NULL, NULL);
+}
+
+/* Returns a list or a vector of booleans, the same type as ITEMS. */
+ScmObj Scm_BloomFilterQuery(ScmBloomFilter *bf, ScmObj items)
+{
+    ScmObj h = SCM_NIL, t = SCM_NIL;
+    bloom_batch(bf, items, FALSE, &h, &t);
+    if (SCM_VECTORP(items)) return Scm_ListToVector(h, 0, -1);
+    return h;
+}
+
+/*
+ * Merging and statistics
+ */
+
+void Scm_BloomFilterMerge(ScmBloomFilter *dst, ScmBloomFilter *src)
+{
+    if (!bloom_compatible_p(dst, src)) {
+        Scm_Error("can't merge Bloom filters with different size, "
+                  "number of hashes or seed: %S and %S",
+                  SCM_OBJ(dst), SCM_OBJ(src));
+    }
+    uint64_t nw = dst->nbits / 64;
+    for (uint64_t i = 0; i < nw; i++) dst->bits[i] |= src->bits[i];
+}
+
+uint64_t Scm_BloomFilterPopcount(ScmBloomFilter *bf)
+{
+    uint64_t nw = bf->nbits / 64, c = 0;
+    for (uint64_t i = 0; i < nw; i++) c += BLOOM_POPCOUNT(bf->bits[i]);
+    return c;
+}
+
+/* Swamidass & Baldi: n = -(m/k) ln(1 - X/m), where X is the number of
+   set bits. */
+double Scm_BloomFilterEstimatedCount(ScmBloomFilter *bf)
+{
+    double m = (double)bf->nbits;
+    double x = (double)Scm_BloomFilterPopcount(bf);
+    if (x >= m) return HUGE_VAL;
+    return -(m / bf->nhashes) * log(1.0 - x / m);
+}
+
+/*
+ * Serialization
+ */
+
+ScmObj Scm_BloomFilterToU8Vector(ScmBloomFilter *bf)
+{
+    uint64_t nw = bf->nbits / 64;
+    ScmObj v = Scm_MakeU8Vector((ScmSmallInt)(BLOOM_HEADER_SIZE + nw*8), 0);
+    u_char *p = SCM_U8VECTOR_ELEMENTS(v);
+    memcpy(p, BLOOM_MAGIC, 4);
+    sketch_put_u32(p+4, bf->nhashes);
+    sketch_put_u64(p+8, bf->nbits);
+    sketch_put_u64(p+16, bf->seed);
+    p += BLOOM_HEADER_SIZE;
+    for (uint64_t i = 0; i < nw; i++, p += 8) sketch_put_u64(p, bf->bits[i]);
+    return v;
+}
+
+ScmObj Scm_U8VectorToBloomFilter(ScmUVector *v)
+{
+    ScmSmallInt size = SCM_U8VECTOR_SIZE(v);
+    const u_char *p = SCM_U8VECTOR_ELEMENTS(v);
+    if (size < BLOOM_HEADER_SIZE || memcmp(p, BLOOM_MAGIC, 4) != 0) goto bad;
+    uint32_t nhashes = sketch_get_u32(p+4);
+    uint64_t nbits = sketch_get_u64(p+8);
+    uint64_t seed = sketch_get_u64(p+16);
+    if (nhashes == 0 || nbits == 0 || nbits % 64 != 0
+        || nbits / 8 != (uint64_t)(size - BLOOM_HEADER_SIZE)) goto bad;
+
+    ScmBloomFilter *bf = make_bloom(nbits, nhashes, seed);
+    p += BLOOM_HEADER_SIZE;
+    for (uint64_t i = 0; i < nbits / 64; i++, p += 8) {
+        bf->bits[i] = sketch_get_u64(p);
+    }
+    return SCM_OBJ(bf);
+  bad:
+    Scm_Error("invalid serialized Bloom filter: %S", SCM_OBJ(v));
+    return SCM_UNDEFINED;       /* dummy */
+}
+
+void Scm_Init_bloom(ScmModule *mod)
+{
+    Scm_InitStaticClass(&Scm_BloomFilterClass, "<bloom-filter>", mod, NULL, 0);
+}
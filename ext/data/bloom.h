@@ -0,0 +1,79 @@
+/*
+ * bloom.h - Bloom filter
+ *
+ *   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef GAUCHE_DATA_BLOOM_H
+#define GAUCHE_DATA_BLOOM_H
+
+#include "sketch.h"
+
+/* A Bloom filter of NBITS bits with NHASHES hash functions.  The bit
+ * positions of an item are derived from one 64-bit hash by double
+ * hashing (Kirsch & Mitzenmacher): pos_i = (h1 + i*h2) mod NBITS,
+ * computed incrementally so that it doesn't depend on the width of
+ * the machine arithmetic.
+ *
+ * Filters can be merged (OR-ed) if they have the same size, the same
+ * number of hashes and the same seed.
+ */
+
+typedef struct ScmBloomFilterRec {
+    SCM_HEADER;
+    uint64_t nbits;             /* multiple of 64 */
+    uint32_t nhashes;
+    uint64_t seed;
+    u_long   salt[2];
+    uint64_t *bits;
+} ScmBloomFilter;
+
+SCM_CLASS_DECL(Scm_BloomFilterClass);
+#define SCM_CLASS_BLOOM_FILTER   (&Scm_BloomFilterClass)
+#define SCM_BLOOM_FILTER(obj)    ((ScmBloomFilter*)(obj))
+#define SCM_BLOOM_FILTER_P(obj)  SCM_XTYPEP(obj, SCM_CLASS_BLOOM_FILTER)
+
+extern ScmObj Scm_MakeBloomFilter(uint64_t nbits, uint32_t nhashes,
+                                  uint64_t seed);
+extern ScmObj Scm_BloomFilterCopy(ScmBloomFilter *bf);
+extern void   Scm_BloomFilterClear(ScmBloomFilter *bf);
+extern int    Scm_BloomFilterAdd(ScmBloomFilter *bf, ScmObj item);
+extern int    Scm_BloomFilterContains(ScmBloomFilter *bf, ScmObj item);
+extern ScmSmallInt Scm_BloomFilterAddAll(ScmBloomFilter *bf, ScmObj items);
+extern ScmObj Scm_BloomFilterQuery(ScmBloomFilter *bf, ScmObj items);
+extern void   Scm_BloomFilterMerge(ScmBloomFilter *dst, ScmBloomFilter *src);
+extern uint64_t Scm_BloomFilterPopcount(ScmBloomFilter *bf);
+extern double Scm_BloomFilterEstimatedCount(ScmBloomFilter *bf);
+extern ScmObj Scm_BloomFilterToU8Vector(ScmBloomFilter *bf);
+extern ScmObj Scm_U8VectorToBloomFilter(ScmUVector *v);
+
+extern void   Scm_Init_bloom(ScmModule *mod);
+
+#endif /* GAUCHE_DATA_BLOOM_H */
@@ -0,0 +1,115 @@
+;;;
+;;; data.bloom - Bloom filter
+;;;
+;;;   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+;;;
+;;;   Redistribution and use in source and binary forms, with or without
+;;;   modification, are permitted provided that the following conditions
+;;;   are met:
+;;;
+;;;   1. Redistributions of source code must retain the above copyright
+;;;      notice, this list of conditions and the following disclaimer.
+;;;
+;;;   2. Redistributions in binary form must reproduce the above copyright
+;;;      notice, this list of conditions and the following disclaimer in the
+;;;      documentation and/or other materials provided with the distribution.
+;;;
+;;;   3. Neither the name of the authors nor the names of its contributors
+;;;      may be used to endorse or promote products derived from this
+;;;      software without specific prior written permission.
+;;;
+;;;   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+;;;   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+;;;   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+;;;   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+;;;   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+;;;   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+;;;   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+;;;   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+;;;   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+;;;   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+;;;   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+;;;
+
+(define-module data.bloom
+  (use gauche.uvector)
+  (export <bloom-filter> make-bloom-filter bloom-filter?
+          bloom-filter-size bloom-filter-num-hashes bloom-filter-seed
+          bloom-filter-add! bloom-filter-contains?
+          bloom-filter-add-all! bloom-filter-query
+          bloom-filter-copy bloom-filter-clear! bloom-filter-merge!
+          bloom-filter-estimated-count bloom-filter-false-positive-rate
+          bloom-filter->u8vector u8vector->bloom-filter)
+  )
+(select-module data.bloom)
+
+(inline-stub
+ (declcode "#include \"bloom.h\"")
+ (initcode "Scm_Init_bloom(Scm_CurrentModule());")
+
+ (define-type <bloom-filter> "ScmBloomFilter*" "Bloom filter"
+   "SCM_BLOOM_FILTER_P" "SCM_BLOOM_FILTER")
+
+ (define-cproc %make-bloom-filter (nbits nhashes::<uint32> seed)
+   (return (Scm_MakeBloomFilter (Scm_GetIntegerU64 nbits) nhashes
+                                (Scm_GetIntegerU64 seed))))
+
+ (define-cproc bloom-filter? (obj) ::<boolean> SCM_BLOOM_FILTER_P)
+
+ (define-cproc bloom-filter-size (bf::<bloom-filter>)
+   (return (Scm_MakeIntegerU64 (-> bf nbits))))
+ (define-cproc bloom-filter-num-hashes (bf::<bloom-filter>) ::<uint32>
+   (return (-> bf nhashes)))
+ (define-cproc bloom-filter-seed (bf::<bloom-filter>)
+   (return (Scm_MakeIntegerU64 (-> bf seed))))
+
+ (define-cproc bloom-filter-add! (bf::<bloom-filter> item) ::<boolean>
+   Scm_BloomFilterAdd)
+ (define-cproc bloom-filter-contains? (bf::<bloom-filter> item) ::<boolean>
+   Scm_BloomFilterContains)
+ (define-cproc bloom-filter-add-all! (bf::<bloom-filter> items) ::<fixnum>
+   Scm_BloomFilterAddAll)
+ (define-cproc bloom-filter-query (bf::<bloom-filter> items)
+   Scm_BloomFilterQuery)
+
+ (define-cproc bloom-filter-copy (bf::<bloom-filter>) Scm_BloomFilterCopy)
+ (define-cproc bloom-filter-clear! (bf::<bloom-filter>) ::<void>
+   Scm_BloomFilterClear)
+ (define-cproc %bloom-filter-merge! (dst::<bloom-filter> src::<bloom-filter>)
+   ::<void>
+   Scm_BloomFilterMerge)
+
+ (define-cproc %bloom-filter-popcount (bf::<bloom-filter>)
+   (return (Scm_MakeIntegerU64 (Scm_BloomFilterPopcount bf))))
+ (define-cproc bloom-filter-estimated-count (bf::<bloom-filter>) ::<double>
+   Scm_BloomFilterEstimatedCount)
+
+ (define-cproc bloom-filter->u8vector (bf::<bloom-filter>)
+   Scm_BloomFilterToU8Vector)
+ (define-cproc u8vector->bloom-filter (v::<u8vector>)
+   Scm_U8VectorToBloomFilter)
+ )
+
+;; The optimal size for CAPACITY items and the false positive rate P:
+;;   m = -n ln p / (ln 2)^2,  k = (m/n) ln 2
+(define (make-bloom-filter capacity :optional (error-rate 0.01) (seed 0))
+  (unless (and (exact-integer? capacity) (positive? capacity))
+    (error "capacity must be a positive exact integer, but got:" capacity))
+  (unless (and (real? error-rate) (< 0 error-rate 1))
+    (error "error-rate must be a real number between 0 and 1, but got:"
+           error-rate))
+  (let* ([ln2 (log 2)]
+         [m (max 64 (ceiling->exact (/ (* (- capacity) (log error-rate))
+                                      (* ln2 ln2))))]
+         [k (max 1 (round->exact (* (/ m capacity) ln2)))])
+    (%make-bloom-filter m k seed)))
+
+(define (bloom-filter-merge! dst . srcs)
+  (dolist [src srcs] (%bloom-filter-merge! dst src))
+  dst)
+
+;; The probability that an item not in the filter is reported to be in,
+;; given the current number of set bits.
+(define (bloom-filter-false-positive-rate bf)
+  (expt (/ (%bloom-filter-popcount bf) (bloom-filter-size bf))
+        (bloom-filter-num-hashes bf)))
@@ -0,0 +1,216 @@
+;;;
+;;; data.frozen-trie - Compact immutable trie
+;;;
+;;;   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+;;;
+;;;   Redistribution and use in source and binary forms, with or without
+;;;   modification, are permitted provided that the following conditions
+;;;   are met:
+;;;
+;;;   1. Redistributions of source code must retain the above copyright
+;;;      notice, this list of conditions and the following disclaimer.
+;;;
+;;;   2. Redistributions in binary form must reproduce the above copyright
+;;;      notice, this list of conditions and the following disclaimer in the
+;;;      documentation and/or other materials provided with the distribution.
+;;;
+;;;   3. Neither the name of the authors nor the names of its contributors
+;;;      may be used to endorse or promote products derived from this
+;;;      software without specific prior written permission.
+;;;
+;;;   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+;;;   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+;;;   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+;;;   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+;;;   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+;;;   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+;;;   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+;;;   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+;;;   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+;;;   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+;;;   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+;;;
+
+;; An immutable trie from strings, built at once and stored in a few
+;; flat arrays (see ftrie.h).  It takes much less memory than <trie>,
+;; and the serialized image can be used in place, e.g. directly from
+;; a mapped file.
+
+(define-module data.frozen-trie
+  (use gauche.uvector)
+  (use gauche.dictionary)
+  (use data.trie)
+  (export <frozen-trie> make-frozen-trie alist->frozen-trie
+          trie->frozen-trie frozen-trie?
+          frozen-trie-num-entries frozen-trie-exists? frozen-trie-partial-key?
+          frozen-trie-get frozen-trie-longest-match frozen-trie-prefix-matches
+          frozen-trie-common-prefix
+          frozen-trie-common-prefix-keys
+          frozen-trie-common-prefix-values
+          frozen-trie-common-prefix-fold
+          frozen-trie-common-prefix-map
+          frozen-trie-common-prefix-for-each
+          frozen-trie->list frozen-trie-keys frozen-trie-values
+          frozen-trie-fold frozen-trie-map frozen-trie-for-each
+          frozen-trie-key-id frozen-trie-id->key
+          frozen-trie->u8vector u8vector->frozen-trie)
+  )
+(select-module data.frozen-trie)
+
+(inline-stub
+ (declcode "#include \"ftrie.h\"")
+ (initcode "Scm_Init_ftrie(Scm_CurrentModule());")
+
+ (define-type <frozen-trie> "ScmFrozenTrie*" "frozen trie"
+   "SCM_FROZEN_TRIE_P" "SCM_FROZEN_TRIE")
+
+ (define-cproc %make-frozen-trie (keys values) Scm_MakeFrozenTrie)
+
+ (define-cproc frozen-trie? (obj) ::<boolean> SCM_FROZEN_TRIE_P)
+ (define-cproc frozen-trie-num-entries (t::<frozen-trie>) ::<uint32>
+   (return (-> t nkeys)))
+
+ ;; These return a key id, or -1 (or a list of ids).
+ (define-cproc %frozen-trie-lookup (t::<frozen-trie> key::<string>)
+   ::<fixnum> Scm_FrozenTrieLookup)
+ (define-cproc %frozen-trie-longest (t::<frozen-trie> s::<string>
+                                     start::<fixnum>)
+   ::<fixnum> Scm_FrozenTrieLongestMatch)
+ (define-cproc %frozen-trie-prefixes (t::<frozen-trie> s::<string>
+                                      start::<fixnum>)
+   Scm_FrozenTriePrefixMatches)
+ (define-cproc %frozen-trie-range (t::<frozen-trie> prefix::<string>)
+   Scm_FrozenTriePrefixRange)
+ (define-cproc %frozen-trie-value (t::<frozen-trie> id::<fixnum>)
+   Scm_FrozenTrieValue)
+ (define-cproc frozen-trie-id->key (t::<frozen-trie> id::<fixnum>)
+   Scm_FrozenTrieKey)
+
+ (define-cproc frozen-trie->u8vector (t::<frozen-trie>)
+   Scm_FrozenTrieToU8Vector)
+ (define-cproc u8vector->frozen-trie (v::<u8vector> :optional (values #f))
+   Scm_U8VectorToFrozenTrie)
+ )
+
+;;;===========================================================
+;;; Constructors
+;;;
+
+;; KEYS is a list or a vector of strings, in any order.  If VALUES is
+;; omitted, the value of each key is its id.
+(define (make-frozen-trie keys :optional (values #f))
+  (%make-frozen-trie keys values))
+
+(define (alist->frozen-trie alist)
+  (%make-frozen-trie (map car alist) (map cdr alist)))
+
+(define (trie->frozen-trie trie)
+  (alist->frozen-trie (trie->list trie)))
+
+;;;===========================================================
+;;; Lookup
+;;;
+
+(define (%no-key key)
+  (error "frozen trie doesn't have an entry for the key:" key))
+
+;; Returns the id of KEY, or #f.
+(define (frozen-trie-key-id t key)
+  (let1 id (%frozen-trie-lookup t key)
+    (and (>= id 0) id)))
+
+(define (frozen-trie-exists? t key)
+  (>= (%frozen-trie-lookup t key) 0))
+
+(define (frozen-trie-get t key . opt)
+  (let1 id (%frozen-trie-lookup t key)
+    (cond [(>= id 0) (%frozen-trie-value t id)]
+          [(pair? opt) (car opt)]
+          [else (%no-key key)])))
+
+;; True if PREFIX is a proper prefix of some key.
+(define (frozen-trie-partial-key? t prefix)
+  (let1 r (%frozen-trie-range t prefix)
+    (> (- (cdr r) (car r)) (if (frozen-trie-exists? t prefix) 1 0))))
+
+;; Returns (key . value) of the longest key that is a prefix of S, which
+;; starts from START-th character.  Like trie-longest-match, FALLBACK is
+;; returned if there's no such key, or an error is raised.
+(define (frozen-trie-longest-match t s :optional (fallback (undefined))
+                                   (start 0))
+  (let1 id (%frozen-trie-longest t s start)
+    (cond [(>= id 0) (%entry t id)]
+          [(undefined? fallback) (%no-key s)]
+          [else fallback])))
+
+;; Returns a list of (key . value) of all the keys that are prefixes of
+;; S from START-th character, shorter ones first.  This is what we need
+;; to build a lattice for tokenization.
+(define (frozen-trie-prefix-matches t s :optional (start 0))
+  (map (cut %entry t <>) (%frozen-trie-prefixes t s start)))
+
+(define (%entry t id)
+  (cons (frozen-trie-id->key t id) (%frozen-trie-value t id)))
+
+;;;===========================================================
+;;; Scanning
+;;;
+
+;; The keys sharing a prefix have consecutive ids, in the order of
+;; string<?.  We scan them backwards so that the collecting procedures
+;; return the keys in order.
+
+(define (frozen-trie-common-prefix-fold t prefix proc seed)
+  (let1 r (%frozen-trie-range t prefix)
+    (let loop ([id (- (cdr r) 1)] [seed seed])
+      (if (< id (car r))
+        seed
+        (loop (- id 1)
+              (proc (frozen-trie-id->key t id) (%frozen-trie-value t id)
+                    seed))))))
+
+(define (frozen-trie-common-prefix t prefix)
+  (frozen-trie-common-prefix-fold t prefix acons '()))
+
+(define (frozen-trie-common-prefix-keys t prefix)
+  (frozen-trie-common-prefix-fold t prefix (^[k v s] (cons k s)) '()))
+
+(define (frozen-trie-common-prefix-values t prefix)
+  (frozen-trie-common-prefix-fold t prefix (^[k v s] (cons v s)) '()))
+
+(define (frozen-trie-common-prefix-map t prefix proc)
+  (frozen-trie-common-prefix-fold t prefix
+                                  (^[k v s] (cons (proc k v) s)) '()))
+
+(define (frozen-trie-common-prefix-for-each t prefix proc)
+  (let1 r (%frozen-trie-range t prefix)
+    (do ([id (car r) (+ id 1)])
+        [(>= id (cdr r)) (undefined)]
+      (proc (frozen-trie-id->key t id) (%frozen-trie-value t id)))))
+
+(define (frozen-trie-fold t proc seed)
+  (frozen-trie-common-prefix-fold t "" proc seed))
+(define (frozen-trie->list t)
+  (frozen-trie-common-prefix t ""))
+(define (frozen-trie-keys t)
+  (frozen-trie-common-prefix-keys t ""))
+(define (frozen-trie-values t)
+  (frozen-trie-common-prefix-values t ""))
+(define (frozen-trie-map t proc)
+  (frozen-trie-common-prefix-map t "" proc))
+(define (frozen-trie-for-each t proc)
+  (frozen-trie-common-prefix-for-each t "" proc))
+
+;;;===========================================================
+;;; Dictionary framework
+;;;
+
+(define-dict-interface <frozen-trie>
+  :get      frozen-trie-get
+  :exists?  frozen-trie-exists?
+  :fold     frozen-trie-fold
+  :for-each frozen-trie-for-each
+  :map      frozen-trie-map
+  :keys     frozen-trie-keys
+  :values   frozen-trie-values
+  :->alist  frozen-trie->list)
@@ -0,0 +1,636 @@
+/*
+ * ftrie.c - Frozen trie
+ *
+ *   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ftrie.h"
+#include <string.h>
+
+/* Serialized form, all fields little-endian:
+ *   offset  size
+ *     0      4    magic "GFT\1"
+ *     4      4    number of slots (N)
+ *     8      4    number of keys (K)
+ *    12      4    size of the key pool (P)
+ *    16     4N    BASE
+ *           4N    CHECK
+ *        4(K+1)   OFFSETS
+ *            P    key pool
+ */
+#define FTRIE_MAGIC       "GFT\1"
+#define FTRIE_HEADER_SIZE 16
+
+#define FTRIE_FREE   (-1)       /* CHECK of an unused slot */
+#define FTRIE_ROOT   (-2)       /* CHECK of the root, slot 0 */
+#define FTRIE_NCODES 257        /* terminal + 256 bytes */
+
+static void ftrie_print(ScmObj obj, ScmPort *port, ScmWriteContext *ctx)
+{
+    ScmFrozenTrie *t = SCM_FROZEN_TRIE(obj);
+    Scm_Printf(port, "#<frozen-trie %u keys @%p>", t->nkeys, obj);
+}
+
+SCM_DEFINE_BUILTIN_CLASS(Scm_FrozenTrieClass,
+                         ftrie_print, NULL, NULL, NULL,
+                         SCM_CLASS_DICTIONARY_CPL);
+
+static ScmFrozenTrie *make_ftrie(void)
+{
+    ScmFrozenTrie *t = SCM_NEW(ScmFrozenTrie);
+    SCM_SET_CLASS(t, SCM_CLASS_FROZEN_TRIE);
+    t->nslots = t->nkeys = 0;
+    t->base = t->check = NULL;
+    t->offsets = NULL;
+    t->pool = NULL;
+    t->storage = SCM_FALSE;
+    t->values = SCM_FALSE;
+    return t;
+}
+
+/*
+ * Building
+ */
+
+typedef struct ft_key_rec {
+    const u_char *ptr;
+    uint32_t len;
+    ScmSmallInt index;          /* position in the given sequence */
+} ft_key;
+
+static int ft_key_cmp(const void *x, const void *y)
+{
+    const ft_key *a = (const ft_key*)x, *b = (const ft_key*)y;
+    uint32_t n = (a->len < b->len)? a->len : b->len;
+    int r = memcmp(a->ptr, b->ptr, n);
+    if (r != 0) return r;
+    return (a->len < b->len)? -1 : (a->len > b->len)? 1 : 0;
+}
+
+typedef struct ft_builder_rec {
+    int32_t *base;
+    int32_t *check;
+    uint32_t cap;
+    uint32_t nslots;            /* 1 + the largest slot used */
+    /* Unused slots are kept in a doubly linked list, where we look for
+       the place of the first child of a node. */
+    int32_t *next;
+    int32_t *prev;              /* -2 if the slot isn't in the list */
+    u_char  *tries;             /* # of failed attempts at the slot */
+    int32_t head, tail;         /* -1 if the list is empty */
+} ft_builder;
+
+/* A slot that failed this many times is dropped from the free list,
+   though it can still take a child other than the first.  Otherwise
+   densely packed regions would be scanned over and over. */
+#define FTRIE_MAX_TRIES 16
+
+typedef struct ft_task_rec {
+    uint32_t slot;
+    uint32_t lo, hi;            /* key ids in the subtree */
+    uint32_t depth;
+} ft_task;
+
+#define FT_GROW(type, arr, ncap, n)                             \
+    do {                                                        \
+        type *d_ = SCM_NEW_ATOMIC_ARRAY(type, ncap);            \
+        if (n) memcpy(d_, arr, sizeof(type)*(n));               \
+        arr = d_;                                               \
+    } while (0)
+
+static void ft_reserve(ft_builder *b, uint64_t n)
+{
+    if (n <= b->cap) return;
+    if (n > (uint64_t)INT32_MAX) {
+        Scm_Error("frozen trie too big: more than %d slots", INT32_MAX);
+    }
+    uint64_t ncap = (uint64_t)b->cap * 2;
+    if (ncap < n) ncap = n;
+    if (ncap > (uint64_t)INT32_MAX) ncap = INT32_MAX;
+    FT_GROW(int32_t, b->base, ncap, b->cap);
+    FT_GROW(int32_t, b->check, ncap, b->cap);
+    FT_GROW(int32_t, b->next, ncap, b->cap);
+    FT_GROW(int32_t, b->prev, ncap, b->cap);
+    FT_GROW(u_char, b->tries, ncap, b->cap);
+    for (uint32_t i = b->cap; i < ncap; i++) {
+        b->base[i] = 0;
+        b->check[i] = FTRIE_FREE;
+        b->tries[i] = 0;
+        b->next[i] = -1;
+        b->prev[i] = b->tail;
+        if (b->tail >= 0) b->next[b->tail] = (int32_t)i;
+        else b->head = (int32_t)i;
+        b->tail = (int32_t)i;
+    }
+    b->cap = (uint32_t)ncap;
+}
+
+static void ft_unlink(ft_builder *b, uint32_t s)
+{
+    int32_t n = b->next[s], p = b->prev[s];
+    if (p == -2) return;
+    if (p >= 0) b->next[p] = n; else b->head = n;
+    if (n >= 0) b->prev[n] = p; else b->tail = p;
+    b->prev[s] = -2;
+}
+
+/* Finds a base where all CODES (ascending) land on free slots. */
+static uint32_t ft_find_base(ft_builder *b, const int *codes, int ncodes)
+{
+    int32_t pos = b->head;
+    for (;;) {
+        if (pos < 0) {
+            /* No room; extending the arrays adds free slots. */
+            uint32_t cap = b->cap;
+            ft_reserve(b, (uint64_t)cap + FTRIE_NCODES);
+            pos = (int32_t)cap;
+            continue;
+        }
+        if (pos > codes[0]) {
+            uint32_t base = (uint32_t)(pos - codes[0]);
+            ft_reserve(b, (uint64_t)base + FTRIE_NCODES);
+            int k;
+            for (k = 1; k < ncodes; k++) {
+                if (b->check[base + codes[k]] != FTRIE_FREE) break;
+            }
+            if (k == ncodes) return base;
+        }
+        int32_t nextpos = b->next[pos];
+        if (++b->tries[pos] >= FTRIE_MAX_TRIES) ft_unlink(b, pos);
+        pos = nextpos;
+    }
+}
+
+static inline int ft_code(const ft_key *k, uint32_t depth)
+{
+    return (k->len == depth)? 0 : k->ptr[depth] + 1;
+}
+
+static void ft_build(ScmFrozenTrie *t, const ft_key *keys, uint32_t nkeys)
+{
+    ft_builder b;
+    b.base = b.check = b.next = b.prev = NULL;
+    b.tries = NULL;
+    b.cap = 0;
+    b.head = b.tail = -1;
+    ft_reserve(&b, FTRIE_NCODES + 1);
+    b.check[0] = FTRIE_ROOT;
+    ft_unlink(&b, 0);
+    b.nslots = 1;
+
+    ScmSmallInt sp = 0, stack_cap = 64;
+    ft_task *stack = SCM_NEW_ATOMIC_ARRAY(ft_task, stack_cap);
+    stack[sp++] = (ft_task){0, 0, nkeys, 0};
+
+    int codes[FTRIE_NCODES];
+    uint32_t starts[FTRIE_NCODES+1];
+
+    while (sp > 0) {
+        ft_task task = stack[--sp];
+        if (task.hi - task.lo == 1 && task.slot != 0) {
+            b.base[task.slot] = -(int32_t)task.lo - 1;   /* leaf */
+            continue;
+        }
+        if (task.hi == task.lo) continue; /* empty trie */
+
+        int ncodes = 0;
+        for (uint32_t i = task.lo; i < task.hi; ) {
+            int c = ft_code(&keys[i], task.depth);
+            codes[ncodes] = c;
+            starts[ncodes++] = i;
+            for (i++; i < task.hi && ft_code(&keys[i], task.depth) == c; i++)
+                ;
+        }
+        starts[ncodes] = task.hi;
+
+        uint32_t base = ft_find_base(&b, codes, ncodes);
+        b.base[task.slot] = (int32_t)base;
+        if (sp + ncodes > stack_cap) {
+            ScmSmallInt ncap = (sp + ncodes) * 2;
+            ft_task *ns = SCM_NEW_ATOMIC_ARRAY(ft_task, ncap);
+            memcpy(ns, stack, sizeof(ft_task)*sp);
+            stack = ns;
+            stack_cap = ncap;
+        }
+        for (int k = 0; k < ncodes; k++) {
+            uint32_t s = base + codes[k];
+            b.check[s] = (int32_t)task.slot;
+            ft_unlink(&b, s);
+            if (s >= b.nslots) b.nslots = s + 1;
+            stack[sp++] = (ft_task){s, starts[k], starts[k+1], task.depth+1};
+        }
+    }
+
+    /* Trim the arrays. */
+    int32_t *base = SCM_NEW_ATOMIC_ARRAY(int32_t, b.nslots);
+    int32_t *check = SCM_NEW_ATOMIC_ARRAY(int32_t, b.nslots);
+    memcpy(base, b.base, sizeof(int32_t)*b.nslots);
+    memcpy(check, b.check, sizeof(int32_t)*b.nslots);
+    t->base = base;
+    t->check = check;
+    t->nslots = b.nslots;
+}
+
+/* Keys and values are given as a list or a vector. */
+static ScmSmallInt seq_length(ScmObj seq, const char *what)
+{
+    if (SCM_VECTORP(seq)) return SCM_VECTOR_SIZE(seq);
+    ScmSmallInt n = Scm_Length(seq);
+    if (n < 0) Scm_Error("%s must be a list or a vector, but got: %S",
+                         what, seq);
+    return n;
+}
+
+static ScmObj seq_ref(ScmObj *seq, ScmSmallInt i)
+{
+    if (SCM_VECTORP(*seq)) return SCM_VECTOR_ELEMENT(*seq, i);
+    ScmObj x = SCM_CAR(*seq);
+    *seq = SCM_CDR(*seq);
+    return x;
+}
+
+ScmObj Scm_MakeFrozenTrie(ScmObj keys, ScmObj values)
+{
+    ScmSmallInt n = seq_length(keys, "keys");
+    if (n > INT32_MAX - 1) Scm_Error("too many keys for a frozen trie");
+    if (!SCM_FALSEP(values) && seq_length(values, "values") != n) {
+        Scm_Error("numbers of keys and values differ: %ld vs %ld",
+                  n, seq_length(values, "values"));
+    }
+
+    ft_key *ks = SCM_NEW_ATOMIC_ARRAY(ft_key, n > 0 ? n : 1);
+    ScmObj kseq = keys;
+    uint64_t poolsize = 0;
+    for (ScmSmallInt i = 0; i < n; i++) {
+        ScmObj k = seq_ref(&kseq, i);
+        if (!SCM_STRINGP(k)) Scm_TypeError("key", "string", k);
+        const ScmStringBody *kb = SCM_STRING_BODY(k);
+        ks[i].ptr = (const u_char*)SCM_STRING_BODY_START(kb);
+        ks[i].len = (uint32_t)SCM_STRING_BODY_SIZE(kb);
+        ks[i].index = i;
+        poolsize += ks[i].len;
+    }
+    if (poolsize > UINT32_MAX) Scm_Error("keys too long for a frozen trie");
+    qsort(ks, n, sizeof(ft_key), ft_key_cmp);
+
+    ScmFrozenTrie *t = make_ftrie();
+    uint32_t *offsets = SCM_NEW_ATOMIC_ARRAY(uint32_t, n+1);
+    u_char *pool = SCM_NEW_ATOMIC_ARRAY(u_char, poolsize > 0 ? poolsize : 1);
+    uint32_t off = 0;
+    for (ScmSmallInt i = 0; i < n; i++) {
+        if (i > 0 && ft_key_cmp(&ks[i-1], &ks[i]) == 0) {
+            Scm_Error("duplicate key for a frozen trie: %S",
+                      Scm_MakeString((const char*)ks[i].ptr, ks[i].len, -1,
+                                     SCM_STRING_COPYING));
+        }
+        offsets[i] = off;
+        memcpy(pool + off, ks[i].ptr, ks[i].len);
+        off += ks[i].len;
+    }
+    offsets[n] = off;
+    t->nkeys = (uint32_t)n;
+    t->offsets = offsets;
+    t->pool = pool;
+
+    if (!SCM_FALSEP(values)) {
+        ScmObj v = Scm_MakeVector(n, SCM_FALSE);
+        ScmObj vs = SCM_VECTORP(values)
+            ? values : Scm_ListToVector(values, 0, -1);
+        for (ScmSmallInt i = 0; i < n; i++) {
+            SCM_VECTOR_ELEMENT(v, i) = SCM_VECTOR_ELEMENT(vs, ks[i].index);
+        }
+        t->values = v;
+    }
+
+    /* The key pointers still point to the given strings; use the pool,
+       which we've just filled in the sorted order. */
+    for (ScmSmallInt i = 0; i < n; i++) ks[i].ptr = pool + offsets[i];
+    ft_build(t, ks, (uint32_t)n);
+    return SCM_OBJ(t);
+}
+
+/* Returns a trie sharing the structure of T, with VALUES (a vector of
+   the size of the keys, or #f). */
+ScmObj Scm_FrozenTrieWithValues(ScmFrozenTrie *t, ScmObj values)
+{
+    if (!SCM_FALSEP(values)
+        && !(SCM_VECTORP(values) && SCM_VECTOR_SIZE(values) == t->nkeys)) {
+        Scm_Error("values must be #f or a vector of %u elements, "
+                  "but got: %S", t->nkeys, values);
+    }
+    ScmFrozenTrie *r = make_ftrie();
+    *r = *t;
+    r->values = values;
+    return SCM_OBJ(r);
+}
+
+/*
+ * Lookup
+ */
+
+static const u_char *string_bytes(ScmString *s, ScmSmallInt start,
+                                  uint32_t *size)
+{
+    const ScmStringBody *b = SCM_STRING_BODY(s);
+    if (start < 0 || start > SCM_STRING_BODY_LENGTH(b)) {
+        Scm_Error("start index out of range: %ld", start);
+    }
+    const char *p = (start == 0)
+        ? SCM_STRING_BODY_START(b)
+        : Scm_StringBodyPosition(b, start);
+    *size = (uint32_t)(SCM_STRING_BODY_SIZE(b)
+                       - (p - SCM_STRING_BODY_START(b)));
+    return (const u_char*)p;
+}
+
+/* The child of slot S by CODE, or -1.  This is the only place we follow
+   BASE, so an invalid image can't make us read out of the arrays. */
+static inline int64_t ft_child(const ScmFrozenTrie *t, uint32_t s, int code)
+{
+    int64_t c = (int64_t)t->base[s] + code;
+    if (c < 0 || c >= t->nslots || t->check[c] != (int32_t)s) return -1;
+    return c;
+}
+
+/* The key id of a leaf, or -1 if S isn't a leaf. */
+static inline int64_t ft_leaf(const ScmFrozenTrie *t, uint32_t s)
+{
+    int64_t b = t->base[s];
+    if (b >= 0 || -b - 1 >= t->nkeys) return -1;
+    return -b - 1;
+}
+
+/* Whether the key ID matches the DEPTH bytes we've followed and then
+   P[DEPTH..LEN).  If PREFIXP, the key only needs to be a prefix of P. */
+static inline int ft_key_match(const ScmFrozenTrie *t, int64_t id,
+                               const u_char *p, uint32_t len,
+                               uint32_t depth, int prefixp)
+{
+    uint32_t off = t->offsets[id], klen = t->offsets[id+1] - off;
+    if (klen < depth) return FALSE;
+    if (prefixp ? klen > len : klen != len) return FALSE;
+    return memcmp(t->pool + off + depth, p + depth, klen - depth) == 0;
+}
+
+ScmSmallInt Scm_FrozenTrieLookup(ScmFrozenTrie *t, ScmString *key)
+{
+    uint32_t len;
+    const u_char *p = string_bytes(key, 0, &len);
+    if (t->nslots == 0) return -1;
+    uint32_t s = 0;
+    for (uint32_t d = 0; ; d++) {
+        int64_t id = ft_leaf(t, s);
+        if (id >= 0) return ft_key_match(t, id, p, len, d, FALSE)? id : -1;
+        int64_t c = ft_child(t, s, (d == len)? 0 : p[d] + 1);
+        if (c < 0) return -1;
+        if (d == len) {
+            id = ft_leaf(t, (uint32_t)c);
+            return (id >= 0 && ft_key_match(t, id, p, len, d, FALSE))? id : -1;
+        }
+        s = (uint32_t)c;
+    }
+}
+
+/* Walks down along S[START..], calling PROC with the id of each key
+   that is a prefix of it, shorter ones first. */
+static void ft_prefixes(ScmFrozenTrie *t, ScmString *str, ScmSmallInt start,
+                        void (*proc)(int64_t, void*), void *data)
+{
+    uint32_t len;
+    const u_char *p = string_bytes(str, start, &len);
+    if (t->nslots == 0) return;
+    uint32_t s = 0;
+    for (uint32_t d = 0; ; d++) {
+        int64_t id = ft_leaf(t, s);
+        if (id >= 0) {
+            if (ft_key_match(t, id, p, len, d, TRUE)) proc(id, data);
+            return;
+        }
+        int64_t c = ft_child(t, s, 0);
+        if (c >= 0 && (id = ft_leaf(t, (uint32_t)c)) >= 0
+            && ft_key_match(t, id, p, len, d, TRUE)) {
+            proc(id, data);
+        }
+        if (d == len) return;
+        if ((c = ft_child(t, s, p[d] + 1)) < 0) return;
+        s = (uint32_t)c;
+    }
+}
+
+static void longest_cb(int64_t id, void *data)
+{
+    *(ScmSmallInt*)data = (ScmSmallInt)id;
+}
+
+ScmSmallInt Scm_FrozenTrieLongestMatch(ScmFrozenTrie *t, ScmString *s,
+                                       ScmSmallInt start)
+{
+    ScmSmallInt id = -1;
+    ft_prefixes(t, s, start, longest_cb, &id);
+    return id;
+}
+
+static void collect_cb(int64_t id, void *data)
+{
+    ScmObj *ht = (ScmObj*)data;
+    SCM_APPEND1(ht[0], ht[1], SCM_MAKE_INT(id));
+}
+
+/* Returns a list of ids of the keys that are prefixes of S[START..],
+   shorter ones first. */
+ScmObj Scm_FrozenTriePrefixMatches(ScmFrozenTrie *t, ScmString *s,
+                                   ScmSmallInt start)
+{
+    ScmObj ht[2] = { SCM_NIL, SCM_NIL };
+    ft_prefixes(t, s, start, collect_cb, ht);
+    return ht[0];
+}
+
+/* Compares the first PLEN bytes of the key ID with P. */
+static int ft_prefix_cmp(const ScmFrozenTrie *t, uint32_t id,
+                         const u_char *p, uint32_t plen)
+{
+    uint32_t off = t->offsets[id], klen = t->offsets[id+1] - off;
+    uint32_t n = (klen < plen)? klen : plen;
+    int r = memcmp(t->pool + off, p, n);
+    if (r != 0) return r;
+    return (klen < plen)? -1 : 0;
+}
+
+/* Returns (LO . HI), where the keys with PREFIX have the ids LO <= id < HI.
+   The keys are sorted, so we just look for both ends. */
+ScmObj Scm_FrozenTriePrefixRange(ScmFrozenTrie *t, ScmString *prefix)
+{
+    uint32_t plen;
+    const u_char *p = string_bytes(prefix, 0, &plen);
+    uint32_t lo = 0, hi = t->nkeys;
+    while (lo < hi) {           /* first key >= prefix */
+        uint32_t m = lo + (hi - lo) / 2;
+        if (ft_prefix_cmp(t, m, p, plen) < 0) lo = m + 1;
+        else hi = m;
+    }
+    uint32_t start = lo;
+    hi = t->nkeys;
+    while (lo < hi) {           /* first key that doesn't have prefix */
+        uint32_t m = lo + (hi - lo) / 2;
+        if (ft_prefix_cmp(t, m, p, plen) == 0) lo = m + 1;
+        else hi = m;
+    }
+    return Scm_Cons(Scm_MakeIntegerU(start), Scm_MakeIntegerU(lo));
+}
+
+static void check_id(ScmFrozenTrie *t, ScmSmallInt id)
+{
+    if (id < 0 || id >= (ScmSmallInt)t->nkeys) {
+        Scm_Error("key id out of range: %ld", id);
+    }
+}
+
+ScmObj Scm_FrozenTrieKey(ScmFrozenTrie *t, ScmSmallInt id)
+{
+    check_id(t, id);
+    uint32_t off = t->offsets[id];
+    return Scm_MakeString((const char*)t->pool + off,
+                          t->offsets[id+1] - off, -1, SCM_STRING_COPYING);
+}
+
+ScmObj Scm_FrozenTrieValue(ScmFrozenTrie *t, ScmSmallInt id)
+{
+    check_id(t, id);
+    if (SCM_FALSEP(t->values)) return SCM_MAKE_INT(id);
+    return SCM_VECTOR_ELEMENT(t->values, id);
+}
+
+/*
+ * Serialization
+ */
+
+static void put_u32(u_char *p, uint32_t v)
+{
+    for (int i=0; i<4; i++) p[i] = (u_char)(v >> (i*8));
+}
+
+static uint32_t get_u32(const u_char *p)
+{
+    uint32_t v = 0;
+    for (int i=3; i>=0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+ScmObj Scm_FrozenTrieToU8Vector(ScmFrozenTrie *t)
+{
+    uint32_t poolsize = t->offsets ? t->offsets[t->nkeys] : 0;
+    uint64_t size = FTRIE_HEADER_SIZE + (uint64_t)t->nslots * 8
+        + ((uint64_t)t->nkeys + 1) * 4 + poolsize;
+    if (size > (uint64_t)SCM_SMALL_INT_MAX) {
+        Scm_Error("frozen trie too big to serialize: %S", SCM_OBJ(t));
+    }
+    ScmObj v = Scm_MakeU8Vector((ScmSmallInt)size, 0);
+    u_char *p = SCM_U8VECTOR_ELEMENTS(v);
+    memcpy(p, FTRIE_MAGIC, 4);
+    put_u32(p+4, t->nslots);
+    put_u32(p+8, t->nkeys);
+    put_u32(p+12, poolsize);
+    p += FTRIE_HEADER_SIZE;
+    for (uint32_t i = 0; i < t->nslots; i++, p += 4) {
+        put_u32(p, (uint32_t)t->base[i]);
+    }
+    for (uint32_t i = 0; i < t->nslots; i++, p += 4) {
+        put_u32(p, (uint32_t)t->check[i]);
+    }
+    for (uint32_t i = 0; i <= t->nkeys; i++, p += 4) {
+        put_u32(p, t->offsets ? t->offsets[i] : 0);
+    }
+    if (poolsize > 0) memcpy(p, t->pool, poolsize);
+    return v;
+}
+
+/* On little-endian platforms, we use the arrays in V as they are if
+   they are aligned, e.g. V is a view of a mapped file.  V must not be
+   modified afterwards.  Otherwise we decode them into fresh arrays. */
+ScmObj Scm_U8VectorToFrozenTrie(ScmUVector *v, ScmObj values)
+{
+    ScmSmallInt size = SCM_U8VECTOR_SIZE(v);
+    const u_char *p = SCM_U8VECTOR_ELEMENTS(v);
+    if (size < FTRIE_HEADER_SIZE || memcmp(p, FTRIE_MAGIC, 4) != 0) goto bad;
+    uint32_t nslots = get_u32(p+4), nkeys = get_u32(p+8);
+    uint32_t poolsize = get_u32(p+12);
+    if (nslots == 0 || (uint64_t)nslots * 8 + ((uint64_t)nkeys + 1) * 4
+        + poolsize + FTRIE_HEADER_SIZE != (uint64_t)size) goto bad;
+
+    ScmFrozenTrie *t = make_ftrie();
+    t->nslots = nslots;
+    t->nkeys = nkeys;
+    const u_char *a = p + FTRIE_HEADER_SIZE;
+    const u_char *pool = a + (uint64_t)nslots * 8 + ((uint64_t)nkeys + 1) * 4;
+#if !WORDS_BIGENDIAN
+    if (((uintptr_t)a & 3) == 0) {
+        t->base = (const int32_t*)a;
+        t->check = (const int32_t*)(a + (uint64_t)nslots * 4);
+        t->offsets = (const uint32_t*)(a + (uint64_t)nslots * 8);
+        t->pool = pool;
+        t->storage = SCM_OBJ(v);
+    } else
+#endif /*!WORDS_BIGENDIAN*/
+    {
+        int32_t *base = SCM_NEW_ATOMIC_ARRAY(int32_t, nslots);
+        int32_t *check = SCM_NEW_ATOMIC_ARRAY(int32_t, nslots);
+        uint32_t *offsets = SCM_NEW_ATOMIC_ARRAY(uint32_t, nkeys+1);
+        u_char *pl = SCM_NEW_ATOMIC_ARRAY(u_char, poolsize > 0? poolsize : 1);
+        for (uint32_t i = 0; i < nslots; i++, a += 4) {
+            base[i] = (int32_t)get_u32(a);
+        }
+        for (uint32_t i = 0; i < nslots; i++, a += 4) {
+            check[i] = (int32_t)get_u32(a);
+        }
+        for (uint32_t i = 0; i <= nkeys; i++, a += 4) {
+            offsets[i] = get_u32(a);
+        }
+        memcpy(pl, pool, poolsize);
+        t->base = base;
+        t->check = check;
+        t->offsets = offsets;
+        t->pool = pl;
+    }
+    /* The lookup code trusts the offsets; check them once here. */
+    if (t->offsets[0] != 0 || t->offsets[nkeys] != poolsize) goto bad;
+    for (uint32_t i = 0; i < nkeys; i++) {
+        if (t->offsets[i] > t->offsets[i+1]) goto bad;
+    }
+    return Scm_FrozenTrieWithValues(t, values);
+  bad:
+    Scm_Error("invalid serialized frozen trie: %S", SCM_OBJ(v));
+    return SCM_UNDEFINED;       /* dummy */
+}
+
+void Scm_Init_ftrie(ScmModule *mod)
+{
+    Scm_InitStaticClass(&Scm_FrozenTrieClass, "<frozen-trie>", mod, NULL, 0);
+}
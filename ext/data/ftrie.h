@@ -0,0 +1,94 @@
+/*
+ * ftrie.h - Frozen trie
+ *
+ *   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef GAUCHE_DATA_FTRIE_H
+#define GAUCHE_DATA_FTRIE_H
+
+#include <gauche.h>
+#include <gauche/extend.h>
+#include <stdint.h>
+
+/* A frozen trie is an immutable map from strings to values, built in
+ * bulk.  The keys are sorted by their UTF-8 bytes (the order of string<?)
+ * and numbered from 0; we call the number the key id.
+ *
+ * The branching part of the trie is a double array over bytes:
+ * a child of node S by byte C is T = BASE[S] + C + 1 if CHECK[T] == S,
+ * and T = BASE[S] + 0 is the terminal of a key that ends at S.
+ * A subtree that has just one key is cut into a leaf, whose BASE is
+ * -(id+1); the rest of the key is compared with the key pool.  The key
+ * pool has all the keys concatenated in order, and OFFSETS[id] is where
+ * the key starts; OFFSETS[nkeys] is the size of the pool.
+ *
+ * Since the ids are in key order, the keys sharing a prefix have
+ * consecutive ids, so we can enumerate them by a range.
+ *
+ * The arrays can be used in place of a serialized image on
+ * little-endian platforms, so a trie loaded from a mapped file
+ * doesn't copy anything.  STORAGE keeps the image alive then.
+ */
+
+typedef struct ScmFrozenTrieRec {
+    SCM_HEADER;
+    uint32_t nslots;
+    uint32_t nkeys;
+    const int32_t  *base;
+    const int32_t  *check;
+    const uint32_t *offsets;
+    const u_char   *pool;
+    ScmObj storage;             /* u8vector we share, or #f */
+    ScmObj values;              /* vector of values, or #f if ids are vals */
+} ScmFrozenTrie;
+
+SCM_CLASS_DECL(Scm_FrozenTrieClass);
+#define SCM_CLASS_FROZEN_TRIE   (&Scm_FrozenTrieClass)
+#define SCM_FROZEN_TRIE(obj)    ((ScmFrozenTrie*)(obj))
+#define SCM_FROZEN_TRIE_P(obj)  SCM_XTYPEP(obj, SCM_CLASS_FROZEN_TRIE)
+
+extern ScmObj Scm_MakeFrozenTrie(ScmObj keys, ScmObj values);
+extern ScmObj Scm_FrozenTrieWithValues(ScmFrozenTrie *t, ScmObj values);
+extern ScmSmallInt Scm_FrozenTrieLookup(ScmFrozenTrie *t, ScmString *key);
+extern ScmSmallInt Scm_FrozenTrieLongestMatch(ScmFrozenTrie *t,
+                                              ScmString *s,
+                                              ScmSmallInt start);
+extern ScmObj Scm_FrozenTriePrefixMatches(ScmFrozenTrie *t, ScmString *s,
+                                          ScmSmallInt start);
+extern ScmObj Scm_FrozenTriePrefixRange(ScmFrozenTrie *t, ScmString *prefix);
+extern ScmObj Scm_FrozenTrieKey(ScmFrozenTrie *t, ScmSmallInt id);
+extern ScmObj Scm_FrozenTrieValue(ScmFrozenTrie *t, ScmSmallInt id);
+extern ScmObj Scm_FrozenTrieToU8Vector(ScmFrozenTrie *t);
+extern ScmObj Scm_U8VectorToFrozenTrie(ScmUVector *v, ScmObj values);
+
+extern void   Scm_Init_ftrie(ScmModule *mod);
+
+#endif /* GAUCHE_DATA_FTRIE_H */
@@ -1,7 +1,7 @@
 ;;;
 ;;;  data.heap - Heaps
 ;;;
-;;;   Copyright (c) 2014-2015  Shiro Kawai  <shiro@acm.org>
+;;;   Copyright (c) 2014-2016  Shiro Kawai  <shiro@acm.org>
 ;;;
 ;;;   Redistribution and use in source and binary forms, with or without
 ;;;   modification, are permitted provided that the following conditions
@@ -34,6 +34,7 @@
 (define-module data.heap
   (use gauche.sequence)
   (use gauche.uvector)
+  (use gauche.record)
   (use srfi-1)
   (export <binary-heap>
           make-binary-heap build-binary-heap
@@ -46,9 +47,22 @@
           binary-heap-pop-min! binary-heap-pop-max!
           binary-heap-swap-min! binary-heap-swap-max!
           binary-heap-find binary-heap-remove! binary-heap-delete!
+          binary-heap-update! binary-heap-handle-item
           ))
 (select-module data.heap)
 
+(inline-stub
+ "#include \"binheap.h\""
+
+ (define-cproc %bh-native-storage? (storage) ::<boolean>
+   (return (Scm__BinaryHeapNativeP storage)))
+ (define-cproc %bh-native-bubble-up! (storage index::<long> cmp) ::<void>
+   (Scm__BinaryHeapBubbleUp storage index cmp))
+ (define-cproc %bh-native-trickle-down! (storage index::<long> size::<long>
+                                         cmp) ::<void>
+   (Scm__BinaryHeapTrickleDown storage index size cmp))
+ )
+
 ;; we use sparse-vector by default; we just make it autoload
 ;; so that the tests won't depend on data.sparse.
 (autoload data.sparse make-sparse-vector <sparse-vector-base>
@@ -79,6 +93,17 @@
 ;; Backing storage can be either a flat vector (vector, uvector) or
 ;; a sparse vector.  If it is a flat vector, the heap has maximum size
 ;; (we don't extend the buffer automatically).
+;;
+;; If the storage is a flat vector and the comparator is either
+;; default-comparator or real-comparator, bubbling up and trickling down
+;; are done in C (binheap.c).  The 'native' slot of the heap keeps
+;; the comparison procedure in that case, and #f otherwise.
+;;
+;; If the heap is created with :handles #t, each item is wrapped by
+;; a handle that knows its current position in the storage, so that
+;; a specific entry can be updated or deleted in O(log n).  The storage
+;; is wrapped by <handle-storage>, which adjusts the indices of the
+;; handles whenever they're moved.
 
 (define-inline (Ix x) (- x 1)) ; convert 1-base to 0-base
 
@@ -103,33 +128,82 @@
    (>:         :init-keyword :>:) ; cached greater-than proc
    (storage    :init-keyword :storage)
    (next-leaf  :init-keyword :next-leaf :init-value 1)  ; next leaf index
+   (native     :init-keyword :native :init-value #f) ; comparison proc or #f
+   (handles    :init-keyword :handles :init-value #f) ; #t if handles are used
    ))
 
+;; Handles
+(define-record-type bh-handle %make-bh-handle bh-handle?
+  (item  binary-heap-handle-item bh-handle-item-set!)
+  (index bh-handle-index bh-handle-index-set!)) ; 1-based, #f if removed
+
+(define-class <handle-storage> ()
+  ((storage :init-keyword :storage)))
+
+(define-method ref ((s <handle-storage>) i) (~ s'storage i))
+(define-method (setter ref) ((s <handle-storage>) i v)
+  (set! (~ s'storage i) v)
+  (when (bh-handle? v) (bh-handle-index-set! v (+ i 1))))
+
+(define (bh-raw-storage storage)
+  (if (is-a? storage <handle-storage>) (~ storage'storage) storage))
+
+;; Returns an item stored in the storage
+(define-inline (bh-item hp x)
+  (if (~ hp'handles) (binary-heap-handle-item x) x))
+
+;; Returns an item removed from the heap, invalidating its handle.
+(define (bh-release hp x)
+  (if (~ hp'handles)
+    (begin (bh-handle-index-set! x #f) (binary-heap-handle-item x))
+    x))
+
+(define (bh-compare-procs comparator)
+  (ecase (comparator-flavor comparator)
+    [(ordering) (values (comparator-ordering-predicate comparator)
+                        (^[a b] (>? comparator a b)))]
+    [(comparison) (values (^[a b] (<? comparator a b))
+                          (^[a b] (>? comparator a b)))]))
+
+(define (bh-native-proc comparator storage)
+  (and (or (eq? comparator default-comparator)
+           (eq? comparator real-comparator))
+       (%bh-native-storage? storage)
+       (comparator-comparison-procedure comparator)))
+
 (define (make-binary-heap :key (comparator default-comparator)
                                (storage (make-sparse-vector))
-                               (key identity))
+                               (key identity)
+                               (handles #f))
   (unless (comparator-ordered? comparator)
     (error "make-binary-heap requires ordered comparator, \
             but got:" comparator))
-  (receive (<: >:)
-      (ecase (comparator-flavor comparator)
-        [(ordering) (values (comparator-ordering-predicate comparator)
-                            (^[a b] (>? comparator a b)))]
-        [(comparison) (values (^[a b] (<? comparator a b))
-                              (^[a b] (>? comparator a b)))])
+  (unless (or (vector? storage) (uvector? storage)
+              (is-a? storage <sparse-vector-base>))
+    (error "make-binary-heap requires a vector, a uvector \
+            or a sparse vector as a storage, but got:" storage))
+  (when (and handles (uvector? storage))
+    (error "make-binary-heap can't use a uvector storage with handles:"
+           storage))
+  (receive (<: >:) (bh-compare-procs comparator)
     (make <binary-heap> :comparator comparator
-          :storage (if (or (vector? storage) (uvector? storage)
-                           (is-a? storage <sparse-vector-base>))
-                     storage
-                     (error "make-binary-heap requires a vector, a uvector \
-                             or a sparse vector as a storage, but got:"
-                            storage))
+          :storage (if handles
+                     (make <handle-storage> :storage storage)
+                     storage)
           :key key
           :capacity (cond [(vector? storage) (vector-length storage)]
                           [(uvector? storage) (uvector-length storage)]
                           [else +inf.0])
-          :<: <:
-          :>: >:)))
+          :<: (if handles
+                (^[a b] (<: (binary-heap-handle-item a)
+                            (binary-heap-handle-item b)))
+                <:)
+          :>: (if handles
+                (^[a b] (>: (binary-heap-handle-item a)
+                            (binary-heap-handle-item b)))
+                >:)
+          :native (and (not handles) (bh-native-proc comparator storage))
+          :handles (boolean handles))))
 
 ;; heapify 
 (define (build-binary-heap storage :key (num-entries #f)
@@ -152,53 +226,70 @@
                      [else
                       (error "invalid num-entris value for build-binary-heap:"
                              num-entries)])])
-    (receive (<: >:)
-        (ecase (comparator-flavor comparator)
-          [(ordering) (values (comparator-ordering-predicate comparator)
-                              (^[a b] (>? comparator a b)))]
-          [(comparison) (values (^[a b] (<? comparator a b))
-                                (^[a b] (>? comparator a b)))])        
-      (bh-heapify! storage <: >: size)
-      (make <binary-heap> :comparator comparator :storage storage :key key
-            :<: <: :>: >: :next-leaf (+ size 1)
-            :capacity (cond [(vector? storage) (vector-length storage)]
-                            [(uvector? storage) (uvector-length storage)]
-                            [else +inf.0])))))
-
+    (receive (<: >:) (bh-compare-procs comparator)
+      (let1 native (bh-native-proc comparator storage)
+        (bh-heapify! storage <: >: size native)
+        (make <binary-heap> :comparator comparator :storage storage :key key
+              :<: <: :>: >: :next-leaf (+ size 1) :native native
+              :capacity (cond [(vector? storage) (vector-length storage)]
+                              [(uvector? storage) (uvector-length storage)]
+                              [else +inf.0]))))))
+
+;; The copy of a heap with handles gets fresh handles; the handles of
+;; the original heap can't be used for the copy.
 (define (binary-heap-copy hp)
+  (define (copy-storage s)
+    (cond [(vector? s) (vector-copy s)]
+          [(uvector? s) (uvector-copy s)]
+          [(is-a? s <sparse-vector-base>) (sparse-vector-copy s)]
+          [else (error "[internal] binary-heap-copy: invalid storage:" s)]))
   (make <binary-heap>
     :comparator (~ hp'comparator)
-    :storage (let1 s (~ hp'storage)
-               (cond [(vector? s) (vector-copy s)]
-                     [(uvector? s) (uvector-copy s)]
-                     [(is-a? s <sparse-vector-base>) (sparse-vector-copy s)]
-                     [else (error "[internal] binary-heap-copy: invalid storage:" s)]))
+    :storage (if (~ hp'handles)
+               (rlet1 s (make <handle-storage>
+                          :storage (copy-storage (bh-raw-storage
+                                                  (~ hp'storage))))
+                 (do ([i 1 (+ i 1)])
+                     [(>= i (~ hp'next-leaf))]
+                   (set! (~ s (Ix i))
+                         (%make-bh-handle
+                          (binary-heap-handle-item (~ s (Ix i))) i))))
+               (copy-storage (~ hp'storage)))
     :key (~ hp'key)
     :capaticy (~ hp'capacity)
     :<: (~ hp'<:)
     :>: (~ hp'>:)
-    :next-leaf (~ hp'next-leaf)))
+    :next-leaf (~ hp'next-leaf)
+    :native (~ hp'native)
+    :handles (~ hp'handles)))
 
 (define (binary-heap-comparator hp) (~ hp'comparator))
 (define (binary-heap-key-procedure hp) (~ hp'key))
 (define (binary-heap-capacity hp) (~ hp'capacity))
 
 (define (binary-heap-clear! hp)
-  (set! (~ hp'next-leaf) 1)
-  ;; These are theoretically unnecessary, but works nicely with GC.
-  (let1 st (~ hp'storage)
+  (let1 st (bh-raw-storage (~ hp'storage))
+    (when (~ hp'handles)
+      (do ([i 1 (+ i 1)])
+          [(>= i (~ hp'next-leaf))]
+        (bh-handle-index-set! (~ st (Ix i)) #f)))
+    (set! (~ hp'next-leaf) 1)
+    ;; These are theoretically unnecessary, but works nicely with GC.
     (cond [(vector? st) (vector-fill! st #f)]
           [(is-a? st <sparse-vector-base>) (sparse-vector-clear! st)])))
 
+;; If the heap uses handles, returns the handle of the pushed item.
 (define (binary-heap-push! hp item)
-  (let1 next (~ hp'next-leaf)
+  (let ([next (~ hp'next-leaf)]
+        [entry (if (~ hp'handles) (%make-bh-handle item #f) item)])
     (when (>= (- next 1) (~ hp'capacity))
       (errorf "binary heap ~s is full: couldn't insert ~s" hp item))
     (comparator-check-type (~ hp'comparator) ((~ hp'key) item))
-    (set! (~ hp'storage (Ix next)) item)
+    (set! (~ hp'storage (Ix next)) entry)
     (set! (~ hp'next-leaf) (+ next 1))
     (when (> next 1)
-      (bh-bubble-up (~ hp'storage) (~ hp'<:) (~ hp'>:) next))))
+      (bh-bubble-up (~ hp'storage) (~ hp'<:) (~ hp'>:) next (~ hp'native)))
+    (if (~ hp'handles) entry (undefined))))
 
 (define (binary-heap-num-entries hp) (- (~ hp'next-leaf) 1))
 
@@ -209,28 +300,29 @@
     (if (undefined? fallback)
       (error "binary heap is empty:" hp)
       fallback)
-    (~ hp'storage (Ix 1))))
+    (bh-item hp (~ hp'storage (Ix 1)))))
 
 (define (binary-heap-find-max hp :optional (fallback (undefined)))
   (case (~ hp'next-leaf)
     [(1) (if (undefined? fallback)
            (error "binary heap is empty:" hp)
            fallback)]
-    [(2) (~ hp'storage (Ix 1))]
-    [(3) (~ hp'storage (Ix 2))]
+    [(2) (bh-item hp (~ hp'storage (Ix 1)))]
+    [(3) (bh-item hp (~ hp'storage (Ix 2)))]
     [else (let ([a (~ hp'storage (Ix 2))]
                 [b (~ hp'storage (Ix 3))])
-            (if ((~ hp'>:) a b) a b))]))
+            (bh-item hp (if ((~ hp'>:) a b) a b)))]))
 
 (define (binary-heap-pop-min! hp)
   (let ([nelts (binary-heap-num-entries hp)]
         [storage (~ hp'storage)])
     (when (= nelts 0) (error "binary heap is empty:" hp))
-    (rlet1 r (~ storage (Ix 1))
+    (let1 r (~ storage (Ix 1))
       (set! (~ storage (Ix 1)) (~ storage (Ix nelts)))
       (set! (~ storage (Ix nelts)) *filler*)
       (set! (~ hp'next-leaf) nelts)
-      (bh-trickle-down storage (~ hp'<:) (~ hp'>:) 1 nelts))))
+      (bh-trickle-down storage (~ hp'<:) (~ hp'>:) 1 nelts (~ hp'native))
+      (bh-release hp r))))
 
 (define (binary-heap-pop-max! hp)
   (let ([nelts (binary-heap-num-entries hp)]
@@ -239,72 +331,81 @@
       (set! (~ storage (Ix index)) (~ storage (Ix nelts)))
       (set! (~ storage (Ix nelts)) *filler*)
       (set! (~ hp'next-leaf) nelts)
-      (bh-trickle-down storage (~ hp'<:) (~ hp'>:) index nelts))
+      (bh-trickle-down storage (~ hp'<:) (~ hp'>:) index nelts (~ hp'native)))
     (case nelts
       [(0) (error "binary heap is empty:" hp)]
-      [(1 2) (set! (~ hp'next-leaf) nelts) (~ storage (Ix nelts))]
+      [(1 2) (set! (~ hp'next-leaf) nelts)
+             (bh-release hp (~ storage (Ix nelts)))]
       [else
        (let ([a (~ storage (Ix 2))]
              [b (~ storage (Ix 3))])
          (if ((~ hp'>:) a b)
-           (begin (swap-and-adjust 2) a)
-           (begin (swap-and-adjust 3) b)))])))
+           (begin (swap-and-adjust 2) (bh-release hp a))
+           (begin (swap-and-adjust 3) (bh-release hp b))))])))
 
 ;; (binary-heap-swap-* hp item) is operationally equivalent to
 ;; (rlet1 entry (binary-heap-pop-* hp) (binary-heap-push! hp item))
-;; but it is more efficient.
+;; but it is more efficient.  If the heap uses handles, it is done
+;; exactly as above, for the new item needs a fresh handle.
 (define (binary-heap-swap-min! hp item)
-  (let1 storage (~ hp'storage)
-    (when (binary-heap-empty? hp) (error "binary heap is empty:" hp))
-    (rlet1 r (~ storage (Ix 1))
-      (set! (~ storage (Ix 1)) item)
-      (let1 n (binary-heap-num-entries hp)
-        (when (> n 1)
-          (bh-trickle-down storage (~ hp'<:) (~ hp'>:) 1 (+ n 1)))))))
+  (if (~ hp'handles)
+    (rlet1 r (binary-heap-pop-min! hp) (binary-heap-push! hp item))
+    (let1 storage (~ hp'storage)
+      (when (binary-heap-empty? hp) (error "binary heap is empty:" hp))
+      (rlet1 r (~ storage (Ix 1))
+        (set! (~ storage (Ix 1)) item)
+        (let1 n (binary-heap-num-entries hp)
+          (when (> n 1)
+            (bh-trickle-down storage (~ hp'<:) (~ hp'>:) 1 (+ n 1)
+                             (~ hp'native))))))))
 
 (define (binary-heap-swap-max! hp item)
-  (let ([storage (~ hp'storage)]
-        [nelts (binary-heap-num-entries hp)])
-    (define (store-and-adjust index)
-      (let1 a (~ storage (Ix 1))
-        (set! (~ storage (Ix index)) item)
-        (when ((~ hp'>:) a item)
-          (swap! storage 1 index))
-        (bh-trickle-down storage (~ hp'<:) (~ hp'>:) index (+ nelts 1))))
-    (case nelts
-      [(0) (error "binary heap is empty:" hp)]
-      [(1) (rlet1 r (~ storage (Ix 1))
-             (set! (~ storage (Ix 1)) item))]
-      [(2) (rlet1 r (~ storage (Ix 2))
-             (let1 a (~ storage (Ix 1))
-               (set! (~ storage (Ix 2)) item)
-               (when ((~ hp'>:) a item)
-                 (swap! storage 1 2))))]
-      [else
-       (let ([a (~ storage (Ix 2))]
-             [b (~ storage (Ix 3))])
-         (if ((~ hp'>:) a b)
-           (begin (store-and-adjust 2) a)
-           (begin (store-and-adjust 3) b)))])))
+  (if (~ hp'handles)
+    (rlet1 r (binary-heap-pop-max! hp) (binary-heap-push! hp item))
+    (let ([storage (~ hp'storage)]
+          [nelts (binary-heap-num-entries hp)])
+      (define (store-and-adjust index)
+        (let1 a (~ storage (Ix 1))
+          (set! (~ storage (Ix index)) item)
+          (when ((~ hp'>:) a item)
+            (swap! storage 1 index))
+          (bh-trickle-down storage (~ hp'<:) (~ hp'>:) index (+ nelts 1)
+                           (~ hp'native))))
+      (case nelts
+        [(0) (error "binary heap is empty:" hp)]
+        [(1) (rlet1 r (~ storage (Ix 1))
+               (set! (~ storage (Ix 1)) item))]
+        [(2) (rlet1 r (~ storage (Ix 2))
+               (let1 a (~ storage (Ix 1))
+                 (set! (~ storage (Ix 2)) item)
+                 (when ((~ hp'>:) a item)
+                   (swap! storage 1 2))))]
+        [else
+         (let ([a (~ storage (Ix 2))]
+               [b (~ storage (Ix 3))])
+           (if ((~ hp'>:) a b)
+             (begin (store-and-adjust 2) a)
+             (begin (store-and-adjust 3) b)))]))))
 
 ;; not exactly heap operations, but useful...
 
 (define (binary-heap-find hp pred)
   (and-let* ([storage (~ hp'storage)]
-             [i (find-index (^i (pred (~ storage i)))
+             [i (find-index (^i (pred (bh-item hp (~ storage i))))
                             (liota (binary-heap-num-entries hp)))])
     ;; NB: This i is 0-base, so we don't need Ix.
-    (~ storage i)))
+    (bh-item hp (~ storage i))))
 
 (define (binary-heap-remove! hp pred)
   (let1 storage (~ hp'storage)
 
     (define (finish-up next)
       (unless (= next (~ hp'next-leaf)) ;; some keys are removed
-        (bh-heapify! storage (~ hp'<:) (~ hp'>:) (- next 1))
+        (bh-heapify! storage (~ hp'<:) (~ hp'>:) (- next 1) (~ hp'native))
         (do ([i next (+ i 1)]
              [lim (~ hp'next-leaf)])
             [(>= i lim)]
+          (when (~ hp'handles) (bh-release hp (~ storage (Ix i))))
           (set! (~ hp'storage (Ix i)) *filler*))
         (set! (~ hp'next-leaf) next))
       hp)
@@ -312,7 +413,7 @@
     (let loop ([i 1] [next (~ hp'next-leaf)])
       (if (>= i next)
         (finish-up next)
-        (if (pred (~ storage (Ix i)))
+        (if (pred (bh-item hp (~ storage (Ix i))))
           (if (= (+ i 1) next)
             (finish-up i)  ; this is the last item
             (begin
@@ -321,9 +422,49 @@
           (loop (+ i 1) next))))))
 
 (define (binary-heap-delete! hp item)
-  (let ([cmp (~ hp'comparator)]
-        [key (~ hp'key)])
-    (binary-heap-remove! hp (^e (=? cmp (key item) (key e))))))
+  (if (and (~ hp'handles) (bh-handle? item))
+    (bh-delete-handle! hp item)
+    (let ([cmp (~ hp'comparator)]
+          [key (~ hp'key)])
+      (binary-heap-remove! hp (^e (=? cmp (key item) (key e)))))))
+
+;; Operations on handles
+(define (bh-check-handle hp handle)
+  (unless (~ hp'handles)
+    (error "binary heap doesn't use handles:" hp))
+  (let1 i (and (bh-handle? handle) (bh-handle-index handle))
+    (unless (and i (< i (~ hp'next-leaf))
+                 (eq? (~ hp'storage (Ix i)) handle))
+      (error "invalid handle for the binary heap:" handle))
+    i))
+
+;; Move the entry at INDEX to the right place, after its item is changed.
+(define (bh-adjust! hp index)
+  (let ([storage (~ hp'storage)]
+        [handle (~ hp'storage (Ix index))])
+    (when (> index 1)
+      (bh-bubble-up storage (~ hp'<:) (~ hp'>:) index #f))
+    (when (eqv? (bh-handle-index handle) index)
+      (bh-trickle-down storage (~ hp'<:) (~ hp'>:) index (~ hp'next-leaf) #f))))
+
+(define (binary-heap-update! hp handle item)
+  (let1 i (bh-check-handle hp handle)
+    (comparator-check-type (~ hp'comparator) ((~ hp'key) item))
+    (bh-handle-item-set! handle item)
+    (bh-adjust! hp i)
+    hp))
+
+(define (bh-delete-handle! hp handle)
+  (let ([i (bh-check-handle hp handle)]
+        [last (- (~ hp'next-leaf) 1)]
+        [storage (~ hp'storage)])
+    (unless (= i last)
+      (set! (~ storage (Ix i)) (~ storage (Ix last))))
+    (set! (~ storage (Ix last)) *filler*)
+    (set! (~ hp'next-leaf) last)
+    (bh-release hp handle)
+    (unless (= i last) (bh-adjust! hp i))
+    hp))
 
 ;; Internal procedures
 (define-inline (min-node? index) (odd? (integer-length index)))
@@ -358,7 +499,7 @@
 ;; else we have max node
 
 ;; called with index > 1
-(define (bh-bubble-up storage <: >: index)
+(define (bh-bubble-up storage <: >: index native)
 
   (define (bubble-up-rec >< index)
     (when (> index 3)
@@ -367,29 +508,31 @@
           (swap! storage grandparent-index index)
           (bubble-up-rec >< grandparent-index)))))
 
-  (let1 parent-index (ash index -1)
-    (if (min-node? parent-index)
-      (if (<: (~ storage (Ix parent-index)) (~ storage (Ix index)))
-        (bubble-up-rec >: index)
-        (begin
-          (swap! storage parent-index index)
-          (bubble-up-rec <: parent-index)))
-      (if (>: (~ storage (Ix parent-index)) (~ storage (Ix index)))
-        (bubble-up-rec <: index)
-        (begin
-          (swap! storage parent-index index)
-          (bubble-up-rec >: parent-index))))))
-
-(define (bh-heapify! storage <: >: size)
+  (if native
+    (%bh-native-bubble-up! storage index native)
+    (let1 parent-index (ash index -1)
+      (if (min-node? parent-index)
+        (if (<: (~ storage (Ix parent-index)) (~ storage (Ix index)))
+          (bubble-up-rec >: index)
+          (begin
+            (swap! storage parent-index index)
+            (bubble-up-rec <: parent-index)))
+        (if (>: (~ storage (Ix parent-index)) (~ storage (Ix index)))
+          (bubble-up-rec <: index)
+          (begin
+            (swap! storage parent-index index)
+            (bubble-up-rec >: parent-index)))))))
+
+(define (bh-heapify! storage <: >: size native)
   (do ([i 2 (+ i 1)])
       [(>= i (+ 1 size))]
     (when (is-a? storage <sparse-vector-base>)
       (unless (sparse-vector-exists? storage (Ix i))
         (errorf "can't heapify a sparse vector with a hole (at index ~s): ~s"
                 (Ix i) storage)))
-    (bh-bubble-up storage <: >: i)))
+    (bh-bubble-up storage <: >: i native)))
 
-(define (bh-trickle-down storage <: >: index size)
+(define (bh-trickle-down storage <: >: index size native)
   
   (define-syntax getval (syntax-rules () [(getval i) (~ storage (Ix i))]))
   (define-syntax in-bound? (syntax-rules () [(in-bound? i) (< i size)]))
@@ -429,5 +572,7 @@
             (swap! storage (ash pick -1) pick))
           (trickle-down-rec >< pick)))))
 
-  (trickle-down-rec (if (min-node? index) <: >:) index))
+  (if native
+    (%bh-native-trickle-down! storage index size native)
+    (trickle-down-rec (if (min-node? index) <: >:) index)))
 
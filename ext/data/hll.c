@@ -0,0 +1,250 @@
+/*
+ * hll.c - HyperLogLog cardinality estimator
+ *
+ *   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "hll.h"
+#include <math.h>
+#include <string.h>
+
+/* Serialized form:
+ *   offset  size
+ *     0      4    magic "GHL\1"
+ *     4      4    precision
+ *     8      8    seed
+ *    16           registers, one byte each
+ */
+#define HLL_MAGIC       "GHL\1"
+#define HLL_HEADER_SIZE 16
+
+#if defined(__GNUC__)
+#define HLL_CLZ64(w)   __builtin_clzll(w)
+#else
+static int HLL_CLZ64(uint64_t w)
+{
+    int n = 0;
+    for (; !(w & ((uint64_t)1 << 63)); w <<= 1) n++;
+    return n;
+}
+#endif
+
+static void hll_print(ScmObj obj, ScmPort *port, ScmWriteContext *ctx)
+{
+    Scm_Printf(port, "#<hll precision %d @%p>", SCM_HLL(obj)->precision, obj);
+}
+
+static int hll_compatible_p(ScmHll *a, ScmHll *b)
+{
+    return (a->precision == b->precision && a->seed == b->seed);
+}
+
+static int hll_compare(ScmObj x, ScmObj y, int equalp)
+{
+    ScmHll *a = SCM_HLL(x), *b = SCM_HLL(y);
+    if (!equalp) {
+        Scm_Error("can't order HyperLogLog sketches: %S and %S", x, y);
+    }
+    if (!hll_compatible_p(a, b)) return 1;
+    return memcmp(a->registers, b->registers, SCM_HLL_NUM_REGISTERS(a)) != 0;
+}
+
+SCM_DEFINE_BUILTIN_CLASS(Scm_HllClass,
+                         hll_print, hll_compare, NULL, NULL,
+                         SCM_CLASS_DEFAULT_CPL);
+
+static ScmHll *make_hll(int precision, uint64_t seed)
+{
+    if (precision < SCM_HLL_MIN_PRECISION
+        || precision > SCM_HLL_MAX_PRECISION) {
+        Scm_Error("HyperLogLog precision must be between %d and %d, "
+                  "but got %d",
+                  SCM_HLL_MIN_PRECISION, SCM_HLL_MAX_PRECISION, precision);
+    }
+    ScmHll *h = SCM_NEW(ScmHll);
+    SCM_SET_CLASS(h, SCM_CLASS_HLL);
+    h->precision = precision;
+    h->seed = seed;
+    sketch_salts(seed, h->salt);
+    h->registers = SCM_NEW_ATOMIC_ARRAY(uint8_t, (size_t)1 << precision);
+    memset(h->registers, 0, (size_t)1 << precision);
+    return h;
+}
+
+ScmObj Scm_MakeHll(int precision, uint64_t seed)
+{
+    return SCM_OBJ(make_hll(precision, seed));
+}
+
+ScmObj Scm_HllCopy(ScmHll *h)
+{
+    ScmHll *c = make_hll(h->precision, h->seed);
+    memcpy(c->registers, h->registers, SCM_HLL_NUM_REGISTERS(h));
+    return SCM_OBJ(c);
+}
+
+void Scm_HllClear(ScmHll *h)
+{
+    memset(h->registers, 0, SCM_HLL_NUM_REGISTERS(h));
+}
+
+/* Returns TRUE if the register is updated. */
+static inline int hll_add(ScmHll *h, ScmObj item)
+{
+    uint64_t x = sketch_hash(item, h->salt);
+    int p = h->precision;
+    size_t index = (size_t)(x >> (64 - p));
+    uint64_t w = x << p;
+    /* the rank is in [1, 64-p+1] */
+    uint8_t rank = (uint8_t)(w ? HLL_CLZ64(w) + 1 : 64 - p + 1);
+    if (h->registers[index] < rank) {
+        h->registers[index] = rank;
+        return TRUE;
+    }
+    return FALSE;
+}
+
+int Scm_HllAdd(ScmHll *h, ScmObj item)
+{
+    return hll_add(h, item);
+}
+
+void Scm_HllAddAll(ScmHll *h, ScmObj items)
+{
+    sketch_iter it;
+    ScmObj item;
+    sketch_iter_init(&it, items);
+    while (sketch_iter_next(&it, &item)) hll_add(h, item);
+}
+
+void Scm_HllMerge(ScmHll *dst, ScmHll *src)
+{
+    if (!hll_compatible_p(dst, src)) {
+        Scm_Error("can't merge HyperLogLog sketches with different "
+                  "precision or seed: %S and %S", SCM_OBJ(dst), SCM_OBJ(src));
+    }
+    size_t m = SCM_HLL_NUM_REGISTERS(dst);
+    uint8_t *d = dst->registers;
+    const uint8_t *s = src->registers;
+    for (size_t i = 0; i < m; i++) {
+        if (d[i] < s[i]) d[i] = s[i];
+    }
+}
+
+/*
+ * Estimation
+ */
+
+static double hll_sigma(double x)
+{
+    if (x == 1.0) return HUGE_VAL;
+    double y = 1.0, z = x, zp;
+    do {
+        x *= x;
+        zp = z;
+        z += x * y;
+        y += y;
+    } while (z != zp);
+    return z;
+}
+
+static double hll_tau(double x)
+{
+    if (x == 0.0 || x == 1.0) return 0.0;
+    double y = 1.0, z = 1.0 - x, zp;
+    do {
+        x = sqrt(x);
+        zp = z;
+        y *= 0.5;
+        z -= (1.0 - x) * (1.0 - x) * y;
+    } while (z != zp);
+    return z / 3.0;
+}
+
+double Scm_HllEstimate(ScmHll *h)
+{
+    int q = 64 - h->precision;
+    size_t m = SCM_HLL_NUM_REGISTERS(h);
+    double dm = (double)m;
+    size_t c[64 + 2];
+
+    memset(c, 0, sizeof(c));
+    for (size_t i = 0; i < m; i++) c[h->registers[i]]++;
+
+    double z = dm * hll_tau(1.0 - (double)c[q+1] / dm);
+    for (int k = q; k >= 1; k--) {
+        z = 0.5 * (z + (double)c[k]);
+    }
+    z += dm * hll_sigma((double)c[0] / dm);
+    return (dm * dm / (2.0 * log(2.0))) / z;
+}
+
+/*
+ * Serialization
+ */
+
+ScmObj Scm_HllToU8Vector(ScmHll *h)
+{
+    size_t m = SCM_HLL_NUM_REGISTERS(h);
+    ScmObj v = Scm_MakeU8Vector((ScmSmallInt)(HLL_HEADER_SIZE + m), 0);
+    u_char *p = SCM_U8VECTOR_ELEMENTS(v);
+    memcpy(p, HLL_MAGIC, 4);
+    sketch_put_u32(p+4, (uint32_t)h->precision);
+    sketch_put_u64(p+8, h->seed);
+    memcpy(p + HLL_HEADER_SIZE, h->registers, m);
+    return v;
+}
+
+ScmObj Scm_U8VectorToHll(ScmUVector *v)
+{
+    ScmSmallInt size = SCM_U8VECTOR_SIZE(v);
+    const u_char *p = SCM_U8VECTOR_ELEMENTS(v);
+    if (size < HLL_HEADER_SIZE || memcmp(p, HLL_MAGIC, 4) != 0) goto bad;
+    uint32_t precision = sketch_get_u32(p+4);
+    if (precision < SCM_HLL_MIN_PRECISION
+        || precision > SCM_HLL_MAX_PRECISION
+        || (size_t)(size - HLL_HEADER_SIZE) != ((size_t)1 << precision)) {
+        goto bad;
+    }
+    ScmHll *h = make_hll((int)precision, sketch_get_u64(p+8));
+    memcpy(h->registers, p + HLL_HEADER_SIZE, (size_t)1 << precision);
+    for (size_t i = 0; i < ((size_t)1 << precision); i++) {
+        if (h->registers[i] > 64 - precision + 1) goto bad;
+    }
+    return SCM_OBJ(h);
+  bad:
+    Scm_Error("invalid serialized HyperLogLog sketch: %S", SCM_OBJ(v));
+    return SCM_UNDEFINED;       /* dummy */
+}
+
+void Scm_Init_hll(ScmModule *mod)
+{
+    Scm_InitStaticClass(&Scm_HllClass, "<hll>", mod, NULL, 0);
+}
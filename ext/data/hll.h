@@ -0,0 +1,81 @@
+/*
+ * hll.h - HyperLogLog cardinality estimator
+ *
+ *   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef GAUCHE_DATA_HLL_H
+#define GAUCHE_DATA_HLL_H
+
+#include "sketch.h"
+
+/* HyperLogLog with 2^PRECISION one-byte registers.  An item's 64-bit
+ * hash picks a register by its top PRECISION bits and the rest gives
+ * the register value, which is the position of the leftmost 1 in it.
+ * With 64-bit hashes we don't need the large-range correction of the
+ * original algorithm; the estimate uses Ertl's improved estimator
+ * (O. Ertl, "New cardinality estimation algorithms for HyperLogLog
+ * sketches", 2017), which is unbiased over the whole range without
+ * empirical bias tables.
+ *
+ * Sketches can be merged (register-wise max) if they have the same
+ * precision and seed.
+ */
+
+#define SCM_HLL_MIN_PRECISION  4
+#define SCM_HLL_MAX_PRECISION  18
+
+typedef struct ScmHllRec {
+    SCM_HEADER;
+    int      precision;
+    uint64_t seed;
+    u_long   salt[2];
+    uint8_t *registers;
+} ScmHll;
+
+SCM_CLASS_DECL(Scm_HllClass);
+#define SCM_CLASS_HLL     (&Scm_HllClass)
+#define SCM_HLL(obj)      ((ScmHll*)(obj))
+#define SCM_HLL_P(obj)    SCM_XTYPEP(obj, SCM_CLASS_HLL)
+#define SCM_HLL_NUM_REGISTERS(h)  ((size_t)1 << (h)->precision)
+
+extern ScmObj Scm_MakeHll(int precision, uint64_t seed);
+extern ScmObj Scm_HllCopy(ScmHll *h);
+extern void   Scm_HllClear(ScmHll *h);
+extern int    Scm_HllAdd(ScmHll *h, ScmObj item);
+extern void   Scm_HllAddAll(ScmHll *h, ScmObj items);
+extern void   Scm_HllMerge(ScmHll *dst, ScmHll *src);
+extern double Scm_HllEstimate(ScmHll *h);
+extern ScmObj Scm_HllToU8Vector(ScmHll *h);
+extern ScmObj Scm_U8VectorToHll(ScmUVector *v);
+
+extern void   Scm_Init_hll(ScmModule *mod);
+
+#endif /* GAUCHE_DATA_HLL_H */
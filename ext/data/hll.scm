@@ -0,0 +1,77 @@
+;;;
+;;; data.hll - HyperLogLog cardinality estimator
+;;;
+;;;   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+;;;
+;;;   Redistribution and use in source and binary forms, with or without
+;;;   modification, are permitted provided that the following conditions
+;;;   are met:
+;;;
+;;;   1. Redistributions of source code must retain the above copyright
+;;;      notice, this list of conditions and the following disclaimer.
+;;;
+;;;   2. Redistributions in binary form must reproduce the above copyright
+;;;      notice, this list of conditions and the following disclaimer in the
+;;;      documentation and/or other materials provided with the distribution.
+;;;
+;;;   3. Neither the name of the authors nor the names of its contributors
+;;;      may be used to endorse or promote products derived from this
+;;;      software without specific prior written permission.
+;;;
+;;;   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+;;;   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+;;;   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+;;;   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+;;;   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+;;;   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+;;;   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+;;;   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+;;;   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+;;;   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+;;;   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+;;;
+
+(define-module data.hll
+  (use gauche.uvector)
+  (export <hll> make-hll hll? hll-precision hll-seed
+          hll-add! hll-add-all! hll-estimate hll-standard-error
+          hll-copy hll-clear! hll-merge!
+          hll->u8vector u8vector->hll)
+  )
+(select-module data.hll)
+
+(inline-stub
+ (declcode "#include \"hll.h\"")
+ (initcode "Scm_Init_hll(Scm_CurrentModule());")
+
+ (define-type <hll> "ScmHll*" "HyperLogLog sketch"
+   "SCM_HLL_P" "SCM_HLL")
+
+ (define-cproc make-hll (:optional (precision::<int> 14) (seed 0))
+   (return (Scm_MakeHll precision (Scm_GetIntegerU64 seed))))
+
+ (define-cproc hll? (obj) ::<boolean> SCM_HLL_P)
+ (define-cproc hll-precision (h::<hll>) ::<int> (return (-> h precision)))
+ (define-cproc hll-seed (h::<hll>) (return (Scm_MakeIntegerU64 (-> h seed))))
+
+ (define-cproc hll-add! (h::<hll> item) ::<boolean> Scm_HllAdd)
+ (define-cproc hll-add-all! (h::<hll> items) ::<void> Scm_HllAddAll)
+ (define-cproc %hll-estimate (h::<hll>) ::<double> Scm_HllEstimate)
+
+ (define-cproc hll-copy (h::<hll>) Scm_HllCopy)
+ (define-cproc hll-clear! (h::<hll>) ::<void> Scm_HllClear)
+ (define-cproc %hll-merge! (dst::<hll> src::<hll>) ::<void> Scm_HllMerge)
+
+ (define-cproc hll->u8vector (h::<hll>) Scm_HllToU8Vector)
+ (define-cproc u8vector->hll (v::<u8vector>) Scm_U8VectorToHll)
+ )
+
+(define (hll-estimate h) (round->exact (%hll-estimate h)))
+
+;; Relative standard error of the estimate, 1.04/sqrt(m).
+(define (hll-standard-error h)
+  (/ 1.04 (sqrt (expt 2 (hll-precision h)))))
+
+(define (hll-merge! dst . srcs)
+  (dolist [src srcs] (%hll-merge! dst src))
+  dst)
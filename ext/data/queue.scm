@@ -59,7 +59,13 @@
           find-in-queue remove-from-queue!
           any-in-queue every-in-queue
 
-          enqueue/wait! queue-push/wait! dequeue/wait! queue-pop/wait!)
+          enqueue/wait! queue-push/wait! dequeue/wait! queue-pop/wait!
+
+          <mpmc-queue> make-mpmc-queue mpmc-queue?
+          mpmc-queue-capacity mpmc-queue-length mpmc-queue-empty?
+          mpmc-enqueue! mpmc-dequeue! mpmc-enqueue/wait! mpmc-dequeue/wait!
+          mpmc-enqueue-list! mpmc-dequeue-list!
+          mpmc-enqueue-list/wait! mpmc-dequeue-list/wait!)
   )
 (select-module data.queue)
 
@@ -592,3 +598,348 @@
 ;;
 ;; (define (delete-from-queue! q item)  ;;Scheme48
 ;;   (remove-from-queue! (lambda (elt) (eq? item elt)) q))
+
+;;;
+;;; Lock-free bounded queue
+;;;
+
+;; <mpmc-queue> is a fixed-size ring buffer that multiple producers
+;; and consumers can operate on without taking a lock.   It is a
+;; separate class from <queue>, since it can't support operations that
+;; need to look at or modify the whole content (queue-push!,
+;; remove-from-queue! etc).
+;;
+;; Each cell has a sequence number, which tells the state of the cell
+;; relative to the position of the producer or the consumer.  For the
+;; cell at position POS of the current lap of the ring:
+;;
+;;   seq == POS        the cell is empty, a producer can fill it.
+;;   seq == POS+1      the cell is filled, a consumer can take it.
+;;
+;; A producer claims cells by advancing enqPos with CAS, fills them,
+;; then publishes each one by setting its seq to POS+1.   A consumer
+;; claims cells by advancing deqPos with CAS, takes the values, then
+;; releases each cell for the next lap by setting its seq to
+;; POS+capacity.   Batched operations claim a run of consecutive cells
+;; with a single CAS, after checking every cell in the run is ready.
+;;
+;; Waiting threads park on a mutex and condition variables.  They show
+;; up in numWaitingReaders/Writers, so that the other side only touches
+;; the mutex when someone is actually parked.
+
+(inline-stub
+ "/* See src/lazy.c for why we avoid native atomic ops on these platforms */"
+ "#if defined(__SH4__) || defined(__ARMEL__)"
+ "#define AO_USE_PTHREAD_DEFS 1"
+ "#endif"
+ "#include \"atomic_ops.h\""
+
+ "typedef struct MpmcCellRec {"
+ "  AO_t seq;"
+ "  ScmObj value;"
+ "} MpmcCell;"
+
+ "#define MPMCQ_PAD 64"   ;keep positions on separate cache lines
+
+ "typedef struct MpmcQueueRec {"
+ "  SCM_INSTANCE_HEADER;"
+ "  AO_t mask;"         ;capacity - 1
+ "  MpmcCell *cells;"
+ "  char pad0[MPMCQ_PAD];"
+ "  AO_t enqPos;"
+ "  char pad1[MPMCQ_PAD];"
+ "  AO_t deqPos;"
+ "  char pad2[MPMCQ_PAD];"
+ "  AO_t numWaitingReaders;"
+ "  AO_t numWaitingWriters;"
+ "  ScmInternalMutex mutex;"
+ "  ScmInternalCond readerWait;"
+ "  ScmInternalCond writerWait;"
+ "} MpmcQueue;"
+
+ "SCM_CLASS_DECL(MpmcQueueClass);"
+ "#define MPMCQP(obj)      SCM_ISA(obj, &MpmcQueueClass)"
+ "#define MPMCQ(obj)       ((MpmcQueue*)(obj))"
+ "#define MPMCQ_CELL(q, pos) ((q)->cells + ((pos) & (q)->mask))"
+ "#define MPMCQ_MAX_CAPACITY (1L<<28)"
+ "#define MPMCQ_BATCH 64"   ;max # of items taken at once by batch dequeue
+
+ (define-cfn makempmcq (klass::ScmClass* capacity::long)
+   (unless (and (> capacity 0) (<= capacity MPMCQ_MAX_CAPACITY))
+     (Scm_Error "capacity out of range: %ld" capacity))
+   (let* ([z::MpmcQueue* (SCM_NEW_INSTANCE MpmcQueue klass)]
+          [size::AO_t 2])
+     (while (< size (cast AO_t capacity)) (set! size (<< size 1)))
+     (set! (-> z mask) (- size 1)
+           (-> z cells) (SCM_NEW_ARRAY MpmcCell size))
+     (dotimes [i size]
+       (set! (ref (aref (-> z cells) i) seq) i
+             (ref (aref (-> z cells) i) value) SCM_FALSE))
+     (AO_store_full (& (-> z enqPos)) 0)
+     (AO_store_full (& (-> z deqPos)) 0)
+     (AO_store_full (& (-> z numWaitingReaders)) 0)
+     (AO_store_full (& (-> z numWaitingWriters)) 0)
+     (SCM_INTERNAL_MUTEX_INIT (-> z mutex))
+     (SCM_INTERNAL_COND_INIT (-> z readerWait))
+     (SCM_INTERNAL_COND_INIT (-> z writerWait))
+     (return (SCM_OBJ z))))
+
+ ;; Number of items.  It's a snapshot; it can be stale as soon as
+ ;; it's returned.
+ (define-cfn mpmcq-length (q::MpmcQueue*) ::u_long
+   (let* ([d::AO_t (AO_load_full (& (-> q deqPos)))]
+          [e::AO_t (AO_load_full (& (-> q enqPos)))]
+          [n::long (cast long (- e d))])
+     (cond [(< n 0) (return 0)]
+           [(> n (+ (-> q mask) 1)) (return (+ (-> q mask) 1))]
+           [else (return n)])))
+
+ (define-type <mpmc-queue> "MpmcQueue*" "mpmc-queue" "MPMCQP" "MPMCQ")
+ (define-cclass <mpmc-queue>
+   "MpmcQueue*" "MpmcQueueClass" ()
+   ((capacity :getter "return Scm_MakeIntegerU(MPMCQ(obj)->mask + 1);"
+              :setter #f))
+   (allocator
+    (let* ([c (Scm_GetKeyword ':capacity initargs SCM_UNDEFINED)])
+      (unless (SCM_INTP c) (SCM_TYPE_ERROR c "positive fixnum"))
+      (return (makempmcq klass (SCM_INT_VALUE c)))))
+   (printer
+    (Scm_Printf port "#<mpmc-queue %lu/%lu @%p>"
+                (mpmcq-length (MPMCQ obj)) (+ (-> (MPMCQ obj) mask) 1) obj)))
+
+ (define-cfn mpmcq-add (loc::AO_t* delta::long) ::void
+   (loop
+    (let* ([old::AO_t (AO_load_full loc)])
+      (when (AO_compare_and_swap_full loc old (+ old (cast AO_t delta)))
+        (break)))))
+
+ ;; Claims up to MAX consecutive cells from position *PPOS of the
+ ;; producer (KIND == 0) or consumer (KIND == 1) side.  A cell is ready
+ ;; if its seq is POS (for producers) or POS+1 (for consumers).  Returns
+ ;; the number of claimed cells, and sets *PPOS to the first claimed
+ ;; position.  Returns 0 if the queue is full or empty, respectively.
+ (define-cfn mpmcq-claim (q::MpmcQueue* kind::int max::u_long
+                          ppos::AO_t*) ::u_long
+   (let* ([ptr::AO_t* (?: kind (& (-> q deqPos)) (& (-> q enqPos)))]
+          [pos::AO_t (AO_load_full ptr)])
+     (loop
+      (let* ([n::u_long 0] [diff::long 0])
+        (while (< n max)
+          (let* ([c::MpmcCell* (MPMCQ_CELL q (+ pos n))])
+            (set! diff (cast long (- (AO_load_full (& (-> c seq)))
+                                     (+ pos n kind))))
+            (unless (== diff 0) (break))
+            (inc! n)))
+        (cond [(> n 0)
+               (when (AO_compare_and_swap_full ptr pos (+ pos n))
+                 (set! (* ppos) pos)
+                 (return n))]
+              [(< diff 0) (return 0)])
+        ;; someone else took the position.  retry.
+        (set! pos (AO_load_full ptr))))))
+
+ ;; Fills claimed cell at POS and publishes it.
+ (define-cfn mpmcq-fill (q::MpmcQueue* pos::AO_t obj) ::void
+   (let* ([c::MpmcCell* (MPMCQ_CELL q pos)])
+     (set! (-> c value) obj)
+     (AO_store_full (& (-> c seq)) (+ pos 1))))
+
+ ;; Takes the value of claimed cell at POS and releases the cell.
+ (define-cfn mpmcq-take (q::MpmcQueue* pos::AO_t)
+   (let* ([c::MpmcCell* (MPMCQ_CELL q pos)]
+          [v (-> c value)])
+     (set! (-> c value) SCM_FALSE)      ; to be friendly to GC
+     (AO_store_full (& (-> c seq)) (+ pos (-> q mask) 1))
+     (return v)))
+
+ ;; Enqueues objects from LIST as many as possible, in order.
+ ;; Returns the rest of LIST that couldn't be enqueued.
+ (define-cfn mpmcq-put-list (q::MpmcQueue* lis)
+   (let* ([len::u_long (Scm_Length lis)])
+     (while (> len 0)
+       (let* ([pos::AO_t 0]
+              [n::u_long (mpmcq-claim q 0 len (& pos))])
+         (when (== n 0) (break))
+         (dotimes [i n]
+           (mpmcq-fill q (+ pos i) (SCM_CAR lis))
+           (set! lis (SCM_CDR lis)))
+         (set! len (- len n))))
+     (return lis)))
+
+ ;; Dequeues up to MAX objects (at most MPMCQ_BATCH) into BUF.
+ (define-cfn mpmcq-take-n (q::MpmcQueue* buf::ScmObj* max::u_long) ::u_long
+   (let* ([pos::AO_t 0]
+          [n::u_long (mpmcq-claim q 1 (?: (> max MPMCQ_BATCH) MPMCQ_BATCH max)
+                                  (& pos))])
+     (dotimes [i n] (set! (aref buf i) (mpmcq-take q (+ pos i))))
+     (return n)))
+
+ ;; Wakes up the other side only if someone's waiting.
+ (define-cise-stmt mpmcq-notify
+   [(_ q waiters cv)
+    `(when (> (AO_load_full (& (-> ,q ,waiters))) 0)
+       (SCM_INTERNAL_MUTEX_SAFE_LOCK_BEGIN (-> ,q mutex))
+       (SCM_INTERNAL_COND_BROADCAST (-> ,q ,cv))
+       (SCM_INTERNAL_MUTEX_SAFE_LOCK_END))])
+
+ ;; Same as mpmcq-notify, but to be called while the mutex is held.
+ (define-cise-stmt mpmcq-notify-locked
+   [(_ q waiters cv)
+    `(when (> (AO_load_full (& (-> ,q ,waiters))) 0)
+       (SCM_INTERNAL_COND_BROADCAST (-> ,q ,cv)))])
+
+ ;; (mpmcq-wait Q WAITERS CV TIMEOUT LOCKED TRY-EXPR OK)
+ ;;   Evaluates TRY-EXPR, which returns true when the operation is done,
+ ;;   until it succeeds or TIMEOUT expires.  The fast path doesn't touch
+ ;;   the mutex.  Before parking, we register ourselves in WAITERS and
+ ;;   retry, so that the other side, which checks WAITERS after
+ ;;   publishing its change, can't miss us.  The retry is done while
+ ;;   holding the mutex, and the variable LOCKED is TRUE during that
+ ;;   time, so that TRY-EXPR can use mpmcq-notify-locked.  OK is set
+ ;;   to TRUE iff the operation is done.
+ (define-cise-stmt mpmcq-wait
+   [(_ q waiters cv timeout locked try-expr ok)
+    (let ([ts (gensym)] [pts (gensym)] [status (gensym)] [r (gensym)])
+      `(let* ([,ts :: (ScmTimeSpec)]
+              [,pts :: (ScmTimeSpec*) (Scm_GetTimeSpec ,timeout (& ,ts))]
+              [,status :: int 0])
+         (set! ,ok ,try-expr)
+         (.if "defined(GAUCHE_HAS_THREADS)"
+           (while (not ,ok)
+             (SCM_INTERNAL_MUTEX_SAFE_LOCK_BEGIN (-> ,q mutex))
+             (mpmcq-add (& (-> ,q ,waiters)) 1)
+             (set! ,locked TRUE)
+             (set! ,ok ,try-expr)
+             (set! ,locked FALSE)
+             (unless ,ok
+               (cond [,pts
+                      (let* ([,r :: int
+                              (SCM_INTERNAL_COND_TIMEDWAIT (-> ,q ,cv)
+                                                           (-> ,q mutex)
+                                                           ,pts)])
+                        (cond [(== ,r SCM_INTERNAL_COND_TIMEDOUT)
+                               (set! ,status CW_TIMEDOUT)]
+                              [(== ,r SCM_INTERNAL_COND_INTR)
+                               (set! ,status CW_INTR)]))]
+                     [else
+                      (SCM_INTERNAL_COND_WAIT (-> ,q ,cv) (-> ,q mutex))]))
+             (mpmcq-add (& (-> ,q ,waiters)) -1)
+             (SCM_INTERNAL_MUTEX_SAFE_LOCK_END)
+             (cond [(== ,status CW_TIMEDOUT) (break)]
+                   [(== ,status CW_INTR)
+                    (Scm_SigCheck (Scm_VM)) (set! ,status 0)])))))])
+ )
+
+;; APIs
+(inline-stub
+ (define-cproc make-mpmc-queue (capacity::<fixnum>)
+   (return (makempmcq (& MpmcQueueClass) capacity)))
+
+ (define-cproc mpmc-queue? (obj) ::<boolean> (return (MPMCQP obj)))
+
+ (define-cproc mpmc-queue-capacity (q::<mpmc-queue>) ::<ulong>
+   (return (+ (-> q mask) 1)))
+
+ (define-cproc mpmc-queue-length (q::<mpmc-queue>) ::<ulong>
+   (return (mpmcq-length q)))
+
+ (define-cproc mpmc-queue-empty? (q::<mpmc-queue>) ::<boolean>
+   (return (== (mpmcq-length q) 0)))
+
+ (define-cproc mpmc-enqueue! (q::<mpmc-queue> obj) ::<boolean>
+   (let* ([pos::AO_t 0])
+     (cond [(mpmcq-claim q 0 1 (& pos))
+            (mpmcq-fill q pos obj)
+            (mpmcq-notify q numWaitingReaders readerWait)
+            (return TRUE)]
+           [else (return FALSE)])))
+
+ (define-cproc mpmc-dequeue! (q::<mpmc-queue> :optional fallback)
+   (let* ([pos::AO_t 0])
+     (cond [(mpmcq-claim q 1 1 (& pos))
+            (let* ([r (mpmcq-take q pos)])
+              (mpmcq-notify q numWaitingWriters writerWait)
+              (return r))]
+           [(SCM_UNBOUNDP fallback) (Scm_Error "queue is empty: %S" q)]
+           [else (return fallback)])))
+
+ (define-cproc mpmc-enqueue/wait! (q::<mpmc-queue> obj
+                                   :optional (timeout #f) (timeout-val #f))
+   (let* ([pos::AO_t 0] [ok::int FALSE] [locked::int FALSE])
+     (mpmcq-wait q numWaitingWriters writerWait timeout locked
+                 (mpmcq-claim q 0 1 (& pos)) ok)
+     (cond [ok (mpmcq-fill q pos obj)
+               (mpmcq-notify q numWaitingReaders readerWait)
+               (return '#t)]
+           [else (return timeout-val)])))
+
+ (define-cproc mpmc-dequeue/wait! (q::<mpmc-queue>
+                                   :optional (timeout #f) (timeout-val #f))
+   (let* ([pos::AO_t 0] [ok::int FALSE] [locked::int FALSE])
+     (mpmcq-wait q numWaitingReaders readerWait timeout locked
+                 (mpmcq-claim q 1 1 (& pos)) ok)
+     (cond [ok (let* ([r (mpmcq-take q pos)])
+                 (mpmcq-notify q numWaitingWriters writerWait)
+                 (return r))]
+           [else (return timeout-val)])))
+
+ ;; Batched operations.  A batch is transferred in runs of consecutive
+ ;; cells with one CAS each, and the other side is notified once.
+ (define-cproc mpmc-enqueue-list! (q::<mpmc-queue> lis::<list>)
+   (let* ([rest (mpmcq-put-list q lis)])
+     (unless (SCM_EQ rest lis)
+       (mpmcq-notify q numWaitingReaders readerWait))
+     (return rest)))
+
+ ;; Enqueues as many items in *PLIS as possible and updates *PLIS with
+ ;; the rest.  Returns TRUE if all items are enqueued.
+ (define-cfn mpmcq-put-list-step (q::MpmcQueue* plis::ScmObj* locked::int)
+   ::int
+   (let* ([rest (mpmcq-put-list q (* plis))])
+     (unless (SCM_EQ rest (* plis))
+       (if locked
+         (mpmcq-notify-locked q numWaitingReaders readerWait)
+         (mpmcq-notify q numWaitingReaders readerWait)))
+     (set! (* plis) rest)
+     (return (SCM_NULLP rest))))
+
+ (define-cproc mpmc-enqueue-list/wait! (q::<mpmc-queue> lis::<list>
+                                        :optional (timeout #f)
+                                                  (timeout-val #f))
+   (let* ([ok::int FALSE] [locked::int FALSE])
+     (mpmcq-wait q numWaitingWriters writerWait timeout locked
+                 (mpmcq-put-list-step q (& lis) locked) ok)
+     (return (?: ok '#t timeout-val))))
+
+ (define-cfn mpmcq-take-list (q::MpmcQueue* max::u_long)
+   (let* ([h SCM_NIL] [t SCM_NIL] [cnt::u_long 0]
+          [buf::(.array ScmObj (MPMCQ_BATCH))])
+     (while (< cnt max)
+       (let* ([n::u_long (mpmcq-take-n q buf (- max cnt))])
+         (when (== n 0) (break))
+         (dotimes [i n] (SCM_APPEND1 h t (aref buf i)))
+         (set! cnt (+ cnt n))))
+     (return h)))
+
+ (define-cproc mpmc-dequeue-list! (q::<mpmc-queue> :optional (max #f))
+   (let* ([r (mpmcq-take-list q (?: (SCM_INTP max)
+                                    (cast u_long (SCM_INT_VALUE max))
+                                    (+ (-> q mask) 1)))])
+     (unless (SCM_NULLP r) (mpmcq-notify q numWaitingWriters writerWait))
+     (return r)))
+
+ ;; Waits until at least one item is available, then takes up to MAX.
+ (define-cproc mpmc-dequeue-list/wait! (q::<mpmc-queue>
+                                        :optional (max #f) (timeout #f)
+                                                  (timeout-val #f))
+   (let* ([n::u_long (?: (SCM_INTP max)
+                         (cast u_long (SCM_INT_VALUE max))
+                         (+ (-> q mask) 1))]
+          [r SCM_NIL] [ok::int FALSE] [locked::int FALSE])
+     (when (== n 0) (return SCM_NIL))
+     (mpmcq-wait q numWaitingReaders readerWait timeout locked
+                 (SCM_PAIRP (set! r (mpmcq-take-list q n))) ok)
+     (cond [ok (mpmcq-notify q numWaitingWriters writerWait)
+               (return r)]
+           [else (return timeout-val)])))
+ )
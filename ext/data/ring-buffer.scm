@@ -0,0 +1,173 @@
+;;;
+;;;  data.ring-buffer - Ring buffers
+;;;
+;;;   Copyright (c) 2015  Shiro Kawai  <shiro@acm.org>
+;;;
+;;;   Redistribution and use in source and binary forms, with or without
+;;;   modification, are permitted provided that the following conditions
+;;;   are met:
+;;;
+;;;   1. Redistributions of source code must retain the above copyright
+;;;      notice, this list of conditions and the following disclaimer.
+;;;
+;;;   2. Redistributions in binary form must reproduce the above copyright
+;;;      notice, this list of conditions and the following disclaimer in the
+;;;      documentation and/or other materials provided with the distribution.
+;;;
+;;;   3. Neither the name of the authors nor the names of its contributors
+;;;      may be used to endorse or promote products derived from this
+;;;      software without specific prior written permission.
+;;;
+;;;   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+;;;   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+;;;   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+;;;   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+;;;   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+;;;   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+;;;   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+;;;   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+;;;   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+;;;   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+;;;   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+;;;
+
+;; The ring buffer itself and its operations are in C (ringbuf.c);
+;; only the overflow handling, which calls back Scheme procedures,
+;; is here.
+
+(define-module data.ring-buffer
+  (use gauche.uvector)
+  (export make-ring-buffer
+          make-overflow-doubler
+          ring-buffer?
+          ring-buffer-empty? ring-buffer-num-entries ring-buffer-capacity
+          ring-buffer-full?
+          ring-buffer-front ring-buffer-back
+          ring-buffer-add-front! ring-buffer-add-back!
+          ring-buffer-remove-front! ring-buffer-remove-back!
+          ring-buffer-ref ring-buffer-set!))
+(select-module data.ring-buffer)
+
+;;
+;;          +-----------+            +-----------+
+;;          |  (vacant) |            |///////////|
+;;          |           |            |///////////|
+;;          +-----------+            |///////////|
+;;    head >|///////////|            +-----------+
+;;          |///////////|      tail >|  (vacant) |
+;;          |///////////|            |           |
+;;          |///////////|            |           |
+;;          +-----------+            |           |
+;;    tail >|  (vacant) |            +-----------+
+;;          |           |      head >|///////////|
+;;          +-----------+            +-----------+
+
+(inline-stub
+ (declcode "#include \"ringbuf.h\"")
+ (initcode "Scm_Init_ringbuf(Scm_CurrentModule());")
+
+ (define-type <ring-buffer> "ScmRingBuffer*" "ring buffer"
+   "SCM_RING_BUFFER_P" "SCM_RING_BUFFER")
+
+ (define-cproc %make-ring-buffer (storage handler) Scm_MakeRingBuffer)
+
+ (define-cproc ring-buffer? (obj) ::<boolean> SCM_RING_BUFFER_P)
+ (define-cproc ring-buffer-num-entries (rb::<ring-buffer>) ::<long>
+   (return (-> rb numEntries)))
+ (define-cproc ring-buffer-capacity (rb::<ring-buffer>) ::<long>
+   (return (-> rb capacity)))
+ (define-cproc ring-buffer-empty? (rb::<ring-buffer>) ::<boolean>
+   (return (== (-> rb numEntries) 0)))
+ (define-cproc ring-buffer-full? (rb::<ring-buffer>) ::<boolean>
+   (return (== (-> rb numEntries) (-> rb capacity))))
+ (define-cproc %ring-buffer-storage (rb::<ring-buffer>)
+   (return (-> rb storage)))
+ (define-cproc %ring-buffer-overflow-handler (rb::<ring-buffer>)
+   (return (-> rb overflowHandler)))
+
+ (define-cproc ring-buffer-front (rb::<ring-buffer>) Scm_RingBufferFront)
+ (define-cproc ring-buffer-back (rb::<ring-buffer>) Scm_RingBufferBack)
+ (define-cproc %ring-buffer-add-front! (rb::<ring-buffer> val) ::<boolean>
+   Scm_RingBufferAddFront)
+ (define-cproc %ring-buffer-add-back! (rb::<ring-buffer> val) ::<boolean>
+   Scm_RingBufferAddBack)
+ (define-cproc ring-buffer-remove-front! (rb::<ring-buffer>)
+   Scm_RingBufferRemoveFront)
+ (define-cproc ring-buffer-remove-back! (rb::<ring-buffer>)
+   Scm_RingBufferRemoveBack)
+ (define-cproc ring-buffer-ref (rb::<ring-buffer> n::<fixnum>
+                                :optional fallback)
+   Scm_RingBufferRef)
+ (define-cproc ring-buffer-set! (rb::<ring-buffer> n::<fixnum> val) ::<void>
+   Scm_RingBufferSet)
+ (define-cproc %ring-buffer-replace-storage! (rb::<ring-buffer> storage)
+   ::<void> Scm_RingBufferReplaceStorage)
+ (define-cproc %ring-buffer-alloc-storage (storage size::<fixnum>)
+   Scm_RingBufferAllocStorage)
+ )
+
+;; predefined overflow handlers
+(define (overflow-error rb v) 'error)
+(define (overflow-overwrite rb v) 'overwrite)
+
+;; API
+(define (make-overflow-doubler :key (max-increase +inf.0)
+                                    (max-capacity +inf.0))
+  (^[rb v]
+    (let1 size (ring-buffer-capacity rb)
+      (cond [(>= size max-capacity) 'error]
+            [(>= size max-increase)
+             (%ring-buffer-alloc-storage v (+ size max-increase))]
+            [else
+             (%ring-buffer-alloc-storage v (* size 2))]))))
+
+;; API
+;; make-ring-buffer
+;;  Returns a ring buffer.
+;;  STORAGE can be vector-like objects.
+;;  OVERFLOW-HANDLER must be a procedure that takes ring buffer instance
+;;    and the current backing storage.  It can perform one of the following
+;;    ops.
+;;
+;;    Returns 'error      - causes the API to throws an error
+;;    Returns 'overwrite  - overwrite existing entries.
+;;    Allocates larger backing storage
+(define (make-ring-buffer :optional (storage (make-vector 4))
+                          :key (overflow-handler (make-overflow-doubler)))
+  (unless (or (vector? storage) (uvector? storage))
+    (error "Ring buffer storage must be a vector-like object, but got:" storage))
+  (let1 h (case overflow-handler
+            [(error) overflow-error]
+            [(overwrite) overflow-overwrite]
+            [else (unless (applicable? overflow-handler <ring-buffer> <top>)
+                    (error "overflow-handler must be a procedure, or a symbol error of overwrite, but got" overflow-handler))
+                  overflow-handler])
+    (%make-ring-buffer storage h)))
+
+(define (%ensure-room! rb)
+  (let1 v ((%ring-buffer-overflow-handler rb) rb (%ring-buffer-storage rb))
+    (case v
+      [(error) (error "Ring buffer overflow:" rb)]
+      [(overwrite)
+       ;; pop the last item so that we can fill it
+       (ring-buffer-remove-front! rb)]
+      [else
+       (unless (or (vector? v) (uvector? v))
+         (error "Ring buffer overflow handler returned invalid object:" v))
+       (%ring-buffer-replace-storage! rb v)])))
+
+;; API
+(define (ring-buffer-add-front! rb elt)
+  (unless (%ring-buffer-add-front! rb elt)
+    (%ensure-room! rb)
+    (unless (%ring-buffer-add-front! rb elt)
+      (error "Ring buffer overflow:" rb)))
+  (undefined))
+
+;; API
+(define (ring-buffer-add-back! rb elt)
+  (unless (%ring-buffer-add-back! rb elt)
+    (%ensure-room! rb)
+    (unless (%ring-buffer-add-back! rb elt)
+      (error "Ring buffer overflow:" rb)))
+  (undefined))
@@ -0,0 +1,297 @@
+/*
+ * ringbuf.c - Ring buffers
+ *
+ *   Copyright (c) 2015  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ringbuf.h"
+#include <string.h>
+
+static void rb_print(ScmObj obj, ScmPort *port, ScmWriteContext *ctx)
+{
+    ScmRingBuffer *rb = SCM_RING_BUFFER(obj);
+    Scm_Printf(port, "#<ring-buffer %ld/%ld @%p>",
+               (long)rb->numEntries, (long)rb->capacity, obj);
+}
+
+SCM_DEFINE_BUILTIN_CLASS(Scm_RingBufferClass,
+                         rb_print, NULL, NULL, NULL,
+                         SCM_CLASS_DEFAULT_CPL);
+
+static int storage_type(ScmObj storage)
+{
+    if (SCM_VECTORP(storage)) return -1;
+    if (SCM_UVECTORP(storage)) {
+        return Scm_UVectorType(SCM_CLASS_OF(storage));
+    }
+    Scm_Error("Ring buffer storage must be a vector-like object, but got: %S",
+              storage);
+    return -1;                  /* dummy */
+}
+
+static ScmSmallInt storage_size(ScmObj storage)
+{
+    if (SCM_VECTORP(storage)) return SCM_VECTOR_SIZE(storage);
+    else return SCM_UVECTOR_SIZE(storage);
+}
+
+/*
+ * Element access
+ */
+
+static inline ScmObj rb_get(ScmRingBuffer *rb, ScmSmallInt i)
+{
+    if (rb->utype < 0) return SCM_VECTOR_ELEMENT(rb->storage, i);
+    return Scm_VMUVectorRef(SCM_UVECTOR(rb->storage), rb->utype, i,
+                            SCM_UNBOUND);
+}
+
+static double get_real(ScmObj val)
+{
+    if (!SCM_REALP(val)) Scm_Error("real number required, but got: %S", val);
+    return Scm_GetDouble(val);
+}
+
+static void rb_put(ScmRingBuffer *rb, ScmSmallInt i, ScmObj val)
+{
+    ScmObj s = rb->storage;
+    switch (rb->utype) {
+    case -1:
+        SCM_VECTOR_ELEMENTS(s)[i] = val; break;
+    case SCM_UVECTOR_S8:
+        SCM_S8VECTOR_ELEMENTS(s)[i] =
+            (signed char)Scm_GetInteger8Clamp(val, SCM_CLAMP_ERROR, NULL);
+        break;
+    case SCM_UVECTOR_U8:
+        SCM_U8VECTOR_ELEMENTS(s)[i] =
+            (u_char)Scm_GetIntegerU8Clamp(val, SCM_CLAMP_ERROR, NULL);
+        break;
+    case SCM_UVECTOR_S16:
+        SCM_S16VECTOR_ELEMENTS(s)[i] =
+            (short)Scm_GetInteger16Clamp(val, SCM_CLAMP_ERROR, NULL);
+        break;
+    case SCM_UVECTOR_U16:
+        SCM_U16VECTOR_ELEMENTS(s)[i] =
+            (u_short)Scm_GetIntegerU16Clamp(val, SCM_CLAMP_ERROR, NULL);
+        break;
+    case SCM_UVECTOR_S32:
+        SCM_S32VECTOR_ELEMENTS(s)[i] =
+            Scm_GetInteger32Clamp(val, SCM_CLAMP_ERROR, NULL);
+        break;
+    case SCM_UVECTOR_U32:
+        SCM_U32VECTOR_ELEMENTS(s)[i] =
+            Scm_GetIntegerU32Clamp(val, SCM_CLAMP_ERROR, NULL);
+        break;
+    case SCM_UVECTOR_S64:
+        SCM_S64VECTOR_ELEMENTS(s)[i] =
+            Scm_GetInteger64Clamp(val, SCM_CLAMP_ERROR, NULL);
+        break;
+    case SCM_UVECTOR_U64:
+        SCM_U64VECTOR_ELEMENTS(s)[i] =
+            Scm_GetIntegerU64Clamp(val, SCM_CLAMP_ERROR, NULL);
+        break;
+    case SCM_UVECTOR_F16:
+        SCM_F16VECTOR_ELEMENTS(s)[i] = Scm_DoubleToHalf(get_real(val));
+        break;
+    case SCM_UVECTOR_F32:
+        SCM_F32VECTOR_ELEMENTS(s)[i] = (float)get_real(val);
+        break;
+    case SCM_UVECTOR_F64:
+        SCM_F64VECTOR_ELEMENTS(s)[i] = get_real(val);
+        break;
+    default:
+        Scm_Error("[internal] bad ring buffer storage: %S", s);
+    }
+}
+
+/* Index arithmetic.  I is in [0, capacity). */
+static inline ScmSmallInt rb_inc(ScmRingBuffer *rb, ScmSmallInt i)
+{
+    return (++i == rb->capacity)? 0 : i;
+}
+
+static inline ScmSmallInt rb_dec(ScmRingBuffer *rb, ScmSmallInt i)
+{
+    return (i == 0)? rb->capacity - 1 : i - 1;
+}
+
+/* N-th entry from the head, 0 <= N < capacity. */
+static inline ScmSmallInt rb_index(ScmRingBuffer *rb, ScmSmallInt n)
+{
+    ScmSmallInt i = rb->head + n;
+    return (i >= rb->capacity)? i - rb->capacity : i;
+}
+
+/*
+ * API
+ */
+
+ScmObj Scm_MakeRingBuffer(ScmObj storage, ScmObj overflowHandler)
+{
+    int utype = storage_type(storage);
+    if (utype >= 0) SCM_UVECTOR_CHECK_MUTABLE(storage);
+
+    ScmRingBuffer *rb = SCM_NEW(ScmRingBuffer);
+    SCM_SET_CLASS(rb, SCM_CLASS_RING_BUFFER);
+    rb->storage = storage;
+    rb->overflowHandler = overflowHandler;
+    rb->utype = utype;
+    rb->head = rb->tail = 0;
+    rb->capacity = storage_size(storage);
+    rb->numEntries = 0;
+    return SCM_OBJ(rb);
+}
+
+static void rb_ensure_nonempty(ScmRingBuffer *rb)
+{
+    if (rb->numEntries == 0) Scm_Error("Ring buffer is empty: %S", rb);
+}
+
+ScmObj Scm_RingBufferFront(ScmRingBuffer *rb)
+{
+    rb_ensure_nonempty(rb);
+    return rb_get(rb, rb->head);
+}
+
+ScmObj Scm_RingBufferBack(ScmRingBuffer *rb)
+{
+    rb_ensure_nonempty(rb);
+    return rb_get(rb, rb_dec(rb, rb->tail));
+}
+
+/* The add operations return FALSE without touching the buffer if it
+   is full, so that the caller can run the overflow handler. */
+int Scm_RingBufferAddFront(ScmRingBuffer *rb, ScmObj val)
+{
+    if (rb->numEntries >= rb->capacity) return FALSE;
+    ScmSmallInt h = rb_dec(rb, rb->head);
+    rb_put(rb, h, val);         /* may throw on a bad value */
+    rb->head = h;
+    rb->numEntries++;
+    return TRUE;
+}
+
+int Scm_RingBufferAddBack(ScmRingBuffer *rb, ScmObj val)
+{
+    if (rb->numEntries >= rb->capacity) return FALSE;
+    rb_put(rb, rb->tail, val);
+    rb->tail = rb_inc(rb, rb->tail);
+    rb->numEntries++;
+    return TRUE;
+}
+
+ScmObj Scm_RingBufferRemoveFront(ScmRingBuffer *rb)
+{
+    rb_ensure_nonempty(rb);
+    ScmObj v = rb_get(rb, rb->head);
+    rb->head = rb_inc(rb, rb->head);
+    rb->numEntries--;
+    return v;
+}
+
+ScmObj Scm_RingBufferRemoveBack(ScmRingBuffer *rb)
+{
+    rb_ensure_nonempty(rb);
+    rb->tail = rb_dec(rb, rb->tail);
+    rb->numEntries--;
+    return rb_get(rb, rb->tail);
+}
+
+ScmObj Scm_RingBufferRef(ScmRingBuffer *rb, ScmSmallInt n, ScmObj fallback)
+{
+    if (n < 0 || n >= rb->numEntries) {
+        if (SCM_UNBOUNDP(fallback)) {
+            Scm_Error("index out of range (%ld) for a ring buffer %S",
+                      (long)n, rb);
+        }
+        return fallback;
+    }
+    return rb_get(rb, rb_index(rb, n));
+}
+
+void Scm_RingBufferSet(ScmRingBuffer *rb, ScmSmallInt n, ScmObj val)
+{
+    if (n < 0 || n >= rb->numEntries) {
+        Scm_Error("index out of range (%ld) for a ring buffer %S",
+                  (long)n, rb);
+    }
+    rb_put(rb, rb_index(rb, n), val);
+}
+
+/* Moves the entries to the beginning of the new STORAGE, which must be
+   of the same type as the current one and have room for them. */
+void Scm_RingBufferReplaceStorage(ScmRingBuffer *rb, ScmObj storage)
+{
+    int utype = storage_type(storage);
+    ScmSmallInt size = storage_size(storage);
+    if (utype != rb->utype) {
+        Scm_Error("Ring buffer overflow handler returned storage of "
+                  "a different type: %S", storage);
+    }
+    if (utype >= 0) SCM_UVECTOR_CHECK_MUTABLE(storage);
+    if (SCM_EQ(storage, rb->storage) || size < rb->numEntries) {
+        Scm_Error("Ring buffer overflow handler must return new storage "
+                  "large enough for the entries, but got: %S", storage);
+    }
+
+    size_t esize = (utype < 0)
+        ? sizeof(ScmObj)
+        : (size_t)Scm_UVectorElementSize(SCM_CLASS_OF(storage));
+    char *src = (utype < 0)
+        ? (char*)SCM_VECTOR_ELEMENTS(rb->storage)
+        : (char*)SCM_UVECTOR_ELEMENTS(rb->storage);
+    char *dst = (utype < 0)
+        ? (char*)SCM_VECTOR_ELEMENTS(storage)
+        : (char*)SCM_UVECTOR_ELEMENTS(storage);
+    ScmSmallInt n1 = rb->capacity - rb->head;
+    if (n1 > rb->numEntries) n1 = rb->numEntries;
+    if (rb->numEntries > 0) {
+        memmove(dst, src + rb->head*esize, n1*esize);
+        memmove(dst + n1*esize, src, (rb->numEntries - n1)*esize);
+    }
+    rb->storage = storage;
+    rb->capacity = size;
+    rb->head = 0;
+    rb->tail = (rb->numEntries == size)? 0 : rb->numEntries;
+}
+
+/* Allocates new storage of the same type as STORAGE. */
+ScmObj Scm_RingBufferAllocStorage(ScmObj storage, ScmSmallInt size)
+{
+    if (storage_type(storage) < 0) return Scm_MakeVector(size, SCM_UNDEFINED);
+    ScmObj v = Scm_MakeUVector(SCM_CLASS_OF(storage), size, NULL);
+    memset(SCM_UVECTOR_ELEMENTS(v), 0, Scm_UVectorSizeInBytes(SCM_UVECTOR(v)));
+    return v;
+}
+
+void Scm_Init_ringbuf(ScmModule *mod)
+{
+    Scm_InitStaticClass(&Scm_RingBufferClass, "<ring-buffer>", mod, NULL, 0);
+}
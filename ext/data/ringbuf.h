@@ -0,0 +1,87 @@
+/*
+ * ringbuf.h - Ring buffers
+ *
+ *   Copyright (c) 2015  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef GAUCHE_DATA_RINGBUF_H
+#define GAUCHE_DATA_RINGBUF_H
+
+#include <gauche.h>
+
+/* A ring buffer on a vector or a uvector STORAGE, which the caller
+ * gives and may replace when the buffer overflows.  Entries are in
+ * STORAGE[head] ... STORAGE[tail-1], wrapping around at the end;
+ * head == tail either when it's empty or full, which is distinguished
+ * by numEntries.
+ *
+ * The indices only move by one, and an index from the head is less
+ * than capacity, so we wrap them with a comparison instead of modulo;
+ * the capacity doesn't need to be a power of two.  Uvector elements
+ * are read and written in place, without going through the generic
+ * dispatch.
+ *
+ * The overflow handler is a Scheme procedure and is dealt with in
+ * ring-buffer.scm; the add operations here just report the buffer
+ * is full.
+ */
+
+typedef struct ScmRingBufferRec {
+    SCM_HEADER;
+    ScmObj storage;
+    ScmObj overflowHandler;
+    int utype;                  /* ScmUVectorType, or -1 for a vector */
+    ScmSmallInt head;
+    ScmSmallInt tail;
+    ScmSmallInt capacity;
+    ScmSmallInt numEntries;
+} ScmRingBuffer;
+
+SCM_CLASS_DECL(Scm_RingBufferClass);
+#define SCM_CLASS_RING_BUFFER     (&Scm_RingBufferClass)
+#define SCM_RING_BUFFER(obj)      ((ScmRingBuffer*)(obj))
+#define SCM_RING_BUFFER_P(obj)    SCM_XTYPEP(obj, SCM_CLASS_RING_BUFFER)
+
+extern ScmObj Scm_MakeRingBuffer(ScmObj storage, ScmObj overflowHandler);
+extern ScmObj Scm_RingBufferFront(ScmRingBuffer *rb);
+extern ScmObj Scm_RingBufferBack(ScmRingBuffer *rb);
+extern int    Scm_RingBufferAddFront(ScmRingBuffer *rb, ScmObj val);
+extern int    Scm_RingBufferAddBack(ScmRingBuffer *rb, ScmObj val);
+extern ScmObj Scm_RingBufferRemoveFront(ScmRingBuffer *rb);
+extern ScmObj Scm_RingBufferRemoveBack(ScmRingBuffer *rb);
+extern ScmObj Scm_RingBufferRef(ScmRingBuffer *rb, ScmSmallInt n,
+                                ScmObj fallback);
+extern void   Scm_RingBufferSet(ScmRingBuffer *rb, ScmSmallInt n, ScmObj val);
+extern void   Scm_RingBufferReplaceStorage(ScmRingBuffer *rb, ScmObj storage);
+extern ScmObj Scm_RingBufferAllocStorage(ScmObj storage, ScmSmallInt size);
+
+extern void   Scm_Init_ringbuf(ScmModule *mod);
+
+#endif /* GAUCHE_DATA_RINGBUF_H */
@@ -0,0 +1,128 @@
+/*
+ * sketch.h - common parts of probabilistic sketches
+ *
+ *   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef GAUCHE_DATA_SKETCH_H
+#define GAUCHE_DATA_SKETCH_H
+
+#include <gauche.h>
+#include <gauche/extend.h>
+#include <stdint.h>
+
+/* Common parts of data.bloom and data.hll.
+ *
+ * Items are hashed with Scm_PortableHash, so that a serialized sketch
+ * stays valid across runs and platforms, and anything equal? gets the
+ * same hash.  Scm_PortableHash yields 32 bits, which is too few for
+ * large sketches: with 10^8 items, distinct items would collide every
+ * few percent.  We call it with two salts derived from the sketch's
+ * seed and mix the two halves into a 64-bit value.
+ */
+
+/* The finalizer of SplitMix64. */
+static inline uint64_t sketch_mix64(uint64_t z)
+{
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static inline void sketch_salts(uint64_t seed, u_long salt[2])
+{
+    uint64_t s = sketch_mix64(seed);
+    salt[0] = (u_long)(s & 0xffffffffUL);
+    salt[1] = (u_long)(s >> 32);
+}
+
+static inline uint64_t sketch_hash(ScmObj obj, const u_long salt[2])
+{
+    uint64_t a = Scm_PortableHash(obj, salt[0]);
+    uint64_t b = Scm_PortableHash(obj, salt[1]);
+    return sketch_mix64((a << 32) | (b & 0xffffffffUL));
+}
+
+/* Serialized sketches are byte vectors with little-endian fields. */
+static inline void sketch_put_u32(u_char *p, uint32_t v)
+{
+    for (int i=0; i<4; i++) p[i] = (u_char)(v >> (i*8));
+}
+
+static inline void sketch_put_u64(u_char *p, uint64_t v)
+{
+    for (int i=0; i<8; i++) p[i] = (u_char)(v >> (i*8));
+}
+
+static inline uint32_t sketch_get_u32(const u_char *p)
+{
+    uint32_t v = 0;
+    for (int i=3; i>=0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+static inline uint64_t sketch_get_u64(const u_char *p)
+{
+    uint64_t v = 0;
+    for (int i=7; i>=0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+/* Iterates over the items of a batch operation, which must be a list
+   or a vector. */
+typedef struct sketch_iter_rec {
+    ScmObj seq;                 /* list: the rest; vector: the vector */
+    ScmSmallInt index;
+} sketch_iter;
+
+static inline void sketch_iter_init(sketch_iter *it, ScmObj seq)
+{
+    if (!SCM_VECTORP(seq) && !SCM_LISTP(seq)) {
+        Scm_TypeError("items", "list or vector", seq);
+    }
+    it->seq = seq;
+    it->index = 0;
+}
+
+/* Returns FALSE when all items are consumed. */
+static inline int sketch_iter_next(sketch_iter *it, ScmObj *item)
+{
+    if (SCM_VECTORP(it->seq)) {
+        if (it->index >= SCM_VECTOR_SIZE(it->seq)) return FALSE;
+        *item = SCM_VECTOR_ELEMENT(it->seq, it->index++);
+        return TRUE;
+    }
+    if (!SCM_PAIRP(it->seq)) return FALSE;
+    *item = SCM_CAR(it->seq);
+    it->seq = SCM_CDR(it->seq);
+    return TRUE;
+}
+
+#endif /* GAUCHE_DATA_SKETCH_H */
@@ -202,7 +202,197 @@
 
 (test* "mtqueue room" +inf.0 (mtqueue-room (make-mtqueue)))
 
+(let1 q (make-mpmc-queue 3)
+  (test* "mpmc-queue?" '(#t #f) (list (mpmc-queue? q) (mpmc-queue? 3)))
+  (test* "mpmc-queue capacity (rounded up)" 4 (mpmc-queue-capacity q))
+  (test* "mpmc-queue-empty?" #t (mpmc-queue-empty? q))
+  (test* "mpmc-enqueue!" '(#t #t #t #t #f)
+         (map (cut mpmc-enqueue! q <>) '(a b c d e)))
+  (test* "mpmc-queue-length" 4 (mpmc-queue-length q))
+  (test* "mpmc-dequeue!" '(a b) (list (mpmc-dequeue! q) (mpmc-dequeue! q)))
+  (test* "mpmc-enqueue! (wrap around)" '(#t #t #f)
+         (map (cut mpmc-enqueue! q <>) '(e f g)))
+  (test* "mpmc-dequeue!" '(c d e f) (list (mpmc-dequeue! q) (mpmc-dequeue! q)
+                                          (mpmc-dequeue! q) (mpmc-dequeue! q)))
+  (test* "mpmc-dequeue! (error)" (test-error) (mpmc-dequeue! q))
+  (test* "mpmc-dequeue! (fallback)" 'none (mpmc-dequeue! q 'none))
+  (test* "mpmc-enqueue-list!" '(e f)
+         (mpmc-enqueue-list! q '(a b c d e f)))
+  (test* "mpmc-dequeue-list! (max)" '(a b) (mpmc-dequeue-list! q 2))
+  (test* "mpmc-enqueue-list!" '() (mpmc-enqueue-list! q '(x y)))
+  (test* "mpmc-dequeue-list!" '(c d x y) (mpmc-dequeue-list! q))
+  (test* "mpmc-dequeue-list! (empty)" '() (mpmc-dequeue-list! q))
+  (test* "mpmc-dequeue/wait! timeout" 'timed-out
+         (mpmc-dequeue/wait! q 0.01 'timed-out))
+  (test* "mpmc-dequeue-list/wait! timeout" 'timed-out
+         (mpmc-dequeue-list/wait! q #f 0.01 'timed-out))
+  (test* "mpmc-enqueue/wait! timeout" 'timed-out
+         (begin (mpmc-enqueue-list! q '(a b c d))
+                (mpmc-enqueue/wait! q 'e 0.01 'timed-out)))
+  (test* "mpmc-enqueue-list/wait! timeout" 'timed-out
+         (mpmc-enqueue-list/wait! q '(e) 0.01 'timed-out))
+  )
+
+(test* "make-mpmc-queue (range)" (test-error) (make-mpmc-queue 0))
+(test* "make <mpmc-queue>" 8
+       (mpmc-queue-capacity (make <mpmc-queue> :capacity 8)))
+
 ;; Note: */wait! APIs are tested in ext/threads/test.scm instead of here,
 ;; since we need threads working.
 
+;;-----------------------------------------------
+(test-section "data.bloom")
+(use data.bloom)
+(use gauche.uvector)
+(test-module 'data.bloom)
+
+(let1 bf (make-bloom-filter 1000 0.01)
+  (test* "bloom-filter?" '(#t #f) (list (bloom-filter? bf) (bloom-filter? 3)))
+  (test* "bloom-filter parameters" '(9600 7)
+         (list (bloom-filter-size bf) (bloom-filter-num-hashes bf)))
+  (test* "bloom-filter-add!" '(#t #f)
+         (list (bloom-filter-add! bf "abc") (bloom-filter-add! bf "abc")))
+  (test* "bloom-filter-contains?" '(#t #f)
+         (list (bloom-filter-contains? bf "abc")
+               (bloom-filter-contains? bf "abd")))
+  (test* "bloom-filter-add-all!" #t
+         (<= 980 (bloom-filter-add-all! bf (list->vector (iota 1000))) 1000))
+  (test* "bloom-filter-query (list)" (make-list 1000 #t)
+         (bloom-filter-query bf (iota 1000)))
+  (test* "bloom-filter-query (vector)" '#(#t #t)
+         (bloom-filter-query bf '#(0 "abc")))
+  (test* "bloom-filter false positives" #t
+         (< (count identity (bloom-filter-query bf (iota 10000 1000))) 300))
+  (test* "bloom-filter-estimated-count" #t
+         (< 950 (bloom-filter-estimated-count bf) 1050))
+  (test* "bloom-filter-false-positive-rate" #t
+         (< 0.005 (bloom-filter-false-positive-rate bf) 0.02))
+  (test* "bloom-filter serialization" bf
+         (u8vector->bloom-filter (bloom-filter->u8vector bf)) equal?)
+  (test* "bloom-filter serialization (bad)" (test-error)
+         (u8vector->bloom-filter (u8vector-copy (bloom-filter->u8vector bf)
+                                                0 100)))
+  (test* "bloom-filter-clear!" #f
+         (let1 c (bloom-filter-copy bf)
+           (bloom-filter-clear! c)
+           (bloom-filter-contains? c "abc")))
+  )
+
+(let ([a (make-bloom-filter 100 0.01 42)]
+      [b (make-bloom-filter 100 0.01 42)])
+  (bloom-filter-add-all! a '(x y))
+  (bloom-filter-add-all! b '(z))
+  (test* "bloom-filter-merge!" '(#t #t #t)
+         (bloom-filter-query (bloom-filter-merge! a b) '(x y z)))
+  (test* "bloom-filter-merge! (incompatible)" (test-error)
+         (bloom-filter-merge! a (make-bloom-filter 100 0.01 43))))
+
+;;-----------------------------------------------
+(test-section "data.hll")
+(use data.hll)
+(test-module 'data.hll)
+
+(let1 h (make-hll 12)
+  (test* "hll?" '(#t #f) (list (hll? h) (hll? 3)))
+  (test* "hll-estimate (empty)" 0 (hll-estimate h))
+  (test* "hll-add!" '(#t #f) (list (hll-add! h 'a) (hll-add! h 'a)))
+  (test* "hll-estimate (small)" 1 (hll-estimate h))
+  (hll-add-all! h (iota 100000))
+  (hll-add-all! h (list->vector (iota 50000)))
+  (test* "hll-estimate" #t
+         (< (abs (- (hll-estimate h) 100001))
+            (* 100001 4 (hll-standard-error h))))
+  (test* "hll serialization" h (u8vector->hll (hll->u8vector h)) equal?)
+  (test* "hll-clear!" 0
+         (let1 c (hll-copy h) (hll-clear! c) (hll-estimate c)))
+  )
+
+(let ([a (make-hll 10)] [b (make-hll 10)] [c (make-hll 10)])
+  (hll-add-all! a (iota 1000))
+  (hll-add-all! b (iota 1000 500))
+  (hll-add-all! c (iota 1500))
+  (test* "hll-merge!" c (hll-merge! a b) equal?)
+  (test* "hll-merge! (incompatible)" (test-error)
+         (hll-merge! a (make-hll 11))))
+(test* "make-hll (range)" (test-error) (make-hll 3))
+;;-----------------------------------------------
+(test-section "data.frozen-trie")
+(use data.frozen-trie)
+(use data.trie)
+(test-module 'data.frozen-trie)
+
+(let* ([words '("to" "tea" "ted" "ten" "i" "in" "inn" "" "日本" "日本語"
+                "A" "tealeaf")]
+       [t (alist->frozen-trie (map (^w (cons w (string-length w))) words))])
+  (test* "frozen-trie?" '(#t #f) (list (frozen-trie? t) (frozen-trie? words)))
+  (test* "frozen-trie-num-entries" 12 (frozen-trie-num-entries t))
+  (test* "frozen-trie-get" '(3 0 3 none)
+         (list (frozen-trie-get t "tea") (frozen-trie-get t "")
+               (frozen-trie-get t "日本語") (frozen-trie-get t "te" 'none)))
+  (test* "frozen-trie-get (no key)" (test-error) (frozen-trie-get t "t"))
+  (test* "frozen-trie-exists?" '(#t #t #f #f #f)
+         (map (cut frozen-trie-exists? t <>) '("inn" "tealeaf" "tealea" "x"
+                                               "innn")))
+  (test* "frozen-trie-partial-key?" '(#t #t #f #f)
+         (map (cut frozen-trie-partial-key? t <>) '("te" "tea" "ted" "x")))
+  (test* "frozen-trie-keys" (sort words) (frozen-trie-keys t))
+  (test* "frozen-trie->list" (map (^w (cons w (string-length w))) (sort words))
+         (frozen-trie->list t))
+  (test* "frozen-trie-common-prefix-keys" '("tea" "tealeaf" "ted" "ten")
+         (frozen-trie-common-prefix-keys t "te"))
+  (test* "frozen-trie-common-prefix-keys" '("日本" "日本語")
+         (frozen-trie-common-prefix-keys t "日"))
+  (test* "frozen-trie-common-prefix (no match)" '()
+         (frozen-trie-common-prefix t "tx"))
+  (test* "frozen-trie-common-prefix-fold" 16
+         (frozen-trie-common-prefix-fold t "te" (^[k v s] (+ v s)) 0))
+  (test* "frozen-trie-longest-match" '(("tealeaf" . 7) ("tea" . 3) ("" . 0))
+         (list (frozen-trie-longest-match t "tealeafs")
+               (frozen-trie-longest-match t "teal")
+               (frozen-trie-longest-match t "zzz")))
+  (test* "frozen-trie-longest-match (start)" '("日本語" . 3)
+         (frozen-trie-longest-match t "今日本語で" #f 1))
+  (test* "frozen-trie-prefix-matches" '(("" . 0) ("i" . 1) ("in" . 2) ("inn" . 3))
+         (frozen-trie-prefix-matches t "inner"))
+  (test* "frozen-trie-prefix-matches (start)" '(("" . 0) ("to" . 2))
+         (frozen-trie-prefix-matches t "auto" 2))
+  (test* "frozen-trie serialization" (frozen-trie->list t)
+         (frozen-trie->list
+          (u8vector->frozen-trie (frozen-trie->u8vector t)
+                                 (list->vector (frozen-trie-values t)))))
+  (test* "frozen-trie serialization (bad)" (test-error)
+         (u8vector->frozen-trie (u8vector-copy (frozen-trie->u8vector t)
+                                               0 40)))
+  (test* "frozen-trie dictionary" '(2 #t)
+         (list (dict-get t "in") (dict-exists? t "ted")))
+  )
+
+(let1 t (make-frozen-trie '#("b" "c" "a"))
+  (test* "frozen-trie ids as values" '(("a" . 0) ("b" . 1) ("c" . 2))
+         (frozen-trie->list t))
+  (test* "frozen-trie-key-id" '(1 #f) (list (frozen-trie-key-id t "b")
+                                            (frozen-trie-key-id t "d")))
+  (test* "frozen-trie-id->key" "c" (frozen-trie-id->key t 2))
+  (test* "frozen-trie serialization (ids)" '(("a" . 0) ("b" . 1) ("c" . 2))
+         (frozen-trie->list (u8vector->frozen-trie (frozen-trie->u8vector t)))))
+
+(test* "frozen-trie (empty)" '(0 #f ())
+       (let1 t (make-frozen-trie '())
+         (list (frozen-trie-num-entries t) (frozen-trie-exists? t "")
+               (frozen-trie-prefix-matches t "abc"))))
+(test* "frozen-trie (duplicate key)" (test-error)
+       (make-frozen-trie '("a" "b" "a")))
+
+(let* ([keys (map (^i (number->string (* i 7919) 36)) (iota 3000))]
+       [t (make-frozen-trie keys (iota 3000))])
+  (test* "frozen-trie many keys" #t
+         (every (^[k i] (eqv? (frozen-trie-get t k) i)) keys (iota 3000)))
+  (test* "frozen-trie many keys (absent)" #f
+         (any (^k (frozen-trie-exists? t (string-append k "!"))) keys)))
+
+(test* "trie->frozen-trie" '(("abc" . 1) ("abd" . 2))
+       (frozen-trie->list (trie->frozen-trie (trie '() '("abd" . 2)
+                                                   '("abc" . 1)))))
+
+
 (test-end)
@@ -0,0 +1,1783 @@
+/*
+ * mmdb.c - mmap-backed B+tree store for dbm.mmdbm
+ *
+ *
+ *   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "mmdb.h"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+
+/*
+ * File layout
+ *
+ *  Page 0 holds two meta records at offset 0 and META_SLOT_SIZE.
+ *  Commit N writes slot (N & 1), so the record of the previous commit
+ *  survives a torn write; each record carries a checksum and the
+ *  reader picks the valid one with the larger txnid.
+ *
+ *  Other pages are B+tree nodes or overflow pages.  A node is a slotted
+ *  page: an 8-byte header (type, number of entries), an array of 16-bit
+ *  entry offsets sorted by key, and the entries packed from the end of
+ *  the page.  An entry is
+ *
+ *    u16 klen, u16 flags, u32 vlen, key[klen], payload
+ *
+ *  where the payload is the value itself in a leaf, the child page
+ *  number in a branch, or the first overflow page number if a leaf
+ *  entry has E_BIG flag.  The key of the first entry of a branch is
+ *  ignored by search.
+ *
+ *  Pages are written through a shared writable mapping.  A transaction
+ *  copies a node before modifying it (touch()), into a page beyond the
+ *  committed size or into a recycled one, so nothing reachable from the
+ *  committed root changes.
+ *
+ *  Page recycling
+ *
+ *  The pages a transaction makes unreachable are kept in a freelist in
+ *  the writer's memory, and reused REUSE_LAG commits later.  Readers take
+ *  no locks; instead, after copying out the result, a reader checks the
+ *  txnid again.  If it has advanced by less than REUSE_LAG, none of the
+ *  pages the reader looked at could have been overwritten; otherwise the
+ *  reader retries.  Since a reader may look at a page being overwritten,
+ *  it validates every node it visits, so that garbage can't lead it out
+ *  of the page.  The freelist isn't saved in the file; the pages left
+ *  unreused when the writer closes are reclaimed by compaction.
+ */
+
+typedef uint64_t pgno_t;
+
+#define MMDB_MAGIC        "GaucheDB"
+#define MMDB_BYTEORDER    0x01020304UL
+#define MMDB_VERSION      1
+#define META_SLOT_SIZE    2048
+#define MIN_PAGESIZE      4096
+#define MAX_PAGESIZE      32768
+#define MAX_DEPTH         32
+#define COMPACT_MIN_PAGES 1024  /* don't bother compacting small files */
+#define REUSE_LAG         4     /* commits before a freed page is reused */
+
+#if SIZEOF_LONG >= 8
+#define DEFAULT_MAPSIZE   ((size_t)1<<36)
+#else
+#define DEFAULT_MAPSIZE   ((size_t)1<<30)
+#endif
+
+#define META_MOVED        1     /* superseded; reopen the path */
+
+typedef struct {
+    char     magic[8];
+    uint32_t byteorder;
+    uint32_t version;
+    uint32_t pagesize;
+    uint32_t flags;
+    uint64_t txnid;
+    uint64_t root;              /* 0 if empty */
+    uint64_t npages;            /* committed size in pages */
+    uint64_t nkeys;
+    uint64_t garbage;           /* number of unreachable pages */
+    uint64_t checksum;
+} mmdb_meta;
+
+typedef struct mapinfo {
+    char *base;
+    size_t size;
+    int fd;                     /* -1 once retired */
+    struct mapinfo *prev;       /* retired mappings, unmapped at close */
+} mapinfo;
+
+typedef struct {
+    const char *p;
+    size_t len;
+} ent_t;
+
+typedef struct {
+    uint64_t txnid;             /* freed by this commit */
+    pgno_t pg;
+} freepage;
+
+struct MMDBRec {
+    char *path;
+    int flags;
+    uint32_t pagesize;
+    size_t maxent;              /* max size of an entry */
+    size_t mapsize;             /* requested map size */
+    size_t syspagesize;
+    mapinfo *volatile map;
+    pgno_t filepages;           /* writer: actual file size in pages */
+    ScmInternalMutex mutex;
+    ScmInternalCond cv;
+
+    /* transaction */
+    int txn_depth;
+    ScmVM *txn_owner;
+    int txn_changed;
+    int txn_doomed;             /* a nested transaction is aborted */
+    pgno_t txn_base;            /* pages >= this are writable */
+    mmdb_meta txn;
+    size_t txn_free_head;       /* free_head at the start of the txn */
+
+    /* page recycling (writer) */
+    freepage *freelist;         /* a queue, ordered by txnid */
+    size_t free_head, free_tail, free_size;
+    pgno_t *pending;            /* freed by the running transaction */
+    size_t npending, pending_size;
+    pgno_t *dirty;              /* hash set of recycled pages written */
+    size_t ndirty, dirty_size;  /*   by the running transaction */
+
+    /* work areas of the writer */
+    char *scratch;
+    char *entbuf;
+    char *bentbuf;
+    ent_t *ents;
+};
+
+typedef struct {
+    mapinfo *map;
+    uint32_t pagesize;
+    int check;                  /* validate nodes (reader) */
+    uint64_t txnid;
+    pgno_t root;
+    pgno_t npages;
+} view;
+
+#define MMDB_BARRIER()  __sync_synchronize()
+
+/*================================================================
+ * Page and entry accessors
+ */
+
+#define P_LEAF    1
+#define P_BRANCH  2
+#define PAGE_HDR  8
+#define ENT_HDR   8
+#define E_BIG     1
+
+#define NODE_TYPE(p)   (((uint16_t*)(p))[0])
+#define NODE_N(p)      (((uint16_t*)(p))[1])
+#define NODE_OFF(p,i)  (((uint16_t*)((p)+PAGE_HDR))[i])
+#define NODE_ENT(p,i)  ((p) + NODE_OFF(p,i))
+
+#define PAGE(map, psize, pg)  ((map)->base + (size_t)(pg)*(psize))
+#define VPAGE(v, pg)          PAGE((v)->map, (v)->pagesize, pg)
+#define WPAGE(db, pg)         PAGE((db)->map, (db)->pagesize, pg)
+
+/* Entries are not aligned; access fields by memcpy. */
+static inline size_t ent_klen(const char *e)
+{
+    uint16_t k; memcpy(&k, e, 2); return k;
+}
+
+static inline int ent_flags(const char *e)
+{
+    uint16_t f; memcpy(&f, e+2, 2); return f;
+}
+
+static inline size_t ent_vlen(const char *e)
+{
+    uint32_t v; memcpy(&v, e+4, 4); return v;
+}
+
+#define ENT_KEY(e)  ((e) + ENT_HDR)
+
+static inline pgno_t ent_pgno(const char *e)
+{
+    pgno_t pg; memcpy(&pg, e + ENT_HDR + ent_klen(e), 8); return pg;
+}
+
+static inline void ent_set_pgno(char *e, pgno_t pg)
+{
+    memcpy(e + ENT_HDR + ent_klen(e), &pg, 8);
+}
+
+static size_t ent_make(char *buf, const char *key, size_t klen, int flags,
+                       size_t vlen, const char *val, pgno_t pg)
+{
+    uint16_t k = (uint16_t)klen, f = (uint16_t)flags;
+    uint32_t v = (uint32_t)vlen;
+    memcpy(buf, &k, 2);
+    memcpy(buf+2, &f, 2);
+    memcpy(buf+4, &v, 4);
+    memcpy(buf+ENT_HDR, key, klen);
+    if (val) {
+        memcpy(buf+ENT_HDR+klen, val, vlen);
+        return ENT_HDR + klen + vlen;
+    } else {
+        memcpy(buf+ENT_HDR+klen, &pg, 8);
+        return ENT_HDR + klen + 8;
+    }
+}
+
+static inline size_t ent_size(const char *e, int type)
+{
+    if (type == P_BRANCH || (ent_flags(e) & E_BIG)) {
+        return ENT_HDR + ent_klen(e) + 8;
+    }
+    return ENT_HDR + ent_klen(e) + ent_vlen(e);
+}
+
+static inline pgno_t overflow_pages(size_t vlen, uint32_t psize)
+{
+    return (vlen + psize - 1) / psize;
+}
+
+static int keycmp(const char *a, size_t alen, const char *b, size_t blen)
+{
+    int r = memcmp(a, b, (alen < blen)? alen : blen);
+    if (r != 0) return r;
+    return (alen < blen)? -1 : (alen > blen)? 1 : 0;
+}
+
+/* Leaf: index of the first entry whose key >= KEY. */
+static int leaf_search(const char *page, const char *key, size_t klen,
+                       int *exact)
+{
+    int lo = 0, hi = NODE_N(page);
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        const char *e = NODE_ENT(page, mid);
+        if (keycmp(ENT_KEY(e), ent_klen(e), key, klen) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo < NODE_N(page)) {
+        const char *e = NODE_ENT(page, lo);
+        *exact = (keycmp(ENT_KEY(e), ent_klen(e), key, klen) == 0);
+    } else {
+        *exact = FALSE;
+    }
+    return lo;
+}
+
+/* Branch: index of the child that may contain KEY. */
+static int branch_search(const char *page, const char *key, size_t klen)
+{
+    int lo = 1, hi = NODE_N(page);
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        const char *e = NODE_ENT(page, mid);
+        if (keycmp(ENT_KEY(e), ent_klen(e), key, klen) <= 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo - 1;
+}
+
+/* A reader may see a page being recycled; make sure that following the
+   offsets in it doesn't go out of the page. */
+static int node_check(const char *page, uint32_t psize)
+{
+    int type = NODE_TYPE(page), n = NODE_N(page);
+    size_t lo = PAGE_HDR + 2*(size_t)n;
+    if ((type != P_LEAF && type != P_BRANCH) || lo > psize) return FALSE;
+    for (int i=0; i<n; i++) {
+        size_t off = NODE_OFF(page, i);
+        if (off < lo || off + ENT_HDR > psize
+            || off + ent_size(page + off, type) > psize) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static size_t node_size(const ent_t *es, int n)
+{
+    size_t s = PAGE_HDR + 2*(size_t)n;
+    for (int i=0; i<n; i++) s += es[i].len;
+    return s;
+}
+
+static void node_build(char *page, uint32_t psize, int type,
+                       const ent_t *es, int n)
+{
+    size_t top = psize;
+    NODE_TYPE(page) = (uint16_t)type;
+    NODE_N(page) = (uint16_t)n;
+    memset(page+4, 0, 4);
+    for (int i=0; i<n; i++) {
+        top -= es[i].len;
+        memcpy(page+top, es[i].p, es[i].len);
+        NODE_OFF(page, i) = (uint16_t)top;
+    }
+}
+
+/* Copy PAGE into the scratch area and collect its entries from there,
+   so that the page can be rebuilt in place. */
+static int node_load(MMDB *db, const char *page)
+{
+    int n = NODE_N(page), type = NODE_TYPE(page);
+    memcpy(db->scratch, page, db->pagesize);
+    for (int i=0; i<n; i++) {
+        const char *e = NODE_ENT(db->scratch, i);
+        db->ents[i].p = e;
+        db->ents[i].len = ent_size(e, type);
+    }
+    return n;
+}
+
+/*================================================================
+ * Meta records
+ */
+
+static uint64_t meta_checksum(const mmdb_meta *m)
+{
+    const unsigned char *p = (const unsigned char*)m;
+    uint64_t h = 14695981039346656037ULL;   /* FNV-1a */
+    for (size_t i=0; i<offsetof(mmdb_meta, checksum); i++) {
+        h = (h ^ p[i]) * 1099511628211ULL;
+    }
+    return h;
+}
+
+static int meta_valid(const mmdb_meta *m)
+{
+    return (memcmp(m->magic, MMDB_MAGIC, 8) == 0
+            && m->byteorder == MMDB_BYTEORDER
+            && m->version == MMDB_VERSION
+            && m->checksum == meta_checksum(m));
+}
+
+/* BASE points to page 0. */
+static int meta_pick(const char *base, mmdb_meta *m)
+{
+    mmdb_meta a, b;
+    memcpy(&a, base, sizeof(mmdb_meta));
+    memcpy(&b, base + META_SLOT_SIZE, sizeof(mmdb_meta));
+    int va = meta_valid(&a), vb = meta_valid(&b);
+    if (!va && !vb) return MMDB_EBADFILE;
+    if (va && (!vb || a.txnid > b.txnid)) *m = a;
+    else *m = b;
+    MMDB_BARRIER();             /* read pages after the meta */
+    return MMDB_OK;
+}
+
+static void meta_store(char *base, mmdb_meta *m)
+{
+    m->checksum = meta_checksum(m);
+    memcpy(base + (m->txnid & 1) * META_SLOT_SIZE, m, sizeof(mmdb_meta));
+}
+
+static void meta_init(mmdb_meta *m, uint32_t pagesize)
+{
+    memset(m, 0, sizeof(mmdb_meta));
+    memcpy(m->magic, MMDB_MAGIC, 8);
+    m->byteorder = MMDB_BYTEORDER;
+    m->version = MMDB_VERSION;
+    m->pagesize = pagesize;
+    m->txnid = 1;
+    m->npages = 1;
+}
+
+/*================================================================
+ * Files and mappings
+ */
+
+static int write_all(int fd, const char *buf, size_t size, off_t off)
+{
+    while (size > 0) {
+        ssize_t r = pwrite(fd, buf, size, off);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            return MMDB_ESYS;
+        }
+        buf += r; size -= r; off += r;
+    }
+    return MMDB_OK;
+}
+
+static int lock_file(int fd)
+{
+    while (flock(fd, LOCK_EX|LOCK_NB) < 0) {
+        if (errno == EINTR) continue;
+        if (errno == EWOULDBLOCK) return MMDB_ELOCKED;
+        return MMDB_ESYS;
+    }
+    return MMDB_OK;
+}
+
+/* Writes page 0 of a fresh database with meta M. */
+static int write_meta_page(int fd, mmdb_meta *m, int sync)
+{
+    char *buf = calloc(1, m->pagesize);
+    if (buf == NULL) return MMDB_ENOMEM;
+    meta_store(buf, m);
+    int r = write_all(fd, buf, m->pagesize, 0);
+    free(buf);
+    if (r == MMDB_OK && sync && fsync(fd) < 0) r = MMDB_ESYS;
+    return r;
+}
+
+/* Marks the file FD as superseded, so that readers switch to the file
+   that now has its name. */
+static void mark_moved(int fd)
+{
+    char *base = mmap(NULL, MIN_PAGESIZE, PROT_READ|PROT_WRITE, MAP_SHARED,
+                      fd, 0);
+    mmdb_meta m;
+    if (base == MAP_FAILED) return;
+    if (meta_pick(base, &m) == MMDB_OK) {
+        m.flags |= META_MOVED;
+        m.txnid++;
+        meta_store(base, &m);
+        msync(base, MIN_PAGESIZE, MS_SYNC);
+    }
+    munmap(base, MIN_PAGESIZE);
+}
+
+static char *tmp_path(const char *path)
+{
+    size_t len = strlen(path);
+    char *p = malloc(len + 5);
+    if (p) {
+        memcpy(p, path, len);
+        memcpy(p + len, ".tmp", 5);
+    }
+    return p;
+}
+
+/* Creates an empty database at PATH via a temporary file, and returns
+   its locked fd in *rfd.  OLDFD, if not negative, is the file that had
+   PATH. */
+static int replace_with_empty(MMDB *db, int oldfd, int mode,
+                              uint32_t pagesize, int *rfd)
+{
+    char *tmp = tmp_path(db->path);
+    mmdb_meta m;
+    int fd, r;
+
+    if (tmp == NULL) return MMDB_ENOMEM;
+    fd = open(tmp, O_RDWR|O_CREAT|O_TRUNC, mode);
+    if (fd < 0) { free(tmp); return MMDB_ESYS; }
+    meta_init(&m, pagesize);
+    r = lock_file(fd);
+    if (r == MMDB_OK) r = write_meta_page(fd, &m, TRUE);
+    if (r == MMDB_OK && rename(tmp, db->path) < 0) r = MMDB_ESYS;
+    if (r != MMDB_OK) {
+        int e = errno;
+        unlink(tmp);
+        close(fd);
+        errno = e;
+    } else {
+        if (oldfd >= 0) mark_moved(oldfd);
+        *rfd = fd;
+    }
+    free(tmp);
+    return r;
+}
+
+static size_t round_up(size_t n, size_t unit)
+{
+    return (n + unit - 1) / unit * unit;
+}
+
+/* Maps an opened database file FD. */
+static int map_fd(MMDB *db, int fd, int rdonly, mapinfo **rm)
+{
+    struct stat st;
+    mmdb_meta m;
+    char hdr[MIN_PAGESIZE];
+    mapinfo *mi;
+    void *base;
+    size_t size;
+
+    if (fstat(fd, &st) < 0) return MMDB_ESYS;
+    if (st.st_size < MIN_PAGESIZE
+        || pread(fd, hdr, MIN_PAGESIZE, 0) != MIN_PAGESIZE
+        || meta_pick(hdr, &m) != MMDB_OK
+        || m.pagesize < MIN_PAGESIZE || m.pagesize > MAX_PAGESIZE
+        || (m.pagesize & (m.pagesize - 1)) != 0) {
+        return MMDB_EBADFILE;
+    }
+    size = db->mapsize;
+    if (size < (size_t)st.st_size) size = (size_t)st.st_size;
+    size = round_up(size, m.pagesize);
+    base = mmap(NULL, size, rdonly? PROT_READ : (PROT_READ|PROT_WRITE),
+                MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) return MMDB_ESYS;
+    mi = calloc(1, sizeof(mapinfo));
+    if (mi == NULL) {
+        munmap(base, size);
+        return MMDB_ENOMEM;
+    }
+    mi->base = base;
+    mi->size = size;
+    mi->fd = fd;
+    mi->prev = NULL;
+    db->pagesize = m.pagesize;
+    db->filepages = (pgno_t)(st.st_size / m.pagesize);
+    *rm = mi;
+    return MMDB_OK;
+}
+
+/* Opens and maps the database file.  FLAGS and MODE are as in mmdb_open.
+   For a reader, PAGESIZE is ignored. */
+static int map_open(MMDB *db, int flags, int mode, uint32_t pagesize,
+                    mapinfo **rm)
+{
+    int rdonly = (flags & MMDB_RDONLY);
+    int fd, r = MMDB_OK;
+    struct stat st;
+    mmdb_meta m;
+
+    fd = open(db->path,
+              rdonly? O_RDONLY : (O_RDWR|((flags&MMDB_CREATE)? O_CREAT:0)),
+              mode);
+    if (fd < 0) return MMDB_ESYS;
+    if (!rdonly) r = lock_file(fd);
+    if (r == MMDB_OK && fstat(fd, &st) < 0) r = MMDB_ESYS;
+    if (r == MMDB_OK && !rdonly) {
+        if (st.st_size > 0 && (flags & MMDB_TRUNC)) {
+            int nfd;
+            r = replace_with_empty(db, fd, st.st_mode & 0777, pagesize, &nfd);
+            if (r == MMDB_OK) {
+                close(fd);
+                fd = nfd;
+            }
+        } else if (st.st_size == 0) {
+            /* Nobody can be using an empty file; initialize in place. */
+            meta_init(&m, pagesize);
+            r = write_meta_page(fd, &m, !(flags & MMDB_NOSYNC));
+        }
+    }
+    if (r == MMDB_OK) r = map_fd(db, fd, rdonly, rm);
+    if (r != MMDB_OK) {
+        int e = errno;
+        close(fd);
+        errno = e;
+    }
+    return r;
+}
+
+/* Switches DB to the new mapping NEW.  The old one is kept mapped until
+   the database is closed, for another thread may still be reading it. */
+static void map_switch(MMDB *db, mapinfo *newm)
+{
+    mapinfo *old = db->map;
+    newm->prev = old;
+    MMDB_BARRIER();
+    db->map = newm;
+    if (old->fd >= 0) {
+        close(old->fd);
+        old->fd = -1;
+    }
+}
+
+/* Called by a reader that finds its file superseded. */
+static int reader_reopen(MMDB *db, mapinfo *seen)
+{
+    int r = MMDB_OK;
+    SCM_INTERNAL_MUTEX_LOCK(db->mutex);
+    if (db->map == seen) {
+        mapinfo *newm;
+        r = map_open(db, db->flags, 0, 0, &newm);
+        if (r == MMDB_OK) map_switch(db, newm);
+    }
+    SCM_INTERNAL_MUTEX_UNLOCK(db->mutex);
+    return r;
+}
+
+/* Sets up V to see the latest committed tree (or the running transaction
+   of the calling thread).  The writer calls this with the mutex held. */
+static int get_view(MMDB *db, view *v, mmdb_meta *pm)
+{
+    mmdb_meta m;
+    int r;
+
+    v->pagesize = db->pagesize;
+    v->check = (db->flags & MMDB_RDONLY);
+    if (db->txn_depth > 0 && db->txn_owner == Scm_VM() && !db->txn_doomed) {
+        v->map = db->map;
+        v->txnid = db->txn.txnid;
+        v->root = db->txn.root;
+        v->npages = db->txn.npages;
+        if (pm) *pm = db->txn;
+        return MMDB_OK;
+    }
+    for (int tries = 0; ; tries++) {
+        mapinfo *mi = db->map;
+        r = meta_pick(mi->base, &m);
+        if (r != MMDB_OK) return r;
+        if ((m.flags & META_MOVED) && (db->flags & MMDB_RDONLY) && tries < 8) {
+            r = reader_reopen(db, mi);
+            if (r != MMDB_OK) return r;
+            v->pagesize = db->pagesize;
+            continue;
+        }
+        if (m.npages * db->pagesize > mi->size) return MMDB_EFULL;
+        v->map = mi;
+        v->txnid = m.txnid;
+        v->root = m.root;
+        v->npages = m.npages;
+        if (pm) *pm = m;
+        return MMDB_OK;
+    }
+}
+
+/* Called by a reader after it copied out what it's read from V.  Returns
+   FALSE if the pages V refers to may have been recycled meanwhile.  The
+   writer's handle doesn't need this, for its readers hold the mutex. */
+static int view_valid(MMDB *db, view *v)
+{
+    mmdb_meta m;
+    if (!(db->flags & MMDB_RDONLY)) return TRUE;
+    MMDB_BARRIER();             /* read the meta after the pages */
+    if (meta_pick(v->map->base, &m) != MMDB_OK) return FALSE;
+    return m.txnid < v->txnid + REUSE_LAG;
+}
+
+/* Returns the node at PG in *PAGE. */
+static int view_node(view *v, pgno_t pg, const char **page)
+{
+    if (pg == 0 || pg >= v->npages) return MMDB_EBADFILE;
+    *page = VPAGE(v, pg);
+    if (v->check && !node_check(*page, v->pagesize)) return MMDB_EBADFILE;
+    return MMDB_OK;
+}
+
+/*================================================================
+ * Cursor
+ */
+
+typedef struct {
+    view *v;
+    int depth;
+    pgno_t pg[MAX_DEPTH];
+    int idx[MAX_DEPTH];
+} cursor;
+
+/* Descends from page PG at level D following the leftmost children. */
+static int cursor_leftmost(cursor *c, int d, pgno_t pg)
+{
+    for (;;) {
+        const char *page;
+        if (d >= MAX_DEPTH || view_node(c->v, pg, &page) != MMDB_OK) {
+            return MMDB_EBADFILE;
+        }
+        c->pg[d] = pg;
+        c->idx[d] = 0;
+        if (NODE_TYPE(page) == P_LEAF) break;
+        if (NODE_TYPE(page) != P_BRANCH || NODE_N(page) == 0) {
+            return MMDB_EBADFILE;
+        }
+        pg = ent_pgno(NODE_ENT(page, 0));
+        d++;
+    }
+    c->depth = d + 1;
+    return MMDB_OK;
+}
+
+/* Current leaf is exhausted; move to the first entry of the next one. */
+static int cursor_next_leaf(cursor *c)
+{
+    for (int d = c->depth - 2; d >= 0; d--) {
+        const char *page = VPAGE(c->v, c->pg[d]);
+        if (c->idx[d] + 1 < NODE_N(page)) {
+            c->idx[d]++;
+            return cursor_leftmost(c, d+1, ent_pgno(NODE_ENT(page, c->idx[d])));
+        }
+    }
+    return MMDB_NOTFOUND;
+}
+
+/* Positions C at the first entry whose key is greater than KEY (or
+   equal, if !STRICT).  KEY == NULL means the first entry. */
+static int cursor_seek(cursor *c, view *v, const char *key, size_t klen,
+                       int strict)
+{
+    pgno_t pg = v->root;
+    int d = 0, i, exact;
+    const char *page;
+
+    c->v = v;
+    if (pg == 0) return MMDB_NOTFOUND;
+    if (key == NULL) {
+        int r = cursor_leftmost(c, 0, pg);
+        if (r != MMDB_OK) return r;
+        return MMDB_OK;         /* the tree has no empty leaf */
+    }
+    for (;;) {
+        if (d >= MAX_DEPTH || view_node(v, pg, &page) != MMDB_OK) {
+            return MMDB_EBADFILE;
+        }
+        c->pg[d] = pg;
+        if (NODE_TYPE(page) == P_LEAF) break;
+        if (NODE_TYPE(page) != P_BRANCH || NODE_N(page) == 0) {
+            return MMDB_EBADFILE;
+        }
+        i = branch_search(page, key, klen);
+        c->idx[d++] = i;
+        pg = ent_pgno(NODE_ENT(page, i));
+    }
+    i = leaf_search(page, key, klen, &exact);
+    if (exact && strict) i++;
+    c->idx[d] = i;
+    c->depth = d + 1;
+    if (i >= NODE_N(page)) return cursor_next_leaf(c);
+    return MMDB_OK;
+}
+
+static int cursor_next(cursor *c)
+{
+    const char *leaf = VPAGE(c->v, c->pg[c->depth-1]);
+    if (++c->idx[c->depth-1] < NODE_N(leaf)) return MMDB_OK;
+    return cursor_next_leaf(c);
+}
+
+static inline const char *cursor_entry(cursor *c)
+{
+    const char *leaf = VPAGE(c->v, c->pg[c->depth-1]);
+    return NODE_ENT(leaf, c->idx[c->depth-1]);
+}
+
+static int datum_set(MMDBDatum *d, const char *p, size_t len)
+{
+    if (d->ptr == NULL || d->size < len) {
+        size_t size = (len < 64)? 64 : len;
+        char *np = realloc(d->ptr, size);
+        if (np == NULL) return MMDB_ENOMEM;
+        d->ptr = np;
+        d->size = size;
+    }
+    memcpy(d->ptr, p, len);
+    d->len = len;
+    return MMDB_OK;
+}
+
+/* Copies the value of the leaf entry E into D. */
+static int entry_value(view *v, const char *e, MMDBDatum *d)
+{
+    size_t vlen = ent_vlen(e);
+    if (ent_flags(e) & E_BIG) {
+        pgno_t pg = ent_pgno(e);
+        if (pg == 0 || pg >= v->npages
+            || overflow_pages(vlen, v->pagesize) > v->npages - pg) {
+            return MMDB_EBADFILE;
+        }
+        return datum_set(d, VPAGE(v, pg), vlen);
+    }
+    return datum_set(d, ENT_KEY(e) + ent_klen(e), vlen);
+}
+
+/*================================================================
+ * Transactions
+ */
+
+static void txn_start(MMDB *db)
+{
+    meta_pick(db->map->base, &db->txn); /* the writer's file is valid */
+    db->txn_base = db->txn.npages;
+    db->txn_free_head = db->free_head;
+    db->txn_changed = FALSE;
+    db->txn_depth = 1;
+    db->txn_owner = Scm_VM();
+}
+
+static void txn_end(MMDB *db)
+{
+    if (db->ndirty > 0) {
+        memset(db->dirty, 0, db->dirty_size * sizeof(pgno_t));
+        db->ndirty = 0;
+    }
+    db->npending = 0;
+    db->txn_doomed = FALSE;
+    db->txn_depth = 0;
+    db->txn_owner = NULL;
+    SCM_INTERNAL_COND_BROADCAST(db->cv);
+}
+
+/* Discards the running transaction.  The pages it took from the freelist
+   are still free. */
+static void txn_abort(MMDB *db)
+{
+    db->free_head = db->txn_free_head;
+    txn_end(db);
+}
+
+/* The running transaction is committed as TXNID; its freed pages go to
+   the freelist.  If we can't extend the freelist, the pages are left
+   to compaction. */
+static void txn_release_pages(MMDB *db, uint64_t txnid)
+{
+    if (db->free_head > 0 && db->free_head >= db->free_tail / 2) {
+        memmove(db->freelist, db->freelist + db->free_head,
+                (db->free_tail - db->free_head) * sizeof(freepage));
+        db->free_tail -= db->free_head;
+        db->free_head = 0;
+    }
+    if (db->free_tail + db->npending > db->free_size) {
+        size_t size = db->free_size * 2;
+        if (size < db->free_tail + db->npending) {
+            size = db->free_tail + db->npending + 256;
+        }
+        freepage *nf = realloc(db->freelist, size * sizeof(freepage));
+        if (nf == NULL) return;
+        db->freelist = nf;
+        db->free_size = size;
+    }
+    for (size_t i=0; i<db->npending; i++) {
+        db->freelist[db->free_tail].txnid = txnid;
+        db->freelist[db->free_tail].pg = db->pending[i];
+        db->free_tail++;
+    }
+}
+
+/* Waits until no other thread has a transaction. */
+static void txn_wait(MMDB *db)
+{
+    ScmVM *self = Scm_VM();
+    while (db->txn_depth > 0 && db->txn_owner != self) {
+        SCM_INTERNAL_COND_WAIT(db->cv, db->mutex);
+    }
+}
+
+static int compact_int(MMDB *db);
+
+static int txn_commit(MMDB *db)
+{
+    int sync = !(db->flags & MMDB_NOSYNC);
+    mapinfo *mi = db->map;
+
+    if (!db->txn_changed) {
+        txn_abort(db);
+        return MMDB_OK;
+    }
+    if (sync && db->txn.npages > db->txn_base) {
+        size_t start = (size_t)db->txn_base * db->pagesize;
+        size_t end = (size_t)db->txn.npages * db->pagesize;
+        start -= start % db->syspagesize;
+        if (msync(mi->base + start, end - start, MS_SYNC) < 0) {
+            txn_abort(db);
+            return MMDB_ESYS;
+        }
+    }
+    if (sync && db->ndirty > 0) {
+        /* Recycled pages are scattered; sync the whole file. */
+        if (msync(mi->base, (size_t)db->txn_base * db->pagesize,
+                  MS_SYNC) < 0) {
+            txn_abort(db);
+            return MMDB_ESYS;
+        }
+    }
+    MMDB_BARRIER();             /* pages before the meta */
+    db->txn.txnid++;
+    meta_store(mi->base, &db->txn);
+    MMDB_BARRIER();             /* the meta before recycling pages */
+    txn_release_pages(db, db->txn.txnid);
+    txn_end(db);
+    /* The meta is visible to readers, so we can't go back even if
+       syncing it fails. */
+    if (sync && msync(mi->base, round_up(MIN_PAGESIZE, db->syspagesize),
+                      MS_SYNC) < 0) {
+        return MMDB_ESYS;
+    }
+
+    /* Garbage pages not in the freelist are left from previous
+       sessions; also shrink the file if it is mostly free. */
+    uint64_t nfree = db->free_tail - db->free_head;
+    if (!(db->flags & MMDB_NOCOMPACT)
+        && db->txn.npages >= COMPACT_MIN_PAGES
+        && ((db->txn.garbage - nfree) * 2 > db->txn.npages
+            || db->txn.garbage * 4 > db->txn.npages * 3)) {
+        /* The commit is done; failing to compact is not an error. */
+        int e = errno;
+        (void)compact_int(db);
+        errno = e;
+    }
+    return MMDB_OK;
+}
+
+/* Enters a write operation.  If the calling thread has no transaction,
+   starts an implicit one, which is committed by txn_leave. */
+static int txn_enter(MMDB *db, int *implicit)
+{
+    if (db->flags & MMDB_RDONLY) return MMDB_ERDONLY;
+    txn_wait(db);
+    if (db->txn_doomed) return MMDB_ETXN;
+    *implicit = (db->txn_depth == 0);
+    if (*implicit) txn_start(db);
+    return MMDB_OK;
+}
+
+/* An error other than NOTFOUND may leave the transaction inconsistent;
+   we discard the whole transaction then.  An explicit one is kept open
+   until the outermost mmdb_commit or mmdb_abort, so that the following
+   updates of the batch don't go through on their own. */
+static int txn_leave(MMDB *db, int implicit, int r)
+{
+    if (r != MMDB_OK && r != MMDB_NOTFOUND) {
+        if (implicit) txn_abort(db);
+        else db->txn_doomed = TRUE;
+        return r;
+    }
+    if (implicit) {
+        int r2 = txn_commit(db);
+        if (r2 != MMDB_OK) return r2;
+    }
+    return r;
+}
+
+/*================================================================
+ * Page allocation
+ */
+
+/* Allocates N contiguous pages at the end of the file. */
+static int alloc_pages(MMDB *db, pgno_t n, pgno_t *rpg)
+{
+    pgno_t pg = db->txn.npages;
+    size_t psize = db->pagesize;
+
+    if ((pg + n) * psize > db->map->size) return MMDB_EFULL;
+    if (pg + n > db->filepages) {
+        pgno_t grow = db->filepages / 8;
+        if (grow < 256) grow = 256;
+        pgno_t newpages = db->filepages + grow;
+        if (newpages < pg + n) newpages = pg + n;
+        if (newpages * psize > db->map->size) newpages = db->map->size / psize;
+        if (ftruncate(db->map->fd, (off_t)(newpages * psize)) < 0) {
+            return MMDB_ESYS;
+        }
+        db->filepages = newpages;
+    }
+    db->txn.npages += n;
+    *rpg = pg;
+    return MMDB_OK;
+}
+
+static inline size_t dirty_hash(pgno_t pg, size_t size)
+{
+    return (size_t)((pg * 0x9e3779b97f4a7c15ULL) >> 17) & (size - 1);
+}
+
+static int dirty_p(MMDB *db, pgno_t pg)
+{
+    if (pg >= db->txn_base) return TRUE;
+    if (db->ndirty == 0) return FALSE;
+    for (size_t i = dirty_hash(pg, db->dirty_size); db->dirty[i] != 0;
+         i = (i + 1) & (db->dirty_size - 1)) {
+        if (db->dirty[i] == pg) return TRUE;
+    }
+    return FALSE;
+}
+
+static int dirty_add(MMDB *db, pgno_t pg)
+{
+    if ((db->ndirty + 1) * 2 > db->dirty_size) {
+        size_t size = db->dirty_size? db->dirty_size * 2 : 1024;
+        pgno_t *nd = calloc(size, sizeof(pgno_t));
+        if (nd == NULL) return MMDB_ENOMEM;
+        for (size_t j=0; j<db->dirty_size; j++) {
+            pgno_t p = db->dirty[j];
+            if (p == 0) continue;
+            size_t i = dirty_hash(p, size);
+            while (nd[i] != 0) i = (i + 1) & (size - 1);
+            nd[i] = p;
+        }
+        free(db->dirty);
+        db->dirty = nd;
+        db->dirty_size = size;
+    }
+    size_t i = dirty_hash(pg, db->dirty_size);
+    while (db->dirty[i] != 0) i = (i + 1) & (db->dirty_size - 1);
+    db->dirty[i] = pg;
+    db->ndirty++;
+    return MMDB_OK;
+}
+
+/* Allocates a page, from the freelist if possible. */
+static int alloc_page(MMDB *db, pgno_t *rpg)
+{
+    uint64_t txnid = db->txn.txnid + 1;  /* of the running transaction */
+    if (db->free_head < db->free_tail
+        && db->freelist[db->free_head].txnid + REUSE_LAG <= txnid) {
+        pgno_t pg = db->freelist[db->free_head].pg;
+        int r = dirty_add(db, pg);
+        if (r != MMDB_OK) return r;
+        db->free_head++;
+        db->txn.garbage--;
+        *rpg = pg;
+        return MMDB_OK;
+    }
+    return alloc_pages(db, 1, rpg);
+}
+
+/* Pages PG..PG+N-1 become unreachable. */
+static int free_pages(MMDB *db, pgno_t pg, pgno_t n)
+{
+    if (db->npending + n > db->pending_size) {
+        size_t size = db->pending_size * 2;
+        if (size < db->npending + n) size = db->npending + n + 256;
+        pgno_t *np = realloc(db->pending, size * sizeof(pgno_t));
+        if (np == NULL) return MMDB_ENOMEM;
+        db->pending = np;
+        db->pending_size = size;
+    }
+    for (pgno_t i=0; i<n; i++) db->pending[db->npending++] = pg + i;
+    db->txn.garbage += n;
+    return MMDB_OK;
+}
+
+/* Makes page *PG writable, copying it if it belongs to a committed
+   tree.  *PG and *PAGE are updated. */
+static int touch(MMDB *db, pgno_t *pg, char **page)
+{
+    pgno_t npg;
+    int r;
+    if (dirty_p(db, *pg)) return MMDB_OK;
+    r = alloc_page(db, &npg);
+    if (r != MMDB_OK) return r;
+    r = free_pages(db, *pg, 1);
+    if (r != MMDB_OK) return r;
+    memcpy(WPAGE(db, npg), WPAGE(db, *pg), db->pagesize);
+    *pg = npg;
+    *page = WPAGE(db, npg);
+    return MMDB_OK;
+}
+
+/*================================================================
+ * Insertion
+ */
+
+typedef struct {
+    pgno_t pg;                  /* new page number of the node */
+    int split;                  /* if TRUE, the node is split and ... */
+    const char *sep;            /*   the right half starts with this key */
+    size_t seplen;
+    pgno_t right;               /*   and is in this page */
+    int replaced;               /* an existing entry was replaced */
+} ins_result;
+
+/* Stores db->ents[0..n) into the node at PG, splitting it if needed. */
+static int node_store(MMDB *db, pgno_t pg, char *page, int type, int n,
+                      ins_result *res)
+{
+    size_t size = node_size(db->ents, n), acc = PAGE_HDR;
+    pgno_t rpg;
+    int m, r;
+
+    res->pg = pg;
+    if (size <= db->pagesize) {
+        node_build(page, db->pagesize, type, db->ents, n);
+        res->split = FALSE;
+        return MMDB_OK;
+    }
+    for (m = 0; m < n-1; m++) {
+        size_t s = 2 + db->ents[m].len;
+        if (m > 0 && acc + s > (size + PAGE_HDR) / 2) break;
+        acc += s;
+    }
+    r = alloc_page(db, &rpg);
+    if (r != MMDB_OK) return r;
+    char *rpage = WPAGE(db, rpg);
+    node_build(page, db->pagesize, type, db->ents, m);
+    node_build(rpage, db->pagesize, type, db->ents + m, n - m);
+    res->split = TRUE;
+    res->right = rpg;
+    res->sep = ENT_KEY(NODE_ENT(rpage, 0));
+    res->seplen = ent_klen(NODE_ENT(rpage, 0));
+    return MMDB_OK;
+}
+
+static int ins(MMDB *db, pgno_t pg, int depth,
+               const char *key, size_t klen, const char *ent, size_t elen,
+               ins_result *res)
+{
+    char *page;
+    int r, i, n;
+
+    if (depth >= MAX_DEPTH || pg == 0 || pg >= db->txn.npages) {
+        return MMDB_EBADFILE;
+    }
+    page = WPAGE(db, pg);
+    if (NODE_TYPE(page) == P_LEAF) {
+        int exact;
+        i = leaf_search(page, key, klen, &exact);
+        r = touch(db, &pg, &page);
+        if (r != MMDB_OK) return r;
+        n = node_load(db, page);
+        if (exact) {
+            const char *old = db->ents[i].p;
+            if (ent_flags(old) & E_BIG) {
+                r = free_pages(db, ent_pgno(old),
+                               overflow_pages(ent_vlen(old), db->pagesize));
+                if (r != MMDB_OK) return r;
+            }
+            res->replaced = TRUE;
+        } else {
+            memmove(db->ents + i + 1, db->ents + i, (n - i) * sizeof(ent_t));
+            n++;
+            res->replaced = FALSE;
+        }
+        db->ents[i].p = ent;
+        db->ents[i].len = elen;
+        return node_store(db, pg, page, P_LEAF, n, res);
+    }
+    if (NODE_TYPE(page) != P_BRANCH) return MMDB_EBADFILE;
+
+    ins_result cres;
+    i = branch_search(page, key, klen);
+    r = ins(db, ent_pgno(NODE_ENT(page, i)), depth+1, key, klen, ent, elen,
+            &cres);
+    if (r != MMDB_OK) return r;
+    res->replaced = cres.replaced;
+    r = touch(db, &pg, &page);
+    if (r != MMDB_OK) return r;
+    ent_set_pgno(NODE_ENT(page, i), cres.pg);
+    if (!cres.split) {
+        res->pg = pg;
+        res->split = FALSE;
+        return MMDB_OK;
+    }
+    n = node_load(db, page);
+    memmove(db->ents + i + 2, db->ents + i + 1, (n - i - 1) * sizeof(ent_t));
+    db->ents[i+1].p = db->bentbuf;
+    db->ents[i+1].len = ent_make(db->bentbuf, cres.sep, cres.seplen, 0, 0,
+                                 NULL, cres.right);
+    return node_store(db, pg, page, P_BRANCH, n+1, res);
+}
+
+static int put_int(MMDB *db, const char *key, size_t klen,
+                   const char *val, size_t vlen)
+{
+    size_t elen;
+    int r;
+
+    if (klen > mmdb_max_key_size(db)) return MMDB_EKEYSIZE;
+    if (vlen > UINT32_MAX) return MMDB_EINVAL;
+    if (ENT_HDR + klen + vlen <= db->maxent) {
+        elen = ent_make(db->entbuf, key, klen, 0, vlen, val, 0);
+    } else {
+        pgno_t ov;
+        r = alloc_pages(db, overflow_pages(vlen, db->pagesize), &ov);
+        if (r != MMDB_OK) return r;
+        memcpy(WPAGE(db, ov), val, vlen);
+        elen = ent_make(db->entbuf, key, klen, E_BIG, vlen, NULL, ov);
+    }
+
+    if (db->txn.root == 0) {
+        pgno_t pg;
+        ent_t e = { db->entbuf, elen };
+        r = alloc_page(db, &pg);
+        if (r != MMDB_OK) return r;
+        node_build(WPAGE(db, pg), db->pagesize, P_LEAF, &e, 1);
+        db->txn.root = pg;
+        db->txn.nkeys = 1;
+    } else {
+        ins_result res;
+        r = ins(db, db->txn.root, 0, key, klen, db->entbuf, elen, &res);
+        if (r != MMDB_OK) return r;
+        if (res.split) {
+            char e0[ENT_HDR + 8];
+            ent_t es[2];
+            pgno_t pg;
+            r = alloc_page(db, &pg);
+            if (r != MMDB_OK) return r;
+            es[0].p = e0;
+            es[0].len = ent_make(e0, "", 0, 0, 0, NULL, res.pg);
+            es[1].p = db->bentbuf;
+            es[1].len = ent_make(db->bentbuf, res.sep, res.seplen, 0, 0,
+                                 NULL, res.right);
+            node_build(WPAGE(db, pg), db->pagesize, P_BRANCH, es, 2);
+            db->txn.root = pg;
+        } else {
+            db->txn.root = res.pg;
+        }
+        if (!res.replaced) db->txn.nkeys++;
+    }
+    db->txn_changed = TRUE;
+    return MMDB_OK;
+}
+
+/*================================================================
+ * Deletion
+ *
+ *  We don't rebalance underfull nodes; a node is removed when it gets
+ *  empty.  Compaction rebuilds a packed tree anyway.
+ */
+
+/* *NEWPG is set to the new page number of the node, or 0 if the node
+   became empty. */
+static int del(MMDB *db, pgno_t pg, int depth, const char *key, size_t klen,
+               pgno_t *newpg)
+{
+    char *page;
+    int r, i, n;
+
+    if (depth >= MAX_DEPTH || pg == 0 || pg >= db->txn.npages) {
+        return MMDB_EBADFILE;
+    }
+    page = WPAGE(db, pg);
+    n = NODE_N(page);
+    if (NODE_TYPE(page) == P_LEAF) {
+        int exact;
+        i = leaf_search(page, key, klen, &exact);
+        if (!exact) return MMDB_NOTFOUND;
+        const char *e = NODE_ENT(page, i);
+        if (ent_flags(e) & E_BIG) {
+            r = free_pages(db, ent_pgno(e),
+                           overflow_pages(ent_vlen(e), db->pagesize));
+            if (r != MMDB_OK) return r;
+        }
+    } else if (NODE_TYPE(page) == P_BRANCH) {
+        pgno_t nc;
+        i = branch_search(page, key, klen);
+        r = del(db, ent_pgno(NODE_ENT(page, i)), depth+1, key, klen, &nc);
+        if (r != MMDB_OK) return r;
+        if (nc != 0) {
+            r = touch(db, &pg, &page);
+            if (r != MMDB_OK) return r;
+            ent_set_pgno(NODE_ENT(page, i), nc);
+            *newpg = pg;
+            return MMDB_OK;
+        }
+    } else {
+        return MMDB_EBADFILE;
+    }
+    /* Remove the i-th entry */
+    if (n == 1) {
+        r = free_pages(db, pg, 1);
+        if (r != MMDB_OK) return r;
+        *newpg = 0;
+        return MMDB_OK;
+    }
+    r = touch(db, &pg, &page);
+    if (r != MMDB_OK) return r;
+    int type = NODE_TYPE(page);
+    n = node_load(db, page);
+    memmove(db->ents + i, db->ents + i + 1, (n - i - 1) * sizeof(ent_t));
+    node_build(page, db->pagesize, type, db->ents, n - 1);
+    *newpg = pg;
+    return MMDB_OK;
+}
+
+static int del_int(MMDB *db, const char *key, size_t klen)
+{
+    pgno_t root;
+    int r;
+
+    if (db->txn.root == 0) return MMDB_NOTFOUND;
+    r = del(db, db->txn.root, 0, key, klen, &root);
+    if (r != MMDB_OK) return r;
+    while (root != 0) {
+        const char *page = WPAGE(db, root);
+        if (NODE_TYPE(page) != P_BRANCH || NODE_N(page) != 1) break;
+        r = free_pages(db, root, 1);
+        if (r != MMDB_OK) return r;
+        root = ent_pgno(NODE_ENT(page, 0));
+    }
+    db->txn.root = root;
+    db->txn.nkeys--;
+    db->txn_changed = TRUE;
+    return MMDB_OK;
+}
+
+/*================================================================
+ * Compaction
+ *
+ *  Writes the live entries in order into a new file, building the tree
+ *  bottom up, and renames it over the original.  The old file is marked
+ *  as moved; readers notice it and reopen the path.
+ */
+
+typedef struct {
+    char *page;
+    size_t top;                 /* entries are packed above this */
+    char *ebuf;                 /* entry to be added to the upper level */
+} build_level;
+
+typedef struct {
+    int fd;
+    uint32_t psize;
+    size_t fill;                /* leave some room for later updates */
+    pgno_t next;
+    int nlevels;
+    build_level lv[MAX_DEPTH];
+} builder;
+
+static int builder_add(builder *b, int level, const char *e, size_t elen);
+
+static int builder_emit(builder *b, int level, pgno_t *rpg)
+{
+    char *page = b->lv[level].page;
+    int r = write_all(b->fd, page, b->psize, (off_t)(b->next * b->psize));
+    if (r != MMDB_OK) return r;
+    *rpg = b->next++;
+    /* The first key of the emitted node goes to the upper level. */
+    const char *e0 = NODE_ENT(page, 0);
+    size_t len = ent_make(b->lv[level].ebuf, ENT_KEY(e0), ent_klen(e0),
+                          0, 0, NULL, *rpg);
+    NODE_N(page) = 0;
+    b->lv[level].top = b->psize;
+    return builder_add(b, level+1, b->lv[level].ebuf, len);
+}
+
+static int builder_add(builder *b, int level, const char *e, size_t elen)
+{
+    build_level *lv;
+    int r;
+
+    if (level >= MAX_DEPTH) return MMDB_EBADFILE;
+    if (level >= b->nlevels) {
+        lv = &b->lv[level];
+        lv->page = calloc(1, b->psize);
+        lv->ebuf = malloc(b->psize);
+        if (lv->page == NULL || lv->ebuf == NULL) return MMDB_ENOMEM;
+        NODE_TYPE(lv->page) = (level == 0)? P_LEAF : P_BRANCH;
+        NODE_N(lv->page) = 0;
+        lv->top = b->psize;
+        b->nlevels = level + 1;
+    }
+    lv = &b->lv[level];
+    int n = NODE_N(lv->page);
+    if (n > 0
+        && PAGE_HDR + 2*(n+1) + (b->psize - lv->top) + elen > b->fill) {
+        pgno_t pg;
+        r = builder_emit(b, level, &pg);
+        if (r != MMDB_OK) return r;
+        n = 0;
+    }
+    lv->top -= elen;
+    memcpy(lv->page + lv->top, e, elen);
+    NODE_OFF(lv->page, n) = (uint16_t)lv->top;
+    NODE_N(lv->page) = (uint16_t)(n + 1);
+    return MMDB_OK;
+}
+
+/* Flushes the partial nodes and returns the root. */
+static int builder_finish(builder *b, pgno_t *root)
+{
+    int r;
+    *root = 0;
+    for (int level = 0; level < b->nlevels; level++) {
+        char *page = b->lv[level].page;
+        int n = NODE_N(page);
+        if (n == 0) continue;
+        if (level == b->nlevels - 1) {
+            if (level > 0 && n == 1) {
+                *root = ent_pgno(NODE_ENT(page, 0));
+                return MMDB_OK;
+            }
+            r = write_all(b->fd, page, b->psize, (off_t)(b->next * b->psize));
+            if (r != MMDB_OK) return r;
+            *root = b->next++;
+            return MMDB_OK;
+        }
+        pgno_t pg;
+        r = builder_emit(b, level, &pg);
+        if (r != MMDB_OK) return r;
+    }
+    return MMDB_OK;
+}
+
+static int compact_build(MMDB *db, int fd, mmdb_meta *m)
+{
+    builder b;
+    cursor c;
+    view v;
+    char *ebuf = malloc(db->maxent);
+    int r;
+
+    if (ebuf == NULL) return MMDB_ENOMEM;
+    memset(&b, 0, sizeof(b));
+    b.fd = fd;
+    b.psize = db->pagesize;
+    b.fill = db->pagesize - db->pagesize / 8;
+    b.next = 1;
+
+    r = get_view(db, &v, m);
+    if (r == MMDB_OK) r = cursor_seek(&c, &v, NULL, 0, FALSE);
+    while (r == MMDB_OK) {
+        const char *e = cursor_entry(&c);
+        size_t elen = ent_size(e, P_LEAF);
+        if (ent_flags(e) & E_BIG) {
+            size_t vlen = ent_vlen(e);
+            pgno_t n = overflow_pages(vlen, b.psize);
+            r = write_all(fd, VPAGE(&v, ent_pgno(e)), vlen,
+                          (off_t)(b.next * b.psize));
+            if (r != MMDB_OK) break;
+            elen = ent_make(ebuf, ENT_KEY(e), ent_klen(e), E_BIG, vlen,
+                            NULL, b.next);
+            e = ebuf;
+            b.next += n;
+        }
+        r = builder_add(&b, 0, e, elen);
+        if (r == MMDB_OK) r = cursor_next(&c);
+    }
+    if (r == MMDB_NOTFOUND) {
+        pgno_t root;
+        r = builder_finish(&b, &root);
+        if (r == MMDB_OK) {
+            m->txnid++;
+            m->flags = 0;
+            m->root = root;
+            m->npages = b.next;
+            m->garbage = 0;
+            /* The file is shorter than npages if the last
+               overflow page is partial. */
+            if (ftruncate(fd, (off_t)(b.next * b.psize)) < 0) r = MMDB_ESYS;
+        }
+        if (r == MMDB_OK) {
+            char *buf = calloc(1, b.psize);
+            if (buf == NULL) r = MMDB_ENOMEM;
+            else {
+                meta_store(buf, m);
+                r = write_all(fd, buf, b.psize, 0);
+                free(buf);
+            }
+        }
+        if (r == MMDB_OK && fsync(fd) < 0) r = MMDB_ESYS;
+    }
+    for (int i=0; i<b.nlevels; i++) {
+        free(b.lv[i].page);
+        free(b.lv[i].ebuf);
+    }
+    free(ebuf);
+    return r;
+}
+
+/* Mutex held, no transaction. */
+static int compact_int(MMDB *db)
+{
+    char *tmp = tmp_path(db->path);
+    mapinfo *newm;
+    mmdb_meta m;
+    struct stat st;
+    int fd, r;
+
+    if (tmp == NULL) return MMDB_ENOMEM;
+    if (fstat(db->map->fd, &st) < 0) { free(tmp); return MMDB_ESYS; }
+    fd = open(tmp, O_RDWR|O_CREAT|O_TRUNC, st.st_mode & 0777);
+    if (fd < 0) { free(tmp); return MMDB_ESYS; }
+    r = lock_file(fd);
+    if (r == MMDB_OK) r = compact_build(db, fd, &m);
+    if (r == MMDB_OK && rename(tmp, db->path) < 0) r = MMDB_ESYS;
+    if (r != MMDB_OK) {
+        int e = errno;
+        unlink(tmp);
+        close(fd);
+        free(tmp);
+        errno = e;
+        return r;
+    }
+    free(tmp);
+
+    /* The new file has the name now, and we hold its lock. */
+    mark_moved(db->map->fd);
+    r = map_fd(db, fd, FALSE, &newm);
+    if (r != MMDB_OK) {
+        int e = errno;
+        close(fd);
+        errno = e;
+        return r;
+    }
+    map_switch(db, newm);
+    db->free_head = db->free_tail = 0;
+    return MMDB_OK;
+}
+
+/*================================================================
+ * API
+ */
+
+/* Readers don't lock; the writer's handle serializes the threads
+   sharing it. */
+#define DB_LOCK(db)                                     \
+    do {                                                \
+        if (!((db)->flags & MMDB_RDONLY))               \
+            SCM_INTERNAL_MUTEX_LOCK((db)->mutex);       \
+    } while (0)
+#define DB_UNLOCK(db)                                   \
+    do {                                                \
+        if (!((db)->flags & MMDB_RDONLY))               \
+            SCM_INTERNAL_MUTEX_UNLOCK((db)->mutex);     \
+    } while (0)
+
+static void db_free(MMDB *db)
+{
+    mapinfo *mi = db->map;
+    while (mi) {
+        mapinfo *prev = mi->prev;
+        munmap(mi->base, mi->size);
+        if (mi->fd >= 0) close(mi->fd);
+        free(mi);
+        mi = prev;
+    }
+    free(db->scratch);
+    free(db->entbuf);
+    free(db->bentbuf);
+    free(db->ents);
+    free(db->freelist);
+    free(db->pending);
+    free(db->dirty);
+    free(db->path);
+    free(db);
+}
+
+int mmdb_open(const char *path, int flags, int mode,
+              size_t mapsize, int pagesize, MMDB **rdb)
+{
+    MMDB *db;
+    mapinfo *mi;
+    long sysps;
+    int r;
+
+    if (pagesize == 0) pagesize = MIN_PAGESIZE;
+    if (pagesize < MIN_PAGESIZE || pagesize > MAX_PAGESIZE
+        || (pagesize & (pagesize - 1)) != 0) {
+        return MMDB_EINVAL;
+    }
+    db = calloc(1, sizeof(MMDB));
+    if (db == NULL) return MMDB_ENOMEM;
+    db->path = strdup(path);
+    if (db->path == NULL) { free(db); return MMDB_ENOMEM; }
+    db->flags = flags;
+    db->mapsize = mapsize? mapsize : DEFAULT_MAPSIZE;
+    sysps = sysconf(_SC_PAGESIZE);
+    db->syspagesize = (sysps > 0)? (size_t)sysps : MIN_PAGESIZE;
+    r = map_open(db, flags, mode, (uint32_t)pagesize, &mi);
+    if (r != MMDB_OK) {
+        int e = errno;
+        free(db->path);
+        free(db);
+        errno = e;
+        return r;
+    }
+    db->map = mi;
+    db->maxent = (db->pagesize - PAGE_HDR) / 4 - 2;
+    if (!(flags & MMDB_RDONLY)) {
+        db->scratch = malloc(db->pagesize);
+        db->entbuf = malloc(db->maxent);
+        db->bentbuf = malloc(db->maxent);
+        db->ents = malloc((db->pagesize / (ENT_HDR + 2) + 4) * sizeof(ent_t));
+        if (!db->scratch || !db->entbuf || !db->bentbuf || !db->ents) {
+            db_free(db);
+            return MMDB_ENOMEM;
+        }
+    }
+    SCM_INTERNAL_MUTEX_INIT(db->mutex);
+    SCM_INTERNAL_COND_INIT(db->cv);
+    *rdb = db;
+    return MMDB_OK;
+}
+
+/* An unfinished transaction is discarded. */
+int mmdb_close(MMDB *db)
+{
+    SCM_INTERNAL_MUTEX_DESTROY(db->mutex);
+    SCM_INTERNAL_COND_DESTROY(db->cv);
+    db_free(db);
+    return MMDB_OK;
+}
+
+size_t mmdb_max_key_size(MMDB *db)
+{
+    return db->maxent - ENT_HDR - 8;
+}
+
+static int lookup(view *v, const char *key, size_t klen, MMDBDatum *val)
+{
+    pgno_t pg = v->root;
+    const char *page;
+    int exact, i;
+
+    if (pg == 0) return MMDB_NOTFOUND;
+    for (int d = 0; ; d++) {
+        if (d >= MAX_DEPTH || view_node(v, pg, &page) != MMDB_OK) {
+            return MMDB_EBADFILE;
+        }
+        if (NODE_TYPE(page) == P_LEAF) break;
+        if (NODE_TYPE(page) != P_BRANCH || NODE_N(page) == 0) {
+            return MMDB_EBADFILE;
+        }
+        pg = ent_pgno(NODE_ENT(page, branch_search(page, key, klen)));
+    }
+    i = leaf_search(page, key, klen, &exact);
+    if (!exact) return MMDB_NOTFOUND;
+    if (val) return entry_value(v, NODE_ENT(page, i), val);
+    return MMDB_OK;
+}
+
+/* Reader operations are retried if the writer may have recycled the
+   pages they've read; see the comment at the top. */
+int mmdb_get(MMDB *db, const void *key, size_t klen, MMDBDatum *val)
+{
+    view v;
+    int r;
+    for (;;) {
+        DB_LOCK(db);
+        r = get_view(db, &v, NULL);
+        if (r != MMDB_OK) break;
+        r = lookup(&v, key, klen, val);
+        DB_UNLOCK(db);
+        if (r == MMDB_ENOMEM || view_valid(db, &v)) return r;
+    }
+    DB_UNLOCK(db);
+    return r;
+}
+
+int mmdb_next(MMDB *db, const void *key, size_t klen,
+              MMDBDatum *rkey, MMDBDatum *rval)
+{
+    view v;
+    cursor c;
+    int r;
+    for (;;) {
+        DB_LOCK(db);
+        r = get_view(db, &v, NULL);
+        if (r != MMDB_OK) break;
+        r = cursor_seek(&c, &v, key, klen, TRUE);
+        if (r == MMDB_OK) {
+            const char *e = cursor_entry(&c);
+            r = datum_set(rkey, ENT_KEY(e), ent_klen(e));
+            if (r == MMDB_OK) r = entry_value(&v, e, rval);
+        }
+        DB_UNLOCK(db);
+        if (r == MMDB_ENOMEM || view_valid(db, &v)) return r;
+    }
+    DB_UNLOCK(db);
+    return r;
+}
+
+int mmdb_put(MMDB *db, const void *key, size_t klen,
+             const void *val, size_t vlen)
+{
+    int r, implicit;
+    if (db->flags & MMDB_RDONLY) return MMDB_ERDONLY;
+    SCM_INTERNAL_MUTEX_LOCK(db->mutex);
+    r = txn_enter(db, &implicit);
+    if (r == MMDB_OK) {
+        r = txn_leave(db, implicit, put_int(db, key, klen, val, vlen));
+    }
+    SCM_INTERNAL_MUTEX_UNLOCK(db->mutex);
+    return r;
+}
+
+int mmdb_del(MMDB *db, const void *key, size_t klen)
+{
+    int r, implicit;
+    if (db->flags & MMDB_RDONLY) return MMDB_ERDONLY;
+    SCM_INTERNAL_MUTEX_LOCK(db->mutex);
+    r = txn_enter(db, &implicit);
+    if (r == MMDB_OK) {
+        r = txn_leave(db, implicit, del_int(db, key, klen));
+    }
+    SCM_INTERNAL_MUTEX_UNLOCK(db->mutex);
+    return r;
+}
+
+int mmdb_begin(MMDB *db)
+{
+    if (db->flags & MMDB_RDONLY) return MMDB_ERDONLY;
+    SCM_INTERNAL_MUTEX_LOCK(db->mutex);
+    txn_wait(db);
+    if (db->txn_depth > 0) db->txn_depth++;
+    else txn_start(db);
+    SCM_INTERNAL_MUTEX_UNLOCK(db->mutex);
+    return MMDB_OK;
+}
+
+int mmdb_commit(MMDB *db)
+{
+    int r = MMDB_OK;
+    if (db->flags & MMDB_RDONLY) return MMDB_ERDONLY;
+    SCM_INTERNAL_MUTEX_LOCK(db->mutex);
+    if (db->txn_depth == 0 || db->txn_owner != Scm_VM()) r = MMDB_ETXN;
+    else if (db->txn_depth > 1) db->txn_depth--;
+    else if (db->txn_doomed) {
+        txn_abort(db);
+        r = MMDB_ETXN;
+    }
+    else r = txn_commit(db);
+    SCM_INTERNAL_MUTEX_UNLOCK(db->mutex);
+    return r;
+}
+
+int mmdb_abort(MMDB *db)
+{
+    if (db->flags & MMDB_RDONLY) return MMDB_OK;
+    SCM_INTERNAL_MUTEX_LOCK(db->mutex);
+    if (db->txn_depth > 1 && db->txn_owner == Scm_VM()) {
+        /* The outermost transaction can't be committed anymore. */
+        db->txn_depth--;
+        db->txn_doomed = TRUE;
+    } else if (db->txn_depth > 0 && db->txn_owner == Scm_VM()) {
+        txn_abort(db);
+    }
+    SCM_INTERNAL_MUTEX_UNLOCK(db->mutex);
+    return MMDB_OK;
+}
+
+int mmdb_compact(MMDB *db)
+{
+    int r;
+    if (db->flags & MMDB_RDONLY) return MMDB_ERDONLY;
+    SCM_INTERNAL_MUTEX_LOCK(db->mutex);
+    txn_wait(db);
+    if (db->txn_depth > 0) r = MMDB_ETXN;
+    else r = compact_int(db);
+    SCM_INTERNAL_MUTEX_UNLOCK(db->mutex);
+    return r;
+}
+
+int mmdb_count(MMDB *db, uint64_t *count)
+{
+    view v;
+    mmdb_meta m;
+    int r;
+    DB_LOCK(db);
+    r = get_view(db, &v, &m);
+    if (r == MMDB_OK) *count = m.nkeys;
+    DB_UNLOCK(db);
+    return r;
+}
+
+const char *mmdb_strerror(int code)
+{
+    switch (code) {
+    case MMDB_OK:       return "success";
+    case MMDB_NOTFOUND: return "key not found";
+    case MMDB_ESYS:     return "system error";
+    case MMDB_EBADFILE: return "not a mmdbm database, or corrupted";
+    case MMDB_ELOCKED:  return "database is locked by another writer";
+    case MMDB_EKEYSIZE: return "key too long";
+    case MMDB_EFULL:    return "database exceeds the map size";
+    case MMDB_ERDONLY:  return "database is read-only";
+    case MMDB_ETXN:     return "no transaction, the transaction is aborted, or a transaction in progress";
+    case MMDB_ENOMEM:   return "out of memory";
+    case MMDB_EINVAL:   return "invalid argument";
+    default:            return "unknown error";
+    }
+}
@@ -0,0 +1,117 @@
+/*
+ * mmdb.h - mmap-backed B+tree store for dbm.mmdbm
+ *
+ *
+ *   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * A single-writer, multiple-reader key-value store kept in one file.
+ * The file is a copy-on-write B+tree: a commit never overwrites a page
+ * reachable from a previous commit; it appends the modified pages and
+ * then switches the root by writing one of two meta records.  Hence
+ * readers need no locks---whatever meta record they pick, the tree it
+ * points to stays intact, as long as the writer doesn't recycle the
+ * pages the reader is looking at.  The writer reuses a freed page only
+ * after a few more commits, and a reader verifies, after copying out
+ * the result, that not that many commits have happened meanwhile;
+ * otherwise it retries.  Unreachable pages not recycled this way are
+ * reclaimed by compaction, which rewrites the live tree into a new file.
+ */
+
+#ifndef GAUCHE_MMDB_H
+#define GAUCHE_MMDB_H
+
+#include <gauche.h>
+
+typedef struct MMDBRec MMDB;
+
+/* A buffer to receive keys and values.  PTR is malloc'ed and grown as
+   needed; initialize all fields to 0 and free PTR after use. */
+typedef struct MMDBDatumRec {
+    char *ptr;
+    size_t len;
+    size_t size;
+} MMDBDatum;
+
+/* mmdb_open flags */
+enum {
+    MMDB_RDONLY  = (1L<<0),     /* read only.  doesn't take the lock */
+    MMDB_CREATE  = (1L<<1),     /* create the file if it doesn't exist */
+    MMDB_TRUNC   = (1L<<2),     /* discard the existing contents */
+    MMDB_NOSYNC  = (1L<<3),     /* don't flush to disk on commit */
+    MMDB_NOCOMPACT = (1L<<4)    /* don't compact automatically */
+};
+
+/* Return codes.  MMDB_ESYS means errno tells the detail. */
+enum {
+    MMDB_OK = 0,
+    MMDB_NOTFOUND = -1,
+    MMDB_ESYS = -2,
+    MMDB_EBADFILE = -3,         /* not a mmdbm file, or incompatible */
+    MMDB_ELOCKED = -4,          /* another writer has the file */
+    MMDB_EKEYSIZE = -5,         /* key too long */
+    MMDB_EFULL = -6,            /* map size exceeded */
+    MMDB_ERDONLY = -7,          /* write operation on read-only db */
+    MMDB_ETXN = -8,             /* operation not allowed in transaction */
+    MMDB_ENOMEM = -9,
+    MMDB_EINVAL = -10           /* bad parameter */
+};
+
+extern int mmdb_open(const char *path, int flags, int mode,
+                     size_t mapsize, int pagesize, MMDB **db);
+extern int mmdb_close(MMDB *db);
+
+/* VAL can be NULL to check the existence only. */
+extern int mmdb_get(MMDB *db, const void *key, size_t klen, MMDBDatum *val);
+extern int mmdb_put(MMDB *db, const void *key, size_t klen,
+                    const void *val, size_t vlen);
+extern int mmdb_del(MMDB *db, const void *key, size_t klen);
+
+/* Finds the smallest entry whose key is greater than KEY, or the first
+   entry if KEY is NULL. */
+extern int mmdb_next(MMDB *db, const void *key, size_t klen,
+                     MMDBDatum *rkey, MMDBDatum *rval);
+
+/* Batched writes.  Updates between mmdb_begin and mmdb_commit are made
+   durable and visible to others at once.  Calls may nest; only the
+   outermost commit counts.  If an update fails, or a nested batch is
+   aborted, the whole batch is discarded: the following updates and the
+   outermost commit fail with MMDB_ETXN. */
+extern int mmdb_begin(MMDB *db);
+extern int mmdb_commit(MMDB *db);
+extern int mmdb_abort(MMDB *db);
+
+extern int mmdb_compact(MMDB *db);
+extern int mmdb_count(MMDB *db, uint64_t *count);
+extern size_t mmdb_max_key_size(MMDB *db);
+extern const char *mmdb_strerror(int code);
+
+#endif /* GAUCHE_MMDB_H */
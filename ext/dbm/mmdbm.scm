@@ -0,0 +1,332 @@
+;;;
+;;; mmdbm - native mmap-backed dbm
+;;;
+;;;   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+;;;
+;;;   Redistribution and use in source and binary forms, with or without
+;;;   modification, are permitted provided that the following conditions
+;;;   are met:
+;;;
+;;;   1. Redistributions of source code must retain the above copyright
+;;;      notice, this list of conditions and the following disclaimer.
+;;;
+;;;   2. Redistributions in binary form must reproduce the above copyright
+;;;      notice, this list of conditions and the following disclaimer in the
+;;;      documentation and/or other materials provided with the distribution.
+;;;
+;;;   3. Neither the name of the authors nor the names of its contributors
+;;;      may be used to endorse or promote products derived from this
+;;;      software without specific prior written permission.
+;;;
+;;;   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+;;;   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+;;;   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+;;;   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+;;;   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+;;;   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+;;;   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+;;;   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+;;;   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+;;;   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+;;;   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+;;;
+
+;; A dbm implementation that doesn't depend on external libraries.
+;; The database is a copy-on-write B+tree in a single file, accessed
+;; through mmap.  See mmdb.c for the details.
+
+(define-module dbm.mmdbm
+  (extend dbm)
+  (export <mmdbm> mmdbm-batch mmdbm-compact mmdbm-count)
+  )
+(select-module dbm.mmdbm)
+
+;;;
+;;; High-level dbm interface
+;;;
+
+(define-class <mmdbm-meta> (<dbm-meta>)
+  ())
+
+(define-class <mmdbm> (<dbm>)
+  ((mmdbm-file   :accessor mmdbm-file-of :initform #f)
+   (sync         :init-keyword :sync         :initform #t)
+   (auto-compact :init-keyword :auto-compact :initform #t)
+   (map-size     :init-keyword :map-size     :initform 0)
+   (page-size    :init-keyword :page-size    :initform 0)
+   )
+  :metaclass <mmdbm-meta>)
+
+(define-method dbm-open ((self <mmdbm>))
+  (next-method)
+  (unless (slot-bound? self 'path)
+    (error "path must be set to open mmdbm database"))
+  (when (mmdbm-file-of self)
+    (errorf "mmdbm ~S already opened" self))
+  (let* ([path  (slot-ref self 'path)]
+         [opts  (+ (if (slot-ref self 'sync) 0 MMDB_NOSYNC)
+                   (if (slot-ref self 'auto-compact) 0 MMDB_NOCOMPACT))]
+         [flags (case (slot-ref self 'rw-mode)
+                  [(:read)   MMDB_RDONLY]
+                  [(:write)  (+ MMDB_CREATE opts)]
+                  [(:create) (+ MMDB_CREATE MMDB_TRUNC opts)])])
+    (slot-set! self 'mmdbm-file
+               (mmdb-open path flags (slot-ref self 'file-mode)
+                          (slot-ref self 'map-size)
+                          (slot-ref self 'page-size)))
+    self))
+
+;;
+;; close operation
+;;
+
+(define-method dbm-close ((self <mmdbm>))
+  (let1 f (mmdbm-file-of self)
+    (and f (mmdb-close f))))
+
+(define-method dbm-closed? ((self <mmdbm>))
+  (let1 f (mmdbm-file-of self)
+    (or (not f) (mmdb-closed? f))))
+
+;;
+;; accessors
+;;
+
+(define-method dbm-put! ((self <mmdbm>) key value)
+  (next-method)
+  (mmdb-put (mmdbm-file-of self) (%dbm-k2s self key) (%dbm-v2s self value)))
+
+(define-method dbm-get ((self <mmdbm>) key . args)
+  (next-method)
+  (cond [(mmdb-get (mmdbm-file-of self) (%dbm-k2s self key))
+         => (cut %dbm-s2v self <>)]
+        [(pair? args) (car args)]     ;fall-back value
+        [else  (errorf "mmdbm: no data for key ~s in database ~s"
+                       key (mmdbm-file-of self))]))
+
+(define-method dbm-exists? ((self <mmdbm>) key)
+  (next-method)
+  (mmdb-exists? (mmdbm-file-of self) (%dbm-k2s self key)))
+
+(define-method dbm-delete! ((self <mmdbm>) key)
+  (next-method)
+  (mmdb-delete (mmdbm-file-of self) (%dbm-k2s self key)))
+
+;;
+;; Iterations
+;;
+
+;; Entries are visited in the order of the serialized keys.  Each step
+;; looks up the successor of the previous key in the latest committed
+;; tree, so the database can be modified during the iteration.
+(define-method dbm-fold ((self <mmdbm>) proc knil)
+  (let1 f (mmdbm-file-of self)
+    (let loop ([kv (mmdb-next f #f)] [r knil])
+      (if kv
+        (loop (mmdb-next f (car kv))
+              (proc (%dbm-s2k self (car kv)) (%dbm-s2v self (cdr kv)) r))
+        r))))
+
+;;
+;; mmdbm specific operations
+;;
+
+;; Updates in THUNK are committed at once when it returns.  If it exits
+;; otherwise, they are discarded.
+(define (mmdbm-batch db thunk)
+  (let ([f (mmdbm-file-of db)]
+        [done #f])
+    (dynamic-wind
+      (^[] (mmdb-begin f))
+      (^[] (receive r (thunk)
+             (set! done #t)
+             (mmdb-commit f)
+             (apply values r)))
+      (^[] (unless done (mmdb-abort f))))))
+
+(define (mmdbm-compact db) (mmdb-compact (mmdbm-file-of db)))
+
+(define (mmdbm-count db) (mmdb-count (mmdbm-file-of db)))
+
+;;
+;; Metaoperations
+;;
+
+(autoload file.util copy-file move-file)
+
+;; Holding the writer's lock keeps the file intact while we copy it.
+(define (%with-mmdbm-locking path thunk)
+  (let1 f (mmdb-open path MMDB_NOCOMPACT #o664 0 0)
+    (unwind-protect (thunk) (mmdb-close f))))
+
+(define-method dbm-db-exists? ((class <mmdbm-meta>) name)
+  (file-exists? name))
+
+(define-method dbm-db-remove ((class <mmdbm-meta>) name)
+  (sys-unlink name))
+
+(define-method dbm-db-copy ((class <mmdbm-meta>) from to . keys)
+  (%with-mmdbm-locking from
+   (^[] (apply copy-file from to :safe #t keys))))
+
+(define-method dbm-db-move ((class <mmdbm-meta>) from to . keys)
+  (%with-mmdbm-locking from
+   (^[] (apply move-file from to :safe #t keys))))
+
+;;;
+;;; Low-level bindings
+;;;
+
+(inline-stub
+ "#include \"mmdb.h\""
+ "#include <stdlib.h>"
+
+ "typedef struct ScmMmdbFileRec {
+    SCM_HEADER;
+    ScmObj name;
+    MMDB *db;                   /* NULL if closed */
+  } ScmMmdbFile;"
+
+ (define-cclass <mmdb-file> :private ScmMmdbFile* "Scm_MmdbFileClass" ()
+   ()
+   [printer
+    (Scm_Printf port "#<mmdb-file %S>" (-> (SCM_MMDB_FILE obj) name))])
+
+ (define-cfn mmdb_finalize (obj data::void*) ::void :static
+   (let* ([f::ScmMmdbFile* (SCM_MMDB_FILE obj)])
+     (when (-> f db)
+       (mmdb_close (-> f db))
+       (set! (-> f db) NULL))))
+
+ (define-cfn mmdb_raise (f::ScmMmdbFile* r::int what::(const char*))
+   ::void :static
+   (if (== r MMDB_ESYS)
+     (Scm_SysError "mmdbm: %s failed on %S" what (-> f name))
+     (Scm_Error "mmdbm: %s failed on %S: %s" what (-> f name)
+                (mmdb_strerror r))))
+
+ (define-cise-stmt CHECK_MMDB
+   [(_ f)
+    `(unless (-> ,f db) (Scm_Error "mmdb file already closed: %S" ,f))])
+
+ (define-cise-stmt WITH_KEY
+   [(_ (ptr len) scm . body)
+    (let ((tmp (gensym)))
+      `(let* ([,tmp :: (const ScmStringBody*) (SCM_STRING_BODY ,scm)]
+              [,ptr :: (const char*) (SCM_STRING_BODY_START ,tmp)]
+              [,len :: size_t (SCM_STRING_BODY_SIZE ,tmp)])
+         ,@body))])
+
+ ;; Takes the buffer of D.
+ (define-cfn datum_to_string (d::MMDBDatum*) :static
+   (let* ([s (Scm_MakeString (-> d ptr) (-> d len) -1 SCM_STRING_COPYING)])
+     (free (-> d ptr))
+     (set! (-> d ptr) NULL)
+     (return s)))
+
+ (define-cproc mmdb-open (name::<string> flags::<fixnum> fmode::<fixnum>
+                          mapsize::<ulong> pagesize::<fixnum>)
+   (let* ([z::ScmMmdbFile* (SCM_NEW ScmMmdbFile)]
+          [r::int 0])
+     (SCM_SET_CLASS z (& Scm_MmdbFileClass))
+     (set! (-> z name) (SCM_OBJ name))
+     (set! r (mmdb_open (Scm_GetStringConst name) flags fmode
+                        mapsize pagesize (& (-> z db))))
+     (unless (== r MMDB_OK)
+       (set! (-> z db) NULL)
+       (mmdb_raise z r "open"))
+     (Scm_RegisterFinalizer (SCM_OBJ z) mmdb_finalize NULL)
+     (return (SCM_OBJ z))))
+
+ (define-cproc mmdb-close (f::<mmdb-file>) ::<void>
+   (when (-> f db)
+     (mmdb_close (-> f db))
+     (set! (-> f db) NULL)))
+
+ (define-cproc mmdb-closed? (f::<mmdb-file>) ::<boolean>
+   (return (== (-> f db) NULL)))
+
+ (define-cproc mmdb-put (f::<mmdb-file> key::<string> val::<string>) ::<void>
+   (CHECK_MMDB f)
+   (WITH_KEY (k klen) key
+     (WITH_KEY (v vlen) val
+       (let* ([r::int (mmdb_put (-> f db) k klen v vlen)])
+         (unless (== r MMDB_OK) (mmdb_raise f r "put"))))))
+
+ (define-cproc mmdb-get (f::<mmdb-file> key::<string>)
+   (CHECK_MMDB f)
+   (WITH_KEY (k klen) key
+     (let* ([d::MMDBDatum] [r::int])
+       (set! (ref d ptr) NULL (ref d len) 0 (ref d size) 0)
+       (set! r (mmdb_get (-> f db) k klen (& d)))
+       (cond [(== r MMDB_OK) (return (datum_to_string (& d)))]
+             [else (free (ref d ptr))
+                   (unless (== r MMDB_NOTFOUND) (mmdb_raise f r "get"))
+                   (return SCM_FALSE)]))))
+
+ (define-cproc mmdb-exists? (f::<mmdb-file> key::<string>) ::<boolean>
+   (CHECK_MMDB f)
+   (WITH_KEY (k klen) key
+     (let* ([r::int (mmdb_get (-> f db) k klen NULL)])
+       (unless (or (== r MMDB_OK) (== r MMDB_NOTFOUND))
+         (mmdb_raise f r "get"))
+       (return (== r MMDB_OK)))))
+
+ ;; Deleting a nonexistent key isn't an error.
+ (define-cproc mmdb-delete (f::<mmdb-file> key::<string>) ::<void>
+   (CHECK_MMDB f)
+   (WITH_KEY (k klen) key
+     (let* ([r::int (mmdb_del (-> f db) k klen)])
+       (unless (or (== r MMDB_OK) (== r MMDB_NOTFOUND))
+         (mmdb_raise f r "delete")))))
+
+ ;; Returns (key . value) of the entry next to KEY, or the first one
+ ;; if KEY is #f.  Returns #f if there's no such entry.
+ (define-cproc mmdb-next (f::<mmdb-file> key::<string>?)
+   (let* ([dk::MMDBDatum] [dv::MMDBDatum] [r::int])
+     (CHECK_MMDB f)
+     (set! (ref dk ptr) NULL (ref dk len) 0 (ref dk size) 0)
+     (set! (ref dv ptr) NULL (ref dv len) 0 (ref dv size) 0)
+     (if (== key NULL)
+       (set! r (mmdb_next (-> f db) NULL 0 (& dk) (& dv)))
+       (WITH_KEY (k klen) key
+         (set! r (mmdb_next (-> f db) k klen (& dk) (& dv)))))
+     (cond [(== r MMDB_OK)
+            (let* ([sk (datum_to_string (& dk))])
+              (return (Scm_Cons sk (datum_to_string (& dv)))))]
+           [else (free (ref dk ptr))
+                 (free (ref dv ptr))
+                 (unless (== r MMDB_NOTFOUND) (mmdb_raise f r "next"))
+                 (return SCM_FALSE)])))
+
+ (define-cproc mmdb-begin (f::<mmdb-file>) ::<void>
+   (CHECK_MMDB f)
+   (let* ([r::int (mmdb_begin (-> f db))])
+     (unless (== r MMDB_OK) (mmdb_raise f r "begin"))))
+
+ (define-cproc mmdb-commit (f::<mmdb-file>) ::<void>
+   (CHECK_MMDB f)
+   (let* ([r::int (mmdb_commit (-> f db))])
+     (unless (== r MMDB_OK) (mmdb_raise f r "commit"))))
+
+ (define-cproc mmdb-abort (f::<mmdb-file>) ::<void>
+   (when (-> f db) (mmdb_abort (-> f db))))
+
+ (define-cproc mmdb-compact (f::<mmdb-file>) ::<void>
+   (CHECK_MMDB f)
+   (let* ([r::int (mmdb_compact (-> f db))])
+     (unless (== r MMDB_OK) (mmdb_raise f r "compact"))))
+
+ (define-cproc mmdb-count (f::<mmdb-file>)
+   (let* ([n::uint64_t 0] [r::int])
+     (CHECK_MMDB f)
+     (set! r (mmdb_count (-> f db) (& n)))
+     (unless (== r MMDB_OK) (mmdb_raise f r "count"))
+     (return (Scm_MakeIntegerU64 n))))
+
+ (define-enum MMDB_RDONLY)
+ (define-enum MMDB_CREATE)
+ (define-enum MMDB_TRUNC)
+ (define-enum MMDB_NOSYNC)
+ (define-enum MMDB_NOCOMPACT)
+ )
@@ -179,7 +179,7 @@
 (define (clean-up)
   (define (remover f)
     (remove-files (list f (string-append f ".dir") (string-append f ".pag")
-                        (string-append f ".db"))))
+                        (string-append f ".db") (string-append f ".tmp"))))
   (remover *test-dbm*)
   (remover *test2-dbm*))
 
@@ -274,5 +274,64 @@
 ;;
 
 (test-if-exists "dbm--odbm" dbm.odbm <odbm>)
+;;
+;; MMDBM test
+;;
+
+(test-if-exists "dbm--mmdbm" dbm.mmdbm <mmdbm>)
+
+(define-macro (when-mmdbm . body)
+  (if (file-exists? (string-append "dbm--mmdbm." (gauche-dso-suffix)))
+    `(begin ,@body)
+    '(begin)))
+
+(when-mmdbm
+ (test-section "mmdbm specific")
+ (clean-up)
+ (let ([db (dbm-open <mmdbm> :path *test-dbm* :rw-mode :create)]
+       [keys (map (^i (format "k~3,'0d" (modulo (* i 7) 100))) (iota 100))])
+   (test* "batch" '(#t 100)
+          (mmdbm-batch db
+            (^[]
+              (for-each (^k (dbm-put! db k (string-append k "v"))) keys)
+              (list (dbm-exists? db "k050") (mmdbm-count db)))))
+   (test* "fold is ordered" (sort keys)
+          (reverse (dbm-fold db (^[k v r] (cons k r)) '())))
+   (test* "batch abort" '(#f 100)
+          (begin
+            (guard (e [else #f])
+              (mmdbm-batch db
+                (^[] (dbm-put! db "x" "1") (dbm-delete! db "k000")
+                     (error "abort"))))
+            (list (dbm-exists? db "x") (mmdbm-count db))))
+   (test* "nested batch abort" '(#f #f)
+          (let1 r (guard (e [else #f])
+                    (mmdbm-batch db
+                      (^[]
+                        (dbm-put! db "x" "1")
+                        (guard (e [else #f])
+                          (mmdbm-batch db (^[] (error "inner"))))
+                        (dbm-put! db "y" "2")))
+                    #t)
+            (list r (dbm-exists? db "x"))))
+   (test* "long value" 100000
+          (begin (dbm-put! db "long" (make-string 100000 #\z))
+                 (string-length (dbm-get db "long"))))
+   (test* "another writer" (test-error)
+          (dbm-open <mmdbm> :path *test-dbm* :rw-mode :write))
+   (let1 rd (dbm-open <mmdbm> :path *test-dbm* :rw-mode :read)
+     (test* "reader" "k042v" (dbm-get rd "k042"))
+     (dbm-put! db "k042" "new")
+     (test* "reader sees commit" "new" (dbm-get rd "k042"))
+     (dbm-delete! db "long")
+     (mmdbm-compact db)
+     (dbm-put! db "k043" "newer")
+     (test* "reader after compaction" '("new" "newer" #f 100)
+            (list (dbm-get rd "k042") (dbm-get rd "k043")
+                  (dbm-get rd "long" #f) (mmdbm-count rd)))
+     (dbm-close rd))
+   (dbm-close db))
+ (clean-up))
+
 
 (test-end)
@@ -0,0 +1,155 @@
+;;;
+;;; blake2 - BLAKE2b message digest
+;;;
+;;;   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+;;;
+;;;   Redistribution and use in source and binary forms, with or without
+;;;   modification, are permitted provided that the following conditions
+;;;   are met:
+;;;
+;;;   1. Redistributions of source code must retain the above copyright
+;;;      notice, this list of conditions and the following disclaimer.
+;;;
+;;;   2. Redistributions in binary form must reproduce the above copyright
+;;;      notice, this list of conditions and the following disclaimer in the
+;;;      documentation and/or other materials provided with the distribution.
+;;;
+;;;   3. Neither the name of the authors nor the names of its contributors
+;;;      may be used to endorse or promote products derived from this
+;;;      software without specific prior written permission.
+;;;
+;;;   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+;;;   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+;;;   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+;;;   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+;;;   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+;;;   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+;;;   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+;;;   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+;;;   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+;;;   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+;;;   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+;;;
+
+;;; Cf. RFC 7693 The BLAKE2 Cryptographic Hash and Message Authentication Code
+
+(define-module rfc.blake2
+  (use gauche.uvector)
+  (extend util.digest)
+  (export <blake2b> blake2b-digest blake2b-digest-string))
+(select-module rfc.blake2)
+
+;;;
+;;;  High-level API
+;;;
+
+(define-constant *blake2-unit-len* 4096)
+
+(define (blake2b-digest :key (size 64) (key #f))
+  (let ([ctx (make <blake2b-context>)]
+        [buf (make-u8vector *blake2-unit-len*)])
+    (%blake2b-init ctx size key)
+    (generator-for-each
+     (^x (%blake2b-update ctx x))
+     (^[] (let1 count (read-block! buf)
+            (cond [(eof-object? count) count]
+                  [(< count *blake2-unit-len*)
+                   (uvector-alias <u8vector> buf 0 count)]
+                  [else buf]))))
+    (%blake2b-final ctx)))
+
+(define (blake2b-digest-string s . opts)
+  (with-input-from-string s (cut apply blake2b-digest opts)))
+
+;;;
+;;; Digest framework
+;;;
+
+(define-class <blake2b-meta> (<message-digest-algorithm-meta>) ())
+
+;; (make <blake2b> :size SIZE :key KEY)
+;;   SIZE is the digest length in bytes, from 1 to 64 (default 64).
+;;   KEY, if given, is a string or u8vector up to 64 bytes, which
+;;   makes it a keyed hash (MAC).
+(define-class <blake2b> (<message-digest-algorithm>)
+  (context)
+  :metaclass <blake2b-meta>
+  :hmac-block-size 128)
+
+(define-method initialize ((self <blake2b>) initargs)
+  (next-method)
+  (let1 ctx (make <blake2b-context>)
+    (%blake2b-init ctx
+                   (get-keyword :size initargs 64)
+                   (get-keyword :key initargs #f))
+    (slot-set! self 'context ctx)))
+(define-method digest-update! ((self <blake2b>) data)
+  (%blake2b-update (slot-ref self'context) data))
+(define-method digest-final! ((self <blake2b>))
+  (%blake2b-final (slot-ref self'context)))
+(define-method digest ((class <blake2b-meta>))
+  (blake2b-digest))
+
+;;;
+;;; Low-level bindings
+;;;
+
+(inline-stub
+ "#include <gauche/class.h>"
+ "#include \"blake2b.h\""
+
+ "#define LIBGAUCHE_EXT_BODY"
+ "#include <gauche/extern.h>  /* fix SCM_EXTERN in SCM_CLASS_DECL */"
+
+ "typedef struct ScmBlake2bContextRec {"
+ " SCM_HEADER;"
+ " Blake2bState ctx;"
+ "} ScmBlake2bContext;"
+
+ (define-cclass <blake2b-context> :private
+   ScmBlake2bContext* "Scm_Blake2bContextClass" ()
+   ()
+   [allocator
+    (let* ([ctx :: ScmBlake2bContext* (SCM_NEW_INSTANCE ScmBlake2bContext klass)])
+      (Scm_Blake2bInit (& (-> ctx ctx)) BLAKE2B_MAX_DIGEST_LENGTH NULL 0)
+      (return (SCM_OBJ ctx)))])
+
+ ;; Sets *P and *LEN to the bytes of a string or u8vector.
+ (define-cfn get_bytes (data p::(const uint8_t**) len::size_t*) ::void :static
+   (cond
+    [(SCM_U8VECTORP data)
+     (set! (* p) (cast (const uint8_t*)
+                       (SCM_UVECTOR_ELEMENTS (SCM_U8VECTOR data)))
+           (* len) (SCM_U8VECTOR_SIZE (SCM_U8VECTOR data)))]
+    [(SCM_STRINGP data)
+     (let* ([b::(const ScmStringBody*) (SCM_STRING_BODY data)])
+       (set! (* p) (cast (const uint8_t*) (SCM_STRING_BODY_START b))
+             (* len) (SCM_STRING_BODY_SIZE b)))]
+    [else (SCM_TYPE_ERROR data "u8vector or string")]))
+
+ (define-cproc %blake2b-init (ctx::<blake2b-context> size::<int> key)
+   ::<void>
+   (let* ([k::(const uint8_t*) NULL]
+          [klen::size_t 0])
+     (unless (SCM_FALSEP key) (get_bytes key (& k) (& klen)))
+     (when (or (< size 1) (> size BLAKE2B_MAX_DIGEST_LENGTH))
+       (Scm_Error "BLAKE2b digest size must be between 1 and %d, but got: %d"
+                  BLAKE2B_MAX_DIGEST_LENGTH size))
+     (when (> klen BLAKE2B_MAX_KEY_LENGTH)
+       (Scm_Error "BLAKE2b key can't be longer than %d bytes, but got: %S"
+                  BLAKE2B_MAX_KEY_LENGTH key))
+     (Scm_Blake2bInit (& (-> ctx ctx)) size k klen)))
+
+ (define-cproc %blake2b-update (ctx::<blake2b-context> data) ::<void>
+   (let* ([p::(const uint8_t*)] [len::size_t])
+     (get_bytes data (& p) (& len))
+     (Scm_Blake2bUpdate (& (-> ctx ctx)) p len)))
+
+ (define-cproc %blake2b-final (ctx::<blake2b-context>)
+   (let* ([digest::(.array (unsigned char) [BLAKE2B_MAX_DIGEST_LENGTH])]
+          [size::int (-> ctx ctx outlen)])
+     (Scm_Blake2bFinal (& (-> ctx ctx)) digest)
+     (return (Scm_MakeString (cast (const char*) digest) size size
+                             (logior SCM_STRING_INCOMPLETE
+                                     SCM_STRING_COPYING)))))
+ )
@@ -0,0 +1,180 @@
+/*
+ * blake2b.c - BLAKE2b message digest
+ *
+ *   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * BLAKE2b as specified in RFC 7693.
+ */
+
+#include <string.h>
+#include "blake2b.h"
+
+static const uint64_t blake2b_iv[8] = {
+    0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL,
+    0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+    0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL,
+    0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL
+};
+
+static const uint8_t blake2b_sigma[12][16] = {
+    {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+    { 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 },
+    { 11,  8, 12,  0,  5,  2, 15, 13, 10, 14,  3,  6,  7,  1,  9,  4 },
+    {  7,  9,  3,  1, 13, 12, 11, 14,  2,  6,  5, 10,  4,  0, 15,  8 },
+    {  9,  0,  5,  7,  2,  4, 10, 15, 14,  1, 11, 12,  6,  8,  3, 13 },
+    {  2, 12,  6, 10,  0, 11,  8,  3,  4, 13,  7,  5, 15, 14,  1,  9 },
+    { 12,  5,  1, 15, 14, 13,  4, 10,  0,  7,  6,  3,  9,  2,  8, 11 },
+    { 13, 11,  7, 14, 12,  1,  3,  9,  5,  0, 15,  4,  8,  6,  2, 10 },
+    {  6, 15, 14,  9, 11,  3,  0,  8, 12,  2, 13,  7,  1,  4, 10,  5 },
+    { 10,  2,  8,  4,  7,  6,  1,  5, 15, 11,  9, 14,  3, 12, 13,  0 },
+    {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+    { 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 }
+};
+
+static inline uint64_t load64_le(const uint8_t *p)
+{
+    return (uint64_t)p[0]         | ((uint64_t)p[1] << 8)
+        | ((uint64_t)p[2] << 16) | ((uint64_t)p[3] << 24)
+        | ((uint64_t)p[4] << 32) | ((uint64_t)p[5] << 40)
+        | ((uint64_t)p[6] << 48) | ((uint64_t)p[7] << 56);
+}
+
+static inline uint64_t rotr64(uint64_t x, int n)
+{
+    return (x >> n) | (x << (64 - n));
+}
+
+#define G(a, b, c, d, x, y)                     \
+    do {                                        \
+        v[a] = v[a] + v[b] + (x);               \
+        v[d] = rotr64(v[d] ^ v[a], 32);         \
+        v[c] = v[c] + v[d];                     \
+        v[b] = rotr64(v[b] ^ v[c], 24);         \
+        v[a] = v[a] + v[b] + (y);               \
+        v[d] = rotr64(v[d] ^ v[a], 16);         \
+        v[c] = v[c] + v[d];                     \
+        v[b] = rotr64(v[b] ^ v[c], 63);         \
+    } while (0)
+
+static void blake2b_compress(Blake2bState *s, const uint8_t *block, int lastp)
+{
+    uint64_t v[16], m[16];
+
+    for (int i = 0; i < 16; i++) m[i] = load64_le(block + i*8);
+    for (int i = 0; i < 8; i++) {
+        v[i] = s->h[i];
+        v[i+8] = blake2b_iv[i];
+    }
+    v[12] ^= s->t[0];
+    v[13] ^= s->t[1];
+    if (lastp) v[14] = ~v[14];
+
+    for (int r = 0; r < 12; r++) {
+        const uint8_t *sg = blake2b_sigma[r];
+        G(0, 4,  8, 12, m[sg[ 0]], m[sg[ 1]]);
+        G(1, 5,  9, 13, m[sg[ 2]], m[sg[ 3]]);
+        G(2, 6, 10, 14, m[sg[ 4]], m[sg[ 5]]);
+        G(3, 7, 11, 15, m[sg[ 6]], m[sg[ 7]]);
+        G(0, 5, 10, 15, m[sg[ 8]], m[sg[ 9]]);
+        G(1, 6, 11, 12, m[sg[10]], m[sg[11]]);
+        G(2, 7,  8, 13, m[sg[12]], m[sg[13]]);
+        G(3, 4,  9, 14, m[sg[14]], m[sg[15]]);
+    }
+    for (int i = 0; i < 8; i++) s->h[i] ^= v[i] ^ v[i+8];
+}
+
+static void blake2b_count(Blake2bState *s, size_t n)
+{
+    s->t[0] += n;
+    if (s->t[0] < n) s->t[1]++;
+}
+
+int Scm_Blake2bInit(Blake2bState *s, size_t outlen,
+                    const uint8_t *key, size_t keylen)
+{
+    if (outlen == 0 || outlen > BLAKE2B_MAX_DIGEST_LENGTH
+        || keylen > BLAKE2B_MAX_KEY_LENGTH) {
+        return -1;
+    }
+    memset(s, 0, sizeof(*s));
+    for (int i = 0; i < 8; i++) s->h[i] = blake2b_iv[i];
+    /* parameter block: digest length, key length, fanout=1, depth=1 */
+    s->h[0] ^= 0x01010000ULL ^ ((uint64_t)keylen << 8) ^ outlen;
+    s->outlen = outlen;
+    if (keylen > 0) {
+        /* The key is fed as a full, zero-padded first block. */
+        memcpy(s->buf, key, keylen);
+        s->buflen = BLAKE2B_BLOCK_LENGTH;
+    }
+    return 0;
+}
+
+void Scm_Blake2bUpdate(Blake2bState *s, const uint8_t *data, size_t len)
+{
+    /* The last block has to be compressed with the final flag, so we
+       always keep at least one byte in the buffer. */
+    while (len > 0) {
+        if (s->buflen == BLAKE2B_BLOCK_LENGTH) {
+            blake2b_count(s, BLAKE2B_BLOCK_LENGTH);
+            blake2b_compress(s, s->buf, 0);
+            s->buflen = 0;
+        }
+        if (s->buflen == 0) {
+            /* Process full blocks directly from the input. */
+            while (len > BLAKE2B_BLOCK_LENGTH) {
+                blake2b_count(s, BLAKE2B_BLOCK_LENGTH);
+                blake2b_compress(s, data, 0);
+                data += BLAKE2B_BLOCK_LENGTH;
+                len -= BLAKE2B_BLOCK_LENGTH;
+            }
+        }
+        size_t n = BLAKE2B_BLOCK_LENGTH - s->buflen;
+        if (n > len) n = len;
+        memcpy(s->buf + s->buflen, data, n);
+        s->buflen += n;
+        data += n;
+        len -= n;
+    }
+}
+
+void Scm_Blake2bFinal(Blake2bState *s, uint8_t *out)
+{
+    uint8_t h[BLAKE2B_MAX_DIGEST_LENGTH];
+
+    blake2b_count(s, s->buflen);
+    memset(s->buf + s->buflen, 0, BLAKE2B_BLOCK_LENGTH - s->buflen);
+    blake2b_compress(s, s->buf, 1);
+    for (int i = 0; i < 8; i++) {
+        for (int j = 0; j < 8; j++) h[i*8+j] = (uint8_t)(s->h[i] >> (j*8));
+    }
+    memcpy(out, h, s->outlen);
+}
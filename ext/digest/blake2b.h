@@ -0,0 +1,60 @@
+/*
+ * blake2b.h - BLAKE2b message digest
+ *
+ *   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef GAUCHE_BLAKE2B_H
+#define GAUCHE_BLAKE2B_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define BLAKE2B_BLOCK_LENGTH      128
+#define BLAKE2B_MAX_DIGEST_LENGTH 64
+#define BLAKE2B_MAX_KEY_LENGTH    64
+
+typedef struct Blake2bStateRec {
+    uint64_t h[8];              /* chain value */
+    uint64_t t[2];              /* total bytes, 128bit */
+    uint8_t  buf[BLAKE2B_BLOCK_LENGTH];
+    size_t   buflen;
+    size_t   outlen;
+} Blake2bState;
+
+/* Returns 0 on success, -1 if OUTLEN or KEYLEN is out of range. */
+extern int  Scm_Blake2bInit(Blake2bState *s, size_t outlen,
+                            const uint8_t *key, size_t keylen);
+extern void Scm_Blake2bUpdate(Blake2bState *s, const uint8_t *data,
+                              size_t len);
+/* OUT must have room for s->outlen bytes. */
+extern void Scm_Blake2bFinal(Blake2bState *s, uint8_t *out);
+
+#endif /* GAUCHE_BLAKE2B_H */
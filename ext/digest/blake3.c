@@ -0,0 +1,297 @@
+/*
+ * blake3.c - BLAKE3 message digest
+ *
+ *   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * BLAKE3, following the structure of the reference implementation
+ * in the BLAKE3 specification.  The input is split into 1KB chunks,
+ * each of which is hashed into a chaining value; those are merged
+ * pairwise into a binary tree.  We keep the pending left subtrees
+ * on a stack, whose shape follows the binary representation of the
+ * chunk count.
+ */
+
+#include <string.h>
+#include "blake3.h"
+
+enum {
+    CHUNK_START = 1 << 0,
+    CHUNK_END   = 1 << 1,
+    PARENT      = 1 << 2,
+    ROOT        = 1 << 3,
+    KEYED_HASH  = 1 << 4
+};
+
+static const uint32_t blake3_iv[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+/* Message word order of each round; round r uses the permutation
+   applied r times. */
+static const uint8_t blake3_schedule[7][16] = {
+    {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+    {  2,  6,  3, 10,  7,  0,  4, 13,  1, 11, 12,  5,  9, 14, 15,  8 },
+    {  3,  4, 10, 12, 13,  2,  7, 14,  6,  5,  9,  0, 11, 15,  8,  1 },
+    { 10,  7, 12,  9, 14,  3, 13, 15,  4,  0, 11,  2,  5,  8,  1,  6 },
+    { 12, 13,  9, 11, 15, 10, 14,  8,  7,  2,  5,  3,  0,  1,  6,  4 },
+    {  9, 14, 11,  5,  8, 12, 15,  1, 13,  3,  0, 10,  2,  6,  4,  7 },
+    { 11, 15,  5,  0,  1,  9,  8,  6, 14, 10,  2, 12,  3,  4,  7, 13 }
+};
+
+static inline uint32_t load32_le(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8)
+        | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void store32_le(uint8_t *p, uint32_t w)
+{
+    p[0] = (uint8_t)w;
+    p[1] = (uint8_t)(w >> 8);
+    p[2] = (uint8_t)(w >> 16);
+    p[3] = (uint8_t)(w >> 24);
+}
+
+static inline uint32_t rotr32(uint32_t x, int n)
+{
+    return (x >> n) | (x << (32 - n));
+}
+
+#define G(a, b, c, d, x, y)                     \
+    do {                                        \
+        v[a] = v[a] + v[b] + (x);               \
+        v[d] = rotr32(v[d] ^ v[a], 16);         \
+        v[c] = v[c] + v[d];                     \
+        v[b] = rotr32(v[b] ^ v[c], 12);         \
+        v[a] = v[a] + v[b] + (y);               \
+        v[d] = rotr32(v[d] ^ v[a], 8);          \
+        v[c] = v[c] + v[d];                     \
+        v[b] = rotr32(v[b] ^ v[c], 7);          \
+    } while (0)
+
+/* The compression function.  Leaves the full 16-word state in OUT;
+   the first 8 words are the new chaining value. */
+static void blake3_compress(const uint32_t cv[8], const uint8_t block[64],
+                            uint8_t block_len, uint64_t counter,
+                            uint8_t flags, uint32_t out[16])
+{
+    uint32_t m[16], v[16];
+
+    for (int i = 0; i < 16; i++) m[i] = load32_le(block + i*4);
+    for (int i = 0; i < 8; i++) v[i] = cv[i];
+    v[8]  = blake3_iv[0];
+    v[9]  = blake3_iv[1];
+    v[10] = blake3_iv[2];
+    v[11] = blake3_iv[3];
+    v[12] = (uint32_t)counter;
+    v[13] = (uint32_t)(counter >> 32);
+    v[14] = block_len;
+    v[15] = flags;
+
+    for (int r = 0; r < 7; r++) {
+        const uint8_t *s = blake3_schedule[r];
+        G(0, 4,  8, 12, m[s[ 0]], m[s[ 1]]);
+        G(1, 5,  9, 13, m[s[ 2]], m[s[ 3]]);
+        G(2, 6, 10, 14, m[s[ 4]], m[s[ 5]]);
+        G(3, 7, 11, 15, m[s[ 6]], m[s[ 7]]);
+        G(0, 5, 10, 15, m[s[ 8]], m[s[ 9]]);
+        G(1, 6, 11, 12, m[s[10]], m[s[11]]);
+        G(2, 7,  8, 13, m[s[12]], m[s[13]]);
+        G(3, 4,  9, 14, m[s[14]], m[s[15]]);
+    }
+    for (int i = 0; i < 8; i++) {
+        out[i] = v[i] ^ v[i+8];
+        out[i+8] = v[i+8] ^ cv[i];
+    }
+}
+
+/* The inputs of the last compression of a node, which is postponed
+   until we know whether the node is the root. */
+typedef struct {
+    uint32_t cv[8];
+    uint8_t  block[64];
+    uint8_t  block_len;
+    uint64_t counter;
+    uint8_t  flags;
+} Output;
+
+static void output_cv(const Output *o, uint32_t cv[8])
+{
+    uint32_t w[16];
+    blake3_compress(o->cv, o->block, o->block_len, o->counter, o->flags, w);
+    memcpy(cv, w, 32);
+}
+
+static void parent_output(const uint32_t left[8], const uint32_t right[8],
+                          const uint32_t key[8], uint8_t flags, Output *o)
+{
+    memcpy(o->cv, key, 32);
+    for (int i = 0; i < 8; i++) {
+        store32_le(o->block + i*4, left[i]);
+        store32_le(o->block + 32 + i*4, right[i]);
+    }
+    o->block_len = BLAKE3_BLOCK_LENGTH;
+    o->counter = 0;
+    o->flags = flags | PARENT;
+}
+
+static void chunk_init(Blake3ChunkState *c, const uint32_t key[8],
+                       uint64_t counter, uint8_t flags)
+{
+    memcpy(c->cv, key, 32);
+    c->chunk_counter = counter;
+    memset(c->buf, 0, sizeof(c->buf));
+    c->buflen = 0;
+    c->blocks_compressed = 0;
+    c->flags = flags;
+}
+
+static size_t chunk_len(const Blake3ChunkState *c)
+{
+    return (size_t)c->blocks_compressed * BLAKE3_BLOCK_LENGTH + c->buflen;
+}
+
+static uint8_t chunk_start_flag(const Blake3ChunkState *c)
+{
+    return c->blocks_compressed == 0 ? CHUNK_START : 0;
+}
+
+/* Never fills beyond one chunk; the caller sees to that. */
+static void chunk_update(Blake3ChunkState *c, const uint8_t *data,
+                         size_t len)
+{
+    while (len > 0) {
+        if (c->buflen == BLAKE3_BLOCK_LENGTH) {
+            uint32_t w[16];
+            blake3_compress(c->cv, c->buf, BLAKE3_BLOCK_LENGTH,
+                            c->chunk_counter,
+                            c->flags | chunk_start_flag(c), w);
+            memcpy(c->cv, w, 32);
+            c->blocks_compressed++;
+            c->buflen = 0;
+            memset(c->buf, 0, sizeof(c->buf));
+        }
+        size_t n = BLAKE3_BLOCK_LENGTH - c->buflen;
+        if (n > len) n = len;
+        memcpy(c->buf + c->buflen, data, n);
+        c->buflen += (uint8_t)n;
+        data += n;
+        len -= n;
+    }
+}
+
+static void chunk_output(const Blake3ChunkState *c, Output *o)
+{
+    memcpy(o->cv, c->cv, 32);
+    memcpy(o->block, c->buf, BLAKE3_BLOCK_LENGTH);
+    o->block_len = c->buflen;
+    o->counter = c->chunk_counter;
+    o->flags = c->flags | chunk_start_flag(c) | CHUNK_END;
+}
+
+/* Push the chaining value of a finished chunk.  TOTAL_CHUNKS is the
+   number of chunks so far; each trailing zero bit of it means a
+   completed subtree, which we merge with its left sibling. */
+static void add_chunk_cv(Blake3State *s, uint32_t cv[8], uint64_t total_chunks)
+{
+    while ((total_chunks & 1) == 0) {
+        Output o;
+        s->cv_stack_len--;
+        parent_output(s->cv_stack[s->cv_stack_len], cv, s->key,
+                      s->chunk.flags, &o);
+        output_cv(&o, cv);
+        total_chunks >>= 1;
+    }
+    memcpy(s->cv_stack[s->cv_stack_len], cv, 32);
+    s->cv_stack_len++;
+}
+
+void Scm_Blake3Init(Blake3State *s, const uint8_t *key)
+{
+    uint8_t flags = 0;
+    if (key) {
+        for (int i = 0; i < 8; i++) s->key[i] = load32_le(key + i*4);
+        flags = KEYED_HASH;
+    } else {
+        memcpy(s->key, blake3_iv, 32);
+    }
+    chunk_init(&s->chunk, s->key, 0, flags);
+    s->cv_stack_len = 0;
+}
+
+void Scm_Blake3Update(Blake3State *s, const uint8_t *data, size_t len)
+{
+    while (len > 0) {
+        /* We finish a chunk only when more input arrives, since the
+           last chunk may turn out to be the root. */
+        if (chunk_len(&s->chunk) == BLAKE3_CHUNK_LENGTH) {
+            Output o;
+            uint32_t cv[8];
+            uint64_t total = s->chunk.chunk_counter + 1;
+            chunk_output(&s->chunk, &o);
+            output_cv(&o, cv);
+            add_chunk_cv(s, cv, total);
+            chunk_init(&s->chunk, s->key, total, s->chunk.flags);
+        }
+        size_t n = BLAKE3_CHUNK_LENGTH - chunk_len(&s->chunk);
+        if (n > len) n = len;
+        chunk_update(&s->chunk, data, n);
+        data += n;
+        len -= n;
+    }
+}
+
+void Scm_Blake3Final(const Blake3State *s, uint8_t *out, size_t outlen)
+{
+    Output o;
+    chunk_output(&s->chunk, &o);
+    for (int i = s->cv_stack_len; i > 0; i--) {
+        uint32_t cv[8];
+        output_cv(&o, cv);
+        parent_output(s->cv_stack[i-1], cv, s->key, s->chunk.flags, &o);
+    }
+
+    /* The root node is compressed with the ROOT flag, once per 64
+       bytes of output, with the counter numbering the output blocks. */
+    for (uint64_t counter = 0; outlen > 0; counter++) {
+        uint32_t w[16];
+        uint8_t b[64];
+        blake3_compress(o.cv, o.block, o.block_len, counter,
+                        o.flags | ROOT, w);
+        for (int i = 0; i < 16; i++) store32_le(b + i*4, w[i]);
+        size_t n = outlen < 64 ? outlen : 64;
+        memcpy(out, b, n);
+        out += n;
+        outlen -= n;
+    }
+}
@@ -0,0 +1,72 @@
+/*
+ * blake3.h - BLAKE3 message digest
+ *
+ *   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef GAUCHE_BLAKE3_H
+#define GAUCHE_BLAKE3_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define BLAKE3_KEY_LENGTH     32
+#define BLAKE3_DIGEST_LENGTH  32    /* default; the output is extendable */
+#define BLAKE3_BLOCK_LENGTH   64
+#define BLAKE3_CHUNK_LENGTH   1024
+#define BLAKE3_MAX_DEPTH      54    /* enough for 2^64 bytes of input */
+
+typedef struct Blake3ChunkStateRec {
+    uint32_t cv[8];
+    uint64_t chunk_counter;
+    uint8_t  buf[BLAKE3_BLOCK_LENGTH];
+    uint8_t  buflen;
+    uint8_t  blocks_compressed;
+    uint8_t  flags;
+} Blake3ChunkState;
+
+typedef struct Blake3StateRec {
+    uint32_t key[8];
+    Blake3ChunkState chunk;
+    uint8_t  cv_stack_len;
+    uint32_t cv_stack[BLAKE3_MAX_DEPTH][8];
+} Blake3State;
+
+/* KEY is NULL for the plain hash mode, or BLAKE3_KEY_LENGTH bytes
+   for the keyed hash mode. */
+extern void Scm_Blake3Init(Blake3State *s, const uint8_t *key);
+extern void Scm_Blake3Update(Blake3State *s, const uint8_t *data,
+                             size_t len);
+/* Writes OUTLEN bytes of output.  S isn't modified, so more data
+   can be added afterwards. */
+extern void Scm_Blake3Final(const Blake3State *s, uint8_t *out,
+                            size_t outlen);
+
+#endif /* GAUCHE_BLAKE3_H */
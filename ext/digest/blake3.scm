@@ -0,0 +1,152 @@
+;;;
+;;; blake3 - BLAKE3 message digest
+;;;
+;;;   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+;;;
+;;;   Redistribution and use in source and binary forms, with or without
+;;;   modification, are permitted provided that the following conditions
+;;;   are met:
+;;;
+;;;   1. Redistributions of source code must retain the above copyright
+;;;      notice, this list of conditions and the following disclaimer.
+;;;
+;;;   2. Redistributions in binary form must reproduce the above copyright
+;;;      notice, this list of conditions and the following disclaimer in the
+;;;      documentation and/or other materials provided with the distribution.
+;;;
+;;;   3. Neither the name of the authors nor the names of its contributors
+;;;      may be used to endorse or promote products derived from this
+;;;      software without specific prior written permission.
+;;;
+;;;   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+;;;   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+;;;   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+;;;   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+;;;   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+;;;   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+;;;   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+;;;   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+;;;   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+;;;   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+;;;   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+;;;
+
+;;; Cf. The BLAKE3 specification, https://github.com/BLAKE3-team/BLAKE3-specs
+
+(define-module rfc.blake3
+  (use gauche.uvector)
+  (extend util.digest)
+  (export <blake3> blake3-digest blake3-digest-string))
+(select-module rfc.blake3)
+
+;;;
+;;;  High-level API
+;;;
+
+(define-constant *blake3-unit-len* 4096)
+
+(define (blake3-digest :key (size 32) (key #f))
+  (let ([ctx (make <blake3-context>)]
+        [buf (make-u8vector *blake3-unit-len*)])
+    (%blake3-init ctx key)
+    (generator-for-each
+     (^x (%blake3-update ctx x))
+     (^[] (let1 count (read-block! buf)
+            (cond [(eof-object? count) count]
+                  [(< count *blake3-unit-len*)
+                   (uvector-alias <u8vector> buf 0 count)]
+                  [else buf]))))
+    (%blake3-final ctx size)))
+
+(define (blake3-digest-string s . opts)
+  (with-input-from-string s (cut apply blake3-digest opts)))
+
+;;;
+;;; Digest framework
+;;;
+
+(define-class <blake3-meta> (<message-digest-algorithm-meta>) ())
+
+;; (make <blake3> :size SIZE :key KEY)
+;;   SIZE is the output length in bytes (default 32).  BLAKE3 is
+;;   an extendable-output function; a shorter output is a prefix of
+;;   a longer one.
+;;   KEY, if given, is a 32-byte string or u8vector, which selects
+;;   the keyed hash mode.
+(define-class <blake3> (<message-digest-algorithm>)
+  (context size)
+  :metaclass <blake3-meta>
+  :hmac-block-size 64)
+
+(define-method initialize ((self <blake3>) initargs)
+  (next-method)
+  (let1 ctx (make <blake3-context>)
+    (%blake3-init ctx (get-keyword :key initargs #f))
+    (slot-set! self 'context ctx)
+    (slot-set! self 'size (get-keyword :size initargs 32))))
+(define-method digest-update! ((self <blake3>) data)
+  (%blake3-update (slot-ref self'context) data))
+(define-method digest-final! ((self <blake3>))
+  (%blake3-final (slot-ref self'context) (slot-ref self'size)))
+(define-method digest ((class <blake3-meta>))
+  (blake3-digest))
+
+;;;
+;;; Low-level bindings
+;;;
+
+(inline-stub
+ "#include <gauche/class.h>"
+ "#include \"blake3.h\""
+
+ "#define LIBGAUCHE_EXT_BODY"
+ "#include <gauche/extern.h>  /* fix SCM_EXTERN in SCM_CLASS_DECL */"
+
+ "typedef struct ScmBlake3ContextRec {"
+ " SCM_HEADER;"
+ " Blake3State ctx;"
+ "} ScmBlake3Context;"
+
+ (define-cclass <blake3-context> :private
+   ScmBlake3Context* "Scm_Blake3ContextClass" ()
+   ()
+   [allocator
+    (let* ([ctx :: ScmBlake3Context* (SCM_NEW_INSTANCE ScmBlake3Context klass)])
+      (Scm_Blake3Init (& (-> ctx ctx)) NULL)
+      (return (SCM_OBJ ctx)))])
+
+ ;; Sets *P and *LEN to the bytes of a string or u8vector.
+ (define-cfn get_bytes (data p::(const uint8_t**) len::size_t*) ::void :static
+   (cond
+    [(SCM_U8VECTORP data)
+     (set! (* p) (cast (const uint8_t*)
+                       (SCM_UVECTOR_ELEMENTS (SCM_U8VECTOR data)))
+           (* len) (SCM_U8VECTOR_SIZE (SCM_U8VECTOR data)))]
+    [(SCM_STRINGP data)
+     (let* ([b::(const ScmStringBody*) (SCM_STRING_BODY data)])
+       (set! (* p) (cast (const uint8_t*) (SCM_STRING_BODY_START b))
+             (* len) (SCM_STRING_BODY_SIZE b)))]
+    [else (SCM_TYPE_ERROR data "u8vector or string")]))
+
+ (define-cproc %blake3-init (ctx::<blake3-context> key) ::<void>
+   (if (SCM_FALSEP key)
+     (Scm_Blake3Init (& (-> ctx ctx)) NULL)
+     (let* ([k::(const uint8_t*)] [klen::size_t])
+       (get_bytes key (& k) (& klen))
+       (unless (== klen BLAKE3_KEY_LENGTH)
+         (Scm_Error "BLAKE3 key must be %d bytes long, but got: %S"
+                    BLAKE3_KEY_LENGTH key))
+       (Scm_Blake3Init (& (-> ctx ctx)) k))))
+
+ (define-cproc %blake3-update (ctx::<blake3-context> data) ::<void>
+   (let* ([p::(const uint8_t*)] [len::size_t])
+     (get_bytes data (& p) (& len))
+     (Scm_Blake3Update (& (-> ctx ctx)) p len)))
+
+ (define-cproc %blake3-final (ctx::<blake3-context> size::<fixnum>)
+   (when (< size 1)
+     (Scm_Error "BLAKE3 output size must be positive, but got: %ld" size))
+   (let* ([digest::char* (SCM_NEW_ATOMIC_ARRAY (char) size)])
+     (Scm_Blake3Final (& (-> ctx ctx)) (cast uint8_t* digest) size)
+     (return (Scm_MakeString digest size size SCM_STRING_INCOMPLETE))))
+ )
@@ -0,0 +1,351 @@
+/*
+ * sha-accel.c - hardware SHA block functions
+ *
+ *   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * SHA-1 and SHA-256 block functions using the CPU's SHA instructions:
+ * the SHA extensions (SHA-NI) on x86, and the cryptography extension
+ * on ARMv8.  They follow the structure of Intel's and ARM's
+ * published examples.  Which one is used is decided at runtime by
+ * Scm__InitSHAAccel().
+ */
+
+#include "sha-accel.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) \
+    && (defined(__clang__) \
+        || (defined(__GNUC__) \
+            && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define SHA_ACCEL_X86 1
+#include <immintrin.h>
+#include <cpuid.h>
+#endif
+
+#if defined(__aarch64__) && defined(__GNUC__)
+#define SHA_ACCEL_ARM 1
+#include <arm_neon.h>
+#if defined(__ARM_FEATURE_CRYPTO) || defined(__ARM_FEATURE_SHA2)
+#define ARM_SHA_TARGET          /* always available */
+#define arm_sha_available() 1
+#elif defined(__linux__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#if defined(__clang__)
+#define ARM_SHA_TARGET __attribute__((target("sha2")))
+#else
+#define ARM_SHA_TARGET __attribute__((target("+crypto")))
+#endif
+#define arm_sha_available() \
+    ((getauxval(AT_HWCAP) & (HWCAP_SHA1|HWCAP_SHA2)) == (HWCAP_SHA1|HWCAP_SHA2))
+#else
+#undef SHA_ACCEL_ARM
+#endif
+#endif
+
+void (*Scm__SHA1AccelBlocks)(uint32_t*, const uint8_t*, size_t) = NULL;
+void (*Scm__SHA256AccelBlocks)(uint32_t*, const uint8_t*, size_t) = NULL;
+
+static const uint32_t K256[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+    0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+    0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+    0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+    0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+    0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+/*================================================================
+ * x86 SHA extensions
+ */
+
+#if defined(SHA_ACCEL_X86)
+
+/* Message words are big-endian.  M0..M3 hold the last four 4-word
+   groups of the schedule; each round group computes the next one
+   into M0 (for G >= 4), then runs four rounds (two rnds2) with it. */
+#define SHA256_X86_GROUP(G, M0, M1, M2, M3)                             \
+    do {                                                                \
+        if ((G) >= 4) {                                                 \
+            M0 = _mm_sha256msg2_epu32(                                  \
+                     _mm_add_epi32(_mm_sha256msg1_epu32(M0, M1),        \
+                                   _mm_alignr_epi8(M3, M2, 4)),         \
+                     M3);                                               \
+        }                                                               \
+        msg = _mm_add_epi32(M0,                                         \
+                   _mm_loadu_si128((const __m128i*)&K256[(G)*4]));      \
+        state1 = _mm_sha256rnds2_epu32(state1, state0, msg);            \
+        msg = _mm_shuffle_epi32(msg, 0x0e);                             \
+        state0 = _mm_sha256rnds2_epu32(state0, state1, msg);            \
+    } while (0)
+
+__attribute__((target("sha,sse4.1")))
+static void sha256_x86(uint32_t state[8], const uint8_t *data, size_t nblocks)
+{
+    const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL,
+                                         0x0405060700010203ULL);
+    __m128i state0, state1, tmp, msg, m0, m1, m2, m3, abef, cdgh;
+
+    /* The instructions want the state as ABEF and CDGH. */
+    tmp    = _mm_loadu_si128((const __m128i*)&state[0]);
+    state1 = _mm_loadu_si128((const __m128i*)&state[4]);
+    tmp    = _mm_shuffle_epi32(tmp, 0xb1);          /* CDAB */
+    state1 = _mm_shuffle_epi32(state1, 0x1b);       /* EFGH */
+    state0 = _mm_alignr_epi8(tmp, state1, 8);       /* ABEF */
+    state1 = _mm_blend_epi16(state1, tmp, 0xf0);    /* CDGH */
+
+    for (; nblocks > 0; nblocks--, data += 64) {
+        abef = state0;
+        cdgh = state1;
+        m0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data+0)), bswap);
+        m1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data+16)), bswap);
+        m2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data+32)), bswap);
+        m3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data+48)), bswap);
+        for (int g = 0; g < 16; g += 4) {
+            SHA256_X86_GROUP(g,   m0, m1, m2, m3);
+            SHA256_X86_GROUP(g+1, m1, m2, m3, m0);
+            SHA256_X86_GROUP(g+2, m2, m3, m0, m1);
+            SHA256_X86_GROUP(g+3, m3, m0, m1, m2);
+        }
+        state0 = _mm_add_epi32(state0, abef);
+        state1 = _mm_add_epi32(state1, cdgh);
+    }
+
+    tmp    = _mm_shuffle_epi32(state0, 0x1b);       /* FEBA */
+    state1 = _mm_shuffle_epi32(state1, 0xb1);       /* DCHG */
+    state0 = _mm_blend_epi16(tmp, state1, 0xf0);    /* DCBA */
+    state1 = _mm_alignr_epi8(state1, tmp, 8);       /* HGFE */
+    _mm_storeu_si128((__m128i*)&state[0], state0);
+    _mm_storeu_si128((__m128i*)&state[4], state1);
+}
+
+/* Same scheme for SHA-1.  E carries the 'e' input of the next round
+   group; sha1nexte derives it from ABCD before the previous group. */
+#define SHA1_X86_GROUP(G, F, M0, M1, M2, M3)                            \
+    do {                                                                \
+        if ((G) >= 4) {                                                 \
+            M0 = _mm_sha1msg2_epu32(                                    \
+                     _mm_xor_si128(_mm_sha1msg1_epu32(M0, M1), M2),     \
+                     M3);                                               \
+        }                                                               \
+        if ((G) == 0) e = _mm_add_epi32(e, M0);                         \
+        else          e = _mm_sha1nexte_epu32(e, M0);                   \
+        tmp = abcd;                                                     \
+        abcd = _mm_sha1rnds4_epu32(abcd, e, F);                         \
+        e = tmp;                                                        \
+    } while (0)
+
+__attribute__((target("sha,sse4.1")))
+static void sha1_x86(uint32_t state[5], const uint8_t *data, size_t nblocks)
+{
+    const __m128i bswap = _mm_set_epi64x(0x0001020304050607ULL,
+                                         0x08090a0b0c0d0e0fULL);
+    __m128i abcd, e, e_save, abcd_save, tmp, m0, m1, m2, m3;
+
+    abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)state), 0x1b);
+    e_save = _mm_set_epi32((int)state[4], 0, 0, 0);
+
+    for (; nblocks > 0; nblocks--, data += 64) {
+        abcd_save = abcd;
+        e = e_save;
+        m0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data+0)), bswap);
+        m1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data+16)), bswap);
+        m2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data+32)), bswap);
+        m3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data+48)), bswap);
+
+        SHA1_X86_GROUP(0,  0, m0, m1, m2, m3);
+        SHA1_X86_GROUP(1,  0, m1, m2, m3, m0);
+        SHA1_X86_GROUP(2,  0, m2, m3, m0, m1);
+        SHA1_X86_GROUP(3,  0, m3, m0, m1, m2);
+        SHA1_X86_GROUP(4,  0, m0, m1, m2, m3);
+        SHA1_X86_GROUP(5,  1, m1, m2, m3, m0);
+        SHA1_X86_GROUP(6,  1, m2, m3, m0, m1);
+        SHA1_X86_GROUP(7,  1, m3, m0, m1, m2);
+        SHA1_X86_GROUP(8,  1, m0, m1, m2, m3);
+        SHA1_X86_GROUP(9,  1, m1, m2, m3, m0);
+        SHA1_X86_GROUP(10, 2, m2, m3, m0, m1);
+        SHA1_X86_GROUP(11, 2, m3, m0, m1, m2);
+        SHA1_X86_GROUP(12, 2, m0, m1, m2, m3);
+        SHA1_X86_GROUP(13, 2, m1, m2, m3, m0);
+        SHA1_X86_GROUP(14, 2, m2, m3, m0, m1);
+        SHA1_X86_GROUP(15, 3, m3, m0, m1, m2);
+        SHA1_X86_GROUP(16, 3, m0, m1, m2, m3);
+        SHA1_X86_GROUP(17, 3, m1, m2, m3, m0);
+        SHA1_X86_GROUP(18, 3, m2, m3, m0, m1);
+        SHA1_X86_GROUP(19, 3, m3, m0, m1, m2);
+
+        e_save = _mm_sha1nexte_epu32(e, e_save);
+        abcd = _mm_add_epi32(abcd, abcd_save);
+    }
+
+    _mm_storeu_si128((__m128i*)state, _mm_shuffle_epi32(abcd, 0x1b));
+    state[4] = (uint32_t)_mm_extract_epi32(e_save, 3);
+}
+
+#endif /*SHA_ACCEL_X86*/
+
+/*================================================================
+ * ARMv8 cryptography extension
+ */
+
+#if defined(SHA_ACCEL_ARM)
+
+#define LOAD_BE32X4(p) \
+    vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(p)))
+
+#define SHA256_ARM_GROUP(G, M0, M1, M2, M3)                             \
+    do {                                                                \
+        if ((G) >= 4) {                                                 \
+            M0 = vsha256su1q_u32(vsha256su0q_u32(M0, M1), M2, M3);      \
+        }                                                               \
+        uint32x4_t t_ = vaddq_u32(M0, vld1q_u32(&K256[(G)*4]));         \
+        uint32x4_t s_ = state0;                                         \
+        state0 = vsha256hq_u32(state0, state1, t_);                     \
+        state1 = vsha256h2q_u32(state1, s_, t_);                        \
+    } while (0)
+
+ARM_SHA_TARGET
+static void sha256_arm(uint32_t state[8], const uint8_t *data, size_t nblocks)
+{
+    uint32x4_t state0 = vld1q_u32(&state[0]);
+    uint32x4_t state1 = vld1q_u32(&state[4]);
+
+    for (; nblocks > 0; nblocks--, data += 64) {
+        uint32x4_t abcd = state0, efgh = state1;
+        uint32x4_t m0 = LOAD_BE32X4(data+0);
+        uint32x4_t m1 = LOAD_BE32X4(data+16);
+        uint32x4_t m2 = LOAD_BE32X4(data+32);
+        uint32x4_t m3 = LOAD_BE32X4(data+48);
+        for (int g = 0; g < 16; g += 4) {
+            SHA256_ARM_GROUP(g,   m0, m1, m2, m3);
+            SHA256_ARM_GROUP(g+1, m1, m2, m3, m0);
+            SHA256_ARM_GROUP(g+2, m2, m3, m0, m1);
+            SHA256_ARM_GROUP(g+3, m3, m0, m1, m2);
+        }
+        state0 = vaddq_u32(state0, abcd);
+        state1 = vaddq_u32(state1, efgh);
+    }
+    vst1q_u32(&state[0], state0);
+    vst1q_u32(&state[4], state1);
+}
+
+#define SHA1_ARM_GROUP(G, OP, K, M0, M1, M2, M3)                        \
+    do {                                                                \
+        if ((G) >= 4) {                                                 \
+            M0 = vsha1su1q_u32(vsha1su0q_u32(M0, M1, M2), M3);          \
+        }                                                               \
+        uint32x4_t t_ = vaddq_u32(M0, vdupq_n_u32(K));                  \
+        uint32_t e_ = vsha1h_u32(vgetq_lane_u32(abcd, 0));              \
+        abcd = OP(abcd, e, t_);                                         \
+        e = e_;                                                         \
+    } while (0)
+
+#define K1 0x5a827999
+#define K2 0x6ed9eba1
+#define K3 0x8f1bbcdc
+#define K4 0xca62c1d6
+
+ARM_SHA_TARGET
+static void sha1_arm(uint32_t state[5], const uint8_t *data, size_t nblocks)
+{
+    uint32x4_t abcd = vld1q_u32(state);
+    uint32_t e0 = state[4];
+
+    for (; nblocks > 0; nblocks--, data += 64) {
+        uint32x4_t abcd_save = abcd;
+        uint32_t e = e0;
+        uint32x4_t m0 = LOAD_BE32X4(data+0);
+        uint32x4_t m1 = LOAD_BE32X4(data+16);
+        uint32x4_t m2 = LOAD_BE32X4(data+32);
+        uint32x4_t m3 = LOAD_BE32X4(data+48);
+
+        SHA1_ARM_GROUP(0,  vsha1cq_u32, K1, m0, m1, m2, m3);
+        SHA1_ARM_GROUP(1,  vsha1cq_u32, K1, m1, m2, m3, m0);
+        SHA1_ARM_GROUP(2,  vsha1cq_u32, K1, m2, m3, m0, m1);
+        SHA1_ARM_GROUP(3,  vsha1cq_u32, K1, m3, m0, m1, m2);
+        SHA1_ARM_GROUP(4,  vsha1cq_u32, K1, m0, m1, m2, m3);
+        SHA1_ARM_GROUP(5,  vsha1pq_u32, K2, m1, m2, m3, m0);
+        SHA1_ARM_GROUP(6,  vsha1pq_u32, K2, m2, m3, m0, m1);
+        SHA1_ARM_GROUP(7,  vsha1pq_u32, K2, m3, m0, m1, m2);
+        SHA1_ARM_GROUP(8,  vsha1pq_u32, K2, m0, m1, m2, m3);
+        SHA1_ARM_GROUP(9,  vsha1pq_u32, K2, m1, m2, m3, m0);
+        SHA1_ARM_GROUP(10, vsha1mq_u32, K3, m2, m3, m0, m1);
+        SHA1_ARM_GROUP(11, vsha1mq_u32, K3, m3, m0, m1, m2);
+        SHA1_ARM_GROUP(12, vsha1mq_u32, K3, m0, m1, m2, m3);
+        SHA1_ARM_GROUP(13, vsha1mq_u32, K3, m1, m2, m3, m0);
+        SHA1_ARM_GROUP(14, vsha1mq_u32, K3, m2, m3, m0, m1);
+        SHA1_ARM_GROUP(15, vsha1pq_u32, K4, m3, m0, m1, m2);
+        SHA1_ARM_GROUP(16, vsha1pq_u32, K4, m0, m1, m2, m3);
+        SHA1_ARM_GROUP(17, vsha1pq_u32, K4, m1, m2, m3, m0);
+        SHA1_ARM_GROUP(18, vsha1pq_u32, K4, m2, m3, m0, m1);
+        SHA1_ARM_GROUP(19, vsha1pq_u32, K4, m3, m0, m1, m2);
+
+        e0 += e;
+        abcd = vaddq_u32(abcd, abcd_save);
+    }
+    vst1q_u32(state, abcd);
+    state[4] = e0;
+}
+
+#endif /*SHA_ACCEL_ARM*/
+
+void Scm__InitSHAAccel(void)
+{
+#if defined(SHA_ACCEL_X86)
+    __builtin_cpu_init();
+    /* Older GCC's __builtin_cpu_supports doesn't know "sha", so we ask
+       cpuid directly: leaf 7, EBX bit 29. */
+    if (__get_cpuid_max(0, NULL) >= 7 && __builtin_cpu_supports("sse4.1")) {
+        unsigned int a, b, c, d;
+        __cpuid_count(7, 0, a, b, c, d);
+        if (b & (1U<<29)) {
+            Scm__SHA1AccelBlocks = sha1_x86;
+            Scm__SHA256AccelBlocks = sha256_x86;
+        }
+    }
+#endif
+#if defined(SHA_ACCEL_ARM)
+    if (arm_sha_available()) {
+        Scm__SHA1AccelBlocks = sha1_arm;
+        Scm__SHA256AccelBlocks = sha256_arm;
+    }
+#endif
+}
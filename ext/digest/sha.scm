@@ -120,10 +120,13 @@
  ;; customization for sha2.h
  "#define SHA2_USE_INTTYPES_H" ; use uintXX_t
  "#include \"sha2.h\""
+ "#include \"sha-accel.h\""
 
  "#define LIBGAUCHE_EXT_BODY"
  "#include <gauche/extern.h>  /* fix SCM_EXTERN in SCM_CLASS_DECL */"
 
+ (initcode (Scm__InitSHAAccel))
+
  "typedef struct ScmShaContextRec {"
  " SCM_HEADER;"
  " SHA_CTX ctx;"
@@ -36,6 +36,7 @@
 #include <string.h>	/* memcpy()/memset() or bcopy()/bzero() */
 #include <assert.h>	/* assert() */
 #include "sha2.h"
+#include "sha-accel.h"
 
 /*
  * ASSERT NOTE:
@@ -237,6 +238,11 @@ void SHA512_Internal_Init(SHA_CTX*, const sha_word64*);
 void SHA512_Internal_Last(SHA_CTX*);
 void SHA512_Internal_Transform(SHA_CTX*, const sha_word64*);
 
+/* Process N consecutive blocks, with the CPU's SHA instructions
+   if available (see sha-accel.c): */
+static void SHA1_Internal_Blocks(SHA_CTX*, const sha_byte*, size_t);
+static void SHA256_Internal_Blocks(SHA_CTX*, const sha_byte*, size_t);
+
 
 /*** SHA2 INITIAL HASH VALUES AND CONSTANTS ***************************/
 
@@ -639,6 +645,16 @@ void SHA1_Internal_Transform(SHA_CTX* context, const sha_word32* data) {
 
 #endif /* SHA2_UNROLL_TRANSFORM */
 
+static void SHA1_Internal_Blocks(SHA_CTX* context, const sha_byte* data, size_t n) {
+	if (Scm__SHA1AccelBlocks) {
+		Scm__SHA1AccelBlocks(context->s1.state, data, n);
+		return;
+	}
+	for (; n > 0; n--, data += 64) {
+		SHA1_Internal_Transform(context, (const sha_word32*)data);
+	}
+}
+
 void SHA1_Update(SHA_CTX* context, const sha_byte *data, size_t len) {
 	unsigned int	freespace, usedspace;
 	if (len == 0) {
@@ -660,7 +676,7 @@ void SHA1_Update(SHA_CTX* context, const sha_byte *data, size_t len) {
 			context->s1.bitcount += freespace << 3;
 			len -= freespace;
 			data += freespace;
-			SHA1_Internal_Transform(context, (sha_word32*)context->s1.buffer);
+			SHA1_Internal_Blocks(context, context->s1.buffer, 1);
 		} else {
 			/* The buffer is not yet full */
 			MEMCPY_BCOPY(&context->s1.buffer[usedspace], data, len);
@@ -670,12 +686,13 @@ void SHA1_Update(SHA_CTX* context, const sha_byte *data, size_t len) {
 			return;
 		}
 	}
-	while (len >= 64) {
+	if (len >= 64) {
 		/* Process as many complete blocks as we can */
-		SHA1_Internal_Transform(context, (sha_word32*)data);
-		context->s1.bitcount += 512;
-		len -= 64;
-		data += 64;
+		size_t	nblocks = len / 64;
+		SHA1_Internal_Blocks(context, data, nblocks);
+		context->s1.bitcount += (sha_word64)nblocks << 9;
+		len -= nblocks * 64;
+		data += nblocks * 64;
 	}
 	if (len > 0) {
 		/* There's left-overs, so save 'em */
@@ -721,7 +738,7 @@ void SHA1_Final(sha_byte digest[], SHA_CTX* context) {
 				MEMSET_BZERO(&context->s1.buffer[usedspace], 64 - usedspace);
 			}
 			/* Do second-to-last transform: */
-			SHA1_Internal_Transform(context, (sha_word32*)context->s1.buffer);
+			SHA1_Internal_Blocks(context, context->s1.buffer, 1);
 
 			/* And set-up for the last transform: */
 			MEMSET_BZERO(context->s1.buffer, 56);
@@ -737,7 +754,7 @@ void SHA1_Final(sha_byte digest[], SHA_CTX* context) {
 	*(sha_word64*)&context->s1.buffer[56] = context->s1.bitcount;
 
 	/* Final transform: */
-	SHA1_Internal_Transform(context, (sha_word32*)context->s1.buffer);
+	SHA1_Internal_Blocks(context, context->s1.buffer, 1);
 
 	/* Save the hash data for output: */
 #if BYTE_ORDER == LITTLE_ENDIAN
@@ -978,6 +995,16 @@ void SHA256_Internal_Transform(SHA_CTX* context, const sha_word32* data) {
 
 #endif /* SHA2_UNROLL_TRANSFORM */
 
+static void SHA256_Internal_Blocks(SHA_CTX* context, const sha_byte* data, size_t n) {
+	if (Scm__SHA256AccelBlocks) {
+		Scm__SHA256AccelBlocks(context->s256.state, data, n);
+		return;
+	}
+	for (; n > 0; n--, data += 64) {
+		SHA256_Internal_Transform(context, (const sha_word32*)data);
+	}
+}
+
 void SHA256_Update(SHA_CTX* context, const sha_byte *data, size_t len) {
 	unsigned int	freespace, usedspace;
 
@@ -1000,7 +1027,7 @@ void SHA256_Update(SHA_CTX* context, const sha_byte *data, size_t len) {
 			context->s256.bitcount += freespace << 3;
 			len -= freespace;
 			data += freespace;
-			SHA256_Internal_Transform(context, (sha_word32*)context->s256.buffer);
+			SHA256_Internal_Blocks(context, context->s256.buffer, 1);
 		} else {
 			/* The buffer is not yet full */
 			MEMCPY_BCOPY(&context->s256.buffer[usedspace], data, len);
@@ -1010,12 +1037,13 @@ void SHA256_Update(SHA_CTX* context, const sha_byte *data, size_t len) {
 			return;
 		}
 	}
-	while (len >= 64) {
+	if (len >= 64) {
 		/* Process as many complete blocks as we can */
-		SHA256_Internal_Transform(context, (sha_word32*)data);
-		context->s256.bitcount += 512;
-		len -= 64;
-		data += 64;
+		size_t	nblocks = len / 64;
+		SHA256_Internal_Blocks(context, data, nblocks);
+		context->s256.bitcount += (sha_word64)nblocks << 9;
+		len -= nblocks * 64;
+		data += nblocks * 64;
 	}
 	if (len > 0) {
 		/* There's left-overs, so save 'em */
@@ -1046,7 +1074,7 @@ void SHA256_Internal_Last(SHA_CTX* context) {
 				MEMSET_BZERO(&context->s256.buffer[usedspace], 64 - usedspace);
 			}
 			/* Do second-to-last transform: */
-			SHA256_Internal_Transform(context, (sha_word32*)context->s256.buffer);
+			SHA256_Internal_Blocks(context, context->s256.buffer, 1);
 
 			/* And set-up for the last transform: */
 			MEMSET_BZERO(context->s256.buffer, 56);
@@ -1064,7 +1092,7 @@ void SHA256_Internal_Last(SHA_CTX* context) {
 	*(sha_word64*)&context->s256.buffer[56] = context->s256.bitcount;
 
 	/* Final transform: */
-	SHA256_Internal_Transform(context, (sha_word32*)context->s256.buffer);
+	SHA256_Internal_Blocks(context, context->s256.buffer, 1);
 }
 
 void SHA256_Final(sha_byte digest[], SHA_CTX* context) {
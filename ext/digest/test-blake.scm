@@ -0,0 +1,72 @@
+;;
+;; test for blake2 and blake3 modules
+;;
+
+(test-section "blake2")
+
+(use gauche.uvector)
+(use srfi-13)
+
+(use rfc.blake2)
+(test-module 'rfc.blake2)
+
+(for-each
+ (^[args]
+   (test* "blake2b-digest-string" (car args)
+          (digest-hexify (apply blake2b-digest-string (cdr args))))
+   (when (null? (cddr args))
+     (test* "digest-string" (car args)
+            (digest-hexify (digest-string <blake2b> (cadr args))))))
+ `(("786a02f742015903c6c6fd852552d272912f4740e15847618a86e217f71f5419d25e1031afee585313896444934eb04b903a685b1448b755d56f701afe9be2ce" "")
+   ("ba80a53f981c4d0d6a2797b69f12f6e94c212f14685ac4b74b12bb6fdbffa2d17d87c5392aab792dc252d5de4533cc9518d38aa8dbf1925ab92386edd4009923" "abc")
+   ("fe89a110a412012e7cc5c0e05b03b48a6b9d0ba108187826c5ac82ce7aa45e7e31b054979ec8ca5acd0bcc85f379d848f90f9d1593358cba8d88c7cd94ea8eee"
+    ,(make-string 100000 #\a))
+   ("bddd813c634239723171ef3fee98579b94964e3bb1cb3e427262c8c068d52319"
+    "abc" :size 32)
+   ("ffeb325c5f4ba9d7ded241511e725468e591a273f17ed92f5f6d2893274b2a824cc388c9e2a33771d716b4424f78a62de060647fcd4720fa09496ffae3ed5e57"
+    "The quick brown fox jumps over the lazy dog" :key "secret key")))
+
+(test* "blake2b digest-update!"
+       "bddd813c634239723171ef3fee98579b94964e3bb1cb3e427262c8c068d52319"
+       (let1 d (make <blake2b> :size 32)
+         (digest-update! d "a")
+         (digest-update! d (string->u8vector "bc"))
+         (digest-hexify (digest-final! d))))
+
+(test* "blake2b bad size" (test-error) (make <blake2b> :size 65))
+(test* "blake2b bad size" (test-error) (blake2b-digest-string "" :size 0))
+(test* "blake2b bad key" (test-error)
+       (blake2b-digest-string "" :key (make-string 65 #\a)))
+
+(test-section "blake3")
+
+(use rfc.blake3)
+(test-module 'rfc.blake3)
+
+(for-each
+ (^[args]
+   (test* "blake3-digest-string" (car args)
+          (digest-hexify (apply blake3-digest-string (cdr args))))
+   (when (null? (cddr args))
+     (test* "digest-string" (car args)
+            (digest-hexify (digest-string <blake3> (cadr args))))))
+ `(("af1349b9f5f9a1a6a0404dea36dcc9499bcb25c9adc112b7cc9a93cae41f3262" "")
+   ("6437b3ac38465133ffb63b75273a8db548c558465d79db03fd359c6cd5bd9d85" "abc")
+   ;; spans many chunks, so it exercises the tree
+   ("4d593f58529cc720a92d1a3c4e0d0f05929bee0bc6e4cc0ede9476ff59c71536"
+    ,(make-string 100000 #\a))
+   ("8243fa46b05dbbf045844c186bed1d591853b046f4f272d1c5d4ca5881d5e99c"
+    "The quick brown fox jumps over the lazy dog"
+    :key "whats the Elvish word for friend")
+   ("6437b3ac38465133ffb63b75273a8db548c558465d79db03fd359c6cd5bd9d851fb250ae7393f5d02813b65d521a0d492d9ba09cf7ce7f4cffd900f23374bf0bc08a1fb0b38ed276181ccbd9f7b7edbddf9f86404ad7929605f6ffa3fb1ac87983105f01"
+    "abc" :size 100)))
+
+(test* "blake3 digest-update!"
+       "4d593f58529cc720a92d1a3c4e0d0f05929bee0bc6e4cc0ede9476ff59c71536"
+       (let1 d (make <blake3>)
+         (dotimes [i 1000] (digest-update! d (make-string 100 #\a)))
+         (digest-hexify (digest-final! d))))
+
+(test* "blake3 bad key" (test-error)
+       (blake3-digest-string "" :key "too short"))
+(test* "blake3 bad size" (test-error) (blake3-digest-string "" :size 0))
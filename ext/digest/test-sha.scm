@@ -99,3 +99,22 @@
 
 (for-each test-from-file (glob "data/*.info"))
 
+
+;; Feeding data in odd-sized pieces mixes buffered blocks with
+;; blocks processed directly from the input.
+(let1 v (make-u8vector 1000)
+  (dotimes [i 1000] (u8vector-set! v i (modulo i 256)))
+  (define (piecewise class)
+    (let1 d (make class)
+      (let loop ([i 0])
+        (when (< i 1000)
+          (let1 e (min 1000 (+ i 150))
+            (digest-update! d (uvector-alias <u8vector> v i (min e (+ i 7))))
+            (digest-update! d (uvector-alias <u8vector> v (min e (+ i 7)) e))
+            (loop e))))
+      (digest-hexify (digest-final! d))))
+  (test* "sha1 piecewise" "af0b191c2de46fe13fe0908f5a6a4e90e0cafc46"
+         (piecewise <sha1>))
+  (test* "sha256 piecewise"
+         "a8af099bf2e878609558dbf69d8f88f4a31040a8cf84b549a0cfa912f12ffc3f"
+         (piecewise <sha256>)))
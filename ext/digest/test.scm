@@ -3,6 +3,7 @@
 
 (include "test-md5")
 (include "test-sha")
+(include "test-blake")
 (include "test-hmac")
 
 (test-end)
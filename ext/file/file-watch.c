@@ -0,0 +1,255 @@
+/*
+ * file-watch.c - file change notification
+ *   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * Native backends of file.watch.  On Linux we use inotify, and on BSDs
+ * and OSX we use kqueue's EVFILT_VNODE.  Either way the backend gives
+ * a single file descriptor that becomes readable when there are events,
+ * so that it can be watched by a selector.  Scm_FileWatchRead never
+ * blocks; it returns what's available.
+ *
+ * If neither is available, Scm_FileWatchBackend returns #f and file.watch
+ * falls back to polling in Scheme.
+ */
+
+#include "file-watch.h"
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#if defined(HAVE_SYS_INOTIFY_H)
+#include <sys/inotify.h>
+#define USE_INOTIFY 1
+#elif defined(HAVE_KQUEUE) && defined(HAVE_SYS_EVENT_H)
+#include <sys/types.h>
+#include <sys/event.h>
+#include <sys/time.h>
+#define USE_KQUEUE 1
+#endif
+
+ScmObj Scm_FileWatchBackend(void)
+{
+#if defined(USE_INOTIFY)
+    return SCM_INTERN("inotify");
+#elif defined(USE_KQUEUE)
+    return SCM_INTERN("kqueue");
+#else
+    return SCM_FALSE;
+#endif
+}
+
+#if !defined(USE_INOTIFY) && !defined(USE_KQUEUE)
+static void no_backend(void)
+{
+    Scm_Error("native file watching isn't supported on this platform");
+}
+#endif
+
+int Scm_FileWatchOpen(void)
+{
+    int fd = -1;
+#if defined(USE_INOTIFY)
+    SCM_SYSCALL(fd, inotify_init1(IN_NONBLOCK|IN_CLOEXEC));
+    if (fd < 0) Scm_SysError("inotify_init1 failed");
+#elif defined(USE_KQUEUE)
+    SCM_SYSCALL(fd, kqueue());
+    if (fd < 0) Scm_SysError("kqueue failed");
+    (void)fcntl(fd, F_SETFD, FD_CLOEXEC);
+#else
+    no_backend();
+#endif
+    return fd;
+}
+
+void Scm_FileWatchClose(int fd)
+{
+    if (fd >= 0) close(fd);
+}
+
+#if defined(USE_INOTIFY)
+static uint32_t kinds_to_mask(int kinds)
+{
+    uint32_t mask = 0;
+    if (kinds & SCM_FILE_WATCH_MODIFY) mask |= IN_MODIFY|IN_CLOSE_WRITE;
+    if (kinds & SCM_FILE_WATCH_ATTRIB) mask |= IN_ATTRIB;
+    if (kinds & SCM_FILE_WATCH_CREATE) mask |= IN_CREATE;
+    if (kinds & SCM_FILE_WATCH_DELETE) mask |= IN_DELETE|IN_DELETE_SELF;
+    if (kinds & SCM_FILE_WATCH_MOVE)
+        mask |= IN_MOVED_FROM|IN_MOVED_TO|IN_MOVE_SELF;
+    return mask;
+}
+
+static int mask_to_kinds(uint32_t mask)
+{
+    int kinds = 0;
+    if (mask & (IN_MODIFY|IN_CLOSE_WRITE)) kinds |= SCM_FILE_WATCH_MODIFY;
+    if (mask & IN_ATTRIB) kinds |= SCM_FILE_WATCH_ATTRIB;
+    if (mask & IN_CREATE) kinds |= SCM_FILE_WATCH_CREATE;
+    if (mask & (IN_DELETE|IN_DELETE_SELF)) kinds |= SCM_FILE_WATCH_DELETE;
+    if (mask & (IN_MOVED_FROM|IN_MOVED_TO|IN_MOVE_SELF))
+        kinds |= SCM_FILE_WATCH_MOVE;
+    if (mask & IN_Q_OVERFLOW) kinds |= SCM_FILE_WATCH_OVERFLOW;
+    return kinds;
+}
+#endif /*USE_INOTIFY*/
+
+#if defined(USE_KQUEUE)
+static u_int kinds_to_fflags(int kinds)
+{
+    u_int fflags = 0;
+    /* NB: kqueue reports creation and deletion of directory entries
+       as NOTE_WRITE on the directory. */
+    if (kinds & (SCM_FILE_WATCH_MODIFY|SCM_FILE_WATCH_CREATE))
+        fflags |= NOTE_WRITE|NOTE_EXTEND;
+    if (kinds & SCM_FILE_WATCH_ATTRIB) fflags |= NOTE_ATTRIB|NOTE_LINK;
+    if (kinds & SCM_FILE_WATCH_DELETE) fflags |= NOTE_DELETE;
+    if (kinds & SCM_FILE_WATCH_MOVE)   fflags |= NOTE_RENAME;
+    return fflags;
+}
+
+static int fflags_to_kinds(u_int fflags)
+{
+    int kinds = 0;
+    if (fflags & (NOTE_WRITE|NOTE_EXTEND)) kinds |= SCM_FILE_WATCH_MODIFY;
+    if (fflags & (NOTE_ATTRIB|NOTE_LINK))  kinds |= SCM_FILE_WATCH_ATTRIB;
+    if (fflags & NOTE_DELETE) kinds |= SCM_FILE_WATCH_DELETE;
+    if (fflags & NOTE_RENAME) kinds |= SCM_FILE_WATCH_MOVE;
+    return kinds;
+}
+#endif /*USE_KQUEUE*/
+
+/* Starts watching PATH.  Returns a watch descriptor, with which events
+   are reported.  With kqueue, we need to keep the file open while
+   watching it; the watch descriptor is that fd. */
+int Scm_FileWatchAdd(int fd, ScmString *path, int kinds)
+{
+    const char *cpath = Scm_GetStringConst(path);
+    int wd = -1;
+#if defined(USE_INOTIFY)
+    SCM_SYSCALL(wd, inotify_add_watch(fd, cpath, kinds_to_mask(kinds)));
+    if (wd < 0) Scm_SysError("couldn't watch %S", SCM_OBJ(path));
+#elif defined(USE_KQUEUE)
+    int oflags = O_RDONLY;
+#if defined(O_EVTONLY)
+    oflags = O_EVTONLY;         /* OSX; doesn't prevent unmounting */
+#endif
+    SCM_SYSCALL(wd, open(cpath, oflags));
+    if (wd < 0) Scm_SysError("couldn't watch %S", SCM_OBJ(path));
+    (void)fcntl(wd, F_SETFD, FD_CLOEXEC);
+    struct kevent kev;
+    EV_SET(&kev, wd, EVFILT_VNODE, EV_ADD|EV_CLEAR, kinds_to_fflags(kinds),
+           0, NULL);
+    if (kevent(fd, &kev, 1, NULL, 0, NULL) < 0) {
+        int e = errno;
+        close(wd);
+        errno = e;
+        Scm_SysError("couldn't watch %S", SCM_OBJ(path));
+    }
+#else
+    (void)fd; (void)cpath; (void)kinds;
+    no_backend();
+#endif
+    return wd;
+}
+
+void Scm_FileWatchRemove(int fd, int wd)
+{
+#if defined(USE_INOTIFY)
+    /* This fails if the watch has already gone (e.g. the file is
+       deleted), but that's what we want anyway. */
+    (void)inotify_rm_watch(fd, wd);
+#elif defined(USE_KQUEUE)
+    (void)fd;
+    close(wd);                  /* removes the kevent as well */
+#else
+    (void)fd; (void)wd;
+    no_backend();
+#endif
+}
+
+/* Returns a list of pending events, each of which is #(wd kinds name).
+   NAME is the name of the entry in the watched directory, or #f.
+   With inotify, a watch that has gone away (IN_IGNORED) is reported
+   with kinds 0. */
+ScmObj Scm_FileWatchRead(int fd)
+{
+    ScmObj h = SCM_NIL, t = SCM_NIL;
+#if defined(USE_INOTIFY)
+    char buf[4096]
+        __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    for (;;) {
+        ssize_t n;
+        SCM_SYSCALL(n, read(fd, buf, sizeof(buf)));
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            Scm_SysError("reading inotify events failed");
+        }
+        if (n == 0) break;
+        for (char *p = buf; p < buf + n; ) {
+            struct inotify_event *ev = (struct inotify_event*)p;
+            ScmObj name = (ev->len > 0 && ev->name[0] != '\0')
+                ? SCM_MAKE_STR_COPYING(ev->name) : SCM_FALSE;
+            int kinds = mask_to_kinds(ev->mask);
+            if (kinds != 0 || (ev->mask & IN_IGNORED)) {
+                ScmObj v = Scm_MakeVector(3, SCM_FALSE);
+                SCM_VECTOR_ELEMENT(v, 0) = Scm_MakeInteger(ev->wd);
+                SCM_VECTOR_ELEMENT(v, 1) = SCM_MAKE_INT(kinds);
+                SCM_VECTOR_ELEMENT(v, 2) = name;
+                SCM_APPEND1(h, t, v);
+            }
+            p += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+#elif defined(USE_KQUEUE)
+    struct kevent evs[64];
+    struct timespec zero = {0, 0};
+    for (;;) {
+        int n;
+        SCM_SYSCALL(n, kevent(fd, NULL, 0, evs, 64, &zero));
+        if (n < 0) Scm_SysError("reading kqueue events failed");
+        for (int i=0; i<n; i++) {
+            ScmObj v = Scm_MakeVector(3, SCM_FALSE);
+            SCM_VECTOR_ELEMENT(v, 0) = Scm_MakeInteger((int)evs[i].ident);
+            SCM_VECTOR_ELEMENT(v, 1)
+                = SCM_MAKE_INT(fflags_to_kinds(evs[i].fflags));
+            SCM_APPEND1(h, t, v);
+        }
+        if (n < 64) break;
+    }
+#else
+    (void)fd; (void)t;
+    no_backend();
+#endif
+    return h;
+}
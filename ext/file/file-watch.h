@@ -0,0 +1,61 @@
+/*
+ * file-watch.h - file change notification
+ *   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef GAUCHE_FILE_WATCH_H
+#define GAUCHE_FILE_WATCH_H
+
+#include <gauche.h>
+#include <gauche/extend.h>
+
+SCM_DECL_BEGIN
+
+/* Event kinds.  Used both to specify interest and to report events. */
+enum {
+    SCM_FILE_WATCH_MODIFY   = (1L<<0),
+    SCM_FILE_WATCH_ATTRIB   = (1L<<1),
+    SCM_FILE_WATCH_CREATE   = (1L<<2),
+    SCM_FILE_WATCH_DELETE   = (1L<<3),
+    SCM_FILE_WATCH_MOVE     = (1L<<4),
+    SCM_FILE_WATCH_OVERFLOW = (1L<<5)  /* events are lost (report only) */
+};
+
+extern ScmObj Scm_FileWatchBackend(void);
+extern int    Scm_FileWatchOpen(void);
+extern void   Scm_FileWatchClose(int fd);
+extern int    Scm_FileWatchAdd(int fd, ScmString *path, int kinds);
+extern void   Scm_FileWatchRemove(int fd, int wd);
+extern ScmObj Scm_FileWatchRead(int fd);
+
+SCM_DECL_END
+
+#endif /*GAUCHE_FILE_WATCH_H*/
@@ -310,6 +310,19 @@
   (sys-unlink "test.out/test.dangling")]
  [else])
 
+(cond-expand
+ [gauche.sys.threads
+  (test* "directory-fold :threads"
+         (sort (directory-fold "test.out" cons '()))
+         (sort (directory-fold "test.out" cons '()
+                               :threads 3 :combine append)))
+
+  (test* "directory-fold :threads (error)" (test-error)
+         (directory-fold "test.out"
+                         (^[path seed] (error "oops" path))
+                         '() :threads 2 :combine append))]
+ [else])
+
 (test* "directory-fold :lister"
        (cond-expand
         [gauche.sys.symlink
@@ -704,4 +717,67 @@
 (test-lock-file 'file)
 (test-lock-file 'directory)
 
+;;------------------------------------------------------------------
+(test-section "file.watch")
+
+(use file.watch)
+(use gauche.selector)
+(test-module 'file.watch)
+
+(define (test-file-watch backend)
+  ;; kqueue only tells us the directory is written.
+  (define (expect kind name)
+    (if (eq? backend 'kqueue) '(modify #f) (list kind name)))
+  (define (got? kind name evs)
+    (and (member (expect kind name)
+                 (map (^e (list (file-event-kind e) (file-event-name e)))
+                      evs))
+         #t))
+  (remove-files "test.watch")
+  (make-directory* "test.watch")
+  (let1 w (make-file-watcher :backend backend :poll-interval 0.05)
+    (file-watcher-add! w "test.watch")
+    (test* #"file.watch (~backend) paths" '("test.watch")
+           (file-watcher-paths w))
+    (test* #"file.watch (~backend) create" #t
+           (begin
+             (with-output-to-file "test.watch/a" (cut display "abc"))
+             (got? 'create "a" (file-watcher-wait w 5))))
+    (file-watcher-read w)
+    (test* #"file.watch (~backend) modify" #t
+           (begin
+             (with-output-to-file "test.watch/a" (cut display "defg")
+                                  :if-exists :append)
+             (got? 'modify "a" (file-watcher-wait w 5))))
+    (file-watcher-read w)
+    (test* #"file.watch (~backend) delete" #t
+           (begin
+             (sys-unlink "test.watch/a")
+             (got? 'delete "a" (file-watcher-wait w 5))))
+    (test* #"file.watch (~backend) timeout" '()
+           (file-watcher-wait w 0.1))
+    (file-watcher-remove! w "test.watch")
+    (test* #"file.watch (~backend) remove" '()
+           (file-watcher-paths w))
+    (file-watcher-close! w))
+  (remove-files "test.watch"))
+
+(test-file-watch 'poll)
+(and-let* ([native (file-watcher-backend (make-file-watcher))]
+           [(not (eq? native 'poll))])
+  (test-file-watch native)
+
+  (test* "file.watch with selector" #t
+         (let ([w (make-file-watcher)]
+               [sel (make <selector>)]
+               [got #f])
+           (make-directory* "test.watch")
+           (file-watcher-add! w "test.watch")
+           (selector-add-file-watcher! sel w (^[evs] (set! got evs)))
+           (touch-file "test.watch/b")
+           (selector-select sel 5000000)
+           (file-watcher-close! w)
+           (remove-files "test.watch")
+           (pair? got))))
+
 (test-end)
@@ -0,0 +1,298 @@
+;;;
+;;; file.watch - file change notification
+;;;
+;;;   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+;;;
+;;;   Redistribution and use in source and binary forms, with or without
+;;;   modification, are permitted provided that the following conditions
+;;;   are met:
+;;;
+;;;   1. Redistributions of source code must retain the above copyright
+;;;      notice, this list of conditions and the following disclaimer.
+;;;
+;;;   2. Redistributions in binary form must reproduce the above copyright
+;;;      notice, this list of conditions and the following disclaimer in the
+;;;      documentation and/or other materials provided with the distribution.
+;;;
+;;;   3. Neither the name of the authors nor the names of its contributors
+;;;      may be used to endorse or promote products derived from this
+;;;      software without specific prior written permission.
+;;;
+;;;   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+;;;   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+;;;   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+;;;   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+;;;   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+;;;   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+;;;   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+;;;   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+;;;   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+;;;   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+;;;   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+;;;
+
+;; Watches files and directories for changes, with inotify on Linux,
+;; kqueue on BSDs and OSX, and by polling elsewhere.  Events are read
+;; in batches; the watcher's file descriptor can be registered to a
+;; selector so that the program is woken up only when something happens.
+
+#!no-fold-case
+
+(define-module file.watch
+  (use srfi-1)
+  (export <file-watcher> <file-event>
+          make-file-watcher file-watcher-backend file-watcher-fd
+          file-watcher-add! file-watcher-remove! file-watcher-close!
+          file-watcher-paths file-watcher-read file-watcher-wait
+          selector-add-file-watcher!
+          file-event-path file-event-name file-event-kind
+          file-event-pathname))
+(select-module file.watch)
+
+(autoload gauche.selector selector-add!)
+
+(inline-stub
+ (declcode "#include \"file-watch.h\"")
+
+ (define-enum SCM_FILE_WATCH_MODIFY)
+ (define-enum SCM_FILE_WATCH_ATTRIB)
+ (define-enum SCM_FILE_WATCH_CREATE)
+ (define-enum SCM_FILE_WATCH_DELETE)
+ (define-enum SCM_FILE_WATCH_MOVE)
+ (define-enum SCM_FILE_WATCH_OVERFLOW)
+
+ (define-cproc %native-backend () Scm_FileWatchBackend)
+ (define-cproc %native-open () ::<int> Scm_FileWatchOpen)
+ (define-cproc %native-close (fd::<int>) ::<void> Scm_FileWatchClose)
+ (define-cproc %native-add (fd::<int> path::<string> kinds::<int>) ::<int>
+   Scm_FileWatchAdd)
+ (define-cproc %native-remove (fd::<int> wd::<int>) ::<void>
+   Scm_FileWatchRemove)
+ (define-cproc %native-read (fd::<int>) Scm_FileWatchRead)
+ )
+
+(define *kinds*
+  `((modify   . ,SCM_FILE_WATCH_MODIFY)
+    (attrib   . ,SCM_FILE_WATCH_ATTRIB)
+    (create   . ,SCM_FILE_WATCH_CREATE)
+    (delete   . ,SCM_FILE_WATCH_DELETE)
+    (move     . ,SCM_FILE_WATCH_MOVE)
+    (overflow . ,SCM_FILE_WATCH_OVERFLOW)))
+
+(define (kinds->bits kinds)
+  (fold (^[k bits]
+          (logior bits
+                  (or (assq-ref *kinds* k)
+                      (error "unknown file event kind:" k))))
+        0 kinds))
+
+(define (bits->kinds bits)
+  (filter-map (^p (and (logtest bits (cdr p)) (car p))) *kinds*))
+
+(define-class <file-event> ()
+  ((path :init-keyword :path :getter file-event-path) ; watched path
+   (name :init-keyword :name :getter file-event-name) ; entry name or #f
+   (kind :init-keyword :kind :getter file-event-kind)))
+
+(define-method write-object ((e <file-event>) port)
+  (format port "#<file-event ~a ~s>" (~ e'kind) (file-event-pathname e)))
+
+;; The pathname of the file the event is about.
+(define (file-event-pathname e)
+  (if (and (~ e'path) (~ e'name))
+    (string-append (~ e'path) "/" (~ e'name))
+    (~ e'path)))
+
+;; A watch is #(path kinds snapshot); snapshot is only used by
+;; the polling backend.
+(define-class <file-watcher> ()
+  ((backend :init-keyword :backend :getter file-watcher-backend)
+   (fd      :init-value #f :getter file-watcher-fd) ; #f for polling
+   (watches :init-form (make-hash-table 'eqv?))    ; wd -> watch
+   (paths   :init-form (make-hash-table 'equal?))  ; path -> wd
+   (next-wd :init-value 0)                         ; for polling
+   (poll-interval :init-keyword :poll-interval :init-value 1)))
+
+;; BACKEND may be #f to choose the native one if available, or 'poll.
+(define (make-file-watcher :key (backend #f) (poll-interval 1))
+  (let* ([native (%native-backend)]
+         [b (case backend
+              [(#f) (or native 'poll)]
+              [(poll) 'poll]
+              [else (if (eq? backend native)
+                      backend
+                      (error "file watcher backend not supported:" backend))])]
+         [w (make <file-watcher> :backend b :poll-interval poll-interval)])
+    (unless (eq? b 'poll)
+      (slot-set! w 'fd (%native-open)))
+    w))
+
+(define (%check-open w)
+  (when (and (not (eq? (~ w'backend) 'poll)) (not (~ w'fd)))
+    (error "file watcher is already closed:" w)))
+
+(define (file-watcher-paths w) (hash-table-keys (~ w'paths)))
+
+;; Starts watching PATH for the events given by KINDS.  If PATH is a
+;; directory, events on its entries are reported as well, with their names
+;; (except on kqueue, where changes of the entries are reported as
+;; modification of the directory).  Adding the same path again updates
+;; the events to watch.
+(define (file-watcher-add! w path
+                           :optional (kinds '(modify attrib create delete move)))
+  (%check-open w)
+  (let1 bits (kinds->bits kinds)
+    (if (eq? (~ w'backend) 'poll)
+      (let1 wd (or (hash-table-get (~ w'paths) path #f)
+                   (rlet1 wd (~ w'next-wd) (inc! (~ w'next-wd))))
+        (hash-table-put! (~ w'paths) path wd)
+        (hash-table-put! (~ w'watches) wd (vector path bits (snapshot path))))
+      (begin
+        (and-let* ([old (hash-table-get (~ w'paths) path #f)]
+                   [(not (eq? (~ w'backend) 'inotify))])
+          ;; kqueue needs a fresh fd.
+          (%forget-watch! w old))
+        (let1 wd (%native-add (~ w'fd) path bits)
+          (hash-table-put! (~ w'paths) path wd)
+          (hash-table-put! (~ w'watches) wd (vector path bits #f)))))
+    (undefined)))
+
+(define (%forget-watch! w wd)
+  (and-let* ([watch (hash-table-get (~ w'watches) wd #f)])
+    (unless (eq? (~ w'backend) 'poll)
+      (%native-remove (~ w'fd) wd))
+    (hash-table-delete! (~ w'watches) wd)
+    (hash-table-delete! (~ w'paths) (vector-ref watch 0))))
+
+(define (file-watcher-remove! w path)
+  (%check-open w)
+  (and-let* ([wd (hash-table-get (~ w'paths) path #f)])
+    (%forget-watch! w wd))
+  (undefined))
+
+(define (file-watcher-close! w)
+  (unless (eq? (~ w'backend) 'poll)
+    (when (~ w'fd)
+      (when (eq? (~ w'backend) 'kqueue)
+        (hash-table-for-each (~ w'watches)
+                             (^[wd _] (%native-remove (~ w'fd) wd))))
+      (%native-close (~ w'fd))
+      (slot-set! w 'fd #f)))
+  (hash-table-clear! (~ w'watches))
+  (hash-table-clear! (~ w'paths))
+  (undefined))
+
+;; Returns a list of <file-event>s that have happened since the last call,
+;; without blocking.  Duplicate events in the batch are merged, keeping
+;; the order of the first occurrence.
+(define (file-watcher-read w)
+  (%check-open w)
+  (dedup-events
+   (if (eq? (~ w'backend) 'poll)
+     (append-map (^[wd] (poll-watch! w wd))
+                 (sort (hash-table-keys (~ w'watches))))
+     (append-map (^[ev] (native-event w ev)) (%native-read (~ w'fd))))))
+
+(define (dedup-events evs)
+  (let1 seen (make-hash-table 'equal?)
+    (filter (^e (let1 key (list (~ e'path) (~ e'name) (~ e'kind))
+                  (and (not (hash-table-get seen key #f))
+                       (hash-table-put! seen key #t)
+                       #t)))
+            evs)))
+
+(define (native-event w ev)
+  (let ([wd (vector-ref ev 0)] [bits (vector-ref ev 1)] [name (vector-ref ev 2)])
+    (cond
+     [(logtest bits SCM_FILE_WATCH_OVERFLOW)
+      (list (make <file-event> :path #f :name #f :kind 'overflow))]
+     [(hash-table-get (~ w'watches) wd #f)
+      => (^[watch]
+           (define mask
+             ;; kqueue reports entry creation as a write to the directory
+             (if (and (eq? (~ w'backend) 'kqueue)
+                      (logtest (vector-ref watch 1) SCM_FILE_WATCH_CREATE))
+               (logior (vector-ref watch 1) SCM_FILE_WATCH_MODIFY)
+               (vector-ref watch 1)))
+           (when (zero? bits)        ; the watch has gone
+             (hash-table-delete! (~ w'watches) wd)
+             (hash-table-delete! (~ w'paths) (vector-ref watch 0)))
+           (map (^k (make <file-event> :path (vector-ref watch 0)
+                          :name name :kind k))
+                (bits->kinds (logand bits mask))))]
+     [else '()])))
+
+;; Polling backend.  A snapshot is #f (nonexistent), (mtime . size) for
+;; a file, or an alist of (name mtime . size) for a directory.
+(define (stat-sig path)
+  (and-let* ([s (and (file-exists? path) (sys-stat path))])
+    (cons (~ s'mtime) (~ s'size))))
+
+(define (snapshot path)
+  (cond [(not (file-exists? path)) #f]
+        [(eq? (~ (sys-stat path)'type) 'directory)
+         (filter-map (^[name]
+                       (and (not (member name '("." "..")))
+                            (and-let* ([sig (stat-sig
+                                             (string-append path "/" name))])
+                              (cons name sig))))
+                     (sys-readdir path))]
+        [else (stat-sig path)]))
+
+(define (poll-watch! w wd)
+  (let* ([watch (hash-table-get (~ w'watches) wd)]
+         [path (vector-ref watch 0)]
+         [bits (vector-ref watch 1)]
+         [old (vector-ref watch 2)]
+         [new (snapshot path)]
+         [evs '()])
+    (define (ev! kind name)
+      (when (logtest bits (assq-ref *kinds* kind))
+        (push! evs (make <file-event> :path path :name name :kind kind))))
+    (vector-set! watch 2 new)
+    (cond [(equal? old new)]
+          [(not new) (ev! 'delete #f)]
+          [(not old) (ev! 'create #f)]
+          [(and (list? old) (list? new))  ; directory
+           (dolist [e new]
+             (match-entry e old ev!))
+           (dolist [e old]
+             (unless (assoc (car e) new) (ev! 'delete (car e))))]
+          [else (ev! 'modify #f)])
+    (reverse! evs)))
+
+(define (match-entry e old ev!)
+  (let1 o (assoc (car e) old)
+    (cond [(not o) (ev! 'create (car e))]
+          [(not (equal? (cdr o) (cdr e))) (ev! 'modify (car e))])))
+
+;; Waits until some events arrive or TIMEOUT (in seconds) passes, and
+;; returns the list of events (which is empty on timeout).
+(define (file-watcher-wait w :optional (timeout #f))
+  (%check-open w)
+  (if (eq? (~ w'backend) 'poll)
+    (let loop ([waited 0])
+      (let1 evs (file-watcher-read w)
+        (if (or (pair? evs) (and timeout (>= waited timeout)))
+          evs
+          (let1 dt (if timeout
+                     (min (~ w'poll-interval) (- timeout waited))
+                     (~ w'poll-interval))
+            (sys-nanosleep (exact (round (* dt 1e9))))
+            (loop (+ waited dt))))))
+    (let1 fds (make <sys-fdset>)
+      (sys-fdset-set! fds (~ w'fd) #t)
+      (sys-select fds #f #f (and timeout (exact (round (* timeout 1e6)))))
+      (file-watcher-read w))))
+
+;; Register the watcher to SELECTOR, so that PROC is called with a
+;; list of events whenever some arrive.
+(define (selector-add-file-watcher! selector w proc)
+  (%check-open w)
+  (unless (~ w'fd)
+    (error "polling file watcher can't be used with a selector:" w))
+  (selector-add! selector (~ w'fd)
+                 (^[fd flag]
+                   (let1 evs (file-watcher-read w)
+                     (unless (null? evs) (proc evs))))
+                 '(r)))
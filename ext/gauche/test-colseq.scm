@@ -58,6 +58,15 @@
 (test* "fold (hash-table)" '((c . "c") (b . "b") (a . "a"))
        (fold cons '() (hash-table 'eq? '(a . "a") '(b . "b") '(c . "c")))
        (cut lset= equal? <> <>))
+(test* "fold (uvector)" '(6 5 4 3 2 1)
+       (fold cons '() '#u8(1 2 3 4 5 6)))
+(test* "fold (uvector)" '(3.5 1.5)
+       (fold cons '() '#f64(1.5 3.5)))
+(test* "fold (tree-map)" '((c . "c") (b . "b") (a . "a"))
+       (fold cons '()
+             (alist->tree-map '((b . "b") (a . "a") (c . "c")))))
+(test* "fold (multibyte string)" '(#\う #\い #\あ)
+       (fold cons '() "あいう"))
 (test* "fold (custom)" '("f" "e" "d" "c" "b" "a")
        (fold cons '() (sseq 'a 'b 'c 'd 'e 'f)))
 
@@ -104,6 +113,12 @@
 (test* "map (hash-table)" '((c . "c") (b . "b") (a . "a"))
        (map identity (hash-table 'eq? '(a . "a") '(b . "b") '(c . "c")))
        (cut lset= equal? <> <>))
+(test* "map (uvector)" '(2 4 6 8 10)
+       (map (^x (* x 2)) '#s32(1 2 3 4 5)))
+(test* "map (tree-map)" '(a b c)
+       (map car (alist->tree-map '((b . "b") (a . "a") (c . "c")))))
+(test* "map (uvector, n-ary)" '(3 5 7)
+       (map + '#u16(1 2 3) '#(2 3 4)))
 (test* "map (custom)" '(2 4 6 8 10)
        (map (^x (* (string->number x) 2))
             (sseq 1 2 3 4 5)))
@@ -170,6 +185,9 @@
          (for-each (^x (push! p x))
                    (hash-table 'eq? '(a . "a") '(b . "b") '(c . "c"))))
        (cut lset= equal? <> <>))
+(test* "for-each (uvector)" '(5 4 3 2 1)
+       (rlet1 p '()
+         (for-each (^x (push! p x)) '#u8(1 2 3 4 5))))
 (test* "for-each (custom)" '("5" "4" "3" "2" "1")
        (rlet1 p '()
          (for-each (^x (push! p x)) (sseq 1 2 3 4 5))))
@@ -185,6 +203,13 @@
 (test* "find (hash-table)" '(b . "b")
        (find (^x (string=? "b" (cdr x)))
              (hash-table 'eq? '(a . "a") '(b . "b") '(c . "c"))))
+(test* "find (uvector)" 4
+       (find even? '#u32(3 1 7 5 4 8 7)))
+(test* "find (uvector)" #f
+       (find even? '#u32(3 1 7 5)))
+(test* "find (tree-map)" '(b . "b")
+       (find (^x (string=? "b" (cdr x)))
+             (alist->tree-map '((a . "a") (b . "b") (c . "c")))))
 (test* "find (custom)" "zoo"
        (find (^s (= (size-of s) 3))
              (sseq 'najr 'ej 'zoo 'bunr)))
@@ -300,6 +325,9 @@
 (test* "size-of (custom)" 5 (size-of (sseq 1 2 3 4 5)))
 (test* "size-of (hash-table)" 4
        (size-of (hash-table 'eq? '(a . "a") '(b . "b") '(c . "c") '(z . "b"))))
+(test* "size-of (uvector)" 3 (size-of '#f32(1 2 3)))
+(test* "size-of (tree-map)" 2
+       (size-of (alist->tree-map '((a . 1) (b . 2)))))
 (test* "size-of (char-set)" 0 (size-of (char-set)))
 (test* "size-of (char-set)" 5 (size-of #[abAB0]))
 
@@ -441,6 +469,8 @@
        (map-with-index cons '(a b c)))
 (test* "map-with-index (vector)" '((0 . a) (1 . b) (2 . c))
        (map-with-index cons '#(a b c)))
+(test* "map-with-index (uvector)" '((0 . 7) (1 . 8))
+       (map-with-index cons '#u8(7 8)))
 (test* "map-with-index (string)" '((0 . #\a) (1 . #\b) (2 . #\c))
        (map-with-index cons "abc"))
 (test* "map-with-index (custom)" '((0 . "a") (1 . "b") (2 . "c"))
@@ -505,6 +535,8 @@
        (values->list (find-with-index (cut eq? 'f <>) '#(a b c d e))))
 (test* "find-with-index (string)" '(2 #\c)
        (values->list (find-with-index (cut eqv? #\c <>) "abcde")))
+(test* "find-with-index (uvector)" '(2 4)
+       (receive r (find-with-index even? '#u8(1 3 4 5)) r))
 (test* "find-with-index (string)" '(#f #f)
        (values->list (find-with-index (cut eqv? #\f <>) "abcde")))
 (test* "find-with-index (custom)" '(2 "c")
@@ -533,6 +565,10 @@
        (fold-right cons '() '#(a b c d e)))
 (test* "fold-right (string)" '(#\a #\b #\c #\d #\e)
        (fold-right cons '() "abcde"))
+(test* "fold-right (uvector)" '(1 2 3)
+       (fold-right cons '() '#s8(1 2 3)))
+(test* "fold-right (multibyte string)" '(#\あ #\い #\う)
+       (fold-right cons '() "あいう"))
 (test* "fold-right (custom)" '("a" "b" "c" "d" "e")
        (fold-right cons '() (sseq 'a 'b 'c 'd 'e)))
 (test* "fold-right (list+list)" '(a 0 b 1 c 2 d 3 e 4)
@@ -280,6 +280,47 @@
                 (cut slices <> 3 #t 'z)
                 '(1 2 3 4 5 6 7 8 9) '(1 2 3 4) '(1)  '())
 
+;; Nested calls are fused by compiler macros; compare the results
+;; with the unfused chain, built through apply so that the compiler
+;; doesn't see the calls.
+(let ()
+  (define (unfused . stages)
+    (fold (^[stage g] (apply (car stage) (map (^x (if (eq? x '@) g x))
+                                              (cdr stage))))
+          (x->generator (iota 30))
+          stages))
+  (test* "fused gmap/gfilter"
+         (generator->list (unfused `(,gfilter ,odd? @) `(,gmap ,square @)))
+         (generator->list (gmap square (gfilter odd? (iota 30)))))
+  (test* "fused gtake/gremove/gmap"
+         (generator->list (unfused `(,gmap ,(cut * 3 <>) @)
+                                   `(,gremove ,even? @)
+                                   `(,gtake @ 5)))
+         (generator->list (gtake (gremove even? (gmap (cut * 3 <>) (iota 30)))
+                                 5)))
+  (test* "fused gfilter-map/gtake-while"
+         '(0 2 4 6 8)
+         (generator->list (gfilter-map (^x (and (even? x) x))
+                                       (gtake-while (cut < <> 10)
+                                                    (giota)))))
+  (test* "fused chain doesn't overread" '((a b) (c d e))
+         (let* ([g (list->generator '(a b c d e))]
+                [h (gmap identity (gtake g 2))])
+           (list (generator->list h) (generator->list g))))
+  (test* "fused chain evaluation order" '(f p src)
+         (let1 r '()
+           (define (note x v) (push! r x) v)
+           (generator->list (gmap (note 'f identity)
+                                  (gfilter (note 'p odd?) (note 'src '()))))
+           (reverse r)))
+  (test* "fused chain is a fresh generator each time" '((1 3) (1 3))
+         (let1 mk (^[] (gtake (gfilter odd? '(1 2 3 4 5)) 2))
+           (list (generator->list (mk)) (generator->list (mk)))))
+  (test* "locally rebound stage isn't fused" '(10 20)
+         (let ([gfilter (^[p g] (gmap (cut * 10 <>) g))])
+           (generator->list (gmap identity (gfilter odd? '(1 2))))))
+  )
+
 (test* "gstate-filter"
        '(1 2 3 1 2 3 1 2 3)
        (generator->list
@@ -1,4 +1,5 @@
 (use gauche.uvector)
+(use gauche.sequence)
 (use gauche.test)
 (test-start "records")
 
@@ -331,5 +332,95 @@
 (pseudo-record-test <f32vector> f32vector)
 (pseudo-record-test <f64vector> f64vector)
 
+;;--------------------------------------------------------------
+(test-section "packed record")
+
+(define-packed-record-type pk #t #t
+  (a u8)
+  (b f64)
+  (c s16 pk-c)
+  (d fixnum pk-d pk-d-put!)
+  (e obj))
+
+(test* "packed-rtd?" '(#t #f) (list (packed-rtd? pk) (packed-rtd? <record>)))
+(test* "field names" '#(a b c d e) (rtd-field-names pk))
+(test* "field mutability" '(#t #t #f #t #t)
+       (map (cut rtd-field-mutable? pk <>) '(a b c d e)))
+
+(let1 p (make-pk 1 2.5 -3 100 'x)
+  (test* "predicate" '(#t #f) (list (pk? p) (pk? 'x)))
+  (test* "accessors" '(1 2.5 -3 100 x)
+         (list (pk-a p) (pk-b p) (pk-c p) (pk-d p) (pk-e p)))
+  (test* "modifiers" '(255 -0.5 -3 -7 (y))
+         (begin (pk-a-set! p 255)
+                (pk-b-set! p -0.5)
+                (pk-d-put! p -7)
+                (pk-e-set! p '(y))
+                (list (pk-a p) (pk-b p) (pk-c p) (pk-d p) (pk-e p))))
+  (test* "range check" (test-error) (pk-a-set! p 256))
+  (test* "fixnum check" (test-error) (pk-d-put! p 1.0))
+  (test* "slot-ref" '(255 -0.5 -3) (map (cut slot-ref p <>) '(a b c)))
+  (test* "slot-set!" 3.0 (begin (slot-set! p 'b 3.0) (pk-b p)))
+  (test* "slot-set! (immutable)" (test-error) (slot-set! p 'c 0))
+  ;; u8 at 0, f64 at 8, s16 at 16, fixnum at 24 => 32 bytes
+  (test* "storage layout" '(32 255)
+         (let1 s (packed-record-storage p)
+           (list (u8vector-length s) (u8vector-ref s 0))))
+  (test* "procedural accessor" -0.25
+         (let1 acc (rtd-accessor pk 'b)
+           (set! (acc p) -0.25)
+           (acc p)))
+  (test* "procedural mutator (immutable)" (test-error) (rtd-mutator pk 'c))
+  )
+
+(test* "custom constructor" '(0 0.0 5 0)
+       (let* ([ctor (rtd-constructor pk '#(c))]
+              [p (ctor 5)])
+         (list (pk-a p) (pk-b p) (pk-c p) (pk-d p))))
+
+(test* "make-packed-rtd" '(1.5 #t)
+       (let* ([rtd (make-packed-rtd 'q '#((mutable x f32) (immutable y u8)))]
+              [p ((rtd-constructor rtd) 1.5 1)])
+         (list ((rtd-accessor rtd 'x) p) ((rtd-predicate rtd) p))))
+(test* "packed record as a parent" (test-error)
+       (make-rtd 'child '#(z) pk))
+(test* "make-packed-rtd (bad type)" (test-error)
+       (make-packed-rtd 'q '#((mutable x int))))
+
+(define-packed-record-type v3 #t #t
+  (x f64) (y f64) (z f64) (id u16))
+
+(test* "record array" '(3 (1.0 2.0 3.0 7) (0.0 0.0 0.0 0))
+       (let1 arr (make-record-array v3 3)
+         (record-array-set! arr 1 (make-v3 1.0 2.0 3.0 7))
+         (list (record-array-length arr)
+               (let1 r (record-array-ref arr 1)
+                 (list (v3-x r) (v3-y r) (v3-z r) (v3-id r)))
+               (let1 r (record-array-ref arr 2)
+                 (list (v3-x r) (v3-y r) (v3-z r) (v3-id r))))))
+
+(test* "record array (shared storage)" '(9.0 9.0 103)
+       (let* ([arr (make-record-array v3 4)]
+              [r (record-array-ref arr 2)]
+              [y (record-array-accessor v3 'y)])
+         (v3-y-set! r 9.0)
+         (set! (y arr 3) 9.0)
+         ((record-array-mutator v3 'id) arr 3 103)
+         (list (y arr 2) (v3-y (record-array-ref arr 3))
+               ((record-array-accessor v3 'id) arr 3))))
+
+(test* "record array (contiguous)" 128
+       (u8vector-length (record-array-storage (make-record-array v3 4))))
+(test* "record array (index range)" (test-error)
+       ((record-array-accessor v3 'x) (make-record-array v3 2) 2))
+(test* "record array (type check)" (test-error)
+       ((record-array-accessor v3 'x)
+        (make-record-array (make-packed-rtd 'w '#((mutable x f64))) 1) 0))
+(test* "record array (untyped field)" (test-error)
+       (make-record-array pk 1))
+(test* "record array (sequence)" '(0.0 1.0 2.0)
+       (let1 arr (make-record-array v3 3)
+         (dotimes [i 3] (set! ((record-array-accessor v3 'x) arr i) (* i 1.0)))
+         (map-to <list> v3-x arr)))
 
 (test-end)
@@ -5,6 +5,7 @@
 (use gauche.test)
 (use util.match)
 (use gauche.sequence)
+(use gauche.uvector)
 (test-start "gauche.unicode")
 
 (use gauche.unicode)
@@ -163,8 +164,15 @@
 
 (test-section "word boundary")
 
+(define (segments->breaks segs)
+  (list->u32vector
+   (reverse (fold (^[seg ks] (cons (+ (car ks) (string-length seg)) ks))
+                  '(0) segs))))
+
 (define (test-word-breaker sentence expected)
   (test* "string->words" expected (string->words sentence))
+  (test* "string-word-breaks" (segments->breaks expected)
+         (string-word-breaks sentence))
   (test* "codepoints->words"
          (map (^w (map char->ucs w)) expected)
          (codepoints->words (map char->ucs sentence)))
@@ -184,6 +192,42 @@
    '("Gauche" "(" "ゴーシュ" ")" "は" "R5RS" "準" "拠" "の"
      "Scheme" "処" "理" "系")))
 
+(test-word-breaker "" '())
+(test-word-breaker "1,234.5 ok" '("1,234.5" " " "ok"))
+(test-word-breaker "a,b" '("a" "," "b"))
+(test-word-breaker "x\r\n\ny" '("x" "\r\n" "\n" "y"))
+(test-word-breaker "foo_bar 3_a" '("foo_bar" " " "3_a"))
+(when (eq? (gauche-character-encoding) 'utf-8)
+  (test-word-breaker "(\u0301)" '("(\u0301" ")")))
+(when (memq (gauche-character-encoding) '(utf-8 euc-jp sjis))
+  (test-word-breaker "カタカナ_1" '("カタカナ_1")))
+
+(test-section "grapheme cluster boundary")
+
+(define (test-grapheme-breaker str expected)
+  (test* "string->grapheme-clusters" expected
+         (string->grapheme-clusters str))
+  (test* "string-grapheme-cluster-breaks" (segments->breaks expected)
+         (string-grapheme-cluster-breaks str))
+  (test* "codepoints->grapheme-clusters"
+         (map (^c (map char->ucs c)) expected)
+         (codepoints->grapheme-clusters (map char->ucs str))))
+
+(test-grapheme-breaker "" '())
+(test-grapheme-breaker "ab\r\nc" '("a" "b" "\r\n" "c"))
+(when (eq? (gauche-character-encoding) 'utf-8)
+  (test-grapheme-breaker "e\u0301x" '("e\u0301" "x"))
+  ;; Hangul syllable sequences, followed by a combining mark
+  (test-grapheme-breaker "\u1100\u1161\u11a8\u0301\u1100"
+                         '("\u1100\u1161\u11a8\u0301" "\u1100"))
+  (test-grapheme-breaker "\uac00\u0308a"
+                         '("\uac00\u0308" "a"))
+  (test-grapheme-breaker "\U0001F1EF\U0001F1F5\u0308!"
+                         '("\U0001F1EF\U0001F1F5\u0308" "!")))
+
+(test* "string-word-breaks (incomplete)" (test-error)
+       (string-word-breaks #*"abc"))
+
 (test-section "case conversion")
 
 (define (test-xcase-matrix up down title fold)
@@ -235,4 +279,21 @@
 (test* "string-titlecase" "Stra\u00dfe" (string-titlecase "stra\u00dfe"))
 (test* "string-foldcase" "strasse" (string-foldcase "stra\u00dfe"))
 
+;; ASCII-only strings take the fast path
+(let ([s "The Quick Brown Fox Jumps Over The Lazy Dog, 1234567890 [@`{]"])
+  (dotimes [i (string-length s)]
+    (let1 t (string-copy s i)
+      (test* #"string-upcase (ascii) ~i"
+             (list->string (map char-upcase (string->list t)))
+             (string-upcase t))
+      (test* #"string-downcase (ascii) ~i"
+             (list->string (map char-downcase (string->list t)))
+             (string-downcase t))
+      (test* #"string-foldcase (ascii) ~i"
+             (list->string (map char-downcase (string->list t)))
+             (string-foldcase t))))
+  (test* "string-upcase (non-ascii after a long ascii run)"
+         "THE QUICK BROWN FOX STRASSE"
+         (string-upcase "The Quick Brown Fox stra\u00dfe")))
+
 (test-end)
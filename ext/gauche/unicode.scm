@@ -43,10 +43,11 @@
 
           make-word-breaker
           make-word-reader
-          string->words codepoints->words
+          string->words codepoints->words string-word-breaks
           make-grapheme-cluster-breaker
           make-grapheme-cluster-reader
           string->grapheme-clusters codepoints->grapheme-clusters
+          string-grapheme-cluster-breaks
 
           string-upcase string-downcase string-titlecase string-foldcase
           codepoints-upcase codepoints-downcase codepoints-titlecase
@@ -407,39 +408,143 @@
                 (set! ,var ,i))]
              [else (SCM_TYPE_ERROR scode "char or fixnum")]))])
 
+ (define-cfn gb-prop (ch::int) ::int :static
+   (cond [(== ch #x0a) (return GB_LF)]
+         [(== ch #x0d) (return GB_CR)]
+         [(< ch 0) (return GB_Other)]
+         [(< ch #x20000)
+          (let* ([k::u_char (aref break_table (>> ch 8))])
+            (if (== k 255)
+              (return GB_Other)
+              (let* ([b::u_char (aref break_subtable k (logand ch #xff))])
+                (return (>> b 4)))))]
+         [(or (== #xE0001 ch)
+              (and (<= #xE0020 ch) (<= ch #xE007F))) (return GB_Control)]
+         [(and (<= #xE0100 ch) (<= ch #xE01EF)) (return GB_Extend)]
+         [else (return GB_Other)]))
+
+ (define-cfn wb-prop (ch::int) ::int :static
+   (cond [(== ch #x0a) (return WB_LF)]
+         [(== ch #x0d) (return WB_CR)]
+         [(== ch #x22) (return WB_Double_Quote)]
+         [(== ch #x27) (return WB_Single_Quote)]
+         [(< ch 0) (return WB_Other)]
+         [(< ch #x20000)
+          (let* ([k::u_char (aref break_table (>> ch 8))])
+            (if (== k 255)
+              (return WB_Other)
+              (let* ([b::u_char (aref break_subtable k (logand ch #xff))])
+                (return (logand b #x0f)))))]
+         [(or (== #xE0001 ch)
+              (and (<= #xE0020 ch) (<= ch #xE007F))) (return WB_Format)]
+         [(and (<= #xE0100 ch) (<= ch #xE01EF)) (return WB_Extend)]
+         [else (return WB_Other)]))
+
  (define-cproc gb-property (scode) ::<int>
    (let* ([ch::int])
      (get-arg ch scode)
-     (cond [(== ch #x0a) (return GB_LF)]
-           [(== ch #x0d) (return GB_CR)]
-           [(< ch #x20000)
-            (let* ([k::u_char (aref break_table (>> ch 8))])
-              (if (== k 255)
-                (return GB_Other)
-                (let* ([b::u_char (aref break_subtable k (logand ch #xff))])
-                  (return (>> b 4)))))]
-           [(or (== #xE0001 ch)
-                (and (<= #xE0020 ch) (<= ch #xE007F))) (return GB_Control)]
-           [(and (<= #xE0100 ch) (<= ch #xE01EF)) (return GB_Extend)]
-           [else (return GB_Other)])))
+     (return (gb-prop ch))))
 
  (define-cproc wb-property (scode) ::<int>
    (let* ([ch::int])
-     (get-arg ch scode) 
-     (cond [(== ch #x0a) (return WB_LF)]
-           [(== ch #x0d) (return WB_CR)]
-           [(== ch #x22) (return WB_Double_Quote)]
-           [(== ch #x27) (return WB_Single_Quote)]
-           [(< ch #x20000)
-            (let* ([k::u_char (aref break_table (>> ch 8))])
-              (if (== k 255)
-                (return WB_Other)
-                (let* ([b::u_char (aref break_subtable k (logand ch #xff))])
-                  (return (logand b #x0f)))))]
-           [(or (== #xE0001 ch)
-                (and (<= #xE0020 ch) (<= ch #xE007F))) (return WB_Format)]
-           [(and (<= #xE0100 ch) (<= ch #xE01EF)) (return WB_Extend)]
-           [else (return WB_Other)])))
+     (get-arg ch scode)
+     (return (wb-prop ch))))
+
+ ;; Break finder.  TAB is a finite automaton compiled from the state
+ ;; transition description by fa->table below: TAB[state*NPROPS+prop] is
+ ;; (next-state<<3)|action, where action is one of BRK_* below.  Since we
+ ;; have the properties of the whole string at hand, the lookahead required
+ ;; by WB6, WB7b and WB12 is just a scan of the property array.
+ ;; We fill COFFS and BOFFS (if not NULL) with the character and byte offsets
+ ;; of the breaks, including the beginning and the end of the string, and
+ ;; return the number of breaks.  Each array must have room for
+ ;; length+1 entries.
+ "#define BRK_NO    0"
+ "#define BRK_YES   1"
+ "#define BRK_WB6   2"
+ "#define BRK_WB12  3"
+ "#define BRK_WB7B  4"
+
+ (define-cfn wb-lookahead-p (props::(const u_char*) i::ScmSmallInt
+                             len::ScmSmallInt p0::int p1::int) ::int :static
+   (for [() (< i len) (pre++ i)]
+     (let* ([p::int (aref props i)])
+       (cond [(or (== p p0) (== p p1)) (return TRUE)]
+             [(and (!= p WB_Extend) (!= p WB_Format)) (return FALSE)])))
+   (return FALSE))
+
+ (define-cfn string-breaks (s::ScmString* tab::(const u_char*) nprops::int
+                            word::int coffs::ScmUInt32* boffs::ScmSmallInt*)
+   ::ScmSmallInt :static
+   (let* ([b::(const ScmStringBody*) (SCM_STRING_BODY s)]
+          [len::ScmSmallInt (SCM_STRING_BODY_LENGTH b)]
+          [start::(const char*) (SCM_STRING_BODY_START b)]
+          [p::(const char*) start]
+          [props::u_char* (SCM_NEW_ATOMIC_ARRAY u_char (+ len 1))]
+          [state::int 0]
+          [nb::ScmSmallInt 0]
+          [i::ScmSmallInt 0])
+     (when (SCM_STRING_BODY_INCOMPLETE_P b)
+       (Scm_Error "incomplete string not allowed: %S" s))
+     (for [(set! i 0) (< i len) (pre++ i)]
+       (let* ([ch::ScmChar])
+         (SCM_CHAR_GET p ch)
+         (+= p (+ (SCM_CHAR_NFOLLOWS (* p)) 1))
+         (let* ([u::int (Scm_CharToUcs ch)])
+           (set! (aref props i) (?: word (wb-prop u) (gb-prop u))))))
+     (set! p start)
+     (for [(set! i 0) (< i len) (pre++ i)]
+       (let* ([e::int (aref tab (+ (* state nprops) (aref props i)))]
+              [brk::int FALSE])
+         (set! state (>> e 3))
+         (case (logand e 7)
+           [(BRK_YES) (set! brk TRUE)]
+           [(BRK_WB6)
+            (set! brk (not (wb-lookahead-p props (+ i 1) len
+                                           WB_ALetter WB_Hebrew_Letter)))]
+           [(BRK_WB12)
+            (set! brk (not (wb-lookahead-p props (+ i 1) len
+                                           WB_Numeric WB_Numeric)))]
+           [(BRK_WB7B)
+            (set! brk (not (wb-lookahead-p props (+ i 1) len
+                                           WB_Hebrew_Letter
+                                           WB_Hebrew_Letter)))])
+         (when (or brk (== i 0))
+           (set! (aref coffs nb) (cast ScmUInt32 i))
+           (when boffs (set! (aref boffs nb) (- p start)))
+           (pre++ nb))
+         (+= p (+ (SCM_CHAR_NFOLLOWS (* p)) 1))))
+     ;; WB2, GB2: we always break at the end.
+     (set! (aref coffs nb) (cast ScmUInt32 len))
+     (when boffs (set! (aref boffs nb) (- p start)))
+     (return (+ nb 1))))
+
+ (define-cproc %string-breaks (s::<string> tab::<u8vector> nprops::<int>
+                               word::<boolean>)
+   (let* ([len::ScmSmallInt (SCM_STRING_BODY_LENGTH (SCM_STRING_BODY s))]
+          [coffs::ScmUInt32* (SCM_NEW_ATOMIC_ARRAY ScmUInt32 (+ len 1))]
+          [nb::ScmSmallInt (string-breaks s (SCM_U8VECTOR_ELEMENTS tab)
+                                          nprops word coffs NULL)])
+     (return (Scm_MakeU32VectorFromArrayShared nb coffs))))
+
+ ;; Returns a list of the segments of S.
+ (define-cproc %string-segments (s::<string> tab::<u8vector> nprops::<int>
+                                 word::<boolean>)
+   (let* ([b::(const ScmStringBody*) (SCM_STRING_BODY s)]
+          [len::ScmSmallInt (SCM_STRING_BODY_LENGTH b)]
+          [start::(const char*) (SCM_STRING_BODY_START b)]
+          [coffs::ScmUInt32* (SCM_NEW_ATOMIC_ARRAY ScmUInt32 (+ len 1))]
+          [boffs::ScmSmallInt* (SCM_NEW_ATOMIC_ARRAY ScmSmallInt (+ len 1))]
+          [nb::ScmSmallInt (string-breaks s (SCM_U8VECTOR_ELEMENTS tab)
+                                          nprops word coffs boffs)]
+          [h SCM_NIL] [t SCM_NIL]
+          [i::ScmSmallInt 1])
+     (for [() (< i nb) (pre++ i)]
+       (SCM_APPEND1 h t (Scm_MakeString (+ start (aref boffs (- i 1)))
+                                        (- (aref boffs i) (aref boffs (- i 1)))
+                                        (- (aref coffs i) (aref coffs (- i 1)))
+                                        SCM_STRING_COPYING)))
+     (return h)))
  )
 
 ;;=========================================================================
@@ -465,22 +570,6 @@
                  (begin (set! lookahead ch) (return (reverse acc)))
                  (loop (cons ch acc)))))))))
 
-;; NB: These may be refactored once we have the generator framework.
-(define (make-string-splitter cluster-reader-maker)
-  (case (gauche-character-encoding)
-    [(utf-8 none)  ;NB: we treat 'none' as latin-1
-     (^[str]
-       (with-input-from-string str
-         (cut generator->list
-              (cluster-reader-maker read-char list->string))))]
-    [else
-     (^[str]
-       (with-input-from-string str
-         (cut generator->list
-              (cluster-reader-maker (gmap char->ucs read-char)
-                                    (^[cs] (map-to <string> ucs->char cs))))))]
-    ))
-
 (define (make-sequence-splitter cluster-reader-maker)
   (^[seq]
     (let1 gen (x->generator seq)
@@ -504,6 +593,13 @@
 ;;
 ;; The input-index-map argument is a map to look up input index from
 ;; the input symbol.
+;;
+;; For strings, we don't go through the generators; fa->table flattens
+;; the compiled automaton into a u8vector and the C routine %string-breaks
+;; runs it over the whole string at once.  An entry of the table is
+;; (next-state-index << 3) | output, where output is 0 (no break), 1 (break),
+;; 2 (wb6), 3 (wb12) or 4 (wb7b).  Returns the table and the number of
+;; inputs, which is the stride of the table.
 
 (define (compile-state-transition-description state-desc default-next-state
                                               input-index-map)
@@ -541,6 +637,22 @@
                           (car state) input-symbol)])))))
     (list->vector (map build-inner-vec states))))
 
+(define (fa->table fa)
+  (let* ([nstates (vector-length fa)]
+         [ninputs (vector-length (vector-ref fa 0))]
+         [tab (make-u8vector (* nstates ninputs) 0)])
+    (dotimes [s nstates]
+      (dotimes [i ninputs]
+        (match (vector-ref (vector-ref fa s) i)
+          [(_ . #f) #f]                 ;unused input index
+          [(output . next)
+           (u8vector-set! tab (+ (* s ninputs) i)
+                          (logior (ash next 3)
+                                  (case output
+                                    [(#f) 0] [(#t) 1]
+                                    [(wb6) 2] [(wb12) 3] [(wb7b) 4])))])))
+    (values tab ninputs)))
+
 ;;=========================================================================
 ;; Word breaker state transition tables
 ;;
@@ -622,7 +734,7 @@
      (Numeric             -> #f :numeric)        ; WB8
      (ALetter             -> #f :a-letter)       ; WB10
      (Hebrew_Letter       -> #f :hebrew-letter)  ; WB10
-     ((or MidLetter MidNumLet Single_Quote) -> wb12 :numeric+mid) ; WB12
+     ((or MidNum MidNumLet Single_Quote) -> wb12 :numeric+mid) ; WB12
      (ExtendNumLet        -> #f :extend-num-let) ; WB13a
      (:else               -> #t :default))
     (:numeric+mid
@@ -632,6 +744,7 @@
     (:katakana
      ((or Extend Format)  -> #f :katakana)       ; WB4
      (Katakana            -> #f :katakana)       ; WB13
+     (ExtendNumLet        -> #f :extend-num-let) ; WB13a
      (:else               -> #t :default))
     (:extend-num-let
      ((or Extend Format)  -> #f :extend-num-let) ; WB4
@@ -646,6 +759,7 @@
      (Regional_Indicator  -> #f :regional-indicator) ; WB13c
      (:else               -> #t :default))
     (:other
+     ((or Extend Format)  -> #f :other)          ; WB4
      (:else               -> #t :default))       ; WB14
     ))
   
@@ -728,7 +842,10 @@
   (make-cluster-reader-maker make-word-breaker))
 
 ;; API
-(define string->words (make-string-splitter make-word-reader))
+(define-values (string-word-breaks string->words)
+  (receive (tab ninputs) (fa->table *word-break-fa*)
+    (values (^[str] (%string-breaks str tab ninputs #t))
+            (^[str] (%string-segments str tab ninputs #t)))))
 (define codepoints->words (make-sequence-splitter make-word-reader))
 
 ;; Grapheme Cluster Break Finite Automaton
@@ -761,16 +878,24 @@
      (L                  -> #f :l)          ; GB6
      ((or V LV)          -> #f :lv-v)       ; GB6
      (LVT                -> #f :lvt-t)      ; GB6
+     (Extend             -> #f :other)      ; GB9
+     (SpacingMark        -> #f :other)      ; GB9a
      (:else              -> #t :default))
     (:lv-v
      (V                  -> #f :lv-v)       ; GB7
      (T                  -> #f :lvt-t)      ; GB7
+     (Extend             -> #f :other)      ; GB9
+     (SpacingMark        -> #f :other)      ; GB9a
      (:else              -> #t :default))
     (:lvt-t
      (T                  -> #f :lvt-t)      ; GB8
+     (Extend             -> #f :other)      ; GB9
+     (SpacingMark        -> #f :other)      ; GB9a
      (:else              -> #t :default))
     (:regional-indicator
      (Regional_Indicator -> #f :regional-indicator) ; GB8a
+     (Extend             -> #f :other)      ; GB9
+     (SpacingMark        -> #f :other)      ; GB9a
      (:else              -> #t :default))
     (:prepend
      (CR                 -> #t :cr)         ; GB5
@@ -821,8 +946,10 @@
   (make-cluster-reader-maker make-grapheme-cluster-breaker))
 
 ;; API
-(define string->grapheme-clusters
-  (make-string-splitter make-grapheme-cluster-reader))
+(define-values (string-grapheme-cluster-breaks string->grapheme-clusters)
+  (receive (tab ninputs) (fa->table *grapheme-break-fa*)
+    (values (^[str] (%string-breaks str tab ninputs #f))
+            (^[str] (%string-segments str tab ninputs #f)))))
 (define codepoints->grapheme-clusters
   (make-sequence-splitter make-grapheme-cluster-reader))
 
@@ -876,6 +1003,10 @@
        )))
 
  (define-enum SCM_CHAR_FULL_CASE_MAPPING_SIZE)
+
+ ;; Fast path for ASCII-only strings; returns #f if STR has other chars.
+ (define-cproc %string-ascii-xcase (str::<string> upcase::<boolean>)
+   (return (Scm__StringAsciiCase str upcase)))
  )
 
 ;; Common args in the following routines
@@ -974,10 +1105,16 @@
     (get)))
 
 ;; APIs
-(define (string-upcase str)    (string-xcase str %upcase))
-(define (string-downcase str)  (string-xcase str %downcase))
+;; For ASCII strings, downcase and foldcase are the same, and no context
+;; matters.  Titlecase depends on word breaks, so it always takes the
+;; full path.
+(define (string-upcase str)
+  (or (%string-ascii-xcase str #t) (string-xcase str %upcase)))
+(define (string-downcase str)
+  (or (%string-ascii-xcase str #f) (string-xcase str %downcase)))
 (define (string-titlecase str) (string-xcase str %titlecase))
-(define (string-foldcase str)  (string-xcase str %foldcase))
+(define (string-foldcase str)
+  (or (%string-ascii-xcase str #f) (string-xcase str %foldcase)))
 
 (define (codepoints-upcase seq)    (codepoints-xcase seq %upcase))
 (define (codepoints-downcase seq)  (codepoints-xcase seq %downcase))
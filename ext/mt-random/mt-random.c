@@ -58,6 +58,7 @@
 
 #include <math.h>
 #include "mt-random.h"
+#include "ziggurat.h"
 
 /* Period parameters */
 #define M 397
@@ -196,6 +197,38 @@ double Scm_MTGenrandF64(ScmMersenneTwister *mt, int exclude0)
     return r;
 }
 
+/*
+ * Normal and exponential distributions, by the ziggurat method
+ */
+static uint64_t mt_source(void *state)
+{
+    ScmMersenneTwister *mt = (ScmMersenneTwister*)state;
+    uint64_t hi = Scm_MTGenrandU32(mt);
+    return (hi << 32) | Scm_MTGenrandU32(mt);
+}
+
+double Scm_MTGenrandNormal(ScmMersenneTwister *mt)
+{
+    return zig_normal(mt_source, mt);
+}
+
+double Scm_MTGenrandExponential(ScmMersenneTwister *mt)
+{
+    return zig_exponential(mt_source, mt);
+}
+
+/* V must be an f32vector or f64vector. */
+void Scm_MTFillNormal(ScmMersenneTwister *mt, ScmUVector *v,
+                      double mu, double sigma)
+{
+    zig_fill(v, TRUE, mu, sigma, mt_source, mt);
+}
+
+void Scm_MTFillExponential(ScmMersenneTwister *mt, ScmUVector *v, double mu)
+{
+    zig_fill(v, FALSE, mu, 0.0, mt_source, mt);
+}
+
 /*
  * Generic integer routine for [0, n-1], 0 < n <= 2^32
  */
@@ -308,5 +341,6 @@ void Scm_Init_mt_random(void)
     Scm_InitStaticClass(&Scm_MersenneTwisterClass, "<mersenne-twister>",
                         mod, NULL, 0);
     key_seed = SCM_MAKE_KEYWORD("seed");
+    zig_init();
 }
 
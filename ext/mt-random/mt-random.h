@@ -79,4 +79,11 @@ extern float         Scm_MTGenrandF32(ScmMersenneTwister *, int);
 extern double        Scm_MTGenrandF64(ScmMersenneTwister *, int);
 extern ScmObj        Scm_MTGenrandInt(ScmMersenneTwister *mt, ScmObj n);
 
+extern double        Scm_MTGenrandNormal(ScmMersenneTwister *mt);
+extern double        Scm_MTGenrandExponential(ScmMersenneTwister *mt);
+extern void          Scm_MTFillNormal(ScmMersenneTwister *mt, ScmUVector *v,
+                                      double mu, double sigma);
+extern void          Scm_MTFillExponential(ScmMersenneTwister *mt,
+                                           ScmUVector *v, double mu);
+
 extern void          Scm_Init_mt_random(void);
@@ -42,7 +42,11 @@
           mt-random-integer
           mt-random-fill-u32vector!
           mt-random-fill-f32vector!
-          mt-random-fill-f64vector!)
+          mt-random-fill-f64vector!
+          mt-random-normal
+          mt-random-exponential
+          mt-random-fill-normal!
+          mt-random-fill-exponential!)
   )
 (select-module math.mt-random)
 
@@ -104,6 +108,25 @@
      (dotimes [i (SCM_F64VECTOR_SIZE v)]
        (set! (* (post++ p)) (Scm_MTGenrandF64 mt TRUE)))
      (return (SCM_OBJ v))))
+
+ ;; Non-uniform distributions (ziggurat method)
+ (define-cproc mt-random-normal (mt::<mersenne-twister>) ::<double>
+   Scm_MTGenrandNormal)
+
+ (define-cproc mt-random-exponential (mt::<mersenne-twister>) ::<double>
+   Scm_MTGenrandExponential)
+
+ (define-cproc mt-random-fill-normal! (mt::<mersenne-twister> v::<uvector>
+                                       :optional (mean::<double> 0.0)
+                                                 (deviation::<double> 1.0))
+   (Scm_MTFillNormal mt v mean deviation)
+   (return (SCM_OBJ v)))
+
+ (define-cproc mt-random-fill-exponential! (mt::<mersenne-twister>
+                                            v::<uvector>
+                                            :optional (mean::<double> 1.0))
+   (Scm_MTFillExponential mt v mean)
+   (return (SCM_OBJ v)))
  )
 
 (define (%get-nword-random-int mt n)
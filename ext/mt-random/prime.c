@@ -0,0 +1,292 @@
+/*
+ * prime.c - native support of math.prime
+ *
+ *   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "prime.h"
+#include <string.h>
+
+/*===================================================================
+ * Segmented sieve
+ */
+
+/* We sieve odd numbers only, a byte per odd number, in blocks that fit
+   in L1 cache.  Each block starts as a copy of the wheel pattern, in
+   which the multiples of the small primes 3, 5, 7, 11 and 13 are already
+   crossed out; so we only cross out the multiples of primes from 17.
+   WHEEL_PERIOD is 3*5*7*11*13 = 15015 odd numbers; byte k of
+   the pattern is for 2k+1 (mod 30030).  The pattern has extra
+   SIEVE_BLOCK bytes, so that we can copy a block from any offset. */
+#define SIEVE_BLOCK   32768              /* odd numbers per block */
+#define WHEEL_PERIOD  15015
+#define WHEEL_MAX     13                 /* largest prime of the wheel */
+
+static unsigned char wheel_pattern[WHEEL_PERIOD + SIEVE_BLOCK];
+
+static void init_wheel(void)
+{
+    static const int wheel_primes[] = { 3, 5, 7, 11, 13 };
+    memset(wheel_pattern, 1, sizeof(wheel_pattern));
+    for (int i=0; i<5; i++) {
+        int p = wheel_primes[i];
+        /* byte k is for 2k+1; p divides it when k = (p-1)/2 + p*j */
+        for (int k=(p-1)/2; k<(int)sizeof(wheel_pattern); k+=p) {
+            wheel_pattern[k] = 0;
+        }
+    }
+}
+
+/* Base primes, which are the primes from 17 to base_limit.  The array is
+   replaced by a larger one when we need more, but never modified, so
+   a reader can keep using what it took. */
+static struct {
+    uint32_t *primes;
+    long count;
+    uint64_t limit;
+    ScmInternalMutex mutex;
+} base = { NULL, 0, 0 };
+
+/* Sieve of Eratosthenes up to LIMIT; used for the base primes. */
+static void compute_base_primes(uint64_t limit, uint32_t **pprimes,
+                                long *pcount)
+{
+    long n = (long)(limit/2) + 1;          /* byte k is for 2k+1 */
+    unsigned char *s = SCM_NEW_ATOMIC_ARRAY(unsigned char, n);
+    memset(s, 1, n);
+    for (long k=1; 2*k*(k+1) < n; k++) {
+        if (!s[k]) continue;
+        long p = 2*k+1;
+        for (long j=2*k*(k+1); j<n; j+=p) s[j] = 0;   /* from p^2 */
+    }
+    long count = 0;
+    for (long k=(WHEEL_MAX+1)/2; k<n; k++) if (s[k]) count++;
+    uint32_t *primes = SCM_NEW_ATOMIC_ARRAY(uint32_t, count);
+    long i = 0;
+    for (long k=(WHEEL_MAX+1)/2; k<n; k++) if (s[k]) primes[i++] = 2*k+1;
+    *pprimes = primes;
+    *pcount = count;
+}
+
+/* Returns base primes up to at least sqrt(hi). */
+static uint32_t *get_base_primes(uint64_t hi, long *pcount)
+{
+    uint64_t need = 1;
+    while (need < UINT32_MAX && need*need < hi) need <<= 1;
+    uint32_t *primes;
+    long count;
+    SCM_INTERNAL_MUTEX_LOCK(base.mutex);
+    if (base.limit < need) {
+        uint64_t limit = (base.limit*2 > need)? base.limit*2 : need;
+        if (limit > UINT32_MAX) limit = UINT32_MAX;
+        compute_base_primes(limit, &base.primes, &base.count);
+        base.limit = limit;
+    }
+    primes = base.primes;
+    count = base.count;
+    SCM_INTERNAL_MUTEX_UNLOCK(base.mutex);
+    *pcount = count;
+    return primes;
+}
+
+ScmObj Scm_PrimesInRange(uint64_t lo, uint64_t hi)
+{
+    ScmObj h = SCM_NIL, t = SCM_NIL;
+    long nbase;
+    if (hi <= lo) return SCM_NIL;
+    uint32_t *bp = get_base_primes(hi, &nbase);
+    unsigned char *block = SCM_NEW_ATOMIC_ARRAY(unsigned char, SIEVE_BLOCK);
+
+    if (lo <= 2 && hi > 2) SCM_APPEND1(h, t, SCM_MAKE_INT(2));
+    if (lo < 3) lo = 3;
+    if (lo % 2 == 0) lo++;
+
+    /* Each block covers odd numbers [s, s + 2*len) */
+    for (uint64_t s = lo; s < hi; s += 2*SIEVE_BLOCK) {
+        uint64_t end = (hi - s > 2*(uint64_t)SIEVE_BLOCK)
+            ? s + 2*SIEVE_BLOCK : hi;
+        long len = (long)((end - s + 1)/2);
+        memcpy(block, wheel_pattern + (s/2) % WHEEL_PERIOD, len);
+        if (s <= WHEEL_MAX) {
+            /* The wheel primes themselves are crossed out in the pattern */
+            for (uint64_t p = s; p <= WHEEL_MAX && p < end; p += 2) {
+                if (p != 9) block[(p - s)/2] = 1;
+            }
+        }
+        for (long i=0; i<nbase; i++) {
+            uint64_t p = bp[i];
+            if (p*p >= end) break;
+            /* the first odd multiple of p that is >= max(s, p^2) */
+            uint64_t m = (p*p >= s)? p*p : (s + p - 1)/p*p;
+            if (m % 2 == 0) m += p;
+            for (uint64_t j = (m - s)/2; j < (uint64_t)len; j += p) {
+                block[j] = 0;
+            }
+        }
+        for (long j=0; j<len; j++) {
+            if (block[j]) SCM_APPEND1(h, t, Scm_MakeIntegerU64(s + 2*j));
+        }
+    }
+    return h;
+}
+
+/*===================================================================
+ * Miller-Rabin test
+ */
+
+/* We use Montgomery multiplication modulo an odd N: a number x is
+   represented as xR mod N, where R = 2^64.  Then the product of two
+   such numbers only needs multiplications and a shift, instead of
+   a 128-bit division. */
+
+static inline void umul128(uint64_t a, uint64_t b, uint64_t *hi, uint64_t *lo)
+{
+#if defined(__SIZEOF_INT128__)
+    unsigned __int128 r = (unsigned __int128)a * b;
+    *hi = (uint64_t)(r >> 64);
+    *lo = (uint64_t)r;
+#else
+    uint64_t a0 = a & 0xffffffffUL, a1 = a >> 32;
+    uint64_t b0 = b & 0xffffffffUL, b1 = b >> 32;
+    uint64_t p00 = a0*b0, p01 = a0*b1, p10 = a1*b0, p11 = a1*b1;
+    uint64_t mid = (p00 >> 32) + (p01 & 0xffffffffUL) + (p10 & 0xffffffffUL);
+    *lo = (mid << 32) | (p00 & 0xffffffffUL);
+    *hi = p11 + (p01 >> 32) + (p10 >> 32) + (mid >> 32);
+#endif
+}
+
+typedef struct {
+    uint64_t n;                 /* modulus, odd */
+    uint64_t ninv;              /* -N^-1 mod R */
+    uint64_t one;               /* R mod N */
+    uint64_t r2;                /* R^2 mod N */
+} mont;
+
+static void mont_init(mont *m, uint64_t n)
+{
+    /* Newton's iteration for N^-1 mod 2^64; N*N = 1 (mod 8) gives
+       3 bits to start with, and each step doubles them. */
+    uint64_t x = n;
+    for (int i=0; i<5; i++) x *= 2 - n*x;
+    m->n = n;
+    m->ninv = -x;
+    m->one = (-n) % n;
+    /* R^2 mod N by doubling R 64 times */
+    uint64_t r = m->one;
+    for (int i=0; i<64; i++) {
+        r = (r >= n - r)? r - (n - r) : r + r;
+    }
+    m->r2 = r;
+}
+
+/* a * b * R^-1 mod N, where a, b < N */
+static inline uint64_t mont_mul(const mont *m, uint64_t a, uint64_t b)
+{
+    uint64_t hi, lo, mh, ml;
+    umul128(a, b, &hi, &lo);
+    umul128(lo * m->ninv, m->n, &mh, &ml);
+    /* lo + ml is 0 mod R; it carries unless lo is 0 */
+    uint64_t t = hi + mh;
+    int over = (t < hi);
+    uint64_t c = (lo != 0);
+    t += c;
+    over |= (t < c);
+    if (over || t >= m->n) t -= m->n;
+    return t;
+}
+
+static inline uint64_t mont_from(const mont *m, uint64_t a)
+{
+    return mont_mul(m, a % m->n, m->r2);
+}
+
+/* A strong probable prime test of N with base A. */
+static int mr_pass(const mont *m, uint64_t a, uint64_t d, int s)
+{
+    uint64_t minus_one = m->n - m->one;
+    uint64_t b = mont_from(m, a), x = m->one;
+    if (b == 0) return TRUE;
+    for (; d > 0; d >>= 1) {
+        if (d & 1) x = mont_mul(m, x, b);
+        b = mont_mul(m, b, b);
+    }
+    if (x == m->one || x == minus_one) return TRUE;
+    for (int i=1; i<s; i++) {
+        x = mont_mul(m, x, x);
+        if (x == minus_one) return TRUE;
+        if (x == m->one) return FALSE;
+    }
+    return FALSE;
+}
+
+/* Bases that make Miller-Rabin deterministic.  {2, 7, 61} is enough for
+   n < 4759123141 (Jaeschke 1993), and the seven bases found by Jim
+   Sinclair for all n < 2^64. */
+static const uint64_t mr_bases32[] = { 2, 7, 61 };
+static const uint64_t mr_bases64[] = {
+    2, 325, 9375, 28178, 450775, 9780504, 1795265022
+};
+
+int Scm_Prime64P(uint64_t n)
+{
+    static const int small_primes[] = {
+        2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53, 59, 61
+    };
+    if (n < 2) return FALSE;
+    for (int i=0; i<(int)(sizeof(small_primes)/sizeof(int)); i++) {
+        uint64_t p = small_primes[i];
+        if (n == p) return TRUE;
+        if (n % p == 0) return FALSE;
+    }
+    if (n < 61*61) return TRUE;
+
+    uint64_t d = n - 1;
+    int s = 0;
+    while ((d & 1) == 0) { d >>= 1; s++; }
+    mont m;
+    mont_init(&m, n);
+    const uint64_t *bases;
+    int nbases;
+    if (n < UINT64_C(4759123141)) {
+        bases = mr_bases32; nbases = 3;
+    } else {
+        bases = mr_bases64; nbases = 7;
+    }
+    for (int i=0; i<nbases; i++) {
+        if (!mr_pass(&m, bases[i], d, s)) return FALSE;
+    }
+    return TRUE;
+}
+
+void Scm_Init_prime(ScmModule *mod)
+{
+    SCM_INTERNAL_MUTEX_INIT(base.mutex);
+    init_wheel();
+}
@@ -35,7 +35,6 @@
 (define-module math.prime
   (use srfi-27)
   (use srfi-42)
-  (use gauche.uvector)
   (use gauche.generator)
   (use gauche.sequence)
   (use gauche.threads)
@@ -48,81 +47,45 @@
           jacobi totient))
 (select-module math.prime)
 
+;;;
+;;; Native support
+;;;
+
+(inline-stub
+ (declcode "#include \"prime.h\"")
+ (initcode "Scm_Init_prime(Scm_CurrentModule());")
+
+ ;; Returns a list of primes in [lo, hi)
+ (define-cproc %primes-in-range (lo hi)
+   (return (Scm_PrimesInRange (Scm_GetIntegerU64Clamp lo SCM_CLAMP_BOTH NULL)
+                              (Scm_GetIntegerU64Clamp hi SCM_CLAMP_BOTH NULL))))
+ ;; N must be an exact integer 0 <= N < 2^64
+ (define-cproc %prime64? (n) ::<boolean>
+   (return (Scm_Prime64P (Scm_GetIntegerU64 n))))
+ )
+
 ;;;
 ;;; Infinite sequence of prime numbers
 ;;;
 
-;; This section of code is based on the segment sieve prime number generator
-;; written by @cddddr.  Optimized by SK.  As of 0.9.4_pre2, it can generate
-;; first 10^7 primes in 14sec on 2.4GHz Core2 machine.
-
-(define (take-first-term a0 d lower-bound)
-  (if (<= lower-bound a0)
-      a0
-      (+ a0 (* d (quotient (- lower-bound a0 (- d) 1) d)))))
-(define (->odd x)  (if (odd? x) x (+ x 1)))
-(define (->even x) (if (even? x) x (+ x 1)))
-(define-inline (integer->index x) (ash x -1))
-
-(define-constant *segment-size* (->even #e5e4))
-(define-constant *first-segment-start*
-  (->odd (ceiling->exact (expt *segment-size* 0.6))))
-(define-constant *sieve-vec-size* (/ *segment-size* 2))
-(define-constant *sieve-filler* '#u8(0))
-
-;; sieve is a bytevector, representing a range of odd numbers.
-;; given odd number N in the range [start, end] (where start and end
-;; are both odd), (vector-ref bytevec (/ (- N start) 2)) is 0 if N
-;; is composite, 1 if not.
-(define (segment-sieve! bytevec start primes)
-  (let ([root (floor->exact (sqrt (+ start *segment-size* -1)))]
-        [start-index (integer->index start)])
-    (let sieve! ([ps (cdr primes)])
-      (match-let1 (p . qs) ps
-        (when (<= p root)
-          (let1 i (- (take-first-term (integer->index (* p p)) p start-index)
-                     start-index)
-            (u8vector-multi-copy! bytevec i p *sieve-filler*))
-          (sieve! qs))))))
-
-(define (bytevec->generator bytevec start)
-  (let1 i 0
-    (^[] (let loop ([j i])
-           (cond [(>= j *sieve-vec-size*) (set! i j) (eof-object)]
-                 [(not (zero? (u8vector-ref bytevec j)))
-                  (set! i (+ j 1))
-                  (+ (* j 2) start)]
-                 [else (loop (+ j 1))])))))
-
-(define (segment-prime-generator start primes)
-  (let1 bytevec (make-u8vector *sieve-vec-size* 1)
-    (segment-sieve! bytevec start primes)
-    (bytevec->generator bytevec start)))
-
-;; Head of prime sequence.  We don't make it a generator,
-;; for we only need to calculate them once and it won't
-;; take long.  We just wrap it with delay so that it won't
-;; tax loading time.
-(define *small-primes*
-  (delay (list-ec (:range n 2 *first-segment-start*)
-                  (if (every?-ec (:range j 2 (+ 1 (floor->exact (sqrt n))))
-                                 (< 0 (mod n j))))
-                  n)))
+;; We sieve in C (see prime.c), *segment-size* numbers at a time, and
+;; feed the primes of each segment to the lazy sequence.
+
+(define-constant *segment-size* 262144)
 
 ;; API
 (define (primes)
-  (define start *first-segment-start*)
-  (define gen (list->generator (force *small-primes*)))
+  (define start 0)
+  (define gen (^[] (eof-object)))
   (define (gen-primes)
     (let loop ([v (gen)])
       (if (eof-object? v)
-        (begin
-          (set! gen (segment-prime-generator start prime-lseq))
-          (inc! start *segment-size*)
+        (let1 end (+ start *segment-size*)
+          (set! gen (list->generator (%primes-in-range start end)))
+          (set! start end)
           (loop (gen)))
         v)))
-  (define prime-lseq (generator->lseq gen-primes))
-  prime-lseq)
+  (generator->lseq gen-primes))
 
 ;; API
 (define *primes* (primes))
@@ -150,33 +113,18 @@
                 [(= a^d n-1) #t]
                 [else (loop (+ i 1) (expt-mod a^d 2 n))])))))
 
-;; For small integers, determinisitc Miller-Rabin is known.
-;; Selfridge&Wagstaff  doi:10.2307/2006210
+;; Below 2^64, deterministic Miller-Rabin is known, which we run in C
+;; with Montgomery multiplication (see prime.c for the bases).
 ;; Jaeschke doi:10.2307/2153262
-(define *deterministic-witnesses*
-  ;; ((bound a ...) ...)
-  ;; If the number to test is less than bound, we only need to test with a ...
-  '((1373653 2 3)
-    (9080191 31 73)
-    (4759123141 2 7 61)
-    (2152302898747 2 3 5 7 11)
-    (3474749660383 2 3 5 7 11 13)
-    (341550071728321 2 3 5 7 11 13 17)))
-
-(define *small-prime-bound*
-  (car (last *deterministic-witnesses*)))
-
-(define (deterministic-miller-rabin n witnesses)
-  (every?-ec (: a witnesses) (miller-rabin-test a n)))
+
+(define *small-prime-bound* 18446744073709551616) ; (expt 2 64)
 
 ;; If n is below *small-prime-bound*, returns deterministic
 ;; answer.  If n is over, always return #f.
 (define (small-prime? n)
-  (if (<= n 100)
-    (boolean (memv n (take *primes* 25))) ; we have 25 primes below 100.
-    (and-let* ([ (odd? n) ]
-               [p (find (^p (< n (car p))) *deterministic-witnesses*)])
-      (deterministic-miller-rabin n (cdr p)))))
+  (and (exact-integer? n)
+       (< 1 n *small-prime-bound*)
+       (%prime64? n)))
 
 (define *miller-rabin-random-source*
   (rlet1 s (make-random-source)
@@ -287,6 +235,7 @@
   (cond [(< n 2) #f]
         [(= n 2) #t]
         [(even? n) #f]
+        [(< n *small-prime-bound*) (%prime64? n)]
         [else
          (let1 fs (naive-factorize n 1000)
            (cond
@@ -414,10 +363,7 @@
       (let1 d (mc-try-factorize n)
         (append (smash (car d)) (smash (cdr d))))))
 
-  (define (definite-prime? n)
-    (cond [(< n *small-prime-bound*) (small-prime? n)]
-          [(< n 18446744073709551616) (bpsw-prime? n)]; (expt 2 64)
-          [else #f]))
+  (define (definite-prime? n) (small-prime? n))
 
   (define try-prime-limit 1000)
 
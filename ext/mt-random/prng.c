@@ -0,0 +1,458 @@
+/*
+ * prng.c - xoshiro256** and Philox4x32 generators
+ *
+ *   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "prng.h"
+#include "ziggurat.h"
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) \
+    && (defined(__clang__) \
+        || (defined(__GNUC__) \
+            && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define PRNG_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+static uint64_t splitmix64(uint64_t *x)
+{
+    uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+/*================================================================
+ * xoshiro256**
+ */
+
+static void xoshiro_print(ScmObj obj, ScmPort *port, ScmWriteContext *ctx)
+{
+    Scm_Printf(port, "#<xoshiro256 @%p>", obj);
+}
+
+SCM_DEFINE_BUILTIN_CLASS(Scm_Xoshiro256Class, xoshiro_print, NULL, NULL, NULL,
+                         SCM_CLASS_DEFAULT_CPL);
+
+static inline uint64_t rotl(uint64_t x, int k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+static inline uint64_t xoshiro_next(ScmXoshiro256 *x)
+{
+    uint64_t *s = x->s;
+    uint64_t result = rotl(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+    return result;
+}
+
+ScmObj Scm_MakeXoshiro256(uint64_t seed)
+{
+    ScmXoshiro256 *x = SCM_NEW(ScmXoshiro256);
+    SCM_SET_CLASS(x, SCM_CLASS_XOSHIRO256);
+    /* As recommended by the authors, we expand the seed with splitmix64.
+       It never yields all-zero state. */
+    for (int i = 0; i < 4; i++) x->s[i] = splitmix64(&seed);
+    return SCM_OBJ(x);
+}
+
+uint64_t Scm_Xoshiro256Next(ScmXoshiro256 *x)
+{
+    return xoshiro_next(x);
+}
+
+/* Advances the state by 2^128 steps, or 2^192 steps if LONG_JUMP. */
+void Scm_Xoshiro256Jump(ScmXoshiro256 *x, int long_jump)
+{
+    static const uint64_t jump[] = {
+        0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL,
+        0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL
+    };
+    static const uint64_t long_jump_poly[] = {
+        0x76e15d3efefdcbbfULL, 0xc5004e441c522fb3ULL,
+        0x77710069854ee241ULL, 0x39109bb02acbe635ULL
+    };
+    const uint64_t *poly = long_jump? long_jump_poly : jump;
+    uint64_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    for (int i = 0; i < 4; i++) {
+        for (int b = 0; b < 64; b++) {
+            if (poly[i] & ((uint64_t)1 << b)) {
+                s0 ^= x->s[0];
+                s1 ^= x->s[1];
+                s2 ^= x->s[2];
+                s3 ^= x->s[3];
+            }
+            xoshiro_next(x);
+        }
+    }
+    x->s[0] = s0;
+    x->s[1] = s1;
+    x->s[2] = s2;
+    x->s[3] = s3;
+}
+
+/*================================================================
+ * Philox4x32-10
+ */
+
+#define PHILOX_M0 0xD2511F53U
+#define PHILOX_M1 0xCD9E8D57U
+#define PHILOX_W0 0x9E3779B9U
+#define PHILOX_W1 0xBB67AE85U
+
+static void philox_print(ScmObj obj, ScmPort *port, ScmWriteContext *ctx)
+{
+    ScmPhilox *p = SCM_PHILOX(obj);
+    Scm_Printf(port, "#<philox4x32 stream %lu @%p>",
+               (u_long)(((uint64_t)p->ctr[3] << 32) | p->ctr[2]), obj);
+}
+
+SCM_DEFINE_BUILTIN_CLASS(Scm_PhiloxClass, philox_print, NULL, NULL, NULL,
+                         SCM_CLASS_DEFAULT_CPL);
+
+static inline void philox_block(const uint32_t ctr[4], const uint32_t key[2],
+                                uint64_t out[2])
+{
+    uint32_t x0 = ctr[0], x1 = ctr[1], x2 = ctr[2], x3 = ctr[3];
+    uint32_t k0 = key[0], k1 = key[1];
+    for (int r = 0; r < 10; r++) {
+        if (r > 0) { k0 += PHILOX_W0; k1 += PHILOX_W1; }
+        uint64_t p0 = (uint64_t)PHILOX_M0 * x0;
+        uint64_t p1 = (uint64_t)PHILOX_M1 * x2;
+        x0 = (uint32_t)(p1 >> 32) ^ x1 ^ k0;
+        x1 = (uint32_t)p1;
+        x2 = (uint32_t)(p0 >> 32) ^ x3 ^ k1;
+        x3 = (uint32_t)p0;
+    }
+    out[0] = x0 | ((uint64_t)x1 << 32);
+    out[1] = x2 | ((uint64_t)x3 << 32);
+}
+
+/* Adds N to the lower 64 bits of the counter.  We don't carry into
+   the stream number; a stream has 2^64 blocks. */
+static inline void philox_advance(ScmPhilox *p, uint64_t n)
+{
+    uint64_t c = (p->ctr[0] | ((uint64_t)p->ctr[1] << 32)) + n;
+    p->ctr[0] = (uint32_t)c;
+    p->ctr[1] = (uint32_t)(c >> 32);
+}
+
+static inline uint64_t philox_next(ScmPhilox *p)
+{
+    if (p->bufpos >= 2) {
+        philox_block(p->ctr, p->key, p->buf);
+        philox_advance(p, 1);
+        p->bufpos = 0;
+    }
+    return p->buf[p->bufpos++];
+}
+
+ScmObj Scm_MakePhilox(uint64_t seed, uint64_t stream)
+{
+    ScmPhilox *p = SCM_NEW(ScmPhilox);
+    SCM_SET_CLASS(p, SCM_CLASS_PHILOX);
+    p->key[0] = (uint32_t)seed;
+    p->key[1] = (uint32_t)(seed >> 32);
+    p->ctr[0] = p->ctr[1] = 0;
+    p->ctr[2] = (uint32_t)stream;
+    p->ctr[3] = (uint32_t)(stream >> 32);
+    p->bufpos = 2;
+    return SCM_OBJ(p);
+}
+
+uint64_t Scm_PhiloxNext(ScmPhilox *p)
+{
+    return philox_next(p);
+}
+
+/* Skips N outputs. */
+void Scm_PhiloxSkip(ScmPhilox *p, uint64_t n)
+{
+    while (n > 0 && p->bufpos < 2) { p->bufpos++; n--; }
+    philox_advance(p, n / 2);
+    if (n % 2) {
+        philox_block(p->ctr, p->key, p->buf);
+        philox_advance(p, 1);
+        p->bufpos = 1;
+    }
+}
+
+/* Moves to the next stream, keeping the position in it. */
+void Scm_PhiloxJump(ScmPhilox *p)
+{
+    uint64_t s = (p->ctr[2] | ((uint64_t)p->ctr[3] << 32)) + 1;
+    p->ctr[2] = (uint32_t)s;
+    p->ctr[3] = (uint32_t)(s >> 32);
+    if (p->bufpos < 2) {
+        /* recompute the buffered block for the new stream */
+        uint32_t c[4];
+        uint64_t b = (p->ctr[0] | ((uint64_t)p->ctr[1] << 32)) - 1;
+        c[0] = (uint32_t)b;
+        c[1] = (uint32_t)(b >> 32);
+        c[2] = p->ctr[2];
+        c[3] = p->ctr[3];
+        philox_block(c, p->key, p->buf);
+    }
+}
+
+#if defined(PRNG_SIMD_X86)
+/* 32x32->64 multiply of each lane by M; returns the high and low
+   halves in the same lanes. */
+__attribute__((target("avx2")))
+static inline void mulhilo8(__m256i a, __m256i m, __m256i *hi, __m256i *lo)
+{
+    __m256i pe = _mm256_mul_epu32(a, m);
+    __m256i po = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), m);
+    *lo = _mm256_blend_epi32(pe, _mm256_slli_epi64(po, 32), 0xaa);
+    *hi = _mm256_blend_epi32(_mm256_srli_epi64(pe, 32), po, 0xaa);
+}
+
+/* Eight consecutive blocks from CTR, which must not carry out of
+   ctr[0] within them.  OUT receives 16 outputs. */
+__attribute__((target("avx2")))
+static void philox8_avx2(const uint32_t ctr[4], const uint32_t key[2],
+                         uint64_t *out)
+{
+    __m256i x0 = _mm256_add_epi32(_mm256_set1_epi32((int)ctr[0]),
+                                  _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    __m256i x1 = _mm256_set1_epi32((int)ctr[1]);
+    __m256i x2 = _mm256_set1_epi32((int)ctr[2]);
+    __m256i x3 = _mm256_set1_epi32((int)ctr[3]);
+    __m256i m0 = _mm256_set1_epi32((int)PHILOX_M0);
+    __m256i m1 = _mm256_set1_epi32((int)PHILOX_M1);
+    uint32_t k0 = key[0], k1 = key[1];
+
+    for (int r = 0; r < 10; r++) {
+        __m256i hi0, lo0, hi1, lo1;
+        if (r > 0) { k0 += PHILOX_W0; k1 += PHILOX_W1; }
+        mulhilo8(x0, m0, &hi0, &lo0);
+        mulhilo8(x2, m1, &hi1, &lo1);
+        x0 = _mm256_xor_si256(_mm256_xor_si256(hi1, x1),
+                              _mm256_set1_epi32((int)k0));
+        x1 = lo1;
+        x2 = _mm256_xor_si256(_mm256_xor_si256(hi0, x3),
+                              _mm256_set1_epi32((int)k1));
+        x3 = lo0;
+    }
+
+    uint32_t w[4][8];
+    _mm256_storeu_si256((__m256i*)w[0], x0);
+    _mm256_storeu_si256((__m256i*)w[1], x1);
+    _mm256_storeu_si256((__m256i*)w[2], x2);
+    _mm256_storeu_si256((__m256i*)w[3], x3);
+    for (int j = 0; j < 8; j++) {
+        out[2*j]   = w[0][j] | ((uint64_t)w[1][j] << 32);
+        out[2*j+1] = w[2][j] | ((uint64_t)w[3][j] << 32);
+    }
+}
+#endif /*PRNG_SIMD_X86*/
+
+/* Set to the SIMD kernel if the CPU supports it. */
+static void (*philox8)(const uint32_t ctr[4], const uint32_t key[2],
+                       uint64_t *out) = NULL;
+
+static void philox_fill(ScmPhilox *p, uint64_t *out, ScmSmallInt n)
+{
+    ScmSmallInt i = 0;
+    while (i < n && p->bufpos < 2) out[i++] = p->buf[p->bufpos++];
+    if (philox8 != NULL) {
+        while (n - i >= 16) {
+            if (p->ctr[0] <= 0xffffffffU - 8) {
+                philox8(p->ctr, p->key, out + i);
+                philox_advance(p, 8);
+                i += 16;
+            } else {
+                philox_block(p->ctr, p->key, out + i);
+                philox_advance(p, 1);
+                i += 2;
+            }
+        }
+    }
+    for (; n - i >= 2; i += 2) {
+        philox_block(p->ctr, p->key, out + i);
+        philox_advance(p, 1);
+    }
+    if (i < n) out[i] = philox_next(p);
+}
+
+/*================================================================
+ * Generic interface
+ */
+
+static uint64_t xoshiro_source(void *s)
+{
+    return xoshiro_next((ScmXoshiro256*)s);
+}
+
+static uint64_t philox_source(void *s)
+{
+    return philox_next((ScmPhilox*)s);
+}
+
+static void check_prng(ScmObj g)
+{
+    if (!SCM_XOSHIRO256_P(g) && !SCM_PHILOX_P(g)) {
+        Scm_TypeError("generator", "<xoshiro256> or <philox4x32>", g);
+    }
+}
+
+ScmObj Scm_PrngCopy(ScmObj g)
+{
+    check_prng(g);
+    if (SCM_XOSHIRO256_P(g)) {
+        ScmXoshiro256 *x = SCM_NEW(ScmXoshiro256);
+        memcpy(x, SCM_XOSHIRO256(g), sizeof(ScmXoshiro256));
+        return SCM_OBJ(x);
+    } else {
+        ScmPhilox *p = SCM_NEW(ScmPhilox);
+        memcpy(p, SCM_PHILOX(g), sizeof(ScmPhilox));
+        return SCM_OBJ(p);
+    }
+}
+
+uint64_t Scm_PrngNext(ScmObj g)
+{
+    check_prng(g);
+    if (SCM_XOSHIRO256_P(g)) return xoshiro_next(SCM_XOSHIRO256(g));
+    else return philox_next(SCM_PHILOX(g));
+}
+
+void Scm_PrngFillU64(ScmObj g, uint64_t *p, ScmSmallInt n)
+{
+    check_prng(g);
+    if (SCM_XOSHIRO256_P(g)) {
+        ScmXoshiro256 *x = SCM_XOSHIRO256(g);
+        for (ScmSmallInt i = 0; i < n; i++) p[i] = xoshiro_next(x);
+    } else {
+        philox_fill(SCM_PHILOX(g), p, n);
+    }
+}
+
+#define FILL_CHUNK 256
+
+/* Integer vectors get raw bits; flonum vectors get uniform deviates
+   in (0, 1). */
+void Scm_PrngFillUVector(ScmObj g, ScmUVector *v)
+{
+    uint64_t buf[FILL_CHUNK];
+    ScmSmallInt size = SCM_UVECTOR_SIZE(v);
+    SCM_UVECTOR_CHECK_MUTABLE(v);
+    switch (Scm_UVectorType(SCM_CLASS_OF(v))) {
+    case SCM_UVECTOR_S64: case SCM_UVECTOR_U64:
+        Scm_PrngFillU64(g, (uint64_t*)SCM_UVECTOR_ELEMENTS(v), size);
+        break;
+    case SCM_UVECTOR_S32: case SCM_UVECTOR_U32: {
+        uint32_t *p = (uint32_t*)SCM_UVECTOR_ELEMENTS(v);
+        for (ScmSmallInt i = 0; i < size; i += 2*FILL_CHUNK) {
+            ScmSmallInt n = size - i;
+            if (n > 2*FILL_CHUNK) n = 2*FILL_CHUNK;
+            Scm_PrngFillU64(g, buf, (n + 1) / 2);
+            for (ScmSmallInt j = 0; j < n; j++) {
+                p[i+j] = (uint32_t)(buf[j/2] >> ((j%2)*32));
+            }
+        }
+        break;
+    }
+    case SCM_UVECTOR_F64: {
+        double *p = SCM_F64VECTOR_ELEMENTS(v);
+        for (ScmSmallInt i = 0; i < size; i += FILL_CHUNK) {
+            ScmSmallInt n = size - i;
+            if (n > FILL_CHUNK) n = FILL_CHUNK;
+            Scm_PrngFillU64(g, buf, n);
+            for (ScmSmallInt j = 0; j < n; j++) p[i+j] = zig_open01(buf[j]);
+        }
+        break;
+    }
+    case SCM_UVECTOR_F32: {
+        float *p = SCM_F32VECTOR_ELEMENTS(v);
+        for (ScmSmallInt i = 0; i < size; i += FILL_CHUNK) {
+            ScmSmallInt n = size - i;
+            if (n > FILL_CHUNK) n = FILL_CHUNK;
+            Scm_PrngFillU64(g, buf, n);
+            for (ScmSmallInt j = 0; j < n; j++) {
+                p[i+j] = (float)(((double)(buf[j] >> 41) + 0.5)
+                                 * (1.0/8388608.0));
+            }
+        }
+        break;
+    }
+    default:
+        Scm_TypeError("v", "s32, u32, s64, u64, f32 or f64 vector",
+                      SCM_OBJ(v));
+    }
+}
+
+double Scm_PrngNormal(ScmObj g)
+{
+    check_prng(g);
+    if (SCM_XOSHIRO256_P(g)) return zig_normal(xoshiro_source, g);
+    else return zig_normal(philox_source, g);
+}
+
+double Scm_PrngExponential(ScmObj g)
+{
+    check_prng(g);
+    if (SCM_XOSHIRO256_P(g)) return zig_exponential(xoshiro_source, g);
+    else return zig_exponential(philox_source, g);
+}
+
+void Scm_PrngFillNormal(ScmObj g, ScmUVector *v, double mu, double sigma)
+{
+    check_prng(g);
+    if (SCM_XOSHIRO256_P(g)) zig_fill(v, TRUE, mu, sigma, xoshiro_source, g);
+    else zig_fill(v, TRUE, mu, sigma, philox_source, g);
+}
+
+void Scm_PrngFillExponential(ScmObj g, ScmUVector *v, double mu)
+{
+    check_prng(g);
+    if (SCM_XOSHIRO256_P(g)) zig_fill(v, FALSE, mu, 0, xoshiro_source, g);
+    else zig_fill(v, FALSE, mu, 0, philox_source, g);
+}
+
+void Scm_Init_prng(ScmModule *mod)
+{
+    Scm_InitStaticClass(&Scm_Xoshiro256Class, "<xoshiro256>", mod, NULL, 0);
+    Scm_InitStaticClass(&Scm_PhiloxClass, "<philox4x32>", mod, NULL, 0);
+    zig_init();
+#if defined(PRNG_SIMD_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) philox8 = philox8_avx2;
+#endif
+}
@@ -0,0 +1,103 @@
+/*
+ * prng.h - xoshiro256** and Philox4x32 generators
+ *
+ *   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef GAUCHE_MATH_PRNG_H
+#define GAUCHE_MATH_PRNG_H
+
+#include <gauche.h>
+#include <gauche/extend.h>
+#include <stdint.h>
+
+/* Generators for parallel streams.
+ *
+ * xoshiro256** (Blackman & Vigna, 2018): 256 bits of state with period
+ * 2^256-1.  Jump functions advance the state by 2^128 or 2^192 steps,
+ * so each thread can take a non-overlapping stream.
+ *
+ * Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as
+ * 1, 2, 3", 2011): a counter-based generator; the output for a 128-bit
+ * counter is a bijection keyed by 64 bits.  Jumping ahead is just
+ * adding to the counter, and the counter blocks are independent, so the
+ * bulk fill computes several blocks at once with SIMD.  The upper 64
+ * bits of the counter are the stream number.
+ *
+ * Both produce 64-bit outputs; a Philox block of four 32-bit words
+ * (x0 x1 x2 x3) gives two outputs, x0|x1<<32 and x2|x3<<32.
+ */
+
+typedef struct ScmXoshiro256Rec {
+    SCM_HEADER;
+    uint64_t s[4];
+} ScmXoshiro256;
+
+SCM_CLASS_DECL(Scm_Xoshiro256Class);
+#define SCM_CLASS_XOSHIRO256     (&Scm_Xoshiro256Class)
+#define SCM_XOSHIRO256(obj)      ((ScmXoshiro256*)(obj))
+#define SCM_XOSHIRO256_P(obj)    SCM_XTYPEP(obj, SCM_CLASS_XOSHIRO256)
+
+typedef struct ScmPhiloxRec {
+    SCM_HEADER;
+    uint32_t ctr[4];            /* the next block */
+    uint32_t key[2];
+    uint64_t buf[2];            /* outputs of the last block */
+    int bufpos;                 /* next index in buf; 2 if empty */
+} ScmPhilox;
+
+SCM_CLASS_DECL(Scm_PhiloxClass);
+#define SCM_CLASS_PHILOX         (&Scm_PhiloxClass)
+#define SCM_PHILOX(obj)          ((ScmPhilox*)(obj))
+#define SCM_PHILOX_P(obj)        SCM_XTYPEP(obj, SCM_CLASS_PHILOX)
+
+extern ScmObj   Scm_MakeXoshiro256(uint64_t seed);
+extern uint64_t Scm_Xoshiro256Next(ScmXoshiro256 *x);
+extern void     Scm_Xoshiro256Jump(ScmXoshiro256 *x, int long_jump);
+
+extern ScmObj   Scm_MakePhilox(uint64_t seed, uint64_t stream);
+extern uint64_t Scm_PhiloxNext(ScmPhilox *p);
+extern void     Scm_PhiloxSkip(ScmPhilox *p, uint64_t n);
+extern void     Scm_PhiloxJump(ScmPhilox *p);
+
+/* Generic operations on either generator. */
+extern ScmObj   Scm_PrngCopy(ScmObj g);
+extern uint64_t Scm_PrngNext(ScmObj g);
+extern void     Scm_PrngFillU64(ScmObj g, uint64_t *p, ScmSmallInt n);
+extern void     Scm_PrngFillUVector(ScmObj g, ScmUVector *v);
+extern double   Scm_PrngNormal(ScmObj g);
+extern double   Scm_PrngExponential(ScmObj g);
+extern void     Scm_PrngFillNormal(ScmObj g, ScmUVector *v,
+                                   double mu, double sigma);
+extern void     Scm_PrngFillExponential(ScmObj g, ScmUVector *v, double mu);
+
+extern void     Scm_Init_prng(ScmModule *mod);
+
+#endif /* GAUCHE_MATH_PRNG_H */
@@ -0,0 +1,137 @@
+;;;
+;;; prng.scm - xoshiro256** and Philox4x32 generators
+;;;
+;;;   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+;;;
+;;;   Redistribution and use in source and binary forms, with or without
+;;;   modification, are permitted provided that the following conditions
+;;;   are met:
+;;;
+;;;   1. Redistributions of source code must retain the above copyright
+;;;      notice, this list of conditions and the following disclaimer.
+;;;
+;;;   2. Redistributions in binary form must reproduce the above copyright
+;;;      notice, this list of conditions and the following disclaimer in the
+;;;      documentation and/or other materials provided with the distribution.
+;;;
+;;;   3. Neither the name of the authors nor the names of its contributors
+;;;      may be used to endorse or promote products derived from this
+;;;      software without specific prior written permission.
+;;;
+;;;   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+;;;   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+;;;   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+;;;   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+;;;   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+;;;   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+;;;   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+;;;   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+;;;   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+;;;   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+;;;   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+;;;
+
+(define-module math.prng
+  (use gauche.uvector)
+  (export <xoshiro256> <philox4x32>
+          make-xoshiro256 xoshiro256-jump! xoshiro256-long-jump!
+          make-philox4x32 philox4x32-skip!
+          prng? prng-copy prng-jump! prng-split
+          prng-u64 prng-real prng-integer prng-normal prng-exponential
+          prng-fill! prng-fill-normal! prng-fill-exponential!)
+  )
+(select-module math.prng)
+
+(inline-stub
+ (declcode "#include \"prng.h\"")
+ (initcode "Scm_Init_prng(Scm_CurrentModule());")
+
+ (define-type <xoshiro256> "ScmXoshiro256*" "xoshiro256 generator"
+   "SCM_XOSHIRO256_P" "SCM_XOSHIRO256")
+ (define-type <philox4x32> "ScmPhilox*" "philox4x32 generator"
+   "SCM_PHILOX_P" "SCM_PHILOX")
+
+ (define-cproc %make-xoshiro256 (seed)
+   (return (Scm_MakeXoshiro256 (Scm_GetIntegerU64 seed))))
+ (define-cproc xoshiro256-jump! (g::<xoshiro256>) ::<void>
+   (Scm_Xoshiro256Jump g FALSE))
+ (define-cproc xoshiro256-long-jump! (g::<xoshiro256>) ::<void>
+   (Scm_Xoshiro256Jump g TRUE))
+
+ (define-cproc %make-philox4x32 (seed stream)
+   (return (Scm_MakePhilox (Scm_GetIntegerU64 seed)
+                           (Scm_GetIntegerU64 stream))))
+ (define-cproc philox4x32-skip! (g::<philox4x32> n) ::<void>
+   (Scm_PhiloxSkip g (Scm_GetIntegerU64 n)))
+ (define-cproc %philox4x32-jump! (g::<philox4x32>) ::<void>
+   Scm_PhiloxJump)
+
+ (define-cproc prng? (obj) ::<boolean>
+   (return (or (SCM_XOSHIRO256_P obj) (SCM_PHILOX_P obj))))
+ (define-cproc prng-copy (g) Scm_PrngCopy)
+
+ (define-cproc prng-u64 (g)
+   (return (Scm_MakeIntegerU64 (Scm_PrngNext g))))
+ (define-cproc prng-real (g) ::<double>
+   (return (* (+ (cast double (>> (Scm_PrngNext g) 12)) 0.5)
+              (/ 1.0 4503599627370496.0))))
+ (define-cproc %prng-u32 (g) ::<ulong>
+   (return (cast u_long (>> (Scm_PrngNext g) 32))))
+ (define-cproc prng-normal (g) ::<double> Scm_PrngNormal)
+ (define-cproc prng-exponential (g) ::<double> Scm_PrngExponential)
+
+ (define-cproc prng-fill! (g v::<uvector>)
+   (Scm_PrngFillUVector g v)
+   (return (SCM_OBJ v)))
+ (define-cproc prng-fill-normal! (g v::<uvector>
+                                  :optional (mean::<double> 0.0)
+                                            (deviation::<double> 1.0))
+   (Scm_PrngFillNormal g v mean deviation)
+   (return (SCM_OBJ v)))
+ (define-cproc prng-fill-exponential! (g v::<uvector>
+                                       :optional (mean::<double> 1.0))
+   (Scm_PrngFillExponential g v mean)
+   (return (SCM_OBJ v)))
+ )
+
+(define (%seed->u64 seed) (logand seed #xffffffffffffffff))
+
+(define (make-xoshiro256 :optional (seed 0))
+  (%make-xoshiro256 (%seed->u64 seed)))
+
+;; STREAM selects one of 2^64 independent streams for the same seed.
+(define (make-philox4x32 :optional (seed 0) (stream 0))
+  (%make-philox4x32 (%seed->u64 seed) (%seed->u64 stream)))
+
+;; Advances G to the next non-overlapping stream: 2^128 outputs for
+;; xoshiro256, the next stream number for philox4x32.
+(define (prng-jump! g)
+  (cond [(is-a? g <xoshiro256>) (xoshiro256-jump! g)]
+        [(is-a? g <philox4x32>) (%philox4x32-jump! g)]
+        [else (error "generator required, but got:" g)])
+  g)
+
+;; Returns a list of N generators on distinct streams, e.g. one for
+;; each thread.  G itself is moved past them.
+(define (prng-split g n)
+  (list-tabulate n (^_ (rlet1 c (prng-copy g) (prng-jump! g)))))
+
+;; Uniform integer in [0, n).  We reject the biased tail, the same
+;; way as mt-random-integer.
+(define (prng-integer g n)
+  (unless (and (exact-integer? n) (positive? n))
+    (error "positive exact integer required, but got:" n))
+  (if (<= n #x100000000)
+    (let* ([q (quotient #x100000000 n)]
+           [qn (* q n)])
+      (let loop ([r (%prng-u32 g)])
+        (if (< r qn) (quotient r q) (loop (%prng-u32 g)))))
+    (let* ([nw (quotient (+ (integer-length n) 63) 64)]
+           [range (ash 1 (* 64 nw))]
+           [q (quotient range n)]
+           [qn (* q n)])
+      (define (bits)
+        (let loop ([i 0] [r 0])
+          (if (= i nw) r (loop (+ i 1) (+ (ash r 64) (prng-u64 g))))))
+      (let loop ([r (bits)])
+        (if (< r qn) (quotient r q) (loop (bits)))))))
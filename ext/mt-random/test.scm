@@ -110,6 +110,102 @@
                      (make-random-sequence <list> 100 (^[] (mt-random-real m2)))
                      ))))
 
+;; Non-uniform distributions.  We only check rough moments; with
+;; 100000 samples the error of the mean is about 0.003.
+(define (vector-moments v)
+  (let* ([n (uvector-length v)]
+         [mean (/ (f64vector-dot v (make-f64vector n 1.0)) n)]
+         [d (f64vector-sub v mean)])
+    (values mean (/ (f64vector-dot d d) n))))
+
+(test* "mt-random-normal" #t
+       (every real? (list-tabulate 100 (^_ (mt-random-normal m)))))
+(test* "mt-random-exponential" #t
+       (every (^x (>= x 0)) (list-tabulate 100 (^_ (mt-random-exponential m)))))
+
+(test* "mt-random-fill-normal!" '(#t #t)
+       (receive (mean var)
+           (vector-moments (mt-random-fill-normal! m (make-f64vector 100000)
+                                                   3.0 2.0))
+         (list (< (abs (- mean 3.0)) 0.05)
+               (< (abs (- var 4.0)) 0.2))))
+
+(test* "mt-random-fill-exponential!" '(#t #t #t)
+       (let1 v (mt-random-fill-exponential! m (make-f64vector 100000) 0.5)
+         (receive (mean var) (vector-moments v)
+           (list (every (^x (>= x 0)) (f64vector->list v))
+                 (< (abs (- mean 0.5)) 0.02)
+                 (< (abs (- var 0.25)) 0.03)))))
+
+(test* "mt-random-fill-normal! (f32)" #t
+       (let1 v (mt-random-fill-normal! m (make-f32vector 1000))
+         (every (^x (< (abs x) 10)) (f32vector->list v))))
+
+(test* "mt-random-fill-normal! (bad type)" (test-error)
+       (mt-random-fill-normal! m (make-u8vector 10)))
+
+;;-------------------------------------------------------------------
+(test-section "math.prng")
+
+(use math.prng)
+(test-module 'math.prng)
+
+;; Known answer of Philox4x32-10 with zero counter and key.
+(test* "philox4x32 known answer" '(#xe169c58d6627e8d5 #x9b00dbd8bc57ac4c)
+       (let1 g (make-philox4x32 0 0)
+         (list (prng-u64 g) (prng-u64 g))))
+
+(define (prng-sequence g n) (list-tabulate n (^_ (prng-u64 g))))
+
+(dolist [maker (list make-xoshiro256 make-philox4x32)]
+  (let1 name (if (eq? maker make-xoshiro256) "xoshiro256" "philox4x32")
+    (test* #"~name seed" #t
+           (equal? (prng-sequence (maker 42) 50)
+                   (prng-sequence (maker 42) 50)))
+    (test* #"~name seed" #f
+           (equal? (prng-sequence (maker 42) 50)
+                   (prng-sequence (maker 43) 50)))
+    (test* #"~name fill!" #t
+           (let ([g0 (maker 7)] [g1 (maker 7)])
+             (equal? (prng-sequence g0 1003)
+                     (u64vector->list (prng-fill! g1 (make-u64vector 1003))))))
+    (test* #"~name copy" #t
+           (let* ([g (maker 7)] [c (prng-copy g)])
+             (equal? (prng-sequence g 20) (prng-sequence c 20))))
+    (test* #"~name split" #t
+           (let1 seqs (map (cut prng-sequence <> 20) (prng-split (maker 1) 4))
+             (= (length (delete-duplicates (concatenate seqs))) 80)))
+    (test* #"~name real" #t
+           (let1 g (maker 3)
+             (every (^_ (< 0 (prng-real g) 1)) (iota 1000))))
+    (test* #"~name integer" #t
+           (let1 g (maker 3)
+             (and (every (^_ (< -1 (prng-integer g 7) 7)) (iota 1000))
+                  (every (^_ (< -1 (prng-integer g (expt 10 30)) (expt 10 30)))
+                         (iota 100)))))
+    (test* #"~name fill-normal!" '(#t #t)
+           (receive (mean var)
+               (vector-moments (prng-fill-normal! (maker 5)
+                                                  (make-f64vector 100000)))
+             (list (< (abs mean) 0.05) (< (abs (- var 1.0)) 0.05))))
+    (test* #"~name fill-exponential!" #t
+           (receive (mean var)
+               (vector-moments (prng-fill-exponential! (maker 5)
+                                                       (make-f64vector 100000)
+                                                       2.0))
+             (< (abs (- mean 2.0)) 0.05)))
+    ))
+
+(test* "philox4x32-skip!" #t
+       (let ([g0 (make-philox4x32 9)] [g1 (make-philox4x32 9)])
+         (prng-sequence g0 1000)
+         (philox4x32-skip! g1 1000)
+         (equal? (prng-sequence g0 10) (prng-sequence g1 10))))
+
+(test* "philox4x32 streams" #f
+       (equal? (prng-sequence (make-philox4x32 9 0) 10)
+               (prng-sequence (make-philox4x32 9 1) 10)))
+
 ;;-------------------------------------------------------------------
 ;; srfi-27 is built on top of mt-random, so we test it here.
 (test-section "srfi-27")
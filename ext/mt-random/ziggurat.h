@@ -0,0 +1,183 @@
+/*
+ * ziggurat.h - normal and exponential deviates by the ziggurat method
+ *
+ *   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef GAUCHE_MATH_ZIGGURAT_H
+#define GAUCHE_MATH_ZIGGURAT_H
+
+#include <math.h>
+#include <stdint.h>
+
+/* The ziggurat method of Marsaglia & Tsang (2000), with the layout of
+ * Doornik (2005) so that one 64-bit uniform gives both the layer (its
+ * low 8 bits) and the abscissa (its high 53 bits).  The tables are
+ * computed at initialization instead of being pasted as constants.
+ *
+ * This header is included by each generator module.  The samplers take
+ * the generator as a function pointer and a state; since they are
+ * static inline, the compiler specializes them for each generator.
+ */
+
+#define ZIG_LAYERS 256
+
+/* Right edge of the base layer and the area of each layer, for the
+   unnormalized densities exp(-x^2/2) and exp(-x). */
+#define ZIG_NORM_R 3.6541528853610088
+#define ZIG_NORM_V 0.00492867323399
+#define ZIG_EXP_R  7.69711747013104972
+#define ZIG_EXP_V  0.0039496598225815571993
+
+static double zig_norm_x[ZIG_LAYERS+1], zig_norm_f[ZIG_LAYERS+1];
+static double zig_exp_x[ZIG_LAYERS+1],  zig_exp_f[ZIG_LAYERS+1];
+
+typedef uint64_t (*zig_source)(void *state);
+
+static void zig_init(void)
+{
+    static int initialized = FALSE;
+    if (initialized) return;
+
+    double r = ZIG_NORM_R;
+    zig_norm_x[0] = ZIG_NORM_V / exp(-0.5*r*r);
+    zig_norm_x[1] = r;
+    for (int i = 2; i < ZIG_LAYERS; i++) {
+        double x = zig_norm_x[i-1];
+        zig_norm_x[i] = sqrt(-2.0 * log(ZIG_NORM_V/x + exp(-0.5*x*x)));
+    }
+    zig_norm_x[ZIG_LAYERS] = 0.0;
+    for (int i = 0; i <= ZIG_LAYERS; i++) {
+        zig_norm_f[i] = exp(-0.5 * zig_norm_x[i] * zig_norm_x[i]);
+    }
+
+    r = ZIG_EXP_R;
+    zig_exp_x[0] = ZIG_EXP_V / exp(-r);
+    zig_exp_x[1] = r;
+    for (int i = 2; i < ZIG_LAYERS; i++) {
+        double x = zig_exp_x[i-1];
+        zig_exp_x[i] = -log(ZIG_EXP_V/x + exp(-x));
+    }
+    zig_exp_x[ZIG_LAYERS] = 0.0;
+    for (int i = 0; i <= ZIG_LAYERS; i++) {
+        zig_exp_f[i] = exp(-zig_exp_x[i]);
+    }
+    initialized = TRUE;
+}
+
+/* Uniform in [0,1) and (0,1) from the high 53 bits. */
+static inline double zig_u01(uint64_t bits)
+{
+    return (double)(bits >> 11) * (1.0/9007199254740992.0);
+}
+
+static inline double zig_open01(uint64_t bits)
+{
+    return ((double)(bits >> 12) + 0.5) * (1.0/4503599627370496.0);
+}
+
+/* Standard normal deviate. */
+static inline double zig_normal(zig_source next, void *state)
+{
+    for (;;) {
+        uint64_t bits = next(state);
+        int i = (int)(bits & 0xff);
+        double u = 2.0 * zig_open01(bits) - 1.0;
+        double x = u * zig_norm_x[i];
+        if (fabs(x) < zig_norm_x[i+1]) return x;
+        if (i == 0) {
+            /* the tail beyond R (Marsaglia 1964) */
+            double xx, yy;
+            do {
+                xx = -log(zig_open01(next(state))) / ZIG_NORM_R;
+                yy = -log(zig_open01(next(state)));
+            } while (yy + yy < xx * xx);
+            return (u < 0)? -(ZIG_NORM_R + xx) : ZIG_NORM_R + xx;
+        }
+        if (zig_norm_f[i] + (zig_norm_f[i+1] - zig_norm_f[i])
+            * zig_u01(next(state)) < exp(-0.5 * x * x)) {
+            return x;
+        }
+    }
+}
+
+/* Exponential deviate with mean 1. */
+static inline double zig_exponential(zig_source next, void *state)
+{
+    for (;;) {
+        uint64_t bits = next(state);
+        int i = (int)(bits & 0xff);
+        double x = zig_u01(bits) * zig_exp_x[i];
+        if (x < zig_exp_x[i+1]) return x;
+        if (i == 0) {
+            /* the tail is memoryless */
+            return ZIG_EXP_R - log(zig_open01(next(state)));
+        }
+        if (zig_exp_f[i] + (zig_exp_f[i+1] - zig_exp_f[i])
+            * zig_u01(next(state)) < exp(-x)) {
+            return x;
+        }
+    }
+}
+
+/* Bulk fills.  V must be an f32vector or f64vector. */
+static inline void zig_fill(ScmUVector *v, int normal, double mu, double sigma,
+                            zig_source next, void *state)
+{
+    ScmSmallInt size = SCM_UVECTOR_SIZE(v);
+    SCM_UVECTOR_CHECK_MUTABLE(v);
+    if (SCM_F64VECTORP(v)) {
+        double *p = SCM_F64VECTOR_ELEMENTS(v);
+        if (normal) {
+            for (ScmSmallInt i = 0; i < size; i++) {
+                p[i] = mu + sigma * zig_normal(next, state);
+            }
+        } else {
+            for (ScmSmallInt i = 0; i < size; i++) {
+                p[i] = mu * zig_exponential(next, state);
+            }
+        }
+    } else if (SCM_F32VECTORP(v)) {
+        float *p = SCM_F32VECTOR_ELEMENTS(v);
+        if (normal) {
+            for (ScmSmallInt i = 0; i < size; i++) {
+                p[i] = (float)(mu + sigma * zig_normal(next, state));
+            }
+        } else {
+            for (ScmSmallInt i = 0; i < size; i++) {
+                p[i] = (float)(mu * zig_exponential(next, state));
+            }
+        }
+    } else {
+        Scm_TypeError("v", "f32vector or f64vector", SCM_OBJ(v));
+    }
+}
+
+#endif /* GAUCHE_MATH_ZIGGURAT_H */
@@ -0,0 +1,920 @@
+/*
+ * aio.c - asynchronous I/O
+ *
+ *   Copyright (c) 2001-2015  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * An aio context accepts read, write, accept and connect requests on
+ * file descriptors, performs them in the background, and hands back
+ * the completed requests.  Requests are staged by Scm_AioRead etc.,
+ * handed to the backend in a batch by Scm_AioSubmit, and collected by
+ * Scm_AioWait.
+ *
+ * Backends:
+ *
+ *   io-uring  Linux io_uring, driven by raw system calls.  A batch of
+ *             requests costs one io_uring_enter(2), and no extra thread
+ *             is involved.
+ *   threads   A pool of worker threads that perform blocking system
+ *             calls.  Used when io_uring isn't available.
+ *   sync      Requests are performed at submission time.  The last
+ *             resort, when Gauche is built without threads.
+ *
+ * The context has a file descriptor (Scm_AioContextFd) that becomes
+ * readable when there are completions to collect, so it can be
+ * watched by gauche.selector along with other descriptors.
+ *
+ * GC notes: Requests are kept in the context's inflight list from
+ * staging until collected, so the buffers the kernel or the workers
+ * write into stay alive.  Worker threads never allocate; the Scheme
+ * level result is built by the collecting thread.
+ */
+
+#include "gauche-net.h"
+#include <gauche/class.h>
+#include <string.h>
+
+#if !defined(GAUCHE_WINDOWS)
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#if defined(HAVE_LINUX_IO_URING_H)
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <linux/io_uring.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter) \
+    && defined(IORING_FEAT_RW_CUR_POS)
+#define USE_IO_URING 1
+#endif
+#endif /*HAVE_LINUX_IO_URING_H*/
+
+enum {
+    AIO_BACKEND_URING,
+    AIO_BACKEND_THREADS,
+    AIO_BACKEND_SYNC
+};
+
+#define AIO_DEFAULT_ENTRIES  256
+#define AIO_DEFAULT_THREADS  4
+
+#ifdef USE_IO_URING
+typedef struct aio_ring_rec {
+    int fd;
+    unsigned entries;
+    unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+    unsigned *cqHead, *cqTail, *cqMask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sqPtr, *cqPtr;
+    size_t sqSize, cqSize, sqesSize;
+    unsigned unsubmitted;       /* SQEs written but not entered yet */
+} aio_ring;
+#endif /*USE_IO_URING*/
+
+struct ScmAioContextRec {
+    SCM_HEADER;
+    int backend;
+    int closed;
+    int notifyRead;             /* becomes readable on completion */
+    int notifyWrite;            /* threads/sync: the other end of pipe */
+    ScmAioRequest *inflight;    /* all requests not collected yet */
+    ScmSmallInt ninflight;
+    ScmAioRequest *stagedHead;  /* requests waiting for Scm_AioSubmit */
+    ScmAioRequest *stagedTail;
+#ifdef USE_IO_URING
+    aio_ring ring;
+#endif
+#ifdef GAUCHE_USE_PTHREADS
+    ScmInternalMutex mutex;
+    ScmInternalCond cond;
+    ScmAioRequest *workHead, *workTail; /* for workers */
+    ScmAioRequest *doneHead, *doneTail; /* completed by workers */
+    int nthreads;
+#endif
+};
+
+static ScmObj sym_uring, sym_threads, sym_sync;
+static ScmObj sym_read, sym_write, sym_accept, sym_connect;
+
+static void aio_context_print(ScmObj obj, ScmPort *port, ScmWriteContext *ctx)
+{
+    ScmAioContext *c = SCM_AIO_CONTEXT(obj);
+    Scm_Printf(port, "#<aio-context %S%s %ld>",
+               Scm_AioContextBackend(c), c->closed? " (closed)" : "",
+               c->ninflight);
+}
+
+SCM_DEFINE_BUILTIN_CLASS_SIMPLE(Scm_AioContextClass, aio_context_print);
+
+static void aio_request_print(ScmObj obj, ScmPort *port, ScmWriteContext *ctx)
+{
+    ScmAioRequest *r = SCM_AIO_REQUEST(obj);
+    static const char *states[] = { "staged", "submitted", "done" };
+    Scm_Printf(port, "#<aio-request %S %S %s>",
+               Scm_AioRequestOp(r), r->target, states[r->state]);
+}
+
+SCM_DEFINE_BUILTIN_CLASS_SIMPLE(Scm_AioRequestClass, aio_request_print);
+
+ScmObj Scm_AioContextBackend(ScmAioContext *c)
+{
+    switch (c->backend) {
+    case AIO_BACKEND_URING:   return sym_uring;
+    case AIO_BACKEND_THREADS: return sym_threads;
+    default:                  return sym_sync;
+    }
+}
+
+ScmObj Scm_AioRequestOp(ScmAioRequest *r)
+{
+    switch (r->op) {
+    case SCM_AIO_READ:   return sym_read;
+    case SCM_AIO_WRITE:  return sym_write;
+    case SCM_AIO_ACCEPT: return sym_accept;
+    default:             return sym_connect;
+    }
+}
+
+int Scm_AioContextFd(ScmAioContext *c)
+{
+    if (c->closed) Scm_Error("aio context already closed: %S", SCM_OBJ(c));
+    return c->notifyRead;
+}
+
+/*==================================================================
+ * Performing a request synchronously (threads and sync backends)
+ */
+
+/* Called without VM (in worker threads), so it must not allocate nor
+   raise errors.  We can't use SCM_SYSCALL either, for it checks
+   signals. */
+static void aio_perform(ScmAioRequest *r)
+{
+    long n;
+    do {
+        switch (r->op) {
+        case SCM_AIO_READ:
+            if (r->offset < 0) n = read(r->fd, r->ptr, r->size);
+            else               n = pread(r->fd, r->ptr, r->size, r->offset);
+            break;
+        case SCM_AIO_WRITE:
+            if (r->offset < 0) n = write(r->fd, r->ptr, r->size);
+            else               n = pwrite(r->fd, r->ptr, r->size, r->offset);
+            break;
+        case SCM_AIO_ACCEPT:
+            r->addrlen = sizeof(r->addrbuf);
+            n = accept(r->fd, (struct sockaddr*)&r->addrbuf, &r->addrlen);
+            break;
+        default:
+            n = connect(r->fd, &SCM_SOCKADDR(r->buf)->addr,
+                        SCM_SOCKADDR(r->buf)->addrlen);
+            break;
+        }
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) {
+        r->rawResult = -1;
+        r->error = errno;
+    } else {
+        r->rawResult = n;
+        r->error = 0;
+    }
+}
+
+static void aio_notify(ScmAioContext *c)
+{
+    char b = 0;
+    int r;
+    do {
+        r = (int)write(c->notifyWrite, &b, 1);
+    } while (r < 0 && errno == EINTR);
+    /* EAGAIN means the pipe is full, i.e. there are plenty of
+       notifications already pending.  Nothing to do. */
+}
+
+static void aio_drain_notify(ScmAioContext *c)
+{
+    char buf[256];
+    int r;
+    do {
+        r = (int)read(c->notifyRead, buf, sizeof(buf));
+    } while (r > 0 || (r < 0 && errno == EINTR));
+}
+
+#ifdef GAUCHE_USE_PTHREADS
+static void *aio_worker(void *data)
+{
+    ScmAioContext *c = (ScmAioContext*)data;
+    for (;;) {
+        (void)SCM_INTERNAL_MUTEX_LOCK(c->mutex);
+        while (c->workHead == NULL && !c->closed) {
+            (void)SCM_INTERNAL_COND_WAIT(c->cond, c->mutex);
+        }
+        if (c->closed) {
+            /* The last one to exit releases the notification pipe. */
+            if (--c->nthreads == 0) {
+                close(c->notifyRead);
+                close(c->notifyWrite);
+            }
+            (void)SCM_INTERNAL_MUTEX_UNLOCK(c->mutex);
+            break;
+        }
+        ScmAioRequest *r = c->workHead;
+        c->workHead = r->qnext;
+        if (c->workHead == NULL) c->workTail = NULL;
+        r->qnext = NULL;
+        (void)SCM_INTERNAL_MUTEX_UNLOCK(c->mutex);
+
+        aio_perform(r);
+
+        (void)SCM_INTERNAL_MUTEX_LOCK(c->mutex);
+        if (c->doneTail) c->doneTail->qnext = r;
+        else c->doneHead = r;
+        c->doneTail = r;
+        (void)SCM_INTERNAL_MUTEX_UNLOCK(c->mutex);
+        aio_notify(c);
+    }
+    return NULL;
+}
+
+static int aio_start_workers(ScmAioContext *c, int nthreads)
+{
+    (void)SCM_INTERNAL_MUTEX_INIT(c->mutex);
+    (void)SCM_INTERNAL_COND_INIT(c->cond);
+    c->workHead = c->workTail = c->doneHead = c->doneTail = NULL;
+    c->nthreads = 0;
+    for (int i=0; i<nthreads; i++) {
+        pthread_t th;
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        /* NB: pthread_create is redirected to GC's version, so the
+           worker's stack, which holds live requests, is scanned. */
+        int e = pthread_create(&th, &attr, aio_worker, c);
+        pthread_attr_destroy(&attr);
+        if (e != 0) break;
+        c->nthreads++;
+    }
+    return c->nthreads > 0;
+}
+#endif /*GAUCHE_USE_PTHREADS*/
+
+/*==================================================================
+ * io_uring backend
+ */
+
+#ifdef USE_IO_URING
+
+static int ring_setup(aio_ring *ring, unsigned entries)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (fd < 0) return FALSE;
+    /* We rely on IORING_OP_READ/WRITE/ACCEPT/CONNECT, which came with
+       the kernel that introduced IORING_FEAT_RW_CUR_POS. */
+    if (!(params.features & IORING_FEAT_RW_CUR_POS)) {
+        close(fd);
+        return FALSE;
+    }
+
+    ring->fd = fd;
+    ring->entries = params.sq_entries;
+    ring->sqSize = params.sq_off.array + params.sq_entries*sizeof(unsigned);
+    ring->cqSize = params.cq_off.cqes
+        + params.cq_entries*sizeof(struct io_uring_cqe);
+    int single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single) {
+        if (ring->cqSize > ring->sqSize) ring->sqSize = ring->cqSize;
+        ring->cqSize = ring->sqSize;
+    }
+    ring->sqPtr = mmap(NULL, ring->sqSize, PROT_READ|PROT_WRITE,
+                       MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (ring->sqPtr == MAP_FAILED) goto fail0;
+    if (single) {
+        ring->cqPtr = ring->sqPtr;
+    } else {
+        ring->cqPtr = mmap(NULL, ring->cqSize, PROT_READ|PROT_WRITE,
+                           MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (ring->cqPtr == MAP_FAILED) goto fail1;
+    }
+    ring->sqesSize = params.sq_entries*sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqesSize, PROT_READ|PROT_WRITE,
+                      MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) goto fail2;
+
+    char *sq = (char*)ring->sqPtr, *cq = (char*)ring->cqPtr;
+    ring->sqHead  = (unsigned*)(sq + params.sq_off.head);
+    ring->sqTail  = (unsigned*)(sq + params.sq_off.tail);
+    ring->sqMask  = (unsigned*)(sq + params.sq_off.ring_mask);
+    ring->sqArray = (unsigned*)(sq + params.sq_off.array);
+    ring->cqHead  = (unsigned*)(cq + params.cq_off.head);
+    ring->cqTail  = (unsigned*)(cq + params.cq_off.tail);
+    ring->cqMask  = (unsigned*)(cq + params.cq_off.ring_mask);
+    ring->cqes    = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+    ring->unsubmitted = 0;
+    return TRUE;
+
+  fail2:
+    if (!single) munmap(ring->cqPtr, ring->cqSize);
+  fail1:
+    munmap(ring->sqPtr, ring->sqSize);
+  fail0:
+    close(fd);
+    return FALSE;
+}
+
+static void ring_teardown(aio_ring *ring)
+{
+    munmap(ring->sqes, ring->sqesSize);
+    if (ring->cqPtr != ring->sqPtr) munmap(ring->cqPtr, ring->cqSize);
+    munmap(ring->sqPtr, ring->sqSize);
+    close(ring->fd);
+    ring->fd = -1;
+}
+
+/* Hands the written SQEs to the kernel. */
+static void ring_enter(aio_ring *ring)
+{
+    while (ring->unsubmitted > 0) {
+        int r;
+        SCM_SYSCALL(r, (int)syscall(__NR_io_uring_enter, ring->fd,
+                                    ring->unsubmitted, 0, 0, NULL, 0));
+        if (r < 0) Scm_SysError("io_uring_enter failed");
+        ring->unsubmitted -= r;
+    }
+}
+
+static void ring_push(aio_ring *ring, ScmAioRequest *r)
+{
+    unsigned tail = *ring->sqTail;
+    unsigned head = __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE);
+    if (tail - head >= ring->entries) {
+        /* SQ is full.  Without SQPOLL the kernel consumes the entries
+           on entering, so this makes room. */
+        ring_enter(ring);
+        head = __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE);
+        if (tail - head >= ring->entries) {
+            Scm_Error("io_uring submission queue overflow");
+        }
+    }
+    unsigned idx = tail & *ring->sqMask;
+    struct io_uring_sqe *sqe = &ring->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->fd = r->fd;
+    sqe->user_data = (uint64_t)(intptr_t)r;
+    switch (r->op) {
+    case SCM_AIO_READ:
+    case SCM_AIO_WRITE:
+        sqe->opcode = (r->op == SCM_AIO_READ)? IORING_OP_READ : IORING_OP_WRITE;
+        sqe->addr = (uint64_t)(intptr_t)r->ptr;
+        sqe->len = (uint32_t)r->size;
+        sqe->off = (uint64_t)r->offset; /* -1 for the current position */
+        break;
+    case SCM_AIO_ACCEPT:
+        r->addrlen = sizeof(r->addrbuf);
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->addr = (uint64_t)(intptr_t)&r->addrbuf;
+        sqe->addr2 = (uint64_t)(intptr_t)&r->addrlen;
+        break;
+    default:
+        sqe->opcode = IORING_OP_CONNECT;
+        sqe->addr = (uint64_t)(intptr_t)&SCM_SOCKADDR(r->buf)->addr;
+        sqe->off = (uint64_t)SCM_SOCKADDR(r->buf)->addrlen;
+        break;
+    }
+    ring->sqArray[idx] = idx;
+    __atomic_store_n(ring->sqTail, tail+1, __ATOMIC_RELEASE);
+    ring->unsubmitted++;
+}
+
+/* Moves completed requests to the list H/T. */
+static void ring_reap(aio_ring *ring, ScmAioRequest **h, ScmAioRequest **t)
+{
+    unsigned head = *ring->cqHead;
+    unsigned tail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+        struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cqMask];
+        ScmAioRequest *r = (ScmAioRequest*)(intptr_t)cqe->user_data;
+        if (cqe->res < 0) {
+            r->rawResult = -1;
+            r->error = -cqe->res;
+        } else {
+            r->rawResult = cqe->res;
+            r->error = 0;
+        }
+        r->qnext = NULL;
+        if (*t) (*t)->qnext = r;
+        else *h = r;
+        *t = r;
+        head++;
+    }
+    __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+}
+
+#endif /*USE_IO_URING*/
+
+/*==================================================================
+ * Context
+ */
+
+static void aio_context_finalize(ScmObj obj, void *data)
+{
+    Scm_AioContextClose(SCM_AIO_CONTEXT(obj));
+}
+
+static int make_notify_pipe(ScmAioContext *c)
+{
+    int fds[2];
+    if (pipe(fds) < 0) return FALSE;
+    for (int i=0; i<2; i++) {
+        int flags = fcntl(fds[i], F_GETFL, 0);
+        (void)fcntl(fds[i], F_SETFL, flags|O_NONBLOCK);
+        (void)fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+    }
+    c->notifyRead = fds[0];
+    c->notifyWrite = fds[1];
+    return TRUE;
+}
+
+/* BACKEND is #f (pick the best available), or one of the symbols
+   io-uring, threads or sync.  ENTRIES is the size of the io_uring
+   submission queue, and NTHREADS the number of workers. */
+ScmObj Scm_MakeAioContext(ScmObj backend, int entries, int nthreads)
+{
+    if (entries <= 0) entries = AIO_DEFAULT_ENTRIES;
+    if (nthreads <= 0) nthreads = AIO_DEFAULT_THREADS;
+    if (!SCM_FALSEP(backend) && !SCM_EQ(backend, sym_uring)
+        && !SCM_EQ(backend, sym_threads) && !SCM_EQ(backend, sym_sync)) {
+        Scm_Error("aio backend must be #f, io-uring, threads or sync,"
+                  " but got %S", backend);
+    }
+
+    ScmAioContext *c = SCM_NEW(ScmAioContext);
+    SCM_SET_CLASS(c, SCM_CLASS_AIO_CONTEXT);
+    c->closed = FALSE;
+    c->inflight = NULL;
+    c->ninflight = 0;
+    c->stagedHead = c->stagedTail = NULL;
+    c->notifyRead = c->notifyWrite = -1;
+
+#ifdef USE_IO_URING
+    if (SCM_FALSEP(backend) || SCM_EQ(backend, sym_uring)) {
+        if (ring_setup(&c->ring, (unsigned)entries)) {
+            c->backend = AIO_BACKEND_URING;
+            c->notifyRead = c->ring.fd; /* readable when CQ has entries */
+            goto done;
+        }
+        if (!SCM_FALSEP(backend)) {
+            Scm_SysError("io_uring setup failed");
+        }
+    }
+#endif /*USE_IO_URING*/
+    if (SCM_EQ(backend, sym_uring)) {
+        Scm_Error("io_uring isn't supported on this platform");
+    }
+    if (!make_notify_pipe(c)) {
+        Scm_SysError("couldn't create notification pipe");
+    }
+#ifdef GAUCHE_USE_PTHREADS
+    if (!SCM_EQ(backend, sym_sync)) {
+        if (aio_start_workers(c, nthreads)) {
+            c->backend = AIO_BACKEND_THREADS;
+            goto done;
+        }
+        if (!SCM_FALSEP(backend)) {
+            Scm_Error("couldn't start aio worker threads");
+        }
+    }
+#else  /*!GAUCHE_USE_PTHREADS*/
+    if (SCM_EQ(backend, sym_threads)) {
+        Scm_Error("threads aio backend isn't supported on this platform");
+    }
+#endif /*!GAUCHE_USE_PTHREADS*/
+    c->backend = AIO_BACKEND_SYNC;
+  done:
+    Scm_RegisterFinalizer(SCM_OBJ(c), aio_context_finalize, NULL);
+    return SCM_OBJ(c);
+}
+
+/* Closing a context abandons the requests in flight; the results of
+   those being processed are discarded.  With io_uring, closing the
+   ring cancels them. */
+ScmObj Scm_AioContextClose(ScmAioContext *c)
+{
+    if (c->closed) return SCM_FALSE;
+#ifdef GAUCHE_USE_PTHREADS
+    if (c->backend == AIO_BACKEND_THREADS) {
+        (void)SCM_INTERNAL_MUTEX_LOCK(c->mutex);
+        c->closed = TRUE;
+        (void)SCM_INTERNAL_COND_BROADCAST(c->cond);
+        (void)SCM_INTERNAL_MUTEX_UNLOCK(c->mutex);
+        /* Workers in the middle of a request may still touch the
+           notification pipe, so the last exiting worker closes it. */
+        Scm_UnregisterFinalizer(SCM_OBJ(c));
+        c->inflight = NULL;
+        c->stagedHead = c->stagedTail = NULL;
+        c->ninflight = 0;
+        return SCM_TRUE;
+    }
+#endif /*GAUCHE_USE_PTHREADS*/
+    c->closed = TRUE;
+#ifdef USE_IO_URING
+    if (c->backend == AIO_BACKEND_URING) {
+        ring_teardown(&c->ring);
+        c->notifyRead = -1;
+    }
+#endif /*USE_IO_URING*/
+    if (c->notifyWrite >= 0) {
+        close(c->notifyRead);
+        close(c->notifyWrite);
+        c->notifyRead = c->notifyWrite = -1;
+    }
+    c->inflight = NULL;
+    c->stagedHead = c->stagedTail = NULL;
+    c->ninflight = 0;
+    Scm_UnregisterFinalizer(SCM_OBJ(c));
+    return SCM_TRUE;
+}
+
+/*==================================================================
+ * Requests
+ */
+
+static Socket target_fd(ScmObj target)
+{
+    if (SCM_SOCKETP(target)) {
+        Socket fd = SCM_SOCKET(target)->fd;
+        if (SOCKET_CLOSED(fd)) {
+            Scm_Error("attempt to use a closed socket: %S", target);
+        }
+        return fd;
+    }
+    if (SCM_PORTP(target)) {
+        int fd = Scm_PortFileNo(SCM_PORT(target));
+        if (fd < 0) {
+            Scm_Error("port doesn't have a file descriptor: %S", target);
+        }
+        return fd;
+    }
+    if (SCM_INTP(target) && SCM_INT_VALUE(target) >= 0) {
+        return (Socket)SCM_INT_VALUE(target);
+    }
+    Scm_TypeError("target", "socket, port or file descriptor", target);
+    return INVALID_SOCKET;      /* dummy */
+}
+
+static ScmAioRequest *make_request(ScmAioContext *c, int op, ScmObj target,
+                                   ScmObj tag)
+{
+    if (c->closed) Scm_Error("aio context already closed: %S", SCM_OBJ(c));
+    ScmAioRequest *r = SCM_NEW(ScmAioRequest);
+    SCM_SET_CLASS(r, SCM_CLASS_AIO_REQUEST);
+    r->op = op;
+    r->state = SCM_AIO_STAGED;
+    r->fd = target_fd(target);
+    r->target = target;
+    r->buf = SCM_FALSE;
+    r->tag = tag;
+    r->ptr = NULL;
+    r->size = 0;
+    r->offset = -1;
+    r->result = SCM_FALSE;
+    r->error = 0;
+    r->rawResult = 0;
+    r->addrlen = 0;
+    r->qnext = NULL;
+    return r;
+}
+
+static ScmObj stage_request(ScmAioContext *c, ScmAioRequest *r)
+{
+    /* link to inflight */
+    r->prev = NULL;
+    r->next = c->inflight;
+    if (c->inflight) c->inflight->prev = r;
+    c->inflight = r;
+    c->ninflight++;
+#ifdef USE_IO_URING
+    if (c->backend == AIO_BACKEND_URING) {
+        ring_push(&c->ring, r);
+        return SCM_OBJ(r);
+    }
+#endif /*USE_IO_URING*/
+    if (c->stagedTail) c->stagedTail->qnext = r;
+    else c->stagedHead = r;
+    c->stagedTail = r;
+    return SCM_OBJ(r);
+}
+
+static ScmObj buffer_request(ScmAioContext *c, int op, ScmObj target,
+                             ScmUVector *buf, ScmObj offset, ScmObj tag)
+{
+    ScmAioRequest *r = make_request(c, op, target, tag);
+    if (op == SCM_AIO_READ) SCM_UVECTOR_CHECK_MUTABLE(buf);
+    r->buf = SCM_OBJ(buf);
+    r->ptr = SCM_UVECTOR_ELEMENTS(buf);
+    r->size = Scm_UVectorSizeInBytes(buf);
+    if (!SCM_FALSEP(offset)) {
+        r->offset = Scm_IntegerToOffset(offset);
+        if (r->offset < 0) {
+            Scm_Error("offset must be a nonnegative integer or #f,"
+                      " but got %S", offset);
+        }
+    }
+    return stage_request(c, r);
+}
+
+ScmObj Scm_AioRead(ScmAioContext *c, ScmObj target, ScmUVector *buf,
+                   ScmObj offset, ScmObj tag)
+{
+    return buffer_request(c, SCM_AIO_READ, target, buf, offset, tag);
+}
+
+ScmObj Scm_AioWrite(ScmAioContext *c, ScmObj target, ScmUVector *buf,
+                    ScmObj offset, ScmObj tag)
+{
+    return buffer_request(c, SCM_AIO_WRITE, target, buf, offset, tag);
+}
+
+ScmObj Scm_AioAccept(ScmAioContext *c, ScmSocket *sock, ScmObj tag)
+{
+    return stage_request(c, make_request(c, SCM_AIO_ACCEPT, SCM_OBJ(sock),
+                                         tag));
+}
+
+ScmObj Scm_AioConnect(ScmAioContext *c, ScmSocket *sock, ScmSockAddr *addr,
+                      ScmObj tag)
+{
+    ScmAioRequest *r = make_request(c, SCM_AIO_CONNECT, SCM_OBJ(sock), tag);
+    r->buf = SCM_OBJ(addr);
+    return stage_request(c, r);
+}
+
+/* Hands the staged requests to the backend.  Returns the number of
+   requests in flight. */
+ScmSmallInt Scm_AioSubmit(ScmAioContext *c)
+{
+    if (c->closed) Scm_Error("aio context already closed: %S", SCM_OBJ(c));
+    switch (c->backend) {
+#ifdef USE_IO_URING
+    case AIO_BACKEND_URING:
+        ring_enter(&c->ring);
+        break;
+#endif /*USE_IO_URING*/
+#ifdef GAUCHE_USE_PTHREADS
+    case AIO_BACKEND_THREADS:
+        if (c->stagedHead) {
+            (void)SCM_INTERNAL_MUTEX_LOCK(c->mutex);
+            if (c->workTail) c->workTail->qnext = c->stagedHead;
+            else c->workHead = c->stagedHead;
+            c->workTail = c->stagedTail;
+            (void)SCM_INTERNAL_COND_BROADCAST(c->cond);
+            (void)SCM_INTERNAL_MUTEX_UNLOCK(c->mutex);
+        }
+        break;
+#endif /*GAUCHE_USE_PTHREADS*/
+    default:
+        /* Sync backend.  Performed requests stay in the staged list,
+           which Scm_AioWait collects. */
+        if (c->stagedHead) {
+            for (ScmAioRequest *r = c->stagedHead; r; r = r->qnext) {
+                if (r->state == SCM_AIO_STAGED) {
+                    aio_perform(r);
+                    r->state = SCM_AIO_SUBMITTED;
+                }
+            }
+            aio_notify(c);
+        }
+        return c->ninflight;
+    }
+    for (ScmAioRequest *r = c->stagedHead; r; r = r->qnext) {
+        r->state = SCM_AIO_SUBMITTED;
+    }
+    c->stagedHead = c->stagedTail = NULL;
+#ifdef USE_IO_URING
+    if (c->backend == AIO_BACKEND_URING) {
+        for (ScmAioRequest *r = c->inflight; r; r = r->next) {
+            if (r->state == SCM_AIO_STAGED) r->state = SCM_AIO_SUBMITTED;
+            else break;         /* earlier ones are already submitted */
+        }
+    }
+#endif /*USE_IO_URING*/
+    return c->ninflight;
+}
+
+/* Builds the Scheme level result of a completed request. */
+static void finish_request(ScmAioContext *c, ScmAioRequest *r)
+{
+    if (r->prev) r->prev->next = r->next;
+    else c->inflight = r->next;
+    if (r->next) r->next->prev = r->prev;
+    r->prev = r->next = NULL;
+    r->qnext = NULL;
+    c->ninflight--;
+    r->state = SCM_AIO_DONE;
+
+    if (r->error) {
+        r->result = SCM_FALSE;
+        return;
+    }
+    switch (r->op) {
+    case SCM_AIO_READ:
+    case SCM_AIO_WRITE:
+        r->result = Scm_MakeInteger(r->rawResult);
+        break;
+    case SCM_AIO_ACCEPT: {
+        ScmSocket *sock = SCM_SOCKET(r->target);
+        ScmSocket *newsock = make_socket((Socket)r->rawResult, sock->type);
+        ScmClass *addrClass = Scm_ClassOf(SCM_OBJ(sock->address));
+        newsock->address =
+            SCM_SOCKADDR(Scm_MakeSockAddr(addrClass,
+                                          (struct sockaddr*)&r->addrbuf,
+                                          r->addrlen));
+        newsock->status = SCM_SOCKET_STATUS_CONNECTED;
+        r->result = SCM_OBJ(newsock);
+        break;
+    }
+    default: {
+        ScmSocket *sock = SCM_SOCKET(r->target);
+        sock->address = SCM_SOCKADDR(r->buf);
+        sock->status = SCM_SOCKET_STATUS_CONNECTED;
+        r->result = SCM_OBJ(sock);
+        break;
+    }
+    }
+}
+
+/* Collects completed requests without blocking. */
+static ScmObj aio_collect(ScmAioContext *c)
+{
+    ScmAioRequest *h = NULL, *t = NULL;
+    ScmObj rh = SCM_NIL, rt = SCM_NIL;
+
+    switch (c->backend) {
+#ifdef USE_IO_URING
+    case AIO_BACKEND_URING:
+        ring_reap(&c->ring, &h, &t);
+        break;
+#endif /*USE_IO_URING*/
+#ifdef GAUCHE_USE_PTHREADS
+    case AIO_BACKEND_THREADS:
+        aio_drain_notify(c);
+        (void)SCM_INTERNAL_MUTEX_LOCK(c->mutex);
+        h = c->doneHead;
+        c->doneHead = c->doneTail = NULL;
+        (void)SCM_INTERNAL_MUTEX_UNLOCK(c->mutex);
+        break;
+#endif /*GAUCHE_USE_PTHREADS*/
+    default:
+        aio_drain_notify(c);
+        /* Take performed requests from the staged list, keeping the
+           ones that aren't submitted yet. */
+        {
+            ScmAioRequest *keepH = NULL, *keepT = NULL, *r, *next;
+            for (r = c->stagedHead; r; r = next) {
+                next = r->qnext;
+                r->qnext = NULL;
+                if (r->state == SCM_AIO_SUBMITTED) {
+                    if (t) t->qnext = r; else h = r;
+                    t = r;
+                } else {
+                    if (keepT) keepT->qnext = r; else keepH = r;
+                    keepT = r;
+                }
+            }
+            c->stagedHead = keepH;
+            c->stagedTail = keepT;
+        }
+        break;
+    }
+
+    for (ScmAioRequest *r = h, *next; r; r = next) {
+        next = r->qnext;
+        finish_request(c, r);
+        SCM_APPEND1(rh, rt, SCM_OBJ(r));
+    }
+    return rh;
+}
+
+/* Returns timeout in milliseconds, or -1 for no timeout.  TIMEOUT is
+   interpreted as in sys-select. */
+static long aio_timeout_ms(ScmObj timeout)
+{
+    if (SCM_FALSEP(timeout)) return -1;
+    if (SCM_REALP(timeout)) {
+        double usec = Scm_GetDouble(timeout);
+        if (usec >= 0) return (long)((usec + 999)/1000);
+    } else if (SCM_PAIRP(timeout) && SCM_PAIRP(SCM_CDR(timeout))
+               && Scm_IntegerP(SCM_CAR(timeout))
+               && Scm_IntegerP(SCM_CADR(timeout))) {
+        long sec = Scm_GetInteger(SCM_CAR(timeout));
+        long usec = Scm_GetInteger(SCM_CADR(timeout));
+        if (sec >= 0 && usec >= 0) return sec*1000 + (usec + 999)/1000;
+    }
+    Scm_Error("timeout needs to be a real number (in microseconds) or a"
+              " list of two integers (seconds and microseconds),"
+              " but got %S", timeout);
+    return -1;                  /* dummy */
+}
+
+/* Submits staged requests, then waits until at least MINCOMPLETE
+   requests are completed or TIMEOUT expires.  Returns a list of
+   completed requests, in the order of completion. */
+ScmObj Scm_AioWait(ScmAioContext *c, int mincomplete, ScmObj timeout)
+{
+    long timeout_ms = aio_timeout_ms(timeout);
+    u_long start_sec, start_usec;
+
+    Scm_AioSubmit(c);
+    ScmObj h = aio_collect(c), t = Scm_LastPair(h);
+    ScmSmallInt count = Scm_Length(h);
+    if (mincomplete > count + c->ninflight) {
+        mincomplete = (int)(count + c->ninflight);
+    }
+    if (timeout_ms > 0) Scm_GetTimeOfDay(&start_sec, &start_usec);
+
+    while (count < mincomplete) {
+        struct pollfd pfd;
+        int r;
+        long wait_ms = timeout_ms;
+        if (timeout_ms > 0) {
+            u_long sec, usec;
+            Scm_GetTimeOfDay(&sec, &usec);
+            long elapsed = (long)((sec - start_sec)*1000)
+                + ((long)usec - (long)start_usec)/1000;
+            wait_ms = timeout_ms - elapsed;
+            if (wait_ms < 0) wait_ms = 0;
+        }
+        pfd.fd = c->notifyRead;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        SCM_SYSCALL(r, poll(&pfd, 1, (int)wait_ms));
+        if (r < 0) Scm_SysError("poll failed");
+        ScmObj z = aio_collect(c);
+        if (SCM_PAIRP(z)) {
+            count += Scm_Length(z);
+            if (SCM_NULLP(h)) h = z;
+            else SCM_SET_CDR(t, z);
+            t = Scm_LastPair(z);
+        } else if (r == 0) {
+            break;              /* timed out */
+        }
+    }
+    return h;
+}
+
+/*==================================================================
+ * Initialization
+ */
+
+void Scm_Init_NetAio(ScmModule *mod)
+{
+    sym_uring   = SCM_INTERN("io-uring");
+    sym_threads = SCM_INTERN("threads");
+    sym_sync    = SCM_INTERN("sync");
+    sym_read    = SCM_INTERN("read");
+    sym_write   = SCM_INTERN("write");
+    sym_accept  = SCM_INTERN("accept");
+    sym_connect = SCM_INTERN("connect");
+    Scm_InitStaticClass(&Scm_AioContextClass, "<aio-context>", mod, NULL, 0);
+    Scm_InitStaticClass(&Scm_AioRequestClass, "<aio-request>", mod, NULL, 0);
+    Scm_AddFeature("gauche.net.aio", NULL);
+}
+
+#else  /*GAUCHE_WINDOWS*/
+
+void Scm_Init_NetAio(ScmModule *mod)
+{
+    /* Not supported on Windows yet. */
+}
+
+#endif /*GAUCHE_WINDOWS*/
@@ -245,9 +245,16 @@ extern ScmObj Scm_SocketClose(ScmSocket *s);
 
 extern ScmObj Scm_SocketInputPort(ScmSocket *s, int buffered);
 extern ScmObj Scm_SocketOutputPort(ScmSocket *s, int buffered);
+extern ScmObj Scm_SocketInputPortFull(ScmSocket *s, int buffered,
+                                      int bufsize);
+extern ScmObj Scm_SocketOutputPortFull(ScmSocket *s, int buffered,
+                                       int bufsize);
 
 extern ScmObj Scm_SocketBind(ScmSocket *s, ScmSockAddr *addr);
 extern ScmObj Scm_SocketConnect(ScmSocket *s, ScmSockAddr *addr);
+#if !defined(GAUCHE_WINDOWS)
+extern ScmObj Scm_SocketConnectAny(ScmObj addrs, long delay);
+#endif
 extern ScmObj Scm_SocketListen(ScmSocket *s, int backlog);
 extern ScmObj Scm_SocketAccept(ScmSocket *s);
 
@@ -257,11 +264,17 @@ extern ScmObj Scm_SocketGetPeerName(ScmSocket *s);
 extern ScmObj Scm_SocketSend(ScmSocket *s, ScmObj msg, int flags);
 extern ScmObj Scm_SocketSendTo(ScmSocket *s, ScmObj msg, ScmSockAddr *to, int flags);
 extern ScmObj Scm_SocketSendMsg(ScmSocket *s, ScmObj msg, int flags);
+extern ScmObj Scm_SocketSendFile(ScmSocket *s, ScmObj src, ScmObj count);
 extern ScmObj Scm_SocketRecv(ScmSocket *s, int bytes, int flags);
 extern ScmObj Scm_SocketRecvX(ScmSocket *s, ScmUVector *buf, int flags);
 extern ScmObj Scm_SocketRecvFrom(ScmSocket *s, int bytes, int flags);
 extern ScmObj Scm_SocketRecvFromX(ScmSocket *s, ScmUVector *buf,
                                   ScmObj addrs, int flags);
+extern ScmObj Scm_SocketRecvMMsgX(ScmSocket *s, ScmVector *bufs,
+                                  ScmU32Vector *lens, ScmObj addrs,
+                                  int flags);
+extern ScmObj Scm_SocketSendMMsg(ScmSocket *s, ScmVector *msgs,
+                                 ScmObj addrs, int flags);
 
 extern ScmObj Scm_SocketBuildMsg(ScmSockAddr *name, ScmVector *iov,
                                  ScmObj control, int flags,
@@ -273,6 +286,87 @@ extern ScmObj Scm_SocketGetOpt(ScmSocket *s, int level,
                                int option, int resulttype);
 extern ScmObj Scm_SocketIoctl(ScmSocket *s, u_long requiest, ScmObj data);
 
+extern ScmObj Scm_PortTransfer(ScmPort *src, ScmPort *dst, ScmObj count);
+
+/* HTTP request head parser (see httphead.c) */
+extern ScmObj Scm_HttpParseRequestHead(ScmUVector *buf, ScmSmallInt start,
+                                       ScmSmallInt end);
+extern ScmObj Scm_HttpFindEol(ScmUVector *buf, ScmSmallInt start,
+                              ScmSmallInt end);
+
+/* make_socket is used by aio.c to wrap accepted descriptors */
+extern ScmSocket *make_socket(Socket fd, int type);
+
+/*==================================================================
+ * Asynchronous I/O  (see aio.c)
+ */
+
+#if !defined(GAUCHE_WINDOWS)
+
+typedef struct ScmAioContextRec ScmAioContext; /* opaque */
+
+SCM_CLASS_DECL(Scm_AioContextClass);
+#define SCM_CLASS_AIO_CONTEXT   (&Scm_AioContextClass)
+#define SCM_AIO_CONTEXT(obj)    ((ScmAioContext*)obj)
+#define SCM_AIO_CONTEXT_P(obj)  SCM_XTYPEP(obj, SCM_CLASS_AIO_CONTEXT)
+
+enum {
+    SCM_AIO_READ,
+    SCM_AIO_WRITE,
+    SCM_AIO_ACCEPT,
+    SCM_AIO_CONNECT
+};
+
+enum {
+    SCM_AIO_STAGED,             /* not handed to the backend yet */
+    SCM_AIO_SUBMITTED,          /* in flight */
+    SCM_AIO_DONE                /* completed and collected */
+};
+
+typedef struct ScmAioRequestRec {
+    SCM_HEADER;
+    int op;
+    int state;
+    Socket fd;
+    ScmObj target;              /* socket, port or fd given by the caller */
+    ScmObj buf;                 /* uvector for read/write, sockaddr for
+                                   connect */
+    ScmObj tag;                 /* client data */
+    void *ptr;                  /* read/write: buffer and its size */
+    size_t size;
+    off_t offset;               /* read/write: -1 for the current position */
+    ScmObj result;              /* valid when done */
+    int error;                  /* errno, 0 on success */
+    long rawResult;             /* filled by the backend */
+    struct sockaddr_storage addrbuf; /* accept: peer address */
+    socklen_t addrlen;
+    struct ScmAioRequestRec *prev, *next; /* context's inflight list */
+    struct ScmAioRequestRec *qnext;       /* backend queues */
+} ScmAioRequest;
+
+SCM_CLASS_DECL(Scm_AioRequestClass);
+#define SCM_CLASS_AIO_REQUEST   (&Scm_AioRequestClass)
+#define SCM_AIO_REQUEST(obj)    ((ScmAioRequest*)obj)
+#define SCM_AIO_REQUEST_P(obj)  SCM_XTYPEP(obj, SCM_CLASS_AIO_REQUEST)
+
+extern ScmObj Scm_MakeAioContext(ScmObj backend, int entries, int nthreads);
+extern ScmObj Scm_AioContextBackend(ScmAioContext *c);
+extern int    Scm_AioContextFd(ScmAioContext *c);
+extern ScmObj Scm_AioContextClose(ScmAioContext *c);
+
+extern ScmObj Scm_AioRead(ScmAioContext *c, ScmObj target, ScmUVector *buf,
+                          ScmObj offset, ScmObj tag);
+extern ScmObj Scm_AioWrite(ScmAioContext *c, ScmObj target, ScmUVector *buf,
+                           ScmObj offset, ScmObj tag);
+extern ScmObj Scm_AioAccept(ScmAioContext *c, ScmSocket *sock, ScmObj tag);
+extern ScmObj Scm_AioConnect(ScmAioContext *c, ScmSocket *sock,
+                             ScmSockAddr *addr, ScmObj tag);
+extern ScmSmallInt Scm_AioSubmit(ScmAioContext *c);
+extern ScmObj Scm_AioWait(ScmAioContext *c, int mincomplete, ScmObj timeout);
+extern ScmObj Scm_AioRequestOp(ScmAioRequest *r);
+
+#endif /*!GAUCHE_WINDOWS*/
+
 /*==================================================================
  * Netdb interface
  */
@@ -362,6 +456,14 @@ extern ScmObj Scm_GetAddrinfo(const char *nodename,
                               struct addrinfo *hints);
 extern ScmObj Scm_GetNameinfo(ScmSockAddr *addr, int flags);
 
+extern ScmObj Scm_ResolverGetAddrinfo(const char *nodename,
+                                      const char *servname,
+                                      struct addrinfo *hints,
+                                      ScmObj timeout);
+extern void   Scm_ResolverFlush(const char *nodename);
+extern ScmObj Scm_ResolverConfigure(double ttl, double negttl,
+                                    int maxEntries, int maxThreads);
+
 #define NI_MAXHOST  1025
 #define NI_MAXSERV    32
 
@@ -0,0 +1,179 @@
+/*
+ * httphead.c - HTTP request head parser
+ *
+ *   Copyright (c) 2001-2015  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * The request line and header fields are parsed directly from the byte
+ * buffer the server receives into, so that the server doesn't need to
+ * go through a port and regexps for every request.  This is what
+ * net.http-server uses; it isn't a public API.
+ */
+
+#include "gauche-net.h"
+#include <string.h>
+#include <ctype.h>
+
+/* RFC7230 tchar */
+static inline int tcharp(unsigned char c)
+{
+    if (c >= '0' && c <= '9') return TRUE;
+    if (c >= 'a' && c <= 'z') return TRUE;
+    if (c >= 'A' && c <= 'Z') return TRUE;
+    return (c != 0 && strchr("!#$%&'*+-.^_`|~", c) != NULL);
+}
+
+static void http_bad_request(const char *what)
+{
+    Scm_Error("malformed HTTP request: %s", what);
+}
+
+/* Returns a pointer to the LF that ends the line starting at P, or NULL. */
+static inline const unsigned char *find_lf(const unsigned char *p,
+                                           const unsigned char *end)
+{
+    return (const unsigned char*)memchr(p, '\n', end - p);
+}
+
+/* Strips the trailing CR of the line [P, E). */
+static inline const unsigned char *chop_cr(const unsigned char *p,
+                                           const unsigned char *e)
+{
+    return (e > p && e[-1] == '\r') ? e - 1 : e;
+}
+
+static inline ScmObj make_str(const unsigned char *p, const unsigned char *e)
+{
+    return Scm_MakeString((const char*)p, (ScmSmallInt)(e - p), -1,
+                          SCM_STRING_COPYING);
+}
+
+static ScmObj make_lower_str(const unsigned char *p, const unsigned char *e)
+{
+    ScmSmallInt len = e - p;
+    char *s = SCM_NEW_ATOMIC2(char*, len + 1);
+    for (ScmSmallInt i = 0; i < len; i++) {
+        unsigned char c = p[i];
+        s[i] = (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+    }
+    s[len] = '\0';
+    return Scm_MakeString(s, len, len, 0);
+}
+
+/*
+ * Parses the request head in BUF[START, END).  If the buffer doesn't
+ * contain the whole head yet, returns #f.  Otherwise returns five values:
+ * the method (symbol), request-uri, http version ("1.1" etc.), a list of
+ * headers in the form of ((name value) ...) with lowercased names,
+ * and the index right after the head.  Malformed request raises an error.
+ */
+ScmObj Scm_HttpParseRequestHead(ScmUVector *buf, ScmSmallInt start,
+                                ScmSmallInt end)
+{
+    ScmSmallInt size = Scm_UVectorSizeInBytes(buf);
+    if (start < 0 || end > size || start > end) {
+        Scm_Error("range out of bound: [%ld, %ld)", start, end);
+    }
+    const unsigned char *base = (const unsigned char*)SCM_UVECTOR_ELEMENTS(buf);
+    const unsigned char *p = base + start, *bend = base + end;
+
+    /* RFC7230 3.5: ignore at least one empty line before the request. */
+    while (p < bend && (*p == '\r' || *p == '\n')) p++;
+
+    /* First, make sure we have the whole head. */
+    const unsigned char *q = p, *lf;
+    for (;;) {
+        if ((lf = find_lf(q, bend)) == NULL) return SCM_FALSE;
+        if (chop_cr(q, lf) == q && q != p) break;  /* empty line */
+        q = lf + 1;
+    }
+    const unsigned char *head_end = lf + 1;
+
+    /* Request line */
+    lf = find_lf(p, bend);
+    const unsigned char *le = chop_cr(p, lf), *s = p;
+    while (s < le && tcharp(*s)) s++;
+    if (s == p || s == le || *s != ' ') http_bad_request("method");
+    ScmObj method = Scm_MakeSymbol(SCM_STRING(make_str(p, s)), TRUE);
+    const unsigned char *u = ++s;
+    while (s < le && *s > ' ' && *s != 0x7f) s++;
+    if (s == u || s == le || *s != ' ') http_bad_request("request-uri");
+    ScmObj uri = make_str(u, s);
+    s++;
+    if (le - s != 8 || memcmp(s, "HTTP/", 5) != 0
+        || !isdigit(s[5]) || s[6] != '.' || !isdigit(s[7])) {
+        http_bad_request("http version");
+    }
+    ScmObj version = make_str(s + 5, le);
+
+    /* Header fields */
+    ScmObj h = SCM_NIL, t = SCM_NIL, lastval = SCM_FALSE;
+    for (p = lf + 1; p < head_end; p = lf + 1) {
+        lf = find_lf(p, bend);
+        le = chop_cr(p, lf);
+        if (le == p) break;
+        if (*p == ' ' || *p == '\t') {
+            /* obsolete line folding; join with a space */
+            if (SCM_FALSEP(lastval)) http_bad_request("header continuation");
+            while (p < le && (*p == ' ' || *p == '\t')) p++;
+            while (le > p && (le[-1] == ' ' || le[-1] == '\t')) le--;
+            ScmObj v = Scm_StringAppendC(SCM_STRING(SCM_CAR(lastval)),
+                                         " ", 1, 1);
+            v = Scm_StringAppend2(SCM_STRING(v), SCM_STRING(make_str(p, le)));
+            SCM_SET_CAR(lastval, v);
+            continue;
+        }
+        s = p;
+        while (s < le && tcharp(*s)) s++;
+        if (s == p || s == le || *s != ':') http_bad_request("header field");
+        ScmObj name = make_lower_str(p, s);
+        s++;
+        while (s < le && (*s == ' ' || *s == '\t')) s++;
+        while (le > s && (le[-1] == ' ' || le[-1] == '\t')) le--;
+        lastval = SCM_LIST1(make_str(s, le));
+        SCM_APPEND1(h, t, Scm_Cons(name, lastval));
+    }
+
+    return Scm_Values5(method, uri, version, h,
+                       Scm_MakeInteger(head_end - base));
+}
+
+/* Returns the index after the next LF in BUF[START, END), or #f. */
+ScmObj Scm_HttpFindEol(ScmUVector *buf, ScmSmallInt start, ScmSmallInt end)
+{
+    ScmSmallInt size = Scm_UVectorSizeInBytes(buf);
+    if (start < 0 || end > size || start > end) {
+        Scm_Error("range out of bound: [%ld, %ld)", start, end);
+    }
+    const unsigned char *base = (const unsigned char*)SCM_UVECTOR_ELEMENTS(buf);
+    const unsigned char *lf = find_lf(base + start, base + end);
+    return lf ? Scm_MakeInteger(lf + 1 - base) : SCM_FALSE;
+}
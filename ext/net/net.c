@@ -31,9 +31,16 @@
  *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#define _GNU_SOURCE  /* for Linux, this enables splice and copy_file_range */
 #include "gauche-net.h"
 #include <fcntl.h>
 #include <gauche/extend.h>
+#if !defined(GAUCHE_WINDOWS)
+#include <poll.h>
+#endif
+#if defined(HAVE_SYS_SENDFILE_H)
+#include <sys/sendfile.h>
+#endif
 
 /*==================================================================
  * Socket
@@ -172,6 +179,12 @@ static void sockport_err(ScmSocket *sock, const char *io)
 
 
 ScmObj Scm_SocketInputPort(ScmSocket *sock, int buffering)
+{
+    return Scm_SocketInputPortFull(sock, buffering, 0);
+}
+
+/* BUFSIZE only matters when the port is created for the first time. */
+ScmObj Scm_SocketInputPortFull(ScmSocket *sock, int buffering, int bufsize)
 {
     if (sock->inPort == NULL) {
         int infd;
@@ -195,13 +208,21 @@ ScmObj Scm_SocketInputPort(ScmSocket *sock, int buffering)
            pointer to the socket. */
         ScmObj sockname = SCM_LIST2(SCM_MAKE_STR("socket input"),
                                     SCM_OBJ(sock));
-        sock->inPort = SCM_PORT(Scm_MakePortWithFd(sockname, SCM_PORT_INPUT,
-                                                   infd, buffering, FALSE));
+        sock->inPort = SCM_PORT(Scm_MakePortWithFdFull(sockname,
+                                                       SCM_PORT_INPUT, infd,
+                                                       buffering, bufsize,
+                                                       FALSE));
     }
     return SCM_OBJ(sock->inPort);
 }
 
 ScmObj Scm_SocketOutputPort(ScmSocket *sock, int buffering)
+{
+    return Scm_SocketOutputPortFull(sock, buffering, 0);
+}
+
+/* BUFSIZE only matters when the port is created for the first time. */
+ScmObj Scm_SocketOutputPortFull(ScmSocket *sock, int buffering, int bufsize)
 {
     if (sock->outPort == NULL) {
         int outfd;
@@ -225,8 +246,10 @@ ScmObj Scm_SocketOutputPort(ScmSocket *sock, int buffering)
            pointer to the socket. */
         ScmObj sockname = SCM_LIST2(SCM_MAKE_STR("socket output"),
                                     SCM_OBJ(sock));
-        sock->outPort = SCM_PORT(Scm_MakePortWithFd(sockname, SCM_PORT_OUTPUT,
-                                                    outfd, buffering, FALSE));
+        sock->outPort = SCM_PORT(Scm_MakePortWithFdFull(sockname,
+                                                        SCM_PORT_OUTPUT, outfd,
+                                                        buffering, bufsize,
+                                                        FALSE));
     }
     return SCM_OBJ(sock->outPort);
 }
@@ -314,6 +337,165 @@ ScmObj Scm_SocketConnect(ScmSocket *sock, ScmSockAddr *addr)
     return SCM_OBJ(sock);
 }
 
+#if !defined(GAUCHE_WINDOWS)
+/* Connects to one of ADDRS, a list of <sockaddr>s, in the
+   "happy eyeballs" way (RFC 8305): we start a non-blocking connect
+   to the first address, and if it doesn't finish in DELAY milliseconds,
+   we start the next one without abandoning the first, and so on.
+   The first attempt that succeeds wins and the rest are closed.
+   A failed attempt lets the next one start immediately.
+   The caller is supposed to order ADDRS, e.g. alternating families. */
+
+typedef struct {
+    int n;                      /* # of addresses */
+    struct pollfd *fds;         /* in-progress attempts */
+    ScmSockAddr **addrs;        /* corresponding addresses */
+    int nfds;
+} connect_race;
+
+static void connect_race_drop(connect_race *r, int i)
+{
+    closeSocket(r->fds[i].fd);
+    r->nfds--;
+    r->fds[i] = r->fds[r->nfds];
+    r->addrs[i] = r->addrs[r->nfds];
+}
+
+static void connect_race_cleanup(connect_race *r)
+{
+    while (r->nfds > 0) connect_race_drop(r, 0);
+}
+
+static long connect_race_now(void)
+{
+    ScmTimeSpec ts;
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#else
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    ts.tv_sec = tv.tv_sec;
+    ts.tv_nsec = tv.tv_usec * 1000;
+#endif
+    return (long)ts.tv_sec*1000 + ts.tv_nsec/1000000;
+}
+
+/* Starts a connection attempt to ADDR.  Returns the socket if it is
+   connected immediately, INVALID_SOCKET otherwise; in the latter case
+   *ERR is set to the errno on failure, or 0 if it's in progress. */
+static Socket connect_race_start(connect_race *r, ScmSockAddr *addr, int *err)
+{
+    Socket fd = socket(addr->addr.sa_family, SOCK_STREAM, 0);
+    if (SOCKET_INVALID(fd)) { *err = errno; return INVALID_SOCKET; }
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags|O_NONBLOCK) < 0) {
+        *err = errno;
+        closeSocket(fd);
+        return INVALID_SOCKET;
+    }
+    int c;
+    do {
+        c = connect(fd, &addr->addr, addr->addrlen);
+    } while (c < 0 && errno == EINTR);
+    if (c == 0) return fd;
+    if (errno != EINPROGRESS) {
+        *err = errno;
+        closeSocket(fd);
+        return INVALID_SOCKET;
+    }
+    r->fds[r->nfds].fd = fd;
+    r->fds[r->nfds].events = POLLOUT;
+    r->fds[r->nfds].revents = 0;
+    r->addrs[r->nfds] = addr;
+    r->nfds++;
+    *err = 0;
+    return INVALID_SOCKET;
+}
+
+ScmObj Scm_SocketConnectAny(ScmObj addrs, long delay)
+{
+    /* NB: allocated in heap, so that the handler sees the current state
+       after longjmp. */
+    connect_race *r = SCM_NEW(connect_race);
+    r->n = Scm_Length(addrs);
+    if (r->n <= 0) Scm_Error("list of socket addresses required, but got %S",
+                            addrs);
+    r->fds = SCM_NEW_ATOMIC_ARRAY(struct pollfd, r->n);
+    r->addrs = SCM_NEW_ARRAY(ScmSockAddr*, r->n);
+    r->nfds = 0;
+
+    ScmObj cp = addrs;
+    Socket winner = INVALID_SOCKET;
+    ScmSockAddr *winaddr = NULL;
+    int lasterr = ECONNREFUSED;
+    long next_start = connect_race_now();
+
+    SCM_UNWIND_PROTECT {
+        while (winner == INVALID_SOCKET) {
+            long now = connect_race_now();
+            if (SCM_PAIRP(cp) && (r->nfds == 0 || now >= next_start)) {
+                ScmObj a = SCM_CAR(cp);
+                int err;
+                if (!SCM_SOCKADDRP(a)) {
+                    Scm_Error("socket address required, but got %S", a);
+                }
+                cp = SCM_CDR(cp);
+                winner = connect_race_start(r, SCM_SOCKADDR(a), &err);
+                if (winner != INVALID_SOCKET) { winaddr = SCM_SOCKADDR(a); break; }
+                if (err) lasterr = err;
+                next_start = (err? now : now + delay);
+                continue;
+            }
+            if (r->nfds == 0) break; /* all failed */
+
+            int timeout = SCM_PAIRP(cp)? (int)(next_start - now) : -1;
+            int nready = poll(r->fds, r->nfds, timeout);
+            if (nready < 0) {
+                if (errno == EINTR) { Scm_SigCheck(Scm_VM()); continue; }
+                Scm_SysError("poll failed");
+            }
+            for (int i=0; i<r->nfds && nready > 0; ) {
+                if (r->fds[i].revents == 0) { i++; continue; }
+                nready--;
+                int soerr = 0;
+                socklen_t len = sizeof(soerr);
+                if (getsockopt(r->fds[i].fd, SOL_SOCKET, SO_ERROR,
+                               (void*)&soerr, &len) < 0) {
+                    soerr = errno;
+                }
+                if (soerr == 0) {
+                    winner = r->fds[i].fd;
+                    winaddr = r->addrs[i];
+                    r->fds[i].fd = INVALID_SOCKET;
+                    r->nfds--;
+                    r->fds[i] = r->fds[r->nfds];
+                    r->addrs[i] = r->addrs[r->nfds];
+                    break;
+                }
+                lasterr = soerr;
+                connect_race_drop(r, i);
+                next_start = now;  /* start the next one right away */
+            }
+        }
+    } SCM_WHEN_ERROR {
+        connect_race_cleanup(r);
+        SCM_NEXT_HANDLER;
+    } SCM_END_PROTECT;
+    connect_race_cleanup(r);
+
+    if (winner == INVALID_SOCKET) {
+        errno = lasterr;
+        Scm_SysError("connect failed to %S", addrs);
+    }
+    int flags = fcntl(winner, F_GETFL, 0);
+    if (flags >= 0) (void)fcntl(winner, F_SETFL, flags & ~O_NONBLOCK);
+    ScmSocket *sock = make_socket(winner, SOCK_STREAM);
+    sock->address = winaddr;
+    sock->status = SCM_SOCKET_STATUS_CONNECTED;
+    return SCM_OBJ(sock);
+}
+#endif /*!GAUCHE_WINDOWS*/
+
 ScmObj Scm_SocketGetSockName(ScmSocket *sock)
 {
     int r;
@@ -356,11 +538,53 @@ static const char *get_message_body(ScmObj msg, u_int *size)
     }
 }
 
+#define GATHER_MESSAGE_P(msg) \
+    (SCM_LISTP(msg) || SCM_VECTORP(msg))
+
+/* MSG is a list or a vector of strings and uniform vectors.  We pass
+   them to sendmsg(2) as iovecs, instead of concatenating them. */
+static ScmObj socket_send_gather(ScmSocket *sock, ScmObj msg,
+                                 ScmSockAddr *to, int flags)
+{
+#if !GAUCHE_WINDOWS
+    if (SCM_VECTORP(msg)) msg = Scm_VectorToList(SCM_VECTOR(msg), 0, -1);
+    int len = Scm_Length(msg);
+    if (len < 0) Scm_TypeError("socket message", "proper list", msg);
+    struct iovec *iov = SCM_NEW_ARRAY(struct iovec, len > 0 ? len : 1);
+    int i = 0;
+    ScmObj cp;
+    SCM_FOR_EACH(cp, msg) {
+        u_int size;
+        iov[i].iov_base = (void*)get_message_body(SCM_CAR(cp), &size);
+        iov[i].iov_len = size;
+        i++;
+    }
+
+    struct msghdr hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    if (to) {
+        hdr.msg_name = &to->addr;
+        hdr.msg_namelen = to->addrlen;
+    }
+    hdr.msg_iov = iov;
+    hdr.msg_iovlen = len;
+
+    int r;
+    SCM_SYSCALL(r, sendmsg(sock->fd, &hdr, flags));
+    if (r < 0) Scm_SysError("sendmsg(2) failed");
+    return SCM_MAKE_INT(r);
+#else  /*GAUCHE_WINDOWS*/
+    Scm_Error("sending multiple chunks is not implemented on this platform.");
+    return SCM_UNDEFINED;       /* dummy */
+#endif /*GAUCHE_WINDOWS*/
+}
+
 ScmObj Scm_SocketSend(ScmSocket *sock, ScmObj msg, int flags)
 {
     int r;
     u_int size;
     CLOSE_CHECK(sock->fd, "send to", sock);
+    if (GATHER_MESSAGE_P(msg)) return socket_send_gather(sock, msg, NULL, flags);
     const char *cmsg = get_message_body(msg, &size);
     SCM_SYSCALL(r, send(sock->fd, cmsg, size, flags));
     if (r < 0) Scm_SysError("send(2) failed");
@@ -373,6 +597,7 @@ ScmObj Scm_SocketSendTo(ScmSocket *sock, ScmObj msg, ScmSockAddr *to,
     int r;
     u_int size;
     CLOSE_CHECK(sock->fd, "send to", sock);
+    if (GATHER_MESSAGE_P(msg)) return socket_send_gather(sock, msg, to, flags);
     const char *cmsg = get_message_body(msg, &size);
     SCM_SYSCALL(r, sendto(sock->fd, cmsg, size, flags,
                           &SCM_SOCKADDR(to)->addr, SCM_SOCKADDR(to)->addrlen));
@@ -486,6 +711,197 @@ ScmObj Scm_SocketRecvFromX(ScmSocket *sock, ScmUVector *buf,
     return Scm_Values2(Scm_MakeInteger(r), addr);
 }
 
+/* Batch datagram I/O.
+ *   Scm_SocketRecvMMsgX receives up to as many datagrams as BUFS,
+ *   a vector of uniform vectors, has.  It waits for the first datagram
+ *   (unless the socket is non-blocking or MSG_DONTWAIT is given), then
+ *   takes whatever is already queued.  The size of each datagram is
+ *   stored in LENS.  If ADDRS is a vector, the sender's address of each
+ *   datagram is stored into it; an address of the same family is
+ *   overwritten in place, so that steady traffic doesn't allocate.
+ *   Returns the number of datagrams received, which is 0 if the socket
+ *   is non-blocking and no datagram is queued.
+ *
+ *   Scm_SocketSendMMsg sends each element of MSGS as a datagram,
+ *   to the corresponding address in ADDRS if it is a vector.  Returns
+ *   the number of datagrams sent, which may be less than requested if
+ *   the socket is non-blocking.
+ *
+ *   We use recvmmsg(2) and sendmmsg(2) if available, and fall back to
+ *   loops of recvfrom(2) and sendto(2) otherwise.
+ */
+static int would_block_p(void)
+{
+#if defined(EWOULDBLOCK) && EWOULDBLOCK != EAGAIN
+    if (errno == EWOULDBLOCK) return TRUE;
+#endif
+    return (errno == EAGAIN);
+}
+
+static void check_mmsg_addrs(ScmObj addrs, int n)
+{
+    if (SCM_FALSEP(addrs)) return;
+    if (!SCM_VECTORP(addrs)) {
+        Scm_TypeError("addrs", "vector or #f", addrs);
+    }
+    if (SCM_VECTOR_SIZE(addrs) < n) {
+        Scm_Error("address vector too short (%d required): %S", n, addrs);
+    }
+}
+
+static void store_from_addr(ScmObj addrs, int i,
+                            struct sockaddr_storage *from, socklen_t fromlen)
+{
+    if (SCM_FALSEP(addrs)) return;
+    ScmObj a = SCM_VECTOR_ELEMENT(addrs, i);
+    if (Scm_SockAddrP(a) && SCM_SOCKADDR_FAMILY(a) == from->ss_family) {
+        memcpy(&SCM_SOCKADDR(a)->addr, from, SCM_SOCKADDR(a)->addrlen);
+    } else {
+        SCM_VECTOR_ELEMENT(addrs, i) =
+            Scm_MakeSockAddr(NULL, (struct sockaddr*)from, fromlen);
+    }
+}
+
+static ScmSockAddr *get_to_addr(ScmObj addrs, int i)
+{
+    if (SCM_FALSEP(addrs)) return NULL;
+    ScmObj a = SCM_VECTOR_ELEMENT(addrs, i);
+    if (!Scm_SockAddrP(a)) Scm_TypeError("address", "socket address", a);
+    return SCM_SOCKADDR(a);
+}
+
+ScmObj Scm_SocketRecvMMsgX(ScmSocket *sock, ScmVector *bufs,
+                           ScmU32Vector *lens, ScmObj addrs, int flags)
+{
+    int n = SCM_VECTOR_SIZE(bufs);
+    int r;
+
+    CLOSE_CHECK(sock->fd, "recv from", sock);
+    SCM_UVECTOR_CHECK_MUTABLE(lens);
+    if (SCM_U32VECTOR_SIZE(lens) < n) {
+        Scm_Error("length vector too short (%d required): %S", n, lens);
+    }
+    check_mmsg_addrs(addrs, n);
+    if (n == 0) return SCM_MAKE_INT(0);
+
+    struct sockaddr_storage *from =
+        SCM_NEW_ATOMIC2(struct sockaddr_storage*,
+                        n * sizeof(struct sockaddr_storage));
+    struct iovec *iov = SCM_NEW_ATOMIC2(struct iovec*, n * sizeof(struct iovec));
+    for (int i=0; i<n; i++) {
+        ScmObj b = SCM_VECTOR_ELEMENT(bufs, i);
+        u_int size;
+        if (!SCM_UVECTORP(b)) Scm_TypeError("buffer", "uniform vector", b);
+        iov[i].iov_base = get_message_buffer(SCM_UVECTOR(b), &size);
+        iov[i].iov_len = size;
+    }
+
+#if defined(HAVE_RECVMMSG)
+    struct mmsghdr *hdrs =
+        SCM_NEW_ATOMIC2(struct mmsghdr*, n * sizeof(struct mmsghdr));
+    memset(hdrs, 0, n * sizeof(struct mmsghdr));
+    for (int i=0; i<n; i++) {
+        hdrs[i].msg_hdr.msg_name = &from[i];
+        hdrs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+        hdrs[i].msg_hdr.msg_iov = &iov[i];
+        hdrs[i].msg_hdr.msg_iovlen = 1;
+    }
+#if defined(MSG_WAITFORONE)
+    flags |= MSG_WAITFORONE;
+#endif
+    SCM_SYSCALL(r, recvmmsg(sock->fd, hdrs, n, flags, NULL));
+    if (r < 0) {
+        if (would_block_p()) return SCM_MAKE_INT(0);
+        Scm_SysError("recvmmsg(2) failed");
+    }
+    for (int i=0; i<r; i++) {
+        SCM_U32VECTOR_ELEMENTS(lens)[i] = hdrs[i].msg_len;
+        store_from_addr(addrs, i, &from[i], hdrs[i].msg_hdr.msg_namelen);
+    }
+    return SCM_MAKE_INT(r);
+#else  /*!HAVE_RECVMMSG*/
+    int i;
+    for (i=0; i<n; i++) {
+        socklen_t fromlen = sizeof(struct sockaddr_storage);
+        int f = flags;
+        if (i > 0) {
+#if defined(MSG_DONTWAIT)
+            f |= MSG_DONTWAIT;
+#else
+            break;              /* we can't tell if the next one blocks */
+#endif
+        }
+        SCM_SYSCALL(r, recvfrom(sock->fd, iov[i].iov_base, iov[i].iov_len, f,
+                                (struct sockaddr*)&from[i], &fromlen));
+        if (r < 0) {
+            /* If we've got some, the error will be reported next time */
+            if (i > 0 || would_block_p()) break;
+            Scm_SysError("recvfrom(2) failed");
+        }
+        SCM_U32VECTOR_ELEMENTS(lens)[i] = r;
+        store_from_addr(addrs, i, &from[i], fromlen);
+    }
+    return SCM_MAKE_INT(i);
+#endif /*!HAVE_RECVMMSG*/
+}
+
+ScmObj Scm_SocketSendMMsg(ScmSocket *sock, ScmVector *msgs, ScmObj addrs,
+                          int flags)
+{
+    int n = SCM_VECTOR_SIZE(msgs);
+    int r, sent = 0;
+
+    CLOSE_CHECK(sock->fd, "send to", sock);
+    check_mmsg_addrs(addrs, n);
+    if (n == 0) return SCM_MAKE_INT(0);
+
+#if defined(HAVE_SENDMMSG)
+    struct iovec *iov = SCM_NEW_ATOMIC2(struct iovec*, n * sizeof(struct iovec));
+    struct mmsghdr *hdrs =
+        SCM_NEW_ATOMIC2(struct mmsghdr*, n * sizeof(struct mmsghdr));
+    memset(hdrs, 0, n * sizeof(struct mmsghdr));
+    for (int i=0; i<n; i++) {
+        u_int size;
+        ScmSockAddr *to = get_to_addr(addrs, i);
+        iov[i].iov_base = (void*)get_message_body(SCM_VECTOR_ELEMENT(msgs, i),
+                                                  &size);
+        iov[i].iov_len = size;
+        hdrs[i].msg_hdr.msg_iov = &iov[i];
+        hdrs[i].msg_hdr.msg_iovlen = 1;
+        if (to) {
+            hdrs[i].msg_hdr.msg_name = &to->addr;
+            hdrs[i].msg_hdr.msg_namelen = to->addrlen;
+        }
+    }
+    while (sent < n) {
+        SCM_SYSCALL(r, sendmmsg(sock->fd, hdrs+sent, n-sent, flags));
+        if (r < 0) {
+            if (sent > 0 || would_block_p()) break;
+            Scm_SysError("sendmmsg(2) failed");
+        }
+        sent += r;
+    }
+#else  /*!HAVE_SENDMMSG*/
+    for (; sent < n; sent++) {
+        u_int size;
+        ScmSockAddr *to = get_to_addr(addrs, sent);
+        const char *body = get_message_body(SCM_VECTOR_ELEMENT(msgs, sent),
+                                            &size);
+        if (to) {
+            SCM_SYSCALL(r, sendto(sock->fd, body, size, flags,
+                                  &to->addr, to->addrlen));
+        } else {
+            SCM_SYSCALL(r, send(sock->fd, body, size, flags));
+        }
+        if (r < 0) {
+            if (sent > 0 || would_block_p()) break;
+            Scm_SysError("sendto(2) failed");
+        }
+    }
+#endif /*!HAVE_SENDMMSG*/
+    return SCM_MAKE_INT(sent);
+}
+
 /* Low level message builder */
 ScmObj Scm_SocketBuildMsg(ScmSockAddr *name, ScmVector *iov,
                           ScmObj control, int flags,
@@ -742,6 +1158,211 @@ ScmObj Scm_SocketIoctl(ScmSocket *s, u_long request, ScmObj data)
     return SCM_UNDEFINED;       /* dummy */
 }
 
+/*==================================================================
+ * Bulk transfer
+ */
+
+/* Serving a file through ports copies every byte twice, once into
+   the input port's buffer and once into the output port's.  When both
+   ends have file descriptors, we let the kernel move the data, using
+   copy_file_range(2), sendfile(2) or splice(2), whichever the pair of
+   descriptors accepts; then we fall back to a read/write loop with
+   a large buffer.  COUNT < 0 means transferring until EOF. */
+
+#ifndef MIN
+#define MIN(a, b) ((a)<(b)? (a) : (b))
+#endif
+
+#define TRANSFER_BUFSIZ  65536
+#define TRANSFER_CHUNK   0x40000000 /* per syscall, to avoid overflow */
+
+static void write_all(int fd, const char *buf, long n)
+{
+    while (n > 0) {
+        ssize_t r;
+        SCM_SYSCALL(r, write(fd, buf, n));
+        if (r < 0) Scm_SysError("write failed on fd %d", fd);
+        buf += r;
+        n -= r;
+    }
+}
+
+#define NEXT_CHUNK(count, total) \
+    ((count) < 0 ? TRANSFER_CHUNK : MIN((count) - (total), TRANSFER_CHUNK))
+
+/* The zero-copy calls fail with one of these if they can't handle the
+   given pair of descriptors; then we try the next method. */
+#define TRANSFER_UNSUPPORTED(e) \
+    ((e) == EINVAL || (e) == ENOSYS || (e) == EXDEV || (e) == EBADF \
+     || (e) == EOPNOTSUPP)
+
+static long fd_transfer(int infd, int outfd, long count)
+{
+    long total = 0;
+    ssize_t r;
+
+#if defined(HAVE_COPY_FILE_RANGE)
+    while (count < 0 || total < count) {
+        SCM_SYSCALL(r, copy_file_range(infd, NULL, outfd, NULL,
+                                       NEXT_CHUNK(count, total), 0));
+        if (r < 0) {
+            if (total == 0 && TRANSFER_UNSUPPORTED(errno)) break;
+            Scm_SysError("copy_file_range failed");
+        }
+        /* Some pseudo files report 0 to copy_file_range; let the
+           other methods confirm EOF. */
+        if (r == 0) { if (total == 0) break; return total; }
+        total += r;
+    }
+    if (total > 0) return total;
+#endif /*HAVE_COPY_FILE_RANGE*/
+
+#if defined(HAVE_SENDFILE) && defined(HAVE_SYS_SENDFILE_H)
+    while (count < 0 || total < count) {
+        SCM_SYSCALL(r, sendfile(outfd, infd, NULL, NEXT_CHUNK(count, total)));
+        if (r < 0) {
+            if (total == 0 && TRANSFER_UNSUPPORTED(errno)) break;
+            Scm_SysError("sendfile failed");
+        }
+        if (r == 0) return total;
+        total += r;
+    }
+    if (total > 0) return total;
+#endif /*HAVE_SENDFILE && HAVE_SYS_SENDFILE_H*/
+
+#if defined(HAVE_SPLICE)
+    /* splice requires either end to be a pipe. */
+    while (count < 0 || total < count) {
+        SCM_SYSCALL(r, splice(infd, NULL, outfd, NULL,
+                              NEXT_CHUNK(count, total), SPLICE_F_MOVE));
+        if (r < 0) {
+            if (total == 0 && TRANSFER_UNSUPPORTED(errno)) break;
+            Scm_SysError("splice failed");
+        }
+        if (r == 0) return total;
+        total += r;
+    }
+    if (total > 0) return total;
+#endif /*HAVE_SPLICE*/
+
+    char *buf = SCM_NEW_ATOMIC2(char*, TRANSFER_BUFSIZ);
+    while (count < 0 || total < count) {
+        SCM_SYSCALL(r, read(infd, buf, NEXT_CHUNK(count, total) > TRANSFER_BUFSIZ
+                            ? TRANSFER_BUFSIZ : NEXT_CHUNK(count, total)));
+        if (r < 0) Scm_SysError("read failed on fd %d", infd);
+        if (r == 0) break;
+        write_all(outfd, buf, r);
+        total += r;
+    }
+    return total;
+}
+
+/* The input port may already hold some data read ahead from the fd;
+   send it first.  Afterwards the fd's position matches the port's. */
+static long drain_input(ScmPort *src, int outfd, long count)
+{
+    long total = 0;
+    char buf[1024];
+
+    for (;;) {
+        long pending = (long)src->scrcnt
+            + (src->ungotten != SCM_CHAR_INVALID
+               ? SCM_CHAR_NBYTES(src->ungotten) : 0)
+            + (long)(src->src.buf.end - src->src.buf.current);
+        if (count >= 0) pending = MIN(pending, count - total);
+        if (pending <= 0) break;
+        int r = Scm_Getz(buf, (int)MIN(pending, (long)sizeof(buf)), src);
+        if (r <= 0) break;
+        write_all(outfd, buf, r);
+        total += r;
+    }
+    return total;
+}
+
+static long port_transfer_to_fd(ScmPort *src, int outfd, long count)
+{
+    int infd = Scm_PortFileNo(src);
+    long total = 0;
+
+    if (infd >= 0 && SCM_PORT_TYPE(src) == SCM_PORT_FILE) {
+        total = drain_input(src, outfd, count);
+        if (count < 0 || total < count) {
+            total += fd_transfer(infd, outfd, count < 0 ? -1 : count - total);
+        }
+    } else {
+        char *buf = SCM_NEW_ATOMIC2(char*, TRANSFER_BUFSIZ);
+        while (count < 0 || total < count) {
+            int r = Scm_Getz(buf, (int)MIN(NEXT_CHUNK(count, total),
+                                           TRANSFER_BUFSIZ), src);
+            if (r <= 0) break;
+            write_all(outfd, buf, r);
+            total += r;
+        }
+    }
+    return total;
+}
+
+static long transfer_count(ScmObj count)
+{
+    if (SCM_FALSEP(count) || SCM_UNBOUNDP(count)) return -1;
+    long n = Scm_GetIntegerClamp(count, SCM_CLAMP_NONE, NULL);
+    if (n < 0) Scm_Error("count must be a nonnegative integer or #f, \
+but got %S", count);
+    return n;
+}
+
+/* Copies the content of SRC to DST, up to COUNT bytes or until EOF if
+   COUNT is #f.  Returns the number of bytes transferred. */
+ScmObj Scm_PortTransfer(ScmPort *src, ScmPort *dst, ScmObj count)
+{
+    long n = transfer_count(count);
+    long total = 0;
+    int outfd = Scm_PortFileNo(dst);
+
+    if (!SCM_IPORTP(src)) Scm_Error("input port required, but got %S", src);
+    if (!SCM_OPORTP(dst)) Scm_Error("output port required, but got %S", dst);
+
+    if (outfd >= 0) {
+        Scm_Flush(dst);
+        total = port_transfer_to_fd(src, outfd, n);
+    } else {
+        char *buf = SCM_NEW_ATOMIC2(char*, TRANSFER_BUFSIZ);
+        while (n < 0 || total < n) {
+            int r = Scm_Getz(buf, (int)MIN(NEXT_CHUNK(n, total),
+                                           TRANSFER_BUFSIZ), src);
+            if (r <= 0) break;
+            Scm_Putz(buf, r, dst);
+            total += r;
+        }
+    }
+    return Scm_MakeInteger(total);
+}
+
+/* Sends the content of SRC to the socket.  SRC may be an input port
+   or an integer file descriptor. */
+ScmObj Scm_SocketSendFile(ScmSocket *sock, ScmObj src, ScmObj count)
+{
+    CLOSE_CHECK(sock->fd, "send to", sock);
+    if (sock->outPort) Scm_Flush(sock->outPort);
+#if !defined(GAUCHE_WINDOWS)
+    long n = transfer_count(count);
+    if (SCM_INTP(src)) {
+        return Scm_MakeInteger(fd_transfer(SCM_INT_VALUE(src), sock->fd, n));
+    }
+    if (!SCM_IPORTP(src)) {
+        Scm_TypeError("src", "input port or file descriptor", src);
+    }
+    return Scm_MakeInteger(port_transfer_to_fd(SCM_PORT(src), sock->fd, n));
+#else  /*GAUCHE_WINDOWS*/
+    /* Socket handles aren't file descriptors; go through the port. */
+    if (!SCM_IPORTP(src)) Scm_TypeError("src", "input port", src);
+    return Scm_PortTransfer(SCM_PORT(src),
+                            SCM_PORT(Scm_SocketOutputPort(sock,
+                                                          SCM_PORT_BUFFER_FULL)),
+                            count);
+#endif /*GAUCHE_WINDOWS*/
+}
+
 /*==================================================================
  * Windows/MinGW compatibility layer
  */
@@ -822,6 +1443,7 @@ extern void Scm_Init_NetAddr(ScmModule *mod);
 extern void Scm_Init_NetDB(ScmModule *mod);
 extern void Scm_Init_netlib(ScmModule *mod);
 extern void Scm_Init_netaux(void);
+extern void Scm_Init_NetAio(ScmModule *mod);
 
 
 
@@ -836,6 +1458,7 @@ SCM_EXTENSION_ENTRY void Scm_Init_gauche__net(void)
     Scm_InitStaticClass(&Scm_SocketClass, "<socket>", mod, NULL, 0);
     Scm_Init_NetAddr(mod);
     Scm_Init_NetDB(mod);
+    Scm_Init_NetAio(mod);
     Scm_Init_netlib(mod);
     Scm_Init_netaux();
 }
@@ -47,8 +47,16 @@
           socket-listen socket-accept socket-setsockopt socket-getsockopt
           socket-getsockname socket-getpeername socket-ioctl
           socket-send socket-sendto socket-sendmsg socket-buildmsg
+          socket-sendfile port-transfer
+          <aio-context> make-aio-context aio-context-backend aio-context-fd
+          aio-context-close aio-read! aio-write! aio-accept! aio-connect!
+          aio-submit! aio-wait <aio-request> aio-request-op
+          aio-request-target aio-request-tag aio-request-done?
+          aio-request-result aio-request-error
           socket-recv socket-recv! socket-recvfrom socket-recvfrom!
+          socket-recvmmsg! socket-sendmmsg
           <sockaddr> <sockaddr-in> <sockaddr-un> make-sockaddrs
+          resolver-timeout resolver-configure! resolver-stats
           sockaddr-name sockaddr-family sockaddr-addr sockaddr-port
           make-client-socket make-server-socket make-server-sockets
           call-with-client-socket
@@ -102,6 +110,7 @@
 (export-if-defined
  PF_INET6 AF_INET6
  <sockaddr-in6> <sys-addrinfo> sys-getaddrinfo make-sys-addrinfo
+ resolver-getaddrinfo resolver-cache-clear!
  AI_PASSIVE AI_CANONNAME AI_NUMERICHOST AI_NUMERICSERV
  AI_V4MAPPED AI_ALL AI_ADDRCONFIG
  IPV6_UNICAST_HOPS IPV6_MULTICAST_IF IPV6_MULTICAST_HOPS
@@ -45,6 +45,12 @@
 ;; the feature 'gauche.net.ipv6' is not available since the gauche.net module
 ;; is not yet built.  So we use a bit of kludge here.
 (define ipv6-capable (global-variable-bound? 'gauche.net 'sys-getaddrinfo))
+(define connect-any-capable
+  (global-variable-bound? 'gauche.net '%socket-connect-any))
+
+;; The delay before starting the next connection attempt in
+;; make-client-socket-inet, in milliseconds.  RFC 8305 recommends 250ms.
+(define-constant CONNECTION_ATTEMPT_DELAY 250)
 
 ;; API
 (define (make-sys-addrinfo :key (flags 0) (family AF_UNSPEC)
@@ -97,14 +103,34 @@
     (socket-connect socket (make <sockaddr-un> :path path))))
 
 (define (make-client-socket-inet host port)
-  (let1 err #f
-    (define (try-connect address)
-      (guard (e [else (set! err e) #f])
-        (rlet1 socket (make-socket (address->protocol-family address)
-                                  SOCK_STREAM)
-          (socket-connect socket address))))
-    (rlet1 socket (any try-connect (make-sockaddrs host port))
-      (unless socket (raise err)))))
+  (let1 addrs (make-sockaddrs host port)
+    (if (and connect-any-capable (length>? addrs 1))
+      (%socket-connect-any (interleave-address-families addrs)
+                           CONNECTION_ATTEMPT_DELAY)
+      (let1 err #f
+        (define (try-connect address)
+          (guard (e [else (set! err e) #f])
+            (rlet1 socket (make-socket (address->protocol-family address)
+                                       SOCK_STREAM)
+              (socket-connect socket address))))
+        (rlet1 socket (any try-connect addrs)
+          (unless socket (raise err)))))))
+
+;; Reorder addresses so that the families alternate, starting from
+;; the family of the first one (which the resolver prefers), as
+;; RFC 8305 suggests.  The order within each family is kept.
+(define (interleave-address-families addrs)
+  (let1 fam (sockaddr-family (car addrs))
+    (receive (as bs) (partition (^s (eq? (sockaddr-family s) fam)) addrs)
+      (let loop ([as as] [bs bs] [r '()])
+        (cond [(null? as) (append (reverse! r) bs)]
+              [(null? bs) (append (reverse! r) as)]
+              [else (loop (cdr as) (cdr bs) (list* (car bs) (car as) r))])))))
+
+;; SO_REUSEPORT is only defined on the platforms that support it.
+(define (so-reuseport)
+  (or (global-variable-ref (find-module 'gauche.net) 'SO_REUSEPORT #f)
+      (error "SO_REUSEPORT isn't supported on this platform")))
 
 ;; API
 (define (make-server-socket proto . args)
@@ -134,6 +160,7 @@
          (error "unsupported protocol:" proto)]))
 
 (define (make-server-socket-from-addr addr :key (reuse-addr? #f)
+                                                (reuse-port? #f)
                                                 (sock-init #f)
                                                 (backlog DEFAULT_BACKLOG))
   (rlet1 socket (make-socket (address->protocol-family addr) SOCK_STREAM)
@@ -141,6 +168,8 @@
       (sock-init socket addr))
     (when reuse-addr?
       (socket-setsockopt socket SOL_SOCKET SO_REUSEADDR 1))
+    (when reuse-port?
+      (socket-setsockopt socket SOL_SOCKET (so-reuseport) 1))
     (socket-bind socket addr)
     (socket-listen socket backlog)))
 
@@ -239,6 +268,26 @@
       (append-map (cut try-v4 <> ss) (make-v6socks (v6addrs ss))))))
 
 ;; API
+;; API
+;; The resolver used by make-sockaddrs caches the results of getaddrinfo,
+;; and runs the queries in separate threads so that we can time out.
+(define resolver-timeout (make-parameter #f))
+
+(define (resolver-configure! :key (ttl #f) (negative-ttl #f)
+                                  (max-entries #f) (max-threads #f))
+  (unless ipv6-capable
+    (error "resolver-configure! is available on IPv6-enabled platform"))
+  (%resolver-configure (if ttl (x->number ttl) -1.0)
+                       (if negative-ttl (x->number negative-ttl) -1.0)
+                       (or max-entries -1)
+                       (or max-threads -1))
+  (undefined))
+
+(define (resolver-stats)
+  (if ipv6-capable
+    (%resolver-configure -1.0 -1.0 -1 -1)
+    '()))
+
 (define (make-sockaddrs host port :optional (proto 'tcp))
   (if ipv6-capable
     (let* ([socktype (case proto
@@ -246,8 +295,11 @@
                        [(udp) SOCK_DGRAM]
                        [else (error "unsupported protocol:" proto)])]
            [port (x->string port)]
-           [hints (make-sys-addrinfo :flags AI_PASSIVE :socktype socktype)])
-      (map (cut slot-ref <> 'addr) (sys-getaddrinfo host port hints)))
+           [hints (make-sys-addrinfo :flags AI_PASSIVE :socktype socktype)]
+           [timeout (resolver-timeout)])
+      (map (cut slot-ref <> 'addr)
+           (or (resolver-getaddrinfo host port hints :timeout timeout)
+               (errorf "name resolution of ~s timed out" host))))
     (let1 port (cond [(number? port) port]
                      [(sys-getservbyname port (symbol->string proto))
                       => (cut slot-ref <> 'port)]
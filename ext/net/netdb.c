@@ -514,6 +514,436 @@ ScmObj Scm_GetAddrinfo(const char *nodename,
     return h;
 }
 
+/*-------------------------------------------------------------
+ * Caching resolver
+ *
+ *   getaddrinfo() blocks the calling thread for as long as the name
+ *   service takes, and the C library doesn't cache the answers.
+ *   Scm_ResolverGetAddrinfo keeps the results in an in-process cache,
+ *   and performs the lookups in a small pool of resolver threads, so
+ *   that the caller can give up waiting after a timeout, and
+ *   concurrent lookups of the same name share a single query.
+ *
+ *   getaddrinfo doesn't tell us the TTL of the DNS records, so the
+ *   entries are kept for a configurable period (resolver.ttl).
+ *   Failures saying the name doesn't exist are cached for
+ *   resolver.negttl; other failures (e.g. EAI_AGAIN) aren't cached.
+ *
+ *   Resolver threads never allocate from GC heap, nor touch
+ *   Scheme objects; the cache entries are malloc'ed and reference
+ *   counted, and the requesting thread builds <sys-addrinfo>s
+ *   from the copy in the entry.  Without pthreads, or when we fail
+ *   to start a thread, the requesting thread performs the lookup
+ *   by itself.
+ */
+
+#define RESOLVER_NBUCKETS        64
+#define RESOLVER_DEFAULT_TTL     60.0
+#define RESOLVER_DEFAULT_NEGTTL  5.0
+#define RESOLVER_DEFAULT_MAX     1024
+#define RESOLVER_DEFAULT_THREADS 4
+
+typedef struct resolver_entry_rec {
+    struct resolver_entry_rec *next;  /* hash chain */
+    struct resolver_entry_rec *qnext; /* work queue */
+    u_long hashval;
+    char *node;                 /* may be NULL */
+    char *serv;                 /* may be NULL */
+    int hasHints;
+    struct addrinfo hints;
+    int refs;                   /* # of threads using this entry */
+    int pending;                /* lookup in progress */
+    int removed;                /* unlinked from the table */
+    int error;                  /* return value of getaddrinfo */
+    int syserr;                 /* errno, if error == EAI_SYSTEM */
+    struct addrinfo *result;
+    double expires;
+} resolver_entry;
+
+static struct resolver_rec {
+    ScmInternalMutex mutex;
+    ScmInternalCond  workCond;  /* resolver threads wait on this */
+    ScmInternalCond  doneCond;  /* requesters wait on this */
+    resolver_entry *buckets[RESOLVER_NBUCKETS];
+    resolver_entry *workHead, *workTail;
+    int numEntries;
+    int numThreads;
+    int idleThreads;
+    int maxThreads;
+    int maxEntries;
+    double ttl;
+    double negttl;
+    u_long hits, misses, coalesced;
+} resolver;
+
+static double resolver_now(void)
+{
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + ts.tv_nsec/1.0e9;
+#else
+    return (double)time(NULL);
+#endif
+}
+
+static char *resolver_strdup(const char *s)
+{
+    if (s == NULL) return NULL;
+    size_t len = strlen(s);
+    char *d = malloc(len+1);
+    if (d) memcpy(d, s, len+1);
+    return d;
+}
+
+static int resolver_streq(const char *a, const char *b)
+{
+    if (a == NULL || b == NULL) return a == b;
+    return strcmp(a, b) == 0;
+}
+
+static u_long resolver_hash(const char *node, const char *serv,
+                            const struct addrinfo *hints)
+{
+    u_long h = 5381;
+    if (node) for (const char *p = node; *p; p++) h = h*33 + (u_char)*p;
+    h = h*33 + 1;
+    if (serv) for (const char *p = serv; *p; p++) h = h*33 + (u_char)*p;
+    if (hints) {
+        h = h*33 + (u_long)hints->ai_flags;
+        h = h*33 + (u_long)hints->ai_family;
+        h = h*33 + (u_long)hints->ai_socktype;
+        h = h*33 + (u_long)hints->ai_protocol;
+    }
+    return h;
+}
+
+static int resolver_match(resolver_entry *e, u_long hashval,
+                          const char *node, const char *serv,
+                          const struct addrinfo *hints)
+{
+    if (e->hashval != hashval) return FALSE;
+    if (!resolver_streq(e->node, node)) return FALSE;
+    if (!resolver_streq(e->serv, serv)) return FALSE;
+    if (hints == NULL) return !e->hasHints;
+    return e->hasHints
+        && e->hints.ai_flags == hints->ai_flags
+        && e->hints.ai_family == hints->ai_family
+        && e->hints.ai_socktype == hints->ai_socktype
+        && e->hints.ai_protocol == hints->ai_protocol;
+}
+
+static void resolver_free_entry(resolver_entry *e)
+{
+    if (e->result) freeaddrinfo(e->result);
+    free(e->node);
+    free(e->serv);
+    free(e);
+}
+
+/* Unlink E from the hash table.  It is freed now if nobody is using it;
+   otherwise the last user frees it.  Must be called with the lock. */
+static void resolver_unlink(resolver_entry *e)
+{
+    resolver_entry **pp = &resolver.buckets[e->hashval % RESOLVER_NBUCKETS];
+    for (; *pp; pp = &(*pp)->next) {
+        if (*pp == e) { *pp = e->next; break; }
+    }
+    e->next = NULL;
+    e->removed = TRUE;
+    resolver.numEntries--;
+    if (e->refs == 0) resolver_free_entry(e);
+}
+
+static void resolver_release(resolver_entry *e)
+{
+    if (--e->refs == 0 && e->removed) resolver_free_entry(e);
+}
+
+/* Make room for a new entry.  First we drop the expired entries; if it
+   isn't enough, the entries that expire soonest.  Must be called with
+   the lock. */
+static void resolver_evict(double now)
+{
+    for (int i=0; i<RESOLVER_NBUCKETS; i++) {
+        resolver_entry *e = resolver.buckets[i], *n;
+        for (; e; e = n) {
+            n = e->next;
+            if (!e->pending && e->expires <= now) resolver_unlink(e);
+        }
+    }
+    while (resolver.numEntries >= resolver.maxEntries) {
+        resolver_entry *victim = NULL;
+        for (int i=0; i<RESOLVER_NBUCKETS; i++) {
+            for (resolver_entry *e = resolver.buckets[i]; e; e = e->next) {
+                if (e->pending) continue;
+                if (victim == NULL || e->expires < victim->expires) victim = e;
+            }
+        }
+        if (victim == NULL) break; /* all pending */
+        resolver_unlink(victim);
+    }
+}
+
+static int resolver_cacheable_error(int error)
+{
+    if (error == EAI_NONAME) return TRUE;
+#if defined(EAI_NODATA) && EAI_NODATA != EAI_NONAME
+    if (error == EAI_NODATA) return TRUE;
+#endif
+    return FALSE;
+}
+
+/* Performs a lookup.  Called without the lock, possibly without VM. */
+static void resolver_perform(resolver_entry *e)
+{
+    struct addrinfo *res = NULL;
+    int r = getaddrinfo(e->node, e->serv,
+                        e->hasHints? &e->hints : NULL, &res);
+    int syserr = errno;
+
+    (void)SCM_INTERNAL_MUTEX_LOCK(resolver.mutex);
+    double now = resolver_now();
+    e->error = r;
+    e->syserr = syserr;
+    e->result = (r == 0)? res : NULL;
+    if (r == 0) {
+        e->expires = now + resolver.ttl;
+    } else if (resolver_cacheable_error(r)) {
+        e->expires = now + resolver.negttl;
+    } else {
+        e->expires = now;       /* only the waiters see the failure */
+    }
+    e->pending = FALSE;
+    (void)SCM_INTERNAL_COND_BROADCAST(resolver.doneCond);
+    resolver_release(e);
+    (void)SCM_INTERNAL_MUTEX_UNLOCK(resolver.mutex);
+}
+
+#ifdef GAUCHE_USE_PTHREADS
+static void *resolver_worker(void *data)
+{
+    for (;;) {
+        (void)SCM_INTERNAL_MUTEX_LOCK(resolver.mutex);
+        resolver.idleThreads++;
+        while (resolver.workHead == NULL) {
+            (void)SCM_INTERNAL_COND_WAIT(resolver.workCond, resolver.mutex);
+        }
+        resolver.idleThreads--;
+        resolver_entry *e = resolver.workHead;
+        resolver.workHead = e->qnext;
+        if (resolver.workHead == NULL) resolver.workTail = NULL;
+        e->qnext = NULL;
+        (void)SCM_INTERNAL_MUTEX_UNLOCK(resolver.mutex);
+
+        resolver_perform(e);
+    }
+    return NULL;
+}
+
+/* Hands E to a resolver thread, starting one if needed.  Returns FALSE
+   if no thread is available.  Must be called with the lock. */
+static int resolver_dispatch(resolver_entry *e)
+{
+    if (resolver.idleThreads == 0 && resolver.numThreads < resolver.maxThreads) {
+        pthread_t th;
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        int r = pthread_create(&th, &attr, resolver_worker, NULL);
+        pthread_attr_destroy(&attr);
+        if (r == 0) resolver.numThreads++;
+    }
+    if (resolver.numThreads == 0) return FALSE;
+    if (resolver.workTail) resolver.workTail->qnext = e;
+    else resolver.workHead = e;
+    resolver.workTail = e;
+    (void)SCM_INTERNAL_COND_SIGNAL(resolver.workCond);
+    return TRUE;
+}
+#else  /*!GAUCHE_USE_PTHREADS*/
+static int resolver_dispatch(resolver_entry *e)
+{
+    return FALSE;
+}
+#endif /*!GAUCHE_USE_PTHREADS*/
+
+static ScmObj resolver_error(resolver_entry *e)
+{
+    int error = e->error, syserr = e->syserr;
+    resolver_release(e);
+    (void)SCM_INTERNAL_MUTEX_UNLOCK(resolver.mutex);
+#if defined(EAI_SYSTEM)
+    if (error == EAI_SYSTEM) {
+        errno = syserr;
+        Scm_SysError("getaddrinfo failed");
+    }
+#endif
+#if !defined(GAUCHE_WINDOWS)
+    Scm_Error("getaddrinfo failed: %s", gai_strerror(error));
+#else  /*GAUCHE_WINDOWS*/
+    errno = syserr;
+    Scm_SysError("getaddrinfo failed");
+#endif /*GAUCHE_WINDOWS*/
+    return SCM_UNDEFINED;       /* dummy */
+}
+
+/* Like Scm_GetAddrinfo, but consults the cache.  TIMEOUT is #f
+   (wait indefinitely), or a relative seconds or absolute <time>,
+   as in mutex-lock!.  Returns #f on timeout. */
+ScmObj Scm_ResolverGetAddrinfo(const char *nodename,
+                               const char *servname,
+                               struct addrinfo *hints,
+                               ScmObj timeout)
+{
+    ScmTimeSpec ts;
+    ScmTimeSpec *pts = Scm_GetTimeSpec(timeout, &ts);
+    u_long hashval = resolver_hash(nodename, servname, hints);
+    resolver_entry *e;
+
+    (void)SCM_INTERNAL_MUTEX_LOCK(resolver.mutex);
+    double now = resolver_now();
+    for (e = resolver.buckets[hashval % RESOLVER_NBUCKETS]; e; e = e->next) {
+        if (resolver_match(e, hashval, nodename, servname, hints)) break;
+    }
+    if (e && !e->pending && e->expires <= now) {
+        resolver_unlink(e);
+        e = NULL;
+    }
+    if (e) {
+        if (e->pending) resolver.coalesced++;
+        else resolver.hits++;
+        e->refs++;
+    } else {
+        resolver.misses++;
+        if (resolver.numEntries >= resolver.maxEntries) resolver_evict(now);
+        e = calloc(1, sizeof(resolver_entry));
+        if (e == NULL) {
+            (void)SCM_INTERNAL_MUTEX_UNLOCK(resolver.mutex);
+            Scm_Error("getaddrinfo: out of memory");
+        }
+        e->hashval = hashval;
+        e->node = resolver_strdup(nodename);
+        e->serv = resolver_strdup(servname);
+        if (hints) {
+            e->hasHints = TRUE;
+            e->hints.ai_flags = hints->ai_flags;
+            e->hints.ai_family = hints->ai_family;
+            e->hints.ai_socktype = hints->ai_socktype;
+            e->hints.ai_protocol = hints->ai_protocol;
+        }
+        e->pending = TRUE;
+        e->refs = 2;            /* the requester and the performer */
+        e->next = resolver.buckets[hashval % RESOLVER_NBUCKETS];
+        resolver.buckets[hashval % RESOLVER_NBUCKETS] = e;
+        resolver.numEntries++;
+        if (!resolver_dispatch(e)) {
+            (void)SCM_INTERNAL_MUTEX_UNLOCK(resolver.mutex);
+            resolver_perform(e);
+            (void)SCM_INTERNAL_MUTEX_LOCK(resolver.mutex);
+        }
+    }
+
+    while (e->pending) {
+        if (pts) {
+            int r = SCM_INTERNAL_COND_TIMEDWAIT(resolver.doneCond,
+                                                resolver.mutex, pts);
+            if (r == SCM_INTERNAL_COND_TIMEDOUT) break;
+        } else {
+            (void)SCM_INTERNAL_COND_WAIT(resolver.doneCond, resolver.mutex);
+        }
+    }
+    if (e->pending) {
+        /* Timed out.  The lookup continues, and its result will be
+           cached for the next request. */
+        resolver_release(e);
+        (void)SCM_INTERNAL_MUTEX_UNLOCK(resolver.mutex);
+        return SCM_FALSE;
+    }
+    if (e->error) return resolver_error(e);
+    (void)SCM_INTERNAL_MUTEX_UNLOCK(resolver.mutex);
+
+    /* We hold a reference, so E->result stays intact even if
+       the entry is evicted meanwhile. */
+    ScmObj h = SCM_NIL, t = SCM_NIL;
+    SCM_UNWIND_PROTECT {
+        for (struct addrinfo *res = e->result; res; res = res->ai_next) {
+            SCM_APPEND1(h, t, SCM_OBJ(make_addrinfo(res)));
+        }
+    } SCM_WHEN_ERROR {
+        (void)SCM_INTERNAL_MUTEX_LOCK(resolver.mutex);
+        resolver_release(e);
+        (void)SCM_INTERNAL_MUTEX_UNLOCK(resolver.mutex);
+        SCM_NEXT_HANDLER;
+    } SCM_END_PROTECT;
+    (void)SCM_INTERNAL_MUTEX_LOCK(resolver.mutex);
+    resolver_release(e);
+    (void)SCM_INTERNAL_MUTEX_UNLOCK(resolver.mutex);
+    return h;
+}
+
+/* Drops cached entries.  If NODENAME is given, only the entries
+   of that name are dropped.  Entries being looked up are left. */
+void Scm_ResolverFlush(const char *nodename)
+{
+    (void)SCM_INTERNAL_MUTEX_LOCK(resolver.mutex);
+    for (int i=0; i<RESOLVER_NBUCKETS; i++) {
+        resolver_entry *e = resolver.buckets[i], *n;
+        for (; e; e = n) {
+            n = e->next;
+            if (e->pending) continue;
+            if (nodename == NULL || resolver_streq(e->node, nodename)) {
+                resolver_unlink(e);
+            }
+        }
+    }
+    (void)SCM_INTERNAL_MUTEX_UNLOCK(resolver.mutex);
+}
+
+/* Changes parameters.  Negative value leaves the parameter intact.
+   Returns the current settings and statistics as an alist. */
+ScmObj Scm_ResolverConfigure(double ttl, double negttl,
+                             int maxEntries, int maxThreads)
+{
+    (void)SCM_INTERNAL_MUTEX_LOCK(resolver.mutex);
+    if (ttl >= 0) resolver.ttl = ttl;
+    if (negttl >= 0) resolver.negttl = negttl;
+    if (maxEntries >= 0) resolver.maxEntries = maxEntries;
+    if (maxThreads >= 0) resolver.maxThreads = maxThreads;
+    double    cttl = resolver.ttl, cnegttl = resolver.negttl;
+    int       cmaxe = resolver.maxEntries, cmaxt = resolver.maxThreads;
+    int       nents = resolver.numEntries, nthr = resolver.numThreads;
+    u_long    hits = resolver.hits, misses = resolver.misses;
+    u_long    coalesced = resolver.coalesced;
+    (void)SCM_INTERNAL_MUTEX_UNLOCK(resolver.mutex);
+
+    ScmObj h = SCM_NIL, t = SCM_NIL;
+#define PARAM(name, val) \
+    SCM_APPEND1(h, t, Scm_Cons(SCM_INTERN(name), val))
+    PARAM("ttl", Scm_MakeFlonum(cttl));
+    PARAM("negative-ttl", Scm_MakeFlonum(cnegttl));
+    PARAM("max-entries", Scm_MakeInteger(cmaxe));
+    PARAM("max-threads", Scm_MakeInteger(cmaxt));
+    PARAM("entries", Scm_MakeInteger(nents));
+    PARAM("threads", Scm_MakeInteger(nthr));
+    PARAM("hits", Scm_MakeIntegerU(hits));
+    PARAM("misses", Scm_MakeIntegerU(misses));
+    PARAM("coalesced", Scm_MakeIntegerU(coalesced));
+#undef PARAM
+    return h;
+}
+
+static void resolver_init(void)
+{
+    (void)SCM_INTERNAL_MUTEX_INIT(resolver.mutex);
+    (void)SCM_INTERNAL_COND_INIT(resolver.workCond);
+    (void)SCM_INTERNAL_COND_INIT(resolver.doneCond);
+    resolver.ttl = RESOLVER_DEFAULT_TTL;
+    resolver.negttl = RESOLVER_DEFAULT_NEGTTL;
+    resolver.maxEntries = RESOLVER_DEFAULT_MAX;
+    resolver.maxThreads = RESOLVER_DEFAULT_THREADS;
+}
+
 ScmObj Scm_GetNameinfo(ScmSockAddr *addr, int flags)
 {
     char host[NI_MAXHOST], serv[NI_MAXSERV];
@@ -545,4 +975,7 @@ void Scm_Init_NetDB(ScmModule *mod)
     SCM_INTERNAL_MUTEX_INIT(netdb_data.hostent_mutex);
     SCM_INTERNAL_MUTEX_INIT(netdb_data.protoent_mutex);
     SCM_INTERNAL_MUTEX_INIT(netdb_data.servent_mutex);
+#ifdef HAVE_IPV6
+    resolver_init();
+#endif /* HAVE_IPV6 */
 }
@@ -174,7 +174,8 @@
 ;; NB: buffered? keyword args in the following two procedures are
 ;; deprecated; use buffering arg.
 (define-cproc socket-input-port (sock::<socket>
-                                 :key (buffering #f) (buffered? #f))
+                                 :key (buffering #f) (buffered? #f)
+                                 (buffer-size::<fixnum> 0))
   (let* ([bufmode::int])
     (cond [(not (SCM_FALSEP buffered?)) ;for backward compatibility
            (set! bufmode SCM_PORT_BUFFER_FULL)]
@@ -182,10 +183,11 @@
            (set! bufmode (Scm_BufferingMode buffering
                                             SCM_PORT_INPUT
                                             SCM_PORT_BUFFER_LINE))])
-    (return (Scm_SocketInputPort sock bufmode))))
+    (return (Scm_SocketInputPortFull sock bufmode buffer-size))))
 
 (define-cproc socket-output-port (sock::<socket>
-                                  :key (buffering #f) (buffered? #f))
+                                  :key (buffering #f) (buffered? #f)
+                                  (buffer-size::<fixnum> 0))
   (let* ([bufmode::int])
     (cond [(not (SCM_FALSEP buffered?)) ;for backward compatibility
            (set! bufmode SCM_PORT_BUFFER_FULL)]
@@ -193,7 +195,7 @@
            (set! bufmode (Scm_BufferingMode buffering
                                             SCM_PORT_OUTPUT
                                             SCM_PORT_BUFFER_LINE))])
-    (return (Scm_SocketOutputPort sock bufmode))))
+    (return (Scm_SocketOutputPortFull sock bufmode buffer-size))))
 
 (inline-stub 
  (if "defined(SHUT_RD) && defined(SHUD_WR) && defined(SHUT_RDWR)"
@@ -225,6 +227,11 @@
 (define-cproc socket-connect (sock::<socket> addr::<socket-address>)
   Scm_SocketConnect)
 
+(inline-stub
+ (when "!defined(GAUCHE_WINDOWS)"
+   (define-cproc %socket-connect-any (addrs::<list> delay::<long>)
+     Scm_SocketConnectAny)))
+
 (define-cproc socket-getsockname (sock::<socket>)
   Scm_SocketGetSockName)
 
@@ -242,6 +249,68 @@
 (define-cproc socket-sendmsg (sock::<socket> msg :optional (flags::<fixnum> 0))
   Scm_SocketSendMsg)
 
+(define-cproc socket-sendfile (sock::<socket> src :optional (count #f))
+  Scm_SocketSendFile)
+
+(define-cproc port-transfer (src::<input-port> dst::<output-port>
+                             :optional (count #f))
+  Scm_PortTransfer)
+
+;; used by net.http-server
+(define-cproc %http-parse-request-head (buf::<u8vector> start::<fixnum>
+                                        end::<fixnum>)
+  (return (Scm_HttpParseRequestHead (SCM_UVECTOR buf) start end)))
+(define-cproc %http-find-eol (buf::<u8vector> start::<fixnum> end::<fixnum>)
+  (return (Scm_HttpFindEol (SCM_UVECTOR buf) start end)))
+
+;;----------------------------------------------------------
+;; Asynchronous I/O
+
+(inline-stub
+ (when "!defined(GAUCHE_WINDOWS)"
+   (define-type <aio-context> "ScmAioContext*" "aio context"
+     "SCM_AIO_CONTEXT_P" "SCM_AIO_CONTEXT")
+   (define-type <aio-request> "ScmAioRequest*" "aio request"
+     "SCM_AIO_REQUEST_P" "SCM_AIO_REQUEST")
+
+   (define-cproc make-aio-context (:key (backend #f)
+                                        (entries::<fixnum> 0)
+                                        (threads::<fixnum> 0))
+     (return (Scm_MakeAioContext backend entries threads)))
+
+   (define-cproc aio-context-backend (c::<aio-context>) Scm_AioContextBackend)
+   (define-cproc aio-context-fd (c::<aio-context>) ::<int> Scm_AioContextFd)
+   (define-cproc aio-context-close (c::<aio-context>) ::<void>
+     (Scm_AioContextClose c))
+
+   (define-cproc aio-read! (c::<aio-context> target buf::<uvector>
+                            :optional (offset #f) (tag #f))
+     Scm_AioRead)
+   (define-cproc aio-write! (c::<aio-context> target buf::<uvector>
+                             :optional (offset #f) (tag #f))
+     Scm_AioWrite)
+   (define-cproc aio-accept! (c::<aio-context> sock::<socket>
+                              :optional (tag #f))
+     Scm_AioAccept)
+   (define-cproc aio-connect! (c::<aio-context> sock::<socket>
+                               addr::<socket-address> :optional (tag #f))
+     Scm_AioConnect)
+
+   (define-cproc aio-submit! (c::<aio-context>) ::<fixnum> Scm_AioSubmit)
+   (define-cproc aio-wait (c::<aio-context> :optional (min::<fixnum> 1)
+                                                      (timeout #f))
+     Scm_AioWait)
+
+   (define-cproc aio-request-op (r::<aio-request>) Scm_AioRequestOp)
+   (define-cproc aio-request-target (r::<aio-request>) (return (-> r target)))
+   (define-cproc aio-request-tag (r::<aio-request>) (return (-> r tag)))
+   (define-cproc aio-request-done? (r::<aio-request>) ::<boolean>
+     (return (== (-> r state) SCM_AIO_DONE)))
+   (define-cproc aio-request-result (r::<aio-request>) (return (-> r result)))
+   (define-cproc aio-request-error (r::<aio-request>)
+     (return (?: (-> r error) (SCM_MAKE_INT (-> r error)) SCM_FALSE)))
+   ))
+
 (define-cproc socket-recv (sock::<socket> bytes::<fixnum>
                            :optional (flags::<fixnum> 0))
   Scm_SocketRecv)
@@ -258,6 +327,14 @@
                                 :optional (flags::<fixnum> 0))
   Scm_SocketRecvFromX)
 
+(define-cproc socket-recvmmsg! (sock::<socket> bufs::<vector> lens::<u32vector>
+                                :optional (addrs #f) (flags::<fixnum> 0))
+  Scm_SocketRecvMMsgX)
+
+(define-cproc socket-sendmmsg (sock::<socket> msgs::<vector>
+                               :optional (addrs #f) (flags::<fixnum> 0))
+  Scm_SocketSendMMsg)
+
 ;; struct msghdr builder
 (define-cproc socket-buildmsg (name::<socket-address>?
                                iov::<vector>?
@@ -440,6 +517,31 @@
           (return (Scm_GetAddrinfo nodename servname
                                    (?: (SCM_FALSEP hints) NULL (& ai))))))
 
+      (define-cproc resolver-getaddrinfo (nodename::<const-cstring>?
+                                          servname::<const-cstring>?
+                                          hints
+                                          :key (timeout #f))
+        (let* ([ai::(struct addrinfo)])
+          (unless (or (SCM_SYS_ADDRINFO_P hints) (SCM_FALSEP hints))
+            (SCM_TYPE_ERROR hints "<sys-addrinfo> or #f"))
+          (unless (SCM_FALSEP hints)
+            (memset (& ai) 0 (sizeof ai))
+            (set! (ref ai ai_flags)  (-> (SCM_SYS_ADDRINFO hints) flags)
+                  (ref ai ai_family) (-> (SCM_SYS_ADDRINFO hints) family)
+                  (ref ai ai_socktype) (-> (SCM_SYS_ADDRINFO hints) socktype)
+                  (ref ai ai_protocol) (-> (SCM_SYS_ADDRINFO hints) protocol)))
+          (return (Scm_ResolverGetAddrinfo nodename servname
+                                           (?: (SCM_FALSEP hints) NULL (& ai))
+                                           timeout))))
+
+      (define-cproc resolver-cache-clear! (:optional
+                                           (nodename::<const-cstring>? #f))
+        ::<void> Scm_ResolverFlush)
+
+      (define-cproc %resolver-configure (ttl::<double> negttl::<double>
+                                         max-entries::<int> max-threads::<int>)
+        Scm_ResolverConfigure)
+
       (define-cproc sys-getnameinfo
         (addr::<socket-address> :optional flags::<fixnum>)
         Scm_GetNameinfo)
@@ -13,7 +13,9 @@
 (use gauche.net)
 (test-module 'gauche.net
              :allow-undefined '(sys-getaddrinfo <sys-addrinfo>
-                                AI_PASSIVE PF_INET6))
+                                AI_PASSIVE PF_INET6
+                                resolver-getaddrinfo %resolver-configure
+                                %socket-connect-any))
 
 ;;-----------------------------------------------------------------
 (test-section "socket address")
@@ -264,6 +266,42 @@
             '(23       21)
             '("tcp"    "tcp")))
 
+(cond-expand
+ [gauche.net.ipv6
+  (let ([hints (make-sys-addrinfo :flags AI_NUMERICHOST :socktype SOCK_STREAM)]
+        [names (^[ais] (map (^[ai] (sockaddr-name (slot-ref ai 'addr))) ais))]
+        [stat  (^[key] (assq-ref (resolver-stats) key))])
+    (resolver-cache-clear!)
+    (test* "resolver-getaddrinfo" '("127.0.0.1:80")
+           (names (resolver-getaddrinfo "127.0.0.1" "80" hints)))
+    (test* "resolver-getaddrinfo (cached)" '(("127.0.0.1:80") 1)
+           (let1 h (stat 'hits)
+             (list (names (resolver-getaddrinfo "127.0.0.1" "80" hints
+                                                :timeout 10))
+                   (- (stat 'hits) h))))
+    (test* "resolver-getaddrinfo (negative)" '(#t 1)
+           (let1 h (stat 'hits)
+             (list (every (^_ (test-error?
+                               (guard (e [else (test-error)])
+                                 (resolver-getaddrinfo "no.such.address" "80"
+                                                       hints))))
+                          '(1 2))
+                   (- (stat 'hits) h))))
+    (test* "resolver-cache-clear!" 1
+           (let1 m (stat 'misses)
+             (resolver-cache-clear! "127.0.0.1")
+             (resolver-getaddrinfo "127.0.0.1" "80" hints)
+             (- (stat 'misses) m)))
+    (test* "resolver-configure! :ttl 0" 2
+           (let1 m (stat 'misses)
+             (resolver-configure! :ttl 0)
+             (resolver-getaddrinfo "127.0.0.1" "8080" hints)
+             (resolver-getaddrinfo "127.0.0.1" "8080" hints)
+             (resolver-configure! :ttl 60)
+             (- (stat 'misses) m)))
+    )]
+ [else])
+
 ;;-----------------------------------------------------------------
 (test-section "Packet utility")
 
@@ -415,6 +453,34 @@
            (receive (pid code) (sys-wait)
              (sys-wait-exit-status code)))))
 
+;; Find a port nobody listens, to get "connection refused".
+(define (closed-inet-port)
+  (let* ([s (make-server-socket 'inet 0)]
+         [p (sockaddr-port (socket-address s))])
+    (socket-close s)
+    p))
+
+(when (global-variable-bound? 'gauche.net '%socket-connect-any)
+  (test* "connecting to multiple addresses (all refused)" (test-error)
+         (let1 p (closed-inet-port)
+           ((with-module gauche.net %socket-connect-any)
+            (list (make <sockaddr-in> :host "127.0.0.1" :port p)
+                  (make <sockaddr-in> :host "127.0.0.1" :port p))
+            50)))
+  (test* "connecting to multiple addresses (fallback)" #t
+         (let* ([srv (make-server-socket 'inet 0)]
+                [port (sockaddr-port (socket-address srv))]
+                [sock ((with-module gauche.net %socket-connect-any)
+                       (list (make <sockaddr-in> :host "127.0.0.1"
+                                   :port (closed-inet-port))
+                             (make <sockaddr-in> :host "127.0.0.1"
+                                   :port port))
+                       50)])
+           (begin0 (and (eq? (socket-status sock) 'connected)
+                        (= (sockaddr-port (socket-address sock)) port))
+             (socket-close sock)
+             (socket-close srv)))))
+
 
 (cond-expand
  [gauche.net.ipv6
@@ -465,6 +531,21 @@
          (close-socket s)
          (socket-output-port s)))
 
+(test* "socket port buffer size" '(128 64 "hello")
+       (let* ([addr (make <sockaddr-in> :host :loopback :port *inet-port*)]
+              [serv (make-server-socket addr :reuse-addr? #t)]
+              [clnt (make-client-socket addr)]
+              [conn (socket-accept serv)])
+         (unwind-protect
+             (let ([in (socket-input-port conn :buffer-size 128)]
+                   [out (socket-output-port clnt :buffer-size 64)])
+               (display "hello\n" out)
+               (flush out)
+               (list (slot-ref in 'buffer-size)
+                     (slot-ref out 'buffer-size)
+                     (read-line in)))
+           (for-each socket-close (list conn clnt serv)))))
+
 (test* "getsockname/getpeername" #t
        (let* ([addr (make <sockaddr-in> :host :loopback :port *inet-port*)]
               [serv (make-server-socket addr :reuse-addr? #t)]
@@ -542,6 +623,37 @@
                 (list (eq? f-addr from)
                       (equal? buf data))))))))
 
+(with-sr-udp
+ (^[s-sock s-addr r-sock r-addr]
+   (let ([bufs (vector (make-u8vector 16 0) (make-u8vector 16 0)
+                       (make-u8vector 16 0) (make-u8vector 16 0))]
+         [lens (make-u32vector 4 0)]
+         [from (make <sockaddr-in>)])
+     (test* "udp sendmmsg" 3
+            (socket-sendmmsg s-sock `#("abc" ,(u8vector 1 2) "defgh")
+                             (make-vector 3 s-addr)))
+     (test* "udp recvmmsg!" '(3 (3 2 5) #t)
+            (let* ([addrs (vector from #f #f #f)]
+                   [n (socket-recvmmsg! r-sock bufs lens addrs)])
+              (list n (u32vector->list lens 0 3)
+                    (eq? (vector-ref addrs 0) from))))
+     (test* "udp recvmmsg! content" '(#u8(97 98 99) #u8(1 2)
+                                      #u8(100 101 102 103 104))
+            (map (^[b k] (u8vector-copy b 0 k))
+                 (vector->list bufs 0 3) (u32vector->list lens 0 3))))))
+
+(cond-expand
+ [(and (not gauche.os.cygwin)
+       (not gauche.os.windows))
+  (with-sr-udp
+   (^[s-sock s-addr r-sock r-addr]
+     (test* "udp sendto with chunks" "abcdef"
+            (begin
+              (socket-sendto s-sock `("ab" ,(string->u8vector "cd") "ef") s-addr)
+              (receive (msg from) (socket-recvfrom r-sock 1024)
+                (string-incomplete->complete msg))))))]
+ [else #f])
+
 (cond-expand
  ;; NB: as of 0.9, sendmsg fails on cygwin.  We don't have time to track
  ;; it down yet.  For now, we skip the tests.
@@ -570,6 +682,149 @@
        (test* "udp sendmsg w/o sendbuf" '(#t #t) (xtest #f)))))]
  [else #f])
 
+;;-----------------------------------------------------------------
+(test-section "bulk transfer")
+
+(define *xfer-data*
+  (with-output-to-string
+    (^[] (dotimes [i 2000] (format #t "line ~4d\n" i)))))
+
+(with-output-to-file "xfer.o" (cut display *xfer-data*))
+
+(test* "port-transfer (file to file)" '(20000 #t)
+       (let1 n (call-with-input-file "xfer.o"
+                 (^[in] (call-with-output-file "xfer2.o"
+                          (^[out] (port-transfer in out)))))
+         (list n (equal? (call-with-input-file "xfer2.o" port->string) *xfer-data*))))
+
+(test* "port-transfer (buffered data, count)" '(100 #t)
+       (let1 n (call-with-input-file "xfer.o"
+                 (^[in]
+                   (read-line in)
+                   (call-with-output-file "xfer2.o"
+                     (^[out] (display "head" out) (port-transfer in out 100)))))
+         (list n (equal? (call-with-input-file "xfer2.o" port->string)
+                         (string-append "head"
+                                        (substring *xfer-data* 10 110))))))
+
+(test* "port-transfer (to string port)" *xfer-data*
+       (call-with-output-string
+         (^[out] (call-with-input-file "xfer.o" (cut port-transfer <> out)))))
+
+(test* "port-transfer (from string port)" '(20000 #t)
+       (let1 n (call-with-output-file "xfer2.o"
+                 (^[out] (port-transfer (open-input-string *xfer-data*) out)))
+         (list n (equal? (call-with-input-file "xfer2.o" port->string) *xfer-data*))))
+
+(test* "socket-sendfile" '(20000 #t)
+       (let* ([addr (make <sockaddr-in> :host :loopback :port *inet-port*)]
+              [serv (make-server-socket addr :reuse-addr? #t)]
+              [clnt (make-client-socket addr)]
+              [conn (socket-accept serv)])
+         (unwind-protect
+             (let1 n (call-with-input-file "xfer.o"
+                       (cut socket-sendfile clnt <>))
+               (socket-shutdown clnt SHUT_WR)
+               (list n (equal? (port->string (socket-input-port conn))
+                               *xfer-data*)))
+           (for-each socket-close (list conn clnt serv)))))
+
+;;-----------------------------------------------------------------
+(test-section "asynchronous I/O")
+
+(cond-expand
+ [gauche.net.aio
+  (define (aio-tests backend)
+    (let1 ctx (guard (e [else #f]) (make-aio-context :backend backend))
+      (when ctx
+        (unwind-protect
+            (aio-tests-1 ctx backend)
+          (aio-context-close ctx)))))
+
+  (define (aio-tests-1 ctx backend)
+    (test* #"aio backend (~backend)" backend (aio-context-backend ctx))
+    (test* #"aio wait without requests (~backend)" '() (aio-wait ctx))
+    (test* #"aio read with offsets (~backend)"
+           (list '(a 10 b 10)
+                 (string->u8vector (substring *xfer-data* 0 10))
+                 (string->u8vector (substring *xfer-data* 100 110)))
+           (call-with-input-file "xfer.o"
+             (^[in]
+               (let ([b0 (make-u8vector 10)]
+                     [b1 (make-u8vector 10)])
+                 (aio-read! ctx in b0 0 'a)
+                 (aio-read! ctx (port-file-number in) b1 100 'b)
+                 (let* ([rs (aio-wait ctx 2)]
+                        [rs (sort rs (^[r1 r2]
+                                       (eq? (aio-request-tag r1) 'a)))])
+                   (list (append-map (^r (list (aio-request-tag r)
+                                               (aio-request-result r)))
+                                     rs)
+                         b0 b1))))))
+    (test* #"aio write (~backend)" "abcdefghij"
+           (begin
+             (call-with-output-file "xfer2.o"
+               (^[out]
+                 (aio-write! ctx out (string->u8vector "fghij") 5)
+                 (aio-write! ctx out (string->u8vector "abcde") 0)
+                 (aio-wait ctx 2)))
+             (call-with-input-file "xfer2.o" port->string)))
+    (test* #"aio read error (~backend)" '(#f #t)
+           (let1 r (call-with-output-file "xfer2.o"
+                     (^[out]
+                       (aio-read! ctx out (make-u8vector 4))
+                       (car (aio-wait ctx))))
+             (list (aio-request-result r) (integer? (aio-request-error r)))))
+    (test* #"aio accept/connect (~backend)" '(#t #t "hello")
+           (let* ([serv (make-server-socket 'inet 0 :reuse-addr? #t)]
+                  [port (sockaddr-port (socket-address serv))]
+                  [clnt (make-socket PF_INET SOCK_STREAM)]
+                  ;; connect is staged first, so that the sync backend
+                  ;; won't block in accept.
+                  [rc (aio-connect! ctx clnt
+                                    (make <sockaddr-in> :host :loopback
+                                          :port port)
+                                    'connect)]
+                  [ra (aio-accept! ctx serv 'accept)])
+             (let loop ()
+               (unless (and (aio-request-done? ra) (aio-request-done? rc))
+                 (aio-wait ctx)
+                 (loop)))
+             (let1 conn (aio-request-result ra)
+               (unwind-protect
+                   (begin
+                     (aio-write! ctx clnt (string->u8vector "hello"))
+                     (aio-wait ctx)
+                     (let1 buf (make-u8vector 5)
+                       (aio-read! ctx conn buf)
+                       (aio-wait ctx)
+                       (list (eq? (aio-request-result rc) clnt)
+                             (is-a? conn <socket>)
+                             (u8vector->string buf))))
+                 (for-each socket-close (list conn clnt serv)))))))
+
+  (for-each aio-tests '(io-uring threads sync))
+
+  (test* "aio context fd with selector" #t
+         (let ([ctx (make-aio-context :backend 'sync)]
+               [buf (make-u8vector 4)])
+           (unwind-protect
+               (call-with-input-file "xfer.o"
+                 (^[in]
+                   (aio-read! ctx in buf 0)
+                   (aio-submit! ctx)
+                   (let1 r (sys-select! (rlet1 fds (make <sys-fdset>)
+                                          (sys-fdset-set! fds (aio-context-fd ctx) #t))
+                                        #f #f 1000000)
+                     (and (= r 1)
+                          (= (length (aio-wait ctx 0)) 1)))))
+             (aio-context-close ctx))))]
+ [else])
+
+(sys-unlink "xfer.o")
+(sys-unlink "xfer2.o")
+
+
 ;;-----------------------------------------------------------------
 (test-section "srfi-106")
 
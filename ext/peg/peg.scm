@@ -44,7 +44,7 @@
 
           peg-run-parser
           peg-parse-string peg-parse-port
-          peg-parser->generator ;experimental
+          peg-parser->generator
 
           parse-success?
           return-result return-failure/expect return-failure/unexpect
@@ -60,7 +60,7 @@
           $sep-by $end-by $sep-end-by
           $count $between $followed-by
           $not $many-till $chain-left $chain-right
-          $lazy
+          $lazy $memo
 
           $s $c $y
           $string $string-ci
@@ -270,7 +270,11 @@
   (values-ref (peg-run-parser parser (x->lseq port)) 0))
 
 ;; API
-;;  Returns a generator
+;;  Returns a generator that yields the results of repeatedly applying
+;;  PARSER on SRC, until PARSER returns an EOF object or the input is
+;;  exhausted.  This is the streaming mode: SRC can be a port or a
+;;  generator, and only the part of the input from the current parse
+;;  position is retained, so the whole input need not fit in memory.
 (define (peg-parser->generator parser src)
   (let1 s (%->lseq src)
     (^[] (if (null? s)
@@ -311,6 +315,16 @@
    (let* ([p (Scm_MakeOutputStringPort TRUE)])
      (rope2string_int obj p)
      (return (Scm_GetOutputString (SCM_PORT p) 0))))
+
+ ;; Weak-key tables used for the memo tables of $memo and for the
+ ;; annotation of character-class parsers.  Neither should keep the
+ ;; input stream or a discarded parser alive.
+ (define-cproc %make-weak-table ()
+   (return (Scm_MakeWeakHashTableSimple SCM_HASH_EQ SCM_WEAK_KEY 0 SCM_FALSE)))
+ (define-cproc %weak-table-ref (tab::<weak-hash-table> key)
+   (return (Scm_WeakHashTableRef tab key SCM_FALSE)))
+ (define-cproc %weak-table-put! (tab::<weak-hash-table> key val) ::<void>
+   (Scm_WeakHashTableSet tab key val 0))
  )
 
 ;;;============================================================
@@ -486,6 +500,24 @@
      (let ((p (delay parse)))
        (lambda (s) ((force p) s)))]))
 
+;; API
+;; $memo p
+;;   Packrat memoization.  Returns a parser that behaves like P, but
+;;   remembers the result of P for each input position it is applied to,
+;;   so that P runs at most once per position even if backtracking
+;;   tries it again.  Useful on the named rules of a grammar that are
+;;   reached from several alternatives, e.g.
+;;     (define term ($memo ($lazy ($or ...))))
+;;   The memo table is keyed weakly by the input stream cell, so it
+;;   doesn't retain the input already consumed.
+(define ($memo parse)
+  (let1 tab (%make-weak-table)
+    (^s (if-let1 m (%weak-table-ref tab s)
+          (values (vector-ref m 0) (vector-ref m 1) (vector-ref m 2))
+          (receive (r v s1) (parse s)
+            (%weak-table-put! tab s (vector r v s1))
+            (values r v s1))))))
+
 ;; alternative $lazy possibility (need benchmark!)
 ;(define-syntax $lazy
 ;  (syntax-rules ()
@@ -518,39 +550,45 @@
 ;; $many1 p :optional max
 (define-inline ($many parse :optional (min 0) (max #f))
   (%check-min-max min max)
-  (lambda (s)
-    (let loop ([vs '()] [s s] [count 0])
-      (if (>=? count max)
-        (return-result (reverse! vs) s)
-        (receive (r v s1) (parse s)
-          (cond [(parse-success? r) (loop (cons v vs) s1 (+ count 1))]
-                [(and (eq? s s1) (<= min count))
-                 (return-result (reverse! vs) s1)]
-                [else (values r v s1)]))))))
+  (if-let1 cp (%char-parser-info parse)
+    (%scan-chars (car cp) (cdr cp) min max)
+    (lambda (s)
+      (let loop ([vs '()] [s s] [count 0])
+        (if (>=? count max)
+          (return-result (reverse! vs) s)
+          (receive (r v s1) (parse s)
+            (cond [(parse-success? r) (loop (cons v vs) s1 (+ count 1))]
+                  [(and (eq? s s1) (<= min count))
+                   (return-result (reverse! vs) s1)]
+                  [else (values r v s1)])))))))
 
 (define ($many1 parse :optional (max #f))
-  (if max
-    ($do [v parse] [vs ($many parse 0 (- max 1))] ($return (cons v vs)))
-    ($do [v parse] [vs ($many parse)] ($return (cons v vs)))))
+  (cond [(%char-parser-info parse) ($many parse 1 max)]
+        [max ($do [v parse] [vs ($many parse 0 (- max 1))] ($return (cons v vs)))]
+        [else ($do [v parse] [vs ($many parse)] ($return (cons v vs)))]))
 
 ;; API
 ;; $skip-many p :optional min max
 ;; $skip-many1 p :optional max
 ;;   Like $many, but does not keep the results. Always returns #f.
 ;;   This should be optimized; we don't need to retain intermediate values
+;;   (it is, if PARSE is a character-class parser).
 (define ($skip-many parse :optional (min 0) (max #f))
   (%check-min-max min max)
-  (if (= min 0)
-    ($do [($many parse min max)]
-         ($return #f))
-    ($do [($skip-count parse min)]
-         [($skip-many parse 0 (and max (- max min)))]
-         ($return #f))))
+  (cond [(%char-parser-info parse)
+         => (^[cp] (%skip-chars (car cp) (cdr cp) min max))]
+        [(= min 0)
+         ($do [($many parse min max)]
+              ($return #f))]
+        [else
+         ($do [($skip-count parse min)]
+              [($skip-many parse 0 (and max (- max min)))]
+              ($return #f))]))
 
 (define ($skip-many1 parse :optional (max #f))
-  (if max
-    ($do parse [($skip-many parse 0 (- max 1))] ($return #f))
-    ($do parse [($skip-many parse)] ($return #f))))
+  (cond [(%char-parser-info parse) ($skip-many parse 1 max)]
+        [max ($do parse [($skip-many parse 0 (- max 1))] ($return #f))]
+        [else ($do parse [($skip-many parse)] ($return #f))]))
 
 ;; API
 ;; $optional p :optional fallback
@@ -744,16 +782,49 @@
     (values (expand char=?)
             (expand char-ci=?))))
 
+;; Character-class parsers, i.e. the ones that consume exactly one
+;; character in a charset, are recorded here with the charset and the
+;; object they report on failure.  $many and $skip-many look them up
+;; and compile the repetition into a single scanning loop instead of
+;; calling the parser closure for each character.
+(define %char-parsers (%make-weak-table))
+
+(define (%char-parser-info parse) (%weak-table-ref %char-parsers parse))
+
+(define (%register-char-parser! parse charset expect)
+  (%weak-table-put! %char-parsers parse (cons charset expect))
+  parse)
+
+(define (%scan-chars charset expect min max)
+  (lambda (s)
+    (let loop ([vs '()] [s s] [count 0])
+      (cond [(>=? count max) (return-result (reverse! vs) s)]
+            [(and (pair? s) (char-set-contains? charset (car s)))
+             (loop (cons (car s) vs) (cdr s) (+ count 1))]
+            [(<= min count) (return-result (reverse! vs) s)]
+            [else (return-failure/expect expect s)]))))
+
+(define (%skip-chars charset expect min max)
+  (lambda (s)
+    (let loop ([s s] [count 0])
+      (cond [(>=? count max) (return-result #f s)]
+            [(and (pair? s) (char-set-contains? charset (car s)))
+             (loop (cdr s) (+ count 1))]
+            [(<= min count) (return-result #f s)]
+            [else (return-failure/expect expect s)]))))
+
 (define ($char c)
-  ($satisfy (cut char=? c <>) c))
+  (%register-char-parser! ($satisfy (cut char=? c <>) c) (char-set c) c))
 
 (define ($char-ci c)
-  ($satisfy (cut char-ci=? c <>)
-            (list->char-set c (char-upcase c) (char-downcase c))))
+  (let1 cs (list->char-set (list c (char-upcase c) (char-downcase c)))
+    (%register-char-parser! ($satisfy (cut char-set-contains? cs <>) cs)
+                            cs cs)))
 
 (define ($one-of charset)
-  ($satisfy (cut char-set-contains? charset <>)
-            charset))
+  (%register-char-parser! ($satisfy (cut char-set-contains? charset <>)
+                                    charset)
+                          charset charset))
 
 (define ($s x) ($string x))
 
@@ -762,12 +833,10 @@
 (define ($y x) ($lift ($ string->symbol $ rope->string $) ($s x)))
 
 ;; ($many-chars charset [min [max]]) == ($many ($one-of charset) [min [max]])
-;;   with possible optimization.
-(define-syntax $many-chars
-  (syntax-rules ()
-    [(_ parser) ($many ($one-of parser))]
-    [(_ parser min) ($many ($one-of parser) min)]
-    [(_ parser min max) ($many ($one-of parser) min max)]))
+;;   but doesn't create the intermediate parser.
+(define ($many-chars charset :optional (min 0) (max #f))
+  (%check-min-max min max)
+  (%scan-chars charset charset min max))
 
 (define ($none-of charset)
   ($one-of (char-set-complement charset)))
@@ -781,7 +850,8 @@
   (syntax-rules ()
     ((_ proc charset expect)
      (define proc
-       ($expect ($one-of charset) expect)))))
+       (%register-char-parser! ($expect ($one-of charset) expect)
+                               charset expect)))))
 
 (define-char-parser upper    #[A-Z]         "upper case letter")
 (define-char-parser lower    #[a-z]         "lower case letter")
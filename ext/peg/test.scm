@@ -306,6 +306,33 @@
 (test-succ "$skip-many" #\b
            ($seq ($skip-many ($string "a")) ($one-of #[a-z])) "baaaaa")
 
+;; $many and $skip-many over character-class parsers are compiled into
+;; scanning loops; they should behave the same as the generic ones.
+(test-succ "$many (charset)" '(#\a #\b #\a)
+           ($many ($one-of #[ab])) "abacd")
+(test-succ "$many (charset)" '(#\a #\b)
+           ($many ($one-of #[ab]) 1 2) "abacd")
+(test-fail "$many (charset)" '(2 "digit")
+           ($many digit 3) "12a")
+(test-fail "$many (char)" '(1 #\a)
+           ($many ($char #\a) 2) "ab")
+(test-succ "$many1 (charset)" '(#\1 #\2)
+           ($many1 digit) "12a")
+(test-fail "$many1 (charset)" '(0 "digit")
+           ($many1 digit) "a12")
+(test-succ "$skip-many (charset)" #\c
+           ($seq ($skip-many ($one-of #[ab])) ($one-of #[a-z])) "abacd")
+(test-succ "$skip-many (charset)" #\a
+           ($seq ($skip-many ($one-of #[ab]) 1 2) ($one-of #[a-z])) "abacd")
+(test-fail "$skip-many (charset)" '(3 #[ab])
+           ($skip-many ($one-of #[ab]) 4) "abacd")
+(test-succ "$skip-many1 (charset)" #\x
+           ($seq ($skip-many1 space) anychar) "  x")
+(test-fail "$skip-many1 (charset)" '(0 "space")
+           ($seq ($skip-many1 space) anychar) "x")
+(test-succ "$skip-many (char-ci)" #\b
+           ($seq ($skip-many ($char-ci #\a)) anychar) "aAab")
+
 ;; $repeat
 (test-succ "$repeat" '(#\a #\b #\a)
            ($repeat anychar 3) "abab")
@@ -632,6 +659,33 @@
   (test-succ "tag element" '("a" "foo" ("b" "bar") "baz")
              element "<a>foo<b>bar</b>baz</a>"))
 
+;; $memo
+(let* ([count 0]
+       [p ($memo ($do [v ($many digit 1)]
+                      ($return (begin (inc! count) (apply string v)))))]
+       [q ($or ($try ($seq p ($char #\+) p))
+               ($try ($seq p ($char #\-) p))
+               p)])
+  (test-succ "$memo" "12" q "12*3")
+  (test* "$memo (count)" 1 count))
+
+(let* ([count 0]
+        [p ($memo (^s (inc! count) (digit s)))])
+  (test* "$memo (failure)" 1
+         (begin
+           (guard (e [(<parse-error> e) #f])
+             (peg-parse-string ($or ($seq p ($char #\a)) ($seq p ($char #\b)))
+                               "x"))
+           count)))
+
+;; streaming
+(test* "peg-parser->generator" '("ab" "cd" "ef")
+       (generator->list
+        (peg-parser->generator ($or ($seq ($skip-many space) eof)
+                                    ($->string ($many1 letter)
+                                               ($skip-many space)))
+                               (open-input-string "ab cd  ef"))))
+
 ;; Calculator
 (letrec ([integer ($do (v ($many digit 1))
                        ($return (string->number (apply string v))))]
@@ -648,187 +702,4 @@
   (test-succ "calculator" -1 expr "1-2"))
 
 
-;;;============================================================
-;;; rfc.json
-;;;   Test is here since the module uses parser.peg.
-
-(test-section "rfc.json")
-(use rfc.json)
-(test-module 'rfc.json)
-
-(let ()
-  (define (t str val)
-    (test* "primitive" `(("x" . ,val)) (parse-json-string str)))
-  (t "{\"x\": 100 }" 100)
-  (t "{\"x\" : -100}" -100)
-  (t "{\"x\":  +100 }" 100)
-  (t "{\"x\": 12.5} " 12.5)
-  (t "{\"x\":-12.5}" -12.5)
-  (t "{\"x\":+12.5}"  12.5)
-  (t "{\"x\": 1.25e1 }" 12.5)
-  (t "{\"x\":125e-1}" 12.5)
-  (t "{\"x\":1250.0e-2}" 12.5)
-  (t "{\"x\":  false  }" 'false)
-  (t "{\"x\":true}" 'true)
-  (t "{\"x\":null}" 'null)
-  (t "{\"x\": \"abc\\\"\\\\\\/\\b\\f\\n\\r\\t\\u0040abc\"}"
-     "abc\"\\/\u0008\u000c\u000a\u000d\u0009@abc")
-  )
-
-(let ()
-  (define (t str)
-    (test* #"parse error ~str" (test-error <json-parse-error>)
-           (parse-json-string str)))
-  (t "{\"x\": 100")
-  (t "{x : 100}}")
-  )
-
-(test* "parsing an object"
-       '(("Image"
-          ("Width"  . 800)
-          ("Height" . 600)
-          ("Title"  . "View from 15th Floor")
-          ("Thumbnail"
-           ("Url"    . "http://www.example.com/image/481989943")
-           ("Height" . 125)
-           ("Width"  . "100"))
-          ("IDs" . #(116 943 234 38793))))
-       (parse-json-string "{
-   \"Image\": {
-       \"Width\":  800,
-       \"Height\": 600,
-       \"Title\":  \"View from 15th Floor\",
-       \"Thumbnail\": {
-           \"Url\":    \"http://www.example.com/image/481989943\",
-           \"Height\": 125,
-           \"Width\":  \"100\"
-       },
-       \"IDs\": [116, 943, 234, 38793]
-     }
-}"))
-
-(test* "parsing an array containing two objects"
-       '#((("precision" . "zip")
-           ("Latitude"  . 37.7668)
-           ("Longitude" . -122.3959)
-           ("Address"   . "")
-           ("City"      . "SAN FRANCISCO")
-           ("State"     . "CA")
-           ("Zip"       . "94107")
-           ("Country"   . "US"))
-          (("precision" . "zip")
-           ("Latitude"  . 37.371991)
-           ("Longitude" . -122.026020)
-           ("Address"   . "")
-           ("City"      . "SUNNYVALE")
-           ("State"     . "CA")
-           ("Zip"       . "94085")
-           ("Country"   . "US")))
-       (parse-json-string "[
-   {
-      \"precision\": \"zip\",
-      \"Latitude\":  37.7668,
-      \"Longitude\": -122.3959,
-      \"Address\":   \"\",
-      \"City\":      \"SAN FRANCISCO\",
-      \"State\":     \"CA\",
-      \"Zip\":       \"94107\",
-      \"Country\":   \"US\"
-   },
-   {
-      \"precision\": \"zip\",
-      \"Latitude\":  37.371991,
-      \"Longitude\": -122.026020,
-      \"Address\":   \"\",
-      \"City\":      \"SUNNYVALE\",
-      \"State\":     \"CA\",
-      \"Zip\":       \"94085\",
-      \"Country\":   \"US\"
-   }
-]"))
-
-(test* "Parsing sequence of json objects"
-       '((("a" . 1)("b" . 2)) (("c" . 3) ("d" . 4)))
-       (with-input-from-string "{\"a\":1, \"b\":2}{\"c\":3, \"d\":4}"
-         parse-json*))
-
-(test* "Customizing consturctors"
-       '(object ("x" array 1 2 3) ("y" array #f #t null))
-       (parameterize ([json-array-handler (^[elts] (cons 'array elts))]
-                      [json-object-handler (^[pairs] (cons 'object pairs))]
-                      [json-special-handler (^y (case y
-                                                  [(false) #f]
-                                                  [(true) #t]
-                                                  [(null) 'null]))])
-         (parse-json-string "{\"x\":[1,2,3],\"y\":[false,true,null]}")))
-
-(let ()
-  (define (test-writer name obj)
-    (test* name obj
-           (parse-json-string (construct-json-string obj))))
-
-  (test-writer "writing an object"
-               '(("Image"
-                  ("Width"  . 800)
-                  ("Height" . 600)
-                  ("Title"  . "View from 15th Floor \"magnificent\"")
-                  ("Thumbnail"
-                   ("Url"    . "http://www.example.com/image/481989943")
-                   ("Height" . 125)
-                   ("Width"  . "100"))
-                  ("Description" . "Foo\nbackslash \\and tab\t and \u00a1")
-                  ("IDs" . #(116 943 234 38793))
-                  ("Misc" . ()))))
-
-  (test-writer "writing an array containing two objects"
-               '#((("precision" . "zip")
-                   ("Latitude"  . 37.7668)
-                   ("Longitude" . -122.3959)
-                   ("Address"   . "")
-                   ("City"      . "SAN FRANCISCO")
-                   ("State"     . "CA")
-                   ("Zip"       . "94107")
-                   ("Country"   . "US"))
-                  (("precision" . "zip")
-                   ("Latitude"  . 37.371991)
-                   ("Longitude" . -122.026020)
-                   ("Address"   . "")
-                   ("City"      . "SUNNYVALE")
-                   ("State"     . "CA")
-                   ("Zip"       . "94085")
-                   ("Country"   . "US"))))
-  )
-
-(cond-expand
- [gauche.ces.utf8
-  (let1 data `(("[\"\\u03bb\"]" #("\x3bb;"))
-               ("[\"\\ud800\"]" ,(test-error <json-parse-error>))
-               ("[\"\\ud867\\ude3d\\u03bb\"]" #("\x29e3d;\x3bb;"))
-               ("[\"\\ude3d\\ud867\"]" ,(test-error <json-parse-error>))
-               ("[\"\\uf020\\u03bb\"]"  #("\xf020;\x3bb;")))
-    (dolist [d data]
-      (test* (format "unicode escape reading (~s)" (car d))
-             (cadr d)
-             (parse-json-string (car d)))
-      (when (vector? (cadr data))
-        (test* (format "unicode escape writing (~s)" (cadr d))
-               (car d)
-               (construct-json-string (cadr d))))))]
- [else])
-
-(let ()
-  (define (t obj)
-    (test* #"writer error ~obj" (test-error <json-construct-error>)
-           (construct-json-string obj)))
-  (t "a")
-  (t '#(1 2 x))
-  (t '(("a" . 2) 9)))
-
-(test* "generalized array" "[1,2,3]"
-       (construct-json-string '#u8(1 2 3)))
-(test* "generalized object" (test-one-of "{\"a\":1,\"b\":2}"
-                                         "{\"b\":2,\"a\":1}")
-       (construct-json-string (hash-table 'eq? '(a . 1) '(b . 2))))
-
-
 (test-end)
@@ -0,0 +1,671 @@
+/*
+ * base64.c - native Base64 and Base16 codec
+ *
+ *   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * The scalar codec handles everything; on x86 with SSSE3 or AVX2, and
+ * on AArch64, the bulk of the input is processed by vector kernels as
+ * well, which follow Wojciech Muła's and Daniel Lemire's published
+ * algorithms.  A vector decoder gives up a block as soon as it sees a
+ * character outside of the alphabet (newlines, '=' or junk), and the
+ * scalar decoder takes over until it reaches a group boundary again.
+ */
+
+#include "base64.h"
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) \
+    && (defined(__clang__) \
+        || (defined(__GNUC__) \
+            && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define BASE64_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) && defined(__GNUC__)
+#define BASE64_SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
+static const char std_chars[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+static const char url_chars[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+/* Decode tables: a sextet, DEC_SKIP or DEC_PAD.  Filled in
+   Scm_Init_base64. */
+#define DEC_SKIP  (-1)
+#define DEC_PAD   (-2)
+static signed char std_decode[256];
+static signed char url_decode[256];
+
+#define ENCODE_TABLE(flags) \
+    (((flags)&BASE64_URL_SAFE)? url_chars : std_chars)
+#define DECODE_TABLE(flags) \
+    (((flags)&BASE64_URL_SAFE)? url_decode : std_decode)
+
+/* Vector kernels.  The encoder returns the number of input bytes
+   consumed (4/3 of which are written); the decoder returns the number
+   of characters consumed (3/4 of which are written, but it may store
+   up to 4 bytes beyond that). */
+static size_t (*encode_simd)(const unsigned char*, size_t, char*, int) = NULL;
+static size_t (*decode_simd)(const unsigned char*, size_t,
+                             unsigned char*, int) = NULL;
+
+/*================================================================
+ * x86
+ */
+
+#if defined(BASE64_SIMD_X86)
+
+/* Maps 6-bit indices to characters.  See Muła, "Base64 encoding with
+   SIMD instructions"; we use the variant with one pshufb. */
+#define ENC_LUT(flags)                                                  \
+    (((flags)&BASE64_URL_SAFE)                                          \
+     ? _mm_setr_epi8('a'-26, '0'-52, '0'-52, '0'-52, '0'-52, '0'-52,    \
+                     '0'-52, '0'-52, '0'-52, '0'-52, '0'-52, '-'-62,    \
+                     '_'-63, 'A', 0, 0)                                 \
+     : _mm_setr_epi8('a'-26, '0'-52, '0'-52, '0'-52, '0'-52, '0'-52,    \
+                     '0'-52, '0'-52, '0'-52, '0'-52, '0'-52, '+'-62,    \
+                     '/'-63, 'A', 0, 0))
+
+__attribute__((target("ssse3")))
+static inline __m128i enc_block_ssse3(__m128i in, __m128i lut)
+{
+    in = _mm_shuffle_epi8(in, _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4,
+                                            7, 6, 8, 7, 10, 9, 11, 10));
+    __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+    __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+    __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+    __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+    __m128i idx = _mm_or_si128(t1, t3);
+    __m128i r = _mm_subs_epu8(idx, _mm_set1_epi8(51));
+    __m128i lt = _mm_cmpgt_epi8(_mm_set1_epi8(26), idx);
+    r = _mm_or_si128(r, _mm_and_si128(lt, _mm_set1_epi8(13)));
+    return _mm_add_epi8(_mm_shuffle_epi8(lut, r), idx);
+}
+
+/* Converts 16 characters into sextets.  Returns FALSE if there's
+   a character outside the alphabet. */
+__attribute__((target("ssse3")))
+static inline int dec_block_ssse3(__m128i *pin, int flags)
+{
+    const __m128i lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11,
+                                         0x11, 0x11, 0x11, 0x11,
+                                         0x11, 0x11, 0x13, 0x1a,
+                                         0x1b, 0x1b, 0x1b, 0x1a);
+    const __m128i lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02,
+                                         0x04, 0x08, 0x04, 0x08,
+                                         0x10, 0x10, 0x10, 0x10,
+                                         0x10, 0x10, 0x10, 0x10);
+    const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71,
+                                           0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i mask_2f = _mm_set1_epi8(0x2f);
+    __m128i in = *pin;
+
+    if (flags & BASE64_URL_SAFE) {
+        /* Reject '+' and '/', then map '-' and '_' to them. */
+        __m128i plus = _mm_cmpeq_epi8(in, _mm_set1_epi8('+'));
+        __m128i slash = _mm_cmpeq_epi8(in, mask_2f);
+        if (_mm_movemask_epi8(_mm_or_si128(plus, slash))) return FALSE;
+        __m128i minus = _mm_cmpeq_epi8(in, _mm_set1_epi8('-'));
+        __m128i under = _mm_cmpeq_epi8(in, _mm_set1_epi8('_'));
+        in = _mm_add_epi8(in, _mm_and_si128(minus, _mm_set1_epi8('+'-'-')));
+        in = _mm_add_epi8(in, _mm_and_si128(under, _mm_set1_epi8('/'-'_')));
+    }
+
+    __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(in, 4), mask_2f);
+    __m128i lo_nibbles = _mm_and_si128(in, mask_2f);
+    __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+    __m128i lo = _mm_shuffle_epi8(lut_lo, lo_nibbles);
+    if (_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_and_si128(lo, hi),
+                                         _mm_setzero_si128()))) {
+        return FALSE;
+    }
+    __m128i eq_2f = _mm_cmpeq_epi8(in, mask_2f);
+    __m128i roll = _mm_shuffle_epi8(lut_roll,
+                                    _mm_add_epi8(eq_2f, hi_nibbles));
+    *pin = _mm_add_epi8(in, roll);
+    return TRUE;
+}
+
+/* Packs 16 sextets into 12 bytes, in the low 12 bytes of the result. */
+__attribute__((target("ssse3")))
+static inline __m128i dec_pack_ssse3(__m128i v)
+{
+    __m128i ab_bc = _mm_maddubs_epi16(v, _mm_set1_epi32(0x01400140));
+    __m128i out = _mm_madd_epi16(ab_bc, _mm_set1_epi32(0x00011000));
+    return _mm_shuffle_epi8(out, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8,
+                                               14, 13, 12, -1, -1, -1, -1));
+}
+
+__attribute__((target("ssse3")))
+static size_t encode_ssse3(const unsigned char *src, size_t len,
+                           char *dst, int flags)
+{
+    const __m128i lut = ENC_LUT(flags);
+    size_t i = 0;
+    /* Each load reads 16 bytes, of which 12 are used. */
+    for (; len - i >= 16; i += 12, dst += 16) {
+        __m128i in = _mm_loadu_si128((const __m128i*)(src + i));
+        _mm_storeu_si128((__m128i*)dst, enc_block_ssse3(in, lut));
+    }
+    return i;
+}
+
+__attribute__((target("ssse3")))
+static size_t decode_ssse3(const unsigned char *src, size_t len,
+                           unsigned char *dst, int flags)
+{
+    size_t i = 0;
+    for (; len - i >= 16; i += 16, dst += 12) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        if (!dec_block_ssse3(&v, flags)) break;
+        _mm_storeu_si128((__m128i*)dst, dec_pack_ssse3(v));
+    }
+    return i;
+}
+
+/* AVX2 versions run the same algorithm on both 128-bit lanes. */
+__attribute__((target("avx2")))
+static size_t encode_avx2(const unsigned char *src, size_t len,
+                          char *dst, int flags)
+{
+    const __m256i lut = _mm256_broadcastsi128_si256(ENC_LUT(flags));
+    const __m256i shuf =
+        _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+                         1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+    size_t i = 0;
+    /* The upper lane reads 16 bytes from src+i+12. */
+    for (; len - i >= 28; i += 24, dst += 32) {
+        __m256i in = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(
+                _mm_loadu_si128((const __m128i*)(src + i))),
+            _mm_loadu_si128((const __m128i*)(src + i + 12)), 1);
+        in = _mm256_shuffle_epi8(in, shuf);
+        __m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+        __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+        __m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+        __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+        __m256i idx = _mm256_or_si256(t1, t3);
+        __m256i r = _mm256_subs_epu8(idx, _mm256_set1_epi8(51));
+        __m256i lt = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), idx);
+        r = _mm256_or_si256(r, _mm256_and_si256(lt, _mm256_set1_epi8(13)));
+        r = _mm256_add_epi8(_mm256_shuffle_epi8(lut, r), idx);
+        _mm256_storeu_si256((__m256i*)dst, r);
+    }
+    return i + encode_ssse3(src + i, len - i, dst, flags);
+}
+
+__attribute__((target("avx2")))
+static size_t decode_avx2(const unsigned char *src, size_t len,
+                          unsigned char *dst, int flags)
+{
+    const __m256i lut_lo = _mm256_setr_epi8(
+        0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+        0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a,
+        0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+        0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+    const __m256i lut_hi = _mm256_setr_epi8(
+        0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+        0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+        0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+        0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m256i lut_roll = _mm256_setr_epi8(
+        0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i pack = _mm256_setr_epi8(
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    const __m256i mask_2f = _mm256_set1_epi8(0x2f);
+    size_t i = 0;
+
+    for (; len - i >= 32; i += 32, dst += 24) {
+        __m256i in = _mm256_loadu_si256((const __m256i*)(src + i));
+        if (flags & BASE64_URL_SAFE) {
+            __m256i plus = _mm256_cmpeq_epi8(in, _mm256_set1_epi8('+'));
+            __m256i slash = _mm256_cmpeq_epi8(in, mask_2f);
+            if (_mm256_movemask_epi8(_mm256_or_si256(plus, slash))) break;
+            __m256i minus = _mm256_cmpeq_epi8(in, _mm256_set1_epi8('-'));
+            __m256i under = _mm256_cmpeq_epi8(in, _mm256_set1_epi8('_'));
+            in = _mm256_add_epi8(in, _mm256_and_si256(
+                                     minus, _mm256_set1_epi8('+'-'-')));
+            in = _mm256_add_epi8(in, _mm256_and_si256(
+                                     under, _mm256_set1_epi8('/'-'_')));
+        }
+        __m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(in, 4),
+                                              mask_2f);
+        __m256i lo_nibbles = _mm256_and_si256(in, mask_2f);
+        __m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+        __m256i lo = _mm256_shuffle_epi8(lut_lo, lo_nibbles);
+        if (_mm256_movemask_epi8(
+                _mm256_cmpgt_epi8(_mm256_and_si256(lo, hi),
+                                  _mm256_setzero_si256()))) {
+            break;
+        }
+        __m256i eq_2f = _mm256_cmpeq_epi8(in, mask_2f);
+        __m256i roll = _mm256_shuffle_epi8(lut_roll,
+                                           _mm256_add_epi8(eq_2f,
+                                                           hi_nibbles));
+        __m256i v = _mm256_add_epi8(in, roll);
+        __m256i ab_bc = _mm256_maddubs_epi16(v,
+                                             _mm256_set1_epi32(0x01400140));
+        __m256i out = _mm256_madd_epi16(ab_bc,
+                                        _mm256_set1_epi32(0x00011000));
+        out = _mm256_shuffle_epi8(out, pack);
+        _mm_storeu_si128((__m128i*)dst, _mm256_castsi256_si128(out));
+        _mm_storeu_si128((__m128i*)(dst + 12),
+                         _mm256_extracti128_si256(out, 1));
+    }
+    return i + decode_ssse3(src + i, len - i, dst, flags);
+}
+
+#endif /*BASE64_SIMD_X86*/
+
+/*================================================================
+ * AArch64
+ */
+
+#if defined(BASE64_SIMD_NEON)
+
+/* 128-entry decode tables for tbl/tbx; 0xff for non-alphabet. */
+static unsigned char neon_std_decode[128];
+static unsigned char neon_url_decode[128];
+
+static inline uint8x16x4_t neon_load_table(const unsigned char *p)
+{
+    uint8x16x4_t t;
+    t.val[0] = vld1q_u8(p);
+    t.val[1] = vld1q_u8(p + 16);
+    t.val[2] = vld1q_u8(p + 32);
+    t.val[3] = vld1q_u8(p + 48);
+    return t;
+}
+
+static size_t encode_neon(const unsigned char *src, size_t len,
+                          char *dst, int flags)
+{
+    const uint8x16x4_t tbl =
+        neon_load_table((const unsigned char*)ENCODE_TABLE(flags));
+    const uint8x16_t m63 = vdupq_n_u8(63);
+    size_t i = 0;
+
+    for (; len - i >= 48; i += 48, dst += 64) {
+        uint8x16x3_t in = vld3q_u8(src + i);
+        uint8x16x4_t out;
+        out.val[0] = vshrq_n_u8(in.val[0], 2);
+        out.val[1] = vandq_u8(vorrq_u8(vshlq_n_u8(in.val[0], 4),
+                                       vshrq_n_u8(in.val[1], 4)), m63);
+        out.val[2] = vandq_u8(vorrq_u8(vshlq_n_u8(in.val[1], 2),
+                                       vshrq_n_u8(in.val[2], 6)), m63);
+        out.val[3] = vandq_u8(in.val[2], m63);
+        out.val[0] = vqtbl4q_u8(tbl, out.val[0]);
+        out.val[1] = vqtbl4q_u8(tbl, out.val[1]);
+        out.val[2] = vqtbl4q_u8(tbl, out.val[2]);
+        out.val[3] = vqtbl4q_u8(tbl, out.val[3]);
+        vst4q_u8((unsigned char*)dst, out);
+    }
+    return i;
+}
+
+static inline uint8x16_t neon_decode_lookup(uint8x16_t c,
+                                            uint8x16x4_t lo,
+                                            uint8x16x4_t hi)
+{
+    /* tbl gives 0 for c >= 64, tbx leaves it for c >= 128;
+       the last one marks c >= 128 invalid. */
+    uint8x16_t v = vqtbl4q_u8(lo, c);
+    v = vqtbx4q_u8(v, hi, vsubq_u8(c, vdupq_n_u8(64)));
+    return vorrq_u8(v, vcgtq_u8(c, vdupq_n_u8(127)));
+}
+
+static size_t decode_neon(const unsigned char *src, size_t len,
+                          unsigned char *dst, int flags)
+{
+    const unsigned char *t = ((flags & BASE64_URL_SAFE)
+                              ? neon_url_decode : neon_std_decode);
+    const uint8x16x4_t lo = neon_load_table(t);
+    const uint8x16x4_t hi = neon_load_table(t + 64);
+    size_t i = 0;
+
+    for (; len - i >= 64; i += 64, dst += 48) {
+        uint8x16x4_t in = vld4q_u8(src + i);
+        uint8x16_t a = neon_decode_lookup(in.val[0], lo, hi);
+        uint8x16_t b = neon_decode_lookup(in.val[1], lo, hi);
+        uint8x16_t c = neon_decode_lookup(in.val[2], lo, hi);
+        uint8x16_t d = neon_decode_lookup(in.val[3], lo, hi);
+        uint8x16_t any = vorrq_u8(vorrq_u8(a, b), vorrq_u8(c, d));
+        if (vmaxvq_u8(any) > 63) break;
+        uint8x16x3_t out;
+        out.val[0] = vorrq_u8(vshlq_n_u8(a, 2), vshrq_n_u8(b, 4));
+        out.val[1] = vorrq_u8(vshlq_n_u8(b, 4), vshrq_n_u8(c, 2));
+        out.val[2] = vorrq_u8(vshlq_n_u8(c, 6), d);
+        vst3q_u8(dst, out);
+    }
+    return i;
+}
+
+#endif /*BASE64_SIMD_NEON*/
+
+/*================================================================
+ * Base64
+ */
+
+static size_t encoded_chars(size_t len, int final)
+{
+    return final? ((len + 2)/3)*4 : (len/3)*4;
+}
+
+size_t Base64EncodedLength(size_t len, int line_width, int col, int final)
+{
+    size_t n = encoded_chars(len, final);
+    if (line_width > 0) n += (col + n)/line_width;
+    return n;
+}
+
+/* Encodes without line splitting. */
+static void encode_raw(const unsigned char *s, size_t len, char *d,
+                       int flags, int final)
+{
+    const char *tab = ENCODE_TABLE(flags);
+    size_t i = 0;
+
+    if (encode_simd) {
+        i = encode_simd(s, len, d, flags);
+        d += (i/3)*4;
+    }
+    for (; len - i >= 3; i += 3) {
+        u_long v = ((u_long)s[i]<<16) | ((u_long)s[i+1]<<8) | s[i+2];
+        *d++ = tab[v>>18];
+        *d++ = tab[(v>>12)&63];
+        *d++ = tab[(v>>6)&63];
+        *d++ = tab[v&63];
+    }
+    if (final && i < len) {
+        u_long v = (u_long)s[i]<<16;
+        if (i+1 < len) v |= (u_long)s[i+1]<<8;
+        *d++ = tab[v>>18];
+        *d++ = tab[(v>>12)&63];
+        *d++ = (i+1 < len)? tab[(v>>6)&63] : '=';
+        *d++ = '=';
+    }
+}
+
+size_t Base64Encode(const unsigned char *src, size_t len, char *dst,
+                    int flags, int line_width, int *col, int final)
+{
+    size_t nraw = encoded_chars(len, final);
+    if (line_width <= 0) {
+        encode_raw(src, len, dst, flags, final);
+        return nraw;
+    }
+
+    /* Encode into the tail of DST, then slide the lines down, leaving
+       room for newlines.  The reading position never falls behind the
+       writing position. */
+    int c = *col;
+    size_t nl = (c + nraw)/line_width;
+    const char *r = dst + nl;
+    char *w = dst;
+    size_t left = nraw;
+
+    encode_raw(src, len, dst + nl, flags, final);
+    while (left > 0) {
+        size_t k = line_width - c;
+        if (k > left) {
+            memmove(w, r, left);
+            c += left;
+            break;
+        }
+        memmove(w, r, k);
+        w += k; r += k; left -= k;
+        *w++ = '\n';
+        c = 0;
+    }
+    *col = c;
+    return nraw + nl;
+}
+
+size_t Base64Decode(const unsigned char *src, size_t len,
+                    unsigned char *dst, int flags, int *state)
+{
+    if (*state == BASE64_DECODE_DONE) return 0;
+
+    const signed char *tab = DECODE_TABLE(flags);
+    int count = *state & 3;
+    u_int acc = (u_int)*state >> 2;
+    unsigned char *d = dst;
+    size_t i = 0, scalar_until = 0;
+
+    while (i < len) {
+        if (count == 0 && decode_simd && i >= scalar_until
+            && len - i >= 16) {
+            size_t n = decode_simd(src + i, len - i, d, flags);
+            i += n;
+            d += (n/4)*3;
+            /* Don't retry the vector path on the block it just
+               rejected. */
+            scalar_until = i + 16;
+            if (i >= len) break;
+        }
+        int v = tab[src[i++]];
+        if (v < 0) {
+            if (v == DEC_PAD) {
+                *state = BASE64_DECODE_DONE;
+                return (size_t)(d - dst);
+            }
+            continue;
+        }
+        switch (count) {
+        case 0: acc = v; count = 1; break;
+        case 1: *d++ = (acc<<2)|(v>>4); acc = v&15; count = 2; break;
+        case 2: *d++ = (acc<<4)|(v>>2); acc = v&3;  count = 3; break;
+        default: *d++ = (acc<<6)|v; count = 0; break;
+        }
+    }
+    *state = (int)((acc<<2) | count);
+    return (size_t)(d - dst);
+}
+
+/* Room Base64Decode may use for LEN characters.  The vector kernels
+   store a few bytes beyond the decoded ones. */
+static size_t decode_capacity(size_t len)
+{
+    return (len/4)*3 + 8;
+}
+
+/*================================================================
+ * Base16
+ */
+
+void Base16Encode(const unsigned char *src, size_t len, char *dst, int upper)
+{
+    const char *digits = upper? "0123456789ABCDEF" : "0123456789abcdef";
+    for (size_t i = 0; i < len; i++) {
+        *dst++ = digits[src[i]>>4];
+        *dst++ = digits[src[i]&15];
+    }
+}
+
+static int hexval(unsigned char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/*================================================================
+ * Scheme interface
+ */
+
+static const unsigned char *get_bytes(ScmObj src, size_t *size)
+{
+    if (SCM_STRINGP(src)) {
+        const ScmStringBody *b = SCM_STRING_BODY(src);
+        *size = SCM_STRING_BODY_SIZE(b);
+        return (const unsigned char*)SCM_STRING_BODY_START(b);
+    }
+    if (SCM_U8VECTORP(src)) {
+        *size = SCM_U8VECTOR_SIZE(src);
+        return SCM_U8VECTOR_ELEMENTS(src);
+    }
+    Scm_TypeError("source", "string or u8vector", src);
+    return NULL;                /* dummy */
+}
+
+ScmObj Scm_Base64EncodeBytes(ScmObj src, int flags, int line_width)
+{
+    size_t len;
+    const unsigned char *s = get_bytes(src, &len);
+    size_t n = Base64EncodedLength(len, line_width, 0, TRUE);
+    char *d = SCM_NEW_ATOMIC2(char*, n+1);
+    int col = 0;
+
+    Base64Encode(s, len, d, flags, line_width, &col, TRUE);
+    d[n] = '\0';
+    return Scm_MakeString(d, n, n, 0);
+}
+
+ScmObj Scm_Base64DecodeBytes(ScmObj src, int flags, int to_string)
+{
+    size_t len;
+    const unsigned char *s = get_bytes(src, &len);
+    unsigned char *d = SCM_NEW_ATOMIC2(unsigned char*, decode_capacity(len));
+    int state = 0;
+    size_t n = Base64Decode(s, len, d, flags, &state);
+
+    if (to_string) {
+        d[n] = '\0';
+        return Scm_MakeString((char*)d, n, -1, 0);
+    }
+    return Scm_MakeU8VectorFromArrayShared(n, d);
+}
+
+int Scm_Base64EncodeChunk(ScmU8Vector *buf, int start, int end,
+                          int flags, int line_width, int col, int final,
+                          ScmPort *out)
+{
+    int size = SCM_U8VECTOR_SIZE(buf);
+    SCM_CHECK_START_END(start, end, size);
+    size_t len = end - start;
+    if (!final && len%3 != 0) {
+        Scm_Error("non-final chunk must be a multiple of 3 bytes, "
+                  "but got %d bytes", (int)len);
+    }
+    size_t n = Base64EncodedLength(len, line_width, col, final);
+    char *d = SCM_NEW_ATOMIC2(char*, n+1);
+    Base64Encode(SCM_U8VECTOR_ELEMENTS(buf) + start, len, d, flags,
+                 line_width, &col, final);
+    if (n > 0) Scm_Putz(d, n, out);
+    return col;
+}
+
+int Scm_Base64DecodeChunk(ScmU8Vector *buf, int start, int end,
+                          int flags, int state, ScmPort *out)
+{
+    int size = SCM_U8VECTOR_SIZE(buf);
+    SCM_CHECK_START_END(start, end, size);
+    size_t len = end - start;
+    unsigned char *d = SCM_NEW_ATOMIC2(unsigned char*, decode_capacity(len));
+    size_t n = Base64Decode(SCM_U8VECTOR_ELEMENTS(buf) + start, len, d,
+                            flags, &state);
+    if (n > 0) Scm_Putz((char*)d, n, out);
+    return state;
+}
+
+ScmObj Scm_Base16EncodeBytes(ScmObj src, int upper)
+{
+    size_t len;
+    const unsigned char *s = get_bytes(src, &len);
+    char *d = SCM_NEW_ATOMIC2(char*, len*2+1);
+
+    Base16Encode(s, len, d, upper);
+    d[len*2] = '\0';
+    return Scm_MakeString(d, len*2, len*2, 0);
+}
+
+ScmObj Scm_Base16DecodeBytes(ScmObj src)
+{
+    size_t len;
+    const unsigned char *s = get_bytes(src, &len);
+
+    if (len%2 != 0) {
+        Scm_Error("base16 string must have even number of digits: %S", src);
+    }
+    unsigned char *d = SCM_NEW_ATOMIC2(unsigned char*, len/2 + 1);
+    for (size_t i = 0; i < len; i += 2) {
+        int h = hexval(s[i]), l = hexval(s[i+1]);
+        if (h < 0 || l < 0) {
+            Scm_Error("invalid base16 digit at position %d: %S",
+                      (int)(h < 0 ? i : i+1), src);
+        }
+        d[i/2] = (unsigned char)((h<<4)|l);
+    }
+    return Scm_MakeU8VectorFromArrayShared(len/2, d);
+}
+
+/*================================================================
+ * Initialization
+ */
+
+static void init_decode_table(signed char *tab, const char *chars)
+{
+    for (int i = 0; i < 256; i++) tab[i] = DEC_SKIP;
+    for (int i = 0; i < 64; i++) tab[(unsigned char)chars[i]] = i;
+    tab['='] = DEC_PAD;
+}
+
+void Scm_Init_base64(ScmModule *mod)
+{
+    init_decode_table(std_decode, std_chars);
+    init_decode_table(url_decode, url_chars);
+
+#if defined(BASE64_SIMD_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        encode_simd = encode_avx2;
+        decode_simd = decode_avx2;
+    } else if (__builtin_cpu_supports("ssse3")) {
+        encode_simd = encode_ssse3;
+        decode_simd = decode_ssse3;
+    }
+#endif
+#if defined(BASE64_SIMD_NEON)
+    for (int i = 0; i < 128; i++) {
+        neon_std_decode[i] = (std_decode[i] < 0)? 0xff : std_decode[i];
+        neon_url_decode[i] = (url_decode[i] < 0)? 0xff : url_decode[i];
+    }
+    encode_simd = encode_neon;
+    decode_simd = decode_neon;
+#endif
+}
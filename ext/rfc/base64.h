@@ -0,0 +1,83 @@
+/*
+ * base64.h - native Base64 and Base16 codec
+ *
+ *   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef GAUCHE_RFC_BASE64_H
+#define GAUCHE_RFC_BASE64_H
+
+#include <gauche.h>
+#include <gauche/extend.h>
+
+/* The codec works on byte buffers; the Scheme procedures in base64.scm
+   feed it either the whole input (*-string and *-bytevector versions)
+   or a block read from the port at a time.
+
+   Line splitting of the encoder follows the Scheme version it replaced:
+   a newline is written right after the character that fills
+   LINE_WIDTH columns, including the padding characters.  LINE_WIDTH
+   <= 0 means no splitting.  *COL keeps the current column across calls.
+   Unless FINAL is true, LEN must be a multiple of 3.
+
+   The decoder skips characters that are not in the alphabet, and stops
+   at '='.  The partially decoded group is kept in *STATE, which should
+   be 0 initially; it becomes BASE64_DECODE_DONE once '=' is seen.  */
+
+#define BASE64_URL_SAFE      (1L<<0)
+#define BASE64_DECODE_DONE   (-1)
+
+extern size_t Base64EncodedLength(size_t len, int line_width, int col,
+                                  int final);
+extern size_t Base64Encode(const unsigned char *src, size_t len,
+                           char *dst, int flags,
+                           int line_width, int *col, int final);
+extern size_t Base64Decode(const unsigned char *src, size_t len,
+                           unsigned char *dst, int flags, int *state);
+
+/* Base16 (hex).  The decoder rejects anything but hex digit pairs. */
+extern void   Base16Encode(const unsigned char *src, size_t len,
+                           char *dst, int upper);
+
+/* Scheme-level entries.  SRC can be a string or a u8vector; strings
+   are taken as byte sequences. */
+extern ScmObj Scm_Base64EncodeBytes(ScmObj src, int flags, int line_width);
+extern ScmObj Scm_Base64DecodeBytes(ScmObj src, int flags, int to_string);
+extern int    Scm_Base64EncodeChunk(ScmU8Vector *buf, int start, int end,
+                                    int flags, int line_width, int col,
+                                    int final, ScmPort *out);
+extern int    Scm_Base64DecodeChunk(ScmU8Vector *buf, int start, int end,
+                                    int flags, int state, ScmPort *out);
+extern ScmObj Scm_Base16EncodeBytes(ScmObj src, int upper);
+extern ScmObj Scm_Base16DecodeBytes(ScmObj src);
+
+extern void   Scm_Init_base64(ScmModule *mod);
+
+#endif /*GAUCHE_RFC_BASE64_H*/
@@ -0,0 +1,122 @@
+;;;
+;;; base64.scm - base64 encoding/decoding routine
+;;;
+;;;   Copyright (c) 2000-2015  Shiro Kawai  <shiro@acm.org>
+;;;
+;;;   Redistribution and use in source and binary forms, with or without
+;;;   modification, are permitted provided that the following conditions
+;;;   are met:
+;;;
+;;;   1. Redistributions of source code must retain the above copyright
+;;;      notice, this list of conditions and the following disclaimer.
+;;;
+;;;   2. Redistributions in binary form must reproduce the above copyright
+;;;      notice, this list of conditions and the following disclaimer in the
+;;;      documentation and/or other materials provided with the distribution.
+;;;
+;;;   3. Neither the name of the authors nor the names of its contributors
+;;;      may be used to endorse or promote products derived from this
+;;;      software without specific prior written permission.
+;;;
+;;;   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+;;;   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+;;;   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+;;;   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+;;;   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+;;;   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+;;;   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+;;;   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+;;;   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+;;;   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+;;;   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+;;;
+
+;; Implements Base64 encoding/decoding routine
+;; Ref: RFC2045 section 6.8  <http://www.rfc-editor.org/rfc/rfc2045.txt>
+;; and RFC4648 <http://www.rfc-editor.org/rfc/rfc4648.txt>
+
+;; The codec is written in C (base64.c).  The port-based procedures
+;; feed it a block at a time; the others hand it the whole input.
+
+(define-module rfc.base64
+  (use gauche.uvector)
+  (export base64-encode base64-encode-string base64-encode-bytevector
+          base64-decode base64-decode-string base64-decode-bytevector
+          base16-encode-bytevector base16-decode-bytevector))
+(select-module rfc.base64)
+
+(inline-stub
+ (declcode "#include \"base64.h\"")
+ (initcode "Scm_Init_base64(Scm_CurrentModule());")
+
+ (define-cproc %base64-encode-bytes (src flags::<fixnum> line-width::<fixnum>)
+   (return (Scm_Base64EncodeBytes src flags line-width)))
+ (define-cproc %base64-decode-bytes (src flags::<fixnum> to-string::<boolean>)
+   (return (Scm_Base64DecodeBytes src flags to-string)))
+
+ ;; Port-based ones write to the current output port, and return
+ ;; the state to be passed to the next call.
+ (define-cproc %base64-encode-chunk (buf::<u8vector> start::<fixnum>
+                                     end::<fixnum> flags::<fixnum>
+                                     line-width::<fixnum> col::<fixnum>
+                                     final::<boolean>)
+   ::<fixnum>
+   (return (Scm_Base64EncodeChunk buf start end flags line-width col final
+                                  SCM_CUROUT)))
+ (define-cproc %base64-decode-chunk (buf::<u8vector> start::<fixnum>
+                                     end::<fixnum> flags::<fixnum>
+                                     state::<fixnum>)
+   ::<fixnum>
+   (return (Scm_Base64DecodeChunk buf start end flags state SCM_CUROUT)))
+
+ (define-cproc base16-encode-bytevector (src :key (upper-case::<boolean> #f))
+   (return (Scm_Base16EncodeBytes src upper-case)))
+ (define-cproc base16-decode-bytevector (src)
+   (return (Scm_Base16DecodeBytes src)))
+ )
+
+(define-constant *chunk-size* 12288)
+
+(define (%flags url-safe) (if url-safe 1 0)) ; BASE64_URL_SAFE
+
+(define (%line-width line-width)
+  (if (and line-width (> line-width 0)) line-width 0))
+
+(define (base64-decode :key (url-safe #f))
+  (let ([buf (make-u8vector *chunk-size*)]
+        [in (current-input-port)]
+        [flags (%flags url-safe)])
+    (let loop ([state 0])
+      (let1 n (read-uvector! buf in)
+        (unless (eof-object? n)
+          (let1 state (%base64-decode-chunk buf 0 n flags state)
+            (unless (< state 0) (loop state))))))))
+
+(define (base64-decode-string string :key (url-safe #f))
+  (%base64-decode-bytes string (%flags url-safe) #t))
+
+(define (base64-decode-bytevector src :key (url-safe #f))
+  (%base64-decode-bytes src (%flags url-safe) #f))
+
+(define (base64-encode :key (line-width 76) (url-safe #f))
+  (let ([buf (make-u8vector *chunk-size*)]
+        [in (current-input-port)]
+        [flags (%flags url-safe)]
+        [width (%line-width line-width)])
+    ;; Bytes that don't make a whole group are carried over to the
+    ;; beginning of the buffer.
+    (let loop ([rest 0] [col 0])
+      (let1 n (read-uvector! buf in rest)
+        (if (eof-object? n)
+          (%base64-encode-chunk buf 0 rest flags width col #t)
+          (let* ([total (+ rest n)]
+                 [end (- total (modulo total 3))]
+                 [col (%base64-encode-chunk buf 0 end flags width col #f)])
+            (u8vector-copy! buf 0 buf end total)
+            (loop (- total end) col)))))))
+
+(define (base64-encode-string string :key (line-width 76) (url-safe #f))
+  (%base64-encode-bytes string (%flags url-safe) (%line-width line-width)))
+
+(define (base64-encode-bytevector src :key (line-width 76) (url-safe #f))
+  (%base64-encode-bytes src (%flags url-safe) (%line-width line-width)))
@@ -0,0 +1,592 @@
+/*
+ * json.c - native JSON reader and writer
+ *
+ *   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "json.h"
+
+static ScmModule *json_module = NULL;
+
+static ScmObj sym_true;
+static ScmObj sym_false;
+static ScmObj sym_null;
+static ScmObj sym_start_object;
+static ScmObj sym_end_object;
+static ScmObj sym_start_array;
+static ScmObj sym_end_array;
+static ScmObj sym_key;
+static ScmObj sym_value;
+
+/* Containers nested deeper than this is rejected, not to overflow
+   the C stack while building the result. */
+#define JSON_MAX_DEPTH 10000
+
+/*================================================================
+ * Reader
+ */
+
+#define GETC(p)       ((p)->pos++, Scm_Getc((p)->port))
+#define UNGETC(p, c)                                    \
+    do {                                                \
+        if ((c) != EOF) {                               \
+            (p)->pos--;                                 \
+            Scm_Ungetc((c), (p)->port);                 \
+        }                                               \
+    } while (0)
+
+#define WSP(c)     ((c) == ' ' || (c) == '\t' || (c) == '\r' || (c) == '\n')
+#define DIGITP(c)  ((c) >= '0' && (c) <= '9')
+
+/* Event mode states */
+enum {
+    ST_TOP,                     /* between top-level values */
+    ST_VALUE,                   /* a value is expected */
+    ST_ARRAY_FIRST,             /* after '[' */
+    ST_OBJECT_FIRST,            /* after '{' */
+    ST_OBJECT_NEXT,             /* after ',' in an object */
+    ST_AFTER_VALUE              /* a value in a container is done */
+};
+
+void JsonParserInit(JsonParser *p, ScmPort *port,
+                    ScmObj array_handler,
+                    ScmObj object_handler,
+                    ScmObj special_handler)
+{
+    p->port = port;
+    p->pos = 0;
+    p->array_handler = array_handler;
+    p->object_handler = object_handler;
+    p->special_handler = special_handler;
+    p->state = ST_TOP;
+    p->depth = 0;
+    p->stack_size = 0;
+    p->stack = NULL;
+}
+
+/* Raises <json-parse-error> via %json-parse-error in rfc.json. */
+static void parse_error(JsonParser *p, ScmObj msg, ScmObj obj)
+{
+    static ScmObj parse_error_proc = SCM_UNDEFINED;
+    SCM_BIND_PROC(parse_error_proc, "%json-parse-error", json_module);
+    Scm_ApplyRec3(parse_error_proc, Scm_MakeInteger(p->pos), msg, obj);
+    Scm_Error("%A %S", msg, obj); /* NOTREACHED */
+}
+
+static void unexpected(JsonParser *p, int c)
+{
+    if (c == EOF) {
+        parse_error(p, SCM_MAKE_STR("unexpected end of input"), SCM_EOF);
+    } else {
+        parse_error(p, SCM_MAKE_STR("unexpected character:"),
+                    SCM_MAKE_CHAR(c));
+    }
+}
+
+/* Returns the next non-whitespace character, consuming it. */
+static int skip_ws(JsonParser *p)
+{
+    int c;
+    do {
+        c = GETC(p);
+    } while (WSP(c));
+    return c;
+}
+
+static int read_hex4(JsonParser *p)
+{
+    int v = 0;
+    for (int i=0; i<4; i++) {
+        int c = GETC(p), d;
+        if (DIGITP(c))                 d = c - '0';
+        else if (c >= 'a' && c <= 'f') d = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') d = c - 'A' + 10;
+        else { unexpected(p, c); d = 0; }
+        v = v*16 + d;
+    }
+    return v;
+}
+
+static void surrogate_error(JsonParser *p, int u)
+{
+    parse_error(p, Scm_Sprintf("unpaired surrogate: \\u%04x", u),
+                SCM_MAKE_INT(u));
+}
+
+/* After "\u".  A surrogate pair makes one character. */
+static ScmChar read_unicode(JsonParser *p)
+{
+    int u = read_hex4(p);
+    if (u >= 0xdc00 && u <= 0xdfff) surrogate_error(p, u);
+    if (u >= 0xd800 && u <= 0xdbff) {
+        if (GETC(p) != '\\' || GETC(p) != 'u') surrogate_error(p, u);
+        int l = read_hex4(p);
+        if (l < 0xdc00 || l > 0xdfff) surrogate_error(p, u);
+        u = 0x10000 + ((u - 0xd800) << 10) + (l - 0xdc00);
+    }
+    return Scm_UcsToChar(u);
+}
+
+/* After the opening '"'. */
+static ScmObj read_string(JsonParser *p)
+{
+    ScmDString ds;
+    Scm_DStringInit(&ds);
+    for (;;) {
+        int c = GETC(p);
+        if (c == '"') break;
+        if (c == EOF) unexpected(p, c);
+        if (c == '\\') {
+            c = GETC(p);
+            switch (c) {
+            case '"': case '\\': case '/': break;
+            case 'b': c = 0x08; break;
+            case 'f': c = 0x0c; break;
+            case 'n': c = 0x0a; break;
+            case 'r': c = 0x0d; break;
+            case 't': c = 0x09; break;
+            case 'u': c = read_unicode(p); break;
+            default:  unexpected(p, c);
+            }
+        }
+        Scm_DStringPutc(&ds, c);
+    }
+    return Scm_DStringGet(&ds, 0);
+}
+
+/* C is the first character.  Like the original parser, we allow
+   leading '+' and zeros.  Integers that surely fit in a long are
+   computed on the fly; others are converted by the Scheme reader. */
+static ScmObj read_number(JsonParser *p, int c)
+{
+    ScmDString ds;
+    int neg = FALSE, ndigits = 0, inexact = FALSE;
+    long v = 0;
+
+    Scm_DStringInit(&ds);
+    if (c == '-' || c == '+') {
+        neg = (c == '-');
+        SCM_DSTRING_PUTB(&ds, c);
+        c = GETC(p);
+    }
+    if (!DIGITP(c)) unexpected(p, c);
+    while (DIGITP(c)) {
+        if (ndigits < 18) v = v*10 + (c - '0');
+        ndigits++;
+        SCM_DSTRING_PUTB(&ds, c);
+        c = GETC(p);
+    }
+    if (c == '.') {
+        inexact = TRUE;
+        SCM_DSTRING_PUTB(&ds, c);
+        c = GETC(p);
+        if (!DIGITP(c)) unexpected(p, c);
+        while (DIGITP(c)) { SCM_DSTRING_PUTB(&ds, c); c = GETC(p); }
+    }
+    if (c == 'e' || c == 'E') {
+        inexact = TRUE;
+        SCM_DSTRING_PUTB(&ds, c);
+        c = GETC(p);
+        if (c == '-' || c == '+') { SCM_DSTRING_PUTB(&ds, c); c = GETC(p); }
+        if (!DIGITP(c)) unexpected(p, c);
+        while (DIGITP(c)) { SCM_DSTRING_PUTB(&ds, c); c = GETC(p); }
+    }
+    UNGETC(p, c);
+
+    if (!inexact && ndigits <= 18) return Scm_MakeInteger(neg? -v : v);
+    ScmObj s = Scm_DStringGet(&ds, 0);
+    ScmObj n = Scm_StringToNumber(SCM_STRING(s), 10, 0);
+    if (SCM_FALSEP(n)) parse_error(p, SCM_MAKE_STR("bad number:"), s);
+    return n;
+}
+
+/* true, false or null.  C is the first character. */
+static ScmObj read_special(JsonParser *p, int c)
+{
+    const char *rest;
+    ScmObj sym;
+    switch (c) {
+    case 't': rest = "rue";  sym = sym_true;  break;
+    case 'f': rest = "alse"; sym = sym_false; break;
+    default:  rest = "ull";  sym = sym_null;  break;
+    }
+    for (; *rest; rest++) {
+        c = GETC(p);
+        if (c != *rest) unexpected(p, c);
+    }
+    if (SCM_FALSEP(p->special_handler)) return sym;
+    return Scm_ApplyRec1(p->special_handler, sym);
+}
+
+/* Returns a value other than array or object, starting with C. */
+static ScmObj read_scalar(JsonParser *p, int c)
+{
+    switch (c) {
+    case '"': return read_string(p);
+    case 't': case 'f': case 'n': return read_special(p, c);
+    case '-': case '+':
+    case '0': case '1': case '2': case '3': case '4':
+    case '5': case '6': case '7': case '8': case '9':
+        return read_number(p, c);
+    default:
+        unexpected(p, c);
+        return SCM_UNDEFINED;   /* dummy */
+    }
+}
+
+static ScmObj parse_value(JsonParser *p, int c, int depth);
+
+static ScmObj parse_array(JsonParser *p, int depth)
+{
+    ScmObj h = SCM_NIL, t = SCM_NIL;
+    ScmSmallInt n = 0;
+    int c = skip_ws(p);
+    if (c != ']') {
+        for (;;) {
+            SCM_APPEND1(h, t, parse_value(p, c, depth));
+            n++;
+            c = skip_ws(p);
+            if (c == ']') break;
+            if (c != ',') unexpected(p, c);
+            c = skip_ws(p);
+        }
+    }
+    if (SCM_FALSEP(p->array_handler)) return Scm_ListToVector(h, 0, n);
+    return Scm_ApplyRec1(p->array_handler, h);
+}
+
+static ScmObj parse_object(JsonParser *p, int depth)
+{
+    ScmObj h = SCM_NIL, t = SCM_NIL;
+    int c = skip_ws(p);
+    if (c != '}') {
+        for (;;) {
+            if (c != '"') unexpected(p, c);
+            ScmObj k = read_string(p);
+            c = skip_ws(p);
+            if (c != ':') unexpected(p, c);
+            ScmObj v = parse_value(p, skip_ws(p), depth);
+            SCM_APPEND1(h, t, Scm_Cons(k, v));
+            c = skip_ws(p);
+            if (c == '}') break;
+            if (c != ',') unexpected(p, c);
+            c = skip_ws(p);
+        }
+    }
+    if (SCM_FALSEP(p->object_handler)) return h;
+    return Scm_ApplyRec1(p->object_handler, h);
+}
+
+static ScmObj parse_value(JsonParser *p, int c, int depth)
+{
+    if (c == '[' || c == '{') {
+        if (depth >= JSON_MAX_DEPTH) {
+            parse_error(p, SCM_MAKE_STR("too deeply nested:"),
+                        SCM_MAKE_INT(depth));
+        }
+        if (c == '[') return parse_array(p, depth+1);
+        else          return parse_object(p, depth+1);
+    }
+    return read_scalar(p, c);
+}
+
+/* Reads one JSON value and the whitespaces after it.  Returns EOF
+   if there's nothing but whitespaces. */
+ScmObj JsonParse(JsonParser *p)
+{
+    int c = skip_ws(p);
+    if (c == EOF) return SCM_EOF;
+    ScmObj v = parse_value(p, c, 0);
+    UNGETC(p, skip_ws(p));
+    return v;
+}
+
+/*
+ * Event mode
+ */
+
+static void push_container(JsonParser *p, char kind)
+{
+    if (p->depth >= p->stack_size) {
+        int newsize = p->stack_size? p->stack_size*2 : 16;
+        char *newstack = SCM_NEW_ATOMIC2(char*, newsize);
+        if (p->depth > 0) memcpy(newstack, p->stack, p->depth);
+        p->stack = newstack;
+        p->stack_size = newsize;
+    }
+    p->stack[p->depth++] = kind;
+}
+
+static void value_done(JsonParser *p)
+{
+    p->state = (p->depth == 0)? ST_TOP : ST_AFTER_VALUE;
+}
+
+static ScmObj event_value(JsonParser *p, int c)
+{
+    if (c == '[') {
+        push_container(p, 'a');
+        p->state = ST_ARRAY_FIRST;
+        return sym_start_array;
+    }
+    if (c == '{') {
+        push_container(p, 'o');
+        p->state = ST_OBJECT_FIRST;
+        return sym_start_object;
+    }
+    ScmObj v = read_scalar(p, c);
+    value_done(p);
+    return Scm_Cons(sym_value, v);
+}
+
+static ScmObj event_key(JsonParser *p, int c)
+{
+    if (c != '"') unexpected(p, c);
+    ScmObj k = read_string(p);
+    c = skip_ws(p);
+    if (c != ':') unexpected(p, c);
+    p->state = ST_VALUE;
+    return Scm_Cons(sym_key, k);
+}
+
+static ScmObj event_close(JsonParser *p)
+{
+    char kind = p->stack[--p->depth];
+    value_done(p);
+    return (kind == 'a')? sym_end_array : sym_end_object;
+}
+
+/* Returns the next event:
+     start-object, end-object, start-array, end-array,
+     (key . <string>) or (value . <scalar>).
+   EOF is returned when the input is exhausted between top-level
+   values. */
+ScmObj JsonNextEvent(JsonParser *p)
+{
+    for (;;) {
+        int c;
+        switch (p->state) {
+        case ST_TOP:
+            c = skip_ws(p);
+            if (c == EOF) return SCM_EOF;
+            return event_value(p, c);
+        case ST_VALUE:
+            return event_value(p, skip_ws(p));
+        case ST_ARRAY_FIRST:
+            c = skip_ws(p);
+            if (c == ']') return event_close(p);
+            return event_value(p, c);
+        case ST_OBJECT_FIRST:
+            c = skip_ws(p);
+            if (c == '}') return event_close(p);
+            return event_key(p, c);
+        case ST_OBJECT_NEXT:
+            return event_key(p, skip_ws(p));
+        case ST_AFTER_VALUE: {
+            char kind = p->stack[p->depth-1];
+            c = skip_ws(p);
+            if (c == ',') {
+                p->state = (kind == 'a')? ST_VALUE : ST_OBJECT_NEXT;
+                continue;
+            }
+            if (c == ((kind == 'a')? ']' : '}')) return event_close(p);
+            unexpected(p, c);
+        }
+        }
+    }
+}
+
+/*================================================================
+ * Writer
+ */
+
+/* Raises <json-construct-error> via %json-construct-error in rfc.json. */
+static void construct_error(ScmObj obj, const char *msg)
+{
+    static ScmObj construct_error_proc = SCM_UNDEFINED;
+    SCM_BIND_PROC(construct_error_proc, "%json-construct-error", json_module);
+    Scm_ApplyRec2(construct_error_proc, SCM_MAKE_STR(msg), obj);
+    Scm_Error("%s %S", msg, obj); /* NOTREACHED */
+}
+
+static void write_ucs(int ucs, ScmPort *port)
+{
+    char buf[16];
+    if (ucs >= 0x10000) {
+        ucs -= 0x10000;
+        snprintf(buf, sizeof(buf), "\\u%04x\\u%04x",
+                 0xd800 + (ucs >> 10), 0xdc00 + (ucs & 0x3ff));
+        Scm_Putz(buf, 12, port);
+    } else {
+        snprintf(buf, sizeof(buf), "\\u%04x", ucs);
+        Scm_Putz(buf, 6, port);
+    }
+}
+
+/* Printable ASCII characters are written out in runs; only the
+   characters that need escaping are handled one by one.
+   Non-ASCII characters are escaped, as the original writer did. */
+void JsonWriteString(ScmString *s, ScmPort *port)
+{
+    u_int size;
+    const char *cp = Scm_GetStringContent(s, &size, NULL, NULL);
+    const char *end = cp + size, *run = cp;
+
+    Scm_Putc('"', port);
+    while (cp < end) {
+        unsigned char b = (unsigned char)*cp;
+        if (b >= 0x20 && b < 0x7f && b != '"' && b != '\\') {
+            cp++;
+            continue;
+        }
+        if (cp > run) Scm_Putz(run, (int)(cp - run), port);
+        if (b < 0x80) {
+            switch (b) {
+            case '"':  Scm_Putz("\\\"", 2, port); break;
+            case '\\': Scm_Putz("\\\\", 2, port); break;
+            case 0x08: Scm_Putz("\\b", 2, port); break;
+            case 0x0c: Scm_Putz("\\f", 2, port); break;
+            case 0x0a: Scm_Putz("\\n", 2, port); break;
+            case 0x0d: Scm_Putz("\\r", 2, port); break;
+            case 0x09: Scm_Putz("\\t", 2, port); break;
+            default:   write_ucs(b, port);
+            }
+            cp++;
+        } else {
+            ScmChar ch;
+            SCM_CHAR_GET(cp, ch);
+            int ucs = Scm_CharToUcs(ch);
+            if (ucs < 0) {
+                construct_error(SCM_MAKE_CHAR(ch),
+                                "json cannot represent a character");
+            }
+            write_ucs(ucs, port);
+            cp += SCM_CHAR_NBYTES(ch);
+        }
+        run = cp;
+    }
+    if (cp > run) Scm_Putz(run, (int)(cp - run), port);
+    Scm_Putc('"', port);
+}
+
+static void write_number(ScmObj obj, ScmPort *port)
+{
+    if (SCM_INTP(obj)) {
+        char buf[32];
+        int n = snprintf(buf, sizeof(buf), "%ld", SCM_INT_VALUE(obj));
+        Scm_Putz(buf, n, port);
+        return;
+    }
+    if (!SCM_REALP(obj) || !Scm_FiniteP(obj)) {
+        construct_error(obj, "json cannot represent a number");
+    }
+    if (SCM_RATNUMP(obj)) obj = Scm_ExactToInexact(obj);
+    Scm_Write(obj, SCM_OBJ(port), SCM_WRITE_WRITE);
+}
+
+static void write_object(ScmObj obj, ScmPort *port, ScmObj fallback)
+{
+    static ScmObj x_to_string_proc = SCM_UNDEFINED;
+    ScmObj cp;
+    int first = TRUE;
+
+    Scm_Putc('{', port);
+    SCM_FOR_EACH(cp, obj) {
+        ScmObj attr = SCM_CAR(cp);
+        if (!SCM_PAIRP(attr)) {
+            construct_error(obj, "construct-json needs an assoc list or "
+                            "dictionary, but got:");
+        }
+        if (!first) Scm_Putc(',', port);
+        first = FALSE;
+        ScmObj key = SCM_CAR(attr);
+        if (!SCM_STRINGP(key)) {
+            SCM_BIND_PROC(x_to_string_proc, "x->string", Scm_GaucheModule());
+            key = Scm_ApplyRec1(x_to_string_proc, key);
+            if (!SCM_STRINGP(key)) Scm_Error("string required, but got %S", key);
+        }
+        JsonWriteString(SCM_STRING(key), port);
+        Scm_Putc(':', port);
+        JsonWrite(SCM_CDR(attr), port, fallback);
+    }
+    Scm_Putc('}', port);
+}
+
+static void write_array(ScmObj obj, ScmPort *port, ScmObj fallback)
+{
+    Scm_Putc('[', port);
+    for (ScmSmallInt i=0; i<SCM_VECTOR_SIZE(obj); i++) {
+        if (i > 0) Scm_Putc(',', port);
+        JsonWrite(SCM_VECTOR_ELEMENT(obj, i), port, fallback);
+    }
+    Scm_Putc(']', port);
+}
+
+/* Lists, vectors, strings, numbers and the special values are handled
+   here.  Other objects, e.g. dictionaries and other sequences, are
+   passed to FALLBACK, which may call back JsonWrite for the contents. */
+void JsonWrite(ScmObj obj, ScmPort *port, ScmObj fallback)
+{
+    if (SCM_FALSEP(obj) || SCM_EQ(obj, sym_false)) {
+        Scm_Putz("false", 5, port);
+    } else if (SCM_TRUEP(obj) || SCM_EQ(obj, sym_true)) {
+        Scm_Putz("true", 4, port);
+    } else if (SCM_EQ(obj, sym_null)) {
+        Scm_Putz("null", 4, port);
+    } else if (SCM_STRINGP(obj)) {
+        JsonWriteString(SCM_STRING(obj), port);
+    } else if (SCM_NUMBERP(obj)) {
+        write_number(obj, port);
+    } else if (SCM_LISTP(obj) && SCM_PROPER_LIST_P(obj)) {
+        write_object(obj, port, fallback);
+    } else if (SCM_VECTORP(obj)) {
+        write_array(obj, port, fallback);
+    } else {
+        Scm_ApplyRec1(fallback, obj);
+    }
+}
+
+/*================================================================
+ * Initialization
+ */
+
+void Scm_Init_json(ScmModule *mod)
+{
+    json_module = mod;
+    sym_true  = SCM_INTERN("true");
+    sym_false = SCM_INTERN("false");
+    sym_null  = SCM_INTERN("null");
+    sym_start_object = SCM_INTERN("start-object");
+    sym_end_object   = SCM_INTERN("end-object");
+    sym_start_array  = SCM_INTERN("start-array");
+    sym_end_array    = SCM_INTERN("end-array");
+    sym_key   = SCM_INTERN("key");
+    sym_value = SCM_INTERN("value");
+}
@@ -0,0 +1,78 @@
+/*
+ * json.h - native JSON reader and writer
+ *
+ *   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef GAUCHE_RFC_JSON_H
+#define GAUCHE_RFC_JSON_H
+
+#include <gauche.h>
+#include <gauche/extend.h>
+
+/* The reader takes characters from the port one at a time, and pushes
+   back the one that terminates a number, so it never reads beyond the
+   JSON value it returns.
+
+   Handlers are the values of json-array-handler etc., or #f if the
+   parameter has the default value, in which case the result is
+   built directly in C.
+
+   The same parser can also be used in the event mode, where
+   JsonNextEvent returns one token at a time and only the nesting
+   of containers is kept.  */
+
+typedef struct JsonParserRec {
+    ScmPort *port;
+    long     pos;               /* # of characters read so far */
+    ScmObj   array_handler;     /* #f for the default */
+    ScmObj   object_handler;
+    ScmObj   special_handler;
+    /* for the event mode */
+    int      state;
+    int      depth;
+    int      stack_size;
+    char    *stack;             /* 'a' or 'o' for each nesting level */
+} JsonParser;
+
+extern void   JsonParserInit(JsonParser *p, ScmPort *port,
+                             ScmObj array_handler,
+                             ScmObj object_handler,
+                             ScmObj special_handler);
+extern ScmObj JsonParse(JsonParser *p);
+extern ScmObj JsonNextEvent(JsonParser *p);
+
+/* FALLBACK is called with an object JsonWrite doesn't know about. */
+extern void   JsonWrite(ScmObj obj, ScmPort *port, ScmObj fallback);
+extern void   JsonWriteString(ScmString *s, ScmPort *port);
+
+extern void   Scm_Init_json(ScmModule *mod);
+
+#endif /*GAUCHE_RFC_JSON_H*/
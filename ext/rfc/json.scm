@@ -33,7 +33,11 @@
 
 ;;; http://www.ietf.org/rfc/rfc7159.txt
 
-;; NOTE: This module depends on parser.peg, whose API is not officially
+;; The reader and the writer are implemented in C (json.c).  The
+;; parser.peg version of the grammar is kept as json-parser, for
+;; those who want to combine it with other peg parsers.
+;;
+;; NOTE: json-parser depends on parser.peg, whose API is not officially
 ;; fixed.  Hence do not take this code as an example of parser.peg;
 ;; this will likely to be rewritten once parser.peg's API is changed.
 
@@ -53,6 +57,8 @@
 
           json-array-handler json-object-handler json-special-handler
 
+          json-event-generator
+
           json-parser                   ;experimental
           ))
 (select-module rfc.json)
@@ -70,6 +76,38 @@
 (define json-object-handler  (make-parameter identity))
 (define json-special-handler (make-parameter identity))
 
+(inline-stub
+ (declcode "#include \"json.h\"")
+ (initcode "Scm_Init_json(Scm_CurrentModule());")
+
+ ;; Handlers are #f when they have the default values.
+ (define-cproc %json-parse (port::<input-port> ah oh sh)
+   (let* ([p::JsonParser])
+     (JsonParserInit (& p) port ah oh sh)
+     (return (JsonParse (& p)))))
+
+ (define-cfn json-event-next (args::ScmObj* nargs::int data::void*) :static
+   (return (JsonNextEvent (cast JsonParser* data))))
+
+ (define-cproc %json-event-generator (port::<input-port> sh)
+   (let* ([p::JsonParser* (SCM_NEW JsonParser)])
+     (JsonParserInit p port '#f '#f sh)
+     (return (Scm_MakeSubr json_event_next p 0 0 '"json-event-generator"))))
+
+ (define-cproc %json-write (obj port::<output-port> fallback) ::<void>
+   (JsonWrite obj port fallback))
+
+ (define-cproc %json-write-string (s::<string> port::<output-port>) ::<void>
+   (JsonWriteString s port))
+ )
+
+;; Called from C
+(define (%json-parse-error pos msg obj)
+  (error <json-parse-error> :position pos :objects obj msg obj))
+
+(define (%json-construct-error msg obj)
+  (error <json-construct-error> :object obj msg obj))
+
 (define (build-array elts) ((json-array-handler) elts))
 (define (build-object pairs) ((json-object-handler) pairs))
 (define (build-special symbol) ((json-special-handler) symbol))
@@ -178,41 +216,46 @@
 (define json-parser ($seq %ws ($or eof %value)))
 
 ;; entry point
+(define (%handler param default)
+  (let1 h (param)
+    (if (eq? h default) #f h)))
+
 (define (parse-json :optional (port (current-input-port)))
-  (guard (e [(<parse-error> e)
-             ;; not to expose parser.peg's <parse-error>.
-             (error <json-parse-error>
-                    :position (~ e'position) :objects (~ e'objects)
-                    :message (~ e'message))])
-    (peg-parse-port json-parser port)))
+  (%json-parse port
+               (%handler json-array-handler list->vector)
+               (%handler json-object-handler identity)
+               (%handler json-special-handler identity)))
 
 (define (parse-json-string str)
   (call-with-input-string str (cut parse-json <>)))
 
 (define (parse-json* :optional (port (current-input-port)))
-  (guard (e [(<parse-error> e)
-             ;; not to expose parser.peg's <parse-error>.
-             (error <json-parse-error>
-                    :position (~ e'position) :objects (~ e'objects)
-                    :message (~ e'message))])
-    (generator->list (peg-parser->generator json-parser port))))
+  (let ([ah (%handler json-array-handler list->vector)]
+        [oh (%handler json-object-handler identity)]
+        [sh (%handler json-special-handler identity)])
+    (generator->list (cut %json-parse port ah oh sh))))
+
+;; Streaming interface.  Returns a generator of parse events; see the
+;; comment of JsonNextEvent in json.c.  Only the nesting of containers
+;; is kept, so documents larger than the memory can be processed.
+(define (json-event-generator :optional (port (current-input-port)))
+  (%json-event-generator port (%handler json-special-handler identity)))
 
 ;;;============================================================
 ;;; Writer
 ;;;
 
-(define (print-value obj)
-  (cond [(or (eq? obj 'false) (eq? obj #f)) (display "false")]
-        [(or (eq? obj 'true) (eq? obj #t))  (display "true")]
-        [(eq? obj 'null)  (display "null")]
-        [(list? obj)      (print-object obj)]
-        [(string? obj)    (print-string obj)]
-        [(number? obj)    (print-number obj)]
-        [(is-a? obj <dictionary>) (print-object obj)]
+;; Lists, vectors, strings, numbers and special values are written
+;; by %json-write.  This handles the rest.
+(define (print-generic obj)
+  (cond [(is-a? obj <dictionary>) (print-object obj)]
         [(is-a? obj <sequence>)   (print-array obj)]
         [else (error <json-construct-error> :object obj
                      "can't convert Scheme object to json:" obj)]))
 
+(define (print-value obj)
+  (%json-write obj (current-output-port) print-generic))
+
 (define (print-object obj)
   (display "{")
   (fold (^[attr comma]
@@ -221,7 +264,7 @@
                    "construct-json needs an assoc list or dictionary, \
                     but got:" obj))
           (display comma)
-          (print-string (x->string (car attr)))
+          (%json-write-string (x->string (car attr)) (current-output-port))
           (display ":")
           (print-value (cdr attr))
           ",")
@@ -236,38 +279,11 @@
                        obj)
   (display "]"))
 
-(define (print-number num)
-  (cond [(or (not (real? num)) (not (finite? num)))
-         (error <json-construct-error> :object num
-                "json cannot represent a number" num)]
-        [(and (rational? num) (not (integer? num)))
-         (write (exact->inexact num))]
-        [else (write num)]))
-
-(define (print-string str)
-  (define specials
-    '((#\" . #\") (#\\ . #\\) (#\x08 . #\b) (#\page . #\f)
-      (#\newline . #\n) (#\return . #\r) (#\tab . #\t)))
-  (define (hexescape code) (format #t "\\u~4,'0x" code))
-  (define (print-char c)
-    (cond [(assv c specials) => (^p (write-char #\\) (write-char (cdr p)))]
-          [(and (char-set-contains? char-set:ascii c)
-                (not (eq? (char-general-category c) 'Cc)))
-           (write-char c)]
-          [else
-           (let1 code (char->ucs c)
-             (if (>= code #x10000)
-               (for-each hexescape (ucs4->utf16 code))
-               (hexescape code)))]))
-  (display "\"")
-  (string-for-each print-char str)
-  (display "\""))
-
 (define (construct-json x :optional (oport (current-output-port)))
   (with-output-to-port oport
     (^()
-      (cond [(or (list? x) (is-a? x <dictionary>)) (print-object x)]
-            [(and (is-a? x <sequence>) (not (string? x))) (print-array x)]
+      (cond [(or (list? x) (is-a? x <dictionary>)) (print-value x)]
+            [(and (is-a? x <sequence>) (not (string? x))) (print-value x)]
             [else (error <json-construct-error> :object x
                          "construct-json expects a list or a vector, \
                           but got" x)]))))
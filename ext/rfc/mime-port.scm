@@ -0,0 +1,115 @@
+;;;
+;;; mime-port.scm - submodule to read from mime part body
+;;;
+;;;   Copyright (c) 2000-2015  Shiro Kawai  <shiro@acm.org>
+;;;
+;;;   Redistribution and use in source and binary forms, with or without
+;;;   modification, are permitted provided that the following conditions
+;;;   are met:
+;;;
+;;;   1. Redistributions of source code must retain the above copyright
+;;;      notice, this list of conditions and the following disclaimer.
+;;;
+;;;   2. Redistributions in binary form must reproduce the above copyright
+;;;      notice, this list of conditions and the following disclaimer in the
+;;;      documentation and/or other materials provided with the distribution.
+;;;
+;;;   3. Neither the name of the authors nor the names of its contributors
+;;;      may be used to endorse or promote products derived from this
+;;;      software without specific prior written permission.
+;;;
+;;;   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+;;;   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+;;;   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+;;;   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+;;;   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+;;;   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+;;;   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+;;;   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+;;;   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+;;;   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+;;;   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+;;;
+
+;; This module is autoloaded from rfc.mime.  You don't need to "use" this
+;; directly.
+
+;; The boundary is recognized by a native scanner (mimeport.c), which
+;; reads the source by blocks and searches the delimiter in them.
+;; <mime-port> is a buffered port filled by the scanner.
+
+(define-module rfc.mime-port
+  (use gauche.uvector)
+  (use gauche.vport)
+  (use rfc.822)
+  (export make-mime-port mime-port-headers))
+(select-module rfc.mime-port)
+
+(inline-stub
+ (declcode "#include \"mimeport.h\"")
+ (initcode "Scm_Init_mimeport(Scm_CurrentModule());")
+
+ (define-type <mime-scanner> "ScmMimeScanner*" "MIME scanner"
+   "SCM_MIME_SCANNER_P" "SCM_MIME_SCANNER")
+
+ (define-cproc %make-mime-scanner (boundary::<string> src::<input-port>)
+   (return (Scm_MakeMimeScanner boundary src)))
+
+ ;; State is set by the caller, and the new one is returned with
+ ;; the number of bytes read.
+ (define-cproc %mime-scanner-read! (s::<mime-scanner> vec::<u8vector>
+                                    state::<fixnum>)
+   ::(<int> <int>)
+   (set! (-> s state) state)
+   (let* ([n::ScmSmallInt
+           (Scm_MimeScannerRead s (cast char* (SCM_U8VECTOR_ELEMENTS vec))
+                                (SCM_U8VECTOR_SIZE vec))])
+     (return n (-> s state))))
+
+ (define-cproc %mime-scanner-headers (s::<mime-scanner> state::<fixnum>)
+   ::(<top> <int>)
+   (set! (-> s state) state)
+   (let* ([r (Scm_MimeScannerReadHeaders s)])
+     (return r (-> s state))))
+ )
+
+;;===============================================================
+;; Virtual port to recognize mime boundary
+;;
+
+(define-class <mime-port> (<buffered-input-port>)
+  ((state :init-form 'prologue)
+   ;; prologue -> body -> boundary -> (body) ... -> eof
+   (scanner)
+   ))
+
+;; Must match MIME_SCAN_* in mimeport.h
+(define *states* '#(prologue body boundary eof))
+(define (state->code state)
+  (case state [(prologue) 0] [(body) 1] [(boundary) 2] [else 3]))
+
+;; Creates a procedural port, which reads from SRCPORT until it reaches
+;; either EOF or MIME boundary.
+(define (make-mime-port boundary srcport)
+  (define scanner (%make-mime-scanner boundary srcport))
+  (define port (make <mime-port>))
+
+  (define (fill vec)
+    (receive (n state) (%mime-scanner-read! scanner vec
+                                            (state->code (ref port 'state)))
+      (set! (ref port 'state) (vector-ref *states* state))
+      n))
+
+  (set! (ref port 'fill) fill)
+  (set! (ref port 'scanner) scanner)
+  port)
+
+;; Reads the headers of the part that begins at PORT, as
+;; rfc822-header->list does.  If the header block is in the scanner's
+;; buffer, it is taken at once; otherwise we read it line by line.
+(define (mime-port-headers port)
+  (receive (block state) (%mime-scanner-headers (ref port 'scanner)
+                                                (state->code
+                                                 (ref port 'state)))
+    (set! (ref port 'state) (vector-ref *states* state))
+    (rfc822-header->list (if block (open-input-string block) port))))
@@ -0,0 +1,304 @@
+/*
+ * mimeport.c - MIME boundary scanner
+ *
+ *   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "mimeport.h"
+#include <string.h>
+
+/*
+ * The delimiter is searched as "\n--boundary", which covers both CRLF
+ * and bare LF line endings; a CR right before the match is taken as
+ * a part of the delimiter.  The delimiter has to be followed by CR/LF
+ * (another part follows) or "--" (the last part); otherwise it's
+ * a part of the body.  At the very beginning of the message, the first
+ * delimiter may lack the preceding line ending.
+ *
+ * While no delimiter is found, we can hand out all the bytes in the
+ * buffer except the last delimLen ones, which may be the beginning
+ * of a delimiter, including the CR before it.
+ */
+
+#define MIME_SCAN_BUFSIZ  16384
+#define MAX_BOUNDARY_LEN  200   /* RFC2046 says 70; we're lenient */
+
+static void mime_scanner_print(ScmObj obj, ScmPort *port,
+                               ScmWriteContext *ctx)
+{
+    Scm_Printf(port, "#<mime-scanner %S>", SCM_MIME_SCANNER(obj)->src);
+}
+
+SCM_DEFINE_BUILTIN_CLASS_SIMPLE(Scm_MimeScannerClass, mime_scanner_print);
+
+ScmObj Scm_MakeMimeScanner(ScmString *boundary, ScmPort *src)
+{
+    unsigned int blen;
+    const char *b = Scm_GetStringContent(boundary, &blen, NULL, NULL);
+    if (blen > MAX_BOUNDARY_LEN) {
+        Scm_Error("MIME boundary too long: %S", SCM_OBJ(boundary));
+    }
+    if (!SCM_IPORTP(src)) {
+        Scm_Error("input port required, but got %S", SCM_OBJ(src));
+    }
+
+    ScmMimeScanner *s = SCM_NEW(ScmMimeScanner);
+    SCM_SET_CLASS(s, SCM_CLASS_MIME_SCANNER);
+    s->src = src;
+    s->state = MIME_SCAN_PROLOGUE;
+    s->srcEOF = FALSE;
+    s->delimLen = blen + 3;
+    s->delim = SCM_NEW_ATOMIC2(char*, s->delimLen);
+    memcpy(s->delim, "\n--", 3);
+    memcpy(s->delim + 3, b, blen);
+    Scm__BoyerMooreTable(s->delim, s->delimLen, s->shift);
+    s->bufSize = MIME_SCAN_BUFSIZ;
+    s->buf = SCM_NEW_ATOMIC2(char*, s->bufSize);
+    s->start = s->end = 0;
+    return SCM_OBJ(s);
+}
+
+/* Moves the pending bytes to the beginning of the buffer and reads
+   more from the source.  Returns FALSE if nothing could be read. */
+static int scan_refill(ScmMimeScanner *s)
+{
+    if (s->srcEOF) return FALSE;
+    if (s->start > 0) {
+        memmove(s->buf, s->buf + s->start, s->end - s->start);
+        s->end -= s->start;
+        s->start = 0;
+    }
+    if (s->end == s->bufSize) return FALSE;
+    int n = Scm_Getz(s->buf + s->end, (int)(s->bufSize - s->end), s->src);
+    if (n <= 0) {
+        s->srcEOF = TRUE;
+        return FALSE;
+    }
+    s->end += n;
+    return TRUE;
+}
+
+/* Reads and discards the source up to EOF (the epilogue). */
+static void scan_skip_to_eof(ScmMimeScanner *s)
+{
+    s->start = s->end = 0;
+    while (scan_refill(s)) s->start = s->end = 0;
+    s->state = MIME_SCAN_EOF;
+}
+
+/* Looks at the bytes after the delimiter at DP.  Returns the state
+   the delimiter leads to (MIME_SCAN_BOUNDARY or MIME_SCAN_EOF), or
+   MIME_SCAN_BODY if it's not a delimiter, and sets *AFTER to the
+   position past the line ending.  Returns -1 if we need more bytes
+   to tell. */
+static int scan_delimiter_kind(ScmMimeScanner *s, ScmSmallInt dp,
+                               ScmSmallInt *after)
+{
+    ScmSmallInt q = dp + s->delimLen;
+    if (q + 2 > s->end && !s->srcEOF) return -1;
+    if (q >= s->end) return MIME_SCAN_BODY;
+    char c = s->buf[q];
+    if (c == '\n') {
+        *after = q + 1;
+        return MIME_SCAN_BOUNDARY;
+    }
+    if (c == '\r') {
+        *after = (q + 1 < s->end && s->buf[q+1] == '\n') ? q + 2 : q + 1;
+        return MIME_SCAN_BOUNDARY;
+    }
+    if (c == '-' && q + 1 < s->end && s->buf[q+1] == '-') {
+        *after = q + 2;
+        return MIME_SCAN_EOF;
+    }
+    return MIME_SCAN_BODY;
+}
+
+/* Copies N bytes from the buffer to DST (unless it's NULL). */
+static ScmSmallInt scan_emit(ScmMimeScanner *s, char *dst, ScmSmallInt n)
+{
+    if (dst) memcpy(dst, s->buf + s->start, n);
+    s->start += n;
+    return n;
+}
+
+/* The core of Scm_MimeScannerRead, in the body state.  DST may be
+   NULL to discard the bytes. */
+static ScmSmallInt scan_body(ScmMimeScanner *s, char *dst, ScmSmallInt size)
+{
+    ScmSmallInt from = s->start; /* where to search the delimiter from */
+    for (;;) {
+        ScmSmallInt avail = s->end - s->start;
+        /* We don't need to look further than SIZE bytes, plus the
+           delimiter that may follow them. */
+        ScmSmallInt window = avail;
+        if (window > size + s->delimLen) window = size + s->delimLen;
+        ScmSmallInt dp = -1;
+        if (from - s->start < window) {
+            dp = Scm__BoyerMooreSearch(s->buf + from,
+                                       s->start + window - from,
+                                       s->delim, s->delimLen, s->shift);
+            if (dp >= 0) dp += from;
+        }
+
+        if (dp >= 0) {
+            ScmSmallInt e = dp;     /* end of the body */
+            if (e > s->start && s->buf[e-1] == '\r') e--;
+            ScmSmallInt after = 0;
+            int kind = scan_delimiter_kind(s, dp, &after);
+            if (kind == MIME_SCAN_BODY) {
+                /* Not a delimiter; the LF is a part of the body. */
+                from = dp + 1;
+                continue;
+            }
+            if (e - s->start > size || (kind < 0 && e > s->start)) {
+                /* Hand out the body before the delimiter first. */
+                ScmSmallInt n = e - s->start;
+                return scan_emit(s, dst, n > size ? size : n);
+            }
+            if (kind < 0) {
+                (void)scan_refill(s);
+                from = s->start;
+                continue;
+            }
+            ScmSmallInt n = scan_emit(s, dst, e - s->start);
+            s->start = after;
+            if (kind == MIME_SCAN_EOF) scan_skip_to_eof(s);
+            else s->state = MIME_SCAN_BOUNDARY;
+            return n;
+        }
+
+        ScmSmallInt safe = window - s->delimLen;
+        if (s->srcEOF) safe = window > size ? size : window;
+        if (safe > 0) return scan_emit(s, dst, safe);
+        if (avail == 0 && s->srcEOF) {
+            s->state = MIME_SCAN_EOF;
+            return 0;
+        }
+        if (!scan_refill(s) && !s->srcEOF) {
+            /* Buffer full without a decision; can't happen since the
+               buffer is much larger than the delimiter. */
+            Scm_Error("[internal] MIME scanner buffer overflow");
+        }
+        from = s->start;
+    }
+}
+
+/* Skips up to the first delimiter.  It may appear at the very
+   beginning, without the preceding line ending. */
+static void scan_prologue(ScmMimeScanner *s)
+{
+    while (s->end - s->start < s->delimLen + 1 && scan_refill(s))
+        ;
+    ScmSmallInt dp = s->start - 1; /* where the '\n' would be */
+    if (s->end - s->start >= s->delimLen - 1
+        && memcmp(s->buf + s->start, s->delim + 1, s->delimLen - 1) == 0) {
+        ScmSmallInt after = 0;
+        int kind = scan_delimiter_kind(s, dp, &after);
+        if (kind == MIME_SCAN_BOUNDARY) {
+            s->start = after;
+            s->state = MIME_SCAN_BODY;
+            return;
+        }
+        if (kind == MIME_SCAN_EOF) {
+            scan_skip_to_eof(s);
+            return;
+        }
+    }
+    s->state = MIME_SCAN_BODY;
+    while (s->state == MIME_SCAN_BODY) {
+        scan_body(s, NULL, s->bufSize);
+    }
+    /* The first delimiter begins the first part.  If we reached eof
+       instead, there's no part. */
+    if (s->state == MIME_SCAN_BOUNDARY) s->state = MIME_SCAN_BODY;
+}
+
+ScmSmallInt Scm_MimeScannerRead(ScmMimeScanner *s, char *buf,
+                                ScmSmallInt size)
+{
+    if (s->state == MIME_SCAN_PROLOGUE) scan_prologue(s);
+    if (s->state != MIME_SCAN_BODY || size <= 0) return 0;
+    return scan_body(s, buf, size);
+}
+
+/* Returns the end of the header block (past the empty line) that
+   begins at START and doesn't go beyond LIMIT, or -1. */
+static ScmSmallInt header_block_end(const char *buf, ScmSmallInt start,
+                                    ScmSmallInt limit)
+{
+    ScmSmallInt p = start;      /* beginning of a line */
+    for (;;) {
+        if (p < limit && buf[p] == '\n') return p + 1;
+        if (p + 1 < limit && buf[p] == '\r' && buf[p+1] == '\n') return p + 2;
+        const char *nl = memchr(buf + p, '\n', limit - p);
+        if (nl == NULL) return -1;
+        p = nl - buf + 1;
+    }
+}
+
+ScmObj Scm_MimeScannerReadHeaders(ScmMimeScanner *s)
+{
+    if (s->state == MIME_SCAN_PROLOGUE) scan_prologue(s);
+    if (s->state != MIME_SCAN_BODY) return SCM_FALSE;
+
+    for (;;) {
+        /* The headers must end before the delimiter (and the CR before
+           it).  If we haven't seen the delimiter, the last LF in the
+           buffer can still be the beginning of one. */
+        ScmSmallInt limit;
+        ScmSmallInt dp = Scm__BoyerMooreSearch(s->buf + s->start,
+                                               s->end - s->start,
+                                               s->delim, s->delimLen,
+                                               s->shift);
+        if (dp >= 0) {
+            limit = s->start + dp;
+            if (limit > s->start && s->buf[limit-1] == '\r') limit--;
+        } else if (s->srcEOF) {
+            limit = s->end;
+        } else {
+            limit = s->end - s->delimLen + 1;
+            if (limit < s->start) limit = s->start;
+        }
+        ScmSmallInt e = header_block_end(s->buf, s->start, limit);
+        if (e >= 0) {
+            ScmObj r = Scm_MakeString(s->buf + s->start, e - s->start, -1,
+                                      SCM_STRING_COPYING);
+            s->start = e;
+            return r;
+        }
+        if (dp >= 0 || !scan_refill(s)) return SCM_FALSE;
+    }
+}
+
+void Scm_Init_mimeport(ScmModule *mod)
+{
+    Scm_InitStaticClass(&Scm_MimeScannerClass, "<mime-scanner>", mod,
+                        NULL, 0);
+}
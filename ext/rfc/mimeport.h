@@ -0,0 +1,96 @@
+/*
+ * mimeport.h - MIME boundary scanner
+ *
+ *   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef GAUCHE_RFC_MIMEPORT_H
+#define GAUCHE_RFC_MIMEPORT_H
+
+#include <gauche.h>
+#include <gauche/extend.h>
+
+/* A MIME scanner reads a multipart body from the source port, and
+ * hands out the bytes of each part, stopping at the delimiter
+ * (CRLF or LF, "--", and the boundary).  The source is read by
+ * blocks into the scanner's buffer, in which the delimiter is
+ * searched with Boyer-Moore-Horspool.  The scanner reads ahead up to
+ * a block beyond the current part, so the source port must not be
+ * read by others while the scanner is in use.
+ *
+ * The state follows the one of <mime-port> in mime-port.scm:
+ *   prologue -> body -> boundary -> (body is set by the caller) ...
+ *                    -> eof
+ */
+
+enum {
+    MIME_SCAN_PROLOGUE,
+    MIME_SCAN_BODY,
+    MIME_SCAN_BOUNDARY,
+    MIME_SCAN_EOF
+};
+
+typedef struct ScmMimeScannerRec {
+    SCM_HEADER;
+    ScmPort *src;
+    int state;
+    int srcEOF;                 /* src has been read to EOF */
+    char *delim;                /* "\n--" + boundary */
+    ScmSmallInt delimLen;
+    unsigned char shift[256];   /* Boyer-Moore table of delim */
+    char *buf;                  /* read-ahead bytes are [start, end) */
+    ScmSmallInt bufSize;
+    ScmSmallInt start;
+    ScmSmallInt end;
+} ScmMimeScanner;
+
+SCM_CLASS_DECL(Scm_MimeScannerClass);
+#define SCM_CLASS_MIME_SCANNER     (&Scm_MimeScannerClass)
+#define SCM_MIME_SCANNER(obj)      ((ScmMimeScanner*)(obj))
+#define SCM_MIME_SCANNER_P(obj)    SCM_XTYPEP(obj, SCM_CLASS_MIME_SCANNER)
+
+extern ScmObj Scm_MakeMimeScanner(ScmString *boundary, ScmPort *src);
+
+/* Fills BUF[start, end) with the bytes of the current part, and
+   returns the number of bytes.  Zero means the end of the part; then
+   the state tells whether it's followed by another part (boundary)
+   or not (eof). */
+extern ScmSmallInt Scm_MimeScannerRead(ScmMimeScanner *s, char *buf,
+                                       ScmSmallInt size);
+
+/* If the header block of the current part, up to and including
+   the empty line, is in the buffer, consumes and returns it as
+   a string.  Otherwise returns #f, and the caller should read the
+   headers in the usual way. */
+extern ScmObj Scm_MimeScannerReadHeaders(ScmMimeScanner *s);
+
+extern void   Scm_Init_mimeport(ScmModule *mod);
+
+#endif /*GAUCHE_RFC_MIMEPORT_H*/
@@ -0,0 +1,365 @@
+/*
+ * uri.c - native URI splitter and percent-encoding
+ *
+ *   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "uri.h"
+#include <string.h>
+
+/* All the delimiters are ASCII.  In Shift_JIS, '@', '[' and ']' can be
+   the second byte of a double-byte character, so we step by characters
+   where we look for them.  Other encodings we support never have
+   ASCII bytes within a multibyte character. */
+#if defined(GAUCHE_CHAR_ENCODING_SJIS)
+#define NEXT_CHAR(p, e, b)                                              \
+    do {                                                                \
+        (p) += SCM_STRING_BODY_INCOMPLETE_P(b)                          \
+            ? 1 : SCM_CHAR_NFOLLOWS(*(p)) + 1;                          \
+        if ((p) > (e)) (p) = (e);                                       \
+    } while (0)
+#else
+#define NEXT_CHAR(p, e, b)  ((p)++)
+#endif
+
+#define IS_ALPHA(c)  (((c) >= 'a' && (c) <= 'z') || ((c) >= 'A' && (c) <= 'Z'))
+#define IS_DIGIT(c)  ((c) >= '0' && (c) <= '9')
+
+static int hexval(unsigned char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static int all_digits(const char *s, const char *e)
+{
+    for (; s < e; s++) if (!IS_DIGIT(*s)) return FALSE;
+    return TRUE;
+}
+
+/* A new string sharing [S, E) of the body B, or #f if S is NULL. */
+static ScmObj share(const ScmStringBody *b, const char *s, const char *e)
+{
+    if (s == NULL) return SCM_FALSE;
+    if (SCM_STRING_BODY_INCOMPLETE_P(b)) {
+        return Scm_MakeString(s, e-s, e-s, SCM_STRING_INCOMPLETE);
+    }
+    if (SCM_STRING_BODY_SINGLE_BYTE_P(b)) {
+        return Scm_MakeString(s, e-s, e-s, 0);
+    }
+    return Scm_MakeString(s, e-s, -1, 0);
+}
+
+/*================================================================
+ * Splitting
+ */
+
+/* ^([A-Za-z][A-Za-z0-9+.-]*): */
+void Scm_URISchemeSpecific(ScmString *uri, ScmObj *scheme, ScmObj *specific)
+{
+    const ScmStringBody *b = SCM_STRING_BODY(uri);
+    const char *s = SCM_STRING_BODY_START(b);
+    const char *e = s + SCM_STRING_BODY_SIZE(b);
+    const char *p = s;
+    int upper = FALSE;
+
+    if (p < e && IS_ALPHA(*p)) {
+        for (; p < e; p++) {
+            char c = *p;
+            if (c == ':') break;
+            if (c >= 'A' && c <= 'Z') upper = TRUE;
+            else if (!(IS_ALPHA(c) || IS_DIGIT(c)
+                       || c == '+' || c == '.' || c == '-')) {
+                p = e;
+                break;
+            }
+        }
+    } else {
+        p = e;
+    }
+    if (p == e) {
+        *scheme = SCM_FALSE;
+        *specific = SCM_OBJ(uri);
+        return;
+    }
+    if (upper) {
+        char *d = SCM_NEW_ATOMIC2(char*, p-s+1);
+        for (int i = 0; i < p-s; i++) {
+            d[i] = (s[i] >= 'A' && s[i] <= 'Z')? s[i] - 'A' + 'a' : s[i];
+        }
+        d[p-s] = '\0';
+        *scheme = Scm_MakeString(d, p-s, p-s, 0);
+    } else {
+        *scheme = share(b, s, p);
+    }
+    *specific = share(b, p+1, e);
+}
+
+/* ^(?://([^/?#]*))?([^?#]+)?(?:\?([^#]*))?(?:#(.*))?$ */
+void Scm_URIDecomposeHierarchical(ScmString *specific,
+                                  ScmObj *authority, ScmObj *path,
+                                  ScmObj *query, ScmObj *fragment)
+{
+    const ScmStringBody *b = SCM_STRING_BODY(specific);
+    const char *p = SCM_STRING_BODY_START(b);
+    const char *e = p + SCM_STRING_BODY_SIZE(b);
+    const char *q;
+
+    *authority = *path = *query = *fragment = SCM_FALSE;
+    if (e - p >= 2 && p[0] == '/' && p[1] == '/') {
+        for (q = p += 2; p < e && *p != '/' && *p != '?' && *p != '#'; p++)
+            ;
+        *authority = share(b, q, p);
+    }
+    for (q = p; p < e && *p != '?' && *p != '#'; p++)
+        ;
+    if (p > q) *path = share(b, q, p);
+    if (p < e && *p == '?') {
+        for (q = ++p; p < e && *p != '#'; p++)
+            ;
+        *query = share(b, q, p);
+    }
+    if (p < e) *fragment = share(b, p+1, e);
+}
+
+/* Matches [S, E) against
+     (?:(?<host>[^:]*)|(?:\[(?<v6host>[a-fA-F\d:]+)\]))(?::(?<port>\d*))?$
+   On success, fills HOST and PORT (PORT[0] is NULL if absent). */
+static int match_hostport(const char *s, const char *e,
+                          const char **host, const char **port)
+{
+    const char *p = memchr(s, ':', e - s);
+    if (p == NULL) {
+        host[0] = s; host[1] = e; port[0] = NULL;
+        return TRUE;
+    }
+    if (all_digits(p+1, e)) {
+        host[0] = s; host[1] = p; port[0] = p+1; port[1] = e;
+        return TRUE;
+    }
+    if (*s == '[') {
+        for (p = s+1; p < e && (hexval(*p) >= 0 || *p == ':'); p++)
+            ;
+        if (p > s+1 && p < e && *p == ']') {
+            const char *q = p+1;
+            if (q == e) {
+                host[0] = s+1; host[1] = p; port[0] = NULL;
+                return TRUE;
+            }
+            if (*q == ':' && all_digits(q+1, e)) {
+                host[0] = s+1; host[1] = p; port[0] = q+1; port[1] = e;
+                return TRUE;
+            }
+        }
+    }
+    return FALSE;
+}
+
+/* ^(?:(?<userinfo>.*?)@)?<hostport>$  The userinfo part is the shortest
+   one that lets the rest match, and the one without userinfo is tried
+   last. */
+static int match_authority(const ScmStringBody *b,
+                           const char **userinfo, const char **host,
+                           const char **port)
+{
+    const char *s = SCM_STRING_BODY_START(b);
+    const char *e = s + SCM_STRING_BODY_SIZE(b);
+
+    for (const char *p = s; p < e; NEXT_CHAR(p, e, b)) {
+        if (*p == '@' && match_hostport(p+1, e, host, port)) {
+            userinfo[0] = s; userinfo[1] = p;
+            return TRUE;
+        }
+    }
+    userinfo[0] = NULL;
+    return match_hostport(s, e, host, port);
+}
+
+void Scm_URIDecomposeAuthority(ScmString *authority,
+                               ScmObj *userinfo, ScmObj *host, ScmObj *port)
+{
+    const ScmStringBody *b = SCM_STRING_BODY(authority);
+    const char *u[2], *h[2], *p[2];
+
+    if (match_authority(b, u, h, p)) {
+        *userinfo = share(b, u[0], u[1]);
+        *host = share(b, h[0], h[1]);
+        *port = share(b, p[0], p[1]);
+    } else {
+        *userinfo = *host = *port = SCM_FALSE;
+    }
+}
+
+void Scm_URIParse(ScmString *uri, ScmObj r[7])
+{
+    ScmObj specific, authority;
+
+    Scm_URISchemeSpecific(uri, &r[0], &specific);
+    Scm_URIDecomposeHierarchical(SCM_STRING(specific),
+                                 &authority, &r[4], &r[5], &r[6]);
+    r[1] = r[2] = r[3] = SCM_FALSE;
+    if (SCM_STRINGP(authority)) {
+        const ScmStringBody *b = SCM_STRING_BODY(authority);
+        const char *u[2], *h[2], *p[2];
+        if (match_authority(b, u, h, p)) {
+            r[1] = share(b, u[0], u[1]);
+            if (h[1] > h[0]) r[2] = share(b, h[0], h[1]);
+            if (p[0] != NULL && p[1] > p[0]) {
+                if (p[1] - p[0] <= 9) {
+                    long n = 0;
+                    for (const char *q = p[0]; q < p[1]; q++) {
+                        n = n*10 + (*q - '0');
+                    }
+                    r[3] = Scm_MakeInteger(n);
+                } else {
+                    r[3] = Scm_StringToNumber(SCM_STRING(share(b, p[0], p[1])),
+                                              10, 0);
+                }
+            }
+        }
+    }
+}
+
+/*================================================================
+ * Percent-encoding
+ */
+
+/* Decodes [S, E).  Returns a shared string if there's nothing to
+   decode. */
+static ScmObj decode_range(const ScmStringBody *b,
+                           const char *s, const char *e, int cgi)
+{
+    const char *p = s;
+
+    while (p < e && *p != '%' && !(cgi && *p == '+')) p++;
+    if (p == e) return share(b, s, e);
+
+    char *buf = SCM_NEW_ATOMIC2(char*, e - s + 1);
+    char *d = buf;
+    memcpy(d, s, p - s);
+    d += p - s;
+    while (p < e) {
+        char c = *p;
+        if (c == '%') {
+            /* Malformed escapes are passed through. */
+            int h1 = (p+1 < e)? hexval(p[1]) : -1;
+            int h2 = (p+2 < e)? hexval(p[2]) : -1;
+            if (h1 >= 0 && h2 >= 0) {
+                *d++ = (char)((h1<<4) | h2);
+                p += 3;
+            } else if (h1 >= 0) {
+                *d++ = '%';
+                *d++ = p[1];
+                p += 2;
+            } else {
+                *d++ = '%';
+                p++;
+            }
+        } else if (c == '+' && cgi) {
+            *d++ = ' ';
+            p++;
+        } else {
+            const char *q = p++;
+            while (p < e && *p != '%' && *p != '+') p++;
+            memcpy(d, q, p - q);
+            d += p - q;
+        }
+    }
+    *d = '\0';
+    return Scm_MakeString(buf, d - buf, -1, 0);
+}
+
+ScmObj Scm_URIDecodeString(ScmString *str, int cgi)
+{
+    const ScmStringBody *b = SCM_STRING_BODY(str);
+    const char *s = SCM_STRING_BODY_START(b);
+    return decode_range(b, s, s + SCM_STRING_BODY_SIZE(b), cgi);
+}
+
+#define NOESCAPE_P(cs, c) \
+    ((c) < 0x80 && SCM_BITS_TEST((cs)->small, (c)))
+
+ScmObj Scm_URIEncodeString(ScmString *str, ScmCharSet *noescape)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    const ScmStringBody *b = SCM_STRING_BODY(str);
+    const unsigned char *s = (const unsigned char*)SCM_STRING_BODY_START(b);
+    ScmSmallInt size = SCM_STRING_BODY_SIZE(b), n = 0;
+
+    for (ScmSmallInt i = 0; i < size; i++) {
+        if (!NOESCAPE_P(noescape, s[i])) n++;
+    }
+    if (n == 0) return share(b, (const char*)s, (const char*)s + size);
+
+    char *buf = SCM_NEW_ATOMIC2(char*, size + n*2 + 1);
+    char *d = buf;
+    for (ScmSmallInt i = 0; i < size; i++) {
+        unsigned char c = s[i];
+        if (NOESCAPE_P(noescape, c)) {
+            *d++ = c;
+        } else {
+            *d++ = '%';
+            *d++ = hex[c>>4];
+            *d++ = hex[c&15];
+        }
+    }
+    *d = '\0';
+    return Scm_MakeString(buf, d - buf, d - buf, 0);
+}
+
+ScmObj Scm_URIDecomposeQuery(ScmString *query, int cgi)
+{
+    const ScmStringBody *b = SCM_STRING_BODY(query);
+    const char *p = SCM_STRING_BODY_START(b);
+    const char *e = p + SCM_STRING_BODY_SIZE(b);
+    ScmObj h = SCM_NIL, t = SCM_NIL;
+
+    if (p == e) return SCM_NIL;
+    for (;;) {
+        const char *s = p, *eq = NULL;
+        for (; p < e && *p != '&' && *p != ';'; p++) {
+            if (*p == '=' && eq == NULL) eq = p;
+        }
+        ScmObj name, value;
+        if (eq) {
+            name = decode_range(b, s, eq, cgi);
+            value = decode_range(b, eq+1, p, cgi);
+        } else {
+            name = decode_range(b, s, p, cgi);
+            value = SCM_TRUE;
+        }
+        SCM_APPEND1(h, t, Scm_Cons(name, value));
+        if (p == e) break;
+        p++;
+    }
+    return h;
+}
@@ -0,0 +1,70 @@
+/*
+ * uri.h - native URI splitter and percent-encoding
+ *
+ *   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef GAUCHE_RFC_URI_H
+#define GAUCHE_RFC_URI_H
+
+#include <gauche.h>
+#include <gauche/extend.h>
+
+/* These scan the bytes of the string body.  The components they return
+   share the body of the given string; nothing is copied unless
+   it is decoded, encoded or case-folded.
+
+   The splitters follow the regexps of the Scheme version they
+   replaced; see uri.scm.  Absent components are #f.  */
+
+extern void   Scm_URISchemeSpecific(ScmString *uri,
+                                    ScmObj *scheme, ScmObj *specific);
+extern void   Scm_URIDecomposeHierarchical(ScmString *specific,
+                                           ScmObj *authority, ScmObj *path,
+                                           ScmObj *query, ScmObj *fragment);
+extern void   Scm_URIDecomposeAuthority(ScmString *authority,
+                                        ScmObj *userinfo, ScmObj *host,
+                                        ScmObj *port);
+/* Fills R with scheme, userinfo, host, port, path, query and fragment,
+   as uri-parse returns. */
+extern void   Scm_URIParse(ScmString *uri, ScmObj r[7]);
+
+/* Percent-encoding in the native encoding.  Bytes beyond ASCII are
+   always escaped by the encoder.  If CGI is true, the decoder
+   maps '+' to a space. */
+extern ScmObj Scm_URIDecodeString(ScmString *s, int cgi);
+extern ScmObj Scm_URIEncodeString(ScmString *s, ScmCharSet *noescape);
+
+/* Splits a query string at '&' and ';', and then each field at the
+   first '='.  Returns ((name . value) ...), where value is #t if
+   the field doesn't have '='.  Both are decoded. */
+extern ScmObj Scm_URIDecomposeQuery(ScmString *query, int cgi);
+
+#endif /*GAUCHE_RFC_URI_H*/
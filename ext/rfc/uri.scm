@@ -45,6 +45,9 @@
 
 ;; Also supports 'data' uri scheme specified in RFC2397.
 
+;; Splitting and percent-encoding are done in C (uri.c).  The regexps
+;; in the comments below describe what the splitters match.
+
 (define-module rfc.uri
   (use srfi-13)
   (use util.match)
@@ -56,6 +59,7 @@
           uri-merge uri-compose
           uri-decode uri-decode-string
           uri-encode uri-encode-string
+          uri-decompose-query
           *rfc2396-unreserved-char-set*
           *rfc3986-unreserved-char-set*
           uri-compose-data uri-decompose-data
@@ -67,51 +71,60 @@
 ;; Generic parser
 ;;
 
-;; Splits URI scheme and the scheme specific part from given URI.
-;; If URI doesn't follow the generic URI syntax, it is regarded
-;; as a relative URI and #f is returned for the scheme.
-;; The escaped characters of the scheme specific part is not unescaped;
-;; their interpretation is dependent on the scheme.
-
-(define (uri-scheme&specific uri)
-  (cond [(#/^([A-Za-z][A-Za-z0-9+.-]*):/ uri)
-         => (^m (values (string-downcase (m 1)) (m 'after)))]
-        [else (values #f uri)]))
-
-(define (uri-decompose-hierarchical specific)
-  (cond
-   [(and (string? specific)
-         (#/^(?:\/\/([^\/?#]*))?([^?#]+)?(?:\?([^#]*))?(?:#(.*))?$/ specific))
-    => (^m (values (m 1) (m 2) (m 3) (m 4)))]
-   [else (values #f #f #f #f)]))
-
-(define (uri-decompose-authority authority)
-  (cond
-   [(and (string? authority)
-         (#/^(?:(?<userinfo>.*?)@)?(?:(?<host>[^:]*)|(?:\[(?<v6host>[a-fA-F\d:]+)\]))(?::(?<port>\d*))?$/ authority))
-    => (^m (values (m 'userinfo) (or (m 'v6host) (m 'host)) (m 'port)))]
-   [else (values #f #f #f)]))
-
-;; A common cliche (suggested by Kouhei Sutou)
-;; Returns: scheme, user-info, host, port, path, query, fragment
-(define (uri-parse uri)
-  (define (filter-non-empty-string str)
-    (and (string? str)
-         (not (string-null? str))
-         str))
-  (receive (scheme specific)
-      (uri-scheme&specific uri)
-    (receive (authority path query fragment)
-        (uri-decompose-hierarchical specific)
-      (receive (user-info host port)
-          (uri-decompose-authority authority)
-        (values scheme
-                user-info
-                (filter-non-empty-string host)
-                (and port (string->number port))
-                (filter-non-empty-string path)
-                query
-                fragment)))))
+;; The components returned by the splitters share the storage with
+;; the given string.
+
+(inline-stub
+ (declcode "#include \"uri.h\"")
+
+ ;; Splits URI scheme and the scheme specific part from given URI.
+ ;; If URI doesn't follow the generic URI syntax, it is regarded
+ ;; as a relative URI and #f is returned for the scheme.
+ ;; The escaped characters of the scheme specific part is not unescaped;
+ ;; their interpretation is dependent on the scheme.
+ ;;   #/^([A-Za-z][A-Za-z0-9+.-]*):/, with the scheme downcased
+ (define-cproc uri-scheme&specific (uri::<string>) ::(<top> <top>)
+   (Scm_URISchemeSpecific uri (& SCM_RESULT0) (& SCM_RESULT1)))
+
+ ;;   #/^(?:\/\/([^\/?#]*))?([^?#]+)?(?:\?([^#]*))?(?:#(.*))?$/
+ (define-cproc uri-decompose-hierarchical (specific)
+   ::(<top> <top> <top> <top>)
+   (if (SCM_STRINGP specific)
+     (Scm_URIDecomposeHierarchical (SCM_STRING specific)
+                                   (& SCM_RESULT0) (& SCM_RESULT1)
+                                   (& SCM_RESULT2) (& SCM_RESULT3))
+     (set! SCM_RESULT0 SCM_FALSE SCM_RESULT1 SCM_FALSE
+           SCM_RESULT2 SCM_FALSE SCM_RESULT3 SCM_FALSE)))
+
+ ;;   #/^(?:(?<userinfo>.*?)@)?(?:(?<host>[^:]*)|(?:\[(?<v6host>[a-fA-F\d:]+)\]))(?::(?<port>\d*))?$/
+ ;; with v6host taking precedence over host
+ (define-cproc uri-decompose-authority (authority) ::(<top> <top> <top>)
+   (if (SCM_STRINGP authority)
+     (Scm_URIDecomposeAuthority (SCM_STRING authority)
+                                (& SCM_RESULT0) (& SCM_RESULT1)
+                                (& SCM_RESULT2))
+     (set! SCM_RESULT0 SCM_FALSE SCM_RESULT1 SCM_FALSE
+           SCM_RESULT2 SCM_FALSE)))
+
+ ;; A common cliche (suggested by Kouhei Sutou)
+ ;; Returns: scheme, user-info, host, port, path, query, fragment
+ ;; Empty host and path are returned as #f, and port as an integer.
+ (define-cproc uri-parse (uri::<string>)
+   ::(<top> <top> <top> <top> <top> <top> <top>)
+   (let* ([r::(.array ScmObj (7))])
+     (Scm_URIParse uri r)
+     (set! SCM_RESULT0 (aref r 0) SCM_RESULT1 (aref r 1)
+           SCM_RESULT2 (aref r 2) SCM_RESULT3 (aref r 3)
+           SCM_RESULT4 (aref r 4) SCM_RESULT5 (aref r 5)
+           SCM_RESULT6 (aref r 6))))
+
+ (define-cproc %uri-decode-string (s::<string> cgi-decode::<boolean>)
+   (return (Scm_URIDecodeString s cgi-decode)))
+ (define-cproc %uri-encode-string (s::<string> noescape::<char-set>)
+   (return (Scm_URIEncodeString s noescape)))
+ (define-cproc %uri-decompose-query (query::<string> cgi-decode::<boolean>)
+   (return (Scm_URIDecomposeQuery query cgi-decode)))
+ )
 
 ;; Convenience utility
 ;;  (uri-ref "http://foo:8080/baz?q" 'host) => "foo"
@@ -299,17 +312,31 @@
            (loop (read-char))]
           [else (write-char c) (loop (read-char))])))
 
+;; The string versions don't need ports unless a character encoding
+;; conversion is involved.
+(define (%native-encoding? encoding)
+  (or (eq? encoding (gauche-character-encoding))
+      (ces-upper-compatible? encoding (gauche-character-encoding))))
+
 (define (uri-decode-string string :key (encoding (gauche-character-encoding))
                            :allow-other-keys args)
   (define (wrap out)
     (wrap-with-output-conversion out (gauche-character-encoding)
                                  :from-code encoding))
-  (call-with-string-io string
-    (^[in out]
-      (with-ports in (wrap out) (current-error-port)
-        (^[]
-          (apply uri-decode args)
-          (close-output-port (current-output-port)))))))
+  (if (%native-encoding? encoding)
+    (%uri-decode-string string (get-keyword :cgi-decode args #f))
+    (call-with-string-io string
+      (^[in out]
+        (with-ports in (wrap out) (current-error-port)
+          (^[]
+            (apply uri-decode args)
+            (close-output-port (current-output-port))))))))
+
+;; Splits a query string into ((name . value) ...), decoding both.
+;; Fields are separated by '&' or ';'.  A field without '=' gets #t
+;; as the value.
+(define (uri-decompose-query query :key (cgi-decode #t))
+  (%uri-decompose-query query cgi-decode))
 
 ;; Default set of characters that can be passed without escaping.
 ;; See 2.3 "Unreserved Characters" of RFC 2396.  It is slightly
@@ -335,10 +362,13 @@
   (define (wrap in)
     (wrap-with-input-conversion in (gauche-character-encoding)
                                 :to-code encoding))
-  (call-with-string-io string
-    (^[in out]
-      (with-ports (wrap in) out (current-error-port)
-        (cut apply uri-encode args)))))
+  (if (%native-encoding? encoding)
+    (%uri-encode-string string (get-keyword :noescape args
+                                            *rfc3986-unreserved-char-set*))
+    (call-with-string-io string
+      (^[in out]
+        (with-ports (wrap in) out (current-error-port)
+          (cut apply uri-encode args))))))
 
 ;;==============================================================
 ;; Data uri scheme (rfc2397)
@@ -0,0 +1,1002 @@
+/*
+ * hamt.c - Hash array mapped trie
+ *
+ *   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include "hamt.h"
+#include <gauche/bits_inline.h>
+
+/*===================================================================
+ * Nodes and leaves
+ */
+
+/* A node is a 32-way branch.  EMAP tells which logical indices have
+ * entries, and LMAP tells which of them are leaves; the other entries
+ * are child nodes.  The entries follow in compact form, as in
+ * CompactTrie.  COUNT is the number of keys under the node, which lets
+ * set operations skip shared subtrees in O(1).
+ */
+struct HamtNodeRec {
+    u_long   emap;              /* bitmap: 1 = has entry */
+    u_long   lmap;              /* bitmap: 1 = entry is leaf */
+    u_long   count;             /* number of keys in this subtree */
+    void    *owner;             /* edit token of the transient, or NULL */
+    void    *entries[1];        /* variable length */
+};
+
+/* A leaf holds the keys that has the same (32bit) hash value.  Usually
+ * there's only one; the rest is kept in CHAIN as an alist.  Leaves are
+ * never modified once created.
+ */
+typedef struct HamtLeafRec {
+    u_long   hash;
+    ScmObj   key;
+    ScmObj   value;
+    ScmObj   chain;             /* ((key . value) ...) */
+} HamtLeaf;
+
+#define HAMT_SHIFT      5
+#define HAMT_MASK       0x1f
+#define HAMT_HASH_BITS  32
+#define HAMT_HASH_MASK  0xffffffffUL
+
+#define HASH2INDEX(hv, shift)   (((hv) >> (shift)) & HAMT_MASK)
+#define NODE_NENTRIES(n)        ((int)Scm__CountBitsInWord((n)->emap))
+#define NODE_OFFSET(n, ind)     ((int)Scm__CountBitsBelow((n)->emap, (ind)))
+#define NODE_HAS(n, ind)        ((n)->emap & (1UL<<(ind)))
+#define NODE_LEAFP(n, ind)      ((n)->lmap & (1UL<<(ind)))
+
+static HamtNode *node_alloc(int nentries, void *owner)
+{
+    HamtNode *n = SCM_NEW2(HamtNode*,
+                           sizeof(HamtNode)
+                           + sizeof(void*)*(nentries > 0? nentries-1 : 0));
+    n->emap = n->lmap = 0;
+    n->count = 0;
+    n->owner = owner;
+    return n;
+}
+
+/* Returns N itself if it is owned by OWNER, or its copy otherwise. */
+static HamtNode *node_edit(HamtNode *n, void *owner)
+{
+    if (owner != NULL && n->owner == owner) return n;
+    int size = NODE_NENTRIES(n);
+    HamtNode *m = node_alloc(size, owner);
+    m->emap = n->emap;
+    m->lmap = n->lmap;
+    m->count = n->count;
+    memcpy(m->entries, n->entries, sizeof(void*)*size);
+    return m;
+}
+
+/* Returns a new node with ENTRY added at logical index IND. */
+static HamtNode *node_insert(HamtNode *n, int ind, void *entry, int leafp,
+                             u_long count, void *owner)
+{
+    int size = NODE_NENTRIES(n);
+    int off = NODE_OFFSET(n, ind);
+    HamtNode *m = node_alloc(size+1, owner);
+    m->emap = n->emap | (1UL<<ind);
+    m->lmap = leafp? (n->lmap | (1UL<<ind)) : n->lmap;
+    m->count = n->count + count;
+    memcpy(m->entries, n->entries, sizeof(void*)*off);
+    m->entries[off] = entry;
+    memcpy(m->entries+off+1, n->entries+off, sizeof(void*)*(size-off));
+    return m;
+}
+
+/* Returns a node with the entry at logical index IND removed, or NULL
+   if it becomes empty. */
+static HamtNode *node_remove(HamtNode *n, int ind, u_long count, void *owner)
+{
+    int size = NODE_NENTRIES(n);
+    int off = NODE_OFFSET(n, ind);
+    if (size == 1) return NULL;
+    HamtNode *m;
+    if (owner != NULL && n->owner == owner) {
+        m = n;
+        memmove(m->entries+off, m->entries+off+1,
+                sizeof(void*)*(size-off-1));
+        m->entries[size-1] = NULL;  /* for GC */
+    } else {
+        m = node_alloc(size-1, owner);
+        memcpy(m->entries, n->entries, sizeof(void*)*off);
+        memcpy(m->entries+off, n->entries+off+1, sizeof(void*)*(size-off-1));
+    }
+    m->emap = n->emap & ~(1UL<<ind);
+    m->lmap = n->lmap & ~(1UL<<ind);
+    m->count = n->count - count;
+    return m;
+}
+
+static HamtLeaf *leaf_new(u_long hv, ScmObj key, ScmObj value, ScmObj chain)
+{
+    HamtLeaf *l = SCM_NEW(HamtLeaf);
+    l->hash = hv;
+    l->key = key;
+    l->value = value;
+    l->chain = chain;
+    return l;
+}
+
+static inline u_long leaf_count(HamtLeaf *l)
+{
+    return SCM_NULLP(l->chain)? 1 : 1 + Scm_Length(l->chain);
+}
+
+static inline u_long entry_count(void *e, int leafp)
+{
+    return leafp? leaf_count((HamtLeaf*)e) : ((HamtNode*)e)->count;
+}
+
+static void node_recount(HamtNode *n)
+{
+    u_long c = 0;
+    for (int ind = 0, off = 0; ind <= HAMT_MASK; ind++) {
+        if (NODE_HAS(n, ind)) {
+            c += entry_count(n->entries[off++], NODE_LEAFP(n, ind));
+        }
+    }
+    n->count = c;
+}
+
+/* Returns the only entry of N if it is a leaf, or NULL. */
+static HamtLeaf *node_single_leaf(HamtNode *n)
+{
+    if (n->emap == n->lmap && NODE_NENTRIES(n) == 1) {
+        return (HamtLeaf*)n->entries[0];
+    }
+    return NULL;
+}
+
+/* Creates a subtree at level SHIFT that contains two leaves with
+   different hash values. */
+static HamtNode *make_subnode(int shift, HamtLeaf *a, HamtLeaf *b,
+                              void *owner)
+{
+    SCM_ASSERT(shift < HAMT_HASH_BITS);
+    int ia = HASH2INDEX(a->hash, shift);
+    int ib = HASH2INDEX(b->hash, shift);
+    HamtNode *n;
+    if (ia == ib) {
+        n = node_alloc(1, owner);
+        n->emap = 1UL<<ia;
+        n->entries[0] = make_subnode(shift+HAMT_SHIFT, a, b, owner);
+    } else {
+        n = node_alloc(2, owner);
+        n->emap = n->lmap = (1UL<<ia) | (1UL<<ib);
+        n->entries[0] = (ia < ib)? a : b;
+        n->entries[1] = (ia < ib)? b : a;
+    }
+    n->count = leaf_count(a) + leaf_count(b);
+    return n;
+}
+
+/*===================================================================
+ * Hashing and comparison
+ */
+
+static u_long string_hash(ScmObj key)
+{
+    if (!SCM_STRINGP(key)) {
+        Scm_Error("string hamt got non-string key: %S", key);
+    }
+    return Scm_HashString(SCM_STRING(key), 0);
+}
+
+static int string_cmp(ScmObj a, ScmObj b)
+{
+    if (!SCM_STRINGP(a)) {
+        Scm_Error("string hamt got non-string key: %S", a);
+    }
+    if (!SCM_STRINGP(b)) {
+        Scm_Error("string hamt got non-string key: %S", b);
+    }
+    return Scm_StringEqual(SCM_STRING(a), SCM_STRING(b));
+}
+
+static u_long hamt_hash(Hamt *h, ScmObj key)
+{
+    u_long hv;
+    if (h->hashfn) {
+        hv = h->hashfn(key);
+    } else {
+        ScmObj f = h->comparator->hashFn;
+        ScmObj r = Scm_ApplyRec1(f, key);
+        if (!SCM_INTEGERP(r)) {
+            Scm_Error("hash function %S returns non-integer: %S", f, r);
+        }
+        hv = Scm_GetIntegerUClamp(r, SCM_CLAMP_BOTH, NULL);
+    }
+#if SIZEOF_LONG > 4
+    hv ^= hv >> 32;
+#endif
+    return hv & HAMT_HASH_MASK;
+}
+
+static int hamt_eq(Hamt *h, ScmObj a, ScmObj b)
+{
+    if (h->cmpfn) return h->cmpfn(a, b);
+    ScmObj r = Scm_ApplyRec2(h->comparator->eqFn, a, b);
+    return !SCM_FALSEP(r);
+}
+
+/*===================================================================
+ * Leaf operations
+ */
+
+/* Returns the value, or SCM_UNBOUND.  If RKEY isn't NULL, the key
+   in the leaf is stored in it. */
+static ScmObj leaf_lookup(Hamt *h, HamtLeaf *l, ScmObj key, ScmObj *rkey)
+{
+    if (hamt_eq(h, key, l->key)) {
+        if (rkey) *rkey = l->key;
+        return l->value;
+    }
+    ScmObj cp;
+    SCM_FOR_EACH(cp, l->chain) {
+        if (hamt_eq(h, key, SCM_CAAR(cp))) {
+            if (rkey) *rkey = SCM_CAAR(cp);
+            return SCM_CDAR(cp);
+        }
+    }
+    return SCM_UNBOUND;
+}
+
+/* Returns a leaf with KEY associated to VALUE.  If OVERWRITE is false
+   and KEY already exists, L is returned. */
+static HamtLeaf *leaf_put(Hamt *h, HamtLeaf *l, ScmObj key, ScmObj value,
+                          int overwrite, int *added)
+{
+    if (hamt_eq(h, key, l->key)) {
+        if (!overwrite || SCM_EQ(l->value, value)) return l;
+        return leaf_new(l->hash, key, value, l->chain);
+    }
+    ScmObj h0 = SCM_NIL, t0 = SCM_NIL, cp;
+    SCM_FOR_EACH(cp, l->chain) {
+        if (hamt_eq(h, key, SCM_CAAR(cp))) {
+            if (!overwrite || SCM_EQ(SCM_CDAR(cp), value)) return l;
+            SCM_APPEND1(h0, t0, Scm_Cons(key, value));
+            SCM_APPEND(h0, t0, SCM_CDR(cp));
+            return leaf_new(l->hash, l->key, l->value, h0);
+        }
+        SCM_APPEND1(h0, t0, SCM_CAR(cp));
+    }
+    *added = TRUE;
+    return leaf_new(l->hash, l->key, l->value,
+                    Scm_Cons(Scm_Cons(key, value), l->chain));
+}
+
+/* Returns a leaf without KEY, or NULL if it becomes empty.  If KEY
+   isn't in L, L is returned. */
+static HamtLeaf *leaf_delete(Hamt *h, HamtLeaf *l, ScmObj key)
+{
+    if (hamt_eq(h, key, l->key)) {
+        if (SCM_NULLP(l->chain)) return NULL;
+        ScmObj p = SCM_CAR(l->chain);
+        return leaf_new(l->hash, SCM_CAR(p), SCM_CDR(p), SCM_CDR(l->chain));
+    }
+    ScmObj h0 = SCM_NIL, t0 = SCM_NIL, cp;
+    SCM_FOR_EACH(cp, l->chain) {
+        if (hamt_eq(h, key, SCM_CAAR(cp))) {
+            SCM_APPEND(h0, t0, SCM_CDR(cp));
+            return leaf_new(l->hash, l->key, l->value, h0);
+        }
+        SCM_APPEND1(h0, t0, SCM_CAR(cp));
+    }
+    return l;
+}
+
+/* Returns a leaf that keeps the entries of L whose presence in the
+   entry E (at level SHIFT) matches KEEP.  Used by set operations. */
+static ScmObj entry_lookup(Hamt *h, void *e, int leafp, int shift,
+                           u_long hv, ScmObj key, ScmObj *rkey);
+
+static HamtLeaf *leaf_filter(Hamt *h, HamtLeaf *l, void *e, int leafp,
+                             int shift, int keep)
+{
+    ScmObj h0 = SCM_NIL, t0 = SCM_NIL, cp;
+    int changed = FALSE;
+    if ((entry_lookup(h, e, leafp, shift, l->hash, l->key, NULL)
+         != SCM_UNBOUND) == keep) {
+        SCM_APPEND1(h0, t0, Scm_Cons(l->key, l->value));
+    } else {
+        changed = TRUE;
+    }
+    SCM_FOR_EACH(cp, l->chain) {
+        ScmObj k = SCM_CAAR(cp);
+        if ((entry_lookup(h, e, leafp, shift, l->hash, k, NULL)
+             != SCM_UNBOUND) == keep) {
+            SCM_APPEND1(h0, t0, SCM_CAR(cp));
+        } else {
+            changed = TRUE;
+        }
+    }
+    if (!changed) return l;
+    if (SCM_NULLP(h0)) return NULL;
+    return leaf_new(l->hash, SCM_CAAR(h0), SCM_CDAR(h0), SCM_CDR(h0));
+}
+
+/*===================================================================
+ * Lookup
+ */
+
+static ScmObj node_lookup(Hamt *h, HamtNode *n, int shift,
+                          u_long hv, ScmObj key, ScmObj *rkey)
+{
+    for (;;) {
+        int ind = HASH2INDEX(hv, shift);
+        if (!NODE_HAS(n, ind)) return SCM_UNBOUND;
+        void *e = n->entries[NODE_OFFSET(n, ind)];
+        if (NODE_LEAFP(n, ind)) {
+            HamtLeaf *l = (HamtLeaf*)e;
+            if (l->hash != hv) return SCM_UNBOUND;
+            return leaf_lookup(h, l, key, rkey);
+        }
+        n = (HamtNode*)e;
+        shift += HAMT_SHIFT;
+    }
+}
+
+/* E is an entry whose children are at level SHIFT. */
+static ScmObj entry_lookup(Hamt *h, void *e, int leafp, int shift,
+                           u_long hv, ScmObj key, ScmObj *rkey)
+{
+    if (leafp) {
+        HamtLeaf *l = (HamtLeaf*)e;
+        if (l->hash != hv) return SCM_UNBOUND;
+        return leaf_lookup(h, l, key, rkey);
+    }
+    return node_lookup(h, (HamtNode*)e, shift, hv, key, rkey);
+}
+
+ScmObj HamtRef(Hamt *h, ScmObj key, ScmObj fallback)
+{
+    if (h->root == NULL) return fallback;
+    ScmObj r = node_lookup(h, h->root, 0, hamt_hash(h, key), key, NULL);
+    return SCM_UNBOUNDP(r)? fallback : r;
+}
+
+u_long HamtNumEntries(Hamt *h)
+{
+    return h->root? h->root->count : 0;
+}
+
+/*===================================================================
+ * Insertion and deletion
+ */
+
+static HamtNode *node_put(Hamt *h, HamtNode *n, int shift, u_long hv,
+                          ScmObj key, ScmObj value, int overwrite,
+                          void *owner, int *added)
+{
+    int ind = HASH2INDEX(hv, shift);
+    if (!NODE_HAS(n, ind)) {
+        *added = TRUE;
+        return node_insert(n, ind, leaf_new(hv, key, value, SCM_NIL),
+                           TRUE, 1, owner);
+    }
+    int off = NODE_OFFSET(n, ind);
+    int leafp = NODE_LEAFP(n, ind);
+    void *e = n->entries[off], *ne;
+    if (leafp) {
+        HamtLeaf *l = (HamtLeaf*)e;
+        if (l->hash == hv) {
+            ne = leaf_put(h, l, key, value, overwrite, added);
+        } else {
+            *added = TRUE;
+            ne = make_subnode(shift+HAMT_SHIFT, l,
+                              leaf_new(hv, key, value, SCM_NIL), owner);
+            leafp = FALSE;
+        }
+    } else {
+        ne = node_put(h, (HamtNode*)e, shift+HAMT_SHIFT, hv, key, value,
+                      overwrite, owner, added);
+    }
+    if (ne == e) {
+        /* the child may have been modified in place by a transient */
+        if (*added) n->count++;
+        return n;
+    }
+    HamtNode *m = node_edit(n, owner);
+    m->entries[off] = ne;
+    if (!leafp) m->lmap &= ~(1UL<<ind);
+    if (*added) m->count++;
+    return m;
+}
+
+/* Returns NULL if the node becomes empty.  REMOVED is set if KEY
+   is found. */
+static HamtNode *node_delete(Hamt *h, HamtNode *n, int shift, u_long hv,
+                             ScmObj key, void *owner, int *removed)
+{
+    int ind = HASH2INDEX(hv, shift);
+    if (!NODE_HAS(n, ind)) return n;
+    int off = NODE_OFFSET(n, ind);
+    void *e = n->entries[off], *ne;
+    int leafp = NODE_LEAFP(n, ind);
+    if (leafp) {
+        HamtLeaf *l = (HamtLeaf*)e;
+        if (l->hash != hv) return n;
+        ne = leaf_delete(h, l, key);
+        if (ne == e) return n;
+        *removed = TRUE;
+        if (ne == NULL) return node_remove(n, ind, 1, owner);
+    } else {
+        HamtNode *c = node_delete(h, (HamtNode*)e, shift+HAMT_SHIFT,
+                                  hv, key, owner, removed);
+        if (c == e) {
+            /* the child may have been modified in place by a transient */
+            if (*removed) n->count--;
+            return n;
+        }
+        if (c == NULL) return node_remove(n, ind, 1, owner);
+        HamtLeaf *l = node_single_leaf(c);
+        if (l) { ne = l; leafp = TRUE; }
+        else   { ne = c; }
+    }
+    HamtNode *m = node_edit(n, owner);
+    m->entries[off] = ne;
+    if (leafp) m->lmap |= 1UL<<ind;
+    m->count--;
+    return m;
+}
+
+static Hamt *hamt_derive(Hamt *h, HamtNode *root, ScmClass *klass)
+{
+    Hamt *z = SCM_NEW(Hamt);
+    SCM_SET_CLASS(z, klass);
+    z->root = root;
+    z->hashfn = h->hashfn;
+    z->cmpfn = h->cmpfn;
+    z->comparator = h->comparator;
+    z->owner = NULL;
+    return z;
+}
+
+static HamtNode *root_put(Hamt *h, ScmObj key, ScmObj value, void *owner)
+{
+    u_long hv = hamt_hash(h, key);
+    if (h->root == NULL) {
+        HamtNode *n = node_alloc(1, owner);
+        int ind = HASH2INDEX(hv, 0);
+        n->emap = n->lmap = 1UL<<ind;
+        n->count = 1;
+        n->entries[0] = leaf_new(hv, key, value, SCM_NIL);
+        return n;
+    }
+    int added = FALSE;
+    return node_put(h, h->root, 0, hv, key, value, TRUE, owner, &added);
+}
+
+static HamtNode *root_delete(Hamt *h, ScmObj key, void *owner,
+                             int *removed)
+{
+    if (h->root == NULL) return NULL;
+    return node_delete(h, h->root, 0, hamt_hash(h, key), key, owner, removed);
+}
+
+ScmObj HamtPut(Hamt *h, ScmObj key, ScmObj value)
+{
+    HamtNode *r = root_put(h, key, value, NULL);
+    if (r == h->root) return SCM_OBJ(h);
+    return SCM_OBJ(hamt_derive(h, r, SCM_CLASS_HAMT));
+}
+
+ScmObj HamtDelete(Hamt *h, ScmObj key)
+{
+    int removed = FALSE;
+    HamtNode *r = root_delete(h, key, NULL, &removed);
+    if (r == h->root) return SCM_OBJ(h);
+    return SCM_OBJ(hamt_derive(h, r, SCM_CLASS_HAMT));
+}
+
+/*===================================================================
+ * Transients
+ */
+
+static void check_transient(Hamt *t)
+{
+    if (t->owner == NULL) {
+        Scm_Error("transient hamt has already been made persistent: %S",
+                  SCM_OBJ(t));
+    }
+}
+
+ScmObj HamtTransient(Hamt *h)
+{
+    Hamt *t = hamt_derive(h, h->root, SCM_CLASS_TRANSIENT_HAMT);
+    t->owner = SCM_NEW_ATOMIC(char);  /* just a unique token */
+    return SCM_OBJ(t);
+}
+
+ScmObj HamtPersistent(Hamt *t)
+{
+    check_transient(t);
+    t->owner = NULL;
+    return SCM_OBJ(hamt_derive(t, t->root, SCM_CLASS_HAMT));
+}
+
+void HamtPutX(Hamt *t, ScmObj key, ScmObj value)
+{
+    check_transient(t);
+    t->root = root_put(t, key, value, t->owner);
+}
+
+int HamtDeleteX(Hamt *t, ScmObj key)
+{
+    check_transient(t);
+    int removed = FALSE;
+    t->root = root_delete(t, key, t->owner, &removed);
+    return removed;
+}
+
+/*===================================================================
+ * Concurrent hamt
+ *
+ *  A concurrent hamt is a mutable reference to an immutable hamt.
+ *  Readers take the current hamt with a single load and search it
+ *  without locking; since a published hamt is never modified, they
+ *  see a consistent map however the writers proceed.  A writer
+ *  derives a new hamt by path copying and installs it with CAS,
+ *  retrying if another writer got in first.  The nodes of the old
+ *  version are reclaimed by GC once no reader holds it, so we don't
+ *  need grace periods as RCU does.
+ */
+
+static void chamt_print(ScmObj obj, ScmPort *port, ScmWriteContext *ctx)
+{
+    Scm_Printf(port, "#<concurrent-hamt %p (%lu entries)>", obj,
+               HamtNumEntries(ConcurrentHamtSnapshot(CONCURRENT_HAMT(obj))));
+}
+
+SCM_DEFINE_BUILTIN_CLASS(Scm_ConcurrentHamtClass,
+                         chamt_print, NULL, NULL, NULL,
+                         SCM_CLASS_DICTIONARY_CPL);
+
+ScmObj MakeConcurrentHamt(Hamt *init)
+{
+    ConcurrentHamt *c = SCM_NEW(ConcurrentHamt);
+    SCM_SET_CLASS(c, SCM_CLASS_CONCURRENT_HAMT);
+    AO_store_release(&c->current, (AO_t)init);
+    return SCM_OBJ(c);
+}
+
+Hamt *ConcurrentHamtSnapshot(ConcurrentHamt *c)
+{
+    return (Hamt*)AO_load_acquire(&c->current);
+}
+
+/* Installs UPD if the current hamt is still OLD. */
+int ConcurrentHamtCompareAndSet(ConcurrentHamt *c, Hamt *old, Hamt *upd)
+{
+    if (!HAMT_P(upd)) {
+        Scm_Error("hamt required, but got: %S", SCM_OBJ(upd));
+    }
+    if (upd->comparator != old->comparator) {
+        Scm_Error("new hamt has a different comparator from %S: %S",
+                  SCM_OBJ(c), SCM_OBJ(upd));
+    }
+    return AO_compare_and_swap_full(&c->current, (AO_t)old, (AO_t)upd);
+}
+
+ScmObj ConcurrentHamtRef(ConcurrentHamt *c, ScmObj key, ScmObj fallback)
+{
+    return HamtRef(ConcurrentHamtSnapshot(c), key, fallback);
+}
+
+void ConcurrentHamtPut(ConcurrentHamt *c, ScmObj key, ScmObj value)
+{
+    for (;;) {
+        Hamt *h = ConcurrentHamtSnapshot(c);
+        ScmObj n = HamtPut(h, key, value);
+        if (AO_compare_and_swap_full(&c->current, (AO_t)h, (AO_t)n)) return;
+    }
+}
+
+int ConcurrentHamtDelete(ConcurrentHamt *c, ScmObj key)
+{
+    for (;;) {
+        Hamt *h = ConcurrentHamtSnapshot(c);
+        ScmObj n = HamtDelete(h, key);
+        if (n == SCM_OBJ(h)) return FALSE; /* not there */
+        if (AO_compare_and_swap_full(&c->current, (AO_t)h, (AO_t)n)) {
+            return TRUE;
+        }
+    }
+}
+
+/*===================================================================
+ * Set operations
+ */
+
+static void check_compatible(Hamt *a, Hamt *b)
+{
+    if (a->comparator != b->comparator || a->hashfn != b->hashfn) {
+        Scm_Error("hamts with different comparators: %S and %S",
+                  SCM_OBJ(a), SCM_OBJ(b));
+    }
+}
+
+/* Puts all entries of leaf L into the entry E, whose children are at
+   level SHIFT.  Returns a new node. */
+static HamtNode *entry_put_leaf(Hamt *h, void *e, int leafp, int shift,
+                                HamtLeaf *l, int overwrite)
+{
+    HamtNode *n;
+    int added = FALSE;
+    if (leafp) {
+        HamtLeaf *el = (HamtLeaf*)e;
+        SCM_ASSERT(el->hash != l->hash);
+        return make_subnode(shift, el, l, NULL);
+    }
+    n = node_put(h, (HamtNode*)e, shift, l->hash, l->key, l->value,
+                 overwrite, NULL, &added);
+    ScmObj cp;
+    SCM_FOR_EACH(cp, l->chain) {
+        n = node_put(h, n, shift, l->hash, SCM_CAAR(cp), SCM_CDAR(cp),
+                     overwrite, NULL, &added);
+    }
+    return n;
+}
+
+/* Union of two leaves with the same hash value; A takes precedence. */
+static HamtLeaf *leaf_union(Hamt *h, HamtLeaf *a, HamtLeaf *b)
+{
+    int added = FALSE;
+    HamtLeaf *r = leaf_put(h, a, b->key, b->value, FALSE, &added);
+    ScmObj cp;
+    SCM_FOR_EACH(cp, b->chain) {
+        r = leaf_put(h, r, SCM_CAAR(cp), SCM_CDAR(cp), FALSE, &added);
+    }
+    return r;
+}
+
+static HamtNode *node_union(Hamt *h, HamtNode *a, HamtNode *b, int shift)
+{
+    if (a == b) return a;
+    u_long emap = a->emap | b->emap;
+    HamtNode *n = node_alloc((int)Scm__CountBitsInWord(emap), NULL);
+    n->emap = emap;
+    for (int ind = 0, off = 0; ind <= HAMT_MASK; ind++) {
+        if (!(emap & (1UL<<ind))) continue;
+        int ha = NODE_HAS(a, ind), hb = NODE_HAS(b, ind);
+        if (!hb) {
+            n->entries[off] = a->entries[NODE_OFFSET(a, ind)];
+            if (NODE_LEAFP(a, ind)) n->lmap |= 1UL<<ind;
+        } else if (!ha) {
+            n->entries[off] = b->entries[NODE_OFFSET(b, ind)];
+            if (NODE_LEAFP(b, ind)) n->lmap |= 1UL<<ind;
+        } else {
+            void *ea = a->entries[NODE_OFFSET(a, ind)];
+            void *eb = b->entries[NODE_OFFSET(b, ind)];
+            int la = NODE_LEAFP(a, ind), lb = NODE_LEAFP(b, ind);
+            int cs = shift + HAMT_SHIFT;
+            if (la && lb
+                && ((HamtLeaf*)ea)->hash == ((HamtLeaf*)eb)->hash) {
+                n->entries[off] = leaf_union(h, ea, eb);
+                n->lmap |= 1UL<<ind;
+            } else if (la) {
+                n->entries[off] = entry_put_leaf(h, eb, lb, cs, ea, TRUE);
+            } else if (lb) {
+                n->entries[off] = entry_put_leaf(h, ea, FALSE, cs, eb, FALSE);
+            } else {
+                n->entries[off] = node_union(h, ea, eb, cs);
+            }
+        }
+        off++;
+    }
+    node_recount(n);
+    return n;
+}
+
+ScmObj HamtUnion(Hamt *a, Hamt *b)
+{
+    check_compatible(a, b);
+    if (b->root == NULL) return SCM_OBJ(a);
+    if (a->root == NULL) return SCM_OBJ(hamt_derive(a, b->root,
+                                                    SCM_CLASS_HAMT));
+    HamtNode *r = node_union(a, a->root, b->root, 0);
+    if (r == a->root) return SCM_OBJ(a);
+    return SCM_OBJ(hamt_derive(a, r, SCM_CLASS_HAMT));
+}
+
+/* Common routine of intersection (KEEP = TRUE) and difference
+ * (KEEP = FALSE).  Returns the entries of node A (at level SHIFT) whose
+ * presence in node B matches KEEP.  The result is a node, a leaf (if
+ * LEAFP is set), or NULL.  A is returned if nothing is removed.
+ */
+static void *node_filter(Hamt *h, HamtNode *a, HamtNode *b, int shift,
+                         int keep, int *leafp)
+{
+    *leafp = FALSE;
+    if (a == b) return keep? a : NULL;
+
+    void *ents[HAMT_MASK+1];
+    int   lfs[HAMT_MASK+1];
+    int   changed = FALSE;
+    u_long emap = 0;
+    int cs = shift + HAMT_SHIFT;
+
+    for (int ind = 0, off = 0; ind <= HAMT_MASK; ind++) {
+        if (!NODE_HAS(a, ind)) continue;
+        void *ea = a->entries[off++];
+        int la = NODE_LEAFP(a, ind);
+        void *r = ea;
+        int lr = la;
+        if (!NODE_HAS(b, ind)) {
+            if (keep) r = NULL;
+        } else {
+            void *eb = b->entries[NODE_OFFSET(b, ind)];
+            int lb = NODE_LEAFP(b, ind);
+            if (la) {
+                r = leaf_filter(h, ea, eb, lb, cs, keep);
+            } else if (lb) {
+                HamtLeaf *l = (HamtLeaf*)eb;
+                if (keep) {
+                    /* entries of A that are also in leaf L */
+                    ScmObj k = SCM_UNBOUND;
+                    ScmObj v = node_lookup(h, ea, cs, l->hash, l->key, &k);
+                    ScmObj h0 = SCM_NIL, t0 = SCM_NIL, cp;
+                    if (!SCM_UNBOUNDP(v)) SCM_APPEND1(h0, t0, Scm_Cons(k, v));
+                    SCM_FOR_EACH(cp, l->chain) {
+                        v = node_lookup(h, ea, cs, l->hash, SCM_CAAR(cp), &k);
+                        if (!SCM_UNBOUNDP(v)) {
+                            SCM_APPEND1(h0, t0, Scm_Cons(k, v));
+                        }
+                    }
+                    r = SCM_NULLP(h0)? NULL
+                        : leaf_new(l->hash, SCM_CAAR(h0), SCM_CDAR(h0),
+                                   SCM_CDR(h0));
+                    lr = TRUE;
+                } else {
+                    int removed = FALSE;
+                    HamtNode *c = node_delete(h, ea, cs, l->hash, l->key,
+                                              NULL, &removed);
+                    ScmObj cp;
+                    SCM_FOR_EACH(cp, l->chain) {
+                        if (c == NULL) break;
+                        c = node_delete(h, c, cs, l->hash, SCM_CAAR(cp),
+                                        NULL, &removed);
+                    }
+                    r = c;
+                    if (c && c != ea) {
+                        HamtLeaf *sl = node_single_leaf(c);
+                        if (sl) { r = sl; lr = TRUE; }
+                    }
+                }
+            } else {
+                r = node_filter(h, ea, eb, cs, keep, &lr);
+            }
+        }
+        if (r != ea) changed = TRUE;
+        if (r != NULL) {
+            int k = (int)Scm__CountBitsInWord(emap);
+            ents[k] = r;
+            lfs[k] = lr;
+            emap |= 1UL<<ind;
+        }
+    }
+    if (!changed) return a;
+    int size = (int)Scm__CountBitsInWord(emap);
+    if (size == 0) return NULL;
+    if (size == 1 && lfs[0] && shift > 0) {
+        *leafp = TRUE;
+        return ents[0];
+    }
+    HamtNode *n = node_alloc(size, NULL);
+    n->emap = emap;
+    for (int ind = 0, k = 0; ind <= HAMT_MASK; ind++) {
+        if (!(emap & (1UL<<ind))) continue;
+        n->entries[k] = ents[k];
+        if (lfs[k]) n->lmap |= 1UL<<ind;
+        k++;
+    }
+    node_recount(n);
+    return n;
+}
+
+static ScmObj hamt_filter(Hamt *a, Hamt *b, int keep)
+{
+    check_compatible(a, b);
+    if (a->root == NULL) return SCM_OBJ(a);
+    if (b->root == NULL) {
+        return keep? SCM_OBJ(hamt_derive(a, NULL, SCM_CLASS_HAMT)) : SCM_OBJ(a);
+    }
+    int leafp;
+    HamtNode *r = node_filter(a, a->root, b->root, 0, keep, &leafp);
+    SCM_ASSERT(!leafp);
+    if (r == a->root) return SCM_OBJ(a);
+    return SCM_OBJ(hamt_derive(a, r, SCM_CLASS_HAMT));
+}
+
+ScmObj HamtIntersection(Hamt *a, Hamt *b)
+{
+    return hamt_filter(a, b, TRUE);
+}
+
+ScmObj HamtDifference(Hamt *a, Hamt *b)
+{
+    return hamt_filter(a, b, FALSE);
+}
+
+/*===================================================================
+ * Constructor
+ */
+
+ScmObj MakeHamt(ScmHashType type, ScmComparator *comparator)
+{
+    Hamt *h = SCM_NEW(Hamt);
+    SCM_SET_CLASS(h, SCM_CLASS_HAMT);
+    h->root = NULL;
+    h->comparator = comparator;
+    h->owner = NULL;
+
+    switch (type) {
+    case SCM_HASH_EQ:
+        h->hashfn = Scm_EqHash;
+        h->cmpfn = Scm_EqP;
+        break;
+    case SCM_HASH_EQV:
+        h->hashfn = Scm_EqvHash;
+        h->cmpfn = Scm_EqvP;
+        break;
+    case SCM_HASH_EQUAL:
+        h->hashfn = Scm_Hash;
+        h->cmpfn = Scm_EqualP;
+        break;
+    case SCM_HASH_STRING:
+        h->hashfn = string_hash;
+        h->cmpfn = string_cmp;
+        break;
+    case SCM_HASH_GENERAL:
+        SCM_ASSERT(comparator != NULL);
+        h->hashfn = NULL;
+        h->cmpfn = NULL;
+        break;
+    default:
+        Scm_Error("invalid hash type (%d) for a hamt", type);
+    }
+    return SCM_OBJ(h);
+}
+
+SCM_DEFINE_BUILTIN_CLASS(Scm_HamtClass,
+                         NULL, NULL, NULL, NULL,
+                         SCM_CLASS_DICTIONARY_CPL);
+SCM_DEFINE_BUILTIN_CLASS(Scm_TransientHamtClass,
+                         NULL, NULL, NULL, NULL,
+                         SCM_CLASS_DICTIONARY_CPL);
+
+/*===================================================================
+ * Iterators
+ */
+
+void HamtIterInit(HamtIter *it, Hamt *h)
+{
+    it->chain = SCM_NIL;
+    if (h->root == NULL) {
+        it->depth = -1;
+    } else {
+        it->depth = 0;
+        it->nodes[0] = h->root;
+        it->index[0] = 0;
+    }
+}
+
+/* returns (key . value) or #f */
+ScmObj HamtIterNext(HamtIter *it)
+{
+    if (SCM_PAIRP(it->chain)) {
+        ScmObj p = SCM_CAR(it->chain);
+        it->chain = SCM_CDR(it->chain);
+        return p;
+    }
+    while (it->depth >= 0) {
+        HamtNode *n = it->nodes[it->depth];
+        int ind = it->index[it->depth];
+        while (ind <= HAMT_MASK && !NODE_HAS(n, ind)) ind++;
+        if (ind > HAMT_MASK) {
+            it->depth--;
+            continue;
+        }
+        it->index[it->depth] = ind+1;
+        void *e = n->entries[NODE_OFFSET(n, ind)];
+        if (NODE_LEAFP(n, ind)) {
+            HamtLeaf *l = (HamtLeaf*)e;
+            it->chain = l->chain;
+            return Scm_Cons(l->key, l->value);
+        }
+        SCM_ASSERT(it->depth+1 < HAMT_MAX_DEPTH);
+        it->depth++;
+        it->nodes[it->depth] = (HamtNode*)e;
+        it->index[it->depth] = 0;
+    }
+    return SCM_FALSE;
+}
+
+/*===================================================================
+ * Miscellaneous
+ */
+
+static u_long node_check(Hamt *h, HamtNode *n, int shift, u_long prefix)
+{
+    if (n->emap == 0) Scm_Error("hamt: empty node at level %d", shift);
+    if ((n->lmap & ~n->emap) != 0) {
+        Scm_Error("hamt: leaf map %lx isn't a subset of entry map %lx",
+                  n->lmap, n->emap);
+    }
+    u_long c = 0;
+    for (int ind = 0, off = 0; ind <= HAMT_MASK; ind++) {
+        if (!NODE_HAS(n, ind)) continue;
+        void *e = n->entries[off++];
+        u_long p = prefix | ((u_long)ind << shift);
+        if (NODE_LEAFP(n, ind)) {
+            HamtLeaf *l = (HamtLeaf*)e;
+            u_long m = (shift+HAMT_SHIFT >= HAMT_HASH_BITS)
+                ? HAMT_HASH_MASK
+                : (1UL<<(shift+HAMT_SHIFT)) - 1;
+            if ((l->hash & m) != (p & m)) {
+                Scm_Error("hamt: leaf hash %lx is misplaced", l->hash);
+            }
+            if (hamt_hash(h, l->key) != l->hash) {
+                Scm_Error("hamt: hash of key %S doesn't match", l->key);
+            }
+            c += leaf_count(l);
+        } else {
+            c += node_check(h, (HamtNode*)e, shift+HAMT_SHIFT, p);
+        }
+    }
+    if (c != n->count) {
+        Scm_Error("hamt: node count mismatch (%lu, actually %lu)",
+                  n->count, c);
+    }
+    return c;
+}
+
+void HamtCheck(Hamt *h)
+{
+    if (h->root) node_check(h, h->root, 0, 0);
+}
+
+/*===================================================================
+ * Initialization
+ */
+
+void Scm_Init_hamt(ScmModule *mod)
+{
+    Scm_InitStaticClass(&Scm_HamtClass, "<hamt>", mod, NULL, 0);
+    Scm_InitStaticClass(&Scm_TransientHamtClass, "<transient-hamt>",
+                        mod, NULL, 0);
+    Scm_InitStaticClass(&Scm_ConcurrentHamtClass, "<concurrent-hamt>",
+                        mod, NULL, 0);
+}
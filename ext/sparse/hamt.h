@@ -0,0 +1,135 @@
+/*
+ * hamt.h - Hash array mapped trie
+ *
+ *   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef GAUCHE_HAMT_H
+#define GAUCHE_HAMT_H
+
+#include <gauche.h>
+#include <gauche/extend.h>
+
+/* See src/lazy.c for why we avoid native atomic ops on these platforms */
+#if defined(__SH4__) || defined(__ARMEL__)
+#define AO_USE_PTHREAD_DEFS 1
+#endif
+#include "atomic_ops.h"
+
+/* Hamt is a persistent hash map based on hash array mapped trie
+ * (Phil Bagwell, Ideal Hash Trees, 2001).  Its nodes use the same
+ * bitmap-indexed compact format as CompactTrie (ctrie.h), but nodes are
+ * never modified once they become visible, so that an update creates
+ * a new path from the root to the leaf and shares the rest.
+ *
+ * A transient hamt is a mutable version.  It has an edit token, and
+ * nodes created by the transient carry that token; such nodes are
+ * modified in place until the transient is turned back into a
+ * persistent hamt, which invalidates the token.
+ */
+
+typedef struct HamtNodeRec HamtNode;
+
+typedef struct HamtRec {
+    SCM_HEADER;
+    HamtNode      *root;        /* NULL if empty */
+    u_long        (*hashfn)(ScmObj key);
+    int           (*cmpfn)(ScmObj a, ScmObj b);
+    ScmComparator *comparator;
+    void          *owner;       /* edit token of a transient, or NULL */
+} Hamt;
+
+SCM_CLASS_DECL(Scm_HamtClass);
+SCM_CLASS_DECL(Scm_TransientHamtClass);
+#define SCM_CLASS_HAMT            (&Scm_HamtClass)
+#define SCM_CLASS_TRANSIENT_HAMT  (&Scm_TransientHamtClass)
+#define HAMT(obj)                 ((Hamt*)(obj))
+#define HAMT_P(obj)               SCM_XTYPEP(obj, SCM_CLASS_HAMT)
+#define TRANSIENT_HAMT_P(obj)     SCM_XTYPEP(obj, SCM_CLASS_TRANSIENT_HAMT)
+#define ANY_HAMT_P(obj)           (HAMT_P(obj) || TRANSIENT_HAMT_P(obj))
+
+extern ScmObj MakeHamt(ScmHashType type, ScmComparator *comparator);
+extern u_long HamtNumEntries(Hamt *h);
+extern ScmObj HamtRef(Hamt *h, ScmObj key, ScmObj fallback);
+
+/* Persistent operations; these return a new hamt */
+extern ScmObj HamtPut(Hamt *h, ScmObj key, ScmObj value);
+extern ScmObj HamtDelete(Hamt *h, ScmObj key);
+extern ScmObj HamtUnion(Hamt *a, Hamt *b);
+extern ScmObj HamtIntersection(Hamt *a, Hamt *b);
+extern ScmObj HamtDifference(Hamt *a, Hamt *b);
+
+/* Transients */
+extern ScmObj HamtTransient(Hamt *h);
+extern ScmObj HamtPersistent(Hamt *t);
+extern void   HamtPutX(Hamt *t, ScmObj key, ScmObj value);
+extern int    HamtDeleteX(Hamt *t, ScmObj key);
+
+/* Concurrent hamt: a mutable reference to a hamt, which can be read
+   without locking while other threads update it.  CURRENT holds
+   a Hamt*. */
+typedef struct ConcurrentHamtRec {
+    SCM_HEADER;
+    volatile AO_t current;
+} ConcurrentHamt;
+
+SCM_CLASS_DECL(Scm_ConcurrentHamtClass);
+#define SCM_CLASS_CONCURRENT_HAMT (&Scm_ConcurrentHamtClass)
+#define CONCURRENT_HAMT(obj)      ((ConcurrentHamt*)(obj))
+#define CONCURRENT_HAMT_P(obj)    SCM_XTYPEP(obj, SCM_CLASS_CONCURRENT_HAMT)
+
+extern ScmObj MakeConcurrentHamt(Hamt *init);
+extern Hamt  *ConcurrentHamtSnapshot(ConcurrentHamt *c);
+extern int    ConcurrentHamtCompareAndSet(ConcurrentHamt *c,
+                                          Hamt *old, Hamt *upd);
+extern ScmObj ConcurrentHamtRef(ConcurrentHamt *c, ScmObj key,
+                                ScmObj fallback);
+extern void   ConcurrentHamtPut(ConcurrentHamt *c, ScmObj key, ScmObj value);
+extern int    ConcurrentHamtDelete(ConcurrentHamt *c, ScmObj key);
+
+/* Iterator */
+#define HAMT_MAX_DEPTH 8
+
+typedef struct HamtIterRec {
+    int       depth;                    /* -1 if exhausted */
+    HamtNode *nodes[HAMT_MAX_DEPTH];
+    int       index[HAMT_MAX_DEPTH];    /* next logical index in the node */
+    ScmObj    chain;                    /* remaining chain of a leaf */
+} HamtIter;
+
+extern void   HamtIterInit(HamtIter *it, Hamt *h);
+extern ScmObj HamtIterNext(HamtIter *it);
+
+/* For debug */
+extern void   HamtCheck(Hamt *h);
+
+extern void   Scm_Init_hamt(ScmModule *mod);
+
+#endif /*GAUCHE_HAMT_H*/
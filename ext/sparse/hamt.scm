@@ -0,0 +1,281 @@
+;;;
+;;; data.hamt - hash array mapped trie
+;;;
+;;;   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+;;;
+;;;   Redistribution and use in source and binary forms, with or without
+;;;   modification, are permitted provided that the following conditions
+;;;   are met:
+;;;
+;;;   1. Redistributions of source code must retain the above copyright
+;;;      notice, this list of conditions and the following disclaimer.
+;;;
+;;;   2. Redistributions in binary form must reproduce the above copyright
+;;;      notice, this list of conditions and the following disclaimer in the
+;;;      documentation and/or other materials provided with the distribution.
+;;;
+;;;   3. Neither the name of the authors nor the names of its contributors
+;;;      may be used to endorse or promote products derived from this
+;;;      software without specific prior written permission.
+;;;
+;;;   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+;;;   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+;;;   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+;;;   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+;;;   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+;;;   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+;;;   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+;;;   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+;;;   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+;;;   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+;;;   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+;;;
+
+
+
+;; Persistent hash map based on hash array mapped trie.  Unlike data.imap,
+;; which needs an ordered comparator, it needs a hashable comparator;
+;; lookup and update take O(log32 n) node visits.
+;;
+;; Besides the usual functional update, a <transient-hamt> can be
+;; made from a <hamt> for a batch of destructive updates, which avoids
+;; copying nodes repeatedly.  Once turned back to <hamt> by
+;; hamt-persistent!, the transient can no longer be used.
+;;
+;; A <concurrent-hamt> is a mutable reference to a hamt, shared by
+;; threads.  Readers never block; writers install a new version with CAS.
+
+(define-module data.hamt
+  (use gauche.dictionary)
+  (use gauche.collection)
+  (export <hamt> <transient-hamt>
+          make-hamt alist->hamt hamt? transient-hamt?
+          hamt-comparator hamt-num-entries hamt-empty?
+          hamt-get hamt-exists? hamt-put hamt-delete hamt-update
+          hamt-fold hamt-for-each hamt-keys hamt-values hamt->alist
+          hamt-union hamt-intersection hamt-difference
+          hamt-transient hamt-persistent!
+          hamt-put! hamt-delete! hamt-update!
+
+          <concurrent-hamt> make-concurrent-hamt concurrent-hamt?
+          concurrent-hamt-snapshot concurrent-hamt-compare-and-set!
+          concurrent-hamt-num-entries
+          concurrent-hamt-get concurrent-hamt-exists?
+          concurrent-hamt-put! concurrent-hamt-delete!
+          concurrent-hamt-update! concurrent-hamt-swap!
+          %hamt-check)
+  )
+(select-module data.hamt)
+
+(inline-stub
+ (declcode "#include \"hamt.h\"")
+ (initcode "Scm_Init_hamt(Scm_CurrentModule());")
+
+ (define-type <hamt> "Hamt*" "hamt" "HAMT_P" "HAMT")
+ (define-type <transient-hamt> "Hamt*" "transient hamt"
+   "TRANSIENT_HAMT_P" "HAMT")
+ ;; either one
+ (define-type <hamt-base> "Hamt*" "hamt or transient hamt"
+   "ANY_HAMT_P" "HAMT")
+
+ (define-cproc %make-hamt (type cmpr::<comparator>)
+   (let* ([t::ScmHashType SCM_HASH_GENERAL])
+     (cond
+      [(SCM_EQ type 'eq?)      (set! t SCM_HASH_EQ)]
+      [(SCM_EQ type 'eqv?)     (set! t SCM_HASH_EQV)]
+      [(SCM_EQ type 'equal?)   (set! t SCM_HASH_EQUAL)]
+      [(SCM_EQ type 'string=?) (set! t SCM_HASH_STRING)])
+     (return (MakeHamt t cmpr))))
+
+ (define-cproc hamt? (obj) ::<boolean> (return (HAMT_P obj)))
+ (define-cproc transient-hamt? (obj) ::<boolean>
+   (return (TRANSIENT_HAMT_P obj)))
+
+ (define-cproc hamt-comparator (h::<hamt-base>)
+   (return (SCM_OBJ (-> h comparator))))
+ (define-cproc hamt-num-entries (h::<hamt-base>) ::<ulong> HamtNumEntries)
+ (define-cproc hamt-empty? (h::<hamt-base>) ::<boolean>
+   (return (== (HamtNumEntries h) 0)))
+
+ (define-cproc hamt-get (h::<hamt-base> key :optional fallback)
+   (let* ([r (HamtRef h key fallback)])
+     (when (SCM_UNBOUNDP r)
+       (Scm_Error "%S doesn't have an entry for key %S" (SCM_OBJ h) key))
+     (return r)))
+ (define-cproc hamt-exists? (h::<hamt-base> key) ::<boolean>
+   (return (not (SCM_UNBOUNDP (HamtRef h key SCM_UNBOUND)))))
+
+ (define-cproc hamt-put (h::<hamt> key value) HamtPut)
+ (define-cproc hamt-delete (h::<hamt> key) HamtDelete)
+ (define-cproc hamt-union (a::<hamt> b::<hamt>) HamtUnion)
+ (define-cproc hamt-intersection (a::<hamt> b::<hamt>) HamtIntersection)
+ (define-cproc hamt-difference (a::<hamt> b::<hamt>) HamtDifference)
+
+ (define-cproc hamt-transient (h::<hamt>) HamtTransient)
+ (define-cproc hamt-persistent! (t::<transient-hamt>) HamtPersistent)
+ (define-cproc hamt-put! (t::<transient-hamt> key value) ::<void> HamtPutX)
+ (define-cproc hamt-delete! (t::<transient-hamt> key) ::<boolean>
+   HamtDeleteX)
+
+ (define-cfn hamt-iter (args::ScmObj* nargs::int data::void*) :static
+   (let* ([iter::HamtIter* (cast HamtIter* data)]
+          [r (HamtIterNext iter)]
+          [eofval (aref args 0)])
+     (if (SCM_FALSEP r)
+       (return (values eofval eofval))
+       (return (values (SCM_CAR r) (SCM_CDR r))))))
+
+ (define-cproc %hamt-iter (h::<hamt-base>)
+   (let* ([iter::HamtIter* (SCM_NEW HamtIter)])
+     (HamtIterInit iter h)
+     (return (Scm_MakeSubr hamt-iter iter 1 0 '"hamt-iterator"))))
+
+ (define-cproc %hamt-check (h::<hamt-base>) ::<void> HamtCheck)
+
+ (define-type <concurrent-hamt> "ConcurrentHamt*" "concurrent hamt"
+   "CONCURRENT_HAMT_P" "CONCURRENT_HAMT")
+
+ (define-cproc %make-concurrent-hamt (h::<hamt>) MakeConcurrentHamt)
+ (define-cproc concurrent-hamt? (obj) ::<boolean>
+   (return (CONCURRENT_HAMT_P obj)))
+ (define-cproc concurrent-hamt-snapshot (c::<concurrent-hamt>)
+   (return (SCM_OBJ (ConcurrentHamtSnapshot c))))
+ (define-cproc concurrent-hamt-compare-and-set! (c::<concurrent-hamt>
+                                                 old::<hamt> new::<hamt>)
+   ::<boolean> ConcurrentHamtCompareAndSet)
+ (define-cproc concurrent-hamt-num-entries (c::<concurrent-hamt>) ::<ulong>
+   (return (HamtNumEntries (ConcurrentHamtSnapshot c))))
+
+ (define-cproc concurrent-hamt-get (c::<concurrent-hamt> key
+                                                         :optional fallback)
+   (let* ([r (ConcurrentHamtRef c key fallback)])
+     (when (SCM_UNBOUNDP r)
+       (Scm_Error "%S doesn't have an entry for key %S" (SCM_OBJ c) key))
+     (return r)))
+ (define-cproc concurrent-hamt-exists? (c::<concurrent-hamt> key) ::<boolean>
+   (return (not (SCM_UNBOUNDP (ConcurrentHamtRef c key SCM_UNBOUND)))))
+ (define-cproc concurrent-hamt-put! (c::<concurrent-hamt> key value) ::<void>
+   ConcurrentHamtPut)
+ (define-cproc concurrent-hamt-delete! (c::<concurrent-hamt> key) ::<boolean>
+   ConcurrentHamtDelete)
+ )
+
+;; We recognize common cases (eq?, eqv?, equal? and string=?) to avoid
+;; calling back Scheme procedures, as make-sparse-table does.
+(define *shortcut-comparators*
+  `((eq? . ,eq-comparator)
+    (eqv? . ,eqv-comparator)
+    (equal? . ,equal-comparator)
+    (string=? . ,string-comparator)))
+
+(define (make-hamt :optional (comparator default-comparator))
+  (define (bad)
+    (error "make-hamt needs a hashable comparator or one of the symbols \
+            eq?, eqv?, equal? or string=?, as an argument, but got:"
+           comparator))
+  (receive (type cmpr)
+      (cond [(symbol? comparator)
+             (if-let1 cmpr (assq-ref *shortcut-comparators* comparator)
+               (values comparator cmpr)
+               (bad))]
+            [(and (comparator? comparator) (comparator-hashable? comparator))
+             (values (rassq-ref *shortcut-comparators* comparator) comparator)]
+            [else (bad)])
+    (%make-hamt type cmpr)))
+
+(define (alist->hamt alist :optional (comparator default-comparator))
+  (let1 t (hamt-transient (make-hamt comparator))
+    (dolist [p alist] (hamt-put! t (car p) (cdr p)))
+    (hamt-persistent! t)))
+
+(define (hamt-update h key proc . fallback)
+  (hamt-put h key (proc (apply hamt-get h key fallback))))
+
+(define (hamt-update! t key proc . fallback)
+  (hamt-put! t key (proc (apply hamt-get t key fallback))))
+
+(define (hamt-fold h proc seed)
+  (let ([iter (%hamt-iter h)]
+        [end  (list #f)])
+    (let loop ((seed seed))
+      (receive (key val) (iter end)
+        (if (eq? key end)
+          seed
+          (loop (proc key val seed)))))))
+
+(define (hamt-for-each h proc) (hamt-fold h (^[k v _] (proc k v)) #f))
+(define (hamt-keys h) (hamt-fold h (^[k v s] (cons k s)) '()))
+(define (hamt-values h) (hamt-fold h (^[k v s] (cons v s)) '()))
+(define (hamt->alist h) (hamt-fold h acons '()))
+
+;; Concurrent hamt
+
+(define (make-concurrent-hamt :optional (init default-comparator))
+  (%make-concurrent-hamt (if (hamt? init) init (make-hamt init))))
+
+;; PROC takes the current hamt and returns a new one, which is installed
+;; unless another thread has updated C meanwhile; if so, PROC is called
+;; again with the newer hamt.  So PROC should have no side effects.
+;; Returns the installed hamt.
+(define (concurrent-hamt-swap! c proc)
+  (let loop ()
+    (let* ([old (concurrent-hamt-snapshot c)]
+           [new (proc old)])
+      (if (concurrent-hamt-compare-and-set! c old new)
+        new
+        (loop)))))
+
+(define (concurrent-hamt-update! c key proc . fallback)
+  (concurrent-hamt-swap! c (^h (apply hamt-update h key proc fallback))))
+
+;;
+;; Collection & dictionary protocol
+;;
+
+(define-method call-with-iterator ((h <hamt>) proc :allow-other-keys)
+  (%hamt-call-with-iterator h proc))
+(define-method call-with-iterator ((h <transient-hamt>) proc
+                                   :allow-other-keys)
+  (%hamt-call-with-iterator h proc))
+
+(define (%hamt-call-with-iterator h proc)
+  (let* ([iter (%hamt-iter h)]
+         [end (list #f)])
+    (define (next) (receive (k v) (iter end) (cons k v)))
+    (define cache (next))
+    (proc (^[] (eq? (car cache) end))
+          (^[] (rlet1 v cache (set! cache (next)))))))
+
+(define-method dict-get ((h <hamt>) key . default)
+  (apply hamt-get h key default))
+(define-method dict-get ((h <transient-hamt>) key . default)
+  (apply hamt-get h key default))
+(define-method dict-exists? ((h <hamt>) key) (hamt-exists? h key))
+(define-method dict-exists? ((h <transient-hamt>) key) (hamt-exists? h key))
+(define-method dict-put! ((h <transient-hamt>) key value)
+  (hamt-put! h key value))
+(define-method dict-delete! ((h <transient-hamt>) key)
+  (hamt-delete! h key))
+(define-method dict-comparator ((h <hamt>)) (hamt-comparator h))
+(define-method dict-comparator ((h <transient-hamt>)) (hamt-comparator h))
+(define-method dict-fold ((h <hamt>) proc seed) (hamt-fold h proc seed))
+(define-method dict-fold ((h <transient-hamt>) proc seed)
+  (hamt-fold h proc seed))
+
+;; A concurrent hamt iterates over, and folds, the snapshot at the time
+;; of the call.
+(define-method call-with-iterator ((c <concurrent-hamt>) proc
+                                   :allow-other-keys)
+  (%hamt-call-with-iterator (concurrent-hamt-snapshot c) proc))
+(define-method dict-get ((c <concurrent-hamt>) key . default)
+  (apply concurrent-hamt-get c key default))
+(define-method dict-exists? ((c <concurrent-hamt>) key)
+  (concurrent-hamt-exists? c key))
+(define-method dict-put! ((c <concurrent-hamt>) key value)
+  (concurrent-hamt-put! c key value))
+(define-method dict-delete! ((c <concurrent-hamt>) key)
+  (concurrent-hamt-delete! c key))
+(define-method dict-comparator ((c <concurrent-hamt>))
+  (hamt-comparator (concurrent-hamt-snapshot c)))
+(define-method dict-fold ((c <concurrent-hamt>) proc seed)
+  (hamt-fold (concurrent-hamt-snapshot c) proc seed))
@@ -56,6 +56,7 @@
           sparse-vector-push! sparse-vector-pop!
           sparse-vector-fold sparse-vector-map sparse-vector-for-each
           sparse-vector-keys sparse-vector-values
+          sparse-vector-dot sparse-vector-axpy!
           %sparse-vector-dump
 
           <sparse-matrix-base> <sparse-matrix> <sparse-s8matrix>
@@ -68,6 +69,7 @@
           sparse-matrix-clear! sparse-matrix-delete! sparse-matrix-copy
           sparse-matrix-update! sparse-matrix-inc!
           sparse-matrix-push! sparse-matrix-pop!
+          sparse-matrix-mul-vector sparse-matrix->csr csr->sparse-matrix
           sparse-matrix-fold sparse-matrix-map sparse-matrix-for-each
           sparse-matrix-keys sparse-matrix-values
           )
@@ -346,6 +348,21 @@
 
  (define-cproc %sparse-vector-dump (sv::<sparse-vector>) ::<void>
    SparseVectorDump)
+
+ ;; Numeric kernels
+ (define-cproc sparse-vector-dot (sv::<sparse-vector> v) ::<double>
+   (cond [(SPARSE_VECTOR_BASE_P v)
+          (return (SparseVectorDot sv (SPARSE_VECTOR v)))]
+         [(SCM_UVECTORP v)
+          (return (SparseVectorDotDense sv (SCM_UVECTOR v)))]
+         [else
+          (Scm_TypeError "v" "sparse vector or uniform vector" v)
+          (return 0.0)]))
+
+ (define-cproc sparse-vector-axpy! (y::<sparse-vector> a::<double>
+                                    x::<sparse-vector>)
+   ::<void>
+   (SparseVectorAxpy y a x))
  )
 
 (define (sparse-vector-push! spvec key val)
@@ -573,6 +590,36 @@
     (SparseVectorSet sv i (SCM_CDR v))
     (return (SCM_CAR v))))
 
+;; Numeric kernels.  The first index is taken as a row.
+(define-cproc sparse-matrix-mul-vector (m::<sparse-matrix> v::<uvector>
+                                        :optional (out #f))
+  (cond [(SCM_FALSEP out)
+         (set! out (Scm_MakeF64Vector (SparseMatrixNumRows m) 0.0))]
+        [(not (SCM_F64VECTORP out))
+         (Scm_TypeError "out" "f64vector" out)])
+  (SparseMatrixMulVector m v (SCM_UVECTOR out))
+  (return out))
+
+(define-cproc sparse-matrix->csr (m::<sparse-matrix> :optional (nrows #f))
+  (let* ([n::u_long 0]
+         [p SCM_UNDEFINED] [i SCM_UNDEFINED] [v SCM_UNDEFINED])
+    (if (SCM_FALSEP nrows)
+      (set! n (SparseMatrixNumRows m))
+      (set! n (Scm_GetIntegerUClamp nrows SCM_CLAMP_ERROR NULL)))
+    (SparseMatrixToCSR m n (& p) (& i) (& v))
+    (return (values p i v))))
+
+(define-cproc %sparse-matrix-set-csr! (m::<sparse-matrix>
+                                       indptr::<uvector>
+                                       indices::<uvector>
+                                       vals::<uvector>)
+  ::<void> SparseMatrixSetCSR)
+
+(define (csr->sparse-matrix indptr indices values :optional (type 'f64)
+                            :key default)
+  (rlet1 m (make-sparse-matrix type :default default)
+    (%sparse-matrix-set-csr! m indptr indices values)))
+
 (define (sparse-matrix-fold sv proc seed)
   (let ([iter (%sparse-matrix-iter sv)]
         [end (list #f)])
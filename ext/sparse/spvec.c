@@ -249,7 +249,8 @@ static void g_dump(ScmPort *out, Leaf *leaf, int indent, void *data)
 }
 
 static SparseVectorDescriptor g_desc = {
-    g_ref, g_set, g_allocate, g_delete, g_clear, g_copy, g_iter, g_dump, 1
+    g_ref, g_set, g_allocate, g_delete, g_clear, g_copy, g_iter, g_dump, 1,
+    SCM_UVECTOR_INVALID
 };
 
 SCM_DEFINE_BUILTIN_CLASS(Scm_SparseVectorClass, NULL, NULL, NULL, NULL,
@@ -541,7 +542,7 @@ U_ITER(f64, MASK64)
         u_clear,                                                        \
         u_copy,                                                         \
         SCM_CPP_CAT(tag,_iter),                                         \
-        NULL, shift,                                                    \
+        NULL, shift, SCM_CPP_CAT(SCM_UVECTOR_,TAG)                      \
     };                                                                  \
     SCM_DEFINE_BUILTIN_CLASS(SCM_CPP_CAT3(Scm_Sparse,TAG,VectorClass),  \
                              NULL, NULL, NULL, NULL, spvec_cpl);        \
@@ -607,6 +608,516 @@ ScmObj MakeSparseVector(ScmClass *klass, ScmObj defaultValue, u_long flags)
     return SCM_OBJ(v);
 }
 
+/*===================================================================
+ * Numeric kernels
+ *
+ * These walk the leaves of the trie and read the typed arrays of
+ * uniform leaves directly, so that we don't box each element.
+ * Computation is done in double.  Generic sparse vectors are also
+ * accepted as far as their values are real numbers, but they go
+ * through Scm_GetDouble.
+ */
+
+/* Max # of entries in a leaf (s8 and u8 leaves have the most). */
+#define LEAF_MAX_ENTRIES  (2*SIZEOF_LONG)
+
+static double g_real(SparseVector *sv, u_long index, ScmObj v)
+{
+    if (!SCM_REALP(v)) {
+        Scm_Error("real number required, but %S has %S at index %lu",
+                  SCM_OBJ(sv), v, index);
+    }
+    return Scm_GetDouble(v);
+}
+
+#define TODOUBLE(v)  ((double)(v))
+
+/* Stores indexes and values of the entries in LEAF to IND and VAL,
+   in the increasing order of the index.  Returns the number of entries. */
+static int leaf_entries(SparseVector *sv, Leaf *leaf,
+                        u_long *ind, double *val)
+{
+    u_long base = leaf_key(leaf) << sv->desc->shift;
+    int n = 0;
+
+#define EXTRACT(tag, mask, conv)                                \
+    do {                                                        \
+        for (u_long i=0; i<=mask; i++) {                        \
+            if (U_HAS_ENTRY(leaf, i, mask)) {                   \
+                ind[n] = base + i;                              \
+                val[n] = conv(ULEAF(leaf)->tag[i]);             \
+                n++;                                            \
+            }                                                   \
+        }                                                       \
+    } while (0)
+
+    switch (sv->desc->etype) {
+    case SCM_UVECTOR_S8:  EXTRACT(s8,  MASK8,  TODOUBLE); break;
+    case SCM_UVECTOR_U8:  EXTRACT(u8,  MASK8,  TODOUBLE); break;
+    case SCM_UVECTOR_S16: EXTRACT(s16, MASK16, TODOUBLE); break;
+    case SCM_UVECTOR_U16: EXTRACT(u16, MASK16, TODOUBLE); break;
+    case SCM_UVECTOR_S32: EXTRACT(s32, MASK32, TODOUBLE); break;
+    case SCM_UVECTOR_U32: EXTRACT(u32, MASK32, TODOUBLE); break;
+    case SCM_UVECTOR_S64: EXTRACT(s64, MASK64, TODOUBLE); break;
+    case SCM_UVECTOR_U64: EXTRACT(u64, MASK64, TODOUBLE); break;
+    case SCM_UVECTOR_F16: EXTRACT(f16, MASK16, Scm_HalfToDouble); break;
+    case SCM_UVECTOR_F32: EXTRACT(f32, MASK32, TODOUBLE); break;
+    case SCM_UVECTOR_F64: EXTRACT(f64, MASK64, TODOUBLE); break;
+    default:
+        for (int i=0; i<2; i++) {
+            ScmObj v = ((GLeaf*)leaf)->val[i];
+            if (!SCM_UNBOUNDP(v)) {
+                ind[n] = base + i;
+                val[n] = g_real(sv, base + i, v);
+                n++;
+            }
+        }
+    }
+#undef EXTRACT
+    return n;
+}
+
+/* If SV has an entry at INDEX, sets its value to *VAL and returns TRUE. */
+static int entry_value(SparseVector *sv, u_long index, double *val)
+{
+    Leaf *leaf = CompactTrieGet(&sv->trie, index >> sv->desc->shift);
+    if (leaf == NULL) return FALSE;
+
+#define LOOKUP(tag, mask, conv)                                 \
+    do {                                                        \
+        if (!U_HAS_ENTRY(leaf, index, mask)) return FALSE;      \
+        *val = conv(ULEAF(leaf)->tag[index&mask]);              \
+        return TRUE;                                            \
+    } while (0)
+
+    switch (sv->desc->etype) {
+    case SCM_UVECTOR_S8:  LOOKUP(s8,  MASK8,  TODOUBLE);
+    case SCM_UVECTOR_U8:  LOOKUP(u8,  MASK8,  TODOUBLE);
+    case SCM_UVECTOR_S16: LOOKUP(s16, MASK16, TODOUBLE);
+    case SCM_UVECTOR_U16: LOOKUP(u16, MASK16, TODOUBLE);
+    case SCM_UVECTOR_S32: LOOKUP(s32, MASK32, TODOUBLE);
+    case SCM_UVECTOR_U32: LOOKUP(u32, MASK32, TODOUBLE);
+    case SCM_UVECTOR_S64: LOOKUP(s64, MASK64, TODOUBLE);
+    case SCM_UVECTOR_U64: LOOKUP(u64, MASK64, TODOUBLE);
+    case SCM_UVECTOR_F16: LOOKUP(f16, MASK16, Scm_HalfToDouble);
+    case SCM_UVECTOR_F32: LOOKUP(f32, MASK32, TODOUBLE);
+    case SCM_UVECTOR_F64: LOOKUP(f64, MASK64, TODOUBLE);
+    default: {
+        ScmObj v = g_ref(leaf, index);
+        if (SCM_UNBOUNDP(v)) return FALSE;
+        *val = g_real(sv, index, v);
+        return TRUE;
+    }
+    }
+#undef LOOKUP
+}
+
+/* Adds DELTA to the entry at INDEX in LEAF, or sets DELTA if there's
+   no entry yet.  With OVERWRITE, DELTA replaces the existing value.
+   Returns TRUE if a new entry is created.  Only called on flonum
+   and generic sparse vectors. */
+static int leaf_put(SparseVector *sv, Leaf *leaf, u_long index,
+                    double delta, int overwrite)
+{
+#define PUT(tag, mask, type, get, put)                                  \
+    do {                                                                \
+        int created = !U_HAS_ENTRY(leaf, index, mask);                  \
+        type *p = &ULEAF(leaf)->tag[index&mask];                        \
+        *p = put((created||overwrite)? delta : get(*p) + delta);        \
+        U_SET_ENTRY(leaf, index, mask);                                 \
+        return created;                                                 \
+    } while (0)
+
+    switch (sv->desc->etype) {
+    case SCM_UVECTOR_F16:
+        PUT(f16, MASK16, ScmHalfFloat, Scm_HalfToDouble, Scm_DoubleToHalf);
+    case SCM_UVECTOR_F32: PUT(f32, MASK32, float, TODOUBLE, (float));
+    case SCM_UVECTOR_F64: PUT(f64, MASK64, double, TODOUBLE, TODOUBLE);
+    default: {
+        ScmObj v = g_ref(leaf, index);
+        if (SCM_UNBOUNDP(v) || overwrite) {
+            g_set(leaf, index, Scm_MakeFlonum(delta));
+        } else {
+            g_set(leaf, index, Scm_MakeFlonum(g_real(sv, index, v) + delta));
+        }
+        return SCM_UNBOUNDP(v);
+    }
+    }
+#undef PUT
+}
+
+static int flonum_or_generic_p(SparseVector *sv)
+{
+    switch (sv->desc->etype) {
+    case SCM_UVECTOR_F16:
+    case SCM_UVECTOR_F32:
+    case SCM_UVECTOR_F64:
+    case SCM_UVECTOR_INVALID:
+        return TRUE;
+    default:
+        return FALSE;
+    }
+}
+
+static double dense_ref(ScmUVector *v, int type, u_long k)
+{
+    switch (type) {
+    case SCM_UVECTOR_S8:  return SCM_S8VECTOR_ELEMENT(v, k);
+    case SCM_UVECTOR_U8:  return SCM_U8VECTOR_ELEMENT(v, k);
+    case SCM_UVECTOR_S16: return SCM_S16VECTOR_ELEMENT(v, k);
+    case SCM_UVECTOR_U16: return SCM_U16VECTOR_ELEMENT(v, k);
+    case SCM_UVECTOR_S32: return SCM_S32VECTOR_ELEMENT(v, k);
+    case SCM_UVECTOR_U32: return SCM_U32VECTOR_ELEMENT(v, k);
+    case SCM_UVECTOR_S64: return (double)SCM_S64VECTOR_ELEMENT(v, k);
+    case SCM_UVECTOR_U64: return (double)SCM_U64VECTOR_ELEMENT(v, k);
+    case SCM_UVECTOR_F16: return Scm_HalfToDouble(SCM_F16VECTOR_ELEMENT(v, k));
+    case SCM_UVECTOR_F32: return SCM_F32VECTOR_ELEMENT(v, k);
+    case SCM_UVECTOR_F64: return SCM_F64VECTOR_ELEMENT(v, k);
+    default: Scm_Error("[internal] bad uvector type: %d", type);
+    }
+    return 0.0;                 /* dummy */
+}
+
+/* Boxes k-th element of V, for storing into integer sparse vectors. */
+static ScmObj dense_obj(ScmUVector *v, int type, u_long k)
+{
+    switch (type) {
+    case SCM_UVECTOR_S8:  return SCM_MAKE_INT(SCM_S8VECTOR_ELEMENT(v, k));
+    case SCM_UVECTOR_U8:  return SCM_MAKE_INT(SCM_U8VECTOR_ELEMENT(v, k));
+    case SCM_UVECTOR_S16: return SCM_MAKE_INT(SCM_S16VECTOR_ELEMENT(v, k));
+    case SCM_UVECTOR_U16: return SCM_MAKE_INT(SCM_U16VECTOR_ELEMENT(v, k));
+    case SCM_UVECTOR_S32: return Scm_MakeInteger(SCM_S32VECTOR_ELEMENT(v, k));
+    case SCM_UVECTOR_U32: return Scm_MakeIntegerU(SCM_U32VECTOR_ELEMENT(v, k));
+    case SCM_UVECTOR_S64: return Scm_MakeInteger64(SCM_S64VECTOR_ELEMENT(v, k));
+    case SCM_UVECTOR_U64: return Scm_MakeIntegerU64(SCM_U64VECTOR_ELEMENT(v, k));
+    default: return Scm_MakeFlonum(dense_ref(v, type, k));
+    }
+}
+
+double SparseVectorDotDense(SparseVector *sv, ScmUVector *v)
+{
+    int type = Scm_UVectorType(SCM_CLASS_OF(v));
+    u_long size = SCM_UVECTOR_SIZE(v);
+    u_long ind[LEAF_MAX_ENTRIES];
+    double val[LEAF_MAX_ENTRIES];
+    double r = 0.0;
+    CompactTrieIter iter;
+    Leaf *leaf;
+
+    CompactTrieIterInit(&iter, &sv->trie);
+    while ((leaf = CompactTrieIterNext(&iter)) != NULL) {
+        int n = leaf_entries(sv, leaf, ind, val);
+        for (int i=0; i<n; i++) {
+            if (ind[i] >= size) {
+                Scm_Error("%S has an entry at index %lu, which is out of "
+                          "range of %S", SCM_OBJ(sv), ind[i], SCM_OBJ(v));
+            }
+            r += val[i] * dense_ref(v, type, ind[i]);
+        }
+    }
+    return r;
+}
+
+double SparseVectorDot(SparseVector *a, SparseVector *b)
+{
+    u_long ia[LEAF_MAX_ENTRIES], ib[LEAF_MAX_ENTRIES];
+    double va[LEAF_MAX_ENTRIES], vb[LEAF_MAX_ENTRIES];
+    double r = 0.0;
+    CompactTrieIter iter;
+    Leaf *leaf;
+
+    /* Walk the one with fewer entries, and look up the other. */
+    if (a->numEntries > b->numEntries) {
+        SparseVector *t = a; a = b; b = t;
+    }
+    int sameshape = (a->desc->shift == b->desc->shift);
+
+    CompactTrieIterInit(&iter, &a->trie);
+    while ((leaf = CompactTrieIterNext(&iter)) != NULL) {
+        int n = leaf_entries(a, leaf, ia, va);
+        if (sameshape) {
+            /* The corresponding leaf of B covers the same index range.
+               Merge two sorted runs. */
+            Leaf *lb = CompactTrieGet(&b->trie, leaf_key(leaf));
+            if (lb == NULL) continue;
+            int m = leaf_entries(b, lb, ib, vb);
+            for (int i=0, j=0; i<n && j<m;) {
+                if (ia[i] == ib[j])     r += va[i++] * vb[j++];
+                else if (ia[i] < ib[j]) i++;
+                else                    j++;
+            }
+        } else {
+            for (int i=0; i<n; i++) {
+                double y;
+                if (entry_value(b, ia[i], &y)) r += va[i] * y;
+            }
+        }
+    }
+    return r;
+}
+
+/* y += a*x.  Missing entries in y are regarded as 0. */
+void SparseVectorAxpy(SparseVector *y, double a, SparseVector *x)
+{
+    u_long ind[LEAF_MAX_ENTRIES];
+    double val[LEAF_MAX_ENTRIES];
+    CompactTrieIter iter;
+    Leaf *leaf;
+
+    if (!flonum_or_generic_p(y)) {
+        Scm_Error("flonum or generic sparse vector required, but got %S",
+                  SCM_OBJ(y));
+    }
+    /* NB: If x and y are the same, we only update existing entries, so
+       the trie structure doesn't change while we're walking it. */
+    CompactTrieIterInit(&iter, &x->trie);
+    while ((leaf = CompactTrieIterNext(&iter)) != NULL) {
+        int n = leaf_entries(x, leaf, ind, val);
+        for (int i=0; i<n; i++) {
+            Leaf *ly = CompactTrieAdd(&y->trie, ind[i] >> y->desc->shift,
+                                      y->desc->allocate, y);
+            if (leaf_put(y, ly, ind[i], a * val[i], FALSE)) y->numEntries++;
+        }
+    }
+}
+
+/*-------------------------------------------------------------------
+ * Sparse matrix kernels
+ *
+ * The first index of the matrix is taken as a row.  The linear index
+ * interleaves 4 bits at a time of both indexes; this must agree with
+ * index-combine-2d and index-split-2d in sparse.scm.
+ */
+
+#define INTERLEAVE_SHIFT 4
+#define INTERLEAVE_MASK  ((1UL<<INTERLEAVE_SHIFT)-1)
+#define MATRIX_INDEX_LIMIT (1UL<<(SPARSE_VECTOR_MAX_INDEX_BITS/2))
+
+static void matrix_index_split(u_long i, u_long *px, u_long *py)
+{
+    u_long x = 0, y = 0;
+    for (int shift = 0; i; shift += INTERLEAVE_SHIFT) {
+        x |= (i & INTERLEAVE_MASK) << shift;
+        i >>= INTERLEAVE_SHIFT;
+        y |= (i & INTERLEAVE_MASK) << shift;
+        i >>= INTERLEAVE_SHIFT;
+    }
+    *px = x;
+    *py = y;
+}
+
+/* The caller must ensure x and y are below MATRIX_INDEX_LIMIT. */
+static u_long matrix_index_combine(u_long x, u_long y)
+{
+    u_long i = 0;
+    for (int shift = 0; (x >> shift) | (y >> shift);
+         shift += INTERLEAVE_SHIFT) {
+        i |= ((x >> shift) & INTERLEAVE_MASK) << (shift*2);
+        i |= ((y >> shift) & INTERLEAVE_MASK) << (shift*2 + INTERLEAVE_SHIFT);
+    }
+    return i;
+}
+
+/* Returns 1 + the largest row index that has an entry. */
+u_long SparseMatrixNumRows(SparseVector *m)
+{
+    u_long ind[LEAF_MAX_ENTRIES];
+    double val[LEAF_MAX_ENTRIES];
+    u_long nrows = 0;
+    CompactTrieIter iter;
+    Leaf *leaf;
+
+    CompactTrieIterInit(&iter, &m->trie);
+    while ((leaf = CompactTrieIterNext(&iter)) != NULL) {
+        int n = leaf_entries(m, leaf, ind, val);
+        for (int i=0; i<n; i++) {
+            u_long x, y;
+            matrix_index_split(ind[i], &x, &y);
+            if (x >= nrows) nrows = x+1;
+        }
+    }
+    return nrows;
+}
+
+/* out = m v.  OUT must be a f64vector. */
+void SparseMatrixMulVector(SparseVector *m, ScmUVector *v, ScmUVector *out)
+{
+    int type = Scm_UVectorType(SCM_CLASS_OF(v));
+    u_long ncols = SCM_UVECTOR_SIZE(v);
+    u_long nrows = SCM_UVECTOR_SIZE(out);
+    double *r = SCM_F64VECTOR_ELEMENTS(out);
+    u_long ind[LEAF_MAX_ENTRIES];
+    double val[LEAF_MAX_ENTRIES];
+    CompactTrieIter iter;
+    Leaf *leaf;
+
+    SCM_ASSERT(Scm_UVectorType(SCM_CLASS_OF(out)) == SCM_UVECTOR_F64);
+    if (SCM_EQ(v, out)) {
+        Scm_Error("input and output vectors must be different: %S",
+                  SCM_OBJ(v));
+    }
+    SCM_UVECTOR_CHECK_MUTABLE(out);
+    for (u_long k=0; k<nrows; k++) r[k] = 0.0;
+
+    CompactTrieIterInit(&iter, &m->trie);
+    while ((leaf = CompactTrieIterNext(&iter)) != NULL) {
+        int n = leaf_entries(m, leaf, ind, val);
+        for (int i=0; i<n; i++) {
+            u_long x, y;
+            matrix_index_split(ind[i], &x, &y);
+            if (x >= nrows || y >= ncols) {
+                Scm_Error("%S has an entry at (%lu %lu), which doesn't fit "
+                          "in %lux%lu", SCM_OBJ(m), x, y, nrows, ncols);
+            }
+            r[x] += val[i] * dense_ref(v, type, y);
+        }
+    }
+}
+
+typedef struct CSREntryRec {
+    u_long col;
+    double val;
+} CSREntry;
+
+static int csr_entry_cmp(const void *a, const void *b)
+{
+    u_long x = ((const CSREntry*)a)->col, y = ((const CSREntry*)b)->col;
+    return (x < y)? -1 : (x > y)? 1 : 0;
+}
+
+/* Creates CSR representation of M with NROWS rows: indptr and indices
+   are u32vectors, and values is a f64vector.  Within a row, entries
+   are sorted by the column index. */
+void SparseMatrixToCSR(SparseVector *m, u_long nrows,
+                       ScmObj *indptr, ScmObj *indices, ScmObj *values)
+{
+    u_long nent = m->numEntries;
+    u_long ind[LEAF_MAX_ENTRIES];
+    double val[LEAF_MAX_ENTRIES];
+    CompactTrieIter iter;
+    Leaf *leaf;
+
+    if (nent > 0xffffffffUL || nrows > 0xffffffffUL) {
+        Scm_Error("sparse matrix is too large to convert to CSR: %S",
+                  SCM_OBJ(m));
+    }
+    ScmObj vp = Scm_MakeU32Vector(nrows+1, 0);
+    ScmUInt32 *p = SCM_U32VECTOR_ELEMENTS(vp);
+    CSREntry *es = SCM_NEW_ATOMIC_ARRAY(CSREntry, nent);
+    u_long *fill = SCM_NEW_ATOMIC_ARRAY(u_long, nrows);
+
+    /* Count entries per row */
+    CompactTrieIterInit(&iter, &m->trie);
+    while ((leaf = CompactTrieIterNext(&iter)) != NULL) {
+        int n = leaf_entries(m, leaf, ind, val);
+        for (int i=0; i<n; i++) {
+            u_long x, y;
+            matrix_index_split(ind[i], &x, &y);
+            if (x >= nrows) {
+                Scm_Error("%S has an entry at row %lu, while the number of "
+                          "rows is %lu", SCM_OBJ(m), x, nrows);
+            }
+            p[x+1]++;
+        }
+    }
+    for (u_long k=0; k<nrows; k++) {
+        p[k+1] += p[k];
+        fill[k] = p[k];
+    }
+
+    /* Place entries, then sort each row */
+    CompactTrieIterInit(&iter, &m->trie);
+    while ((leaf = CompactTrieIterNext(&iter)) != NULL) {
+        int n = leaf_entries(m, leaf, ind, val);
+        for (int i=0; i<n; i++) {
+            u_long x, y;
+            matrix_index_split(ind[i], &x, &y);
+            es[fill[x]].col = y;
+            es[fill[x]].val = val[i];
+            fill[x]++;
+        }
+    }
+    for (u_long k=0; k<nrows; k++) {
+        if (p[k+1] - p[k] > 1) {
+            qsort(es + p[k], p[k+1] - p[k], sizeof(CSREntry), csr_entry_cmp);
+        }
+    }
+
+    ScmObj vi = Scm_MakeU32Vector(nent, 0);
+    ScmObj vv = Scm_MakeF64Vector(nent, 0.0);
+    for (u_long k=0; k<nent; k++) {
+        SCM_U32VECTOR_ELEMENT(vi, k) = (ScmUInt32)es[k].col;
+        SCM_F64VECTOR_ELEMENT(vv, k) = es[k].val;
+    }
+    *indptr = vp;
+    *indices = vi;
+    *values = vv;
+}
+
+static u_long csr_index(ScmUVector *v, int type, u_long k)
+{
+    if (type == SCM_UVECTOR_U32) return SCM_U32VECTOR_ELEMENT(v, k);
+    ScmInt32 i = SCM_S32VECTOR_ELEMENT(v, k);
+    if (i < 0) Scm_Error("negative index in %S: %d", SCM_OBJ(v), i);
+    return (u_long)i;
+}
+
+/* Sets entries given in CSR form into M.  INDPTR and INDICES must be
+   u32vectors or s32vectors; VALUES can be any uvector. */
+void SparseMatrixSetCSR(SparseVector *m, ScmUVector *indptr,
+                        ScmUVector *indices, ScmUVector *values)
+{
+    int ptype = Scm_UVectorType(SCM_CLASS_OF(indptr));
+    int itype = Scm_UVectorType(SCM_CLASS_OF(indices));
+    int vtype = Scm_UVectorType(SCM_CLASS_OF(values));
+    u_long nrows = SCM_UVECTOR_SIZE(indptr);
+    u_long nent = SCM_UVECTOR_SIZE(values);
+    /* flonum matrices can be filled without boxing */
+    int direct = (flonum_or_generic_p(m)
+                  && m->desc->etype != SCM_UVECTOR_INVALID);
+
+    if ((ptype != SCM_UVECTOR_U32 && ptype != SCM_UVECTOR_S32)
+        || (itype != SCM_UVECTOR_U32 && itype != SCM_UVECTOR_S32)) {
+        Scm_Error("indptr and indices must be u32vectors or s32vectors, "
+                  "but got %S and %S", SCM_OBJ(indptr), SCM_OBJ(indices));
+    }
+    if (nrows == 0 || SCM_UVECTOR_SIZE(indices) != nent
+        || csr_index(indptr, ptype, 0) != 0
+        || csr_index(indptr, ptype, nrows-1) != nent) {
+        Scm_Error("inconsistent CSR vectors: %S, %S and %S",
+                  SCM_OBJ(indptr), SCM_OBJ(indices), SCM_OBJ(values));
+    }
+    nrows--;
+    if (nrows > MATRIX_INDEX_LIMIT) {
+        Scm_Error("too many rows in CSR indptr: %S", SCM_OBJ(indptr));
+    }
+
+    for (u_long x=0; x<nrows; x++) {
+        u_long start = csr_index(indptr, ptype, x);
+        u_long end = csr_index(indptr, ptype, x+1);
+        if (start > end || end > nent) {
+            Scm_Error("indptr isn't monotonically increasing: %S",
+                      SCM_OBJ(indptr));
+        }
+        for (u_long k=start; k<end; k++) {
+            u_long y = csr_index(indices, itype, k);
+            if (y >= MATRIX_INDEX_LIMIT) {
+                Scm_Error("column index is out of range: %lu", y);
+            }
+            u_long i = matrix_index_combine(x, y);
+            if (direct) {
+                Leaf *leaf = CompactTrieAdd(&m->trie, i >> m->desc->shift,
+                                            m->desc->allocate, m);
+                if (leaf_put(m, leaf, i, dense_ref(values, vtype, k), TRUE)) {
+                    m->numEntries++;
+                }
+            } else {
+                SparseVectorSet(m, i, dense_obj(values, vtype, k));
+            }
+        }
+    }
+}
+
 /*===================================================================
  * Initialization
  */
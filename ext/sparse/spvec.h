@@ -86,6 +86,10 @@ typedef struct SparseVectorIterRec {
                  I is intra-leaf index, not the vector-wide index.
    dump(P,L,I,_) - Dumps leaf data.
 
+   The etype field is one of SCM_UVECTOR_* for uniform sparse vectors,
+   and SCM_UVECTOR_INVALID for the generic one.  Numeric kernels use it
+   to access leaves directly.
+
    The numEntries field is taken care of by generic routine.
  */
 struct SparseVectorDescriptorRec {
@@ -99,6 +103,7 @@ struct SparseVectorDescriptorRec {
     void     (*dump)(ScmPort *out, Leaf *leaf, int indent, void *data);
 
     int shift;                  /* # of shift bits to access Leaf */
+    int etype;                  /* element type (ScmUVectorType) */
 };
 
 /* Max # of bits for index.  Theoretrically we can extend this
@@ -124,6 +129,19 @@ extern void   SparseVectorDump(SparseVector *sv);
 extern void   SparseVectorIterInit(SparseVectorIter *iter, SparseVector *sv);
 extern ScmObj SparseVectorIterNext(SparseVectorIter *iter);
 
+/* Numeric kernels.  Elements are computed in double. */
+extern double SparseVectorDotDense(SparseVector *sv, ScmUVector *v);
+extern double SparseVectorDot(SparseVector *a, SparseVector *b);
+extern void   SparseVectorAxpy(SparseVector *y, double a, SparseVector *x);
+extern u_long SparseMatrixNumRows(SparseVector *m);
+extern void   SparseMatrixMulVector(SparseVector *m, ScmUVector *v,
+                                    ScmUVector *out);
+extern void   SparseMatrixToCSR(SparseVector *m, u_long nrows,
+                                ScmObj *indptr, ScmObj *indices,
+                                ScmObj *values);
+extern void   SparseMatrixSetCSR(SparseVector *m, ScmUVector *indptr,
+                                 ScmUVector *indices, ScmUVector *values);
+
 extern void   Scm_Init_spvec(ScmModule *mod);
 
 /*
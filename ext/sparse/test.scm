@@ -13,6 +13,7 @@
 (use data.sparse)
 (test-module 'data.sparse)
 (use gauche.collection)
+(use gauche.uvector)
 
 (define (simple-test name obj %ref %set! %exists? %fold key1 key2
                      :optional (val1 'ok) (val2 'okok) (val3 'okokok))
@@ -288,6 +289,49 @@
            (sparse-vector-ref y 1)))
   )
 
+(let ([a (make-sparse-vector 'f64)]
+      [b (make-sparse-vector 's32)]
+      [c (make-sparse-vector #f)])
+  (define (sorted-alist sv)
+    (sort (sparse-vector-map sv cons) (^[p q] (< (car p) (car q)))))
+  (dolist [p '((0 . 1.5) (3 . 2.0) (100 . -1.0) (1000 . 4.0))]
+    (sparse-vector-set! a (car p) (cdr p)))
+  (dolist [p '((3 . 2) (100 . 5) (1001 . 7))]
+    (sparse-vector-set! b (car p) (cdr p)))
+  (sparse-vector-set! c 3 10)
+  (sparse-vector-set! c 1000 1/2)
+
+  (test* "sparse-vector-dot (f64 x f64vector)" 3912.5
+         (sparse-vector-dot a (list->f64vector (iota 1002 1))))
+  (test* "sparse-vector-dot (s32 x s32vector)" 28.0
+         (sparse-vector-dot b (make-s32vector 1002 2)))
+  (test* "sparse-vector-dot (out of range)" (test-error)
+         (sparse-vector-dot a (make-f64vector 10 1.0)))
+  (test* "sparse-vector-dot (f64 x s32)" '(-1.0 -1.0)
+         (list (sparse-vector-dot a b) (sparse-vector-dot b a)))
+  (test* "sparse-vector-dot (f64 x f64)" 23.25
+         (sparse-vector-dot a (sparse-vector-copy a)))
+  (test* "sparse-vector-dot (f64 x generic)" 22.0
+         (sparse-vector-dot a c))
+  (test* "sparse-vector-dot (non-numeric)" (test-error)
+         (let1 d (make-sparse-vector)
+           (sparse-vector-set! d 0 'x)
+           (sparse-vector-dot a d)))
+
+  (test* "sparse-vector-axpy!"
+         '(5 ((0 . 1.5) (3 . 6.0) (100 . 9.0) (1000 . 4.0) (1001 . 14.0)))
+         (let1 y (sparse-vector-copy a)
+           (sparse-vector-axpy! y 2.0 b)
+           (list (sparse-vector-num-entries y) (sorted-alist y))))
+  (test* "sparse-vector-axpy! (same vector)"
+         '((0 . 3.0) (3 . 4.0) (100 . -2.0) (1000 . 8.0))
+         (let1 y (sparse-vector-copy a)
+           (sparse-vector-axpy! y 1.0 y)
+           (sorted-alist y)))
+  (test* "sparse-vector-axpy! (integer vector)" (test-error)
+         (sparse-vector-axpy! (sparse-vector-copy b) 1.0 a))
+  )
+
 ;; sparse matrix----------------------------------------------------
 (test-section "sparse-matrix")
 
@@ -357,4 +401,249 @@
            (list A a B b)))
   )
 
+(let ([m (make-sparse-matrix 'f64)]
+      [n (make-sparse-matrix 's32)])
+  (dolist [e '((0 0 1) (0 2 2) (1 1 3) (2 0 4) (2 2 5))]
+    (apply sparse-matrix-set! m e))
+  (dolist [e '((0 40 1) (0 3 2) (5 17 3))]
+    (apply sparse-matrix-set! n e))
+
+  (test* "sparse-matrix-mul-vector" '#f64(7.0 6.0 19.0)
+         (sparse-matrix-mul-vector m '#f64(1.0 2.0 3.0)))
+  (test* "sparse-matrix-mul-vector (out)" '(#t #f64(3.0 3.0 9.0 0.0))
+         (let* ([out (make-f64vector 4 100.0)]
+                [r (sparse-matrix-mul-vector m '#s32(1 1 1) out)])
+           (list (eq? r out) out)))
+  (test* "sparse-matrix-mul-vector (out of range)" (test-error)
+         (sparse-matrix-mul-vector n '#f64(1.0 2.0 3.0)))
+
+  (test* "sparse-matrix->csr" '(#u32(0 2 2 2 2 2 3) #u32(3 40 17)
+                                #f64(2.0 1.0 3.0))
+         (values->list (sparse-matrix->csr n)))
+  (test* "sparse-matrix->csr (too few rows)" (test-error)
+         (sparse-matrix->csr n 2))
+  (test* "sparse-matrix->csr (nrows)" '#u32(0 2 2 2 2 2 3 3)
+         (values-ref (sparse-matrix->csr n 7) 0))
+  (test* "csr->sparse-matrix" '(3 2 1 3)
+         (receive (p i v) (sparse-matrix->csr n)
+           (let1 n2 (csr->sparse-matrix p i
+                                        (list->s32vector
+                                         (map exact (f64vector->list v)))
+                                        's32)
+             (list (sparse-matrix-num-entries n2)
+                   (sparse-matrix-ref n2 0 3)
+                   (sparse-matrix-ref n2 0 40)
+                   (sparse-matrix-ref n2 5 17)))))
+  (test* "csr->sparse-matrix (f64)" '#f64(7.0 6.0 19.0)
+         (receive (p i v) (sparse-matrix->csr m)
+           (sparse-matrix-mul-vector (csr->sparse-matrix p i v)
+                                     '#f64(1.0 2.0 3.0))))
+  (test* "csr->sparse-matrix (inconsistent)" (test-error)
+         (csr->sparse-matrix '#u32(0 2) '#u32(0) '#f64(1.0)))
+  )
+
+;;;
+;;; data.hamt
+;;;
+
+(test-section "data.hamt")
+(use data.hamt)
+(cond-expand
+ [gauche.sys.threads (use gauche.threads)]
+ [else])
+(test-module 'data.hamt)
+(use gauche.dictionary)
+
+(let ()
+  (define (sorted-alist h) (sort (hamt->alist h) (^[a b] (< (car a) (car b)))))
+  (define (sorted-alist/table tab)
+    (sort (hash-table->alist tab) (^[a b] (< (car a) (car b)))))
+
+  (test* "hamt basic" '(#t 0 a b #f)
+         (let* ([h0 (make-hamt 'eqv?)]
+                [h1 (hamt-put h0 1 'a)]
+                [h2 (hamt-put h1 2 'b)])
+           (list (hamt-empty? h0) (hamt-num-entries h0)
+                 (hamt-get h2 1) (hamt-get h2 2) (hamt-get h1 2 #f))))
+  (test* "hamt get nokey" (test-error) (hamt-get (make-hamt) 1))
+  (test* "hamt persistence" '(((1 . a) (2 . b)) ((1 . z) (2 . b)) ((2 . b)))
+         (let* ([h1 (alist->hamt '((1 . a) (2 . b)) 'eqv?)]
+                [h2 (hamt-put h1 1 'z)]
+                [h3 (hamt-delete h1 1)])
+           (map sorted-alist (list h1 h2 h3))))
+  (test* "hamt put same value" #t
+         (let1 h (alist->hamt '((1 . a)) 'eqv?)
+           (eq? h (hamt-put h 1 'a))))
+  (test* "hamt update" '(11 1)
+         (let* ([h (alist->hamt '((1 . 10)) 'eqv?)]
+                [h1 (hamt-update h 1 (cut + <> 1))]
+                [h2 (hamt-update h 2 (cut + <> 1) 0)])
+           (list (hamt-get h1 1) (hamt-get h2 2))))
+
+  ;; compare with a hash table by random operations
+  (define (random-test name comparator keygen)
+    (let ([tab (make-hash-table comparator)]
+          [h (make-hamt comparator)])
+      (dotimes [i 5000]
+        (let1 k (keygen)
+          (if (zero? (random-integer 3))
+            (begin (hash-table-delete! tab k)
+                   (set! h (hamt-delete h k)))
+            (begin (hash-table-put! tab k i)
+                   (set! h (hamt-put h k i))))))
+      (%hamt-check h)
+      (test* #"hamt random ops (~name)" (hash-table-num-entries tab)
+             (hamt-num-entries h))
+      (test* #"hamt random ops (~name) entries" '()
+             (hash-table-fold tab
+                              (^[k v s]
+                                (if (eqv? v (hamt-get h k #f)) s (cons k s)))
+                              '()))
+      h))
+
+  (random-test "eqv" eqv-comparator (^[] (random-integer 2000)))
+  (random-test "string" string-comparator
+               (^[] (number->string (random-integer 2000))))
+  ;; every 5 keys share the same hash value
+  (random-test "collision"
+               (make-comparator exact-integer? = #f (^x (quotient x 5)))
+               (^[] (random-integer 500)))
+
+  (test* "hamt transient" '(1000 #t 999)
+         (let* ([t (hamt-transient (make-hamt 'eqv?))])
+           (dotimes [i 1000] (hamt-put! t i (* i i)))
+           (let* ([c (hamt-num-entries t)]
+                  [d (hamt-delete! t 500)]
+                  [h (hamt-persistent! t)])
+             (%hamt-check h)
+             (list c d (hamt-num-entries h)))))
+  (test* "hamt transient doesn't affect the original" '(10 20)
+         (let* ([h (alist->hamt (map (^i (cons i i)) (iota 10)) 'eqv?)]
+                [t (hamt-transient h)])
+           (dotimes [i 20] (hamt-put! t i 'x))
+           (list (hamt-num-entries h) (hamt-num-entries t))))
+  (test* "hamt transient after persistent!" (test-error)
+         (let1 t (hamt-transient (make-hamt 'eqv?))
+           (hamt-persistent! t)
+           (hamt-put! t 1 1)))
+
+  (let* ([a (alist->hamt (map (^i (cons i 'a)) (iota 300 0 2)) 'eqv?)]
+         [b (alist->hamt (map (^i (cons i 'b)) (iota 200 0 3)) 'eqv?)])
+    (define (expected pred val)
+      (filter-map (^i (and (pred (even? i) (zero? (modulo i 3)))
+                           (cons i (val (even? i)))))
+                  (iota 600)))
+    (test* "hamt-union"
+           (expected (^[x y] (or x y)) (^[x] (if x 'a 'b)))
+           (let1 h (hamt-union a b) (%hamt-check h) (sorted-alist h)))
+    (test* "hamt-intersection"
+           (expected (^[x y] (and x y)) (^_ 'a))
+           (let1 h (hamt-intersection a b) (%hamt-check h) (sorted-alist h)))
+    (test* "hamt-difference"
+           (expected (^[x y] (and x (not y))) (^_ 'a))
+           (let1 h (hamt-difference a b) (%hamt-check h) (sorted-alist h)))
+    (test* "hamt set operations on shared structure" '(300 301 0)
+           (let1 a2 (hamt-put a 1 'z)
+             (list (hamt-num-entries (hamt-intersection a a2))
+                   (hamt-num-entries (hamt-union a a2))
+                   (hamt-num-entries (hamt-difference a a)))))
+    (test* "hamt set operations with different comparators" (test-error)
+           (hamt-union a (make-hamt 'equal?))))
+
+  (test* "hamt dictionary" '(a #f ((1 . a) (2 . b)))
+         (let1 h (alist->hamt '((1 . a) (2 . b)) 'eqv?)
+           (list (dict-get h 1) (dict-get h 3 #f)
+                 (sort (dict->alist h) (^[a b] (< (car a) (car b)))))))
+  (test* "hamt collection" 2
+         (size-of (alist->hamt '((1 . a) (2 . b)) 'eqv?)))
+  )
+
+(test-section "concurrent hamt")
+
+(let ()
+  (define (sorted-alist h) (sort (hamt->alist h) (^[a b] (< (car a) (car b)))))
+
+  (test* "make-concurrent-hamt" '(#t 0)
+         (let1 c (make-concurrent-hamt 'eqv?)
+           (list (concurrent-hamt? c) (concurrent-hamt-num-entries c))))
+  (test* "make-concurrent-hamt with initial hamt" '(b 2)
+         (let1 c (make-concurrent-hamt (alist->hamt '((1 . a) (2 . b)) 'eqv?))
+           (list (concurrent-hamt-get c 2) (concurrent-hamt-num-entries c))))
+
+  (let ([c (make-concurrent-hamt 'eqv?)])
+    (test* "concurrent-hamt-put!/get" '(a b none)
+           (begin
+             (concurrent-hamt-put! c 1 'a)
+             (concurrent-hamt-put! c 2 'b)
+             (list (concurrent-hamt-get c 1)
+                   (concurrent-hamt-get c 2)
+                   (concurrent-hamt-get c 3 'none))))
+    (test* "concurrent-hamt-get (error)" (test-error)
+           (concurrent-hamt-get c 3))
+    (test* "concurrent-hamt snapshot isn't affected by update"
+           '(((1 . a) (2 . b)) ((2 . b) (3 . c)))
+           (let1 snap (concurrent-hamt-snapshot c)
+             (concurrent-hamt-put! c 3 'c)
+             (concurrent-hamt-delete! c 1)
+             (list (sorted-alist snap)
+                   (sorted-alist (concurrent-hamt-snapshot c)))))
+    (test* "concurrent-hamt-delete!" '(#t #f #f)
+           (list (concurrent-hamt-delete! c 2)
+                 (concurrent-hamt-delete! c 2)
+                 (concurrent-hamt-exists? c 2)))
+    (test* "concurrent-hamt-update!" 13
+           (begin
+             (concurrent-hamt-update! c 4 (cut + <> 3) 10)
+             (concurrent-hamt-get c 4)))
+    (test* "concurrent-hamt-compare-and-set!" '(#f #t x)
+           (let* ([old (concurrent-hamt-snapshot c)]
+                  [new (hamt-put old 5 'x)])
+             (concurrent-hamt-put! c 6 'y)
+             (let1 r1 (concurrent-hamt-compare-and-set! c old new)
+               (list r1
+                     (concurrent-hamt-compare-and-set!
+                      c (concurrent-hamt-snapshot c) new)
+                     (concurrent-hamt-get c 5)))))
+    (test* "concurrent-hamt-compare-and-set! (different comparator)"
+           (test-error)
+           (concurrent-hamt-compare-and-set! c (concurrent-hamt-snapshot c)
+                                             (make-hamt 'equal?)))
+    (test* "concurrent-hamt-swap!" '((1 . z))
+           (hamt->alist
+            (concurrent-hamt-swap! c (^_ (alist->hamt '((1 . z)) 'eqv?)))))
+    (test* "concurrent hamt dictionary" '(z #f ((1 . z) (2 . w)))
+           (begin
+             (dict-put! c 2 'w)
+             (list (dict-get c 1) (dict-get c 3 #f)
+                   (sort (dict->alist c) (^[a b] (< (car a) (car b)))))))
+    )
+
+  (cond-expand
+   [gauche.sys.threads
+    ;; Writers update disjoint keys while readers keep reading;
+    ;; no update must be lost.
+    (test* "concurrent hamt with threads" '(4000 #t)
+           (let* ([c (make-concurrent-hamt 'eqv?)]
+                  [done #f]
+                  [writers (map (^k ($ thread-start! $ make-thread
+                                       (^[] (dotimes [i 1000]
+                                              (concurrent-hamt-put!
+                                               c (+ (* k 1000) i) i)))))
+                                '(0 1 2 3))]
+                  [reader ($ thread-start! $ make-thread
+                             (^[] (let loop ([ok #t])
+                                    (if done
+                                      ok
+                                      (let1 h (concurrent-hamt-snapshot c)
+                                        (loop
+                                         (and ok
+                                              (= (hamt-num-entries h)
+                                                 (length (hamt-keys h))))))))))])
+             (for-each thread-join! writers)
+             (set! done #t)
+             (list (concurrent-hamt-num-entries c)
+                   (thread-join! reader))))]
+   [else])
+  )
+
 (test-end)
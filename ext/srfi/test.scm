@@ -344,6 +344,14 @@
        (string-index-right "abcd:efgh;ijkl" #[\d]))
 (test* "string-index-right" 4
        (string-index-right "abcd:efgh;ijkl" #[\W] 2 5))
+(test* "string-index (cursor)" "efgh:ijkl"
+       (let* ([s "abcd:efgh:ijkl"]
+              [c (string-index s #\: (string-cursor-start s))])
+         (substring/cursors s (string-cursor-next s c) (string-cursor-end s))))
+(test* "string-index-right (cursor)" "ijkl"
+       (let* ([s "abcd:efgh;ijkl"]
+              [c (string-index-right s #[\W] (string-cursor-start s))])
+         (substring/cursors s (string-cursor-next s c) (string-cursor-end s))))
 
 (test* "string-count" 2
        (string-count "abc def\tghi jkl" #\space))
@@ -0,0 +1,265 @@
+/*
+ * ssaxscan.c - native tokenizer for SSAX
+ *
+ *   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ssaxscan.h"
+#include "gauche/priv/portP.h"
+#include <string.h>
+
+/*================================================================
+ * Window
+ *
+ *  A `window' is a range of bytes that can be read without calling
+ *  the port's filler: the unread part of the buffer of a file port,
+ *  or the rest of the string of an input string port.  It is only
+ *  available when nothing is pushed back to the port.  When the window
+ *  is exhausted, or isn't available, we take one byte with
+ *  Scm_GetbUnsafe, which also refills the buffer; if the byte turns
+ *  out to end the token, it is pushed back with Scm_UngetbUnsafe.
+ *
+ *  All the bytes we stop at are ASCII below 0x40, which never appear
+ *  as a part of a multibyte character in utf-8, euc-jp and Shift_JIS,
+ *  so we can scan bytes without caring about character boundaries.
+ */
+
+static int get_window(ScmPort *p, const char **start, const char **end)
+{
+    if (p->closed || p->scrcnt > 0 || p->ungotten != SCM_CHAR_INVALID) {
+        return FALSE;
+    }
+    switch (SCM_PORT_TYPE(p)) {
+    case SCM_PORT_FILE:
+        *start = p->src.buf.current;
+        *end = p->src.buf.end;
+        break;
+    case SCM_PORT_ISTR:
+        *start = p->src.istr.current;
+        *end = p->src.istr.end;
+        break;
+    default:
+        return FALSE;
+    }
+    return (*start < *end);
+}
+
+/* Advances the port position to TO, which is within the window. */
+static void consume_window(ScmPort *p, const char *to)
+{
+    int filep = (SCM_PORT_TYPE(p) == SCM_PORT_FILE);
+    const char *q = filep ? p->src.buf.current : p->src.istr.current;
+
+    p->bytes += to - q;
+    while (q < to && (q = memchr(q, '\n', to - q)) != NULL) {
+        p->line++;
+        q++;
+    }
+    if (filep) p->src.buf.current = (char*)to;
+    else       p->src.istr.current = to;
+}
+
+/* Gets a byte when the window isn't available.  Returns EOF at the end. */
+static int get_byte(ScmPort *p)
+{
+    int b = Scm_GetbUnsafe(p);
+    if (b == '\n') p->line++;
+    return b;
+}
+
+static void unget_byte(ScmPort *p, int b)
+{
+    if (b == '\n') p->line--;
+    Scm_UngetbUnsafe(b, p);
+}
+
+/*================================================================
+ * Tokens
+ */
+
+/* [3] S ::= (#x20 | #x9 | #xD | #xA)+ */
+static inline int space_p(int b)
+{
+    return (b == ' ' || b == '\n' || b == '\t' || b == '\r');
+}
+
+/* ASCII part of NCNameChar.  SSAX accepts Letter, Digit, '.', '-' and
+   '_', where Letter is anything char-alphabetic? says yes. */
+static char ncname_ascii[128];
+
+static void init_tables(void)
+{
+    static int initialized = FALSE;
+    if (initialized) return;
+    for (int c = 0; c < 128; c++) {
+        ncname_ascii[c] = ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+                           || (c >= '0' && c <= '9')
+                           || c == '.' || c == '-' || c == '_');
+    }
+    initialized = TRUE;
+}
+
+static inline int ncname_start_p(ScmChar c)
+{
+    if (c == '_') return TRUE;
+    if (c < 0x80) return ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'));
+    return Scm_CharAlphabeticP(c);
+}
+
+static inline int ncname_char_p(ScmChar c)
+{
+    if (c < 0x80) return ncname_ascii[c];
+    return Scm_CharAlphabeticP(c);
+}
+
+static ScmObj skip_S(ScmPort *p)
+{
+    const char *s, *e;
+    for (;;) {
+        if (get_window(p, &s, &e)) {
+            const char *q = s;
+            while (q < e && space_p((unsigned char)*q)) q++;
+            consume_window(p, q);
+            if (q < e) break;
+        }
+        int b = get_byte(p);
+        if (b == EOF) return SCM_EOF;
+        if (!space_p(b)) {
+            unget_byte(p, b);
+            break;
+        }
+    }
+    ScmChar c = Scm_PeekcUnsafe(p);
+    return (c == EOF) ? SCM_EOF : SCM_MAKE_CHAR(c);
+}
+
+static ScmObj read_ncname(ScmPort *p)
+{
+    ScmChar c = Scm_PeekcUnsafe(p);
+    if (c == EOF || !ncname_start_p(c)) return SCM_FALSE;
+
+    ScmDString ds;
+    Scm_DStringInit(&ds);
+    Scm_GetcUnsafe(p);
+    Scm_DStringPutc(&ds, c);
+    for (;;) {
+        const char *s, *e;
+        if (get_window(p, &s, &e)) {
+            const char *q = s;
+            while (q < e && (unsigned char)*q < 0x80 && ncname_ascii[(int)*q]) {
+                q++;
+            }
+            if (q > s) Scm_DStringPutz(&ds, s, (int)(q - s));
+            consume_window(p, q);
+            if (q < e && (unsigned char)*q < 0x80) break;
+        }
+        /* non-ASCII character, or the window is exhausted */
+        c = Scm_PeekcUnsafe(p);
+        if (c == EOF || !ncname_char_p(c)) break;
+        Scm_GetcUnsafe(p);
+        Scm_DStringPutc(&ds, c);
+    }
+    return Scm_Intern(SCM_STRING(Scm_DStringGet(&ds, 0)));
+}
+
+static ScmObj read_text(ScmPort *p, const char *stop)
+{
+    ScmDString ds;
+    Scm_DStringInit(&ds);
+    for (;;) {
+        const char *s, *e;
+        if (get_window(p, &s, &e)) {
+            const char *q = s;
+            while (q < e && !stop[(unsigned char)*q]) q++;
+            if (q > s) Scm_DStringPutz(&ds, s, (int)(q - s));
+            consume_window(p, q);
+            if (q < e) break;
+        }
+        int b = get_byte(p);
+        if (b == EOF) break;
+        if (stop[b]) {
+            unget_byte(p, b);
+            break;
+        }
+        Scm_DStringPutb(&ds, (char)b);
+    }
+    return Scm_DStringGet(&ds, 0);
+}
+
+/*================================================================
+ * Entry points
+ *
+ *  The port is locked during the scan, since we touch its buffer
+ *  directly.
+ */
+
+ScmObj Ssax_SkipS(ScmPort *port)
+{
+    ScmVM *vm = Scm_VM();
+    ScmObj r = SCM_UNDEFINED;
+    PORT_LOCK(port, vm);
+    PORT_SAFE_CALL(port, r = skip_S(port), /*no cleanup*/);
+    PORT_UNLOCK(port);
+    return r;
+}
+
+ScmObj Ssax_ReadNCName(ScmPort *port)
+{
+    ScmVM *vm = Scm_VM();
+    ScmObj r = SCM_UNDEFINED;
+    init_tables();
+    PORT_LOCK(port, vm);
+    PORT_SAFE_CALL(port, r = read_ncname(port), /*no cleanup*/);
+    PORT_UNLOCK(port);
+    return r;
+}
+
+ScmObj Ssax_ReadText(ScmPort *port, ScmString *stops)
+{
+    char stop[256];
+    unsigned int size;
+    const char *z = Scm_GetStringContent(stops, &size, NULL, NULL);
+    ScmVM *vm = Scm_VM();
+    ScmObj r = SCM_UNDEFINED;
+
+    memset(stop, 0, sizeof(stop));
+    for (unsigned int i = 0; i < size; i++) {
+        unsigned char b = (unsigned char)z[i];
+        if (b >= 0x40) {
+            Scm_Error("stop characters must be ASCII below 0x40, but got: %S",
+                      SCM_OBJ(stops));
+        }
+        stop[b] = TRUE;
+    }
+    PORT_LOCK(port, vm);
+    PORT_SAFE_CALL(port, r = read_text(port, stop), /*no cleanup*/);
+    PORT_UNLOCK(port);
+    return r;
+}
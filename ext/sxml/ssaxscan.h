@@ -0,0 +1,62 @@
+/*
+ * ssaxscan.h - native tokenizer for SSAX
+ *
+ *   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef GAUCHE_SXML_SSAXSCAN_H
+#define GAUCHE_SXML_SSAXSCAN_H
+
+#include <gauche.h>
+#include <gauche/extend.h>
+
+/* These take over the lexical scanning that SSAX does one character
+   at a time in Scheme.  They work on the bytes of the port's buffer
+   (or the body of an input string port) directly, with the port locked,
+   and fall back to byte or character operations when something is
+   pushed back or the port is procedural.  The parsing itself stays
+   in Scheme (sxml-ssax.scm.in).  */
+
+/* Skips XML whitespaces (S production) and returns the following
+   character without consuming it, or EOF. */
+extern ScmObj Ssax_SkipS(ScmPort *port);
+
+/* Reads an NCName and returns it as a symbol.  If the next character
+   can't start an NCName, returns #f without consuming anything. */
+extern ScmObj Ssax_ReadNCName(ScmPort *port);
+
+/* Reads characters up to one of the characters in STOPS, or EOF, and
+   returns them as a string.  The stop character is left in the port.
+   STOPS may only contain ASCII characters below 0x40, which never
+   appear as a part of a multibyte character in the supported
+   encodings. */
+extern ScmObj Ssax_ReadText(ScmPort *port, ScmString *stops);
+
+#endif /*GAUCHE_SXML_SSAXSCAN_H*/
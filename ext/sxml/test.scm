@@ -5,6 +5,89 @@
 ;; ssax test is derived from the original SSAX source.
 (include "./ssax-test.scm")
 
+;; native tokenizer and streaming interface
+(use gauche.test)
+(use gauche.vport)
+(use gauche.generator)
+
+(test-start "SSAX native tokenizer")
+(use sxml.ssax)
+(use sxml.sxpath)
+
+(define *doc*
+  "<?xml version='1.0'?>\r\n<feed xmlns:a='http://example.com/a'>\r\n\
+   <entry note=\"x&amp;y &#x41;\r\nz\">\
+   caf\u00e9 &lt;1&gt;<![CDATA[<raw>]]><!-- c -->tail</entry>\r\n\
+   <a:link a:lang='ja'/><\u65e5\u672c n\u540d='v'/>\
+   <?target some data?></feed>")
+
+(define *expected*
+  `(*TOP* (*PI* xml "version='1.0'")
+          (feed (entry (@ (note "x&y A z")) "caf\u00e9 <1><raw>tail")
+                (http://example.com/a:link (@ (http://example.com/a:lang "ja")))
+                (,(string->symbol "\u65e5\u672c")
+                 (@ (,(string->symbol "n\u540d") "v")))
+                (*PI* target "some data"))))
+
+;; Reads the document through ports of the kinds the tokenizer handles
+;; differently.
+(define (parse-with opener)
+  (let1 port (opener *doc*)
+    (begin0 (ssax:xml->sxml port '())
+      (close-input-port port))))
+
+(test* "string port" *expected* (parse-with open-input-string))
+
+(test* "file port" *expected*
+       (begin
+         (with-output-to-file "test.o" (cut display *doc*))
+         (begin0 (parse-with (^_ (open-input-file "test.o")))
+           (sys-unlink "test.o"))))
+
+(test* "procedural port" *expected*
+       (parse-with (^[s] (let1 p (open-input-string s)
+                           (make <virtual-input-port>
+                             :getb (cut read-byte p))))))
+
+(test* "name after peek-char" '(abc #\space)
+       (call-with-input-string "abc def"
+         (^[p] (peek-char p)
+               (list (ssax:read-NCName p) (peek-char p)))))
+
+(test* "skip-S" `(#\x #\x ,(eof-object))
+       (call-with-input-string "  \r\n\t x"
+         (^[p] (list (ssax:skip-S p) (read-char p) (read-char p)))))
+
+(test* "skip-S at EOF" (eof-object)
+       (call-with-input-string "  " ssax:skip-S))
+
+(test* "xml->sxml and sxpath" '("x&y A z")
+       ((sxpath '(// entry @ note *text*)) (ssax:xml->sxml
+                                          (open-input-string *doc*) '())))
+
+(test* "ssax:for-each-xml-event"
+       '((start a ((x "1"))) (text "p") (start b ()) (end b)
+         (text "q") (text "&") (pi t "d") (end a))
+       (let1 r '()
+         (call-with-input-string "<a x='1'>p<b/>q&amp;<?t d?></a>"
+           (cut ssax:for-each-xml-event (^e (push! r e)) <>))
+         (reverse r)))
+
+(test* "ssax:xml-event-generator" '(start end start end)
+       (call-with-input-string "<a y='2'><b>text</b></a>"
+         (^[p]
+           (generator->list
+            (gmap car (gfilter (^e (memq (car e) '(start end)))
+                               (ssax:xml-event-generator p)))))))
+
+(test* "event generator, namespaces"
+       '(start ns:item ((ns:k "v")))
+       (call-with-input-string
+           "<i:item xmlns:i='urn:x' i:k='v'/>"
+         (^[p] ((ssax:xml-event-generator p '((ns . "urn:x")))))))
+
+(test-end)
+
 ;(load "./tree-trans-test.scm")
 ;(load "./to-html-test.scm")
 
@@ -23,6 +106,44 @@
   (test* "ns-trans" '((rss:title "foo"))
          ((sxpath "//my:title" ns-alist) sxml)))
 
+;; compile-sxpath should give the same result as sxpath
+(let ([doc '(*TOP*
+             (catalog (@ (id "c"))
+               (item (@ (id "x") (kind "a")) (name "foo") "text")
+               (group
+                (item (@ (id "y")) (name "bar")
+                      (item (@ (id "x")) (name "baz")))
+                (item (name "qux") (note "n")))
+               (note (item (@ (id "z") (kind "a"))))))]
+      [paths `((// item)
+               (// item name *text*)
+               (// (item (@ id (equal? "x"))))
+               (// (item (@ id (equal? "x")) name))
+               (// (* (@ id (equal? "c"))))
+               (// (item (@ kind)))
+               (// (item 1))
+               (// (item -1) name)
+               (catalog group (item (note)))
+               (// @ id)
+               (// *)
+               (// *text*)
+               (catalog // note)
+               (// (or@ note name))
+               (// ((// name) 2))
+               ("catalog/item")
+               (// item ,(lambda (ns r v) (take* ns 1))))])
+  (define (check label doc)
+    (dolist [path paths]
+      (test* (format "compile-sxpath~a ~s" label path)
+             ((sxpath path) doc)
+             ((compile-sxpath path) doc))))
+  (check "" doc)
+  (sxml:attach-index! doc)
+  (check " (indexed)" doc)
+  (check " (indexed, nodeset)" (list doc))
+  (sxml:detach-index! doc)
+  (check " (detached)" doc))
+
 (test-end)
 
 ;; sxml.serializer test
@@ -36,6 +36,12 @@
     ((define (fold ...) ...))
     ;; We have constant definition instead.
     ((define ssax:S-chars ...))
+    ;; These are replaced by the ones using the native tokenizer,
+    ;; defined in sxml-ssax.scm.in.
+    ((define (ssax:skip-S ...) ...))
+    ((define (ssax:read-NCName ...) ...))
+    ((define ssax:read-char-data ...))
+    ((define ssax:read-attributes ...))
     ;; These forms are in sxml-tools.
     ;; We have Gauche-specific versions for them
     ((define-macro (sxml:find-name-separator ...) ...))
@@ -0,0 +1,529 @@
+/*
+ * csv.c - native CSV scanner
+ *
+ *   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "csv.h"
+#include "gauche/priv/portP.h"
+#include <ctype.h>
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) \
+    && (defined(__clang__) \
+        || (defined(__GNUC__) \
+            && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define CSV_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) && defined(__GNUC__)
+#define CSV_SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
+/*================================================================
+ * Vector kernels
+ *
+ *  find2_simd(p, end, a, b) returns the first byte in [p, end) that
+ *  is A or B, looking only at whole blocks.  If no block has one, it
+ *  returns the beginning of the remaining bytes, which the caller has
+ *  to scan.  NULL if the CPU has no suitable instructions.
+ */
+
+static const char *(*find2_simd)(const char*, const char*,
+                                 unsigned char, unsigned char) = NULL;
+
+#if defined(CSV_SIMD_X86)
+
+__attribute__((target("sse2")))
+static const char *find2_sse2(const char *p, const char *end,
+                              unsigned char a, unsigned char b)
+{
+    const __m128i va = _mm_set1_epi8((char)a);
+    const __m128i vb = _mm_set1_epi8((char)b);
+    for (; end - p >= 16; p += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        int m = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, va),
+                                               _mm_cmpeq_epi8(v, vb)));
+        if (m) return p + __builtin_ctz(m);
+    }
+    return p;
+}
+
+__attribute__((target("avx2")))
+static const char *find2_avx2(const char *p, const char *end,
+                              unsigned char a, unsigned char b)
+{
+    const __m256i va = _mm256_set1_epi8((char)a);
+    const __m256i vb = _mm256_set1_epi8((char)b);
+    for (; end - p >= 32; p += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)p);
+        unsigned int m = (unsigned int)
+            _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, va),
+                                                 _mm256_cmpeq_epi8(v, vb)));
+        if (m) return p + __builtin_ctz(m);
+    }
+    return find2_sse2(p, end, a, b);
+}
+
+#endif /*CSV_SIMD_X86*/
+
+#if defined(CSV_SIMD_NEON)
+
+/* NEON has no movemask; narrowing the comparison result by 4 bits
+   gives a 64-bit mask with a nibble per byte. */
+static const char *find2_neon(const char *p, const char *end,
+                              unsigned char a, unsigned char b)
+{
+    const uint8x16_t va = vdupq_n_u8(a);
+    const uint8x16_t vb = vdupq_n_u8(b);
+    for (; end - p >= 16; p += 16) {
+        uint8x16_t v = vld1q_u8((const uint8_t*)p);
+        uint8x16_t eq = vorrq_u8(vceqq_u8(v, va), vceqq_u8(v, vb));
+        uint64_t m = vget_lane_u64(vreinterpret_u64_u8(
+                         vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+        if (m) return p + (__builtin_ctzll(m) >> 2);
+    }
+    return p;
+}
+
+#endif /*CSV_SIMD_NEON*/
+
+void CsvInit(void)
+{
+#if defined(CSV_SIMD_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        find2_simd = find2_avx2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        find2_simd = find2_sse2;
+    }
+#endif
+#if defined(CSV_SIMD_NEON)
+    find2_simd = find2_neon;
+#endif
+}
+
+/*================================================================
+ * Scanner
+ *
+ *  The scanner looks at a `window', a range of bytes that can be
+ *  read without calling the port's filler.  For a file port with
+ *  nothing pushed back, the window is the unread part of the port
+ *  buffer; for an input string port, it is the rest of the string.
+ *  Otherwise (pushed back bytes, an empty buffer, or a procedural
+ *  port) we take one byte with Scm_GetbUnsafe and make it the window.
+ *  The bytes consumed from the port buffer are committed, i.e. the
+ *  port's pointer is advanced, whenever the window is refilled and
+ *  when we leave the scanner.
+ *
+ *  A field is delimited within the window by a table lookup
+ *  (unquoted fields) or memchr (quoted fields), and the string is made
+ *  directly from the window.  On x86 with SSE2 or AVX2, and on
+ *  AArch64, a vector kernel skips the blocks of 16 or 32 bytes that
+ *  contain neither delimiter first, and the scalar loop finishes up.  Only when a field crosses the window
+ *  boundary, or a quoted field contains doubled quotes, its content is
+ *  accumulated in a DString.
+ *
+ *  The separator and the quote character are single bytes in the
+ *  native encoding, and never appear as a part of multibyte
+ *  characters (see CsvNativeCharsP), so we can deal with bytes
+ *  except when we skip leading whitespaces or trim trailing ones.
+ */
+
+typedef struct CsvScannerRec {
+    ScmPort *port;
+    unsigned char sep;
+    unsigned char quo;
+    char stop[256];             /* bytes that end an unquoted field */
+    int shared;                 /* fields may share the input string */
+    const char *cur;            /* the window is [cur, end) */
+    const char *end;
+    const char *base;           /* the port's current position */
+    int direct;                 /* the window is in the port's buffer */
+    int shareable;              /* ... and it can be shared */
+    char onebyte;               /* the window when !direct */
+    int pending;                /* acc has a part of the current field */
+    ScmDString acc;
+} CsvScanner;
+
+int CsvNativeCharsP(ScmChar sep, ScmChar quo)
+{
+#if defined(GAUCHE_CHAR_ENCODING_SJIS)
+    /* The second byte of a Shift_JIS character can be 0x40 or above. */
+    return (sep < 0x40 && quo < 0x40);
+#else
+    return (SCM_CHAR_ASCII_P(sep) && SCM_CHAR_ASCII_P(quo));
+#endif
+}
+
+static void scanner_init(CsvScanner *s, ScmPort *port,
+                         ScmChar sep, ScmChar quo, int shared)
+{
+    if (!CsvNativeCharsP(sep, quo)) {
+        Scm_Error("unsupported separator or quote character: %C, %C",
+                  sep, quo);
+    }
+    s->port = port;
+    s->sep = (unsigned char)sep;
+    s->quo = (unsigned char)quo;
+    memset(s->stop, 0, sizeof(s->stop));
+    s->stop['\n'] = TRUE;
+    s->stop[s->sep] = TRUE;
+    s->shared = shared;
+    s->cur = s->end = s->base = &s->onebyte;
+    s->direct = s->shareable = FALSE;
+    s->pending = FALSE;
+    Scm_DStringInit(&s->acc);
+}
+
+/* Advances the port position to the scanner's one. */
+static void scan_commit(CsvScanner *s)
+{
+    if (!s->direct) return;
+    ScmPort *p = s->port;
+    const char *q = s->base;
+    while (q < s->cur && (q = memchr(q, '\n', s->cur - q)) != NULL) {
+        p->line++;
+        q++;
+    }
+    p->bytes += s->cur - s->base;
+    if (SCM_PORT_TYPE(p) == SCM_PORT_FILE) {
+        p->src.buf.current = (char*)s->cur;
+    } else {
+        p->src.istr.current = s->cur;
+    }
+    s->base = s->cur;
+}
+
+/* Called when the window is exhausted.  Returns FALSE on EOF, in
+   which case the window is left empty. */
+static int scan_fill(CsvScanner *s)
+{
+    ScmPort *p = s->port;
+
+    scan_commit(s);
+    if (!p->closed && p->scrcnt == 0 && p->ungotten == SCM_CHAR_INVALID) {
+        switch (SCM_PORT_TYPE(p)) {
+        case SCM_PORT_FILE:
+            if (p->src.buf.current < p->src.buf.end) {
+                s->base = s->cur = p->src.buf.current;
+                s->end = p->src.buf.end;
+                s->direct = TRUE;
+                s->shareable = FALSE; /* the buffer will be overwritten */
+                return TRUE;
+            }
+            break;
+        case SCM_PORT_ISTR:
+            if (p->src.istr.current < p->src.istr.end) {
+                s->base = s->cur = p->src.istr.current;
+                s->end = p->src.istr.end;
+                s->direct = TRUE;
+                /* A string body can't keep the mapped file alive. */
+                s->shareable = s->shared && !(p->flags & SCM_PORT_MAPPED);
+                return TRUE;
+            }
+            break;
+        }
+    }
+    s->direct = s->shareable = FALSE;
+    int b = Scm_GetbUnsafe(p);
+    if (b == EOF) {
+        s->cur = s->end = &s->onebyte;
+        return FALSE;
+    }
+    if (b == '\n') p->line++;
+    s->onebyte = (char)b;
+    s->cur = &s->onebyte;
+    s->end = s->cur + 1;
+    return TRUE;
+}
+
+/* Saves [from, end) of the window, which is a part of the current
+   field, before the window is refilled. */
+static void scan_spill(CsvScanner *s, const char *from)
+{
+    Scm_DStringPutz(&s->acc, from, (int)(s->end - from));
+    s->pending = TRUE;
+}
+
+/* Returns the size of B without trailing whitespaces. */
+static int trimmed_size(const char *b, int size)
+{
+    while (size > 0) {
+        unsigned char c = (unsigned char)b[size-1];
+        if (c >= 0x80) goto multibyte;
+        if (!isspace(c)) return size;
+        size--;
+    }
+    return 0;
+
+  multibyte:
+    /* We can't go backwards in a multibyte string in general. */
+    {
+        const char *p = b, *e = b + size;
+        int last = 0;
+        while (p < e) {
+            unsigned char c = (unsigned char)*p;
+            int n = SCM_CHAR_NFOLLOWS(c) + 1;
+            int wsp;
+            if (c < 0x80) {
+                wsp = isspace(c);
+            } else if (n > e - p) {
+                n = (int)(e - p);
+                wsp = FALSE;
+            } else {
+                ScmChar ch;
+                SCM_CHAR_GET(p, ch);
+                wsp = SCM_CHAR_EXTRA_WHITESPACE(ch);
+            }
+            p += n;
+            if (!wsp) last = (int)(p - b);
+        }
+        return last;
+    }
+}
+
+/* Makes a field from [from, to) of the window, prepended by the
+   accumulated content if any. */
+static ScmObj make_field(CsvScanner *s, const char *from, const char *to,
+                         int trim)
+{
+    const char *b;
+    int size, len, flags = SCM_STRING_COPYING;
+
+    if (s->pending) {
+        Scm_DStringPutz(&s->acc, from, (int)(to - from));
+        b = Scm_DStringPeek(&s->acc, &size, &len);
+    } else {
+        b = from;
+        size = (int)(to - from);
+        if (s->shareable) flags = 0;
+    }
+    if (trim) size = trimmed_size(b, size);
+    ScmObj r = Scm_MakeString(b, size, -1, flags);
+    if (s->pending) {
+        Scm_DStringInit(&s->acc);
+        s->pending = FALSE;
+    }
+    return r;
+}
+
+/* S->cur points to a non-ASCII byte at the beginning of a field.
+   If it begins a whitespace character, skips it and returns TRUE.
+   Otherwise returns FALSE; if we've taken the character across the
+   window boundary, its bytes are saved as a part of the field. */
+static int skip_extra_whitespace(CsvScanner *s)
+{
+    int n = SCM_CHAR_NFOLLOWS(*s->cur) + 1;
+    ScmChar ch;
+
+    if (n > SCM_CHAR_MAX_BYTES) n = SCM_CHAR_MAX_BYTES;
+    if (s->end - s->cur >= n) {
+        SCM_CHAR_GET(s->cur, ch);
+        if (!SCM_CHAR_EXTRA_WHITESPACE(ch)) return FALSE;
+        s->cur += n;
+        return TRUE;
+    } else {
+        char buf[SCM_CHAR_MAX_BYTES];
+        int i = 0;
+        while (i < n) {
+            if (s->cur >= s->end && !scan_fill(s)) break;
+            buf[i++] = *s->cur++;
+        }
+        if (i == n) {
+            SCM_CHAR_GET(buf, ch);
+            if (SCM_CHAR_EXTRA_WHITESPACE(ch)) return TRUE;
+        }
+        Scm_DStringPutz(&s->acc, buf, i);
+        s->pending = TRUE;
+        return FALSE;
+    }
+}
+
+/* Reads one record.  The rules are the same as the Scheme version
+   of csv-reader in csv.scm. */
+static ScmObj read_record(CsvScanner *s)
+{
+    ScmObj h = SCM_NIL, t = SCM_NIL;
+    const char *from, *q;
+
+    if (s->cur >= s->end && !scan_fill(s)) return SCM_EOF;
+
+  start:
+    /* The beginning of a field.  Skip whitespaces. */
+    for (;;) {
+        if (s->cur >= s->end && !scan_fill(s)) goto empty_field;
+        unsigned char c = (unsigned char)*s->cur;
+        if (c == '\n') {
+            s->cur++;
+            goto empty_field;
+        }
+        if (c == s->sep) {
+            s->cur++;
+            SCM_APPEND1(h, t, SCM_MAKE_STR(""));
+            continue;
+        }
+        if (c == s->quo) {
+            s->cur++;
+            goto quoted;
+        }
+        if (c < 0x80) {
+            if (!isspace(c)) break;
+            s->cur++;
+        } else {
+            if (!skip_extra_whitespace(s)) break;
+        }
+    }
+
+    /* Unquoted field. */
+    from = s->cur;
+    for (;;) {
+        q = s->cur;
+        if (find2_simd) q = find2_simd(q, s->end, '\n', s->sep);
+        for (; q < s->end; q++) {
+            if (s->stop[(unsigned char)*q]) break;
+        }
+        if (q < s->end) {
+            SCM_APPEND1(h, t, make_field(s, from, q, TRUE));
+            s->cur = q + 1;
+            if (*q == '\n') return h;
+            goto start;
+        }
+        scan_spill(s, from);
+        s->cur = s->end;
+        if (!scan_fill(s)) {
+            SCM_APPEND1(h, t, make_field(s, s->cur, s->cur, TRUE));
+            return h;
+        }
+        from = s->cur;
+    }
+
+  quoted:
+    from = s->cur;
+    for (;;) {
+        q = s->cur;
+        if (find2_simd) q = find2_simd(q, s->end, s->quo, s->quo);
+        q = (q < s->end)? memchr(q, s->quo, s->end - q) : NULL;
+        if (q == NULL) {
+            scan_spill(s, from);
+            s->cur = s->end;
+            if (!scan_fill(s)) Scm_Error("unterminated quoted field");
+            from = s->cur;
+            continue;
+        }
+        if (q + 1 < s->end) {
+            if ((unsigned char)q[1] == s->quo) {
+                /* Doubled quote.  Keep one of them. */
+                Scm_DStringPutz(&s->acc, from, (int)(q + 1 - from));
+                s->pending = TRUE;
+                s->cur = from = q + 2;
+                continue;
+            }
+            SCM_APPEND1(h, t, make_field(s, from, q, FALSE));
+            s->cur = q + 1;
+        } else {
+            /* The quote is at the end of the window. */
+            Scm_DStringPutz(&s->acc, from, (int)(q - from));
+            s->pending = TRUE;
+            s->cur = q + 1;
+            if (scan_fill(s) && (unsigned char)*s->cur == s->quo) {
+                SCM_DSTRING_PUTB(&s->acc, s->quo);
+                s->cur = from = s->cur + 1;
+                continue;
+            }
+            SCM_APPEND1(h, t, make_field(s, s->cur, s->cur, FALSE));
+        }
+        break;
+    }
+
+    /* After the closing quote, ignore everything up to the separator. */
+    for (;;) {
+        if (s->cur >= s->end && !scan_fill(s)) return h;
+        unsigned char c = (unsigned char)*s->cur++;
+        if (c == '\n') return h;
+        if (c == s->sep) goto start;
+    }
+
+  empty_field:
+    SCM_APPEND1(h, t, SCM_MAKE_STR(""));
+    return h;
+}
+
+static ScmObj read_records(CsvScanner *s, ScmSmallInt nrows)
+{
+    ScmObj h = SCM_NIL, t = SCM_NIL;
+    ScmSmallInt n = 0;
+
+    for (; n < nrows; n++) {
+        ScmObj r = read_record(s);
+        if (SCM_EOFP(r)) break;
+        SCM_APPEND1(h, t, Scm_ListToVector(r, 0, -1));
+    }
+    if (n == 0 && nrows > 0) return SCM_EOF;
+    return Scm_ListToVector(h, 0, -1);
+}
+
+/*================================================================
+ * Entry points
+ *
+ *  The port is locked during the scan, since we touch its buffer
+ *  directly.
+ */
+
+ScmObj CsvReadRecord(ScmPort *port, ScmChar sep, ScmChar quo, int shared)
+{
+    CsvScanner s;
+    ScmVM *vm = Scm_VM();
+    ScmObj r = SCM_UNDEFINED;
+
+    scanner_init(&s, port, sep, quo, shared);
+    PORT_LOCK(port, vm);
+    PORT_SAFE_CALL(port, r = read_record(&s), scan_commit(&s));
+    PORT_UNLOCK(port);
+    return r;
+}
+
+ScmObj CsvReadRecords(ScmPort *port, ScmChar sep, ScmChar quo, int shared,
+                      ScmSmallInt nrows)
+{
+    CsvScanner s;
+    ScmVM *vm = Scm_VM();
+    ScmObj r = SCM_UNDEFINED;
+
+    if (nrows < 0) Scm_Error("nrows must be a nonnegative integer: %ld",
+                             nrows);
+    scanner_init(&s, port, sep, quo, shared);
+    PORT_LOCK(port, vm);
+    PORT_SAFE_CALL(port, r = read_records(&s, nrows), scan_commit(&s));
+    PORT_UNLOCK(port);
+    return r;
+}
@@ -0,0 +1,64 @@
+/*
+ * csv.h - native CSV scanner
+ *
+ *   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef GAUCHE_TEXT_CSV_H
+#define GAUCHE_TEXT_CSV_H
+
+#include <gauche.h>
+#include <gauche/extend.h>
+
+/* The scanner works on the bytes of the port's buffer (or the body of
+   an input string port) directly, with the port locked, instead of
+   taking one character at a time.  Only the field strings are
+   allocated; if SHARED is true and the port is an input string port,
+   a field that appears verbatim in the input shares the input string
+   body instead of being copied.
+
+   The separator and the quote character must satisfy CsvNativeCharsP;
+   otherwise text.csv falls back to the reader written in Scheme.  */
+
+extern int    CsvNativeCharsP(ScmChar sep, ScmChar quo);
+
+/* Chooses the vector kernels for the CPU.  Called once at load time. */
+extern void   CsvInit(void);
+
+/* Returns a list of fields, or EOF. */
+extern ScmObj CsvReadRecord(ScmPort *port, ScmChar sep, ScmChar quo,
+                            int shared);
+
+/* Reads up to NROWS records and returns a vector of vectors of fields,
+   or EOF if no record is left. */
+extern ScmObj CsvReadRecords(ScmPort *port, ScmChar sep, ScmChar quo,
+                             int shared, ScmSmallInt nrows);
+
+#endif /*GAUCHE_TEXT_CSV_H*/
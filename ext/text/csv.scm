@@ -39,6 +39,7 @@
   (use srfi-42)
   (use gauche.sequence)
   (export make-csv-reader
+          make-csv-batch-reader
           make-csv-writer
           make-csv-header-parser
           make-csv-record-parser
@@ -50,10 +51,48 @@
 ;;;Low-level API - convert text into nested lists
 ;;;
 
+;; The native scanner handles the records when the separator and the
+;; quote character are single-byte ones.  Otherwise we use csv-reader
+;; below, which reads characters one at a time.
+(inline-stub
+ (declcode "#include \"csv.h\"")
+ (initcode "CsvInit();")
+
+ (define-cproc %csv-native-chars? (sep::<char> quo::<char>) ::<boolean>
+   (return (CsvNativeCharsP sep quo)))
+
+ (define-cproc %csv-read-record (port::<input-port> sep::<char> quo::<char>
+                                 shared::<boolean>)
+   (return (CsvReadRecord port sep quo shared)))
+
+ (define-cproc %csv-read-records (port::<input-port> sep::<char> quo::<char>
+                                  shared::<boolean> nrows::<fixnum>)
+   (return (CsvReadRecords port sep quo shared nrows)))
+ )
+
 ;; API
 (define (make-csv-reader separator :optional (quote-char #\"))
-  (^[:optional (port (current-input-port))]
-    (csv-reader separator quote-char port)))
+  (if (%csv-native-chars? separator quote-char)
+    (^[:optional (port (current-input-port))]
+      (%csv-read-record port separator quote-char #f))
+    (^[:optional (port (current-input-port))]
+      (csv-reader separator quote-char port))))
+
+;; API
+;; Returns a procedure that reads up to N records at once, as a vector
+;; of vectors of fields.  If SHARED? is true, fields read from an input
+;; string port may share the storage of the input string.
+(define (make-csv-batch-reader separator :key (quote-char #\") (shared? #f))
+  (if (%csv-native-chars? separator quote-char)
+    (^[n :optional (port (current-input-port))]
+      (%csv-read-records port separator quote-char shared? n))
+    (^[n :optional (port (current-input-port))]
+      (let loop ([k 0] [rows '()])
+        (let1 row (if (< k n) (csv-reader separator quote-char port) (eof-object))
+          (cond [(not (eof-object? row))
+                 (loop (+ k 1) (cons (list->vector row) rows))]
+                [(and (zero? k) (> n 0)) row]
+                [else (list->vector (reverse! rows))]))))))
 
 (define (csv-reader sep quo port)
   (define (eor? ch) (or (eqv? ch #\newline) (eof-object? ch)))
@@ -75,6 +75,7 @@
   (use rfc.822)   ;; message headers parsing (same syntax for .po meta-data)
   (use file.util) ;; file-is-readable?
   (use binary.io)          ;; unpacking .mo files
+  (use gauche.uvector)     ;; mapped .mo images
   (use gauche.charconv)    ;; :encoding on i/o procedures
   (use util.combinations)  ;; cartesian-product for file lists
   (export
@@ -100,6 +101,7 @@
    (properties :init-keyword :properties :initform #f :accessor properties-of)
    (type       :init-keyword :type       :initform #f :accessor type-of)
    (plural-index :init-keyword :plural-index :initform #f :accessor plural-index-of)
+   (catalog    :init-keyword :catalog    :initform #f :accessor catalog-of)
    ))
 
 (define (make-gettext-file filename locale)
@@ -241,59 +243,139 @@
                  [else (loop (read-line))])))
        :encoding encoding))))
 
-(define (lookup-mo-message file msg msg2 encoding)
-  ;;(warn "(lookup-mo-message ~S ~S ~S)" file msg encoding)
-  (and
-   (file-is-readable? file)
-   (guard (err [else (warn "error reading from file ~S: ~S" file err) #f])
-     (with-input-from-file file
-       (^[]
-         (define (search read-int)
-           (let* ([key (if msg2 (string-append msg "\0" msg2) msg)]
-                  [format (read-int)]
-                  [count (read-int)]
-                  [src-offset (read-int)]
-                  [trans-offset (read-int)]
-                  [hash-size (read-int)]
-                  [hash-offset (read-int)]
-                  [diff (- trans-offset src-offset)]
-                  [end (+ src-offset (* (- count 1) 8))])
-             (define (string-at pos)
-               (port-seek (current-input-port) pos)
-               (let* ([len (read-int)]
-                      [off (read-int)])
-                 (port-seek (current-input-port) off)
-                 ;;(warn "string-at: pos: ~S => len: ~S off: ~S" pos len off)
-                 (ces-convert (read-block len) encoding)))
-             ;;(warn "search ~S ~S ~S ~S ~S" format count src-offset trans-offset end)
-             (cond ;; check endpoints
-              [(string=? key (string-at src-offset))
-               (string-at (+ src-offset diff))]
-              [(and (> end src-offset) (string=? key (string-at end)))
-               (string-at (+ end diff))]
-              (else ;; binary search
-               (let loop ([lo 0] [hi (- count 1)])
-                 ;;(warn "(loop ~S ~S)" lo hi)
-                 (if (>= lo hi)
-                   #f
-                   (let* ([mid (+ lo (quotient (- hi lo) 2))]
-                          [pos (+ src-offset (* mid 8))]
-                          [str (string-at pos)])
-                     (cond [(string<? key str)
-                            (if (>= mid hi) #f (loop lo mid))]
-                           [(string>? key str)
-                            (if (<= mid lo) #f (loop mid hi))]
-                           [else ;; match
-                            (string-at (+ pos diff))]))))))))
-         (let1 magic (read-binary-uint32 (current-input-port) 'big-endian)
-           (case magic
-             [(#xde120495) (search (cut read-binary-uint32 #f 'little-endian))]
-             [(#x950412de) (search (cut read-binary-uint32 #f 'big-endian))]
-             [else (warn "invalid magic: ~S" magic) #f])))))))
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; the gettext .mo reader
+
+;; A .mo file is mapped into memory when it is first used, and messages
+;; are looked up in place, through the hash table in the file if it has
+;; one, or by binary search otherwise.  Only the translation found is
+;; converted to a string.  So opening a catalog costs the same no matter
+;; how large it is, and processes using the same file share its pages.
+
+(define-class <mo-catalog> ()
+  ((image        :init-keyword :image)   ; u8vector sharing the mapped file
+   (get-u32      :init-keyword :get-u32) ; get-u32le or get-u32be
+   (count        :init-keyword :count)
+   (src-offset   :init-keyword :src-offset)
+   (trans-offset :init-keyword :trans-offset)
+   (hash-size    :init-keyword :hash-size)
+   (hash-offset  :init-keyword :hash-offset)))
+
+(define (open-mo-catalog file)
+  (let* ([port (open-mapped-input-file file)]
+         [image (begin0 (port-mapped-view port) (close-input-port port))])
+    (and (>= (u8vector-length image) 28)
+         (let1 get-u32 (case (get-u32le image 0)
+                         [(#x950412de) get-u32le]
+                         [(#xde120495) get-u32be]
+                         [else #f])
+           (if get-u32
+             (make <mo-catalog>
+               :image image :get-u32 get-u32
+               :count (get-u32 image 8)
+               :src-offset (get-u32 image 12)
+               :trans-offset (get-u32 image 16)
+               :hash-size (get-u32 image 20)
+               :hash-offset (get-u32 image 24))
+             (begin (warn "invalid magic in ~S" file) #f))))))
+
+;; Returns the offset and the length of the I-th string of TABLE,
+;; which is either src-offset or trans-offset.
+(define (mo-string-ref cat table i)
+  (let ([get-u32 (~ cat'get-u32)]
+        [image (~ cat'image)]
+        [pos (+ table (* i 8))])
+    (values (get-u32 image (+ pos 4)) (get-u32 image pos))))
+
+;; Compares KEY, a u8vector, with LEN bytes at OFF of the image.
+(define (mo-compare key image off len)
+  (let1 klen (u8vector-length key)
+    (let loop ([i 0])
+      (cond [(= i klen) (if (= i len) 0 -1)]
+            [(= i len) 1]
+            [else (let ([a (u8vector-ref key i)]
+                        [b (u8vector-ref image (+ off i))])
+                    (cond [(< a b) -1]
+                          [(> a b) 1]
+                          [else (loop (+ i 1))]))]))))
+
+;; The hash function of GNU gettext (hashpjw), which stops at NUL.
+;; Only the lower 32 bits are used.
+(define (mo-hash key)
+  (let1 len (u8vector-length key)
+    (let loop ([i 0] [h 0])
+      (if (or (= i len) (zero? (u8vector-ref key i)))
+        h
+        (let* ([h (logand (+ (ash h 4) (u8vector-ref key i)) #xffffffff)]
+               [g (logand h #xf0000000)])
+          (loop (+ i 1) (if (zero? g) h (logxor h g (ash g -24)))))))))
+
+;; Returns the index of the message KEY, or #f.
+(define (mo-find cat key)
+  (define image (~ cat'image))
+  (define count (~ cat'count))
+  (define (match? i)
+    (receive (off len) (mo-string-ref cat (~ cat'src-offset) i)
+      (and (<= (+ off len) (u8vector-length image))
+           (zero? (mo-compare key image off len)))))
+  (define (hash-search size)
+    (let* ([h (mo-hash key)]
+           [incr (+ 1 (modulo h (- size 2)))])
+      (let loop ([idx (modulo h size)] [probes 0])
+        (and (< probes size)
+             (let1 n ((~ cat'get-u32) image (+ (~ cat'hash-offset) (* idx 4)))
+               (cond [(zero? n) #f]
+                     [(and (<= n count) (match? (- n 1))) (- n 1)]
+                     [else (loop (if (>= idx (- size incr))
+                                   (- idx (- size incr))
+                                   (+ idx incr))
+                                 (+ probes 1))]))))))
+  (define (binary-search)
+    (let loop ([lo 0] [hi count])
+      (and (< lo hi)
+           (let1 mid (+ lo (quotient (- hi lo) 2))
+             (receive (off len) (mo-string-ref cat (~ cat'src-offset) mid)
+               (let1 c (mo-compare key image off len)
+                 (cond [(< c 0) (loop lo mid)]
+                       [(> c 0) (loop (+ mid 1) hi)]
+                       [else mid])))))))
+  (let1 size (~ cat'hash-size)
+    (if (> size 2) (hash-search size) (binary-search))))
+
+;; The msgids are compared as bytes in the encoding of the file.
+(define (mo-key msg msg2 encoding)
+  (let1 key (if msg2 (string-append msg "\0" msg2) msg)
+    (string->u8vector
+     (if (or (string-every (^c (char<? c #\x80)) key)
+             (not (ces-conversion-supported? (gauche-character-encoding)
+                                             encoding)))
+       key
+       (ces-convert key (gauche-character-encoding) encoding)))))
+
+(define (gettext-file-catalog gfile)
+  (let1 cat (catalog-of gfile)
+    (if (not cat)
+      (rlet1 cat (guard (err [else (warn "error mapping file ~S: ~S"
+                                         (filename-of gfile) err)
+                                   #f])
+                   (open-mo-catalog (filename-of gfile)))
+        (set! (catalog-of gfile) (or cat 'none)))
+      (and (is-a? cat <mo-catalog>) cat))))
+
+(define (lookup-mo-message gfile msg msg2 encoding)
+  (and-let* ([cat (gettext-file-catalog gfile)])
+    (guard (err [else (warn "error reading from file ~S: ~S"
+                            (filename-of gfile) err)
+                      #f])
+      (and-let* ([i (mo-find cat (mo-key msg msg2 encoding))])
+        (receive (off len) (mo-string-ref cat (~ cat'trans-offset) i)
+          (ces-convert (u8vector->string (~ cat'image) off (+ off len))
+                       encoding))))))
 
 (define (lookup-message gfile msg msg2 :optional (encoding (encoding-of gfile)))
-  ((if (eq? (type-of gfile) 'mo) lookup-mo-message lookup-po-message)
-   (filename-of gfile) msg msg2 encoding))
+  (if (eq? (type-of gfile) 'mo)
+    (lookup-mo-message gfile msg msg2 encoding)
+    (lookup-po-message (filename-of gfile) msg msg2 encoding)))
 
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 ;; the subset C parser for ngettext plural forms
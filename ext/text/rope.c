@@ -0,0 +1,278 @@
+/*
+ * rope.c - immutable chunked strings
+ *
+ *   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "rope.h"
+#include <string.h>
+
+static Rope *empty_rope = NULL;
+
+static Rope *make_leaf(ScmString *s)
+{
+    if (!SCM_STRING_IMMUTABLE_P(s)) {
+        /* Shares the body; later string-set! on S doesn't affect us. */
+        s = SCM_STRING(Scm_CopyStringWithFlags(s, SCM_STRING_IMMUTABLE,
+                                               SCM_STRING_IMMUTABLE));
+    }
+    const ScmStringBody *b = SCM_STRING_BODY(s);
+    ScmSmallInt size = SCM_STRING_BODY_SIZE(b);
+    if (size == 0 && empty_rope) return empty_rope;
+    Rope *r = SCM_NEW(Rope);
+    SCM_SET_CLASS(r, SCM_CLASS_ROPE);
+    r->left = r->right = NULL;
+    r->str = s;
+    r->size = size;
+    r->length = SCM_STRING_BODY_LENGTH(b);
+    r->height = 0;
+    r->incomplete = SCM_STRING_BODY_INCOMPLETE_P(b);
+    return r;
+}
+
+static Rope *make_node(Rope *a, Rope *b)
+{
+    Rope *r = SCM_NEW(Rope);
+    SCM_SET_CLASS(r, SCM_CLASS_ROPE);
+    r->left = a;
+    r->right = b;
+    r->str = NULL;
+    r->size = a->size + b->size;
+    r->length = a->length + b->length;
+    r->height = (a->height > b->height ? a->height : b->height) + 1;
+    r->incomplete = a->incomplete || b->incomplete;
+    return r;
+}
+
+static Rope *merge_leaves(Rope *a, Rope *b)
+{
+    return make_leaf(SCM_STRING(Scm_StringAppend2(a->str, b->str)));
+}
+
+#define SMALL_PAIR_P(a, b) \
+    ((a)->height == 0 && (b)->height == 0 \
+     && (a)->size + (b)->size <= ROPE_LEAF_MAX)
+
+/* Makes a node of L and R, whose heights differ at most by 2, with
+   a single or double rotation if needed. */
+static Rope *balance(Rope *l, Rope *r)
+{
+    if (l->height > r->height + 1) {
+        if (l->left->height >= l->right->height) {
+            return make_node(l->left, make_node(l->right, r));
+        } else {
+            return make_node(make_node(l->left, l->right->left),
+                             make_node(l->right->right, r));
+        }
+    }
+    if (r->height > l->height + 1) {
+        if (r->right->height >= r->left->height) {
+            return make_node(make_node(l, r->left), r->right);
+        } else {
+            return make_node(make_node(l, r->left->left),
+                             make_node(r->left->right, r->right));
+        }
+    }
+    return make_node(l, r);
+}
+
+/* Joins two AVL trees.  We go down along the edge of the taller one
+   until we find a subtree of the same height as the other, so this
+   takes O(|height(a) - height(b)|). */
+static Rope *concat(Rope *a, Rope *b)
+{
+    if (a->size == 0) return b;
+    if (b->size == 0) return a;
+    if (SMALL_PAIR_P(a, b)) return merge_leaves(a, b);
+    if (a->height > b->height + 1) return balance(a->left, concat(a->right, b));
+    if (b->height > a->height + 1) return balance(concat(a, b->left), b->right);
+    /* Merge a small chunk into the adjacent one if possible. */
+    if (a->height > 0 && SMALL_PAIR_P(a->right, b)) {
+        return balance(a->left, merge_leaves(a->right, b));
+    }
+    if (b->height > 0 && SMALL_PAIR_P(a, b->left)) {
+        return balance(merge_leaves(a, b->left), b->right);
+    }
+    return make_node(a, b);
+}
+
+Rope *RopeFrom(ScmObj obj)
+{
+    if (ROPE_P(obj)) return ROPE(obj);
+    if (SCM_STRINGP(obj)) return make_leaf(SCM_STRING(obj));
+    if (SCM_CHARP(obj)) {
+        return make_leaf(SCM_STRING(Scm_MakeFillString(1, SCM_CHAR_VALUE(obj))));
+    }
+    Scm_Error("rope, string or character required, but got %S", obj);
+    return NULL;                /* dummy */
+}
+
+Rope *RopeAppend(Rope *a, Rope *b)
+{
+    return concat(a, b);
+}
+
+static Rope *concat_range(ScmObj *v, ScmSmallInt start, ScmSmallInt end)
+{
+    if (end - start == 0) return empty_rope;
+    if (end - start == 1) return RopeFrom(v[start]);
+    ScmSmallInt mid = start + (end - start)/2;
+    return concat(concat_range(v, start, mid), concat_range(v, mid, end));
+}
+
+/* Concatenating halves recursively gives a balanced tree in O(n),
+   instead of O(n log n) by appending one by one. */
+Rope *RopeConcatenate(ScmObj objs)
+{
+    ScmSmallInt n = Scm_Length(objs);
+    if (n < 0) Scm_Error("proper list required, but got %S", objs);
+    ScmObj *v = SCM_NEW_ARRAY(ScmObj, n), cp;
+    ScmSmallInt i = 0;
+    SCM_FOR_EACH(cp, objs) v[i++] = SCM_CAR(cp);
+    return concat_range(v, 0, n);
+}
+
+static Rope *substring(Rope *r, ScmSmallInt start, ScmSmallInt end)
+{
+    if (start == 0 && end == r->length) return r;
+    if (start >= end) return empty_rope;
+    if (r->height == 0) {
+        return make_leaf(SCM_STRING(Scm_Substring(r->str, start, end, FALSE)));
+    }
+    ScmSmallInt llen = r->left->length;
+    if (end <= llen) return substring(r->left, start, end);
+    if (start >= llen) return substring(r->right, start - llen, end - llen);
+    return concat(substring(r->left, start, llen),
+                  substring(r->right, 0, end - llen));
+}
+
+Rope *RopeSubstring(Rope *r, ScmSmallInt start, ScmSmallInt end)
+{
+    if (end < 0) end = r->length;
+    if (start < 0 || start > r->length || end > r->length || start > end) {
+        Scm_Error("rope index out of range: [%ld, %ld)", start, end);
+    }
+    return substring(r, start, end);
+}
+
+ScmChar RopeRef(Rope *r, ScmSmallInt k)
+{
+    if (k < 0 || k >= r->length) {
+        Scm_Error("rope index out of range: %ld", k);
+    }
+    while (r->height > 0) {
+        if (r->str) return Scm_StringRef(r->str, k, TRUE);
+        if (k < r->left->length) {
+            r = r->left;
+        } else {
+            k -= r->left->length;
+            r = r->right;
+        }
+    }
+    return Scm_StringRef(r->str, k, TRUE);
+}
+
+static char *copy_chunks(Rope *r, char *dst)
+{
+    while (r->height > 0 && r->str == NULL) {
+        dst = copy_chunks(r->left, dst);
+        r = r->right;
+    }
+    memcpy(dst, SCM_STRING_BODY_START(SCM_STRING_BODY(r->str)), r->size);
+    return dst + r->size;
+}
+
+ScmString *RopeToString(Rope *r)
+{
+    if (r->str == NULL) {
+        char *buf = SCM_NEW_ATOMIC2(char*, r->size + 1);
+        copy_chunks(r, buf);
+        buf[r->size] = '\0';
+        int flags = SCM_STRING_IMMUTABLE;
+        if (r->incomplete) flags |= SCM_STRING_INCOMPLETE;
+        /* Benign race; another thread may set the same content. */
+        r->str = SCM_STRING(Scm_MakeString(buf, r->size, r->length, flags));
+    }
+    return r->str;
+}
+
+static void collect_chunks(Rope *r, ScmObj *h, ScmObj *t)
+{
+    while (r->height > 0) {
+        collect_chunks(r->left, h, t);
+        r = r->right;
+    }
+    if (r->size > 0) SCM_APPEND1(*h, *t, SCM_OBJ(r->str));
+}
+
+ScmObj RopeChunks(Rope *r)
+{
+    ScmObj h = SCM_NIL, t = SCM_NIL;
+    collect_chunks(r, &h, &t);
+    return h;
+}
+
+void RopeWrite(Rope *r, ScmPort *port)
+{
+    while (r->height > 0 && r->str == NULL) {
+        RopeWrite(r->left, port);
+        r = r->right;
+    }
+    if (r->size > 0) {
+        Scm_Putz(SCM_STRING_BODY_START(SCM_STRING_BODY(r->str)),
+                 (int)r->size, port);
+    }
+}
+
+static void rope_print(ScmObj obj, ScmPort *port, ScmWriteContext *ctx)
+{
+    if (Scm_WriteContextMode(ctx) == SCM_WRITE_DISPLAY) {
+        RopeWrite(ROPE(obj), port);
+    } else {
+        Scm_Printf(port, "#<rope %S>", SCM_OBJ(RopeToString(ROPE(obj))));
+    }
+}
+
+static int rope_compare(ScmObj x, ScmObj y, int equalp)
+{
+    Rope *a = ROPE(x), *b = ROPE(y);
+    if (equalp && (a->size != b->size || a->length != b->length)) return 1;
+    return Scm_StringCmp(RopeToString(a), RopeToString(b));
+}
+
+SCM_DEFINE_BUILTIN_CLASS(Scm_RopeClass,
+                         rope_print, rope_compare, NULL, NULL,
+                         SCM_CLASS_DEFAULT_CPL);
+
+void Scm_Init_rope(ScmModule *mod)
+{
+    Scm_InitStaticClass(&Scm_RopeClass, "<rope>", mod, NULL, 0);
+    empty_rope = make_leaf(SCM_STRING(SCM_MAKE_STR_IMMUTABLE("")));
+}
@@ -0,0 +1,87 @@
+/*
+ * rope.h - immutable chunked strings
+ *
+ *   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef GAUCHE_TEXT_ROPE_H
+#define GAUCHE_TEXT_ROPE_H
+
+#include <gauche.h>
+#include <gauche/extend.h>
+
+/* A rope is an immutable string represented as a balanced binary tree
+ * whose leaves are ordinary strings (chunks).  Concatenation and
+ * substring create O(log n) new nodes and share the rest, so building
+ * a large text piece by piece doesn't copy what's already been built.
+ *
+ * The tree is kept AVL-balanced.  Small adjacent chunks are merged
+ * into one as long as the result fits in ROPE_LEAF_MAX bytes, so that
+ * appending characters one at a time doesn't produce a node per
+ * character.
+ *
+ * A rope is flattened into a string only when it is asked for, and
+ * the result is cached in the node.  Writing a rope to a port feeds the
+ * chunks to the port one by one without flattening.
+ */
+
+#define ROPE_LEAF_MAX  512
+
+typedef struct RopeRec {
+    SCM_HEADER;
+    struct RopeRec *left;       /* NULL if this is a leaf */
+    struct RopeRec *right;
+    ScmString *str;             /* leaf: the chunk.
+                                   node: flattened string, or NULL */
+    ScmSmallInt size;           /* # of bytes */
+    ScmSmallInt length;         /* # of characters */
+    int height;                 /* 0 for a leaf */
+    int incomplete;             /* TRUE if any chunk is incomplete */
+} Rope;
+
+SCM_CLASS_DECL(Scm_RopeClass);
+#define SCM_CLASS_ROPE   (&Scm_RopeClass)
+#define ROPE(obj)        ((Rope*)(obj))
+#define ROPE_P(obj)      SCM_XTYPEP(obj, SCM_CLASS_ROPE)
+
+/* OBJ may be a rope, a string or a character. */
+extern Rope      *RopeFrom(ScmObj obj);
+extern Rope      *RopeAppend(Rope *a, Rope *b);
+extern Rope      *RopeConcatenate(ScmObj objs);
+extern Rope      *RopeSubstring(Rope *r, ScmSmallInt start, ScmSmallInt end);
+extern ScmChar    RopeRef(Rope *r, ScmSmallInt k);
+extern ScmString *RopeToString(Rope *r);
+extern ScmObj     RopeChunks(Rope *r);
+extern void       RopeWrite(Rope *r, ScmPort *port);
+
+extern void Scm_Init_rope(ScmModule *mod);
+
+#endif /*GAUCHE_TEXT_ROPE_H*/
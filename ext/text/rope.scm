@@ -0,0 +1,81 @@
+;;;
+;;; rope.scm - immutable chunked strings
+;;;
+;;;   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+;;;
+;;;   Redistribution and use in source and binary forms, with or without
+;;;   modification, are permitted provided that the following conditions
+;;;   are met:
+;;;
+;;;   1. Redistributions of source code must retain the above copyright
+;;;      notice, this list of conditions and the following disclaimer.
+;;;
+;;;   2. Redistributions in binary form must reproduce the above copyright
+;;;      notice, this list of conditions and the following disclaimer in the
+;;;      documentation and/or other materials provided with the distribution.
+;;;
+;;;   3. Neither the name of the authors nor the names of its contributors
+;;;      may be used to endorse or promote products derived from this
+;;;      software without specific prior written permission.
+;;;
+;;;   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+;;;   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+;;;   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+;;;   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+;;;   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+;;;   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+;;;   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+;;;   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+;;;   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+;;;   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+;;;   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+;;;
+
+(define-module text.rope
+  (export <rope> rope? string->rope rope->string
+          rope-append rope-concatenate rope-length rope-size
+          rope-ref rope-substring rope-chunks write-rope)
+  )
+(select-module text.rope)
+
+(inline-stub
+ (declcode "#include \"rope.h\"")
+ (initcode "Scm_Init_rope(Scm_CurrentModule());")
+
+ (define-type <rope> "Rope*" "rope" "ROPE_P" "ROPE")
+
+ (define-cproc rope? (obj) ::<boolean> ROPE_P)
+
+ (define-cproc string->rope (s::<string>)
+   (return (SCM_OBJ (RopeFrom (SCM_OBJ s)))))
+
+ (define-cproc rope->string (r::<rope>)
+   (return (SCM_OBJ (RopeToString r))))
+
+ (define-cproc rope-append (:rest objs)
+   (return (SCM_OBJ (RopeConcatenate objs))))
+
+ (define-cproc rope-concatenate (objs::<list>)
+   (return (SCM_OBJ (RopeConcatenate objs))))
+
+ (define-cproc rope-length (r::<rope>) ::<fixnum> (return (-> r length)))
+ (define-cproc rope-size (r::<rope>) ::<fixnum> (return (-> r size)))
+
+ (define-cproc rope-ref (r::<rope> k::<fixnum>) ::<char>
+   (return (RopeRef r k)))
+
+ (define-cproc rope-substring (r::<rope> start::<fixnum>
+                               :optional (end::<fixnum> -1))
+   (return (SCM_OBJ (RopeSubstring r start end))))
+
+ (define-cproc rope-chunks (r::<rope>) (return (RopeChunks r)))
+
+ (define-cproc write-rope (r::<rope> :optional (port::<output-port>
+                                                 (current-output-port)))
+   ::<void>
+   (RopeWrite r port))
+ )
+
+;; The default method goes through display, which works too, but
+;; the flattened string is cached in the rope.
+(define-method x->string ((r <rope>)) (rope->string r))
@@ -1,5 +1,6 @@
 (use gauche.test)
 (use gauche.charconv)
+(use gauche.uvector)
 
 (add-load-path "../../test")
 (define *test-locale-dirs* '("../../test/data/locale"))
@@ -64,5 +65,24 @@
               (assoc-ref *tests* locale)))
   )
 
+;; .mo files are searched through their hash table; binary search is
+;; used when it's missing.  Both must find every message.
+(test-section "mo catalog")
+(let1 cat ((with-module text.gettext open-mo-catalog)
+           "../../test/data/locale/ja/LC_MESSAGES/motest.mo")
+  (define mo-find (with-module text.gettext mo-find))
+  (define (msgid i)
+    (receive (off len) ((with-module text.gettext mo-string-ref)
+                        cat (~ cat'src-offset) i)
+      (u8vector-copy (~ cat'image) off (+ off len))))
+  (define ids (map msgid (iota (~ cat'count))))
+  (test* "hash search" (iota (~ cat'count)) (map (cut mo-find cat <>) ids))
+  (test* "hash search (missing)" #f
+         (mo-find cat (string->u8vector "no such message")))
+  (set! (~ cat'hash-size) 0)
+  (test* "binary search" (iota (~ cat'count)) (map (cut mo-find cat <>) ids))
+  (test* "binary search (missing)" #f
+         (mo-find cat (string->u8vector "no such message"))))
+
 (test-end)
 
@@ -87,4 +87,19 @@
 (test* "escape in spec" "*ello, World!"
        (string-tr "Hello,-World!" "A\\-H" "_ \\*"))
 
+;; cached tables and the single-byte fast path
+(test* "same specs again" "hELLO, wORLD!"
+       (string-tr "Hello, World!" "A-Za-z" "a-zA-Z"))
+(test* "same specs, different options" "ello, orld!"
+       (string-tr "Hello, World!" "A-Z" "" :delete #t))
+(test* "mutated spec string" '("HELLO" "GDKKN")
+       (let1 from (string-copy "a-z")
+         (let1 r1 (string-tr "hello" from "A-Z")
+           (string-set! from 0 #\b)
+           (list r1 (string-tr "hello" from "A-Z")))))
+(test* "long unmapped run" (string-append (make-string 1000 #\.) "X")
+       (string-tr (string-append (make-string 1000 #\.) "x") "x" "X"))
+(test* "several ranges, table-size" "ABXYZq"
+       (string-tr "abxyzq" "a-cx-z" "A-CX-Z" :table-size 2))
+
 (test-end)
@@ -0,0 +1,165 @@
+/*
+ * atomic.c - atomic boxes
+ *
+ *   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <gauche.h>
+#include <gauche/class.h>
+#include "threads.h"
+
+/*=====================================================
+ * Atomic boxes
+ *
+ *  Every update is a CAS loop, so that we only rely on
+ *  AO_compare_and_swap_full, which libatomic_ops provides on
+ *  all platforms (emulated by pthreads if necessary).
+ *  An atomic box holds a pointer to the Scheme object, which is
+ *  visible to the conservative GC as it is.
+ */
+
+static void abox_print(ScmObj obj, ScmPort *port, ScmWriteContext *ctx);
+static void afix_print(ScmObj obj, ScmPort *port, ScmWriteContext *ctx);
+
+SCM_DEFINE_BUILTIN_CLASS_SIMPLE(Scm_AtomicBoxClass, abox_print);
+SCM_DEFINE_BUILTIN_CLASS_SIMPLE(Scm_AtomicFixnumClass, afix_print);
+
+static void abox_print(ScmObj obj, ScmPort *port, ScmWriteContext *ctx)
+{
+    Scm_Printf(port, "#<atomic-box %S>",
+               Scm_AtomicBoxRef(SCM_ATOMIC_BOX(obj)));
+}
+
+static void afix_print(ScmObj obj, ScmPort *port, ScmWriteContext *ctx)
+{
+    Scm_Printf(port, "#<atomic-fixnum %ld>",
+               Scm_AtomicFixnumRef(SCM_ATOMIC_FIXNUM(obj)));
+}
+
+/* Returns the old value */
+static AO_t swap(volatile AO_t *loc, AO_t val)
+{
+    for (;;) {
+        AO_t old = AO_load_full(loc);
+        if (AO_compare_and_swap_full(loc, old, val)) return old;
+    }
+}
+
+/* Returns the old value; the swap is done iff it equals EXPECTED. */
+static AO_t compare_and_swap(volatile AO_t *loc, AO_t expected, AO_t val)
+{
+    for (;;) {
+        if (AO_compare_and_swap_full(loc, expected, val)) return expected;
+        AO_t old = AO_load_full(loc);
+        if (old != expected) return old;
+    }
+}
+
+ScmObj Scm_MakeAtomicBox(ScmObj value)
+{
+    ScmAtomicBox *b = SCM_NEW(ScmAtomicBox);
+    SCM_SET_CLASS(b, SCM_CLASS_ATOMIC_BOX);
+    AO_store_full(&b->value, (AO_t)value);
+    return SCM_OBJ(b);
+}
+
+ScmObj Scm_AtomicBoxRef(ScmAtomicBox *box)
+{
+    return SCM_OBJ(AO_load_full(&box->value));
+}
+
+void Scm_AtomicBoxSet(ScmAtomicBox *box, ScmObj value)
+{
+    AO_store_full(&box->value, (AO_t)value);
+}
+
+ScmObj Scm_AtomicBoxSwap(ScmAtomicBox *box, ScmObj value)
+{
+    return SCM_OBJ(swap(&box->value, (AO_t)value));
+}
+
+ScmObj Scm_AtomicBoxCompareAndSwap(ScmAtomicBox *box,
+                                   ScmObj expected, ScmObj value)
+{
+    return SCM_OBJ(compare_and_swap(&box->value, (AO_t)expected,
+                                    (AO_t)value));
+}
+
+ScmObj Scm_MakeAtomicFixnum(long value)
+{
+    ScmAtomicBox *b = SCM_NEW_ATOMIC(ScmAtomicBox);
+    SCM_SET_CLASS(b, SCM_CLASS_ATOMIC_FIXNUM);
+    AO_store_full(&b->value, (AO_t)value);
+    return SCM_OBJ(b);
+}
+
+long Scm_AtomicFixnumRef(ScmAtomicBox *box)
+{
+    return (long)AO_load_full(&box->value);
+}
+
+void Scm_AtomicFixnumSet(ScmAtomicBox *box, long value)
+{
+    AO_store_full(&box->value, (AO_t)value);
+}
+
+long Scm_AtomicFixnumSwap(ScmAtomicBox *box, long value)
+{
+    return (long)swap(&box->value, (AO_t)value);
+}
+
+long Scm_AtomicFixnumCompareAndSwap(ScmAtomicBox *box,
+                                    long expected, long value)
+{
+    return (long)compare_and_swap(&box->value, (AO_t)expected, (AO_t)value);
+}
+
+/* Returns the old value.  Wraps around on overflow, as C arithmetic
+   on AO_t does. */
+long Scm_AtomicFixnumAdd(ScmAtomicBox *box, long delta)
+{
+    for (;;) {
+        AO_t old = AO_load_full(&box->value);
+        if (AO_compare_and_swap_full(&box->value, old, old + (AO_t)delta)) {
+            return (long)old;
+        }
+    }
+}
+
+/*
+ * Initialization
+ */
+
+void Scm_Init_atomic(ScmModule *mod)
+{
+    Scm_InitStaticClass(&Scm_AtomicBoxClass, "<atomic-box>", mod, NULL, 0);
+    Scm_InitStaticClass(&Scm_AtomicFixnumClass, "<atomic-fixnum>",
+                        mod, NULL, 0);
+}
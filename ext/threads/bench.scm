@@ -0,0 +1,55 @@
+;;
+;; Allocation throughput with multiple threads.
+;;
+;;  gosh -I. -I../../src -I../../lib bench.scm [max-threads]
+;;
+;; Each thread conses the same number of short lists.  With the
+;; thread-local free lists of GC, the throughput should grow with the
+;; number of threads, up to the number of processors.
+;;
+
+(add-load-path ".")
+
+(use gauche.threads)
+(use gauche.time)
+(use srfi-1)
+
+(define *lists-per-thread* 200000)
+(define *list-length* 10)
+
+(define (cons-lists)
+  (let loop ([i 0] [r '()])
+    (if (= i *lists-per-thread*)
+      (length r)
+      (loop (+ i 1)
+            (if (zero? (modulo i 1000))
+              '()
+              (cons (make-list *list-length* i) r))))))
+
+(define (round-to x k) (/. (round (* x k)) k))
+
+(define (elapsed nthreads)
+  (let1 t0 (current-time)
+    (for-each thread-join!
+              (list-tabulate nthreads
+                             (^_ (thread-start! (make-thread cons-lists)))))
+    (let1 d (time-difference (current-time) t0)
+      (+ (time-second d) (/. (time-nanosecond d) 1e9)))))
+
+(define (main args)
+  (let* ([max-threads (if (pair? (cdr args))
+                        (string->number (cadr args))
+                        (max 1 (sys-available-processors)))]
+         [conses (* *lists-per-thread* (+ *list-length* 1))])
+    (format #t "~7a ~10a ~16a ~a\n" "threads" "seconds" "conses/sec" "speedup")
+    (let loop ([n 1] [base #f])
+      (when (<= n max-threads)
+        (gc)
+        (let* ([sec (elapsed n)]
+               [rate (/. (* n conses) sec)]
+               [base (or base rate)])
+          (format #t "~7d ~10a ~16d ~a\n"
+                  n (round-to sec 1000) (round->exact rate)
+                  (round-to (/. rate base) 100))
+          (loop (* n 2) base)))))
+  0)
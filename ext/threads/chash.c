@@ -0,0 +1,271 @@
+/*
+ * chash.c - Concurrent hash table
+ *
+ *
+ *   Copyright (c) 2000-2015  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <gauche.h>
+#include <gauche/class.h>
+#include "threads.h"
+
+/*=====================================================
+ * Concurrent hash table
+ *
+ *  The table is split into stripes, each of which is an ordinary
+ *  ScmHashCore protected by its own mutex.  A key always goes to the
+ *  same stripe, so operations on keys in different stripes don't
+ *  contend.  The stripe is chosen from a remixed hash value, so that
+ *  the keys within a stripe still spread over its buckets.
+ *
+ *  No entry pointer escapes from the lock; hence we can let the cores
+ *  rehash freely.
+ */
+
+static void chash_print(ScmObj obj, ScmPort *port, ScmWriteContext *ctx);
+
+SCM_DEFINE_BUILTIN_CLASS_SIMPLE(Scm_ConcurrentHashTableClass, chash_print);
+
+#define DEFAULT_NUM_STRIPES 16
+#define MAX_NUM_STRIPES     1024
+
+static void chash_finalize(ScmObj obj, void *data)
+{
+    ScmConcurrentHashTable *ht = SCM_CONCURRENT_HASH_TABLE(obj);
+    for (int i=0; i<ht->numStripes; i++) {
+        SCM_INTERNAL_MUTEX_DESTROY(ht->stripes[i].mutex);
+    }
+}
+
+ScmObj Scm_MakeConcurrentHashTable(ScmHashType type, int numStripes)
+{
+    switch (type) {
+    case SCM_HASH_EQ: case SCM_HASH_EQV:
+    case SCM_HASH_EQUAL: case SCM_HASH_STRING:
+        break;
+    default:
+        Scm_Error("unsupported hash type for concurrent hash table: %d", type);
+    }
+    if (numStripes <= 0) numStripes = DEFAULT_NUM_STRIPES;
+    if (numStripes > MAX_NUM_STRIPES) numStripes = MAX_NUM_STRIPES;
+    int bits = 0;
+    while ((1 << bits) < numStripes) bits++;
+    numStripes = 1 << bits;
+
+    ScmConcurrentHashTable *ht = SCM_NEW(ScmConcurrentHashTable);
+    SCM_SET_CLASS(ht, SCM_CLASS_CONCURRENT_HASH_TABLE);
+    ht->type = type;
+    ht->numStripes = numStripes;
+    ht->stripeBits = bits;
+    ht->stripes = SCM_NEW_ARRAY(ScmConcurrentHashStripe, numStripes);
+    for (int i=0; i<numStripes; i++) {
+        SCM_INTERNAL_MUTEX_INIT(ht->stripes[i].mutex);
+        Scm_HashCoreInitSimple(&ht->stripes[i].core, type, 0, NULL);
+    }
+    ScmHashCompareProc *cmpfn;  /* dummy */
+    (void)Scm_HashCoreTypeToProcs(type, &ht->hashfn, &cmpfn);
+    Scm_RegisterFinalizer(SCM_OBJ(ht), chash_finalize, NULL);
+    return SCM_OBJ(ht);
+}
+
+static ScmConcurrentHashStripe *get_stripe(ScmConcurrentHashTable *ht,
+                                           ScmObj key)
+{
+    if (ht->type == SCM_HASH_STRING && !SCM_STRINGP(key)) {
+        Scm_Error("Got non-string key %S to the string hashtable.", key);
+    }
+    /* Equal hash may call back Scheme; we do it outside of the lock. */
+    u_long h = ht->hashfn(&ht->stripes[0].core, (intptr_t)key);
+    u_int  s = (u_int)((h ^ (h >> 16)) * 2654435761UL) & 0xffffffffUL;
+    return &ht->stripes[ht->stripeBits ? (s >> (32 - ht->stripeBits)) : 0];
+}
+
+/* Run BODY with the stripe locked.  For equal? tables, the core may
+   call back to Scheme and throw an error, so we need a guard. */
+#define WITH_STRIPE_LOCKED(ht, stripe, body)                    \
+    do {                                                        \
+        (void)SCM_INTERNAL_MUTEX_LOCK((stripe)->mutex);         \
+        if ((ht)->type == SCM_HASH_EQUAL) {                     \
+            SCM_UNWIND_PROTECT { body; }                        \
+            SCM_WHEN_ERROR {                                    \
+                (void)SCM_INTERNAL_MUTEX_UNLOCK((stripe)->mutex); \
+                SCM_NEXT_HANDLER;                               \
+            } SCM_END_PROTECT;                                  \
+        } else {                                                \
+            body;                                               \
+        }                                                       \
+        (void)SCM_INTERNAL_MUTEX_UNLOCK((stripe)->mutex);       \
+    } while (0)
+
+ScmObj Scm_ConcurrentHashTableRef(ScmConcurrentHashTable *ht,
+                                  ScmObj key, ScmObj fallback)
+{
+    ScmConcurrentHashStripe *st = get_stripe(ht, key);
+    ScmObj r = fallback;
+    WITH_STRIPE_LOCKED(ht, st, {
+            ScmDictEntry *e = Scm_HashCoreSearch(&st->core, (intptr_t)key,
+                                                 SCM_DICT_GET);
+            if (e) r = SCM_DICT_VALUE(e);
+        });
+    return r;
+}
+
+ScmObj Scm_ConcurrentHashTableSet(ScmConcurrentHashTable *ht,
+                                  ScmObj key, ScmObj value)
+{
+    ScmConcurrentHashStripe *st = get_stripe(ht, key);
+    WITH_STRIPE_LOCKED(ht, st, {
+            ScmDictEntry *e = Scm_HashCoreSearch(&st->core, (intptr_t)key,
+                                                 SCM_DICT_CREATE);
+            (void)SCM_DICT_SET_VALUE(e, value);
+        });
+    return value;
+}
+
+int Scm_ConcurrentHashTableDelete(ScmConcurrentHashTable *ht, ScmObj key)
+{
+    ScmConcurrentHashStripe *st = get_stripe(ht, key);
+    int found = FALSE;
+    WITH_STRIPE_LOCKED(ht, st, {
+            found = (Scm_HashCoreSearch(&st->core, (intptr_t)key,
+                                        SCM_DICT_DELETE) != NULL);
+        });
+    return found;
+}
+
+/* Conses VALUE onto the current value of KEY, or '() if KEY doesn't
+   exist.  Returns the new value. */
+ScmObj Scm_ConcurrentHashTablePush(ScmConcurrentHashTable *ht,
+                                   ScmObj key, ScmObj value)
+{
+    ScmConcurrentHashStripe *st = get_stripe(ht, key);
+    ScmObj cell = Scm_Cons(value, SCM_NIL);   /* allocate outside the lock */
+    WITH_STRIPE_LOCKED(ht, st, {
+            ScmDictEntry *e = Scm_HashCoreSearch(&st->core, (intptr_t)key,
+                                                 SCM_DICT_CREATE);
+            if (e->value) SCM_SET_CDR(cell, SCM_DICT_VALUE(e));
+            (void)SCM_DICT_SET_VALUE(e, cell);
+        });
+    return cell;
+}
+
+/* If the current value of KEY is eq? to EXPECTED, replace it with
+   NEWVAL and returns TRUE.  Otherwise returns FALSE.  If KEY doesn't
+   exist, its current value is regarded as ABSENT; pass SCM_UNBOUND
+   to make the operation fail on a missing key. */
+int Scm_ConcurrentHashTableCompareAndSwap(ScmConcurrentHashTable *ht,
+                                          ScmObj key, ScmObj expected,
+                                          ScmObj newval, ScmObj absent)
+{
+    ScmConcurrentHashStripe *st = get_stripe(ht, key);
+    int swapped = FALSE;
+    WITH_STRIPE_LOCKED(ht, st, {
+            ScmDictOp op = SCM_UNBOUNDP(absent)? SCM_DICT_GET : SCM_DICT_CREATE;
+            ScmDictEntry *e = Scm_HashCoreSearch(&st->core, (intptr_t)key, op);
+            if (e) {
+                ScmObj cur = e->value? SCM_DICT_VALUE(e) : absent;
+                if (SCM_EQ(cur, expected)) {
+                    (void)SCM_DICT_SET_VALUE(e, newval);
+                    swapped = TRUE;
+                } else if (!e->value) {
+                    /* we created the entry; undo it. */
+                    Scm_HashCoreSearch(&st->core, (intptr_t)key,
+                                       SCM_DICT_DELETE);
+                }
+            }
+        });
+    return swapped;
+}
+
+int Scm_ConcurrentHashTableNumEntries(ScmConcurrentHashTable *ht)
+{
+    int n = 0;
+    for (int i=0; i<ht->numStripes; i++) {
+        ScmConcurrentHashStripe *st = &ht->stripes[i];
+        (void)SCM_INTERNAL_MUTEX_LOCK(st->mutex);
+        n += Scm_HashCoreNumEntries(&st->core);
+        (void)SCM_INTERNAL_MUTEX_UNLOCK(st->mutex);
+    }
+    return n;
+}
+
+void Scm_ConcurrentHashTableClear(ScmConcurrentHashTable *ht)
+{
+    for (int i=0; i<ht->numStripes; i++) {
+        ScmConcurrentHashStripe *st = &ht->stripes[i];
+        (void)SCM_INTERNAL_MUTEX_LOCK(st->mutex);
+        Scm_HashCoreClear(&st->core);
+        (void)SCM_INTERNAL_MUTEX_UNLOCK(st->mutex);
+    }
+}
+
+/* Returns an alist of the entries.  Each stripe is snapshotted
+   atomically, but the table as a whole is not. */
+ScmObj Scm_ConcurrentHashTableToAlist(ScmConcurrentHashTable *ht)
+{
+    ScmObj h = SCM_NIL, t = SCM_NIL;
+    for (int i=0; i<ht->numStripes; i++) {
+        ScmConcurrentHashStripe *st = &ht->stripes[i];
+        ScmHashIter iter;
+        ScmDictEntry *e;
+        (void)SCM_INTERNAL_MUTEX_LOCK(st->mutex);
+        Scm_HashIterInit(&iter, &st->core);
+        while ((e = Scm_HashIterNext(&iter)) != NULL) {
+            SCM_APPEND1(h, t, Scm_Cons(SCM_DICT_KEY(e), SCM_DICT_VALUE(e)));
+        }
+        (void)SCM_INTERNAL_MUTEX_UNLOCK(st->mutex);
+    }
+    return h;
+}
+
+static void chash_print(ScmObj obj, ScmPort *port, ScmWriteContext *ctx)
+{
+    ScmConcurrentHashTable *ht = SCM_CONCURRENT_HASH_TABLE(obj);
+    const char *type = "";
+    switch (ht->type) {
+    case SCM_HASH_EQ:     type = "eq?"; break;
+    case SCM_HASH_EQV:    type = "eqv?"; break;
+    case SCM_HASH_EQUAL:  type = "equal?"; break;
+    case SCM_HASH_STRING: type = "string=?"; break;
+    default: break;
+    }
+    Scm_Printf(port, "#<concurrent-hash-table %s %p>", type, ht);
+}
+
+/*
+ * Initialization
+ */
+
+void Scm_Init_chash(ScmModule *mod)
+{
+    Scm_InitStaticClass(&Scm_ConcurrentHashTableClass,
+                        "<concurrent-hash-table>", mod, NULL, 0);
+}
@@ -67,18 +67,30 @@ static ScmObj mutex_allocate(ScmClass *klass, ScmObj initargs)
     Scm_RegisterFinalizer(SCM_OBJ(mutex), mutex_finalize, NULL);
     mutex->name = SCM_FALSE;
     mutex->specific = SCM_UNDEFINED;
-    mutex->locked = FALSE;
+    AO_store(&mutex->lock, SCM_MUTEX_UNLOCKED);
+    mutex->spin = 0;
     mutex->owner = NULL;
     mutex->locker_proc = mutex->unlocker_proc = SCM_FALSE;
+    mutex->lockStat = NULL;
     return SCM_OBJ(mutex);
 }
 
+/* NB: A mutex in HANDOFF state is released by its former owner, but
+   the owner is about to wait on a condition variable while holding
+   the internal mutex.  Whoever can see this state while holding the
+   internal mutex can regard it as unlocked. */
+static inline int mutex_locked_p(ScmMutex *mutex)
+{
+    AO_t s = AO_load(&mutex->lock);
+    return (s == SCM_MUTEX_LOCKED || s == SCM_MUTEX_CONTENDED);
+}
+
 static void mutex_print(ScmObj obj, ScmPort *port, ScmWriteContext *ctx)
 {
     ScmMutex *mutex = SCM_MUTEX(obj);
 
     (void)SCM_INTERNAL_MUTEX_LOCK(mutex->mutex);
-    int locked = mutex->locked;
+    int locked = mutex_locked_p(mutex);
     ScmVM *vm = mutex->owner;
     ScmObj name = mutex->name;
     (void)SCM_INTERNAL_MUTEX_UNLOCK(mutex->mutex);
@@ -106,12 +118,13 @@ static void mutex_print(ScmObj obj, ScmPort *port, ScmWriteContext *ctx)
 static ScmObj sym_not_owned;
 static ScmObj sym_abandoned;
 static ScmObj sym_not_abandoned;
+static ScmObj sym_write;
 
 static ScmObj mutex_state_get(ScmMutex *mutex)
 {
     ScmObj r;
     (void)SCM_INTERNAL_MUTEX_LOCK(mutex->mutex);
-    if (mutex->locked) {
+    if (mutex_locked_p(mutex)) {
         if (mutex->owner) {
             if (mutex->owner->state == SCM_VM_TERMINATED) r = sym_abandoned;
             else r = SCM_OBJ(mutex->owner);
@@ -157,8 +170,24 @@ static ScmClassStaticSlotSpec mutex_slots[] = {
  */
 ScmObj Scm_MakeMutex(ScmObj name)
 {
+    return Scm_MakeMutexFull(name, FALSE);
+}
+
+/* An adaptive mutex spins for a while before parking when it finds the
+   mutex locked.  It pays off when critical sections are short, but it
+   is just a waste on a single processor. */
+#define MUTEX_SPIN_ROUNDS   10
+#define MUTEX_SPIN_MAX_WAIT 64
+
+ScmObj Scm_MakeMutexFull(ScmObj name, int adaptive)
+{
+    static int nprocs = 0;
     ScmObj m = mutex_allocate(SCM_CLASS_MUTEX, SCM_NIL);
     SCM_MUTEX(m)->name = name;
+    if (adaptive) {
+        if (nprocs == 0) nprocs = Scm_AvailableProcessors(); /* race is ok */
+        if (nprocs > 1) SCM_MUTEX(m)->spin = MUTEX_SPIN_ROUNDS;
+    }
     return m;
 }
 
@@ -166,22 +195,112 @@ ScmObj Scm_MakeMutex(ScmObj name)
  * Lock and unlock mutex
  */
 
+/*
+ * The lock word goes through these states:
+ *
+ *   UNLOCKED -> LOCKED       lock, fast path (CAS)
+ *   LOCKED -> UNLOCKED       unlock, fast path (CAS)
+ *   UNLOCKED/LOCKED/HANDOFF -> CONTENDED
+ *                            a locker parks, or grabs the lock while
+ *                            others may be parked (with internal mutex)
+ *   CONTENDED -> UNLOCKED    unlock, waking a parked thread
+ *                            (with internal mutex)
+ *   LOCKED/CONTENDED -> HANDOFF
+ *                            mutex-unlock! with a condition variable
+ *                            (with internal mutex)
+ *
+ * Mutex-unlock! with a condition variable has to release the lock and
+ * start waiting on the cv atomically, so that a thread that grabs the
+ * mutex afterwards and signals the cv won't lose the signal.  Keeping the
+ * lock word in HANDOFF forces such thread into the slow path, where it
+ * has to acquire the internal mutex, which is held by the unlocker until
+ * it starts waiting.
+ */
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define SPIN_PAUSE()  __asm__ __volatile__("pause")
+#else
+#define SPIN_PAUSE()  /*empty*/
+#endif
+
+static inline int mutex_try_fast_lock(ScmMutex *mutex)
+{
+    return AO_compare_and_swap_full(&mutex->lock, SCM_MUTEX_UNLOCKED,
+                                    SCM_MUTEX_LOCKED);
+}
+
+/* Spin with exponential backoff, hoping the owner releases the lock
+   soon.  Returns TRUE if we got the lock. */
+static int mutex_spin_lock(ScmMutex *mutex)
+{
+    int wait = 1;
+    for (int round = 0; round < mutex->spin; round++) {
+        for (int i = 0; i < wait; i++) SPIN_PAUSE();
+        AO_t s = AO_load(&mutex->lock);
+        if (s == SCM_MUTEX_UNLOCKED) {
+            if (mutex_try_fast_lock(mutex)) return TRUE;
+        } else if (s != SCM_MUTEX_LOCKED) {
+            break;              /* there're parked threads; don't bother */
+        }
+        if (wait < MUTEX_SPIN_MAX_WAIT) wait <<= 1;
+    }
+    return FALSE;
+}
+
 ScmObj Scm_MutexLock(ScmMutex *mutex, ScmObj timeout, ScmVM *owner)
 {
 #ifdef GAUCHE_HAS_THREADS
     ScmTimeSpec ts;
     ScmObj r = SCM_TRUE;
     ScmVM *abandoned = NULL;
-    int intr = FALSE;
+    double waitStart = 0;
+    int intr;
+
+    if (mutex_try_fast_lock(mutex)) {
+        mutex->owner = owner;
+        if (SCM_LOCK_STAT_ENABLED()) {
+            Scm__LockStatAcquired(&mutex->lockStat, SCM_OBJ(mutex), 0);
+        }
+        return SCM_TRUE;
+    }
+    if (SCM_LOCK_STAT_ENABLED()) waitStart = Scm__LockStatNow();
+    if (mutex->spin > 0 && mutex_spin_lock(mutex)) {
+        mutex->owner = owner;
+        if (SCM_LOCK_STAT_ENABLED()) {
+            Scm__LockStatAcquired(&mutex->lockStat, SCM_OBJ(mutex),
+                                  waitStart);
+        }
+        return SCM_TRUE;
+    }
 
     ScmTimeSpec *pts = Scm_GetTimeSpec(timeout, &ts);
+  retry:
+    intr = FALSE;
     SCM_INTERNAL_MUTEX_SAFE_LOCK_BEGIN(mutex->mutex);
-    while (mutex->locked) {
+    for (;;) {
+        AO_t s = AO_load(&mutex->lock);
+        if (s == SCM_MUTEX_UNLOCKED || s == SCM_MUTEX_HANDOFF) {
+            /* We may not be the only one who's been parked, so we leave
+               it CONTENDED to make the unlocker wake others. */
+            if (AO_compare_and_swap_full(&mutex->lock, s,
+                                         SCM_MUTEX_CONTENDED)) {
+                break;
+            }
+            continue;
+        }
         if (mutex->owner && mutex->owner->state == SCM_VM_TERMINATED) {
+            /* The owner is gone; no one but us can touch the lock word
+               now, since it isn't UNLOCKED and we hold the internal
+               mutex. */
             abandoned = mutex->owner;
-            mutex->locked = FALSE;
+            AO_store_full(&mutex->lock, SCM_MUTEX_CONTENDED);
             break;
         }
+        if (s == SCM_MUTEX_LOCKED
+            && !AO_compare_and_swap_full(&mutex->lock, SCM_MUTEX_LOCKED,
+                                         SCM_MUTEX_CONTENDED)) {
+            continue;
+        }
         if (pts) {
             int tr = SCM_INTERNAL_COND_TIMEDWAIT(mutex->cv, mutex->mutex, pts);
             if (tr == SCM_INTERNAL_COND_TIMEDOUT) { r = SCM_FALSE; break; }
@@ -190,12 +309,18 @@ ScmObj Scm_MutexLock(ScmMutex *mutex, ScmObj timeout, ScmVM *owner)
             SCM_INTERNAL_COND_WAIT(mutex->cv, mutex->mutex);
         }
     }
-    if (SCM_TRUEP(r)) {
-        mutex->locked = TRUE;
+    if (SCM_TRUEP(r) && !intr) {
         mutex->owner = owner;
     }
     SCM_INTERNAL_MUTEX_SAFE_LOCK_END();
-    if (intr) Scm_SigCheck(Scm_VM());
+    if (intr) {
+        /* Handle signals, then try again. */
+        Scm_SigCheck(Scm_VM());
+        goto retry;
+    }
+    if (SCM_TRUEP(r) && SCM_LOCK_STAT_ENABLED()) {
+        Scm__LockStatAcquired(&mutex->lockStat, SCM_OBJ(mutex), waitStart);
+    }
     if (abandoned) {
         ScmObj exc = Scm_MakeThreadException(SCM_CLASS_ABANDONED_MUTEX_EXCEPTION, abandoned);
         SCM_THREAD_EXCEPTION(exc)->data = SCM_OBJ(mutex);
@@ -214,10 +339,20 @@ ScmObj Scm_MutexUnlock(ScmMutex *mutex, ScmConditionVariable *cv, ScmObj timeout
     ScmTimeSpec ts;
     int intr = FALSE;
 
+    if (mutex->lockStat) Scm__LockStatReleased(mutex->lockStat);
+    if (cv == NULL) {
+        mutex->owner = NULL;
+        if (AO_compare_and_swap_full(&mutex->lock, SCM_MUTEX_LOCKED,
+                                     SCM_MUTEX_UNLOCKED)) {
+            return r;
+        }
+    }
+
     ScmTimeSpec *pts = Scm_GetTimeSpec(timeout, &ts);
     SCM_INTERNAL_MUTEX_SAFE_LOCK_BEGIN(mutex->mutex);
-    mutex->locked = FALSE;
     mutex->owner = NULL;
+    AO_store_full(&mutex->lock,
+                  cv? SCM_MUTEX_HANDOFF : SCM_MUTEX_UNLOCKED);
     SCM_INTERNAL_COND_SIGNAL(mutex->cv);
     if (cv) {
         if (pts) {
@@ -227,6 +362,10 @@ ScmObj Scm_MutexUnlock(ScmMutex *mutex, ScmConditionVariable *cv, ScmObj timeout
         } else {
             SCM_INTERNAL_COND_WAIT(cv->cv, mutex->mutex);
         }
+        /* If no one has taken the mutex in the meantime, make it
+           available to the fast path again. */
+        AO_compare_and_swap_full(&mutex->lock, SCM_MUTEX_HANDOFF,
+                                 SCM_MUTEX_UNLOCKED);
     }
     SCM_INTERNAL_MUTEX_SAFE_LOCK_END();
     if (intr) Scm_SigCheck(Scm_VM());
@@ -354,6 +493,237 @@ ScmObj Scm_ConditionVariableBroadcast(ScmConditionVariable *cond)
     return SCM_UNDEFINED;
 }
 
+/*=====================================================
+ * Reader/writer lock
+ */
+
+static void rwlock_print(ScmObj obj, ScmPort *port, ScmWriteContext *ctx);
+
+SCM_DEFINE_BUILTIN_CLASS_SIMPLE(Scm_RWLockClass, rwlock_print);
+
+#define RW_READERS(s)  ((s) >> SCM_RWLOCK_READER_SHIFT)
+#define RW_ONE_READER  ((AO_t)1 << SCM_RWLOCK_READER_SHIFT)
+
+static void rwlock_finalize(ScmObj obj, void *data)
+{
+    ScmRWLock *rw = SCM_RWLOCK(obj);
+    SCM_INTERNAL_MUTEX_DESTROY(rw->mutex);
+    SCM_INTERNAL_COND_DESTROY(rw->readerCv);
+    SCM_INTERNAL_COND_DESTROY(rw->writerCv);
+}
+
+ScmObj Scm_MakeRWLock(ScmObj name)
+{
+    ScmRWLock *rw = SCM_NEW(ScmRWLock);
+    SCM_SET_CLASS(rw, SCM_CLASS_RWLOCK);
+    SCM_INTERNAL_MUTEX_INIT(rw->mutex);
+    SCM_INTERNAL_COND_INIT(rw->readerCv);
+    SCM_INTERNAL_COND_INIT(rw->writerCv);
+    rw->name = name;
+    rw->specific = SCM_UNDEFINED;
+    AO_store(&rw->lock, 0);
+    rw->numWaitingReaders = rw->numWaitingWriters = 0;
+    Scm_RegisterFinalizer(SCM_OBJ(rw), rwlock_finalize, NULL);
+    return SCM_OBJ(rw);
+}
+
+ScmObj Scm_RWLockState(ScmRWLock *rw)
+{
+    AO_t s = AO_load(&rw->lock);
+    if (s & SCM_RWLOCK_WRITER) return sym_write;
+    if (RW_READERS(s) > 0)     return Scm_MakeIntegerU(RW_READERS(s));
+    return SCM_FALSE;
+}
+
+static void rwlock_print(ScmObj obj, ScmPort *port, ScmWriteContext *ctx)
+{
+    ScmRWLock *rw = SCM_RWLOCK(obj);
+    AO_t s = AO_load(&rw->lock);
+    if (SCM_FALSEP(rw->name)) Scm_Printf(port, "#<rwlock %p ", rw);
+    else                      Scm_Printf(port, "#<rwlock %S ", rw->name);
+    if (s & SCM_RWLOCK_WRITER) Scm_Printf(port, "write-locked>");
+    else if (RW_READERS(s))    Scm_Printf(port, "read-locked(%lu)>",
+                                          (u_long)RW_READERS(s));
+    else                       Scm_Printf(port, "unlocked>");
+}
+
+/* Called with rw->mutex held.  Sets or clears WAITING in the lock word,
+   according to the waiting counts. */
+static void rwlock_update_waiting(ScmRWLock *rw)
+{
+    int waiting = (rw->numWaitingReaders > 0 || rw->numWaitingWriters > 0);
+    for (;;) {
+        AO_t s = AO_load(&rw->lock);
+        AO_t n = waiting? (s | SCM_RWLOCK_WAITING) : (s & ~SCM_RWLOCK_WAITING);
+        if (s == n || AO_compare_and_swap_full(&rw->lock, s, n)) break;
+    }
+}
+
+/* Called with rw->mutex held.  Wakes up whoever should go next. */
+static void rwlock_wake(ScmRWLock *rw)
+{
+    if (rw->numWaitingWriters > 0) {
+        SCM_INTERNAL_COND_SIGNAL(rw->writerCv);
+    } else if (rw->numWaitingReaders > 0) {
+        SCM_INTERNAL_COND_BROADCAST(rw->readerCv);
+    }
+}
+
+/* Waits on CV, with an optional deadline.  Returns FALSE on timeout. */
+static int rwlock_wait(ScmRWLock *rw, ScmInternalCond *cv, ScmTimeSpec *pts)
+{
+    if (pts) {
+        int tr = SCM_INTERNAL_COND_TIMEDWAIT(*cv, rw->mutex, pts);
+        if (tr == SCM_INTERNAL_COND_TIMEDOUT) return FALSE;
+    } else {
+        SCM_INTERNAL_COND_WAIT(*cv, rw->mutex);
+    }
+    return TRUE;
+}
+
+ScmObj Scm_RWLockReadLock(ScmRWLock *rw, ScmObj timeout)
+{
+    AO_t s = AO_load(&rw->lock);
+    if (!(s & (SCM_RWLOCK_WRITER|SCM_RWLOCK_WAITING))
+        && AO_compare_and_swap_full(&rw->lock, s, s + RW_ONE_READER)) {
+        return SCM_TRUE;
+    }
+
+    ScmTimeSpec ts;
+    ScmTimeSpec *pts = Scm_GetTimeSpec(timeout, &ts);
+    ScmObj r = SCM_TRUE;
+    SCM_INTERNAL_MUTEX_SAFE_LOCK_BEGIN(rw->mutex);
+    for (;;) {
+        s = AO_load(&rw->lock);
+        if (!(s & SCM_RWLOCK_WRITER) && rw->numWaitingWriters == 0) {
+            if (AO_compare_and_swap_full(&rw->lock, s, s + RW_ONE_READER)) {
+                break;
+            }
+            continue;
+        }
+        /* Setting WAITING on the very state we've seen guarantees that
+           the unlocker that changes it will wake us. */
+        if (!(s & SCM_RWLOCK_WAITING)
+            && !AO_compare_and_swap_full(&rw->lock, s,
+                                         s | SCM_RWLOCK_WAITING)) {
+            continue;
+        }
+        rw->numWaitingReaders++;
+        int ok = rwlock_wait(rw, &rw->readerCv, pts);
+        rw->numWaitingReaders--;
+        rwlock_update_waiting(rw);
+        if (!ok) { r = SCM_FALSE; break; }
+    }
+    SCM_INTERNAL_MUTEX_SAFE_LOCK_END();
+    return r;
+}
+
+void Scm_RWLockReadUnlock(ScmRWLock *rw)
+{
+    for (;;) {
+        AO_t s = AO_load(&rw->lock);
+        if (RW_READERS(s) == 0) {
+            Scm_Error("rwlock isn't read-locked: %S", SCM_OBJ(rw));
+        }
+        if (AO_compare_and_swap_full(&rw->lock, s, s - RW_ONE_READER)) {
+            s -= RW_ONE_READER;
+            if (RW_READERS(s) == 0 && (s & SCM_RWLOCK_WAITING)) {
+                (void)SCM_INTERNAL_MUTEX_LOCK(rw->mutex);
+                rwlock_update_waiting(rw);
+                rwlock_wake(rw);
+                (void)SCM_INTERNAL_MUTEX_UNLOCK(rw->mutex);
+            }
+            return;
+        }
+    }
+}
+
+ScmObj Scm_RWLockWriteLock(ScmRWLock *rw, ScmObj timeout)
+{
+    if (AO_compare_and_swap_full(&rw->lock, 0, SCM_RWLOCK_WRITER)) {
+        return SCM_TRUE;
+    }
+
+    ScmTimeSpec ts;
+    ScmTimeSpec *pts = Scm_GetTimeSpec(timeout, &ts);
+    ScmObj r = SCM_TRUE;
+    SCM_INTERNAL_MUTEX_SAFE_LOCK_BEGIN(rw->mutex);
+    for (;;) {
+        AO_t s = AO_load(&rw->lock);
+        if (!(s & SCM_RWLOCK_WRITER) && RW_READERS(s) == 0) {
+            if (AO_compare_and_swap_full(&rw->lock, s,
+                                         s | SCM_RWLOCK_WRITER)) {
+                break;
+            }
+            continue;
+        }
+        if (!(s & SCM_RWLOCK_WAITING)
+            && !AO_compare_and_swap_full(&rw->lock, s,
+                                         s | SCM_RWLOCK_WAITING)) {
+            continue;
+        }
+        rw->numWaitingWriters++;
+        int ok = rwlock_wait(rw, &rw->writerCv, pts);
+        rw->numWaitingWriters--;
+        rwlock_update_waiting(rw);
+        if (!ok) {
+            /* Readers may have been held back because of us. */
+            if (!(AO_load(&rw->lock) & SCM_RWLOCK_WRITER)) rwlock_wake(rw);
+            r = SCM_FALSE;
+            break;
+        }
+    }
+    SCM_INTERNAL_MUTEX_SAFE_LOCK_END();
+    return r;
+}
+
+void Scm_RWLockWriteUnlock(ScmRWLock *rw)
+{
+    if (AO_compare_and_swap_full(&rw->lock, SCM_RWLOCK_WRITER, 0)) return;
+
+    (void)SCM_INTERNAL_MUTEX_LOCK(rw->mutex);
+    AO_t s;
+    for (;;) {
+        s = AO_load(&rw->lock);
+        if (!(s & SCM_RWLOCK_WRITER)) break;
+        if (AO_compare_and_swap_full(&rw->lock, s, s & ~SCM_RWLOCK_WRITER)) {
+            rwlock_update_waiting(rw);
+            rwlock_wake(rw);
+            break;
+        }
+    }
+    (void)SCM_INTERNAL_MUTEX_UNLOCK(rw->mutex);
+    if (!(s & SCM_RWLOCK_WRITER)) {
+        Scm_Error("rwlock isn't write-locked: %S", SCM_OBJ(rw));
+    }
+}
+
+static ScmObj rwlock_name_get(ScmRWLock *rw)
+{
+    return rw->name;
+}
+
+static void rwlock_name_set(ScmRWLock *rw, ScmObj name)
+{
+    rw->name = name;
+}
+
+static ScmObj rwlock_specific_get(ScmRWLock *rw)
+{
+    return rw->specific;
+}
+
+static void rwlock_specific_set(ScmRWLock *rw, ScmObj value)
+{
+    rw->specific = value;
+}
+
+static ScmClassStaticSlotSpec rwlock_slots[] = {
+    SCM_CLASS_SLOT_SPEC("name", rwlock_name_get, rwlock_name_set),
+    SCM_CLASS_SLOT_SPEC("specific", rwlock_specific_get, rwlock_specific_set),
+    SCM_CLASS_SLOT_SPEC_END()
+};
+
 /*
  * Initialization
  */
@@ -363,6 +733,8 @@ void Scm_Init_mutex(ScmModule *mod)
     sym_not_owned     = SCM_INTERN("not-owned");
     sym_abandoned     = SCM_INTERN("abandoned");
     sym_not_abandoned = SCM_INTERN("not-abandoned");
+    sym_write         = SCM_INTERN("write");
     Scm_InitStaticClass(&Scm_MutexClass, "<mutex>", mod, mutex_slots, 0);
     Scm_InitStaticClass(&Scm_ConditionVariableClass, "<condition-variable>", mod, cv_slots, 0);
+    Scm_InitStaticClass(&Scm_RWLockClass, "<rwlock>", mod, rwlock_slots, 0);
 }
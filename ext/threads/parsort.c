@@ -0,0 +1,341 @@
+/*
+ * parsort.c - Parallel sort
+ *
+ *
+ *   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <gauche.h>
+#include <gauche/class.h>
+#include "gauche/priv/sortP.h"
+#include "threads.h"
+
+/*
+ * Parallel sort of vectors and uniform vectors.
+ *
+ *  The sequence is split into as many chunks as the worker threads,
+ *  each of which is sorted by a worker with the sequential kernel.
+ *  Then adjacent runs are merged pairwise until one run remains.
+ *  Each merge round is also split evenly among the workers by merge
+ *  path partitioning; a worker takes a fixed range of the output and
+ *  finds where it starts in the two input runs by binary search.
+ *  Thus the last round, which merges two halves, is parallel as well.
+ *
+ *  Workers are native threads without VM.  They never call back to
+ *  Scheme, so we only take the keys the kernels can compare inline
+ *  (see gauche/priv/sortP.h) and uniform vectors.  The caller falls
+ *  back to the sequential sort otherwise.  Workers are still created
+ *  via GC's thread creation, so they can allocate and the objects they
+ *  hold are seen by GC.
+ */
+
+/* We don't bother to split a chunk smaller than this. */
+#define PARSORT_MIN_CHUNK  4096
+
+/* Merge-path merge.  A[0..na) and B[0..nb) are sorted; write the
+   elements D0..D1 of the merged sequence into OUT[D0..D1).  Equal
+   elements are taken from A first, so the merge is stable. */
+#define DEFINE_PATH_MERGE(name, T, LESS)                                \
+static ScmSmallInt SCM_CPP_CAT(name, _split)(const T *a, ScmSmallInt na,\
+                                             const T *b, ScmSmallInt nb,\
+                                             ScmSmallInt d)             \
+{                                                                       \
+    ScmSmallInt lo = (d > nb)? d-nb : 0, hi = (d < na)? d : na;         \
+    while (lo < hi) {                                                   \
+        ScmSmallInt mid = lo + (hi-lo)/2;                               \
+        if (LESS(b[d-mid-1], a[mid])) hi = mid;                         \
+        else lo = mid+1;                                                \
+    }                                                                   \
+    return lo;                                                          \
+}                                                                       \
+                                                                        \
+static void name(const void *va, ScmSmallInt na,                        \
+                 const void *vb, ScmSmallInt nb,                        \
+                 ScmSmallInt d0, ScmSmallInt d1, void *vout)            \
+{                                                                       \
+    const T *a = (const T*)va, *b = (const T*)vb;                       \
+    T *out = (T*)vout;                                                  \
+    ScmSmallInt i = SCM_CPP_CAT(name, _split)(a, na, b, nb, d0);        \
+    ScmSmallInt j = d0 - i;                                             \
+    for (ScmSmallInt k = d0; k < d1; k++) {                             \
+        if (j >= nb || (i < na && !LESS(b[j], a[i]))) out[k] = a[i++];  \
+        else                                          out[k] = b[j++];  \
+    }                                                                   \
+}
+
+#define KEY_LESS(KEY, x, y)  (KEY(x) < KEY(y))
+#define LESS_S8(x, y)   KEY_LESS(S8_KEY, x, y)
+#define LESS_U8(x, y)   KEY_LESS(U8_KEY, x, y)
+#define LESS_S16(x, y)  KEY_LESS(S16_KEY, x, y)
+#define LESS_U16(x, y)  KEY_LESS(U16_KEY, x, y)
+#define LESS_S32(x, y)  KEY_LESS(S32_KEY, x, y)
+#define LESS_U32(x, y)  KEY_LESS(U32_KEY, x, y)
+#define LESS_S64(x, y)  KEY_LESS(S64_KEY, x, y)
+#define LESS_U64(x, y)  KEY_LESS(U64_KEY, x, y)
+#define LESS_F16(x, y)  KEY_LESS(F16_KEY, x, y)
+#define LESS_F32(x, y)  KEY_LESS(f32_key, x, y)
+#define LESS_F64(x, y)  KEY_LESS(f64_key, x, y)
+
+DEFINE_PATH_MERGE(merge_fixnum, ScmObj, LESS_FIXNUM)
+DEFINE_PATH_MERGE(merge_flonum, ScmObj, LESS_FLONUM)
+DEFINE_PATH_MERGE(merge_string, ScmObj, LESS_STRING)
+DEFINE_PATH_MERGE(merge_symbol, ScmObj, LESS_SYMBOL)
+DEFINE_PATH_MERGE(merge_s8,  signed char, LESS_S8)
+DEFINE_PATH_MERGE(merge_u8,  u_char, LESS_U8)
+DEFINE_PATH_MERGE(merge_s16, short, LESS_S16)
+DEFINE_PATH_MERGE(merge_u16, u_short, LESS_U16)
+DEFINE_PATH_MERGE(merge_s32, ScmInt32, LESS_S32)
+DEFINE_PATH_MERGE(merge_u32, ScmUInt32, LESS_U32)
+DEFINE_PATH_MERGE(merge_s64, ScmInt64, LESS_S64)
+DEFINE_PATH_MERGE(merge_u64, ScmUInt64, LESS_U64)
+DEFINE_PATH_MERGE(merge_f16, ScmHalfFloat, LESS_F16)
+DEFINE_PATH_MERGE(merge_f32, float, LESS_F32)
+DEFINE_PATH_MERGE(merge_f64, double, LESS_F64)
+
+typedef void (*merge_proc)(const void *a, ScmSmallInt na,
+                           const void *b, ScmSmallInt nb,
+                           ScmSmallInt d0, ScmSmallInt d1, void *out);
+
+typedef struct parsort_rec {
+    ScmObj seq;                 /* vector or uvector being sorted */
+    ScmClass *uvklass;          /* uvector class, or NULL for vector */
+    int stable;
+    size_t esize;               /* element size in bytes */
+    ScmSmallInt nelts;
+    int nchunks;
+    ScmSmallInt *bounds;        /* start of each chunk; [nchunks] = nelts */
+    merge_proc merge;
+    /* current merge round */
+    char *src;                  /* runs to be merged */
+    char *dst;                  /* merged runs */
+    int runchunks;              /* # of chunks per run in SRC */
+} parsort;
+
+typedef struct parsort_task_rec {
+    parsort *ps;
+    int index;
+    void (*proc)(parsort *ps, int index);
+} parsort_task;
+
+/* Sort I-th chunk in place with the sequential kernel. */
+static void sort_chunk(parsort *ps, int i)
+{
+    ScmSmallInt start = ps->bounds[i], len = ps->bounds[i+1] - start;
+    if (ps->uvklass) {
+        char *p = (char*)SCM_UVECTOR_ELEMENTS(ps->seq) + start*ps->esize;
+        ScmObj v = Scm_MakeUVectorFull(ps->uvklass, len, p, FALSE, NULL);
+        Scm_UVectorSortX(SCM_UVECTOR(v));
+    } else {
+        ScmObj *p = SCM_VECTOR_ELEMENTS(ps->seq) + start;
+        if (ps->stable) Scm_StableSortArray(p, NULL, (int)len);
+        else            Scm_SortArray(p, (int)len, SCM_FALSE);
+    }
+}
+
+/* Produce I-th slice of the output of the current merge round. */
+static void merge_slice(parsort *ps, int i)
+{
+    ScmSmallInt olo = ps->nelts * i / ps->nchunks;
+    ScmSmallInt ohi = ps->nelts * (i+1) / ps->nchunks;
+    int step = ps->runchunks * 2;
+
+    for (int c = 0; c < ps->nchunks; c += step) {
+        ScmSmallInt lo = ps->bounds[c];
+        ScmSmallInt mid = ps->bounds[(c + ps->runchunks < ps->nchunks)
+                                     ? c + ps->runchunks : ps->nchunks];
+        ScmSmallInt hi = ps->bounds[(c + step < ps->nchunks)
+                                    ? c + step : ps->nchunks];
+        if (hi <= olo) continue;
+        if (lo >= ohi) break;
+        ScmSmallInt d0 = ((olo > lo)? olo : lo) - lo;
+        ScmSmallInt d1 = ((ohi < hi)? ohi : hi) - lo;
+        ps->merge(ps->src + lo*ps->esize, mid - lo,
+                  ps->src + mid*ps->esize, hi - mid,
+                  d0, d1, ps->dst + lo*ps->esize);
+    }
+}
+
+static SCM_INTERNAL_THREAD_PROC_RETTYPE parsort_entry(void *data)
+{
+    parsort_task *task = (parsort_task*)data;
+    task->proc(task->ps, task->index);
+    return SCM_INTERNAL_THREAD_PROC_RETVAL;
+}
+
+/* Run PROC(ps, i) for i in [0, nchunks), each in its own thread.
+   The last one runs in the calling thread.  If we can't create a thread,
+   we just run the task by ourselves. */
+static void run_tasks(parsort *ps, void (*proc)(parsort*, int))
+{
+    int n = ps->nchunks;
+    parsort_task *tasks = SCM_NEW_ARRAY(parsort_task, n);
+#if defined(GAUCHE_USE_PTHREADS)
+    pthread_t *ths = SCM_NEW_ATOMIC_ARRAY(pthread_t, n);
+    char *started = SCM_NEW_ATOMIC_ARRAY(char, n);
+    sigset_t all, omask;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &omask);
+#elif defined(GAUCHE_USE_WTHREADS)
+    HANDLE *ths = SCM_NEW_ATOMIC_ARRAY(HANDLE, n);
+    char *started = SCM_NEW_ATOMIC_ARRAY(char, n);
+#endif
+
+    for (int i=0; i<n; i++) {
+        tasks[i].ps = ps;
+        tasks[i].index = i;
+        tasks[i].proc = proc;
+#if defined(GAUCHE_USE_PTHREADS)
+        started[i] = (i < n-1
+                      && pthread_create(&ths[i], NULL, parsort_entry,
+                                        &tasks[i]) == 0);
+#elif defined(GAUCHE_USE_WTHREADS)
+        ths[i] = (i < n-1)
+            ? GC_CreateThread(NULL, 0, parsort_entry, &tasks[i], 0, NULL)
+            : NULL;
+        started[i] = (ths[i] != NULL);
+#endif
+    }
+#if defined(GAUCHE_USE_PTHREADS)
+    pthread_sigmask(SIG_SETMASK, &omask, NULL);
+#endif
+
+    for (int i=0; i<n; i++) {
+#if defined(GAUCHE_USE_PTHREADS)
+        if (started[i]) continue;
+#elif defined(GAUCHE_USE_WTHREADS)
+        if (started[i]) continue;
+#endif
+        proc(ps, i);
+    }
+
+#if defined(GAUCHE_USE_PTHREADS)
+    for (int i=0; i<n; i++) {
+        if (started[i]) pthread_join(ths[i], NULL);
+    }
+#elif defined(GAUCHE_USE_WTHREADS)
+    for (int i=0; i<n; i++) {
+        if (started[i]) {
+            WaitForSingleObject(ths[i], INFINITE);
+            CloseHandle(ths[i]);
+        }
+    }
+#endif
+}
+
+static merge_proc uvector_merge_proc(int type)
+{
+    switch (type) {
+    case SCM_UVECTOR_S8:  return merge_s8;
+    case SCM_UVECTOR_U8:  return merge_u8;
+    case SCM_UVECTOR_S16: return merge_s16;
+    case SCM_UVECTOR_U16: return merge_u16;
+    case SCM_UVECTOR_S32: return merge_s32;
+    case SCM_UVECTOR_U32: return merge_u32;
+    case SCM_UVECTOR_S64: return merge_s64;
+    case SCM_UVECTOR_U64: return merge_u64;
+    case SCM_UVECTOR_F16: return merge_f16;
+    case SCM_UVECTOR_F32: return merge_f32;
+    case SCM_UVECTOR_F64: return merge_f64;
+    default: return NULL;
+    }
+}
+
+/* Sort a vector or a uniform vector SEQ with at most NTHREADS threads,
+   using the default ordering.  If INPLACE is false, SEQ is copied
+   first.  Returns the sorted sequence, or #f if SEQ has keys we can't
+   compare without calling back to Scheme; the caller should use the
+   sequential sort then. */
+ScmObj Scm_ParallelSort(ScmObj seq, int stable, int nthreads, int inplace)
+{
+    parsort ps;
+    ScmSmallInt n;
+
+    ps.stable = stable;
+    if (SCM_VECTORP(seq)) {
+        n = SCM_VECTOR_SIZE(seq);
+        if (n > 1) {
+            switch (sort_key_kind(SCM_VECTOR_ELEMENTS(seq), (int)n, 1)) {
+            case SORT_KEY_FIXNUM: ps.merge = merge_fixnum; break;
+            case SORT_KEY_FLONUM: ps.merge = merge_flonum; break;
+            case SORT_KEY_STRING: ps.merge = merge_string; break;
+            case SORT_KEY_SYMBOL: ps.merge = merge_symbol; break;
+            default: return SCM_FALSE;
+            }
+        }
+        if (!inplace) seq = Scm_VectorCopy(SCM_VECTOR(seq), 0, -1,
+                                           SCM_UNDEFINED);
+        ps.uvklass = NULL;
+        ps.esize = sizeof(ScmObj);
+    } else if (SCM_UVECTORP(seq)) {
+        ps.uvklass = Scm_ClassOf(seq);
+        ps.esize = Scm_UVectorElementSize(ps.uvklass);
+        ps.merge = uvector_merge_proc(Scm_UVectorType(ps.uvklass));
+        n = SCM_UVECTOR_SIZE(seq);
+        if (inplace) {
+            SCM_UVECTOR_CHECK_MUTABLE(seq);
+        } else {
+            ScmObj v = Scm_MakeUVector(ps.uvklass, n, NULL);
+            memcpy(SCM_UVECTOR_ELEMENTS(v), SCM_UVECTOR_ELEMENTS(seq),
+                   n*ps.esize);
+            seq = v;
+        }
+    } else {
+        SCM_TYPE_ERROR(seq, "vector or uniform vector");
+        return SCM_UNDEFINED;   /* dummy */
+    }
+    if (n <= 1) return seq;
+
+    if (nthreads > n / PARSORT_MIN_CHUNK) nthreads = (int)(n / PARSORT_MIN_CHUNK);
+    if (nthreads < 1) nthreads = 1;
+
+    ps.seq = seq;
+    ps.nelts = n;
+    ps.nchunks = nthreads;
+    ps.bounds = SCM_NEW_ATOMIC_ARRAY(ScmSmallInt, nthreads+1);
+    for (int i=0; i<=nthreads; i++) ps.bounds[i] = n * i / nthreads;
+
+    run_tasks(&ps, sort_chunk);
+    if (nthreads == 1) return seq;
+
+    char *data = ps.uvklass
+        ? (char*)SCM_UVECTOR_ELEMENTS(seq)
+        : (char*)SCM_VECTOR_ELEMENTS(seq);
+    char *buf = ps.uvklass
+        ? SCM_NEW_ATOMIC_ARRAY(char, n*ps.esize)
+        : (char*)SCM_NEW_ARRAY(ScmObj, n);
+    ps.src = data;
+    ps.dst = buf;
+    for (ps.runchunks = 1; ps.runchunks < nthreads; ps.runchunks *= 2) {
+        run_tasks(&ps, merge_slice);
+        char *t = ps.src; ps.src = ps.dst; ps.dst = t;
+    }
+    if (ps.src != data) memcpy(data, ps.src, n*ps.esize);
+    return seq;
+}
@@ -0,0 +1,60 @@
+;;
+;; Parallel sort scaling.
+;;
+;;  gosh -I. -I../../src -I../../lib sortbench.scm [size] [max-threads]
+;;
+;; Sorts the same data with 1, 2, 4, ... threads and shows the speedup
+;; relative to a single thread.
+;;
+
+(add-load-path ".")
+
+(use gauche.threads)
+(use gauche.time)
+(use gauche.uvector)
+(use srfi-1)
+
+(define (random-fixnums size)
+  (let ([v (make-vector size)])
+    (let loop ([i 0] [x 12345])
+      (when (< i size)
+        (vector-set! v i (- (ash x -8) (ash 1 39)))
+        (loop (+ i 1) (logand (+ (* x 6364136223846793005) 1442695040888963407)
+                              (- (ash 1 48) 1)))))
+    v))
+
+(define (round-to x k) (/. (round (* x k)) k))
+
+(define (elapsed thunk)
+  (let1 t0 (current-time)
+    (thunk)
+    (let1 d (time-difference (current-time) t0)
+      (+ (time-second d) (/. (time-nanosecond d) 1e9)))))
+
+(define (bench name make-data max-threads)
+  (format #t "~a\n" name)
+  (format #t "  ~7a ~10a ~a\n" "threads" "seconds" "speedup")
+  (let loop ([n 1] [base #f])
+    (when (<= n max-threads)
+      (let1 data (make-data)
+        (gc)
+        (let* ([sec (elapsed (^[] (parallel-sort! data #f n)))]
+               [base (or base sec)])
+          (format #t "  ~7d ~10a ~a\n"
+                  n (round-to sec 1000) (round-to (/. base sec) 100))
+          (loop (* n 2) base))))))
+
+(define (main args)
+  (let* ([size (if (pair? (cdr args))
+                 (string->number (cadr args))
+                 10000000)]
+         [max-threads (if (and (pair? (cdr args)) (pair? (cddr args)))
+                        (string->number (caddr args))
+                        (max 1 (sys-available-processors)))]
+         [fixnums (random-fixnums size)])
+    (bench #"~size fixnums (vector)"
+           (^[] (vector-copy fixnums)) max-threads)
+    (bench #"~size flonums (f64vector)"
+           (^[] (vector->f64vector (vector-map (cut / <> 3.0) fixnums)))
+           max-threads))
+  0)
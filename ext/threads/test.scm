@@ -41,6 +41,47 @@
          (^p (let1 t (thread-start! (make-thread (^[] (display "hello" p))))
                (thread-join! t)))))
 
+;; stack size
+(define (stk-count n) (if (= n 0) 0 (+ 1 (stk-count (- n 1)))))
+(test* "thread with small stack (deep recursion)" 100000
+       (thread-join! (thread-start!
+                      (make-thread (^[] (stk-count 100000)) 'small 1000))))
+(test* "thread with small stack (many arguments)" 5000
+       (thread-join! (thread-start!
+                      (make-thread (eval `(^[] (+ ,@(make-list 5000 1)))
+                                         (current-module))
+                                   'small 1000))))
+(test* "thread with large stack" 100000
+       (thread-join! (thread-start!
+                      (make-thread (^[] (stk-count 100000)) 'large 200000))))
+(test* "thread with too small stack" (test-error)
+       (make-thread (^[] #f) 'tiny 10))
+
+;; stack pool
+(let1 saved (thread-stack-pool-size)
+  (define (run-many n)
+    (let1 ts (map (^i (thread-start!
+                       (make-thread (^[] (list i (stk-count 20000))))))
+                  (iota n))
+      (map thread-join! ts)))
+  (define expected (map (^i (list i 20000)) (iota 50)))
+  (test* "thread-stack-pool-size" #t (exact-integer? saved))
+  (test* "threads reusing pooled stacks" expected
+         (begin (set! (thread-stack-pool-size) 4)
+                (run-many 50)
+                (run-many 50)))
+  (test* "threads reusing pooled stacks (custom size)" '(20000 20000)
+         (map (^_ (thread-join!
+                   (thread-start!
+                    (make-thread (^[] (stk-count 20000)) 'small 1000))))
+              '(0 1)))
+  (test* "threads without stack pool" expected
+         (begin (set! (thread-stack-pool-size) 0)
+                (run-many 50)))
+  (test* "thread-stack-pool-size (bad)" (test-error)
+         (set! (thread-stack-pool-size) -1))
+  (set! (thread-stack-pool-size) saved))
+
 ;; calculate fibonacchi in awful way
 (define (mt-fib n)
   (let1 threads (make-vector n)
@@ -112,6 +153,34 @@
          (thread-terminate! t1)
          (thread-state t1)))
 
+;; thread start options
+(let ([supported (thread-start-options-supported)]
+      [cpus (thread-available-cpus)])
+  (test* "thread-start-options-supported" #t
+         (every keyword? supported))
+  (test* "thread-available-cpus" #t
+         (or (not cpus) (and (pair? cpus) (every exact-integer? cpus))))
+  (test* "thread-start! :os-stack-size" 'ok
+         (thread-join! (thread-start! (make-thread (^[] 'ok))
+                                      :os-stack-size (* 1024 1024))))
+  (test* "thread-start! :os-name" 'ok
+         (thread-join! (thread-start! (make-thread (^[] 'ok) "main")
+                                      :os-name "a-very-long-thread-name")))
+  (when (and (memq :cpus supported) (pair? cpus))
+    (test* "thread-start! :cpus" 'ok
+           (thread-join! (thread-start! (make-thread (^[] 'ok))
+                                        :cpus (list (car cpus)))))
+    (test* "thread-start! :cpus (bad)" (test-error)
+           (thread-start! (make-thread (^[] 'ok)) :cpus '(-1)))
+    (test* "thread-start! :cpus (bad) leaves the thread new" 'new
+           (let1 t (make-thread (^[] 'ok))
+             (guard (e [else (thread-state t)])
+               (thread-start! t :cpus '(foo))))))
+  (when (memq :priority supported)
+    (test* "thread-start! :priority" 'ok
+           (thread-join! (thread-start! (make-thread (^[] 'ok))
+                                        :priority 19)))))
+
 ;;---------------------------------------------------------------------
 (test-section "thread and error")
 
@@ -246,6 +315,57 @@
               (list r0 r1 (mutex-state m)))))
         ))
 
+(let ()
+  (define (contend m)
+    (let* ([count 0]
+           [ts (list-tabulate
+                4 (^_ (make-thread
+                       (^[] (dotimes [i 10000]
+                              (mutex-lock! m)
+                              (set! count (+ count 1))
+                              (mutex-unlock! m))))))])
+      (for-each thread-start! ts)
+      (for-each thread-join! ts)
+      count))
+  (test* "contended mutex" 40000 (contend (make-mutex)))
+  (test* "make-adaptive-mutex" #t (mutex? (make-adaptive-mutex 'foo)))
+  (test* "contended adaptive mutex" 40000 (contend (make-adaptive-mutex))))
+
+(test* "abandoned adaptive mutex" '(abandoned #t)
+       (let* ([m (make-adaptive-mutex)]
+              [t (thread-start! (make-thread (^[] (mutex-lock! m))))])
+         (thread-join! t)
+         (list (mutex-state m)
+               (guard (e [(abandoned-mutex-exception? e)
+                          (eq? (mutex-state m) (current-thread))])
+                 (mutex-lock! m)
+                 #f))))
+
+(let ([m (make-mutex)]
+      [m2 (make-mutex)])
+  (test* "mutex-lock-stat (not profiled)" #f
+         (begin (mutex-lock! m) (mutex-unlock! m) (mutex-lock-stat m)))
+  (lock-stat-start)
+  (let1 ts (list-tabulate
+            4 (^_ (make-thread (^[] (dotimes [i 1000]
+                                      (mutex-lock! m)
+                                      (mutex-unlock! m))))))
+    (for-each thread-start! ts)
+    (for-each thread-join! ts))
+  (lock-stat-stop)
+  (mutex-lock! m2) (mutex-unlock! m2)
+  (test* "mutex-lock-stat" '(4000 #t #t)
+         (let1 s (mutex-lock-stat m)
+           (list (get-keyword :acquisitions s)
+                 (<= (get-keyword :contentions s) 4000)
+                 (>= (get-keyword :hold-time s) 0))))
+  (test* "lock-stat-result" #t
+         (boolean (assq m (lock-stat-result))))
+  (test* "mutex-lock-stat (after stop)" #f (mutex-lock-stat m2))
+  (lock-stat-reset)
+  (test* "lock-stat-reset" 0
+         (get-keyword :acquisitions (mutex-lock-stat m))))
+
 ;;---------------------------------------------------------------------
 (test-section "condition variables")
 
@@ -433,6 +553,25 @@
            (cut port-test-on-error <> #t))
          (call-with-input-file "test.out" port->string)))
 
+;; Confined ports reject other threads instead of spinning on the lock.
+(test* "confined port (other thread)" '(ok error)
+       (let1 p (open-output-string)
+         (port-confine! p)
+         (display "ok" p)
+         (list (string->symbol (get-output-string p))
+               (thread-join!
+                (thread-start!
+                 (make-thread (^[] (guard (e [else 'error])
+                                     (display "ng" p)
+                                     'ok))))))))
+
+(test* "confined port (owner terminated)" "ab"
+       (let1 p (open-output-string)
+         (thread-join! (thread-start!
+                        (make-thread (^[] (port-confine! p) (display "a" p)))))
+         (display "b" p)
+         (get-output-string p)))
+
 ;;---------------------------------------------------------------------
 ;(test-section "thread and signal")
 
@@ -489,6 +628,40 @@
            (thread-join! th3)
            (list val1 val2 val3))))
 
+;; A new thread starts with the values of its creator at the creation time,
+;; and changes on either side don't affect the other.
+(test* "inherited parameter values" '(10 20 30)
+       (let* ([q (make-parameter 0)]
+              [seen #f]
+              [after #f])
+         (q 10)
+         (let1 th (make-thread (^[] (set! seen (q)) (q 20) (set! after (q))))
+           (q 30)
+           (thread-join! (thread-start! th))
+           (list seen after (q)))))
+
+(test* "parameterize multiple parameters" '((1 a x) (2 b y) (1 a x))
+       (let ([p1 (make-parameter 1)]
+             [p2 (make-parameter 'a)]
+             [p3 (make-parameter "x" string->symbol)])
+         (let* ([before (list (p1) (p2) (p3))]
+                [inside (parameterize ([p1 2] [p2 'b] [p3 "y"])
+                          (list (p1) (p2) (p3)))])
+           (list before inside (list (p1) (p2) (p3))))))
+
+(test* "parameterize multiple parameters and re-entry"
+       '((2 b) (1 a) (2 b) (1 a))
+       (let ([p1 (make-parameter 1)]
+             [p2 (make-parameter 'a)]
+             [k #f]
+             [r '()])
+         (parameterize ([p1 2] [p2 'b])
+           (call/cc (^c (set! k c)))
+           (push! r (list (p1) (p2))))
+         (push! r (list (p1) (p2)))
+         (when (< (length r) 4) (k #f))
+         (reverse r)))
+
 ;;---------------------------------------------------------------------
 (test-section "atoms")
 
@@ -504,6 +677,186 @@
          (for-each thread-join! ts)
          (atom-ref a)))
 
+;;---------------------------------------------------------------------
+(test-section "reader/writer locks")
+
+(test* "rwlock" '(#t foo #f)
+       (let1 rw (make-rwlock 'foo)
+         (list (rwlock? rw) (rwlock-name rw) (rwlock-state rw))))
+
+(test* "rwlock multiple readers" '(#t #t 2 #f #f)
+       (let* ([rw (make-rwlock)]
+              [r0 (rwlock-read-lock! rw)]
+              [r1 (rwlock-read-lock! rw)]
+              [s (rwlock-state rw)]
+              [w (rwlock-write-lock! rw 0.01)])
+         (rwlock-read-unlock! rw)
+         (rwlock-read-unlock! rw)
+         (list r0 r1 s w (rwlock-state rw))))
+
+(test* "rwlock writer excludes readers" '(#t write #f #f #t)
+       (let* ([rw (make-rwlock)]
+              [w (rwlock-write-lock! rw)]
+              [s (rwlock-state rw)]
+              [r (thread-join! (thread-start!
+                                (make-thread (^[] (rwlock-read-lock! rw 0.01)))))]
+              [w2 (rwlock-write-lock! rw 0.01)])
+         (rwlock-write-unlock! rw)
+         (list w s r w2 (rwlock-read-lock! rw))))
+
+(test* "rwlock unlock error" (test-error)
+       (rwlock-write-unlock! (make-rwlock)))
+
+(test* "rwlock writer preference" '(w r)
+       (let* ([rw (make-rwlock)]
+              [log (atom '())]
+              [_ (rwlock-read-lock! rw)]
+              [tw (thread-start!
+                   (make-thread (^[] (with-write-lock rw
+                                       (^[] (atomic-update! log (cut cons 'w <>)))))))])
+         (sys-nanosleep #e5e7)          ; let the writer wait
+         (let1 tr (thread-start!
+                   (make-thread (^[] (with-read-lock rw
+                                       (^[] (atomic-update! log (cut cons 'r <>)))))))
+           (sys-nanosleep #e5e7)
+           (rwlock-read-unlock! rw)
+           (thread-join! tw)
+           (thread-join! tr)
+           (reverse (atom-ref log)))))
+
+(test* "rwlock contention" 40000
+       (let* ([rw (make-rwlock)]
+              [count 0]
+              [ts (list-tabulate
+                   4 (^_ (thread-start!
+                          (make-thread
+                           (^[] (dotimes [i 10000]
+                                  (with-write-lock rw (^[] (inc! count)))
+                                  (with-read-lock rw (^[] count))))))))])
+         (for-each thread-join! ts)
+         count))
+
+;;---------------------------------------------------------------------
+(test-section "atomic boxes")
+
+(test* "atomic-box" '(#t a b c)
+       (let1 b (make-atomic-box 'a)
+         (list (atomic-box? b)
+               (atomic-box-ref b)
+               (begin (atomic-box-set! b 'b) (atomic-box-swap! b 'c))
+               (atomic-box-ref b))))
+
+(test* "atomic-box-compare-and-swap!" '(c c d d)
+       (let1 b (make-atomic-box 'c)
+         (list (atomic-box-compare-and-swap! b 'x 'y)
+               (atomic-box-compare-and-swap! b 'c 'd)
+               (atomic-box-ref b)
+               (atomic-box-compare-and-swap! b 'c 'e))))
+
+(test* "atomic-fixnum" '(#t 10 10 15 -3 8)
+       (let1 a (make-atomic-fixnum 10)
+         (list (atomic-fixnum? a)
+               (atomic-fixnum-ref a)
+               (atomic-fixnum-add! a 5)
+               (atomic-fixnum-swap! a -3)
+               (atomic-fixnum-compare-and-swap! a -3 8)
+               (atomic-fixnum-ref a))))
+
+(test* "atomic-fixnum counting" 300000
+       (let ([a (make-atomic-fixnum 0)] [ts '()])
+         (dotimes [n 30]
+           (push! ts (thread-start! (make-thread
+                                     (^[] (dotimes [m 10000]
+                                            (atomic-fixnum-add! a 1)))))))
+         (for-each thread-join! ts)
+         (atomic-fixnum-ref a)))
+
+;;---------------------------------------------------------------------
+(test-section "concurrent hash table")
+
+(let1 h (make-concurrent-hash-table 'equal?)
+  (test* "concurrent-hash-table?" #t (concurrent-hash-table? h))
+  (concurrent-hash-table-put! h '(a b) 1)
+  (concurrent-hash-table-put! h "c" 2)
+  (test* "get" '(1 2 none)
+         (list (concurrent-hash-table-get h (list 'a 'b))
+               (concurrent-hash-table-get h "c")
+               (concurrent-hash-table-get h 'd 'none)))
+  (test* "get (error)" (test-error)
+         (concurrent-hash-table-get h 'd))
+  (test* "contains?" '(#t #f)
+         (list (concurrent-hash-table-contains? h "c")
+               (concurrent-hash-table-contains? h "d")))
+  (test* "compare-and-swap!" '(#f 1 #t 3)
+         (let* ([r1 (concurrent-hash-table-compare-and-swap! h '(a b) 0 3)]
+                [v1 (concurrent-hash-table-get h '(a b))]
+                [r2 (concurrent-hash-table-compare-and-swap! h '(a b) 1 3)])
+           (list r1 v1 r2 (concurrent-hash-table-get h '(a b)))))
+  (test* "compare-and-swap! (absent)" '(#f #f #t 5)
+         (let* ([r1 (concurrent-hash-table-compare-and-swap! h 'x #f 5)]
+                [v1 (concurrent-hash-table-contains? h 'x)]
+                [r2 (concurrent-hash-table-compare-and-swap! h 'x #f 5 #f)])
+           (list r1 v1 r2 (concurrent-hash-table-get h 'x))))
+  (test* "delete!" '(#t #f 2)
+         (list (concurrent-hash-table-delete! h 'x)
+               (concurrent-hash-table-delete! h 'x)
+               (concurrent-hash-table-num-entries h)))
+  (test* "->alist" '(("c" . 2) ((a b) . 3))
+         (sort (concurrent-hash-table->alist h)
+               (^[a b] (string? (car a)))))
+  (test* "clear!" 0
+         (begin (concurrent-hash-table-clear! h)
+                (concurrent-hash-table-num-entries h))))
+
+(test* "concurrent update!" (make-list 10 300)
+       (let ([h (make-concurrent-hash-table 'eqv? 4)] [ts '()])
+         (dotimes [n 30]
+           (push! ts
+                  (thread-start!
+                   (make-thread
+                    (^[] (dotimes [m 10]
+                           (dotimes [k 10]
+                             (concurrent-hash-table-update! h k (pa$ + 1)
+                                                            0))))))))
+         (for-each thread-join! ts)
+         (map (cut concurrent-hash-table-get h <>) (iota 10))))
+
+(test* "concurrent push!" '(300 300)
+       (let ([h (make-concurrent-hash-table 'string=?)] [ts '()])
+         (dotimes [n 30]
+           (push! ts
+                  (thread-start!
+                   (make-thread
+                    (^[] (dotimes [m 10]
+                           (concurrent-hash-table-push! h "a" m)
+                           (concurrent-hash-table-push! h "b" n)))))))
+         (for-each thread-join! ts)
+         (list (length (concurrent-hash-table-get h "a"))
+               (length (concurrent-hash-table-get h "b")))))
+
+;;---------------------------------------------------------------------
+(test-section "concurrent symbol interning")
+
+;; Each thread interns the same fresh names in a different order.  It
+;; adds enough symbols to make the symbol table grow while the others
+;; are looking it up.
+(test* "concurrent string->symbol" #t
+       (let* ([names (map (cut format "concurrent-intern-test-~d" <>)
+                          (iota 20000))]
+              [ts (map (^k (thread-start!
+                            (make-thread
+                             (^[] (if (odd? k)
+                                    (reverse (map string->symbol
+                                                  (reverse names)))
+                                    (map string->symbol names))))))
+                       (iota 8))]
+              [rs (map thread-join! ts)])
+         (and (every (^r (every eq? r (car rs))) rs)
+              (every (^[sym name] (and (symbol-interned? sym)
+                                       (string=? (symbol->string sym) name)
+                                       (eq? sym (string->symbol name))))
+                     (car rs) names))))
+
 ;;---------------------------------------------------------------------
 (test-section "threads and promise")
 
@@ -607,6 +960,43 @@
          (enqueue! q 'a)
          (queue-push/wait! q 'b 0.01 "timed out!")))
 
+(let ()
+  (define (test-mpmc-queue name q nproducers nconsumers ndata batch?)
+    (define data (iota ndata))
+    (define results (make-mtqueue))
+    (define (producer k)
+      (let1 xs (filter (^n (= (modulo n nproducers) k)) data)
+        (if batch?
+          (mpmc-enqueue-list/wait! q xs)
+          (dolist [x xs] (mpmc-enqueue/wait! q x)))))
+    ;; Each consumer stops at an end marker #f.  A batch may carry
+    ;; markers for other consumers, which we put back.
+    (define (consumer)
+      (let loop ()
+        (let* ([xs (if batch?
+                     (mpmc-dequeue-list/wait! q 3)
+                     (list (mpmc-dequeue/wait! q)))]
+               [vals (delete #f xs)]
+               [nmarks (- (length xs) (length vals))])
+          (unless (null? vals) (apply enqueue! results vals))
+          (if (zero? nmarks)
+            (loop)
+            (dotimes [i (- nmarks 1)] (mpmc-enqueue/wait! q #f))))))
+    (test* #"mpmc-queue ~name" data
+           (let ([cs (map (^_ (thread-start! (make-thread consumer)))
+                          (iota nconsumers))]
+                 [ps (map (^k (thread-start! (make-thread (cut producer k))))
+                          (iota nproducers))])
+             (for-each thread-join! ps)
+             (dotimes [i nconsumers] (mpmc-enqueue/wait! q #f))
+             (for-each thread-join! cs)
+             (sort (queue->list results)))))
+
+  (test-mpmc-queue "(single item)" (make-mpmc-queue 4) 3 3 1000 #f)
+  (test-mpmc-queue "(batch)" (make-mpmc-queue 8) 3 3 1000 #t)
+  (test-mpmc-queue "(capacity 2)" (make-mpmc-queue 1) 2 2 300 #f)
+  )
+
 (test* "zero-length-queue handshaking" '(5 4 3 2 1 0)
        (let ([r '()]
              [q0 (make-mtqueue :max-length 0)]
@@ -650,5 +1040,56 @@
            (let1 r (list (dequeue/wait! qq) (dequeue/wait! qq))
              (list* r0 r1 r)))))
 
+;;---------------------------------------------------------------------
+(test-section "parallel sort")
+
+(use gauche.uvector)
+
+(let ()
+  (define (gen n f)
+    (list->vector (list-tabulate n (^i (f (modulo (* i 7919) 100003))))))
+  (define (t name vec)
+    (let1 exp (sort vec)
+      (test* #"parallel-sort ~name" exp (parallel-sort vec #f 4))
+      (test* #"parallel-stable-sort ~name" exp
+             (parallel-stable-sort vec #f 3))
+      (test* #"parallel-sort! ~name" exp
+             (let1 v (vector-copy vec) (parallel-sort! v #f 4) v))))
+  (t "fixnum" (gen 50000 (^i (- i 50000))))
+  (t "flonum" (gen 50000 (^i (/ i 3.0))))
+  (t "string" (gen 30000 number->string))
+  (t "small"  (gen 100 values))
+  (t "mixed (fallback)" (gen 10000 (^i (if (odd? i) i (+ i 0.5)))))
+
+  (test* "parallel-stable-sort! stability" #t
+         (let* ([v (gen 30000 (^i (string-copy (number->string (modulo i 7)))))]
+                [pos (make-hash-table 'eq?)])
+           (dotimes [i (vector-length v)] (hash-table-put! pos (vector-ref v i) i))
+           (parallel-stable-sort! v #f 4)
+           (let loop ([i 1])
+             (or (= i (vector-length v))
+                 (let ([a (vector-ref v (- i 1))] [b (vector-ref v i)])
+                   (and (or (string<? a b)
+                            (and (string=? a b)
+                                 (< (hash-table-get pos a)
+                                    (hash-table-get pos b))))
+                        (loop (+ i 1))))))))
+
+  (test* "parallel-sort (source intact)" #t
+         (let* ([v (gen 20000 values)] [v2 (vector-copy v)])
+           (parallel-sort v #f 4)
+           (equal? v v2)))
+  (test* "parallel-sort with cmp" (sort (gen 10000 values) >)
+         (parallel-sort (gen 10000 values) > 4))
+
+  (let1 uv (list->s32vector (vector->list (gen 50000 (^i (- (* i 13) 600000)))))
+    (test* "parallel-sort s32vector" (sort uv) (parallel-sort uv #f 4))
+    (test* "parallel-sort! s32vector" (sort uv)
+           (let1 v (s32vector-copy uv) (parallel-sort! v #f 4) v)))
+  (let1 uv (list->f64vector (vector->list (gen 50000 (^i (- (/ i 7.0) 5000)))))
+    (test* "parallel-stable-sort f64vector" (sort uv)
+           (parallel-stable-sort uv #f 3)))
+  )
+
 (test-end)
 
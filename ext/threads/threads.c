@@ -31,10 +31,12 @@
  *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#define _GNU_SOURCE  /* for Linux, this enables CPU affinity and thread names */
 #include <gauche.h>
 #include <gauche/vm.h>
 #include <gauche/extend.h>
 #include <gauche/exception.h>
+#include <gauche/priv/probeP.h>
 #include "threads.h"
 
 #ifdef HAVE_UNISTD_H
@@ -43,11 +45,50 @@
 #ifdef HAVE_SCHED_H
 #include <sched.h>
 #endif
+#ifdef HAVE_SYS_RESOURCE_H
+#include <sys/resource.h>
+#endif
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
+/* Platform capabilities of the thread start options.  Affinity is
+   given to pthread attributes, so that the thread never runs on other
+   CPUs; priority and name are set by the new thread itself. */
+#if defined(GAUCHE_USE_PTHREADS) && defined(__GLIBC__) && defined(CPU_SET)
+#define AFFINITY_PTHREAD_ATTR 1
+#elif defined(GAUCHE_USE_WTHREADS)
+#define AFFINITY_WIN32_MASK 1
+#endif
+#if defined(GAUCHE_USE_PTHREADS) && defined(__linux__) && defined(SYS_gettid) \
+    && defined(HAVE_SYS_RESOURCE_H)
+#define PRIORITY_LINUX_NICE 1
+#endif
+#if defined(GAUCHE_USE_PTHREADS) && defined(__GLIBC__) \
+    && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 12))
+#define OSNAME_GLIBC 1
+#elif defined(GAUCHE_USE_PTHREADS) && defined(__APPLE__)
+#define OSNAME_DARWIN 1
+#endif
+#define OSNAME_MAX 15           /* glibc's limit, excluding NUL */
 
 /*==============================================================
  * Thread interface
  */
 
+/* USDT probes.  The semaphores must reside in this DSO, since the
+   probe sites are here; see gauche/priv/probeP.h. */
+#if defined(GAUCHE_USE_SDT)
+SCM_PROBE_DEFINE_SEMAPHORE(thread__start);
+SCM_PROBE_DEFINE_SEMAPHORE(thread__stop);
+
+static const char *probe_thread_name(ScmVM *vm)
+{
+    if (SCM_STRINGP(vm->name)) return Scm_GetStringConst(SCM_STRING(vm->name));
+    return NULL;
+}
+#endif /*GAUCHE_USE_SDT*/
+
 /* Creation.  In the "NEW" state, a VM is allocated but actual thread
    is not created. */
 ScmObj Scm_MakeThread(ScmProcedure *thunk, ScmObj name)
@@ -87,16 +128,57 @@ static void thread_cleanup_inner(ScmVM *vm)
 static void thread_cleanup(void *data)
 {
     ScmVM *vm = SCM_VM(data);
+    if (SCM_PROBE_ENABLED(thread__stop)) {
+        SCM_PROBE2(thread__stop, vm, probe_thread_name(vm));
+    }
     SCM_INTERNAL_MUTEX_LOCK(vm->vmlock);
     thread_cleanup_inner(vm);
     SCM_INTERNAL_MUTEX_UNLOCK(vm->vmlock);
+    /* The VM won't run again; let a new thread reuse its stack. */
+    Scm_VMReleaseStack(vm);
     Scm_DetachVM(vm);
 }
 
 #if defined(GAUCHE_HAS_THREADS)
+/* Passed to thread_entry; carries the start options the new thread
+   has to apply by itself. */
+typedef struct thread_start_rec {
+    ScmVM *vm;
+    const char *osName;         /* NULL if not to set */
+    int setPriority;
+    int priority;
+} thread_start;
+
+static void set_os_name(const char *name)
+{
+#if defined(OSNAME_GLIBC)
+    (void)pthread_setname_np(pthread_self(), name);
+#elif defined(OSNAME_DARWIN)
+    (void)pthread_setname_np(name);
+#else
+    (void)name;                 /* best effort */
+#endif
+}
+
+static void set_priority(int priority)
+{
+#if defined(PRIORITY_LINUX_NICE)
+    /* On Linux, the nice value is per-thread, addressed by tid. */
+    int r;
+    SCM_SYSCALL(r, setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid),
+                               priority));
+    if (r < 0) Scm_SysError("couldn't set thread priority to %d", priority);
+#else
+    (void)priority;
+#endif
+}
+
 static SCM_INTERNAL_THREAD_PROC_RETTYPE thread_entry(void *data)
 {
-    ScmVM *vm = SCM_VM(data);
+    thread_start *start = (thread_start*)data;
+    ScmVM *vm = start->vm;
+
+    if (start->osName) set_os_name(start->osName);
 
     if (!Scm_AttachVM(vm)) {
         vm->resultException =
@@ -104,7 +186,11 @@ static SCM_INTERNAL_THREAD_PROC_RETTYPE thread_entry(void *data)
         thread_cleanup(vm);
     } else {
         SCM_INTERNAL_THREAD_CLEANUP_PUSH(thread_cleanup, vm);
+        if (SCM_PROBE_ENABLED(thread__start)) {
+            SCM_PROBE2(thread__start, vm, probe_thread_name(vm));
+        }
         SCM_UNWIND_PROTECT {
+            if (start->setPriority) set_priority(start->priority);
             vm->result = Scm_ApplyRec(SCM_OBJ(vm->thunk), SCM_NIL);
         } SCM_WHEN_ERROR {
             switch (vm->escapeReason) {
@@ -151,8 +237,96 @@ static struct threadRec {
    uncollected.
  */
 ScmObj Scm_ThreadStart(ScmVM *vm)
+{
+    return Scm_ThreadStartWithOptions(vm, NULL);
+}
+
+/* Thread name for the OS, truncated to OSNAME_MAX bytes without
+   breaking a multibyte character. */
+static const char *os_thread_name(ScmObj name)
+{
+    if (!SCM_STRINGP(name)) return NULL;
+    const char *s = Scm_GetStringConst(SCM_STRING(name));
+    size_t size = strlen(s);
+    if (size > OSNAME_MAX) {
+        size = OSNAME_MAX;
+        while (size > 0 && (s[size] & 0xc0) == 0x80) size--;
+    }
+    char *buf = SCM_NEW_ATOMIC_ARRAY(char, size+1);
+    memcpy(buf, s, size);
+    buf[size] = '\0';
+    return buf;
+}
+
+#if defined(AFFINITY_PTHREAD_ATTR)
+static void cpus_to_set(ScmObj cpus, cpu_set_t *set)
+{
+    ScmObj cp;
+    CPU_ZERO(set);
+    SCM_FOR_EACH(cp, cpus) {
+        ScmObj c = SCM_CAR(cp);
+        if (!SCM_INTP(c) || SCM_INT_VALUE(c) < 0
+            || SCM_INT_VALUE(c) >= CPU_SETSIZE) {
+            Scm_Error("CPU number must be an integer between 0 and %d, "
+                      "but got: %S", CPU_SETSIZE-1, c);
+        }
+        CPU_SET(SCM_INT_VALUE(c), set);
+    }
+}
+#elif defined(AFFINITY_WIN32_MASK)
+static DWORD_PTR cpus_to_mask(ScmObj cpus)
+{
+    ScmObj cp;
+    DWORD_PTR mask = 0;
+    SCM_FOR_EACH(cp, cpus) {
+        ScmObj c = SCM_CAR(cp);
+        if (!SCM_INTP(c) || SCM_INT_VALUE(c) < 0
+            || SCM_INT_VALUE(c) >= (ScmSmallInt)(sizeof(DWORD_PTR)*8)) {
+            Scm_Error("CPU number must be an integer between 0 and %d, "
+                      "but got: %S", (int)(sizeof(DWORD_PTR)*8-1), c);
+        }
+        mask |= ((DWORD_PTR)1) << SCM_INT_VALUE(c);
+    }
+    return mask;
+}
+#endif
+
+/* Start a thread with OPTS, which may be NULL to take the defaults.
+   The options that the platform can't honor raise an error, except
+   the OS thread name, which is a mere hint. */
+ScmObj Scm_ThreadStartWithOptions(ScmVM *vm, const ScmThreadStartOptions *opts)
 {
     int err_state = FALSE, err_create = FALSE;
+    ScmObj cpus = (opts && SCM_PAIRP(opts->cpus)) ? opts->cpus : SCM_NIL;
+    size_t stackSize = opts ? opts->stackSize : 0;
+
+#if !defined(AFFINITY_PTHREAD_ATTR) && !defined(AFFINITY_WIN32_MASK)
+    if (!SCM_NULLP(cpus)) {
+        Scm_Error("CPU affinity isn't supported on this platform");
+    }
+#endif
+#if !defined(PRIORITY_LINUX_NICE)
+    if (opts && opts->setPriority) {
+        Scm_Error("thread priority isn't supported on this platform");
+    }
+#endif
+
+#if defined(GAUCHE_HAS_THREADS)
+    thread_start *start = SCM_NEW(thread_start);
+    start->vm = vm;
+    start->osName = os_thread_name((opts && SCM_STRINGP(opts->osName))
+                                   ? opts->osName : vm->name);
+    start->setPriority = opts ? opts->setPriority : FALSE;
+    start->priority = opts ? opts->priority : 0;
+#endif /*GAUCHE_HAS_THREADS*/
+
+    /* Check CPU numbers before touching the VM state. */
+#if defined(AFFINITY_PTHREAD_ATTR)
+    cpu_set_t cpuset;
+    if (!SCM_NULLP(cpus)) cpus_to_set(cpus, &cpuset);
+#elif defined(AFFINITY_WIN32_MASK)
+    DWORD_PTR cpumask = SCM_NULLP(cpus) ? 0 : cpus_to_mask(cpus);
+#endif
 
     (void)SCM_INTERNAL_MUTEX_LOCK(vm->vmlock);
     if (vm->state != SCM_VM_NEW) {
@@ -166,24 +340,42 @@ ScmObj Scm_ThreadStart(ScmVM *vm)
             sigset_t omask;
             pthread_attr_init(&thattr);
             pthread_attr_setdetachstate(&thattr, PTHREAD_CREATE_DETACHED);
-            pthread_sigmask(SIG_SETMASK, &threadrec.defaultSigmask, &omask);
-            if (pthread_create(&vm->thread, &thattr, thread_entry, vm) != 0) {
-                vm->state = SCM_VM_NEW;
+            if (stackSize > 0) {
+                if (pthread_attr_setstacksize(&thattr, stackSize) != 0) {
+                    err_create = TRUE;
+                }
+            }
+#if defined(AFFINITY_PTHREAD_ATTR)
+            if (!SCM_NULLP(cpus)
+                && pthread_attr_setaffinity_np(&thattr, sizeof(cpuset),
+                                               &cpuset) != 0) {
                 err_create = TRUE;
             }
-            pthread_sigmask(SIG_SETMASK, &omask, NULL);
+#endif /*AFFINITY_PTHREAD_ATTR*/
+            if (!err_create) {
+                pthread_sigmask(SIG_SETMASK, &threadrec.defaultSigmask, &omask);
+                if (pthread_create(&vm->thread, &thattr,
+                                   thread_entry, start) != 0) {
+                    err_create = TRUE;
+                }
+                pthread_sigmask(SIG_SETMASK, &omask, NULL);
+            }
+            if (err_create) vm->state = SCM_VM_NEW;
             pthread_attr_destroy(&thattr);
         }
 #elif defined(GAUCHE_USE_WTHREADS)
         {
             HANDLE h = GC_CreateThread(NULL, /* security */
-                                       0,    /* default stack size */
+                                       stackSize, /* 0 for default */
                                        thread_entry, /* start proc */
-                                       vm,           /* parameter */
+                                       start,        /* parameter */
                                        0,            /* flags */
                                        NULL);        /* thread id receiver */
             if (h != NULL) {
                 vm->thread = h;
+#if defined(AFFINITY_WIN32_MASK)
+                if (cpumask) (void)SetThreadAffinityMask(h, cpumask);
+#endif /*AFFINITY_WIN32_MASK*/
             } else {
                 vm->state = SCM_VM_NEW;
                 err_create = TRUE;
@@ -199,6 +391,52 @@ ScmObj Scm_ThreadStart(ScmVM *vm)
     return SCM_OBJ(vm);
 }
 
+/* Returns a list of CPU numbers the process is allowed to run on,
+   or #f if we can't tell. */
+ScmObj Scm_ThreadAvailableCPUs(void)
+{
+#if defined(AFFINITY_PTHREAD_ATTR)
+    cpu_set_t set;
+    ScmObj h = SCM_NIL, t = SCM_NIL;
+    if (sched_getaffinity(0, sizeof(set), &set) < 0) return SCM_FALSE;
+    for (int i = 0; i < CPU_SETSIZE; i++) {
+        if (CPU_ISSET(i, &set)) SCM_APPEND1(h, t, SCM_MAKE_INT(i));
+    }
+    return h;
+#elif defined(AFFINITY_WIN32_MASK)
+    DWORD_PTR pmask, smask;
+    ScmObj h = SCM_NIL, t = SCM_NIL;
+    if (!GetProcessAffinityMask(GetCurrentProcess(), &pmask, &smask)) {
+        return SCM_FALSE;
+    }
+    for (int i = 0; i < (int)(sizeof(DWORD_PTR)*8); i++) {
+        if (pmask & (((DWORD_PTR)1) << i)) SCM_APPEND1(h, t, SCM_MAKE_INT(i));
+    }
+    return h;
+#else
+    return SCM_FALSE;
+#endif
+}
+
+/* Returns a list of the start options supported on this platform. */
+ScmObj Scm_ThreadStartOptionsSupported(void)
+{
+    ScmObj h = SCM_NIL, t = SCM_NIL;
+#if defined(AFFINITY_PTHREAD_ATTR) || defined(AFFINITY_WIN32_MASK)
+    SCM_APPEND1(h, t, SCM_MAKE_KEYWORD("cpus"));
+#endif
+#if defined(GAUCHE_HAS_THREADS)
+    SCM_APPEND1(h, t, SCM_MAKE_KEYWORD("os-stack-size"));
+#endif
+#if defined(PRIORITY_LINUX_NICE)
+    SCM_APPEND1(h, t, SCM_MAKE_KEYWORD("priority"));
+#endif
+#if defined(OSNAME_GLIBC) || defined(OSNAME_DARWIN)
+    SCM_APPEND1(h, t, SCM_MAKE_KEYWORD("os-name"));
+#endif
+    return h;
+}
+
 /* Thread join */
 ScmObj Scm_ThreadJoin(ScmVM *target, ScmObj timeout, ScmObj timeoutval)
 {
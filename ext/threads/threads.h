@@ -34,6 +34,8 @@
 #ifndef GAUCHE_THREADS_H
 #define GAUCHE_THREADS_H
 
+#include <gauche/prof.h>        /* ScmLockStat */
+
 #if defined(EXTTHREADS_EXPORTS)
 #define LIBGAUCHE_EXT_BODY
 #endif
@@ -51,6 +53,29 @@ extern ScmObj Scm_ThreadCont(ScmVM *vm);
 extern ScmObj Scm_ThreadSleep(ScmObj timeout);
 extern ScmObj Scm_ThreadTerminate(ScmVM *vm);
 
+/* Options to create the OS thread.  Zero-filled options are the
+   same as the defaults. */
+typedef struct ScmThreadStartOptionsRec {
+    ScmObj cpus;                /* list of CPU numbers to run on;
+                                   not a pair for any CPU */
+    size_t stackSize;           /* OS thread stack in bytes; 0 for default */
+    int setPriority;            /* TRUE to set priority */
+    int priority;               /* nice value on Linux */
+    ScmObj osName;              /* OS thread name; if not a string, the
+                                   Scheme thread name is used if any */
+} ScmThreadStartOptions;
+
+extern ScmObj Scm_ThreadStartWithOptions(ScmVM *vm,
+                                         const ScmThreadStartOptions *opts);
+extern ScmObj Scm_ThreadAvailableCPUs(void);
+extern ScmObj Scm_ThreadStartOptionsSupported(void);
+
+/* See src/lazy.c for why we avoid native atomic ops on these platforms */
+#if defined(__SH4__) || defined(__ARMEL__)
+#define AO_USE_PTHREAD_DEFS 1
+#endif
+#include "atomic_ops.h"
+
 /*---------------------------------------------------------
  * SYNCHRONIZATION DEVICES
  *
@@ -80,10 +105,15 @@ ScmObj Scm_ConditionVariableBroadcast(ScmConditionVariable *cond);
 
 /*
  * Scheme mutex.
- *    locked=FALSE  owner=dontcare       unlocked/not-abandoned
- *    locked=TRUE   owner=NULL           locked/not-owned
- *    locked=TRUE   owner=active vm      locked/owned
- *    locked=TRUE   owner=terminated vm  unlocked/abandoned
+ *    lock=UNLOCKED  owner=dontcare       unlocked/not-abandoned
+ *    lock=other     owner=NULL           locked/not-owned
+ *    lock=other     owner=active vm      locked/owned
+ *    lock=other     owner=terminated vm  unlocked/abandoned
+ *
+ *  The lock word is manipulated by CAS, so that an uncontended lock
+ *  and unlock don't touch the internal mutex.  The internal mutex and
+ *  cv are only used to park contending threads.  See mutex.c for the
+ *  state transitions.
  */
 typedef struct ScmMutexRec {
     SCM_INSTANCE_HEADER;
@@ -91,18 +121,28 @@ typedef struct ScmMutexRec {
     ScmInternalCond  cv;
     ScmObj name;
     ScmObj specific;
-    int   locked;
+    volatile AO_t lock;        /* SCM_MUTEX_UNLOCKED etc. */
+    int   spin;                /* max rounds to spin before parking */
     ScmVM *owner;              /* the thread who owns this lock; may be NULL */
     ScmObj locker_proc;        /* subr thunk to lock this mutex */
     ScmObj unlocker_proc;      /* subr thunk to unlock this mutex */
+    ScmLockStat *lockStat;     /* contention statistics; see prof.h */
 } ScmMutex;
 
+enum {
+    SCM_MUTEX_UNLOCKED = 0,
+    SCM_MUTEX_LOCKED = 1,       /* locked, no one is parked */
+    SCM_MUTEX_CONTENDED = 2,    /* locked, someone may be parked */
+    SCM_MUTEX_HANDOFF = 3       /* being released by mutex-unlock! with cv */
+};
+
 SCM_CLASS_DECL(Scm_MutexClass);
 #define SCM_CLASS_MUTEX        (&Scm_MutexClass)
 #define SCM_MUTEX(obj)         ((ScmMutex*)obj)
 #define SCM_MUTEXP(obj)        SCM_XTYPEP(obj, SCM_CLASS_MUTEX)
 
 ScmObj Scm_MakeMutex(ScmObj name);
+ScmObj Scm_MakeMutexFull(ScmObj name, int adaptive);
 ScmObj Scm_MutexLock(ScmMutex *mutex, ScmObj timeout, ScmVM *owner);
 ScmObj Scm_MutexUnlock(ScmMutex *mutex, ScmConditionVariable *cv, ScmObj timeout);
 ScmObj Scm_MutexLocker(ScmMutex *mutex);
@@ -110,23 +150,124 @@ ScmObj Scm_MutexUnlocker(ScmMutex *mutex);
 
 /*
  * Scheme reader/writer lock.
+ *
+ *  The lock word holds the number of active readers, shifted by
+ *  SCM_RWLOCK_READER_SHIFT, and two flags.  Readers get in by an atomic
+ *  increment as long as neither flag is set, and writers by CAS from
+ *  zero.  Threads that have to wait park on the internal mutex/cvs,
+ *  and set the WAITING flag so that unlockers know they need to wake
+ *  somebody.  Writers are preferred: once a writer is waiting, new
+ *  readers wait, too.
  */
 typedef struct ScmRWLockRec {
     SCM_HEADER;
     ScmInternalMutex mutex;
-    ScmInternalCond cond;
+    ScmInternalCond readerCv;
+    ScmInternalCond writerCv;
     ScmObj name;
     ScmObj specific;
-    int numReader;
-    int numWriter;
+    volatile AO_t lock;
+    int numWaitingReaders;      /* protected by mutex */
+    int numWaitingWriters;      /* protected by mutex */
 } ScmRWLock;
 
+#define SCM_RWLOCK_WRITER        1
+#define SCM_RWLOCK_WAITING       2
+#define SCM_RWLOCK_READER_SHIFT  2
+
 SCM_CLASS_DECL(Scm_RWLockClass);
 #define SCM_CLASS_RWLOCK       (&Scm_RWLockClass)
 #define SCM_RWLOCK(obj)        ((ScmRWLock*)obj)
 #define SCM_RWLOCKP(obj)       SCM_XTYPEP(obj, SCM_CLASS_RWLOCK)
 
 ScmObj Scm_MakeRWLock(ScmObj name);
+ScmObj Scm_RWLockReadLock(ScmRWLock *rw, ScmObj timeout);
+void   Scm_RWLockReadUnlock(ScmRWLock *rw);
+ScmObj Scm_RWLockWriteLock(ScmRWLock *rw, ScmObj timeout);
+void   Scm_RWLockWriteUnlock(ScmRWLock *rw);
+ScmObj Scm_RWLockState(ScmRWLock *rw);
+
+/*---------------------------------------------------------
+ * Atomic boxes
+ *
+ *  An atomic box holds a Scheme object, and an atomic fixnum holds
+ *  a C long, both in an AO_t so that they can be accessed and updated
+ *  without locking.
+ */
+
+typedef struct ScmAtomicBoxRec {
+    SCM_HEADER;
+    volatile AO_t value;
+} ScmAtomicBox;
+
+SCM_CLASS_DECL(Scm_AtomicBoxClass);
+#define SCM_CLASS_ATOMIC_BOX   (&Scm_AtomicBoxClass)
+#define SCM_ATOMIC_BOX(obj)    ((ScmAtomicBox*)obj)
+#define SCM_ATOMIC_BOX_P(obj)  SCM_XTYPEP(obj, SCM_CLASS_ATOMIC_BOX)
+
+SCM_CLASS_DECL(Scm_AtomicFixnumClass);
+#define SCM_CLASS_ATOMIC_FIXNUM   (&Scm_AtomicFixnumClass)
+#define SCM_ATOMIC_FIXNUM(obj)    ((ScmAtomicBox*)obj)
+#define SCM_ATOMIC_FIXNUM_P(obj)  SCM_XTYPEP(obj, SCM_CLASS_ATOMIC_FIXNUM)
+
+ScmObj Scm_MakeAtomicBox(ScmObj value);
+ScmObj Scm_AtomicBoxRef(ScmAtomicBox *box);
+void   Scm_AtomicBoxSet(ScmAtomicBox *box, ScmObj value);
+ScmObj Scm_AtomicBoxSwap(ScmAtomicBox *box, ScmObj value);
+ScmObj Scm_AtomicBoxCompareAndSwap(ScmAtomicBox *box,
+                                   ScmObj expected, ScmObj value);
+
+ScmObj Scm_MakeAtomicFixnum(long value);
+long   Scm_AtomicFixnumRef(ScmAtomicBox *box);
+void   Scm_AtomicFixnumSet(ScmAtomicBox *box, long value);
+long   Scm_AtomicFixnumSwap(ScmAtomicBox *box, long value);
+long   Scm_AtomicFixnumCompareAndSwap(ScmAtomicBox *box,
+                                      long expected, long value);
+long   Scm_AtomicFixnumAdd(ScmAtomicBox *box, long delta);
+
+/*---------------------------------------------------------
+ * Concurrent hash table
+ */
+
+typedef struct ScmConcurrentHashStripeRec {
+    ScmInternalMutex mutex;
+    ScmHashCore core;
+} ScmConcurrentHashStripe;
+
+typedef struct ScmConcurrentHashTableRec {
+    SCM_HEADER;
+    ScmHashType type;
+    int numStripes;             /* power of 2 */
+    int stripeBits;             /* log2(numStripes) */
+    ScmHashProc *hashfn;
+    ScmConcurrentHashStripe *stripes;
+} ScmConcurrentHashTable;
+
+SCM_CLASS_DECL(Scm_ConcurrentHashTableClass);
+#define SCM_CLASS_CONCURRENT_HASH_TABLE   (&Scm_ConcurrentHashTableClass)
+#define SCM_CONCURRENT_HASH_TABLE(obj)    ((ScmConcurrentHashTable*)obj)
+#define SCM_CONCURRENT_HASH_TABLE_P(obj)  SCM_XTYPEP(obj, SCM_CLASS_CONCURRENT_HASH_TABLE)
+
+ScmObj Scm_MakeConcurrentHashTable(ScmHashType type, int numStripes);
+ScmObj Scm_ConcurrentHashTableRef(ScmConcurrentHashTable *ht,
+                                  ScmObj key, ScmObj fallback);
+ScmObj Scm_ConcurrentHashTableSet(ScmConcurrentHashTable *ht,
+                                  ScmObj key, ScmObj value);
+int    Scm_ConcurrentHashTableDelete(ScmConcurrentHashTable *ht, ScmObj key);
+ScmObj Scm_ConcurrentHashTablePush(ScmConcurrentHashTable *ht,
+                                   ScmObj key, ScmObj value);
+int    Scm_ConcurrentHashTableCompareAndSwap(ScmConcurrentHashTable *ht,
+                                             ScmObj key, ScmObj expected,
+                                             ScmObj newval, ScmObj absent);
+int    Scm_ConcurrentHashTableNumEntries(ScmConcurrentHashTable *ht);
+void   Scm_ConcurrentHashTableClear(ScmConcurrentHashTable *ht);
+ScmObj Scm_ConcurrentHashTableToAlist(ScmConcurrentHashTable *ht);
+
+/*---------------------------------------------------------
+ * Parallel sort
+ */
+
+ScmObj Scm_ParallelSort(ScmObj seq, int stable, int nthreads, int inplace);
 
 
 #endif /*GAUCHE_THREADS_H*/
@@ -39,11 +39,13 @@
           thread? make-thread thread-name thread-specific-set! thread-specific
           thread-state thread-start! thread-yield! thread-sleep!
           thread-join! thread-terminate! thread-stop! thread-cont!
+          thread-available-cpus thread-start-options-supported
+          thread-stack-pool-size
 
-          mutex? make-mutex mutex-name mutex-state
+          mutex? make-mutex make-adaptive-mutex mutex-name mutex-state
           mutex-specific-set! mutex-specific
           with-locking-mutex mutex-lock! mutex-unlock!
-          mutex-locker mutex-unlocker
+          mutex-locker mutex-unlocker mutex-lock-stat
 
           condition-variable? make-condition-variable condition-variable-name
           condition-variable-specific condition-variable-specific-set!
@@ -53,7 +55,30 @@
           terminated-thread-exception? uncaught-exception?
           uncaught-exception-reason
 
-          atom atom? atom-ref atomic atomic-update!))
+          <rwlock> make-rwlock rwlock? rwlock-name rwlock-state
+          rwlock-specific rwlock-specific-set!
+          rwlock-read-lock! rwlock-read-unlock!
+          rwlock-write-lock! rwlock-write-unlock!
+          with-read-lock with-write-lock
+
+          atom atom? atom-ref atomic atomic-update!
+
+          <atomic-box> make-atomic-box atomic-box? atomic-box-ref
+          atomic-box-set! atomic-box-swap! atomic-box-compare-and-swap!
+          <atomic-fixnum> make-atomic-fixnum atomic-fixnum? atomic-fixnum-ref
+          atomic-fixnum-set! atomic-fixnum-swap!
+          atomic-fixnum-compare-and-swap! atomic-fixnum-add!
+
+          make-concurrent-hash-table concurrent-hash-table?
+          concurrent-hash-table-get concurrent-hash-table-put!
+          concurrent-hash-table-delete! concurrent-hash-table-contains?
+          concurrent-hash-table-push! concurrent-hash-table-update!
+          concurrent-hash-table-compare-and-swap!
+          concurrent-hash-table-num-entries concurrent-hash-table-clear!
+          concurrent-hash-table->alist
+
+          parallel-sort parallel-sort! parallel-stable-sort
+          parallel-stable-sort!))
 (select-module gauche.threads)
 
 (inline-stub
@@ -61,11 +86,15 @@
 
  (declcode
   "extern void Scm_Init_mutex(ScmModule*);"
+  "extern void Scm_Init_chash(ScmModule*);"
+  "extern void Scm_Init_atomic(ScmModule*);"
   "extern void Scm_Init_threads(ScmModule*);")
 
  (initcode
   "Scm_Init_threads(Scm_CurrentModule());"
-  "Scm_Init_mutex(Scm_CurrentModule());"))
+  "Scm_Init_mutex(Scm_CurrentModule());"
+  "Scm_Init_chash(Scm_CurrentModule());"
+  "Scm_Init_atomic(Scm_CurrentModule());"))
 
 ;;===============================================================
 ;; System query
@@ -100,10 +129,16 @@
      (slot-ref thread 'specific))
    thread-specific-set!))
 
-(define (make-thread thunk :optional (name #f))
+(define (make-thread thunk :optional (name #f) (stack-size #f))
   (rlet1 t (%make-thread thunk name)
+    (when stack-size (%thread-stack-size-set! t stack-size))
     ((with-module gauche.internal %vm-custom-error-reporter-set!) t (^e #f))))
 
+(define thread-stack-pool-size
+  (getter-with-setter
+   (^[] (%thread-stack-pool-size))
+   (^[n] (%thread-stack-pool-size-set! n))))
+
 (inline-stub
  (define-cproc thread-state (vm::<thread>)
    (case (-> vm state)
@@ -116,7 +151,37 @@
 
  (define-cproc %make-thread (thunk::<procedure> name) Scm_MakeThread)
 
- (define-cproc thread-start! (vm::<thread>) Scm_ThreadStart)
+ (define-cproc %thread-stack-size-set! (vm::<thread> size::<fixnum>) ::<void>
+   Scm_VMSetStackSize)
+
+ (define-cproc %thread-stack-pool-size () ::<int> Scm_VMStackPoolSize)
+ (define-cproc %thread-stack-pool-size-set! (size::<fixnum>) ::<void>
+   Scm_VMSetStackPoolSize)
+
+ ;; The keyword arguments are applied to the OS thread; see
+ ;; Scm_ThreadStartWithOptions.
+ (define-cproc thread-start! (vm::<thread> :key (cpus #f) (os-stack-size #f)
+                              (priority #f) (os-name #f))
+   (let* ([opts::ScmThreadStartOptions])
+     (unless (or (SCM_FALSEP cpus) (SCM_LISTP cpus))
+       (Scm_Error "list of CPU numbers or #f required, but got: %S" cpus))
+     (unless (or (SCM_FALSEP os-name) (SCM_STRINGP os-name))
+       (Scm_Error "string or #f required for os-name, but got: %S" os-name))
+     (set! (ref opts cpus) cpus
+           (ref opts stackSize) (?: (SCM_FALSEP os-stack-size)
+                                    0
+                                    (Scm_GetIntegerU os-stack-size))
+           (ref opts setPriority) (not (SCM_FALSEP priority))
+           (ref opts priority) (?: (SCM_FALSEP priority)
+                                   0
+                                   (Scm_GetInteger priority))
+           (ref opts osName) os-name)
+     (return (Scm_ThreadStartWithOptions vm (& opts)))))
+
+ (define-cproc thread-available-cpus () Scm_ThreadAvailableCPUs)
+
+ (define-cproc thread-start-options-supported ()
+   Scm_ThreadStartOptionsSupported)
 
  (define-cproc thread-yield! () ::<void> Scm_YieldCPU)
 
@@ -167,6 +232,8 @@
 
 (inline-stub
  (define-cproc make-mutex (:optional (name #f)) Scm_MakeMutex)
+ (define-cproc make-adaptive-mutex (:optional (name #f))
+   (return (Scm_MakeMutexFull name TRUE)))
 
  (define-cise-stmt with-mutex
    [(_ mutex . form)
@@ -190,6 +257,8 @@
 
  (define-cproc mutex-locker (mutex::<mutex>) Scm_MutexLocker)
  (define-cproc mutex-unlocker (mutex::<mutex>) Scm_MutexUnlocker)
+ (define-cproc mutex-lock-stat (mutex::<mutex>)
+   (return (Scm_LockStatToList (-> mutex lockStat))))
  )
 
 ;;===============================================================
@@ -224,6 +293,55 @@
     Scm_ConditionVariableBroadcast)
   )
 
+;;===============================================================
+;; Reader/writer lock
+;;
+
+(inline-stub
+ (define-type <rwlock> "ScmRWLock*" "reader/writer lock"
+   "SCM_RWLOCKP" "SCM_RWLOCK")
+
+ (define-cproc make-rwlock (:optional (name #f)) Scm_MakeRWLock)
+ (define-cproc rwlock? (obj) ::<boolean> SCM_RWLOCKP)
+ (define-cproc rwlock-state (rw::<rwlock>) Scm_RWLockState)
+
+ (define-cproc rwlock-read-lock! (rw::<rwlock> :optional (timeout #f))
+   Scm_RWLockReadLock)
+ (define-cproc rwlock-read-unlock! (rw::<rwlock>) ::<void>
+   Scm_RWLockReadUnlock)
+ (define-cproc rwlock-write-lock! (rw::<rwlock> :optional (timeout #f))
+   Scm_RWLockWriteLock)
+ (define-cproc rwlock-write-unlock! (rw::<rwlock>) ::<void>
+   Scm_RWLockWriteUnlock)
+ )
+
+(define (rwlock-name rw)
+  (check-arg rwlock? rw)
+  (slot-ref rw 'name))
+
+(define (rwlock-specific-set! rw value)
+  (check-arg rwlock? rw)
+  (slot-set! rw 'specific value))
+
+(define rwlock-specific
+  (getter-with-setter
+   (^[rw]
+     (check-arg rwlock? rw)
+     (slot-ref rw 'specific))
+   rwlock-specific-set!))
+
+(define-inline (with-read-lock rw thunk)
+  (dynamic-wind
+      (^[] (rwlock-read-lock! rw))
+      thunk
+      (^[] (rwlock-read-unlock! rw))))
+
+(define-inline (with-write-lock rw thunk)
+  (dynamic-wind
+      (^[] (rwlock-write-lock! rw))
+      thunk
+      (^[] (rwlock-write-unlock! rw))))
+
 ;;===============================================================
 ;; Exceptions
 ;;
@@ -290,3 +408,154 @@
 (define (atom-ref atom :optional (index 0) (timeout #f) (timeout-val #f))
   (unless (atom? atom) (error "atom required, but got:" atom))
   ((atom-applier atom) (^ xs (list-ref xs index)) timeout timeout-val))
+
+;;===============================================================
+;; Atomic boxes
+;;
+
+(inline-stub
+ (define-type <atomic-box> "ScmAtomicBox*" "atomic box"
+   "SCM_ATOMIC_BOX_P" "SCM_ATOMIC_BOX")
+ (define-type <atomic-fixnum> "ScmAtomicBox*" "atomic fixnum"
+   "SCM_ATOMIC_FIXNUM_P" "SCM_ATOMIC_FIXNUM")
+
+ (define-cproc make-atomic-box (value) Scm_MakeAtomicBox)
+ (define-cproc atomic-box? (obj) ::<boolean> SCM_ATOMIC_BOX_P)
+ (define-cproc atomic-box-ref (box::<atomic-box>) Scm_AtomicBoxRef)
+ (define-cproc atomic-box-set! (box::<atomic-box> value) ::<void>
+   Scm_AtomicBoxSet)
+ (define-cproc atomic-box-swap! (box::<atomic-box> value) Scm_AtomicBoxSwap)
+ (define-cproc atomic-box-compare-and-swap! (box::<atomic-box> expected value)
+   Scm_AtomicBoxCompareAndSwap)
+
+ (define-cproc make-atomic-fixnum (value::<long>) Scm_MakeAtomicFixnum)
+ (define-cproc atomic-fixnum? (obj) ::<boolean> SCM_ATOMIC_FIXNUM_P)
+ (define-cproc atomic-fixnum-ref (box::<atomic-fixnum>) ::<long>
+   Scm_AtomicFixnumRef)
+ (define-cproc atomic-fixnum-set! (box::<atomic-fixnum> value::<long>)
+   ::<void> Scm_AtomicFixnumSet)
+ (define-cproc atomic-fixnum-swap! (box::<atomic-fixnum> value::<long>)
+   ::<long> Scm_AtomicFixnumSwap)
+ (define-cproc atomic-fixnum-compare-and-swap! (box::<atomic-fixnum>
+                                                expected::<long>
+                                                value::<long>)
+   ::<long> Scm_AtomicFixnumCompareAndSwap)
+ (define-cproc atomic-fixnum-add! (box::<atomic-fixnum> delta::<long>)
+   ::<long> Scm_AtomicFixnumAdd)
+ )
+
+;;===============================================================
+;; Concurrent hash table
+;;
+
+(inline-stub
+ (define-type <concurrent-hash-table> "ScmConcurrentHashTable*"
+   "concurrent hash table"
+   "SCM_CONCURRENT_HASH_TABLE_P" "SCM_CONCURRENT_HASH_TABLE")
+
+ (define-cproc %make-concurrent-hash-table (type num-stripes::<int>)
+   (let* ([ctype::int 0])
+     (cond [(SCM_EQ type 'eq?)      (set! ctype SCM_HASH_EQ)]
+           [(SCM_EQ type 'eqv?)     (set! ctype SCM_HASH_EQV)]
+           [(SCM_EQ type 'equal?)   (set! ctype SCM_HASH_EQUAL)]
+           [(SCM_EQ type 'string=?) (set! ctype SCM_HASH_STRING)]
+           [else (Scm_Error "unsupported concurrent hash table type: %S"
+                            type)])
+     (return (Scm_MakeConcurrentHashTable ctype num-stripes))))
+
+ (define-cproc concurrent-hash-table? (obj) ::<boolean>
+   SCM_CONCURRENT_HASH_TABLE_P)
+
+ (define-cproc concurrent-hash-table-get (ht::<concurrent-hash-table> key
+                                          :optional fallback)
+   (let* ([r (Scm_ConcurrentHashTableRef ht key fallback)])
+     (when (SCM_UNBOUNDP r)
+       (Scm_Error "concurrent hash table doesn't have an entry for key %S"
+                  key))
+     (return r)))
+
+ (define-cproc concurrent-hash-table-contains? (ht::<concurrent-hash-table>
+                                                key)
+   ::<boolean>
+   (return (not (SCM_UNBOUNDP (Scm_ConcurrentHashTableRef ht key
+                                                          SCM_UNBOUND)))))
+
+ (define-cproc concurrent-hash-table-put! (ht::<concurrent-hash-table>
+                                           key value) ::<void>
+   (Scm_ConcurrentHashTableSet ht key value))
+
+ (define-cproc concurrent-hash-table-delete! (ht::<concurrent-hash-table>
+                                              key) ::<boolean>
+   Scm_ConcurrentHashTableDelete)
+
+ (define-cproc concurrent-hash-table-push! (ht::<concurrent-hash-table>
+                                            key value) ::<void>
+   (Scm_ConcurrentHashTablePush ht key value))
+
+ (define-cproc concurrent-hash-table-compare-and-swap!
+   (ht::<concurrent-hash-table> key expected newval :optional absent)
+   ::<boolean>
+   Scm_ConcurrentHashTableCompareAndSwap)
+
+ (define-cproc concurrent-hash-table-num-entries (ht::<concurrent-hash-table>)
+   ::<int> Scm_ConcurrentHashTableNumEntries)
+
+ (define-cproc concurrent-hash-table-clear! (ht::<concurrent-hash-table>)
+   ::<void> Scm_ConcurrentHashTableClear)
+
+ (define-cproc concurrent-hash-table->alist (ht::<concurrent-hash-table>)
+   Scm_ConcurrentHashTableToAlist)
+ )
+
+(define (make-concurrent-hash-table :optional (type 'eq?) (num-stripes 0))
+  (%make-concurrent-hash-table type num-stripes))
+
+;; PROC is called without holding a lock, so it may be called more than
+;; once if other threads modify the entry concurrently.  The update is
+;; committed only if the entry hasn't changed since we read it.
+(define %absent (list 'absent))
+
+(define (concurrent-hash-table-update! ht key proc :optional fallback)
+  (let loop ()
+    (let1 old (concurrent-hash-table-get ht key %absent)
+      (when (and (eq? old %absent) (undefined? fallback))
+        (error "concurrent hash table doesn't have an entry for key" key))
+      (let1 new (proc (if (eq? old %absent) fallback old))
+        (if (concurrent-hash-table-compare-and-swap! ht key old new %absent)
+          new
+          (loop))))))
+
+;;===============================================================
+;; Parallel sort
+;;
+
+(inline-stub
+ (define-cproc %parallel-sort (seq stable::<boolean> nthreads::<int>
+                                   inplace::<boolean>)
+   Scm_ParallelSort)
+ )
+
+;; The worker threads compare elements in C without VM, so we can only
+;; parallelize the default ordering, and only when the elements are of
+;; the types the C kernels know (fixnums, flonums, strings or symbols),
+;; or the sequence is a uniform vector.  Otherwise, we fall back to the
+;; sequential sort.
+(define (%parallel-sort-1 seq cmp nthreads stable? inplace?)
+  (or (and (or (not cmp) (eq? cmp default-comparator))
+           (or (vector? seq) (uvector? seq))
+           (%parallel-sort seq stable?
+                           (or nthreads (sys-available-processors))
+                           inplace?))
+      (let1 args (if cmp (list cmp) '())
+        (if inplace?
+          (apply (if stable? stable-sort! sort!) seq args)
+          (apply (if stable? stable-sort sort) seq args)))))
+
+(define (parallel-sort seq :optional (cmp #f) (nthreads #f))
+  (%parallel-sort-1 seq cmp nthreads #f #f))
+(define (parallel-sort! seq :optional (cmp #f) (nthreads #f))
+  (%parallel-sort-1 seq cmp nthreads #f #t))
+(define (parallel-stable-sort seq :optional (cmp #f) (nthreads #f))
+  (%parallel-sort-1 seq cmp nthreads #t #f))
+(define (parallel-stable-sort! seq :optional (cmp #f) (nthreads #f))
+  (%parallel-sort-1 seq cmp nthreads #t #t))
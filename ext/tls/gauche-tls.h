@@ -44,6 +44,11 @@
 #if defined(GAUCHE_USE_AXTLS)
 #include "axTLS/ssl/ssl.h"
 #else /*!GAUCHE_USE_AXTLS*/
+#if defined(GAUCHE_USE_OPENSSL)
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#endif /*GAUCHE_USE_OPENSSL*/
+/* These are axTLS flags; we keep them for the compatibility of API. */
 #define SSL_CLIENT_AUTHENTICATION               0x00010000
 #define SSL_SERVER_VERIFY_LATER                 0x00020000
 #define SSL_NO_DEFAULT_KEY                      0x00040000
@@ -63,11 +68,12 @@ SCM_DECL_BEGIN
 
 typedef struct ScmTLSRec {
   SCM_HEADER;
-#if defined(GAUCHE_USE_AXTLS)
+#if defined(GAUCHE_USE_AXTLS) || defined(GAUCHE_USE_OPENSSL)
   SSL_CTX* ctx;
   SSL* conn;
   ScmPort* in_port, * out_port;
-#endif /*GAUCHE_USE_AXTLS*/
+  int reused;                   /* TRUE if the session is resumed */
+#endif /*GAUCHE_USE_AXTLS || GAUCHE_USE_OPENSSL*/
 } ScmTLS;
 
 SCM_CLASS_DECL(Scm_TLSClass);
@@ -76,12 +82,33 @@ SCM_CLASS_DECL(Scm_TLSClass);
 #define SCM_TLS(obj)    ((ScmTLS*)obj)
 #define SCM_TLSP(obj)   SCM_XTYPEP(obj, SCM_CLASS_TLS)
 
+/* A TLS session taken from an established connection, which can be
+   passed to a later connection to the same server to resume
+   the session and skip the full handshake. */
+typedef struct ScmTLSSessionRec {
+  SCM_HEADER;
+#if defined(GAUCHE_USE_AXTLS)
+  uint8_t id[SSL_SESSION_ID_SIZE];
+  uint8_t id_size;
+#elif defined(GAUCHE_USE_OPENSSL)
+  SSL_SESSION* session;
+#endif
+} ScmTLSSession;
+
+SCM_CLASS_DECL(Scm_TLSSessionClass);
+
+#define SCM_CLASS_TLS_SESSION   (&Scm_TLSSessionClass)
+#define SCM_TLS_SESSION(obj)    ((ScmTLSSession*)obj)
+#define SCM_TLS_SESSION_P(obj)  SCM_XTYPEP(obj, SCM_CLASS_TLS_SESSION)
+
 extern ScmObj Scm_MakeTLS(uint32_t options, int num_sessions);
 extern ScmObj Scm_TLSDestroy(ScmTLS* t);
 extern ScmObj Scm_TLSLoadObject(ScmTLS* t, ScmObj obj_type,
                                 const char *filename,
                                 const char *password);
 extern ScmObj Scm_TLSConnect(ScmTLS* t, int fd);
+extern ScmObj Scm_TLSConnectFull(ScmTLS* t, int fd, ScmObj session,
+                                 const char* hostname);
 extern ScmObj Scm_TLSAccept(ScmTLS* t, int fd);
 extern ScmObj Scm_TLSClose(ScmTLS* t);
 
@@ -94,6 +121,9 @@ extern ScmObj Scm_TLSClose(ScmTLS* t);
 extern ScmObj Scm_TLSRead(ScmTLS* t);
 extern ScmObj Scm_TLSWrite(ScmTLS* t, ScmObj msg);
 
+extern ScmObj Scm_TLSSession(ScmTLS* t);
+extern int    Scm_TLSSessionReusedP(ScmTLS* t);
+
 extern ScmObj Scm_TLSInputPort(ScmTLS* t);
 extern ScmObj Scm_TLSOutputPort(ScmTLS* t);
 
@@ -45,4 +45,82 @@
   ]
  [else])
 
+(cond-expand
+ [gauche.net.tls
+  (test* "tls-session before connect" #f
+         (let* ([t (make-tls #f 1)]
+                [r (guard (e [else #f]) (tls-session t))])
+           (tls-destroy t)
+           (is-a? r <tls-session>)))]
+ [else])
+
+;; Loopback connections.  The server echoes a line back.  The client
+;; connects twice, resuming the session of the first connection in the
+;; second one.
+(cond-expand
+ [(and gauche.net.tls gauche.sys.threads)
+  (use gauche.net)
+  (use gauche.threads)
+
+  (define (test-file name)
+    (find-file-in-paths (build-path "axTLS/ssl/test" name)
+                        :paths *load-path* :pred file-exists?))
+
+  (define server-tls (make-tls SSL_SERVER_VERIFY_LATER 5))
+  (tls-load-object server-tls SSL_OBJ_X509_CERT
+                   (test-file "axTLS.x509_1024.pem"))
+  (tls-load-object server-tls SSL_OBJ_RSA_KEY
+                   (test-file "axTLS.key_1024.pem"))
+
+  (define server-socket (make-server-socket 'inet 0 :reuse-addr? #t))
+  (define server-port (sockaddr-port (socket-address server-socket)))
+
+  (define server-thread
+    (thread-start!
+     (make-thread
+      (^[]
+        (dotimes (i 2)
+          (let1 s (socket-accept server-socket)
+            (guard (e [else (report-error e)])
+              (tls-accept server-tls (socket-fd s))
+              (let1 line (read-line (tls-input-port server-tls))
+                (display line (tls-output-port server-tls))
+                (newline (tls-output-port server-tls))
+                (flush (tls-output-port server-tls)))
+              (tls-close server-tls))
+            (socket-close s)))))))
+
+  (define client-tls (make-tls))
+
+  ;; Returns the echoed line, whether the session is resumed, and
+  ;; the session.
+  (define (echo-client session)
+    (let ([s (make-client-socket 'inet "127.0.0.1" server-port)]
+          [t client-tls])
+      (unwind-protect
+          (begin
+            (tls-connect t (socket-fd s) session "localhost")
+            (display "hello\n" (tls-output-port t))
+            (flush (tls-output-port t))
+            (let1 line (read-line (tls-input-port t))
+              (list line (tls-session-reused? t) (tls-session t))))
+        (tls-close t)
+        (socket-close s))))
+
+  (define first-connection #f)
+
+  (test* "tls-connect (full handshake)" '("hello" #f #t)
+         (let1 r (echo-client #f)
+           (set! first-connection r)
+           (list (car r) (cadr r) (is-a? (caddr r) <tls-session>))))
+  (test* "tls-connect (resumed)" '("hello" #t)
+         (let1 r (echo-client (caddr first-connection))
+           (list (car r) (cadr r))))
+
+  (thread-join! server-thread)
+  (socket-close server-socket)
+  (tls-destroy client-tls)
+  (tls-destroy server-tls)]
+ [else])
+
 (test-end)
@@ -34,9 +34,22 @@
 #include "gauche-tls.h"
 #include <gauche/extend.h>
 
+/*
+ * Backends
+ *   GAUCHE_USE_AXTLS   - the bundled axTLS.
+ *   GAUCHE_USE_OPENSSL - the system's OpenSSL (or a compatible library,
+ *                        e.g. LibreSSL), selected by --enable-tls=openssl.
+ *                        It uses hardware-accelerated crypto where
+ *                        available, and establishes connections much faster.
+ */
+#if defined(GAUCHE_USE_AXTLS) || defined(GAUCHE_USE_OPENSSL)
+#define HAVE_TLS_BACKEND 1
+#endif
+
 static void tls_print(ScmObj obj, ScmPort* port, ScmWriteContext* ctx);
 
 SCM_DEFINE_BUILTIN_CLASS_SIMPLE(Scm_TLSClass, tls_print);
+SCM_DEFINE_BUILTIN_CLASS_SIMPLE(Scm_TLSSessionClass, NULL);
 
 static void tls_print(ScmObj obj, ScmPort* port, ScmWriteContext* ctx)
 {
@@ -46,6 +59,21 @@ static void tls_print(ScmObj obj, ScmPort* port, ScmWriteContext* ctx)
     Scm_Printf(port, ">");
 }
 
+#if defined(GAUCHE_USE_OPENSSL)
+/* Raises an error with the reason taken from OpenSSL's error queue. */
+static void tls_error(ScmTLS* t, int r, const char* op)
+{
+    int e = t->conn? SSL_get_error(t->conn, r) : SSL_ERROR_SSL;
+    unsigned long code = ERR_get_error();
+    ERR_clear_error();
+    if (e == SSL_ERROR_SYSCALL && code == 0 && r < 0) {
+        Scm_SysError("%s failed", op);
+    }
+    Scm_Error("%s failed: %s", op,
+              code? ERR_error_string(code, NULL) : "unexpected EOF");
+}
+#endif /*GAUCHE_USE_OPENSSL*/
+
 static void tls_finalize(ScmObj obj, void* data)
 {
     ScmTLS* t = SCM_TLS(obj);
@@ -55,21 +83,27 @@ static void tls_finalize(ScmObj obj, void* data)
         ssl_ctx_free(t->ctx);
         t->ctx = NULL;
     }
-#endif /*GAUCHE_USE_AXTLS*/
+#elif defined(GAUCHE_USE_OPENSSL)
+    if (t->ctx) {
+        Scm_TLSClose(t);
+        SSL_CTX_free(t->ctx);
+        t->ctx = NULL;
+    }
+#endif
 }
 
 static void context_check(ScmTLS* tls, const char* op)
 {
-#if defined(GAUCHE_USE_AXTLS)
+#if defined(HAVE_TLS_BACKEND)
     if (!tls->ctx) Scm_Error("attempt to %s destroyed TLS: %S", op, tls);
-#endif /*GAUCHE_USE_AXTLS*/
+#endif /*HAVE_TLS_BACKEND*/
 }
 
 static void close_check(ScmTLS* tls, const char* op)
 {
-#if defined(GAUCHE_USE_AXTLS)
+#if defined(HAVE_TLS_BACKEND)
     if (!tls->conn) Scm_Error("attempt to %s closed TLS: %S", op, tls);
-#endif /*GAUCHE_USE_AXTLS*/
+#endif /*HAVE_TLS_BACKEND*/
 }
 
 ScmObj Scm_MakeTLS(uint32_t options, int num_sessions)
@@ -80,7 +114,38 @@ ScmObj Scm_MakeTLS(uint32_t options, int num_sessions)
     t->ctx = ssl_ctx_new(options, num_sessions);
     t->conn = NULL;
     t->in_port = t->out_port = 0;
-#endif /*GAUCHE_USE_AXTLS*/
+    t->reused = FALSE;
+#elif defined(GAUCHE_USE_OPENSSL)
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+    t->ctx = SSL_CTX_new(TLS_method());
+#else
+    t->ctx = SSL_CTX_new(SSLv23_method());
+#endif
+    if (t->ctx == NULL) {
+        Scm_Error("SSL_CTX_new failed: %s",
+                  ERR_error_string(ERR_get_error(), NULL));
+    }
+    t->conn = NULL;
+    t->in_port = t->out_port = 0;
+    t->reused = FALSE;
+    SSL_CTX_set_options(t->ctx, SSL_OP_NO_SSLv2|SSL_OP_NO_SSLv3);
+    if (!(options & SSL_SERVER_VERIFY_LATER)) {
+        int mode = SSL_VERIFY_PEER;
+        if (options & SSL_CLIENT_AUTHENTICATION) {
+            mode |= SSL_VERIFY_FAIL_IF_NO_PEER_CERT;
+        }
+        SSL_CTX_set_verify(t->ctx, mode, NULL);
+        SSL_CTX_set_default_verify_paths(t->ctx);
+    }
+    /* NUM_SESSIONS is the size of the server-side session cache, as
+       in axTLS.  Clients resume sessions explicitly; see Scm_TLSSession. */
+    SSL_CTX_set_session_id_context(t->ctx, (const unsigned char*)"gauche", 6);
+    if (num_sessions > 0) {
+        SSL_CTX_sess_set_cache_size(t->ctx, num_sessions);
+    } else {
+        SSL_CTX_set_session_cache_mode(t->ctx, SSL_SESS_CACHE_OFF);
+    }
+#endif
     Scm_RegisterFinalizer(SCM_OBJ(t), tls_finalize, NULL);
     return SCM_OBJ(t);
 }
@@ -90,12 +155,14 @@ ScmObj Scm_MakeTLS(uint32_t options, int num_sessions)
    up all fds, so explicit destruction is recommended whenever possible. */
 ScmObj Scm_TLSDestroy(ScmTLS* t)
 {
-#if defined(GAUCHE_USE_AXTLS)
+#if defined(HAVE_TLS_BACKEND)
     tls_finalize(SCM_OBJ(t), NULL);
-#endif /*GAUCHE_USE_AXTLS*/
+#endif /*HAVE_TLS_BACKEND*/
     return SCM_TRUE;
 }
 
+/* Closes the connection.  The context is kept, so the same TLS object
+   can be used for another connection. */
 ScmObj Scm_TLSClose(ScmTLS* t)
 {
 #if defined(GAUCHE_USE_AXTLS)
@@ -104,7 +171,15 @@ ScmObj Scm_TLSClose(ScmTLS* t)
         t->conn = 0;
         t->in_port = t->out_port = 0;
     }
-#endif /*GAUCHE_USE_AXTLS*/
+#elif defined(GAUCHE_USE_OPENSSL)
+    if (t->ctx && t->conn) {
+        (void)SSL_shutdown(t->conn);
+        SSL_free(t->conn);
+        ERR_clear_error();
+        t->conn = 0;
+        t->in_port = t->out_port = 0;
+    }
+#endif
     return SCM_TRUE;
 }
 
@@ -115,21 +190,112 @@ ScmObj Scm_TLSLoadObject(ScmTLS* t, ScmObj obj_type,
     uint32_t type = Scm_GetIntegerU32Clamp(obj_type, SCM_CLAMP_ERROR, NULL);
     if (ssl_obj_load(t->ctx, type, filename, password) == SSL_OK)
         return SCM_TRUE;
-#endif /*GAUCHE_USE_AXTLS*/
+#elif defined(GAUCHE_USE_OPENSSL)
+    uint32_t type = Scm_GetIntegerU32Clamp(obj_type, SCM_CLAMP_ERROR, NULL);
+    int r = 0;
+    context_check(t, "load an object into");
+    SSL_CTX_set_default_passwd_cb_userdata(t->ctx, (void*)password);
+    switch (type) {
+    case SSL_OBJ_X509_CERT:
+        r = SSL_CTX_use_certificate_file(t->ctx, filename, SSL_FILETYPE_PEM)
+            || SSL_CTX_use_certificate_file(t->ctx, filename,
+                                            SSL_FILETYPE_ASN1);
+        break;
+    case SSL_OBJ_X509_CACERT:
+        r = SSL_CTX_load_verify_locations(t->ctx, filename, NULL);
+        break;
+    case SSL_OBJ_RSA_KEY:
+    case SSL_OBJ_PKCS8:
+        r = SSL_CTX_use_PrivateKey_file(t->ctx, filename, SSL_FILETYPE_PEM)
+            || SSL_CTX_use_PrivateKey_file(t->ctx, filename,
+                                           SSL_FILETYPE_ASN1);
+        break;
+    default:
+        /* PKCS12 isn't supported */
+        break;
+    }
+    SSL_CTX_set_default_passwd_cb_userdata(t->ctx, NULL);
+    ERR_clear_error();
+    if (r == 1) return SCM_TRUE;
+#endif
     return SCM_FALSE;
 }
 
 ScmObj Scm_TLSConnect(ScmTLS* t, int fd)
 {
+    return Scm_TLSConnectFull(t, fd, SCM_FALSE, NULL);
+}
+
+#if defined(GAUCHE_USE_OPENSSL)
+/* Tells OpenSSL the name of the server we're connecting to.  It is sent
+   in the SNI extension, so that the server can choose the certificate,
+   and the peer certificate is checked against it.  Without the latter,
+   SSL_VERIFY_PEER accepts any certificate signed by a trusted CA.
+   An IP address literal is not sent in SNI (RFC 6066), and is matched
+   against the address in the certificate. */
+static void set_server_name(ScmTLS* t, const char* hostname)
+{
+    int ip = (strchr(hostname, ':') != NULL
+              || strspn(hostname, "0123456789.") == strlen(hostname));
+#if OPENSSL_VERSION_NUMBER >= 0x10002000L
+    X509_VERIFY_PARAM *param = SSL_get0_param(t->conn);
+    int r = (ip
+             ? X509_VERIFY_PARAM_set1_ip_asc(param, hostname)
+             : X509_VERIFY_PARAM_set1_host(param, hostname, 0));
+    if (r != 1) {
+        ERR_clear_error();
+        Scm_Error("invalid server name for TLS: %s", hostname);
+    }
+#endif
+    if (!ip && SSL_set_tlsext_host_name(t->conn, hostname) != 1) {
+        tls_error(t, 0, "SSL_set_tlsext_host_name");
+    }
+}
+#endif /*GAUCHE_USE_OPENSSL*/
+
+/* If SESSION is a <tls-session> taken from a previous connection to
+   the same server, we try to resume it.  If the server doesn't accept
+   it, a full handshake is done silently.
+   HOSTNAME, if not NULL, is the name of the server.  With OpenSSL,
+   it is used for SNI and for verification of the server certificate.
+   axTLS does neither. */
+ScmObj Scm_TLSConnectFull(ScmTLS* t, int fd, ScmObj session,
+                          const char* hostname)
+{
+    if (!SCM_FALSEP(session) && !SCM_TLS_SESSION_P(session)) {
+        Scm_TypeError("session", "<tls-session> or #f", session);
+    }
 #if defined(GAUCHE_USE_AXTLS)
     context_check(t, "connect");
     if (t->conn) Scm_SysError("attempt to connect already-connected TLS %S", t);
-    t->conn = ssl_client_new(t->ctx, fd, 0, 0);
+    const uint8_t *id = NULL;
+    uint8_t id_size = 0;
+    if (SCM_TLS_SESSION_P(session)) {
+        id = SCM_TLS_SESSION(session)->id;
+        id_size = SCM_TLS_SESSION(session)->id_size;
+    }
+    t->conn = ssl_client_new(t->ctx, fd, id, id_size);
     int r = ssl_handshake_status(t->conn);
     if (r != SSL_OK) {
         Scm_Error("TLS handshake failed: %d", r);
     }
-#endif /*GAUCHE_USE_AXTLS*/
+    t->reused = (id_size > 0
+                 && ssl_get_session_id_size(t->conn) == id_size
+                 && memcmp(ssl_get_session_id(t->conn), id, id_size) == 0);
+#elif defined(GAUCHE_USE_OPENSSL)
+    context_check(t, "connect");
+    if (t->conn) Scm_SysError("attempt to connect already-connected TLS %S", t);
+    t->conn = SSL_new(t->ctx);
+    if (t->conn == NULL) tls_error(t, 0, "SSL_new");
+    SSL_set_fd(t->conn, fd);
+    if (hostname) set_server_name(t, hostname);
+    if (SCM_TLS_SESSION_P(session)) {
+        SSL_set_session(t->conn, SCM_TLS_SESSION(session)->session);
+    }
+    int r = SSL_connect(t->conn);
+    if (r != 1) tls_error(t, r, "TLS handshake");
+    t->reused = SSL_session_reused(t->conn);
+#endif
     return SCM_OBJ(t);
 }
 
@@ -139,10 +305,68 @@ ScmObj Scm_TLSAccept(ScmTLS* t, int fd)
     context_check(t, "accept");
     if (t->conn) Scm_SysError("attempt to connect already-connected TLS %S", t);
     t->conn = ssl_server_new(t->ctx, fd);
-#endif /*GAUCHE_USE_AXTLS*/
+#elif defined(GAUCHE_USE_OPENSSL)
+    context_check(t, "accept");
+    if (t->conn) Scm_SysError("attempt to connect already-connected TLS %S", t);
+    t->conn = SSL_new(t->ctx);
+    if (t->conn == NULL) tls_error(t, 0, "SSL_new");
+    SSL_set_fd(t->conn, fd);
+    int r = SSL_accept(t->conn);
+    if (r != 1) tls_error(t, r, "TLS handshake");
+    t->reused = SSL_session_reused(t->conn);
+#endif
     return SCM_OBJ(t);
 }
 
+#if defined(GAUCHE_USE_OPENSSL)
+static void tls_session_finalize(ScmObj obj, void* data)
+{
+    ScmTLSSession* s = SCM_TLS_SESSION(obj);
+    if (s->session) {
+        SSL_SESSION_free(s->session);
+        s->session = NULL;
+    }
+}
+#endif /*GAUCHE_USE_OPENSSL*/
+
+/* Returns the session of the current connection, or #f if it can't be
+   resumed. */
+ScmObj Scm_TLSSession(ScmTLS* t)
+{
+#if defined(HAVE_TLS_BACKEND)
+    context_check(t, "get the session of");
+    close_check(t, "get the session of");
+#endif /*HAVE_TLS_BACKEND*/
+#if defined(GAUCHE_USE_AXTLS)
+    uint8_t size = ssl_get_session_id_size(t->conn);
+    if (size == 0 || size > SSL_SESSION_ID_SIZE) return SCM_FALSE;
+    ScmTLSSession* s = SCM_NEW(ScmTLSSession);
+    SCM_SET_CLASS(s, SCM_CLASS_TLS_SESSION);
+    memcpy(s->id, ssl_get_session_id(t->conn), size);
+    s->id_size = size;
+    return SCM_OBJ(s);
+#elif defined(GAUCHE_USE_OPENSSL)
+    SSL_SESSION* sess = SSL_get1_session(t->conn);
+    if (sess == NULL) return SCM_FALSE;
+    ScmTLSSession* s = SCM_NEW(ScmTLSSession);
+    SCM_SET_CLASS(s, SCM_CLASS_TLS_SESSION);
+    s->session = sess;
+    Scm_RegisterFinalizer(SCM_OBJ(s), tls_session_finalize, NULL);
+    return SCM_OBJ(s);
+#else
+    return SCM_FALSE;
+#endif
+}
+
+int Scm_TLSSessionReusedP(ScmTLS* t)
+{
+#if defined(HAVE_TLS_BACKEND)
+    return (t->conn != NULL && t->reused);
+#else
+    return FALSE;
+#endif
+}
+
 ScmObj Scm_TLSRead(ScmTLS* t)
 {
 #if defined(GAUCHE_USE_AXTLS)
@@ -152,12 +376,25 @@ ScmObj Scm_TLSRead(ScmTLS* t)
     while ((r = ssl_read(t->conn, &buf)) == SSL_OK);
     if (r < 0) Scm_SysError("ssl_read() failed");
     return Scm_MakeString((char*) buf, r, r, SCM_STRING_INCOMPLETE);
-#else  /*!GAUCHE_USE_AXTLS*/
+#elif defined(GAUCHE_USE_OPENSSL)
+    context_check(t, "read");
+    close_check(t, "read");
+    char buf[16384];            /* maximum size of a TLS record */
+    int r = SSL_read(t->conn, buf, sizeof(buf));
+    if (r <= 0) {
+        if (SSL_get_error(t->conn, r) == SSL_ERROR_ZERO_RETURN) {
+            return Scm_MakeString("", 0, 0, SCM_STRING_INCOMPLETE);
+        }
+        tls_error(t, r, "SSL_read");
+    }
+    return Scm_MakeString(buf, r, r,
+                          SCM_STRING_INCOMPLETE|SCM_STRING_COPYING);
+#else  /*!HAVE_TLS_BACKEND*/
     return SCM_FALSE;
-#endif /*!GAUCHE_USE_AXTLS*/
+#endif /*!HAVE_TLS_BACKEND*/
 }
 
-#if defined(GAUCHE_USE_AXTLS)
+#if defined(HAVE_TLS_BACKEND)
 static const uint8_t* get_message_body(ScmObj msg, u_int *size)
 {
     if (SCM_UVECTORP(msg)) {
@@ -171,7 +408,7 @@ static const uint8_t* get_message_body(ScmObj msg, u_int *size)
         return 0;
     }
 }
-#endif /*GAUCHE_USE_AXTLS*/
+#endif /*HAVE_TLS_BACKEND*/
 
 ScmObj Scm_TLSWrite(ScmTLS* t, ScmObj msg)
 {
@@ -185,42 +422,56 @@ ScmObj Scm_TLSWrite(ScmTLS* t, ScmObj msg)
         Scm_SysError("ssl_write() failed");
     }
     return SCM_MAKE_INT(r);
-#else  /*!GAUCHE_USE_AXTLS*/
+#elif defined(GAUCHE_USE_OPENSSL)
+    context_check(t, "write");
+    close_check(t, "write");
+    u_int size;
+    const uint8_t* cmsg = get_message_body(msg, &size);
+    if (size == 0) return SCM_MAKE_INT(0);
+    int r = SSL_write(t->conn, cmsg, size);
+    if (r <= 0) tls_error(t, r, "SSL_write");
+    return SCM_MAKE_INT(r);
+#else  /*!HAVE_TLS_BACKEND*/
     return SCM_FALSE;
-#endif /*!GAUCHE_USE_AXTLS*/
+#endif /*!HAVE_TLS_BACKEND*/
 }
 
 ScmObj Scm_TLSInputPort(ScmTLS* t)
 {
-#if defined(GAUCHE_USE_AXTLS)
+#if defined(HAVE_TLS_BACKEND)
     return SCM_OBJ(t->in_port);
-#endif /*GAUCHE_USE_AXTLS*/
+#endif /*HAVE_TLS_BACKEND*/
 }
 
 ScmObj Scm_TLSOutputPort(ScmTLS* t)
 {
-#if defined(GAUCHE_USE_AXTLS)
+#if defined(HAVE_TLS_BACKEND)
     return SCM_OBJ(t->out_port);
-#endif /*GAUCHE_USE_AXTLS*/
+#endif /*HAVE_TLS_BACKEND*/
 }
 
 ScmObj Scm_TLSInputPortSet(ScmTLS* t, ScmObj port)
 {
-#if defined(GAUCHE_USE_AXTLS)
+#if defined(HAVE_TLS_BACKEND)
     t->in_port = SCM_PORT(port);
-#endif /*GAUCHE_USE_AXTLS*/
+#endif /*HAVE_TLS_BACKEND*/
     return port;
 }
 
 ScmObj Scm_TLSOutputPortSet(ScmTLS* t, ScmObj port)
 {
-#if defined(GAUCHE_USE_AXTLS)
+#if defined(HAVE_TLS_BACKEND)
     t->out_port = SCM_PORT(port);
-#endif /*GAUCHE_USE_AXTLS*/
+#endif /*HAVE_TLS_BACKEND*/
     return port;
 }
 
 void Scm_Init_tls(ScmModule *mod)
 {
     Scm_InitStaticClass(&Scm_TLSClass, "<tls>", mod, NULL, 0);
+    Scm_InitStaticClass(&Scm_TLSSessionClass, "<tls-session>", mod, NULL, 0);
+#if defined(GAUCHE_USE_OPENSSL)
+    SSL_library_init();
+    SSL_load_error_strings();
+#endif /*GAUCHE_USE_OPENSSL*/
 }
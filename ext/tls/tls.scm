@@ -38,6 +38,7 @@
   (export <tls> make-tls tls-destroy tls-connect tls-accept tls-close
           tls-load-object tls-read tls-write
           tls-input-port tls-output-port
+          <tls-session> tls-session tls-session-reused?
 
           SSL_SERVER_VERIFY_LATER SSL_CLIENT_AUTHENTICATION
           SSL_DISPLAY_BYTES SSL_DISPLAY_STATES SSL_DISPLAY_CERTS
@@ -51,6 +52,7 @@
  (declcode "#include \"gauche-tls.h\" ")
 
  (define-type <tls> "ScmTLS*")
+ (define-type <tls-session> "ScmTLSSession*")
 
  (define-enum SSL_SERVER_VERIFY_LATER)
  (define-enum SSL_CLIENT_AUTHENTICATION)
@@ -77,11 +79,16 @@
  (define-cproc tls-load-object (tls::<tls> obj-type filename::<const-cstring>
                                            :optional (password::<const-cstring>? #f)) Scm_TLSLoadObject)
  (define-cproc tls-destroy (tls::<tls>) Scm_TLSDestroy)
- (define-cproc %tls-connect (tls::<tls> fd::<long>) Scm_TLSConnect)
+ (define-cproc %tls-connect (tls::<tls> fd::<long> session
+                                         hostname::<const-cstring>?)
+   Scm_TLSConnectFull)
  (define-cproc %tls-accept (tls::<tls> fd::<long>) Scm_TLSAccept)
  (define-cproc %tls-close (tls::<tls>) Scm_TLSClose)
  (define-cproc tls-read (tls::<tls>) Scm_TLSRead)
  (define-cproc tls-write (tls::<tls> msg) Scm_TLSWrite)
+ (define-cproc tls-session (tls::<tls>) Scm_TLSSession)
+ (define-cproc tls-session-reused? (tls::<tls>) ::<boolean>
+   Scm_TLSSessionReusedP)
  (define-cproc tls-input-port (tls::<tls>) Scm_TLSInputPort)
  (define-cproc tls-output-port (tls::<tls>) Scm_TLSOutputPort)
  ;; internal
@@ -93,8 +100,12 @@
  )
 
 ;; API
-(define (tls-connect tls fd)
-  (%tls-connect tls fd) ;; done before ports in case of connect failure.
+;;  If SESSION is given, we try to resume it.
+;;  HOSTNAME is the name of the server, used for SNI and to verify
+;;  the server certificate.
+(define (tls-connect tls fd :optional (session #f) (hostname #f))
+  ;; done before ports in case of connect failure.
+  (%tls-connect tls fd session hostname)
   (tls-input-port-set! tls (make-tls-input-port tls))
   (tls-output-port-set! tls (make-tls-output-port tls))
   tls)
@@ -123,11 +134,15 @@
                 (rlet1 r (string-byte-ref buf pos)
                   (set! pos (+ pos 1))
                   (when (= pos size) (set! buf #f)))
-                (begin
-                  (set! buf (tls-read tls))
-                  (set! size (string-size buf))
-                  (set! pos 1)
-                  (string-byte-ref buf 0))))))))
+                (let1 s (tls-read tls)
+                  (if (zero? (string-size s))
+                    (eof-object)        ; the peer closed the connection
+                    (begin
+                      (set! buf s)
+                      (set! size (string-size s))
+                      (set! pos 1)
+                      (when (= pos size) (set! buf #f))
+                      (string-byte-ref s 0))))))))))
 
 (define (make-tls-output-port tls)
   (rlet1 op (make <virtual-output-port>)
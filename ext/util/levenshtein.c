@@ -0,0 +1,249 @@
+/*
+ * levenshtein.c - native edit distance of strings
+ *
+ *   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "levenshtein.h"
+#include <stdint.h>
+#include <string.h>
+
+/* Strings are decoded to arrays of ScmChar first; short ones go to
+   the buffer on the stack. */
+#define STACK_CHARS 128
+
+static const ScmChar *decode(ScmString *s, ScmSmallInt *plen,
+                             ScmChar *buf)
+{
+    unsigned int size, len, flags;
+    const char *p = Scm_GetStringContent(s, &size, &len, &flags);
+    ScmChar *v = (len <= STACK_CHARS)? buf : SCM_NEW_ATOMIC_ARRAY(ScmChar, len);
+
+    if (flags & SCM_STRING_INCOMPLETE) {
+        for (unsigned int i = 0; i < size; i++) v[i] = (unsigned char)p[i];
+        *plen = size;
+    } else {
+        for (unsigned int i = 0; i < len; i++) {
+            ScmChar ch;
+            SCM_CHAR_GET(p, ch);
+            p += SCM_CHAR_NBYTES(ch);
+            v[i] = ch;
+        }
+        *plen = len;
+    }
+    return v;
+}
+
+/*
+ * Bit-parallel algorithm.  Bit i of the vertical delta vectors PV/MV
+ * tells whether D[i+1][j] - D[i][j] is +1/-1, where i runs over the
+ * pattern (at most 64 characters) and j over the text.  We only keep
+ * track of the bottom row, D[m][j], as SCORE.
+ */
+typedef struct pattern_rec {
+    ScmSmallInt len;
+    uint64_t ascii[128];        /* match masks of ASCII characters */
+    int nother;
+    ScmChar otherc[64];         /* match masks of other characters */
+    uint64_t otherm[64];
+} pattern;
+
+static void pattern_init(pattern *pat, const ScmChar *p, ScmSmallInt len)
+{
+    SCM_ASSERT(len <= 64);
+    memset(pat->ascii, 0, sizeof(pat->ascii));
+    pat->len = len;
+    pat->nother = 0;
+    for (ScmSmallInt i = 0; i < len; i++) {
+        ScmChar c = p[i];
+        if (c >= 0 && c < 128) {
+            pat->ascii[c] |= (uint64_t)1 << i;
+        } else {
+            int k;
+            for (k = 0; k < pat->nother; k++) {
+                if (pat->otherc[k] == c) break;
+            }
+            if (k == pat->nother) {
+                pat->otherc[k] = c;
+                pat->otherm[k] = 0;
+                pat->nother++;
+            }
+            pat->otherm[k] |= (uint64_t)1 << i;
+        }
+    }
+}
+
+static inline uint64_t pattern_mask(const pattern *pat, ScmChar c)
+{
+    if (c >= 0 && c < 128) return pat->ascii[c];
+    for (int k = 0; k < pat->nother; k++) {
+        if (pat->otherc[k] == c) return pat->otherm[k];
+    }
+    return 0;
+}
+
+static ScmSmallInt bit_parallel(const pattern *pat,
+                                const ScmChar *t, ScmSmallInt n,
+                                ScmSmallInt cutoff)
+{
+    ScmSmallInt m = pat->len;
+    if (m == 0) return (cutoff >= 0 && n > cutoff)? -1 : n;
+
+    uint64_t pv = ~(uint64_t)0, mv = 0, hb = (uint64_t)1 << (m-1);
+    ScmSmallInt score = m;
+    for (ScmSmallInt j = 0; j < n; j++) {
+        uint64_t eq = pattern_mask(pat, t[j]);
+        uint64_t xv = eq | mv;
+        uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+        uint64_t ph = mv | ~(xh | pv);
+        uint64_t mh = pv & xh;
+        if (ph & hb) score++;
+        else if (mh & hb) score--;
+        /* the top row D[0][j] = j increases at every step */
+        ph = (ph << 1) | 1;
+        mh <<= 1;
+        pv = mh | ~(xv | ph);
+        mv = ph & xv;
+        /* The score can decrease at most by one per remaining column. */
+        if (cutoff >= 0 && score - (n - j - 1) > cutoff) return -1;
+    }
+    return (cutoff >= 0 && score > cutoff)? -1 : score;
+}
+
+/*
+ * Banded DP.  Only the cells with |i - j| <= k are calculated, where
+ * k is the cutoff; the ones outside of the band can't be on a path
+ * within the cutoff, and are treated as k+1.  Without cutoff, k is
+ * taken large enough to cover the whole matrix.  A single row is kept
+ * and updated in place.
+ */
+static ScmSmallInt banded(const ScmChar *a, ScmSmallInt n,
+                          const ScmChar *b, ScmSmallInt m,
+                          ScmSmallInt cutoff)
+{
+    ScmSmallInt k = (n > m)? n : m;
+    if (cutoff >= 0) {
+        if (cutoff < k) k = cutoff;
+        if (n - m > k || m - n > k) return -1;
+    }
+    ScmSmallInt inf = k + 1;
+    ScmSmallInt *d = SCM_NEW_ATOMIC_ARRAY(ScmSmallInt, n + 1);
+
+    for (ScmSmallInt i = 0; i <= n; i++) d[i] = (i < inf)? i : inf;
+    for (ScmSmallInt j = 1; j <= m; j++) {
+        ScmSmallInt lo = (j - k > 1)? j - k : 1;
+        ScmSmallInt hi = (j + k < n)? j + k : n;
+        ScmSmallInt diag = d[lo-1], left, rowmin;
+        ScmChar bc = b[j-1];
+
+        if (lo == 1) {
+            left = d[0] = (j < inf)? j : inf;
+        } else {
+            left = inf;
+        }
+        rowmin = left;
+        for (ScmSmallInt i = lo; i <= hi; i++) {
+            ScmSmallInt up = d[i];
+            ScmSmallInt v = diag + (a[i-1] != bc);
+            if (up + 1 < v) v = up + 1;
+            if (left + 1 < v) v = left + 1;
+            if (v > inf) v = inf;
+            diag = up;
+            d[i] = left = v;
+            if (v < rowmin) rowmin = v;
+        }
+        if (cutoff >= 0 && rowmin > k) return -1;
+    }
+    return (d[n] > k)? -1 : d[n];
+}
+
+static ScmSmallInt distance(const pattern *pat, /* for A, or NULL */
+                            const ScmChar *a, ScmSmallInt alen,
+                            ScmString *b, ScmSmallInt cutoff)
+{
+    ScmChar bbuf[STACK_CHARS];
+    ScmSmallInt blen;
+    const ScmChar *bv = decode(b, &blen, bbuf);
+
+    if (cutoff >= 0 && (alen - blen > cutoff || blen - alen > cutoff)) {
+        return -1;
+    }
+    if (pat) return bit_parallel(pat, bv, blen, cutoff);
+    if (blen <= 64) {
+        pattern bpat;
+        pattern_init(&bpat, bv, blen);
+        return bit_parallel(&bpat, a, alen, cutoff);
+    }
+    return banded(a, alen, bv, blen, cutoff);
+}
+
+ScmSmallInt LevenshteinStrings(ScmString *a, ScmString *b,
+                               ScmSmallInt cutoff)
+{
+    ScmChar abuf[STACK_CHARS];
+    ScmSmallInt alen;
+    const ScmChar *av = decode(a, &alen, abuf);
+
+    if (alen <= 64) {
+        pattern apat;
+        pattern_init(&apat, av, alen);
+        return distance(&apat, av, alen, b, cutoff);
+    }
+    return distance(NULL, av, alen, b, cutoff);
+}
+
+ScmObj LevenshteinStringsVector(ScmString *a, ScmVector *bs,
+                                ScmSmallInt cutoff)
+{
+    ScmChar abuf[STACK_CHARS];
+    ScmSmallInt alen, nb = SCM_VECTOR_SIZE(bs);
+    const ScmChar *av = decode(a, &alen, abuf);
+    pattern apat, *pat = NULL;
+
+    for (ScmSmallInt i = 0; i < nb; i++) {
+        if (!SCM_STRINGP(SCM_VECTOR_ELEMENT(bs, i))) {
+            Scm_Error("string required, but got %S", SCM_VECTOR_ELEMENT(bs, i));
+        }
+    }
+    /* The pattern of A is made once and shared by all candidates. */
+    if (alen <= 64) {
+        pattern_init(&apat, av, alen);
+        pat = &apat;
+    }
+
+    ScmObj r = Scm_MakeVector(nb, SCM_FALSE);
+    for (ScmSmallInt i = 0; i < nb; i++) {
+        ScmSmallInt d = distance(pat, av, alen,
+                                 SCM_STRING(SCM_VECTOR_ELEMENT(bs, i)),
+                                 cutoff);
+        if (d >= 0) SCM_VECTOR_ELEMENT(r, i) = SCM_MAKE_INT(d);
+    }
+    return r;
+}
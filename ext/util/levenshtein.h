@@ -0,0 +1,57 @@
+/*
+ * levenshtein.h - native edit distance of strings
+ *
+ *   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef GAUCHE_UTIL_LEVENSHTEIN_H
+#define GAUCHE_UTIL_LEVENSHTEIN_H
+
+#include <gauche.h>
+#include <gauche/extend.h>
+
+/* Levenshtein distance of two strings, compared by characters.
+   CUTOFF is a nonnegative integer or -1 (no cutoff); if the distance
+   exceeds CUTOFF, -1 is returned.
+
+   If either string has at most 64 characters, bit-parallel algorithm
+   (Myers 1999, in the form of Hyyro 2001) is used.  Otherwise it runs
+   DP limited to the diagonal band of width 2*CUTOFF+1, and gives up
+   as soon as every cell of a row exceeds CUTOFF.  */
+
+extern ScmSmallInt LevenshteinStrings(ScmString *a, ScmString *b,
+                                      ScmSmallInt cutoff);
+
+/* Distances between A and each string in the vector BS.  Returns
+   a vector of distances, with #f for those exceeding CUTOFF.  */
+extern ScmObj      LevenshteinStringsVector(ScmString *a, ScmVector *bs,
+                                            ScmSmallInt cutoff);
+
+#endif /*GAUCHE_UTIL_LEVENSHTEIN_H*/
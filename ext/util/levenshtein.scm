@@ -69,6 +69,35 @@
 ;;  hand, this one restricts how transposition is applied and is not
 ;;  fully compatible to Damerau-Levenshtein.
 
+;; Strings compared by characters with Levenshtein distance are
+;; the most common case, and they are handled by native code
+;; (levenshtein.c).  The Scheme versions below are used for other
+;; sequences and element comparators.
+
+(inline-stub
+ (declcode "#include \"levenshtein.h\"")
+
+ ;; cutoff is -1 for no cutoff
+ (define-cproc %l-distance-strings (a::<string> b::<string> cutoff::<fixnum>)
+   (let* ([d::ScmSmallInt (LevenshteinStrings a b cutoff)])
+     (return (?: (< d 0) SCM_FALSE (SCM_MAKE_INT d)))))
+
+ (define-cproc %l-distances-strings (a::<string> bs::<vector>
+                                     cutoff::<fixnum>)
+   (return (LevenshteinStringsVector a bs cutoff)))
+ )
+
+;; Character comparators that the native code can stand for.
+(define (char-elt=? elt=)
+  (memq elt= `(,eqv? ,eq? ,equal? ,char=?)))
+
+;; The plural versions accept a list or a vector of sequences, and
+;; return the results in the same type.
+(define (map-distances base A Bs elt= cutoff)
+  (if (vector? Bs)
+    (list->vector (base A (vector->list Bs) elt= cutoff))
+    (base A Bs elt= cutoff)))
+
 ;; It is often explaned using (N+k)x(M+k) array for dynamic programming
 ;; (k=1 or 2), but we only need to refer to look back at most k rows,
 ;; so we can run the algorithm with k+1 rows and rotating them.
@@ -147,10 +176,18 @@
     (map f Bs)))
       
 (define (l-distance A B :key (elt= eqv?) (cutoff #f))
-  (car (l-base A (list B) elt= cutoff)))
+  (if (and (string? A) (string? B) (char-elt=? elt=))
+    (%l-distance-strings A B (or cutoff -1))
+    (car (l-base A (list B) elt= cutoff))))
 
 (define (l-distances A Bs  :key (elt= eqv?) (cutoff #f))
-  (l-base A Bs elt= cutoff))
+  (cond [(and (string? A) (char-elt=? elt=)
+              (if (vector? Bs) (vector-every string? Bs) (every string? Bs)))
+         (if (vector? Bs)
+           (%l-distances-strings A Bs (or cutoff -1))
+           (vector->list (%l-distances-strings A (list->vector Bs)
+                                               (or cutoff -1))))]
+        [else (map-distances l-base A Bs elt= cutoff)]))
 
 ;; Restricted Edit distance
 ;;
@@ -222,7 +259,7 @@
   (car (re-base A (list B) elt= cutoff)))
 
 (define (re-distances A Bs  :key (elt= eqv?) (cutoff #f))
-  (re-base A Bs elt= cutoff))
+  (map-distances re-base A Bs elt= cutoff))
 
 ;; Damerau-Levenshtein distance
 ;; We need a way to look up the last character position seen in A.
@@ -295,4 +332,4 @@
   (car (dl-base A (list B) elt= cutoff)))
 
 (define (dl-distances A Bs  :key (elt= eqv?) (cutoff #f))
-  (dl-base A Bs elt= cutoff))
+  (map-distances dl-base A Bs elt= cutoff))
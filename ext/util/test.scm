@@ -144,6 +144,30 @@
                 (list a b)))
   )
 
+(test* "dispatch on tags" '((lit 1) (add 1 2) (neg 3) (sub 4 5)
+                            (call f (1 2)) (add* 1 2 3) (other (add))
+                            (var x) (other 7) (other (foo)))
+       (map (match-lambda
+              [(? number? n)   (list 'lit n)]
+              [('add x y)      (list 'add x y)]
+              [('neg x)        (list 'neg x)]
+              [('add x y . z)  (list* 'add* x y z)]
+              [('sub x y)      (list 'sub x y)]
+              [('call f a ...) (list 'call f a)]
+              [(? symbol? s)   (list 'var s)]
+              [other           (list 'other other)])
+            '(1 (add 1 2) (neg 3) (sub 4 5) (call f 1 2) (add 1 2 3) (add)
+              x 7 (foo))))
+
+(test* "dispatch on tags with failure continuation" '(a-big a-small b c (a))
+       (map (^[exp]
+              (match exp
+                [('a (? positive? n)) (=> fail) (if (> n 10) 'a-big (fail))]
+                [('a n) 'a-small]
+                [('b . _) 'b]
+                [('c . _) 'c]
+                [x x]))
+            '((a 20) (a 1) (b 2) (c) (a))))
 
 ;;--------------------------------------------------------------
 
@@ -16,6 +16,11 @@
 
 ;; Conceptually, an array is a backing storage and a procedure to
 ;; map n-dimensional indices to an index of the backing storage.
+;; Arrays created by this module have an affine mapper, which is also
+;; kept as an offset and a stride for each dimension.  Shared arrays
+;; (views) are created by calculating new offset and strides, so the
+;; cost doesn't depend on the size of the array, and accessing a view
+;; is as fast as accessing the original array.
 
 (define-module gauche.array
   (use srfi-1)
@@ -34,6 +39,8 @@
           array-for-each-index shape-for-each
           array-for-each-index-by-dimension
           array-for-each array-every array-any
+          subarray-view array-transpose-view array-slice-view
+          array-uvector-alias
           tabulate-array array-retabulate!
           array-map array-map! array->vector array->list
           make-u8array make-s8array make-u16array make-s16array
@@ -87,7 +94,13 @@
    (getter          :getter getter-of)
    (setter          :getter setter-of)
    (backing-storage :init-keyword :backing-storage
-                    :getter backing-storage-of))
+                    :getter backing-storage-of)
+   ;; If the mapper is affine, it calculates offset + strides . index.
+   ;; Both are #f if we don't know the mapper.
+   (offset          :init-keyword :offset  :init-value #f
+                    :getter offset-of)
+   (strides         :init-keyword :strides :init-value #f
+                    :getter strides-of))
   :metaclass <array-meta>)
 
 (define-method initialize ((self <array-base>) initargs)
@@ -183,11 +196,17 @@
   :backing-storage-length f64vector-length)
 
 (define-method copy-object ((self <array-base>))
-  (make (class-of self)
-    :start-vector (start-vector-of self)
-    :end-vector   (end-vector-of self)
-    :mapper       (mapper-of self)
-    :backing-storage (copy-object (backing-storage-of self))))
+  (if (or (array-dense? self) (not (strides-of self)))
+    (make (class-of self)
+      :start-vector (start-vector-of self)
+      :end-vector   (end-vector-of self)
+      :mapper       (mapper-of self)
+      :offset       (offset-of self)
+      :strides      (strides-of self)
+      :backing-storage (copy-object (backing-storage-of self)))
+    ;; a view; we only copy the elements it can see.
+    (rlet1 r (make-array-internal (class-of self) (array-shape self))
+      (array-map! r identity self))))
 
 ;; NB: these should be built-in; but here for now.
 (define-method copy-object ((self <vector>))    (vector-copy self))
@@ -213,31 +232,29 @@
 ;;    which calculates 1-dimentional offset off to the backing storage,
 ;;          from given index vector #s32(i0 i1 ... iN)
 ;;
-;;  Pre-calculation:
+;;  For a fresh array, the elements are stored in row-major order:
 ;;    sizes          s0 = e0 - b0, s1 = e1 - b1 ...
 ;;    coefficients   c0   = s1 * s2 * ... * sN
 ;;                   c1   = s2 * ... * sN
 ;;                   cN-1 = sN
 ;;                   cN   = 1
-;;
-;;  Mapping
 ;;   off = c0*(i0-b0) + c1*(i1-b1) + .. + cN*(iN-bN)
 ;;
+;;  In general, the mapping is off = offset + c0*i0 + ... + cN*iN,
+;;  where the strides c0 ... cN can be any integers.
 ;;
 
 (define (zero-vector? vec)
   (not (s32vector-range-check vec 0 0)))
 
-(define (generate-amap Vb Ve)
-  (let* ([rank    (s32vector-length Vb)]
-         [indices (iota rank)]
-         [Vs      (s32vector-sub Ve Vb)]
-         [-Vb     (map-to <s32vector> - Vb)]
-         [Ve-1    (s32vector-sub Ve 1)]
-         [vcl     (fold-right (^[sN l] (cons (* sN (car l)) l))
-                              '(1)
-                              (s32vector->list Vs))]
-         [Vc      (coerce-to <s32vector> (cdr vcl))])
+(define (row-major-strides Vb Ve)
+  (let1 vcl (fold-right (^[sN l] (cons (* sN (car l)) l))
+                        '(1)
+                        (s32vector->list (s32vector-sub Ve Vb)))
+    (coerce-to <s32vector> (cdr vcl))))
+
+(define (generate-amap Vb Ve offset Vc)
+  (let1 Ve-1 (s32vector-sub Ve 1)
     (^[Vi]
       (cond [(s32vector-range-check Ve-1 Vi #f)
              => (^i (errorf "index of dimension ~s is too big: ~s"
@@ -245,7 +262,19 @@
             [(s32vector-range-check Vb #f Vi)
              => (^i (errorf "index of dimension ~s is too small: ~s"
                             i (ref Vi i)))]
-            [else (s32vector-dot Vc (s32vector-add -Vb Vi))]))))
+            [else (+ offset (s32vector-dot Vc Vi))]))))
+
+;; Returns #t if the elements of AR occupy the whole backing storage
+;; in row-major order, so that we can scan the storage directly.
+(define (array-dense? ar)
+  (and-let* ([Vc (strides-of ar)]
+             [Vb (start-vector-of ar)]
+             [Ve (end-vector-of ar)])
+    (and (equal? Vc (row-major-strides Vb Ve))
+         (= (offset-of ar) (- (s32vector-dot Vc Vb)))
+         (= (array-size ar)
+            ((backing-storage-length-of (class-of ar))
+             (backing-storage-of ar))))))
 
 ;; shape index tests
 
@@ -302,6 +331,8 @@
         :start-vector (s32vector 0 0)
         :end-vector (s32vector rank 2)
         :mapper (^[Vi] (s32vector-dot (s32vector 2 1) Vi))
+        :offset 0
+        :strides (s32vector 2 1)
         :backing-storage (list->vector args)))))
 
 (define (shape->start/end-vector shape)
@@ -323,13 +354,17 @@
 
 (define (make-array-internal class shape . maybe-init)
   (receive (Vb Ve) (shape->start/end-vector shape)
-    (make class
-      :start-vector Vb
-      :end-vector Ve
-      :mapper (generate-amap Vb Ve)
-      :backing-storage (apply (backing-storage-creator-of class)
-                              (fold * 1 (s32vector-sub Ve Vb))
-                              maybe-init))))
+    (let* ([Vc (row-major-strides Vb Ve)]
+           [offset (- (s32vector-dot Vc Vb))])
+      (make class
+        :start-vector Vb
+        :end-vector Ve
+        :mapper (generate-amap Vb Ve offset Vc)
+        :offset offset
+        :strides Vc
+        :backing-storage (apply (backing-storage-creator-of class)
+                                (fold * 1 (s32vector-sub Ve Vb))
+                                maybe-init)))))
 
 (define (make-array shape . opt)
   (apply make-array-internal <array> shape opt))
@@ -472,11 +507,118 @@
 (define (share-array array shape proc)
   (receive (Vb Ve) (shape->start/end-vector shape)
     (receive (constants coeffs) (affine-proc->coeffs proc (size-of Vb))
-      (make (class-of array)
-        :start-vector Vb
-        :end-vector   Ve
-        :mapper (generate-shared-map (mapper-of array) constants coeffs)
-        :backing-storage (backing-storage-of array)))))
+      (if-let1 Vc (strides-of array)
+        (begin
+          (check-shared-range array Vb Ve constants coeffs)
+          (make-array-view array Vb Ve
+                           (+ (offset-of array) (s32vector-dot Vc constants))
+                           (fold (^[c cvec Vs] (s32vector-add Vs
+                                                              (s32vector-mul cvec c)))
+                                 (make-s32vector (size-of Vb) 0)
+                                 (s32vector->list Vc) coeffs)))
+        (make (class-of array)
+          :start-vector Vb
+          :end-vector   Ve
+          :mapper (generate-shared-map (mapper-of array) constants coeffs)
+          :backing-storage (backing-storage-of array))))))
+
+;; Creates an array that shares the backing storage of ARRAY, with the
+;; given affine mapping.
+(define (make-array-view array Vb Ve offset Vc)
+  (make (class-of array)
+    :start-vector Vb
+    :end-vector   Ve
+    :mapper (generate-amap Vb Ve offset Vc)
+    :offset offset
+    :strides Vc
+    :backing-storage (backing-storage-of array)))
+
+;; Since the affine mapping is no longer checked against the shape
+;; of the original array, we make sure the whole new shape is mapped
+;; into it beforehand.  For each dimension, the extreme values of an
+;; affine map over a box are taken at its corners.
+(define (check-shared-range array Vb Ve constants coeffs)
+  (unless (= (length constants) (array-rank array))
+    (errorf "share-array: mapping procedure must return ~s values, \
+             but returned ~s" (array-rank array) (length constants)))
+  (unless (any = (s32vector->list Vb) (s32vector->list Ve)) ; empty
+    (let ([bs (s32vector->list Vb)]
+          [ls (s32vector->list (s32vector-sub Ve 1))])
+      (for-each-with-index
+       (^[k c cvec]
+         (let* ([cs (s32vector->list cvec)]
+                [lo (fold (^[a b l acc] (+ acc (min (* a b) (* a l)))) c cs bs ls)]
+                [hi (fold (^[a b l acc] (+ acc (max (* a b) (* a l)))) c cs bs ls)])
+           (unless (and (<= (array-start array k) lo)
+                        (< hi (array-end array k)))
+             (errorf "share-array: index of dimension ~s of the original \
+                      array is mapped out of range: [~s, ~s]" k lo hi))))
+       constants coeffs))))
+
+;;---------------------------------------------------------------
+;; Views
+;;   They share the backing storage with the original array.
+;;
+
+;; Like subarray, the resulting view is indexed from 0.
+(define (subarray-view ar sh)
+  (receive (Vb Ve) (shape->start/end-vector sh)
+    (share-array ar
+                 (start/end-vector->shape (make-s32vector (size-of Vb) 0)
+                                          (s32vector-sub Ve Vb))
+                 (^ ind (apply values (map + ind (s32vector->list Vb)))))))
+
+(define (array-transpose-view ar :optional (dim1 0) (dim2 1))
+  (let ([Vb (s32vector-copy (start-vector-of ar))]
+        [Ve (s32vector-copy (end-vector-of ar))])
+    (define (swap! v)
+      (let1 t (ref v dim1)
+        (set! (ref v dim1) (ref v dim2))
+        (set! (ref v dim2) t)))
+    (swap! Vb)
+    (swap! Ve)
+    (share-array ar (start/end-vector->shape Vb Ve)
+                 (^ ind (let1 v (list->vector ind)
+                          (swap! v)
+                          (apply values (vector->list v)))))))
+
+;; Returns a view of rank one less than AR, fixing the index of DIM
+;; to INDEX.  E.g. (array-slice-view m 0 i) is the i-th row of a matrix.
+(define (array-slice-view ar dim index)
+  (let ([Vb (s32vector->list (start-vector-of ar))]
+        [Ve (s32vector->list (end-vector-of ar))])
+    (unless (and (<= 0 dim) (< dim (length Vb)))
+      (error "dimension out of range:" dim))
+    (unless (and (<= (list-ref Vb dim) index) (< index (list-ref Ve dim)))
+      (errorf "index of dimension ~s is out of range: ~s" dim index))
+    (share-array ar
+                 (start/end-vector->shape
+                  (list->s32vector (append (take Vb dim) (drop Vb (+ dim 1))))
+                  (list->s32vector (append (take Ve dim) (drop Ve (+ dim 1)))))
+                 (^ ind (apply values
+                               (append (take ind dim) (list index)
+                                       (drop ind dim)))))))
+
+;; If the elements of AR are contiguous in row-major order in its
+;; backing uvector, returns a uvector that shares the region, so that
+;; uvector procedures can work on the array directly.  Otherwise
+;; returns #f.
+(define (array-uvector-alias ar)
+  (and-let* ([store (backing-storage-of ar)]
+             [ (uvector? store) ]
+             [Vc (strides-of ar)])
+    (let* ([Vb (start-vector-of ar)]
+           [Ve (end-vector-of ar)]
+           [start (+ (offset-of ar) (s32vector-dot Vc Vb))]
+           [size (array-size ar)])
+      ;; strides of dimensions of length 1 don't matter.
+      (and (every (^[c r len] (or (<= len 1) (= c r)))
+                  (s32vector->list Vc)
+                  (s32vector->list (row-major-strides Vb Ve))
+                  (s32vector->list (s32vector-sub Ve Vb)))
+           (if (zero? size)
+             (uvector-alias (class-of store) store 0 0)
+             (uvector-alias (class-of store) store start (+ start size)))))))
 
 ;;---------------------------------------------------------------
 ;; Array utilities
@@ -522,17 +664,26 @@
            (proc (vector-ref vec 0) (vector-ref vec 1) (vector-ref vec 2)))]
     [else (^[proc vec] (apply proc (vector->list vec)))]))
 
+;; Calls PROC on every element of AR in row-major order.  We can scan
+;; the backing storage directly, unless AR is a view.
+(define (array-elements-for-each proc ar)
+  (if (or (array-dense? ar) (not (strides-of ar)))
+    (for-each proc (backing-storage-of ar))
+    (array-for-each-index ar
+      (^[ind] (proc (array-ref ar ind)))
+      (make-vector (array-rank ar)))))
+
 (define (array-for-each proc ar)
-  (for-each proc (backing-storage-of ar)))
+  (array-elements-for-each proc ar))
 
 (define (array-any pred ar)
   (let/cc found
-    (for-each (^x (if (pred x) (found #t))) (backing-storage-of ar))
+    (array-elements-for-each (^x (if (pred x) (found #t))) ar)
     #f))
 
 (define (array-every pred ar)
   (let/cc found
-    (for-each (^x (if (not (pred x)) (found #f))) (backing-storage-of ar))
+    (array-elements-for-each (^x (if (not (pred x)) (found #f))) ar)
     #t))
 
 ;; repeat construct
@@ -0,0 +1,60 @@
+;;
+;; Vectorized kernels vs. scalar loops for f32/f64vector operations.
+;;
+;;  gosh -I. -I../../src -I../../lib bench.scm [length]
+;;
+;; Each operation is timed with every kernel set available on this
+;; machine, and with the scalar loops ('none').
+;;
+
+(add-load-path ".")
+
+(use gauche.uvector)
+(use gauche.time)
+(use srfi-1)
+
+(define (kernel-sets)
+  (filter (^k (guard (e [(error? e) #f]) (%uvector-simd-kernels k) #t))
+          '(none sse2 neon avx2)))
+
+(define (seconds-per-call thunk)
+  (let loop ([count 1])
+    (let* ([t (make <real-time-counter>)]
+           [_ (with-time-counter t (dotimes [i count] (thunk)))]
+           [sec (time-counter-value t)])
+      (if (< sec 0.5)
+        (loop (* count 2))
+        (/. sec count)))))
+
+(define (round-to x k) (/. (round (* x k)) k))
+
+(define (main args)
+  (let* ([len (if (pair? (cdr args)) (string->number (cadr args)) 1000000)]
+         [kernels (kernel-sets)]
+         [x32 (make-f32vector len 1.5)] [y32 (make-f32vector len 0.25)]
+         [x64 (make-f64vector len 1.5)] [y64 (make-f64vector len 0.25)]
+         [ops `(("f32vector-add"    ,(^[] (f32vector-add x32 y32)))
+                ("f32vector-add!"   ,(^[] (f32vector-add! x32 y32)))
+                ("f32vector-mul c"  ,(^[] (f32vector-mul x32 1.0)))
+                ("f32vector-dot"    ,(^[] (f32vector-dot x32 y32)))
+                ("f32vector-clamp"  ,(^[] (f32vector-clamp x32 0 1e30)))
+                ("f64vector-add"    ,(^[] (f64vector-add x64 y64)))
+                ("f64vector-add!"   ,(^[] (f64vector-add! x64 y64)))
+                ("f64vector-mul c"  ,(^[] (f64vector-mul x64 1.0)))
+                ("f64vector-dot"    ,(^[] (f64vector-dot x64 y64)))
+                ("f64vector-clamp"  ,(^[] (f64vector-clamp x64 0 1e300)))
+                ("f32vector-swap-bytes!"
+                 ,(^[] (f32vector-swap-bytes! x32)))
+                ("f64vector-swap-bytes!"
+                 ,(^[] (f64vector-swap-bytes! x64))))])
+    (format #t "length ~d, msec per call\n" len)
+    (format #t "~22a~{ ~10a~}\n" "" kernels)
+    (dolist [op ops]
+      (format #t "~22a" (car op))
+      (dolist [k kernels]
+        (%uvector-simd-kernels k)
+        (format #t " ~10a"
+                (round-to (* 1000 (seconds-per-call (cadr op))) 1000)))
+      (newline))
+    (%uvector-simd-kernels 'default))
+  0)
@@ -55,6 +55,13 @@
         c))))
 
 (define (array-transpose a :optional (dim1 0) (dim2 1))
+  (if (and (native-matrix? a) (= (+ dim1 dim2) 1))
+    (let1 v (array-transpose-view a)
+      (rlet1 res (make-array-internal (class-of a) (array-shape v))
+        (%uvector-matrix-copy! (matrix-spec res) (matrix-spec v))))
+    (generic-array-transpose a dim1 dim2)))
+
+(define (generic-array-transpose a dim1 dim2)
   (let* ([sh (copy-object (array-shape a))]
          [rank (array-rank a)]
          [tmp0 (array-ref sh dim1 0)]
@@ -117,6 +124,79 @@
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 ;; linear algebra
 
+;; Element accessors of a rank-2 array, which calculate the index to
+;; the backing storage by the strides, skipping the dispatch and the
+;; range check of array-ref.  The caller must give valid indices.
+(define (matrix-getter a)
+  (if-let1 Vc (strides-of a)
+    (let ([get (backing-storage-getter-of (class-of a))]
+          [store (backing-storage-of a)]
+          [o (offset-of a)]
+          [c0 (s32vector-ref Vc 0)]
+          [c1 (s32vector-ref Vc 1)])
+      (^[i j] (get store (+ o (* c0 i) (* c1 j)))))
+    (^[i j] (array-ref a i j))))
+
+(define (matrix-setter a)
+  (if-let1 Vc (strides-of a)
+    (let ([set (backing-storage-setter-of (class-of a))]
+          [store (backing-storage-of a)]
+          [o (offset-of a)]
+          [c0 (s32vector-ref Vc 0)]
+          [c1 (s32vector-ref Vc 1)])
+      (^[i j v] (set store (+ o (* c0 i) (* c1 j)) v)))
+    (^[i j v] (array-set! a i j v))))
+
+;; Rank-2 f32array and f64array with affine mappings are given to the
+;; native kernels (uvmatrix.c), which compute in the element type.
+;; Other arrays go through the generic code below.
+(define (native-matrix? a)
+  (and (memq (class-of a) `(,<f32array> ,<f64array>))
+       (strides-of a)
+       (= (array-rank a) 2)))
+
+(define (native-matrices? a b)
+  (and (native-matrix? a) (native-matrix? b) (eq? (class-of a) (class-of b))))
+
+;; Descriptor of the matrix for the kernels.
+(define (matrix-spec a)
+  (let ([Vb (start-vector-of a)]
+        [Ve (end-vector-of a)]
+        [Vc (strides-of a)])
+    (vector (backing-storage-of a)
+            (+ (offset-of a) (s32vector-dot Vc Vb))
+            (s32vector-ref Vc 0)
+            (s32vector-ref Vc 1)
+            (- (s32vector-ref Ve 0) (s32vector-ref Vb 0))
+            (- (s32vector-ref Ve 1) (s32vector-ref Vb 1)))))
+
+;; Returns a fresh zero-based copy of native matrix A, of class CLASS.
+(define (native-matrix-copy a :optional (class (class-of a)))
+  (rlet1 r (make-array-internal class (shape 0 (array-length a 0)
+                                             0 (array-length a 1)))
+    (%uvector-matrix-copy! (matrix-spec r) (matrix-spec a))))
+
+;; Returns LU decomposition of square native matrix A, pivot vector,
+;; and the sign of the permutation, which is 0 if A is singular.
+(define (native-lu a)
+  (let ([lu (native-matrix-copy a)]
+        [piv (make-s32vector (array-length a 0) 0)])
+    (values lu piv (%uvector-matrix-lu! (matrix-spec lu) piv))))
+
+;; Returns X such that A X = B.
+(define (native-solve a b)
+  (let1 n (array-length a 0)
+    (unless (= n (array-length a 1))
+      (error "can only compute inverses of square matrices"))
+    (unless (= n (array-length b 0))
+      (errorf "dimension mismatch: can't mul shapes ~S and ~S"
+              (array-shape a) (array-shape b)))
+    (receive (lu piv sign) (native-lu a)
+      (when (zero? sign)
+        (error "Matrix is not regular:" a))
+      (rlet1 x (native-matrix-copy b)
+        (%uvector-matrix-lu-solve! (matrix-spec lu) piv (matrix-spec x))))))
+
 (define (identity-array n :optional (class <array>))
   (let1 res (make-array-internal class (shape 0 n 0 n) 0)
     (do ([i 0 (+ i 1)])
@@ -131,17 +211,19 @@
          [end (end-vector-of a)]
          [row-end (s32vector-ref end 0)]
          [col-end (s32vector-ref end 1)]
-         [row-col-offset (- row-start col-start)])
+         [row-col-offset (- row-start col-start)]
+         [ref (matrix-getter a)]
+         [set (matrix-setter a)])
     (define (row-swap! i j)
       (do ([k col-start (+ k 1)])
           [(= k col-end)]
-        (let1 temp (array-ref a i k)
-          (array-set! a i k (array-ref a j k))
-          (array-set! a j k temp))))
+        (let1 temp (ref i k)
+          (set i k (ref j k))
+          (set j k temp))))
     (define (row-sub! i j factor)
       (do ([k col-start (+ k 1)])
           [(= k col-end)]
-        (array-set! a i k (- (array-ref a i k) (* factor (array-ref a j k))))))
+        (set i k (- (ref i k) (* factor (ref j k))))))
     (let loop ([i row-start] [factor 1])
       (let1 col (- i row-col-offset)
         (cond [(= i row-end) factor]
@@ -208,16 +290,22 @@
       (error "can only compute inverses of 2D arrays"))
     (unless (= n m)
       (error "can only compute inverses of square matrices"))
-    (let* ([class (class-of a)]
-           [id (identity-array n (if (or (eq? class <f32array>)
-                                         (eq? class <f64array>))
-                                   class <array>))]
-           [tmp (array-concatenate a id 1)])
-      (array-solve-left-identity! tmp)
-      (and (= 1 (array-ref tmp (- (s32vector-ref end 0) 1)
-                           (- (s32vector-ref end 1) 1)))
-           (subarray tmp (shape (s32vector-ref start 0) (s32vector-ref end 0)
-                                (s32vector-ref end 1) (+ (s32vector-ref end 1) n)))))))
+    (if (native-matrix? a)
+      (receive (lu piv sign) (native-lu a)
+        (and (not (zero? sign))
+             (rlet1 x (identity-array n (class-of a))
+               (%uvector-matrix-lu-solve! (matrix-spec lu) piv
+                                          (matrix-spec x)))))
+      (let* ([class (class-of a)]
+             [id (identity-array n (if (or (eq? class <f32array>)
+                                           (eq? class <f64array>))
+                                     class <array>))]
+             [tmp (array-concatenate a id 1)])
+        (array-solve-left-identity! tmp)
+        (and (= 1 (array-ref tmp (- (s32vector-ref end 0) 1)
+                             (- (s32vector-ref end 1) 1)))
+             (subarray tmp (shape (s32vector-ref start 0) (s32vector-ref end 0)
+                                  (s32vector-ref end 1) (+ (s32vector-ref end 1) n))))))))
 
 
 (define (determinant! a)
@@ -235,15 +323,27 @@
 
 (define (determinant a)
   (let1 class (class-of a)
-    (if (or (eq? class <f32array>)
-            (eq? class <f64array>)
-            (eq? class <array>))
-      (determinant! (copy-object a))
+    (cond
+     [(native-matrix? a)
+      (unless (= (array-length a 0) (array-length a 1))
+        (error "can't compute determinants of non-square matrices"))
+      (receive (lu piv sign) (native-lu a)
+        (if (zero? sign)
+          0
+          (let loop ([i 0] [d sign])
+            (if (= i (array-length lu 0))
+              d
+              (loop (+ i 1) (* d (array-ref lu i i)))))))]
+     [(or (eq? class <f32array>)
+          (eq? class <f64array>)
+          (eq? class <array>))
+      (determinant! (copy-object a))]
+     [else
       (let* ([rank (s32vector-length (start-vector-of a))]
              [b (tabulate-array (array-shape a)
                                 (^[ind] (array-ref a ind))
                                 (make-vector rank))])
-        (determinant! b)))))
+        (determinant! b))])))
 
 
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
@@ -266,29 +366,45 @@
            [m (- a-end-col a-start-col)]
            [p (- b-end-col b-start-col)]
            [a-col-b-row-off (- a-start-col (s32vector-ref b-start 0))]
-           [res (make-minimal-backend-array (list a b) (shape 0 n 0 p))])
+           [res (make-minimal-backend-array (list a b) (shape 0 n 0 p))]
+           [aref (matrix-getter a)]
+           [bref (matrix-getter b)]
+           [rset (matrix-setter res)])
       (unless (= m (- (s32vector-ref b-end 0) (s32vector-ref b-start 0)))
         (errorf "dimension mismatch: can't mul shapes ~S and ~S"
                 (array-shape a) (array-shape b)))
-      (do ([i a-start-row (+ i 1)])       ; for-each row of a
-          [(= i a-end-row) res]
-        (do ([k b-start-col (+ k 1)])     ; for-each col of b
-            [(= k b-end-col)]
-          (let1 tmp 0
-            (do ([j a-start-col (+ j 1)]) ; for-each col of a & row of b
-                [(= j a-end-col)]
-              (inc! tmp (* (array-ref a i j) (array-ref b (- j a-col-b-row-off) k))))
-            (array-set! res (- i a-start-row) (- k b-start-col) tmp)))))))
-
+      (if (and (native-matrices? a b) (eq? (class-of res) (class-of a)))
+        (begin
+          (%uvector-matrix-mul! (matrix-spec res) (matrix-spec a)
+                                (matrix-spec b))
+          res)
+        (do ([i a-start-row (+ i 1)])       ; for-each row of a
+            [(= i a-end-row) res]
+          (do ([k b-start-col (+ k 1)])     ; for-each col of b
+              [(= k b-end-col)]
+            (let1 tmp 0
+              (do ([j a-start-col (+ j 1)]) ; for-each col of a & row of b
+                  [(= j a-end-col)]
+                (inc! tmp (* (aref i j) (bref (- j a-col-b-row-off) k))))
+              (rset (- i a-start-row) (- k b-start-col) tmp))))))))
+
+;; With native matrices, B^-1 isn't computed; we solve B X = A,
+;; or X B = A as B^T X^T = A^T, by LU decomposition.
 (define (array-div-left a b)
-  (if-let1 b-1 (array-inverse b)
-    (array-mul b-1 a)
-    (error "Matrix is not regular:" b)))
+  (if (native-matrices? a b)
+    (native-solve b a)
+    (if-let1 b-1 (array-inverse b)
+      (array-mul b-1 a)
+      (error "Matrix is not regular:" b))))
 
 (define (array-div-right a b)
-  (if-let1 b-1 (array-inverse b)
-    (array-mul a b-1)
-    (error "Matrix is not regular:" b)))
+  (if (native-matrices? a b)
+    (native-matrix-copy
+     (array-transpose-view (native-solve (array-transpose-view b)
+                                         (array-transpose-view a))))
+    (if-let1 b-1 (array-inverse b)
+      (array-mul a b-1)
+      (error "Matrix is not regular:" b))))
 
 (define (array-expt ar pow)
   (let loop ([a ar] [n pow])
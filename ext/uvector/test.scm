@@ -1329,6 +1329,250 @@
 (clamp-test-generate u64 #u64(127 0 4 200 255)
                      #u64(3 3 3 3 3) #u64(199 199 199 199 199))
 
+;;-------------------------------------------------------------------
+(test-section "vectorized kernels")
+
+;; The results of the kernels are compared with the scalar loops, which
+;; are used when the second operand is a list.  Lengths are chosen to
+;; exercise the remainder loops.
+(let ()
+  (define lengths '(0 1 3 4 7 8 9 15 16 17 33 1001))
+  (define (integers n k)
+    (list-tabulate n (^i (modulo (* (+ i k) 7919) 2001))))
+  (define (numbers n k)
+    (map (^i (/ (- i 1000) 8)) (integers n k)))
+  (define (byte-swapped v size)
+    (let1 bytes (u8vector->list (uvector-alias <u8vector> v))
+      (let loop ([bytes bytes] [r '()])
+        (if (null? bytes)
+          (list->u8vector (concatenate (reverse r)))
+          (loop (drop bytes size) (cons (reverse (take bytes size)) r))))))
+  (define (test-kernels name)
+    (dolist [type `((f32 ,list->f32vector ,f32vector->list
+                         ,f32vector-add ,f32vector-sub
+                         ,f32vector-mul ,f32vector-div
+                         ,f32vector-add! ,f32vector-dot
+                         ,f32vector-clamp ,f32vector-clamp!)
+                    (f64 ,list->f64vector ,f64vector->list
+                         ,f64vector-add ,f64vector-sub
+                         ,f64vector-mul ,f64vector-div
+                         ,f64vector-add! ,f64vector-dot
+                         ,f64vector-clamp ,f64vector-clamp!))]
+      (apply
+       (^[tag make ->list add sub mul div add! dot clamp clamp!]
+         (define (t msg expected thunk)
+           (test* (format "~a ~a ~a" name tag msg) expected (thunk)))
+         (define (math fn v)
+           ((eval (symbol-append tag 'vector- fn) (current-module)) v))
+         (t "arithmetic" #t
+            (^[] (every (^n (let ([x (make (numbers n 0))]
+                                  [y (make (map (cut + <> 1/16) (numbers n 5)))])
+                              (every (^[op] (and (equal? (op x y)
+                                                         (op x (->list y)))
+                                                 (equal? (op x 3/4)
+                                                         (op x (make-list n 3/4)))))
+                                     (list add sub mul div))))
+                        lengths)))
+         (t "in place" #t
+            (^[] (every (^n (let* ([x (make (numbers n 0))]
+                                   [y (make (numbers n 3))]
+                                   [expected (add x (->list y))])
+                              (equal? expected (add! x y))))
+                        lengths)))
+         (t "dot" #t
+            (^[] (every (^n (let ([x (make (numbers n 0))]
+                                  [y (make (numbers n 9))])
+                              (= (dot x (->list y)) (dot x y))))
+                        lengths)))
+         (t "clamp" #t
+            (^[] (every (^n (let ([x (make (append (numbers n 0)
+                                                   '(+inf.0 -inf.0)))]
+                                  [n (+ n 2)])
+                              (and (equal? (clamp x (make-list n -10.5)
+                                                  (make-list n 20))
+                                           (clamp x -10.5 20))
+                                   (equal? (clamp x #f (make-list n 0))
+                                           (clamp x #f 0))
+                                   (equal? (clamp x (make-list n 0) #f)
+                                           (clamp! (make (->list x)) 0 #f)))))
+                        lengths)))
+         ;; abs and sqrt are exact; exp etc. may be off in the last bits.
+         (t "math" #t
+            (^[] (every (^n (let* ([xs (numbers n 0)]
+                                   [x (make xs)]
+                                   [eps (if (eq? tag 'f32) 1e-6 1e-14)])
+                              (define (close? ys f)
+                                (every (^[y z] (or (= y z)
+                                                   (<= (abs (- y z))
+                                                       (* eps (abs z)))))
+                                       ys (map f xs)))
+                              (and (equal? (math 'abs x) (make (map abs xs)))
+                                   (equal? (->list (math 'sqrt (math 'abs x)))
+                                           (->list (make (map (^x (sqrt (abs x)))
+                                                              xs))))
+                                   (close? (->list (math 'exp (div x 100)))
+                                           (^x (exp (/ x 100))))
+                                   (close? (->list (math 'log (math 'abs x)))
+                                           (^x (if (zero? x) -inf.0
+                                                   (log (abs x)))))
+                                   (close? (->list (math 'sin x)) sin)
+                                   (close? (->list (math 'cos x)) cos))))
+                        lengths))))
+       type))
+    (test* (format "~a swap-bytes" name) #t
+           (every (^n (let ([x16 (list->u16vector
+                                  (map (cut * <> 31) (integers n 1)))]
+                            [x32 (list->u32vector
+                                  (map (cut * <> 2100007) (integers n 2)))]
+                            [x64 (list->u64vector
+                                  (map (cut * <> #x100000001 #x10001)
+                                       (integers n 3)))])
+                        (and (equal? (byte-swapped x16 2)
+                                     (uvector-alias <u8vector>
+                                                    (u16vector-swap-bytes x16)))
+                             (equal? (byte-swapped x32 4)
+                                     (uvector-alias <u8vector>
+                                                    (u32vector-swap-bytes x32)))
+                             (equal? (byte-swapped x64 8)
+                                     (uvector-alias <u8vector>
+                                                    (u64vector-swap-bytes x64))))))
+                  lengths)))
+
+  (test-kernels (%uvector-simd-kernels))
+  (dolist [k '(none sse2 neon avx2)]
+    (when (guard (e [(error? e) #f]) (%uvector-simd-kernels k))
+      (test-kernels k)))
+  (%uvector-simd-kernels 'default)
+  )
+
+;;-------------------------------------------------------------------
+(test-section "reductions")
+
+(test* "s8vector-sum" -6 (s8vector-sum '#s8(1 -2 3 -4 5 -9)))
+(test* "u8vector-sum" 1020 (u8vector-sum '#u8(255 255 255 255)))
+(test* "s32vector-sum" 0 (s32vector-sum '#s32()))
+(test* "u64vector-sum (overflow)" (* 3 (- (expt 2 64) 1))
+       (u64vector-sum (make-u64vector 3 (- (expt 2 64) 1))))
+(test* "s64vector-sum (overflow)" (* -4 (expt 2 63))
+       (s64vector-sum (make-s64vector 4 (- (expt 2 63)))))
+(test* "f64vector-sum" 6.5 (f64vector-sum '#f64(1.0 2.5 3.0)))
+(test* "f16vector-sum" 3.5 (f16vector-sum '#f16(1.0 2.5)))
+
+(test* "s16vector-min" -300 (s16vector-min '#s16(5 -300 7 -300)))
+(test* "s16vector-max" 7 (s16vector-max '#s16(5 -300 7 -300)))
+(test* "s16vector-argmin" 1 (s16vector-argmin '#s16(5 -300 7 -300)))
+(test* "s16vector-argmax" 2 (s16vector-argmax '#s16(5 -300 7 7)))
+(test* "u64vector-max" (- (expt 2 64) 1)
+       (u64vector-max (u64vector 3 (- (expt 2 64) 1) 5)))
+(test* "s64vector-argmin" 2
+       (s64vector-argmin (s64vector 0 (- (expt 2 62)) (- (expt 2 63)) 1)))
+(test* "f32vector-min" -1.5 (f32vector-min '#f32(0.5 -1.5 2.0)))
+(test* "f64vector-max (nan)" #t (nan? (f64vector-max '#f64(1.0 +nan.0 2.0))))
+(test* "f64vector-argmin (nan)" 1 (f64vector-argmin '#f64(1.0 +nan.0 -2.0)))
+(test* "u32vector-min (empty)" 'none (u32vector-min '#u32() 'none))
+(test* "u32vector-argmax (empty)" (test-error) (u32vector-argmax '#u32()))
+
+(test* "s32vector-prefix-sum" '#s32(1 3 6 10)
+       (s32vector-prefix-sum '#s32(1 2 3 4)))
+(test* "u8vector-prefix-sum (clamp)" '#u8(200 255 255)
+       (u8vector-prefix-sum '#u8(200 100 1) 'both))
+(test* "u8vector-prefix-sum (overflow)" (test-error)
+       (u8vector-prefix-sum '#u8(200 100 1)))
+(test* "f64vector-prefix-sum!" '#f64(0.5 1.5 -1.5)
+       (let1 v (f64vector 0.5 1.0 -3.0)
+         (f64vector-prefix-sum! v)
+         v))
+(test* "s8vector-prefix-sum (empty)" '#s8() (s8vector-prefix-sum '#s8()))
+
+(test* "s32vector-histogram" '#u32(2 1 1 2)
+       (s32vector-histogram '#s32(0 1 3 -1 7 8 6 4) 4 0 8))
+(test* "f64vector-histogram" '#u32(1 2)
+       (f64vector-histogram '#f64(0.0 0.5 0.9999 1.0 +nan.0) 2 0 1))
+(test* "u8vector-histogram (bad bins)" (test-error)
+       (u8vector-histogram '#u8(1 2) 0 0 1))
+(test* "u8vector-histogram (bad range)" (test-error)
+       (u8vector-histogram '#u8(1 2) 2 1 1))
+
+;;-------------------------------------------------------------------
+(test-section "math functions")
+
+(test* "f64vector-sqrt" '#f64(1.0 2.0 3.0 4.0)
+       (f64vector-sqrt '#f64(1.0 4.0 9.0 16.0)))
+(test* "f32vector-abs" '#f32(1.5 0.0 2.0)
+       (f32vector-abs '#f32(-1.5 -0.0 2.0)))
+(test* "f64vector-exp/log" '(#f64(1.0) #f64(0.0))
+       (list (f64vector-exp '#f64(0.0)) (f64vector-log '#f64(1.0))))
+(test* "f64vector-log (domain)" '(#t -inf.0)
+       (let1 v (f64vector-log '#f64(-1.0 0.0))
+         (list (nan? (f64vector-ref v 0)) (f64vector-ref v 1))))
+(test* "f64vector-sqrt (domain)" #t
+       (nan? (f64vector-ref (f64vector-sqrt '#f64(-4.0)) 0)))
+(test* "f64vector-atan" (atan 1.0) (f64vector-ref (f64vector-atan '#f64(1.0)) 0))
+(test* "f32vector-round" '#f32(0.0 2.0 2.0 -2.0)
+       (f32vector-round '#f32(0.5 1.5 2.5 -1.5)))
+(test* "f64vector-floor, ceiling, truncate"
+       '(#f64(-2.0 1.0) #f64(-1.0 2.0) #f64(-1.0 1.0))
+       (let1 v '#f64(-1.5 1.5)
+         (list (f64vector-floor v) (f64vector-ceiling v)
+               (f64vector-truncate v))))
+(test* "f64vector-sin (range)" '#f64(1.0 0.0)
+       (f64vector-sin (f64vector 0.0 (/ (atan 1 1) 0.5) 0.0 1.0) 1 3))
+(test* "f64vector-floor! (range)" '#f64(1.5 -2.0 2.0)
+       (f64vector-floor! (f64vector 1.5 -1.5 2.5) 1))
+(test* "f32vector-sqrt! (alias)" '#f32(1.0 2.0 9.0)
+       (let1 v (f32vector 1.0 4.0 9.0)
+         (f32vector-sqrt! (uvector-alias <f32vector> v 0 2))
+         v))
+(test* "f64vector-tanh (empty)" '#f64() (f64vector-tanh '#f64()))
+(test* "f64vector-exp (bad range)" (test-error)
+       (f64vector-exp '#f64(1.0 2.0) 1 3))
+(test* "f64vector-exp! (immutable)" (test-error)
+       (f64vector-exp! '#f64(1.0 2.0)))
+
+;;-------------------------------------------------------------------
+(test-section "fused kernels")
+
+(let ([x (f64vector 1.0 2.0 3.0 4.0)]
+      [y (s32vector 10 20 30 40)]
+      [z (u8vector 1 0 1 0)])
+  (test* "reduce +" 300.0
+         (uvector-reduce-kernel + 0 ((a x) (b y)) (* a b)))
+  (test* "reduce max" 40.0
+         (uvector-reduce-kernel max -inf.0 ((a x) (b y) (c z))
+                                (+ b c (- a a))))
+  (test* "reduce min" -40.0
+         (uvector-reduce-kernel min +inf.0 ((b y)) (- b)))
+  (test* "reduce * with runtime constant" 24.0
+         (let1 k 2
+           (uvector-reduce-kernel * 1 ((a x)) (/ (* a k) (+ k k -2)))))
+  (test* "map" '#f64(1.0 2.0 3.0 4.0)
+         (let1 d (make-f64vector 4)
+           (uvector-map-kernel! d ((a x) (c z)) (sqrt (* a a)))))
+  (test* "map into f32vector" '#f32(-9.0 -18.0 -27.0 -36.0)
+         (let1 d (make-f32vector 4)
+           (uvector-map-kernel! d ((a x) (b y)) (min (- a b) (abs (/ a))))))
+  (test* "map, length mismatch" (test-error)
+         (uvector-map-kernel! (make-f64vector 3) ((a x)) a))
+  (test* "reduce, length mismatch" (test-error)
+         (uvector-reduce-kernel + 0 ((a x) (b '#u8(1 2))) (+ a b)))
+  (test* "bad reducer" (test-error)
+         (uvector-reduce-kernel - 0 ((a x)) a))
+  )
+
+;; The results are compared with the reference computed with lists,
+;; across the block boundary.
+(let* ([n 1000]
+       [xs (list-tabulate n (^i (- (modulo (* i 37) 101) 50)))]
+       [ys (list-tabulate n (^i (modulo (* i 13) 17)))]
+       [x (list->s16vector xs)]
+       [y (list->f32vector ys)])
+  (test* "reduce over blocks" (exact->inexact (apply + (map * xs ys)))
+         (uvector-reduce-kernel + 0 ((a x) (b y)) (* a b)))
+  (test* "map over blocks" (map (^[a b] (exact->inexact (- (* 2 a) b))) xs ys)
+         (f64vector->list
+          (uvector-map-kernel! (make-f64vector n) ((a x) (b y))
+                               (- (* 2 a) b)))))
+
 ;;-------------------------------------------------------------------
 (test-section "block i/o")
 
@@ -2137,6 +2381,48 @@
                  (array-ref sub 1 1)))
     ))
 
+(test-section "array views")
+(let* ([m (tabulate-array (shape 0 3 0 4) (^[i j] (+ (* i 10) j)))]
+       [f (make-f64array (shape 1 3 1 4) 0.0)]
+       [t (array-transpose-view m)]
+       [r (array-slice-view m 0 1)]
+       [c (array-slice-view m 1 2)]
+       [s (subarray-view m (shape 1 3 1 3))])
+  (test* "transpose view" (array-transpose m) t)
+  (test* "transpose view shape" '(0 4 0 3) (array->list (array-shape t)))
+  (test* "row view" '(10 11 12 13) (array->list r))
+  (test* "column view" '(2 12 22) (array->list c))
+  (test* "subarray view" (subarray m (shape 1 3 1 3)) s)
+  (test* "view of view" '(11 21) (array->list (array-slice-view s 1 0)))
+  (test* "transpose of transpose" #t (equal? m (array-transpose-view t)))
+  (test* "array-for-each on view" '(22 21 12 11)
+         (let1 r '() (array-for-each (^x (push! r x)) s) r))
+  (test* "array-every on view" #t (array-every odd? (array-slice-view m 1 1)))
+  (test* "array-any on view" #f (array-any odd? c))
+  (test* "copy of a view" '(0 2 0 2 11 12 21 22)
+         (let1 x (copy-object s)
+           (list* (array-start x 0) (array-end x 0)
+                  (array-start x 1) (array-end x 1)
+                  (array->list x))))
+  (test* "modification through view" '(99 99 99)
+         (begin (array-set! t 3 1 99)
+                (list (array-ref m 1 3) (array-ref r 3) (array-ref t 3 1))))
+  (test* "slice view out of range" (test-error) (array-slice-view m 0 3))
+  (test* "share-array out of range" (test-error)
+         (share-array m (shape 0 3) (^i (values i (+ i 2)))))
+  (test* "uvector alias (row)" '#f64(0.0 0.0 0.0)
+         (array-uvector-alias (array-slice-view f 0 1)))
+  (test* "uvector alias (column)" #f
+         (array-uvector-alias (array-slice-view f 1 1)))
+  (test* "uvector alias (generic array)" #f (array-uvector-alias m))
+  (test* "uvector alias shares storage" 3.0
+         (begin (f64vector-add! (array-uvector-alias (array-slice-view f 0 2))
+                                '#f64(1.0 2.0 3.0))
+                (array-ref f 2 3)))
+  (test* "matrix ops on views" (array-mul (array-transpose m) m)
+         (array-mul t m))
+  )
+
 ;;----------------------------------------------------------------
 (test-section "array-iteration")
 
@@ -2347,6 +2633,76 @@
       #,(<s16array> (0 1 0 1) 204))
      )))
 
+;; f32array and f64array go through the native kernels.  The sizes are
+;; chosen to cross the block boundaries of the kernels.
+(let* ([elt (^[i j] (- (modulo (+ (* i 7) (* j 13) (* i j)) 19) 9))]
+       [mk (^[make sh :optional (f elt)] (rlet1 a (make sh 0) (array-retabulate! a f)))]
+       [g (mk make-array (shape 0 70 0 50))]
+       [h (mk make-array (shape 0 50 0 66))]
+       [d (mk make-f64array (shape 0 70 0 50))]
+       [e (mk make-f64array (shape 0 50 0 66))]
+       [s (mk make-f32array (shape 0 70 0 50))]
+       [t (mk make-f32array (shape 0 50 0 66))]
+       ;; diagonally dominant, hence regular
+       [q (mk make-f64array (shape 0 70 0 70)
+              (^[i j] (+ (elt i j) (if (= i j) 1000 0))))])
+  (test* "native array-mul (f64)" (array-mul g h) (array-mul d e)
+         array-approx-equal?)
+  (test* "native array-mul (f32)" (array-mul g h) (array-mul s t)
+         array-approx-equal?)
+  (test* "native array-mul class" (list <f64array> <f32array>)
+         (list (class-of (array-mul d e)) (class-of (array-mul s t))))
+  (test* "native array-mul (transposed views)"
+         (array-mul (array-transpose h) (array-transpose g))
+         (array-mul (array-transpose-view e) (array-transpose-view d))
+         array-approx-equal?)
+  (test* "native array-mul (subarray views)"
+         (array-mul (subarray-view g (shape 3 10 5 20))
+                    (subarray-view h (shape 5 20 0 4)))
+         (array-mul (subarray-view d (shape 3 10 5 20))
+                    (subarray-view e (shape 5 20 0 4)))
+         array-approx-equal?)
+  (test* "native array-mul (dimension mismatch)" (test-error)
+         (array-mul d d))
+  (test* "native array-inverse" (identity-array 70)
+         (array-mul q (array-inverse q))
+         array-approx-equal?)
+  (test* "native array-div-left" d
+         (array-mul q (array-div-left d q))
+         array-approx-equal?)
+  (test* "native array-div-right" (array-transpose d)
+         (array-mul (array-div-right (array-transpose d) q) q)
+         array-approx-equal?)
+  (test* "native array-transpose" (array-transpose g) (array-transpose d)
+         array-approx-equal?)
+  (test* "native array-transpose class" <f32array>
+         (class-of (array-transpose s)))
+  )
+
+(test* "native array-transpose (shape)"
+       #,(<f64array> (2 5 1 3) 1 4 2 5 3 6)
+       (array-transpose #,(<f64array> (1 3 2 5) 1 2 3 4 5 6)))
+(test* "native determinant" -1.0
+       (determinant #,(<f64array> (0 3 0 3) 1 5 2 1 1 7 0 -3 4))
+       approx-equal?)
+(test* "native determinant (f32)" -2.0
+       (determinant #,(<f32array> (1 3 1 3) 1 2 3 4))
+       approx-equal?)
+(test* "native determinant (singular)" 0
+       (determinant #,(<f64array> (0 2 0 2) 2 4 1 2))
+       approx-equal?)
+(test* "native determinant (non-square)" (test-error)
+       (determinant #,(<f64array> (0 2 0 3) 1 2 3 4 5 6)))
+(test* "native array-inverse"
+       #,(<f64array> (0 3 0 3) -25 26 -33 4 -4 5 3 -3 4)
+       (array-inverse #,(<f64array> (0 3 0 3) 1 5 2 1 1 7 0 -3 4))
+       array-approx-equal?)
+(test* "native array-inverse (singular)" #f
+       (array-inverse #,(<f64array> (0 2 0 2) 2 4 1 2)))
+(test* "native array-div-left (singular)" (test-error)
+       (array-div-left #,(<f64array> (0 2 0 1) 1 1)
+                       #,(<f64array> (0 2 0 2) 2 4 1 2)))
+
 
 ;;-------------------------------------------------------------------
 ;; NB: copy-port uses read-block! and write-block for block copy,
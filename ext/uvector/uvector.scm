@@ -65,6 +65,112 @@
  (include "./uvlib.scm")
  )
 
+;; Selects the set of vectorized kernels (uvsimd.c) used by the arithmetic
+;; operations on f32/f64vectors.  For benchmarks and tests.  NAME is
+;; none, default, or an instruction set such as sse2 or avx2.
+;; Returns the name of the active set.
+(inline-stub
+ "#include \"uvsimd.h\""
+ (define-cproc %uvector-simd-kernels (:optional (name::<symbol>? #f))
+   (when name
+     (unless (Scm__UVSimdSelect (Scm_GetStringConst (SCM_SYMBOL_NAME name)))
+       (Scm_Error "kernel set not available: %S" name)))
+   (return (SCM_INTERN (Scm__UVSimdName))))
+ )
+
+;; Dense matrix kernels (uvmatrix.c), used by gauche.array for f32array
+;; and f64array.  A matrix is given as a vector
+;; #(uvector offset row-stride column-stride rows columns).
+;; %uvector-matrix-backend returns native or cblas.
+(inline-stub
+ "#include \"uvmatrix.h\""
+ (define-cproc %uvector-matrix-mul! (c a b) ::<void> Scm__UVMatrixMul)
+ (define-cproc %uvector-matrix-lu! (a piv) ::<int> Scm__UVMatrixLU)
+ (define-cproc %uvector-matrix-lu-solve! (lu piv b) ::<void>
+   Scm__UVMatrixLUSolve)
+ (define-cproc %uvector-matrix-copy! (dst src) ::<void> Scm__UVMatrixCopy)
+ (define-cproc %uvector-matrix-backend ()
+   (return (SCM_INTERN (Scm__UVMatrixBackend))))
+ )
+
+;; Fused kernels
+;;   (uvector-map-kernel! dest ((x vx) (y vy) ...) expr)
+;;   (uvector-reduce-kernel op seed ((x vx) (y vy) ...) expr)
+;; EXPR is compiled at the expansion time into a code for
+;; Scm_UVectorKernel (uvector.c.tmpl).  Variables bound to the vectors,
+;; real literals, and +, -, *, /, min, max, abs and sqrt are handled
+;; natively.  Other subexpressions that don't refer to the variables
+;; are evaluated once before the loop.
+(inline-stub
+ (define-cproc %uvector-kernel (code::<s32vector> consts::<f64vector>
+                                vecs::<list> reducer seed::<double> dest)
+   Scm_UVectorKernel)
+ )
+
+;; Returns the code (list of integers) and the list of expressions of
+;; the constants.  Opcodes must match KOP_* in uvector.c.tmpl.
+(define (%compile-uvector-kernel vars expr)
+  (define varmap (map-with-index (^[i v] (cons v i)) vars))
+  (define consts '())
+  (define nconsts 0)
+  (define (const e)
+    (push! consts e)
+    (inc! nconsts)
+    `(1 ,(- nconsts 1)))
+  (define (refers? e)
+    (cond [(symbol? e) (assq e varmap)]
+          [(pair? e) (or (refers? (car e)) (refers? (cdr e)))]
+          [else #f]))
+  (define (fold-args opcode unit args)
+    (if (null? args)
+      (const unit)
+      (let loop ([code (comp (car args))] [args (cdr args)])
+        (if (null? args)
+          code
+          (loop `(,@code ,@(comp (car args)) ,opcode) (cdr args))))))
+  (define (comp e)
+    (cond
+     [(assq e varmap) => (^p `(0 ,(cdr p)))]
+     [(real? e) (const e)]
+     [(and (pair? e) (list? e) (memq (car e) '(+ - * / min max abs sqrt)))
+      (let ([op (car e)] [args (cdr e)])
+        (case op
+          [(+) (fold-args 2 0 args)]
+          [(*) (fold-args 4 1 args)]
+          [(- /)
+           (cond [(null? args) (error "kernel: no argument:" e)]
+                 [(null? (cdr args))
+                  (if (eq? op '-)
+                    `(,@(comp (car args)) 8)
+                    `(,@(const 1) ,@(comp (car args)) 5))]
+                 [else (fold-args (if (eq? op '-) 3 5) 0 args)])]
+          [(min max)
+           (when (null? args) (error "kernel: no argument:" e))
+           (fold-args (if (eq? op 'min) 6 7) 0 args)]
+          [else
+           (unless (= (length args) 1)
+             (error "kernel: wrong number of arguments:" e))
+           `(,@(comp (car args)) ,(if (eq? op 'abs) 9 10))]))]
+     [(refers? e) (error "kernel: unsupported expression:" e)]
+     [else (const e)]))
+  (let1 code (comp expr)
+    (values code (reverse consts))))
+
+(define (%expand-uvector-kernel bindings expr reducer seed dest)
+  (unless (and (list? bindings)
+               (every (^b (and (list? b) (= (length b) 2) (symbol? (car b))))
+                      bindings))
+    (error "kernel: malformed bindings:" bindings))
+  (receive (code consts) (%compile-uvector-kernel (map car bindings) expr)
+    `(%uvector-kernel ',(list->s32vector code) (f64vector ,@consts)
+                      (list ,@(map cadr bindings)) ,reducer ,seed ,dest)))
+
+(define-macro (uvector-map-kernel! dest bindings expr)
+  (%expand-uvector-kernel bindings expr #f 0 dest))
+
+(define-macro (uvector-reduce-kernel op seed bindings expr)
+  (%expand-uvector-kernel bindings expr `',op seed #f))
+
 ;;-------------------------------------------------------------
 ;; Experimental - compile-time inlining *-ref
 ;; The TYPE constant must be in sync with ScmUVectorType in gauche/vector.h
@@ -251,7 +357,7 @@
      (Scm_TypeError "class" "uniform vector class" (SCM_OBJ klass)))
    (let* ([v::ScmUVector* (cast ScmUVector* (Scm_MakeUVector klass size NULL))]
           [r (Scm_ReadBlockX v port 0 size endian)])
-     (if (SCM_EOFP r)
+     (if (or (SCM_EOFP r) (SCM_FALSEP r))
        (return r)
        (begin
          (SCM_ASSERT (SCM_INTP r))
@@ -301,6 +301,25 @@
 
 (define (dummy . _) "/* not implemented */")
 
+;; Vectorized kernels (uvsimd.h) are available for f32 and f64.
+;; Returns the kind constant, or #f.
+(define (simd-kind rule)
+  (assoc-ref '(("f32" . "UVSIMD_F32") ("f64" . "UVSIMD_F64"))
+             (getval rule 't)))
+
+(define (simd-numop-rules rule opname)
+  (let ([kind (simd-kind rule)]
+        [op #"UVSIMD_~(string-upcase opname)"]
+        [T (getval rule 'T)])
+    `((SIMD_VV ,(^[d s0 s1]
+                  (if kind
+                    #"if (SCM_~|T|VECTORP(~s1) && uvsimd_vv(~kind, ~op, ~d, ~s0, ~s1)) break;"
+                    "")))
+      (SIMD_VS ,(^[d s0 v1]
+                  (if kind
+                    #"if (!oor && uvsimd_vs(~kind, ~op, ~d, ~s0, ~v1)) break;"
+                    ""))))))
+
 ;;===============================================================
 ;; Uvector opertaion generator
 ;;
@@ -311,6 +330,8 @@
                 (for-each (cute substitute <> `((opname  ,opname)
                                                 (Opname  ,Opname)
                                                 (Sopname ,Sopname)
+                                                ,@(simd-numop-rules rule
+                                                                    opname)
                                                 ,@rule))
                           *tmpl-numop*)))
             '("add" "sub" "mul")
@@ -320,6 +341,7 @@
     (for-each (cute substitute <> `((opname  "div")
                                     (Opname  "Div")
                                     (Sopname  "Div")
+                                    ,@(simd-numop-rules rule "div")
                                     ,@rule))
               *tmpl-numop*)))
 
@@ -355,7 +377,12 @@
         (case tag
           [(s64 u64) #"SCM_SET_INT64_ZERO(~r)"]
           [else #"~r = 0"]))
-      (for-each (cute substitute <> `((ZERO  ,ZERO) ,@rule))
+      (define (SIMD_DOT x y r)
+        (if-let1 kind (simd-kind rule)
+          #"if (SCM_~(getval rule 'T)VECTORP(~y) && uvsimd_dot(~kind, SCM_OBJ(~x), ~y, &~r)) break;"
+          ""))
+      (for-each (cute substitute <> `((ZERO  ,ZERO) (SIMD_DOT ,SIMD_DOT)
+                                      ,@rule))
                 *tmpl-dotop*))))
 
 (define (generate-rangeop)
@@ -387,17 +414,31 @@
         (case tag
           [(s64 u64) #"INT64LT(~|a|, ~|b|)"]
           [else      #"(~a < ~b)"]))
+      ;; Clamping with constant limits can be vectorized.
+      (define (SIMD_CLAMP dst)
+        (if-let1 kind (and dst (simd-kind rule))
+          (tree->string
+           `("if (mintype == ARGTYPE_CONST && maxtype == ARGTYPE_CONST\n"
+             "    && uvsimd_clamp(",kind", ",dst", SCM_OBJ(x),\n"
+             "                    mindc? -HUGE_VAL : minval,\n"
+             "                    maxdc? HUGE_VAL : maxval)) {\n"
+             "    return ",dst";\n"
+             "}"))
+          ""))
       (dolist [ops `(("range-check" "RangeCheck"
                       ""
                       "return Scm_MakeInteger(i)"
-                      "SCM_FALSE")
+                      "SCM_FALSE"
+                      #f)
                      ("clamp" "Clamp"
                       "ScmObj d = Scm_UVectorCopy(SCM_UVECTOR(x), 0, -1)"
                       ,#"SCM_~|TAG|VECTOR_ELEMENTS(d)[i] = ~(cast \"val\")"
+                      "d"
                       "d")
                      ("clamp!" "ClampX"
                       ""
                       ,#"SCM_~|TAG|VECTOR_ELEMENTS(x)[i] = ~(cast \"val\")"
+                      "SCM_OBJ(x)"
                       "SCM_OBJ(x)")
                      )]
         (for-each (cute substitute <> `((GETLIM  ,GETLIM)
@@ -408,9 +449,69 @@
                                         (dstdecl  ,(ref ops 2))
                                         (action   ,(ref ops 3))
                                         (okval    ,(ref ops 4))
+                                        (SIMD_CLAMP ,(cut SIMD_CLAMP
+                                                          (ref ops 5)))
                                         ,@rule))
                   *tmpl-rangeop*)))))
 
+(define (generate-reduce)
+  (dolist [rule (make-rules)]
+    (let1 tag (string->symbol (getval rule 't))
+      (define (ZERO r)
+        (case tag
+          [(s64 u64) #"SCM_SET_INT64_ZERO(~r)"]
+          [else #"~r = 0"]))
+      (define (LT a b)
+        (case tag
+          [(s64 u64) #"INT64LT(~|a|, ~|b|)"]
+          [else      #"(~a < ~b)"]))
+      (define (ISNAN v)
+        (case tag
+          [(f16 f32 f64) #"isnan(~v)"]
+          [else "FALSE"]))
+      (for-each (cute substitute <> `((ZERO ,ZERO) (LT ,LT) (ISNAN ,ISNAN)
+                                      ,@rule))
+                *tmpl-reduce*))))
+
+
+;; Elementwise math functions of f32 and f64 vectors, in the order of
+;; SCM_UVECTOR_MATH_* (uvector.h.tmpl).  Scheme name and libm function.
+(define *math-functions*
+  '(("abs" "fabs") ("sqrt" "sqrt") ("exp" "exp") ("log" "log")
+    ("sin" "sin") ("cos" "cos") ("tan" "tan")
+    ("asin" "asin") ("acos" "acos") ("atan" "atan")
+    ("sinh" "sinh") ("cosh" "cosh") ("tanh" "tanh")
+    ("floor" "floor") ("ceiling" "ceil")
+    ("round" "rint")                    ; rounds to even by default
+    ("truncate" "trunc")))
+
+(define (generate-mathop)
+  (dolist [rule (make-flonum-rules)]
+    (and-let1 kind (simd-kind rule)
+      (let1 sfx (if (equal? (getval rule 't) "f32") "f" "")
+        (define (MATH_CASES)
+          (string-join
+           (map (^[f]
+                  (string-append
+                   #"    case SCM_UVECTOR_MATH_~(string-upcase (car f)):\n"
+                   #"        for (long i=0; i<n; i++) d[i] = ~(cadr f)~|sfx|(x[i]);\n"
+                   "        break;"))
+                *math-functions*)
+           "\n"))
+        (for-each (cute substitute <> `((SIMD_KIND ,kind)
+                                        (MATH_CASES ,MATH_CASES)
+                                        ,@rule))
+                  *tmpl-mathop*)))))
+
+(define (generate-mathop-stubs)
+  (dolist [rule (make-flonum-rules)]
+    (when (simd-kind rule)
+      (dolist [f *math-functions*]
+        (for-each (cute substitute <> `((fn ,(car f))
+                                        (FN ,(string-upcase (car f)))
+                                        ,@rule))
+                  *tmpl-mathop*)))))
+
 (define (generate-swapb)
   (dolist [rule (make-rules)]
     (let1 tag (string->symbol (getval rule 't))
@@ -419,6 +520,14 @@
           [(s16 u16 f16) "SWAP_2"]
           [(s32 u32 f32) "SWAP_4"]
           [(s64 u64 f64) "SWAP_8"]))
+      (define (SIMD_SWAPB d len)
+        (let1 index (case tag
+                      [(s16 u16 f16) 0]
+                      [(s32 u32 f32) 1]
+                      [(s64 u64 f64) 2])
+          #"if (uvsimd_swapb(~index, ~d, ~len)) return;"))
       (unless (memq tag '(s8 u8))
-        (for-each (cute substitute <> `((SWAPB  ,SWAPB) ,@rule))
+        (for-each (cute substitute <> `((SWAPB  ,SWAPB)
+                                        (SIMD_SWAPB ,SIMD_SWAPB)
+                                        ,@rule))
                   *tmpl-swapb*)))))
@@ -0,0 +1,433 @@
+/*
+ * uvmatrix.c - dense matrix kernels on f32 and f64 vectors
+ *
+ *   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include <math.h>
+#include <gauche.h>
+#include "uvmatrix.h"
+
+#if defined(USE_CBLAS)
+#include <cblas.h>
+#endif
+
+/*=====================================================
+ * Matrix descriptors
+ */
+
+typedef struct {
+    ScmObj v;                   /* f32vector or f64vector */
+    long off, rs, cs;           /* (i, j) is at off + i*rs + j*cs */
+    long rows, cols;
+} mspec;
+
+static long spec_long(ScmObj m, int k)
+{
+    ScmObj x = SCM_VECTOR_ELEMENT(m, k);
+    if (!SCM_INTP(x)) Scm_Error("bad matrix descriptor: %S", m);
+    return SCM_INT_VALUE(x);
+}
+
+static void get_spec(ScmObj m, mspec *s, int mutablep)
+{
+    if (!SCM_VECTORP(m) || SCM_VECTOR_SIZE(m) != 6) {
+        Scm_Error("bad matrix descriptor: %S", m);
+    }
+    s->v = SCM_VECTOR_ELEMENT(m, 0);
+    if (!SCM_F32VECTORP(s->v) && !SCM_F64VECTORP(s->v)) {
+        Scm_Error("f32vector or f64vector required, but got: %S", s->v);
+    }
+    s->off = spec_long(m, 1);
+    s->rs = spec_long(m, 2);
+    s->cs = spec_long(m, 3);
+    s->rows = spec_long(m, 4);
+    s->cols = spec_long(m, 5);
+    if (s->rows < 0 || s->cols < 0) Scm_Error("bad matrix descriptor: %S", m);
+    if (s->rows > 0 && s->cols > 0) {
+        long len = SCM_UVECTOR_SIZE(s->v);
+        long lr = (s->rows-1)*s->rs, lc = (s->cols-1)*s->cs;
+        long lo = s->off + (lr < 0? lr : 0) + (lc < 0? lc : 0);
+        long hi = s->off + (lr > 0? lr : 0) + (lc > 0? lc : 0);
+        if (lo < 0 || hi >= len) {
+            Scm_Error("matrix descriptor out of range of the vector: %S", m);
+        }
+    }
+    if (mutablep) SCM_UVECTOR_CHECK_MUTABLE(s->v);
+}
+
+static void check_same_type(const mspec *a, const mspec *b)
+{
+    if (!Scm_EqP(SCM_OBJ(Scm_ClassOf(a->v)), SCM_OBJ(Scm_ClassOf(b->v)))) {
+        Scm_Error("matrices of different element types: %S and %S",
+                  a->v, b->v);
+    }
+}
+
+/* Byte range touched by the matrix, as [*lo, *hi). */
+static void spec_range(const mspec *s, const char **lo, const char **hi)
+{
+    long esize = SCM_F64VECTORP(s->v)? sizeof(double) : sizeof(float);
+    long lr = (s->rows-1)*s->rs, lc = (s->cols-1)*s->cs;
+    const char *base = (const char*)SCM_UVECTOR_ELEMENTS(s->v);
+    *lo = base + (s->off + (lr < 0? lr : 0) + (lc < 0? lc : 0)) * esize;
+    *hi = base + (s->off + (lr > 0? lr : 0) + (lc > 0? lc : 0) + 1) * esize;
+}
+
+static void check_no_overlap(const mspec *d, const mspec *s)
+{
+    const char *dlo, *dhi, *slo, *shi;
+    if (d->rows == 0 || d->cols == 0 || s->rows == 0 || s->cols == 0) return;
+    spec_range(d, &dlo, &dhi);
+    spec_range(s, &slo, &shi);
+    if (dlo < shi && slo < dhi) {
+        Scm_Error("destination matrix shares storage with the source: %S",
+                  d->v);
+    }
+}
+
+/*=====================================================
+ * Kernels
+ *
+ *  gemm_E computes C += alpha*A*B.  B is packed, KC rows by NC columns
+ *  at a time, into a contiguous buffer and each row of C is accumulated
+ *  in ACC, so that the innermost loop runs over contiguous memory
+ *  regardless of the strides, and can be vectorized by the compiler.
+ *  The packed block of B stays in the cache while the MC rows of A
+ *  sweep over it.
+ *
+ *  lu_E is a blocked right-looking LU decomposition with partial
+ *  pivoting.  Each NB-column panel is factorized unblocked, then the
+ *  block row of U is computed, and the trailing submatrix is updated
+ *  by gemm, where most of the time is spent.
+ */
+
+#define MC  64
+#define KC  128
+#define NC  256
+#define NB  64
+
+#define MIN(a, b)  ((a) < (b)? (a) : (b))
+#define MAX(a, b)  ((a) > (b)? (a) : (b))
+
+#define DEFINE_KERNELS(E)                                               \
+static void gemm_native_##E(long m, long n, long k, E alpha,            \
+                            const E *A, long ars, long acs,             \
+                            const E *B, long brs, long bcs,             \
+                            E *C, long crs, long ccs)                   \
+{                                                                       \
+    E *bp = SCM_NEW_ATOMIC_ARRAY(E, KC*NC);                             \
+    E acc[NC];                                                          \
+    for (long j0 = 0; j0 < n; j0 += NC) {                               \
+        long nb = MIN(NC, n-j0);                                        \
+        for (long p0 = 0; p0 < k; p0 += KC) {                           \
+            long kb = MIN(KC, k-p0);                                    \
+            for (long p = 0; p < kb; p++) {                             \
+                const E *b = B + (p0+p)*brs + j0*bcs;                   \
+                for (long j = 0; j < nb; j++) bp[p*nb+j] = b[j*bcs];    \
+            }                                                           \
+            for (long i0 = 0; i0 < m; i0 += MC) {                       \
+                long mb = MIN(MC, m-i0);                                \
+                for (long i = i0; i < i0+mb; i++) {                     \
+                    const E *a = A + i*ars + p0*acs;                    \
+                    E *c = C + i*crs + j0*ccs;                          \
+                    for (long j = 0; j < nb; j++) acc[j] = 0;           \
+                    for (long p = 0; p < kb; p++) {                     \
+                        E s = a[p*acs];                                 \
+                        const E *r = bp + p*nb;                         \
+                        for (long j = 0; j < nb; j++) acc[j] += s*r[j]; \
+                    }                                                   \
+                    for (long j = 0; j < nb; j++) c[j*ccs] += alpha*acc[j]; \
+                }                                                       \
+            }                                                           \
+        }                                                               \
+    }                                                                   \
+}                                                                       \
+                                                                        \
+static void gemm_##E(long m, long n, long k, E alpha,                   \
+                     const E *A, long ars, long acs,                    \
+                     const E *B, long brs, long bcs,                    \
+                     E *C, long crs, long ccs)                          \
+{                                                                       \
+    if (m == 0 || n == 0 || k == 0) return;                             \
+    if (!GEMM_BLAS_##E(m, n, k, alpha, A, ars, acs, B, brs, bcs,        \
+                       C, crs, ccs)) {                                  \
+        gemm_native_##E(m, n, k, alpha, A, ars, acs, B, brs, bcs,       \
+                        C, crs, ccs);                                   \
+    }                                                                   \
+}                                                                       \
+                                                                        \
+static int lu_##E(E *A, long rs, long cs, long n, int32_t *piv)         \
+{                                                                       \
+    int sign = 1;                                                       \
+    for (long k0 = 0; k0 < n; k0 += NB) {                               \
+        long kb = MIN(NB, n-k0), k1 = k0+kb;                            \
+        for (long k = k0; k < k1; k++) {                                \
+            long p = k;                                                 \
+            E pmax = fabs(A[k*rs+k*cs]);                                \
+            for (long i = k+1; i < n; i++) {                            \
+                E v = fabs(A[i*rs+k*cs]);                               \
+                if (v > pmax) { pmax = v; p = i; }                      \
+            }                                                           \
+            piv[k] = (int32_t)p;                                        \
+            if (pmax == 0) return 0;                                    \
+            if (p != k) {                                               \
+                for (long j = 0; j < n; j++) {                          \
+                    E t = A[k*rs+j*cs];                                 \
+                    A[k*rs+j*cs] = A[p*rs+j*cs];                        \
+                    A[p*rs+j*cs] = t;                                   \
+                }                                                       \
+                sign = -sign;                                           \
+            }                                                           \
+            E d = A[k*rs+k*cs];                                         \
+            for (long i = k+1; i < n; i++) {                            \
+                E l = (A[i*rs+k*cs] /= d);                              \
+                for (long j = k+1; j < k1; j++) {                       \
+                    A[i*rs+j*cs] -= l * A[k*rs+j*cs];                   \
+                }                                                       \
+            }                                                           \
+        }                                                               \
+        if (k1 < n) {                                                   \
+            for (long k = k0; k < k1; k++) {                            \
+                for (long i = k+1; i < k1; i++) {                       \
+                    E l = A[i*rs+k*cs];                                 \
+                    for (long j = k1; j < n; j++) {                     \
+                        A[i*rs+j*cs] -= l * A[k*rs+j*cs];               \
+                    }                                                   \
+                }                                                       \
+            }                                                           \
+            gemm_##E(n-k1, n-k1, kb, -1,                                \
+                     A + k1*rs + k0*cs, rs, cs,                         \
+                     A + k0*rs + k1*cs, rs, cs,                         \
+                     A + k1*rs + k1*cs, rs, cs);                        \
+        }                                                               \
+    }                                                                   \
+    return sign;                                                        \
+}                                                                       \
+                                                                        \
+static void lu_solve_##E(const E *A, long ars, long acs, long n,        \
+                         const int32_t *piv,                            \
+                         E *B, long brs, long bcs, long m)              \
+{                                                                       \
+    for (long k = 0; k < n; k++) {                                      \
+        long p = piv[k];                                                \
+        if (p == k) continue;                                           \
+        for (long j = 0; j < m; j++) {                                  \
+            E t = B[k*brs+j*bcs];                                       \
+            B[k*brs+j*bcs] = B[p*brs+j*bcs];                            \
+            B[p*brs+j*bcs] = t;                                         \
+        }                                                               \
+    }                                                                   \
+    for (long i = 1; i < n; i++) {                                      \
+        for (long k = 0; k < i; k++) {                                  \
+            E l = A[i*ars+k*acs];                                       \
+            if (l == 0) continue;                                       \
+            for (long j = 0; j < m; j++) B[i*brs+j*bcs] -= l*B[k*brs+j*bcs]; \
+        }                                                               \
+    }                                                                   \
+    for (long i = n-1; i >= 0; i--) {                                   \
+        for (long k = i+1; k < n; k++) {                                \
+            E u = A[i*ars+k*acs];                                       \
+            if (u == 0) continue;                                       \
+            for (long j = 0; j < m; j++) B[i*brs+j*bcs] -= u*B[k*brs+j*bcs]; \
+        }                                                               \
+        E d = A[i*ars+i*acs];                                           \
+        for (long j = 0; j < m; j++) B[i*brs+j*bcs] /= d;               \
+    }                                                                   \
+}                                                                       \
+                                                                        \
+static void copy_##E(E *D, long drs, long dcs,                          \
+                     const E *S, long srs, long scs, long m, long n)    \
+{                                                                       \
+    for (long i0 = 0; i0 < m; i0 += 32) {                               \
+        for (long j0 = 0; j0 < n; j0 += 32) {                           \
+            for (long i = i0; i < MIN(i0+32, m); i++) {                 \
+                for (long j = j0; j < MIN(j0+32, n); j++) {             \
+                    D[i*drs+j*dcs] = S[i*srs+j*scs];                    \
+                }                                                       \
+            }                                                           \
+        }                                                               \
+    }                                                                   \
+}
+
+/* With an external BLAS, gemm is delegated to cblas_?gemm if each
+   operand has unit stride in either direction.  Returns 0 if it can't
+   handle the layout. */
+#if defined(USE_CBLAS)
+#define DEFINE_GEMM_BLAS(E, fn)                                         \
+static int GEMM_BLAS_##E(long m, long n, long k, E alpha,               \
+                         const E *A, long ars, long acs,                \
+                         const E *B, long brs, long bcs,                \
+                         E *C, long crs, long ccs)                      \
+{                                                                       \
+    enum CBLAS_TRANSPOSE ta, tb;                                        \
+    long lda, ldb;                                                      \
+    if (ccs != 1 || crs < MAX(n, 1)) return 0;                          \
+    if (acs == 1 && ars >= MAX(k, 1))      { ta = CblasNoTrans; lda = ars; } \
+    else if (ars == 1 && acs >= MAX(m, 1)) { ta = CblasTrans;   lda = acs; } \
+    else return 0;                                                      \
+    if (bcs == 1 && brs >= MAX(n, 1))      { tb = CblasNoTrans; ldb = brs; } \
+    else if (brs == 1 && bcs >= MAX(k, 1)) { tb = CblasTrans;   ldb = bcs; } \
+    else return 0;                                                      \
+    fn(CblasRowMajor, ta, tb, (int)m, (int)n, (int)k, alpha,            \
+       A, (int)lda, B, (int)ldb, 1, C, (int)crs);                       \
+    return 1;                                                           \
+}
+DEFINE_GEMM_BLAS(double, cblas_dgemm)
+DEFINE_GEMM_BLAS(float, cblas_sgemm)
+#else  /* !USE_CBLAS */
+#define GEMM_BLAS_double(...)  0
+#define GEMM_BLAS_float(...)   0
+#endif /* !USE_CBLAS */
+
+DEFINE_KERNELS(double)
+DEFINE_KERNELS(float)
+
+/*=====================================================
+ * Entry points
+ */
+
+#define ELTS(s, E)  ((E*)SCM_UVECTOR_ELEMENTS((s)->v) + (s)->off)
+
+void Scm__UVMatrixMul(ScmObj c, ScmObj a, ScmObj b)
+{
+    mspec sc, sa, sb;
+    get_spec(c, &sc, TRUE);
+    get_spec(a, &sa, FALSE);
+    get_spec(b, &sb, FALSE);
+    check_same_type(&sc, &sa);
+    check_same_type(&sc, &sb);
+    if (sa.cols != sb.rows || sc.rows != sa.rows || sc.cols != sb.cols) {
+        Scm_Error("dimension mismatch: can't multiply %ldx%ld and %ldx%ld "
+                  "matrices into %ldx%ld", sa.rows, sa.cols, sb.rows, sb.cols,
+                  sc.rows, sc.cols);
+    }
+    check_no_overlap(&sc, &sa);
+    check_no_overlap(&sc, &sb);
+
+    if (SCM_F64VECTORP(sc.v)) {
+        double *C = ELTS(&sc, double);
+        for (long i = 0; i < sc.rows; i++)
+            for (long j = 0; j < sc.cols; j++) C[i*sc.rs+j*sc.cs] = 0;
+        gemm_double(sa.rows, sb.cols, sa.cols, 1,
+                    ELTS(&sa, double), sa.rs, sa.cs,
+                    ELTS(&sb, double), sb.rs, sb.cs, C, sc.rs, sc.cs);
+    } else {
+        float *C = ELTS(&sc, float);
+        for (long i = 0; i < sc.rows; i++)
+            for (long j = 0; j < sc.cols; j++) C[i*sc.rs+j*sc.cs] = 0;
+        gemm_float(sa.rows, sb.cols, sa.cols, 1,
+                   ELTS(&sa, float), sa.rs, sa.cs,
+                   ELTS(&sb, float), sb.rs, sb.cs, C, sc.rs, sc.cs);
+    }
+}
+
+static int32_t *get_pivots(ScmObj piv, long n)
+{
+    if (!SCM_S32VECTORP(piv) || SCM_S32VECTOR_SIZE(piv) < n) {
+        Scm_Error("s32vector of at least %ld elements required, but got: %S",
+                  n, piv);
+    }
+    return SCM_S32VECTOR_ELEMENTS(piv);
+}
+
+int Scm__UVMatrixLU(ScmObj a, ScmObj piv)
+{
+    mspec sa;
+    get_spec(a, &sa, TRUE);
+    if (sa.rows != sa.cols) {
+        Scm_Error("square matrix required, but got %ldx%ld",
+                  sa.rows, sa.cols);
+    }
+    int32_t *p = get_pivots(piv, sa.rows);
+    SCM_UVECTOR_CHECK_MUTABLE(piv);
+    if (SCM_F64VECTORP(sa.v)) {
+        return lu_double(ELTS(&sa, double), sa.rs, sa.cs, sa.rows, p);
+    } else {
+        return lu_float(ELTS(&sa, float), sa.rs, sa.cs, sa.rows, p);
+    }
+}
+
+void Scm__UVMatrixLUSolve(ScmObj lu, ScmObj piv, ScmObj b)
+{
+    mspec sa, sb;
+    get_spec(lu, &sa, FALSE);
+    get_spec(b, &sb, TRUE);
+    check_same_type(&sa, &sb);
+    if (sa.rows != sa.cols || sb.rows != sa.rows) {
+        Scm_Error("dimension mismatch: can't solve %ldx%ld system "
+                  "with %ldx%ld right-hand side",
+                  sa.rows, sa.cols, sb.rows, sb.cols);
+    }
+    check_no_overlap(&sb, &sa);
+    int32_t *p = get_pivots(piv, sa.rows);
+    for (long i = 0; i < sa.rows; i++) {
+        if (p[i] < 0 || p[i] >= sa.rows) {
+            Scm_Error("bad pivot vector: %S", piv);
+        }
+    }
+    if (SCM_F64VECTORP(sa.v)) {
+        lu_solve_double(ELTS(&sa, double), sa.rs, sa.cs, sa.rows, p,
+                        ELTS(&sb, double), sb.rs, sb.cs, sb.cols);
+    } else {
+        lu_solve_float(ELTS(&sa, float), sa.rs, sa.cs, sa.rows, p,
+                       ELTS(&sb, float), sb.rs, sb.cs, sb.cols);
+    }
+}
+
+void Scm__UVMatrixCopy(ScmObj dst, ScmObj src)
+{
+    mspec sd, ss;
+    get_spec(dst, &sd, TRUE);
+    get_spec(src, &ss, FALSE);
+    check_same_type(&sd, &ss);
+    if (sd.rows != ss.rows || sd.cols != ss.cols) {
+        Scm_Error("dimension mismatch: can't copy %ldx%ld matrix to %ldx%ld",
+                  ss.rows, ss.cols, sd.rows, sd.cols);
+    }
+    check_no_overlap(&sd, &ss);
+    if (SCM_F64VECTORP(sd.v)) {
+        copy_double(ELTS(&sd, double), sd.rs, sd.cs,
+                    ELTS(&ss, double), ss.rs, ss.cs, sd.rows, sd.cols);
+    } else {
+        copy_float(ELTS(&sd, float), sd.rs, sd.cs,
+                   ELTS(&ss, float), ss.rs, ss.cs, sd.rows, sd.cols);
+    }
+}
+
+const char *Scm__UVMatrixBackend(void)
+{
+#if defined(USE_CBLAS)
+    return "cblas";
+#else
+    return "native";
+#endif
+}
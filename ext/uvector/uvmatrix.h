@@ -0,0 +1,67 @@
+/*
+ * uvmatrix.h - dense matrix kernels on f32 and f64 vectors
+ *
+ *   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef GAUCHE_UVMATRIX_H
+#define GAUCHE_UVMATRIX_H
+
+/* Dense linear algebra on f32vectors and f64vectors, used by
+   gauche.array for f32array and f64array (matrix.scm).
+
+   A matrix is passed as a Scheme vector
+     #(uvector offset row-stride column-stride rows columns)
+   whose element (i, j) is at offset + i*row-stride + j*column-stride
+   of uvector.  All the matrices given to an operation must have the same
+   element type.  Matrix multiplication is done by cache-blocked loops,
+   or by the cblas_?gemm of an external BLAS if configured with
+   --with-blas. */
+
+/* C = A * B.  C must not overlap with A nor B. */
+extern void Scm__UVMatrixMul(ScmObj c, ScmObj a, ScmObj b);
+
+/* LU decomposition of square A in place, with partial pivoting.
+   PIV must be an s32vector of at least the size of A, and receives
+   the row exchanges.  Returns 1 or -1, the sign of the permutation,
+   or 0 if A is singular. */
+extern int Scm__UVMatrixLU(ScmObj a, ScmObj piv);
+
+/* Solves A X = B in place of B, where LU and PIV are the result of
+   Scm__UVMatrixLU on A. */
+extern void Scm__UVMatrixLUSolve(ScmObj lu, ScmObj piv, ScmObj b);
+
+/* DST = SRC.  Giving a transposed view as SRC makes a transpose. */
+extern void Scm__UVMatrixCopy(ScmObj dst, ScmObj src);
+
+/* "cblas" or "native" */
+extern const char *Scm__UVMatrixBackend(void);
+
+#endif /* GAUCHE_UVMATRIX_H */
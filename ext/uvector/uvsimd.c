@@ -0,0 +1,396 @@
+/*
+ * uvsimd.c - vectorized kernels for uniform vectors
+ *
+ *   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <gauche.h>
+#include "uvsimd.h"
+
+/* We need __builtin_convertvector, which appeared in gcc 9. */
+#if defined(__GNUC__) && (defined(__clang__) || __GNUC__ >= 9)
+#  if defined(__SSE2__)
+#    define UVSIMD_BASE_NAME "sse2"
+#  elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#    define UVSIMD_BASE_NAME "neon"
+#  endif
+#  if defined(UVSIMD_BASE_NAME) && (defined(__x86_64__) || defined(__i386__))
+#    define UVSIMD_X86 1
+#  endif
+#endif
+
+#if defined(UVSIMD_BASE_NAME)
+
+/* Each kernel processes sizeof(V)/sizeof(E) elements per iteration,
+   and finishes the remaining ones with scalar code.  Loads and stores
+   go through memcpy, since uvector elements are only aligned to the
+   element size. */
+
+#define DEFINE_ARITH(sfx, attr, E, V, opname, op)                       \
+    attr static void vv_##E##_##opname##_##sfx(void *d, const void *x,  \
+                                               const void *y, long n)   \
+    {                                                                   \
+        E *pd = d;                                                      \
+        const E *px = x, *py = y;                                       \
+        long i = 0, k = sizeof(V)/sizeof(E);                            \
+        for (; i+k <= n; i += k) {                                      \
+            V a, b;                                                     \
+            memcpy(&a, px+i, sizeof(V));                                \
+            memcpy(&b, py+i, sizeof(V));                                \
+            a = a op b;                                                 \
+            memcpy(pd+i, &a, sizeof(V));                                \
+        }                                                               \
+        for (; i < n; i++) pd[i] = px[i] op py[i];                      \
+    }                                                                   \
+    attr static void vs_##E##_##opname##_##sfx(void *d, const void *x,  \
+                                               double y, long n)        \
+    {                                                                   \
+        E *pd = d, s = (E)y;                                            \
+        const E *px = x;                                                \
+        long i = 0, k = sizeof(V)/sizeof(E);                            \
+        for (; i+k <= n; i += k) {                                      \
+            V a;                                                        \
+            memcpy(&a, px+i, sizeof(V));                                \
+            a = a op s;                                                 \
+            memcpy(pd+i, &a, sizeof(V));                                \
+        }                                                               \
+        for (; i < n; i++) pd[i] = px[i] op s;                          \
+    }
+
+/* Products are summed in double, in two vector accumulators.  The
+   order of additions differs from the scalar loop, so the last bits
+   of the result may differ.  VE is a vector of E with as many
+   elements as VD. */
+#define DEFINE_DOT(sfx, attr, E, VE, VD)                                \
+    attr static double dot_##E##_##sfx(const void *x, const void *y,   \
+                                       long n)                          \
+    {                                                                   \
+        const E *px = x, *py = y;                                       \
+        long i = 0, k = sizeof(VD)/sizeof(double);                      \
+        VD acc0 = {0}, acc1 = {0};                                      \
+        for (; i+2*k <= n; i += 2*k) {                                  \
+            VE a0, b0, a1, b1;                                          \
+            memcpy(&a0, px+i, sizeof(VE));                              \
+            memcpy(&b0, py+i, sizeof(VE));                              \
+            memcpy(&a1, px+i+k, sizeof(VE));                            \
+            memcpy(&b1, py+i+k, sizeof(VE));                            \
+            acc0 += __builtin_convertvector(a0, VD)                     \
+                * __builtin_convertvector(b0, VD);                      \
+            acc1 += __builtin_convertvector(a1, VD)                     \
+                * __builtin_convertvector(b1, VD);                      \
+        }                                                               \
+        acc0 += acc1;                                                   \
+        double r = 0.0;                                                 \
+        for (long j = 0; j < k; j++) r += acc0[j];                      \
+        for (; i < n; i++) r += (double)px[i] * (double)py[i];          \
+        return r;                                                       \
+    }
+
+/* M is a signed integer vector of the same shape as V.  Comparisons
+   with NaN are false, so NaN elements are left as they are, as in
+   the scalar code. */
+#define DEFINE_CLAMP(sfx, attr, E, V, M)                                \
+    attr static void clamp_##E##_##sfx(void *d, const void *x,          \
+                                       double lo, double hi, long n)    \
+    {                                                                   \
+        E *pd = d, l = (E)lo, h = (E)hi;                                \
+        const E *px = x;                                                \
+        long i = 0, k = sizeof(V)/sizeof(E);                            \
+        V lv = (V){0} + l, hv = (V){0} + h;                             \
+        for (; i+k <= n; i += k) {                                      \
+            V a;                                                        \
+            M m;                                                        \
+            memcpy(&a, px+i, sizeof(V));                                \
+            m = a < lv;                                                 \
+            a = (V)(((M)lv & m) | ((M)a & ~m));                         \
+            m = hv < a;                                                 \
+            a = (V)(((M)hv & m) | ((M)a & ~m));                         \
+            memcpy(pd+i, &a, sizeof(V));                                \
+        }                                                               \
+        for (; i < n; i++) {                                            \
+            E v = px[i];                                                \
+            if (v < l) v = l;                                           \
+            if (h < v) v = h;                                           \
+            pd[i] = v;                                                  \
+        }                                                               \
+    }
+
+#define DEFINE_SWAPB(sfx, attr, V16, V32, V64)                          \
+    attr static void swap2_##sfx(void *d, long n)                       \
+    {                                                                   \
+        uint16_t *p = d;                                                \
+        long i = 0, k = sizeof(V16)/2;                                  \
+        for (; i+k <= n; i += k) {                                      \
+            V16 a;                                                      \
+            memcpy(&a, p+i, sizeof(V16));                               \
+            a = (a >> 8) | (a << 8);                                    \
+            memcpy(p+i, &a, sizeof(V16));                               \
+        }                                                               \
+        for (; i < n; i++) p[i] = (uint16_t)((p[i] >> 8) | (p[i] << 8)); \
+    }                                                                   \
+    attr static void swap4_##sfx(void *d, long n)                       \
+    {                                                                   \
+        uint32_t *p = d;                                                \
+        long i = 0, k = sizeof(V32)/4;                                  \
+        for (; i+k <= n; i += k) {                                      \
+            V32 a;                                                      \
+            memcpy(&a, p+i, sizeof(V32));                               \
+            a = (a >> 24) | ((a >> 8) & 0xff00)                         \
+                | ((a << 8) & 0xff0000) | (a << 24);                    \
+            memcpy(p+i, &a, sizeof(V32));                               \
+        }                                                               \
+        for (; i < n; i++) p[i] = __builtin_bswap32(p[i]);              \
+    }                                                                   \
+    attr static void swap8_##sfx(void *d, long n)                       \
+    {                                                                   \
+        uint64_t *p = d;                                                \
+        long i = 0, k = sizeof(V64)/8;                                  \
+        for (; i+k <= n; i += k) {                                      \
+            V64 a;                                                      \
+            memcpy(&a, p+i, sizeof(V64));                               \
+            a = (a >> 32) | (a << 32);                                  \
+            a = ((a >> 24) & 0x000000ff000000ffULL)                     \
+                | ((a >> 8) & 0x0000ff000000ff00ULL)                    \
+                | ((a << 8) & 0x00ff000000ff0000ULL)                    \
+                | ((a << 24) & 0xff000000ff000000ULL);                  \
+            memcpy(p+i, &a, sizeof(V64));                               \
+        }                                                               \
+        for (; i < n; i++) p[i] = __builtin_bswap64(p[i]);              \
+    }
+
+/* d[i] = fn(x[i]).  VEXPR computes the vector a, and SFN is the scalar
+   function for the remaining elements. */
+#define DEFINE_UNARY(sfx, attr, E, V, fname, vexpr, sfn)                \
+    attr static void math_##E##_##fname##_##sfx(void *d, const void *x, \
+                                                 long n)                \
+    {                                                                   \
+        E *pd = d;                                                      \
+        const E *px = x;                                                \
+        long i = 0, k = sizeof(V)/sizeof(E);                            \
+        for (; i+k <= n; i += k) {                                      \
+            V a;                                                        \
+            memcpy(&a, px+i, sizeof(V));                                \
+            a = vexpr;                                                  \
+            memcpy(pd+i, &a, sizeof(V));                                \
+        }                                                               \
+        for (; i < n; i++) pd[i] = sfn(px[i]);                          \
+    }
+
+/* Abs clears the sign bit: M is as in DEFINE_CLAMP, and MMAX is the
+   maximum of its element type.  Vector square root is only available
+   as intrinsics, which UVSIMD_SQRT{F,D}_sfx wrap. */
+#define DEFINE_MATH(sfx, attr, E, V, M, MMAX, SQRTV, sfabs, sfsqrt)     \
+    DEFINE_UNARY(sfx, attr, E, V, abs,                                  \
+                 (V)((M)a & ((M){0} + MMAX)), sfabs)                    \
+    DEFINE_UNARY(sfx, attr, E, V, sqrt, SQRTV(a), sfsqrt)
+
+#if defined(UVSIMD_X86)
+#include <immintrin.h>
+#define UVSIMD_SQRTF_base(a)  ((vf_base)_mm_sqrt_ps((__m128)(a)))
+#define UVSIMD_SQRTD_base(a)  ((vd_base)_mm_sqrt_pd((__m128d)(a)))
+#define UVSIMD_SQRTF_avx2(a)  ((vf_avx2)_mm256_sqrt_ps((__m256)(a)))
+#define UVSIMD_SQRTD_avx2(a)  ((vd_avx2)_mm256_sqrt_pd((__m256d)(a)))
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define UVSIMD_SQRTF_base(a)  ((vf_base)vsqrtq_f32((float32x4_t)(a)))
+#define UVSIMD_SQRTD_base(a)  ((vd_base)vsqrtq_f64((float64x2_t)(a)))
+#else
+/* 32-bit NEON has no vector square root; we go lane by lane. */
+#define UVSIMD_SQRTF_base(a)                                            \
+    ({ vf_base r_ = (a);                                                \
+       for (int j_ = 0; j_ < 4; j_++) r_[j_] = sqrtf(r_[j_]); r_; })
+#define UVSIMD_SQRTD_base(a)                                            \
+    ({ vd_base r_ = (a);                                                \
+       for (int j_ = 0; j_ < 2; j_++) r_[j_] = sqrt(r_[j_]); r_; })
+#endif
+
+/* Exp, log, sin and cos of glibc's libmvec, which the compiler itself
+   would call for vectorized loops under -ffast-math.  We only use the
+   AVX2 versions ('d' in the vector function ABI). */
+#if defined(UVSIMD_X86) && defined(HAVE_LIBMVEC)
+#define UVSIMD_MVEC 1
+typedef float mvec_v8sf __attribute__((vector_size(32)));
+typedef double mvec_v4df __attribute__((vector_size(32)));
+extern mvec_v8sf _ZGVdN8v_expf(mvec_v8sf);
+extern mvec_v8sf _ZGVdN8v_logf(mvec_v8sf);
+extern mvec_v8sf _ZGVdN8v_sinf(mvec_v8sf);
+extern mvec_v8sf _ZGVdN8v_cosf(mvec_v8sf);
+extern mvec_v4df _ZGVdN4v_exp(mvec_v4df);
+extern mvec_v4df _ZGVdN4v_log(mvec_v4df);
+extern mvec_v4df _ZGVdN4v_sin(mvec_v4df);
+extern mvec_v4df _ZGVdN4v_cos(mvec_v4df);
+
+#define DEFINE_MVEC(fname)                                              \
+    DEFINE_UNARY(avx2, __attribute__((target("avx2"))),                 \
+                 float, mvec_v8sf, fname, _ZGVdN8v_##fname##f(a),       \
+                 fname##f)                                              \
+    DEFINE_UNARY(avx2, __attribute__((target("avx2"))),                 \
+                 double, mvec_v4df, fname, _ZGVdN4v_##fname(a), fname)
+DEFINE_MVEC(exp)
+DEFINE_MVEC(log)
+DEFINE_MVEC(sin)
+DEFINE_MVEC(cos)
+#endif /* UVSIMD_X86 && HAVE_LIBMVEC */
+
+/* Table entries of exp, log, sin and cos. */
+#define MVEC_NONE(E, sfx)  NULL, NULL, NULL, NULL
+#define MVEC_LIBMVEC(E, sfx)                                            \
+    math_##E##_exp_##sfx, math_##E##_log_##sfx,                         \
+    math_##E##_sin_##sfx, math_##E##_cos_##sfx
+
+/* Defines a kernel set named SFX, using vectors of VBYTES bytes.
+   ATTR is given to every function to select the instruction set.
+   MVEC is either MVEC_NONE or MVEC_LIBMVEC. */
+#define DEFINE_KERNELS(sfx, name, attr, VBYTES, mvec)                   \
+    typedef float vf_##sfx __attribute__((vector_size(VBYTES)));        \
+    typedef float vhf_##sfx __attribute__((vector_size(VBYTES/2)));     \
+    typedef double vd_##sfx __attribute__((vector_size(VBYTES)));       \
+    typedef int32_t vi32_##sfx __attribute__((vector_size(VBYTES)));    \
+    typedef int64_t vi64_##sfx __attribute__((vector_size(VBYTES)));    \
+    typedef uint16_t vu16_##sfx __attribute__((vector_size(VBYTES)));   \
+    typedef uint32_t vu32_##sfx __attribute__((vector_size(VBYTES)));   \
+    typedef uint64_t vu64_##sfx __attribute__((vector_size(VBYTES)));   \
+    DEFINE_ARITH(sfx, attr, float, vf_##sfx, add, +)                    \
+    DEFINE_ARITH(sfx, attr, float, vf_##sfx, sub, -)                    \
+    DEFINE_ARITH(sfx, attr, float, vf_##sfx, mul, *)                    \
+    DEFINE_ARITH(sfx, attr, float, vf_##sfx, div, /)                    \
+    DEFINE_ARITH(sfx, attr, double, vd_##sfx, add, +)                   \
+    DEFINE_ARITH(sfx, attr, double, vd_##sfx, sub, -)                   \
+    DEFINE_ARITH(sfx, attr, double, vd_##sfx, mul, *)                   \
+    DEFINE_ARITH(sfx, attr, double, vd_##sfx, div, /)                   \
+    DEFINE_DOT(sfx, attr, float, vhf_##sfx, vd_##sfx)                   \
+    DEFINE_DOT(sfx, attr, double, vd_##sfx, vd_##sfx)                   \
+    DEFINE_CLAMP(sfx, attr, float, vf_##sfx, vi32_##sfx)                \
+    DEFINE_CLAMP(sfx, attr, double, vd_##sfx, vi64_##sfx)               \
+    DEFINE_SWAPB(sfx, attr, vu16_##sfx, vu32_##sfx, vu64_##sfx)         \
+    DEFINE_MATH(sfx, attr, float, vf_##sfx, vi32_##sfx, INT32_MAX,      \
+                UVSIMD_SQRTF_##sfx, fabsf, sqrtf)                       \
+    DEFINE_MATH(sfx, attr, double, vd_##sfx, vi64_##sfx, INT64_MAX,     \
+                UVSIMD_SQRTD_##sfx, fabs, sqrt)                         \
+    static const ScmUVSimdKernels kernels_##sfx = {                     \
+        name,                                                           \
+        { { vv_float_add_##sfx, vv_float_sub_##sfx,                     \
+            vv_float_mul_##sfx, vv_float_div_##sfx },                   \
+          { vv_double_add_##sfx, vv_double_sub_##sfx,                   \
+            vv_double_mul_##sfx, vv_double_div_##sfx } },               \
+        { { vs_float_add_##sfx, vs_float_sub_##sfx,                     \
+            vs_float_mul_##sfx, vs_float_div_##sfx },                   \
+          { vs_double_add_##sfx, vs_double_sub_##sfx,                   \
+            vs_double_mul_##sfx, vs_double_div_##sfx } },               \
+        { dot_float_##sfx, dot_double_##sfx },                          \
+        { clamp_float_##sfx, clamp_double_##sfx },                      \
+        { { math_float_abs_##sfx, math_float_sqrt_##sfx,                \
+            mvec(float, sfx) },                                         \
+          { math_double_abs_##sfx, math_double_sqrt_##sfx,              \
+            mvec(double, sfx) } },                                      \
+        { swap2_##sfx, swap4_##sfx, swap8_##sfx },                      \
+    };
+
+DEFINE_KERNELS(base, UVSIMD_BASE_NAME, , 16, MVEC_NONE)
+
+#if defined(UVSIMD_X86) && defined(UVSIMD_MVEC)
+DEFINE_KERNELS(avx2, "avx2", __attribute__((target("avx2"))), 32,
+               MVEC_LIBMVEC)
+#elif defined(UVSIMD_X86)
+DEFINE_KERNELS(avx2, "avx2", __attribute__((target("avx2"))), 32,
+               MVEC_NONE)
+#endif
+
+/* Candidates, the most preferred first. */
+static const ScmUVSimdKernels *kernel_sets[] = {
+#if defined(UVSIMD_X86)
+    &kernels_avx2,
+#endif
+    &kernels_base,
+    NULL
+};
+
+static int kernels_usable(const ScmUVSimdKernels *k)
+{
+#if defined(UVSIMD_X86)
+    if (k == &kernels_avx2) {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+    }
+#endif
+    return TRUE;
+}
+
+#else  /* !UVSIMD_BASE_NAME */
+static const ScmUVSimdKernels *kernel_sets[] = { NULL };
+static int kernels_usable(const ScmUVSimdKernels *k) { return FALSE; }
+#endif /* !UVSIMD_BASE_NAME */
+
+/* Selected on the first use.  Races are harmless, since every thread
+   would choose the same set. */
+static const ScmUVSimdKernels *current = NULL;
+static int current_selected = FALSE;
+
+const ScmUVSimdKernels *Scm__UVSimdKernels(void)
+{
+    if (!current_selected) {
+        for (const ScmUVSimdKernels **k = kernel_sets; *k; k++) {
+            if (kernels_usable(*k)) { current = *k; break; }
+        }
+        current_selected = TRUE;
+    }
+    return current;
+}
+
+int Scm__UVSimdSelect(const char *name)
+{
+    if (strcmp(name, "none") == 0) {
+        current = NULL;
+        current_selected = TRUE;
+        return TRUE;
+    }
+    if (strcmp(name, "default") == 0) {
+        current_selected = FALSE;
+        (void)Scm__UVSimdKernels();
+        return TRUE;
+    }
+    for (const ScmUVSimdKernels **k = kernel_sets; *k; k++) {
+        if (strcmp((*k)->name, name) == 0 && kernels_usable(*k)) {
+            current = *k;
+            current_selected = TRUE;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+const char *Scm__UVSimdName(void)
+{
+    const ScmUVSimdKernels *k = Scm__UVSimdKernels();
+    return k? k->name : "none";
+}
@@ -0,0 +1,102 @@
+/*
+ * uvsimd.h - vectorized kernels for uniform vectors
+ *
+ *   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef GAUCHE_UVSIMD_H
+#define GAUCHE_UVSIMD_H
+
+/* Element-wise loops on f32 and f64 vectors, and byte swapping, written
+   with the compiler's vector extension.  Several sets of them are
+   compiled for different instruction sets, and one is chosen at
+   runtime according to the CPU.  Scm__UVSimdKernels() returns NULL if
+   no set is available, in which case the callers use the scalar loops.
+
+   Callers must make sure the destination doesn't partially overlap
+   with the sources; it may be identical to one of them. */
+
+enum {
+    UVSIMD_F32,
+    UVSIMD_F64,
+    UVSIMD_NUM_KINDS
+};
+
+enum {
+    UVSIMD_ADD,
+    UVSIMD_SUB,
+    UVSIMD_MUL,
+    UVSIMD_DIV,
+    UVSIMD_NUM_OPS
+};
+
+/* Elementwise functions.  They're in the same order as the first
+   ones of SCM_UVECTOR_MATH_* in gauche/uvector.h. */
+enum {
+    UVSIMD_ABS,
+    UVSIMD_SQRT,
+    UVSIMD_EXP,
+    UVSIMD_LOG,
+    UVSIMD_SIN,
+    UVSIMD_COS,
+    UVSIMD_NUM_FNS
+};
+
+typedef struct ScmUVSimdKernelsRec {
+    const char *name;
+    /* d[i] = x[i] op y[i] */
+    void (*vv[UVSIMD_NUM_KINDS][UVSIMD_NUM_OPS])(void *d, const void *x,
+                                                 const void *y, long n);
+    /* d[i] = x[i] op y */
+    void (*vs[UVSIMD_NUM_KINDS][UVSIMD_NUM_OPS])(void *d, const void *x,
+                                                 double y, long n);
+    /* sum of x[i]*y[i], accumulated in double */
+    double (*dot[UVSIMD_NUM_KINDS])(const void *x, const void *y, long n);
+    /* d[i] = min(max(x[i], lo), hi), treating NaN like the scalar code */
+    void (*clamp[UVSIMD_NUM_KINDS])(void *d, const void *x,
+                                    double lo, double hi, long n);
+    /* d[i] = fn(x[i]).  An entry is NULL if the set has no vector
+       version of the function.  Exp, log, sin and cos come from
+       libmvec, and may differ from libm in the last bit. */
+    void (*math[UVSIMD_NUM_KINDS][UVSIMD_NUM_FNS])(void *d, const void *x,
+                                                   long n);
+    /* reverses bytes of each 2, 4 and 8 byte element in place */
+    void (*swapb[3])(void *d, long n);
+} ScmUVSimdKernels;
+
+extern const ScmUVSimdKernels *Scm__UVSimdKernels(void);
+
+/* For benchmarks and tests.  NAME is "none", "default", or the name of
+   a kernel set: "sse2" or "neon" for the baseline, "avx2".  Returns
+   FALSE if the set is not available on this machine. */
+extern int Scm__UVSimdSelect(const char *name);
+extern const char *Scm__UVSimdName(void);
+
+#endif /* GAUCHE_UVSIMD_H */
@@ -230,6 +230,53 @@
            (list a b s c)))
   )
 
+;; fill procedure returning its own data
+(let ()
+  (define (segment-port segs . opts)
+    (apply make <buffered-input-port>
+           :fill (^[buf]
+                   (if (null? segs)
+                     0
+                     (let1 seg (pop! segs)
+                       (if (string? seg)
+                         (let* ([v (string->u8vector seg)]
+                                [n (min (u8vector-length v)
+                                        (u8vector-length buf))])
+                           (u8vector-copy! buf 0 v 0 n)
+                           (when (< n (u8vector-length v))
+                             (push! segs (u8vector->string v n)))
+                           n)
+                         seg))))
+           opts))
+  (define segs
+    (list (string->u8vector "abc\ndef")
+          (string->u8vector "ghi\n")
+          "jkl"
+          (string->u8vector "mno\npqr")))
+
+  (test* "segments" '("abc" "defghi" "jklmno" "pqr")
+         (port->string-list (segment-port segs)))
+  (test* "segments are intact" '("abc\ndef" "ghi\n" "jkl" "mno\npqr")
+         (map (^s (if (string? s) s (u8vector->string s))) segs))
+  (test* "segments, small buffer" '("abc" "defghi" "jklmno" "pqr")
+         (port->string-list (segment-port segs :buffer-size 2)))
+  (test* "segments, read-block" '(#u8(97 98) #u8(99 10 100 101 102 103 104))
+         (let1 p (segment-port segs :buffer-size 2)
+           (list (read-block 2 p) (read-block 7 p))))
+  (test* "segments, peek" '(#\a #\a #\b)
+         (let1 p (segment-port segs)
+           (list (peek-char p) (read-char p) (read-char p))))
+  (test* "segments, empty vector is EOF" '("abc")
+         (port->string-list (segment-port (list (string->u8vector "abc")
+                                                (u8vector)
+                                                (string->u8vector "def")))))
+  (test* "segments, multibyte char across segments" "\u3042\u3044"
+         (let1 v (string->u8vector "\u3042\u3044")
+           (port->string (segment-port (list (u8vector-copy v 0 2)
+                                             (u8vector-copy v 2 4)
+                                             (u8vector-copy v 4))))))
+  )
+
 ;;-----------------------------------------------------------
 (test-section "buffered-output-port")
 
@@ -488,28 +488,64 @@ static ScmObj key_bufsize = SCM_FALSE; /* :buffer-size */
  */
 
 typedef struct bport_rec {
-    ScmObj fill_proc;           /* (U8vector) -> Maybe Int*/
+    ScmObj fill_proc;           /* (U8vector) -> (Maybe Int | U8vector) */
     ScmObj flush_proc;          /* (U8vector, Bool) -> Maybe Int */
     ScmObj close_proc;          /* () -> () */
     ScmObj ready_proc;          /* () -> Bool */
     ScmObj filenum_proc;        /* () -> Maybe Int */
     ScmObj seek_proc;           /* (Offset, Whence) -> Offset */
+    ScmObj segment;             /* u8vector returned by fill_proc, which
+                                   the port is reading */
+    int segment_off;            /* the offset of the unread part of
+                                   segment, or -1 when it's all given
+                                   to the port */
 } bport;
 
 /*------------------------------------------------------------
  * Bport fill
  */
+
+/* Gives the port the unread part of the segment, as its buffer if
+   possible, or by copying as much as it takes for now. */
+static int bport_give_segment(ScmPort *p, bport *data, int cnt)
+{
+    int size = SCM_U8VECTOR_SIZE(data->segment);
+    char *d = (char*)SCM_U8VECTOR_ELEMENTS(data->segment);
+    int off = data->segment_off;
+    int n = size - off;
+
+    if (!Scm_PortLendBuffer(p, d + off, n)) {
+        if (n > cnt) n = cnt;
+        memcpy(p->src.buf.end, d + off, n);
+    }
+    data->segment_off = (off + n < size)? off + n : -1;
+    return n;
+}
+
 static int bport_fill(ScmPort *p, int cnt)
 {
     bport *data = (bport*)p->src.buf.data;
     SCM_ASSERT(data != NULL);
+    if (SCM_U8VECTORP(data->segment)) {
+        if (data->segment_off >= 0) return bport_give_segment(p, data, cnt);
+        /* The port has gone back to its own buffer; we can release it. */
+        data->segment = SCM_FALSE;
+    }
     if (SCM_FALSEP(data->fill_proc)) {
         return 0;               /* indicates EOF */
     }
+    /* The filler fills the room after the unread data. */
     ScmObj vec = Scm_MakeU8VectorFromArrayShared(
-        cnt, (unsigned char*)p->src.buf.buffer);
+        cnt, (unsigned char*)p->src.buf.end);
     ScmObj r = Scm_ApplyRec(data->fill_proc, SCM_LIST1(vec));
     if (SCM_INTP(r)) return SCM_INT_VALUE(r);
+    else if (SCM_U8VECTORP(r)) {
+        /* The filler returned its own data.  Read it in place. */
+        if (SCM_U8VECTOR_SIZE(r) == 0) return 0;
+        data->segment = r;
+        data->segment_off = 0;
+        return bport_give_segment(p, data, cnt);
+    }
     else if (SCM_EOFP(r)) return 0;
     else return -1;
 }
@@ -613,6 +649,8 @@ static ScmObj bport_allocate(ScmClass *klass, ScmObj initargs)
     data->ready_proc = SCM_FALSE;
     data->filenum_proc = SCM_FALSE;
     data->seek_proc  = SCM_FALSE;
+    data->segment    = SCM_FALSE;
+    data->segment_off = -1;
 
     ScmPortBuffer buf;
     if (bufsize > 0) {
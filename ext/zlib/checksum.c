@@ -0,0 +1,458 @@
+/*
+ * checksum.c - CRC32, CRC32C and Adler32
+ *
+ *   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * zlib's crc32() and adler32() are portable C.  Here we provide faster
+ * versions using CPU instructions, chosen at runtime:
+ *
+ *   CRC32 (zlib's)   x86: PCLMULQDQ folding.   ARMv8: CRC32 instructions.
+ *   CRC32C           x86: SSE4.2 crc32.        ARMv8: CRC32 instructions.
+ *   Adler32          x86: SSSE3.
+ *
+ * Without those, CRC32 and Adler32 fall back to zlib, and CRC32C to
+ * a table-driven slice-by-8 implementation.
+ *
+ * The x86 code follows the zlib optimizations in Chromium, which are
+ * based on Intel's "Fast CRC Computation for Generic Polynomials Using
+ * PCLMULQDQ Instruction".
+ */
+
+#include "gauche-zlib.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) \
+    && (defined(__clang__) \
+        || (defined(__GNUC__) \
+            && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define CHECKSUM_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) && defined(__GNUC__)
+#define CHECKSUM_ARM 1
+#include <arm_acle.h>
+#if defined(__ARM_FEATURE_CRC32)
+#define ARM_CRC_TARGET          /* always available */
+#define arm_crc_available() TRUE
+#elif defined(__linux__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#if defined(__clang__)
+#define ARM_CRC_TARGET __attribute__((target("crc")))
+#else
+#define ARM_CRC_TARGET __attribute__((target("+crc")))
+#endif
+#define arm_crc_available() ((getauxval(AT_HWCAP) & HWCAP_CRC32) != 0)
+#else
+#undef CHECKSUM_ARM
+#endif
+#endif
+
+/*================================================================
+ * Portable CRC32C (slice-by-8)
+ */
+
+#define CRC32C_POLY 0x82f63b78  /* reflected Castagnoli polynomial */
+
+static uint32_t crc32c_table[8][256];
+
+static void crc32c_init_table(void)
+{
+    for (int i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) c = (c >> 1) ^ (CRC32C_POLY & (0U - (c & 1)));
+        crc32c_table[0][i] = c;
+    }
+    for (int i = 0; i < 256; i++) {
+        uint32_t c = crc32c_table[0][i];
+        for (int t = 1; t < 8; t++) {
+            c = crc32c_table[0][c & 0xff] ^ (c >> 8);
+            crc32c_table[t][i] = c;
+        }
+    }
+}
+
+/* CRC is the internal (inverted) state. */
+static uint32_t crc32c_sw(uint32_t crc, const unsigned char *buf, size_t len)
+{
+    while (len > 0 && ((uintptr_t)buf & 7) != 0) {
+        crc = crc32c_table[0][(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+        len--;
+    }
+    while (len >= 8) {
+        /* Assemble little-endian words byte by byte, so that this works
+           regardless of the host byte order. */
+        uint32_t lo = crc ^ ((uint32_t)buf[0] | ((uint32_t)buf[1] << 8)
+                             | ((uint32_t)buf[2] << 16)
+                             | ((uint32_t)buf[3] << 24));
+        crc = crc32c_table[7][lo & 0xff]
+            ^ crc32c_table[6][(lo >> 8) & 0xff]
+            ^ crc32c_table[5][(lo >> 16) & 0xff]
+            ^ crc32c_table[4][lo >> 24]
+            ^ crc32c_table[3][buf[4]]
+            ^ crc32c_table[2][buf[5]]
+            ^ crc32c_table[1][buf[6]]
+            ^ crc32c_table[0][buf[7]];
+        buf += 8;
+        len -= 8;
+    }
+    while (len-- > 0) {
+        crc = crc32c_table[0][(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+/*================================================================
+ * x86
+ */
+
+#if defined(CHECKSUM_X86)
+
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const unsigned char *buf,
+                             size_t len)
+{
+    while (len > 0 && ((uintptr_t)buf & 7) != 0) {
+        crc = _mm_crc32_u8(crc, *buf++);
+        len--;
+    }
+#if defined(__x86_64__)
+    uint64_t c64 = crc;
+    while (len >= 8) {
+        c64 = _mm_crc32_u64(c64, *(const uint64_t*)buf);
+        buf += 8;
+        len -= 8;
+    }
+    crc = (uint32_t)c64;
+#endif
+    while (len >= 4) {
+        crc = _mm_crc32_u32(crc, *(const uint32_t*)buf);
+        buf += 4;
+        len -= 4;
+    }
+    while (len-- > 0) {
+        crc = _mm_crc32_u8(crc, *buf++);
+    }
+    return crc;
+}
+
+/* Folds LEN bytes, which must be at least 64 and a multiple of 16.
+   CRC is the internal (inverted) state.  The constants are for the
+   bit-reflected domain of zlib's polynomial. */
+__attribute__((target("sse4.2,pclmul")))
+static uint32_t crc32_pclmul(uint32_t crc, const unsigned char *buf,
+                             size_t len)
+{
+    static const uint64_t k1k2[] __attribute__((aligned(16)))
+        = { 0x0154442bd4, 0x01c6e41596 };
+    static const uint64_t k3k4[] __attribute__((aligned(16)))
+        = { 0x01751997d0, 0x00ccaa009e };
+    static const uint64_t k5k0[] __attribute__((aligned(16)))
+        = { 0x0163cd6124, 0x0000000000 };
+    static const uint64_t poly[] __attribute__((aligned(16)))
+        = { 0x01db710641, 0x01f7011641 };
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+    x1 = _mm_loadu_si128((const __m128i*)(buf + 0x00));
+    x2 = _mm_loadu_si128((const __m128i*)(buf + 0x10));
+    x3 = _mm_loadu_si128((const __m128i*)(buf + 0x20));
+    x4 = _mm_loadu_si128((const __m128i*)(buf + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+    x0 = _mm_load_si128((const __m128i*)k1k2);
+    buf += 64;
+    len -= 64;
+
+    /* Fold four 128bit lanes in parallel. */
+    while (len >= 64) {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+        y5 = _mm_loadu_si128((const __m128i*)(buf + 0x00));
+        y6 = _mm_loadu_si128((const __m128i*)(buf + 0x10));
+        y7 = _mm_loadu_si128((const __m128i*)(buf + 0x20));
+        y8 = _mm_loadu_si128((const __m128i*)(buf + 0x30));
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+        buf += 64;
+        len -= 64;
+    }
+
+    /* Fold the four lanes into one. */
+    x0 = _mm_load_si128((const __m128i*)k3k4);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    /* Fold the remaining 16-byte blocks. */
+    while (len >= 16) {
+        x2 = _mm_loadu_si128((const __m128i*)buf);
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+        buf += 16;
+        len -= 16;
+    }
+
+    /* 128 bits to 64 bits. */
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_srli_si128(x1, 8);
+    x1 = _mm_xor_si128(x1, x2);
+    x0 = _mm_loadl_epi64((const __m128i*)k5k0);
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, x3);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    /* Barrett reduction to 32 bits. */
+    x0 = _mm_load_si128((const __m128i*)poly);
+    x2 = _mm_and_si128(x1, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+    return (uint32_t)_mm_extract_epi32(x1, 1);
+}
+
+static u_long crc32_x86(u_long crc, const unsigned char *buf, size_t len)
+{
+    if (len >= 64) {
+        size_t chunk = len & ~(size_t)15;
+        crc = ~crc32_pclmul(~(uint32_t)crc, buf, chunk) & 0xffffffffUL;
+        buf += chunk;
+        len -= chunk;
+    }
+    if (len > 0) crc = crc32(crc, buf, (uInt)len);
+    return crc;
+}
+
+#define ADLER_BASE 65521U
+#define ADLER_NMAX 5552         /* max bytes before s2 may overflow */
+
+__attribute__((target("ssse3")))
+static u_long adler32_ssse3(u_long adler, const unsigned char *buf,
+                            size_t len)
+{
+    uint32_t s1 = adler & 0xffff;
+    uint32_t s2 = (adler >> 16) & 0xffff;
+    const unsigned BLOCK = 32;
+    size_t blocks = len / BLOCK;
+    len -= blocks * BLOCK;
+
+    const __m128i tap1 =
+        _mm_setr_epi8(32,31,30,29,28,27,26,25,24,23,22,21,20,19,18,17);
+    const __m128i tap2 =
+        _mm_setr_epi8(16,15,14,13,12,11,10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ones = _mm_set1_epi16(1);
+
+    while (blocks > 0) {
+        unsigned n = ADLER_NMAX / BLOCK;
+        if (n > blocks) n = (unsigned)blocks;
+        blocks -= n;
+
+        /* V_PS accumulates the per-block s1, which contributes to s2
+           BLOCK times for each following block. */
+        __m128i v_ps = _mm_set_epi32(0, 0, 0, s1 * n);
+        __m128i v_s2 = _mm_set_epi32(0, 0, 0, s2);
+        __m128i v_s1 = _mm_setzero_si128();
+
+        do {
+            const __m128i b1 = _mm_loadu_si128((const __m128i*)buf);
+            const __m128i b2 = _mm_loadu_si128((const __m128i*)(buf + 16));
+            v_ps = _mm_add_epi32(v_ps, v_s1);
+            v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(b1, zero));
+            v_s2 = _mm_add_epi32(v_s2,
+                                 _mm_madd_epi16(_mm_maddubs_epi16(b1, tap1),
+                                                ones));
+            v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(b2, zero));
+            v_s2 = _mm_add_epi32(v_s2,
+                                 _mm_madd_epi16(_mm_maddubs_epi16(b2, tap2),
+                                                ones));
+            buf += BLOCK;
+        } while (--n);
+
+        v_s2 = _mm_add_epi32(v_s2, _mm_slli_epi32(v_ps, 5));
+
+        /* Horizontal sums */
+        v_s1 = _mm_add_epi32(v_s1, _mm_shuffle_epi32(v_s1, _MM_SHUFFLE(1,0,3,2)));
+        s1 += (uint32_t)_mm_cvtsi128_si32(v_s1);
+        v_s2 = _mm_add_epi32(v_s2, _mm_shuffle_epi32(v_s2, _MM_SHUFFLE(2,3,0,1)));
+        v_s2 = _mm_add_epi32(v_s2, _mm_shuffle_epi32(v_s2, _MM_SHUFFLE(1,0,3,2)));
+        s2 = (uint32_t)_mm_cvtsi128_si32(v_s2);
+
+        s1 %= ADLER_BASE;
+        s2 %= ADLER_BASE;
+    }
+
+    while (len-- > 0) {
+        s1 += *buf++;
+        s2 += s1;
+    }
+    s1 %= ADLER_BASE;
+    s2 %= ADLER_BASE;
+    return ((u_long)s2 << 16) | s1;
+}
+
+#endif /*CHECKSUM_X86*/
+
+/*================================================================
+ * ARMv8
+ */
+
+#if defined(CHECKSUM_ARM)
+
+ARM_CRC_TARGET
+static uint32_t crc32c_arm(uint32_t crc, const unsigned char *buf, size_t len)
+{
+    while (len > 0 && ((uintptr_t)buf & 7) != 0) {
+        crc = __crc32cb(crc, *buf++);
+        len--;
+    }
+    while (len >= 8) {
+        crc = __crc32cd(crc, *(const uint64_t*)buf);
+        buf += 8;
+        len -= 8;
+    }
+    while (len-- > 0) {
+        crc = __crc32cb(crc, *buf++);
+    }
+    return crc;
+}
+
+ARM_CRC_TARGET
+static uint32_t crc32_arm_raw(uint32_t crc, const unsigned char *buf,
+                              size_t len)
+{
+    while (len > 0 && ((uintptr_t)buf & 7) != 0) {
+        crc = __crc32b(crc, *buf++);
+        len--;
+    }
+    while (len >= 8) {
+        crc = __crc32d(crc, *(const uint64_t*)buf);
+        buf += 8;
+        len -= 8;
+    }
+    while (len-- > 0) {
+        crc = __crc32b(crc, *buf++);
+    }
+    return crc;
+}
+
+static u_long crc32_arm(u_long crc, const unsigned char *buf, size_t len)
+{
+    return ~crc32_arm_raw(~(uint32_t)crc, buf, len) & 0xffffffffUL;
+}
+
+#endif /*CHECKSUM_ARM*/
+
+/*================================================================
+ * Dispatch
+ */
+
+static u_long crc32_zlib(u_long crc, const unsigned char *buf, size_t len)
+{
+    /* zlib takes uInt length */
+    while (len > 0) {
+        uInt n = (len > 0x40000000) ? 0x40000000 : (uInt)len;
+        crc = crc32(crc, buf, n);
+        buf += n;
+        len -= n;
+    }
+    return crc;
+}
+
+static u_long adler32_zlib(u_long adler, const unsigned char *buf, size_t len)
+{
+    while (len > 0) {
+        uInt n = (len > 0x40000000) ? 0x40000000 : (uInt)len;
+        adler = adler32(adler, buf, n);
+        buf += n;
+        len -= n;
+    }
+    return adler;
+}
+
+static uint32_t (*crc32c_proc)(uint32_t, const unsigned char*, size_t)
+    = crc32c_sw;
+static u_long (*crc32_proc)(u_long, const unsigned char*, size_t)
+    = crc32_zlib;
+static u_long (*adler32_proc)(u_long, const unsigned char*, size_t)
+    = adler32_zlib;
+
+u_long Scm_ZlibCrc32(u_long crc, const unsigned char *buf, size_t len)
+{
+    return crc32_proc(crc, buf, len);
+}
+
+u_long Scm_ZlibCrc32c(u_long crc, const unsigned char *buf, size_t len)
+{
+    return ~crc32c_proc(~(uint32_t)crc, buf, len) & 0xffffffffUL;
+}
+
+u_long Scm_ZlibAdler32(u_long adler, const unsigned char *buf, size_t len)
+{
+    return adler32_proc(adler, buf, len);
+}
+
+/* Called from Scm_Init_zlib. */
+void Scm__InitChecksum(void)
+{
+    crc32c_init_table();
+#if defined(CHECKSUM_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2")) {
+        crc32c_proc = crc32c_sse42;
+        if (__builtin_cpu_supports("pclmul")) crc32_proc = crc32_x86;
+    }
+    if (__builtin_cpu_supports("ssse3")) adler32_proc = adler32_ssse3;
+#endif
+#if defined(CHECKSUM_ARM)
+    if (arm_crc_available()) {
+        crc32c_proc = crc32c_arm;
+        crc32_proc = crc32_arm;
+    }
+#endif
+}
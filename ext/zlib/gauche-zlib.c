@@ -333,6 +333,7 @@ ScmObj Scm_MakeDeflatingPort(ScmPort *source, int level,
     }
 
     info->strm = strm;
+    info->par = NULL;
     info->remote = source;
     info->bufsiz = 0;
     info->buf = NULL;
@@ -360,6 +361,463 @@ ScmObj Scm_MakeDeflatingPort(ScmPort *source, int level,
                                 SCM_PORT_OUTPUT, TRUE, &bufrec);
 }
 
+/*================================================================
+ * Parallel deflating port
+ *
+ *  The data is cut into blocks of the port's buffer size, and each
+ *  block is compressed by a worker thread into a raw deflate stream,
+ *  the way pigz does.  A block is primed with the last window of the
+ *  data before it as the dictionary, so we lose little compression.
+ *  The block is ended by a sync flush, which leaves the output byte
+ *  aligned, so the outputs simply concatenate; only the last one is
+ *  finished with Z_FINISH.  The workers also compute the check value
+ *  of their blocks, which we combine in order.  We write the zlib or
+ *  gzip header and trailer by ourselves.
+ *
+ *  Workers are native threads without VM, created via GC's thread
+ *  creation so that the blocks they hold are seen by GC.  They touch
+ *  nothing but the jobs.  If no thread can be created, we compress
+ *  the blocks in the calling thread.
+ */
+
+#define PDEFLATE_DEFAULT_BLOCK_SIZE (128*1024)
+
+enum {
+    PDEFLATE_RAW,
+    PDEFLATE_ZLIB,
+    PDEFLATE_GZIP
+};
+
+typedef struct pdeflate_job_rec {
+    struct pdeflate_job_rec *qnext;   /* in the queue */
+    struct pdeflate_job_rec *pnext;   /* in the pending list */
+    const unsigned char *dict;  /* the window before the data */
+    int dictlen;
+    unsigned char *in;          /* the data */
+    int inlen;
+    int last;                   /* TRUE if this ends the stream */
+    int level;
+    int strategy;
+    unsigned char *out;         /* compressed data */
+    int outlen;
+    u_long check;               /* crc32 or adler32 of the data */
+    int done;
+    int error;                  /* zlib error code, or Z_OK */
+} pdeflate_job;
+
+typedef struct ScmParallelDeflateRec {
+    ScmInternalMutex mutex;
+    ScmInternalCond cond;       /* signalled when a job is queued or done,
+                                   or the workers should exit */
+    pdeflate_job *queue;        /* jobs waiting for a worker */
+    pdeflate_job *queueTail;
+    pdeflate_job *pending;      /* jobs to be written, in order */
+    pdeflate_job *pendingTail;
+    int npending;
+    int nthreads;
+    int shutdown;
+    int wrapper;                /* PDEFLATE_RAW, _ZLIB or _GZIP */
+    int window_bits;            /* 9..15 */
+    int memlevel;
+    const unsigned char *dict;  /* window for the next block */
+    int dictlen;
+    u_long check;
+    int header_written;
+} ScmParallelDeflate;
+
+static void pdeflate_compress(ScmParallelDeflate *pd, pdeflate_job *job)
+{
+    z_stream strm;
+    memset(&strm, 0, sizeof(strm));
+    int r = deflateInit2(&strm, job->level, Z_DEFLATED, -pd->window_bits,
+                         pd->memlevel, job->strategy);
+    if (r != Z_OK) { job->error = r; return; }
+    if (job->dictlen > 0) {
+        r = deflateSetDictionary(&strm, job->dict, job->dictlen);
+        if (r != Z_OK) { deflateEnd(&strm); job->error = r; return; }
+    }
+
+    /* The bound covers Z_FINISH; a sync flush adds an empty stored
+       block and may need a few more bytes. */
+    int size = (int)deflateBound(&strm, job->inlen) + 16;
+    job->out = SCM_NEW_ATOMIC2(unsigned char*, size);
+    strm.next_in = job->in;
+    strm.avail_in = job->inlen;
+    strm.next_out = job->out;
+    strm.avail_out = size;
+    for (;;) {
+        r = deflate(&strm, job->last? Z_FINISH : Z_SYNC_FLUSH);
+        if (r == Z_STREAM_END || (r == Z_OK && strm.avail_out > 0)) break;
+        if (r != Z_OK && r != Z_BUF_ERROR) break;
+        /* Output is full; this shouldn't happen, but just in case. */
+        unsigned char *out = SCM_NEW_ATOMIC2(unsigned char*, size*2);
+        memcpy(out, job->out, size);
+        job->out = out;
+        strm.next_out = out + size;
+        strm.avail_out = size;
+        size *= 2;
+    }
+    job->outlen = size - strm.avail_out;
+    job->error = (r == Z_OK || r == Z_STREAM_END)? Z_OK : r;
+    deflateEnd(&strm);
+
+    if (pd->wrapper == PDEFLATE_GZIP) {
+        job->check = Scm_ZlibCrc32(0, job->in, job->inlen);
+    } else if (pd->wrapper == PDEFLATE_ZLIB) {
+        job->check = Scm_ZlibAdler32(1, job->in, job->inlen);
+    }
+}
+
+#if defined(GAUCHE_USE_PTHREADS)
+static void *pdeflate_worker(void *data)
+{
+    ScmParallelDeflate *pd = (ScmParallelDeflate*)data;
+    (void)SCM_INTERNAL_MUTEX_LOCK(pd->mutex);
+    for (;;) {
+        while (pd->queue == NULL && !pd->shutdown) {
+            (void)SCM_INTERNAL_COND_WAIT(pd->cond, pd->mutex);
+        }
+        if (pd->queue == NULL) break;
+        pdeflate_job *job = pd->queue;
+        pd->queue = job->qnext;
+        if (pd->queue == NULL) pd->queueTail = NULL;
+        (void)SCM_INTERNAL_MUTEX_UNLOCK(pd->mutex);
+        pdeflate_compress(pd, job);
+        (void)SCM_INTERNAL_MUTEX_LOCK(pd->mutex);
+        job->done = TRUE;
+        (void)SCM_INTERNAL_COND_BROADCAST(pd->cond);
+    }
+    (void)SCM_INTERNAL_MUTEX_UNLOCK(pd->mutex);
+    return NULL;
+}
+#endif /*GAUCHE_USE_PTHREADS*/
+
+static void pdeflate_start_workers(ScmParallelDeflate *pd, int nthreads)
+{
+    pd->nthreads = 0;
+#if defined(GAUCHE_USE_PTHREADS)
+    sigset_t all, omask;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &omask);
+    for (int i=0; i<nthreads; i++) {
+        pthread_t th;
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        int e = pthread_create(&th, &attr, pdeflate_worker, pd);
+        pthread_attr_destroy(&attr);
+        if (e != 0) break;
+        pd->nthreads++;
+    }
+    pthread_sigmask(SIG_SETMASK, &omask, NULL);
+#endif /*GAUCHE_USE_PTHREADS*/
+}
+
+static void pdeflate_stop_workers(ScmParallelDeflate *pd)
+{
+    (void)SCM_INTERNAL_MUTEX_LOCK(pd->mutex);
+    pd->shutdown = TRUE;
+    (void)SCM_INTERNAL_COND_BROADCAST(pd->cond);
+    (void)SCM_INTERNAL_MUTEX_UNLOCK(pd->mutex);
+}
+
+static void put_u32(unsigned char *p, u_long v, int bigendian)
+{
+    for (int i=0; i<4; i++) {
+        p[bigendian? 3-i : i] = (unsigned char)((v >> (i*8)) & 0xff);
+    }
+}
+
+static void pdeflate_output(ScmZlibInfo *info, unsigned char *buf, int len)
+{
+    Scm_Putz((char*)buf, len, info->remote);
+    info->strm->total_out += len;
+}
+
+static void pdeflate_write_header(ScmZlibInfo *info)
+{
+    ScmParallelDeflate *pd = info->par;
+    unsigned char h[10];
+    int level = (info->level == Z_DEFAULT_COMPRESSION)? 6 : info->level;
+    int lowlevel = (info->strategy >= Z_HUFFMAN_ONLY || level < 2);
+
+    switch (pd->wrapper) {
+    case PDEFLATE_ZLIB: {
+        /* RFC1950 */
+        u_int hdr = (((pd->window_bits - 8) << 4) | Z_DEFLATED) << 8;
+        hdr |= (lowlevel? 0 : level < 6? 1 : level == 6? 2 : 3) << 6;
+        if (!SCM_FALSEP(info->dict_adler)) hdr |= 0x20;
+        hdr += 31 - (hdr % 31);
+        h[0] = hdr >> 8;
+        h[1] = hdr & 0xff;
+        pdeflate_output(info, h, 2);
+        if (!SCM_FALSEP(info->dict_adler)) {
+            put_u32(h, Scm_GetIntegerU(info->dict_adler), TRUE);
+            pdeflate_output(info, h, 4);
+        }
+        break;
+    }
+    case PDEFLATE_GZIP:
+        /* RFC1952, with no mtime, name nor comment */
+        memset(h, 0, 10);
+        h[0] = 0x1f; h[1] = 0x8b; h[2] = Z_DEFLATED;
+        h[8] = (level == 9)? 2 : lowlevel? 4 : 0;
+        h[9] = 3;               /* Unix, as zlib says */
+        pdeflate_output(info, h, 10);
+        break;
+    }
+    pd->header_written = TRUE;
+}
+
+static void pdeflate_write_trailer(ScmZlibInfo *info)
+{
+    ScmParallelDeflate *pd = info->par;
+    unsigned char t[8];
+
+    switch (pd->wrapper) {
+    case PDEFLATE_ZLIB:
+        put_u32(t, pd->check, TRUE);
+        pdeflate_output(info, t, 4);
+        break;
+    case PDEFLATE_GZIP:
+        put_u32(t, pd->check, FALSE);
+        put_u32(t+4, info->strm->total_in & 0xffffffffUL, FALSE);
+        pdeflate_output(info, t, 8);
+        break;
+    }
+}
+
+/* Writes out the finished jobs in order.  If WAIT_ALL is true, waits
+   for all the jobs; otherwise, waits only while we have too many jobs
+   in flight. */
+static void pdeflate_drain(ScmZlibInfo *info, int wait_all)
+{
+    ScmParallelDeflate *pd = info->par;
+    int limit = pd->nthreads * 2;
+
+    for (;;) {
+        (void)SCM_INTERNAL_MUTEX_LOCK(pd->mutex);
+        while (pd->pending && !pd->pending->done
+               && (wait_all || pd->npending > limit)) {
+            (void)SCM_INTERNAL_COND_WAIT(pd->cond, pd->mutex);
+        }
+        pdeflate_job *job = pd->pending;
+        if (job && job->done) {
+            pd->pending = job->pnext;
+            if (pd->pending == NULL) pd->pendingTail = NULL;
+            pd->npending--;
+        } else {
+            job = NULL;
+        }
+        (void)SCM_INTERNAL_MUTEX_UNLOCK(pd->mutex);
+        if (job == NULL) break;
+
+        if (job->error != Z_OK) {
+            Scm_ZlibError(job->error, "deflate failed on a block of %S",
+                          info->remote);
+        }
+        if (!pd->header_written) pdeflate_write_header(info);
+        pdeflate_output(info, job->out, job->outlen);
+        switch (pd->wrapper) {
+        case PDEFLATE_ZLIB:
+            pd->check = adler32_combine(pd->check, job->check, job->inlen);
+            break;
+        case PDEFLATE_GZIP:
+            pd->check = crc32_combine(pd->check, job->check, job->inlen);
+            break;
+        }
+        info->strm->adler = pd->check;
+    }
+}
+
+/* Queues a block of LEN bytes at DATA.  The data is copied. */
+static void pdeflate_submit(ScmZlibInfo *info, const char *data, int len,
+                            int last)
+{
+    ScmParallelDeflate *pd = info->par;
+    pdeflate_job *job = SCM_NEW(pdeflate_job);
+    job->qnext = job->pnext = NULL;
+    job->dict = pd->dict;
+    job->dictlen = pd->dictlen;
+    job->in = SCM_NEW_ATOMIC2(unsigned char*, len > 0? len : 1);
+    memcpy(job->in, data, len);
+    job->inlen = len;
+    job->last = last;
+    job->level = info->level;
+    job->strategy = info->strategy;
+    job->out = NULL;
+    job->outlen = 0;
+    job->done = FALSE;
+    job->error = Z_OK;
+    info->strm->total_in += len;
+
+    /* The next block is primed with the window up to the end of this
+       one, unless a full flush is requested. */
+    if (info->flush == Z_FULL_FLUSH) {
+        pd->dict = NULL;
+        pd->dictlen = 0;
+        info->flush = Z_NO_FLUSH;
+    } else {
+        int window = 1 << pd->window_bits;
+        if (len >= window) {
+            pd->dict = job->in + len - window;
+            pd->dictlen = window;
+        } else if (len > 0) {
+            /* A short block, e.g. after an explicit flush.  Keep the
+               tail of the previous window as well. */
+            int keep = (pd->dictlen < window - len)? pd->dictlen : window - len;
+            unsigned char *d = SCM_NEW_ATOMIC2(unsigned char*, keep + len);
+            if (keep > 0) memcpy(d, pd->dict + pd->dictlen - keep, keep);
+            memcpy(d + keep, data, len);
+            pd->dict = d;
+            pd->dictlen = keep + len;
+        }
+    }
+
+    if (pd->nthreads == 0) {
+        pdeflate_compress(pd, job);
+        job->done = TRUE;
+    }
+    (void)SCM_INTERNAL_MUTEX_LOCK(pd->mutex);
+    if (pd->pendingTail) pd->pendingTail->pnext = job;
+    else pd->pending = job;
+    pd->pendingTail = job;
+    pd->npending++;
+    if (!job->done) {
+        if (pd->queueTail) pd->queueTail->qnext = job;
+        else pd->queue = job;
+        pd->queueTail = job;
+        (void)SCM_INTERNAL_COND_BROADCAST(pd->cond);
+    }
+    (void)SCM_INTERNAL_MUTEX_UNLOCK(pd->mutex);
+}
+
+static int pdeflate_flusher(ScmPort *port, int cnt, int forcep)
+{
+    ScmZlibInfo *info = SCM_PORT_ZLIB_INFO(port);
+    int avail = SCM_PORT_BUFFER_AVAIL(port);
+
+    /* We always take the whole buffer as a block. */
+    if (avail > 0) pdeflate_submit(info, port->src.buf.buffer, avail, FALSE);
+    pdeflate_drain(info, forcep);
+    return avail;
+}
+
+static void pdeflate_closer(ScmPort *port)
+{
+    ScmZlibInfo *info = SCM_PORT_ZLIB_INFO(port);
+
+    pdeflate_submit(info, port->src.buf.buffer,
+                    SCM_PORT_BUFFER_AVAIL(port), TRUE);
+    pdeflate_drain(info, TRUE);
+    pdeflate_stop_workers(info->par);
+    pdeflate_write_trailer(info);
+    Scm_Flush(info->remote);
+    if (info->ownerp) {
+        Scm_ClosePort(info->remote);
+    }
+}
+
+ScmObj Scm_MakeParallelDeflatingPort(ScmPort *source, int level,
+                                     int window_bits, int memlevel,
+                                     int strategy, ScmObj dict,
+                                     int nthreads, int blocksize,
+                                     int ownerp)
+{
+    ScmZlibInfo *info = SCM_NEW(ScmZlibInfo);
+    ScmParallelDeflate *pd = SCM_NEW(ScmParallelDeflate);
+    z_streamp strm = SCM_NEW_ATOMIC2(z_streamp, sizeof(z_stream));
+
+    if (blocksize <= 0) blocksize = PDEFLATE_DEFAULT_BLOCK_SIZE;
+    blocksize = fix_buffer_size(blocksize);
+
+    if (window_bits < 0) {
+        pd->wrapper = PDEFLATE_RAW;
+        pd->window_bits = -window_bits;
+    } else if (window_bits > 15) {
+        pd->wrapper = PDEFLATE_GZIP;
+        pd->window_bits = window_bits - 16;
+    } else {
+        pd->wrapper = PDEFLATE_ZLIB;
+        pd->window_bits = window_bits;
+    }
+    /* zlib takes 8 as 9 for deflate. */
+    if (pd->window_bits == 8) pd->window_bits = 9;
+    pd->memlevel = memlevel;
+
+    /* Check the parameters as zlib does.  STRM is only used to keep
+       the counters afterwards. */
+    memset(strm, 0, sizeof(z_stream));
+    int r = deflateInit2(strm, level, Z_DEFLATED, window_bits,
+                         memlevel, strategy);
+    if (r != Z_OK) {
+        Scm_ZlibError(r, "deflateInit2 error: %s", strm->msg);
+    }
+    deflateEnd(strm);
+    memset(strm, 0, sizeof(z_stream));
+    strm->data_type = Z_UNKNOWN;
+
+    pd->dict = NULL;
+    pd->dictlen = 0;
+    if (!SCM_FALSEP(dict)) {
+        if (!SCM_STRINGP(dict))
+            Scm_Error("String required, but got %S", dict);
+        if (pd->wrapper == PDEFLATE_GZIP) {
+            Scm_ZlibError(Z_STREAM_ERROR,
+                          "dictionary can't be used with gzip format");
+        }
+        const unsigned char *d = (const unsigned char*)SCM_STRING_START(dict);
+        int dlen = SCM_STRING_SIZE(dict);
+        info->dict_adler = Scm_MakeIntegerU(Scm_ZlibAdler32(1, d, dlen));
+        /* Only the last window of the dictionary matters. */
+        int window = 1 << pd->window_bits;
+        if (dlen > window) { d += dlen - window; dlen = window; }
+        pd->dict = d;
+        pd->dictlen = dlen;
+    } else {
+        info->dict_adler = SCM_FALSE;
+    }
+
+    (void)SCM_INTERNAL_MUTEX_INIT(pd->mutex);
+    (void)SCM_INTERNAL_COND_INIT(pd->cond);
+    pd->queue = pd->queueTail = NULL;
+    pd->pending = pd->pendingTail = NULL;
+    pd->npending = 0;
+    pd->shutdown = FALSE;
+    pd->check = (pd->wrapper == PDEFLATE_ZLIB)? 1 : 0;
+    strm->adler = pd->check;
+    pd->header_written = FALSE;
+    pdeflate_start_workers(pd, nthreads);
+
+    info->strm = strm;
+    info->par = pd;
+    info->remote = source;
+    info->bufsiz = 0;
+    info->buf = NULL;
+    info->ptr = NULL;
+    info->ownerp = ownerp;
+    info->flush = Z_NO_FLUSH;
+    info->stream_endp = FALSE;
+    info->level = level;
+    info->strategy = strategy;
+
+    ScmPortBuffer bufrec;
+    memset(&bufrec, 0, sizeof(bufrec));
+    bufrec.size = blocksize;
+    bufrec.buffer = SCM_NEW_ATOMIC2(char *, blocksize);
+    bufrec.mode = SCM_PORT_BUFFER_FULL;
+    bufrec.filler = NULL;
+    bufrec.flusher = pdeflate_flusher;
+    bufrec.closer = pdeflate_closer;
+    bufrec.ready = NULL;
+    bufrec.filenum = zlib_fileno;
+    bufrec.data = (void*)info;
+
+    ScmObj name = port_name("deflating", source);
+    return Scm_MakeBufferedPort(SCM_CLASS_DEFLATING_PORT, name,
+                                SCM_PORT_OUTPUT, TRUE, &bufrec);
+}
+
 /*================================================================
  * Inflating port
  */
@@ -482,6 +940,7 @@ ScmObj Scm_MakeInflatingPort(ScmPort *sink, int bufsiz,
     }
 
     info->strm = strm;
+    info->par = NULL;
     info->remote = sink;
     info->bufsiz = CHUNK;
     info->buf = SCM_NEW_ATOMIC2(char *, CHUNK);
@@ -559,6 +1018,8 @@ void Scm_Init_zlib(void)
     /* Create the module if it doesn't exist yet. */
     ScmModule *mod = SCM_MODULE(SCM_FIND_MODULE("rfc.zlib", TRUE));
 
+    Scm__InitChecksum();
+
     Scm_InitStaticClass(&Scm_DeflatingPortClass, "<deflating-port>",
                         mod, NULL, 0);
     Scm_InitStaticClass(&Scm_InflatingPortClass, "<inflating-port>",
@@ -49,6 +49,9 @@ SCM_DECL_BEGIN
 
 typedef struct ScmZlibInfoRec {
     z_streamp strm;
+    struct ScmParallelDeflateRec *par; /* non-NULL for parallel deflating
+                                          port.  STRM only keeps the
+                                          counters then. */
     ScmPort *remote;            /* source or drain port */
     int ownerp;
     int flush;
@@ -77,6 +80,11 @@ extern ScmObj Scm_MakeDeflatingPort(ScmPort *source, int level,
                                     int window_bits, int memlevel,
                                     int strategy, ScmObj dict,
                                     int bufsiz, int ownerp);
+extern ScmObj Scm_MakeParallelDeflatingPort(ScmPort *source, int level,
+                                            int window_bits, int memlevel,
+                                            int strategy, ScmObj dict,
+                                            int nthreads, int blocksize,
+                                            int ownerp);
 extern ScmObj Scm_MakeInflatingPort(ScmPort *sink, int bufsiz,
                                     int window_bits, ScmObj dict,
                                     int ownerp);
@@ -126,6 +134,16 @@ extern ScmObj Scm_MakeZlibError(ScmObj message, int error_code);
 extern void Scm_ZlibError(int error_code, const char *msg, ...);
 extern ScmObj Scm_InflateSync(ScmPort *port);
 
+/*================================================================
+ * Checksums (checksum.c)
+ */
+
+extern u_long Scm_ZlibCrc32(u_long crc, const unsigned char *buf, size_t len);
+extern u_long Scm_ZlibCrc32c(u_long crc, const unsigned char *buf, size_t len);
+extern u_long Scm_ZlibAdler32(u_long adler, const unsigned char *buf,
+                              size_t len);
+extern void Scm__InitChecksum(void);
+
 extern void Scm_Init_zlib(void);
 
 /* Epilogue */
@@ -43,6 +43,43 @@
 (test* "adler32 (string)" 1721967257 (adler32 (string->u8vector "abc") 8563))
 (test* "adler32 (error)" (test-error) (adler32 'foo))
 
+(test* "crc32c (string)" 0 (crc32c ""))
+(test* "crc32c (string)" 3808858755 (crc32c "123456789"))
+(test* "crc32c (string)" 224353407 (crc32c "foobar"))
+(test* "crc32c (string)" 224353407 (crc32c "bar" (crc32c "foo")))
+(test* "crc32c (u8vector)" 224353407 (crc32c (string->u8vector "foobar")))
+(test* "crc32c (error)" (test-error) (crc32c 'foo))
+
+;; Long enough to go through the vectorized code paths, if any.
+(let1 v (make-u8vector 100003)
+  (dotimes [i 100003] (u8vector-set! v i (modulo (* i 37) 251)))
+  (test* "crc32 (long)" 3622162824 (crc32 v))
+  (test* "crc32 (long, slice)" 3699377108 (crc32 v 0 5 70000))
+  (test* "crc32 (long, chained)" 3622162824
+         (crc32 v (crc32 v 0 0 12345) 12345))
+  (test* "adler32 (long)" 4053059411 (adler32 v))
+  (test* "adler32 (long, slice)" 3833039261 (adler32 v 1 5 70000))
+  (test* "adler32 (long, chained)" 4053059411
+         (adler32 v (adler32 v 1 0 12345) 12345))
+  (test* "crc32c (long)" 652882799 (crc32c v))
+  (test* "crc32c (long, slice)" 2319940321 (crc32c v 0 5 70000))
+  (test* "crc32c (long, chained)" 652882799
+         (crc32c v (crc32c v 0 0 12345) 12345))
+  ;; other uvectors are viewed as their bytes; offsets count elements
+  (let1 w (uvector-alias <u32vector> v 0 100000)
+    (test* "crc32 (u32vector)" (crc32 v 0 0 100000) (crc32 w))
+    (test* "crc32 (u32vector, slice)" (crc32 v 0 8 400) (crc32 w 0 2 100))
+    (test* "adler32 (u32vector, slice)" (adler32 v 1 8 400)
+           (adler32 w 1 2 100))
+    (test* "crc32c (u32vector, slice)" (crc32c v 0 8 400)
+           (crc32c w 0 2 100))))
+
+(test* "crc32 (string slice)" 1996459178 (crc32 "foobar" 0 3))
+(test* "adler32 (string slice)" 39649590 (adler32 "foobar" 1 3))
+(test* "crc32c (string slice)" 179770161 (crc32c "foobar" 0 3 6))
+(test* "crc32 (bad range)" (test-error) (crc32 "foobar" 0 4 2))
+(test* "crc32 (bad range)" (test-error) (crc32 "foobar" 0 0 7))
+
 ;;------------------------------------------------------------------
 (test-section "constant values")
 
@@ -219,6 +256,55 @@
          (close-output-port p)
          (zstream-data-type p)))
 
+;; parallel deflating
+(let ()
+  (define data
+    (with-output-to-string
+      (^[] (dotimes [i 20000] (format #t "~a ~a\n" i (* i i))))))
+  (define (pdeflate data . args)
+    (call-with-output-string
+      (^[out]
+        (let1 p (apply open-deflating-port out :threads 4 :block-size 4096
+                       args)
+          (display data p)
+          (close-output-port p)))))
+
+  (test* "parallel deflate" data (inflate-string (pdeflate data)))
+  (test* "parallel deflate (gzip)" data
+         (gzip-decode-string (pdeflate data :window-bits 31)))
+  (test* "parallel deflate (raw)" data
+         (inflate-string (pdeflate data :window-bits -15) :window-bits -15))
+  (test* "parallel deflate (empty)" ""
+         (gzip-decode-string (pdeflate "" :window-bits 31)))
+  (test* "parallel deflate (dictionary)" data
+         (inflate-string (pdeflate data :dictionary "0123456789")
+                         :dictionary "0123456789"))
+  (test* "parallel deflate, zlib header" '#u8(#x78 #x9c)
+         (u8vector-copy (string->u8vector (pdeflate "foo")) 0 2))
+  (test* "parallel deflate, counters" `(,(string-size data) ,(adler32 data))
+         (let1 p (open-deflating-port (open-output-string) :threads 2)
+           (display data p)
+           (close-output-port p)
+           (list (zstream-total-in p) (zstream-adler32 p))))
+  (test* "parallel deflate, flushes" "abcdef"
+         (inflate-string
+          (call-with-output-string
+            (^[out]
+              (let1 p (open-deflating-port out :threads 2)
+                (display "abc" p)
+                (deflating-port-full-flush p)
+                (display "de" p)
+                (flush p)
+                (zstream-params-set! p :compression-level 0)
+                (display "f" p)
+                (close-output-port p))))))
+  (test* "parallel deflate, bad level" 'OK
+         (guard (e [(<zlib-stream-error> e) 'OK])
+           (open-deflating-port (open-output-string) :threads 2
+                                :compression-level 10)
+           'error))
+  )
+
 ;;------------------------------------------------------------------
 (test-section "inflate port")
 
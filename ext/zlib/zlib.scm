@@ -35,7 +35,7 @@
 
 (define-module rfc.zlib
   (use gauche.uvector)
-  (export zlib-version adler32 crc32
+  (export zlib-version adler32 crc32 crc32c
           open-deflating-port open-inflating-port
           deflate-string inflate-string
           <zlib-error> <zlib-need-dict-error>
@@ -72,19 +72,32 @@
  (define-type <xflating-port> "ScmPort*" "inflating or deflating port"
    "SCM_XFLATING_PORT_P" "SCM_PORT")
 
+ ;; Returns the bytes of DATA between START and END.  For uvectors,
+ ;; START and END count elements; for strings, they count bytes.
+ ;; Nothing is copied.
  (define-cfn data_element (data::ScmObj
+                           s::ScmSmallInt e::ScmSmallInt
                            start::(const unsigned char**)
-                           siz::int*)
+                           siz::size_t*)
    ::void :static
-   (cond [(SCM_U8VECTORP data)
-          (set! (* start) (SCM_UVECTOR_ELEMENTS (SCM_U8VECTOR data))
-                (* siz)   (SCM_U8VECTOR_SIZE (SCM_U8VECTOR data)))]
+   (cond [(SCM_UVECTORP data)
+          (let* ([len::ScmSmallInt (SCM_UVECTOR_SIZE data)]
+                 [esize::int (Scm_UVectorElementSize (SCM_CLASS_OF data))])
+            (SCM_CHECK_START_END s e len)
+            (set! (* start) (+ (cast (const unsigned char*)
+                                     (SCM_UVECTOR_ELEMENTS data))
+                               (* s esize))
+                  (* siz)   (* (- e s) esize)))]
          [(SCM_STRINGP data)
-          (let* ([b::(const ScmStringBody*) (SCM_STRING_BODY data)])
-            (set! (* start) (cast (unsigned char*) (SCM_STRING_BODY_START b))
-                  (* siz)   (SCM_STRING_BODY_SIZE b)))]
+          (let* ([b::(const ScmStringBody*) (SCM_STRING_BODY data)]
+                 [len::ScmSmallInt (SCM_STRING_BODY_SIZE b)])
+            (SCM_CHECK_START_END s e len)
+            (set! (* start) (+ (cast (const unsigned char*)
+                                     (SCM_STRING_BODY_START b))
+                               s)
+                  (* siz)   (- e s)))]
          [else
-          (Scm_Error "u8vector or string required, but got: %S" data)]))
+          (Scm_Error "uniform vector or string required, but got: %S" data)]))
 
  (define-cproc zlib-version ()
    (expr <top> (SCM_MAKE_STR (zlibVersion))))
@@ -103,17 +116,29 @@
  (define-enum Z_ASCII)
  (define-enum Z_UNKNOWN)
 
- (define-cproc adler32 (data :optional (adler::<ulong> 1)) ::<ulong>
-   (let* ([start::(const unsigned char*)]
-          [siz::int])
-     (data_element data (& start) (& siz))
-     (return (adler32 adler start siz))))
+ (define-cproc adler32 (data :optional (adler::<ulong> 1)
+                             (start::<fixnum> 0) (end::<fixnum> -1))
+   ::<ulong>
+   (let* ([p::(const unsigned char*)]
+          [siz::size_t])
+     (data_element data start end (& p) (& siz))
+     (return (Scm_ZlibAdler32 adler p siz))))
 
- (define-cproc crc32 (data :optional (crc::<ulong> 0)) ::<ulong>
-   (let* ([start::(const unsigned char*)]
-          [siz::int])
-     (data_element data (& start) (& siz))
-     (return (crc32 crc start siz))))
+ (define-cproc crc32 (data :optional (crc::<ulong> 0)
+                           (start::<fixnum> 0) (end::<fixnum> -1))
+   ::<ulong>
+   (let* ([p::(const unsigned char*)]
+          [siz::size_t])
+     (data_element data start end (& p) (& siz))
+     (return (Scm_ZlibCrc32 crc p siz))))
+
+ (define-cproc crc32c (data :optional (crc::<ulong> 0)
+                            (start::<fixnum> 0) (end::<fixnum> -1))
+   ::<ulong>
+   (let* ([p::(const unsigned char*)]
+          [siz::size_t])
+     (data_element data start end (& p) (& siz))
+     (return (Scm_ZlibCrc32c crc p siz))))
 
  (define-cproc %open-deflating-port (source::<output-port>
                                      compression-level::<fixnum>
@@ -127,6 +152,21 @@
                                   memory-level strategy dictionary
                                   buffer-size (not (SCM_FALSEP owner?)))))
 
+ (define-cproc %open-parallel-deflating-port (source::<output-port>
+                                              compression-level::<fixnum>
+                                              window-bits::<fixnum>
+                                              memory-level::<fixnum>
+                                              strategy::<fixnum>
+                                              dictionary
+                                              threads::<fixnum>
+                                              block-size::<fixnum>
+                                              owner?)
+   (return (Scm_MakeParallelDeflatingPort source compression-level
+                                          window-bits memory-level
+                                          strategy dictionary
+                                          threads block-size
+                                          (not (SCM_FALSEP owner?)))))
+
  (define-cproc open-inflating-port (sink::<input-port>
                                     :key (buffer-size::<fixnum> 0)
                                     (window-bits::<fixnum> 15)
@@ -156,9 +196,13 @@
       [(SCM_FALSEP strategy) (set! st (-> info strategy))]
       [(SCM_INTP strategy) (set! st (SCM_INT_VALUE strategy))]
       [else (SCM_TYPE_ERROR strategy "fixnum or #f")])
-     (let* ([r::int (deflateParams strm lv st)])
-       (unless (== r Z_OK)
-         (Scm_ZlibError r "deflateParams failed: %s" (-> strm msg))))))
+     (if (-> info par)
+       ;; parallel deflating port; affects the blocks to be queued.
+       (set! (-> info level) lv
+             (-> info strategy) st)
+       (let* ([r::int (deflateParams strm lv st)])
+         (unless (== r Z_OK)
+           (Scm_ZlibError r "deflateParams failed: %s" (-> strm msg)))))))
 
  (define-cproc deflating-port-full-flush (port::<deflating-port>) ::<void>
    (set! (-> (SCM_PORT_ZLIB_INFO port) flush) Z_FULL_FLUSH)
@@ -187,11 +231,18 @@
                                   (strategy Z_DEFAULT_STRATEGY)
                                   (dictionary #f)
                                   (buffer-size 0)
+                                  (threads 1)
+                                  (block-size 0)
                                   (owner? #f))
-  (%open-deflating-port source compression-level
-                        window-bits memory-level
-                        strategy dictionary
-                        buffer-size owner?))
+  (if (> threads 1)
+    (%open-parallel-deflating-port source compression-level
+                                   window-bits memory-level
+                                   strategy dictionary
+                                   threads block-size owner?)
+    (%open-deflating-port source compression-level
+                          window-bits memory-level
+                          strategy dictionary
+                          buffer-size owner?)))
 
 ;; utility procedures
 (define (deflate-string str . args)
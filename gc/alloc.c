@@ -331,6 +331,27 @@ GC_API GC_start_callback_proc GC_CALL GC_get_start_callback(void)
     return fn;
 }
 
+STATIC GC_on_collection_event_proc GC_on_collection_event = 0;
+
+GC_API void GC_CALL GC_set_on_collection_event(GC_on_collection_event_proc fn)
+{
+    /* fn may be 0 (means no event notifier). */
+    DCL_LOCK_STATE;
+    LOCK();
+    GC_on_collection_event = fn;
+    UNLOCK();
+}
+
+GC_API GC_on_collection_event_proc GC_CALL GC_get_on_collection_event(void)
+{
+    GC_on_collection_event_proc fn;
+    DCL_LOCK_STATE;
+    LOCK();
+    fn = GC_on_collection_event;
+    UNLOCK();
+    return fn;
+}
+
 GC_INLINE void GC_notify_full_gc(void)
 {
     if (GC_start_call_back != 0) {
@@ -432,6 +453,8 @@ GC_INNER GC_bool GC_try_to_collect_inner(GC_stop_func stop_func)
         GC_log_printf("Initiating full world-stop collection!\n");
       }
 #   endif
+    if (GC_on_collection_event)
+      GC_on_collection_event(GC_EVENT_START);
     GC_promote_black_lists();
     /* Make sure all blocks have been reclaimed, so sweep routines      */
     /* don't see cleared mark bits.                                     */
@@ -472,6 +495,8 @@ GC_INNER GC_bool GC_try_to_collect_inner(GC_stop_func stop_func)
                       MS_TIME_DIFF(current_time,start_time));
       }
 #   endif
+    if (GC_on_collection_event)
+      GC_on_collection_event(GC_EVENT_END);
     return(TRUE);
 }
 
@@ -603,7 +628,11 @@ STATIC GC_bool GC_stopped_mark(GC_stop_func stop_func)
         GET_TIME(start_time);
 #   endif
 
+    if (GC_on_collection_event)
+      GC_on_collection_event(GC_EVENT_PRE_STOP_WORLD);
     STOP_WORLD();
+    if (GC_on_collection_event)
+      GC_on_collection_event(GC_EVENT_POST_STOP_WORLD);
 #   ifdef THREAD_LOCAL_ALLOC
       GC_world_stopped = TRUE;
 #   endif
@@ -622,6 +651,9 @@ STATIC GC_bool GC_stopped_mark(GC_stop_func stop_func)
             GC_clear_a_few_frames();
             GC_noop6(0,0,0,0,0,0);
 
+        if (GC_on_collection_event)
+          GC_on_collection_event(GC_EVENT_MARK_START);
+
         GC_initiate_gc();
         for (i = 0;;i++) {
           if ((*stop_func)()) {
@@ -631,12 +663,19 @@ STATIC GC_bool GC_stopped_mark(GC_stop_func stop_func)
 #           ifdef THREAD_LOCAL_ALLOC
               GC_world_stopped = FALSE;
 #           endif
+            if (GC_on_collection_event)
+              GC_on_collection_event(GC_EVENT_PRE_START_WORLD);
             START_WORLD();
+            if (GC_on_collection_event)
+              GC_on_collection_event(GC_EVENT_POST_START_WORLD);
             return(FALSE);
           }
           if (GC_mark_some(GC_approx_sp())) break;
         }
 
+    if (GC_on_collection_event)
+      GC_on_collection_event(GC_EVENT_MARK_END);
+
     GC_gc_no++;
     GC_DBGLOG_PRINTF("GC #%lu freed %ld bytes, heap %lu KiB"
                      IF_USE_MUNMAP(" (+ %lu KiB unmapped)") "\n",
@@ -652,7 +691,11 @@ STATIC GC_bool GC_stopped_mark(GC_stop_func stop_func)
 #   ifdef THREAD_LOCAL_ALLOC
       GC_world_stopped = FALSE;
 #   endif
+    if (GC_on_collection_event)
+      GC_on_collection_event(GC_EVENT_PRE_START_WORLD);
     START_WORLD();
+    if (GC_on_collection_event)
+      GC_on_collection_event(GC_EVENT_POST_START_WORLD);
 #   ifndef SMALL_CONFIG
       if (GC_PRINT_STATS_FLAG) {
         unsigned long time_diff;
@@ -841,6 +884,8 @@ STATIC void GC_finish_collection(void)
       if (GC_print_stats)
         GET_TIME(start_time);
 #   endif
+    if (GC_on_collection_event)
+      GC_on_collection_event(GC_EVENT_RECLAIM_START);
 
 #   ifndef GC_GET_HEAP_USAGE_NOT_NEEDED
       if (GC_bytes_found > 0)
@@ -946,6 +991,8 @@ STATIC void GC_finish_collection(void)
 
     IF_USE_MUNMAP(GC_unmap_old());
 
+    if (GC_on_collection_event)
+      GC_on_collection_event(GC_EVENT_RECLAIM_END);
 #   ifndef SMALL_CONFIG
       if (GC_print_stats) {
         GET_TIME(done_time);
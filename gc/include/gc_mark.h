@@ -246,6 +246,27 @@ GC_API int GC_CALL GC_is_marked(const void *) GC_ATTR_NONNULL(1);
 GC_API void GC_CALL GC_clear_mark_bit(const void *) GC_ATTR_NONNULL(1);
 GC_API void GC_CALL GC_set_mark_bit(const void *) GC_ATTR_NONNULL(1);
 
+/* Return the kind of the given object and store its size (in bytes)    */
+/* to *psize unless psize is NULL.  p should be the base of an object   */
+/* allocated by the collector.  (Backported from GC 7.6.)               */
+#define GC_I_PTRFREE 0
+#define GC_I_NORMAL  1
+GC_API int GC_CALL GC_get_kind_and_size(const void *, size_t *)
+                                                        GC_ATTR_NONNULL(1);
+
+/* Enumerate all the objects found marked by the last collection,       */
+/* calling proc(obj, bytes, client_data) for each of them.  The caller  */
+/* must hold the allocation lock (see GC_call_with_alloc_lock), and     */
+/* proc must not allocate by the collector.  To get the set of the      */
+/* live objects, call GC_gcollect just before; objects allocated after  */
+/* the collection aren't enumerated.  (Backported from GC 7.6.)         */
+typedef void (GC_CALLBACK * GC_reachable_object_proc)(void * /* obj */,
+                                size_t /* bytes */,
+                                void * /* client_data */);
+GC_API void GC_CALL GC_enumerate_reachable_objects_inner(
+                                GC_reachable_object_proc,
+                                void * /* client_data */) GC_ATTR_NONNULL(1);
+
 /* Push everything in the given range onto the mark stack.              */
 /* (GC_push_conditional pushes either all or only dirty pages depending */
 /* on the third argument.)                                              */
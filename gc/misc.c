@@ -478,6 +478,19 @@ GC_API size_t GC_CALL GC_size(const void * p)
     return hhdr -> hb_sz;
 }
 
+/* Return the kind of an object, given a pointer to its base, and   */
+/* store its size to *psize unless psize is NULL.  (Backported from  */
+/* GC 7.6.)                                                          */
+GC_API int GC_CALL GC_get_kind_and_size(const void * p, size_t * psize)
+{
+    hdr * hhdr = HDR(p);
+
+    if (psize != NULL) {
+        *psize = hhdr -> hb_sz;
+    }
+    return hhdr -> hb_obj_kind;
+}
+
 
 /* These getters remain unsynchronized for compatibility (since some    */
 /* clients could call some of them from a GC callback holding the       */
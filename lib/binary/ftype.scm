@@ -74,6 +74,9 @@
    ftype:slot ftype:slot-name ftype:slot-type ftype:slot-position
    make-fstruct-type
    define-fstruct-type
+   fstruct-slot-getter fstruct-slot-putter
+
+   farray-length farray-for-each
 
    fobject fobject? fobject-type fobject-storage fobject-offset
    make-fobject
@@ -263,7 +266,12 @@
 (define (make-fstruct-type name slots endian alignment)
   (receive (size slot-descriptors) (compute-fstruct-slots slots alignment)
     (rec ftype
-      (%make-ftype:struct name size
+      (%make-ftype:struct name
+                          ;; like C, pad the tail so that the structs can
+                          ;; be placed back to back.
+                          (%round size
+                                  (or alignment
+                                      (compute-fstruct-alignment slots)))
                           (or alignment (compute-fstruct-alignment slots))
                           endian
                           (rec (fobject-get uv pos endian)
@@ -350,12 +358,57 @@
 (define (fobject-ref/uv ftd slot uvector pos)
   (let1 s (%get-slot-desc ftd slot)
     ((ftype-getter (ftype:slot-type s))
-     uvector (+ pos (ftype:slot-position s)))))
+     uvector (+ pos (ftype:slot-position s)) (%slot-endian ftd s))))
 
 (define (fobject-set!/uv ftd slot uvector pos val)
   (let1 s (%get-slot-desc ftd slot)
     ((ftype-putter (ftype:slot-type s))
-     uvector (+ pos (ftype:slot-position s)) val)))
+     uvector (+ pos (ftype:slot-position s)) val (%slot-endian ftd s))))
+
+(define (%slot-endian ftd slot-desc)
+  (or (ftype-endian (ftype:slot-type slot-desc)) (ftype-endian ftd)))
+
+;; Specialized slot accessors.
+;; fstruct-slot-getter and fstruct-slot-putter look up the slot once and
+;; return a procedure that just calls the primitive getter/putter at a
+;; fixed offset from the given position.  If the endianness of the slot
+;; is fixed, the endian-specific primitive (e.g. get-u32be) is used, so
+;; no optional argument is processed per access either.
+
+(define *%fixed-endian-accessors*
+  `((,get-u16 ,get-u16be ,get-u16le) (,get-s16 ,get-s16be ,get-s16le)
+    (,get-u32 ,get-u32be ,get-u32le) (,get-s32 ,get-s32be ,get-s32le)
+    (,get-u64 ,get-u64be ,get-u64le) (,get-s64 ,get-s64be ,get-s64le)
+    (,get-f32 ,get-f32be ,get-f32le) (,get-f64 ,get-f64be ,get-f64le)
+    (,put-u16! ,put-u16be! ,put-u16le!) (,put-s16! ,put-s16be! ,put-s16le!)
+    (,put-u32! ,put-u32be! ,put-u32le!) (,put-s32! ,put-s32be! ,put-s32le!)
+    (,put-u64! ,put-u64be! ,put-u64le!) (,put-s64! ,put-s64be! ,put-s64le!)
+    (,put-f32! ,put-f32be! ,put-f32le!) (,put-f64! ,put-f64be! ,put-f64le!)))
+
+(define (%fixed-endian-accessor proc endian)
+  (and-let* ([e (assq proc *%fixed-endian-accessors*)])
+    (case endian
+      [(big-endian) (cadr e)]
+      [(little-endian) (caddr e)]
+      [else #f])))
+
+(define (fstruct-slot-getter ftd slot)
+  (let* ([s (%get-slot-desc ftd slot)]
+         [off (ftype:slot-position s)]
+         [get (ftype-getter (ftype:slot-type s))]
+         [endian (%slot-endian ftd s)])
+    (if-let1 get/e (%fixed-endian-accessor get endian)
+      (^[uvector pos] (get/e uvector (+ pos off)))
+      (^[uvector pos] (get uvector (+ pos off) endian)))))
+
+(define (fstruct-slot-putter ftd slot)
+  (let* ([s (%get-slot-desc ftd slot)]
+         [off (ftype:slot-position s)]
+         [put! (ftype-putter (ftype:slot-type s))]
+         [endian (%slot-endian ftd s)])
+    (if-let1 put/e! (%fixed-endian-accessor put! endian)
+      (^[uvector pos val] (put/e! uvector (+ pos off) val))
+      (^[uvector pos val] (put! uvector (+ pos off) val endian)))))
 
 (define (fobject-ref obj slot)
   (fobject-ref/uv (fobject-type obj) slot
@@ -369,7 +422,7 @@
 ;; TODO: allow constructing fobjects other than fstructs.
 (define (init-fobject! ftype v pos . initargs)
   (let loop ([args initargs])
-    (cond [(null? args) (%make-fobject ftype v 0)]
+    (cond [(null? args) (%make-fobject ftype v pos)]
           [(null? (cdr args)) (error "odd number of initargs:" initargs)]
           [(not (keyword? (car args)))
            (error "keyword required for initarg, but got:" (car args))]
@@ -412,6 +465,33 @@
 ;; farray
 ;;
 
+;; Objects of an ftype placed back to back in a uvector; e.g. the
+;; records of a binary file read into (or mapped as) a u8vector.
+;; farray-for-each only passes around the positions, so walking over
+;; the array doesn't allocate; use the accessors such as get-NAME-SLOT
+;; of define-fstruct-type, or fstruct-slot-getter, on them.
+
+(define (%ftype-stride ftype)
+  (%round (ftype-size ftype) (ftype-alignment ftype)))
+
+(define (farray-length ftype uvector :optional (start 0))
+  (quotient (max 0 (- (uvector-size uvector) start)) (%ftype-stride ftype)))
+
+;; Calls PROC with UVECTOR and the position of each object.
+(define (farray-for-each proc ftype uvector :optional (start 0) (count #f))
+  (let* ([stride (%ftype-stride ftype)]
+         [n (let1 len (farray-length ftype uvector start)
+              (if count
+                (if (> count len)
+                  (errorf "uvector too short to hold ~a objects of ~s"
+                          count ftype)
+                  count)
+                len))]
+         [end (+ start (* n stride))])
+    (do ([pos start (+ pos stride)])
+        [(>= pos end)]
+      (proc uvector pos))))
+
 
 ;;========================================================================
 ;; High-level macro
@@ -435,6 +515,11 @@
 ;;
 ;;  <slot-spec> := (slot-name ftype-expr)    ;FTYPE-EXPR is evaluated.
 ;;
+;;  Options
+;;
+;;   :endian ENDIAN-EXPR      ; fix endianness of the struct
+;;   :alignment ALIGN-EXPR    ; override alignment, e.g. 0 for packed
+;;
 
 (define-macro (define-fstruct-type name ctor-name pred-name slots . options)
   (let* ([yname (unwrap-syntax name)]
@@ -463,21 +548,23 @@
             [.get  (string->symbol #"get-~|yname|-~|sname|")]
             [.put! (string->symbol #"put-~|yname|-~|sname|!")])
         `(begin
+           (define ,.get (,(->id 'fstruct-slot-getter) ,name ',sname))
+           (define ,.put! (,(->id 'fstruct-slot-putter) ,name ',sname))
            (define (,.ref obj)
-             (,(->id 'fobject-ref) obj ',sname))
+             (,.get (,(->id 'fobject-storage) obj)
+                    (,(->id 'fobject-offset) obj)))
            (define (,.set! obj val)
-             (,(->id 'fobject-set!) obj ',sname val))
-           (define (,.get vec pos)
-             (,(->id 'fobject-ref/uv) ,name ',sname vec pos))
-           (define (,.put! vec pos val)
-             (,(->id 'fobject-set!/uv) ,name ',sname vec pos val)))))
+             (,.put! (,(->id 'fobject-storage) obj)
+                     (,(->id 'fobject-offset) obj)
+                     val)))))
 
     `(begin
        (define ,name (,(->id 'make-fstruct-type) ',yname
                       (list
                        ,@(map (^s `(list ',(unwrap-syntax (car s)) ,(cadr s)))
                               slots))
-                      #f #f))
+                      ,(get-keyword :endian options #f)
+                      ,(get-keyword :alignment options #f)))
        ,(if maker
           `(define (,maker . initargs)
              (apply ,(->id 'make-fobject) ,name initargs))
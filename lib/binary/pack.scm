@@ -343,25 +343,74 @@
       (cute reader #f (car opt-endian))
       reader))
 
+;; Uvector types corresponding to the readers of fixed size numeric
+;; types.  A repeated numeric field is read and written by one
+;; read-uvector / write-uvector call, instead of one call per element.
+(define *bulk-number-types*
+  `((,read-u8  ,<u8vector>  ,list->u8vector  ,u8vector->list)
+    (,read-s8  ,<s8vector>  ,list->s8vector  ,s8vector->list)
+    (,read-u16 ,<u16vector> ,list->u16vector ,u16vector->list)
+    (,read-s16 ,<s16vector> ,list->s16vector ,s16vector->list)
+    (,read-u32 ,<u32vector> ,list->u32vector ,u32vector->list)
+    (,read-s32 ,<s32vector> ,list->s32vector ,s32vector->list)
+    (,read-u64 ,<u64vector> ,list->u64vector ,u64vector->list)
+    (,read-s64 ,<s64vector> ,list->s64vector ,s64vector->list)
+    (,read-f32 ,<f32vector> ,list->f32vector ,f32vector->list)
+    (,read-f64 ,<f64vector> ,list->f64vector ,f64vector->list)))
+
+(define-constant *bulk-chunk-size* 4096)
+
+;; Returns a procedure that reads N numbers and returns them as a list.
+;; If N is #f, reads until EOF.  Like the one-by-one reader, missing
+;; numbers at EOF are filled with EOF objects when N is given.
+(define (make-bulk-number-reader base-reader endian)
+  (if-let1 e (assq base-reader *bulk-number-types*)
+    (let ([class (cadr e)] [uv->list (cadddr e)])
+      (define (chunk n)
+        (let1 v (read-uvector class n (current-input-port) endian)
+          (if (uvector? v) (uv->list v) '())))
+      (^n (if n
+            (let* ([lis (if (zero? n) '() (chunk n))]
+                   [k (length lis)])
+              (if (< k n)
+                (append lis (make-list (- n k) (eof-object)))
+                lis))
+            (let loop ([r '()])
+              (let1 lis (chunk *bulk-chunk-size*)
+                (if (< (length lis) *bulk-chunk-size*)
+                  (concatenate (reverse! (cons lis r)))
+                  (loop (cons lis r))))))))
+    (let1 reader (number-reader base-reader endian)
+      (^n (let loop ([i 0] [r '()])
+            (if (eqv? i n)
+              (reverse! r)
+              (let1 x (reader)
+                (if (and (not n) (eof-object? x))
+                  (reverse! r)
+                  (loop (+ i 1) (cons x r))))))))))
+
+;; Returns a procedure that writes a list of numbers.
+(define (make-bulk-number-writer base-reader base-writer endian)
+  (if-let1 e (assq base-reader *bulk-number-types*)
+    (let1 list->uv (caddr e)
+      (^[lis] (write-uvector (list->uv lis) (current-output-port) 0 -1 endian)))
+    (let1 writer (number-writer base-writer endian)
+      (^[lis] (for-each writer lis)))))
+
 ;; make a basic dispatcher for fixed size numeric types
 (define (make-number-pack-dispatcher
          base-reader base-writer size count vlp . opt-endian)
   (let* ((splitter (get-splitter count))
-         (writer (if (pair? opt-endian)
-                   (number-writer base-writer (car opt-endian))
-                   (number-writer base-writer)))
-         (reader (if (pair? opt-endian)
-                     (number-reader base-reader (car opt-endian))
-                   (number-reader base-reader))))
+         (endian (get-optional opt-endian #f))
+         (nbytes (quotient size 8))
+         (read-n (make-bulk-number-reader base-reader endian))
+         (write-n (make-bulk-number-writer base-reader base-writer endian)))
     (cond
       ((eq? count #\*)
        (make-pack-dispatch
         0 #t vlp
-        (^v (for-each writer v) '())
-        (lambda ()
-          (let ((res '()))
-            (until (reader) eof-object? => x (push! res x))
-            (reverse res)))
+        (^v (write-n v) '())
+        (lambda () (read-n #f))
         (make-skipper #\*)))
       ((procedure? count)
        (let ((packer (count 'packer))
@@ -369,31 +418,24 @@
          (make-pack-dispatch
           0 #t vlp
           (lambda (v)
-            (packer (length v))
-            (for-each writer v)
+            (packer (list (length v)))
+            (write-n v)
             '())
           (lambda ()
-            (let ((res '()))
-              (dotimes (i (get-count (unpacker)))
-                (push! res (reader)))
-              (concatenate (reverse res))))
+            (read-n (get-count (unpacker))))
           (lambda ()
-            (let ((n (* size (get-count (unpacker)))))
+            (let ((n (* nbytes (get-count (unpacker)))))
               (or (port-seek (current-input-port) n SEEK_CUR)
                   (read-block n)))))))
       (else
        (make-pack-dispatch
-        (* count (quotient size 8)) #f vlp
+        (* count nbytes) #f vlp
         (lambda (v)
           (let-values (((consume tail) (splitter v)))
-            (for-each writer consume)
+            (write-n consume)
             tail))
-        (lambda ()
-          (let ((res '()))
-            (dotimes (i count)
-              (push! res (reader)))
-            (reverse res)))
-        (make-skipper (* count size)))))))
+        (lambda () (read-n count))
+        (make-skipper (* count nbytes)))))))
 
 ;; not an isolated procedure, as it doesn't handle initializing the
 ;; param to 0 on a pack/unpack/skip.
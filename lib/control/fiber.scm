@@ -0,0 +1,266 @@
+;;;
+;;; control.fiber - lightweight threads
+;;;
+;;;   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+;;;
+;;;   Redistribution and use in source and binary forms, with or without
+;;;   modification, are permitted provided that the following conditions
+;;;   are met:
+;;;
+;;;   1. Redistributions of source code must retain the above copyright
+;;;      notice, this list of conditions and the following disclaimer.
+;;;
+;;;   2. Redistributions in binary form must reproduce the above copyright
+;;;      notice, this list of conditions and the following disclaimer in the
+;;;      documentation and/or other materials provided with the distribution.
+;;;
+;;;   3. Neither the name of the authors nor the names of its contributors
+;;;      may be used to endorse or promote products derived from this
+;;;      software without specific prior written permission.
+;;;
+;;;   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+;;;   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+;;;   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+;;;   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT
+;;;   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+;;;   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+;;;   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+;;;   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+;;;   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+;;;   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+;;;   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+;;;
+
+(define-module control.fiber
+  (use srfi-1)
+  (use gauche.threads)
+  (use gauche.partcont)
+  (use gauche.selector)
+  (use control.timer-wheel)
+  (use data.queue)
+  (export <fiber> make-fiber fiber? fiber-name fiber-state
+          fiber-start! spawn-fiber fiber-join! current-fiber
+          fiber-yield! fiber-sleep! fiber-wait-readable fiber-wait-writable
+          fiber-read fiber-flush fiber-scheduler-start!))
+(select-module control.fiber)
+
+;; - A fiber is run by one of the scheduler threads.  Its body is
+;;   executed inside reset, and parking a fiber captures the rest of
+;;   its computation by shift.  A partial continuation doesn't depend
+;;   on the C stack it was captured on, so any scheduler thread can
+;;   resume it.
+;; - The register procedure passed to park! is called after the
+;;   continuation is saved.  It arranges the fiber to be resumed by
+;;   resume!, which puts it back to the run queue.
+;; - The poller thread waits for I/O readiness and timers, on behalf
+;;   of parked fibers.  Requests are sent through an mtqueue, and a
+;;   byte written to a pipe wakes the poller up.
+
+(define-class <fiber> ()
+  ((name   :init-keyword :name :init-value #f)
+   (thunk  :init-keyword :thunk)
+   (state  :init-value 'new)     ; new, runnable, running, parked, done, error
+   (k      :init-value #f)       ; partial continuation to resume
+   (value  :init-value #f)       ; passed to k on resumption
+   (result :init-value #f)       ; list of values, or condition
+   (joiners :init-value '())     ; fibers waiting for this one
+   (lock   :init-form (make-mutex))
+   (cv     :init-form (make-condition-variable))))
+
+(define-method write-object ((f <fiber>) port)
+  (format port "#<fiber ~s ~a>" (~ f'name) (~ f'state)))
+
+(define (fiber? obj) (is-a? obj <fiber>))
+(define (fiber-name f) (~ f'name))
+(define (fiber-state f) (~ f'state))
+
+(define (make-fiber thunk :optional (name #f))
+  (make <fiber> :thunk thunk :name name))
+
+(define (current-fiber)
+  (let1 s (thread-specific (current-thread))
+    (and (fiber? s) s)))
+
+;;
+;; Scheduler
+;;
+
+(define *run-queue* (make-mtqueue))
+(define *requests* (make-mtqueue))
+(define *wake-out* #f)                  ; write end of the wakeup pipe
+(define *threads* '())
+(define *scheduler-lock* (make-mutex))
+
+(define (fiber-scheduler-start! :optional (nthreads #f))
+  (with-locking-mutex *scheduler-lock*
+    (^[] (when (null? *threads*)
+           (receive (in out) (sys-pipe)
+             (set! *wake-out* out)
+             (set! *threads*
+                   (cons (thread-start! (make-thread (cut poller in)
+                                                     'fiber-poller))
+                         (list-tabulate
+                          (or nthreads (max 1 (sys-available-processors)))
+                          (^_ (thread-start! (make-thread worker
+                                                          'fiber-worker)))))))))
+    #t))
+
+(define (ensure-scheduler)
+  (when (null? *threads*) (fiber-scheduler-start!)))
+
+(define (worker)
+  (let loop ()
+    (run-slice (dequeue/wait! *run-queue*))
+    (loop)))
+
+;; Runs F until it parks or finishes.
+(define (run-slice f)
+  (let ([k (~ f'k)] [v (~ f'value)])
+    (set! (~ f'k) #f)
+    (set! (~ f'value) #f)
+    (set! (~ f'state) 'running)
+    (thread-specific-set! (current-thread) f)
+    (guard (e [else (finish! f 'error e)])
+      (reset (k v)))
+    (thread-specific-set! (current-thread) #f)))
+
+(define (finish! f state result)
+  (let1 joiners
+      (with-locking-mutex (~ f'lock)
+        (^[] (set! (~ f'state) state)
+             (set! (~ f'result) result)
+             (set! (~ f'thunk) #f)
+             (condition-variable-broadcast! (~ f'cv))
+             (begin0 (~ f'joiners) (set! (~ f'joiners) '()))))
+    (for-each (cut resume! <> #t) joiners)))
+
+(define (resume! f value)
+  (set! (~ f'value) value)
+  (set! (~ f'state) 'runnable)
+  (enqueue! *run-queue* f))
+
+;; Parks the current fiber.  REGISTER is called with the fiber after
+;; its continuation is saved.  Returns the value given to resume!.
+(define (park! register)
+  (shift k
+    (let1 f (current-fiber)
+      (set! (~ f'k) k)
+      (set! (~ f'state) 'parked)
+      (register f))))
+
+(define (fiber-start! f)
+  (unless (eq? (~ f'state) 'new)
+    (error "fiber already started:" f))
+  (ensure-scheduler)
+  (set! (~ f'k) (^_ (receive r ((~ f'thunk)) (finish! f 'done r))))
+  (resume! f #f)
+  f)
+
+(define (spawn-fiber thunk :optional (name #f))
+  (fiber-start! (make-fiber thunk name)))
+
+(define (fiber-join! f)
+  (define (done?) (memq (~ f'state) '(done error)))
+  (if (current-fiber)
+    (unless (done?)
+      (park! (^[self]
+               (unless (with-locking-mutex (~ f'lock)
+                         (^[] (and (not (done?))
+                                   (push! (~ f'joiners) self))))
+                 (resume! self #t)))))
+    (begin
+      (mutex-lock! (~ f'lock))
+      (let loop ()
+        (unless (done?)
+          (mutex-unlock! (~ f'lock) (~ f'cv))
+          (mutex-lock! (~ f'lock))
+          (loop)))
+      (mutex-unlock! (~ f'lock))))
+  (if (eq? (~ f'state) 'error)
+    (raise (~ f'result))
+    (apply values (~ f'result))))
+
+(define (fiber-yield!)
+  (if (current-fiber)
+    (park! (cut resume! <> #t))
+    (thread-yield!))
+  (undefined))
+
+;;
+;; Poller
+;;
+
+(define (request! req)
+  (enqueue! *requests* req)
+  (write-byte 0 *wake-out*)
+  (flush *wake-out*))
+
+(define (poller in)
+  (define wheel (make-timer-wheel))
+  (define selector (make <selector> :timer-wheel wheel))
+  (define waiters (make-hash-table 'equal?)) ; (fd . flag) -> [Fiber]
+  (define (add-waiter! fd flag f)
+    (let1 key (cons fd flag)
+      (unless (hash-table-exists? waiters key)
+        (letrec ([handler
+                  (^[fd _]
+                    (selector-delete! selector fd handler (list flag))
+                    (for-each (cut resume! <> #t)
+                              (hash-table-get waiters key '()))
+                    (hash-table-delete! waiters key))])
+          (selector-add! selector fd handler (list flag))))
+      (hash-table-push! waiters key f)))
+  (selector-add! selector in (^[p _] (read-byte p)) '(r))
+  (let loop ()
+    (dolist [req (dequeue-all! *requests*)]
+      (let ([kind (car req)] [arg (cadr req)] [f (caddr req)])
+        (if (eq? kind 'timer)
+          (timer-wheel-schedule! wheel arg (cut resume! f #t))
+          (add-waiter! arg kind f))))
+    (selector-select selector)
+    (loop)))
+
+(define (->fd port-or-fd)
+  (cond [(integer? port-or-fd) port-or-fd]
+        [(port-file-number port-or-fd)]
+        [else (error "port doesn't have a file descriptor:" port-or-fd)]))
+
+(define (fiber-sleep! seconds)
+  (if (current-fiber)
+    (park! (^[self] (request! (list 'timer seconds self))))
+    (sys-nanosleep (round->exact (* seconds 1e9))))
+  (undefined))
+
+(define (wait-fd port-or-fd flag)
+  (let1 fd (->fd port-or-fd)
+    (if (current-fiber)
+      (park! (^[self] (request! (list flag fd self))))
+      (let1 fds (make <sys-fdset>)
+        (sys-fdset-set! fds fd #t)
+        (if (eq? flag 'r)
+          (sys-select fds #f #f)
+          (sys-select #f fds #f))))
+    (undefined)))
+
+(define (fiber-wait-readable port-or-fd) (wait-fd port-or-fd 'r))
+(define (fiber-wait-writable port-or-fd) (wait-fd port-or-fd 'w))
+
+;; Calls (PROC PORT) with PORT in non-blocking mode.  When PROC returns
+;; #f because no data is available, parks the fiber until the port
+;; becomes readable and tries again.
+(define (fiber-read port proc)
+  (port-nonblocking! port #t)
+  (let loop ()
+    (let1 r (proc port)
+      (if (and (not r) (port-would-block? port))
+        (begin (fiber-wait-readable port) (loop))
+        r))))
+
+;; Flushes PORT, parking the fiber while the output can't be written.
+(define (fiber-flush port)
+  (port-nonblocking! port #t)
+  (let loop ()
+    (flush port)
+    (when (> (port-output-pending port) 0)
+      (fiber-wait-writable port)
+      (loop))))
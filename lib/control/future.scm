@@ -0,0 +1,171 @@
+;;;
+;;; control.future - futures and parallel iterators
+;;;
+;;;   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+;;;
+;;;   Redistribution and use in source and binary forms, with or without
+;;;   modification, are permitted provided that the following conditions
+;;;   are met:
+;;;
+;;;   1. Redistributions of source code must retain the above copyright
+;;;      notice, this list of conditions and the following disclaimer.
+;;;
+;;;   2. Redistributions in binary form must reproduce the above copyright
+;;;      notice, this list of conditions and the following disclaimer in the
+;;;      documentation and/or other materials provided with the distribution.
+;;;
+;;;   3. Neither the name of the authors nor the names of its contributors
+;;;      may be used to endorse or promote products derived from this
+;;;      software without specific prior written permission.
+;;;
+;;;   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+;;;   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+;;;   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+;;;   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT
+;;;   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+;;;   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+;;;   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+;;;   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+;;;   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+;;;   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+;;;   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+;;;
+
+(define-module control.future
+  (use srfi-1)
+  (use gauche.threads)
+  (use control.thread-pool)
+  (export <future> future make-future future? future-done? touch
+          parallel-map parallel-for-each parallel-reduce
+          future-pool-size))
+(select-module control.future)
+
+;; - A future is created in 'pending state, and queued to the shared
+;;   work-stealing pool.
+;; - Whoever claims it first---either a pool worker, or a thread that
+;;   touches it---runs the thunk.  So touching a future that no worker
+;;   has started yet just runs it inline, and a worker that waits for
+;;   its children never blocks on a job sitting in its own deque.
+;; - If too many futures are pending, a new future is evaluated
+;;   immediately by the creating thread, to avoid flooding the pool.
+
+(define-class <future> ()
+  ((thunk  :init-keyword :thunk)
+   (state  :init-value 'pending)        ; pending, running, done or error
+   (result :init-value #f)              ; value(s) list, or condition
+   (lock   :init-form (make-mutex))
+   (cv     :init-form (make-condition-variable))))
+
+(define-method write-object ((f <future>) port)
+  (format port "#<future ~a>" (~ f'state)))
+
+(define (future? obj) (is-a? obj <future>))
+
+;;
+;; The shared pool
+;;
+
+(define *pool* #f)
+(define *pool-lock* (make-mutex))
+(define *pending* (atom 0))             ; number of unclaimed futures
+
+(define (future-pool-size)
+  (max 1 (sys-available-processors)))
+
+(define (the-pool)
+  (or *pool*
+      (with-locking-mutex *pool-lock*
+        (^[] (unless *pool*
+               (set! *pool* (make-thread-pool (future-pool-size)
+                                              :work-stealing #t)))
+             *pool*))))
+
+;; The pool is considered saturated when every worker has several
+;; futures waiting for it.
+(define (saturated?)
+  (>= (atom-ref *pending*) (* 4 (future-pool-size))))
+
+;;
+;; Futures
+;;
+
+;; Claims F for the calling thread.  Returns #t if the caller should
+;; run it.
+(define (claim! f)
+  (with-locking-mutex (~ f'lock)
+    (^[] (and (eq? (~ f'state) 'pending)
+              (begin (set! (~ f'state) 'running)
+                     (atomic-update! *pending* (cut - <> 1))
+                     #t)))))
+
+(define (run! f)
+  (receive (state result)
+      (guard (e [else (values 'error e)])
+        (values 'done (values->list ((~ f'thunk)))))
+    (with-locking-mutex (~ f'lock)
+      (^[] (set! (~ f'state) state)
+           (set! (~ f'result) result)
+           (set! (~ f'thunk) #f)
+           (condition-variable-broadcast! (~ f'cv))))))
+
+(define (make-future thunk)
+  (let1 f (make <future> :thunk thunk)
+    (atomic-update! *pending* (cut + <> 1))
+    (if (saturated?)
+      (when (claim! f) (run! f))
+      (add-job! (the-pool) (^[] (when (claim! f) (run! f)))))
+    f))
+
+(define-syntax future
+  (syntax-rules ()
+    [(_ expr) (make-future (^[] expr))]))
+
+(define (future-done? f)
+  (memq (~ f'state) '(done error)))
+
+(define (touch f)
+  (when (claim! f) (run! f))
+  (mutex-lock! (~ f'lock))
+  (let loop ()
+    (when (eq? (~ f'state) 'running)
+      (mutex-unlock! (~ f'lock) (~ f'cv))
+      (mutex-lock! (~ f'lock))
+      (loop)))
+  (mutex-unlock! (~ f'lock))
+  (if (eq? (~ f'state) 'error)
+    (raise (~ f'result))
+    (apply values (~ f'result))))
+
+;;
+;; Parallel iterators
+;;
+
+;; Splits LIS into chunks, so that each worker gets a few of them for
+;; load balancing.
+(define (chunk-list lis chunk-size)
+  (let1 size (or chunk-size
+                 (max 1 (ceiling->exact (/ (length lis)
+                                           (* 4 (future-pool-size))))))
+    (let loop ([lis lis] [r '()])
+      (if (null? lis)
+        (reverse! r)
+        (receive (head tail) (split-at* lis size)
+          (loop tail (cons head r)))))))
+
+(define (parallel-map proc lis :key (chunk-size #f))
+  (append-map touch
+              (map (^[chunk] (future (map proc chunk)))
+                   (chunk-list lis chunk-size))))
+
+(define (parallel-for-each proc lis :key (chunk-size #f))
+  (for-each touch
+            (map (^[chunk] (future (for-each proc chunk)))
+                 (chunk-list lis chunk-size))))
+
+;; PROC must be associative, and KNIL must be its identity.  The result
+;; is the same as (fold-left proc knil lis).
+(define (parallel-reduce proc knil lis :key (chunk-size #f))
+  (fold-left proc knil
+             (map touch
+                  (map (^[chunk] (future (fold-left proc knil chunk)))
+                       (chunk-list lis chunk-size)))))
@@ -39,15 +39,17 @@
   (use srfi-1)
   (use srfi-19)
   (use data.queue)
+  (use data.ring-buffer)
   (use util.match)
   (use gauche.threads)
   (use gauche.record)
   (use gauche.mop.propagate)
   (use control.job)
+  (use control.timer-wheel)
   (export <thread-pool>
           <thread-pool-shut-down>
           make-thread-pool thread-pool-results thread-pool-shut-down?
-          add-job! wait-all terminate-all!))
+          add-job! add-delayed-job! wait-all terminate-all!))
 (select-module control.thread-pool)
 
 ;; - Thread job is queued in job queue.
@@ -55,6 +57,15 @@
 ;; - optionally, the client can ask to queue the finished job to result-queue.
 ;; - while exeuting the job, thread keeps job record in its 'specific' slot.
 ;; - graceful termination is requested by 'over in the job queue.
+;; - in work-stealing mode, each worker also has its local deque.
+;;   add-job! called from a worker pushes to the front of its own deque,
+;;   and the worker takes jobs from the front (LIFO).  An idle worker
+;;   looks at the shared job queue, then steals from the back of other
+;;   workers' deques (FIFO), so it tends to take the larger chunks of
+;;   divide-and-conquer work.
+;; - delayed jobs are kept in a timer wheel, which is run by a timer
+;;   thread started on demand.  When a timer fires, the job is added
+;;   as if add-job! is called at that time.
 
 (define-class <thread-pool> ()
   ((result-queue :init-form (make-mtqueue)) ; Queue Job
@@ -66,18 +77,109 @@
                  :propagate '(job-queue max-length)
                  :init-keyword :max-backlog)
    (shut-down    :init-value #f)       ; #t if the pool is shut down
+   (work-stealing :init-keyword :work-stealing :init-value #f)
+   (placement    :init-keyword :placement :init-value #f) ; #f, cpu or node
+   (thread-options :init-keyword :thread-options :init-value '())
+   (deques       :init-value #f)       ; #f or (Vector Deque)
+   (workers      :init-value #f)       ; #f or (Hash Thread Int)
+   (idle-lock    :init-form (make-mutex))
+   (idle-cv      :init-form (make-condition-variable))
+   (num-idle     :init-value 0)        ; number of sleeping workers
+   (generation   :init-value 0)        ; bumped when work is available
+   (timer-wheel  :init-value #f)       ; #f or <timer-wheel>
+   (timer-thread :init-value #f)       ; #f or Thread
+   (timer-lock   :init-form (make-mutex))
+   (timer-cv     :init-form (make-condition-variable))
+   (timer-deadline :init-value #f)     ; until when timer-thread sleeps
    )
   :metaclass <propagate-meta>)
 
-(define (make-thread-pool size :key (max-backlog #f))
-  (make <thread-pool> :size size :max-backlog max-backlog))
+(define (make-thread-pool size :key (max-backlog #f) (work-stealing #f)
+                          (placement #f) (thread-options '()))
+  (make <thread-pool> :size size :max-backlog max-backlog
+        :work-stealing work-stealing :placement placement
+        :thread-options thread-options))
 
 (define-method initialize ((pool <thread-pool>) initargs)
   (next-method)
-  (set! (~ pool'pool)
-        (list-tabulate (~ pool'size)
-                       (lambda (_)
-                         (thread-start! (make-thread (cut worker pool)))))))
+  (let* ([size (~ pool'size)]
+         [cpus (placement-cpus (~ pool'placement) size)])
+    (define (new-worker proc i)
+      (make-thread (cut proc pool i) (format "pool-worker-~d" i)))
+    (define (start! t i)
+      (apply thread-start! t
+             (if cpus
+               (list* :cpus (vector-ref cpus i) (~ pool'thread-options))
+               (~ pool'thread-options))))
+    (if (~ pool'work-stealing)
+      (begin
+        (set! (~ pool'deques) (vector-tabulate size (^_ (make-deque))))
+        (set! (~ pool'workers) (make-hash-table 'eq?))
+        ;; We create threads first, then register them before starting,
+        ;; so that workers can safely look up the table without locking.
+        (let1 ts (list-tabulate size (cut new-worker ws-worker <>))
+          (for-each (^[t i] (hash-table-put! (~ pool'workers) t i))
+                    ts (iota size))
+          (set! (~ pool'pool) (map start! ts (iota size)))))
+      (set! (~ pool'pool)
+            (list-tabulate size
+                           (^i (start! (new-worker (^[pool _] (worker pool))
+                                                   i)
+                                       i)))))))
+
+;;
+;; Worker placement
+;;
+
+;; Returns a vector of CPU lists for each worker, or #f to leave
+;; it to the OS.  PLACEMENT cpu pins each worker to a CPU, and node
+;; binds each worker to a NUMA node; in both cases consecutive workers
+;; go to different nodes, so that the load spreads over the nodes.
+;; If the platform can't set affinity, placement is ignored.
+(define (placement-cpus placement size)
+  (unless (memq placement '(#f cpu node))
+    (error "placement must be either #f, cpu or node, but got:" placement))
+  (and-let* ([ placement ]
+             [ (memq :cpus (thread-start-options-supported)) ]
+             [avail (thread-available-cpus)]
+             [nodes (filter pair?
+                            (map (cut filter (cut memv <> avail) <>)
+                                 (or (numa-nodes) (list avail))))]
+             [ (pair? nodes) ])
+    (case placement
+      [(node) (vector-tabulate size
+                               (^i (list-ref nodes (modulo i (length nodes)))))]
+      [(cpu) (let* ([order (list->vector (interleave nodes))]
+                    [n (vector-length order)])
+               (vector-tabulate size
+                                (^i (list (vector-ref order (modulo i n))))))])))
+
+;; ((a b c) (d e)) => (a d b e c)
+(define (interleave lists)
+  (let loop ([lists lists] [r '()])
+    (if (null? lists)
+      (reverse r)
+      (loop (filter pair? (map cdr lists))
+            (fold cons r (map car lists))))))
+
+;; Returns a list of CPU lists of NUMA nodes, or #f if unknown.
+;; Currently we only know Linux's sysfs.
+(define (numa-nodes)
+  (define (node-number path)
+    (string->number (rxmatch->string #/node(\d+)\/cpulist$/ path 1)))
+  (and-let* ([files (glob "/sys/devices/system/node/node*/cpulist")]
+             [ (pair? files) ])
+    (map (^f (parse-cpulist (call-with-input-file f read-line)))
+         (sort files < node-number))))
+
+;; "0-3,8,10-11" => (0 1 2 3 8 10 11)
+(define (parse-cpulist str)
+  (append-map (^[range]
+                (match (map string->number (string-split range #\-))
+                  [((? integer? a)) (list a)]
+                  [((? integer? a) (? integer? b)) (iota (+ (- b a) 1) a)]
+                  [_ '()]))
+              (if (string? str) (string-split str #\,) '())))
 
 (define (thread-pool-results pool)    (~ pool'result-queue))
 (define (thread-pool-shut-down? pool) (~ pool'shut-down))
@@ -99,15 +201,163 @@
      (worker pool)]
     [_ #t]))                            ; no more jobs
 
+;;
+;; Work-stealing mode
+;;
+
+;; A deque is a ring buffer protected by its own mutex.  The owner
+;; worker uses the front; thieves take from the back.
+(define (make-deque)
+  (cons (make-mutex) (make-ring-buffer (make-vector 16))))
+
+(define (deque-push! dq item)
+  (with-locking-mutex (car dq) (^[] (ring-buffer-add-front! (cdr dq) item))))
+
+(define-syntax deque-remove!
+  (syntax-rules ()
+    [(_ dq remover)
+     (with-locking-mutex (car dq)
+       (^[] (if (ring-buffer-empty? (cdr dq)) #f (remover (cdr dq)))))]))
+
+(define (deque-pop! dq)   (deque-remove! dq ring-buffer-remove-front!))
+(define (deque-steal! dq) (deque-remove! dq ring-buffer-remove-back!))
+
+(define (deque-empty? dq) (ring-buffer-empty? (cdr dq)))
+
+(define (deque-remove-all! dq)
+  (with-locking-mutex (car dq)
+    (^[] (let loop ([r '()])
+           (if (ring-buffer-empty? (cdr dq))
+             (reverse r)
+             (loop (cons (ring-buffer-remove-back! (cdr dq)) r)))))))
+
+;; Wake up sleeping workers, if any.  The unlocked check of num-idle
+;; is safe, since a worker increments it before its last scan for jobs.
+(define (notify-workers pool)
+  (unless (zero? (~ pool'num-idle))
+    (with-locking-mutex (~ pool'idle-lock)
+      (^[] (inc! (~ pool'generation))
+           (condition-variable-broadcast! (~ pool'idle-cv))))))
+
+;; Returns the next item, either (need-result . job) or 'over.
+(define (ws-next-job pool index)
+  (define deques (~ pool'deques))
+  (define size (vector-length deques))
+  (define (scan)
+    (or (deque-pop! (vector-ref deques index))
+        (dequeue! (~ pool'job-queue) #f)
+        (let loop ([k 1])
+          (and (< k size)
+               (or (deque-steal! (vector-ref deques (modulo (+ index k) size)))
+                   (loop (+ k 1)))))))
+  (define lock (~ pool'idle-lock))
+  (or (scan)
+      (let retry ()
+        (mutex-lock! lock)
+        (inc! (~ pool'num-idle))
+        (let1 gen (~ pool'generation)
+          (mutex-unlock! lock)
+          (let1 item (scan)
+            (mutex-lock! lock)
+            (when (and (not item) (= gen (~ pool'generation)))
+              (mutex-unlock! lock (~ pool'idle-cv))
+              (mutex-lock! lock))
+            (dec! (~ pool'num-idle))
+            (mutex-unlock! lock)
+            (or item (retry)))))))
+
+(define (ws-worker pool index)
+  (define self (current-thread))
+  (let loop ()
+    (match (ws-next-job pool index)
+      [(need-result . job)
+       (thread-specific-set! self job)
+       (job-run! job)
+       (when need-result (enqueue! (~ pool'result-queue) job))
+       (thread-specific-set! self #f)
+       (loop)]
+      [_ #t])))
+
+;; Returns the index of the deque to which a new job should go, or #f
+;; to use the shared job queue.
+(define (target-deque pool affinity)
+  (cond [(not (~ pool'work-stealing)) #f]
+        [affinity
+         (unless (and (exact-integer? affinity)
+                      (< -1 affinity (~ pool'size)))
+           (error "affinity must be an integer between 0 and the pool size \
+                   minus one, but got:" affinity))
+         affinity]
+        [else (hash-table-get (~ pool'workers) (current-thread) #f)]))
+
 ;; Returns job if queued, #f if job queue is full
-(define (add-job! pool thunk :optional (need-result #f) (timeout #f))
+(define (add-job! pool thunk :optional (need-result #f) (timeout #f)
+                  (affinity #f))
   (when (~ pool'shut-down) (%shut-down pool))
-  (let1 job (make-job thunk :cancellable #t)
+  (let ([job (make-job thunk :cancellable #t)]
+        [index (target-deque pool affinity)])
     (job-acknowledge! job)
-    (and (enqueue/wait! (~ pool'job-queue) (cons need-result job) timeout #f)
-         (if (~ pool'shut-down)
-           (%shut-down pool)
-           job))))
+    (cond [index
+           (deque-push! (vector-ref (~ pool'deques) index)
+                        (cons need-result job))
+           (notify-workers pool)
+           job]
+          [(enqueue/wait! (~ pool'job-queue) (cons need-result job) timeout #f)
+           (when (~ pool'work-stealing) (notify-workers pool))
+           (if (~ pool'shut-down)
+             (%shut-down pool)
+             job)]
+          [else #f])))
+
+;; Returns a timer, which can be cancelled by timer-cancel!.
+(define (add-delayed-job! pool delay thunk :optional (need-result #f))
+  (define (fire)
+    (guard (e [(<thread-pool-shut-down> e) #f]) ;pool has shut down meanwhile
+      (add-job! pool thunk need-result)))
+  (when (~ pool'shut-down) (%shut-down pool))
+  (let* ([wheel (ensure-timer-thread pool)]
+         [timer (timer-wheel-schedule! wheel delay fire)]
+         [at (+ (timer-wheel-now wheel) delay)])
+    ;; Wake the timer thread only if it sleeps beyond the new timer.
+    (with-locking-mutex (~ pool'timer-lock)
+      (^[] (let1 deadline (~ pool'timer-deadline)
+             (when (or (not deadline) (< at deadline))
+               (condition-variable-broadcast! (~ pool'timer-cv))))))
+    timer))
+
+(define (ensure-timer-thread pool)
+  (with-locking-mutex (~ pool'timer-lock)
+    (^[]
+      (unless (~ pool'timer-wheel)
+        (set! (~ pool'timer-wheel) (make-timer-wheel))
+        (set! (~ pool'timer-thread)
+              (thread-start! (make-thread (cut timer-worker pool)
+                                          "pool-timer"))))
+      (~ pool'timer-wheel))))
+
+(define (timer-worker pool)
+  (define wheel (~ pool'timer-wheel))
+  (define lock (~ pool'timer-lock))
+  (let loop ()
+    (mutex-lock! lock)
+    (if (~ pool'shut-down)
+      (mutex-unlock! lock)
+      (let1 timeout (timer-wheel-next-timeout wheel)
+        (set! (~ pool'timer-deadline)
+              (and timeout (+ (timer-wheel-now wheel) timeout)))
+        (mutex-unlock! lock (~ pool'timer-cv) timeout)
+        (timer-wheel-advance! wheel)
+        (loop)))))
+
+(define (stop-timer-thread pool)
+  (and-let* ([t (with-locking-mutex (~ pool'timer-lock)
+                  (^[] (condition-variable-broadcast! (~ pool'timer-cv))
+                       (~ pool'timer-thread)))])
+    (thread-join! t)))
+
+(define (all-deques-empty? pool)
+  (or (not (~ pool'deques))
+      (every deque-empty? (vector->list (~ pool'deques)))))
 
 ;; Note: The signature has been changed from 0.9.1, in which wait-all
 ;; only takes check-interval optional argument.  It is impossible to detect
@@ -132,6 +382,7 @@
                         or #f, but got:" timeout)]))
   (let loop ([now (and abstime (current-time))])
     (cond [(and (queue-empty? (~ pool'job-queue))
+                (all-deques-empty? pool)
                 (every (^t (not (thread-specific t))) (~ pool'pool)))]
           [(and abstime (time>=? now abstime)) #f] ;timeout
           [else (sys-nanosleep check-interval)
@@ -150,17 +401,26 @@
   (define size (~ pool'size))
 
   ;; First, make sure no more jobs are put into the queue.
+  ;; Delayed jobs that haven't fired are discarded.
   (set! (~ pool'shut-down) #t)
+  (stop-timer-thread pool)
 
   ;; If requested, cancel jobs already queued but not being executing.
   (when cancel-queued-jobs
     (dolist [job (dequeue-all! (~ pool'job-queue))]
       (job-mark-killed! (cdr job) "thread pool has shut down")
-      (enqueue! (~ pool'result-queue) (cdr job))))
+      (enqueue! (~ pool'result-queue) (cdr job)))
+    (when (~ pool'deques)
+      (vector-for-each
+       (^[dq] (dolist [job (deque-remove-all! dq)]
+                (job-mark-killed! (cdr job) "thread pool has shut down")
+                (enqueue! (~ pool'result-queue) (cdr job))))
+       (~ pool'deques))))
 
   ;; Sends threads termination message
   (dotimes [count size]
-    (enqueue/wait! (~ pool'job-queue) 'over))
+    (enqueue/wait! (~ pool'job-queue) 'over)
+    (when (~ pool'work-stealing) (notify-workers pool)))
 
   ;; Wait for termination of threads.
   (dolist [t (~ pool'pool)]
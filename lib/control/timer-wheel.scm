@@ -0,0 +1,292 @@
+;;;
+;;; control.timer-wheel - hierarchical timer wheel
+;;;
+;;;   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+;;;
+;;;   Redistribution and use in source and binary forms, with or without
+;;;   modification, are permitted provided that the following conditions
+;;;   are met:
+;;;
+;;;   1. Redistributions of source code must retain the above copyright
+;;;      notice, this list of conditions and the following disclaimer.
+;;;
+;;;   2. Redistributions in binary form must reproduce the above copyright
+;;;      notice, this list of conditions and the following disclaimer in the
+;;;      documentation and/or other materials provided with the distribution.
+;;;
+;;;   3. Neither the name of the authors nor the names of its contributors
+;;;      may be used to endorse or promote products derived from this
+;;;      software without specific prior written permission.
+;;;
+;;;   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+;;;   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+;;;   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+;;;   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT
+;;;   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+;;;   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+;;;   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+;;;   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+;;;   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+;;;   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+;;;   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+;;;
+
+(define-module control.timer-wheel
+  (use gauche.record)
+  (use gauche.threads)
+  (export make-timer-wheel timer-wheel? timer-wheel-schedule!
+          timer-wheel-advance! timer-wheel-next-timeout
+          timer-wheel-num-timers timer-wheel-now
+          timer? timer-pending? timer-cancel! timer-reschedule!))
+(select-module control.timer-wheel)
+
+;; The time is quantized to ticks of RESOLUTION seconds.  The wheel has
+;; LEVELS levels of 64 slots each; a slot of level l covers 64^l ticks,
+;; so the whole wheel covers 64^LEVELS ticks ahead.  A timer is put
+;; in the level that its distance from the current tick falls in.
+;; When the current tick crosses a boundary of level l, the timers in
+;; the corresponding slot of level l are redistributed to the lower
+;; levels (cascading), eventually reaching level 0, where they fire.
+;; Timers farther than the wheel covers are parked in the top level and
+;; redistributed each time the top level wraps around.
+;;
+;; Each slot is a circular doubly-linked list with a sentinel, so that
+;; scheduling and cancelling a timer take constant time.  All the
+;; timers of a wheel are protected by the wheel's mutex.  The thunks
+;; of fired timers are called after the mutex is released, so they can
+;; schedule or cancel other timers.
+
+(define *bits* 6)
+(define *slots* (ash 1 *bits*))
+(define *mask* (- *slots* 1))
+
+(define-record-type timer-wheel %make-timer-wheel timer-wheel?
+  (resolution)                          ; seconds per tick
+  (clock)                               ; thunk to return seconds
+  (levels)                              ; vector of vectors of sentinels
+  (counts)                              ; number of timers in each level
+  (current)                             ; the current tick
+  (mutex))
+
+;; A sentinel of a slot is also a timer record, whose wheel is #f.
+(define-record-type timer %make-timer timer?
+  (wheel)
+  (expiry)                              ; tick at which the timer fires
+  (thunk)
+  (prev)
+  (next)
+  (level))                              ; #f if not pending
+
+(define (monotonic-seconds)
+  (receive (sec nsec) (sys-clock-gettime-monotonic)
+    (if sec
+      (+ sec (/. nsec 1e9))
+      (receive (sec usec) (sys-gettimeofday)
+        (+ sec (/. usec 1e6))))))
+
+(define (make-slot)
+  (rlet1 s (%make-timer #f #f #f #f #f #f)
+    (timer-prev-set! s s)
+    (timer-next-set! s s)))
+
+(define (make-timer-wheel :key (resolution 0.01) (levels 4)
+                          (clock monotonic-seconds))
+  (unless (and (real? resolution) (positive? resolution))
+    (error "resolution must be a positive real number, but got:" resolution))
+  (unless (and (exact-integer? levels) (positive? levels))
+    (error "levels must be a positive exact integer, but got:" levels))
+  (%make-timer-wheel resolution clock
+                     (vector-tabulate levels
+                                      (^_ (vector-tabulate *slots*
+                                                           (^_ (make-slot)))))
+                     (make-vector levels 0)
+                     (floor->exact (/ (clock) resolution))
+                     (make-mutex)))
+
+(define (timer-wheel-now wheel) ((timer-wheel-clock wheel)))
+
+(define (timer-wheel-num-timers wheel)
+  (with-locking-mutex (timer-wheel-mutex wheel)
+    (^[] (apply + (vector->list (timer-wheel-counts wheel))))))
+
+(define (->tick wheel seconds)
+  (floor->exact (/ seconds (timer-wheel-resolution wheel))))
+
+;;
+;; Internal routines; called with the mutex held
+;;
+
+(define (%slot wheel level index)
+  (vector-ref (vector-ref (timer-wheel-levels wheel) level) index))
+
+(define (%slot-empty? s) (eq? (timer-next s) s))
+
+;; Puts the timer to the slot determined by its expiry.
+(define (%link! wheel t)
+  (let* ([cur (timer-wheel-current wheel)]
+         [delta (- (timer-expiry t) cur)]
+         [top (- (vector-length (timer-wheel-levels wheel)) 1)]
+         [level (let loop ([l 0] [span *slots*])
+                  (if (or (= l top) (< delta span))
+                    l
+                    (loop (+ l 1) (ash span *bits*))))]
+         [shift (* level *bits*)]
+         [index (logand (ash (if (< delta (ash 1 (+ shift *bits*)))
+                               (timer-expiry t)
+                               cur)     ;beyond the wheel
+                             (- shift))
+                        *mask*)]
+         [s (%slot wheel level index)]
+         [p (timer-prev s)])
+    (timer-next-set! p t)
+    (timer-prev-set! t p)
+    (timer-next-set! t s)
+    (timer-prev-set! s t)
+    (timer-level-set! t level)
+    (vector-set! (timer-wheel-counts wheel) level
+                 (+ (vector-ref (timer-wheel-counts wheel) level) 1))))
+
+(define (%unlink! wheel t)
+  (let ([p (timer-prev t)]
+        [n (timer-next t)]
+        [level (timer-level t)])
+    (timer-next-set! p n)
+    (timer-prev-set! n p)
+    (timer-prev-set! t #f)
+    (timer-next-set! t #f)
+    (timer-level-set! t #f)
+    (vector-set! (timer-wheel-counts wheel) level
+                 (- (vector-ref (timer-wheel-counts wheel) level) 1))))
+
+;; Removes all timers in the slot and returns them in the order of
+;; insertion.
+(define (%detach-slot! wheel level index)
+  (let1 s (%slot wheel level index)
+    (let loop ([t (timer-prev s)] [r '()])
+      (if (eq? t s)
+        r
+        (let1 p (timer-prev t)
+          (%unlink! wheel t)
+          (loop p (cons t r)))))))
+
+(define (%schedule! wheel t delay)
+  (let1 expiry (ceiling->exact (/ (+ (timer-wheel-now wheel) delay)
+                                  (timer-wheel-resolution wheel)))
+    (timer-expiry-set! t (max expiry (+ (timer-wheel-current wheel) 1)))
+    (%link! wheel t)))
+
+;; Called when the current tick becomes CUR.
+(define (%cascade! wheel cur)
+  (let1 nlevels (vector-length (timer-wheel-levels wheel))
+    (let loop ([l 1])
+      (when (< l nlevels)
+        (let1 shift (* l *bits*)
+          (when (zero? (logand cur (- (ash 1 shift) 1)))
+            (dolist [t (%detach-slot! wheel l (logand (ash cur (- shift))
+                                                      *mask*))]
+              (%link! wheel t))
+            (loop (+ l 1))))))))
+
+(define (%lowest-level wheel)
+  (let1 counts (timer-wheel-counts wheel)
+    (let loop ([l 0])
+      (cond [(= l (vector-length counts)) #f]
+            [(zero? (vector-ref counts l)) (loop (+ l 1))]
+            [else l]))))
+
+;; Advances the current tick to TARGET and returns the list of fired
+;; timers.  We skip the ticks in which nothing can happen, so advancing
+;; over a long idle period doesn't cost much.  If the wheel has only
+;; one level, a timer beyond the wheel can appear in level 0; it is
+;; put back instead of fired.
+(define (%advance! wheel target)
+  (let loop ([fired '()])
+    (let ([cur (timer-wheel-current wheel)]
+          [level (%lowest-level wheel)])
+      (define (done) (timer-wheel-current-set! wheel target) (reverse fired))
+      (cond [(>= cur target) (reverse fired)]
+            [(not level) (done)]
+            [else
+             (let* ([step (ash 1 (* level *bits*))]
+                    [next (* (+ (quotient cur step) 1) step)])
+               (if (> next target)
+                 (done)
+                 (begin
+                   (timer-wheel-current-set! wheel next)
+                   (%cascade! wheel next)
+                   (loop (fold (^[t fired]
+                                 (if (> (timer-expiry t) next)
+                                   (begin (%link! wheel t) fired) ;beyond
+                                   (cons t fired)))
+                               fired
+                               (%detach-slot! wheel 0
+                                              (logand next *mask*)))))))]))))
+
+;; Returns the lower bound of the tick of the earliest pending timer,
+;; or #f if there's no pending timers.  It is exact if the earliest
+;; timer is in level 0.
+(define (%next-tick wheel)
+  (let ([cur (timer-wheel-current wheel)]
+        [counts (timer-wheel-counts wheel)])
+    (let loop ([l 0] [best #f])
+      (if (= l (vector-length counts))
+        best
+        (loop (+ l 1)
+              (if (zero? (vector-ref counts l))
+                best
+                (let* ([shift (* l *bits*)]
+                       [base (ash cur (- shift))])
+                  (let scan ([k 1])
+                    (cond [(> k *slots*) best]
+                          [(%slot-empty? (%slot wheel l
+                                                (logand (+ base k) *mask*)))
+                           (scan (+ k 1))]
+                          [else
+                           (let1 tick (ash (+ base k) shift)
+                             (if (and best (< best tick)) best tick))])))))))))
+
+;;
+;; API
+;;
+
+(define (timer-wheel-schedule! wheel delay thunk)
+  (check-arg real? delay)
+  (rlet1 t (%make-timer wheel #f thunk #f #f #f)
+    (with-locking-mutex (timer-wheel-mutex wheel)
+      (^[] (%schedule! wheel t delay)))))
+
+(define (timer-pending? timer) (boolean (timer-level timer)))
+
+(define (timer-cancel! timer)
+  (let1 wheel (timer-wheel timer)
+    (with-locking-mutex (timer-wheel-mutex wheel)
+      (^[] (and (timer-level timer)
+                (begin (%unlink! wheel timer) #t))))))
+
+(define (timer-reschedule! timer delay)
+  (check-arg real? delay)
+  (let1 wheel (timer-wheel timer)
+    (with-locking-mutex (timer-wheel-mutex wheel)
+      (^[]
+        (when (timer-level timer) (%unlink! wheel timer))
+        (%schedule! wheel timer delay)))
+    timer))
+
+;; Fires all the timers that are due by NOW, and returns the number
+;; of fired timers.  The timers that become due in the same tick, or
+;; while nobody has advanced the wheel, are fired together.
+(define (timer-wheel-advance! wheel :optional (now (timer-wheel-now wheel)))
+  (let1 fired (with-locking-mutex (timer-wheel-mutex wheel)
+                (^[] (%advance! wheel (->tick wheel now))))
+    (dolist [t fired] ((timer-thunk t)))
+    (length fired)))
+
+;; Returns the seconds until the wheel should be advanced next, or #f
+;; if there's no pending timers.  It may be shorter than the time
+;; to the earliest timer, when it is in the upper level; advancing
+;; the wheel at that time moves the timer to a lower level.
+(define (timer-wheel-next-timeout wheel)
+  (and-let1 tick (with-locking-mutex (timer-wheel-mutex wheel)
+                   (^[] (%next-tick wheel)))
+    (max 0 (- (* tick (timer-wheel-resolution wheel))
+              (timer-wheel-now wheel)))))
@@ -82,6 +82,8 @@
   (use data.queue)
   (use data.heap)
   (use srfi-114)
+  (use gauche.uvector)
+  (use gauche.threads)
   (export <cache>
           ;; Protocol
           cache-storage cache-comparator
@@ -98,7 +100,9 @@
           make-ttl-cache
           make-ttlr-cache
           make-lru-cache
-          make-counting-cache cache-stats))
+          make-tinylfu-cache
+          make-counting-cache cache-stats
+          make-sharded-cache))
 (select-module data.cache)
 
 ;; storage and comparator 
@@ -269,22 +273,289 @@
   (dequeue-all! (~ cache'queue))
   (undefined))
 
+;; Intrusive doubly linked lists
+;;  - A node is #(<key> <value> <prev> <next> <segment>).  The storage
+;;    maps a key to its node, so that the node can be moved or unlinked
+;;    in O(1).
+;;  - A list is circular with a sentinel node; the next of the sentinel
+;;    is the most recently used node, and the prev is the least.
+
+(define (make-node key value) (vector key value #f #f #f))
+(define-inline (node-key n)   (vector-ref n 0))
+(define-inline (node-value n) (vector-ref n 1))
+(define-inline (node-prev n)  (vector-ref n 2))
+(define-inline (node-next n)  (vector-ref n 3))
+
+(define (make-dlist)
+  (rlet1 s (make-node #f #f)
+    (vector-set! s 2 s)
+    (vector-set! s 3 s)))
+
+(define-inline (dlist-empty? s) (eq? (node-next s) s))
+(define-inline (dlist-last s) (node-prev s))
+
+(define (dlist-unlink! n)
+  (let ([p (node-prev n)] [x (node-next n)])
+    (vector-set! p 3 x)
+    (vector-set! x 2 p)))
+
+(define (dlist-push! s n)
+  (let1 h (node-next s)
+    (vector-set! n 2 s)
+    (vector-set! n 3 h)
+    (vector-set! h 2 n)
+    (vector-set! s 3 n)))
+
+(define (dlist-touch! s n)
+  (dlist-unlink! n)
+  (dlist-push! s n))
+
+;; Called from initialize with a pre-filled storage, which holds nodes of
+;; another cache.  Replaces them with fresh nodes, and calls PLACE! on
+;; each.  The recency order of the original cache isn't preserved.
+(define (%rebuild-nodes! storage place!)
+  (dolist [kn (dict->alist storage)]
+    (let1 n (make-node (car kn) (node-value (cdr kn)))
+      (dict-put! storage (car kn) n)
+      (place! n))))
+
 ;; LRU Cache
-;;  - LRU cache is actually a variation of FIFO cache, except that
-;;    we touch the entry on read operaion as well.
-(define-class <lru-cache> (<fifo-cache>) ())
+;;  - The storage holds <key> -> <node>, and the nodes are kept in
+;;    a list in the order of recency.  Reading or writing an entry moves
+;;    its node to the front, and the last node is evicted when the cache
+;;    is full.  Every operation is O(1).
+
+(define-class <lru-cache> (<cache>)
+  ([capacity :init-keyword :capacity]
+   ;; private
+   [lru :init-form (make-dlist)]
+   [evictions :init-value 0]))
 
 (define (make-lru-cache capacity :key (storage #f) (comparator #f))
   (make <lru-cache> :storage storage :comparator comparator
         :capacity capacity))
 
+(define-method initialize ((c <lru-cache>) initargs)
+  (next-method)
+  (let1 storage (cache-storage c)
+    (%rebuild-nodes! storage (cut dlist-push! (~ c'lru) <>))
+    (while (> (size-of storage) (~ c'capacity))
+      (%lru-evict-last! c))))
+
+(define (%lru-evict-last! cache)
+  (let1 n (dlist-last (~ cache'lru))
+    (dlist-unlink! n)
+    (dict-delete! (cache-storage cache) (node-key n))
+    (inc! (~ cache'evictions))))
+
 (define-method cache-check! ((cache <lru-cache>) key)
-  (and-let* ([nv (dict-get (cache-storage cache) key #f)]
-             [nv2 (cons (~ cache'counter) (cdr nv))])
-    (dict-put! (cache-storage cache) key nv2)
-    (%fifo-touch! cache (~ cache'queue) key)
-    (cons key (cdr nv))))
-  
+  (and-let1 n (dict-get (cache-storage cache) key #f)
+    (dlist-touch! (~ cache'lru) n)
+    (cons key (node-value n))))
+
+(define (%lru-add! cache key value)
+  (let ([dict (cache-storage cache)]
+        [lru (~ cache'lru)])
+    (if-let1 n (dict-get dict key #f)
+      (begin (vector-set! n 1 value)
+             (dlist-touch! lru n))
+      (let1 n (make-node key value)
+        (when (and (>= (size-of dict) (~ cache'capacity))
+                   (not (dlist-empty? lru)))
+          (%lru-evict-last! cache))
+        (dlist-push! lru n)
+        (dict-put! dict key n)))))
+
+(define-method cache-register! ((cache <lru-cache>) key value)
+  (%lru-add! cache key value)
+  (cons key value))
+
+(define-method cache-write! ((cache <lru-cache>) key value)
+  (%lru-add! cache key value))
+
+(define-method cache-evict! ((cache <lru-cache>) key)
+  (and-let1 n (dict-get (cache-storage cache) key #f)
+    (dlist-unlink! n)
+    (dict-delete! (cache-storage cache) key))
+  (undefined))
+
+(define-method cache-clear! ((cache <lru-cache>))
+  (dict-clear! (cache-storage cache))
+  (set! (~ cache'lru) (make-dlist))
+  (undefined))
+
+;; W-TinyLFU Cache
+;;  - New entries go to a small LRU window.  An entry pushed out of the
+;;    window is admitted to the main area only if it has been accessed
+;;    more frequently than the entry the main area would evict; so a
+;;    burst of one-time accesses doesn't flush frequently used entries.
+;;  - The main area is a segmented LRU.  Entries enter the probation
+;;    segment, and are promoted to the protected segment when they are
+;;    hit again.  The victim is the last entry of probation.
+;;  - Access frequencies are estimated by a count-min sketch of 4-bit
+;;    counters, 8 times as wide as the capacity.  The counters are
+;;    halved after every 10*capacity accesses so that the old history
+;;    fades.
+;;  - The segment of a node is kept in its <segment> field.
+
+(define-class <tinylfu-cache> (<cache>)
+  ([capacity :init-keyword :capacity]
+   [window-ratio :init-keyword :window-ratio :init-value 0.01]
+   ;; private
+   [window-capacity]
+   [protected-capacity]
+   [window    :init-form (make-dlist)]
+   [probation :init-form (make-dlist)]
+   [protected :init-form (make-dlist)]
+   [window-size :init-value 0]
+   [protected-size :init-value 0]
+   [sketch]
+   [evictions :init-value 0]))
+
+(define (make-tinylfu-cache capacity :key (storage #f) (comparator #f)
+                                          (window-ratio 0.01))
+  (make <tinylfu-cache> :storage storage :comparator comparator
+        :capacity capacity :window-ratio window-ratio))
+
+(define-method initialize ((c <tinylfu-cache>) initargs)
+  (next-method)
+  (let* ([cap (~ c'capacity)]
+         [w (clamp (round->exact (* cap (~ c'window-ratio))) 1 (max cap 1))])
+    (set! (~ c'window-capacity) w)
+    (set! (~ c'protected-capacity) (floor->exact (* (- cap w) 0.8)))
+    (set! (~ c'sketch) (make-sketch cap)))
+  (let1 storage (cache-storage c)
+    (%rebuild-nodes! storage (^n (%lfu-link! c n 'probation)))
+    (while (> (size-of storage) (max 0 (- (~ c'capacity) (~ c'window-capacity))))
+      (%lfu-evict! c (dlist-last (~ c'probation))))))
+
+;; Frequency sketch.
+;;  #(<counters> <mask> <additions> <sample-size>), where counters is
+;;  a u8vector of 4 rows.
+(define-constant *sketch-seeds* '#(#x9e3779 #x85ebca #xc2b2ae #x27d4eb))
+
+(define (make-sketch capacity)
+  (let1 width (let loop ([w 16]) (if (>= w (* 8 capacity)) w (loop (* w 2))))
+    (vector (make-u8vector (* 4 width) 0) (- width 1) 0
+            (max 1 (* 10 capacity)))))
+
+(define (%sketch-index sk hash row)
+  (let1 h (logand hash #xffffff)
+    (+ (* row (+ (vector-ref sk 1) 1))
+       (logand (ash (* h (vector-ref *sketch-seeds* row)) -16)
+               (vector-ref sk 1)))))
+
+(define (sketch-frequency sk hash)
+  (let1 counters (vector-ref sk 0)
+    (let loop ([row 0] [m 15])
+      (if (= row 4)
+        m
+        (loop (+ row 1)
+              (min m (u8vector-ref counters (%sketch-index sk hash row))))))))
+
+(define (sketch-increment! sk hash)
+  (let1 counters (vector-ref sk 0)
+    (dotimes [row 4]
+      (let1 i (%sketch-index sk hash row)
+        (when (< (u8vector-ref counters i) 15)
+          (u8vector-set! counters i (+ (u8vector-ref counters i) 1)))))
+    (vector-set! sk 2 (+ (vector-ref sk 2) 1))
+    (when (>= (vector-ref sk 2) (vector-ref sk 3))
+      (u8vector-rshift! counters 1)
+      (vector-set! sk 2 (quotient (vector-ref sk 2) 2)))))
+
+(define (u8vector-rshift! v n)
+  (dotimes [i (u8vector-length v)]
+    (u8vector-set! v i (ash (u8vector-ref v i) (- n)))))
+
+(define-inline (%lfu-hash c key) (comparator-hash (cache-comparator c) key))
+
+(define (%lfu-link! c n segment)
+  (vector-set! n 4 segment)
+  (dlist-push! (slot-ref c segment) n)
+  (case segment
+    [(window)    (inc! (~ c'window-size))]
+    [(protected) (inc! (~ c'protected-size))]))
+
+(define (%lfu-unlink! c n)
+  (dlist-unlink! n)
+  (case (vector-ref n 4)
+    [(window)    (dec! (~ c'window-size))]
+    [(protected) (dec! (~ c'protected-size))]))
+
+(define (%lfu-evict! c n)
+  (%lfu-unlink! c n)
+  (dict-delete! (cache-storage c) (node-key n))
+  (inc! (~ c'evictions)))
+
+(define (%lfu-touch! c n)
+  (case (vector-ref n 4)
+    [(window)    (dlist-touch! (~ c'window) n)]
+    [(protected) (dlist-touch! (~ c'protected) n)]
+    [(probation)
+     (%lfu-unlink! c n)
+     (%lfu-link! c n 'protected)
+     (when (> (~ c'protected-size) (~ c'protected-capacity))
+       (let1 m (dlist-last (~ c'protected))
+         (%lfu-unlink! c m)
+         (%lfu-link! c m 'probation)))]))
+
+;; Moves the last entry of the window to the main area, or evicts it
+;; or the main area's victim by comparing their frequencies.
+(define (%lfu-demote-window! c)
+  (let* ([cand (dlist-last (~ c'window))]
+         [main-size (- (size-of (cache-storage c)) (~ c'window-size))]
+         [main-cap (- (~ c'capacity) (~ c'window-capacity))])
+    (%lfu-unlink! c cand)
+    (if (< main-size main-cap)
+      (%lfu-link! c cand 'probation)
+      (let1 victim (if (dlist-empty? (~ c'probation))
+                     (dlist-last (~ c'protected))
+                     (dlist-last (~ c'probation)))
+        (if (and (not (eq? victim (~ c'protected))) ; main area isn't empty
+                 (> (sketch-frequency (~ c'sketch) (%lfu-hash c (node-key cand)))
+                    (sketch-frequency (~ c'sketch) (%lfu-hash c (node-key victim)))))
+          (begin (%lfu-evict! c victim)
+                 (%lfu-link! c cand 'probation))
+          (begin (dict-delete! (cache-storage c) (node-key cand))
+                 (inc! (~ c'evictions))))))))
+
+(define-method cache-check! ((c <tinylfu-cache>) key)
+  (sketch-increment! (~ c'sketch) (%lfu-hash c key))
+  (and-let1 n (dict-get (cache-storage c) key #f)
+    (%lfu-touch! c n)
+    (cons key (node-value n))))
+
+(define (%lfu-add! c key value)
+  (if-let1 n (dict-get (cache-storage c) key #f)
+    (begin (vector-set! n 1 value)
+           (%lfu-touch! c n))
+    (let1 n (make-node key value)
+      (dict-put! (cache-storage c) key n)
+      (%lfu-link! c n 'window)
+      (when (> (~ c'window-size) (~ c'window-capacity))
+        (%lfu-demote-window! c)))))
+
+(define-method cache-register! ((c <tinylfu-cache>) key value)
+  (%lfu-add! c key value)
+  (cons key value))
+
+(define-method cache-write! ((c <tinylfu-cache>) key value)
+  (%lfu-add! c key value))
+
+(define-method cache-evict! ((c <tinylfu-cache>) key)
+  (and-let1 n (dict-get (cache-storage c) key #f)
+    (%lfu-unlink! c n)
+    (dict-delete! (cache-storage c) key))
+  (undefined))
+
+(define-method cache-clear! ((c <tinylfu-cache>))
+  (dict-clear! (cache-storage c))
+  (for-each (^[s] (slot-set! c s (make-dlist))) '(window probation protected))
+  (set! (~ c'window-size) 0)
+  (set! (~ c'protected-size) 0)
+  (undefined))
+
 ;; TTL Cache
 ;;  - Timestamps is a heap with (<timestamp> . <key>).   There can
 ;;    be multiple entries with the same <key>.
@@ -404,4 +675,95 @@
   (cache-clear! (~ cache'inner-cache)))
 
 (define-method cache-stats ((cache <counting-cache>))
-  `(:hits ,(~ cache'hits) :misses ,(~ cache'misses)))
+  `(:hits ,(~ cache'hits) :misses ,(~ cache'misses)
+    ,@(cond-list [(%cache-evictions (~ cache'inner-cache))
+                  => (^e `(:evictions ,e))])))
+
+;; Returns the number of entries evicted by the cache policy so far,
+;; or #f if the cache doesn't count it.
+(define-method %cache-evictions ((cache <cache>)) #f)
+(define-method %cache-evictions ((cache <lru-cache>)) (~ cache'evictions))
+(define-method %cache-evictions ((cache <tinylfu-cache>)) (~ cache'evictions))
+(define-method %cache-evictions ((cache <counting-cache>))
+  (%cache-evictions (~ cache'inner-cache)))
+
+;; Sharded cache
+;; - This is a wrapper cache to share a cache among threads.  Keys are
+;;   distributed by their hash values over N inner caches (shards), each
+;;   of which is guarded by its own mutex, so threads accessing different
+;;   shards don't contend.  The capacity of the whole is the sum of those
+;;   of the shards.
+;; - Hits and misses are counted per shard, under the shard's lock.
+;; - The value-fn of cache-through! is called outside of the lock.  If
+;;   another thread registered the key in the meantime, the existing
+;;   entry wins.
+;; NB: The storage slot of a sharded cache isn't used.
+
+(define-class <sharded-cache> (<cache>)
+  ([shards :init-keyword :shards]         ; vector of caches
+   ;; private
+   [locks]
+   [hits]
+   [misses]))
+
+(define (make-sharded-cache nshards make-shard)
+  (unless (and (exact-integer? nshards) (positive? nshards))
+    (error "number of shards must be a positive exact integer, but got:"
+           nshards))
+  (let1 shards (vector-tabulate nshards (^_ (make-shard)))
+    (make <sharded-cache> :shards shards
+          :comparator (cache-comparator (vector-ref shards 0)))))
+
+(define-method initialize ((c <sharded-cache>) initargs)
+  (next-method)
+  (let1 n (vector-length (~ c'shards))
+    (set! (~ c'locks) (vector-tabulate n (^_ (make-mutex))))
+    (set! (~ c'hits) (make-vector n 0))
+    (set! (~ c'misses) (make-vector n 0))))
+
+(define (%with-shard c key proc)
+  (let1 i (modulo (comparator-hash (cache-comparator c) key)
+                  (vector-length (~ c'shards)))
+    (with-locking-mutex (vector-ref (~ c'locks) i)
+      (^[] (proc i (vector-ref (~ c'shards) i))))))
+
+(define (%for-each-shard c proc)
+  (dotimes [i (vector-length (~ c'shards))]
+    (with-locking-mutex (vector-ref (~ c'locks) i)
+      (^[] (proc i (vector-ref (~ c'shards) i))))))
+
+(define-method cache-check! ((c <sharded-cache>) key)
+  (%with-shard c key
+    (^[i shard]
+      (rlet1 r (cache-check! shard key)
+        (if r
+          (inc! (vector-ref (~ c'hits) i))
+          (inc! (vector-ref (~ c'misses) i)))))))
+
+(define-method cache-register! ((c <sharded-cache>) key value)
+  (%with-shard c key
+    (^[i shard]
+      (or (and (dict-exists? (cache-storage shard) key)
+               (cache-check! shard key))
+          (cache-register! shard key value)))))
+
+(define-method cache-write! ((c <sharded-cache>) key value)
+  (%with-shard c key (^[i shard] (cache-write! shard key value))))
+
+(define-method cache-evict! ((c <sharded-cache>) key)
+  (%with-shard c key (^[i shard] (cache-evict! shard key))))
+
+(define-method cache-clear! ((c <sharded-cache>))
+  (%for-each-shard c (^[i shard] (cache-clear! shard))))
+
+(define-method %cache-evictions ((c <sharded-cache>))
+  (rlet1 total 0
+    (%for-each-shard c (^[i shard]
+                         (inc! total (or (%cache-evictions shard) 0))))))
+
+(define-method cache-stats ((c <sharded-cache>))
+  (let ([hits 0] [misses 0])
+    (%for-each-shard c (^[i shard]
+                         (inc! hits (vector-ref (~ c'hits) i))
+                         (inc! misses (vector-ref (~ c'misses) i))))
+    `(:hits ,hits :misses ,misses :evictions ,(%cache-evictions c))))
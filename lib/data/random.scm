@@ -181,16 +181,12 @@
 ;;
 
 ;; Normal distribution (continuous - generates real numbers)
-;; Box-Muller algorithm
-;; NB: We tested Ziggurat method, too (see git repo for the code),
-;; only to find out Box-Muller is faster about 12% - presumably
-;; the overhead of each ops is larger in Gauche than C/C++, and
-;; so the difference of cost of log or sin from the primitive
-;; addition/multiplication are negligible.
+;; NB: We once tried Ziggurat method written in Scheme, only to find
+;; out Box-Muller is faster about 12% - the overhead of each ops is
+;; larger in Gauche than C/C++.  Now math.mt-random implements Ziggurat
+;; in C, which beats both.
 (define (reals-normal$ :optional (mean 0) (deviation 1))
-  (^[] (let ([r (%sqrt (* -2 (%log (%rand-real))))]
-             [theta (* 2pi (%rand-real))])
-         (+ mean (* deviation r (%sin theta))))))
+  (^[] (+ mean (* deviation (mt-random-normal (cdr (%random-data-state)))))))
 
 #|
 Simple test of gaussian sampling: Generate some data with this:
@@ -207,7 +203,7 @@ plot 'tmp' using (bin($1,binwidth)):(1.0) smooth freq with boxes
 
 ;; Exponential distribution - continuous
 (define (reals-exponential$ m)
-  (^[] (- (* m (log (%rand-real))))))
+  (^[] (* m (mt-random-exponential (cdr (%random-data-state))))))
 
 ;; Draw from geometric distribution, with success probability p.
 ;; Mean is 1/p, variance is (1-p)/p^2
@@ -38,6 +38,8 @@
   (use srfi-1)
   (use srfi-13)
   (use util.match)
+  (use gauche.collection)
+  (use gauche.generator)
   (extend util.relation)
   (export <dbi-error> <dbi-nonexistent-driver-error>
           <dbi-unsupported-error> <dbi-parameter-error>
@@ -46,11 +48,20 @@
           dbi-open? dbi-parse-dsn dbi-make-driver
           dbi-prepare-sql dbi-escape-sql dbi-list-drivers
           dbi-make-connection dbi-execute-using-connection
+          dbi-clear-prepared-cache!
+          <dbi-connection-pool> make-dbi-connection-pool
+          dbi-pool-acquire dbi-pool-release! call-with-dbi-connection
+          <dbi-streaming-result-set> dbi-fetch-batch dbi-result->generator
           ;; compatibility
           dbi-make-query dbi-execute-query dbi-get-value
           <dbi-exception> <dbi-result-set>))
 (select-module dbi)
 
+;; The connection pool needs gauche.threads, so it is in a separate
+;; module, loaded when it's used.
+(autoload dbi.pool <dbi-connection-pool> make-dbi-connection-pool
+                   dbi-pool-acquire dbi-pool-release! call-with-dbi-connection)
+
 ;;;==============================================================
 ;;; DBI conditions
 ;;;
@@ -87,9 +98,15 @@
 
 ;; <dbi-connection> : represents a connection to the database system.
 ;; All the transactions must be done while the connection is 'open'.
+;; The default dbi-prepare keeps the recently prepared queries in
+;; an LRU cache keyed by the SQL text, up to prepared-cache-size
+;; entries.  Setting it to 0 disables caching.
 (define-class <dbi-connection> ()
   ((open :init-value #t) ;; this slot is for backward compatibility.
                          ;; do not count on this.  will be removed.
+   (prepared-cache-size :init-keyword :prepared-cache-size :init-value 64)
+   (%prepared-cache :init-value #f) ; created on demand
+   (%prepared-tick :init-value 0)   ; for LRU
    ))
 
 ;; <dbi-query> : represents a prepared query.
@@ -131,9 +148,48 @@
                        (error <dbi-parameter-error>
                               "parameter is given to the pass through sql:" sql))
                      sql)
-                   (dbi-prepare-sql c sql))
+                   (%prepare-sql/cache c sql))
     (make <dbi-query> :connection c :prepared prepared)))
 
+;; The procedure returned by dbi-prepare-sql only depends on the
+;; connection and the SQL text, so we can share it among the queries.
+;; The cache maps the SQL text to (procedure . last-use).  We don't use
+;; data.cache, which needs extension modules; plain (use dbi) should
+;; work with the core alone.  The least recently used entry is found
+;; by a linear scan, which is fine for the cache sizes we expect.
+(define (%prepare-sql/cache c sql)
+  (let1 size (slot-ref c 'prepared-cache-size)
+    (if (and (integer? size) (positive? size))
+      (let ([cache (or (slot-ref c '%prepared-cache)
+                       (rlet1 cache (make-hash-table 'string=?)
+                         (slot-set! c '%prepared-cache cache)))]
+            [tick (+ (slot-ref c '%prepared-tick) 1)])
+        (slot-set! c '%prepared-tick tick)
+        (cond [(hash-table-get cache sql #f)
+               => (^e (set-cdr! e tick) (car e))]
+              [else
+               (let1 proc (dbi-prepare-sql c sql)
+                 (when (>= (hash-table-num-entries cache) size)
+                   (%evict-lru! cache))
+                 (hash-table-put! cache sql (cons proc tick))
+                 proc)]))
+      (dbi-prepare-sql c sql))))
+
+(define (%evict-lru! cache)
+  (let1 oldest (hash-table-fold cache
+                                (^[k e r] (if (or (not r) (< (cdr e) (cddr r)))
+                                            (cons k e)
+                                            r))
+                                #f)
+    (when oldest (hash-table-delete! cache (car oldest)))))
+
+;; Discards the cached prepared queries, e.g. after the driver changes
+;; the way to escape strings.
+(define-method dbi-clear-prepared-cache! ((c <dbi-connection>))
+  (and-let1 cache (slot-ref c '%prepared-cache)
+    (hash-table-clear! cache))
+  (undefined))
+
 (define-method dbi-execute ((q <dbi-query>) . params)
   (dbi-execute-using-connection (ref q 'connection) q params))
 
@@ -184,6 +240,45 @@
 (define-method dbi-open? (obj) #t)
 (define-method dbi-close (obj) (undefined))
 
+;;;==============================================================
+;;; Streaming result sets
+;;;
+
+;; A driver that can fetch the rows incrementally makes its result set
+;; a subclass of <dbi-streaming-result-set>, and implements
+;; dbi-fetch-batch, which returns a list of up to N next rows, or ()
+;; if there's no more rows.  Then the result can be walked as a
+;; collection, or with dbi-result->generator, without having all the
+;; rows in memory.
+
+(define-class <dbi-streaming-result-set> (<collection>)
+  ((batch-size :init-keyword :batch-size :init-value 256)))
+
+(define-generic dbi-fetch-batch)
+
+;; Returns a thunk that returns the next row, or EOF.
+(define (%batch-reader r n)
+  (let ([buf '()] [done #f])
+    (^[] (when (and (null? buf) (not done))
+           (set! buf (dbi-fetch-batch r n))
+           (when (null? buf) (set! done #t)))
+         (if (null? buf) (eof-object) (pop! buf)))))
+
+(define-method call-with-iterator ((r <dbi-streaming-result-set>) proc
+                                   . _)
+  (let* ([next-row (%batch-reader r (~ r'batch-size))]
+         [row (next-row)])
+    (proc (^[] (eof-object? row))
+          (^[] (begin0 row (set! row (next-row)))))))
+
+;; Returns a generator of rows of the result set R.  Streaming result
+;; sets are read BATCH-SIZE rows at a time; other result sets are
+;; just walked over.
+(define (dbi-result->generator r :optional (batch-size #f))
+  (if (is-a? r <dbi-streaming-result-set>)
+    (%batch-reader r (or batch-size (~ r'batch-size)))
+    (x->generator r)))
+
 ;;;===================================================================
 ;;; Low-level utilities
 ;;;
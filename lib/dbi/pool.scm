@@ -0,0 +1,152 @@
+;;;
+;;; dbi/pool.scm - connection pool for dbi
+;;;
+;;;   Copyright (c) 2015  Shiro Kawai  <shiro@acm.org>
+;;;
+;;;   Redistribution and use in source and binary forms, with or without
+;;;   modification, are permitted provided that the following conditions
+;;;   are met:
+;;;
+;;;   1. Redistributions of source code must retain the above copyright
+;;;      notice, this list of conditions and the following disclaimer.
+;;;
+;;;   2. Redistributions in binary form must reproduce the above copyright
+;;;      notice, this list of conditions and the following disclaimer in the
+;;;      documentation and/or other materials provided with the distribution.
+;;;
+;;;   3. Neither the name of the authors nor the names of its contributors
+;;;      may be used to endorse or promote products derived from this
+;;;      software without specific prior written permission.
+;;;
+;;;   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+;;;   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+;;;   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+;;;   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+;;;   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+;;;   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+;;;   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+;;;   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+;;;   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+;;;   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+;;;   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+;;;
+
+;; This is a separate module, since it needs gauche.threads, which is
+;; an extension module.  dbi autoloads it, so (use dbi) is enough to
+;; use the pool.
+
+(define-module dbi.pool
+  ;; dbi has autoload bindings of these; we define the real ones.
+  (use dbi :except (<dbi-connection-pool> make-dbi-connection-pool
+                    dbi-pool-acquire dbi-pool-release!
+                    call-with-dbi-connection))
+  (use gauche.threads)
+  (export <dbi-connection-pool> make-dbi-connection-pool
+          dbi-pool-acquire dbi-pool-release! call-with-dbi-connection))
+(select-module dbi.pool)
+
+;; A pool keeps up to MAX-IDLE idle connections to reuse, and allows
+;; up to MAX-CONNECTIONS connections at once, counting both idle ones
+;; and the ones in use.  It can be shared among threads.
+;;
+;; An idle connection is checked before being handed out: if it has
+;; been idle for more than IDLE-TIMEOUT seconds, or VALIDATOR returns
+;; #f (or raises an error) on it, it is closed and another one is
+;; tried.
+
+(define-class <dbi-connection-pool> ()
+  ((connector       :init-keyword :connector) ; thunk to make a connection
+   (max-connections :init-keyword :max-connections :init-value 8)
+   (max-idle        :init-keyword :max-idle :init-value 4)
+   (idle-timeout    :init-keyword :idle-timeout :init-value #f)
+   (validator       :init-keyword :validator :init-value dbi-open?)
+   ;; private
+   (mutex :init-form (make-mutex))
+   (cv    :init-form (make-condition-variable))
+   (idle  :init-value '())              ; list of (conn . released-time)
+   (count :init-value 0)                ; # of live connections
+   (closed :init-value #f)))
+
+;; ARGS may contain the keyword arguments of the pool; the rest is
+;; passed to dbi-connect.
+(define (make-dbi-connection-pool dsn . args)
+  (let-keywords args ([max-connections 8]
+                      [max-idle 4]
+                      [idle-timeout #f]
+                      [validator dbi-open?]
+                      . connect-args)
+    (make <dbi-connection-pool>
+      :connector (^[] (apply dbi-connect dsn connect-args))
+      :max-connections max-connections :max-idle max-idle
+      :idle-timeout idle-timeout :validator validator)))
+
+(define (%pool-now) (time->seconds (current-time)))
+
+(define (%pool-usable? pool entry)
+  (and (or (not (~ pool'idle-timeout))
+           (<= (- (%pool-now) (cdr entry)) (~ pool'idle-timeout)))
+       (guard (e [else #f]) ((~ pool'validator) (car entry)))))
+
+;; Closes CONN, which is counted in the pool.
+(define (%pool-discard! pool conn)
+  (guard (e [else #f]) (dbi-close conn))
+  (with-locking-mutex (~ pool'mutex)
+    (^[] (dec! (~ pool'count))
+         (condition-variable-signal! (~ pool'cv)))))
+
+;; Returns a connection, reusing an idle one if possible.  If the pool
+;; has already MAX-CONNECTIONS connections in use, waits until one is
+;; released; TIMEOUT limits the wait in seconds, and #f is returned when
+;; it expires.
+(define (dbi-pool-acquire pool :optional (timeout #f))
+  (define mutex (~ pool'mutex))
+  (define deadline
+    (and timeout (seconds->time (+ (%pool-now) timeout))))
+  (let loop ()
+    (mutex-lock! mutex)
+    (cond [(~ pool'closed)
+           (mutex-unlock! mutex)
+           (error <dbi-error> "connection pool is already closed:" pool)]
+          [(pair? (~ pool'idle))
+           (let1 entry (pop! (~ pool'idle))
+             (mutex-unlock! mutex)
+             (if (%pool-usable? pool entry)
+               (car entry)
+               (begin (%pool-discard! pool (car entry)) (loop))))]
+          [(< (~ pool'count) (~ pool'max-connections))
+           (inc! (~ pool'count))
+           (mutex-unlock! mutex)
+           (guard (e [else (%pool-discard! pool #f) (raise e)])
+             ((~ pool'connector)))]
+          [(mutex-unlock! mutex (~ pool'cv) deadline) (loop)]
+          [else #f])))
+
+;; Returns CONN, obtained by dbi-pool-acquire, back to POOL.
+(define (dbi-pool-release! pool conn)
+  (define mutex (~ pool'mutex))
+  (mutex-lock! mutex)
+  (if (or (~ pool'closed)
+          (>= (length (~ pool'idle)) (~ pool'max-idle)))
+    (begin (mutex-unlock! mutex)
+           (%pool-discard! pool conn))
+    (begin (push! (~ pool'idle) (cons conn (%pool-now)))
+           (condition-variable-signal! (~ pool'cv))
+           (mutex-unlock! mutex)))
+  (undefined))
+
+(define (call-with-dbi-connection pool proc)
+  (let1 conn (dbi-pool-acquire pool)
+    (unwind-protect (proc conn)
+      (dbi-pool-release! pool conn))))
+
+;; Closes the idle connections.  The ones in use are closed when
+;; they are released.
+(define-method dbi-close ((pool <dbi-connection-pool>))
+  (let1 idle (with-locking-mutex (~ pool'mutex)
+               (^[] (set! (~ pool'closed) #t)
+                    (condition-variable-broadcast! (~ pool'cv))
+                    (begin0 (~ pool'idle) (set! (~ pool'idle) '()))))
+    (dolist [entry idle] (%pool-discard! pool (car entry)))))
+
+(define-method dbi-open? ((pool <dbi-connection-pool>))
+  (not (~ pool'closed)))
@@ -0,0 +1,309 @@
+;;;
+;;; gauche/benchmark.scm - micro-benchmark harness
+;;;
+;;;   Copyright (c) 2015  Shiro Kawai  <shiro@acm.org>
+;;;
+;;;   Redistribution and use in source and binary forms, with or without
+;;;   modification, are permitted provided that the following conditions
+;;;   are met:
+;;;
+;;;   1. Redistributions of source code must retain the above copyright
+;;;      notice, this list of conditions and the following disclaimer.
+;;;
+;;;   2. Redistributions in binary form must reproduce the above copyright
+;;;      notice, this list of conditions and the following disclaimer in the
+;;;      documentation and/or other materials provided with the distribution.
+;;;
+;;;   3. Neither the name of the authors nor the names of its contributors
+;;;      may be used to endorse or promote products derived from this
+;;;      software without specific prior written permission.
+;;;
+;;;   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+;;;   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+;;;   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+;;;   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+;;;   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+;;;   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+;;;   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+;;;   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+;;;   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+;;;   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+;;;   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+;;;
+
+
+;; A micro-benchmark harness.  Unlike time-this in gauche.time, which
+;; runs the code a fixed number of times and reports the total, this
+;; takes a number of samples after calibrating the iteration count and
+;; warming up, rejects outliers, and reports the mean with a confidence
+;; interval, together with the allocation and the number of GCs
+;; per iteration.  The results can be written in JSON, so that they
+;; can be compared across runs by external tools.
+
+(define-module gauche.benchmark
+  (use gauche.record)
+  (use gauche.time)
+  (use util.match)
+  (export benchmark benchmarks benchmarks/report
+          <benchmark-result> benchmark-result?
+          benchmark-result-name benchmark-result-iterations
+          benchmark-result-samples benchmark-result-outliers
+          benchmark-result-mean benchmark-result-stddev
+          benchmark-result-median benchmark-result-min benchmark-result-max
+          benchmark-result-confidence
+          benchmark-result-ci-low benchmark-result-ci-high
+          benchmark-result-bytes benchmark-result-gcs
+          report-benchmark-results write-benchmark-results-json)
+  )
+(select-module gauche.benchmark)
+
+(autoload rfc.json construct-json)
+
+;; Result ---------------------------------------------
+
+;; All times are in seconds per iteration.
+(define-record-type <benchmark-result> %make-benchmark-result
+  benchmark-result?
+  (name        benchmark-result-name)        ;name given, or #f
+  (iterations  benchmark-result-iterations)  ;# of iterations per sample
+  (samples     benchmark-result-samples)     ;list of samples used
+  (outliers    benchmark-result-outliers)    ;# of rejected samples
+  (mean        benchmark-result-mean)
+  (stddev      benchmark-result-stddev)
+  (median      benchmark-result-median)
+  (min         benchmark-result-min)
+  (max         benchmark-result-max)
+  (confidence  benchmark-result-confidence)  ;e.g. 0.95
+  (ci-low      benchmark-result-ci-low)      ;confidence interval of mean
+  (ci-high     benchmark-result-ci-high)
+  (bytes       benchmark-result-bytes)       ;allocated bytes per iteration
+  (gcs         benchmark-result-gcs))        ;# of GCs per iteration
+
+(define-method write-object ((obj <benchmark-result>) port)
+  (format port "#<benchmark-result ~s ~a +-~a>"
+          (benchmark-result-name obj)
+          (format-time (benchmark-result-mean obj))
+          (format-time (- (benchmark-result-ci-high obj)
+                          (benchmark-result-mean obj)))))
+
+;; Measurement ----------------------------------------
+
+;; Returns the current time in seconds.  We prefer the monotonic clock,
+;; since the wall clock may be adjusted while we're measuring.
+(define current-seconds
+  (receive (s ns) (sys-clock-gettime-monotonic)
+    (if s
+      (^[] (receive (s ns) (sys-clock-gettime-monotonic) (+ s (* ns 1e-9))))
+      (^[] (receive (s us) (sys-gettimeofday) (+ s (* us 1e-6)))))))
+
+;; Returns # of GCs so far and total allocated bytes.
+(define (gc-counters)
+  (let1 stat (gc-stat)
+    (values (cadr (assq :gc-count stat)) (cadr (assq :total-bytes stat)))))
+
+;; Runs THUNK N times.  Returns elapsed seconds, # of GCs and allocated
+;; bytes.
+(define (run-sample thunk n)
+  (receive (gc0 bytes0) (gc-counters)
+    (let1 t0 (current-seconds)
+      (let loop ([i 0])
+        (when (< i n) (thunk) (loop (+ i 1))))
+      (let1 t1 (current-seconds)
+        (receive (gc1 bytes1) (gc-counters)
+          (values (- t1 t0) (- gc1 gc0) (- bytes1 bytes0)))))))
+
+(define (run-time thunk n) (values-ref (run-sample thunk n) 0))
+
+;; Finds the iteration count so that a sample takes at least SAMPLE-TIME.
+(define (calibrate thunk sample-time)
+  (let loop ([n 1])
+    (let1 t (run-time thunk n)
+      (cond [(>= t sample-time) n]
+            [(< t (/ sample-time 100)) (loop (* n 10))]
+            [else
+             (loop (max (+ n 1) (ceiling->exact (* n 1.1 (/ sample-time t)))))]
+            ))))
+
+;; Statistics -----------------------------------------
+
+;; P-th quantile of sorted vector V, with linear interpolation.
+(define (quantile v p)
+  (let* ([h (* (- (vector-length v) 1) p)]
+         [lo (floor->exact h)]
+         [hi (min (+ lo 1) (- (vector-length v) 1))])
+    (+ (vector-ref v lo)
+       (* (- h lo) (- (vector-ref v hi) (vector-ref v lo))))))
+
+;; Samples outside of Tukey's fences (1.5 IQR beyond the quartiles).
+(define (tukey-fences v)
+  (let* ([q1 (quantile v 0.25)]
+         [q3 (quantile v 0.75)]
+         [iqr (- q3 q1)])
+    (values (- q1 (* 1.5 iqr)) (+ q3 (* 1.5 iqr)))))
+
+;; Inverse of the standard normal CDF (P. J. Acklam's approximation;
+;; relative error is less than 1.2e-9).
+(define (normal-quantile p)
+  (define (poly cs x) (fold (^[c acc] (+ (* acc x) c)) 0 cs))
+  (define a '(-3.969683028665376e+01 2.209460984245205e+02
+              -2.759285104469687e+02 1.383577518672690e+02
+              -3.066479806614716e+01 2.506628277459239e+00))
+  (define b '(-5.447609879822406e+01 1.615858368580409e+02
+              -1.556989798598866e+02 6.680131188771972e+01
+              -1.328068155288572e+01 1.0))
+  (define c '(-7.784894002430293e-03 -3.223964580411365e-01
+              -2.400758277161838e+00 -2.549732539343734e+00
+              4.374664141464968e+00 2.938163982698783e+00))
+  (define d '(7.784695709041462e-03 3.224671290700398e-01
+              2.445134137142996e+00 3.754408661907416e+00 1.0))
+  (define (tail p)
+    (let1 q (sqrt (* -2 (log p)))
+      (/ (poly c q) (poly d q))))
+  (cond [(< p 0.02425) (tail p)]
+        [(> p 0.97575) (- (tail (- 1 p)))]
+        [else (let* ([q (- p 0.5)] [r (* q q)])
+                (/ (* (poly a r) q) (poly b r)))]))
+
+;; Quantile of Student's t distribution with DF degrees of freedom,
+;; by Cornish-Fisher expansion.  It's good to 3 digits for DF >= 4.
+(define (t-quantile p df)
+  (let* ([z (normal-quantile p)]
+         [z3 (* z z z)] [z5 (* z3 z z)] [z7 (* z5 z z)])
+    (+ z
+       (/ (+ z3 z) (* 4 df))
+       (/ (+ (* 5 z5) (* 16 z3) (* 3 z)) (* 96 df df))
+       (/ (+ (* 3 z7) (* 19 z5) (* 17 z3) (* -15 z)) (* 384 df df df)))))
+
+;; Benchmarking ---------------------------------------
+
+;; Keyword args:
+;;   name        - name of the benchmark, just recorded in the result.
+;;   samples     - # of samples to take.  At least 5.
+;;   sample-time - minimum seconds per sample; the iteration count is
+;;                 determined to fit it.
+;;   iterations  - # of iterations per sample.  If given, calibration is
+;;                 skipped and sample-time is ignored.
+;;   warmup      - # of samples to run and discard before measurement.
+;;   confidence  - confidence level of the interval.
+;;   reject-outliers - if true, samples outside of Tukey's fences are
+;;                 rejected.
+(define (benchmark thunk :key (name #f) (samples 30) (sample-time 0.01)
+                   (iterations #f) (warmup 3) (confidence 0.95)
+                   (reject-outliers #t))
+  (unless (and (exact-integer? samples) (>= samples 5))
+    (error "benchmark: samples must be an integer at least 5, but got:"
+           samples))
+  (unless (and (real? confidence) (< 0 confidence 1))
+    (error "benchmark: confidence must be a real number between 0 and 1, \
+            but got:" confidence))
+  (let* ([n (or iterations (calibrate thunk sample-time))]
+         [empty (^[] #f)])
+    (dotimes [_ warmup] (run-sample thunk n))
+    ;; The cost of the loop itself; we take the best of a few runs.
+    (receive (skin-time skin-bytes)
+        (let loop ([k 3] [t +inf.0] [b +inf.0])
+          (if (= k 0)
+            (values t b)
+            (receive (t1 _ b1) (run-sample empty n)
+              (loop (- k 1) (min t t1) (min b b1)))))
+      (gc)
+      (let loop ([k samples] [ts '()] [gcs 0] [bytes 0])
+        (if (> k 0)
+          (receive (t g b) (run-sample thunk n)
+            (loop (- k 1) (cons (/ (- t skin-time) n) ts)
+                  (+ gcs g) (+ bytes (max 0 (- b skin-bytes)))))
+          (summarize name n (reverse ts) confidence reject-outliers
+                     (/. bytes (* samples n)) (/. gcs (* samples n))))))))
+
+(define (summarize name n ts confidence reject-outliers bytes gcs)
+  (let*-values ([(lo hi) (if reject-outliers
+                           (tukey-fences (sort (list->vector ts)))
+                           (values -inf.0 +inf.0))]
+                [(xs) (filter (^x (<= lo x hi)) ts)]
+                [(v) (sort (list->vector xs))]
+                [(k) (length xs)]
+                [(mean) (/. (apply + xs) k)]
+                [(sd) (if (> k 1)
+                        (sqrt (/ (fold (^[x s] (+ s (square (- x mean)))) 0 xs)
+                                 (- k 1)))
+                        0.0)]
+                [(half) (if (> k 1)
+                          (* (t-quantile (/ (+ 1 confidence) 2) (- k 1))
+                             (/ sd (sqrt k)))
+                          +inf.0)])
+    (%make-benchmark-result name n xs (- (length ts) k)
+                            mean sd (quantile v 0.5)
+                            (vector-ref v 0) (vector-ref v (- k 1))
+                            confidence (- mean half) (+ mean half)
+                            bytes gcs)))
+
+;; benchmarks : ((name . thunk) ...)
+;; Returns a list of results.  Keyword args are passed to benchmark.
+(define (benchmarks alist . opts)
+  (map (^p (apply benchmark (cdr p) :name (car p) opts)) alist))
+
+(define (benchmarks/report alist . opts)
+  (rlet1 results (apply benchmarks alist opts)
+    (report-benchmark-results results)))
+
+;; Reporting ------------------------------------------
+
+;; share the helper of gauche.time
+(define (format-flonum val digs)
+  ((with-module gauche.time format-flonum) val 0 digs))
+
+;; Format seconds with a suitable unit.
+(define (format-time secs)
+  (cond [(not (finite? secs)) (x->string secs)]
+        [(< (abs secs) 1e-6) #"~(format-flonum (* secs 1e9) 2)ns"]
+        [(< (abs secs) 1e-3) #"~(format-flonum (* secs 1e6) 2)us"]
+        [(< (abs secs) 1)    #"~(format-flonum (* secs 1e3) 2)ms"]
+        [else                #"~(format-flonum secs 3)s"]))
+
+(define (report-benchmark-results results :optional (port (current-output-port)))
+  (define (name r) (x->string (or (benchmark-result-name r) "")))
+  (define nw (fold (^[r w] (max w (string-length (name r)))) 0 results))
+  (dolist [r results]
+    (let ([mean (benchmark-result-mean r)]
+          [half (- (benchmark-result-ci-high r) (benchmark-result-mean r))])
+      (format port "  ~v@a: ~10@a +-~a (~a%, ~a%CI)  median ~a  ~a\n"
+              nw (name r) (format-time mean) (format-time half)
+              (if (zero? mean) "-" (format-flonum (* 100 (/ half mean)) 1))
+              (round->exact (* 100 (benchmark-result-confidence r)))
+              (format-time (benchmark-result-median r))
+              (format "n=~dx~d~a"
+                      (length (benchmark-result-samples r))
+                      (benchmark-result-iterations r)
+                      (match (benchmark-result-outliers r)
+                        [0 ""]
+                        [k (format " (~d outliers)" k)])))
+      (format port "  ~v@a  ~a bytes, ~a GCs per iteration\n"
+              nw "" (format-flonum (benchmark-result-bytes r) 1)
+              (format-flonum (benchmark-result-gcs r) 4)))))
+
+;; JSON output.  Non-finite numbers can't be represented in JSON,
+;; so they're written as null.
+(define (write-benchmark-results-json results
+                                      :optional (port (current-output-port)))
+  (define (num x) (if (and (real? x) (finite? x)) x 'null))
+  (define (result->json r)
+    `(("name" . ,(cond [(benchmark-result-name r) => x->string]
+                       [else 'null]))
+      ("iterations" . ,(benchmark-result-iterations r))
+      ("samples" . ,(length (benchmark-result-samples r)))
+      ("outliers" . ,(benchmark-result-outliers r))
+      ("mean" . ,(num (benchmark-result-mean r)))
+      ("stddev" . ,(num (benchmark-result-stddev r)))
+      ("median" . ,(num (benchmark-result-median r)))
+      ("min" . ,(num (benchmark-result-min r)))
+      ("max" . ,(num (benchmark-result-max r)))
+      ("confidence" . ,(num (benchmark-result-confidence r)))
+      ("ci-low" . ,(num (benchmark-result-ci-low r)))
+      ("ci-high" . ,(num (benchmark-result-ci-high r)))
+      ("bytes-per-iteration" . ,(num (benchmark-result-bytes r)))
+      ("gcs-per-iteration" . ,(num (benchmark-result-gcs r)))))
+  (construct-json `(("gauche-version" . ,(gauche-version))
+                    ("timestamp" . ,(sys-time))
+                    ("benchmarks" . ,(list->vector (map result->json results))))
+                  port)
+  (newline port))
@@ -798,7 +798,8 @@
                     (~ self'value))]
       (format #t "     Scm_CharSetAddRange(cs, SCM_CHAR(~a), SCM_CHAR(~a));\n"
               (car range) (cdr range)))
-    (print "     "(cgen-c-name self)" = SCM_OBJ(cs);")
+    ;; literal char-sets are immutable, as the ones made by the reader
+    (print "     "(cgen-c-name self)" = Scm_CharSetFreeze(cs);")
     (print "  }"))
   (static (self) #f))
 
@@ -0,0 +1,858 @@
+;;;
+;;; gauche.cgen.native - Compile Scheme procedures into C functions
+;;;
+;;;   Copyright (c) 2015  Shiro Kawai  <shiro@acm.org>
+;;;
+;;;   Redistribution and use in source and binary forms, with or without
+;;;   modification, are permitted provided that the following conditions
+;;;   are met:
+;;;
+;;;   1. Redistributions of source code must retain the above copyright
+;;;      notice, this list of conditions and the following disclaimer.
+;;;
+;;;   2. Redistributions in binary form must reproduce the above copyright
+;;;      notice, this list of conditions and the following disclaimer in the
+;;;      documentation and/or other materials provided with the distribution.
+;;;
+;;;   3. Neither the name of the authors nor the names of its contributors
+;;;      may be used to endorse or promote products derived from this
+;;;      software without specific prior written permission.
+;;;
+;;;   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+;;;   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+;;;   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+;;;   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+;;;   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+;;;   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+;;;   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+;;;   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+;;;   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+;;;   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+;;;   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+;;;
+
+;; This is a part of precompiler (gauche.cgen.precomp) and to be autoloaded
+;; when necessary.  It handles define-native form, which compiles a Scheme
+;; procedure into a C function instead of VM code.
+;;
+;;   (define-native (name arg ...) [:: rettype] body ...)
+;;
+;;   arg     : var | var::<stubtype>
+;;   rettype : <fixnum> | <real> | <boolean> | <top>
+;;
+;; The body is translated into cise, then emitted as a static C function
+;; and a SUBR (define-cproc) that wraps it.  Values of <fixnum>, <real>
+;; and <boolean> are kept unboxed as C integers and doubles; arithmetic
+;; and comparison on them become C operators.  A call to a native
+;; procedure defined earlier in the same unit becomes a direct C call,
+;; and a tail call to itself or to a named let loop becomes a jump.
+;; Other calls go through Scm_ApplyRec.
+;;
+;; Only a subset of Scheme is supported in the body: quote, if, cond
+;; (without =>), when, unless, and, or, begin, let, let*, named let
+;; (only called in tail position), set! of local variables and
+;; procedure calls.  Local variables of let may have the var::<stubtype>
+;; annotation as well.  Other forms, including lambda, are rejected.
+;; Macros are not expanded.
+;;
+;; Internally each value has one of the following 'native types':
+;;   fix  - C ScmSmallInt, in the fixnum range
+;;   lng  - C ScmSmallInt, the result of fixnum addition/subtraction
+;;   dbl  - C double
+;;   bool - C int, as a truth value
+;;   obj  - ScmObj
+;; Integer arithmetic is only done in C when it can't overflow;
+;; Otherwise we fall back to the generic Scheme arithmetic, so the result
+;; is the same as the VM-compiled code.
+
+(define-module gauche.cgen.native
+  (use srfi-1)
+  (use srfi-13)
+  (use gauche.record)
+  (use gauche.cgen.unit)
+  (use gauche.cgen.stub)
+  (use gauche.cgen.type)
+  (use util.match)
+  (export native-compile-define))
+(select-module gauche.cgen.native)
+
+;;================================================================
+;; Types
+;;
+
+(define (stub-type->ntype stype)
+  (case stype
+    [(<fixnum>) 'fix]
+    [(<real> <double>) 'dbl]
+    [(<boolean>) 'bool]
+    [else
+     ;; Other types must be represented by ScmObj or a pointer to
+     ;; a Scheme object in C.
+     (let1 type (cgen-type-from-name stype)
+       (unless (and type (#/^Scm\w+(\*)?$/ (~ type'c-type)))
+         (error "define-native: unsupported type:" stype))
+       'obj)]))
+
+(define (ntype->ctype ntype)
+  (ecase ntype
+    [(fix lng) 'ScmSmallInt]
+    [(dbl)     'double]
+    [(bool)    'int]
+    [(obj)     'ScmObj]))
+
+(define (int-ntype? t) (memq t '(fix lng)))
+(define (num-ntype? t) (memq t '(fix lng dbl)))
+
+;; 'none is the type of a jump (tail call to a loop); it joins with anything.
+(define (join-ntype a b)
+  (cond [(eq? a 'none) b]
+        [(eq? b 'none) a]
+        [(eq? a b) a]
+        [(and (int-ntype? a) (int-ntype? b)) 'lng]
+        [else 'obj]))
+
+;; Returns cise expression to convert EXPR of type FROM to type TO.
+(define (coerce expr from to)
+  (define (side-effect-free? e) (or (symbol? e) (number? e)))
+  (define (mismatch) (errorf "define-native: can't convert ~a to ~a: ~s"
+                             from to expr))
+  (cond
+   [(or (eq? from to) (eq? from 'none)) expr]
+   [else
+    (ecase to
+      [(obj) (ecase from
+               [(fix)  `(SCM_MAKE_INT ,expr)]
+               [(lng)  `(Scm_MakeInteger ,expr)]
+               [(dbl)  `(Scm_MakeFlonum ,expr)]
+               [(bool) `(SCM_MAKE_BOOL ,expr)])]
+      [(bool) (if (eq? from 'obj)
+                `(not (SCM_FALSEP ,expr))
+                (if (side-effect-free? expr) 1 `(begin ,expr 1)))]
+      [(fix) (case from
+               [(obj) `(native_fixnum ,expr)]
+               [(lng) `(native_fixnum_fit ,expr)]
+               [else (mismatch)])]
+      [(lng) (case from
+               [(fix) expr]
+               [(obj) `(native_fixnum ,expr)]
+               [else (mismatch)])]
+      [(dbl) (case from
+               [(fix lng) `(cast double ,expr)]
+               [(obj) `(native_real ,expr)]
+               [else (mismatch)])])]))
+
+;;================================================================
+;; Compile-time environment
+;;
+
+;; Local variable
+(define-record-type <lvar> (make-lvar name cname ntype) lvar?
+  (name  lvar-name)
+  (cname lvar-cname)
+  (ntype lvar-ntype))
+
+;; Named let loop, or the procedure itself (for self tail calls).
+(define-record-type <loop> (make-loop name label lvars) loop?
+  (name   loop-name)
+  (label  loop-label)
+  (lvars  loop-lvars))
+
+;; Procedure compiled into C in the current unit.
+(define-record-type <nproc> (make-nproc name cname arg-ntypes ret-ntype) nproc?
+  (name       nproc-name)
+  (cname      nproc-cname)
+  (arg-ntypes nproc-arg-ntypes)
+  (ret-ntype  nproc-ret-ntype))
+
+;; Per-unit state
+(define-record-type <unit-state> (make-unit-state unit procs glocs) unit-state?
+  (unit  ustate-unit)
+  (procs ustate-procs)                  ;hash-table name -> nproc
+  (glocs ustate-glocs))                 ;hash-table name -> C variable name
+
+(define *state* #f)
+
+(define (current-state)
+  (unless (and *state* (eq? (ustate-unit *state*) (cgen-current-unit)))
+    (set! *state* (make-unit-state (cgen-current-unit)
+                                   (make-hash-table 'eq?)
+                                   (make-hash-table 'eq?)))
+    (emit-runtime-support))
+  *state*)
+
+;; Per-procedure state
+(define-record-type <ctx> (make-ctx module self decls) ctx?
+  (module ctx-module)                   ;module name
+  (self   ctx-self)                     ;nproc being compiled
+  (decls  ctx-decls ctx-decls-set!))    ;((cname . ctype) ...)
+
+(define *cname-counter* 0)
+
+(define (gen-cname base)
+  (inc! *cname-counter*)
+  (string->symbol
+   (format "n_~a_~a"
+           (regexp-replace-all #/[^A-Za-z0-9]/ (x->string base) "_")
+           *cname-counter*)))
+
+(define (new-var! ctx base ntype)
+  (rlet1 cname (gen-cname base)
+    (ctx-decls-set! ctx (acons cname (ntype->ctype ntype) (ctx-decls ctx)))))
+
+;; env is a list of lvars and loops, innermost first.
+(define (env-lookup env name)
+  (find (^b (eq? (if (lvar? b) (lvar-name b) (loop-name b)) name)) env))
+
+;; Is NAME not bound locally?
+(define (global? env name)
+  (and (symbol? name) (not (env-lookup env name))))
+
+;; Parse var or var::type
+(define (parse-typed-var v)
+  (let1 s (symbol->string v)
+    (if-let1 m (#/^(.+)::(.+)$/ s)
+      (values (string->symbol (m 1)) (string->symbol (m 2)))
+      (values v '<top>))))
+
+;;================================================================
+;; Type inference
+;;
+
+;; Returns the natural native type of the value of EXPR.  Must agree
+;; with compile-value.
+(define (infer expr env)
+  (match expr
+    [(? symbol?)
+     (let1 b (env-lookup env expr)
+       (if (lvar? b) (lvar-ntype b) 'obj))]
+    [('quote x) (literal-ntype x)]
+    [((? symbol? op) . args)
+     (let1 b (env-lookup env op)
+       (cond
+        [(loop? b) 'none]
+        [b 'obj]
+        [else (infer-form op args expr env)]))]
+    [(? pair?) 'obj]
+    [_ (literal-ntype expr)]))
+
+(define (infer-form op args expr env)
+  (case op
+    [(if) (match args
+            [(_ c a) (join-ntype (infer c env) (infer a env))]
+            [_ 'obj])]
+    [(begin) (if (null? args) 'obj (infer (last args) env))]
+    [(let let*)
+     (match args
+       [((? symbol? name) binds . body)
+        (infer (last body)
+               (cons (make-loop name #f '())
+                     (fold (^[b inner]
+                             (receive (v init) (binding-parts b)
+                               (receive (n stype) (parse-typed-var v)
+                                 (cons (make-lvar n #f (stub-type->ntype stype))
+                                       inner))))
+                           env binds)))]
+       [(binds . body)
+        (infer (last body)
+               (fold (^[b inner]
+                       (receive (v init) (binding-parts b)
+                         (cons (make-lvar (values-ref (parse-typed-var v) 0)
+                                          #f
+                                          (local-ntype v init body
+                                                       (if (eq? op 'let*)
+                                                         inner
+                                                         env)))
+                               inner)))
+                     env binds))]
+       [_ 'obj])]
+    [(cond) (let loop ([clauses args] [t 'none])
+              (match clauses
+                [() 'obj]
+                [(('else . body)) (join-ntype t (infer (last body) env))]
+                [((test . (? pair? body)) . rest)
+                 (loop rest (join-ntype t (infer (last body) env)))]
+                [_ 'obj]))]
+    [(and or) (if (and (pair? args)
+                       (every (^a (eq? (infer a env) 'bool)) args))
+                'bool
+                'obj)]
+    [(quote) (literal-ntype (car args))]
+    [else
+     (let1 types (map (cut infer <> env) args)
+       (cond [(hash-table-get (ustate-procs (current-state)) op #f)
+              => nproc-ret-ntype]
+             [(prim-applicable? op (length args) types)
+              (prim-ntype op types)]
+             [else 'obj]))]))
+
+(define *undef* `(quote ,(undefined)))
+
+(define (literal-ntype x)
+  (cond [(and (exact-integer? x) (fixnum? x)) 'fix]
+        [(and (flonum? x) (finite? x)) 'dbl]
+        [(boolean? x) 'bool]
+        [else 'obj]))
+
+(define (binding-parts b)
+  (match b
+    [((? symbol? v) init) (values v init)]
+    [_ (error "define-native: bad binding:" b)]))
+
+;; Type of a let-bound variable.  Annotated type if given.  Otherwise,
+;; we use the type of the initial value unless the variable is set!.
+(define (local-ntype v init body env)
+  (receive (name stype) (parse-typed-var v)
+    (cond [(not (eq? stype '<top>)) (stub-type->ntype stype)]
+          [(assigned? name body) 'obj]
+          [else (case (infer init env)
+                  [(none) 'obj]
+                  [else => identity])])))
+
+(define (assigned? name body)
+  (let walk ([x body])
+    (match x
+      [('set! (? (cut eq? name <>)) . _) #t]
+      [('quote _) #f]
+      [(? pair?) (or (walk (car x)) (walk (cdr x)))]
+      [_ #f])))
+
+;;================================================================
+;; Primitives
+;;
+
+(define *arith* '((+ . Scm_Add) (- . Scm_Sub) (* . Scm_Mul) (/ . Scm_Div)))
+(define *compare* '(= < > <= >=))
+(define *c-compare* '((= . ==) (< . <) (> . >) (<= . <=) (>= . >=)))
+(define *intdiv* '((quotient . native_quotient)
+                   (remainder . native_remainder)
+                   (modulo . native_modulo)))
+
+;; Result type of arithmetic step on two operands
+(define (arith-step-ntype op a b)
+  (cond [(and (memq op '(+ -)) (eq? a 'fix) (eq? b 'fix)) 'lng]
+        [(and (memq op '(+ - * /)) (num-ntype? a) (num-ntype? b)
+              (or (eq? a 'dbl) (eq? b 'dbl)))
+         'dbl]
+        [else 'obj]))
+
+;; Returns the result ntype if OP with the operand ntypes is a primitive
+;; we expand inline, #f otherwise.
+(define (prim-ntype op types)
+  (cond
+   [(assq op *arith*)
+    (match types
+      [() (if (memq op '(+ *)) 'fix #f)]
+      [(t) (if (and (memq op '(+ * -)) (memq t '(fix dbl)))
+             (if (eq? op '-) (if (eq? t 'dbl) 'dbl 'obj) t)
+             'obj)]
+      [(t . ts) (fold (^[b a] (arith-step-ntype op a b)) t ts)])]
+   [(memq op *compare*) (and (= (length types) 2) 'bool)]
+   [(memq op '(zero? positive? negative?)) (and (= (length types) 1) 'bool)]
+   [(assq op *intdiv*)
+    (and (= (length types) 2)
+         (if (every (cut eq? <> 'fix) types)
+           (if (eq? op 'quotient) 'lng 'fix)
+           #f))]
+   [(memq op '(not eq? eqv? equal? null? pair?)) 'bool]
+   [(memq op '(car cdr cons)) 'obj]
+   [else #f]))
+
+;; Arity of the primitives other than arithmetic
+(define *prim-arities*
+  '((not . 1) (eq? . 2) (eqv? . 2) (equal? . 2) (null? . 1) (pair? . 1)
+    (car . 1) (cdr . 1) (cons . 2)))
+
+;; Compile primitive OP applied to compiled operands CEXPRS of TYPES.
+;; Returns cise expr (the type is given by prim-ntype).
+(define (compile-prim op cexprs types)
+  (define (box e t) (coerce e t 'obj))
+  (define (c-arith op es ts)
+    (let loop ([e (car es)] [t (car ts)] [es (cdr es)] [ts (cdr ts)])
+      (if (null? es)
+        e
+        (let1 rt (arith-step-ntype op t (car ts))
+          (loop (if (eq? rt 'obj)
+                  `(,(cdr (assq op *arith*)) ,(box e t) ,(box (car es) (car ts)))
+                  `(,op ,(coerce e t rt) ,(coerce (car es) (car ts) rt)))
+                rt (cdr es) (cdr ts))))))
+  (cond
+   [(assq op *arith*)
+    (match cexprs
+      [() (if (eq? op '+) 0 1)]
+      [(e) (let1 t (car types)
+             (case op
+               [(+ *) (if (memq t '(fix dbl))
+                        e
+                        `(,(cdr (assq op *arith*)) ,(box e t)
+                          (SCM_MAKE_INT ,(if (eq? op '+) 0 1))))]
+               [(-) (if (eq? t 'dbl) `(- ,e) `(Scm_Negate ,(box e t)))]
+               [(/) `(Scm_Reciprocal ,(box e t))]))]
+      [_ (c-arith op cexprs types)])]
+   [(memq op *compare*)
+    (match-let ([(a b) cexprs] [(ta tb) types])
+      (let1 cop (cdr (assq op *c-compare*))
+        (cond [(and (int-ntype? ta) (int-ntype? tb)) `(,cop ,a ,b)]
+              [(and (eq? ta 'dbl) (eq? tb 'dbl)) `(,cop ,a ,b)]
+              [else `(,cop (Scm_NumCmp ,(box a ta) ,(box b tb)) 0)])))]
+   [(memq op '(zero? positive? negative?))
+    (let ([e (car cexprs)] [t (car types)]
+          [cop (case op [(zero?) '==] [(positive?) '>] [else '<])])
+      (if (num-ntype? t)
+        `(,cop ,e 0)
+        `(,cop (Scm_Sign ,(box e t)) 0)))]
+   [(assq op *intdiv*) => (^p `(,(cdr p) ,@cexprs))]
+   [else
+    (let1 os (map box cexprs types)
+      (case op
+        [(not)    `(SCM_FALSEP ,@os)]
+        [(eq?)    `(SCM_EQ ,@os)]
+        [(eqv?)   `(Scm_EqvP ,@os)]
+        [(equal?) `(Scm_EqualP ,@os)]
+        [(null?)  `(SCM_NULLP ,@os)]
+        [(pair?)  `(SCM_PAIRP ,@os)]
+        [(car)    `(Scm_Car ,@os)]
+        [(cdr)    `(Scm_Cdr ,@os)]
+        [(cons)   `(Scm_Cons ,@os)]))]))
+
+(define (prim-applicable? op nargs types)
+  (and (prim-ntype op types)
+       (if-let1 a (assq op *prim-arities*)
+         (= (cdr a) nargs)
+         #t)))
+
+;;================================================================
+;; Compiler
+;;
+
+;; Destination of the value of a statement:
+;;   (return ntype)    - return from the C function
+;;   (set cname ntype) - assign to the C variable
+;;   (effect)          - discard
+;;
+;; TAILS is a list of loops we can jump to from the current position.
+
+(define (unsupported form)
+  (error "define-native: unsupported form:" form))
+
+;; Compile EXPR into a list of cise statements that deliver its value
+;; to DEST.
+(define (compile-stmt expr env dest tails ctx)
+  (define (deliver stmts cexpr ntype)
+    (match dest
+      [('return t) `(,@stmts (return ,(coerce cexpr ntype t)))]
+      [('set cname t) `(,@stmts (set! ,cname ,(coerce cexpr ntype t)))]
+      [('effect) (if (or (symbol? cexpr) (number? cexpr) (string? cexpr))
+                   stmts
+                   `(,@stmts ,cexpr))]))
+  (define (rec e) (compile-stmt e env dest tails ctx))
+  (define (value e)
+    (receive (stmts cexpr ntype) (compile-value e env ctx)
+      (deliver stmts cexpr ntype)))
+
+  (match expr
+    [((? (cut global? env <>) op) . args)
+     (case op
+       [(if)
+        (match args
+          [(test then . maybe-else)
+           (receive (stmts c) (compile-test test env ctx)
+             `(,@stmts
+               (if ,c
+                 (begin ,@(rec then))
+                 (begin ,@(match maybe-else
+                            [() (if (equal? dest '(effect))
+                                  '()
+                                  (value *undef*))]
+                            [(alt) (rec alt)]
+                            [_ (unsupported expr)])))))]
+          [_ (unsupported expr)])]
+       [(when)
+        (match args
+          [(test . body) (rec `(if ,test (begin ,@body)))]
+          [_ (unsupported expr)])]
+       [(unless)
+        (match args
+          [(test . body) (rec `(if (not ,test) (begin ,@body)))]
+          [_ (unsupported expr)])]
+       [(cond) (rec (expand-cond args expr))]
+       [(and)
+        (match args
+          [() (value #t)]
+          [(x) (rec x)]
+          [(x . xs) (rec `(if ,x (and ,@xs) #f))])]
+       [(or)
+        (match args
+          [() (value #f)]
+          [(x) (rec x)]
+          [(x . xs)
+           (let1 tmp (gensym "or")
+             (rec `(let ([,tmp ,x]) (if ,tmp ,tmp (or ,@xs)))))])]
+       [(begin)
+        (if (null? args)
+          (value *undef*)
+          `(,@(append-map (cut compile-stmt <> env '(effect) '() ctx)
+                          (drop-right args 1))
+            ,@(rec (last args))))]
+       [(let)
+        (match args
+          [((? symbol? name) binds . body)
+           (compile-named-let name binds body env dest tails ctx)]
+          [(binds . body) (compile-let binds body env dest tails ctx #f)]
+          [_ (unsupported expr)])]
+       [(let*)
+        (match args
+          [(binds . body) (compile-let binds body env dest tails ctx #t)]
+          [_ (unsupported expr)])]
+       [(set!)
+        (match args
+          [((? symbol? v) e)
+           (let1 b (env-lookup env v)
+             (unless (lvar? b) (unsupported expr))
+             `(,@(compile-stmt e env `(set ,(lvar-cname b) ,(lvar-ntype b))
+                               '() ctx)
+               ,@(if (equal? dest '(effect))
+                   '()
+                   (value *undef*))))]
+          [_ (unsupported expr)])]
+       [else
+        ;; self tail call
+        (if-let1 lp (and (eq? op (nproc-name (ctx-self ctx)))
+                         (find (^l (eq? (loop-name l) op)) tails))
+          (compile-jump lp args env ctx)
+          (value expr))])]
+    [((? symbol? op) . args)
+     (let1 b (env-lookup env op)
+       (cond
+        [(loop? b)
+         (unless (memq b tails)
+           (error "define-native: named let loop must be called in \
+                   tail position:" expr))
+         (compile-jump b args env ctx)]
+        [else (value expr)]))]
+    [_ (value expr)]))
+
+(define (expand-cond clauses form)
+  (match clauses
+    [() *undef*]
+    [(('else . body)) `(begin ,@body)]
+    [((test) . rest) `(or ,test ,(expand-cond rest form))]
+    [((test '=> . _) . rest) (unsupported form)]
+    [((test . body) . rest) `(if ,test (begin ,@body)
+                                 ,(expand-cond rest form))]
+    [_ (unsupported form)]))
+
+;; let and let*.
+(define (compile-let binds body env dest tails ctx sequential?)
+  (let loop ([binds binds] [inner env] [stmts '()])
+    (match binds
+      [()
+       `(,@stmts
+         ,@(compile-stmt `(begin ,@body) inner dest tails ctx))]
+      [(b . rest)
+       (receive (v init) (binding-parts b)
+         (let* ([init-env (if sequential? inner env)]
+                [name (values-ref (parse-typed-var v) 0)]
+                [t (local-ntype v init body init-env)]
+                [cname (new-var! ctx name t)])
+           (loop rest
+                 (cons (make-lvar name cname t) inner)
+                 `(,@stmts
+                   ,@(compile-stmt init init-env `(set ,cname ,t) '() ctx)))))]
+      [_ (unsupported binds)])))
+
+;; Named let.  Loop variables are typed by annotation, or ScmObj.
+(define (compile-named-let name binds body env dest tails ctx)
+  (let* ([vars (map (^b (receive (v init) (binding-parts b)
+                          (receive (n stype) (parse-typed-var v)
+                            (let1 t (stub-type->ntype stype)
+                              (make-lvar n (new-var! ctx n t) t)))))
+                    binds)]
+         [lp (make-loop name (gen-cname name) vars)]
+         [inner (cons lp (append (reverse vars) env))])
+    `(,@(append-map (^[b v]
+                      (compile-stmt (cadr b) env
+                                    `(set ,(lvar-cname v) ,(lvar-ntype v))
+                                    '() ctx))
+                    binds vars)
+      ,@(with-label lp (compile-stmt `(begin ,@body) inner dest
+                                     (cons lp tails) ctx)))))
+
+;; Prepend the label of the loop LP to STMTS, if it is used.
+(define (with-label lp stmts)
+  (define goto `(goto ,(loop-label lp)))
+  (if (let search ([x stmts])
+        (or (equal? x goto)
+            (and (pair? x) (or (search (car x)) (search (cdr x))))))
+    `((label ,(loop-label lp)) ,@stmts)
+    stmts))
+
+;; Jump to the loop LP with new values ARGS.  The new values are computed
+;; into temporaries first, for they may refer to the current values.
+(define (compile-jump lp args env ctx)
+  (let1 vars (loop-lvars lp)
+    (unless (= (length args) (length vars))
+      (errorf "define-native: wrong number of arguments to ~a: ~s"
+              (loop-name lp) args))
+    (receive (stmts cexprs)
+        (compile-args args (map lvar-ntype vars) env ctx #t)
+      `(,@stmts
+        ,@(map (^[v e] `(set! ,(lvar-cname v) ,e)) vars cexprs)
+        (goto ,(loop-label lp))))))
+
+;; Compile ARGS to be converted to NTYPES.  Returns statements and
+;; cise expressions.  If TEMP? is true, or an argument needs statements
+;; to compute, each value is saved in a temporary variable to keep the
+;; evaluation order.
+(define (compile-args args ntypes env ctx temp?)
+  (let loop ([args args] [ntypes ntypes] [stmts '()] [es '()])
+    (if (null? args)
+      (values stmts (reverse es))
+      (receive (ss e t) (compile-value (car args) env ctx)
+        (let1 e (coerce e t (car ntypes))
+          (if (or temp? (pair? ss) (pair? stmts))
+            (let1 tmp (new-var! ctx 'arg (car ntypes))
+              (loop (cdr args) (cdr ntypes)
+                    `(,@stmts ,@ss (set! ,tmp ,e))
+                    (cons tmp es)))
+            (loop (cdr args) (cdr ntypes) stmts (cons e es))))))))
+
+;; Compile EXPR appearing in the operand position.
+;; Returns (values stmts cise-expr ntype).
+(define (compile-value expr env ctx)
+  (define (complex)
+    (let* ([t (infer expr env)]
+           [t (if (eq? t 'none) 'obj t)]
+           [tmp (new-var! ctx 'tmp t)])
+      (values (compile-stmt expr env `(set ,tmp ,t) '() ctx) tmp t)))
+  (match expr
+    [(? symbol?)
+     (let1 b (env-lookup env expr)
+       (cond [(lvar? b) (values '() (lvar-cname b) (lvar-ntype b))]
+             [(loop? b) (error "define-native: loop can't be used as a \
+                                value:" expr)]
+             [else (values '() (gref expr ctx) 'obj)]))]
+    [('quote x) (compile-literal x)]
+    [((? symbol? op) . args)
+     (let1 b (env-lookup env op)
+       (cond
+        [(loop? b) (error "define-native: named let loop must be called \
+                           in tail position:" expr)]
+        [(lvar? b) (compile-call (lvar-cname b) args env ctx)]
+        [(memq op '(if when unless cond and or begin let let* set!))
+         (complex)]
+        [(memq op '(lambda define define-values receive case do =>))
+         (unsupported expr)]
+        [else (compile-global-call op args expr env ctx)]))]
+    [(? pair?) (unsupported expr)]
+    [_ (compile-literal expr)]))
+
+(define (compile-literal x)
+  (case (literal-ntype x)
+    [(fix) (values '() x 'fix)]
+    [(dbl) (values '() (list (number->string x)) 'dbl)]
+    [(bool) (values '() (if x 1 0) 'bool)]
+    [else (values '()
+                  (cond [(null? x) 'SCM_NIL]
+                        [(undefined? x) 'SCM_UNDEFINED]
+                        [else `(quote ,x)])
+                  'obj)]))
+
+;; Compile a test expression; returns (values stmts cise-expr) where
+;; cise-expr is a C truth value.
+(define (compile-test expr env ctx)
+  (match expr
+    [('not x)
+     (=> fail)
+     (if (global? env 'not)
+       (receive (s c) (compile-test x env ctx) (values s `(not ,c)))
+       (fail))]
+    [((and (or 'and 'or) op) . args)
+     (=> fail)
+     (if (and (global? env op) (pair? args))
+       (let1 parts (map (^a (receive (s c) (compile-test a env ctx)
+                              (cons s c)))
+                        args)
+         ;; We can use C && and || only if no operand but the first
+         ;; needs statements.
+         (if (every (^p (null? (car p))) (cdr parts))
+           (values (car (car parts)) `(,op ,@(map cdr parts)))
+           (fail)))
+       (fail))]
+    [_ (receive (s c t) (compile-value expr env ctx)
+         (values s (coerce c t 'bool)))]))
+
+;; Call of a procedure in a local variable.
+(define (compile-call pexpr args env ctx)
+  (receive (stmts es) (compile-args args (map (^_ 'obj) args) env ctx #f)
+    (values stmts (apply-rec pexpr es) 'obj)))
+
+(define (apply-rec proc-expr args)
+  (if (<= (length args) 5)
+    `(,(string->symbol #"Scm_ApplyRec~(length args)") ,proc-expr ,@args)
+    `(Scm_ApplyRec ,proc-expr (Scm_List ,@args NULL))))
+
+(define (compile-global-call op args form env ctx)
+  (let1 procs (ustate-procs (current-state))
+    (define (direct np)
+      (unless (= (length args) (length (nproc-arg-ntypes np)))
+        (errorf "define-native: wrong number of arguments to ~a: ~s"
+                op form))
+      (receive (stmts es)
+          (compile-args args (nproc-arg-ntypes np) env ctx #f)
+        (values stmts `(,(nproc-cname np) ,@es) (nproc-ret-ntype np))))
+    (cond
+     [(hash-table-get procs op #f) => direct]
+     [else
+      (let1 evals (map (^a (receive (s c t) (compile-value a env ctx)
+                             (list s c t)))
+                       args)
+        (let ([types (map caddr evals)]
+              [no-stmts? (every (^e (null? (car e))) evals)])
+          (if (and no-stmts? (prim-applicable? op (length args) types))
+            (values '() (compile-prim op (map cadr evals) types)
+                    (prim-ntype op types))
+            ;; Operands with statements: save them into temporaries
+            (receive (stmts es)
+                (let loop ([evals evals] [stmts '()] [es '()])
+                  (match evals
+                    [() (values stmts (reverse es))]
+                    [((s c t) . rest)
+                     (if (or (pair? s) (and (not no-stmts?) (pair? rest)))
+                       (let1 tmp (new-var! ctx 'arg t)
+                         (loop rest `(,@stmts ,@s (set! ,tmp ,c))
+                               (cons tmp es)))
+                       (loop rest stmts (cons c es)))]))
+              (if (prim-applicable? op (length args) types)
+                (values stmts (compile-prim op es types)
+                        (prim-ntype op types))
+                (values stmts
+                        (apply-rec (gref op ctx)
+                                   (map (cut coerce <> <> 'obj) es types))
+                        'obj))))))])))
+
+;; Reference to a global variable.  The gloc is looked up at the first
+;; reference and cached.
+(define (gref name ctx)
+  (let* ([glocs (ustate-glocs (current-state))]
+         [var (or (hash-table-get glocs name #f)
+                  (rlet1 v (gen-cname #"gloc_~name")
+                    (cgen-body #"static ScmGloc *~v = NULL;")
+                    (hash-table-put! glocs name v)))])
+    `(native_gref (& ,var) (quote ,(ctx-module ctx)) (quote ,name))))
+
+;;================================================================
+;; Runtime support
+;;
+
+(define (emit-runtime-support)
+  (cgen-body "
+static ScmObj native_gref(ScmGloc **g, ScmObj mod, ScmObj sym)
+{
+    ScmObj v;
+    if (*g == NULL) {
+        ScmModule *m = Scm_FindModule(SCM_SYMBOL(mod), 0);
+        ScmGloc *gloc = Scm_FindBinding(m, SCM_SYMBOL(sym), 0);
+        if (gloc == NULL) Scm_Error(\"unbound variable: %S\", sym);
+        *g = gloc;
+    }
+    v = SCM_GLOC_GET(*g);
+    if (SCM_UNBOUNDP(v)) Scm_Error(\"unbound variable: %S\", sym);
+    return v;
+}
+
+static ScmSmallInt native_fixnum(ScmObj obj)
+{
+    if (!SCM_INTP(obj)) Scm_Error(\"fixnum required, but got %S\", obj);
+    return SCM_INT_VALUE(obj);
+}
+
+static ScmSmallInt native_fixnum_fit(ScmSmallInt v)
+{
+    if (!SCM_SMALL_INT_FITS(v)) {
+        Scm_Error(\"fixnum required, but got %S\", Scm_MakeInteger(v));
+    }
+    return v;
+}
+
+static double native_real(ScmObj obj)
+{
+    if (!SCM_REALP(obj)) Scm_Error(\"real number required, but got %S\", obj);
+    return Scm_GetDouble(obj);
+}
+
+static ScmSmallInt native_quotient(ScmSmallInt x, ScmSmallInt y)
+{
+    if (y == 0) Scm_Error(\"attempt to calculate a quotient by zero\");
+    return x / y;
+}
+
+static ScmSmallInt native_remainder(ScmSmallInt x, ScmSmallInt y)
+{
+    if (y == 0) Scm_Error(\"attempt to calculate a remainder by zero\");
+    return x % y;
+}
+
+static ScmSmallInt native_modulo(ScmSmallInt x, ScmSmallInt y)
+{
+    ScmSmallInt r;
+    if (y == 0) Scm_Error(\"attempt to calculate a modulo by zero\");
+    r = x % y;
+    if (r != 0 && ((r < 0) != (y < 0))) r += y;
+    return r;
+}
+"))
+
+;;================================================================
+;; Entry point
+;;
+
+;; FORM is the cdr of define-native form.  MODULE is the name of the
+;; module the procedure is defined in.  Generates C function and
+;; the wrapping SUBR into the current unit.
+(define (native-compile-define form module)
+  (match form
+    [((name . args) . rest)
+     (receive (rettype body)
+         (match rest
+           [(':: (? symbol? t) . body) (values t body)]
+           [((? keyword? k) . body)
+            (=> fail)
+            (if-let1 m (#/^:(<.*>)$/ (keyword->string k))
+              (values (string->symbol (m 1)) body)
+              (fail))]
+           [body (values '<top> body)])
+       (unless (memq rettype '(<fixnum> <real> <boolean> <top>))
+         (error "define-native: unsupported return type:" rettype))
+       (current-state)
+       (let* ([params (map (^a (receive (v stype) (parse-typed-var a)
+                                 (list v stype (stub-type->ntype stype))))
+                           args)]
+              [cname (gen-cname name)]
+              [ret (stub-type->ntype rettype)]
+              [np (make-nproc name cname (map caddr params) ret)]
+              [lvars (map (^p (make-lvar (car p) (gen-cname (car p)) (caddr p)))
+                          params)]
+              [top (make-loop name (gen-cname 'top) lvars)]
+              [ctx (make-ctx module np '())])
+         ;; Register first, so that the body can call itself directly.
+         (hash-table-put! (ustate-procs (current-state)) name np)
+         (let1 stmts (compile-stmt `(begin ,@body) (reverse lvars)
+                                   `(return ,ret) (list top) ctx)
+           (cgen-stub-parse-form
+            `(define-cfn ,cname
+               ,(map (^v (string->symbol
+                          #"~(lvar-cname v)::~(ntype->ctype (lvar-ntype v))"))
+                     lvars)
+               :: ,(ntype->ctype ret) :static
+               (let* ,(map (^d `(,(car d) :: ,(cdr d)))
+                           (reverse (ctx-decls ctx)))
+                 ,@(with-label top stmts)))))
+         (cgen-stub-parse-form
+          `(define-cproc ,name
+             ,(map (^p (string->symbol #"~(car p)::~(cadr p)")) params)
+             :: ,rettype
+             (return (,cname ,@(map (^p (if (eq? (caddr p) 'obj)
+                                          `(SCM_OBJ ,(car p))
+                                          (car p)))
+                                    params)))))))]
+    [_ (error "malformed define-native:" (cons 'define-native form))]))
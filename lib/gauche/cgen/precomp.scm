@@ -52,6 +52,7 @@
 (select-module gauche.cgen.precomp)
 
 (autoload gauche.cgen.optimizer optimize-compiled-code)
+(autoload gauche.cgen.native native-compile-define)
 
 ;;================================================================
 ;; Main Entry point
@@ -612,6 +613,11 @@
       ((with-module gauche.cgen.stub cgen-stub-parse-form)
        (unwrap-syntax (cons 'define-enum-conditionally args)))
       (undefined))
+    ;; Compiles a procedure into C instead of VM code.
+    ;; See gauche.cgen.native for the details.
+    (define-macro (define-native . f)
+      ((with-module gauche.cgen.precomp handle-define-native) f)
+      (undefined))
     (define-macro (define-constant . f)
       ((with-module gauche.cgen.precomp handle-define-constant) f))
     (define-macro (define-syntax . f)
@@ -693,6 +699,9 @@
     [_ #f])
   (cons '(with-module gauche define-constant) form))
 
+(define (handle-define-native form)
+  (native-compile-define (unwrap-syntax form) (~ (current-tmodule)'name)))
+
 (define (handle-without-compiling forms)
   (for-each write-ext-module forms))
 
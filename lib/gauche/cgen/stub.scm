@@ -117,6 +117,11 @@
 ;;               NB: Since this procedure may be called at compile time,
 ;;               a subr that may return a different value for batch/cross
 ;;               compilation shouldn't have this flag.
+;;        :leaf          - indicates that this SUBR never passes control
+;;               to the VM (e.g. by Scm_VMApply) and returns its result
+;;               directly.  C code calling it via Scm_ApplyRec can then
+;;               skip the VM re-entry.  Calling back to Scheme via
+;;               Scm_ApplyRec inside the SUBR is fine.
 ;;
 ;;      <Qual> (qualifier) is a list to adds auxiliary information to the
 ;;      SUBR.  Currently the following <quals> are officially supported.
@@ -552,7 +557,7 @@
       ;; for C++ functions that may throw an exception.
    (flags             :initform '() :init-keyword :flags)
       ;; list of keywords to modify code generation.  currently
-      ;; :fast-flonum and :constant are supported.
+      ;; :fast-flonum, :constant and :leaf are supported.
    (forward-decls     :initform '())
       ;; list of strings for code that must be emitted before the
       ;; procedure definition
@@ -611,6 +616,18 @@
    (proc-name    :init-keyword :proc-name)  ; string literal
    ))
 
+;; Whether we bind the cproc with Scm_MakeLazyBinding.  The symbol and
+;; the gloc are created when the name is first looked up.  The name is
+;; passed as a C string, so we can't do it if it contains NUL.
+(define (cproc-lazy-binding? cproc)
+  (and-let* ([name (~ cproc'scheme-name)]
+             [ (symbol? name) ])
+    (not (string-index (symbol->string name) #\null))))
+
+(define (cproc-binding-flags cproc)
+  (if (or (~ cproc'inline-insn) (memq :constant (~ cproc'flags)))
+    "SCM_BINDING_INLINABLE" "0"))
+
 (define-form-parser define-cproc (scheme-name argspec . body)
   (define (check-fast-flonum cproc args)
     ;; if every arg has a type other than <top> or <number>,
@@ -624,7 +641,7 @@
         (push! (~ cproc'flags) :fast-flonum))))
   (define (extract-flags body)
     (receive (flags body) (span keyword? body)
-      (unless (every (cut memq <> '(:fast-flonum :constant)) flags)
+      (unless (every (cut memq <> '(:fast-flonum :constant :leaf)) flags)
         (error "Invalid cproc flag in " flags))
       (values flags body)))
 
@@ -1127,28 +1144,41 @@
       (if (memq :constant flags) (display "1, ") (display "0, ")))
     (format #t "SCM_FALSE,")                          ; info - to be set in init
     (unless (null? flags)                             ; flags
-      (if (memq :fast-flonum flags)
-        (display "SCM_SUBR_IMMEDIATE_ARG, ")
-        (display "0, ")))
+      (display (cond [(and (memq :fast-flonum flags) (memq :leaf flags))
+                      "SCM_SUBR_IMMEDIATE_ARG|SCM_SUBR_LEAF, "]
+                     [(memq :fast-flonum flags) "SCM_SUBR_IMMEDIATE_ARG, "]
+                     [(memq :leaf flags) "SCM_SUBR_LEAF, "]
+                     [else "0, "])))
     (format #t "~a, ~a, NULL);\n"
             (~ cproc'c-name)                          ; func
             (cond [(~ cproc'inline-insn)
                    => (^i (format "SCM_MAKE_INT(SCM_VM_~a)"
                                   (string-tr (x->string i) "-" "_")))]
                   [else "NULL"])))                    ; inliner
+  (when (cproc-lazy-binding? cproc)
+    (f "static ScmLazyBinding ~a_BINDING = SCM_LAZY_BINDING_INITIALIZER(~a, SCM_OBJ(&~a), ~a);"
+       (c-stub-name cproc)
+       (cgen-safe-string (symbol->string (~ cproc'scheme-name)))
+       (c-stub-name cproc)
+       (cproc-binding-flags cproc)))
   (p))
 
 (define-method cgen-emit-body ((cproc <cproc>))
+  ;; Arguments are fetched directly from SCM_FP into the ScmObj variables
+  ;; before the body runs, so we don't need to copy them, except for
+  ;; :optarray whose C array must outlive the VM stack frame.
+  (define arg-array-size (+ (length (~ cproc'args))
+                            (~ cproc'num-optargs)
+                            (if (null? (~ cproc'keyword-args)) 0 -1)))
+  (define need-array? (and (positive? arg-array-size)
+                           (any (cut is-a? <> <optarray-arg>) (~ cproc'args))))
   (p "static ScmObj "(~ cproc'c-name)"(ScmObj *SCM_FP, int SCM_ARGCNT, void *data_)")
   (p "{")
   ;; argument decl
   (for-each emit-arg-decl (~ cproc'args))
   (for-each emit-arg-decl (~ cproc'keyword-args))
-  (let1 arg-array-size (+ (length (~ cproc'args))
-                          (~ cproc'num-optargs)
-                          (if (null? (~ cproc'keyword-args)) 0 -1))
-    (unless (zero? arg-array-size)
-      (p "  ScmObj SCM_SUBRARGS["arg-array-size"];")))
+  (when need-array?
+    (p "  ScmObj SCM_SUBRARGS["arg-array-size"];"))
   (unless (null? (~ cproc'keyword-args))
     (p "  ScmObj SCM_OPTARGS = SCM_ARGREF(SCM_ARGCNT-1);"))
   (p "  SCM_ENTER_SUBR(\""(~ cproc'scheme-name)"\");")
@@ -1163,12 +1193,10 @@
        " is expected, %d given.\", "
        "SCM_ARGCNT + Scm_Length(SCM_ARGREF(SCM_ARGCNT-1)) - 1);"))
   ;; argument assertions & unbox op.
-  (let1 k (+ (length (~ cproc'args)) (~ cproc'num-optargs)
-             (if (null? (~ cproc'keyword-args)) 0 -1))
-    (unless (zero? k)
-      (p "  for (int SCM_i=0; SCM_i<"k"; SCM_i++) {")
-      (p "    SCM_SUBRARGS[SCM_i] = SCM_ARGREF(SCM_i);")
-      (p "  }")))
+  (when need-array?
+    (p "  for (int SCM_i=0; SCM_i<"arg-array-size"; SCM_i++) {")
+    (p "    SCM_SUBRARGS[SCM_i] = SCM_ARGREF(SCM_i);")
+    (p "  }"))
   (for-each emit-arg-unbox (~ cproc'args))
   (unless (null? (~ cproc'keyword-args))
     (emit-keyword-args-unbox cproc))
@@ -1190,13 +1218,15 @@
   (p))
 
 (define-method cgen-emit-init ((cproc <cproc>))
-  (when (symbol? (~ cproc'scheme-name))
-    (f "  Scm_MakeBinding(SCM_MODULE(~a), SCM_SYMBOL(SCM_INTERN(~s)), SCM_OBJ(&~a), ~a);"
-       (stub-tmodule-cname cproc)
-       (symbol->string (~ cproc'scheme-name))
-       (c-stub-name cproc)
-       (if (or (~ cproc'inline-insn) (memq :constant (~ cproc'flags)))
-         "SCM_BINDING_INLINABLE" "0")))
+  (cond [(cproc-lazy-binding? cproc)
+         (f "  Scm_MakeLazyBinding(SCM_MODULE(~a), &~a_BINDING);"
+            (stub-tmodule-cname cproc) (c-stub-name cproc))]
+        [(symbol? (~ cproc'scheme-name))
+         (f "  Scm_MakeBinding(SCM_MODULE(~a), SCM_SYMBOL(SCM_INTERN(~s)), SCM_OBJ(&~a), ~a);"
+            (stub-tmodule-cname cproc)
+            (symbol->string (~ cproc'scheme-name))
+            (c-stub-name cproc)
+            (cproc-binding-flags cproc))])
   (when (~ cproc'info)
     (f "  ~a.common.info = ~a;"
        (c-stub-name cproc) (cgen-c-name (~ cproc'info))))
@@ -1241,19 +1271,19 @@
       (p "  "(~ arg'c-name)" = "(~ arg'scm-name)";"))))
 
 (define-method emit-arg-unbox ((arg <required-arg>))
-  (p "  "(~ arg'scm-name)" = SCM_SUBRARGS["(~ arg'count)"];")
+  (p "  "(~ arg'scm-name)" = SCM_ARGREF("(~ arg'count)");")
   (emit-arg-unbox-rec arg))
 
 (define-method emit-arg-unbox ((arg <optional-arg>))
   (p "  if (SCM_ARGCNT > "(~ arg'count)"+1) {")
-  (p "    "(~ arg'scm-name)" = SCM_SUBRARGS["(~ arg'count)"];")
+  (p "    "(~ arg'scm-name)" = SCM_ARGREF("(~ arg'count)");")
   (p "  } else {")
   (p "    "(~ arg'scm-name)" = "(get-arg-default arg)";")
   (p "  }")
   (emit-arg-unbox-rec arg))
 
 (define-method emit-arg-unbox ((arg <rest-arg>))
-  (p "  "(~ arg'scm-name)" = SCM_SUBRARGS[SCM_ARGCNT-1];")
+  (p "  "(~ arg'scm-name)" = SCM_ARGREF(SCM_ARGCNT-1);")
   (emit-arg-unbox-rec arg))
 
 (define-method emit-arg-unbox ((arg <optarray-arg>))
@@ -1267,9 +1297,10 @@
 (define (emit-keyword-args-unbox cproc)
   (let ([args (~ cproc'keyword-args)]
         [other-keys? (~ cproc'allow-other-keys?)])
-    (p "  if (Scm_Length(SCM_OPTARGS) % 2)")
-    (p "    Scm_Error(\"keyword list not even: %S\", SCM_OPTARGS);")
+    ;; The evenness is checked in the same pass as the keyword matching.
     (p "  while (!SCM_NULLP(SCM_OPTARGS)) {")
+    (p "    if (!SCM_PAIRP(SCM_CDR(SCM_OPTARGS)))")
+    (p "      Scm_Error(\"keyword list not even: %S\", SCM_ARGREF(SCM_ARGCNT-1));")
     (pair-for-each
      (^[args] (let ([arg (car args)]
                     [tail? (null? (cdr args))])
@@ -1412,16 +1443,8 @@
      (~ method'c-name))
   (p "{")
   (for-each emit-arg-decl (~ method'args))
-  (if (~ method'have-rest-arg?)
-    (begin (p "  ScmObj SCM_SUBRARGS["(+ (length (~ method'args)) -1)"];")
-           (p "  ScmObj SCM_OPTARGS = SCM_ARGREF(SCM_ARGCNT-1);"))
-    (p "  ScmObj SCM_SUBRARGS["(length (~ method'args))"];"))
-  (p "  int SCM_i;")
-  (let1 k (+ (length (~ method'args))
-             (if (~ method'have-rest-arg?) -1 0))
-    (p "  for (SCM_i=0; SCM_i<"k"; SCM_i++) {")
-    (p "    SCM_SUBRARGS[SCM_i] = SCM_ARGREF(SCM_i);")
-    (p "  }"))
+  (when (~ method'have-rest-arg?)
+    (p "  ScmObj SCM_OPTARGS = SCM_ARGREF(SCM_ARGCNT-1);"))
   (for-each emit-arg-unbox (~ method'args))
   ;; body
   (p "  {")
@@ -38,15 +38,22 @@
   (use srfi-13)
   (use gauche.fcntl)
   (use gauche.parameter)
-  (export <log-drain>
+  (export <log-drain> <async-log-drain>
           log-open
           log-format
+          log-flush
+          log-close
           log-default-drain)
   )
 (select-module gauche.logger)
 
 (autoload gauche.syslog sys-openlog sys-syslog LOG_PID LOG_INFO LOG_USER)
 (autoload file.util file-mtime<?)
+(autoload data.queue make-mtqueue enqueue! dequeue/wait!
+                     make-mpmc-queue mpmc-enqueue! mpmc-enqueue/wait!
+                     mpmc-dequeue-list/wait!)
+(autoload gauche.threads make-thread thread-start! thread-join!
+                         atom atom-ref atomic-update!)
 
 ;; <log-drain> class
 (define-class <log-drain> ()
@@ -233,18 +240,144 @@
   (apply log-format (log-default-drain) fmtstr args))
 
 (define-method log-format ((drain <log-drain>) fmt . args)
-  (let* ([prefix (log-get-prefix drain)]
-         [str ($ string-concatenate
-                 $ fold-right (^[data rest]
-                                (if (and (null? rest) (string-null? data))
-                                  '()          ;ignore trailing newlines
-                                  (list* prefix data "\n" rest)))
-                              '()
-                 $ string-split (apply format #f fmt args) #\newline)])
+  (let1 str (log-format-message drain fmt args)
     (with-log-output drain (^p (display str p)))))
 
+;; log-flush drain
+;; log-close drain
+;;   These only matter for <async-log-drain>; a plain drain writes out
+;;   each message as log-format is called.
+
+(define-method log-flush ((drain <log-drain>)) (undefined))
+(define-method log-close ((drain <log-drain>)) (undefined))
+
+(define (log-format-message drain fmt args)
+  (let1 prefix (log-get-prefix drain)
+    ($ string-concatenate
+       $ fold-right (^[data rest]
+                      (if (and (null? rest) (string-null? data))
+                        '()          ;ignore trailing newlines
+                        (list* prefix data "\n" rest)))
+                    '()
+       $ string-split (apply format #f fmt args) #\newline)))
+
 ;; log-open path &keyword :program-name :prefix
 
 (define (log-open path . args)
   (log-default-drain (apply make <log-drain> :path path args)))
 
+
+;;;
+;;; Asynchronous drain
+;;;
+
+;; <async-log-drain> formats the message in the caller's thread, then
+;; just puts it into a bounded lock-free queue (<mpmc-queue>).  A
+;; background thread takes messages out and writes them in batches;
+;; a file is opened and locked once per batch, instead of once per
+;; message.  A batch is written when it has batch-size messages, or
+;; flush-interval seconds after its first message arrived.
+;;
+;; The queue also carries control requests, (flush . reply-queue) and
+;; (close . reply-queue).  The thread writes out whatever it has
+;; collected, then puts #t to the reply queue when the request is done.
+;;
+;; Without thread support, it behaves like a plain <log-drain>.
+
+(define-class <async-log-drain> (<log-drain>)
+  ((buffer-size    :init-keyword :buffer-size :init-value 1024)
+   (overflow       :init-keyword :overflow :init-value 'block) ; block|drop
+   (batch-size     :init-keyword :batch-size :init-value 256)
+   (flush-interval :init-keyword :flush-interval :init-value 1)
+   (dropped-count  :allocation :virtual
+                   :slot-ref (^o (if-let1 a (slot-ref o '%dropped)
+                                   (atom-ref a)
+                                   0))
+                   :slot-set! (^[o v] (error "dropped-count is read-only")))
+   ;; private
+   (%queue   :init-value #f)           ; #f or <mpmc-queue>
+   (%thread  :init-value #f)
+   (%dropped :init-value #f)           ; atom of count
+   ))
+
+(define-method initialize ((self <async-log-drain>) initargs)
+  (next-method)
+  (unless (memq (slot-ref self 'overflow) '(block drop))
+    (error "overflow policy must be either block or drop, but got:"
+           (slot-ref self 'overflow)))
+  (cond-expand
+   [gauche.sys.threads
+    (let1 q (make-mpmc-queue (slot-ref self 'buffer-size))
+      (slot-set! self '%queue q)
+      (slot-set! self '%dropped (atom 0))
+      (slot-set! self '%thread
+                 (thread-start!
+                  (make-thread (^[] (async-drain-loop self q)) 'log-drain))))]
+   [else]))
+
+(define (async-drain-loop drain q)
+  (define batch-size (slot-ref drain 'batch-size))
+  (define interval (slot-ref drain 'flush-interval))
+  (define (deadline)
+    (and interval
+         (seconds->time (+ (time->seconds (current-time)) interval))))
+  (define (flush! rmsgs)
+    (unless (null? rmsgs)
+      (guard (e [else (report-error e)])
+        (write-log-batch drain (reverse rmsgs)))))
+  ;; RMSGS is the reversed list of N messages collected for the current
+  ;; batch, and DL is the time by which we have to write them out.
+  (let loop ([rmsgs '()] [n 0] [dl #f])
+    (let1 items (if (null? rmsgs)
+                  (mpmc-dequeue-list/wait! q batch-size)
+                  (mpmc-dequeue-list/wait! q (- batch-size n) dl '()))
+      (if (null? items)
+        (begin (flush! rmsgs) (loop '() 0 #f)) ; flush interval passed
+        (let scan ([items items] [rmsgs rmsgs] [n n])
+          (cond [(null? items)
+                 (if (>= n batch-size)
+                   (begin (flush! rmsgs) (loop '() 0 #f))
+                   (loop rmsgs n (or dl (deadline))))]
+                [(string? (car items))
+                 (scan (cdr items) (cons (car items) rmsgs) (+ n 1))]
+                [else
+                 (flush! rmsgs)
+                 (enqueue! (cdar items) #t)
+                 (unless (eq? (caar items) 'close)
+                   (scan (cdr items) '() 0))]))))))
+
+(define (write-log-batch drain msgs)
+  (if (eq? (slot-ref drain 'path) 'syslog)
+    ;; each message must be a separate syslog record.
+    (dolist [m msgs] (with-log-output drain (^p (display m p))))
+    (with-log-output drain (^p (dolist [m msgs] (display m p))))))
+
+(define (async-drain-request drain q kind)
+  (let1 reply (make-mtqueue)
+    (mpmc-enqueue/wait! q (cons kind reply))
+    (dequeue/wait! reply)))
+
+(define-method log-format ((drain <async-log-drain>) fmt . args)
+  (if-let1 q (slot-ref drain '%queue)
+    (let1 str (log-format-message drain fmt args)
+      (if (eq? (slot-ref drain 'overflow) 'drop)
+        (unless (mpmc-enqueue! q str)
+          (atomic-update! (slot-ref drain '%dropped) (cut + <> 1)))
+        (mpmc-enqueue/wait! q str))
+      (undefined))
+    (next-method)))
+
+;; Waits until all the messages logged so far are written out.
+(define-method log-flush ((drain <async-log-drain>))
+  (and-let1 q (slot-ref drain '%queue)
+    (async-drain-request drain q 'flush))
+  (undefined))
+
+;; Writes out the pending messages and stops the background thread.
+;; The drain writes synchronously afterwards.
+(define-method log-close ((drain <async-log-drain>))
+  (and-let1 q (slot-ref drain '%queue)
+    (slot-set! drain '%queue #f)
+    (async-drain-request drain q 'close)
+    (thread-join! (slot-ref drain '%thread)))
+  (undefined))
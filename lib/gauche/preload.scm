@@ -0,0 +1,180 @@
+;;;
+;;; gauche/preload.scm - loading modules in parallel
+;;;
+;;;   Copyright (c) 2015  Shiro Kawai  <shiro@acm.org>
+;;;
+;;;   Redistribution and use in source and binary forms, with or without
+;;;   modification, are permitted provided that the following conditions
+;;;   are met:
+;;;
+;;;   1. Redistributions of source code must retain the above copyright
+;;;      notice, this list of conditions and the following disclaimer.
+;;;
+;;;   2. Redistributions in binary form must reproduce the above copyright
+;;;      notice, this list of conditions and the following disclaimer in the
+;;;      documentation and/or other materials provided with the distribution.
+;;;
+;;;   3. Neither the name of the authors nor the names of its contributors
+;;;      may be used to endorse or promote products derived from this
+;;;      software without specific prior written permission.
+;;;
+;;;   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+;;;   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+;;;   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+;;;   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+;;;   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+;;;   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+;;;   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+;;;   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+;;;   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+;;;   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+;;;   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+;;;
+
+;; We find the modules a module depends on by reading its file and
+;; looking at use, extend and import forms, without evaluating anything.
+;; A module is handed to a worker thread, which requires it, after all
+;; the modules it depends on are loaded.  So each module is loaded just
+;; as 'use' would load it---its dependencies first, its toplevel forms
+;; in order---only independent modules are loaded at the same time.
+;;
+;; Require is already safe to call from multiple threads: if a feature
+;; is being loaded by another thread, it waits for it (see the comment
+;; of Scm_Require in load.c).  So dependencies we miss, e.g. the ones
+;; required in a procedure body, are just loaded by whoever needs them
+;; first.  The modules that are left in a cycle of the (statically
+;; found) dependencies are required one at a time at last.
+
+(define-module gauche.preload
+  (use gauche.threads)
+  (use util.match)
+  (use srfi-1)
+  (export preload-modules module-dependencies))
+(select-module gauche.preload)
+
+(define %require (with-module gauche.internal %require))
+(define find-load-file (with-module gauche.internal find-load-file))
+
+;; Returns the file to be loaded for module NAME, or #f.
+(define (module-file name)
+  (and-let1 r (find-load-file (module-name->path name)
+                              *load-path* *load-suffixes*)
+    (car r)))
+
+;; API
+;; Returns a list of module names the file of module NAME refers to,
+;; or #f if the file isn't found.
+(define (module-dependencies name)
+  (and-let1 file (module-file name)
+    (scan-dependencies file)))
+
+(define (scan-dependencies file)
+  (guard (e [(<error> e) '()])          ; not a Scheme source; just skip
+    (call-with-input-file file
+      (^[in]
+        (let loop ([deps '()])
+          (let1 form (read in)
+            (if (eof-object? form)
+              (delete-duplicates (reverse deps) eq?)
+              (loop (form-deps form deps)))))))))
+
+(define (form-deps form deps)
+  (match form
+    [((or 'define-module 'define-library) _ . body) (fold form-deps deps body)]
+    [('begin . body) (fold form-deps deps body)]
+    [('use (? symbol? m) . _) (cons m deps)]
+    [('extend . ms) (append (reverse (filter symbol? ms)) deps)]
+    [('import . sets)
+     (append (reverse (filter-map import-set-module sets)) deps)]
+    [_ deps]))
+
+;; Gauche's (import mod ...) and (import (mod :only ...)) as well as
+;; R7RS import sets.
+(define (import-set-module set)
+  (match set
+    [(? symbol? m) m]
+    [((? symbol? m) (? keyword?) . _) m]
+    [((or 'only 'except 'prefix 'rename) inner . _) (import-set-module inner)]
+    [((or (? symbol?) (? exact-integer?)) ...)
+     (and (pair? set) (library-name->module-name set))]
+    [_ #f]))
+
+;; Returns an alist of (name . deps), where all names and deps are
+;; the modules that need to be loaded.  A dependency without a file is
+;; dropped, since it may be a module defined within another file.
+(define (dependency-graph roots)
+  (define seen (make-hash-table 'eq?))
+  (define (loaded? name)
+    (or (find-module name) (provided? (module-name->path name))))
+  (define (to-load? name)
+    (and (not (loaded? name)) (module-file name)))
+  (let loop ([queue roots] [r '()])
+    (match queue
+      [() (reverse r)]
+      [(name . rest)
+       (if (or (hash-table-exists? seen name) (loaded? name))
+         (loop rest r)
+         (let1 deps (filter (^d (and (not (eq? d name)) (to-load? d)))
+                            (or (module-dependencies name) (quote ())))
+           (hash-table-put! seen name #t)
+           (loop (append rest deps) (acons name deps r))))])))
+
+;; API
+(define (preload-modules names :key (threads (sys-available-processors)))
+  (define graph (dependency-graph names))
+  (define names-in-graph (map car graph))
+  (define pending    (make-hash-table 'eq?)) ; name -> # of unloaded deps
+  (define dependents (make-hash-table 'eq?)) ; name -> names
+  (define ready '())                         ; in the order of the graph
+  (define running 0)
+  (define error-raised #f)
+  (define lock (make-mutex))
+  (define cv (make-condition-variable))
+
+  ;; Returns the next module to load, or #f when there'll be no more.
+  (define (take!)
+    (mutex-lock! lock)
+    (cond [error-raised (mutex-unlock! lock) #f]
+          [(pair? ready)
+           (inc! running)
+           (begin0 (pop! ready) (mutex-unlock! lock))]
+          [(zero? running) (mutex-unlock! lock) #f]
+          [else (mutex-unlock! lock cv) (take!)]))
+
+  (define (done! name e)
+    (with-locking-mutex lock
+      (^[] (dec! running)
+           (hash-table-delete! pending name)
+           (if e
+             (unless error-raised (set! error-raised e))
+             (dolist [d (hash-table-get dependents name '())]
+               (let1 n (- (hash-table-get pending d) 1)
+                 (hash-table-put! pending d n)
+                 (when (zero? n)
+                   (set! ready (append ready (list d)))))))
+           (condition-variable-broadcast! cv))))
+
+  (define (worker)
+    (let loop ()
+      (and-let1 name (take!)
+        (done! name (guard (e [else e])
+                      (%require (module-name->path name))
+                      #f))
+        (loop))))
+
+  (dolist [node graph]
+    (let1 deps (filter (cut memq <> names-in-graph) (cdr node))
+      (hash-table-put! pending (car node) (length deps))
+      (dolist [d deps] (hash-table-push! dependents d (car node)))
+      (when (null? deps) (push! ready (car node)))))
+  (set! ready (reverse ready))
+
+  (let1 ts (map (^i (thread-start! (make-thread worker #"preload-~i")))
+                (iota (max 1 (min threads (length graph)))))
+    (for-each thread-join! ts))
+  (when error-raised (raise error-raised))
+  ;; Whatever is left is in a dependency cycle; let require sort it out.
+  (dolist [node graph]
+    (when (hash-table-exists? pending (car node))
+      (%require (module-name->path (car node)))))
+  names-in-graph)
@@ -45,6 +45,7 @@
           run-process process? process-alive? process-pid
           process-command process-input process-output process-error
           process-wait process-wait-any process-exit-status
+          process-reap process-exit-port
           process-send-signal process-kill process-stop process-continue
           process-list
           run-process-pipeline
@@ -76,9 +77,22 @@
    (error     :allocation :virtual :slot-ref (^o (process-output o 2)))
    (extra-inputs  :initform '())
    (extra-outputs :initform '())
-   (processes :allocation :class :initform '())
   ))
 
+;; Table of live child processes, indexed by pid.
+(define *process-table* (make-hash-table 'eqv?))
+
+(define (%register-process! p)
+  (hash-table-put! *process-table* (process-pid p) p))
+
+;; Called when the child PID has exited with STATUS.  Returns its
+;; <process>, or #f if it isn't the one we've created.
+(define (%process-exited! pid status)
+  (and-let* ([p (hash-table-get *process-table* pid #f)])
+    (hash-table-delete! *process-table* pid)
+    (slot-set! p 'status status)
+    p))
+
 ;; Process I/O management
 ;; 'in-pipes' and 'out-pipes' slots contains an assoc list of
 ;; ((<name> . <port>) ...), where <name> is a symbol and <port> is
@@ -185,16 +199,15 @@
                                        :iomap iomap :directory dir
                                        :sigmask (%ensure-mask sigmask)
                                        :detached detached)
-            (push! (ref proc 'processes) proc)
             (set!  (ref proc 'pid) pid)
+            (%register-process! proc)
             (dolist (p toclose)
               (if (input-port? p)
                 (close-input-port p)
                 (close-output-port p)))
             (when (and wait (not detached))
               ;; the following expr waits until the child exits
-              (set! (ref proc 'status) (values-ref (sys-waitpid pid) 1))
-              (update! (ref proc 'processes) (cut delete proc <>)))
+              (%process-exited! pid (values-ref (sys-waitpid pid) 1)))
             proc)
           (sys-exec (car argv) argv
                     :iomap iomap :directory dir
@@ -416,7 +429,7 @@
 (define (process-alive? process)
   (and (not (process-exit-status process))
        (process-pid process)))
-(define (process-list) (class-slot-ref <process> 'processes))
+(define (process-list) (hash-table-values *process-table*))
 
 ;;-----------------------------------------------------------------
 ;; wait
@@ -426,25 +439,73 @@
     (receive (p code) (sys-waitpid (process-pid process) :nohang nohang?)
       (and (not (eqv? p 0))
            (begin
+             (hash-table-delete! *process-table* p)
              (slot-set! process 'status code)
-             (slot-set! process 'processes
-                        (delete process (slot-ref process 'processes)))
              (when raise-error? (%check-normal-exit process))
              #t)))
     #f))
 
 (define (process-wait-any :optional (nohang? #f) (raise-error? #f))
-  (and (not (null? (process-list)))
+  (and (not (zero? (hash-table-num-entries *process-table*)))
        (receive (pid status) (sys-waitpid -1 :nohang nohang?)
          (and (not (eqv? pid 0))
-              (and-let* ((p (find (^[pp] (eqv? (process-pid pp) pid))
-                                  (process-list))))
-                (update! (ref p 'processes) (cut delete p <>))
-                (set! (ref p 'status) status)
+              (and-let* ([p (%process-exited! pid status)])
                 (set! (ref p 'pid) #f)
                 (when raise-error? (%check-normal-exit p))
                 p)))))
 
+;; Reaps all exited children at once without blocking, and returns the
+;; list of their <process> objects.  The cost is proportional to the
+;; number of exited children, not the number of live ones.
+;; NB: This reaps children that aren't created by run-process as well;
+;; their status isn't kept.
+(define (process-reap)
+  (%drain-exit-port!)
+  (if (zero? (hash-table-num-entries *process-table*))
+    '()
+    (let loop ([reaped '()])
+      (let1 r (guard (e [(and (<system-error> e)
+                              (eqv? (condition-ref e 'errno) ECHILD))
+                         #f])
+                (receive (pid status) (sys-waitpid -1 :nohang #t)
+                  (and (not (eqv? pid 0)) (cons pid status))))
+        (if r
+          (loop (if-let1 p (%process-exited! (car r) (cdr r))
+                  (cons p reaped)
+                  reaped))
+          (reverse! reaped))))))
+
+;; process-exit-port returns an input port that becomes readable when
+;; a child process exits, so that an event loop can watch it along with
+;; other fds and call process-reap.  It is a self-pipe written by the
+;; SIGCHLD handler.  To keep the handler from blocking, we write at most
+;; one byte until process-reap drains it.
+(define *exit-pipe* #f)                ; #f or (in . out)
+(define *exit-pending* #f)
+
+(define (process-exit-port)
+  (cond-expand
+   [gauche.os.windows
+    (error "process-exit-port isn't supported on this platform")]
+   [else
+    (unless *exit-pipe*
+      (receive (in out) (sys-pipe :buffering :none)
+        (let1 prev (get-signal-handler SIGCHLD)
+          (set-signal-handler!
+           SIGCHLD
+           (^[sig]
+             (unless *exit-pending*
+               (set! *exit-pending* #t)
+               (write-byte 0 out))
+             (when (procedure? prev) (prev sig)))))
+        (set! *exit-pipe* (cons in out))))
+    (car *exit-pipe*)]))
+
+(define (%drain-exit-port!)
+  (and-let* ([p *exit-pipe*])
+    (set! *exit-pending* #f)
+    (when (byte-ready? (car p)) (read-byte (car p)))))
+
 ;; signal
 (define (process-send-signal process signal)
   (when (process-alive? process)
@@ -25,11 +25,15 @@
   (use srfi-13)
   (use gauche.libutil)
   (use gauche.parameter)
-  (export reload reload-modified-modules
+  (export reload reload-modified-modules watch-modified-modules
           module-reload-rules reload-verbose)
   )
 (select-module gauche.reload)
 
+(autoload file.watch make-file-watcher file-watcher-add!
+                     selector-add-file-watcher! file-event-path
+                     file-event-name)
+
 ;; share the internal utility
 (define module-glob-pattern->regexp
   (with-module gauche.libutil module-glob-pattern->regexp))
@@ -98,38 +102,84 @@
          saves
          (^[sym value] (eval `(set! ,sym (quote ,value)) mod)))))))
 
+;; The time this module is loaded, and the time each module is reloaded.
+(define *init-time* (sys-time))
+(define *mod-times* (make-hash-table 'eq?))
+
+;; get default rules from module-reload-rules, and convert to
+;; regexps up front
+(define (compile-rules rl)
+  (map (^x (cons (module-glob-pattern->regexp (symbol->string (car x)))
+                 (cdr x)))
+       (if (pair? rl) (car rl) (module-reload-rules))))
+
+;; search for the module name in ls
+(define (find-rule name ls)
+  (cond [(null? ls) '()]
+        [(rxmatch (caar ls) name) (cdar ls)]
+        [else (find-rule name (cdr ls))]))
+
+(define (module-source-path name)
+  (find-in-path (string-append (module-name->path name) ".scm") *load-path*))
+
+;; check the module to see if it has changed
+(define (reload-if-modified mod rules now)
+  (and-let* ([name (module-name mod)]
+             [last-load (hash-table-get *mod-times* name *init-time*)]
+             [path (module-source-path name)]
+             [(file-exists? path)]
+             [last-mod (slot-ref (sys-stat path) 'mtime)]
+             [rule (find-rule (symbol->string name) rules)])
+    (when (> last-mod last-load)
+      (when (reload-verbose)
+        (format #t "reloading: ~S\n" name))
+      (hash-table-put! *mod-times* name now)
+      (reload name rule))))
+
 ;; procedure reload-modified-modules &optional <reload-rules>
 ;;   Reloads modules that are modified after this module is loaded.
-(define reload-modified-modules
-  (let ([init (sys-time)]
-        [mod-times (make-hash-table 'eq?)])
-    (lambda rl
-      ;; get default rules from module-reload-rules, and convert to
-      ;; regexps up front
-      (define rules
-        (map (^x (cons (module-glob-pattern->regexp (symbol->string (car x)))
-                       (cdr x)))
-             (if (pair? rl) (car rl) (module-reload-rules))))
-      ;; search for the module name in ls
-      (define (find-rule name ls)
-        (cond [(null? ls) '()]
-              [(rxmatch (caar ls) name) (cdar ls)]
-              [else (find-rule name (cdr ls))]))
-      ;; check each loaded module to see if it has changed
-      (let1 now (sys-time)
-        (for-each
-         (^[mod]
-           (and-let* ([name (module-name mod)]
-                      [last-load (hash-table-get mod-times name init)]
-                      [p1 (string-append (module-name->path name) ".scm")]
-                      [path (find-in-path p1 *load-path*)]
-                      [last-mod (slot-ref (sys-stat path) 'mtime)]
-                      [rule (find-rule (symbol->string name) rules)])
-             (when (> last-mod last-load)
-               (when (reload-verbose)
-                 (format #t "reloading: ~S\n" name))
-               (hash-table-put! mod-times name now)
-               (reload name rule))))
-         (all-modules))))))
+(define (reload-modified-modules . rl)
+  (let ([rules (compile-rules rl)]
+        [now (sys-time)])
+    (for-each (cut reload-if-modified <> rules now) (all-modules))))
+
+;; procedure watch-modified-modules <selector> &optional <reload-rules>
+;;   Watches the source files of the currently loaded modules, and reloads
+;;   modified ones from the selector's loop.  Instead of scanning every
+;;   module, only the modules whose files are reported changed are checked.
+;;   We watch directories rather than files, since editors often save
+;;   a file by renaming a new one over it.  Returns the file watcher.
+(define (watch-modified-modules selector . rl)
+  (let ([watcher (make-file-watcher)]
+        [dirs (make-hash-table 'equal?)])  ; dir -> ((basename . mod) ...)
+    (dolist [mod (all-modules)]
+      (and-let* ([name (module-name mod)]
+                 [path (module-source-path name)])
+        (hash-table-push! dirs (sys-dirname path)
+                          (cons (sys-basename path) mod))))
+    (hash-table-for-each dirs
+                         (^[dir _]
+                           (file-watcher-add! watcher dir
+                                              '(modify create move))))
+    (selector-add-file-watcher!
+     selector watcher
+     (^[events]
+       (let ([rules (compile-rules rl)]
+             [now (sys-time)])
+         (dolist [mod (delete-duplicates
+                       (append-map
+                        (^e (let ([ms (hash-table-get dirs (file-event-path e)
+                                                      '())]
+                                  [name (file-event-name e)])
+                              ;; kqueue doesn't tell us the entry name
+                              (if name
+                                (filter-map (^p (and (equal? (car p) name)
+                                                     (cdr p)))
+                                            ms)
+                                (map cdr ms))))
+                        events)
+                       eq?)]
+           (reload-if-modified mod rules now)))))
+    watcher))
 
 
@@ -38,6 +38,16 @@
   )
 (select-module gauche.selector)
 
+(autoload control.timer-wheel timer-wheel-next-timeout timer-wheel-advance!)
+
+;; When the system provides a poller (epoll, kqueue or poll), the
+;; interest set is registered to it and selector-select only pays for
+;; the ready descriptors.  Otherwise we fall back to sys-select.
+;; In both cases the handler lists are the master record; fdtab maps
+;; a file descriptor to the handlers interested in it, grouped by flag.
+;; If a timer wheel (control.timer-wheel) is given, selector-select
+;; doesn't wait beyond its next timeout, and advances it after waiting.
+
 (define-class <selector> ()
   ((rfds :init-form #f)
    (wfds :init-form #f)
@@ -45,14 +55,23 @@
    (rhandlers :init-form '())  ; list of (port-or-fd . proc)
    (whandlers :init-form '())  ; ditto
    (xhandlers :init-form '())  ; ditto
+   (poller :init-form (make-poller))
+   (fdtab :init-form (make-hash-table 'eqv?)) ; fd -> #(rhs whs xhs)
+   (edges :init-form (make-hash-table 'eqv?)) ; fd -> #t if edge-triggered
+   (timer-wheel :init-keyword :timer-wheel :init-value #f)
   ))
 
+(define (make-poller)
+  (cond-expand
+   [gauche.sys.poller (make-sys-poller)]
+   [else #f]))
+
 (define (canon-flag flag)
   (case flag
     [(r read) 'r]
     [(w write) 'w]
     [(x exception) 'x]
-    [else (errorf "invalid flag ~s, must be r, w, or x" flag)]))
+    [else (errorf "invalid flag ~s, must be r, w, x or edge" flag)]))
 
 (define (flag->fd-slot flag)
   (case flag
@@ -62,18 +81,59 @@
   (case flag
     [(r) 'rhandlers] [(w) 'whandlers] [(x) 'xhandlers]))
 
+(define (port-or-fd->fd port-or-fd)
+  (if (integer? port-or-fd) port-or-fd (port-file-number port-or-fd)))
+
+;; Recompute the poller's interest in FD from the handler lists.
+(define (sync-poller! selector fd)
+  (cond-expand
+   [gauche.sys.poller
+    (and-let* ([poller (slot-ref selector 'poller)]
+               fd)
+      (define (collect slot)
+        (filter (^e (eqv? (port-or-fd->fd (car e)) fd))
+                (slot-ref selector slot)))
+      (let ([rhs (collect 'rhandlers)]
+            [whs (collect 'whandlers)]
+            [xhs (collect 'xhandlers)])
+        (if (and (null? rhs) (null? whs) (null? xhs))
+          (begin (hash-table-delete! (slot-ref selector 'fdtab) fd)
+                 (hash-table-delete! (slot-ref selector 'edges) fd)
+                 (sys-poller-delete! poller fd))
+          (begin (hash-table-put! (slot-ref selector 'fdtab) fd
+                                  (vector rhs whs xhs))
+                 (sys-poller-add! poller fd
+                                  (cond-list [(pair? rhs) 'r]
+                                             [(pair? whs) 'w]
+                                             [(pair? xhs) 'x]
+                                             [(hash-table-get
+                                               (slot-ref selector 'edges)
+                                               fd #f)
+                                              'edge]))))))]
+   [else #f]))
+
 (define-method selector-add! ((selector <selector>) port-or-fd proc flags)
   (check-arg procedure? proc)
   (check-arg list? flags)
-  (dolist [flag (map canon-flag flags)]
-    (let* ([slot (flag->fd-slot flag)]
-           [fds (or (slot-ref selector slot)
-                    (rlet1 f (make <sys-fdset>)
-                      (slot-set! selector slot f)))])
-      (set! (sys-fdset-ref fds port-or-fd) #t))
-    (slot-push! selector (flag->handler-slot flag) (cons port-or-fd proc))))
+  (let ([poller (slot-ref selector 'poller)]
+        [edge? (memq 'edge flags)])
+    (dolist [flag (map canon-flag (delete 'edge flags))]
+      (unless poller
+        (let* ([slot (flag->fd-slot flag)]
+               [fds (or (slot-ref selector slot)
+                        (rlet1 f (make <sys-fdset>)
+                          (slot-set! selector slot f)))])
+          (set! (sys-fdset-ref fds port-or-fd) #t)))
+      (slot-push! selector (flag->handler-slot flag) (cons port-or-fd proc)))
+    (when poller
+      (let1 fd (port-or-fd->fd port-or-fd)
+        (when (and fd edge?)
+          (hash-table-put! (slot-ref selector 'edges) fd #t))
+        (sync-poller! selector fd)))))
 
 (define-method selector-delete! ((selector <selector>) port-or-fd proc flags)
+  (define touched '())
+  (define (touch! port-or-fd) (push! touched port-or-fd))
   (let1 flags (if flags (map canon-flag flags) '(r w x))
     (for-each (^[fds handlers]
                 (cond
@@ -82,6 +142,7 @@
                     (when (or (not proc) (eq? proc (cdr p)))
                       (slot-set! selector handlers
                                  (delete p (slot-ref selector handlers)))
+                      (touch! port-or-fd)
                       (if-let1 fds (slot-ref selector fds)
                         (sys-fdset-set! fds port-or-fd #f))))]
                  [proc
@@ -90,18 +151,71 @@
                     (cond [(null? h)
                            (slot-set! selector handlers (reverse newh))]
                           [(eq? proc (cdar h))
+                           (touch! (caar h))
                            (if-let1 fds (slot-ref selector fds)
                              (sys-fdset-set! fds (caar h) #f))
                            (loop (cdr h) newh)]
                           [else
                            (loop (cdr h) (cons (car h) newh))]))]
                  [else
+                  (for-each (^e (touch! (car e))) (slot-ref selector handlers))
                   (slot-set! selector fds #f)
                   (slot-set! selector handlers '())]))
               (map flag->fd-slot flags)
-              (map flag->handler-slot flags))))
+              (map flag->handler-slot flags)))
+  (when (slot-ref selector 'poller)
+    (for-each (cut sync-poller! selector <>)
+              (delete-duplicates (map port-or-fd->fd touched) eqv?))))
 
 (define-method selector-select ((selector <selector>) :optional (timeout #f))
+  (let* ([wheel (slot-ref selector 'timer-wheel)]
+         [timeout (if wheel (wheel-timeout wheel timeout) timeout)]
+         [nfds (if (slot-ref selector 'poller)
+                 (select-by-poller selector timeout)
+                 (select-by-select selector timeout))])
+    (when wheel (timer-wheel-advance! wheel))
+    nfds))
+
+;; Returns the shorter one of TIMEOUT and the wheel's next timeout,
+;; in microseconds.
+(define (wheel-timeout wheel timeout)
+  (let ([usec (timeout->usec timeout)]
+        [next (timer-wheel-next-timeout wheel)])
+    (if next
+      (let1 wusec (ceiling->exact (* next 1e6))
+        (if usec (min usec wusec) wusec))
+      usec)))
+
+(define (timeout->usec timeout)
+  (cond [(not timeout) #f]
+        [(real? timeout) (ceiling->exact timeout)]
+        [(and (list? timeout) (= (length timeout) 2))
+         (+ (* (car timeout) 1000000) (cadr timeout))]
+        [else (error "bad timeout spec:" timeout)]))
+
+;; Returns the number of (fd, flag) pairs that are ready.
+(define (select-by-poller selector timeout)
+  (cond-expand
+   [gauche.sys.poller
+    (let ([events (sys-poller-wait (slot-ref selector 'poller) timeout)]
+          [fdtab (slot-ref selector 'fdtab)])
+      (define (pick flag index tail)
+        (fold-right (^[ev tail]
+                      (if (memq flag (cdr ev))
+                        (if-let1 hs (hash-table-get fdtab (car ev) #f)
+                          (fold (^[entry tail]
+                                  (cons (list (cdr entry) (car entry) flag)
+                                        tail))
+                                tail (vector-ref hs index))
+                          tail)
+                        tail))
+                    tail events))
+      (for-each (^h (apply (car h) (cdr h)))
+                (pick 'r 0 (pick 'w 1 (pick 'x 2 '()))))
+      (fold (^[ev n] (+ n (length (cdr ev)))) 0 events))]
+   [else 0]))
+
+(define (select-by-select selector timeout)
 
   (define (pick-handlers fds handlers flag)
     (fold (^[entry tail]
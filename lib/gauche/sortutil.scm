@@ -25,6 +25,7 @@
 
 (define %sort  (with-module gauche.internal %sort))
 (define %sort! (with-module gauche.internal %sort!))
+(define %stable-sort! (with-module gauche.internal %stable-sort!))
 
 (define-syntax define-less?
   (syntax-rules ()
@@ -138,12 +139,27 @@
 ;;; adapted it to work destructively in Scheme.
 
 (define (sort! seq . args)
-  (if (and (or (pair? seq) (vector? seq)) (null? args))
+  (if (and (or (pair? seq) (vector? seq) (uvector? seq)) (null? args))
     (%sort! seq)                  ; use internal version
     (apply stable-sort! seq args)))
 
 (define (stable-sort! seq :optional (cmp #f) (key identity))
   (define-less? less? cmp 'sort!)
+  (cond
+   [(and (not cmp) (or (pair? seq) (vector? seq)))
+    ;; With the default ordering, we sort in C.  Keys are computed
+    ;; just once for each element, and compared inline if they are
+    ;; of the same type.
+    (if (memq key `(,identity ,values))
+      (%stable-sort! seq)
+      (%stable-sort! seq (if (pair? seq)
+                           (list->vector (map key seq))
+                           (vector-map key seq))))]
+   [(and (not cmp) (uvector? seq) (memq key `(,identity ,values)))
+    (%sort! seq)]                       ; radix sort, which is stable
+   [else (%merge-sort! seq less? key)]))
+
+(define (%merge-sort! seq less? key)
   (if (memq key `(,identity ,values))
     (letrec ([step (^n (cond [(> n 2) (let* ([j (ash n -1)]
                                              [a (step j)]
@@ -208,7 +224,7 @@
 ;;; copy of the sequence.
 
 (define (sort seq . args)
-  (if (and (or (pair? seq) (vector? seq)) (null? args))
+  (if (and (or (pair? seq) (vector? seq) (uvector? seq)) (null? args))
     (%sort seq)  ;; use internal version
     (apply stable-sort seq args)))
 
@@ -216,13 +232,14 @@
   (define-less? less? cmp 'sort)
   (if (memq key `(,identity ,values))
     (cond [(null? seq) seq]
-          [(pair? seq) (stable-sort! (list-copy seq) less?)]
-          [(vector? seq) (list->vector (sort! (vector->list seq) less?))]
+          [(pair? seq) (stable-sort! (list-copy seq) cmp)]
+          [(vector? seq) (stable-sort! (vector-copy seq) cmp)]
+          [(and (not cmp) (uvector? seq)) (%sort seq)]
           [(is-a? seq <sequence>) (%generic-sort seq less?)]
           [else (error "sequence required, but got:" seq)])
     (cond [(null? seq) seq]
-          [(pair? seq) (stable-sort! (list-copy seq) less? key)]
-          [(vector? seq) (stable-sort! (vector-copy seq) less? key)]
+          [(pair? seq) (stable-sort! (list-copy seq) cmp key)]
+          [(vector? seq) (stable-sort! (vector-copy seq) cmp key)]
           [(is-a? seq <sequence>) (%generic-sort seq less? key)]
           [else (error "sequence required, but got:" seq)])))
 
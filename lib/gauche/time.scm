@@ -49,10 +49,13 @@
 ;; Time, a simple measurement ------------------------------
 
 ;; TODO: Drop these once we support sane formatting of flonums in format.
+;; NB: gauche.benchmark also uses format-flonum.
 (define (format-flonum val mincol digs)
   (let* ([scale (expt 10 digs)]
          [n (round->exact (* val scale))])
-    (format "~vd.~v,'0d" mincol (div n scale) digs (mod n scale))))
+    (format "~v@a.~v,'0d" mincol
+            (format "~a~d" (if (< n 0) "-" "") (quotient (abs n) scale))
+            digs (remainder (abs n) scale))))
 
 (define (format-delta-time delta) (format-flonum delta 3 3))
 
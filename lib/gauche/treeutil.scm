@@ -35,23 +35,34 @@
   (export make-tree-map tree-map-empty?
           tree-map-min tree-map-max tree-map-pop-min! tree-map-pop-max!
           tree-map-fold tree-map-fold-right
+          tree-map-fold-range tree-map-fold-right-range
           tree-map-map tree-map-for-each
           tree-map-keys tree-map-values
           tree-map->alist alist->tree-map)
   )
 (select-module gauche.treeutil)
 
-(define make-tree-map
+;; The positional arguments may be followed by the keyword argument
+;; :layout, which is passed to %make-tree-map.
+(define (make-tree-map . args)
+  (let loop ([args args] [pos '()])
+    (if (and (pair? args) (not (keyword? (car args))))
+      (loop (cdr args) (cons (car args) pos))
+      (let-keywords args ([layout #f])
+        (%make-tree-map (apply tree-map-args->comparator (reverse pos))
+                        layout)))))
+
+(define tree-map-args->comparator
   (case-lambda
-    [() (%make-tree-map default-comparator)]
+    [() default-comparator]
     [(cmp)
      (if (comparator? cmp)
        (begin
          (unless (comparator-ordered? cmp)
            (error "make-tree-map needs an ordered comparator, but got:" cmp))
-         (%make-tree-map cmp))
-       (%make-tree-map (make-comparator/compare #t #t cmp #f)))]
-    [(=? <?) (%make-tree-map (make-comparator #t =? <? #f))]))
+         cmp)
+       (make-comparator/compare #t #t cmp #f))]
+    [(=? <?) (make-comparator #t =? <? #f)]))
 
 (define (tree-map-empty? tm) (zero? (tree-map-num-entries tm)))
 
@@ -62,8 +73,10 @@
 
 (define (%tree-map-fold tm kons knil backward)
   (check-arg tree-map? tm)
-  (let ((eof (cons #f #f))              ;marker
-        (i (%tree-map-iter tm)))
+  (%tree-map-iter-fold (%tree-map-iter tm) kons knil backward))
+
+(define (%tree-map-iter-fold i kons knil backward)
+  (let ((eof (cons #f #f)))             ;marker
     (let loop ((r knil))
       (receive (k v) (i eof backward)
         (if (eq? k eof)
@@ -76,6 +89,15 @@
 (define (tree-map-fold-right tm kons knil)
   (%tree-map-fold tm kons knil #t))
 
+;; Folds over the entries whose keys are in [lo, hi)
+(define (tree-map-fold-range tm lo hi kons knil)
+  (check-arg tree-map? tm)
+  (%tree-map-iter-fold (%tree-map-range-iter tm lo hi) kons knil #f))
+
+(define (tree-map-fold-right-range tm lo hi kons knil)
+  (check-arg tree-map? tm)
+  (%tree-map-iter-fold (%tree-map-range-iter tm lo hi) kons knil #t))
+
 (define (tree-map-map tm proc)
   (tree-map-fold-right tm (lambda (k v r) (cons (proc k v) r)) '()))
 
@@ -93,6 +115,8 @@
 
 (define (alist->tree-map alist . args)
   (rlet1 tm (apply make-tree-map args)
-    (dolist (kv alist)
-      (tree-map-put! tm (car kv) (cdr kv)))))
+    ;; If the keys are already sorted, we build the tree directly
+    (unless (%tree-map-bulk-load! tm alist)
+      (dolist (kv alist)
+        (tree-map-put! tm (car kv) (cdr kv))))))
 
@@ -35,8 +35,17 @@
   (use srfi-13)
   (use util.match)
   (extend gauche.internal)
-  (export profiler-show profiler-get-result
-          profiler-show-load-stats with-profiler)
+  (export profiler-show profiler-get-result profiler-get-alloc-result
+          profiler-show-alloc profiler-get-stacks profiler-write-collapsed-stacks
+          profiler-show-load-stats profiler-show-macro-stats
+          profiler-get-load-times profiler-show-load-times
+          with-profiler lock-stat-result lock-stat-show
+          port-statistics-result port-statistics-show
+          heap-census heap-census-show
+          heap-retention-paths heap-retention-paths-show
+          heap-snapshot-save heap-snapshot-load
+          heap-snapshot-diff heap-snapshot-diff-show
+          code-memory-usage code-memory-usage-show)
   )
 (select-module gauche.vm.profiler)
 
@@ -54,6 +63,60 @@
     (hash-table-map r (^(k v) (cons (entry-name k) v)))
     #f))
 
+;;
+;; Returns the result of the allocation sampler, in the form of
+;;   (:procedures ((<name> <bytes> . <objects>) ...)
+;;    :types ((<c-type-name> <bytes> . <objects>) ...))
+;; Each list is sorted by bytes.  The numbers are estimated from the
+;; samples taken every (profiler-alloc-sampling-period) bytes.
+;; Allocations outside of any Scheme code are shown with the name #f.
+;;
+(define (profiler-get-alloc-result)
+  ;; NB: this part depends on the result of profiler-raw-alloc-result.
+  ;; Keep this in sync with src/prof.c.
+  (define (tally ht key->name)
+    (sort-by (hash-table-map ht (^(k v) (cons (key->name k) v))) cadr >))
+  (if-let1 r (profiler-raw-alloc-result)
+    `(:procedures ,(tally (car r) (^k (and k (entry-name k))))
+      :types ,(tally (cdr r) identity))
+    #f))
+
+;;
+;; Returns the sampled call stacks, as a list of (<names> . <samples>),
+;; where <names> is a list of entry names from the outermost caller
+;; to the sampled code.  A caller that hasn't been called during
+;; profiling (e.g. the one that started the profiler) is shown as #f.
+;;
+(define (profiler-get-stacks)
+  ;; NB: this part depends on the result of profiler-raw-call-tree.
+  ;; Keep this in sync with src/prof.c.
+  (define (walk tree path acc)
+    (hash-table-fold tree
+                     (^(k v acc)
+                       (let* ([path (cons (and k (entry-name k)) path)]
+                              [acc (if (zero? (car v))
+                                     acc
+                                     (acons (reverse path) (car v) acc))])
+                         (if (cdr v) (walk (cdr v) path acc) acc)))
+                     acc))
+  (if-let1 r (profiler-raw-call-tree)
+    (walk r '() '())
+    #f))
+
+;;
+;; Write the call stacks in the 'collapsed' format, one stack per line
+;; as "outer;...;inner <samples>", which can be fed to flame graph tools.
+;;
+(define (profiler-write-collapsed-stacks :optional (port (current-output-port)))
+  (define (frame-name name)
+    (regexp-replace-all #/[;\s]/
+                        (if (string? name) name (write-to-string name))
+                        "_"))
+  (dolist [e (or (profiler-get-stacks) '())]
+    (format port "~a ~d\n"
+            (string-join (map (^n (if n (frame-name n) "???")) (car e)) ";")
+            (cdr e))))
+
 ;;
 ;; Show the profiler result.
 ;;
@@ -63,11 +126,19 @@
 ;;    :sort-by - either one of 'time, 'count, or 'time-per-call
 ;;    :max-rows - # of rows to be shown.  #f to show everything.
 ;;
+;;  If the allocation sampler has gathered data, it is also shown
+;;  (only when the current result is used).
+;;
 (define (profiler-show :key (results #f) (sort-by 'time) (max-rows 50))
   (if (not results)
     ;; use the current result
     (if-let1 r (profiler-get-result)
-      (show-stats r sort-by max-rows)
+      (begin
+        (show-stats r sort-by max-rows)
+        (let1 a (profiler-get-alloc-result)
+          (unless (null? (get-keyword :types a))
+            (newline)
+            (show-alloc-stats a max-rows))))
       (print "No profiling data has been gathered."))
     ;; gather all the results
     (let1 ht (make-hash-table 'equal?)
@@ -81,6 +152,16 @@
       ;; show 'em.
       (show-stats (hash-table-map ht cons) sort-by max-rows))))
 
+;;
+;; Show the allocation sampler result.
+;;
+(define (profiler-show-alloc :key (max-rows 50))
+  (if-let1 a (profiler-get-alloc-result)
+    (if (null? (get-keyword :types a))
+      (print "No allocation samples have been gathered.")
+      (show-alloc-stats a max-rows))
+    (print "No profiling data has been gathered.")))
+
 ;; *EXPERIMENTAL*
 ;; Show the load statistics.
 ;; Called from the cleanup routine of main.c.  Passed STATS is a list of
@@ -119,6 +200,327 @@
         (return #f))
       (start (reverse stats)))))
 
+;; *EXPERIMENTAL*
+;; Show the macro expansion statistics gathered with -pmacro.
+;; Called from the cleanup routine of main.c.  STATS is a list of
+;; (<macro> <count> . <microseconds>), as returned from %macro-stats.
+;; Returns the load time breakdown gathered with -ptime-load, as a tree
+;; of nodes:
+;;   (<name> <kind> <cumulative> ((<phase> . <self-time>) ...) <child> ...)
+;; <kind> is either load or dso.  Times are in microseconds; <cumulative>
+;; includes the time of the children.  Returns #f if no data is gathered.
+(define (profiler-get-load-times)
+  ;; NB: this part depends on the node structure in libeval.scm.
+  ;; Keep this in sync with it.
+  (define (convert node)
+    (let* ([times (vector->list (vector-ref node 2))]
+           [kids (map convert (reverse (vector-ref node 3)))])
+      `(,(vector-ref node 0) ,(vector-ref node 1)
+        ,(fold (^[k sum] (+ (caddr k) sum)) (apply + times) kids)
+        ,(map cons (vector->list *load-time-phases*) times)
+        ,@kids)))
+  (and-let1 root (%load-time-root)
+    (convert root)))
+
+;; Show the load time breakdown.  Files whose cumulative time is less
+;; than MIN-TIME microseconds are omitted, as well as the ones deeper
+;; than MAX-DEPTH.
+(define (profiler-show-load-times :key (min-time 0) (max-depth #f))
+  (define (ms usec)
+    (receive (q r) (quotient&remainder (exact (round (/ usec 100))) 10)
+      (format "~d.~d" q r)))
+  (define (show node depth)
+    (match-let1 (name kind cumulative times . kids) node
+      (when (>= cumulative min-time)
+        (format #t "~8@a ~8@a" (ms cumulative) (ms (apply + (map cdr times))))
+        (dolist [t times] (format #t " ~6@a" (ms (cdr t))))
+        (format #t " ~a~a~a\n" (make-string (* depth 2) #\space) name
+                (if (eq? kind 'dso) " [dso]" ""))
+        (unless (and max-depth (>= depth max-depth))
+          (dolist [k kids] (show k (+ depth 1)))))))
+  (if-let1 tree (profiler-get-load-times)
+    (begin
+      (print "Load time breakdown (in milliseconds):")
+      (format #t "~8@a ~8@a" "cumul" "self")
+      (vector-for-each (^p (format #t " ~6@a" p)) *load-time-phases*)
+      (print "  file")
+      (print (make-string 120 #\-))
+      (show tree 0))
+    (print "No load time data has been gathered.")))
+
+(define (profiler-show-macro-stats :key (stats (%macro-stats)) (max-rows 50))
+  (let* ([sorted (sort-by stats cddr >)]
+         [total (fold (^[e sum] (+ (cddr e) sum)) 0 sorted)])
+    (print "Macro expansion statistics:")
+    (print "Time(us)    Count  us/call  Macro")
+    (print "--------+--------+--------+-------------------------------------------------")
+    (dolist [e (if (integer? max-rows) (take* sorted max-rows) sorted)]
+      (match-let1 (mac count . usec) e
+        (format #t "~8d ~8d ~8d  ~a\n" usec count (quotient usec count) mac)))
+    (print "--------+--------+--------+-------------------------------------------------")
+    (format #t "~8d ~8d           Total\n"
+            total (fold (^[e sum] (+ (cadr e) sum)) 0 sorted))))
+
+;;
+;; Returns the lock contention statistics gathered since lock-stat-start,
+;; as a list of (<lock-object> . <plist>), where <plist> is the same
+;; as the one returned by port-lock-stat and mutex-lock-stat.
+;; The list is sorted by the total wait time, then by the number of
+;; acquisitions.
+;;
+(define (lock-stat-result)
+  ;; NB: this part depends on the result of lock-stat-raw-result.
+  ;; Keep this in sync with src/prof.c.
+  (define (key e) (get-keyword :wait-time (cdr e)))
+  (define (acq e) (get-keyword :acquisitions (cdr e)))
+  (sort (lock-stat-raw-result)
+        (^(a b) (or (> (key a) (key b))
+                    (and (= (key a) (key b)) (> (acq a) (acq b)))))))
+
+;;
+;; Show the lock contention statistics.  Times are in microseconds.
+;;
+(define (lock-stat-show :key (max-rows 20))
+  (define (us sec) (exact (round (* sec 1e6))))
+  (let1 r (lock-stat-result)
+    (if (null? r)
+      (print "No lock statistics have been gathered.")
+      (begin
+        (print "Lock statistics (times in microseconds)")
+        (print "                                    acquired  contended     wait  max-wait     hold  max-hold")
+        (print "-----------------------------------+---------+---------+---------+---------+---------+---------")
+        (dolist [e (if (integer? max-rows) (take* r max-rows) r)]
+          (let ([obj (car e)] [s (cdr e)])
+            (format #t "~35a ~9d ~9d ~9d ~9d ~9d ~9d\n"
+                    (let1 n (write-to-string obj)
+                      (if (> (string-length n) 35) (string-take n 35) n))
+                    (get-keyword :acquisitions s)
+                    (get-keyword :contentions s)
+                    (us (get-keyword :wait-time s))
+                    (us (get-keyword :max-wait-time s))
+                    (us (get-keyword :hold-time s))
+                    (us (get-keyword :max-hold-time s)))
+            (dolist [w (get-keyword :waiters s)]
+              (format #t "    waiter ~a: ~d times, ~d us\n"
+                      (car w) (cadr w) (us (cddr w))))))))))
+
+;;
+;; Returns the I/O statistics of all the ports that have them and are
+;; still alive, as a list of (<port> . <plist>), where <plist> is the
+;; same as the one returned by port-statistics.  The list is sorted
+;; by the number of syscalls, then by the number of fills and flushes.
+;;
+(define (port-statistics-result)
+  ;; NB: this part depends on the result of port-statistics-raw-result.
+  ;; Keep this in sync with src/port.c.
+  (define (calls e) (get-keyword :syscalls (cdr e)))
+  (define (ops e) (+ (get-keyword :fills (cdr e))
+                     (get-keyword :flushes (cdr e))))
+  (sort (port-statistics-raw-result)
+        (^(a b) (or (> (calls a) (calls b))
+                    (and (= (calls a) (calls b)) (> (ops a) (ops b)))))))
+
+;;
+;; Show the I/O statistics.  Bytes per syscall lets you spot ports
+;; doing many small syscalls, e.g. unbuffered ones.
+;;
+(define (port-statistics-show :key (max-rows 20))
+  (let1 r (port-statistics-result)
+    (if (null? r)
+      (print "No port statistics have been gathered.")
+      (begin
+        (print "Port I/O statistics (block time in microseconds)")
+        (print "                              buffering    read(bytes)   write(bytes)  fills flushes syscalls bytes/call  block")
+        (print "-----------------------------+---------+--------------+--------------+------+-------+--------+---------+-------")
+        (dolist [e (if (integer? max-rows) (take* r max-rows) r)]
+          (let* ([s (cdr e)]
+                 [bytes (+ (get-keyword :bytes-read s)
+                           (get-keyword :bytes-written s))]
+                 [calls (get-keyword :syscalls s)])
+            (format #t "~29a ~9a ~14d ~14d ~6d ~7d ~8d ~9a ~6d\n"
+                    (let1 n (write-to-string (car e))
+                      (if (> (string-length n) 29) (string-take n 29) n))
+                    (or (get-keyword :buffering s) "-")
+                    (get-keyword :bytes-read s)
+                    (get-keyword :bytes-written s)
+                    (get-keyword :fills s)
+                    (get-keyword :flushes s)
+                    calls
+                    (if (zero? calls) "-" (quotient bytes calls))
+                    (exact (round (* (get-keyword :block-time s) 1e6))))))))))
+
+;;
+;; Heap census.  Forces a full GC and counts the live objects per class.
+;; The result is a plist; :classes is a list of (class count . bytes)
+;; sorted by bytes, and :largest is a list of #(class bytes address obj)
+;; of the largest objects.  Objects without a class header are counted
+;; under the symbols *untagged* and *atomic*.
+;; NB: this part depends on the result of %heap-census.  Keep this in sync
+;; with src/core.c.
+;;
+
+(define (heap-census :key (max-largest 10))
+  (match-let1 (count bytes classes largest) (%heap-census max-largest)
+    (list :time (sys-time) :count count :bytes bytes
+          :classes (sort classes (^(a b) (> (cddr a) (cddr b))))
+          :largest largest)))
+
+(define (heap-census-show :key (max-rows 20) (census #f))
+  (let* ([c (or census (heap-census))]
+         [total (get-keyword :bytes c)])
+    (format #t "Heap census (~d objects, ~d bytes)\n"
+            (get-keyword :count c) total)
+    (format #t "~44a ~12@a~16@a\n" "Class" "objects" "bytes")
+    (print "--------------------------------------------+------------+----------------")
+    (dolist [e (if (integer? max-rows)
+                 (take* (get-keyword :classes c) max-rows)
+                 (get-keyword :classes c))]
+      (format #t "~44a ~12d~10d(~3d%)\n"
+              (heap-class-name (car e)) (cadr e) (cddr e)
+              (if (zero? total) 0 (exact (round (* 100 (/ (cddr e) total)))))))
+    (unless (null? (get-keyword :largest c))
+      (print)
+      (format #t "~44a ~12@a  ~a\n" "Largest objects" "bytes" "address")
+      (print "--------------------------------------------+------------+----------------")
+      (dolist [v (get-keyword :largest c)]
+        (format #t "~44a ~12d  #x~x\n"
+                (heap-class-name (vector-ref v 0))
+                (vector-ref v 1) (vector-ref v 2))))))
+
+;;
+;; Retention paths.  Finds the paths from the roots (global variables
+;; of named modules, the stack, parameters and registers of THREADS,
+;; and the given ROOTS, a list of (label . obj)) to TARGET, which is either
+;; a class to find its instances, or an object.  Each path is
+;; (root-label #(class bytes address obj) ...).
+;;
+
+(define (heap-retention-paths target :key (max-paths 3) (max-nodes 1000000)
+                              (roots '()) (threads (list (current-thread))))
+  (%heap-retention-paths target roots threads max-paths max-nodes))
+
+(define (heap-retention-paths-show target . opts)
+  (let1 paths (apply heap-retention-paths target opts)
+    (if (null? paths)
+      (print "No retention paths found.")
+      (dolist [p paths]
+        (format #t "~s\n" (car p))
+        (dolist [v (cdr p)]
+          (format #t "  ~a (~d bytes) #x~x~a\n"
+                  (heap-class-name (vector-ref v 0))
+                  (vector-ref v 1) (vector-ref v 2)
+                  (if (vector-ref v 3)
+                    (let1 s (write-to-string (vector-ref v 3))
+                      (string-append " "
+                                     (if (> (string-length s) 40)
+                                       (string-append (string-take s 40) "...")
+                                       s)))
+                    "")))))))
+
+;;
+;; Heap snapshots.  A snapshot file keeps the per-class counts of a
+;; census, with the classes by name, so that you can compare two points
+;; in time, possibly of different processes.
+;;
+
+(define (heap-snapshot-save file :optional (census (heap-census)))
+  (with-output-to-file file
+    (^[] (write `(heap-snapshot 1
+                                :time ,(get-keyword :time census)
+                                :count ,(get-keyword :count census)
+                                :bytes ,(get-keyword :bytes census)
+                                :classes ,(map (^e (list (heap-class-name (car e))
+                                                         (cadr e) (cddr e)))
+                                               (get-keyword :classes census))))
+         (newline))))
+
+(define (heap-snapshot-load file)
+  (match (with-input-from-file file read)
+    [('heap-snapshot 1 . plist) plist]
+    [_ (error "not a heap snapshot file:" file)]))
+
+;; OLD and NEW may be a census, a loaded snapshot or a snapshot file name.
+;; Returns a list of (class-name count-delta bytes-delta) of the classes
+;; that have changed, sorted by bytes-delta.
+(define (heap-snapshot-diff old new)
+  (define (counts x)
+    (rlet1 tab (make-hash-table 'eq?)
+      (dolist [e (get-keyword :classes
+                              (if (string? x) (heap-snapshot-load x) x))]
+        (match e
+          [(name count bytes) (heap-count-add! tab name count bytes)]
+          [(class count . bytes)
+           (heap-count-add! tab (heap-class-name class) count bytes)]))))
+  (let ([o (counts old)] [n (counts new)])
+    (hash-table-for-each o (^[k v] (unless (hash-table-exists? n k)
+                                     (hash-table-put! n k '(0 . 0)))))
+    ($ (cut sort <> (^(a b) (> (caddr a) (caddr b))))
+       $ filter (^e (not (and (zero? (cadr e)) (zero? (caddr e)))))
+       $ hash-table-map n
+       (^[k v] (let1 ov (hash-table-get o k '(0 . 0))
+                 (list k (- (car v) (car ov)) (- (cdr v) (cdr ov))))))))
+
+(define (heap-snapshot-diff-show old new :key (max-rows 20))
+  (let1 r (heap-snapshot-diff old new)
+    (if (null? r)
+      (print "No difference.")
+      (begin
+        (format #t "~44a ~12@a~16@a\n" "Class" "objects" "bytes")
+        (print "--------------------------------------------+------------+----------------")
+        (dolist [e (if (integer? max-rows) (take* r max-rows) r)]
+          (format #t "~44a ~12@a~16@a\n" (car e)
+                  (signed (cadr e)) (signed (caddr e))))))))
+
+(define (signed n)
+  (if (positive? n) (format "+~d" n) (number->string n)))
+
+(define (heap-class-name c)
+  (if (is-a? c <class>) (class-name c) c))
+
+(define (heap-count-add! tab name count bytes)
+  (hash-table-update! tab name
+                      (^p (cons (+ (car p) count) (+ (cdr p) bytes)))
+                      '(0 . 0)))
+
+;;
+;; Code memory usage.  Counts the compiled code reachable from the global
+;; bindings of each module, including the nested code, by the bytes of
+;; the code vectors, the constants and the debug info.  Each entry is
+;; (module-name codes code-bytes constant-bytes debug-info-bytes), sorted
+;; by the total bytes.  A code shared by bindings of more than one module
+;; is counted in each of them.
+;; NB: this part depends on the result of %code-memory-usage.  Keep this
+;; in sync with src/code.c.
+;;
+
+(define (code-memory-usage :optional (modules (all-modules)))
+  (sort (filter-map (^m (match (%code-memory-usage
+                                (hash-table-values (module-table m)))
+                          [(0 . _) #f]
+                          [u (cons (module-name m) u)]))
+                    modules)
+        (^(a b) (> (code-memory-total a) (code-memory-total b)))))
+
+(define (code-memory-total e) (apply + (cddr e)))
+
+(define (code-memory-usage-show :key (max-rows 20) (modules (all-modules)))
+  (let* ([usage (code-memory-usage modules)]
+         [total (fold (^(e s) (+ (code-memory-total e) s)) 0 usage)])
+    (format #t "Code memory usage (~d modules, ~d bytes)\n"
+            (length usage) total)
+    (format #t "~32a ~7@a ~10@a ~10@a ~10@a ~13@a\n"
+            "Module" "codes" "code" "constants" "debug-info" "total")
+    (print "--------------------------------+-------+----------+----------+----------+--------------")
+    (dolist [e (if (integer? max-rows) (take* usage max-rows) usage)]
+      (format #t "~32a ~7d ~10d ~10d ~10d ~7d(~3d%)\n"
+              (let1 n (write-to-string (car e))
+                (if (> (string-length n) 32) (string-take n 32) n))
+              (list-ref e 1) (list-ref e 2) (list-ref e 3) (list-ref e 4)
+              (code-memory-total e)
+              (if (zero? total)
+                0
+                (exact (round (* 100 (/ (code-memory-total e) total)))))))))
+
 ;; Convenience API
 (define (with-profiler thunk)
   (receive vals (dynamic-wind
@@ -136,7 +538,7 @@
 ;; Show the result in a comprehensive way
 (define (show-stats stat sort-by max-rows)
   (let* ([num-samples (fold (^(entry cnt) (+ (cddr entry) cnt)) 0 stat)]
-         [sum-time (* num-samples 0.01)]
+         [sum-time (* num-samples (profiler-sampling-period) 1e-6)]
          [sorter (case sort-by
                    [(time)
                     (^(a b) (or (> (cddr a) (cddr b))
@@ -166,13 +568,31 @@
                   (exact (round (* 100 (/ samples num-samples))))))))
     ))
 
+;; Show the allocation stats, by procedure and by C type
+(define (show-alloc-stats alloc max-rows)
+  (define total (fold (^(e sum) (+ (cadr e) sum)) 0
+                      (get-keyword :types alloc)))
+  (define (show-table title rows)
+    (format #t "~44a ~12@a~16@a\n" title "bytes" "objects")
+    (print "--------------------------------------------+------------------+----------")
+    (dolist [e (if (integer? max-rows) (take* rows max-rows) rows)]
+      (match-let1 (name bytes . objs) e
+        (format #t "~44a ~12d(~3d%) ~9d\n"
+                (or name "???") bytes
+                (if (zero? total) 0 (exact (round (* 100 (/ bytes total)))))
+                objs))))
+  (print "Allocation statistics (about "total" bytes, sampled every "
+         (profiler-alloc-sampling-period)" bytes)")
+  (show-table "Name" (get-keyword :procedures alloc))
+  (newline)
+  (show-table "C type" (get-keyword :types alloc)))
 
 ;; Get a fixed-decimal notation of time/call (in us)
 ;; If the time is under 100ms:  ##.####
 ;; If the time is under 10^6ms: ###.### - ######.
 ;; Else print as is.
 (define (time/call samples ncalls)
-  (let1 time (* 10.0 (/ samples ncalls)) ;; in ms
+  (let1 time (* (profiler-sampling-period) 1e-3 (/ samples ncalls)) ;; in ms
     (receive (frac int) (modf (* time 10000))
       (let1 val (exact (if (>= frac 0.5) (+ int 1) int))
         (receive (q r) (quotient&remainder val 10000)
@@ -0,0 +1,670 @@
+;;;
+;;; net/http-server.scm - HTTP/1.1 server
+;;;
+;;;   Copyright (c) 2015  Shiro Kawai  <shiro@acm.org>
+;;;
+;;;   Redistribution and use in source and binary forms, with or without
+;;;   modification, are permitted provided that the following conditions
+;;;   are met:
+;;;
+;;;   1. Redistributions of source code must retain the above copyright
+;;;      notice, this list of conditions and the following disclaimer.
+;;;
+;;;   2. Redistributions in binary form must reproduce the above copyright
+;;;      notice, this list of conditions and the following disclaimer in the
+;;;      documentation and/or other materials provided with the distribution.
+;;;
+;;;   3. Neither the name of the authors nor the names of its contributors
+;;;      may be used to endorse or promote products derived from this
+;;;      software without specific prior written permission.
+;;;
+;;;   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+;;;   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+;;;   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+;;;   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+;;;   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+;;;   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+;;;   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+;;;   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+;;;   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+;;;   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+;;;   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+;;;
+
+;; Structure:
+;;
+;;  - One thread (the one that calls http-server-start!) runs the event
+;;    loop.  It accepts connections, and receives request heads from
+;;    idle connections into per-connection buffers, watching the sockets
+;;    with the system poller (epoll/kqueue/poll, the one gauche.selector
+;;    uses) or select(2).
+;;  - Once a complete head is received, the connection is handed to
+;;    a thread pool.  A worker reads the request body, calls the handler,
+;;    and writes the response.  If the connection can be kept alive,
+;;    it is given back to the event loop.
+;;
+;; So a connection is owned either by the event loop or by a worker,
+;; never by both.  An idle keep-alive connection costs only its buffer.
+
+(define-module net.http-server
+  (use gauche.net)
+  (use gauche.threads)
+  (use gauche.uvector)
+  (use gauche.record)
+  (use control.thread-pool)
+  (use file.util)
+  (use rfc.uri)
+  (use rfc.http)
+  (use srfi-1)
+  (use srfi-13)
+  (export <http-server> make-http-server http-server-start!
+          http-server-stop! http-server-port
+
+          <http-request> http-request-method http-request-uri
+          http-request-path http-request-query http-request-version
+          http-request-headers http-request-header http-request-body
+          http-request-remote-address
+
+          <http-request-error> http-static-handler))
+(select-module net.http-server)
+
+(define %parse-head (with-module gauche.net %http-parse-request-head))
+(define %find-eol   (with-module gauche.net %http-find-eol))
+
+;;==============================================================
+;; Public classes
+;;
+
+(define-class <http-server> ()
+  ((handler            :init-keyword :handler)
+   (socket             :init-keyword :socket)
+   (threads            :init-keyword :threads)
+   (keep-alive-timeout :init-keyword :keep-alive-timeout)
+   (max-header-size    :init-keyword :max-header-size)
+   (max-body-size      :init-keyword :max-body-size)
+   (error-log          :init-keyword :error-log)
+   ;; runtime
+   (pool       :init-value #f)
+   (running    :init-value #f)
+   (stopping   :init-value #f)
+   (lock       :init-form (make-mutex))
+   (returned   :init-value '())       ; connections given back by workers
+   (wake-pending :init-value #f)
+   (wake-in    :init-value #f)
+   (wake-out   :init-value #f)))
+
+(define-class <http-request> ()
+  ((method  :init-keyword :method)     ; symbol
+   (uri     :init-keyword :uri)        ; request-uri as received
+   (path    :init-keyword :path)       ; decoded path
+   (query   :init-keyword :query)      ; query string or #f
+   (version :init-keyword :version)    ; "1.1" etc.
+   (headers :init-keyword :headers)    ; ((name value) ...), names lowercased
+   (body    :init-value #f)            ; u8vector or #f
+   (remote-address :init-keyword :remote-address)))
+
+(define (http-request-method r)  (~ r'method))
+(define (http-request-uri r)     (~ r'uri))
+(define (http-request-path r)    (~ r'path))
+(define (http-request-query r)   (~ r'query))
+(define (http-request-version r) (~ r'version))
+(define (http-request-headers r) (~ r'headers))
+(define (http-request-body r)    (~ r'body))
+(define (http-request-remote-address r) (~ r'remote-address))
+
+(define (http-request-header r name :optional (default #f))
+  (if-let1 p (assoc (string-downcase name) (~ r'headers))
+    (cadr p)
+    default))
+
+;; Raised while reading a request to reply with STATUS and give up
+;; the connection.
+(define-condition-type <http-request-error> <error> #f
+  (status))
+
+(define (request-error status fmt . args)
+  (error <http-request-error> :status status (apply format fmt args)))
+
+(define (make-http-server handler
+                          :key (port 8080)
+                               (host #f)
+                               (socket #f)
+                               (threads 8)
+                               (backlog 128)
+                               (keep-alive-timeout 15)
+                               (max-header-size 8192)
+                               (max-body-size (* 16 1024 1024))
+                               (error-log (current-error-port)))
+  (make <http-server>
+    :handler handler
+    :socket (cond
+             [socket]
+             [host
+              (make-server-socket (make <sockaddr-in> :host host :port port)
+                                  :reuse-addr? #t :backlog backlog)]
+             [else
+              (make-server-socket 'inet port
+                                  :reuse-addr? #t :backlog backlog)])
+    :threads threads
+    :keep-alive-timeout keep-alive-timeout
+    :max-header-size max-header-size
+    :max-body-size max-body-size
+    :error-log error-log))
+
+;; The actual port number; useful if the server is created with port 0.
+(define (http-server-port server)
+  (sockaddr-port (socket-getsockname (~ server'socket))))
+
+;;==============================================================
+;; Connections
+;;
+
+;; The received bytes are in BUF[START, END).
+(define-record-type conn %make-conn #t
+  socket fd addr out
+  (buf) (start) (end)
+  (deadline)      ; when the idle connection times out
+  (watched))      ; #t while registered to the poller
+
+(define *initial-buffer-size* 8192)
+
+(define (make-conn sock)
+  (%make-conn sock (socket-fd sock) (socket-address sock)
+              (socket-output-port sock :buffering :full)
+              (make-u8vector *initial-buffer-size*) 0 0 0 #f))
+
+(define (conn-close! conn)
+  (guard (e [(<system-error> e) #f])
+    (socket-shutdown (conn-socket conn) 2))
+  (socket-close (conn-socket conn)))
+
+(define (conn-available conn) (- (conn-end conn) (conn-start conn)))
+
+;; Make room after END, by moving the content to the front or by
+;; growing the buffer.
+(define (conn-make-room! conn)
+  (let ([buf (conn-buf conn)]
+        [start (conn-start conn)]
+        [end (conn-end conn)])
+    (cond [(< end (u8vector-length buf))]
+          [(> start 0)
+           (u8vector-copy! buf 0 buf start end)
+           (conn-start-set! conn 0)
+           (conn-end-set! conn (- end start))]
+          [else
+           (let1 new (make-u8vector (* 2 (u8vector-length buf)))
+             (u8vector-copy! new 0 buf 0 end)
+             (conn-buf-set! conn new))])))
+
+;; Receive into the buffer.  Returns the number of bytes received; 0 means
+;; the peer has closed the connection.  This blocks if there's no data,
+;; so the event loop calls it only when the socket is readable.
+(define (conn-fill! conn)
+  (conn-make-room! conn)
+  (rlet1 n (socket-recv! (conn-socket conn)
+                         (uvector-alias <u8vector> (conn-buf conn)
+                                        (conn-end conn)))
+    (conn-end-set! conn (+ (conn-end conn) n))))
+
+;; Blocks until we have at least N bytes in the buffer.
+(define (conn-ensure! conn n)
+  (until (>= (conn-available conn) n)
+    (when (zero? (conn-fill! conn))
+      (request-error 400 "connection closed in the request body"))))
+
+;; Returns a line (without EOL) as a string, blocking if needed.
+(define (conn-read-line! conn limit)
+  (let loop ()
+    (if-let1 eol (%find-eol (conn-buf conn) (conn-start conn) (conn-end conn))
+      (let* ([start (conn-start conn)]
+             [e (if (and (> eol (+ start 1))
+                         (= (u8vector-ref (conn-buf conn) (- eol 2)) 13))
+                  (- eol 2)
+                  (- eol 1))])
+        (conn-start-set! conn eol)
+        (u8vector->string (conn-buf conn) start e))
+      (begin
+        (when (> (conn-available conn) limit)
+          (request-error 400 "line too long in the request body"))
+        (when (zero? (conn-fill! conn))
+          (request-error 400 "connection closed in the request body"))
+        (loop)))))
+
+;; Reads N bytes of body into a fresh u8vector.  The bytes already
+;; buffered are copied, and the rest is received directly into the
+;; result.
+(define (conn-read-bytes! conn n)
+  (rlet1 v (make-u8vector n)
+    (let1 k (min n (conn-available conn))
+      (u8vector-copy! v 0 (conn-buf conn) (conn-start conn)
+                      (+ (conn-start conn) k))
+      (conn-start-set! conn (+ (conn-start conn) k))
+      (let loop ([k k])
+        (when (< k n)
+          (let1 r (socket-recv! (conn-socket conn)
+                                (uvector-alias <u8vector> v k))
+            (when (zero? r)
+              (request-error 400 "connection closed in the request body"))
+            (loop (+ k r))))))))
+
+;;==============================================================
+;; Readiness notification
+;;
+
+;; We use the system poller directly when available, for gauche.selector
+;; keeps handlers in lists, which doesn't scale to many connections.
+;; Without the poller, we fall back to select(2).
+(define (make-watcher)
+  (cond-expand
+   [gauche.sys.poller (make-sys-poller)]
+   [else (make-hash-table 'eqv?)]))
+
+(define (watch! w fd)
+  (cond-expand
+   [gauche.sys.poller (sys-poller-add! w fd '(r))]
+   [else (hash-table-put! w fd #t)]))
+
+(define (unwatch! w fd)
+  (cond-expand
+   [gauche.sys.poller (sys-poller-delete! w fd)]
+   [else (hash-table-delete! w fd)]))
+
+;; Returns a list of readable fds.
+(define (watch-wait w timeout)
+  (cond-expand
+   [gauche.sys.poller (map car (sys-poller-wait w timeout 256))]
+   [else
+    (receive (n rfds wfds xfds)
+        (sys-select (list->sys-fdset (hash-table-keys w)) #f #f timeout)
+      (if (and n (> n 0))
+        (filter (cut sys-fdset-ref rfds <>) (hash-table-keys w))
+        '()))]))
+
+(define (watcher-close! w)
+  (cond-expand
+   [gauche.sys.poller (sys-poller-close w)]
+   [else #f]))
+
+;; Called from workers; wakes up the event loop.  We write a byte only
+;; when the loop hasn't been notified yet, so the loop reads exactly
+;; one byte per wake-up.
+(define (wake-loop! server thunk)
+  (with-locking-mutex (~ server'lock)
+    (^[] (thunk)
+         (unless (~ server'wake-pending)
+           (set! (~ server'wake-pending) #t)
+           (write-byte 0 (~ server'wake-out))
+           (flush (~ server'wake-out))))))
+
+(define (give-back! server conn)
+  (wake-loop! server (^[] (push! (~ server'returned) conn))))
+
+(define (http-server-stop! server)
+  (when (~ server'running)
+    (wake-loop! server (^[] (set! (~ server'stopping) #t)))))
+
+;;==============================================================
+;; Event loop
+;;
+
+(define (current-seconds) (time->seconds (current-time)))
+
+(define (http-server-start! server)
+  (define lsock (~ server'socket))
+  (define lfd (socket-fd lsock))
+  (define w (make-watcher))
+  (define conns (make-hash-table 'eqv?))  ; fd -> conn, owned by the loop
+  (define timeout (~ server'keep-alive-timeout))
+
+  (define (park! conn)
+    (conn-deadline-set! conn (+ (current-seconds) timeout))
+    (unless (conn-watched conn)
+      (hash-table-put! conns (conn-fd conn) conn)
+      (watch! w (conn-fd conn))
+      (conn-watched-set! conn #t)))
+
+  (define (unpark! conn)
+    (when (conn-watched conn)
+      (hash-table-delete! conns (conn-fd conn))
+      (unwatch! w (conn-fd conn))
+      (conn-watched-set! conn #f)))
+
+  (define (drop! conn)
+    (unpark! conn)
+    (conn-close! conn))
+
+  ;; If CONN has a complete request head, dispatch it to a worker.
+  ;; Otherwise wait for more input.
+  (define (consider conn)
+    (guard (e [(<http-request-error> e)
+               (drop-with-error! server conn (condition-ref e 'status))]
+              [(<error> e)
+               (drop-with-error! server conn 400)])
+      (receive (method . rest)
+          (%parse-head (conn-buf conn) (conn-start conn) (conn-end conn))
+        (cond
+         [method
+          (unpark! conn)
+          (apply dispatch! server conn method rest)]
+         [(> (conn-available conn) (~ server'max-header-size))
+          (request-error 431 "request header too large")]
+         [else (park! conn)]))))
+
+  (define (drop-with-error! server conn status)
+    (unpark! conn)
+    (guard (e [else #f])
+      (send-error-response conn status))
+    (conn-close! conn))
+
+  (define (readable! conn)
+    (if (zero? (guard (e [(<system-error> e) 0]) (conn-fill! conn)))
+      (drop! conn)
+      (consider conn)))
+
+  (define (accept!)
+    (guard (e [(<system-error> e) #f])
+      (let1 conn (make-conn (socket-accept lsock))
+        (guard (e [else #f])
+          (socket-setsockopt (conn-socket conn) IPPROTO_TCP TCP_NODELAY 1))
+        (park! conn))))
+
+  (define (take-returned!)
+    (with-locking-mutex (~ server'lock)
+      (^[] (set! (~ server'wake-pending) #f)
+           (begin0 (~ server'returned)
+             (set! (~ server'returned) '())))))
+
+  (define (wake-up!)
+    (let1 returned (take-returned!)
+      (read-byte (~ server'wake-in))
+      ;; a returned connection may already have the next (pipelined)
+      ;; request in its buffer.
+      (for-each consider (reverse returned))))
+
+  (define (sweep! now)
+    (dolist [conn (hash-table-values conns)]
+      (when (< (conn-deadline conn) now)
+        (drop! conn))))
+
+  (when (~ server'running)
+    (error "http server is already running:" server))
+  (receive (in out) (sys-pipe :buffering :none)
+    (set! (~ server'wake-in) in)
+    (set! (~ server'wake-out) out))
+  (set! (~ server'pool) (make-thread-pool (~ server'threads)))
+  (set! (~ server'stopping) #f)
+  (set! (~ server'running) #t)
+  (watch! w lfd)
+  (watch! w (port-file-number (~ server'wake-in)))
+
+  (unwind-protect
+      (let loop ([last-sweep (current-seconds)])
+        (dolist [fd (watch-wait w 1000000)]
+          (cond [(eqv? fd lfd) (accept!)]
+                [(eqv? fd (port-file-number (~ server'wake-in))) (wake-up!)]
+                [(hash-table-get conns fd #f) => readable!]))
+        (unless (~ server'stopping)
+          (let1 now (current-seconds)
+            (if (>= (- now last-sweep) 1)
+              (begin (sweep! now) (loop now))
+              (loop last-sweep)))))
+    (begin
+      (set! (~ server'stopping) #t)
+      (terminate-all! (~ server'pool))
+      (for-each conn-close! (take-returned!))
+      (for-each drop! (hash-table-values conns))
+      (watcher-close! w)
+      (socket-close lsock)
+      (close-port (~ server'wake-in))
+      (close-port (~ server'wake-out))
+      (set! (~ server'running) #f))))
+
+;;==============================================================
+;; Request processing (in worker threads)
+;;
+
+(define (dispatch! server conn method uri version headers next)
+  (conn-start-set! conn next)
+  (receive (path query) (split-request-uri uri)
+    (let1 req (make <http-request>
+                :method method :uri uri :path path :query query
+                :version version :headers headers
+                :remote-address (conn-addr conn))
+      (add-job! (~ server'pool) (^[] (process-request server conn req))))))
+
+;; Given request-uri (path?query, or an absolute URI), returns decoded
+;; path and a query string.
+(define (split-request-uri uri)
+  (receive (scheme user host port path query frag) (uri-parse uri)
+    (values (uri-decode-string (or path "/")) query)))
+
+(define (header-tokens headers name)
+  ($ append-map (^h (string-split (string-downcase (cadr h)) #[\s,]))
+     $ filter (^h (string-ci=? (x->string (car h)) name)) headers))
+
+(define (client-wants-keep-alive? req)
+  (let1 tokens (header-tokens (~ req'headers) "connection")
+    (if (equal? (~ req'version) "1.0")
+      (boolean (member "keep-alive" tokens))
+      (not (member "close" tokens)))))
+
+(define (process-request server conn req)
+  (define keep?
+    (guard (e [(<http-request-error> e)
+               (guard (e2 [else #f])
+                 (send-error-response conn (condition-ref e 'status)))
+               #f]
+              [(<system-error> e) #f]   ;client gone
+              [else (log-error server e) #f])
+      (read-request-body! server conn req)
+      (receive (status headers body) (call-handler server req)
+        (send-response! conn req status headers body
+                        (client-wants-keep-alive? req)))))
+  (if (and keep? (not (~ server'stopping)))
+    (give-back! server conn)
+    (conn-close! conn)))
+
+(define (call-handler server req)
+  (guard (e [(<system-error> e) (raise e)]
+            [else (log-error server e)
+                  (values 500 '(("content-type" "text/plain"))
+                          "Internal Server Error")])
+    ((~ server'handler) req)))
+
+(define (log-error server e)
+  (and-let1 port (~ server'error-log)
+    (guard (e2 [else #f])
+      (report-error e port))))
+
+(define (read-request-body! server conn req)
+  (define headers (~ req'headers))
+  (define (check-size n)
+    (when (> n (~ server'max-body-size))
+      (request-error 413 "request body too large")))
+  (define (continue!)
+    (when (member "100-continue" (header-tokens headers "expect"))
+      (display "HTTP/1.1 100 Continue\r\n\r\n" (conn-out conn))
+      (flush (conn-out conn))))
+  (cond
+   [(member "chunked" (header-tokens headers "transfer-encoding"))
+    (continue!)
+    (set! (~ req'body) (read-chunked-body! conn check-size))]
+   [(assoc "content-length" headers)
+    => (^p (let1 n (string->number (cadr p))
+             (unless (and (exact-integer? n) (>= n 0))
+               (request-error 400 "bad content-length: ~a" (cadr p)))
+             (unless (zero? n)
+               (check-size n)
+               (continue!)
+               (set! (~ req'body) (conn-read-bytes! conn n)))))]))
+
+(define (read-chunked-body! conn check-size)
+  (let loop ([chunks '()] [total 0])
+    (let* ([line (conn-read-line! conn 1024)]
+           [size (string->number (string-take-while line char-set:hex-digit)
+                                 16)])
+      (unless size (request-error 400 "bad chunk size: ~a" line))
+      (if (zero? size)
+        (let skip-trailer ()
+          (if (string-null? (conn-read-line! conn 8192))
+            (concatenate-u8vectors (reverse chunks) total)
+            (skip-trailer)))
+        (begin
+          (check-size (+ total size))
+          (let1 chunk (conn-read-bytes! conn size)
+            (conn-read-line! conn 2)     ;CRLF after the data
+            (loop (cons chunk chunks) (+ total size))))))))
+
+(define (concatenate-u8vectors vs total)
+  (rlet1 r (make-u8vector total)
+    (fold (^[v k] (u8vector-copy! r k v) (+ k (u8vector-length v))) 0 vs)))
+
+;;==============================================================
+;; Sending response
+;;
+
+;; HTTP-date is cached, for it only changes once a second.
+(define *date-cache* (cons 0 ""))
+
+(define (http-date)
+  (let ([now (sys-time)]
+        [c *date-cache*])
+    (if (= (car c) now)
+      (cdr c)
+      (rlet1 s (sys-strftime "%a, %d %b %Y %H:%M:%S GMT" (sys-gmtime now))
+        (set! *date-cache* (cons now s))))))
+
+(define (status-line status)
+  (format "HTTP/1.1 ~d ~a\r\n" status
+          (or (http-status-code->description status) "Unknown")))
+
+(define (send-error-response conn status)
+  (let ([out (conn-out conn)]
+        [msg (or (http-status-code->description status) "Error")])
+    (display (status-line status) out)
+    (format out "Date: ~a\r\nContent-Type: text/plain\r\n\
+                 Content-Length: ~d\r\nConnection: close\r\n\r\n~a"
+            (http-date) (string-size msg) msg)
+    (flush out)))
+
+;; Returns two values: the kind of the body, and its length in bytes
+;; if it is known beforehand.
+(define (body-info body)
+  (define (chunk-size c)
+    (cond [(string? c) (string-size c)]
+          [(u8vector? c) (u8vector-length c)]
+          [(uvector? c) (uvector-size c)]
+          [else (error "bad response body chunk:" c)]))
+  (cond [(not body) (values 'none 0)]
+        [(string? body) (values 'string (string-size body))]
+        [(uvector? body) (values 'uvector (uvector-size body))]
+        [(list? body) (values 'chunks (fold + 0 (map chunk-size body)))]
+        [(input-port? body)
+         (if-let1 size (and-let* ([fd (port-file-number body)]
+                                  [st (sys-fstat fd)]
+                                  [ (eq? (sys-stat->file-type st) 'regular) ]
+                                  [pos (port-tell body)])
+                         (- (sys-stat->size st) pos))
+           (values 'file size)
+           (values 'port #f))]
+        [(procedure? body) (values 'proc #f)]
+        [else (error "bad response body:" body)]))
+
+;; Writes the response.  Returns #t if the connection can be kept alive.
+(define (send-response! conn req status headers body keep?)
+  (define out (conn-out conn))
+  (define v10? (equal? (~ req'version) "1.0"))
+  (define no-body? (or (< status 200) (memv status '(204 304))))
+  (define send-body? (not (or no-body? (eq? (~ req'method) 'HEAD))))
+  (receive (kind len) (body-info body)
+    (let* ([chunked? (and (not len) (not v10?))]
+           [keep? (and keep?
+                       (or len chunked?)
+                       (not (member "close" (header-tokens headers
+                                                           "connection"))))])
+      (display (status-line status) out)
+      (dolist [h headers]
+        (unless (member (string-downcase (x->string (car h)))
+                        '("content-length" "transfer-encoding" "connection"
+                          "date"))
+          (format out "~a: ~a\r\n" (car h) (cadr h))))
+      (format out "Date: ~a\r\n" (http-date))
+      (unless no-body?
+        (if len
+          (format out "Content-Length: ~d\r\n" len)
+          (when chunked? (display "Transfer-Encoding: chunked\r\n" out))))
+      (cond [(not keep?) (display "Connection: close\r\n\r\n" out)]
+            [v10? (display "Connection: keep-alive\r\n\r\n" out)]
+            [else (display "\r\n" out)])
+      (if send-body?
+        (send-body! conn kind body len chunked?)
+        (when (input-port? body) (close-input-port body)))
+      (flush out)
+      keep?)))
+
+(define (send-body! conn kind body len chunked?)
+  (define out (conn-out conn))
+  (define (send-chunk data)
+    (let1 size (if (string? data) (string-size data) (uvector-size data))
+      (unless (zero? size)
+        (when chunked? (format out "~x\r\n" size))
+        (if (string? data) (display data out) (write-uvector data out))
+        (when chunked? (display "\r\n" out)))))
+  (case kind
+    [(none)]
+    [(string) (display body out)]
+    [(uvector) (write-uvector body out)]
+    [(chunks) (write-chunks body out)]
+    [(file) (unwind-protect (socket-sendfile (conn-socket conn) body len)
+              (close-input-port body))]
+    [(port)
+     (unwind-protect
+         (let1 buf (make-u8vector 65536)
+           (let loop ()
+             (let1 n (read-uvector! buf body)
+               (unless (eof-object? n)
+                 (send-chunk (if (= n 65536) buf (uvector-alias <u8vector> buf 0 n)))
+                 (loop)))))
+       (close-input-port body))]
+    [(proc) (body send-chunk)])
+  (when chunked? (display "0\r\n\r\n" out)))
+
+;;==============================================================
+;; Static files
+;;
+
+(define *content-types*
+  '(("html" . "text/html") ("htm" . "text/html") ("css" . "text/css")
+    ("js" . "application/javascript") ("json" . "application/json")
+    ("txt" . "text/plain") ("xml" . "application/xml")
+    ("png" . "image/png") ("jpg" . "image/jpeg") ("jpeg" . "image/jpeg")
+    ("gif" . "image/gif") ("svg" . "image/svg+xml") ("ico" . "image/x-icon")
+    ("pdf" . "application/pdf") ("wasm" . "application/wasm")))
+
+;; Returns a handler that serves files under ROOT.  The file content
+;; is sent with sendfile(2) where available.
+(define (http-static-handler root :key (index "index.html")
+                                       (content-types '()))
+  (define types (append content-types *content-types*))
+  (define (content-type path)
+    (or (and-let* ([ext (path-extension path)])
+          (assoc-ref types (string-downcase ext)))
+        "application/octet-stream"))
+  (define (not-found)
+    (values 404 '(("Content-Type" "text/plain")) "Not Found"))
+  (^[req]
+    (let1 comps (string-split (http-request-path req) #\/)
+      (cond
+       [(not (memq (http-request-method req) '(GET HEAD)))
+        (values 405 '(("Allow" "GET, HEAD") ("Content-Type" "text/plain"))
+                "Method Not Allowed")]
+       [(any (^c (member c '(".." "."))) comps) (not-found)]
+       [else
+        (let* ([p (apply build-path root (remove string-null? comps))]
+               [p (if (and index (file-is-directory? p))
+                    (build-path p index)
+                    p)])
+          (if (file-is-regular? p)
+            (values 200 `(("Content-Type" ,(content-type p)))
+                    (open-input-file p))
+            (not-found)))]))))
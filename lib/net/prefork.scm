@@ -0,0 +1,331 @@
+;;;
+;;; net/prefork.scm - pre-forking multi-process server
+;;;
+;;;   Copyright (c) 2015  Shiro Kawai  <shiro@acm.org>
+;;;
+;;;   Redistribution and use in source and binary forms, with or without
+;;;   modification, are permitted provided that the following conditions
+;;;   are met:
+;;;
+;;;   1. Redistributions of source code must retain the above copyright
+;;;      notice, this list of conditions and the following disclaimer.
+;;;
+;;;   2. Redistributions in binary form must reproduce the above copyright
+;;;      notice, this list of conditions and the following disclaimer in the
+;;;      documentation and/or other materials provided with the distribution.
+;;;
+;;;   3. Neither the name of the authors nor the names of its contributors
+;;;      may be used to endorse or promote products derived from this
+;;;      software without specific prior written permission.
+;;;
+;;;   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+;;;   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+;;;   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+;;;   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+;;;   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+;;;   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+;;;   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+;;;   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+;;;   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+;;;   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+;;;   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+;;;
+
+;; Structure:
+;;
+;;  - The parent process (the one that calls prefork-server-start!)
+;;    binds the address, then forks the workers and supervises them.
+;;    It doesn't serve requests.
+;;  - With SO_REUSEPORT, each worker opens its own listening socket on
+;;    the address, and the kernel distributes the connections among
+;;    them.  The parent keeps a bound but non-listening socket, only to
+;;    hold the port (so port 0 works) across the worker restarts; a
+;;    socket that doesn't listen doesn't get connections.
+;;    Without SO_REUSEPORT, the parent listens and the workers accept
+;;    on the inherited socket.
+;;  - The parent sleeps until a signal (SIGCHLD included) arrives, or
+;;    a short interval passes.  It respawns the workers that died,
+;;    replaces all of them on SIGHUP, and stops them on SIGTERM/SIGINT.
+;;    Workers are stopped with SIGTERM, and killed if they don't exit
+;;    within the graceful timeout.
+
+(define-module net.prefork
+  (use gauche.net)
+  (use gauche.threads)
+  (use gauche.record)
+  (use srfi-1)
+  (export <prefork-server> make-prefork-server prefork-server-start!
+          prefork-server-stop! prefork-server-restart!
+          prefork-server-port prefork-server-pids
+          prefork-worker-index))
+(select-module net.prefork)
+
+(define-class <prefork-server> ()
+  ((worker           :init-keyword :worker)  ; (^[socket] ...), in a child
+   (stop             :init-keyword :stop)    ; thunk or #f, in a child
+   (num-workers      :init-keyword :num-workers)
+   (address          :init-keyword :address)
+   (backlog          :init-keyword :backlog)
+   (reuse-port?      :init-keyword :reuse-port?)
+   (graceful-timeout :init-keyword :graceful-timeout)
+   (on-restart       :init-keyword :on-restart)
+   (prepare-fork?    :init-keyword :prepare-fork?)
+   (error-log        :init-keyword :error-log)
+   ;; runtime, in the parent
+   (socket     :init-value #f)
+   (children   :init-form (make-hash-table 'eqv?)) ; pid -> child
+   (respawn-at :init-value #f)          ; vector of times, by index
+   (generation :init-value 0)
+   (request    :init-value #f)          ; #f, stop or restart
+   (running    :init-value #f)))
+
+(define-record-type child %make-child #t
+  pid index generation
+  (term-sent))                          ; time SIGTERM was sent, or #f
+
+(define (reuse-port-available?)
+  (global-variable-bound? 'gauche.net 'SO_REUSEPORT))
+
+(define (make-prefork-server worker
+                             :key (port 8080)
+                                  (host #f)
+                                  (workers (sys-available-processors))
+                                  (backlog 128)
+                                  (reuse-port :auto)
+                                  (stop #f)
+                                  (graceful-timeout 30)
+                                  (on-restart #f)
+                                  (prepare-fork #t)
+                                  (error-log (current-error-port)))
+  (unless (and (exact-integer? workers) (positive? workers))
+    (error "workers must be a positive exact integer, but got:" workers))
+  (when (and (eq? reuse-port #t) (not (reuse-port-available?)))
+    (error "SO_REUSEPORT isn't supported on this platform"))
+  (make <prefork-server>
+    :worker worker
+    :stop stop
+    :num-workers workers
+    :address (if host
+               (make <sockaddr-in> :host host :port port)
+               (car (make-sockaddrs #f port)))
+    :backlog backlog
+    :reuse-port? (if (eq? reuse-port :auto)
+                   (reuse-port-available?)
+                   (and reuse-port #t))
+    :graceful-timeout graceful-timeout
+    :on-restart on-restart
+    :prepare-fork? prepare-fork
+    :error-log error-log))
+
+;; The actual port number; useful if the server is created with port 0.
+;; Valid while the server is running.
+(define (prefork-server-port server)
+  (and-let1 s (~ server'socket)
+    (sockaddr-port (socket-getsockname s))))
+
+(define (prefork-server-pids server)
+  (hash-table-keys (~ server'children)))
+
+;; These just post a request, so they can be called from a signal
+;; handler or another thread of the parent.  The supervisor acts on it
+;; within a fraction of a second.
+(define (prefork-server-stop! server)
+  (set! (~ server'request) 'stop))
+
+(define (prefork-server-restart! server)
+  (unless (eq? (~ server'request) 'stop)
+    (set! (~ server'request) 'restart)))
+
+;; The index of the worker in the child process, #f in the parent.
+(define *worker-index* #f)
+(define (prefork-worker-index) *worker-index*)
+
+(define (current-seconds)
+  (receive (sec nsec) (sys-clock-gettime-monotonic)
+    (if sec
+      (+ sec (/. nsec 1e9))
+      (time->seconds (current-time)))))
+
+(define (log-error server fmt . args)
+  (and-let1 port (~ server'error-log)
+    (apply format port fmt args)
+    (flush port)))
+
+;;==============================================================
+;; Parent
+;;
+
+;; A worker that dies sooner than this after starting is respawned
+;; after the same delay, so a broken worker doesn't make us fork
+;; in a tight loop.
+(define *min-lifetime* 1)
+
+;; The longest the supervisor sleeps without a signal, in nanoseconds.
+(define *tick* 250e6)
+
+(define (prefork-server-start! server)
+  (when (~ server'running)
+    (error "prefork server is already running:" server))
+  (set! (~ server'running) #t)
+  (set! (~ server'request) #f)
+  (set! (~ server'respawn-at) (make-vector (~ server'num-workers) 0))
+  (unwind-protect
+      (begin
+        (set! (~ server'socket) (open-parent-socket server))
+        (when (~ server'prepare-fork?) (gc-prepare-fork))
+        (with-signal-handlers
+            (((list SIGTERM SIGINT) (prefork-server-stop! server))
+             (SIGHUP (prefork-server-restart! server))
+             (SIGCHLD #f))              ; just to wake up the sleep
+          (^[] (supervise! server))))
+    (begin
+      (kill-all! server)
+      (and-let1 s (~ server'socket)
+        (socket-close s)
+        (set! (~ server'socket) #f))
+      (set! (~ server'running) #f))))
+
+(define (open-parent-socket server)
+  (if (~ server'reuse-port?)
+    (rlet1 s (make-socket (address->protocol-family (~ server'address))
+                          SOCK_STREAM)
+      (socket-setsockopt s SOL_SOCKET SO_REUSEADDR 1)
+      (socket-setsockopt s SOL_SOCKET
+                         (global-variable-ref 'gauche.net 'SO_REUSEPORT) 1)
+      (socket-bind s (~ server'address)))
+    (make-server-socket (~ server'address)
+                        :reuse-addr? #t :backlog (~ server'backlog))))
+
+(define (supervise! server)
+  (let loop ()
+    (reap! server)
+    (case (~ server'request)
+      [(stop) (stop-all! server)]
+      [(restart)
+       (set! (~ server'request) #f)
+       (replace-all! server)
+       (loop)]
+      [else
+       (spawn-missing! server)
+       (kill-overdue! server)
+       (sys-nanosleep *tick* #t)
+       (loop)])))
+
+(define (spawn! server index)
+  (flush-all-ports)
+  (let1 pid (sys-fork)
+    (if (zero? pid)
+      (run-worker server index)
+      (hash-table-put! (~ server'children) pid
+                       (%make-child pid index (~ server'generation) #f)))))
+
+;; Spawns the workers of the current generation that aren't running.
+(define (spawn-missing! server)
+  (let ([gen (~ server'generation)]
+        [now (current-seconds)])
+    (dotimes [i (~ server'num-workers)]
+      (unless (or (find (^c (and (= (child-index c) i)
+                                 (= (child-generation c) gen)))
+                        (hash-table-values (~ server'children)))
+                  (> (vector-ref (~ server'respawn-at) i) now))
+        (spawn! server i)
+        (vector-set! (~ server'respawn-at) i (+ now *min-lifetime*))))))
+
+;; Collects exited children.  Returns when there's no more.
+(define (reap! server)
+  (let loop ()
+    (receive (pid status)
+        (apply values
+               (guard (e [(<system-error> e) '(0 #f)]) ; ECHILD
+                 (values->list (sys-waitpid -1 :nohang #t))))
+      (when (> pid 0)
+        (and-let1 c (hash-table-get (~ server'children) pid #f)
+          (hash-table-delete! (~ server'children) pid)
+          (unless (or (child-term-sent c)
+                      (and (sys-wait-exited? status)
+                           (zero? (sys-wait-exit-status status))))
+            (log-error server "prefork: worker ~a (pid ~a) ~a\n"
+                       (child-index c) pid
+                       (if (sys-wait-signaled? status)
+                         (format "killed by signal ~a"
+                                 (sys-wait-termsig status))
+                         (format "exited with status ~a"
+                                 (sys-wait-exit-status status))))))
+        (loop)))))
+
+(define (terminate! server c sig)
+  (unless (child-term-sent c)
+    (child-term-sent-set! c (current-seconds)))
+  (guard (e [(<system-error> e) #f])    ; already gone
+    (sys-kill (child-pid c) sig)))
+
+;; Graceful restart: start the new generation, then ask the old one
+;; to finish.  The workers of both generations serve in the meantime.
+(define (replace-all! server)
+  (let1 old (hash-table-values (~ server'children))
+    (and-let1 thunk (~ server'on-restart)
+      (guard (e [else (log-error server "prefork: on-restart: ~a\n"
+                                 (condition-message e))])
+        (thunk)))
+    (inc! (~ server'generation))
+    (vector-fill! (~ server'respawn-at) 0)
+    (spawn-missing! server)
+    (dolist [c old] (terminate! server c SIGTERM))))
+
+(define (kill-overdue! server)
+  (let1 limit (- (current-seconds) (~ server'graceful-timeout))
+    (dolist [c (hash-table-values (~ server'children))]
+      (when (and (child-term-sent c) (< (child-term-sent c) limit))
+        (terminate! server c SIGKILL)))))
+
+;; Graceful stop: ask all workers to finish, and wait for them.
+(define (stop-all! server)
+  (dolist [c (hash-table-values (~ server'children))]
+    (terminate! server c SIGTERM))
+  (until (zero? (hash-table-num-entries (~ server'children)))
+    (kill-overdue! server)
+    (sys-nanosleep *tick* #t)
+    (reap! server)))
+
+;; Used when we exit abnormally.
+(define (kill-all! server)
+  (dolist [c (hash-table-values (~ server'children))]
+    (terminate! server c SIGKILL))
+  (until (zero? (hash-table-num-entries (~ server'children)))
+    (sys-nanosleep *tick* #t)
+    (reap! server)))
+
+;;==============================================================
+;; Child
+;;
+
+;; Never returns.
+(define (run-worker server index)
+  (set! *worker-index* index)
+  ;; In case the worker calls exit, which runs the cleanup of
+  ;; prefork-server-start!.  It mustn't kill our siblings.
+  (hash-table-clear! (~ server'children))
+  (sys-exit
+   (guard (e [else
+              (and-let1 port (~ server'error-log)
+                (report-error e port))
+              70])                      ; EX_SOFTWARE
+     (set-signal-handler! (list SIGHUP SIGINT) #f)
+     (set-signal-handler! SIGCHLD #t)
+     (set-signal-handler! SIGTERM
+                          (if-let1 stop (~ server'stop)
+                            ;; The worker may be holding a lock in
+                            ;; the main thread, so we don't call STOP
+                            ;; within the handler.
+                            (^_ (thread-start! (make-thread stop "prefork-stop")))
+                            #t))
+     (let1 sock (if (~ server'reuse-port?)
+                  (begin
+                    (socket-close (~ server'socket))
+                    (make-server-socket (~ server'address)
+                                        :reuse-addr? #t :reuse-port? #t
+                                        :backlog (~ server'backlog)))
+                  (~ server'socket))
+       ((~ server'worker) sock))
+     (flush-all-ports)
+     0)))
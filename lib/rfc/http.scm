@@ -54,6 +54,8 @@
   (use gauche.charconv)
   (use gauche.sequence)
   (use gauche.uvector)
+  (use gauche.threads)
+  (use gauche.vport)
   (use util.match)
   (use text.tree)
   (export <http-error>
@@ -61,9 +63,13 @@
           http-compose-query http-compose-form-data
           http-status-code->description
 
-          http-proxy http-request
+          make-http-connection-pool http-connection-pool
+          reset-http-connection-pool
+
+          http-proxy http-request http-pipeline
           http-null-receiver http-string-receiver http-oport-receiver
           http-file-receiver http-cond-receiver
+          http-block-receiver http-decoding-receiver
           http-null-sender http-string-sender http-blob-sender
           http-file-sender http-multipart-sender
 
@@ -83,9 +89,12 @@
           mime-compose-parameters
           mime-parse-content-type)
 (autoload rfc.tls
-          make-tls tls-destroy tls-connect tls-input-port tls-output-port tls-close)
+          make-tls tls-destroy tls-connect tls-input-port tls-output-port tls-close
+          tls-session)
 
 (autoload file.util file-size find-file-in-paths null-device)
+(autoload rfc.zlib open-inflating-port)
+(autoload compress.zstd open-zstd-decompressing-port)
 
 ;;==============================================================
 ;; Conditions
@@ -105,6 +114,10 @@
 ;; argument.
 (define http-proxy (make-parameter #f))
 
+;; global connection pool.  can be overridden by :pool keyword argument.
+;; #f to make a new connection for each request.
+(define http-connection-pool (make-parameter #f))
+
 ;; The default redirect handler
 ;;
 (define http-default-redirect-handler
@@ -197,6 +210,8 @@
 ;;
 ;;   host    - the host name passed to the 'host' header field.
 ;;   secure  - if true, using secure connection (via gauche.tls).
+;;   pool    - an <http-connection-pool> to take the connection from, and
+;;             to return it after the request if it can be kept alive.
 ;;   auth-user, auth-password, auth-handler - authentication parameters.
 ;;   request-encoding - when http-* is to construct request-uri and/or
 ;;             request body, this argument specifies the character encoding
@@ -230,6 +245,7 @@
                            (secure #f)
                            (receiver (http-string-receiver))
                            (sender #f)
+                           (pool (http-connection-pool))
                            ((:request-encoding enc) (gauche-character-encoding))
                       :allow-other-keys opts)
 
@@ -242,20 +258,13 @@
                          [(#f) #f]
                          [else => identity])))
   (define options `(:user-agent ,user-agent ,@(http-auth-headers conn) ,@opts))
-  (define no-body-replies '("204" "304"))
-
-  (define (get-body iport method code headers receiver)
-    (and (not (eq? method 'HEAD))
-         (not (member code no-body-replies))
-         (receive-body iport code headers receiver)))
+  ;; set when we get a response; if we fail before that on a reused
+  ;; connection, the server may have closed it, and we can retry.
+  (define responded #f)
 
   ;; final touch of request headers
   (define (req-headers host)
-    (cond-list [(~ conn'persistent) @ (if (~ conn'proxy)
-                                        '(:proxy-connection keep-alive)
-                                        '(:connection keep-alive))]
-               [#t @ `(:host ,host :user-agent ,user-agent
-                       ,@(http-auth-headers conn) ,@opts)]))
+    (request-headers conn pool host user-agent opts))
 
   ;; If we decide to give up redirection, we read from already-retrieved
   ;; body of 3xx reply.  This modifies reply headers if necessary.
@@ -270,24 +279,38 @@
   ;; returns either one of:
   ;;   (reply <code> <headers> <body>)
   ;;   (redirect-to <method> <location>)
+  ;; and whether the connection can be kept alive, and for how long.
   (define (request-response in out method uri host sender)
+    (set! responded #f)
     (send-request out method uri sender (req-headers host) enc)
-    (receive (code rep-headers) (receive-header in)
-      (if-let1 consider-redirect (and (string-prefix? "3" code) redirector)
-        ;; we retrieve body as string, not using caller-provided receiver
-        (let* ([body (get-body in method code rep-headers
-                               (http-string-receiver))]
-               [verdict (consider-redirect method code rep-headers body)])
-          (if verdict
-            `(redirect-to ,(car verdict) ,(cdr verdict))
-            (let1 hdrs (redirect-headers body rep-headers)
-              `(reply ,code ,hdrs
-                      ,(and body
-                            (receive-body (open-input-string body) code
-                                          hdrs receiver))))))
-        ;; no redirection
-        `(reply ,code ,rep-headers
-                ,(get-body in method code rep-headers receiver)))))
+    (receive (code rep-headers version) (receive-header in)
+      (set! responded #t)
+      (let* ([complete #f]
+             [done (^[] (set! complete #t))]
+             [result
+              (if-let1 consider-redirect (and (string-prefix? "3" code)
+                                              redirector)
+                ;; we retrieve body as string, not using caller-provided
+                ;; receiver
+                (let* ([body (receive-response-body in method code rep-headers
+                                                    (http-string-receiver)
+                                                    done)]
+                       [verdict (consider-redirect method code rep-headers
+                                                   body)])
+                  (if verdict
+                    `(redirect-to ,(car verdict) ,(cdr verdict))
+                    (let1 hdrs (redirect-headers body rep-headers)
+                      `(reply ,code ,hdrs
+                              ,(and body
+                                    (receive-body (open-input-string body)
+                                                  code hdrs receiver))))))
+                ;; no redirection
+                `(reply ,code ,rep-headers
+                        ,(receive-response-body in method code rep-headers
+                                               receiver done)))])
+        (values result
+                (and complete (keep-alive? version rep-headers))
+                (keep-alive-timeout rep-headers)))))
 
   ;; main loop
   (let loop ([history '()]
@@ -298,8 +321,9 @@
         (consider-proxy conn (or host (~ conn'server)) request-uri)
       (let1 result
           (with-connection
-           conn
-           (^[i o] (request-response i o method uri host sender)))
+           conn pool
+           (^[i o] (request-response i o method uri host sender))
+           (^[] (and (not responded) (not (eq? method 'POST)))))
         (match result
           [('reply code rep-headers body) (values code rep-headers body)]
           [('redirect-to method location)
@@ -311,6 +335,87 @@
              (loop (cons uri history)
                    (~ (redirect-connection! conn proto new-server)'server)
                    method path*))])))))
+
+;; http-pipeline server requests &keyword host pool secure ...
+;;
+;;  Sends REQUESTS to SERVER without waiting for each response, and
+;;  reads the responses in order.  Each request is a list
+;;  (METHOD REQUEST-URI :receiver RECEIVER :sender SENDER HEADER ...),
+;;  where RECEIVER, SENDER and HEADERs are as in http-request.
+;;  Only idempotent methods can be pipelined.  If the server closes
+;;  the connection halfway, the rest of requests are sent again over a
+;;  new connection.  Redirections are not followed.
+;;  Returns a list of (CODE HEADERS BODY) for each request.
+
+(define (http-pipeline server requests
+                       :key (host #f)
+                            auth-handler
+                            auth-user
+                            auth-password
+                            (proxy (http-proxy))
+                            extra-headers
+                            (user-agent (http-user-agent))
+                            (secure #f)
+                            (pool (http-connection-pool))
+                            ((:request-encoding enc) (gauche-character-encoding))
+                       :allow-other-keys opts)
+
+  (define conn (ensure-connection server auth-handler auth-user auth-password
+                                  proxy secure extra-headers))
+  (define responded #f)
+
+  ;; returns (method uri host sender receiver headers)
+  (define (parse-request req)
+    (match req
+      [((? symbol? method) request-uri . rest)
+       (unless (memq method '(GET HEAD PUT DELETE OPTIONS))
+         (error "non-idempotent request can't be pipelined:" req))
+       (let-keywords rest ([receiver (http-string-receiver)]
+                           [sender (and (eq? method 'PUT) (http-null-sender))]
+                           . headers)
+         (receive (host uri)
+             (consider-proxy conn (or host (~ conn'server))
+                             (ensure-request-uri request-uri enc))
+           (list method uri host sender receiver headers)))]
+      [_ (error "bad request for http-pipeline:" req)]))
+
+  ;; Sends all REQS, then reads as many responses as the connection
+  ;; allows.  If the server closes the connection after some responses,
+  ;; we just return those.
+  (define (pipeline-round in out reqs)
+    (set! responded #f)
+    (dolist [r reqs]
+      (match-let1 (method uri host sender _ headers) r
+        (send-request out method uri sender
+                      (request-headers conn pool host user-agent
+                                       (append headers opts))
+                      enc)))
+    (let loop ([reqs reqs] [results '()])
+      (receive (code headers version)
+          (guard (e [(and responded (connection-closed? e))
+                     (values #f #f #f)])
+            (receive-header in))
+        (if (not code)
+          (values (reverse results) #f #f)
+          (let* ([_ (set! responded #t)]
+                 [complete #f]
+                 [body (receive-response-body in (car (car reqs)) code headers
+                                              (list-ref (car reqs) 4)
+                                              (^[] (set! complete #t)))]
+                 [results (cons (list code headers body) results)]
+                 [keep (and complete (keep-alive? version headers))])
+            (if (and keep (pair? (cdr reqs)))
+              (loop (cdr reqs) results)
+              (values (reverse results) keep
+                      (keep-alive-timeout headers))))))))
+
+  (let loop ([reqs (map parse-request requests)] [rs '()])
+    (if (null? reqs)
+      (concatenate (reverse rs))
+      (let1 r (with-connection conn pool
+                               (^[i o] (pipeline-round i o reqs))
+                               (^[] (not responded)))
+        (loop (drop reqs (length r)) (cons r rs))))))
 ;;
 ;; Pre-defined receivers
 ;;
@@ -351,6 +456,99 @@
                    (begin (sys-rename tmpname filename) filename))]
                 [else (close-output-port port) (sys-unlink tmpname)]))))))
 
+;; Calls PROC with each block of the body, as a u8vector of at most
+;; BLOCK-SIZE bytes, then with an EOF object.  The same buffer is reused
+;; for every block; PROC must copy it if it needs to keep data.  Returns
+;; what PROC returns for the EOF.
+(define (http-block-receiver proc :optional (block-size 65536))
+  (^[code hdrs total retr]
+    (let1 buf (make-u8vector block-size)
+      (define (block n)
+        (if (= n block-size) buf (uvector-alias <u8vector> buf 0 n)))
+      (let loop ()
+        (receive (remote size) (retr)
+          (if (and size (<= size 0))
+            (proc (eof-object))
+            ;; SIZE may be #f, meaning until EOF
+            (let inner ([rest size])
+              (if (eqv? rest 0)
+                (loop)
+                (let1 n (read-block! buf remote 0
+                                     (if rest (min rest block-size) block-size))
+                  (cond [(not (eof-object? n))
+                         (proc (block n))
+                         (inner (and rest (- rest n)))]
+                        [rest (error <http-error> "http body ended prematurely")]
+                        [else (loop)]))))))))))
+
+;; Wraps RECEIVER so that it sees the body decoded according to
+;; Content-Encoding.  The body is decoded on the fly as RECEIVER reads it,
+;; so the memory usage doesn't depend on the body size.  RECEIVER gets
+;; #f as the total size, and the headers without content-encoding and
+;; content-length.
+(define (http-decoding-receiver receiver)
+  (^[code hdrs total retr]
+    (let1 codings (content-codings hdrs)
+      (if (null? codings)
+        (receiver code hdrs total retr)
+        (let* ([raw (body-input-port retr)]
+               [port (fold (^[coding p] (decoding-port coding p))
+                           raw (reverse codings))]
+               [sent #f])
+          (begin0
+              (receiver code
+                        (remove (^h (member (car h) '("content-encoding"
+                                                      "content-length")))
+                                hdrs)
+                        #f
+                        (^[] (if sent
+                               (values port 0)
+                               (begin (set! sent #t) (values port #f)))))
+            ;; consume the rest, so that the connection can be reused
+            (let1 buf (make-u8vector 4096)
+              (until (eof-object? (read-block! buf raw))))))))))
+
+(define (content-codings hdrs)
+  (if-let1 v (rfc822-header-ref hdrs "content-encoding")
+    (remove (^c (member c '("" "identity")))
+            (map string-trim-both (string-split (string-downcase v) #\,)))
+    '()))
+
+;; Content codings are applied in the listed order, so we decode from
+;; the last one; the caller folds over the reversed list.
+(define (decoding-port coding port)
+  (cond [(member coding '("gzip" "x-gzip" "deflate"))
+         ;; window-bits 47 detects both gzip and zlib headers
+         (open-inflating-port port :window-bits 47 :owner? #t)]
+        [(equal? coding "zstd")
+         (open-zstd-decompressing-port port :owner? #t)]
+        [else (error <http-error> "unsupported content-encoding:" coding)]))
+
+;; Returns an input port that reads the body via the receiver callback.
+(define (body-input-port retr)
+  (define remote #f)
+  (define rest 0)                       ;#t for until EOF
+  (define eof #f)
+  (define (filler buf)
+    (cond [eof 0]
+          [(eqv? rest 0)
+           (receive (r size) (retr)
+             (if (and size (<= size 0))
+               (set! eof #t)
+               (begin (set! remote r) (set! rest (or size #t)))))
+           (filler buf)]
+          [else
+           (let1 n (read-block! buf remote 0
+                                (if (eq? rest #t)
+                                  (u8vector-length buf)
+                                  (min rest (u8vector-length buf))))
+             (cond [(not (eof-object? n))
+                    (unless (eq? rest #t) (dec! rest n))
+                    n]
+                   [(eq? rest #t) (set! rest 0) (filler buf)]
+                   [else (error <http-error> "http body ended prematurely")]))]))
+  (make <buffered-input-port> :fill filler))
+
 (define-syntax http-cond-receiver
   (syntax-rules (else =>)
     [(_) (http-null-receiver)]
@@ -700,16 +898,19 @@
   (shutdown-socket-connection conn)
   (shutdown-secure-agent conn))
 
+;; Returns host, port and unix domain socket path of server address.
+;; If address is given ipv6 format such as "[::1]:port", we have to
+;; use "::1" part as the hostname, excluding [].
+(define (parse-server-address addr)
+  (rxmatch-case addr
+    [#/^unix:(\/.*)$/ (_ path) (values #f #f path)] ;unix domain
+    [#/^\[([a-fA-F\d:]+)\](?::(\d+))?$/ (_ host port) (values host port #f)]
+    [#/^([^:]+)(?::(\d+))?$/ (_ host port) (values host port #f)]
+    [else (error "Unrecognized http server address:" addr)]))
+
 (define (start-socket-connection conn)
-  ;; If address is given ipv6 format such as "[::1]:port", we have to
-  ;; use "::1" part as the hostname, excluding [].
-  (define (parse-address addr)
-    (rxmatch-case addr
-      [#/^unix:(\/.*)$/ (_ path) (values #f #f path)] ;unix domain
-      [#/^\[([a-fA-F\d:]+)\](?::(\d+))?$/ (_ host port) (values host port #f)]
-      [#/^([^:]+)(?::(\d+))?$/ (_ host port) (values host port #f)]
-      [else (error "Unrecognized http server address:" addr)]))
-  (receive (host port path) (parse-address (or (~ conn'proxy) (~ conn'server)))
+  (receive (host port path)
+      (parse-server-address (or (~ conn'proxy) (~ conn'server)))
     (set! (~ conn'socket)
           (if path
             (make-client-socket 'unix path)
@@ -724,19 +925,75 @@
     (socket-close (~ conn'socket))
     (set! (~ conn'socket) #f)))
 
-(define (with-connection conn proc)
-  (unless (~ conn'persistent)
-    (unless (~ conn'socket) (start-socket-connection conn))
-    (when (~ conn'secure) (start-secure-agent conn)))
-  (unwind-protect
-      (apply proc (if (~ conn'secure)
-                    `(,(tls-input-port (~ conn'secure-agent))
-                      ,(tls-output-port (~ conn'secure-agent)))
-                    `(,(socket-input-port (~ conn'socket))
-                      ,(socket-output-port (~ conn'socket)))))
-    (unless (~ conn'persistent)
-      (when (~ conn'secure) (shutdown-secure-agent conn))
-      (shutdown-socket-connection conn))))
+(define (start-connection conn)
+  (guard (e [else (reset-http-connection conn) (raise e)])
+    (start-socket-connection conn)
+    (when (~ conn'secure) (start-secure-agent conn))))
+
+;; PROC is called with the input and output ports of the connection, and
+;; returns the result, whether the connection can be kept alive, and
+;; the keep-alive timeout the server suggested (or #f).
+;; If we fail on a reused connection before getting any response, most
+;; likely the server has closed it while it was idle.  If RETRY? allows,
+;; we try again with another connection.
+(define (with-connection conn pool proc :optional (retry? (^[] #f)))
+  (define retry (list 'retry))
+  (let loop ()
+    (let* ([reused (connection-checkout! conn pool)]
+           [keep #f]
+           [timeout #f]
+           [r (guard (e [(and reused (connection-closed? e) (retry?)) retry])
+                (unwind-protect
+                    (receive (result k t)
+                        (receive (in out) (connection-ports conn)
+                          (proc in out))
+                      (set! keep k)
+                      (set! timeout t)
+                      result)
+                  (connection-checkin! conn pool keep timeout)))])
+      (if (eq? r retry) (loop) r))))
+
+(define (connection-ports conn)
+  (if (~ conn'secure)
+    (values (tls-input-port (~ conn'secure-agent))
+            (tls-output-port (~ conn'secure-agent)))
+    (values (socket-input-port (~ conn'socket))
+            (socket-output-port (~ conn'socket)))))
+
+;; Errors we get when the server has closed the connection.
+(define (connection-closed? e)
+  (or (<http-error> e) (<system-error> e) (<io-error> e)))
+
+;; Makes CONN ready to talk to the server, taking an idle connection from
+;; POOL if possible.  A persistent connection keeps its own socket and
+;; doesn't go to the pool.  Returns #t if we reuse an existing connection.
+(define (connection-checkout! conn pool)
+  (cond [(and pool (not (~ conn'persistent)))
+         (let1 key (pool-key conn)
+           (match (pool-acquire pool key)
+             [(sock . tls)
+              (set! (~ conn'socket) sock)
+              (set! (~ conn'secure-agent) tls)
+              #t]
+             [#f
+              (guard (e [else (pool-release pool key #f #f #f #f) (raise e)])
+                (start-connection conn))
+              #f]))]
+        [(~ conn'socket) #t]
+        [else (start-connection conn) #f]))
+
+;; Returns the connection to POOL if KEEP is true, or closes it.
+(define (connection-checkin! conn pool keep timeout)
+  (cond [(and pool (not (~ conn'persistent)))
+         (let ([sock (~ conn'socket)]
+               [tls  (~ conn'secure-agent)])
+           (set! (~ conn'socket) #f)
+           (set! (~ conn'secure-agent) #f)
+           ;; leave some margin so that we won't race with the server
+           (pool-release pool (pool-key conn) sock tls keep
+                         (and timeout (- timeout 1))))]
+        [(and keep (~ conn'persistent))]
+        [else (reset-http-connection conn)]))
 
 ;; canonicalize uri for the sake of redirection.
 ;; URI is a request-uri given to the API, or the redirect location specified
@@ -763,6 +1020,15 @@
     (values host (uri-compose :scheme "http" :host (ref conn'server) :path* uri))
     (values host uri)))
 
+;; final touch of request headers
+(define (request-headers conn pool host user-agent opts)
+  (cond-list [(or (~ conn'persistent) pool)
+              @ (if (~ conn'proxy)
+                  '(:proxy-connection keep-alive)
+                  '(:connection keep-alive))]
+             [#t @ `(:host ,host :user-agent ,user-agent
+                     ,@(http-auth-headers conn) ,@opts)]))
+
 ;; send
 (define (send-request out method uri sender headers enc)
   (define request-line #"~method ~uri HTTP/1.1\r\n")
@@ -798,37 +1064,66 @@
   (flush out))
 
 ;; receive
+;; Returns status code, headers, and the protocol version of the reply.
 (define (receive-header remote)
-  (receive (code reason) (parse-status-line (read-line remote))
-    (values code (rfc822-header->list remote))))
+  (receive (code reason version) (parse-status-line (read-line remote))
+    (values code (rfc822-header->list remote) version)))
 
 (define (parse-status-line line)
   (cond [(eof-object? line)
          (error <http-error> "http reply contains no data")]
-        [(#/\w+\s+(\d\d\d)\s+(.*)/ line) => (^m (values (m 1) (m 2)))]
+        [(#/\w+\s+(\d\d\d)\s+(.*)/ line)
+         => (^m (values (m 1) (m 2)
+                        (if-let1 v (#/^HTTP\/(\d+\.\d+)/ line) (v 1) "1.0")))]
         [else (error <http-error> "bad reply from server" line)]))
 
-(define (receive-body remote code headers receiver)
+;; Whether the server lets us keep the connection after this reply.
+(define (keep-alive? version headers)
+  (let1 tokens ($ append-map (^h (string-split (string-downcase (cadr h))
+                                               #[\s,]))
+                  $ filter (^h (member (car h) '("connection"
+                                                 "proxy-connection")))
+                  headers)
+    (if (member version '("0.9" "1.0"))
+      (boolean (member "keep-alive" tokens))
+      (not (member "close" tokens)))))
+
+;; Keep-Alive: timeout=N, max=M
+(define (keep-alive-timeout headers)
+  (and-let* ([v (rfc822-header-ref headers "keep-alive")]
+             [m (#/timeout\s*=\s*(\d+)/i v)])
+    (x->integer (m 1))))
+
+;; DONE, if given, is called when we know the whole body has been read,
+;; so that the connection can be used for the next request.
+(define (receive-response-body remote method code headers receiver done)
+  (if (or (eq? method 'HEAD) (member code '("204" "304")))
+    (begin (when done (done)) #f)
+    (receive-body remote code headers receiver done)))
+
+(define (receive-body remote code headers receiver :optional (done #f))
   (let1 total (and-let* ([p (assoc "content-length" headers)])
                 (x->integer (cadr p)))
     (if-let1 enc (assoc "transfer-encoding" headers)
       (if (equal? (cadr enc) "chunked")
-        (receive-body-chunked remote code headers total receiver)
+        (receive-body-chunked remote code headers total receiver done)
         (error <http-error> "unsupported transfer-encoding:" (cadr enc)))
-      (receive-body-once remote code headers total receiver))))
+      (receive-body-once remote code headers total receiver done))))
 
-(define (receive-body-once remote code headers total receiver)
+(define (receive-body-once remote code headers total receiver done)
   ;; Callback will be called twice (unless total is 0).  The first
   ;; time we return # of total bytes, the second time zero.
+  ;; If TOTAL is #f, the body extends until the server closes the
+  ;; connection, so it can't be reused.
   (let1 rest total
     (define (callback)
       (if (equal? rest 0)
-        (values remote 0)
+        (begin (when (and done total) (done)) (values remote 0))
         (begin (set! rest 0) (values remote total))))
     (receiver code headers total callback)))
 
 ;; NB: chunk extension and trailer are ignored for now.
-(define (receive-body-chunked remote code headers total receiver)
+(define (receive-body-chunked remote code headers total receiver done)
   (define chunk-size #f)
   (define condition #f)
   (define (callback)
@@ -852,6 +1147,7 @@
                 ;; finish reading trailer
                 (do ([line (read-line remote) (read-line remote)])
                     [(or (eof-object? line) (string-null? line))
+                     (when (and done (string? line)) (done))
                      (values remote 0)])
                 (values remote chunk-size)))
             ;; something's wrong
@@ -859,23 +1155,145 @@
   (begin0 (receiver code headers total callback)
     (when condition (raise condition))))
 
+;;==============================================================
+;; connection pool
+;;
+
+;; Idle connections are kept per server (and proxy) and security setting.
+;; Each value of HOSTS is (<active> . <idle>), where <active> is the number
+;; of connections checked out, and <idle> is a list of
+;; #(<socket> <tls> <expiration>), the most recently used one first.
+(define-class <http-connection-pool> ()
+  ((max-per-host :init-keyword :max-per-host :init-value 4)
+   (idle-timeout :init-keyword :idle-timeout :init-value 15)
+   (lock  :init-form (make-mutex))
+   (cv    :init-form (make-condition-variable))
+   (hosts :init-form (make-hash-table 'equal?))))
+
+(define (make-http-connection-pool :key (max-per-host 4) (idle-timeout 15))
+  (make <http-connection-pool>
+    :max-per-host max-per-host :idle-timeout idle-timeout))
+
+(define (pool-key conn)
+  (list (~ conn'server) (~ conn'proxy) (boolean (~ conn'secure))))
+
+(define (discard-connection server sock tls)
+  (when tls
+    (let1 session (guard (e [else #f]) (tls-session tls))
+      (guard (e [else #f]) (tls-close tls))
+      (release-tls server tls session)))
+  (guard (e [(<system-error> e) #f])
+    (socket-shutdown sock))
+  (socket-close sock))
+
+(define (discard-idle-connections server idles)
+  (dolist [v idles]
+    (discard-connection server (vector-ref v 0) (vector-ref v 1))))
+
+;; Returns an idle connection (<socket> . <tls>) if there's any, or
+;; #f if the caller may open a new one.  If there are already max-per-host
+;; connections in use, waits until one is released.
+(define (pool-acquire pool key)
+  (define lock (~ pool'lock))
+  (define (get-entry)
+    (or (hash-table-get (~ pool'hosts) key #f)
+        (rlet1 e (cons 0 '()) (hash-table-put! (~ pool'hosts) key e))))
+  (define (reap! entry)
+    (let1 now (time->seconds (current-time))
+      (receive (live dead) (partition (^v (> (vector-ref v 2) now))
+                                      (cdr entry))
+        (set-cdr! entry live)
+        dead)))
+  (let loop ([expired '()])
+    (mutex-lock! lock)
+    (let* ([entry (get-entry)]
+           [expired (append (reap! entry) expired)])
+      (cond [(or (pair? (cdr entry))
+                 (< (car entry) (~ pool'max-per-host)))
+             (let1 v (and (pair? (cdr entry)) (pop! (cdr entry)))
+               (inc! (car entry))
+               (mutex-unlock! lock)
+               (discard-idle-connections (car key) expired)
+               (and v (cons (vector-ref v 0) (vector-ref v 1))))]
+            [else
+             (mutex-unlock! lock (~ pool'cv))
+             (loop expired)]))))
+
+(define (pool-release pool key sock tls keep timeout)
+  (define lock (~ pool'lock))
+  (define idle-timeout (~ pool'idle-timeout))
+  (with-locking-mutex lock
+    (^[]
+      (let1 entry (hash-table-get (~ pool'hosts) key)
+        (dec! (car entry))
+        (when keep
+          (push! (cdr entry)
+                 (vector sock tls
+                         (+ (time->seconds (current-time))
+                            (if timeout
+                              (min timeout idle-timeout)
+                              idle-timeout))))))
+      (condition-variable-broadcast! (~ pool'cv))))
+  (when (and sock (not keep))
+    (discard-connection (car key) sock tls)))
+
+;; Closes all idle connections in POOL.
+(define (reset-http-connection-pool :optional (pool (http-connection-pool)))
+  (when pool
+    (dolist [k&idles
+             (with-locking-mutex (~ pool'lock)
+               (^[] (hash-table-map (~ pool'hosts)
+                                    (^[k e] (begin0 (cons k (cdr e))
+                                              (set-cdr! e '()))))))]
+      (discard-idle-connections (caar k&idles) (cdr k&idles)))))
+
 ;;==============================================================
 ;; secure agent handling
 ;;
 
+
+;; Closed TLS contexts are kept for a while, along with the session of
+;; the last connection and the server it talked to.  When we connect
+;; to the same server again, we reuse the context and resume the session,
+;; skipping the full handshake.  (axTLS can only resume a session
+;; within the context it was established, hence we keep them together.)
+(define *idle-tls* '())                 ; ((server tls . session) ...)
+(define *idle-tls-max* 8)
+(define *idle-tls-lock* (make-mutex))
+
+;; Returns a TLS context and a session to resume (or #f).
+(define (acquire-tls server)
+  (or (with-locking-mutex *idle-tls-lock*
+        (^[] (and-let1 e (assoc server *idle-tls*)
+               (set! *idle-tls* (remove (cut eq? e <>) *idle-tls*))
+               (cdr e))))
+      (cons (make-tls #f 1) #f)))
+
+(define (release-tls server tls session)
+  (let1 evicted (with-locking-mutex *idle-tls-lock*
+                  (^[] (push! *idle-tls* (cons* server tls session))
+                       (and (> (length *idle-tls*) *idle-tls-max*)
+                            (rlet1 e (last *idle-tls*)
+                              (set! *idle-tls* (drop-right *idle-tls* 1))))))
+    (when evicted (tls-destroy (cadr evicted)))))
+
 (define (shutdown-secure-agent conn)
-  (when (~ conn'secure-agent)
-    (tls-close (~ conn'secure-agent))
-    (tls-destroy (~ conn'secure-agent))
+  (and-let1 tls (~ conn'secure-agent)
+    (let1 session (guard (e [else #f]) (tls-session tls))
+      (tls-close tls)
+      (release-tls (~ conn'server) tls session))
     (set! (~ conn'secure-agent) #f)))
 
 (define (start-secure-agent conn)
   (unless (http-secure-connection-available?)
     (error "Secure connection is not available on this platform"))
   (when (~ conn'secure-agent) (shutdown-secure-agent conn))
-  (let1 tls (make-tls)
-    (tls-connect tls (socket-fd (~ conn'socket)))
-    (set! (~ conn'secure-agent) tls)))
+  (let* ([host (values-ref (parse-server-address (~ conn'server)) 0)]
+         [tls+session (acquire-tls (~ conn'server))])
+    (guard (e [else (tls-destroy (car tls+session)) (raise e)])
+      (tls-connect (car tls+session) (socket-fd (~ conn'socket))
+                   (cdr tls+session) host))
+    (set! (~ conn'secure-agent) (car tls+session))))
 
 ;; for external api
 (define (http-secure-connection-available?)
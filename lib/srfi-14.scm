@@ -93,6 +93,7 @@
 (define %char-set-add! (with-module gauche.internal %char-set-add!))
 (define %char-set-ranges (with-module gauche.internal %char-set-ranges))
 (define %char-set-predefined (with-module gauche.internal %char-set-predefined))
+(define %char-set-freeze! (with-module gauche.internal %char-set-freeze!))
 
 (define char-set-complement  (with-module gauche char-set-complement))
 (define char-set-complement! (with-module gauche char-set-complement!))
@@ -114,11 +115,14 @@
 (define char-set:title-case  (%char-set-predefined 10))  ; UPPER
 (define char-set:hex-digit   (%char-set-predefined 11))  ; XDIGITS
 
-(define char-set:symbol      (%char-set-add-chars! (char-set)
-                                                   (string->list "$+<=>^`|~")))
-(define char-set:ascii       (%char-set-add-range! (char-set) 0 128))
-(define char-set:empty       (char-set))
-(define char-set:full        (char-set-complement! (char-set)))
+(define char-set:symbol      (%char-set-freeze!
+                              (%char-set-add-chars! (char-set)
+                                                    (string->list "$+<=>^`|~"))))
+(define char-set:ascii       (%char-set-freeze!
+                              (%char-set-add-range! (char-set) 0 128)))
+(define char-set:empty       (%char-set-freeze! (char-set)))
+(define char-set:full        (%char-set-freeze!
+                              (char-set-complement! (char-set))))
 
 ;;-------------------------------------------------------------------
 ;; Comparison
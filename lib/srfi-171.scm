@@ -0,0 +1,402 @@
+;;;
+;;; srfi-171 - Transducers
+;;;
+;;;   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+;;;
+;;;   Redistribution and use in source and binary forms, with or without
+;;;   modification, are permitted provided that the following conditions
+;;;   are met:
+;;;
+;;;   1. Redistributions of source code must retain the above copyright
+;;;      notice, this list of conditions and the following disclaimer.
+;;;
+;;;   2. Redistributions in binary form must reproduce the above copyright
+;;;      notice, this list of conditions and the following disclaimer in the
+;;;      documentation and/or other materials provided with the distribution.
+;;;
+;;;   3. Neither the name of the authors nor the names of its contributors
+;;;      may be used to endorse or promote products derived from this
+;;;      software without specific prior written permission.
+;;;
+;;;   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+;;;   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+;;;   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+;;;   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+;;;   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+;;;   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+;;;   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+;;;   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+;;;   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+;;;   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+;;;   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+;;;
+
+;; A transducer takes a reducer and returns another reducer.  A reducer
+;; is a procedure that takes zero (to get the initial value), one (to
+;; finish up the result) or two (to combine the result so far with a new
+;; input) arguments.  Transducers are composed with the ordinary compose,
+;; and the composed transducer processes each input in one pass without
+;; creating intermediate collections.
+
+(define-module srfi-171
+  (use gauche.record)
+  (use gauche.uvector)
+  (export rcons reverse-rcons rcount rany revery
+          list-transduce vector-transduce string-transduce
+          bytevector-u8-transduce port-transduce generator-transduce
+
+          tmap tfilter tremove treplace tfilter-map
+          tdrop tdrop-while ttake ttake-while
+          tconcatenate tappend-map tflatten
+          tdelete-neighbor-duplicates tdelete-duplicates
+          tsegment tpartition tadd-between tenumerate tlog
+
+          ;; srfi-171 meta
+          reduced reduced? unreduce ensure-reduced preserving-reduced
+          list-reduce vector-reduce string-reduce bytevector-u8-reduce
+          port-reduce generator-reduce))
+(select-module srfi-171)
+
+;;;
+;;; Reduced values
+;;;
+
+;; A reducer returns a reduced value to tell the transduction that no
+;; more input is needed.
+(define-record-type <reduced> reduced reduced?
+  (value unreduce))
+
+(define (ensure-reduced x) (if (reduced? x) x (reduced x)))
+
+;; Wraps a reducer so that a reduced value it returns is wrapped again.
+;; Used by the transducers that run a nested reduction (e.g. tconcatenate),
+;; so that the outer reduction also sees the reduced value.
+(define (preserving-reduced reducer)
+  (^[a b] (let1 r (reducer a b) (if (reduced? r) (reduced r) r))))
+
+;;;
+;;; Reducers
+;;;
+
+(define rcons
+  (case-lambda
+    [() '()]
+    [(lis) (reverse! lis)]
+    [(lis x) (cons x lis)]))
+
+(define reverse-rcons
+  (case-lambda
+    [() '()]
+    [(lis) lis]
+    [(lis x) (cons x lis)]))
+
+(define rcount
+  (case-lambda
+    [() 0]
+    [(n) n]
+    [(n _) (+ n 1)]))
+
+(define (rany pred)
+  (case-lambda
+    [() #f]
+    [(r) r]
+    [(r x) (if-let1 v (pred x) (reduced v) #f)]))
+
+(define (revery pred)
+  (case-lambda
+    [() #t]
+    [(r) r]
+    [(r x) (let1 v (pred x) (if (and r v) v (reduced #f)))]))
+
+;;;
+;;; Reductions
+;;;
+
+;; These return the unwrapped value when the reducer returns a reduced
+;; value.
+
+(define (list-reduce f seed lis)
+  (let loop ([acc seed] [lis lis])
+    (if (null? lis)
+      acc
+      (let1 acc (f acc (car lis))
+        (if (reduced? acc)
+          (unreduce acc)
+          (loop acc (cdr lis)))))))
+
+(define-syntax %define-indexed-reduce
+  (syntax-rules ()
+    [(_ name len ref)
+     (define (name f seed coll)
+       (let1 n (len coll)
+         (let loop ([acc seed] [i 0])
+           (if (= i n)
+             acc
+             (let1 acc (f acc (ref coll i))
+               (if (reduced? acc)
+                 (unreduce acc)
+                 (loop acc (+ i 1))))))))]))
+
+(%define-indexed-reduce vector-reduce vector-length vector-ref)
+(%define-indexed-reduce bytevector-u8-reduce u8vector-length u8vector-ref)
+
+;; We don't index strings, for string-ref isn't constant time on
+;; multibyte strings.
+(define (string-reduce f seed str)
+  (let1 p (open-input-string str)
+    (let loop ([acc seed])
+      (let1 c (read-char p)
+        (if (eof-object? c)
+          acc
+          (let1 acc (f acc c)
+            (if (reduced? acc) (unreduce acc) (loop acc))))))))
+
+(define (generator-reduce f seed gen)
+  (let loop ([acc seed])
+    (let1 v (gen)
+      (if (eof-object? v)
+        acc
+        (let1 acc (f acc v)
+          (if (reduced? acc) (unreduce acc) (loop acc)))))))
+
+(define (port-reduce f seed reader port)
+  (generator-reduce f seed (cut reader port)))
+
+;;;
+;;; Transduction
+;;;
+
+(define-syntax %define-transduce
+  (syntax-rules ()
+    [(_ name reduce)
+     (define name
+       (case-lambda
+         [(xform f coll) (name xform f (f) coll)]
+         [(xform f init coll)
+          (let1 xf (xform f)
+            (xf (reduce xf init coll)))]))]))
+
+(%define-transduce list-transduce list-reduce)
+(%define-transduce vector-transduce vector-reduce)
+(%define-transduce string-transduce string-reduce)
+(%define-transduce bytevector-u8-transduce bytevector-u8-reduce)
+(%define-transduce generator-transduce generator-reduce)
+
+(define port-transduce
+  (case-lambda
+    [(xform f reader)
+     (port-transduce xform f (f) reader (current-input-port))]
+    [(xform f reader port)
+     (port-transduce xform f (f) reader port)]
+    [(xform f init reader port)
+     (let1 xf (xform f)
+       (xf (port-reduce xf init reader port)))]))
+
+;;;
+;;; Transducers
+;;;
+
+(define (tmap f)
+  (^[reducer]
+    (case-lambda
+      [() (reducer)]
+      [(r) (reducer r)]
+      [(r x) (reducer r (f x))])))
+
+(define (tfilter pred)
+  (^[reducer]
+    (case-lambda
+      [() (reducer)]
+      [(r) (reducer r)]
+      [(r x) (if (pred x) (reducer r x) r)])))
+
+(define (tremove pred)
+  (^[reducer]
+    (case-lambda
+      [() (reducer)]
+      [(r) (reducer r)]
+      [(r x) (if (pred x) r (reducer r x))])))
+
+(define (tfilter-map f)
+  (^[reducer]
+    (case-lambda
+      [() (reducer)]
+      [(r) (reducer r)]
+      [(r x) (if-let1 v (f x) (reducer r v) r)])))
+
+;; MAPPING can be an alist or a hash table.
+(define (treplace mapping)
+  (let1 lookup (if (hash-table? mapping)
+                 (^x (hash-table-get mapping x x))
+                 (^x (if-let1 p (assoc x mapping) (cdr p) x)))
+    (tmap lookup)))
+
+(define (tdrop n)
+  (^[reducer]
+    (let1 k n
+      (case-lambda
+        [() (reducer)]
+        [(r) (reducer r)]
+        [(r x) (if (> k 0) (begin (dec! k) r) (reducer r x))]))))
+
+(define (tdrop-while pred)
+  (^[reducer]
+    (let1 dropping? #t
+      (case-lambda
+        [() (reducer)]
+        [(r) (reducer r)]
+        [(r x) (if (and dropping? (pred x))
+                 r
+                 (begin (set! dropping? #f) (reducer r x)))]))))
+
+(define (ttake n)
+  (^[reducer]
+    (let1 k n
+      (case-lambda
+        [() (reducer)]
+        [(r) (reducer r)]
+        [(r x) (let1 r (if (> k 0) (reducer r x) r)
+                 (dec! k)
+                 (if (> k 0) r (ensure-reduced r)))]))))
+
+;; RETF is called with the result and the first failing input when we
+;; stop taking.
+(define (ttake-while pred :optional (retf (^[r x] r)))
+  (^[reducer]
+    (let1 taking? #t
+      (case-lambda
+        [() (reducer)]
+        [(r) (reducer r)]
+        [(r x) (if (and taking? (pred x))
+                 (reducer r x)
+                 (begin (set! taking? #f)
+                        (ensure-reduced (retf r x))))]))))
+
+;; NB: tconcatenate and tflatten are transducers themselves, not
+;; procedures returning them.
+(define (tconcatenate reducer)
+  (let1 preserving (preserving-reduced reducer)
+    (case-lambda
+      [() (reducer)]
+      [(r) (reducer r)]
+      [(r x) (list-reduce preserving r x)])))
+
+(define (tappend-map f) (compose (tmap f) tconcatenate))
+
+(define (tflatten reducer)
+  (letrec ([flattener
+            (case-lambda
+              [() (reducer)]
+              [(r) (reducer r)]
+              [(r x) (if (list? x)
+                       (list-reduce (preserving-reduced flattener) r x)
+                       (reducer r x))])])
+    flattener))
+
+(define (tdelete-neighbor-duplicates :optional (= equal?))
+  (^[reducer]
+    (let ([prev #f] [first? #t])
+      (case-lambda
+        [() (reducer)]
+        [(r) (reducer r)]
+        [(r x) (if (and (not first?) (= prev x))
+                 r
+                 (begin (set! prev x) (set! first? #f) (reducer r x)))]))))
+
+;; For the standard equivalence predicates we keep the seen elements in
+;; a hash table; for others we fall back to a list.
+(define (tdelete-duplicates :optional (= equal?))
+  (define type (cond [(eq? = eq?) 'eq?]
+                     [(eq? = eqv?) 'eqv?]
+                     [(eq? = equal?) 'equal?]
+                     [(eq? = string=?) 'string=?]
+                     [else #f]))
+  (^[reducer]
+    (if type
+      (let1 seen (make-hash-table type)
+        (case-lambda
+          [() (reducer)]
+          [(r) (reducer r)]
+          [(r x) (if (hash-table-exists? seen x)
+                   r
+                   (begin (hash-table-put! seen x #t) (reducer r x)))]))
+      (let1 seen '()
+        (case-lambda
+          [() (reducer)]
+          [(r) (reducer r)]
+          [(r x) (if (member x seen =)
+                   r
+                   (begin (push! seen x) (reducer r x)))])))))
+
+;; Groups inputs into lists of N elements.  The last group may be shorter.
+(define (tsegment n)
+  (unless (and (exact-integer? n) (positive? n))
+    (error "tsegment requires a positive exact integer, but got:" n))
+  (^[reducer]
+    (let ([group '()] [k 0])
+      (case-lambda
+        [() (reducer)]
+        [(r) (reducer (if (null? group)
+                        r
+                        (let1 r (reducer r (reverse group))
+                          (set! group '())
+                          (unreduce-if-reduced r))))]
+        [(r x) (push! group x)
+               (inc! k)
+               (if (< k n)
+                 r
+                 (let1 g (reverse group)
+                   (set! group '())
+                   (set! k 0)
+                   (reducer r g)))]))))
+
+;; Groups consecutive inputs for which PRED returns the same value.
+(define (tpartition pred)
+  (^[reducer]
+    (let ([group '()] [key #f])
+      (case-lambda
+        [() (reducer)]
+        [(r) (reducer (if (null? group)
+                        r
+                        (let1 r (reducer r (reverse group))
+                          (set! group '())
+                          (unreduce-if-reduced r))))]
+        [(r x) (let1 k (pred x)
+                 (cond [(null? group) (set! key k) (push! group x) r]
+                       [(equal? k key) (push! group x) r]
+                       [else (let1 g (reverse group)
+                               (set! group (list x))
+                               (set! key k)
+                               (reducer r g))]))]))))
+
+(define (tadd-between elem)
+  (^[reducer]
+    (let1 first? #t
+      (case-lambda
+        [() (reducer)]
+        [(r) (reducer r)]
+        [(r x) (if first?
+                 (begin (set! first? #f) (reducer r x))
+                 (let1 r (reducer r elem)
+                   (if (reduced? r) r (reducer r x))))]))))
+
+(define (tenumerate :optional (start 0))
+  (^[reducer]
+    (let1 i start
+      (case-lambda
+        [() (reducer)]
+        [(r) (reducer r)]
+        [(r x) (let1 p (cons i x)
+                 (inc! i)
+                 (reducer r p))]))))
+
+(define (tlog :optional (logger (^[r x] (write x) (newline))))
+  (^[reducer]
+    (case-lambda
+      [() (reducer)]
+      [(r) (reducer r)]
+      [(r x) (logger r x) (reducer r x)])))
+
+;; The result of flushing the last group may come back reduced; the
+;; completion step needs a plain value.
+(define (unreduce-if-reduced r) (if (reduced? r) (unreduce r) r))
@@ -18,10 +18,10 @@
                     [else (error "don't know how to diff from:" src)])))
 
 ;; lcs on text.  Returns edit-list (as defined in lcs-edit-list).
-(define (diff a b :key (reader read-line) (equal equal?))
+(define (diff a b :key (reader read-line) (equal equal?) (algorithm 'myers))
   (lcs-edit-list (source->list a reader)
                  (source->list b reader)
-                 equal))
+                 equal algorithm))
 
 (define (write-line-diff line type)
   (case type
@@ -30,12 +30,13 @@
     [else (format #t "  ~A\n" line)]))
 
 (define (diff-report a b :key (writer write-line-diff)
-                              (reader read-line) (equal equal?))
+                              (reader read-line) (equal equal?)
+                              (algorithm 'myers))
   (lcs-fold (^[line _] [writer line '-])
             (^[line _] (writer line '+))
             (^[line _] (writer line #f))
             #f
             (source->list a reader)
             (source->list b reader)
-            equal))
+            equal algorithm))
 
@@ -34,7 +34,9 @@
 (define-module text.html-lite
   (use text.tree)
   (use srfi-1)
-  (export html-escape html-escape-string html-doctype)
+  (use util.match)
+  (export html-escape html-escape-string html-doctype
+          html-template define-html-template)
   )
 (select-module text.html-lite)
 
@@ -48,8 +50,13 @@
                             [else (display c)]))
                       read-char))
 
+(define %write-html-escaped (with-module gauche.internal %write-html-escaped))
+
 (define (html-escape-string string)
-  (with-string-io (x->string string) html-escape))
+  (let1 s (x->string string)
+    (if (string-scan s #[<>&\"])
+      (call-with-output-string (cut %write-html-escaped s <>))
+      s)))
 
 ;; Doctype ----------------------------------------------
 
@@ -225,6 +232,97 @@
 
 ;; FRAMES
 (define-html-elements frameset frame noframes iframe)
-
-
-
+;; Templates ------------------------------------------------
+
+;; html-template compiles a template into a procedure that writes the
+;; document to a port.  The template is parsed at macro-expansion time;
+;; all the static parts, including tags and literal attributes, are
+;; escaped and concatenated into strings then, so that at runtime we only
+;; copy those strings and fill in the dynamic parts.
+;;
+;;   template : text | ,expr | ,@expr | (tag attr ... template ...)
+;;   text     : string, character, number or symbol; escaped
+;;   ,expr    : the value of expr, escaped (see html-template-emit)
+;;   ,@expr   : the value of expr, written as a tree without escaping
+;;   attr     : keyword value | keyword ,expr | keyword
+;;
+;; The output of an element is the same as the corresponding html:*
+;; procedure.
+
+(define-constant *html-empty-elements*
+  '(br area link img param hr input col base meta))
+
+;; Runtime support for ,expr.
+(define (html-template-emit obj port)
+  (cond [(or (not obj) (null? obj))]
+        [(string? obj) (%write-html-escaped obj port)]
+        [(pair? obj) (dolist [e obj] (html-template-emit e port))]
+        [(procedure? obj) (obj port)]
+        [else (%write-html-escaped (x->string obj) port)]))
+
+;; Runtime support for keyword ,expr.
+(define (html-template-attr name obj port)
+  (cond [(not obj)]
+        [(eq? obj #t) (write-string " " port) (write-string name port)]
+        [else (write-string " " port) (write-string name port)
+              (write-string "=\"" port)
+              (%write-html-escaped (x->string obj) port)
+              (write-string "\"" port)]))
+
+;; Template -> list of static strings and (kind expr) for dynamic parts.
+(define (html-template-compile tmpl)
+  (define (text x) (html-escape-string (x->string x)))
+  (define (attrs args acc)
+    (match args
+      [((? keyword? k) ('unquote e) . rest)
+       (attrs rest `((attr ,(keyword->string k) ,e) ,@acc))]
+      [((? keyword? k)) (values `(,#" ~(keyword->string k)" ,@acc) '())]
+      [((? keyword? k) #f . rest) (attrs rest acc)]
+      [((? keyword? k) #t . rest)
+       (attrs rest `(,#" ~(keyword->string k)" ,@acc))]
+      [((? keyword? k) v . rest)
+       (attrs rest `(,#" ~(keyword->string k)=\"~(text v)\"" ,@acc))]
+      [_ (values acc args)]))
+  (define (walk t acc)
+    (match t
+      [('unquote e) `((emit ,e) ,@acc)]
+      [('unquote-splicing (? string? s)) `(,s ,@acc)]
+      [('unquote-splicing e) `((raw ,e) ,@acc)]
+      [((? symbol? tag) . args)
+       (receive (acc children) (attrs args `(,#"<~tag" ,@acc))
+         (if (memq tag *html-empty-elements*)
+           (if (null? children)
+             `(" />" ,@acc)
+             (errorf "element ~s can't have content: ~s" tag children))
+           `(,#"</~tag\n>" ,@(fold walk `(">" ,@acc) children))))]
+      [(or (? string?) (? char?) (? number?) (? symbol?)) `(,(text t) ,@acc)]
+      [_ (error "bad html template:" t)]))
+  ;; merge adjacent static strings
+  (fold (^[item r]
+          (if (and (string? item) (pair? r) (string? (car r)))
+            (cons (string-append item (car r)) (cdr r))
+            (cons item r)))
+        '()
+        (fold walk '() tmpl)))
+
+(define-syntax html-template
+  (er-macro-transformer
+   (^[f r c]
+     (let ([out (r 'out)])
+       `(,(r 'lambda) (:optional (,out (,(r 'current-output-port))))
+         (,(r 'with-port-locking) ,out
+          (,(r 'lambda) ()
+           ,@(map (^[item]
+                    (match item
+                      [(? string?) `(,(r 'write-string) ,item ,out)]
+                      [('emit e) `(,(r 'html-template-emit) ,e ,out)]
+                      [('raw e) `(,(r 'write-tree) ,e ,out)]
+                      [('attr name e)
+                       `(,(r 'html-template-attr) ,name ,e ,out)]))
+                  (html-template-compile (cdr f)))
+           (,(r 'undefined)))))))))
+
+(define-syntax define-html-template
+  (syntax-rules ()
+    [(_ (name . formals) tmpl ...)
+     (define (name . formals) ((html-template tmpl ...)))]))
@@ -10,18 +10,24 @@
   )
 (select-module text.tree)
 
+;; The lists, strings, characters, symbols and fixnums in a tree are
+;; handled by a native walker, which locks the port only once for
+;; the whole tree.  It goes back to the generic function write-tree
+;; for other nodes, so you can still define write-tree methods for
+;; your own classes.
+(define %write-tree (with-module gauche.internal %write-tree))
+
 (define-method write-tree (tree)
   (write-tree tree (current-output-port)))
 
 (define-method write-tree ((tree <list>) out)
-  (let loop ((tree tree))
-    (cond ((null? tree))
-          ((pair? tree) (write-tree (car tree) out) (loop (cdr tree)))
-          (else (write-tree tree out)))))
+  (%write-tree tree out write-tree))
+
+(define-method write-tree ((tree <string>) out)
+  (%write-tree tree out write-tree))
 
 (define-method write-tree ((tree <top>) out)
   (display tree out))
 
 (define (tree->string tree)
-  (with-output-to-string (lambda () (write-tree tree))))
-
+  (call-with-output-string (cut %write-tree tree <> write-tree)))
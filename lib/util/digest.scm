@@ -42,6 +42,8 @@
   )
 (select-module util.digest)
 
+(autoload rfc.base64 base16-encode-bytevector)
+
 (define-class <message-digest-algorithm-meta> (<class>)
   ;; Block size (in bytes) used in HMAC, determined by each algorithm.
   ;; Older algorithms uses 64, while SHA-384/512 uses 128.
@@ -61,7 +63,5 @@
   (with-input-from-string string (cut digest class)))
 
 ;; utility
-(define (digest-hexify string)
-  (with-string-io string
-    (cut generator-for-each (cut format #t "~2,'0x" <>) read-byte)))
+(define (digest-hexify data) (base16-encode-bytevector data))
 
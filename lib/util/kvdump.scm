@@ -0,0 +1,273 @@
+;;;
+;;; util.kvdump - binary dump format of key-value collections
+;;;
+;;;   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+;;;
+;;;   Redistribution and use in source and binary forms, with or without
+;;;   modification, are permitted provided that the following conditions
+;;;   are met:
+;;;
+;;;   1. Redistributions of source code must retain the above copyright
+;;;      notice, this list of conditions and the following disclaimer.
+;;;
+;;;   2. Redistributions in binary form must reproduce the above copyright
+;;;      notice, this list of conditions and the following disclaimer in the
+;;;      documentation and/or other materials provided with the distribution.
+;;;
+;;;   3. Neither the name of the authors nor the names of its contributors
+;;;      may be used to endorse or promote products derived from this
+;;;      software without specific prior written permission.
+;;;
+;;;   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+;;;   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+;;;   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+;;;   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT
+;;;   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+;;;   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+;;;   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+;;;   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+;;;   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+;;;   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+;;;   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+;;;
+
+;; A dump is written and read sequentially, but the entries are grouped
+;; into self-contained blocks, which can be encoded (and deflated) or
+;; decoded by multiple threads at once.  The procedure that walks the
+;; collection and the one that receives the entries are always called
+;; from the calling thread, in order.
+;;
+;; Format (integers are big-endian; BER is write-ber-integer's format):
+;;
+;;   header : magic (#x89 "KVD") version(u8) flags(u8)
+;;            count(u64, or #xffffffffffffffff if unknown)
+;;            meta-length(BER) meta(written S-expression, or empty)
+;;   block  : payload-length(BER) num-entries(BER) payload
+;;   end    : a block with 0 entries and 0 length
+;;
+;; The payload is a sequence of key and value items, deflated as a whole
+;; if bit 0 of the flags is set.  Each item is tag(u8) length(BER) bytes.
+;; The tag is 0 for a string (the bytes of it), 1 for a u8vector (its
+;; content), and 2 for other objects (their written representation).
+
+(define-module util.kvdump
+  (use gauche.uvector)
+  (use binary.io)
+  (use util.match)
+  (use util.queue)
+  (autoload rfc.zlib deflate-string inflate-string)
+  (autoload control.future make-future touch)
+  (export write-kvdump read-kvdump kvdump-port?
+          hash-table-save hash-table-load))
+(select-module util.kvdump)
+
+(define-constant *magic* '#u8(#x89 #x4b #x56 #x44))
+(define-constant *version* 1)
+(define-constant *unknown-count* #xffffffffffffffff)
+(define-constant *flag-deflate* 1)
+
+(define-constant *threads-available*
+  (cond-expand [gauche.sys.threads #t] [else #f]))
+
+;;
+;; Items and blocks
+;;
+
+(define (write-item obj out)
+  (define (put tag size)
+    (write-u8 tag out)
+    (write-ber-integer size out))
+  (cond [(string? obj) (put 0 (string-size obj)) (display obj out)]
+        [(u8vector? obj) (put 1 (u8vector-length obj)) (write-block obj out)]
+        [else (let1 s (write-to-string obj)
+                (put 2 (string-size s))
+                (display s out))]))
+
+(define (read-bytes len in)
+  (if (zero? len)
+    ""
+    (let1 s (read-block len in)
+      (when (or (eof-object? s) (< (string-size s) len))
+        (error "kvdump: premature end of data"))
+      s)))
+
+(define (read-item in)
+  (let* ([tag (read-u8 in)]
+         [len (read-ber-integer in)])
+    (when (or (eof-object? tag) (eof-object? len))
+      (error "kvdump: premature end of data"))
+    (case tag
+      [(0) (let1 s (read-bytes len in)
+             (or (string-incomplete->complete s) s))]
+      [(1) (rlet1 v (make-u8vector len)
+             (unless (or (zero? len) (eqv? (read-block! v in) len))
+               (error "kvdump: premature end of data")))]
+      [(2) (read-from-string (read-bytes len in))]
+      [else (error "kvdump: invalid item tag:" tag)])))
+
+;; ENTRIES is a list of (key . value).
+(define (encode-block entries deflate?)
+  (let1 s (call-with-output-string
+            (^[out] (dolist [e entries]
+                      (write-item (car e) out)
+                      (write-item (cdr e) out))))
+    (if deflate? (deflate-string s) s)))
+
+(define (decode-block data n deflate?)
+  (let1 in (open-input-string (if deflate? (inflate-string data) data))
+    (let loop ([i 0] [r '()])
+      (if (= i n)
+        (reverse! r)
+        (let* ([k (read-item in)]
+               [v (read-item in)])
+          (loop (+ i 1) (acons k v r)))))))
+
+;; Returns two procedures, submit and finish.  (submit thunk) evaluates
+;; thunk, and CONSUMER is called with its result.  The consumer is called
+;; in the order of submission, from the caller of submit or finish.
+;; With more than one thread, up to 2*THREADS thunks run in parallel as
+;; futures; finish waits for all of them.
+(define (make-pipeline threads consumer)
+  (if (and *threads-available* (> threads 1))
+    (let1 q (make-queue)
+      (values (^[thunk]
+                (enqueue! q (make-future thunk))
+                (when (> (queue-length q) (* threads 2))
+                  (consumer (touch (dequeue! q)))))
+              (^[]
+                (until (queue-empty? q)
+                  (consumer (touch (dequeue! q)))))))
+    (values (^[thunk] (consumer (thunk)))
+            (^[] #f))))
+
+;;
+;; Writer
+;;
+
+(define (write-header port count meta deflate?)
+  (write-block *magic* port)
+  (write-u8 *version* port)
+  (write-u8 (if deflate? *flag-deflate* 0) port)
+  (write-u64 (or count *unknown-count*) port 'big-endian)
+  (let1 m (if meta (write-to-string meta) "")
+    (write-ber-integer (string-size m) port)
+    (display m port)))
+
+(define (write-block-data port n data)
+  (write-ber-integer (string-size data) port)
+  (write-ber-integer n port)
+  (display data port))
+
+;; API
+;; WALKER is called with a procedure that takes a key and a value,
+;; e.g. (cut hash-table-for-each table <>).  Returns the number of
+;; entries written.
+(define (write-kvdump port walker :key (count #f) (meta #f) (compress #f)
+                      (threads 1) (block-size 1024))
+  (write-header port count meta compress)
+  (receive (submit! finish!)
+      (make-pipeline threads (^[r] (write-block-data port (car r) (cdr r))))
+    (let ([buf '()] [n 0] [total 0])
+      (define (flush!)
+        (unless (zero? n)
+          (let ([es (reverse! buf)] [k n])
+            (submit! (^[] (cons k (encode-block es compress)))))
+          (set! buf '())
+          (set! n 0)))
+      (walker (^[k v]
+                (push! buf (cons k v))
+                (inc! n)
+                (inc! total)
+                (when (>= n block-size) (flush!))))
+      (flush!)
+      (finish!)
+      (write-block-data port 0 "")
+      total)))
+
+;;
+;; Reader
+;;
+
+;; Returns count, meta and deflate flag.
+(define (read-header port)
+  (let1 magic (make-u8vector 4)
+    (unless (and (= (read-block! magic port) 4)
+                 (equal? magic *magic*))
+      (error "kvdump: input isn't a kvdump data:" port)))
+  (let* ([version (read-u8 port)]
+         [flags (read-u8 port)]
+         [count (read-u64 port 'big-endian)]
+         [mlen (read-ber-integer port)])
+    (when (eof-object? mlen)
+      (error "kvdump: premature end of data"))
+    (unless (eqv? version *version*)
+      (error "kvdump: unsupported version:" version))
+    (let1 meta (read-bytes mlen port)
+      (values (if (= count *unknown-count*) #f count)
+              (if (equal? meta "") #f (read-from-string meta))
+              (logtest flags *flag-deflate*)))))
+
+;; API
+;; A quick check by the first byte, without consuming input.
+(define (kvdump-port? port)
+  (eqv? (peek-byte port) (u8vector-ref *magic* 0)))
+
+;; API
+;; PROC is called with each key and value.  HEADER-HANDLER, if given,
+;; is called with the entry count (#f if unknown) and the meta info
+;; before any entry.  Returns the number of entries read.
+(define (read-kvdump port proc :key (threads 1) (header-handler #f))
+  (receive (count meta deflate?) (read-header port)
+    (when header-handler (header-handler count meta))
+    (receive (submit! finish!)
+        (make-pipeline threads (^[es] (dolist [e es] (proc (car e) (cdr e)))))
+      (let loop ([total 0])
+        (let* ([len (read-ber-integer port)]
+               [n (read-ber-integer port)])
+          (when (or (eof-object? len) (eof-object? n))
+            (error "kvdump: premature end of data"))
+          (if (zero? n)
+            (begin (finish!) total)
+            (let1 data (read-bytes len port)
+              (submit! (^[] (decode-block data n deflate?)))
+              (loop (+ total n)))))))))
+
+;;
+;; Hash tables
+;;
+
+;; API
+(define (hash-table-save table dest :key (compress #f) (threads 1))
+  (define (save port)
+    (write-kvdump port (cut hash-table-for-each table <>)
+                  :count (hash-table-num-entries table)
+                  :meta `(hash-table ,(hash-table-type table))
+                  :compress compress :threads threads))
+  (if (output-port? dest)
+    (save dest)
+    (call-with-output-file dest save)))
+
+;; API
+;; The table is created with the entry count recorded in the dump as
+;; its initial size.  COMPARATOR is needed if the saved table wasn't
+;; one of eq?, eqv?, equal? or string=? type.
+(define (hash-table-load src :key (comparator #f) (threads 1))
+  (define (type-of meta)
+    (or comparator
+        (match meta
+          [('hash-table (and (or 'eq? 'eqv? 'equal? 'string=?) type)) type]
+          [_ (error "hash-table-load needs a comparator to load:" src)])))
+  (define (load port)
+    (let1 table #f
+      (read-kvdump port (^[k v] (hash-table-put! table k v))
+                   :threads threads
+                   :header-handler
+                   (^[count meta]
+                     (set! table (make-hash-table (type-of meta)
+                                                  (min (or count 0)
+                                                       (greatest-fixnum)
+                                                       #x7fffffff)))))
+      table))
+  (if (input-port? src)
+    (load src)
+    (call-with-input-file src load)))
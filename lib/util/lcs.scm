@@ -38,6 +38,7 @@
 ;;; Modified by Shiro Kawai
 ;;;  - added lcs-fold and rewrote lcs-edit-list using lcs-fold
 ;;;  - replaced base algorithm from DP to Myers'
+;;  - linear space refinement and patience diff heuristics
 
 (define-module util.lcs
   (use gauche.sequence)
@@ -49,87 +50,292 @@
 ;; The base algorithm.   This code implements
 ;; Eugene Myers, "An O(ND) Difference Algorithm and Its Variations",
 ;; Algorithmica Vol. 1 No. 2, 1986, pp. 251-266.
-;; It takes O((M+N)D) time and O((M+N)L) space, where
-;; N = (length a), M = (length b), D is the length of the smallest edit
-;; sequence (SES), and L is the length of the longest common subsequence (LCS).
+;; It takes O((M+N)D) time, where N = (length a), M = (length b),
+;; and D is the length of the smallest edit sequence (SES).
 ;; In most applications the difference is small, so it is much better than
 ;; DP algorithm that is generally O(MN) time and space complextiy.
-;; The worst case where a and b totally differ is O((M+N)^2).
-;; The Myers's paper gives refinement of the algorithm
-;; that improves worst case behavior, but I don't implement it yet. --[SK]
-
-(define (lcs-with-positions a-ls b-ls :optional (eq equal?))
-  (let* ((A  (list->vector a-ls))
-         (B  (list->vector b-ls))
-         (N  (vector-length A))
-         (M  (vector-length B))
-         (M+N (+ N M))
-         (V_d (make-vector (+ (* 2 M+N) 1) 0))
-         (V_r (make-vector (+ (* 2 M+N) 1) '()))
-         (V_l (make-vector (+ (* 2 M+N) 1) 0)))
-
-    (let-syntax ((vd
-                  (syntax-rules ()
-                    ((vd i) (vector-ref V_d (+ i M+N)))
-                    ((vd i x) (vector-set! V_d (+ i M+N) x))))
-                 (vr
-                  (syntax-rules ()
-                    ((vr i) (vector-ref V_r (+ i M+N)))
-                    ((vr i x) (vector-set! V_r (+ i M+N) x))))
-                 (vl
-                  (syntax-rules ()
-                    ((vl i) (vector-ref V_l (+ i M+N)))
-                    ((vl i x) (vector-set! V_l (+ i M+N) x)))))
-
-      (define (finish)
-        (let loop ((i (- M+N)) (maxl 0) (r '()))
-          (cond ((> i M+N) (list maxl (reverse! r)))
-                ((> (vl i) maxl)
-                 (loop (+ i 1) (vl i) (vr i)))
-                (else
-                 (loop (+ i 1) maxl r)))))
-
-      (if (zero? M+N)
-        '(0 ()) ;; boundary case
-        (let d-loop ((d 0))
-          (if (> d M+N)
-            (error "lcs-with-positions; something's wrong (implementation error?)")
-            (let k-loop ((k (- d)))
-              (if (> k d)
-                (d-loop (+ d 1))
-                (receive (x l r)
-                    (if (or (= k (- d))
-                            (and (not (= k d))
-                                 (< (vd (- k 1)) (vd (+ k 1)))))
-                      (values (vd (+ k 1)) (vl (+ k 1)) (vr (+ k 1)))
-                      (values (+ (vd (- k 1)) 1) (vl (- k 1)) (vr (- k 1))))
-                  (receive (x y l r)
-                      (let xy-loop ((x x) (y (- x k)) (l l) (r r))
-                        (cond ((>= x N) (values x y l r))
-                              ((>= y M) (values x y l r))
-                              ((eq (vector-ref A x) (vector-ref B y))
-                               (xy-loop (+ x 1) (+ y 1) (+ l 1)
-                                        (cons (list (vector-ref A x) x y)
-                                              r)))
-                              (else (values x y l r))))
-                    (vd k x)
-                    (vr k r)
-                    (vl k l)
-                    (if (and (>= x N) (>= y M))
-                      (finish)
-                      (k-loop (+ k 2))))
-                  )))
-            )))
-      )))
+;;
+;; Small problems are solved by the greedy forward search, which keeps
+;; the trace of furthest reaching points to recover the path; it needs
+;; O(D^2) space, so we only use it when N+M is within *greedy-limit*.
+;; Larger problems are split by the "middle snake" of the linear space
+;; refinement (section 4b of the paper) until the pieces are small enough,
+;; so the space is O(N+M) plus the bounded trace.
+;;
+;; If the equality predicate is one of the standard ones, the elements
+;; are mapped to integers first, so that comparing them is cheap.
+;;
+;; Optionally, the patience diff heuristics can be used: elements that
+;; appear exactly once in both sequences are matched first (taking the
+;; longest increasing subsequence of them), and the gaps between them
+;; are filled recursively.  The result is not always the longest, but
+;; tends to be more natural for text diffs.
+
+(define-constant *greedy-limit* 512)
+
+(define (lcs-with-positions a-ls b-ls :optional (eq equal?) (algorithm 'myers))
+  (let ([A (list->vector a-ls)]
+        [B (list->vector b-ls)])
+    (receive (IA IB ieq) (intern-elements A B eq)
+      (let1 common
+          (reverse!
+           (ecase algorithm
+             [(myers) (myers-common IA IB ieq 0 (vector-length A)
+                                    0 (vector-length B) '())]
+             [(patience)
+              (if (eq? ieq eq?)
+                (patience-common IA IB 0 (vector-length A)
+                                 0 (vector-length B) '())
+                (myers-common IA IB ieq 0 (vector-length A)
+                              0 (vector-length B) '()))]))
+        (list (length common)
+              (map (^p (list (vector-ref A (car p)) (car p) (cdr p)))
+                   common))))))
+
+;; Returns vectors of integers that correspond to A and B, and eq? to
+;; compare them.  If EQ isn't the one we know how to hash, returns
+;; A, B and EQ as they are.
+(define (intern-elements A B eq)
+  (if-let1 type (cond [(eq? eq eq?) 'eq?]
+                      [(eq? eq eqv?) 'eqv?]
+                      [(or (eq? eq equal?) (eq? eq string=?)) 'equal?]
+                      [else #f])
+    (let ([tab (make-hash-table type)]
+          [n 0])
+      (define (id x)
+        (or (hash-table-get tab x #f)
+            (begin0 n (hash-table-put! tab x n) (inc! n))))
+      (let* ([IA (vector-map id A)]
+             [IB (vector-map id B)])
+        (values IA IB eq?)))
+    (values A B eq)))
+
+;; The following procedures work on the ranges A[a0,a1) and B[b0,b1),
+;; and push common positions (i . j) onto ACC in ascending order, that is,
+;; the returned list has the last common position first.
+
+(define (myers-common A B eq a0 a1 b0 b1 acc)
+  (define (snake-pairs x y n acc)
+    (if (= n 0)
+      acc
+      (snake-pairs (+ x 1) (+ y 1) (- n 1) (acons x y acc))))
+  (cond
+   [(or (= a0 a1) (= b0 b1)) acc]
+   [(<= (+ (- a1 a0) (- b1 b0)) *greedy-limit*)
+    (greedy-common A B eq a0 a1 b0 b1 acc)]
+   [else
+    ;; Strip common prefix and suffix first.
+    (let pre ([a0 a0] [b0 b0] [acc acc])
+      (if (and (< a0 a1) (< b0 b1)
+               (eq (vector-ref A a0) (vector-ref B b0)))
+        (pre (+ a0 1) (+ b0 1) (acons a0 b0 acc))
+        (let suf ([e1 a1] [f1 b1])
+          (if (and (< a0 e1) (< b0 f1)
+                   (eq (vector-ref A (- e1 1)) (vector-ref B (- f1 1))))
+            (suf (- e1 1) (- f1 1))
+            (snake-pairs
+             e1 f1 (- a1 e1)
+             (if (or (= a0 e1) (= b0 f1))
+               acc
+               (receive (x y u v) (middle-snake A B eq a0 e1 b0 f1)
+                 (myers-common A B eq u e1 v f1
+                               (snake-pairs x y (- u x)
+                                            (myers-common A B eq a0 x b0 y
+                                                          acc))))))))))]))
+
+;; Greedy forward search.  The result is the same as the original
+;; implementation, which kept a list of common elements for each diagonal.
+(define (greedy-common A B eq a0 a1 b0 b1 acc)
+  (let* ([N (- a1 a0)]
+         [M (- b1 b0)]
+         [MN (+ N M)]
+         [V (make-vector (+ (* 2 MN) 1) 0)]   ; furthest x on diagonal k
+         [D (make-vector (+ (* 2 MN) 1) #f)]  ; d when V[k] was set
+         [trace (make-vector (+ MN 1) #f)])   ; trace[d][(k+d)/2] = x
+    (define-syntax v
+      (syntax-rules ()
+        [(_ k) (vector-ref V (+ k MN))]
+        [(_ k x) (vector-set! V (+ k MN) x)]))
+    (define (tr d k) (vector-ref (vector-ref trace d) (ash (+ k d) -1)))
+    (define (snake x k)
+      (if (and (< x N) (< (- x k) M)
+               (eq (vector-ref A (+ a0 x)) (vector-ref B (+ b0 (- x k)))))
+        (snake (+ x 1) k)
+        x))
+    ;; Back-track the path from the point on diagonal K at step D.
+    (define (path k d acc)
+      (let loop ([k k] [d d] [r '()])
+        (let* ([x (tr d k)]
+               [down? (and (> d 0)
+                           (or (= k (- d))
+                               (and (not (= k d))
+                                    (< (tr (- d 1) (- k 1))
+                                       (tr (- d 1) (+ k 1))))))]
+               [xs (cond [(= d 0) 0]
+                         [down? (tr (- d 1) (+ k 1))]
+                         [else (+ (tr (- d 1) (- k 1)) 1)])]
+               [r (let snake-loop ([i (- x 1)] [r r])
+                    (if (< i xs)
+                      r
+                      (snake-loop (- i 1)
+                                  (acons (+ a0 i) (+ b0 (- i k)) r))))])
+          (if (= d 0)
+            (append-reverse! r acc)
+            (loop (if down? (+ k 1) (- k 1)) (- d 1) r)))))
+    ;; Like the original, take the path with the most common elements
+    ;; among all diagonals.
+    (define (finish)
+      (let loop ([k (- MN)] [maxl 0] [best #f])
+        (cond [(> k MN) (if best (path best (vector-ref D (+ best MN)) acc) acc)]
+              [(vector-ref D (+ k MN))
+               => (^d (let1 l (ash (- (* 2 (v k)) k d) -1)
+                        (if (> l maxl)
+                          (loop (+ k 1) l k)
+                          (loop (+ k 1) maxl best))))]
+              [else (loop (+ k 1) maxl best)])))
+    (let d-loop ([d 0])
+      (let1 row (make-vector (+ d 1))
+        (vector-set! trace d row)
+        (let k-loop ([k (- d)])
+          (if (> k d)
+            (d-loop (+ d 1))
+            (let1 x (snake (if (or (= k (- d))
+                                   (and (not (= k d))
+                                        (< (v (- k 1)) (v (+ k 1)))))
+                             (v (+ k 1))
+                             (+ (v (- k 1)) 1))
+                           k)
+              (v k x)
+              (vector-set! D (+ k MN) d)
+              (vector-set! row (ash (+ k d) -1) x)
+              (if (and (>= x N) (>= (- x k) M))
+                (finish)
+                (k-loop (+ k 2))))))))))
+
+;; Finds the middle snake of the shortest edit path from (a0,b0) to (a1,b1),
+;; by running the search from both ends.  Returns x, y, u and v, where
+;; (x,y) and (u,v) are the start and the end of the snake.
+(define (middle-snake A B eq a0 a1 b0 b1)
+  (let* ([N (- a1 a0)]
+         [M (- b1 b0)]
+         [delta (- N M)]
+         [odd (odd? delta)]
+         [mx (quotient (+ N M 1) 2)]
+         [off (+ mx 1)]
+         [V (make-vector (+ (* 2 mx) 3) 0)]   ; forward
+         [U (make-vector (+ (* 2 mx) 3) 0)])  ; backward, from the end
+    (define-syntax ref
+      (syntax-rules () [(_ vec k) (vector-ref vec (+ k off))]))
+    (define (start vec k d)
+      (if (or (= k (- d))
+              (and (not (= k d)) (< (ref vec (- k 1)) (ref vec (+ k 1)))))
+        (ref vec (+ k 1))
+        (+ (ref vec (- k 1)) 1)))
+    (let d-loop ([d 0])
+      (let fwd ([k (- d)])
+        (if (<= k d)
+          (let* ([x0 (start V k d)]
+                 [x (let loop ([x x0])
+                      (if (and (< x N) (< (- x k) M)
+                               (eq (vector-ref A (+ a0 x))
+                                   (vector-ref B (+ b0 (- x k)))))
+                        (loop (+ x 1))
+                        x))]
+                 [kb (- delta k)])
+            (vector-set! V (+ k off) x)
+            (if (and odd (< (- d) kb d) (>= (+ x (ref U kb)) N))
+              (values (+ a0 x0) (+ b0 (- x0 k)) (+ a0 x) (+ b0 (- x k)))
+              (fwd (+ k 2))))
+          (let bwd ([k (- d)])
+            (if (<= k d)
+              (let* ([x0 (start U k d)]
+                     [x (let loop ([x x0])
+                          (if (and (< x N) (< (- x k) M)
+                                   (eq (vector-ref A (- a1 x 1))
+                                       (vector-ref B (- b1 (- x k) 1))))
+                            (loop (+ x 1))
+                            x))]
+                     [kf (- delta k)])
+                (vector-set! U (+ k off) x)
+                (if (and (not odd) (<= (- d) kf d) (>= (+ x (ref V kf)) N))
+                  (values (- a1 x) (- b1 (- x k)) (- a1 x0) (- b1 (- x0 k)))
+                  (bwd (+ k 2))))
+              (d-loop (+ d 1)))))))))
+
+;; Patience diff.  A and B are vectors of integers.
+(define (patience-common A B a0 a1 b0 b1 acc)
+  (let pre ([a0 a0] [b0 b0] [acc acc])
+    (if (and (< a0 a1) (< b0 b1) (eqv? (vector-ref A a0) (vector-ref B b0)))
+      (pre (+ a0 1) (+ b0 1) (acons a0 b0 acc))
+      (let suf ([e1 a1] [f1 b1] [sfx '()])
+        (if (and (< a0 e1) (< b0 f1)
+                 (eqv? (vector-ref A (- e1 1)) (vector-ref B (- f1 1))))
+          (suf (- e1 1) (- f1 1) (acons (- e1 1) (- f1 1) sfx))
+          (append-reverse!
+           sfx
+           (let1 anchors (unique-anchors A B a0 e1 b0 f1)
+             (if (null? anchors)
+               (myers-common A B eq? a0 e1 b0 f1 acc)
+               (let loop ([anchors anchors] [i a0] [j b0] [acc acc])
+                 (if (null? anchors)
+                   (patience-common A B i e1 j f1 acc)
+                   (let ([x (caar anchors)] [y (cdar anchors)])
+                     (loop (cdr anchors) (+ x 1) (+ y 1)
+                           (acons x y (patience-common A B i x j y
+                                                       acc))))))))))))))
+
+;; Returns the longest increasing (in B) list of positions (i . j) of
+;; the elements that appear exactly once in both ranges.
+(define (unique-anchors A B a0 a1 b0 b1)
+  (let ([ca (make-hash-table 'eqv?)]
+        [cb (make-hash-table 'eqv?)])   ; id -> position or #f if not unique
+    (do ([i a0 (+ i 1)]) [(= i a1)]
+      (hash-table-update! ca (vector-ref A i) (^c (+ c 1)) 0))
+    (do ([j b0 (+ j 1)]) [(= j b1)]
+      (hash-table-update! cb (vector-ref B j) (^p (if (eq? p 'none) j #f)) 'none))
+    (let1 cands (list->vector
+                 (filter-map (^i (let1 id (vector-ref A i)
+                                   (and (eqv? (hash-table-get ca id) 1)
+                                        (let1 j (hash-table-get cb id #f)
+                                          (and (integer? j) (cons i j))))))
+                             (iota (- a1 a0) a0)))
+      (longest-increasing cands))))
+
+;; Patience sorting.  CANDS is a vector of (i . j), sorted by i.
+(define (longest-increasing cands)
+  (let* ([n (vector-length cands)]
+         [tops (make-vector n #f)]      ; index of the top card of each pile
+         [prev (make-vector n #f)])     ; the card below, in the previous pile
+    (define (j-of k) (cdr (vector-ref cands k)))
+    (let loop ([k 0] [npiles 0])
+      (if (= k n)
+        (if (= npiles 0)
+          '()
+          (let collect ([c (vector-ref tops (- npiles 1))] [r '()])
+            (if c
+              (collect (vector-ref prev c) (cons (vector-ref cands c) r))
+              r)))
+        ;; find the leftmost pile whose top is greater than the card
+        (let search ([lo 0] [hi npiles])
+          (if (< lo hi)
+            (let1 mid (ash (+ lo hi) -1)
+              (if (< (j-of (vector-ref tops mid)) (j-of k))
+                (search (+ mid 1) hi)
+                (search lo mid)))
+            (begin
+              (vector-set! prev k (and (> lo 0) (vector-ref tops (- lo 1))))
+              (vector-set! tops lo k)
+              (loop (+ k 1) (if (= lo npiles) (+ npiles 1) npiles)))))))))
 
 ;; Just returns the LCS
-(define (lcs a b :optional (eq equal?))
-  (map car (cadr (lcs-with-positions a b eq))))
+(define (lcs a b :optional (eq equal?) (algorithm 'myers))
+  (map car (cadr (lcs-with-positions a b eq algorithm))))
 
 ;; Fundamental iterator to deal with editlist.
 ;;   Similar to Perl's Algorith::Diff's traverse_sequence.
-(define (lcs-fold a-only b-only both seed a b :optional (eq equal?))
-  (let1 common (cadr (lcs-with-positions a b eq))
+(define (lcs-fold a-only b-only both seed a b
+                  :optional (eq equal?) (algorithm 'myers))
+  (let1 common (cadr (lcs-with-positions a b eq algorithm))
     ;; Calculates edit-list from the LCS.
     ;; Loop parameters:
     ;;   common - list of common elements
@@ -226,13 +226,7 @@
               tail alist))
 
 (define (split-query-string input)
-  (map (^[elt] (let1 ss (string-split elt #\=)
-                 (cons (uri-decode-string (car ss) :cgi-decode #t)
-                       (if (null? (cdr ss))
-                         #t
-                         (uri-decode-string (string-join (cdr ss) "=")
-                                            :cgi-decode #t)))))
-       (string-split input #[&\;])))
+  (uri-decompose-query input :cgi-decode #t))
 
 ;; part-handlers: ((<name-list> <action> <options> ...) ...)
 ;;  <name-list> : list of field names (string, symbol, or regexp)
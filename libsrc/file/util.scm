@@ -70,6 +70,12 @@
           ))
 (select-module file.util)
 
+;; Used by the parallel directory-fold.
+(autoload control.thread-pool make-thread-pool add-job! terminate-all!
+                              thread-pool-results)
+(autoload control.job job-status job-result)
+(autoload data.queue dequeue/wait!)
+
 ;; Common util.  Returns #f if PATH does not exist.
 
 (define (safe-stat path follow-link?)
@@ -146,40 +152,100 @@
       (map (cut build-path dir <>) entries)
       entries)))
 
+;; Returns ((name . type) ...) of the entries in DIR, sorted by name.
+;; The type comes from readdir, so we don't need to stat each entry.
+(define (%typed-entries dir follow-link? pred filter-add-path?)
+  (sort (filter (if filter-add-path?
+                  (^e (pred (build-path dir (car e))))
+                  (^e (pred (car e))))
+                (sys-readdir dir #t follow-link?))
+        (^[a b] (string<? (car a) (car b)))))
+
+;; Like %typed-entries, but omits "." and "..", and returns full paths.
+(define (%typed-children dir follow-link?)
+  (map (^e (cons (build-path dir (car e)) (cdr e)))
+       (%typed-entries dir follow-link?
+                       (^e (not (member e '("." "..")))) #f)))
+
 ;; directory-list2 DIR &optional ADD-DIR? FILTER-ADD-PATH? CHILDREN? FILTER FOLLOW-LINK?
 (define (directory-list2 dir :key (add-path? #f)
                                   (filter-add-path? #f)
                                   (follow-link? #t)
                              :allow-other-keys other-keys)
-  (let* ([filters (%directory-filter-compose other-keys)]
-         [selector (lambda (e)
-                     (and-let* ([s (safe-stat e follow-link?)])
-                       (eq? (slot-ref s 'type) 'directory)))]
-         [entries (sort (%directory-filter dir filters filter-add-path?))])
+  (receive (dirs files)
+      (partition (^e (eq? (cdr e) 'directory))
+                 (%typed-entries dir follow-link?
+                                 (%directory-filter-compose other-keys)
+                                 filter-add-path?))
     (if add-path?
-      (partition selector (map (cut build-path dir <>) entries))
-      (partition (^e (selector (build-path dir e))) entries))))
+      (values (map (^e (build-path dir (car e))) dirs)
+              (map (^e (build-path dir (car e))) files))
+      (values (map car dirs) (map car files)))))
 
 ;; directory-fold DIR PROC KNIL &keyword LISTER FOLDER FOLLOW-LINK?
+;;                                       THREADS COMBINE
 (define (directory-fold dir proc knil
-                        :key (lister (lambda (path knil)
-                                       (values (directory-list path
-                                                               :add-path? #t
-                                                               :children? #t)
-                                               knil)))
-                             (folder fold)
-                             (follow-link? #t))
+                        :key (lister #f) (folder #f) (follow-link? #t)
+                             (threads #f) (combine #f))
   (define (selector e)
     (and (file-exists? e)
          (eq? (slot-ref (%stat e follow-link?) 'type) 'directory)))
+  (define (default-lister path knil)
+    (values (directory-list path :add-path? #t :children? #t) knil))
   (define (rec path knil)
     (if (selector path)
       ;; [TODO]: For the backward compatibiliy, we allow LISTER to return
       ;; only a single value.  Should be removed, probably in 0.9.
-      (receive res (lister path knil)
-        (folder rec (get-optional (cdr res) knil) (car res)))
+      (receive res ((or lister default-lister) path knil)
+        ((or folder fold) rec (get-optional (cdr res) knil) (car res)))
       (proc path knil)))
-  (rec dir knil))
+  ;; With the default lister, we know whether each entry is a directory
+  ;; from readdir; no need to stat them.
+  (define (walk path knil)
+    (fold (^[e knil]
+            (if (eq? (cdr e) 'directory)
+              (walk (car e) knil)
+              (proc (car e) knil)))
+          knil (%typed-children path follow-link?)))
+  (cond [threads
+         (when (or lister folder)
+           (error "directory-fold: lister and folder can't be used with \
+                   threads"))
+         (unless combine
+           (error "directory-fold: combine is required with threads"))
+         (if (selector dir)
+           (%directory-fold-parallel dir proc knil combine threads
+                                     follow-link?)
+           (proc dir knil))]
+        [(or lister folder) (rec dir knil)]
+        [(selector dir) (walk dir knil)]
+        [else (proc dir knil)]))
+
+;; Each directory becomes a job of a thread pool, which folds PROC over
+;; its non-directory entries starting from KNIL, and submits its
+;; subdirectories as new jobs.  A finished job comes back through the
+;; result queue with its partial result and the number of jobs it spawned,
+;; so we know we're done when the count of outstanding jobs drops to zero.
+(define (%directory-fold-parallel dir proc knil combine nthreads follow-link?)
+  (define pool (make-thread-pool nthreads :work-stealing #t))
+  (define (job path)
+    (let loop ([es (%typed-children path follow-link?)] [seed knil] [n 0])
+      (cond [(null? es) (cons seed n)]
+            [(eq? (cdar es) 'directory)
+             (add-job! pool (cut job (caar es)) #t)
+             (loop (cdr es) seed (+ n 1))]
+            [else (loop (cdr es) (proc (caar es) seed) n)])))
+  (add-job! pool (cut job dir) #t)
+  (unwind-protect
+      (let loop ([outstanding 1] [acc knil])
+        (if (zero? outstanding)
+          acc
+          (let1 j (dequeue/wait! (thread-pool-results pool))
+            (unless (eq? (job-status j) 'done)
+              (raise (job-result j)))
+            (let1 r (job-result j)
+              (loop (+ outstanding (cdr r) -1) (combine acc (car r)))))))
+    (terminate-all! pool :cancel-queued-jobs #t)))
 
 ;; mkdir -p
 (define (make-directory* dir :optional (mode #o755))
@@ -228,6 +228,80 @@
 ;; Derived operations
 ;;
 
+;; Shortcuts for builtin classes
+;;
+;;  The generic versions below go through call-with-iterator, which
+;;  allocates two closures per call and invokes them for every element.
+;;  For builtin collections we know how to walk them directly, so we
+;;  define single-collection versions of fold, map, for-each and find
+;;  with an inlined loop.  N-ary calls still go to the generic version.
+;;
+;;  (define-collection-walkers class (coll (var init) ...)
+;;                             (cursor start end? step) element)
+;;
+;;  VARs are bound sequentially once per call.  CURSOR is initialized
+;;  with START and updated by STEP until END? holds; ELEMENT computes
+;;  the current element from CURSOR.
+
+(define-syntax define-collection-walkers
+  (syntax-rules ()
+    [(_ class (coll (var init) ...) (cur start end? step) elt)
+     (begin
+       (define-method fold (proc knil (coll class))
+         (let* ([var init] ...)
+           (let loop ([cur start] [r knil])
+             (if end? r (loop step (proc elt r))))))
+       (define-method map (proc (coll class))
+         (let* ([var init] ...)
+           (let loop ([cur start] [r '()])
+             (if end? (reverse! r) (loop step (cons (proc elt) r))))))
+       (define-method for-each (proc (coll class))
+         (let* ([var init] ...)
+           (let loop ([cur start])
+             (unless end? (proc elt) (loop step)))))
+       (define-method find (pred (coll class))
+         (let* ([var init] ...)
+           (let loop ([cur start])
+             (cond [end? #f]
+                   [else (let1 e elt (if (pred e) e (loop step)))]))))
+       )]))
+
+(define %uvector-type (with-module gauche.internal %uvector-type))
+(define %uvector-ref  (with-module gauche.internal %uvector-ref))
+
+;; Entries of hash tables and tree maps are returned by their C-level
+;; iterators; *end* marks the end.
+(define *end* (list 'end))
+(define (%hash-table-next iter)
+  (receive (k v) (iter *end*) (if (eq? k *end*) k (cons k v))))
+(define (%tree-map-next iter)
+  (receive (k v) (iter *end* #f) (if (eq? k *end*) k (cons k v))))
+
+(define-collection-walkers <vector>
+  (v [len (vector-length v)])
+  (i 0 (= i len) (+ i 1))
+  (vector-ref v i))
+
+(define-collection-walkers <uvector>
+  (v [type (%uvector-type v)] [len (uvector-length v)])
+  (i 0 (= i len) (+ i 1))
+  (%uvector-ref v type i))
+
+(define-collection-walkers <string>
+  (s [end (string-cursor-end s)])
+  (c (string-cursor-start s) (string-cursor=? c end) (string-cursor-next s c))
+  (string-cursor-ref s c))
+
+(define-collection-walkers <hash-table>
+  (h [iter (%hash-table-iter h)])
+  (e (%hash-table-next iter) (eq? e *end*) (%hash-table-next iter))
+  e)
+
+(define-collection-walkers <tree-map>
+  (t [iter (%tree-map-iter t)])
+  (e (%tree-map-next iter) (eq? e *end*) (%tree-map-next iter))
+  e)
+
 ;; fold -------------------------------------------------
 
 (define-syntax define-fold-k
@@ -400,11 +474,17 @@
 (define-method size-of ((coll <weak-vector>)) (weak-vector-length coll))
 (define-method size-of ((coll <string>))      (string-length coll))
 (define-method size-of ((coll <char-set>))    (char-set-size coll))
+(define-method size-of ((coll <uvector>))     (uvector-length coll))
+(define-method size-of ((coll <hash-table>))  (hash-table-num-entries coll))
+(define-method size-of ((coll <tree-map>))    (tree-map-num-entries coll))
 
 (define-method lazy-size-of ((coll <list>))        (length coll))
 (define-method lazy-size-of ((coll <vector>))      (vector-length coll))
 (define-method lazy-size-of ((coll <weak-vector>)) (weak-vector-length coll))
 (define-method lazy-size-of ((coll <string>))      (string-length coll))
+(define-method lazy-size-of ((coll <uvector>))     (uvector-length coll))
+(define-method lazy-size-of ((coll <hash-table>))  (hash-table-num-entries coll))
+(define-method lazy-size-of ((coll <tree-map>))    (tree-map-num-entries coll))
 
 ;; find -------------------------------------------------
 
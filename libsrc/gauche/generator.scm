@@ -513,6 +513,101 @@
                  (loop)
                  (begin (set! found? #t) v))))))))
 
+;;;
+;;; Pipeline fusion
+;;;
+
+;; A chain like (gmap f (gfilter p (gtake src n))) creates a closure
+;; for each stage, and every element goes through all of them.  The
+;; compiler macros below recognize such nested calls at compile time and
+;; fuse them into one generator whose body is a single loop; the only
+;; procedure calls left per element are the ones to the user-supplied
+;; procedures.  A form we don't recognize (including a call whose
+;; operator is locally rebound) becomes the source of the fused chain.
+
+(define (%fuse-generator-chain form rename compare)
+  (define (call-of? x name nargs)
+    (and (list? x)
+         (= (length x) (+ nargs 1))
+         (or (symbol? (car x)) (identifier? (car x)))
+         (compare (car x) (rename name))))
+  ;; Returns (kind arg input) or #f.
+  (define (stage x)
+    (cond [(call-of? x 'gmap 2)        `(map ,(cadr x) ,(caddr x))]
+          [(call-of? x 'gfilter 2)     `(filter ,(cadr x) ,(caddr x))]
+          [(call-of? x 'gremove 2)     `(remove ,(cadr x) ,(caddr x))]
+          [(call-of? x 'gfilter-map 2) `(filter-map ,(cadr x) ,(caddr x))]
+          [(call-of? x 'gtake-while 2) `(take-while ,(cadr x) ,(caddr x))]
+          [(call-of? x 'gtake 2)       `(take ,(caddr x) ,(cadr x))]
+          [else #f]))
+  (define r-let (rename 'let))
+  (define (r-if . args) (cons (rename 'if) args))
+  (define (eof? v) `(,(rename 'eof-object?) ,v))
+  (define (eof) `(,(rename 'eof-object)))
+  ;; Builds the expression that pulls the next value through stage S
+  ;; from the expression INPUT.  ARG is the variable holding the
+  ;; stage's argument, and STATE the one holding its state if any.
+  (define (pull s arg state input)
+    (let ([v (gensym)] [loop (gensym)])
+      (ecase s
+        [(map) `(,r-let ([,v ,input]) ,(r-if (eof? v) v `(,arg ,v)))]
+        [(filter)
+         `(,r-let ,loop ()
+            (,r-let ([,v ,input])
+              ,(r-if (eof? v) v (r-if `(,arg ,v) v `(,loop)))))]
+        [(remove)
+         `(,r-let ,loop ()
+            (,r-let ([,v ,input])
+              ,(r-if (eof? v) v (r-if `(,arg ,v) `(,loop) v))))]
+        [(filter-map)
+         `(,r-let ,loop ()
+            (,r-let ([,v ,input])
+              ,(r-if (eof? v) v `(,(rename 'or) (,arg ,v) (,loop)))))]
+        [(take)
+         (r-if `(,(rename '<) ,state ,arg)
+               `(,(rename 'begin)
+                 (,(rename 'set!) ,state (,(rename '+) ,state 1))
+                 ,input)
+               (eof))]
+        [(take-while)
+         (r-if state
+               (eof)
+               `(,r-let ([,v ,input])
+                  ,(r-if `(,(rename 'or) ,(eof? v)
+                                         (,(rename 'not) (,arg ,v)))
+                         `(,(rename 'begin) (,(rename 'set!) ,state #t)
+                                            ,(eof))
+                         v)))])))
+  ;; Collect stages, innermost first.
+  (let loop ([x form] [stages '()])
+    (if-let1 s (stage x)
+      (loop (caddr s) (cons (list (car s) (cadr s) (gensym) (gensym)) stages))
+      (if (< (length stages) 2)
+        form
+        (let* ([gen (gensym)]
+               [states (filter-map (^s (case (car s)
+                                         [(take) `(,(cadddr s) 0)]
+                                         [(take-while) `(,(cadddr s) #f)]
+                                         [else #f]))
+                                   stages)])
+          ;; Arguments are evaluated from the outermost stage to the
+          ;; innermost, then the source, as the nested calls would do.
+          `(,(rename 'let*) (,@(map (^s `(,(caddr s) ,(cadr s)))
+                                    (reverse stages))
+                             (,gen (,(rename '%->gen) ,x))
+                             ,@states)
+            (,(rename 'lambda) ()
+             ,(fold (^[s input] (pull (car s) (caddr s) (cadddr s) input))
+                    `(,gen)
+                    stages))))))))
+
+(define-compiler-macro gmap (er-transformer %fuse-generator-chain))
+(define-compiler-macro gfilter (er-transformer %fuse-generator-chain))
+(define-compiler-macro gremove (er-transformer %fuse-generator-chain))
+(define-compiler-macro gfilter-map (er-transformer %fuse-generator-chain))
+(define-compiler-macro gtake (er-transformer %fuse-generator-chain))
+(define-compiler-macro gtake-while (er-transformer %fuse-generator-chain))
+
 ;; generate :: ((a -> ()) -> ()) -> Generator a
 (define (generate proc)
   (define (cont)
@@ -124,20 +124,43 @@
          (^[] (set! restarted #t)
               (set! V (%restore-parameter P V)))))]
     [(_ ((param val) ...) . body)
-     (let ([P (list param ...)]
-           [S '()]                      ;saved values
+     (let ([P (vector param ...)]
+           [S #f]                       ;saved values
            [restarted #f])
        (dynamic-wind
          (^[] (if restarted
-                (set! S (map (^[p v] (%restore-parameter p v)) P S))
-                (set! S (map (^[p] (p)) P))))
+                (%swap-parameters! P S)
+                (set! S (%parameter-values P))))
          (^[] (unless restarted
-                (set! S (map (^[p v] (p v)) P (list val ...))))
+                (%set-parameters! P (vector val ...)))
            . body)
          (^[] (set! restarted #t)
-              (set! S (map (^[p v] (%restore-parameter p v)) P S)))))]
+              (%swap-parameters! P S))))]
     [(_ . x) (syntax-rules "Invalid parameterize form:" (parameterize . x))]))
 
+;; Used by parameterize with multiple parameters.  Parameters and values
+;; are kept in vectors, so that the entry and exit of the dynamic extent
+;; don't allocate.  %swap-parameters! restores values in V and saves
+;; the current ones into V, to be restored on re-entry.
+(define (%parameter-values P)
+  (rlet1 V (make-vector (vector-length P))
+    (let loop ([i 0])
+      (when (< i (vector-length P))
+        (vector-set! V i ((vector-ref P i)))
+        (loop (+ i 1))))))
+
+(define (%set-parameters! P V)
+  (let loop ([i 0])
+    (when (< i (vector-length P))
+      ((vector-ref P i) (vector-ref V i))
+      (loop (+ i 1)))))
+
+(define (%swap-parameters! P V)
+  (let loop ([i 0])
+    (when (< i (vector-length P))
+      (vector-set! V i (%restore-parameter (vector-ref P i) (vector-ref V i)))
+      (loop (+ i 1)))))
+
 ;; hooks
 
 (define-method parameter-pre-observers ((self <parameter>))
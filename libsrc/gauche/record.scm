@@ -41,7 +41,14 @@
           record? record-rtd rtd-name rtd-parent
           rtd-field-names rtd-all-field-names rtd-field-mutable?
           make-rtd rtd? rtd-constructor rtd-predicate rtd-accessor rtd-mutator
-          define-record-type)
+          define-record-type
+
+          <packed-record-meta> make-packed-rtd packed-rtd?
+          packed-record-storage define-packed-record-type
+          <record-array> make-record-array record-array? record-array-rtd
+          record-array-length record-array-storage
+          record-array-ref record-array-set!
+          record-array-accessor record-array-mutator)
   )
 (select-module gauche.record)
 
@@ -177,6 +184,10 @@
 (define (%check-rtd obj)
   (unless (rtd? obj) (error "rtd required, bot got" obj)))
 
+;; Packed records have internal slots that aren't fields.
+(define (%field-slots slots)
+  (remove (^s (slot-definition-option s :hidden #f)) slots))
+
 ;;;
 ;;; Inspection layer
 ;;;
@@ -196,21 +207,22 @@
 
 (define (rtd-field-names rtd)
   (%check-rtd rtd)
-  (map-to <vector> slot-definition-name (class-direct-slots rtd)))
+  (map-to <vector> slot-definition-name (%field-slots (class-direct-slots rtd))))
 
 (define (rtd-all-field-names rtd)
   (%check-rtd rtd)
   (let loop ([rtd (rtd-parent rtd)]
-             [r (map slot-definition-name (class-direct-slots rtd))])
+             [r (map slot-definition-name
+                     (%field-slots (class-direct-slots rtd)))])
     (if rtd
       (loop (rtd-parent rtd)
             (fold-right (^[s r] (cons (slot-definition-name s) r))
-                        r (class-direct-slots rtd)))
+                        r (%field-slots (class-direct-slots rtd))))
       (list->vector r))))
 
 (define (rtd-field-mutable? rtd field)
   (%check-rtd rtd)
-  (if-let1 s (assq field (class-slots rtd))
+  (if-let1 s (assq field (%field-slots (class-slots rtd)))
     (not (slot-definition-option s :immutable #f))
     (error "rtd-mutable?: ~a does not have a slot ~a" rtd field)))
 
@@ -219,6 +231,8 @@
 ;;;
 
 (define (make-rtd name fieldspecs :optional (parent #f) :rest opts)
+  (when (packed-rtd? parent)
+    (error "make-rtd: packed record type can't be a parent:" parent))
   (make (if parent (class-of parent) <record-meta>)
     :name name :field-specs fieldspecs :metaclass <record-meta>
     :supers (list (or parent <record>))
@@ -424,3 +438,378 @@
             ,@(build-accessors typename)
             ,@(build-mutators typename)))
     )
+;;;
+;;; Packed records
+;;;
+
+;; A packed record keeps its typed fields unboxed in a u8vector, laid out
+;; like a C struct: each field is aligned to its size, and the whole
+;; record is padded to the largest alignment.  The instance slots are:
+;;
+;;   0     the storage (u8vector)
+;;   1..n  aliases of the storage, one for each uvector class used
+;;         by the typed fields
+;;   rest  untyped fields, as ordinary slots
+;;
+;; Typed fields are virtual slots that read and write the aliases.
+;; A record array places records of the same packed type back to back
+;; in one u8vector; a record taken out of it shares the array's storage.
+;; Packed record types can't have a parent.
+
+(define (%s64vector-set-fixnum! v k x)
+  (unless (fixnum? x) (error "fixnum required, but got" x))
+  (s64vector-set! v k x))
+
+;; type => (class size ref set! ref-name set!-name)
+(define *packed-field-types*
+  `((s8     ,<s8vector>  1 ,s8vector-ref  ,s8vector-set!
+                           s8vector-ref   s8vector-set!)
+    (u8     ,<u8vector>  1 ,u8vector-ref  ,u8vector-set!
+                           u8vector-ref   u8vector-set!)
+    (s16    ,<s16vector> 2 ,s16vector-ref ,s16vector-set!
+                           s16vector-ref  s16vector-set!)
+    (u16    ,<u16vector> 2 ,u16vector-ref ,u16vector-set!
+                           u16vector-ref  u16vector-set!)
+    (s32    ,<s32vector> 4 ,s32vector-ref ,s32vector-set!
+                           s32vector-ref  s32vector-set!)
+    (u32    ,<u32vector> 4 ,u32vector-ref ,u32vector-set!
+                           u32vector-ref  u32vector-set!)
+    (s64    ,<s64vector> 8 ,s64vector-ref ,s64vector-set!
+                           s64vector-ref  s64vector-set!)
+    (u64    ,<u64vector> 8 ,u64vector-ref ,u64vector-set!
+                           u64vector-ref  u64vector-set!)
+    (fixnum ,<s64vector> 8 ,s64vector-ref ,%s64vector-set-fixnum!
+                           s64vector-ref  %s64vector-set-fixnum!)
+    (f16    ,<f16vector> 2 ,f16vector-ref ,f16vector-set!
+                           f16vector-ref  f16vector-set!)
+    (f32    ,<f32vector> 4 ,f32vector-ref ,f32vector-set!
+                           f32vector-ref  f32vector-set!)
+    (f64    ,<f64vector> 8 ,f64vector-ref ,f64vector-set!
+                           f64vector-ref  f64vector-set!)))
+
+(define (%ptype type) (cdr (assq type *packed-field-types*)))
+(define (%ptype-class type) (car (%ptype type)))
+(define (%ptype-size type)  (cadr (%ptype type)))
+(define (%ptype-ref type)   (caddr (%ptype type)))
+(define (%ptype-set! type)  (cadddr (%ptype type)))
+
+;; Returns a list of (name mutable? type), where type is #f for an
+;; untyped field.
+(define (%parse-packed-fieldspecs specs)
+  (define (id? x) (or (symbol? x) (identifier? x)))
+  (define (bad spec) (error "make-packed-rtd: invalid field spec:" spec))
+  (define (check-type type spec)
+    (let1 type (unwrap-syntax type)
+      (cond [(or (not type) (eq? type 'obj)) #f]
+            [(assq type *packed-field-types*) type]
+            [else (error "make-packed-rtd: unknown field type:" type)])))
+  (unless (vector? specs)
+    (error "make-packed-rtd: fieldspecs must be a vector, but got" specs))
+  (map (^[spec]
+         (match spec
+           [((and (or 'mutable 'immutable) mut) (? id? name) . opt)
+            (list (unwrap-syntax name) (eq? mut 'mutable)
+                  (match opt
+                    [() #f]
+                    [(type) (check-type type spec)]
+                    [_ (bad spec)]))]
+           [(? id? name) (list (unwrap-syntax name) #t #f)]
+           [_ (bad spec)]))
+       (vector->list specs)))
+
+;; Given the result of %parse-packed-fieldspecs, returns the record size
+;; in bytes, a list of uvector classes of the aliases, and a list of
+;; (name mutable? type slot-index elt-index).  For a typed field,
+;; slot-index is the alias slot and elt-index is the index in the alias.
+(define (%packed-layout fields)
+  (define (round-up n a) (* (quotient (+ n a -1) a) a))
+  (let* ([classes (fold (^[f cs]
+                          (let1 type (caddr f)
+                            (if (and type (not (memq (%ptype-class type) cs)))
+                              (cons (%ptype-class type) cs)
+                              cs)))
+                        '() fields)]
+         [classes (reverse classes)])
+    (let loop ([fs fields] [off 0] [align 1]
+               [k (+ (length classes) 1)] [r '()])
+      (match fs
+        [() (values (round-up off align) classes (reverse r))]
+        [((name mut? #f) . rest)
+         (loop rest off align (+ k 1) (cons (list name mut? #f k #f) r))]
+        [((name mut? type) . rest)
+         (let* ([size (%ptype-size type)]
+                [pos  (round-up off size)]
+                [vk   (+ (find-index (cut eq? (%ptype-class type) <>) classes)
+                         1)])
+           (loop rest (+ pos size) (max align size) k
+                 (cons (list name mut? type vk (quotient pos size)) r)))]))))
+
+(define-class <packed-record-meta> (<record-meta>)
+  ((record-size  :init-keyword :record-size)
+   (view-classes :init-keyword :view-classes)
+   (layout       :init-keyword :layout)))
+
+(define-method compute-get-n-set ((class <packed-record-meta>) slot)
+  (match (slot-definition-option slot :packed #f)
+    [(type k j)
+     (let ([ref (%ptype-ref type)]
+           [set (%ptype-set! type)]
+           [name (slot-definition-name slot)])
+       `(,(^o (ref ((with-module gauche.object %record-ref) class o k) j))
+         ,(if (slot-definition-option slot :immutable #f)
+            (^[o v] (errorf "slot ~a of ~a is immutable" name o))
+            (^[o v] (set ((with-module gauche.object %record-ref) class o k)
+                         j v)))
+         ,(^o #t)))]
+    [_ (next-method)]))
+
+(define (make-packed-rtd name fieldspecs)
+  (receive (size classes layout)
+      (%packed-layout (%parse-packed-fieldspecs fieldspecs))
+    (make <packed-record-meta>
+      :name name :field-specs fieldspecs :metaclass <packed-record-meta>
+      :supers (list <record>)
+      :record-size size :view-classes classes :layout layout
+      :slots `((%storage :index 0 :hidden #t)
+               ,@(map-with-index
+                  (^[i c] `(,(string->symbol (format "%view~a" (+ i 1)))
+                            :index ,(+ i 1) :hidden #t))
+                  classes)
+               ,@(map (match-lambda
+                        [(name mut? #f k _)
+                         `(,name :index ,k :immutable ,(not mut?))]
+                        [(name mut? type k j)
+                         `(,name :packed (,type ,k ,j)
+                                 :immutable ,(not mut?))])
+                      layout)))))
+
+(define (packed-rtd? obj) (is-a? obj <packed-record-meta>))
+
+(define (%packed-field rtd field)
+  (or (assq field (slot-ref rtd 'layout))
+      (errorf "record ~s does not have a slot named ~s" rtd field)))
+
+;; Creates an instance of RTD whose storage is the region of STORAGE
+;; beginning at byte START.
+(define (%packed-instance rtd storage start)
+  (let* ([end (+ start (slot-ref rtd 'record-size))]
+         [views (map (^c (uvector-alias c storage start end))
+                     (slot-ref rtd 'view-classes))])
+    (if (and (= start 0) (= end (u8vector-length storage)))
+      (apply (%make) rtd storage views)
+      (apply (%make) rtd (uvector-alias <u8vector> storage start end) views))))
+
+(define (%packed-allocate rtd)
+  (%packed-instance rtd (make-u8vector (slot-ref rtd 'record-size) 0) 0))
+
+;; Returns a procedure to set the field regardless of its mutability.
+(define (%packed-field-setter rtd field)
+  (match (%packed-field rtd field)
+    [(_ _ #f k _)
+     (^[o v] ((with-module gauche.object %record-set!) rtd o k v))]
+    [(_ _ type k j)
+     (let1 set (%ptype-set! type)
+       (^[o v] (set ((with-module gauche.object %record-ref) rtd o k) j v)))]))
+
+(define (%packed-field-getter rtd field)
+  (match (%packed-field rtd field)
+    [(_ _ #f k _)
+     (^o ((with-module gauche.object %record-ref) rtd o k))]
+    [(_ _ type k j)
+     (let1 ref (%ptype-ref type)
+       (^o (ref ((with-module gauche.object %record-ref) rtd o k) j)))]))
+
+(define-method %rtd-constructor ((rtd <packed-record-meta>) . rest)
+  (let* ([names (vector->list (if (null? rest)
+                                (rtd-all-field-names rtd)
+                                (car rest)))]
+         [setters (map (cut %packed-field-setter rtd <>) names)]
+         [nargs (length setters)])
+    (^ args
+      (unless (= (length args) nargs)
+        (errorf "constructor of ~s takes ~a argument(s), but got: ~s"
+                rtd nargs args))
+      (rlet1 o (%packed-allocate rtd)
+        (for-each (^[set v] (set o v)) setters args)))))
+
+(define-method %rtd-accessor ((rtd <packed-record-meta>) field)
+  (let1 getter (%packed-field-getter rtd field)
+    (if (cadr (%packed-field rtd field))
+      (getter-with-setter getter (%packed-field-setter rtd field))
+      getter)))
+
+(define-method %rtd-mutator ((rtd <packed-record-meta>) field)
+  (unless (cadr (%packed-field rtd field))
+    (errorf "slot ~a of record ~s is immutable" field rtd))
+  (%packed-field-setter rtd field))
+
+(define (packed-record-storage rec)
+  (unless (packed-rtd? (class-of rec))
+    (error "packed record required, but got" rec))
+  ((with-module gauche.object %record-ref) (class-of rec) rec 0))
+
+;; Record arrays
+
+(define-class <record-array> (<sequence>)
+  ((rtd     :init-keyword :rtd)
+   (length  :init-keyword :length)
+   (storage :init-keyword :storage)
+   (views   :init-keyword :views)))     ; vector of aliases, in the order
+                                        ; of the rtd's view-classes
+
+(define (make-record-array rtd n)
+  (unless (packed-rtd? rtd)
+    (error "make-record-array: packed record type required, but got" rtd))
+  (unless (every caddr (slot-ref rtd 'layout))
+    (error "make-record-array: record type with untyped fields can't be \
+            stored in a record array:" rtd))
+  (let1 storage (make-u8vector (* n (slot-ref rtd 'record-size)) 0)
+    (make <record-array> :rtd rtd :length n :storage storage
+          :views (map-to <vector> (cut uvector-alias <> storage)
+                         (slot-ref rtd 'view-classes)))))
+
+(define (record-array? obj) (is-a? obj <record-array>))
+(define (%check-record-array obj)
+  (unless (record-array? obj) (error "record array required, but got" obj)))
+(define (record-array-rtd a) (%check-record-array a) (slot-ref a 'rtd))
+(define (record-array-length a) (%check-record-array a) (slot-ref a 'length))
+(define (record-array-storage a) (%check-record-array a) (slot-ref a 'storage))
+
+(define (%check-record-array-index a i)
+  (unless (and (exact-integer? i) (<= 0 i) (< i (slot-ref a 'length)))
+    (error "record array index out of range:" i)))
+
+;; Returns a record that shares the storage with the array.
+(define (record-array-ref a i)
+  (%check-record-array a)
+  (%check-record-array-index a i)
+  (let1 rtd (slot-ref a 'rtd)
+    (%packed-instance rtd (slot-ref a 'storage)
+                      (* i (slot-ref rtd 'record-size)))))
+
+(define (record-array-set! a i rec)
+  (%check-record-array a)
+  (%check-record-array-index a i)
+  (let1 rtd (slot-ref a 'rtd)
+    (unless (is-a? rec rtd)
+      (errorf "record of type ~s required, but got ~s" rtd rec))
+    (u8vector-copy! (slot-ref a 'storage) (* i (slot-ref rtd 'record-size))
+                    (packed-record-storage rec))))
+
+;; These access a field of the I-th record directly, without creating
+;; a record instance.
+(define (%record-array-field-proc rtd field make-proc)
+  (unless (packed-rtd? rtd)
+    (error "packed record type required, but got" rtd))
+  (match (%packed-field rtd field)
+    [(_ mut? type k j)
+     (make-proc mut? type (- k 1)
+                (quotient (slot-ref rtd 'record-size) (%ptype-size type)) j)]))
+
+(define (%record-array-views a rtd)
+  (unless (and (record-array? a) (eq? (slot-ref a 'rtd) rtd))
+    (errorf "record array of ~s required, but got ~s" rtd a))
+  (slot-ref a 'views))
+
+(define (%record-array-setter rtd type vi stride j)
+  (let1 set (%ptype-set! type)
+    (^[a i v]
+      (set (vector-ref (%record-array-views a rtd) vi) (+ (* i stride) j) v))))
+
+(define (record-array-accessor rtd field)
+  (%record-array-field-proc
+   rtd field
+   (^[mut? type vi stride j]
+     (let* ([ref (%ptype-ref type)]
+            [getter (^[a i] (ref (vector-ref (%record-array-views a rtd) vi)
+                                 (+ (* i stride) j)))])
+       (if mut?
+         (getter-with-setter getter (%record-array-setter rtd type vi stride j))
+         getter)))))
+
+(define (record-array-mutator rtd field)
+  (%record-array-field-proc
+   rtd field
+   (^[mut? type vi stride j]
+     (unless mut?
+       (errorf "slot ~a of record ~s is immutable" field rtd))
+     (%record-array-setter rtd type vi stride j))))
+
+(define-method size-of ((a <record-array>)) (slot-ref a 'length))
+(define-method referencer ((a <record-array>)) record-array-ref)
+(define-method modifier   ((a <record-array>)) record-array-set!)
+(define-method call-with-iterator ((a <record-array>) proc :key (start 0))
+  (let ([i start] [n (slot-ref a 'length)])
+    (proc (^[] (>= i n))
+          (^[] (begin0 (record-array-ref a i) (inc! i))))))
+
+;; The accessors and modifiers defined by this macro are expanded into
+;; direct references to the storage, computed from the layout at
+;; the macro expansion time.
+(define-macro (define-packed-record-type type-spec ctor-spec pred-spec
+                . field-specs)
+  (define (->id x) ((with-module gauche.internal make-identifier) x
+                    (find-module 'gauche.record) '()))
+  (define (id? x)  (or (symbol? x) (identifier? x)))
+  (define %define-inline (->id 'define-inline))
+  (define %make (->id 'make-packed-rtd))
+  (define %ctor (->id 'rtd-constructor))
+  (define %pred (->id 'rtd-predicate))
+  (define %ref `(,(->id 'with-module) gauche.object %record-ref))
+  (define %set `(,(->id 'with-module) gauche.object %record-set!))
+  (define typename
+    (if (id? type-spec)
+      type-spec
+      (error "invalid type-spec for define-packed-record-type:" type-spec)))
+  (define fieldspecs
+    (map-to <vector> (match-lambda
+                       [((? id? f) type) `(mutable ,f ,type)]
+                       [((? id? f) type a) `(immutable ,f ,type)]
+                       [((? id? f) type a m) `(mutable ,f ,type)]
+                       [x (error "invalid field spec:" x)])
+            field-specs))
+  (define layout
+    (receive (size classes layout)
+        (%packed-layout (%parse-packed-fieldspecs fieldspecs))
+      layout))
+  (define (field-names f)               ; returns (accessor modifier)
+    (match f
+      [(f type) (list (sym+ typename '- f) (sym+ typename '- f '-set!))]
+      [(f type a) (list a #f)]
+      [(f type a m) (list a m)]))
+  (define (build-field f)
+    (match-let1 (name _ type k j) (assq (unwrap-syntax (car f)) layout)
+      (match-let1 (acc mod) (field-names f)
+        (let ([o (gensym)] [v (gensym)])
+          `((,%define-inline (,acc ,o)
+              ,(if type
+                 `(,(->id (list-ref (%ptype type) 4))
+                   (,%ref ,typename ,o ,k) ,j)
+                 `(,%ref ,typename ,o ,k)))
+            ,@(if mod
+                `((,%define-inline (,mod ,o ,v)
+                    ,(if type
+                       `(,(->id (list-ref (%ptype type) 5))
+                         (,%ref ,typename ,o ,k) ,j ,v)
+                       `(,%set ,typename ,o ,k ,v))))
+                '()))))))
+  (define tmp (gensym))
+  `(begin
+     (,%define-inline ,typename (,%make ',typename ',fieldspecs))
+     ,@(match ctor-spec
+         [#f '()]
+         [#t `((,%define-inline ,(sym+ 'make- typename) (,%ctor ,typename)))]
+         [((? id? ctor-name) field ...)
+          `((,%define-inline ,ctor-name
+              (,%ctor ,typename ,(list->vector field))))]
+         [(? id? ctor-name)
+          `((,%define-inline ,ctor-name (,%ctor ,typename)))]
+         [x (error "invalid constructor spec" ctor-spec)])
+     ,@(match pred-spec
+         [#f '()]
+         [#t `((,%define-inline (,(sym+ typename '?) ,tmp)
+                 ((,%pred ,typename) ,tmp)))]
+         [(? id? pred-name)
+          `((,%define-inline (,pred-name ,tmp) ((,%pred ,typename) ,tmp)))]
+         [x (error "invalid predicate spec" pred-spec)])
+     ,@(append-map build-field field-specs)))
@@ -146,6 +146,26 @@
 (define-method fold-right (proc seed (seq <list>))
   ((with-module gauche fold-right) proc seed seq))
 
+;; for indexable ones, we walk backwards directly.
+(define-method fold-right (proc seed (seq <vector>))
+  (do ([i (- (vector-length seq) 1) (- i 1)]
+       [r seed (proc (vector-ref seq i) r)])
+      [(< i 0) r]))
+
+(define-method fold-right (proc seed (seq <uvector>))
+  (let1 type (%uvector-type seq)
+    (do ([i (- (uvector-length seq) 1) (- i 1)]
+         [r seed (proc (%uvector-ref seq type i) r)])
+        [(< i 0) r])))
+
+(define-method fold-right (proc seed (seq <string>))
+  (let1 start (string-cursor-start seq)
+    (let loop ([c (string-cursor-end seq)] [r seed])
+      (if (string-cursor=? c start)
+        r
+        (let1 c (string-cursor-prev seq c)
+          (loop c (proc (string-cursor-ref seq c) r)))))))
+
 (define-method fold-right (proc seed (seq1 <list>) (seq2 <list>))
   ((with-module gauche fold-right) proc seed seq1 seq2))
 
@@ -173,12 +193,6 @@
        [r knil  (proc i (car seq) r)])
       [(null? seq) r]))
 
-(define-method fold-with-index (proc knil (seq <vector>))
-  (do ([len (vector-length seq)]
-       [i 0 (+ i 1)]
-       [r knil (proc i (vector-ref seq i) r)])
-      [(= i len) r]))
-
 (define-method map-with-index (proc (seq <sequence>) . more)
   (if (null? more)
     (with-iterator (seq end? next)
@@ -199,12 +213,6 @@
        [r '() (cons (proc i (car seq)) r)])
       [(null? seq) (reverse! r)]))
 
-(define-method map-with-index (proc (seq <vector>))
-  (do ([len (vector-length seq)]
-       [i 0   (+ i 1)]
-       [r '() (cons (proc i (vector-ref seq i)) r)])
-      [(= i len) (reverse! r)]))
-
 (define-method map-to-with-index (class proc (seq <sequence>) . more)
   (if (null? more)
       (with-builder (class add! get :size (size-of seq))
@@ -243,12 +251,6 @@
       [(null? seq)]
     (proc i (car seq))))
 
-(define-method for-each-with-index (proc (seq <vector>))
-  (do ([len (vector-length seq)]
-       [i 0 (+ i 1)])
-      [(= i len)]
-    (proc i (vector-ref seq i))))
-
 ;; find with index ------------------------------------
 
 (define-method find-with-index (pred (seq <sequence>))
@@ -267,11 +269,52 @@
     (cond [(null? seq) (values #f #f)]
           [(pred (car seq)) (values i (car seq))]
           [else (loop (+ i 1) (cdr seq))])))
-(define-method find-with-index (pred (seq <vector>))
-  (let loop ([i 0] [len (vector-length seq)])
-    (cond [(= i len) (values #f #f)]
-          [(pred (vector-ref seq i)) (values i (vector-ref seq i))]
-          [else (loop (+ i 1) len)])))
+
+;; Shortcuts of the above for builtin sequences.  The arguments are
+;; the same as define-collection-walkers in gauche.collection; the
+;; index is counted separately from the cursor, for strings don't
+;; walk by index.
+(define-syntax define-sequence-walkers
+  (syntax-rules ()
+    [(_ class (seq (var init) ...) (cur start end? step) elt)
+     (begin
+       (define-method fold-with-index (proc knil (seq class))
+         (let* ([var init] ...)
+           (let loop ([cur start] [i 0] [r knil])
+             (if end? r (loop step (+ i 1) (proc i elt r))))))
+       (define-method map-with-index (proc (seq class))
+         (let* ([var init] ...)
+           (let loop ([cur start] [i 0] [r '()])
+             (if end?
+               (reverse! r)
+               (loop step (+ i 1) (cons (proc i elt) r))))))
+       (define-method for-each-with-index (proc (seq class))
+         (let* ([var init] ...)
+           (let loop ([cur start] [i 0])
+             (unless end? (proc i elt) (loop step (+ i 1))))))
+       (define-method find-with-index (pred (seq class))
+         (let* ([var init] ...)
+           (let loop ([cur start] [i 0])
+             (if end?
+               (values #f #f)
+               (let1 e elt
+                 (if (pred e) (values i e) (loop step (+ i 1))))))))
+       )]))
+
+(define-sequence-walkers <vector>
+  (v [len (vector-length v)])
+  (k 0 (= k len) (+ k 1))
+  (vector-ref v k))
+
+(define-sequence-walkers <uvector>
+  (v [type (%uvector-type v)] [len (uvector-length v)])
+  (k 0 (= k len) (+ k 1))
+  (%uvector-ref v type k))
+
+(define-sequence-walkers <string>
+  (s [end (string-cursor-end s)])
+  (c (string-cursor-start s) (string-cursor=? c end) (string-cursor-next s c))
+  (string-cursor-ref s c))
 
 (define-method find-index (pred (seq <sequence>))
   (receive (i e) (find-with-index pred seq) i))
@@ -66,7 +66,7 @@
           base64-encode-string base64-encode)
 (autoload gauche.charconv
           ces-upper-compatible? ces-conversion-supported? ces-convert)
-(autoload rfc.mime-port make-mime-port)
+(autoload rfc.mime-port make-mime-port mime-port-headers)
 (autoload srfi-27 random-integer)       ;for MIME boundary generation
 
 ;;===============================================================
@@ -359,7 +359,7 @@
          [mime-port (make-mime-port boundary port)])
     (let loop ([index 0]
                [contents '()])
-      (let* ([headers (rfc822-header->list mime-port)]
+      (let* ([headers (mime-port-headers mime-port)]
              [r (internal-parse mime-port headers handler
                                 packet index
                                 default-type)])
@@ -412,18 +412,10 @@
         (display (decoder line) outp)
         (loop (read-line/nl)))))
 
+  ;; base64-decode skips line breaks, so we can feed the body as is.
   (define (read-base64)
-    (define (base64-output string out)
-      (with-input-from-string string
-        (cut with-port-locking (current-input-port)
-             (cut with-output-to-port out base64-decode))))
-    (let1 buf (open-output-string :private? #t)
-      (let loop ([line (read-line inp)])
-        (unless (eof-object? line)
-          (display line buf)
-          (loop (read-line inp))))
-      (base64-output (get-output-string buf) outp))
-    )
+    (with-input-from-port inp
+      (cut with-output-to-port outp base64-decode)))
 
   (with-port-locking inp
     (^[] (let1 enc (ref packet 'transfer-encoding)
@@ -432,10 +424,7 @@
             [(string-ci=? enc "quoted-printable")
              (read-text quoted-printable-decode-string)]
             [(member enc '("7bit" "8bit" "binary"))
-             (let loop ((b (read-byte inp)))
-               (unless (eof-object? b)
-                 (write-byte b outp)
-                 (loop (read-byte inp))))]
+             (copy-port inp outp)]
             ))))
   )
 
@@ -410,7 +410,61 @@
 ;;;   FILTER in this source code share longest common tails between args
 ;;;   and results to get structure sharing in the lset procedures.
 
-(define (%lset2<= = lis1 lis2) (every (^x (member x lis2 =)) lis1))
+;;; Hashed fast path.  When = is one of eq?, eqv?, equal? or string=?
+;;; and the lists involved are long enough, membership tests go through
+;;; a hash table instead of a linear scan, making the operations O(n)
+;;; instead of O(n^2).  For equal? we only do so when every element can be
+;;; hashed without calling object-hash, which user-defined classes may
+;;; not have.  Results are the same as the linear versions, including
+;;; the order of elements and sharing of structure.
+
+(define-constant *lset-hash-threshold* 16)
+
+(define (%lset-hashable? x depth)
+  (cond [(or (number? x) (string? x) (symbol? x) (keyword? x)
+             (char? x) (boolean? x) (null? x)) #t]
+        [(<= depth 0) #f]
+        [(pair? x) (and (list? x)
+                        (<= (length x) 64)
+                        (every (cut %lset-hashable? <> (- depth 1)) x))]
+        [(vector? x) (and (<= (vector-length x) 64)
+                          (every (cut %lset-hashable? <> (- depth 1))
+                                 (vector->list x)))]
+        [else #f]))
+
+;; Returns the hash table type to use for the elements of LISTS, or #f
+;; if we should use linear scan.
+(define (%lset-hash-type = lists)
+  (let1 type (cond [(eq? = eq?)      'eq?]
+                   [(eq? = eqv?)     'eqv?]
+                   [(eq? = equal?)   'equal?]
+                   [(eq? = string=?) 'string=?]
+                   [else #f])
+    (and type
+         (> (fold (^[lis n] (+ (length lis) n)) 0 lists)
+            *lset-hash-threshold*)
+         (case type
+           [(eq? eqv?) #t]
+           [(equal?) (every (cut every (cut %lset-hashable? <> 4) <>) lists)]
+           [(string=?) (every (cut every string? <>) lists)])
+         type)))
+
+(define (%lset-table type lis)
+  (rlet1 tab (make-hash-table type)
+    (dolist [x lis] (hash-table-put! tab x #t))))
+
+;; Returns a list of predicates, each of which tests if the given item
+;; is a member of the corresponding list in LISTS.  The items tested are
+;; taken from PROBE.
+(define (%lset-memberers = probe lists)
+  (if-let1 type (%lset-hash-type = (cons probe lists))
+    (map (^[lis] (let1 tab (%lset-table type lis)
+                   (^x (hash-table-exists? tab x))))
+         lists)
+    (map (^[lis] (^x (member x lis =))) lists)))
+
+(define (%lset2<= = lis1 lis2)
+  (every (car (%lset-memberers = lis1 (list lis2))) lis1))
 
 (define (lset<= = . lists)
   (check-arg procedure? =)
@@ -436,8 +490,15 @@
 
 (define (lset-adjoin = lis . elts)
   (check-arg procedure? =)
-  (fold (lambda (elt ans) (if (member elt ans =) ans (cons elt ans)))
-        lis elts))
+  (if-let1 type (%lset-hash-type = (list lis elts))
+    (let1 tab (%lset-table type lis)
+      (fold (lambda (elt ans)
+              (if (hash-table-exists? tab elt)
+                ans
+                (begin (hash-table-put! tab elt #t) (cons elt ans))))
+            lis elts))
+    (fold (lambda (elt ans) (if (member elt ans =) ans (cons elt ans)))
+          lis elts)))
 
 
 (define (lset-union = . lists)
@@ -446,6 +507,15 @@
             (cond ((null? lis) ans)     ; Don't copy any lists
                   ((null? ans) lis)     ; if we don't have to.
                   ((eq? lis ans) ans)
+                  ((%lset-hash-type = (list lis ans))
+                   => (lambda (type)
+                        (let1 tab (%lset-table type ans)
+                          (fold (lambda (elt ans)
+                                  (if (hash-table-exists? tab elt)
+                                    ans
+                                    (begin (hash-table-put! tab elt #t)
+                                           (cons elt ans))))
+                                ans lis))))
                   (else
                    (fold (lambda (elt ans) (if (any (^x (= x elt)) ans)
                                              ans
@@ -459,6 +529,18 @@
             (cond ((null? lis) ans)     ; Don't copy any lists
                   ((null? ans) lis)     ; if we don't have to.
                   ((eq? lis ans) ans)
+                  ((%lset-hash-type = (list lis ans))
+                   => (lambda (type)
+                        (let1 tab (%lset-table type ans)
+                          (pair-fold (lambda (pair ans)
+                                       (let ((elt (car pair)))
+                                         (if (hash-table-exists? tab elt)
+                                           ans
+                                           (begin
+                                             (hash-table-put! tab elt #t)
+                                             (set-cdr! pair ans)
+                                             pair))))
+                                     ans lis))))
                   (else
                    (pair-fold (lambda (pair ans)
                                 (let ((elt (car pair)))
@@ -474,18 +556,18 @@
   (let ((lists (delete lis1 lists eq?))) ; Throw out any LIS1 vals.
     (cond ((any null-list? lists) '())          ; Short cut
           ((null? lists)          lis1)         ; Short cut
-          (else (filter (lambda (x)
-                          (every (lambda (lis) (member x lis =)) lists))
-                        lis1)))))
+          (else (let1 preds (%lset-memberers = lis1 lists)
+                  (filter (lambda (x) (every (lambda (p) (p x)) preds))
+                          lis1))))))
 
 (define (lset-intersection! = lis1 . lists)
   (check-arg procedure? =)
   (let ((lists (delete lis1 lists eq?))) ; Throw out any LIS1 vals.
     (cond ((any null-list? lists) '())          ; Short cut
           ((null? lists)          lis1)         ; Short cut
-          (else (filter! (lambda (x)
-                           (every (lambda (lis) (member x lis =)) lists))
-                         lis1)))))
+          (else (let1 preds (%lset-memberers = lis1 lists)
+                  (filter! (lambda (x) (every (lambda (p) (p x)) preds))
+                           lis1))))))
 
 
 (define (lset-difference = lis1 . lists)
@@ -493,20 +575,18 @@
   (let ((lists (filter pair? lists)))   ; Throw out empty lists.
     (cond ((null? lists)     lis1)      ; Short cut
           ((memq lis1 lists) '())       ; Short cut
-          (else (filter (lambda (x)
-                          (every (lambda (lis) (not (member x lis =)))
-                                 lists))
-                        lis1)))))
+          (else (let1 preds (%lset-memberers = lis1 lists)
+                  (filter (lambda (x) (not (any (lambda (p) (p x)) preds)))
+                          lis1))))))
 
 (define (lset-difference! = lis1 . lists)
   (check-arg procedure? =)
   (let ((lists (filter pair? lists)))   ; Throw out empty lists.
     (cond ((null? lists)     lis1)      ; Short cut
           ((memq lis1 lists) '())       ; Short cut
-          (else (filter! (lambda (x)
-                           (every (lambda (lis) (not (member x lis =)))
-                                  lists))
-                         lis1)))))
+          (else (let1 preds (%lset-memberers = lis1 lists)
+                  (filter! (lambda (x) (not (any (lambda (p) (p x)) preds)))
+                           lis1))))))
 
 
 (define (lset-xor = . lists)
@@ -524,10 +604,12 @@
             (receive (a-b a-int-b)   (lset-diff+intersection = a b)
               (cond ((null? a-b)     (lset-difference = b a))
                     ((null? a-int-b) (append b a))
-                    (else (fold (lambda (xb ans)
-                                  (if (member xb a-int-b =) ans (cons xb ans)))
-                                a-b
-                                b)))))
+                    (else (let1 in-a-int-b
+                              (car (%lset-memberers = b (list a-int-b)))
+                            (fold (lambda (xb ans)
+                                    (if (in-a-int-b xb) ans (cons xb ans)))
+                                  a-b
+                                  b))))))
           '() lists))
 
 
@@ -546,11 +628,14 @@
             (receive (a-b a-int-b)   (lset-diff+intersection! = a b)
               (cond ((null? a-b)     (lset-difference! = b a))
                     ((null? a-int-b) (append! b a))
-                    (else (pair-fold (lambda (b-pair ans)
-                                       (if (member (car b-pair) a-int-b =) ans
-                                           (begin (set-cdr! b-pair ans) b-pair)))
-                                     a-b
-                                     b)))))
+                    (else (let1 in-a-int-b
+                              (car (%lset-memberers = b (list a-int-b)))
+                            (pair-fold (lambda (b-pair ans)
+                                         (if (in-a-int-b (car b-pair)) ans
+                                             (begin (set-cdr! b-pair ans)
+                                                    b-pair)))
+                                       a-b
+                                       b))))))
           '() lists))
 
 
@@ -558,19 +643,17 @@
   (check-arg procedure? =)
   (cond ((every null-list? lists) (values lis1 '()))    ; Short cut
         ((memq lis1 lists)        (values '() lis1))    ; Short cut
-        (else (partition (lambda (elt)
-                           (not (any (lambda (lis) (member elt lis =))
-                                     lists)))
-                         lis1))))
+        (else (let1 preds (%lset-memberers = lis1 lists)
+                (partition (lambda (elt) (not (any (lambda (p) (p elt)) preds)))
+                           lis1)))))
 
 (define (lset-diff+intersection! = lis1 . lists)
   (check-arg procedure? =)
   (cond ((every null-list? lists) (values lis1 '()))    ; Short cut
         ((memq lis1 lists)        (values '() lis1))    ; Short cut
-        (else (partition! (lambda (elt)
-                            (not (any (lambda (lis) (member elt lis =))
-                                      lists)))
-                          lis1))))
+        (else (let1 preds (%lset-memberers = lis1 lists)
+                (partition! (lambda (elt) (not (any (lambda (p) (p elt)) preds)))
+                            lis1)))))
 
 (define map-in-order map) ; Gauche's map is already in order
 
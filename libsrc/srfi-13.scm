@@ -138,7 +138,7 @@
 ;;; Selectors
 ;;;
 
-(define substring/shared string-copy)  ; same in Gauche
+(define substring/shared string-slice)
 
 (define (string-copy! target tstart s . args)
   (check-arg string? target)
@@ -470,25 +470,34 @@
 ;;; Search
 ;;;
 
-(define (string-index s c/s/p . args)
+;; For string-index and string-index-right, START and END can be either
+;; indexes or string cursors.  If START is a cursor, the result is
+;; also a cursor, so that the caller can continue scanning without
+;; counting characters.
+(define (string-index s c/s/p :optional (start 0) end)
   (check-arg string? s)
-  (let ((pred (%get-char-pred c/s/p))
-        (offset (if (pair? args) (car args) 0))
-        (sp (apply make-string-pointer s 0 args)))
-    (let loop ((ch (string-pointer-next! sp)))
-      (cond ((eof-object? ch) #f)
-            ((pred c/s/p ch) (+ offset (- (string-pointer-index sp) 1)))
-            (else (loop (string-pointer-next! sp)))))))
-
-(define (string-index-right s c/s/p . args)
+  (let ([pred (%get-char-pred c/s/p)]
+        [ec (if (undefined? end)
+              (string-cursor-end s)
+              (string-index->cursor s end))])
+    (let loop ([cur (string-index->cursor s start)])
+      (cond [(string-cursor>=? cur ec) #f]
+            [(pred c/s/p (string-cursor-ref s cur))
+             (if (string-cursor? start) cur (string-cursor->index s cur))]
+            [else (loop (string-cursor-next s cur))]))))
+
+(define (string-index-right s c/s/p :optional (start 0) end)
   (check-arg string? s)
-  (let ((pred (%get-char-pred c/s/p))
-        (offset (if (pair? args) (car args) 0))
-        (sp (apply make-string-pointer s -1 args)))
-    (let loop ((ch (string-pointer-prev! sp)))
-      (cond ((eof-object? ch) #f)
-            ((pred c/s/p ch) (+ offset (string-pointer-index sp)))
-            (else (loop (string-pointer-prev! sp)))))))
+  (let ([pred (%get-char-pred c/s/p)]
+        [sc (string-index->cursor s start)])
+    (let loop ([cur (if (undefined? end)
+                      (string-cursor-end s)
+                      (string-index->cursor s end))])
+      (and (string-cursor>? cur sc)
+           (let1 prev (string-cursor-prev s cur)
+             (cond [(not (pred c/s/p (string-cursor-ref s prev))) (loop prev)]
+                   [(string-cursor? start) prev]
+                   [else (string-cursor->index s prev)]))))))
 
 (define (string-skip s c/s/p . args)
   (check-arg string? s)
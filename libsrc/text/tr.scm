@@ -47,33 +47,72 @@
 
 (define transliterate tr)               ;alias
 
-(define (string-tr str from to . options)
-  (with-string-io str (cut apply tr from to options)))
+(define (string-tr str from to :key ((:delete d?) #f) ((:squeeze s?) #f)
+                   ((:complement c?) #f) ((:table-size size) 256))
+  (let1 tab (cached-tr-table from to size c?)
+    (if (and (= (string-size str) (string-length str))
+             (not (string-incomplete? str)))
+      (single-byte-string-tr str tab d? s?)
+      (call-with-output-string
+        (cut run-tr tab d? s? (open-input-string str) <>)))))
 
 (define string-transliterate string-tr) ;alias
 
 (define (build-transliterator from to :key ((:delete d?) #f) ((:squeeze s?) #f)
                               ((:complement c?) #f) ((:table-size size) 256)
                               (input #f) (output #f))
-  (let1 tab (build-tr-table from to size c?)
+  (let1 tab (cached-tr-table from to size c?)
     (^[]
-      (let ([in  (or input (current-input-port))]
-            [out (or output (current-output-port))])
-        (let loop ([char (read-char in)] [prev #f])
-          (unless (eof-object? char)
-            (let1 c (tr-table-ref tab (char->integer char))
-              (cond
-               [(char? c)               ;transliterated
-                (unless (and s? (eqv? prev c)) (display c out))
-                (loop (read-char in) c)]
-               [c                       ;char is not in from-set
-                (display char out)
-                (loop (read-char in) #f)]
-               [(not d?)                ;char is in from but not to, and no :d
-                (unless (and s? (eqv? prev char)) (display char out))
-                (loop (read-char in) char)]
-               [else
-                (loop (read-char in) prev)]))))))))
+      (run-tr tab d? s?
+              (or input (current-input-port))
+              (or output (current-output-port))))))
+
+(define (run-tr tab d? s? in out)
+  (let loop ([char (read-char in)] [prev #f])
+    (unless (eof-object? char)
+      (let1 c (tr-table-ref tab (char->integer char))
+        (cond
+         [(char? c)                     ;transliterated
+          (unless (and s? (eqv? prev c)) (write-char c out))
+          (loop (read-char in) c)]
+         [c                             ;char is not in from-set
+          (write-char char out)
+          (loop (read-char in) #f)]
+         [(not d?)                      ;char is in from but not to, and no :d
+          (unless (and s? (eqv? prev char)) (write-char char out))
+          (loop (read-char in) char)]
+         [else
+          (loop (read-char in) prev)])))))
+
+;; The same as run-tr, but STR has only single-byte characters, so we
+;; can index it directly.  A run of characters that aren't in the
+;; from-set is copied at once.
+(define (single-byte-string-tr str tab d? s?)
+  (define len (string-length str))
+  (define (code i) (char->integer (string-ref str i)))
+  (define (skip i)                      ;end of the run of unmapped chars
+    (if (and (< i len) (eq? (tr-table-ref tab (code i)) #t))
+      (skip (+ i 1))
+      i))
+  (call-with-output-string
+    (^[out]
+      (let loop ([i 0] [prev #f])
+        (when (< i len)
+          (let* ([char (string-ref str i)]
+                 [c (tr-table-ref tab (char->integer char))])
+            (cond
+             [(char? c)
+              (unless (and s? (eqv? prev c)) (write-char c out))
+              (loop (+ i 1) c)]
+             [c
+              (let1 j (skip (+ i 1))
+                (display (substring str i j) out)
+                (loop j #f))]
+             [(not d?)
+              (unless (and s? (eqv? prev char)) (write-char char out))
+              (loop (+ i 1) char)]
+             [else
+              (loop (+ i 1) prev)])))))))
 
 ;;--------------------------------------------------------------------
 ;; Parse character array syntax
@@ -229,9 +268,12 @@
 ;;    * #f - no entry
 ;;    * procedure
 ;;
-;;  List is used for larger characters.
+;;  A sorted vector of non-overlapping ranges is used for larger
+;;  characters, which is looked up by binary search.  While the table
+;;  is being filled, it is a list, where an earlier entry takes
+;;  precedence, and finish-tr-table! converts it to the vector.
 ;;
-;;  The list is consisted by the elements of one of the following type:
+;;  Each entry is one of the following type:
 ;;
 ;;    (from to <integer>)
 ;;       An input character between from and to (inclusive) is
@@ -263,14 +305,40 @@
 (define (tr-table-ref tab index)
   (if (< index (slot-ref tab 'vector-size))
     (vector-ref (vector-of tab) index)
-    (let loop ([e (sparse-of tab)])
-      (cond [(null? e) #t]
-            [(<= (caar e) index (cadar e))
-             (let1 v (caddar e)
-               (if (integer? v)
-                 (integer->char (+ v (- index (caar e))))
-                 v))]
-            [else (loop (cdr e))]))))
+    (let1 sv (sparse-of tab)
+      (let loop ([lo 0] [hi (vector-length sv)])
+        (if (>= lo hi)
+          #t
+          (let* ([mid (quotient (+ lo hi) 2)]
+                 [e (vector-ref sv mid)])
+            (cond [(< index (car e)) (loop lo mid)]
+                  [(> index (cadr e)) (loop (+ mid 1) hi)]
+                  [else (let1 v (caddr e)
+                          (if (integer? v)
+                            (integer->char (+ v (- index (car e))))
+                            v))])))))))
+
+;; Converts the sparse entries to a sorted vector.  An entry that is
+;; partially hidden by earlier ones is cut into the visible parts.
+(define (finish-tr-table! tab)
+  (define (piece e from to)
+    (let1 v (caddr e)
+      (list from to (if (integer? v) (+ v (- from (car e))) v))))
+  (define (visible e taken)             ;taken is sorted by from
+    (let loop ([from (car e)] [taken taken] [r '()])
+      (cond [(> from (cadr e)) r]
+            [(or (null? taken) (< (cadr e) (caar taken)))
+             (cons (piece e from (cadr e)) r)]
+            [(< (cadar taken) from) (loop from (cdr taken) r)]
+            [(< from (caar taken))
+             (loop (+ (cadar taken) 1) (cdr taken)
+                   (cons (piece e from (- (caar taken) 1)) r))]
+            [else (loop (+ (cadar taken) 1) (cdr taken) r)])))
+  (let1 ranges (fold (^[e taken]
+                       (sort-by (append (visible e taken) taken) car))
+                     '() (sparse-of tab))
+    (set! (sparse-of tab) (list->vector ranges))
+    tab))
 
 (define (build-tr-table from-spec to-spec size compl?)
   (rlet1 tab (make <tr-table> :vector-size size)
@@ -281,7 +349,30 @@
                      (if compl?
                        (complement-char-array from-ca size)
                        from-ca)
-                     to-ca))))
+                     to-ca)
+      (finish-tr-table! tab))))
+
+;; Tables are cached by the specs, for string-tr is often called with
+;; the same specs over and over.  The cache is direct-mapped, and each
+;; entry is a vector of from, to, size, compl? and the table, so threads
+;; can share it without locking.  Tables are never modified once built.
+(define-constant *tr-table-cache-size* 64)
+(define *tr-table-cache* (make-vector *tr-table-cache-size* #f))
+
+(define (cached-tr-table from to size compl?)
+  (let* ([i (modulo (+ (string-hash from) (* 3 (string-hash to)) size)
+                    *tr-table-cache-size*)]
+         [e (vector-ref *tr-table-cache* i)])
+    (if (and e
+             (string=? (vector-ref e 0) from)
+             (string=? (vector-ref e 1) to)
+             (eqv? (vector-ref e 2) size)
+             (eq? (vector-ref e 3) compl?))
+      (vector-ref e 4)
+      (rlet1 tab (build-tr-table from to size compl?)
+        (vector-set! *tr-table-cache* i
+                     (vector (string-copy from) (string-copy to)
+                             size compl? tab))))))
 
 (define (fill-tr-table tab from-ca to-ca)
   (let loop ([from-ca from-ca]
@@ -243,11 +243,85 @@
                                      (append bindings blist)))
                          (list p code bv (and fail (gensym)) #f)))
                      clauses))
-         (code (gen x '() plist (cdr eb-errf) (gensym))))
+         (code (gen-dispatch x plist (cdr eb-errf) (gensym))))
     (unreachable plist match-expr)
     `(let ,blist
        ,code)))
 
+;; [SK] Clauses over tagged lists, e.g. (('add x y) ...) (('sub x y) ...),
+;; are common in interpreters and compilers.  Gen turns them into
+;; a chain of (equal? (car x) 'tag) tests, so the last clause pays for
+;; all the preceding ones.  We find a run of consecutive clauses whose
+;; pattern is a list headed by a quoted symbol, and dispatch on the car
+;; with a case form; each branch only tries the clauses of its tag,
+;; knowing that x is a pair and what its car is.  Clauses of different
+;; tags can't match the same value, so the order of the clauses is
+;; preserved.  The code after the run is shared through a thunk, for
+;; gen would duplicate it at every failure point otherwise.
+
+(define match:dispatch-threshold 3) ; min # of distinct tags to dispatch
+
+(define (tagged-pair-pattern p)
+  (and (pair? p)
+       (pair? (car p))
+       (eq? (caar p) 'quote)
+       (pair? (cdar p))
+       (symbol? (cadar p))
+       (null? (cddar p))
+       (not (and (pair? (cdr p)) (dot-dot-k? (cadr p))))
+       (cadar p)))
+
+;; Returns three values: clauses before the first run of tagged
+;; clauses that is worth dispatching, the run, and the rest.
+(define (split-tag-run plist)
+  (let loop ((head '()) (plist plist))
+    (if (null? plist)
+      (values (reverse head) '() '())
+      (let scan ((ps plist) (run '()) (tags '()))
+        (let ((tag (and (pair? ps) (tagged-pair-pattern (caar ps)))))
+          (cond
+           (tag (scan (cdr ps) (cons (car ps) run)
+                      (if (memq tag tags) tags (cons tag tags))))
+           ((>= (length tags) match:dispatch-threshold)
+            (values (reverse head) (reverse run) ps))
+           ((null? run) (loop (cons (car plist) head) (cdr plist)))
+           (else (loop (append run head) ps))))))))
+
+(define (gen-dispatch x plist erract eta)
+  (receive (head run tail) (split-tag-run plist)
+    (if (null? run)
+      (gen x '() plist erract eta)
+      (let* ((kr (gensym))
+             (kh (gensym))
+             (rest-code (if (null? tail)
+                          (erract x)
+                          (gen-dispatch x tail erract eta)))
+             (tags (delete-duplicates
+                    (map (lambda (c) (tagged-pair-pattern (car c))) run)
+                    eq?))
+             (branch
+              (lambda (tag)
+                (let ((e (add-a x))
+                      (group (filter (lambda (c)
+                                       (eq? (tagged-pair-pattern (car c)) tag))
+                                     run)))
+                  `((,tag)
+                    ,(gen x `((pair? ,x)
+                              (equal? ,e (quote ,tag))
+                              (symbol? ,e))
+                          group (lambda (x) `(,kr)) eta)))))
+             (run-code `(if (pair? ,x)
+                          (case (car ,x)
+                            ,@(map branch tags)
+                            (else (,kr)))
+                          (,kr))))
+        (if (null? head)
+          `(let ((,kr (lambda () ,rest-code)))
+             ,run-code)
+          `(let* ((,kr (lambda () ,rest-code))
+                  (,kh (lambda () ,run-code)))
+             ,(gen x '() head (lambda (x) `(,kh)) eta)))))))
+
 (define (genletrec pat exp body match-expr)
   (let* ((eb-errf (error-maker match-expr))
          (x (bound (validate-pattern pat)))
@@ -141,7 +141,18 @@
           debug-print-pre debug-print-post debug-funcall-pre)
 
 (autoload gauche.vm.profiler
-          profiler-show profiler-show-load-stats with-profiler)
+          profiler-show profiler-show-load-stats profiler-show-macro-stats
+          profiler-get-load-times profiler-show-load-times
+          with-profiler
+          profiler-get-stacks profiler-write-collapsed-stacks
+          profiler-get-alloc-result profiler-show-alloc
+          lock-stat-result lock-stat-show
+          port-statistics-result port-statistics-show
+          heap-census heap-census-show
+          heap-retention-paths heap-retention-paths-show
+          heap-snapshot-save heap-snapshot-load
+          heap-snapshot-diff heap-snapshot-diff-show
+          code-memory-usage code-memory-usage-show)
 
 (autoload srfi-0  (:macro cond-expand))
 (autoload srfi-7  (:macro program))
@@ -196,6 +207,7 @@
                           tree-map-min tree-map-max
                           tree-map-pop-min! tree-map-pop-max!
                           tree-map-fold tree-map-fold-right
+                          tree-map-fold-range tree-map-fold-right-range
                           tree-map-map tree-map-for-each
                           tree-map-keys tree-map-values
                           tree-map->alist alist->tree-map)
@@ -807,6 +807,347 @@ static ScmBignum *bignum_lshift(ScmBignum *br, const ScmBignum *bx, int amount)
     return br;
 }
 
+/*-----------------------------------------------------------------------
+ * Word array arithmetic
+ *
+ *   The subquadratic multiplication and division work on little-endian
+ *   arrays of words instead of ScmBignums, so that they can recurse on
+ *   parts of the operands without copying them.  Unless noted, the
+ *   result array shouldn't overlap with the inputs.
+ *
+ *   The thresholds are sizes in words, measured on x86_64.
+ */
+
+#define KARATSUBA_THRESHOLD  32
+#define TOOM3_THRESHOLD      250
+#define DIV_DC_THRESHOLD     100
+
+/* Temporary storage.  It is atomic, for it only holds numbers. */
+#define WTEMP(n)  SCM_NEW_ATOMIC2(u_long*, (n)*sizeof(u_long))
+
+/* Words of the scratch area wmul needs for operands of N words. */
+#define WMUL_SCRATCH(n)  (6*(n) + 32*WORD_BITS)
+
+/* r[0..n) = x[0..n) + y[0..n).  Returns carry.  r may be x or y. */
+static u_long wadd_n(u_long *r, const u_long *x, const u_long *y, int n)
+{
+    u_long c = 0, t;
+    for (int i=0; i<n; i++) {
+        UADD(t, c, x[i], y[i]);
+        r[i] = t;
+    }
+    return c;
+}
+
+/* r[0..n) = x[0..n) - y[0..n).  Returns borrow.  r may be x or y. */
+static u_long wsub_n(u_long *r, const u_long *x, const u_long *y, int n)
+{
+    u_long c = 0, t;
+    for (int i=0; i<n; i++) {
+        USUB(t, c, x[i], y[i]);
+        r[i] = t;
+    }
+    return c;
+}
+
+/* r[0..n) += c.  Returns carry. */
+static u_long wadd_1(u_long *r, int n, u_long c)
+{
+    for (int i=0; c && i<n; i++) {
+        r[i] += c;
+        c = (r[i] < c);
+    }
+    return c;
+}
+
+/* r[0..n) -= c.  Returns borrow. */
+static u_long wsub_1(u_long *r, int n, u_long c)
+{
+    for (int i=0; c && i<n; i++) {
+        u_long t = r[i];
+        r[i] = t - c;
+        c = (t < c);
+    }
+    return c;
+}
+
+/* r[0..xn) = x[0..xn) + y[0..yn), xn >= yn.  Returns carry.
+   r may be x. */
+static u_long wadd(u_long *r, const u_long *x, int xn,
+                   const u_long *y, int yn)
+{
+    u_long c = wadd_n(r, x, y, yn);
+    if (r != x) {
+        for (int i=yn; i<xn; i++) r[i] = x[i];
+    }
+    return wadd_1(r+yn, xn-yn, c);
+}
+
+/* r[0..xn) = x[0..xn) - y[0..yn), xn >= yn.  Returns borrow.
+   r may be x. */
+static u_long wsub(u_long *r, const u_long *x, int xn,
+                   const u_long *y, int yn)
+{
+    u_long c = wsub_n(r, x, y, yn);
+    if (r != x) {
+        for (int i=yn; i<xn; i++) r[i] = x[i];
+    }
+    return wsub_1(r+yn, xn-yn, c);
+}
+
+/* Number of words without leading zeros. */
+static int wsize(const u_long *x, int n)
+{
+    while (n > 0 && x[n-1] == 0) n--;
+    return n;
+}
+
+/* r[0..rn) += x[0..xn).  Leading zeros of x are ignored, so xn can be
+   larger than rn as long as the value fits.  Returns carry. */
+static u_long wadd_to(u_long *r, int rn, const u_long *x, int xn)
+{
+    xn = wsize(x, xn);
+    if (xn > rn) xn = rn;       /* can't happen if the caller is right */
+    return wadd(r, r, rn, x, xn);
+}
+
+/* Same as wadd_to, but subtracts.  Returns borrow. */
+static u_long wsub_from(u_long *r, int rn, const u_long *x, int xn)
+{
+    xn = wsize(x, xn);
+    if (xn > rn) xn = rn;
+    return wsub(r, r, rn, x, xn);
+}
+
+/* Compares x[0..n) and y[0..n). */
+static int wcmp_n(const u_long *x, const u_long *y, int n)
+{
+    for (int i=n-1; i>=0; i--) {
+        if (x[i] != y[i]) return (x[i] < y[i])? -1 : 1;
+    }
+    return 0;
+}
+
+/* r[0..xn) = |x[0..xn) - y[0..yn)|, xn >= yn.  Returns the sign of
+   x - y (1 or -1). */
+static int wsub_abs(u_long *r, const u_long *x, int xn,
+                    const u_long *y, int yn)
+{
+    int s = (wsize(x+yn, xn-yn) > 0)? 1 : wcmp_n(x, y, yn);
+    if (s >= 0) {
+        wsub(r, x, xn, y, yn);
+        return 1;
+    } else {
+        wsub_n(r, y, x, yn);
+        for (int i=yn; i<xn; i++) r[i] = 0;
+        return -1;
+    }
+}
+
+/* Two's complement negation of r[0..n), in place. */
+static void wneg(u_long *r, int n)
+{
+    u_long c = 1;
+    for (int i=0; i<n; i++) {
+        r[i] = ~r[i] + c;
+        c = (c && r[i] == 0);
+    }
+}
+
+/* Replaces the two's complement number r[0..n) by its absolute value.
+   Returns the original sign. */
+static int wabs(u_long *r, int n)
+{
+    if ((long)r[n-1] < 0) {
+        wneg(r, n);
+        return -1;
+    }
+    return 1;
+}
+
+/* Arithmetic shift right by one bit of the two's complement number
+   r[0..n), in place. */
+static void wshr1(u_long *r, int n)
+{
+    for (int i=0; i<n-1; i++) {
+        r[i] = (r[i] >> 1) | (r[i+1] << (WORD_BITS-1));
+    }
+    r[n-1] = (u_long)((long)r[n-1] >> 1);
+}
+
+/* Divides the two's complement number r[0..n) by 3 in place.  R must be
+   a multiple of 3.  We multiply by the inverse of 3 modulo 2^WORD_BITS,
+   word by word (Jebelean's exact division). */
+static void wdivexact3(u_long *r, int n)
+{
+    const u_long inv3 = SCM_ULONG_MAX/3*2 + 1;
+    const u_long third = SCM_ULONG_MAX/3 + 1;   /* ceil(2^WORD_BITS/3) */
+    u_long c = 0;
+    for (int i=0; i<n; i++) {
+        u_long x = r[i];
+        u_long s = x - c;
+        u_long q = s * inv3;
+        r[i] = q;
+        /* c = borrow + high word of q*3 */
+        c = (x < c) + (q >= third) + (q >= inv3);
+    }
+}
+
+/* r[0..xn+yn) = x[0..xn) * y[0..yn).  Schoolbook method. */
+static void wmul_basecase(u_long *r, const u_long *x, int xn,
+                          const u_long *y, int yn)
+{
+    for (int i=0; i<xn+yn; i++) r[i] = 0;
+    for (int j=0; j<yn; j++) {
+        u_long yj = y[j], c = 0;
+        if (yj == 0) continue;
+        for (int i=0; i<xn; i++) {
+            u_long hi, lo;
+            UMUL(hi, lo, x[i], yj);
+            lo += c;
+            hi += (lo < c);
+            r[i+j] += lo;
+            c = hi + (r[i+j] < lo);
+        }
+        r[j+xn] = c;
+    }
+}
+
+static void wmul_n(u_long *r, const u_long *x, const u_long *y, int n,
+                   u_long *ws);
+
+/* Karatsuba multiplication of N-word numbers: splitting x = x1*B^k + x0
+   and y likewise,
+     x*y = z2*B^2k + (z0 + z2 + (x0-x1)*(y1-y0))*B^k + z0
+   where z0 = x0*y0 and z2 = x1*y1.  WS is the scratch area. */
+static void wmul_karatsuba(u_long *r, const u_long *x, const u_long *y,
+                           int n, u_long *ws)
+{
+    int h = n/2;                /* size of the upper half */
+    int k = n - h;              /* size of the lower half, k >= h */
+    u_long *t = ws, *dx = ws + 2*k, *dy = ws + 3*k, *mid = ws + 2*k;
+    u_long *next = ws + 4*k + 1;
+
+    int s = wsub_abs(dx, x, k, x+k, h);
+    s *= -wsub_abs(dy, y, k, y+k, h);
+
+    wmul_n(r, x, y, k, next);                /* z0 */
+    wmul_n(r+2*k, x+k, y+k, h, next);        /* z2 */
+    wmul_n(t, dx, dy, k, next);              /* |(x0-x1)*(y1-y0)| */
+
+    /* mid = z0 + z2 +/- t; dx and dy are no longer needed */
+    mid[2*k] = wadd(mid, r, 2*k, r+2*k, 2*h);
+    if (s > 0) wadd(mid, mid, 2*k+1, t, 2*k);
+    else       wsub(mid, mid, 2*k+1, t, 2*k);
+    wadd_to(r+k, 2*n-k, mid, 2*k+1);
+}
+
+/* Toom-3 multiplication of N-word numbers.  Splitting the operands in
+   three parts, we evaluate the polynomials at 0, 1, -1, -2 and infinity,
+   and interpolate the product with Bodrato's sequence.  The values at
+   the negative points can be negative, so the interpolation works on
+   two's complement numbers of a fixed width. */
+static void wmul_toom3(u_long *r, const u_long *x, const u_long *y,
+                       int n, u_long *ws)
+{
+    int k = (n+2)/3;            /* size of the lower two parts */
+    int h = n - 2*k;            /* size of the upper part, 0 < h <= k */
+    int e = k+1;                /* width of the evaluated values */
+    int w = 2*k+2;              /* width of the values in interpolation */
+    u_long *px1 = ws,     *pxm1 = px1 + e, *pxm2 = pxm1 + e;
+    u_long *py1 = pxm2+e, *pym1 = py1 + e, *pym2 = pym1 + e;
+    u_long *r1 = pym2+e,  *rm1 = r1 + w,   *rm2 = rm1 + w;
+    u_long *next = rm2 + w;
+    const u_long *x0 = x, *x1 = x+k, *x2 = x+2*k;
+    const u_long *y0 = y, *y1 = y+k, *y2 = y+2*k;
+
+#define TOOM3_EVAL(p1, pm1, pm2, v0, v1, v2)                            \
+    do {                                                                \
+        /* p1 = v0 + v2, pm1 = p1 - v1, p1 += v1 */                     \
+        p1[k] = wadd(p1, v0, k, v2, h);                                 \
+        wsub(pm1, p1, e, v1, k);                                        \
+        wadd(p1, p1, e, v1, k);                                         \
+        /* pm2 = 2*(pm1 + v2) - v0 */                                   \
+        wadd(pm2, pm1, e, v2, h);                                       \
+        wadd_n(pm2, pm2, pm2, e);                                       \
+        wsub(pm2, pm2, e, v0, k);                                       \
+    } while (0)
+
+    TOOM3_EVAL(px1, pxm1, pxm2, x0, x1, x2);
+    TOOM3_EVAL(py1, pym1, pym2, y0, y1, y2);
+#undef TOOM3_EVAL
+
+    wmul_n(r, x0, y0, k, next);                 /* r0 */
+    wmul_n(r+4*k, x2, y2, h, next);             /* rinf */
+    wmul_n(r1, px1, py1, e, next);
+    {
+        int s = wabs(pxm1, e) * wabs(pym1, e);
+        wmul_n(rm1, pxm1, pym1, e, next);
+        if (s < 0) wneg(rm1, w);
+        s = wabs(pxm2, e) * wabs(pym2, e);
+        wmul_n(rm2, pxm2, pym2, e, next);
+        if (s < 0) wneg(rm2, w);
+    }
+
+    /* Interpolation.  Now rm2 becomes c3, r1 becomes c1, rm1 becomes c2. */
+    const u_long *r0 = r, *rinf = r+4*k;
+    wsub_n(rm2, rm2, r1, w);                    /* r3 = (r(-2) - r(1))/3 */
+    wdivexact3(rm2, w);
+    wsub_n(r1, r1, rm1, w);                     /* r1 = (r(1) - r(-1))/2 */
+    wshr1(r1, w);
+    wsub(rm1, rm1, w, r0, 2*k);                 /* r2 = r(-1) - r(0) */
+    wsub_n(rm2, rm1, rm2, w);                   /* r3 = (r2 - r3)/2 + 2rinf */
+    wshr1(rm2, w);
+    wadd(rm2, rm2, w, rinf, 2*h);
+    wadd(rm2, rm2, w, rinf, 2*h);
+    wadd_n(rm1, rm1, r1, w);                    /* r2 = r2 + r1 - rinf */
+    wsub(rm1, rm1, w, rinf, 2*h);
+    wsub_n(r1, r1, rm2, w);                     /* r1 = r1 - r3 */
+
+    for (int i=2*k; i<4*k; i++) r[i] = 0;
+    wadd_to(r+k,   2*n-k,   r1,  w);
+    wadd_to(r+2*k, 2*n-2*k, rm1, w);
+    wadd_to(r+3*k, 2*n-3*k, rm2, w);
+}
+
+/* r[0..2n) = x[0..n) * y[0..n).  WS must have WMUL_SCRATCH(n) words. */
+static void wmul_n(u_long *r, const u_long *x, const u_long *y, int n,
+                   u_long *ws)
+{
+    if (n < KARATSUBA_THRESHOLD) {
+        wmul_basecase(r, x, n, y, n);
+    } else if (n < TOOM3_THRESHOLD) {
+        wmul_karatsuba(r, x, y, n, ws);
+    } else {
+        wmul_toom3(r, x, y, n, ws);
+    }
+}
+
+/* r[0..xn+yn) = x[0..xn) * y[0..yn).  WS must have WMUL_SCRATCH(xn)
+   words.  If the sizes differ, we multiply y with each yn-word chunk of
+   x. */
+static void wmul(u_long *r, const u_long *x, int xn,
+                 const u_long *y, int yn, u_long *ws)
+{
+    if (xn < yn) {
+        const u_long *t = x; x = y; y = t;
+        int tn = xn; xn = yn; yn = tn;
+    }
+    if (yn < KARATSUBA_THRESHOLD) {
+        wmul_basecase(r, x, xn, y, yn);
+    } else if (xn == yn) {
+        wmul_n(r, x, y, xn, ws);
+    } else {
+        u_long *t = WTEMP(2*yn);
+        for (int i=0; i<xn+yn; i++) r[i] = 0;
+        for (int off=0; off<xn; off+=yn) {
+            int cn = min(yn, xn-off);
+            wmul(t, x+off, cn, y, yn, ws);
+            wadd_to(r+off, xn+yn-off, t, cn+yn);
+        }
+    }
+}
+
 /*-----------------------------------------------------------------------
  * Multiplication
  */
@@ -842,8 +1183,13 @@ static ScmBignum *bignum_mul_word(ScmBignum *br, const ScmBignum *bx,
 static ScmBignum *bignum_mul(const ScmBignum *bx, const ScmBignum *by)
 {
     ScmBignum *br = make_bignum(bx->size + by->size);
-    for (u_int i=0; i<by->size; i++) {
-        bignum_mul_word(br, bx, by->values[i], i);
+    if (bx->size < KARATSUBA_THRESHOLD || by->size < KARATSUBA_THRESHOLD) {
+        for (u_int i=0; i<by->size; i++) {
+            bignum_mul_word(br, bx, by->values[i], i);
+        }
+    } else {
+        u_long *ws = WTEMP(WMUL_SCRATCH(max(bx->size, by->size)));
+        wmul(br->values, bx->values, bx->size, by->values, by->size, ws);
     }
     br->sign = bx->sign * by->sign;
     return br;
@@ -896,6 +1242,178 @@ static inline int div_normalization_factor(u_long w)
     return 0;                   /* dummy */
 }
 
+/* Word array division.  See "Word array arithmetic" above. */
+
+/* Divides [n1;n0] by d, where d is normalized (MSB is 1) and n1 < d.
+   Portable version with half-word digits. */
+#define UDIV(q, r, n1, n0, d)                                           \
+    do {                                                                \
+        u_long d1_ = HI(d), d0_ = LO(d), q1_, q0_, r1_, r0_, m_;        \
+        q1_ = (n1) / d1_;                                               \
+        r1_ = (n1) - q1_*d1_;                                           \
+        m_ = q1_ * d0_;                                                 \
+        r1_ = (r1_ << HALF_BITS) | HI(n0);                              \
+        if (r1_ < m_) {                                                 \
+            q1_--; r1_ += (d);                                          \
+            if (r1_ >= (d) && r1_ < m_) { q1_--; r1_ += (d); }          \
+        }                                                               \
+        r1_ -= m_;                                                      \
+        q0_ = r1_ / d1_;                                                \
+        r0_ = r1_ - q0_*d1_;                                            \
+        m_ = q0_ * d0_;                                                 \
+        r0_ = (r0_ << HALF_BITS) | LO(n0);                              \
+        if (r0_ < m_) {                                                 \
+            q0_--; r0_ += (d);                                          \
+            if (r0_ >= (d) && r0_ < m_) { q0_--; r0_ += (d); }          \
+        }                                                               \
+        r0_ -= m_;                                                      \
+        (q) = (q1_ << HALF_BITS) | q0_;                                 \
+        (r) = r0_;                                                      \
+    } while (0)
+
+/* r[0..n) -= x[0..n) * y.  Returns the borrow word. */
+static u_long wsubmul_1(u_long *r, const u_long *x, int n, u_long y)
+{
+    u_long c = 0;
+    for (int i=0; i<n; i++) {
+        u_long hi, lo;
+        UMUL(hi, lo, x[i], y);
+        lo += c;
+        hi += (lo < c);
+        u_long ri = r[i];
+        r[i] = ri - lo;
+        c = hi + (ri < lo);
+    }
+    return c;
+}
+
+/* Schoolbook division (Knuth's algorithm D) with word digits.
+   A has n+m words, B has n words and is normalized.  On return,
+   q[0..m] has the quotient, and a[0..n) has the remainder. */
+static void wdiv_basecase(u_long *q, u_long *a, const u_long *b,
+                          int n, int m)
+{
+    u_long bh = b[n-1], bl = (n >= 2)? b[n-2] : 0;
+
+    if (wcmp_n(a+m, b, n) >= 0) {
+        wsub_n(a+m, a+m, b, n);
+        q[m] = 1;
+    } else {
+        q[m] = 0;
+    }
+    for (int j=m-1; j>=0; j--) {
+        u_long ah = a[n+j], al = a[n+j-1], qq, rr;
+        if (ah >= bh) {
+            qq = SCM_ULONG_MAX;
+        } else {
+            UDIV(qq, rr, ah, al, bh);
+            /* Knuth's test to correct qq with the next digit */
+            while (n >= 2) {
+                u_long ph, pl;
+                UMUL(ph, pl, qq, bl);
+                if (ph < rr || (ph == rr && pl <= a[n+j-2])) break;
+                qq--;
+                rr += bh;
+                if (rr < bh) break;   /* overflow */
+            }
+        }
+        a[n+j] -= wsubmul_1(a+j, b, n, qq);
+        while (a[n+j] != 0) {
+            /* qq was too large and the partial remainder became
+               negative.  Add back. */
+            qq--;
+            a[n+j] += wadd_n(a+j, a+j, b, n);
+        }
+        q[j] = qq;
+    }
+}
+
+/* Recursive division (Burnikel and Ziegler; Algorithm 1.8 in
+   Brent & Zimmermann, "Modern Computer Arithmetic").  A has n+m words
+   and n >= m, B has n words and is normalized.  On return, q[0..m] has
+   the quotient and a[0..n) has the remainder; the rest of A is zero. */
+static void wdiv_rec(u_long *q, u_long *a, const u_long *b, int n, int m)
+{
+    if (m < DIV_DC_THRESHOLD) {
+        wdiv_basecase(q, a, b, n, m);
+        return;
+    }
+    int k = m/2;
+    const u_long *b0 = b, *b1 = b+k;
+    u_long *t = WTEMP(m+1 + k+1);
+    u_long *q0 = t + m+1;
+    u_long *ws = WTEMP(WMUL_SCRATCH(m+1));
+
+    /* Upper half: divide A div B^2k by B1, then fix with B0 */
+    wdiv_rec(q+k, a+2*k, b1, n-k, m-k);
+    wmul(t, q+k, m-k+1, b0, k, ws);
+    if (wsub_from(a+k, n+m-k, t, m+1)) {
+        do {
+            wsub_1(q+k, m-k+1, 1);
+        } while (!wadd(a+k, a+k, n+m-k, b, n));
+    }
+
+    /* Lower half */
+    wdiv_rec(q0, a+k, b1, n-k, k);
+    wmul(t, q0, k+1, b0, k, ws);
+    if (wsub_from(a, n+m, t, 2*k+1)) {
+        do {
+            wsub_1(q0, k+1, 1);
+        } while (!wadd(a, a, n+m, b, n));
+    }
+    for (int i=0; i<k; i++) q[i] = 0;
+    wadd_to(q, m+1, q0, k+1);
+}
+
+/* Divides A of an words by B of n words, where B is normalized and
+   an >= n.  On return, q[0..an-n] has the quotient and a[0..n) has the
+   remainder.  If the quotient is longer than the divisor, we divide
+   by blocks of n words from the top, like a schoolbook division with
+   B^n-ary digits. */
+static void wdiv(u_long *q, u_long *a, int an, const u_long *b, int n)
+{
+    int m = an - n;
+    if (m <= n) {
+        wdiv_rec(q, a, b, n, m);
+        return;
+    }
+    /* The first block may have one more quotient word; the others
+       don't, since their upper n words are the remainder of the
+       previous block. */
+    u_long *t = WTEMP(n+1);
+    int mm = m - (m-1)/n*n;     /* 0 < mm <= n */
+    wdiv_rec(q+m-mm, a+m-mm, b, n, mm);
+    for (m -= mm; m > 0; m -= n) {
+        wdiv_rec(t, a+m-n, b, n, n);
+        for (int i=0; i<n; i++) q[m-n+i] = t[i];
+    }
+}
+
+/* r[0..n) = x[0..n) << s, 0 <= s < WORD_BITS.  Returns the bits
+   shifted out. */
+static u_long wlshift(u_long *r, const u_long *x, int n, int s)
+{
+    if (s == 0) {
+        for (int i=0; i<n; i++) r[i] = x[i];
+        return 0;
+    }
+    u_long out = x[n-1] >> (WORD_BITS-s);
+    for (int i=n-1; i>0; i--) r[i] = (x[i]<<s)|(x[i-1]>>(WORD_BITS-s));
+    r[0] = x[0]<<s;
+    return out;
+}
+
+/* r[0..n) = x[0..n) >> s, 0 <= s < WORD_BITS. */
+static void wrshift(u_long *r, const u_long *x, int n, int s)
+{
+    if (s == 0) {
+        for (int i=0; i<n; i++) r[i] = x[i];
+        return;
+    }
+    for (int i=0; i<n-1; i++) r[i] = (x[i]>>s)|(x[i+1]<<(WORD_BITS-s));
+    r[n-1] = x[n-1]>>s;
+}
+
 /* General case of division.  We use each half word as a digit.
    Assumes digitsof(dividend) >= digitsof(divisor) > 1.
    Assumes enough digits are allocated to quotient.
@@ -1095,14 +1613,161 @@ ScmObj Scm_BignumDivRem(const ScmBignum *dividend, const ScmBignum *divisor)
         return Scm_Cons(SCM_MAKE_INT(0), SCM_OBJ(dividend));
     }
 
-    ScmBignum *q = make_bignum(dividend->size - divisor->size + 1);
-    ScmBignum *r = bignum_gdiv(dividend, divisor, q);
+    ScmBignum *q, *r;
+    if (divisor->size < DIV_DC_THRESHOLD) {
+        q = make_bignum(dividend->size - divisor->size + 1);
+        r = bignum_gdiv(dividend, divisor, q);
+    } else {
+        /* Normalize so that the MSB of the divisor is 1 */
+        int n = divisor->size, an = dividend->size + 1;
+        int s = div_normalization_factor(divisor->values[n-1]);
+        u_long *a = WTEMP(an), *b = WTEMP(n);
+        a[an-1] = wlshift(a, dividend->values, an-1, s);
+        wlshift(b, divisor->values, n, s);
+        q = make_bignum(an - n + 1);
+        wdiv(q->values, a, an, b, n);
+        r = make_bignum(n);
+        wrshift(r->values, a, n, s);
+    }
     q->sign = dividend->sign * divisor->sign;
     r->sign = dividend->sign;
 
     return Scm_Cons(Scm_NormalizeBignum(q), Scm_NormalizeBignum(r));
 }
 
+/*-----------------------------------------------------------------------
+ * GCD
+ */
+
+/* r[0..yn) = x[0..xn) mod y[0..yn), where xn >= yn > 0 and y[yn-1] != 0.
+   Returns the number of words of the remainder. */
+static int wmod(u_long *r, const u_long *x, int xn, const u_long *y, int yn)
+{
+    int s = div_normalization_factor(y[yn-1]);
+    u_long *a = WTEMP(xn+1), *b = WTEMP(yn), *q = WTEMP(xn-yn+2);
+    a[xn] = wlshift(a, x, xn, s);
+    wlshift(b, y, yn, s);
+    wdiv(q, a, xn+1, b, yn);
+    wrshift(r, a, yn, s);
+    return wsize(r, yn);
+}
+
+/* r[0..n) = a*x[0..xn) - b*y[0..yn), xn, yn <= n, where we know the
+   result is nonnegative and fits in n words. */
+static void wmulsub2(u_long *r, int n, const u_long *x, int xn, u_long a,
+                     const u_long *y, int yn, u_long b)
+{
+    u_long cx = 0, cy = 0, c = 0;
+    for (int i=0; i<n; i++) {
+        u_long hx = 0, lx = 0, hy = 0, ly = 0, t;
+        if (i < xn) { UMUL(hx, lx, x[i], a); }
+        lx += cx; hx += (lx < cx); cx = hx;
+        if (i < yn) { UMUL(hy, ly, y[i], b); }
+        ly += cy; hy += (ly < cy); cy = hy;
+        USUB(t, c, lx, ly);
+        r[i] = t;
+    }
+}
+
+/* r[0..xn) = a*x[0..xn) + b*y[0..yn), xn >= yn, where a and b have
+   opposite signs (or either is zero). */
+static void wlincomb(u_long *r, const u_long *x, int xn, long a,
+                     const u_long *y, int yn, long b)
+{
+    if (b <= 0) wmulsub2(r, xn, x, xn, (u_long)a, y, yn, (u_long)-b);
+    else        wmulsub2(r, xn, y, yn, (u_long)b, x, xn, (u_long)-a);
+}
+
+/* Binary gcd of words */
+static u_long gcd_word(u_long x, u_long y)
+{
+    if (x == 0) return y;
+    if (y == 0) return x;
+    int k = Scm__LowestBitNumber(x|y);
+    x >>= Scm__LowestBitNumber(x);
+    do {
+        y >>= Scm__LowestBitNumber(y);
+        if (x > y) { u_long t = x; x = y; y = t; }
+        y -= x;
+    } while (y != 0);
+    return x << k;
+}
+
+/* Lehmer's algorithm (Knuth TAOCP 4.5.2, Algorithm L).  We run Euclid's
+   algorithm on the leading LEHMER_BITS bits of the operands with word
+   arithmetic as long as the quotients are sure to be the same as the
+   ones for the full operands, keeping the cofactors A, B, C and D.
+   Then we replace (u, v) with (Au+Bv, Cu+Dv) at once, which saves
+   most of the multi-word divisions of the plain Euclid's algorithm.
+   The cofactors are bounded by 2^LEHMER_BITS, so they fit in a long
+   along with the sums in the test. */
+#define LEHMER_BITS  (WORD_BITS-2)
+
+/* Returns the bits [lowbit, lowbit+LEHMER_BITS) of x[0..n). */
+static u_long lehmer_leading_bits(const u_long *x, int n, int lowbit)
+{
+    int i = lowbit / WORD_BITS, s = lowbit % WORD_BITS;
+    if (i >= n) return 0;
+    u_long w = x[i] >> s;
+    if (s > 0 && i+1 < n) w |= x[i+1] << (WORD_BITS - s);
+    return w & ((1UL << LEHMER_BITS) - 1);
+}
+
+/* Returns gcd(|bx|, |by|), normalized. */
+ScmObj Scm_BignumGcd(const ScmBignum *bx, const ScmBignum *by)
+{
+    if (Scm_BignumAbsCmp(bx, by) < 0) {
+        const ScmBignum *bt = bx; bx = by; by = bt;
+    }
+    int un = bx->size, vn = by->size, n = bx->size;
+    u_long *u = WTEMP(n), *v = WTEMP(n), *t = WTEMP(n), *w = WTEMP(n);
+    for (int i=0; i<un; i++) u[i] = bx->values[i];
+    for (int i=0; i<vn; i++) v[i] = by->values[i];
+    un = wsize(u, un);
+    vn = wsize(v, vn);
+
+    while (vn > 1) {
+        /* leading bits of u, and the corresponding bits of v */
+        int lowbit = un*WORD_BITS - div_normalization_factor(u[un-1])
+            - LEHMER_BITS;
+        long uh = (long)lehmer_leading_bits(u, un, lowbit);
+        long vh = (long)lehmer_leading_bits(v, vn, lowbit);
+        long A = 1, B = 0, C = 0, D = 1;
+        for (;;) {
+            if (vh + C <= 0 || vh + D <= 0) break;
+            if (uh + A < 0 || uh + B < 0) break;
+            long q = (uh + A) / (vh + C);
+            if (q != (uh + B) / (vh + D)) break;
+            long T;
+            T = A - q*C; A = C; C = T;
+            T = B - q*D; B = D; D = T;
+            T = uh - q*vh; uh = vh; vh = T;
+        }
+
+        u_long *p;
+        if (B == 0) {
+            /* The leading bits didn't help; do one division step. */
+            int rn = wmod(t, u, un, v, vn);
+            p = u; u = v; v = t; t = p;
+            un = vn; vn = rn;
+        } else {
+            wlincomb(t, u, un, A, v, vn, B);
+            wlincomb(w, u, un, C, v, vn, D);
+            p = u; u = t; t = p;
+            p = v; v = w; w = p;
+            vn = wsize(v, un);
+            un = wsize(u, un);
+        }
+    }
+
+    if (vn == 0) {
+        return Scm_NormalizeBignum(SCM_BIGNUM(Scm_MakeBignumFromUIArray(1, u, un)));
+    }
+    /* v fits in a word. */
+    int rn = wmod(t, u, un, v, 1);
+    return Scm_MakeIntegerU(gcd_word(v[0], rn? t[0] : 0));
+}
+
 /*-----------------------------------------------------------------------
  * Logical (bitwise) opertaions
  */
@@ -1277,24 +1942,173 @@ int Scm_BignumLogCount(const ScmBignum *b)
  * Printing
  */
 
+/*-----------------------------------------------------------------------
+ * Radix conversion
+ *
+ *  Small numbers are converted a chunk of digits at a time, using the
+ *  largest power of radix that fits in a half word.  Large ones are
+ *  split recursively by P_k = chunk^(2^k), so that the cost follows
+ *  that of multiplication and division instead of being quadratic.
+ *  P_k's are computed on demand and kept for each radix.
+ */
+
+#define RADIX_DC_THRESHOLD  40      /* words */
+#define RADIX_POW_LEVELS    48
+
+static ScmObj radix_powers[SCM_RADIX_MAX+1][RADIX_POW_LEVELS];
+static ScmInternalMutex radix_powers_mutex = SCM_INTERNAL_MUTEX_INITIALIZER;
+
+/* Returns the largest power of RADIX below HALF_WORD, and sets its
+   exponent to *DIGITS. */
+static u_long radix_chunk(int radix, int *digits)
+{
+    u_long b = radix;
+    int d = 1;
+    while (b < HALF_WORD/radix) { b *= radix; d++; }
+    *digits = d;
+    return b;
+}
+
+/* Returns P_k. */
+static ScmObj radix_power(int radix, int k)
+{
+    SCM_ASSERT(k < RADIX_POW_LEVELS);
+    (void)SCM_INTERNAL_MUTEX_LOCK(radix_powers_mutex);
+    ScmObj p = radix_powers[radix][k];
+    (void)SCM_INTERNAL_MUTEX_UNLOCK(radix_powers_mutex);
+    if (p != NULL) return p;
+
+    if (k == 0) {
+        int d;
+        p = Scm_MakeIntegerU(radix_chunk(radix, &d));
+    } else {
+        ScmObj h = radix_power(radix, k-1);
+        p = Scm_Mul(h, h);
+    }
+    (void)SCM_INTERNAL_MUTEX_LOCK(radix_powers_mutex);
+    if (radix_powers[radix][k] == NULL) radix_powers[radix][k] = p;
+    else p = radix_powers[radix][k];
+    (void)SCM_INTERNAL_MUTEX_UNLOCK(radix_powers_mutex);
+    return p;
+}
+
+/* Number of bits of nonnegative integer X. */
+static long integer_bits(ScmObj x)
+{
+    if (SCM_INTP(x)) {
+        u_long v = (u_long)SCM_INT_VALUE(x);
+        return v? Scm__HighestBitNumber(v) + 1 : 0;
+    } else {
+        const ScmBignum *b = SCM_BIGNUM(x);
+        return (long)(b->size-1)*WORD_BITS
+            + Scm__HighestBitNumber(b->values[b->size-1]) + 1;
+    }
+}
+
+/* Writes the digits of nonnegative integer X backwards, ending before
+   *PP, and updates *PP to point to the first digit.  X must be less
+   than P_(K+1).  If WIDTH is positive, the result is padded with '0'
+   up to WIDTH digits. */
+static void radix_write(ScmObj x, int radix, int k, long width,
+                        const char *tab, char **pp)
+{
+    char *end = *pp;
+
+    if (SCM_INTP(x) || SCM_BIGNUM_SIZE(x) < RADIX_DC_THRESHOLD || k < 0) {
+        char *p = *pp;
+        if (SCM_INTP(x)) {
+            u_long v = (u_long)SCM_INT_VALUE(x);
+            for (; v > 0; v /= radix) *--p = tab[v % radix];
+        } else {
+            int d;
+            u_long chunk = radix_chunk(radix, &d);
+            ScmBignum *q = SCM_BIGNUM(Scm_BignumCopy(SCM_BIGNUM(x)));
+            while (q->size > 0) {
+                u_long r = bignum_sdiv(q, chunk);
+                for (; q->size > 0 && q->values[q->size-1] == 0; q->size--)
+                    ;
+                for (int i=0; i<d && (q->size > 0 || r > 0); i++) {
+                    *--p = tab[r % radix];
+                    r /= radix;
+                }
+            }
+        }
+        *pp = p;
+    } else {
+        int d;
+        (void)radix_chunk(radix, &d);
+        ScmObj pk = radix_power(radix, k);
+        if (Scm_NumCmp(x, pk) < 0) {
+            radix_write(x, radix, k-1, 0, tab, pp);
+        } else {
+            ScmObj r;
+            ScmObj q = Scm_Quotient(x, pk, &r);
+            radix_write(r, radix, k-1, (long)d << k, tab, pp);
+            radix_write(q, radix, k-1, 0, tab, pp);
+        }
+    }
+    while (end - *pp < width) *--(*pp) = '0';
+}
+
 ScmObj Scm_BignumToString(const ScmBignum *b, int radix, int use_upper)
 {
     static const char ltab[] = "0123456789abcdefghijklmnopqrstuvwxyz";
     static const char utab[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
     const char *tab = use_upper? utab : ltab;
-    ScmObj h = SCM_NIL, t = SCM_NIL;
     if (radix < 2 || radix > 36)
         Scm_Error("radix out of range: %d", radix);
-    ScmBignum *q = SCM_BIGNUM(Scm_BignumCopy(b));
-    for (;q->size > 0;) {
-        long rem = bignum_sdiv(q, radix);
-        SCM_ASSERT(rem >= 0 && rem < radix);
-        SCM_APPEND1(h, t, SCM_MAKE_CHAR(tab[rem]));
-        for (; q->values[q->size-1] == 0 && q->size > 0; q->size--)
-            ;
-    }
-    if (q->sign < 0) SCM_APPEND1(h, t, SCM_MAKE_CHAR('-'));
-    return Scm_ListToString(Scm_ReverseX(h));
+
+    ScmObj x = (b->sign < 0)? Scm_BignumNegate(b) : SCM_OBJ(b);
+    long nbits = integer_bits(x);
+    int lg = 1;                 /* floor(log2(radix)) */
+    while ((2 << lg) <= radix) lg++;
+    long buflen = nbits/lg + 2;
+    char *buf = SCM_NEW_ATOMIC2(char*, buflen);
+    char *p = buf + buflen;
+
+    /* Find K such that x < P_(K+1) = P_K^2. */
+    int k = 0;
+    if (!SCM_INTP(x) && SCM_BIGNUM_SIZE(x) >= RADIX_DC_THRESHOLD) {
+        while (2*(integer_bits(radix_power(radix, k))-1) < nbits) k++;
+    }
+    radix_write(x, radix, k, 0, tab, &p);
+    if (b->sign < 0) *--p = '-';
+    int len = (int)(buf + buflen - p);
+    return Scm_MakeString(p, len, len, SCM_STRING_COPYING);
+}
+
+/* Returns an integer whose digits in RADIX, most significant first,
+   are DIGS[0] ... DIGS[LEN-1].  Each element of DIGS is a digit value,
+   not a character. */
+ScmObj Scm_DigitsToInteger(const unsigned char *digs, long len, int radix)
+{
+    int d;
+    u_long chunk = radix_chunk(radix, &d);
+    int lg = 1;                 /* ceiling(log2(radix)) */
+    while ((1 << lg) < radix) lg++;
+
+    if (len*lg < (long)RADIX_DC_THRESHOLD*WORD_BITS) {
+        ScmBignum *acc = Scm_MakeBignumWithSize(len*lg/WORD_BITS + 1, 0);
+        u_long v = 0, m = 1;
+        for (long i=0; i<len; i++) {
+            v = v*radix + digs[i];
+            m *= radix;
+            if (m == chunk) {
+                acc = Scm_BignumAccMultAddUI(acc, m, v);
+                v = 0; m = 1;
+            }
+        }
+        if (m > 1) acc = Scm_BignumAccMultAddUI(acc, m, v);
+        return Scm_NormalizeBignum(acc);
+    }
+
+    /* Split at the largest P_k with fewer digits than LEN. */
+    int k = 0;
+    while (((long)d << (k+1)) < len) k++;
+    long lolen = (long)d << k;
+    ScmObj hi = Scm_DigitsToInteger(digs, len - lolen, radix);
+    ScmObj lo = Scm_DigitsToInteger(digs + len - lolen, lolen, radix);
+    return Scm_Add(Scm_Mul(hi, radix_power(radix, k)), lo);
 }
 
 int Scm_DumpBignum(const ScmBignum *b, ScmPort *out)
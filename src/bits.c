@@ -35,6 +35,271 @@
 #include "gauche.h"
 #include "gauche/bits_inline.h"
 
+/*
+ * The bulk operations (Scm_BitsOperate, Scm_BitsCount*, Scm_BitsSelect*)
+ * handle the partial words at both ends by themselves, and pass the
+ * run of full words in between to word kernels.  On x86 we pick AVX2
+ * and/or POPCNT kernels at runtime (see Scm__InitBits); on aarch64 NEON
+ * is always there.
+ */
+
+#if (defined(__x86_64__) || defined(__i386__)) \
+    && (defined(__clang__) \
+        || (defined(__GNUC__) \
+            && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define BITS_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) && defined(__GNUC__)
+#define BITS_SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
+#define count_bits Scm__CountBitsInWord /* defined in bits_inline.h */
+#define lowest  Scm__LowestBitNumber
+#define highest Scm__HighestBitNumber
+
+/*===================================================================
+ * Word kernels
+ */
+
+static inline u_long operate_word(ScmBitOp op, u_long a, u_long b)
+{
+    switch (op) {
+    case SCM_BIT_AND:  return a & b;
+    case SCM_BIT_IOR:  return a | b;
+    case SCM_BIT_XOR:  return a ^ b;
+    case SCM_BIT_NAND: return ~(a & b);
+    case SCM_BIT_NOR:  return ~(a | b);
+    case SCM_BIT_EQV:  return ~(a ^ b);
+    case SCM_BIT_ANDC1:return ~a & b;
+    case SCM_BIT_ANDC2:return a & ~b;
+    case SCM_BIT_IORC1:return ~a | b;
+    case SCM_BIT_IORC2:return a | ~b;
+    case SCM_BIT_XORC1:return ~a ^ b;
+    case SCM_BIT_XORC2:return a ^ ~b;
+    case SCM_BIT_SRC1: return a;
+    case SCM_BIT_SRC2: return b;
+    case SCM_BIT_NOT1: return ~a;
+    case SCM_BIT_NOT2: return ~b;
+    }
+    return 0;                   /* dummy */
+}
+
+/* Operands that aren't used by OP may be NULL (e.g. B for SCM_BIT_NOT1),
+   so we only load what's needed. */
+#define USES_A(op)  ((op) != SCM_BIT_SRC2 && (op) != SCM_BIT_NOT2)
+#define USES_B(op)  ((op) != SCM_BIT_SRC1 && (op) != SCM_BIT_NOT1)
+
+/* Scalar kernel; the switch is hoisted out of the loop so that
+   the compiler can unroll or vectorize each loop. */
+static void operate_words_scalar(ScmBits *r, ScmBitOp op,
+                                 const ScmBits *a, const ScmBits *b,
+                                 size_t n)
+{
+#define LOOP(expr)  for (size_t i=0; i<n; i++) r[i] = (expr); break
+    switch (op) {
+    case SCM_BIT_AND:  LOOP(a[i] & b[i]);
+    case SCM_BIT_IOR:  LOOP(a[i] | b[i]);
+    case SCM_BIT_XOR:  LOOP(a[i] ^ b[i]);
+    case SCM_BIT_NAND: LOOP(~(a[i] & b[i]));
+    case SCM_BIT_NOR:  LOOP(~(a[i] | b[i]));
+    case SCM_BIT_EQV:  LOOP(~(a[i] ^ b[i]));
+    case SCM_BIT_ANDC1:LOOP(~a[i] & b[i]);
+    case SCM_BIT_ANDC2:LOOP(a[i] & ~b[i]);
+    case SCM_BIT_IORC1:LOOP(~a[i] | b[i]);
+    case SCM_BIT_IORC2:LOOP(a[i] | ~b[i]);
+    case SCM_BIT_XORC1:LOOP(~a[i] ^ b[i]);
+    case SCM_BIT_XORC2:LOOP(a[i] ^ ~b[i]);
+    case SCM_BIT_SRC1: LOOP(a[i]);
+    case SCM_BIT_SRC2: LOOP(b[i]);
+    case SCM_BIT_NOT1: LOOP(~a[i]);
+    case SCM_BIT_NOT2: LOOP(~b[i]);
+    }
+#undef LOOP
+}
+
+static u_long count_words_scalar(const ScmBits *w, size_t n)
+{
+    u_long c = 0;
+    for (size_t i=0; i<n; i++) c += count_bits(w[i]);
+    return c;
+}
+
+#if defined(BITS_SIMD_X86)
+
+/* Returns the number of words processed; the caller handles the rest. */
+__attribute__((target("avx2")))
+static size_t operate_words_avx2(ScmBits *r, ScmBitOp op,
+                                 const ScmBits *a, const ScmBits *b,
+                                 size_t n)
+{
+    const size_t K = sizeof(__m256i)/sizeof(ScmBits);
+    const __m256i ones = _mm256_set1_epi32(-1);
+    size_t i = 0;
+#define VA _mm256_loadu_si256((const __m256i*)(a+i))
+#define VB _mm256_loadu_si256((const __m256i*)(b+i))
+#define LOOP(expr)                                              \
+    for (; i+K <= n; i += K) {                                  \
+        _mm256_storeu_si256((__m256i*)(r+i), (expr));           \
+    }                                                           \
+    break
+    switch (op) {
+    case SCM_BIT_AND:  LOOP(_mm256_and_si256(VA, VB));
+    case SCM_BIT_IOR:  LOOP(_mm256_or_si256(VA, VB));
+    case SCM_BIT_XOR:  LOOP(_mm256_xor_si256(VA, VB));
+    case SCM_BIT_NAND: LOOP(_mm256_xor_si256(_mm256_and_si256(VA, VB), ones));
+    case SCM_BIT_NOR:  LOOP(_mm256_xor_si256(_mm256_or_si256(VA, VB), ones));
+    case SCM_BIT_EQV:  /* FALLTHROUGH */
+    case SCM_BIT_XORC1:/* FALLTHROUGH */
+    case SCM_BIT_XORC2:LOOP(_mm256_xor_si256(_mm256_xor_si256(VA, VB), ones));
+    case SCM_BIT_ANDC1:LOOP(_mm256_andnot_si256(VA, VB));
+    case SCM_BIT_ANDC2:LOOP(_mm256_andnot_si256(VB, VA));
+    case SCM_BIT_IORC1:LOOP(_mm256_or_si256(_mm256_xor_si256(VA, ones), VB));
+    case SCM_BIT_IORC2:LOOP(_mm256_or_si256(VA, _mm256_xor_si256(VB, ones)));
+    case SCM_BIT_SRC1: LOOP(VA);
+    case SCM_BIT_SRC2: LOOP(VB);
+    case SCM_BIT_NOT1: LOOP(_mm256_xor_si256(VA, ones));
+    case SCM_BIT_NOT2: LOOP(_mm256_xor_si256(VB, ones));
+    }
+#undef LOOP
+#undef VB
+#undef VA
+    return i;
+}
+
+/* Mula's nibble-lookup popcount; the byte counts are summed up
+   into 64bit lanes by vpsadbw. */
+__attribute__((target("avx2")))
+static u_long count_words_avx2(const ScmBits *w, size_t n)
+{
+    const size_t K = sizeof(__m256i)/sizeof(ScmBits);
+    const __m256i lookup = _mm256_setr_epi8(0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4,
+                                            0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4);
+    const __m256i lomask = _mm256_set1_epi8(0x0f);
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i acc = zero;
+    size_t i = 0;
+    for (; i+K <= n; i += K) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(w+i));
+        __m256i lo = _mm256_and_si256(v, lomask);
+        __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), lomask);
+        __m256i c = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, lo),
+                                    _mm256_shuffle_epi8(lookup, hi));
+        acc = _mm256_add_epi64(acc, _mm256_sad_epu8(c, zero));
+    }
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i*)lanes, acc);
+    u_long c = (u_long)(lanes[0] + lanes[1] + lanes[2] + lanes[3]);
+    return c + count_words_scalar(w+i, n-i);
+}
+
+__attribute__((target("popcnt")))
+static u_long count_words_popcnt(const ScmBits *w, size_t n)
+{
+    u_long c = 0;
+    for (size_t i=0; i<n; i++) c += __builtin_popcountl(w[i]);
+    return c;
+}
+
+static size_t (*operate_words_simd)(ScmBits*, ScmBitOp,
+                                    const ScmBits*, const ScmBits*,
+                                    size_t) = NULL;
+static u_long (*count_words)(const ScmBits*, size_t) = count_words_scalar;
+
+#elif defined(BITS_SIMD_NEON)
+
+static size_t operate_words_neon(ScmBits *r, ScmBitOp op,
+                                 const ScmBits *a, const ScmBits *b,
+                                 size_t n)
+{
+    const size_t K = sizeof(uint64x2_t)/sizeof(ScmBits);
+    size_t i = 0;
+#define VA vld1q_u64((const uint64_t*)(a+i))
+#define VB vld1q_u64((const uint64_t*)(b+i))
+#define NOT(x) vreinterpretq_u64_u32(vmvnq_u32(vreinterpretq_u32_u64(x)))
+#define LOOP(expr)                                              \
+    for (; i+K <= n; i += K) vst1q_u64((uint64_t*)(r+i), (expr)); \
+    break
+    switch (op) {
+    case SCM_BIT_AND:  LOOP(vandq_u64(VA, VB));
+    case SCM_BIT_IOR:  LOOP(vorrq_u64(VA, VB));
+    case SCM_BIT_XOR:  LOOP(veorq_u64(VA, VB));
+    case SCM_BIT_NAND: LOOP(NOT(vandq_u64(VA, VB)));
+    case SCM_BIT_NOR:  LOOP(NOT(vorrq_u64(VA, VB)));
+    case SCM_BIT_EQV:  /* FALLTHROUGH */
+    case SCM_BIT_XORC1:/* FALLTHROUGH */
+    case SCM_BIT_XORC2:LOOP(NOT(veorq_u64(VA, VB)));
+    case SCM_BIT_ANDC1:LOOP(vbicq_u64(VB, VA));
+    case SCM_BIT_ANDC2:LOOP(vbicq_u64(VA, VB));
+    case SCM_BIT_IORC1:LOOP(vornq_u64(VB, VA));
+    case SCM_BIT_IORC2:LOOP(vornq_u64(VA, VB));
+    case SCM_BIT_SRC1: LOOP(VA);
+    case SCM_BIT_SRC2: LOOP(VB);
+    case SCM_BIT_NOT1: LOOP(NOT(VA));
+    case SCM_BIT_NOT2: LOOP(NOT(VB));
+    }
+#undef LOOP
+#undef NOT
+#undef VB
+#undef VA
+    return i;
+}
+
+static u_long count_words_neon(const ScmBits *w, size_t n)
+{
+    const size_t K = sizeof(uint8x16_t)/sizeof(ScmBits);
+    uint64x2_t acc = vdupq_n_u64(0);
+    size_t i = 0;
+    for (; i+K <= n; i += K) {
+        uint8x16_t c = vcntq_u8(vld1q_u8((const uint8_t*)(w+i)));
+        acc = vaddq_u64(acc, vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(c))));
+    }
+    u_long c = (u_long)(vgetq_lane_u64(acc, 0) + vgetq_lane_u64(acc, 1));
+    return c + count_words_scalar(w+i, n-i);
+}
+
+static size_t (*operate_words_simd)(ScmBits*, ScmBitOp,
+                                    const ScmBits*, const ScmBits*,
+                                    size_t) = operate_words_neon;
+static u_long (*count_words)(const ScmBits*, size_t) = count_words_neon;
+
+#else  /* !BITS_SIMD_X86 && !BITS_SIMD_NEON */
+
+static size_t (*operate_words_simd)(ScmBits*, ScmBitOp,
+                                    const ScmBits*, const ScmBits*,
+                                    size_t) = NULL;
+static u_long (*count_words)(const ScmBits*, size_t) = count_words_scalar;
+
+#endif /* !BITS_SIMD_X86 && !BITS_SIMD_NEON */
+
+static void operate_words(ScmBits *r, ScmBitOp op,
+                          const ScmBits *a, const ScmBits *b, size_t n)
+{
+    size_t i = 0;
+    if (operate_words_simd != NULL) i = operate_words_simd(r, op, a, b, n);
+    if (i < n) {
+        operate_words_scalar(r+i, op,
+                             USES_A(op)? a+i : NULL,
+                             USES_B(op)? b+i : NULL,
+                             n-i);
+    }
+}
+
+void Scm__InitBits(void)
+{
+#if defined(BITS_SIMD_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        operate_words_simd = operate_words_avx2;
+        count_words = count_words_avx2;
+    } else if (__builtin_cpu_supports("popcnt")) {
+        count_words = count_words_popcnt;
+    }
+#endif
+}
+
 /*===================================================================
  * Construct, copy, fill
  */
@@ -44,25 +309,59 @@ ScmBits *Scm_MakeBits(int numbits)
     return SCM_NEW_ATOMIC_ARRAY(ScmBits, SCM_BITS_NUM_WORDS(numbits));
 }
 
+/* Fetches SCM_WORD_BITS bits starting from bit position POS, which
+   may be negative.  Only the words LO to HI (inclusive) are read;
+   the bits in other words are taken as zero. */
+static inline u_long fetch_word(const ScmBits *src, long pos, long lo, long hi)
+{
+    long q = (pos >= 0)? pos/SCM_WORD_BITS : -((-pos-1)/SCM_WORD_BITS) - 1;
+    int  s = (int)(pos - q*SCM_WORD_BITS);
+    u_long w0 = (q >= lo && q <= hi)? src[q] : 0;
+    if (s == 0) return w0;
+    u_long w1 = (q+1 >= lo && q+1 <= hi)? src[q+1] : 0;
+    return (w0 >> s) | (w1 << (SCM_WORD_BITS - s));
+}
+
+/* Copies bits between SSTART and SEND of SRC into TARGET from TSTART.
+   TARGET and SRC may be the same array with overlapping ranges. */
 void Scm_BitsCopyX(ScmBits *target, int tstart,
                    ScmBits *src, int sstart, int send)
 {
+    if (sstart >= send) return;
+    int tend = tstart + (send - sstart);
+
     if (tstart%SCM_WORD_BITS == 0
         && sstart%SCM_WORD_BITS == 0
         && send%SCM_WORD_BITS == 0) {
         /* easy path */
-        int tw = tstart/SCM_WORD_BITS;
-        int sw = sstart/SCM_WORD_BITS;
-        int ew = send/SCM_WORD_BITS;
-        while (sw < ew) target[tw++] = src[sw++];
+        memmove(target + tstart/SCM_WORD_BITS, src + sstart/SCM_WORD_BITS,
+                (send - sstart)/SCM_WORD_BITS * sizeof(ScmBits));
+        return;
+    }
+
+    long tw = tstart/SCM_WORD_BITS;
+    long ew = (tend-1)/SCM_WORD_BITS;
+    long lo = sstart/SCM_WORD_BITS;
+    long hi = (send-1)/SCM_WORD_BITS;
+    long delta = (long)sstart - tstart;
+    u_long smask = SCM_BITS_MASK(tstart%SCM_WORD_BITS, 0);
+    u_long emask = SCM_BITS_MASK(0, tend%SCM_WORD_BITS);
+
+#define COPY_WORD(w)                                                    \
+    do {                                                                \
+        u_long m_ = ((w) == tw? smask : ~0UL) & ((w) == ew? emask : ~0UL); \
+        u_long v_ = fetch_word(src, (w)*SCM_WORD_BITS + delta, lo, hi); \
+        target[w] = (target[w] & ~m_) | (v_ & m_);                      \
+    } while (0)
+
+    if (target == src && delta < 0) {
+        /* Moving toward higher bits; go backward not to clobber
+           the source words we'll read. */
+        for (long w = ew; w >= tw; w--) COPY_WORD(w);
     } else {
-        /* TODO: make this more efficient. */
-        int t, s;
-        for (t=tstart, s=sstart; s < send; t++, s++) {
-            if (SCM_BITS_TEST(src, s)) SCM_BITS_SET(target, t);
-            else                       SCM_BITS_RESET(target, t);
-        }
+        for (long w = tw; w <= ew; w++) COPY_WORD(w);
     }
+#undef COPY_WORD
 }
 
 void Scm_BitsFill(ScmBits *bits, int start, int end, int b)
@@ -72,6 +371,7 @@ void Scm_BitsFill(ScmBits *bits, int start, int end, int b)
     int sb = start % SCM_WORD_BITS;
     int eb = end   % SCM_WORD_BITS;
 
+    if (start >= end) return;
     if (sw == ew) {
         u_long mask = ((1UL<<eb) - 1) & ~((1UL<<sb) - 1);
         if (b) bits[sw] |= mask;
@@ -83,45 +383,47 @@ void Scm_BitsFill(ScmBits *bits, int start, int end, int b)
             if (b) bits[sw] = ~0UL;
             else   bits[sw] = 0;
         }
-        if (b) bits[ew] |= ((1UL<<eb)-1);
-        else   bits[ew] &= ~((1UL<<eb)-1);
+        /* NB: if END is on a word boundary, bits[ew] may be beyond
+           the array. */
+        if (eb) {
+            if (b) bits[ew] |= ((1UL<<eb)-1);
+            else   bits[ew] &= ~((1UL<<eb)-1);
+        }
     }
 }
 
+/* R = A op B on the bits between S and E.  The bits of R outside
+   of the range are kept intact.  R may be the same as A or B. */
 void Scm_BitsOperate(ScmBits *r, ScmBitOp op,
                      const ScmBits *a, const ScmBits *b,
                      int s, int e)
 {
+    if (s >= e) return;
     int sw = s/SCM_WORD_BITS;
-    int sb = s%SCM_WORD_BITS;
-    int ew = e/SCM_WORD_BITS;
-    int eb = e%SCM_WORD_BITS;
+    int ew = (e-1)/SCM_WORD_BITS;
+    u_long smask = SCM_BITS_MASK(s%SCM_WORD_BITS, 0);
+    u_long emask = SCM_BITS_MASK(0, e%SCM_WORD_BITS);
 
-    /* NB: Not very optimized for speed.  Rewrite when we hit a bottleneck. */
-    for (int w = sw; w < ew + (eb?1:0); w++) {
-        u_long z = 0;
-        switch (op) {
-        case SCM_BIT_AND:  z = a[w] & b[w];    break;
-        case SCM_BIT_IOR:  z = a[w] | b[w];    break;
-        case SCM_BIT_XOR:  z = a[w] ^ b[w];    break;
-        case SCM_BIT_NAND: z = ~(a[w] & b[w]); break;
-        case SCM_BIT_NOR:  z = ~(a[w] | b[w]); break;
-        case SCM_BIT_EQV:  z = ~(a[w] ^ b[w]); break;
-        case SCM_BIT_ANDC1:z = ~a[w] & b[w];   break;
-        case SCM_BIT_ANDC2:z = a[w] & ~b[w];   break;
-        case SCM_BIT_IORC1:z = ~a[w] | b[w];   break;
-        case SCM_BIT_IORC2:z = a[w] | ~b[w];   break;
-        case SCM_BIT_XORC1:z = ~a[w] ^ b[w];   break;
-        case SCM_BIT_XORC2:z = a[w] ^ ~b[w];   break;
-        case SCM_BIT_SRC1: z = a[w];           break;
-        case SCM_BIT_SRC2: z = b[w];           break;
-        case SCM_BIT_NOT1: z = ~a[w];          break;
-        case SCM_BIT_NOT2: z = ~b[w];          break;
-        }
-        if (w == sw && sb != 0) z &= ~((1UL<<sb)-1);
-        else if (w == ew)       z &= (1UL<<eb)-1;
-        r[w] = z;
+#define EDGE_WORD(w, mask)                                              \
+    do {                                                                \
+        u_long z_ = operate_word(op, USES_A(op)? a[w] : 0,              \
+                                 USES_B(op)? b[w] : 0);                 \
+        r[w] = (r[w] & ~(mask)) | (z_ & (mask));                        \
+    } while (0)
+
+    if (sw == ew) {
+        EDGE_WORD(sw, smask & emask);
+        return;
     }
+    EDGE_WORD(sw, smask);
+    if (ew - sw > 1) {
+        operate_words(r+sw+1, op,
+                      USES_A(op)? a+sw+1 : NULL,
+                      USES_B(op)? b+sw+1 : NULL,
+                      ew-sw-1);
+    }
+    EDGE_WORD(ew, emask);
+#undef EDGE_WORD
 }
 
 /*===================================================================
@@ -135,6 +437,10 @@ int Scm_BitsEqual(const ScmBits *a, const ScmBits *b, int s, int e)
     int ew = e/SCM_WORD_BITS;
     int eb = e%SCM_WORD_BITS;
 
+    if (s >= e) return TRUE;
+    if (sw == ew) {
+        return ((a[sw]^b[sw]) & SCM_BITS_MASK(sb, eb)) == 0;
+    }
     if (sb) {
         if (((a[sw]^b[sw])&~((1UL<<sb)-1)) != 0) return FALSE;
         else sw++;
@@ -156,6 +462,10 @@ int Scm_BitsIncludes(const ScmBits *a, const ScmBits *b, int s, int e)
     int ew = e/SCM_WORD_BITS;
     int eb = e%SCM_WORD_BITS;
 
+    if (s >= e) return TRUE;
+    if (sw == ew) {
+        return ((b[sw] & ~a[sw]) & SCM_BITS_MASK(sb, eb)) == 0;
+    }
     if (sb) {
         if (((a[sw]^(a[sw]|b[sw]))&~((1UL<<sb)-1)) != 0) return FALSE;
         else sw++;
@@ -173,8 +483,6 @@ int Scm_BitsIncludes(const ScmBits *a, const ScmBits *b, int s, int e)
  * Bit counting
  */
 
-#define count_bits Scm__CountBitsInWord /* defined in bits_inline.h */
-
 /* count number of '1's from the start-th bit (inclusive) and end-th
    bit (exclusiv) */
 int Scm_BitsCount1(const ScmBits *bits, int start, int end)
@@ -184,36 +492,24 @@ int Scm_BitsCount1(const ScmBits *bits, int start, int end)
     int sb = start  % SCM_WORD_BITS;
     int eb = end    % SCM_WORD_BITS;
 
-    if (start == end) return 0;
+    if (start >= end) return 0;
     if (sw == ew) return count_bits(bits[sw] & SCM_BITS_MASK(sb, eb));
 
     u_long num = count_bits(bits[sw] & SCM_BITS_MASK(sb, 0));
-    for (sw++; sw < ew; sw++) num += count_bits(bits[sw]);
+    if (ew - sw > 1) num += count_words(bits+sw+1, ew-sw-1);
     return num + (count_bits((bits[ew]) & SCM_BITS_MASK(0, eb)));
 }
 
 int Scm_BitsCount0(const ScmBits *bits, int start, int end)
 {
-    int sw = start  / SCM_WORD_BITS;
-    int ew = (end-1)/ SCM_WORD_BITS;
-    int sb = start  % SCM_WORD_BITS;
-    int eb = end    % SCM_WORD_BITS;
-
-    if (start == end) return 0;
-    if (sw == ew) return count_bits(~bits[sw] & SCM_BITS_MASK(sb, eb));
-
-    u_long num = count_bits(~bits[sw] & SCM_BITS_MASK(sb, 0));
-    for (sw++; sw < ew; sw++) num += count_bits(~bits[sw]);
-    return num + (count_bits(~bits[ew] & SCM_BITS_MASK(0, eb)));
+    if (start >= end) return 0;
+    return (end - start) - Scm_BitsCount1(bits, start, end);
 }
 
 /*===================================================================
  * Bit finding
  */
 
-#define lowest  Scm__LowestBitNumber
-#define highest Scm__HighestBitNumber
-
 /* Returns the lowest bit number between start and end, or -1 if all
    the bits there is zero. */
 int Scm_BitsLowest1(const ScmBits *bits, int start, int end)
@@ -223,7 +519,7 @@ int Scm_BitsLowest1(const ScmBits *bits, int start, int end)
     int ew = (end-1)/SCM_WORD_BITS;
     int eb = end%SCM_WORD_BITS;
 
-    if (start == end) return -1;
+    if (start >= end) return -1;
     if (ew == sw) {
         u_long w = bits[sw] & SCM_BITS_MASK(sb, eb);
         if (w) return lowest(w) + sw*SCM_WORD_BITS;
@@ -231,7 +527,7 @@ int Scm_BitsLowest1(const ScmBits *bits, int start, int end)
     } else {
         u_long w = bits[sw] & SCM_BITS_MASK(sb, 0);
         if (w) return lowest(w) + sw*SCM_WORD_BITS;
-        for (;sw < ew; sw++) {
+        for (sw++;sw < ew; sw++) {
             if (bits[sw]) return lowest(bits[sw])+sw*SCM_WORD_BITS;
         }
         w = bits[ew] & SCM_BITS_MASK(0, eb);
@@ -247,7 +543,7 @@ int Scm_BitsLowest0(const ScmBits *bits, int start, int end)
     int ew = (end-1)/SCM_WORD_BITS;
     int eb = end%SCM_WORD_BITS;
 
-    if (start == end) return -1;
+    if (start >= end) return -1;
     if (ew == sw) {
         u_long w = ~bits[sw] & SCM_BITS_MASK(sb, eb);
         if (w) return lowest(w) + sw*SCM_WORD_BITS;
@@ -255,7 +551,7 @@ int Scm_BitsLowest0(const ScmBits *bits, int start, int end)
     } else {
         u_long w = ~bits[sw] & SCM_BITS_MASK(sb, 0);
         if (w) return lowest(w) + sw*SCM_WORD_BITS;
-        for (;sw < ew; sw++) {
+        for (sw++;sw < ew; sw++) {
             if (~bits[sw]) return lowest(~bits[sw])+sw*SCM_WORD_BITS;
         }
         w = ~bits[ew] & SCM_BITS_MASK(0, eb);
@@ -273,7 +569,7 @@ int Scm_BitsHighest1(const ScmBits *bits, int start, int end)
     int ew = (end-1)/SCM_WORD_BITS;
     int eb = end%SCM_WORD_BITS;
 
-    if (start == end) return -1;
+    if (start >= end) return -1;
     if (ew == sw) {
         u_long w = bits[sw] & SCM_BITS_MASK(sb, eb);
         if (w) return highest(w) + sw*SCM_WORD_BITS;
@@ -297,7 +593,7 @@ int Scm_BitsHighest0(const ScmBits *bits, int start, int end)
     int ew = (end-1)/SCM_WORD_BITS;
     int eb = end%SCM_WORD_BITS;
 
-    if (start == end) return -1;
+    if (start >= end) return -1;
     if (ew == sw) {
         u_long w = ~bits[sw] & SCM_BITS_MASK(sb, eb);
         if (w) return highest(w) + sw*SCM_WORD_BITS;
@@ -313,3 +609,53 @@ int Scm_BitsHighest0(const ScmBits *bits, int start, int end)
         return -1;
     }
 }
+
+/* Select: returns the bit number of the K-th (0-based) '1' (or '0')
+   between start and end, or -1 if there are not that many.
+   This is an inverse of rank, i.e. Scm_BitsCount1(bits, start, r) == k
+   where r = Scm_BitsSelect1(bits, start, end, k). */
+
+#define SELECT_CHUNK  64        /* words to skip at once by bulk count */
+
+static inline int select_in_word(u_long w, int k)
+{
+    while (k-- > 0) w &= w-1;   /* drop the lowest '1's */
+    return lowest(w);
+}
+
+static int bits_select(const ScmBits *bits, int start, int end, int k,
+                       int b)
+{
+    int sw = start/SCM_WORD_BITS;
+    int sb = start%SCM_WORD_BITS;
+    int ew = (end-1)/SCM_WORD_BITS;
+    int eb = end%SCM_WORD_BITS;
+    u_long flip = b? 0 : ~0UL;
+
+    if (start >= end || k < 0) return -1;
+    for (int w = sw; w <= ew; w++) {
+        if (w > sw && ew - w > SELECT_CHUNK) {
+            /* skip a chunk of full words quickly */
+            int c = (int)count_words(bits+w, SELECT_CHUNK);
+            if (!b) c = SELECT_CHUNK*SCM_WORD_BITS - c;
+            if (k >= c) { k -= c; w += SELECT_CHUNK - 1; continue; }
+        }
+        u_long word = bits[w] ^ flip;
+        if (w == sw) word &= SCM_BITS_MASK(sb, 0);
+        if (w == ew) word &= SCM_BITS_MASK(0, eb);
+        int c = (int)count_bits(word);
+        if (k < c) return w*SCM_WORD_BITS + select_in_word(word, k);
+        k -= c;
+    }
+    return -1;
+}
+
+int Scm_BitsSelect1(const ScmBits *bits, int start, int end, int k)
+{
+    return bits_select(bits, start, end, k, TRUE);
+}
+
+int Scm_BitsSelect0(const ScmBits *bits, int start, int end, int k)
+{
+    return bits_select(bits, start, end, k, FALSE);
+}
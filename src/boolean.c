@@ -77,9 +77,11 @@ int Scm_EqvP(ScmObj x, ScmObj y)
 
    It is much easier to write the algorithm in Scheme, but we don't want
    the overhead of crossing C-Scheme boundary for trivial cases.
-   So we cover a simple cases (non-aggregates, user-defined objects and
-   flat lists/vectors) in C, and fall back to Scheme routine if we encounter
-   more complex structures.
+   So we walk lists and vectors in C with an explicit stack of pending
+   subobjects, and fall back to Scheme routine only if we find a
+   circular spine, or the number of nested aggregates exceeds
+   EQUAL_NODE_LIMIT (which is where a cycle through cars would lead us).
+   The C walk never recurses, so deep trees don't eat the C stack.
 
    Caveat: The cycle may involve user-defined objects.  To detect such
    cycle, we need to pass down the context info to ScmClass.compare
@@ -88,77 +90,16 @@ int Scm_EqvP(ScmObj x, ScmObj y)
    For now, let such cyclic structures explode.
 */
 
-int Scm_EqualP(ScmObj x, ScmObj y)
-{
-#define CHECK_AGGREGATE(a, b)                   \
-    do {                                        \
-        if (SCM_PAIRP(a)) {                     \
-            if (SCM_PAIRP(b)) goto fallback;    \
-            return FALSE;                       \
-        }                                       \
-        if (SCM_VECTORP(a)) {                   \
-            if (SCM_VECTORP(b)) goto fallback;  \
-            return FALSE;                       \
-        }                                       \
-        if (!Scm_EqualP(a, b)) return FALSE;    \
-    } while (0)                                 \
-
-    if (SCM_EQ(x, y)) return TRUE;
+#define EQUAL_STACK_INIT  32
+#define EQUAL_NODE_LIMIT  100000
 
+/* Compares anything but pairs and vectors. */
+static int equal_atom(ScmObj x, ScmObj y)
+{
     if (SCM_NUMBERP(x)) {
         if (!SCM_NUMBERP(y)) return FALSE;
         return Scm_EqvP(x, y);
     }
-    if (SCM_PAIRP(x)) {
-        if (!SCM_PAIRP(y)) return FALSE;
-        /* We loop on "spine" of lists, so that the typical long flat list
-           can be compared quickly.  If we find nested lists/vectors, we
-           jump to Scheme routine.  We adopt hare and tortoise to detect
-           loop in the CDR side. */
-        ScmObj xslow = x; ScmObj yslow = y;
-        int xcirc = FALSE; int ycirc = FALSE;
-        for (;;) {
-            ScmObj carx = SCM_CAR(x);
-            ScmObj cary = SCM_CAR(y);
-            CHECK_AGGREGATE(carx, cary);
-
-            x = SCM_CDR(x); y = SCM_CDR(y);
-            if (!SCM_PAIRP(x) || !SCM_PAIRP(y)) return Scm_EqualP(x, y);
-            carx = SCM_CAR(x); cary = SCM_CAR(y);
-
-            CHECK_AGGREGATE(carx, cary);
-
-            if (xslow == x) {
-                if (ycirc) return TRUE;
-                xcirc = TRUE;
-            }
-            if (yslow == y) {
-                if (xcirc) return TRUE;
-                ycirc = TRUE;
-            }
-
-            x = SCM_CDR(x); y = SCM_CDR(y);
-            if (!SCM_PAIRP(x) || !SCM_PAIRP(y)) return Scm_EqualP(x, y);
-            xslow = SCM_CDR(xslow); yslow = SCM_CDR(yslow);
-        }
-    }
-    if (SCM_VECTORP(x)) {
-        if (!SCM_VECTORP(y)) return FALSE;
-        ScmWord i = 0, len = SCM_VECTOR_SIZE(x);
-        if (SCM_VECTOR_SIZE(y) != len) return FALSE;
-        for (; i < len; i++) {
-            ScmObj xx = SCM_VECTOR_ELEMENT(x, i);
-            ScmObj yy = SCM_VECTOR_ELEMENT(y, i);
-            /* NB: If we detect nested structure in middle of vectors,
-               we run Scheme routine for the entire vector; so we'll test
-               equality of elements before the current one again.  If
-               they are simple objects that's negligible, but there may
-               be objects of user-defined datatypes, for which object-equal?
-               could be expensive; we'll fix it in future. */
-            CHECK_AGGREGATE(xx, yy);
-        }
-        return TRUE;
-    }
     if (SCM_STRINGP(x)) {
         if (!SCM_STRINGP(y)) return FALSE;
         return Scm_StringEqual(SCM_STRING(x), SCM_STRING(y));
@@ -189,6 +130,79 @@ int Scm_EqualP(ScmObj x, ScmObj y)
     ScmClass *cy = Scm_ClassOf(y);
     if (cx == cy && cx->compare) return (cx->compare(x, y, TRUE) == 0);
     else                         return FALSE;
+}
+
+#define AGGREGATEP(obj)  (SCM_PAIRP(obj) || SCM_VECTORP(obj))
+
+int Scm_EqualP(ScmObj x, ScmObj y)
+{
+    if (SCM_EQ(x, y)) return TRUE;
+    if (!AGGREGATEP(x)) {
+        if (AGGREGATEP(y)) return FALSE;
+        return equal_atom(x, y);
+    }
+
+    /* The stack keeps pairs of subobjects to be compared. */
+    ScmObj sbuf[EQUAL_STACK_INIT*2];
+    ScmObj *stack = sbuf;
+    int sp = 0, size = EQUAL_STACK_INIT;
+    int nodes = 0;
+    ScmObj x0 = x, y0 = y;
+
+#define PUSH_OR_COMPARE(a, b)                                           \
+    do {                                                                \
+        ScmObj a_ = (a), b_ = (b);                                      \
+        if (SCM_EQ(a_, b_)) break;                                      \
+        if (AGGREGATEP(a_)) {                                           \
+            if (sp == size) {                                           \
+                ScmObj *ns = SCM_NEW_ARRAY(ScmObj, size*4);             \
+                memcpy(ns, stack, sizeof(ScmObj)*size*2);               \
+                stack = ns;                                             \
+                size *= 2;                                              \
+            }                                                           \
+            stack[sp*2] = a_; stack[sp*2+1] = b_; sp++;                 \
+        } else if (AGGREGATEP(b_) || !equal_atom(a_, b_)) {             \
+            return FALSE;                                               \
+        }                                                               \
+    } while (0)
+
+    for (;;) {
+        if (SCM_EQ(x, y)) {
+            /* nothing to do */
+        } else if (SCM_PAIRP(x)) {
+            if (!SCM_PAIRP(y)) return FALSE;
+            if (++nodes > EQUAL_NODE_LIMIT) goto fallback;
+            /* We loop on "spine" of lists, so that the typical long flat
+               list can be compared quickly.  We adopt hare and tortoise
+               to detect loop in the CDR side. */
+            ScmObj xslow = x;
+            int odd = FALSE;
+            for (;;) {
+                PUSH_OR_COMPARE(SCM_CAR(x), SCM_CAR(y));
+                x = SCM_CDR(x); y = SCM_CDR(y);
+                if (!SCM_PAIRP(x) || !SCM_PAIRP(y)) break;
+                if (odd) xslow = SCM_CDR(xslow);
+                odd = !odd;
+                if (SCM_EQ(x, xslow)) goto fallback;
+            }
+            continue;           /* compare the last cdrs */
+        } else if (SCM_VECTORP(x)) {
+            if (!SCM_VECTORP(y)) return FALSE;
+            if (++nodes > EQUAL_NODE_LIMIT) goto fallback;
+            ScmWord len = SCM_VECTOR_SIZE(x);
+            if (SCM_VECTOR_SIZE(y) != len) return FALSE;
+            for (ScmWord i = 0; i < len; i++) {
+                PUSH_OR_COMPARE(SCM_VECTOR_ELEMENT(x, i),
+                                SCM_VECTOR_ELEMENT(y, i));
+            }
+        } else if (AGGREGATEP(y) || !equal_atom(x, y)) {
+            return FALSE;
+        }
+        if (sp == 0) return TRUE;
+        sp--;
+        x = stack[sp*2];
+        y = stack[sp*2+1];
+    }
 
  fallback: 
     {
@@ -196,9 +210,9 @@ int Scm_EqualP(ScmObj x, ScmObj y)
         static ScmObj equal_interleave_proc = SCM_UNDEFINED;
         SCM_BIND_PROC(equal_interleave_proc, "%interleave-equal?",
                       Scm_GaucheInternalModule());
-        return !SCM_FALSEP(Scm_ApplyRec2(equal_interleave_proc, x, y));
+        return !SCM_FALSEP(Scm_ApplyRec2(equal_interleave_proc, x0, y0));
     }
-#undef CHECK_AGGREGATE
+#undef PUSH_OR_COMPARE
 }
 
 int Scm_EqualM(ScmObj x, ScmObj y, int mode)
@@ -211,6 +211,46 @@ SCM_DEFINE_BUILTIN_CLASS(Scm_CharSetClass,
 #define MASK_SET(cs, ch)    SCM_BITS_SET(cs->small, ch)
 #define MASK_RESET(cs, ch)  SCM_BITS_RESET(cs->small, ch)
 
+static void check_mutable(ScmCharSet *cs)
+{
+    if (SCM_CHAR_SET_IMMUTABLE_P(cs)) {
+        Scm_Error("char-set is immutable: %S", SCM_OBJ(cs));
+    }
+}
+
+/* Iterates over the ranges of large characters, regardless of
+   the representation. */
+typedef struct large_iter_rec {
+    ScmCharSet *cs;
+    ScmTreeIter iter;
+    ScmSmallInt i;
+} large_iter;
+
+static void large_iter_init(large_iter *it, ScmCharSet *cs)
+{
+    it->cs = cs;
+    it->i = 0;
+    if (!SCM_CHAR_SET_IMMUTABLE_P(cs)) {
+        Scm_TreeIterInit(&it->iter, &cs->large.tree, NULL);
+    }
+}
+
+static int large_iter_next(large_iter *it, ScmChar *lo, ScmChar *hi)
+{
+    if (SCM_CHAR_SET_IMMUTABLE_P(it->cs)) {
+        if (it->i >= it->cs->large.frozen.size) return FALSE;
+        *lo = it->cs->large.frozen.ranges[it->i*2];
+        *hi = it->cs->large.frozen.ranges[it->i*2+1];
+        it->i++;
+        return TRUE;
+    } else {
+        ScmDictEntry *e = Scm_TreeIterNext(&it->iter);
+        if (e == NULL) return FALSE;
+        *lo = (ScmChar)e->key;
+        *hi = (ScmChar)e->value;
+        return TRUE;
+    }
+}
 
 /*----------------------------------------------------------------------
  * Printer
@@ -266,14 +306,14 @@ static void charset_print(ScmObj obj, ScmPort *out, ScmWriteContext *ctx)
             charset_print_ch(out, code-1, FALSE);
         }
     }
-    ScmTreeIter iter;
-    ScmDictEntry *e;
-    Scm_TreeIterInit(&iter, &cs->large, NULL);
-    while ((e = Scm_TreeIterNext(&iter)) != NULL) {
-        charset_print_ch(out, (int)e->key, FALSE);
-        if (e->value != e->key) {
-            if (e->value - e->key > 2) Scm_Printf(out, "-");
-            charset_print_ch(out, (int)e->value, FALSE);
+    large_iter iter;
+    ScmChar lo, hi;
+    large_iter_init(&iter, cs);
+    while (large_iter_next(&iter, &lo, &hi)) {
+        charset_print_ch(out, lo, FALSE);
+        if (hi != lo) {
+            if (hi - lo > 2) Scm_Printf(out, "-");
+            charset_print_ch(out, hi, FALSE);
         }
     }
     Scm_Printf(out, "]");
@@ -294,7 +334,8 @@ static ScmCharSet *make_charset(void)
     ScmCharSet *cs = SCM_NEW(ScmCharSet);
     SCM_SET_CLASS(cs, SCM_CLASS_CHARSET);
     Scm_BitsFill(cs->small, 0, SCM_CHAR_SET_SMALL_CHARS, 0);
-    Scm_TreeCoreInit(&cs->large, cmp, NULL);
+    cs->flags = 0;
+    Scm_TreeCoreInit(&cs->large.tree, cmp, NULL);
     return cs;
 }
 
@@ -303,14 +344,163 @@ ScmObj Scm_MakeEmptyCharSet(void)
     return SCM_OBJ(make_charset());
 }
 
+/* The copy is always mutable. */
 ScmObj Scm_CharSetCopy(ScmCharSet *src)
 {
     ScmCharSet *dst = make_charset();
     Scm_BitsCopyX(dst->small, 0, src->small, 0, SCM_CHAR_SET_SMALL_CHARS);
-    Scm_TreeCoreCopy(&dst->large, &src->large);
+    if (SCM_CHAR_SET_IMMUTABLE_P(src)) {
+        for (ScmSmallInt i = 0; i < src->large.frozen.size; i++) {
+            ScmDictEntry *e =
+                Scm_TreeCoreSearch(&dst->large.tree,
+                                   src->large.frozen.ranges[i*2],
+                                   SCM_DICT_CREATE);
+            e->value = src->large.frozen.ranges[i*2+1];
+        }
+    } else {
+        Scm_TreeCoreCopy(&dst->large.tree, &src->large.tree);
+    }
     return SCM_OBJ(dst);
 }
 
+/*-----------------------------------------------------------------
+ * Freezing
+ */
+
+#define BMP_LIMIT       0x10000
+#define BMP_PAGE_CHARS  256
+#define BMP_NUM_PAGES   (BMP_LIMIT/BMP_PAGE_CHARS)
+#define BMP_PAGE_WORDS  SCM_BITS_NUM_WORDS(BMP_PAGE_CHARS)
+
+/* Page 0 is all clear and page 1 is all set.  A charset without
+   ranges below BMP_LIMIT shares the empty index. */
+static ScmBits bmp_shared_pages[BMP_PAGE_WORDS*2];
+static unsigned short bmp_empty_index[BMP_NUM_PAGES];
+
+static void freeze_bmp(ScmCharSet *cs, const ScmChar *ranges,
+                       ScmSmallInt size)
+{
+    if (size == 0 || ranges[0] >= BMP_LIMIT) {
+        cs->large.frozen.bmpIndex = bmp_empty_index;
+        cs->large.frozen.bmpPages = bmp_shared_pages;
+        return;
+    }
+
+    /* Count the pages partially covered, which need their own bits. */
+    unsigned short *index = SCM_NEW_ATOMIC_ARRAY(unsigned short,
+                                                 BMP_NUM_PAGES);
+    ScmBits page[BMP_PAGE_WORDS];
+    ScmSmallInt r = 0, npages = 2;
+    for (int p = 0; p < BMP_NUM_PAGES; p++) {
+        ScmChar pmin = p*BMP_PAGE_CHARS, pmax = pmin + BMP_PAGE_CHARS - 1;
+        while (r < size && ranges[r*2+1] < pmin) r++;
+        if (r == size || ranges[r*2] > pmax) {
+            index[p] = 0;
+        } else if (ranges[r*2] <= pmin && ranges[r*2+1] >= pmax) {
+            index[p] = 1;
+        } else {
+            index[p] = (unsigned short)npages++;
+        }
+    }
+
+    ScmBits *pages = SCM_NEW_ATOMIC_ARRAY(ScmBits, npages*BMP_PAGE_WORDS);
+    memcpy(pages, bmp_shared_pages, sizeof(bmp_shared_pages));
+    r = 0;
+    for (int p = 0; p < BMP_NUM_PAGES; p++) {
+        if (index[p] < 2) continue;
+        ScmChar pmin = p*BMP_PAGE_CHARS, pmax = pmin + BMP_PAGE_CHARS - 1;
+        Scm_BitsFill(page, 0, BMP_PAGE_CHARS, FALSE);
+        while (r < size && ranges[r*2+1] < pmin) r++;
+        for (ScmSmallInt k = r; k < size && ranges[k*2] <= pmax; k++) {
+            ScmChar lo = (ranges[k*2] < pmin)? pmin : ranges[k*2];
+            ScmChar hi = (ranges[k*2+1] > pmax)? pmax : ranges[k*2+1];
+            Scm_BitsFill(page, (int)(lo - pmin), (int)(hi - pmin + 1), TRUE);
+        }
+        memcpy(pages + index[p]*BMP_PAGE_WORDS, page, sizeof(page));
+    }
+    cs->large.frozen.bmpIndex = index;
+    cs->large.frozen.bmpPages = pages;
+}
+
+/* Turns CS into the immutable form in place, and returns it.
+   Once frozen, a char-set can't be modified. */
+ScmObj Scm_CharSetFreeze(ScmCharSet *cs)
+{
+    if (SCM_CHAR_SET_IMMUTABLE_P(cs)) return SCM_OBJ(cs);
+
+    ScmSmallInt size = Scm_TreeCoreNumEntries(&cs->large.tree);
+    ScmChar *ranges = NULL;
+    if (size > 0) {
+        ScmTreeIter iter;
+        ScmDictEntry *e;
+        ScmSmallInt i = 0;
+        ranges = SCM_NEW_ATOMIC_ARRAY(ScmChar, size*2);
+        Scm_TreeIterInit(&iter, &cs->large.tree, NULL);
+        while ((e = Scm_TreeIterNext(&iter)) != NULL) {
+            ranges[i++] = (ScmChar)e->key;
+            ranges[i++] = (ScmChar)e->value;
+        }
+    }
+    cs->large.frozen.size = size;
+    cs->large.frozen.ranges = ranges;
+    freeze_bmp(cs, ranges, size);
+    cs->flags |= SCM_CHAR_SET_IMMUTABLE;
+    return SCM_OBJ(cs);
+}
+
+/* Returns the index of the range that may contain C, i.e. the last
+   range whose start is not greater than C, or -1.  The loop doesn't
+   branch on the comparison, so its cost depends only on SIZE. */
+static inline ScmSmallInt frozen_search(const ScmChar *ranges,
+                                        ScmSmallInt size, ScmChar c)
+{
+    if (size == 0 || ranges[0] > c) return -1;
+    const ScmChar *base = ranges;
+    while (size > 1) {
+        ScmSmallInt half = size/2;
+        base = (base[half*2] <= c)? base + half*2 : base;
+        size -= half;
+    }
+    return (base - ranges)/2;
+}
+
+static inline int frozen_contains(ScmCharSet *cs, ScmChar c)
+{
+    if (c < BMP_LIMIT) {
+        const ScmBits *page = cs->large.frozen.bmpPages
+            + cs->large.frozen.bmpIndex[c>>8]*BMP_PAGE_WORDS;
+        return SCM_BITS_TEST(page, c & (BMP_PAGE_CHARS-1));
+    } else {
+        const ScmChar *ranges = cs->large.frozen.ranges;
+        ScmSmallInt k = frozen_search(ranges, cs->large.frozen.size, c);
+        return (k >= 0 && ranges[k*2+1] >= c);
+    }
+}
+
+/* Finds the range of large chars in CS that contains C.  Returns
+   FALSE if there's none. */
+static int large_range(ScmCharSet *cs, ScmChar c, ScmChar *lo, ScmChar *hi)
+{
+    if (SCM_CHAR_SET_IMMUTABLE_P(cs)) {
+        const ScmChar *ranges = cs->large.frozen.ranges;
+        ScmSmallInt k = frozen_search(ranges, cs->large.frozen.size, c);
+        if (k < 0 || ranges[k*2+1] < c) return FALSE;
+        *lo = ranges[k*2];
+        *hi = ranges[k*2+1];
+        return TRUE;
+    } else {
+        ScmDictEntry *e, *l, *h;
+        e = Scm_TreeCoreClosestEntries(&cs->large.tree, (int)c, &l, &h);
+        if (!e) {
+            if (!l || l->value < c) return FALSE;
+            e = l;
+        }
+        *lo = (ScmChar)e->key;
+        *hi = (ScmChar)e->value;
+        return TRUE;
+    }
+}
+
 /*-----------------------------------------------------------------
  * Comparison
  */
@@ -334,9 +524,19 @@ int Scm_CharSetEq(ScmCharSet *x, ScmCharSet *y)
 {
     if (!Scm_BitsEqual(x->small, y->small, 0, SCM_CHAR_SET_SMALL_CHARS))
         return FALSE;
-    if (!Scm_TreeCoreEq(&x->large, &y->large))
-        return FALSE;
-    return TRUE;
+    if (!SCM_CHAR_SET_IMMUTABLE_P(x) && !SCM_CHAR_SET_IMMUTABLE_P(y))
+        return Scm_TreeCoreEq(&x->large.tree, &y->large.tree);
+
+    large_iter xi, yi;
+    ScmChar xlo, xhi, ylo, yhi;
+    large_iter_init(&xi, x);
+    large_iter_init(&yi, y);
+    for (;;) {
+        int xp = large_iter_next(&xi, &xlo, &xhi);
+        int yp = large_iter_next(&yi, &ylo, &yhi);
+        if (!xp || !yp) return (xp == yp);
+        if (xlo != ylo || xhi != yhi) return FALSE;
+    }
 }
 
 /* whether x <= y */
@@ -353,18 +553,12 @@ int Scm_CharSetLE(ScmCharSet *x, ScmCharSet *y)
      *         xk<---------->xv
      *    yk<------------------>yv
      */
-    ScmTreeIter xi;
-    ScmDictEntry *xe, *ye, *yl, *yh;
-    Scm_TreeIterInit(&xi, &x->large, NULL);
-    for (xe = Scm_TreeIterNext(&xi); xe; xe = Scm_TreeIterNext(&xi)) {
-        ye = Scm_TreeCoreClosestEntries(&y->large, xe->key, &yl, &yh);
-        if (ye) {               /* case 1 */
-            if (ye->value < xe->value) return FALSE;
-        } else if (yl) {        /* case 2 */
-            if (yl->value < xe->value) return FALSE;
-        } else {
-            return FALSE;
-        }
+    large_iter xi;
+    ScmChar xlo, xhi, ylo, yhi;
+    large_iter_init(&xi, x);
+    while (large_iter_next(&xi, &xlo, &xhi)) {
+        if (!large_range(y, xlo, &ylo, &yhi)) return FALSE;
+        if (yhi < xhi) return FALSE;
     }
     return TRUE;
 }
@@ -377,6 +571,7 @@ ScmObj Scm_CharSetAddRange(ScmCharSet *cs, ScmChar from, ScmChar to)
 {
     ScmDictEntry *e, *lo, *hi;
 
+    check_mutable(cs);
     if (to < from) return SCM_OBJ(cs);
     if (from < SCM_CHAR_SET_SMALL_CHARS) {
         if (to < SCM_CHAR_SET_SMALL_CHARS) {
@@ -388,10 +583,10 @@ ScmObj Scm_CharSetAddRange(ScmCharSet *cs, ScmChar from, ScmChar to)
     }
 
     /* Let e have the lower bound. */
-    e = Scm_TreeCoreClosestEntries(&cs->large, from, &lo, &hi);
+    e = Scm_TreeCoreClosestEntries(&cs->large.tree, from, &lo, &hi);
     if (!e) {
         if (!lo || lo->value < from-1) {
-            e = Scm_TreeCoreSearch(&cs->large, from, SCM_DICT_CREATE);
+            e = Scm_TreeCoreSearch(&cs->large.tree, from, SCM_DICT_CREATE);
         } else {
             e = lo;
         }
@@ -401,12 +596,12 @@ ScmObj Scm_CharSetAddRange(ScmCharSet *cs, ScmChar from, ScmChar to)
     if (e->value >= to) return SCM_OBJ(cs);
 
     hi = e;
-    while ((hi = Scm_TreeCoreNextEntry(&cs->large, hi->key)) != NULL) {
+    while ((hi = Scm_TreeCoreNextEntry(&cs->large.tree, hi->key)) != NULL) {
         if (hi->key > to+1) {
             e->value = to;
             return SCM_OBJ(cs);
         }
-        Scm_TreeCoreSearch(&cs->large, hi->key, SCM_DICT_DELETE);
+        Scm_TreeCoreSearch(&cs->large.tree, hi->key, SCM_DICT_DELETE);
         if (hi->value > to) {
             e->value = hi->value;
             return SCM_OBJ(cs);
@@ -419,14 +614,15 @@ ScmObj Scm_CharSetAddRange(ScmCharSet *cs, ScmChar from, ScmChar to)
 ScmObj Scm_CharSetAdd(ScmCharSet *dst, ScmCharSet *src)
 {
     if (dst == src) return SCM_OBJ(dst);  /* precaution */
+    check_mutable(dst);
 
-    ScmTreeIter iter;
-    ScmDictEntry *e;
+    large_iter iter;
+    ScmChar lo, hi;
     Scm_BitsOperate(dst->small, SCM_BIT_IOR, dst->small, src->small,
                     0, SCM_CHAR_SET_SMALL_CHARS);
-    Scm_TreeIterInit(&iter, &src->large, NULL);
-    while ((e = Scm_TreeIterNext(&iter)) != NULL) {
-        Scm_CharSetAddRange(dst, SCM_CHAR(e->key), SCM_CHAR(e->value));
+    large_iter_init(&iter, src);
+    while (large_iter_next(&iter, &lo, &hi)) {
+        Scm_CharSetAddRange(dst, lo, hi);
     }
     return SCM_OBJ(dst);
 }
@@ -435,20 +631,21 @@ ScmObj Scm_CharSetComplement(ScmCharSet *cs)
 {
     ScmDictEntry *e, *n;
 
+    check_mutable(cs);
     Scm_BitsOperate(cs->small, SCM_BIT_NOT1, cs->small, NULL,
                     0, SCM_CHAR_SET_SMALL_CHARS);
     int last = SCM_CHAR_SET_SMALL_CHARS-1;
     /* we can't use treeiter, since we modify the tree while traversing it. */
-    while ((e = Scm_TreeCoreNextEntry(&cs->large, last)) != NULL) {
-        Scm_TreeCoreSearch(&cs->large, e->key, SCM_DICT_DELETE);
+    while ((e = Scm_TreeCoreNextEntry(&cs->large.tree, last)) != NULL) {
+        Scm_TreeCoreSearch(&cs->large.tree, e->key, SCM_DICT_DELETE);
         if (last < e->key-1) {
-            n = Scm_TreeCoreSearch(&cs->large, last+1, SCM_DICT_CREATE);
+            n = Scm_TreeCoreSearch(&cs->large.tree, last+1, SCM_DICT_CREATE);
             n->value = e->key-1;
         }
         last = (int)e->value;
     }
     if (last < SCM_CHAR_MAX) {
-        n = Scm_TreeCoreSearch(&cs->large, last+1, SCM_DICT_CREATE);
+        n = Scm_TreeCoreSearch(&cs->large.tree, last+1, SCM_DICT_CREATE);
         n->value = SCM_CHAR_MAX;
     }
     return SCM_OBJ(cs);
@@ -457,6 +654,7 @@ ScmObj Scm_CharSetComplement(ScmCharSet *cs)
 /* Make CS case-insensitive. */
 ScmObj Scm_CharSetCaseFold(ScmCharSet *cs)
 {
+    check_mutable(cs);
     for (int ch='a'; ch<='z'; ch++) {
         if (MASK_ISSET(cs, ch) || MASK_ISSET(cs, (ch-('a'-'A')))) {
             MASK_SET(cs, ch);
@@ -466,7 +664,7 @@ ScmObj Scm_CharSetCaseFold(ScmCharSet *cs)
 
     ScmTreeIter iter;
     ScmDictEntry *e;
-    Scm_TreeIterInit(&iter, &cs->large, NULL);
+    Scm_TreeIterInit(&iter, &cs->large.tree, NULL);
     while ((e = Scm_TreeIterNext(&iter)) != NULL) {
         for (ScmChar c = e->key; c <= e->value; c++) {
             ScmChar uch = Scm_CharUpcase(c);
@@ -486,9 +684,10 @@ int Scm_CharSetContains(ScmCharSet *cs, ScmChar c)
 {
     if (c < 0) return FALSE;
     if (c < SCM_CHAR_SET_SMALL_CHARS) return MASK_ISSET(cs, c);
+    if (SCM_CHAR_SET_IMMUTABLE_P(cs)) return frozen_contains(cs, c);
     else {
         ScmDictEntry *e, *l, *h;
-        e = Scm_TreeCoreClosestEntries(&cs->large, (int)c, &l, &h);
+        e = Scm_TreeCoreClosestEntries(&cs->large.tree, (int)c, &l, &h);
         if (e || (l && l->value >= c)) return TRUE;
         else return FALSE;
     }
@@ -518,11 +717,11 @@ ScmObj Scm_CharSetRanges(ScmCharSet *cs)
         SCM_APPEND1(h, t, cell);
     }
 
-    ScmTreeIter iter;
-    ScmDictEntry *e;
-    Scm_TreeIterInit(&iter, &cs->large, NULL);
-    while ((e = Scm_TreeIterNext(&iter)) != NULL) {
-        ScmObj cell = Scm_Cons(SCM_MAKE_INT(e->key), SCM_MAKE_INT(e->value));
+    large_iter iter;
+    ScmChar lo, hi;
+    large_iter_init(&iter, cs);
+    while (large_iter_next(&iter, &lo, &hi)) {
+        ScmObj cell = Scm_Cons(SCM_MAKE_INT(lo), SCM_MAKE_INT(hi));
         SCM_APPEND1(h, t, cell);
     }
     return h;
@@ -530,7 +729,8 @@ ScmObj Scm_CharSetRanges(ScmCharSet *cs)
 
 void Scm_CharSetDump(ScmCharSet *cs, ScmPort *port)
 {
-    Scm_Printf(port, "CharSet %p\nmask:", cs);
+    Scm_Printf(port, "CharSet %p%s\nmask:", cs,
+               SCM_CHAR_SET_IMMUTABLE_P(cs)? " (immutable)" : "");
     for (int i=0; i<SCM_BITS_NUM_WORDS(SCM_CHAR_SET_SMALL_CHARS); i++) {
 #if SIZEOF_LONG == 4
         Scm_Printf(port, "[%08lx]", cs->small[i]);
@@ -539,7 +739,14 @@ void Scm_CharSetDump(ScmCharSet *cs, ScmPort *port)
 #endif
     }
     Scm_Printf(port, "\nranges:");
-    Scm_TreeCoreDump(&cs->large, port);
+    if (SCM_CHAR_SET_IMMUTABLE_P(cs)) {
+        for (ScmSmallInt i = 0; i < cs->large.frozen.size; i++) {
+            Scm_Printf(port, " %lx-%lx", cs->large.frozen.ranges[i*2],
+                       cs->large.frozen.ranges[i*2+1]);
+        }
+    } else {
+        Scm_TreeCoreDump(&cs->large.tree, port);
+    }
     Scm_Printf(port, "\n");
 }
 
@@ -891,12 +1098,17 @@ const ScmCharCaseMap *Scm__CharCaseMap(ScmChar ch,
      (code) = SIMPLE_CASE(code, buf, field),       \
      Scm_UcsToChar((int)(code)))
 
+/* ASCII characters are the majority in most text, and their mappings are
+   the same in all encodings; we don't need to look at the tables. */
+#define ASCII_UPCASE(ch)   ((ch) - (((ch) >= 'a' && (ch) <= 'z')? 'a'-'A' : 0))
+#define ASCII_DOWNCASE(ch) ((ch) + (((ch) >= 'A' && (ch) <= 'Z')? 'a'-'A' : 0))
+
 ScmChar Scm_CharUpcase(ScmChar ch)
 {
     ScmCharCaseMap cm;
+    if (ch < 0x80) return ASCII_UPCASE(ch);
 #if defined(GAUCHE_CHAR_ENCODING_EUC_JP) || defined(GAUCHE_CHAR_ENCODING_SJIS)
-    if (ch < 0x80) return SIMPLE_CASE(ch, &cm, upper);
-    else if (Scm__CharInUnicodeP(ch)) return SIMPLE_CASE_CV(ch, &cm, upper);
+    if (Scm__CharInUnicodeP(ch)) return SIMPLE_CASE_CV(ch, &cm, upper);
     else           return ch;
 #elif defined(GAUCHE_CHAR_ENCODING_UTF_8)
     return SIMPLE_CASE(ch, &cm, upper);
@@ -913,9 +1125,9 @@ ScmChar Scm_CharUpcase(ScmChar ch)
 ScmChar Scm_CharDowncase(ScmChar ch)
 {
     ScmCharCaseMap cm;
+    if (ch < 0x80) return ASCII_DOWNCASE(ch);
 #if defined(GAUCHE_CHAR_ENCODING_EUC_JP) || defined(GAUCHE_CHAR_ENCODING_SJIS)
-    if (ch < 0x80) return SIMPLE_CASE(ch, &cm, lower);
-    else if (Scm__CharInUnicodeP(ch)) return SIMPLE_CASE_CV(ch, &cm, lower);
+    if (Scm__CharInUnicodeP(ch)) return SIMPLE_CASE_CV(ch, &cm, lower);
     else           return ch;
 #else
     return SIMPLE_CASE(ch, &cm, lower);
@@ -925,9 +1137,9 @@ ScmChar Scm_CharDowncase(ScmChar ch)
 ScmChar Scm_CharTitlecase(ScmChar ch)
 {
     ScmCharCaseMap cm;
+    if (ch < 0x80) return ASCII_UPCASE(ch);
 #if defined(GAUCHE_CHAR_ENCODING_EUC_JP) || defined(GAUCHE_CHAR_ENCODING_SJIS)
-    if (ch < 0x80) return SIMPLE_CASE(ch, &cm, title);
-    else if (Scm__CharInUnicodeP(ch)) return SIMPLE_CASE_CV(ch, &cm, title);
+    if (Scm__CharInUnicodeP(ch)) return SIMPLE_CASE_CV(ch, &cm, title);
     else           return ch;
 #elif defined(GAUCHE_CHAR_ENCODING_UTF_8)
     return SIMPLE_CASE(ch, &cm, title);
@@ -940,6 +1152,7 @@ ScmChar Scm_CharTitlecase(ScmChar ch)
 ScmChar Scm_CharFoldcase(ScmChar ch)
 {
     ScmCharCaseMap cm;
+    if (ch < 0x80) return ASCII_DOWNCASE(ch);
 #if defined(GAUCHE_CHAR_ENCODING_EUC_JP) || defined(GAUCHE_CHAR_ENCODING_SJIS)
     if (Scm__CharInUnicodeP(ch)) {
         ScmChar ucs = (ScmChar)Scm_CharToUcs(ch);
@@ -1020,6 +1233,9 @@ static void install_charsets(void)
         if (code == ' ' || code == '\t')
             MASK_SET(CS(SCM_CHAR_SET_BLANK), code);
     }
+    for (int i = 0; i < SCM_CHAR_SET_NUM_PREDEFINED_SETS; i++) {
+        Scm_CharSetFreeze(CS(i));
+    }
 #undef CS
     SCM_INTERNAL_MUTEX_UNLOCK(predef_charsets_mutex);
 }
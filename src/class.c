@@ -65,6 +65,7 @@ static ScmObj instance_class_redefinition(ScmObj obj, ScmClass *old);
 static ScmObj slot_set_using_accessor(ScmObj obj, ScmSlotAccessor *sa,
                                       ScmObj val);
 static ScmObj instance_allocate(ScmClass *klass, ScmObj initargs);
+static void flush_slot_accessor_cache(ScmClass *klass);
 
 static int object_compare(ScmObj x, ScmObj y, int equalp);
 
@@ -181,6 +182,22 @@ static struct {
                                              to ensure this sturcture is
                                              placed in the data area */
 
+/* Generic functions cache sorted applicable methods (see "Dispatch cache"
+   below).  Any change that can alter the result of method dispatch---
+   adding, deleting or replacing methods, and class redefinition---bumps
+   this epoch, which invalidates all cache entries at once. */
+static struct {
+    u_long            epoch;
+    ScmInternalMutex  mutex;
+} dispatch_epoch = { 1 };
+
+static void invalidate_dispatch_cache(void)
+{
+    (void)SCM_INTERNAL_MUTEX_LOCK(dispatch_epoch.mutex);
+    dispatch_epoch.epoch++;
+    (void)SCM_INTERNAL_MUTEX_UNLOCK(dispatch_epoch.mutex);
+}
+
 /* Imporant slots in <class> metaboject can be modified only when the
    class is in 'malleable' state.   Here's the check. */
 #define CHECK_MALLEABLE(k, who)                         \
@@ -465,6 +482,7 @@ ScmClass *Scm_ClassOf(ScmObj obj)
         if (SCM_INTP(obj))  return SCM_CLASS_INTEGER;
         if (SCM_EOFP(obj))  return SCM_CLASS_EOF_OBJECT;
         if (SCM_UNDEFINEDP(obj)) return SCM_CLASS_UNDEFINED_OBJECT;
+        if (SCM_STRING_CURSOR_SMALL_P(obj)) return SCM_CLASS_STRING_CURSOR;
         else return SCM_CLASS_UNKNOWN;
     }
     if (SCM_FLONUMP(obj)) return SCM_CLASS_REAL;
@@ -725,6 +743,7 @@ static void class_accessors_set(ScmClass *klass, ScmObj val)
                       SCM_CAR(vp));
     }
     klass->accessors = val;
+    flush_slot_accessor_cache(klass);
 }
 
 static ScmObj class_numislots(ScmClass *klass)
@@ -1005,6 +1024,7 @@ void Scm_StartClassRedefinition(ScmClass *klass)
 
     /* Allow modification of important slots */
     Scm_ClassMalleableSet(klass, TRUE);
+    invalidate_dispatch_cache();
 }
 
 /* %commit-class-redefinition klass newklass */
@@ -1030,6 +1050,7 @@ void Scm_CommitClassRedefinition(ScmClass *klass, ScmObj newklass)
         (void)SCM_INTERNAL_COND_BROADCAST(klass->cv);
     }
     (void)SCM_INTERNAL_MUTEX_UNLOCK(klass->mutex);
+    invalidate_dispatch_cache();
 
     /* Decrement the recursive global lock. */
     unlock_class_redefinition(vm);
@@ -1345,6 +1366,46 @@ ScmObj Scm_VMSlotInitializeUsingAccessor(ScmObj obj,
     Scm_VMApply(SCM_OBJ(&Scm_GenericSlotMissing),       \
                 SCM_LIST4(SCM_OBJ(klass), obj, slot, val))
 
+/* Slot accessor cache
+ *
+ *  Slot-ref and slot-set! mostly appear with a constant slot name, applied
+ *  to instances of a handful of classes, so we keep a global direct-mapped
+ *  cache from (class, slot name) to the slot accessor, instead of scanning
+ *  the accessors alist every time.
+ *
+ *  A class never changes its slot layout once initialized---redefinition
+ *  creates a new class object---so the class pointer itself serves as the
+ *  guard.  The only way to change the accessors of an existing class is
+ *  through its (malleable) accessors slot, whose setter flushes the entries
+ *  of the class.  Each entry is immutable and replaced by a single pointer
+ *  store, so the lookup doesn't need a lock.
+ */
+
+#define SLOT_ACCESSOR_CACHE_SIZE 256   /* need to be 2^n */
+
+typedef struct slot_accessor_cache_entry_rec {
+    ScmClass *klass;
+    ScmObj slot;
+    ScmSlotAccessor *sa;
+} slot_accessor_cache_entry;
+
+static struct {
+    int dummy;
+    slot_accessor_cache_entry *entries[SLOT_ACCESSOR_CACHE_SIZE];
+} slot_accessor_cache = { 1 };  /* magic to put this in .data area */
+
+#define SLOT_ACCESSOR_HASH(klass, slot)                                 \
+    ((((SCM_WORD(klass)>>3) ^ (SCM_WORD(slot)>>3)) * 2654435761UL >> 16) \
+     % SLOT_ACCESSOR_CACHE_SIZE)
+
+static void flush_slot_accessor_cache(ScmClass *klass)
+{
+    for (int i=0; i<SLOT_ACCESSOR_CACHE_SIZE; i++) {
+        slot_accessor_cache_entry *e = slot_accessor_cache.entries[i];
+        if (e && e->klass == klass) slot_accessor_cache.entries[i] = NULL;
+    }
+}
+
 /* GET-SLOT-ACCESSOR
  *
  * (define (get-slot-accessor class slot)
@@ -1353,11 +1414,24 @@ ScmObj Scm_VMSlotInitializeUsingAccessor(ScmObj obj,
  */
 ScmSlotAccessor *Scm_GetSlotAccessor(ScmClass *klass, ScmObj slot)
 {
+    u_long h = SLOT_ACCESSOR_HASH(klass, slot);
+    slot_accessor_cache_entry *e = slot_accessor_cache.entries[h];
+    if (e && e->klass == klass && SCM_EQ(e->slot, slot)) return e->sa;
+
     ScmObj p = Scm_Assq(slot, klass->accessors);
     if (!SCM_PAIRP(p)) return NULL;
     if (!SCM_XTYPEP(SCM_CDR(p), SCM_CLASS_SLOT_ACCESSOR))
         Scm_Error("slot accessor information of class %S, slot %S is screwed up.",
                   SCM_OBJ(klass), slot);
+
+    /* Don't cache while the class can be modified. */
+    if (!SCM_CLASS_MALLEABLE_P(klass)) {
+        e = SCM_NEW(slot_accessor_cache_entry);
+        e->klass = klass;
+        e->slot = slot;
+        e->sa = SCM_SLOT_ACCESSOR(SCM_CDR(p));
+        slot_accessor_cache.entries[h] = e;
+    }
     return SCM_SLOT_ACCESSOR(SCM_CDR(p));
 }
 
@@ -2010,6 +2084,10 @@ static ScmObj generic_allocate(ScmClass *klass, ScmObj initargs)
     gf->data = NULL;
     gf->maxReqargs = 0;
     (void)SCM_INTERNAL_MUTEX_INIT(gf->lock);
+    for (int i=0; i<SCM_GENERIC_DISPATCH_CACHE_SIZE; i++) {
+        gf->dispatchCache[i] = NULL;
+    }
+    gf->dispatchNext = 0;
     return SCM_OBJ(gf);
 }
 
@@ -2064,6 +2142,7 @@ static void generic_methods_set(ScmGeneric *gf, ScmObj val)
     gf->methods = val;
     gf->maxReqargs = reqs;
     (void)SCM_INTERNAL_MUTEX_UNLOCK(gf->lock);
+    invalidate_dispatch_cache();
 }
 
 /* Make base generic function from C */
@@ -2287,6 +2366,89 @@ ScmObj Scm_SortMethods(ScmObj methods, ScmObj *argv, int argc)
     return Scm_ArrayToList(array, len);
 }
 
+/*
+ * Dispatch cache
+ *
+ *  Computing and sorting applicable methods on every generic function
+ *  call is expensive, while most call sites see the same few argument
+ *  classes over and over.  The result only depends on the number of
+ *  arguments and the classes of the first gf->maxReqargs arguments,
+ *  so each generic function keeps a small cache keyed by them.
+ *
+ *  An entry is never modified once it is stored, so the VM can look up
+ *  the cache without locking.  Entries are stamped with the dispatch
+ *  epoch read _before_ the methods were computed; if the method set
+ *  changes in the meantime, the stamp is already stale.
+ *
+ *  Only the "pure" dispatch path in VM uses the cache; generic functions
+ *  with customized compute-applicable-methods go through apply-generic
+ *  and aren't affected.
+ */
+
+#define DISPATCH_CACHE_MAX_ARGS  4  /* don't cache if more args matter */
+
+typedef struct dispatch_cache_entry_rec {
+    u_long epoch;
+    int argc;
+    int nsel;                   /* # of classes in the key */
+    ScmObj methods;             /* sorted applicable methods */
+    ScmClass *classes[DISPATCH_CACHE_MAX_ARGS];
+} dispatch_cache_entry;
+
+u_long Scm__GenericDispatchEpoch(void)
+{
+    return dispatch_epoch.epoch;
+}
+
+ScmObj Scm__GenericDispatchCacheLookup(ScmGeneric *gf, ScmObj *argv, int argc)
+{
+    ScmClass *typev[DISPATCH_CACHE_MAX_ARGS];
+    u_long epoch = dispatch_epoch.epoch;
+    int nsel = (argc < gf->maxReqargs)? argc : gf->maxReqargs;
+
+    if (nsel > DISPATCH_CACHE_MAX_ARGS) return SCM_FALSE;
+    for (int i=0; i<nsel; i++) typev[i] = Scm_ClassOf(argv[i]);
+
+    for (int i=0; i<SCM_GENERIC_DISPATCH_CACHE_SIZE; i++) {
+        dispatch_cache_entry *e = (dispatch_cache_entry*)gf->dispatchCache[i];
+        if (e == NULL) break;
+        if (e->epoch != epoch || e->argc != argc || e->nsel != nsel) continue;
+        int j = 0;
+        for (; j<nsel; j++) {
+            if (e->classes[j] != typev[j]) break;
+        }
+        if (j == nsel) return e->methods;
+    }
+    return SCM_FALSE;
+}
+
+void Scm__GenericDispatchCacheStore(ScmGeneric *gf, ScmObj *argv, int argc,
+                                    u_long epoch, ScmObj methods)
+{
+    int nsel = (argc < gf->maxReqargs)? argc : gf->maxReqargs;
+    if (nsel > DISPATCH_CACHE_MAX_ARGS) return;
+
+    dispatch_cache_entry *e = SCM_NEW(dispatch_cache_entry);
+    e->epoch = epoch;
+    e->argc = argc;
+    e->nsel = nsel;
+    e->methods = methods;
+    for (int i=0; i<nsel; i++) e->classes[i] = Scm_ClassOf(argv[i]);
+
+    /* Reuse a stale entry if any; otherwise replace in round-robin.
+       Races among threads may lose an entry, but that's harmless. */
+    int k = gf->dispatchNext;
+    for (int i=0; i<SCM_GENERIC_DISPATCH_CACHE_SIZE; i++) {
+        dispatch_cache_entry *ee = (dispatch_cache_entry*)gf->dispatchCache[i];
+        if (ee == NULL || ee->epoch != dispatch_epoch.epoch) {
+            k = i;
+            break;
+        }
+    }
+    gf->dispatchCache[k] = e;
+    gf->dispatchNext = (k+1) % SCM_GENERIC_DISPATCH_CACHE_SIZE;
+}
+
 /*=====================================================================
  * Method
  */
@@ -2453,6 +2615,7 @@ ScmObj Scm_UpdateDirectMethod(ScmMethod *m, ScmClass *old, ScmClass *newc)
     if (SCM_FALSEP(Scm_Memq(SCM_OBJ(m), newc->directMethods))) {
         newc->directMethods = Scm_Cons(SCM_OBJ(m), newc->directMethods);
     }
+    invalidate_dispatch_cache();
     return SCM_OBJ(m);
 }
 
@@ -2520,6 +2683,7 @@ ScmObj Scm_AddMethod(ScmGeneric *gf, ScmMethod *method)
         gf->maxReqargs = reqs;
     }
     (void)SCM_INTERNAL_MUTEX_UNLOCK(gf->lock);
+    invalidate_dispatch_cache();
     return SCM_UNDEFINED;
 }
 
@@ -2569,6 +2733,7 @@ ScmObj Scm_DeleteMethod(ScmGeneric *gf, ScmMethod *method)
         }
     }
     (void)SCM_INTERNAL_MUTEX_UNLOCK(gf->lock);
+    invalidate_dispatch_cache();
     return SCM_UNDEFINED;
 }
 
@@ -2641,6 +2806,12 @@ static ScmObj accessor_get_proc(ScmNextMethod *nm, ScmObj *argv, int argc,
         /* fallback to a normal protocol */
         return Scm_VMSlotRef(obj, ca->name, FALSE);
     }
+    /* Plain instance slot.  The layout of a class is fixed, so we can
+       fetch the value directly. */
+    if (ca->getter == NULL && ca->slotNumber >= 0) {
+        ScmObj v = SCM_INSTANCE_SLOTS(obj)[ca->slotNumber];
+        if (!(SCM_UNBOUNDP(v) || SCM_UNDEFINEDP(v))) return v;
+    }
     /* Standard path.  We can skip searching the slot, so it is faster. */
     return slot_ref_using_accessor(obj, ca, FALSE);
 }
@@ -2655,6 +2826,10 @@ static ScmObj accessor_set_proc(ScmNextMethod *nm, ScmObj *argv, int argc,
     if (!SCM_EQ(Scm_ClassOf(obj), ca->klass)) {
         return Scm_VMSlotSet(obj, ca->name, val);
     }
+    if (ca->setter == NULL && ca->slotNumber >= 0) {
+        SCM_INSTANCE_SLOTS(obj)[ca->slotNumber] = val;
+        return SCM_UNDEFINED;
+    }
     return slot_set_using_accessor(obj, ca, val);
 }
 
@@ -3076,6 +3251,7 @@ static void init_class(ScmClass *klass,
     }
     klass->slots = slots;
     klass->accessors = acc;
+    flush_slot_accessor_cache(klass);
 }
 
 /*
@@ -3186,6 +3362,7 @@ void Scm__InitClass(void)
     key_body = SCM_MAKE_KEYWORD("body");
 
     (void)SCM_INTERNAL_MUTEX_INIT(class_redefinition_lock.mutex);
+    (void)SCM_INTERNAL_MUTEX_INIT(dispatch_epoch.mutex);
     (void)SCM_INTERNAL_COND_INIT(class_redefinition_lock.cv);
 
     /* booting class metaobject */
@@ -3280,6 +3457,8 @@ void Scm__InitClass(void)
     /* string.c */
     CINIT(SCM_CLASS_STRING,           "<string>");
     CINIT(SCM_CLASS_STRING_POINTER,   "<string-pointer>");
+    CINIT(SCM_CLASS_STRING_CURSOR,    "<string-cursor>");
+    CINIT(SCM_CLASS_STRING_SEARCHER,  "<string-searcher>");
 
     /* symbol.c */
     CINIT(SCM_CLASS_SYMBOL,           "<symbol>");
@@ -3295,6 +3474,7 @@ void Scm__InitClass(void)
     /* vector.c */
     CINIT(SCM_CLASS_VECTOR,           "<vector>");
     CINIT(SCM_CLASS_UVECTOR,          "<uvector>");
+    CINIT(SCM_CLASS_BITVECTOR,        "<bitvector>");
     CINIT(SCM_CLASS_S8VECTOR,         "<s8vector>");
     CINIT(SCM_CLASS_U8VECTOR,         "<u8vector>");
     CINIT(SCM_CLASS_S16VECTOR,        "<s16vector>");
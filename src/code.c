@@ -37,8 +37,12 @@
 #include "gauche/code.h"
 #include "gauche/vminsn.h"
 #include "gauche/priv/codeP.h"
+#include "gauche/priv/macroP.h"
+#include "gauche/regexp.h"
 #include "gauche/priv/builtin-syms.h"
 
+static ScmObj pack_debug_info(ScmObj info);
+
 /*===============================================================
  * NVM related stuff
  */
@@ -137,11 +141,12 @@ void Scm_CompiledCodeDump(ScmCompiledCode *cc)
     print_header("main_code", SCM_MAKE_STR(""), cc);
     do {
         ScmWord *p = cc->code;
+        ScmObj debugInfo = Scm_CompiledCodeDebugInfo(cc);
         Scm_Printf(SCM_CUROUT, "signatureInfo: %S\n", cc->signatureInfo);
         for (int i=0; i < cc->codeSize; i++) {
             ScmWord insn = p[i];
             ScmPort *out = SCM_PORT(Scm_MakeOutputStringPort(TRUE));
-            ScmObj info = Scm_Assq(SCM_MAKE_INT(i), cc->debugInfo);
+            ScmObj info = Scm_Assq(SCM_MAKE_INT(i), debugInfo);
             u_int code = SCM_VM_INSN_CODE(insn);
             const char *insn_name = Scm_VMInsnName(code);
 
@@ -297,6 +302,48 @@ static ScmObj check_lifted_closure(ScmWord *p, ScmObj lifted)
     return lifted;
 }
 
+/*------------------------------------------------------------------
+ * Literal pool
+ *
+ *   Each compiled code keeps its own constants, so the same string
+ *   literal appearing in a hundred procedures costs a hundred strings.
+ *   The builder and the code cache reader pass the operands through
+ *   intern_literal, which returns the one that is already in the pool if
+ *   there's an equal one.  The pool is weak, so it doesn't keep literals
+ *   of the code that is gone.
+ *
+ *   Only the literals that can't be told apart from their copies except
+ *   by eq? are shared: immutable strings and heap-allocated numbers.
+ *   Zero flonums are excluded, since 0.0 and -0.0 are equal?, and so
+ *   are NaNs, which never match anyway.
+ */
+
+static struct {
+    ScmWeakHashTable *table;    /* literal -> literal, both weak */
+    ScmInternalMutex mutex;
+} literals;
+
+static int literal_shareable(ScmObj obj)
+{
+    if (SCM_STRINGP(obj)) return SCM_STRING_IMMUTABLE_P(obj);
+    if (SCM_BIGNUMP(obj) || SCM_RATNUMP(obj)) return TRUE;
+    if (SCM_FLONUMP(obj)) {
+        double d = SCM_FLONUM_VALUE(obj);
+        return (d != 0.0 && d == d);
+    }
+    return FALSE;
+}
+
+static ScmObj intern_literal(ScmObj obj)
+{
+    if (!literal_shareable(obj)) return obj;
+    ScmObj r;
+    SCM_INTERNAL_MUTEX_SAFE_LOCK_BEGIN(literals.mutex);
+    r = Scm_WeakHashTableSet(literals.table, obj, obj, SCM_DICT_NO_OVERWRITE);
+    SCM_INTERNAL_MUTEX_SAFE_LOCK_END();
+    return r;
+}
+
 /*------------------------------------------------------------------
  * Builder - used by the new compiler
  */
@@ -441,22 +488,26 @@ static void cc_builder_flush(cc_builder *b)
                                  b->labelRefs);
         cc_builder_add_word(b, SCM_WORD(0)); /* dummy */
         break;
-    case SCM_VM_OPERAND_OBJ:;
+    case SCM_VM_OPERAND_OBJ:
+        b->currentOperand = intern_literal(b->currentOperand);
+        /* FALLTHROUGH */
     case SCM_VM_OPERAND_CODES:
         cc_builder_add_word(b, SCM_WORD(b->currentOperand));
         cc_builder_add_constant(b, b->currentOperand);
         break;
-    case SCM_VM_OPERAND_OBJ_ADDR:
+    case SCM_VM_OPERAND_OBJ_ADDR: {
         /* operand would be given as a list of (OBJ LABEL). */
         SCM_ASSERT(SCM_PAIRP(b->currentOperand)
                    && SCM_PAIRP(SCM_CDR(b->currentOperand)));
-        cc_builder_add_word(b, SCM_WORD(SCM_CAR(b->currentOperand)));
-        cc_builder_add_constant(b, SCM_CAR(b->currentOperand));
+        ScmObj obj = intern_literal(SCM_CAR(b->currentOperand));
+        cc_builder_add_word(b, SCM_WORD(obj));
+        cc_builder_add_constant(b, obj);
         b->labelRefs = Scm_Acons(SCM_CADR(b->currentOperand),
                                  SCM_MAKE_INT(b->currentIndex),
                                  b->labelRefs);
         cc_builder_add_word(b, SCM_WORD(0)); /* dummy */
         break;
+    }
     case SCM_VM_OPERAND_CODE:
         if (!SCM_COMPILED_CODE_P(b->currentOperand)) goto badoperand;
         cc_builder_add_word(b, SCM_WORD(b->currentOperand));
@@ -627,7 +678,11 @@ void Scm_CompiledCodeFinishBuilder(ScmCompiledCode *cc, int maxstack)
     cc_builder_jumpopt(cc);
 
     /* record debug info */
-    cc->debugInfo = b->debugInfo;
+    if (SCM_VM_COMPILER_FLAG_IS_SET(Scm_VM(), SCM_COMPILE_PACK_SOURCE_INFO)) {
+        cc->debugInfo = pack_debug_info(b->debugInfo);
+    } else {
+        cc->debugInfo = b->debugInfo;
+    }
 
     /* set max stack depth */
     cc->maxstack = maxstack;
@@ -879,6 +934,798 @@ ScmObj Scm_CompiledCodeToList(ScmCompiledCode *cc)
     return h;
 }
 
+/* Replaces the identifiers in the operands of GREF-family instructions
+   with the glocs they're bound to, as the VM does when it first executes
+   them.  Used by Scm_HeapFreeze, so that the forked children won't write
+   into the shared code vectors.  GSET operands are left alone, since
+   the VM checks the binding's mutability when it resolves them.
+   Recurses into the closure bodies in the code.  Returns the number of
+   operands resolved. */
+long Scm_CompiledCodeResolveGlobals(ScmCompiledCode *cc)
+{
+    long count = 0;
+
+    for (u_int i=0; i<(u_int)cc->codeSize; i++) {
+        u_int code = SCM_VM_INSN_CODE(cc->code[i]);
+
+        switch (Scm_VMInsnOperandType(code)) {
+        case SCM_VM_OPERAND_OBJ: {
+            ScmObj v = SCM_OBJ(cc->code[++i]);
+            if (!SCM_IDENTIFIERP(v)) break;
+            switch (code) {
+            case SCM_VM_GREF:
+            case SCM_VM_GREF_PUSH:
+            case SCM_VM_GREF_CALL:
+            case SCM_VM_GREF_TAIL_CALL:
+            case SCM_VM_PUSH_GREF:
+            case SCM_VM_PUSH_GREF_CALL:
+            case SCM_VM_PUSH_GREF_TAIL_CALL: {
+                ScmGloc *g = Scm_IdentifierGlobalBinding(SCM_IDENTIFIER(v));
+                if (g != NULL) {
+                    cc->code[i] = SCM_WORD(g);
+                    count++;
+                }
+                break;
+            }
+            default:
+                /*nothing*/;
+            }
+            break;
+        }
+        case SCM_VM_OPERAND_CODE: {
+            ScmObj c = SCM_OBJ(cc->code[++i]);
+            if (SCM_COMPILED_CODE_P(c)) {
+                count += Scm_CompiledCodeResolveGlobals(SCM_COMPILED_CODE(c));
+            }
+            break;
+        }
+        case SCM_VM_OPERAND_CODES: {
+            ScmObj cp;
+            SCM_FOR_EACH(cp, SCM_OBJ(cc->code[++i])) {
+                if (SCM_COMPILED_CODE_P(SCM_CAR(cp))) {
+                    count += Scm_CompiledCodeResolveGlobals(
+                                 SCM_COMPILED_CODE(SCM_CAR(cp)));
+                }
+            }
+            break;
+        }
+        case SCM_VM_OPERAND_ADDR:
+            i++;
+            break;
+        case SCM_VM_OPERAND_OBJ_ADDR:
+            i += 2;
+            break;
+        }
+    }
+    return count;
+}
+
+/*===========================================================
+ * Serialization for the bytecode cache
+ *
+ *   Scm_CodeCacheWrite writes an object---a compiled code, or a datum
+ *   that appears in it---in a compact binary form, which
+ *   Scm_CodeCacheRead reads back.  It is used by the bytecode cache
+ *   of `load' (see libeval.scm).  The format depends on the word size
+ *   and the VM instruction set, so the cache file must be read by the
+ *   same build of Gauche that wrote it.
+ *
+ *   Not every object can be serialized.  If OBJ contains closures,
+ *   subrs, uninterned symbols, identifiers closed in local environments
+ *   and so on, Scm_CodeCacheWrite writes nothing and returns FALSE.
+ *   The exception is the debug information of compiled code, which we
+ *   write on a best-effort basis; objects we can't write there are
+ *   replaced by their names, or #f.
+ *
+ *   Objects other than symbols, keywords, modules and numbers are
+ *   recorded as they're written, and the second and later occurrences
+ *   are written as back references, so the sharing (including the
+ *   parent links of compiled code) is preserved within one call.
+ */
+
+enum {
+    CC_TAG_WORD       = 'w',    /* fixnum or immediate */
+    CC_TAG_REF        = 'R',    /* back reference */
+    CC_TAG_NUMBER     = 'n',
+    CC_TAG_STRING     = 's',
+    CC_TAG_SYMBOL     = 'y',
+    CC_TAG_KEYWORD    = 'k',
+    CC_TAG_PAIR       = 'p',
+    CC_TAG_EPAIR      = 'e',    /* extended pair */
+    CC_TAG_VECTOR     = 'v',
+    CC_TAG_REGEXP     = 'r',
+    CC_TAG_MODULE     = 'm',
+    CC_TAG_IDENTIFIER = 'i',
+    CC_TAG_GLOC       = 'g',
+    CC_TAG_CODE       = 'c'
+};
+
+typedef struct cc_writer_rec {
+    ScmPort *out;
+    ScmHashCore seen;           /* obj -> index+1 */
+    int count;
+    int failed;
+} cc_writer;
+
+static void cw_obj(cc_writer *w, ScmObj obj, int lenient);
+
+static void cw_uint(cc_writer *w, u_long n)
+{
+    while (n >= 0x80) {
+        Scm_Putb((ScmByte)((n & 0x7f) | 0x80), w->out);
+        n >>= 7;
+    }
+    Scm_Putb((ScmByte)n, w->out);
+}
+
+static void cw_body(cc_writer *w, ScmString *s)
+{
+    const ScmStringBody *b = SCM_STRING_BODY(s);
+    cw_uint(w, SCM_STRING_BODY_SIZE(b));
+    Scm_Putz(SCM_STRING_BODY_START(b), SCM_STRING_BODY_SIZE(b), w->out);
+}
+
+static int cw_module_ok(ScmObj mod)
+{
+    return SCM_SYMBOLP(SCM_MODULE(mod)->name);
+}
+
+/* An identifier we can write must be a toplevel one in a named module. */
+static int cw_identifier_ok(ScmObj obj)
+{
+    while (SCM_IDENTIFIERP(obj)) {
+        ScmIdentifier *id = SCM_IDENTIFIER(obj);
+        if (!SCM_NULLP(id->env)) return FALSE;
+        if (!cw_module_ok(SCM_OBJ(id->module))) return FALSE;
+        obj = id->name;
+    }
+    return SCM_SYMBOLP(obj) && SCM_SYMBOL_INTERNED(obj);
+}
+
+/* Returns FALSE if we can't write OBJ itself.  Its components are
+   checked as they're written. */
+static int cw_writable(ScmObj obj)
+{
+    if (SCM_NUMBERP(obj) || SCM_STRINGP(obj) || SCM_PAIRP(obj)
+        || SCM_VECTORP(obj) || SCM_KEYWORDP(obj)) return TRUE;
+    if (SCM_SYMBOLP(obj)) return SCM_SYMBOL_INTERNED(obj);
+    if (SCM_MODULEP(obj)) return cw_module_ok(obj);
+    if (SCM_IDENTIFIERP(obj)) return cw_identifier_ok(obj);
+    if (SCM_GLOCP(obj)) return cw_module_ok(SCM_OBJ(SCM_GLOC(obj)->module));
+    if (SCM_REGEXPP(obj)) return SCM_STRINGP(SCM_REGEXP(obj)->pattern);
+    if (SCM_COMPILED_CODE_P(obj)) {
+        ScmCompiledCode *cc = SCM_COMPILED_CODE(obj);
+        return (cc->code != NULL && cc->builder == NULL);
+    }
+    return FALSE;
+}
+
+/* What we write in place of an unwritable OBJ in debug info. */
+static ScmObj cw_substitute(ScmObj obj)
+{
+    if (SCM_IDENTIFIERP(obj)) return SCM_OBJ(Scm_UnwrapIdentifier(SCM_IDENTIFIER(obj)));
+    if (SCM_SYNTAXP(obj) && SCM_SYNTAX(obj)->name) {
+        return SCM_OBJ(SCM_SYNTAX(obj)->name);
+    }
+    if (SCM_MACROP(obj) && SCM_MACRO(obj)->name) {
+        return SCM_OBJ(SCM_MACRO(obj)->name);
+    }
+    return SCM_FALSE;
+}
+
+static void cw_code(cc_writer *w, ScmCompiledCode *cc)
+{
+    Scm_Putb(CC_TAG_CODE, w->out);
+    cw_uint(w, cc->requiredArgs);
+    cw_uint(w, cc->optionalArgs);
+    cw_uint(w, cc->maxstack);
+    cw_uint(w, cc->codeSize);
+    cw_obj(w, cc->name, TRUE);
+    cw_obj(w, cc->parent, FALSE);
+    cw_obj(w, cc->intermediateForm, FALSE);
+    cw_obj(w, cc->signatureInfo, TRUE);
+    cw_obj(w, Scm_CompiledCodeDebugInfo(cc), TRUE);
+    /* We don't write the constant vector; it is rebuilt from the operands
+       by the reader. */
+    for (int i=0; i<cc->codeSize && !w->failed; i++) {
+        ScmWord insn = cc->code[i];
+        cw_uint(w, (u_long)insn);
+        switch (Scm_VMInsnOperandType(SCM_VM_INSN_CODE(insn))) {
+        case SCM_VM_OPERAND_OBJ:;
+        case SCM_VM_OPERAND_CODE:;
+        case SCM_VM_OPERAND_CODES:
+            cw_obj(w, SCM_OBJ(cc->code[++i]), FALSE);
+            break;
+        case SCM_VM_OPERAND_ADDR:
+            cw_uint(w, (u_long)((ScmWord*)cc->code[++i] - cc->code));
+            break;
+        case SCM_VM_OPERAND_OBJ_ADDR:
+            cw_obj(w, SCM_OBJ(cc->code[i+1]), FALSE);
+            cw_uint(w, (u_long)((ScmWord*)cc->code[i+2] - cc->code));
+            i += 2;
+            break;
+        }
+    }
+}
+
+static void cw_obj(cc_writer *w, ScmObj obj, int lenient)
+{
+    for (;;) {
+        if (w->failed) return;
+        if (SCM_INTP(obj) || SCM_TAG2(obj) == 3) {
+            ScmWord word = SCM_WORD(obj);
+            Scm_Putb(CC_TAG_WORD, w->out);
+            Scm_Putz((const char*)&word, sizeof(ScmWord), w->out);
+            return;
+        }
+        if (!cw_writable(obj)) {
+            if (!lenient) { w->failed = TRUE; return; }
+            obj = cw_substitute(obj);
+            continue;
+        }
+        if (SCM_NUMBERP(obj)) {
+            Scm_Putb(CC_TAG_NUMBER, w->out);
+            cw_body(w, SCM_STRING(Scm_NumberToString(obj, 10, 0)));
+            return;
+        }
+        if (SCM_SYMBOLP(obj)) {
+            Scm_Putb(CC_TAG_SYMBOL, w->out);
+            cw_body(w, SCM_SYMBOL_NAME(obj));
+            return;
+        }
+        if (SCM_KEYWORDP(obj)) {
+            Scm_Putb(CC_TAG_KEYWORD, w->out);
+            cw_body(w, SCM_KEYWORD_NAME(obj));
+            return;
+        }
+        if (SCM_MODULEP(obj)) {
+            Scm_Putb(CC_TAG_MODULE, w->out);
+            cw_body(w, SCM_SYMBOL_NAME(SCM_MODULE(obj)->name));
+            return;
+        }
+
+        ScmDictEntry *e = Scm_HashCoreSearch(&w->seen, (intptr_t)obj,
+                                             SCM_DICT_CREATE);
+        if (e->value) {
+            Scm_Putb(CC_TAG_REF, w->out);
+            cw_uint(w, (u_long)(e->value - 1));
+            return;
+        }
+        e->value = ++w->count;
+
+        if (SCM_STRINGP(obj)) {
+            const ScmStringBody *b = SCM_STRING_BODY(obj);
+            Scm_Putb(CC_TAG_STRING, w->out);
+            cw_uint(w, SCM_STRING_BODY_FLAGS(b)
+                    & (SCM_STRING_IMMUTABLE|SCM_STRING_INCOMPLETE));
+            cw_uint(w, SCM_STRING_BODY_LENGTH(b));
+            cw_body(w, SCM_STRING(obj));
+            return;
+        }
+        if (SCM_PAIRP(obj)) {
+            if (SCM_EXTENDED_PAIR_P(obj)) {
+                Scm_Putb(CC_TAG_EPAIR, w->out);
+                cw_obj(w, SCM_EXTENDED_PAIR(obj)->attributes, TRUE);
+            } else {
+                Scm_Putb(CC_TAG_PAIR, w->out);
+            }
+            cw_obj(w, SCM_CAR(obj), lenient);
+            obj = SCM_CDR(obj);  /* loop instead of recursion */
+            continue;
+        }
+        if (SCM_VECTORP(obj)) {
+            Scm_Putb(CC_TAG_VECTOR, w->out);
+            cw_uint(w, SCM_VECTOR_SIZE(obj));
+            for (int i=0; i<SCM_VECTOR_SIZE(obj); i++) {
+                cw_obj(w, SCM_VECTOR_ELEMENT(obj, i), lenient);
+            }
+            return;
+        }
+        if (SCM_REGEXPP(obj)) {
+            Scm_Putb(CC_TAG_REGEXP, w->out);
+            cw_uint(w, SCM_REGEXP(obj)->flags & SCM_REGEXP_CASE_FOLD);
+            cw_body(w, SCM_STRING(SCM_REGEXP(obj)->pattern));
+            return;
+        }
+        if (SCM_IDENTIFIERP(obj)) {
+            Scm_Putb(CC_TAG_IDENTIFIER, w->out);
+            cw_obj(w, SCM_OBJ(SCM_IDENTIFIER(obj)->module), FALSE);
+            obj = SCM_IDENTIFIER(obj)->name;
+            continue;
+        }
+        if (SCM_GLOCP(obj)) {
+            Scm_Putb(CC_TAG_GLOC, w->out);
+            cw_obj(w, SCM_OBJ(SCM_GLOC(obj)->module), FALSE);
+            obj = SCM_OBJ(SCM_GLOC(obj)->name);
+            continue;
+        }
+        SCM_ASSERT(SCM_COMPILED_CODE_P(obj));
+        cw_code(w, SCM_COMPILED_CODE(obj));
+        return;
+    }
+}
+
+int Scm_CodeCacheWrite(ScmObj obj, ScmPort *port)
+{
+    cc_writer w;
+    w.out = SCM_PORT(Scm_MakeOutputStringPort(TRUE));
+    Scm_HashCoreInitSimple(&w.seen, SCM_HASH_EQ, 0, NULL);
+    w.count = 0;
+    w.failed = FALSE;
+    cw_obj(&w, obj, FALSE);
+    if (w.failed) return FALSE;
+
+    /* We write the result at once, so that a failure leaves nothing
+       in PORT. */
+    ScmObj s = Scm_GetOutputStringUnsafe(w.out, 0);
+    const ScmStringBody *b = SCM_STRING_BODY(s);
+    Scm_Putz(SCM_STRING_BODY_START(b), SCM_STRING_BODY_SIZE(b), port);
+    return TRUE;
+}
+
+typedef struct cc_reader_rec {
+    ScmPort *in;
+    ScmObj *objs;               /* objects read so far */
+    int count;
+    int size;
+} cc_reader;
+
+static ScmObj cr_obj(cc_reader *r);
+
+static void cr_corrupted(cc_reader *r)
+{
+    Scm_Error("corrupted bytecode cache: %S", Scm_PortName(r->in));
+}
+
+static int cr_byte(cc_reader *r)
+{
+    int b = Scm_Getb(r->in);
+    if (b == EOF) cr_corrupted(r);
+    return b;
+}
+
+static u_long cr_uint(cc_reader *r)
+{
+    u_long n = 0;
+    for (int shift = 0; shift < (int)(sizeof(u_long)*8); shift += 7) {
+        int b = cr_byte(r);
+        n |= (u_long)(b & 0x7f) << shift;
+        if (!(b & 0x80)) return n;
+    }
+    cr_corrupted(r);
+    return 0;                   /* dummy */
+}
+
+static ScmObj cr_body(cc_reader *r, int len, int flags)
+{
+    u_long size = cr_uint(r);
+    char *buf = SCM_NEW_ATOMIC2(char*, size+1);
+    if (size > 0 && (u_long)Scm_Getz(buf, (int)size, r->in) != size) {
+        cr_corrupted(r);
+    }
+    buf[size] = '\0';
+    return Scm_MakeString(buf, (ScmSmallInt)size, len, flags);
+}
+
+/* Reserve the index of the object being read. */
+static int cr_reserve(cc_reader *r)
+{
+    if (r->count == r->size) {
+        int newsize = r->size? r->size*2 : 64;
+        ScmObj *objs = SCM_NEW_ARRAY(ScmObj, newsize);
+        for (int i=0; i<r->count; i++) objs[i] = r->objs[i];
+        r->objs = objs;
+        r->size = newsize;
+    }
+    r->objs[r->count] = SCM_UNDEFINED;
+    return r->count++;
+}
+
+static ScmModule *cr_module(cc_reader *r)
+{
+    ScmObj mod = cr_obj(r);
+    if (!SCM_MODULEP(mod)) cr_corrupted(r);
+    return SCM_MODULE(mod);
+}
+
+static ScmObj cr_code(cc_reader *r, int index)
+{
+    ScmCompiledCode *cc = make_compiled_code();
+    r->objs[index] = SCM_OBJ(cc);
+    cc->requiredArgs = (u_short)cr_uint(r);
+    cc->optionalArgs = (u_short)cr_uint(r);
+    cc->maxstack = (int)cr_uint(r);
+    cc->codeSize = (int)cr_uint(r);
+    cc->name = cr_obj(r);
+    cc->parent = cr_obj(r);
+    cc->intermediateForm = cr_obj(r);
+    cc->signatureInfo = cr_obj(r);
+    cc->debugInfo = cr_obj(r);
+    if (SCM_VM_COMPILER_FLAG_IS_SET(Scm_VM(), SCM_COMPILE_PACK_SOURCE_INFO)) {
+        cc->debugInfo = pack_debug_info(cc->debugInfo);
+    }
+
+    /* The code vector is atomic, so we keep the operands in OPS until
+       we make the constant vector out of them. */
+    ScmObj ops = SCM_NIL;
+    int numOps = 0;
+    ScmWord *code = SCM_NEW_ATOMIC_ARRAY(ScmWord, cc->codeSize);
+    for (int i=0; i<cc->codeSize; i++) {
+        ScmWord insn = (ScmWord)cr_uint(r);
+        u_int c = SCM_VM_INSN_CODE(insn);
+        if (c >= SCM_VM_NUM_INSNS) cr_corrupted(r);
+        code[i] = insn;
+        switch (Scm_VMInsnOperandType(c)) {
+        case SCM_VM_OPERAND_OBJ:;
+        case SCM_VM_OPERAND_CODE:;
+        case SCM_VM_OPERAND_CODES:
+            if (i+1 >= cc->codeSize) cr_corrupted(r);
+            code[++i] = SCM_WORD(intern_literal(cr_obj(r)));
+            if (SCM_PTRP(SCM_OBJ(code[i]))) {
+                ops = Scm_Cons(SCM_OBJ(code[i]), ops);
+                numOps++;
+            }
+            break;
+        case SCM_VM_OPERAND_ADDR: {
+            if (i+1 >= cc->codeSize) cr_corrupted(r);
+            u_long off = cr_uint(r);
+            if (off > (u_long)cc->codeSize) cr_corrupted(r);
+            code[++i] = SCM_WORD(code + off);
+            break;
+        }
+        case SCM_VM_OPERAND_OBJ_ADDR: {
+            if (i+2 >= cc->codeSize) cr_corrupted(r);
+            code[i+1] = SCM_WORD(intern_literal(cr_obj(r)));
+            if (SCM_PTRP(SCM_OBJ(code[i+1]))) {
+                ops = Scm_Cons(SCM_OBJ(code[i+1]), ops);
+                numOps++;
+            }
+            u_long off = cr_uint(r);
+            if (off > (u_long)cc->codeSize) cr_corrupted(r);
+            code[i+2] = SCM_WORD(code + off);
+            i += 2;
+            break;
+        }
+        }
+    }
+    cc->constantSize = numOps;
+    cc->constants = SCM_NEW_ARRAY(ScmObj, numOps);
+    for (int i=0; i<numOps; i++, ops = SCM_CDR(ops)) {
+        cc->constants[i] = SCM_CAR(ops);
+    }
+    cc->code = code;
+    return SCM_OBJ(cc);
+}
+
+static ScmObj cr_obj(cc_reader *r)
+{
+    ScmObj head = SCM_UNBOUND, last = SCM_UNBOUND;
+    ScmObj obj;
+
+    /* Pairs are read in a loop; HEAD is the first pair and LAST is
+       the one whose cdr is being read. */
+    for (;;) {
+        int tag = cr_byte(r);
+        switch (tag) {
+        case CC_TAG_WORD: {
+            ScmWord word;
+            if (Scm_Getz((char*)&word, sizeof(ScmWord), r->in)
+                != sizeof(ScmWord)) cr_corrupted(r);
+            if (!(SCM_INTP(SCM_OBJ(word)) || SCM_TAG2(SCM_OBJ(word)) == 3)) {
+                cr_corrupted(r);
+            }
+            obj = SCM_OBJ(word);
+            break;
+        }
+        case CC_TAG_REF: {
+            u_long k = cr_uint(r);
+            if (k >= (u_long)r->count) cr_corrupted(r);
+            obj = r->objs[k];
+            break;
+        }
+        case CC_TAG_NUMBER:
+            obj = Scm_StringToNumber(SCM_STRING(cr_body(r, -1, 0)), 10, 0);
+            if (SCM_FALSEP(obj)) cr_corrupted(r);
+            break;
+        case CC_TAG_SYMBOL:
+            obj = Scm_Intern(SCM_STRING(cr_body(r, -1, 0)));
+            break;
+        case CC_TAG_KEYWORD:
+            obj = Scm_MakeKeyword(SCM_STRING(cr_body(r, -1, 0)));
+            break;
+        case CC_TAG_MODULE: {
+            ScmObj name = Scm_Intern(SCM_STRING(cr_body(r, -1, 0)));
+            /* The module may be created by a form not yet evaluated. */
+            obj = SCM_OBJ(Scm_FindModule(SCM_SYMBOL(name),
+                                         SCM_FIND_MODULE_CREATE));
+            break;
+        }
+        case CC_TAG_STRING: {
+            int k = cr_reserve(r);
+            int flags = (int)cr_uint(r);
+            int len = (int)cr_uint(r);
+            obj = cr_body(r, len,
+                          flags & (SCM_STRING_IMMUTABLE|SCM_STRING_INCOMPLETE));
+            r->objs[k] = obj;
+            break;
+        }
+        case CC_TAG_PAIR:;
+        case CC_TAG_EPAIR: {
+            int k = cr_reserve(r);
+            ScmObj p = (tag == CC_TAG_EPAIR)
+                ? Scm_ExtendedCons(SCM_NIL, SCM_NIL)
+                : Scm_Cons(SCM_NIL, SCM_NIL);
+            r->objs[k] = p;
+            if (tag == CC_TAG_EPAIR) {
+                SCM_EXTENDED_PAIR(p)->attributes = cr_obj(r);
+            }
+            SCM_SET_CAR(p, cr_obj(r));
+            if (SCM_UNBOUNDP(head)) head = p;
+            else SCM_SET_CDR(last, p);
+            last = p;
+            continue;           /* read cdr */
+        }
+        case CC_TAG_VECTOR: {
+            int k = cr_reserve(r);
+            ScmSmallInt size = (ScmSmallInt)cr_uint(r);
+            obj = Scm_MakeVector(size, SCM_FALSE);
+            r->objs[k] = obj;
+            for (ScmSmallInt i=0; i<size; i++) {
+                SCM_VECTOR_ELEMENT(obj, i) = cr_obj(r);
+            }
+            break;
+        }
+        case CC_TAG_REGEXP: {
+            int k = cr_reserve(r);
+            int flags = (int)cr_uint(r);
+            obj = Scm_RegComp(SCM_STRING(cr_body(r, -1, 0)), flags);
+            r->objs[k] = obj;
+            break;
+        }
+        case CC_TAG_IDENTIFIER: {
+            int k = cr_reserve(r);
+            ScmModule *mod = cr_module(r);
+            obj = Scm_MakeIdentifier(cr_obj(r), mod, SCM_NIL);
+            r->objs[k] = obj;
+            break;
+        }
+        case CC_TAG_GLOC: {
+            int k = cr_reserve(r);
+            ScmModule *mod = cr_module(r);
+            ScmObj name = cr_obj(r);
+            if (!SCM_SYMBOLP(name)) cr_corrupted(r);
+            /* We don't create a binding here, for it may shadow
+               an inherited one. */
+            ScmGloc *g = Scm_FindBinding(mod, SCM_SYMBOL(name), 0);
+            if (g == NULL) cr_corrupted(r);
+            obj = SCM_OBJ(g);
+            r->objs[k] = obj;
+            break;
+        }
+        case CC_TAG_CODE:
+            obj = cr_code(r, cr_reserve(r));
+            break;
+        default:
+            cr_corrupted(r);
+            obj = SCM_UNDEFINED; /* dummy */
+        }
+        if (SCM_UNBOUNDP(head)) return obj;
+        SCM_SET_CDR(last, obj);
+        return head;
+    }
+}
+
+/* Returns EOF if PORT is at the end. */
+ScmObj Scm_CodeCacheRead(ScmPort *port)
+{
+    int b = Scm_Peekb(port);
+    if (b == EOF) return SCM_EOF;
+    cc_reader r;
+    r.in = port;
+    r.objs = NULL;
+    r.count = r.size = 0;
+    return cr_obj(&r);
+}
+
+/*----------------------------------------------------------------------
+ * Packed debug info
+ *
+ *   The debug info keeps the source forms alive, which are often larger
+ *   than the code itself, yet they're looked at only when an error is
+ *   reported or a tool asks for them.  With the compiler flag
+ *   SCM_COMPILE_PACK_SOURCE_INFO (gosh -fpack-source-info), we serialize
+ *   the debug info in the code cache format into an incomplete string,
+ *   whose body is atomic and isn't scanned by GC, and unpack it on demand.
+ *   The unpacked info is an equal copy, except that the objects the
+ *   code cache can't write are replaced as they are in the cache.
+ *
+ *   Everyone should use Scm_CompiledCodeDebugInfo instead of looking
+ *   at cc->debugInfo directly.
+ */
+
+static ScmObj pack_debug_info(ScmObj info)
+{
+    if (!SCM_PAIRP(info)) return info;
+    cc_writer w;
+    w.out = SCM_PORT(Scm_MakeOutputStringPort(TRUE));
+    Scm_HashCoreInitSimple(&w.seen, SCM_HASH_EQ, 0, NULL);
+    w.count = 0;
+    w.failed = FALSE;
+    cw_obj(&w, info, TRUE);
+    if (w.failed) return info;
+    return Scm_TakeOutputString(w.out,
+                                SCM_STRING_INCOMPLETE|SCM_STRING_IMMUTABLE);
+}
+
+ScmObj Scm_CompiledCodeDebugInfo(ScmCompiledCode *cc)
+{
+    if (!SCM_STRINGP(cc->debugInfo)) return cc->debugInfo;
+    cc_reader r;
+    r.in = SCM_PORT(Scm_MakeInputStringPort(SCM_STRING(cc->debugInfo), TRUE));
+    r.objs = NULL;
+    r.count = r.size = 0;
+    return cr_obj(&r);
+}
+
+/*----------------------------------------------------------------------
+ * Memory usage
+ *
+ *   Scm_CompiledCodeMemoryUsage counts the compiled code reachable from
+ *   ROOTS, a list of glocs, closures, generic functions, methods and
+ *   compiled code, including the nested code in their operands.
+ *   Returns a list of (<number of codes> <code bytes> <constant bytes>
+ *   <debug info bytes>).  Code bytes are the code headers and vectors,
+ *   constant bytes are the constant vectors and the pairs, vectors and
+ *   strings of the literals, and debug info bytes are the debug and
+ *   signature info, with the source forms they refer to.  An object
+ *   reachable from more than one code is counted once.  The numbers
+ *   are approximate; we don't count the allocator's overhead, nor
+ *   symbols and identifiers, which are shared with the rest of the system.
+ *   Used by code-memory-usage (lib/gauche/vm/profiler.scm).
+ */
+
+typedef struct code_usage_rec {
+    ScmHashCore seen;           /* objects already counted */
+    ScmObj pending;             /* compiled code to visit */
+    u_long codes;
+    u_long codeBytes;
+    u_long constantBytes;
+    u_long infoBytes;
+} code_usage;
+
+static int cu_first_visit(code_usage *u, ScmObj obj)
+{
+    ScmDictEntry *e = Scm_HashCoreSearch(&u->seen, (intptr_t)obj,
+                                         SCM_DICT_CREATE);
+    if (e->value) return FALSE;
+    e->value = 1;
+    return TRUE;
+}
+
+static void cu_push(code_usage *u, ScmObj obj)
+{
+    if (SCM_GLOCP(obj)) obj = SCM_GLOC(obj)->value;
+    if (SCM_CLOSUREP(obj)) obj = SCM_CLOSURE(obj)->code;
+    if (SCM_GENERICP(obj)) {
+        ScmObj mp;
+        SCM_FOR_EACH(mp, SCM_GENERIC(obj)->methods) cu_push(u, SCM_CAR(mp));
+        return;
+    }
+    if (SCM_METHODP(obj)) {
+        if (SCM_METHOD(obj)->func != NULL) return;
+        obj = SCM_OBJ(SCM_METHOD(obj)->data);
+    }
+    if (SCM_COMPILED_CODE_P(obj) && cu_first_visit(u, obj)) {
+        u->pending = Scm_Cons(obj, u->pending);
+    }
+}
+
+/* Adds the size of the data OBJ to *COUNT. */
+static void cu_datum(code_usage *u, ScmObj obj, u_long *count)
+{
+    for (;;) {
+        if (!SCM_PTRP(obj) || SCM_COMPILED_CODE_P(obj)) return;
+        if (!(SCM_PAIRP(obj) || SCM_STRINGP(obj) || SCM_VECTORP(obj))) return;
+        if (!cu_first_visit(u, obj)) return;
+        if (SCM_PAIRP(obj)) {
+            if (SCM_EXTENDED_PAIR_P(obj)) {
+                *count += sizeof(ScmExtendedPair);
+                cu_datum(u, SCM_EXTENDED_PAIR(obj)->attributes, count);
+            } else {
+                *count += sizeof(ScmPair);
+            }
+            cu_datum(u, SCM_CAR(obj), count);
+            obj = SCM_CDR(obj);
+            continue;
+        }
+        if (SCM_STRINGP(obj)) {
+            *count += sizeof(ScmString)
+                + SCM_STRING_BODY_SIZE(SCM_STRING_BODY(obj));
+            return;
+        }
+        *count += sizeof(ScmVector) + SCM_VECTOR_SIZE(obj)*sizeof(ScmObj);
+        for (ScmSmallInt i=0; i<SCM_VECTOR_SIZE(obj); i++) {
+            cu_datum(u, SCM_VECTOR_ELEMENT(obj, i), count);
+        }
+        return;
+    }
+}
+
+static void cu_operand(code_usage *u, ScmObj obj)
+{
+    if (SCM_COMPILED_CODE_P(obj)) {
+        cu_push(u, obj);
+    } else if (SCM_PAIRP(obj) && SCM_COMPILED_CODE_P(SCM_CAR(obj))) {
+        ScmObj cp;
+        SCM_FOR_EACH(cp, obj) cu_push(u, SCM_CAR(cp));
+    } else {
+        cu_datum(u, obj, &u->constantBytes);
+    }
+}
+
+static void cu_code(code_usage *u, ScmCompiledCode *cc)
+{
+    u->codes++;
+    u->codeBytes += sizeof(ScmCompiledCode) + cc->codeSize*sizeof(ScmWord);
+    u->constantBytes += cc->constantSize*sizeof(ScmObj);
+    cu_datum(u, cc->debugInfo, &u->infoBytes);
+    cu_datum(u, cc->signatureInfo, &u->infoBytes);
+    if (cc->code == NULL) return;
+    for (int i=0; i<cc->codeSize; i++) {
+        switch (Scm_VMInsnOperandType(SCM_VM_INSN_CODE(cc->code[i]))) {
+        case SCM_VM_OPERAND_OBJ:;
+        case SCM_VM_OPERAND_CODE:;
+        case SCM_VM_OPERAND_CODES:
+            cu_operand(u, SCM_OBJ(cc->code[++i]));
+            break;
+        case SCM_VM_OPERAND_ADDR:
+            i++;
+            break;
+        case SCM_VM_OPERAND_OBJ_ADDR:
+            cu_operand(u, SCM_OBJ(cc->code[i+1]));
+            i += 2;
+            break;
+        }
+    }
+}
+
+ScmObj Scm_CompiledCodeMemoryUsage(ScmObj roots)
+{
+    code_usage u;
+    Scm_HashCoreInitSimple(&u.seen, SCM_HASH_EQ, 0, NULL);
+    u.pending = SCM_NIL;
+    u.codes = u.codeBytes = u.constantBytes = u.infoBytes = 0;
+
+    ScmObj rp;
+    SCM_FOR_EACH(rp, roots) cu_push(&u, SCM_CAR(rp));
+    while (SCM_PAIRP(u.pending)) {
+        ScmObj cc = SCM_CAR(u.pending);
+        u.pending = SCM_CDR(u.pending);
+        cu_code(&u, SCM_COMPILED_CODE(cc));
+    }
+    return SCM_LIST4(Scm_MakeIntegerU(u.codes),
+                     Scm_MakeIntegerU(u.codeBytes),
+                     Scm_MakeIntegerU(u.constantBytes),
+                     Scm_MakeIntegerU(u.infoBytes));
+}
+
+/* FNV-1a hash of the rest of the content of PORT.  Used as the content
+   digest of the source file. */
+ScmObj Scm_CodeCacheDigest(ScmPort *port)
+{
+    char buf[4096];
+    ScmUInt64 h = 0xcbf29ce484222325ULL;
+    for (;;) {
+        int n = Scm_Getz(buf, sizeof(buf), port);
+        if (n <= 0) break;
+        for (int i=0; i<n; i++) {
+            h ^= (u_char)buf[i];
+            h *= 0x100000001b3ULL;
+        }
+    }
+    return Scm_MakeIntegerU64(h);
+}
+
 /*===========================================================
  * VM Instruction introspection
  */
@@ -984,3 +1831,16 @@ ScmWord Scm_VMInsnBuild(ScmObj obj)
     return 0;       /* dummy */
 }
 
+
+/*===========================================================
+ * Initialization
+ */
+
+void Scm__InitCode(void)
+{
+    literals.table =
+        SCM_WEAK_HASH_TABLE(Scm_MakeWeakHashTableSimple(SCM_HASH_EQUAL,
+                                                        SCM_WEAK_BOTH,
+                                                        0, SCM_UNBOUND));
+    SCM_INTERNAL_MUTEX_INIT(literals.mutex);
+}
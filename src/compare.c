@@ -32,9 +32,11 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #define LIBGAUCHE_BODY
 #include "gauche.h"
 #include "gauche/class.h"
+#include "gauche/priv/sortP.h"
 
 /*
  * Comparator
@@ -259,6 +261,262 @@ int Scm_Compare(ScmObj x, ScmObj y)
     else return 1;
 }
 
+/*
+ * Kernels for homogeneous keys
+ *
+ *  Most sorts called without a comparison function have all keys of
+ *  a single type.  For fixnums, flonums, strings and interned symbols
+ *  we can compare inline, and fixnums can even be sorted without any
+ *  comparison by radix sort.  Uniform vectors are sorted by radix sort
+ *  on the bit pattern of the elements.
+ *
+ *  The orderings of keys are defined in gauche/priv/sortP.h.
+ */
+
+#define SMALL_SORT_THRESHOLD 16
+
+/* Introsort with an inlined comparison, for unstable sort of ScmObj
+   arrays.  Median-of-three pivot, insertion sort for small partitions,
+   and heapsort when the recursion gets too deep. */
+#define DEFINE_INTRO_SORT(name, LESS)                                   \
+static void SCM_CPP_CAT(name, _heap)(ScmObj *a, int n)                  \
+{                                                                       \
+    for (int s = n/2-1, end = n; ; ) {                                  \
+        int root = s;                                                   \
+        ScmObj v = a[root];                                             \
+        for (;;) {                                                      \
+            int c = root*2+1;                                           \
+            if (c >= end) break;                                        \
+            if (c+1 < end && LESS(a[c], a[c+1])) c++;                   \
+            if (!LESS(v, a[c])) break;                                  \
+            a[root] = a[c];                                             \
+            root = c;                                                   \
+        }                                                               \
+        a[root] = v;                                                    \
+        if (s > 0) { s--; continue; }                                   \
+        if (--end <= 0) break;                                          \
+        ScmObj t = a[0]; a[0] = a[end]; a[end] = t;                     \
+    }                                                                   \
+}                                                                       \
+                                                                        \
+static void name(ScmObj *a, int n, int depth)                           \
+{                                                                       \
+    while (n > SMALL_SORT_THRESHOLD) {                                  \
+        if (depth-- <= 0) {                                             \
+            SCM_CPP_CAT(name, _heap)(a, n);                             \
+            return;                                                     \
+        }                                                               \
+        int m = n/2;                                                    \
+        ScmObj t;                                                       \
+        if (LESS(a[m], a[0]))   { t = a[m]; a[m] = a[0]; a[0] = t; }    \
+        if (LESS(a[n-1], a[m])) {                                       \
+            t = a[m]; a[m] = a[n-1]; a[n-1] = t;                        \
+            if (LESS(a[m], a[0])) { t = a[m]; a[m] = a[0]; a[0] = t; }  \
+        }                                                               \
+        ScmObj pivot = a[m];                                            \
+        int l = 0, r = n-1;                                             \
+        for (;;) {                                                      \
+            while (LESS(a[l], pivot)) l++;                              \
+            while (LESS(pivot, a[r])) r--;                              \
+            if (l >= r) break;                                          \
+            t = a[l]; a[l] = a[r]; a[r] = t;                            \
+            l++; r--;                                                   \
+        }                                                               \
+        /* recurse into the smaller half, loop on the larger */         \
+        if (r+1 < n-r-1) {                                              \
+            name(a, r+1, depth);                                        \
+            a += r+1; n -= r+1;                                         \
+        } else {                                                        \
+            name(a+r+1, n-r-1, depth);                                  \
+            n = r+1;                                                    \
+        }                                                               \
+    }                                                                   \
+    for (int i=1; i<n; i++) {                                           \
+        ScmObj v = a[i];                                                \
+        int j = i;                                                      \
+        for (; j > 0 && LESS(v, a[j-1]); j--) a[j] = a[j-1];            \
+        a[j] = v;                                                       \
+    }                                                                   \
+}
+
+DEFINE_INTRO_SORT(intro_sort_flonum, LESS_FLONUM)
+DEFINE_INTRO_SORT(intro_sort_string, LESS_STRING)
+DEFINE_INTRO_SORT(intro_sort_symbol, LESS_SYMBOL)
+
+/* A record for stable sort by keys. */
+typedef struct {
+    ScmObj key;
+    ScmObj elt;
+} sort_rec;
+
+/* Bottom-up merge sort of records, which is stable.  Runs of
+   SMALL_SORT_THRESHOLD records are sorted by insertion sort first. */
+#define DEFINE_MERGE_SORT(name, LESS)                                   \
+static void name(sort_rec *a, int n)                                   \
+{                                                                       \
+    for (int lo=0; lo<n; lo+=SMALL_SORT_THRESHOLD) {                    \
+        int hi = (lo+SMALL_SORT_THRESHOLD < n)? lo+SMALL_SORT_THRESHOLD:n;\
+        for (int i=lo+1; i<hi; i++) {                                   \
+            sort_rec v = a[i];                                          \
+            int j = i;                                                  \
+            for (; j > lo && LESS(v.key, a[j-1].key); j--) a[j] = a[j-1];\
+            a[j] = v;                                                   \
+        }                                                               \
+    }                                                                   \
+    if (n <= SMALL_SORT_THRESHOLD) return;                              \
+    sort_rec *src = a, *dst = SCM_NEW_ARRAY(sort_rec, n);               \
+    for (int w=SMALL_SORT_THRESHOLD; w<n; w*=2) {                       \
+        for (int lo=0; lo<n; lo+=w*2) {                                 \
+            int m = (lo+w < n)? lo+w : n;                               \
+            int hi = (m+w < n)? m+w : n;                                \
+            int i = lo, j = m, k = lo;                                  \
+            if (m == hi || !LESS(src[m].key, src[m-1].key)) {           \
+                /* already in order */                                  \
+                memcpy(dst+lo, src+lo, (hi-lo)*sizeof(sort_rec));       \
+                continue;                                               \
+            }                                                           \
+            while (i < m && j < hi) {                                   \
+                if (LESS(src[j].key, src[i].key)) dst[k++] = src[j++];  \
+                else                              dst[k++] = src[i++];  \
+            }                                                           \
+            while (i < m)  dst[k++] = src[i++];                         \
+            while (j < hi) dst[k++] = src[j++];                         \
+        }                                                               \
+        sort_rec *t = src; src = dst; dst = t;                          \
+    }                                                                   \
+    if (src != a) memcpy(a, src, n*sizeof(sort_rec));                   \
+}
+
+DEFINE_MERGE_SORT(merge_sort_fixnum, LESS_FIXNUM)
+DEFINE_MERGE_SORT(merge_sort_flonum, LESS_FLONUM)
+DEFINE_MERGE_SORT(merge_sort_string, LESS_STRING)
+DEFINE_MERGE_SORT(merge_sort_symbol, LESS_SYMBOL)
+DEFINE_MERGE_SORT(merge_sort_generic, LESS_GENERIC)
+
+/* LSD radix sort, 8 bits at a time.  TOKEY maps an element to an
+   unsigned integer of type UT whose order is the one we want.  The
+   digit passes where all keys have the same digit are skipped, so
+   small integers take only a couple of passes.  Being LSD, this is
+   stable.  Elements must not contain pointers, since the work area
+   is allocated atomic. */
+#define DEFINE_RADIX_SORT(name, T, UT, TOKEY)                           \
+static void name(T *a, ScmSmallInt n)                                   \
+{                                                                       \
+    if (n < SMALL_SORT_THRESHOLD*4) {                                   \
+        for (ScmSmallInt i=1; i<n; i++) {                               \
+            T v = a[i];                                                 \
+            UT kv = TOKEY(v);                                           \
+            ScmSmallInt j = i;                                          \
+            for (; j > 0 && kv < TOKEY(a[j-1]); j--) a[j] = a[j-1];     \
+            a[j] = v;                                                   \
+        }                                                               \
+        return;                                                         \
+    }                                                                   \
+    ScmSmallInt count[sizeof(UT)][256];                                 \
+    memset(count, 0, sizeof(count));                                    \
+    for (ScmSmallInt i=0; i<n; i++) {                                   \
+        UT k = TOKEY(a[i]);                                             \
+        for (size_t d=0; d<sizeof(UT); d++) {                           \
+            count[d][(k >> (d*8)) & 0xff]++;                            \
+        }                                                               \
+    }                                                                   \
+    T *src = a, *dst = NULL;                                            \
+    UT k0 = TOKEY(a[0]);                                                \
+    for (size_t d=0; d<sizeof(UT); d++) {                               \
+        if (count[d][(k0 >> (d*8)) & 0xff] == n) continue;              \
+        if (dst == NULL) dst = SCM_NEW_ATOMIC_ARRAY(T, n);              \
+        ScmSmallInt pos = 0;                                            \
+        for (int b=0; b<256; b++) {                                     \
+            ScmSmallInt c = count[d][b];                                \
+            count[d][b] = pos;                                          \
+            pos += c;                                                   \
+        }                                                               \
+        for (ScmSmallInt i=0; i<n; i++) {                               \
+            dst[count[d][(TOKEY(src[i]) >> (d*8)) & 0xff]++] = src[i];  \
+        }                                                               \
+        T *t = src; src = dst; dst = t;                                 \
+    }                                                                   \
+    if (src != a) memcpy(a, src, n*sizeof(T));                          \
+}
+
+
+DEFINE_RADIX_SORT(radix_sort_fixnum, ScmObj, uintptr_t, FIXNUM_KEY)
+DEFINE_RADIX_SORT(radix_sort_s8,  signed char, u_char, S8_KEY)
+DEFINE_RADIX_SORT(radix_sort_u8,  u_char, u_char, U8_KEY)
+DEFINE_RADIX_SORT(radix_sort_s16, short, u_short, S16_KEY)
+DEFINE_RADIX_SORT(radix_sort_u16, u_short, u_short, U16_KEY)
+DEFINE_RADIX_SORT(radix_sort_s32, ScmInt32, ScmUInt32, S32_KEY)
+DEFINE_RADIX_SORT(radix_sort_u32, ScmUInt32, ScmUInt32, U32_KEY)
+DEFINE_RADIX_SORT(radix_sort_s64, ScmInt64, ScmUInt64, S64_KEY)
+DEFINE_RADIX_SORT(radix_sort_u64, ScmUInt64, ScmUInt64, U64_KEY)
+DEFINE_RADIX_SORT(radix_sort_f16, ScmHalfFloat, u_short, F16_KEY)
+DEFINE_RADIX_SORT(radix_sort_f32, float, ScmUInt32, f32_key)
+DEFINE_RADIX_SORT(radix_sort_f64, double, ScmUInt64, f64_key)
+
+/* Returns TRUE if we sorted ELTS with a specialized kernel. */
+static int sort_array_fast(ScmObj *elts, int nelts, int limit)
+{
+    switch (sort_key_kind(elts, nelts, 1)) {
+    case SORT_KEY_FIXNUM: radix_sort_fixnum(elts, nelts); return TRUE;
+    case SORT_KEY_FLONUM: intro_sort_flonum(elts, nelts, limit); return TRUE;
+    case SORT_KEY_STRING: intro_sort_string(elts, nelts, limit); return TRUE;
+    case SORT_KEY_SYMBOL: intro_sort_symbol(elts, nelts, limit); return TRUE;
+    default: return FALSE;
+    }
+}
+
+/* Stable sort of ELTS, using the default compare.  If KEYS is not NULL,
+   it must have the same number of elements as ELTS, and the elements
+   are ordered by the corresponding keys.  KEYS are rearranged as well. */
+void Scm_StableSortArray(ScmObj *elts, ScmObj *keys, int nelts)
+{
+    if (nelts <= 1) return;
+    if (keys == NULL && sort_key_kind(elts, nelts, 1) == SORT_KEY_FIXNUM) {
+        radix_sort_fixnum(elts, nelts); /* radix sort is stable */
+        return;
+    }
+    sort_rec *recs = SCM_NEW_ARRAY(sort_rec, nelts);
+    for (int i=0; i<nelts; i++) {
+        recs[i].key = keys? keys[i] : elts[i];
+        recs[i].elt = elts[i];
+    }
+    switch (sort_key_kind(&recs[0].key, nelts, 2)) {
+    case SORT_KEY_FIXNUM: merge_sort_fixnum(recs, nelts); break;
+    case SORT_KEY_FLONUM: merge_sort_flonum(recs, nelts); break;
+    case SORT_KEY_STRING: merge_sort_string(recs, nelts); break;
+    case SORT_KEY_SYMBOL: merge_sort_symbol(recs, nelts); break;
+    default:              merge_sort_generic(recs, nelts); break;
+    }
+    for (int i=0; i<nelts; i++) {
+        elts[i] = recs[i].elt;
+        if (keys) keys[i] = recs[i].key;
+    }
+}
+
+/* Sort elements of a uniform vector in place, by their numeric values.
+   For floating point vectors, -0.0 comes before 0.0, and NaNs go to
+   the end (or the beginning, if the sign bit is set).
+   The sort is stable, although it hardly matters for numbers. */
+void Scm_UVectorSortX(ScmUVector *v)
+{
+    SCM_UVECTOR_CHECK_MUTABLE(v);
+    ScmSmallInt n = SCM_UVECTOR_SIZE(v);
+    switch (Scm_UVectorType(Scm_ClassOf(SCM_OBJ(v)))) {
+    case SCM_UVECTOR_S8:  radix_sort_s8(SCM_S8VECTOR_ELEMENTS(v), n); break;
+    case SCM_UVECTOR_U8:  radix_sort_u8(SCM_U8VECTOR_ELEMENTS(v), n); break;
+    case SCM_UVECTOR_S16: radix_sort_s16(SCM_S16VECTOR_ELEMENTS(v), n); break;
+    case SCM_UVECTOR_U16: radix_sort_u16(SCM_U16VECTOR_ELEMENTS(v), n); break;
+    case SCM_UVECTOR_S32: radix_sort_s32(SCM_S32VECTOR_ELEMENTS(v), n); break;
+    case SCM_UVECTOR_U32: radix_sort_u32(SCM_U32VECTOR_ELEMENTS(v), n); break;
+    case SCM_UVECTOR_S64: radix_sort_s64(SCM_S64VECTOR_ELEMENTS(v), n); break;
+    case SCM_UVECTOR_U64: radix_sort_u64(SCM_U64VECTOR_ELEMENTS(v), n); break;
+    case SCM_UVECTOR_F16: radix_sort_f16(SCM_F16VECTOR_ELEMENTS(v), n); break;
+    case SCM_UVECTOR_F32: radix_sort_f32(SCM_F32VECTOR_ELEMENTS(v), n); break;
+    case SCM_UVECTOR_F64: radix_sort_f64(SCM_F64VECTOR_ELEMENTS(v), n); break;
+    default: Scm_Error("[internal] bad uvector: %S", v);
+    }
+}
+
 /* NB: It turns out that calling back Scheme funtion from sort routine
    is very inefficient and runs much slower than Scheme version, if
    a Scheme comarison function is given.
@@ -277,6 +535,8 @@ int Scm_Compare(ScmObj x, ScmObj y)
  *  if (x > y), it may return a positive integer or #f.
  *
  * If cmpfn is #f, the first object's default compare method is used.
+ * If all elements are fixnums, flonums, strings or interned symbols,
+ * one of the kernels above is used instead of calling Scm_Compare.
  *
  * Some notes:
  *  - We can't use libc's qsort, since it doesn't pass closure to cmpfn.
@@ -357,7 +617,7 @@ static void sort_q(ScmObj *elts, int lo, int hi, int depth, int limit,
 
 static int cmp_scm(ScmObj x, ScmObj y, ScmObj fn)
 {
-    ScmObj r = Scm_ApplyRec(fn, SCM_LIST2(x, y));
+    ScmObj r = Scm_ApplyRec2(fn, x, y);
     if (SCM_TRUEP(r) || (SCM_INTP(r) && SCM_INT_VALUE(r) < 0))
         return -1;
     else
@@ -377,7 +637,7 @@ void Scm_SortArray(ScmObj *elts, int nelts, ScmObj cmpfn)
     for (i=nelts,limit=1; i > 0; limit++) {i>>=1;}
     if (SCM_PROCEDUREP(cmpfn)) {
         sort_q(elts, 0, nelts-1, 0, limit, cmp_scm, cmpfn);
-    } else {
+    } else if (!sort_array_fast(elts, nelts, limit)) {
         sort_q(elts, 0, nelts-1, 0, limit, cmp_int, NULL);
     }
 }
@@ -203,13 +203,17 @@
 ;;     initval   - initialized value
 ;;     ref-count - in how many places this variable is referefnced?
 ;;     set-count - in how many places this variable is set!
+;;     captured  - #t if this variable is referred from a closure.  Set by
+;;                 pass4/scan.  A mutable lvar needs to be boxed only if
+;;                 it is captured; see lvar-boxed? below.
 ;;
 
 (define-simple-struct lvar 'lvar make-lvar
   (name
    (initval (undefined))
    (ref-count 0)
-   (set-count 0)))
+   (set-count 0)
+   (captured #f)))
 
 (define (make-lvar+ name) ;; procedure version of constructor, for mapping
   (make-lvar name))
@@ -222,6 +226,14 @@
 (define-inline (lvar-immutable? lvar)
   (= (lvar-set-count lvar) 0))
 
+;; Mutable lvars that are captured by closures are boxed, and LREF/LSET
+;; goes through the box.  Other mutable lvars live directly in the env
+;; frame, so that flonums set! to them can stay in flonum registers while
+;; the frame is in the VM stack.  Only valid after pass4/scan.
+(define-inline (lvar-boxed? lvar)
+  (and (not (lvar-immutable? lvar))
+       (lvar-captured lvar)))
+
 ;; Returns IForm if this lvar has initval and it never changes.  Only valid
 ;; after lvar reference counting is done (that is, after pass1, and after
 ;; each reset-lvars call.
@@ -238,7 +250,8 @@
  "#define LVAR_OFFSET_INITVAL    2"
  "#define LVAR_OFFSET_REF_COUNT  3"
  "#define LVAR_OFFSET_SET_COUNT  4"
- "#define LVAR_SIZE              5"
+ "#define LVAR_OFFSET_CAPTURED   5"
+ "#define LVAR_SIZE              6"
 
  ;; Specialized routine for (map (lambda (name) (make-lvar name)) objs)
  (define-cproc %map-make-lvar (names)
@@ -247,7 +260,8 @@
        (let* ([v (Scm_MakeVector LVAR_SIZE '0)])
          (set! (SCM_VECTOR_ELEMENT v LVAR_OFFSET_TAG) 'lvar
                (SCM_VECTOR_ELEMENT v LVAR_OFFSET_NAME) name
-               (SCM_VECTOR_ELEMENT v LVAR_OFFSET_INITVAL) SCM_UNDEFINED)
+               (SCM_VECTOR_ELEMENT v LVAR_OFFSET_INITVAL) SCM_UNDEFINED
+               (SCM_VECTOR_ELEMENT v LVAR_OFFSET_CAPTURED) SCM_FALSE)
          (SCM_APPEND1 h t v)))
      (return h)))
 
@@ -1457,9 +1471,24 @@
                ;; or an unexpected error (compiler bug).
                ($ raise $ make-compound-condition e
                   $ make <compile-error-mixin> :expr program)])
-      (pass5 (pass2-4 (pass1 program cenv) (cenv-module cenv))
-             (make-compiled-code-builder 0 0 '%toplevel #f #f)
-             '() 'tail))))
+      (if (%collect-load-times?)
+        (compile/timed program cenv)
+        (pass5 (pass2-4 (pass1 program cenv) (cenv-module cenv))
+               (make-compiled-code-builder 0 0 '%toplevel #f #f)
+               '() 'tail)))))
+
+;; Same as above, but charges the time of each pass separately for
+;; -ptime-load.  See %with-load-time-phase in libeval.scm.
+(define (compile/timed program cenv)
+  (let* ([iform (%with-load-time-phase 'pass1 (^[] (pass1 program cenv)))]
+         [iform (%with-load-time-phase 'pass2 (^[] (pass2 iform)))]
+         [iform (%with-load-time-phase 'pass3 (^[] (pass3 iform #f)))]
+         [iform (%with-load-time-phase 'pass4
+                                       (^[] (pass4 iform (cenv-module cenv))))])
+    (%with-load-time-phase
+     'pass5 (^[] (pass5 iform
+                        (make-compiled-code-builder 0 0 '%toplevel #f #f)
+                        '() 'tail)))))
 
 ;; stub for future extension
 (define (compile-partial program module) #f)
@@ -1541,9 +1570,37 @@
            (call-syntax-handler gval program cenv)]
           [(inline)
            (pass1/expand-inliner id gval)]
+          [(guarded)
+           (pass1/guarded-inline id gval)]
           )
         (pass1/call program ($gref id) (cdr program) cenv))))
 
+  ;; Inline a small global procedure that isn't declared inlinable (see
+  ;; pass1/mark-small-procedure! below).  Since the binding may be altered
+  ;; later, the inlined body is guarded by checking that the binding still
+  ;; has the procedure we inlined; otherwise we call whatever the binding
+  ;; has.  We don't do this when AOT compiling, for we can't emit
+  ;; a closure as a literal into C code.
+  (define (pass1/guarded-inline id proc)
+    (let ([iform (unpack-iform (%procedure-inliner proc))]
+          [args (cdr program)])
+      (if (or (eqv? (vm-eval-situation) SCM_VM_COMPILING)
+              (not (= (length args) ($lambda-reqargs iform)))
+              (> ($lambda-optarg iform) 0))
+        (pass1/call program ($gref id) args cenv)
+        (let* ([cenv (cenv-sans-name cenv)]
+               [tmps (imap (^_ (make-lvar 'arg)) args)]
+               [iargs (imap (cut pass1 <> cenv) args)])
+          (for-each (^[lv a] (lvar-initval-set! lv a)) tmps iargs)
+          (compile-report 'guarded-inline id program)
+          ($let program 'let tmps iargs
+                ($if program
+                     ($eq? program ($gref id) ($const proc))
+                     (expand-inlined-procedure program iform
+                                               (imap (^[lv] ($lref lv)) tmps))
+                     ($call program ($gref id)
+                            (imap (^[lv] ($lref lv)) tmps))))))))
+
   ;; Expand inlinable procedure.  Inliner may be...
   ;;   - An integer.  This must be the VM instruction number.
   ;;     (It is useful to initialize the inliner statically in .stub file).
@@ -1898,9 +1955,48 @@
        (let1 id (if (identifier? name)
                   (%rename-toplevel-identifier! name)
                   (make-identifier name module '()))
-         ($define oform flags id (pass1 expr cenv))))]
+         ($define oform flags id
+                  (pass1/mark-small-procedure! (pass1 expr cenv)))))]
     [_ (error "syntax-error:" oform)]))
 
+;; If a global procedure is small enough, we attach its packed IForm
+;; to it, just like define-inline does but without marking the binding
+;; inlinable.  Calls to it that are compiled later can inline it with
+;; a guard (see pass1/guarded-inline).
+;; We don't consider procedures that create closures, since inlining
+;; them would lose the identity of constant closures.
+(define (pass1/mark-small-procedure! iform)
+  (when (and (has-tag? iform $LAMBDA)
+             (not ($lambda-flag iform))
+             (= ($lambda-optarg iform) 0)
+             (not (eqv? (vm-eval-situation) SCM_VM_COMPILING))
+             (not (vm-compiler-flag-is-set? SCM_COMPILE_NOINLINE_GLOBALS))
+             (< (iform-count-size-upto ($lambda-body iform)
+                                       SMALL_LAMBDA_SIZE)
+                SMALL_LAMBDA_SIZE)
+             (pass1/closure-free-body? ($lambda-body iform)))
+    ($lambda-flag-set! iform (pack-iform iform)))
+  iform)
+
+(define (pass1/closure-free-body? iform)
+  (define (rec* iforms) (every pass1/closure-free-body? iforms))
+  (case/unquote
+   (iform-tag iform)
+   [($LREF $GREF $CONST $IT) #t]
+   [($LSET)   (pass1/closure-free-body? ($lset-expr iform))]
+   [($GSET)   (pass1/closure-free-body? ($gset-expr iform))]
+   [($IF)     (rec* (list ($if-test iform) ($if-then iform) ($if-else iform)))]
+   [($LET)    (rec* (cons ($let-body iform) ($let-inits iform)))]
+   [($RECEIVE) (rec* (list ($receive-expr iform) ($receive-body iform)))]
+   [($SEQ)    (rec* ($seq-body iform))]
+   [($CALL)   (rec* (cons ($call-proc iform) ($call-args iform)))]
+   [($ASM)    (rec* ($asm-args iform))]
+   [($CONS $APPEND $MEMV $EQ? $EQV?)
+    (rec* (list ($*-arg0 iform) ($*-arg1 iform)))]
+   [($VECTOR $LIST $LIST*) (rec* ($*-args iform))]
+   [($LIST->VECTOR) (pass1/closure-free-body? ($*-arg0 iform))]
+   [else #f]))                          ; $LAMBDA, $PROMISE etc.
+
 (define (%rename-toplevel-identifier! identifier)
   (slot-set! identifier 'name (gensym #"~(identifier->symbol identifier)."))
   identifier)
@@ -1952,6 +2048,8 @@
     (receive (closure closed) (pass1/check-inlinable-lambda iform)
       (cond
        [(and (not closure) (not closed)) ; too complex to inline
+        (compile-report 'no-inline (variable-name name) form
+                        'not-a-lambda-form)
         (pass1/make-inlinable-binding form name iform cenv)]
        [(null? closed)               ; no closed env
         (pass1/mark-closure-inlinable! closure name cenv)
@@ -2054,6 +2152,7 @@
 
 (define (pass1/define-macro form oform module cenv)
   (check-toplevel oform cenv)
+  (%note-compile-effect!)
   (match form
     [(_ (name . formals) body ...)
      (let1 trans
@@ -2073,6 +2172,7 @@
 
 (define-pass1-syntax (define-syntax form cenv) :null
   (check-toplevel form cenv)
+  (%note-compile-effect!)
   ;; Temporary: we use the old compiler's syntax-rules implementation
   ;; for the time being.
   (match form
@@ -2867,6 +2967,7 @@
 
 (define-pass1-syntax (define-module form cenv) :gauche
   (check-toplevel form cenv)
+  (%note-compile-effect!)
   (match form
     [(_ name body ...)
      (let* ([mod (ensure-module name 'define-module #t)]
@@ -2884,6 +2985,7 @@
 
 (define-pass1-syntax (select-module form cenv) :gauche
   (check-toplevel form cenv)
+  (%note-compile-effect!)
   (match form
     [(_ module)
      ;; This is the only construct that changes VM's current module.
@@ -2903,12 +3005,14 @@
   ($const (cenv-module cenv)))
 
 (define-pass1-syntax (export form cenv) :gauche
+  (%note-compile-effect!)
   (%export-symbols (cenv-module cenv) (cdr form))
   ($values0))
 
 (define-pass1-syntax (export-all form cenv) :gauche
   (unless (null? (cdr form))
     (error "syntax-error: malformed export-all:" form))
+  (%note-compile-effect!)
   (%export-all (cenv-module cenv))
   ($values0))
 
@@ -2916,6 +3020,7 @@
   (define (ensure m) (or (find-module m) (error "unknown module" m)))
   (define (symbol-but-not-keyword? x)
     (and (symbol? x) (not (keyword? x))))
+  (%note-compile-effect!)
   (dolist [f (cdr form)]
     (match f
       [((? symbol-but-not-keyword? a) (? symbol-but-not-keyword? b) . r)
@@ -2988,8 +3093,11 @@
     sym))
 
 (define-pass1-syntax (extend form cenv) :gauche
+  (%note-compile-effect!)
   (%extend-module (cenv-module cenv)
-                  (imap (^[m] (or (find-module m)
+                  (imap (^[m] (%note-compile-effect! 'require
+                                                     (module-name->path m))
+                              (or (find-module m)
                                   (begin
                                     (%require (module-name->path m))
                                     (find-module m))
@@ -2999,7 +3107,10 @@
 
 (define-pass1-syntax (require form cenv) :gauche
   (match form
-    [(_ feature) (%require feature) ($values0)]
+    [(_ feature)
+     (%note-compile-effect! 'require feature)
+     (%require feature)
+     ($values0)]
     [_ (error "syntax-error: malformed require:" form)]))
 
 ;; Include .............................................
@@ -3020,6 +3131,7 @@
     (let1 iport (pass1/open-include-file filename (cenv-source-path cenv))
       (port-case-fold-set! iport case-fold?)
       (pass1/report-include iport #t)
+      (%note-compile-effect! 'include (port-name iport))
       (unwind-protect
           ;; This could be written simpler using port->sexp-list, but it would
           ;; trigger autoload and reenters to the compiler.
@@ -3110,6 +3222,7 @@
        (when (and (eqv? situ SCM_VM_COMPILING)
                   (memq :compile-toplevel wlist)
                   (cenv-toplevel? cenv))
+         (%note-compile-effect!)
          (dolist [e expr] (eval e (cenv-module cenv))))
        (if (or (and (eqv? situ SCM_VM_LOADING)
                     (memq :load-toplevel wlist)
@@ -3472,25 +3585,31 @@
 ;;
 
 (define (pass2/optimize-closure lvar lambda-node)
+  (define (report kind . details)
+    (apply compile-report kind (lvar-name lvar) ($lambda-src lambda-node)
+           details))
+  (define (keep-closure reason)
+    (report 'local reason)
+    (pass2/local-call-optimizer lvar lambda-node))
   (when (and (lvar-immutable? lvar)
              (> (lvar-ref-count lvar) 0)
              (has-tag? lambda-node $LAMBDA))
-    (or (and (= (lvar-ref-count lvar) (length ($lambda-calls lambda-node)))
-             (receive (locals recs tail-recs)
-                 (pass2/classify-calls ($lambda-calls lambda-node) lambda-node)
-               (and (null? recs)
-                    (pair? locals)
-                    (or (and (null? (cdr locals))
-                             (pass2/local-call-embedder lvar lambda-node
-                                                        (car locals)
-                                                        tail-recs))
-                        (and (null? tail-recs)
-                             (< (iform-count-size-upto lambda-node
-                                                       SMALL_LAMBDA_SIZE)
-                                SMALL_LAMBDA_SIZE)
-                             (pass2/local-call-inliner lvar lambda-node
-                                                       locals))))))
-        (pass2/local-call-optimizer lvar lambda-node))))
+    (if (= (lvar-ref-count lvar) (length ($lambda-calls lambda-node)))
+      (receive (locals recs tail-recs)
+          (pass2/classify-calls ($lambda-calls lambda-node) lambda-node)
+        (cond [(pair? recs) (keep-closure 'non-tail-recursive-call)]
+              [(null? locals) (keep-closure 'no-local-call)]
+              [(null? (cdr locals))
+               (report 'embed (length tail-recs))
+               (pass2/local-call-embedder lvar lambda-node (car locals)
+                                          tail-recs)]
+              [(pair? tail-recs) (keep-closure 'multiple-calls-to-loop)]
+              [(< (iform-count-size-upto lambda-node SMALL_LAMBDA_SIZE)
+                  SMALL_LAMBDA_SIZE)
+               (report 'inline (length locals))
+               (pass2/local-call-inliner lvar lambda-node locals)]
+              [else (keep-closure 'too-large-to-duplicate)]))
+      (keep-closure 'used-as-value))))
 
 ;; Classify the calls into categories.  TAIL-REC call is classified as
 ;; REC if the call is across the closure boundary.
@@ -3885,6 +4004,8 @@
 ;; folding.  It may further allow pruning of other subtrees.  So, when
 ;; pruning occurs, pass3 records the fact by setting label-dic-info to #t.
 ;; We repeat the pass then.
+;;  Once the tree settles, we run type inference (see below) to drop
+;; the runtime checks we can prove unnecessary.
 
 (define (pass3 iform show?)
   (if (vm-compiler-flag-no-post-inline?)
@@ -3895,7 +4016,7 @@
              [iform. (pass3/rec (reset-lvars iform) label-dic)])
         (if (label-dic-info label-dic)
           (loop iform. (+ count 1))
-          iform.)))))
+          (pass3/infer-types iform.))))))
 
 (define (pass3-dump iform count)
   (format #t "~78,,,'=a\n" #"pass3 #~count ")
@@ -4225,6 +4346,283 @@
 ;; Dispatch table.
 (define *pass3-dispatch-table* (generate-dispatch-table pass3))
 
+;;---------------------------------------------------------------
+;; Type inference
+;;
+;;  After pass3 settles the tree, we walk it once more, keeping track of
+;;  what we know about the values of immutable local variables, and
+;;  replace the instructions whose runtime checks are redundant with
+;;  their unchecked variants:
+;;
+;;    (car x) (cdr x)          => CAR-UNSAFE, CDR-UNSAFE  if x is a pair
+;;    (vector-ref v i)         => VEC-REF-UNSAFE  if 0 <= i < (vector-length v)
+;;    (vector-set! v i obj)    => VEC-SET-UNSAFE  ditto.
+;;
+;;  A fact is a list (<kind> <lvar> ...):
+;;
+;;    (pair x)      x is a pair
+;;    (vector v)    v is a vector
+;;    (length n v)  n is (vector-length v)
+;;    (below i v)   i is less than (vector-length v), unless i is NaN
+;;    (index i)     i is an exact nonnegative integer
+;;
+;;  Since the variables are immutable, a fact remains true once it is
+;;  established, within the scope of the variables.  There are two
+;;  exceptions we need to care:
+;;
+;;  - The variables of an embedded lambda get new values at each jump.
+;;    We don't carry anything from the arguments, except (index i) when
+;;    every call, including jumps, passes an index (tinfer/loop-indices).
+;;    This is what hoists the bounds check out of counted loops: the loop
+;;    test (< i (vector-length v)) gives (below i v), and given (index i),
+;;    the vector-ref in the loop body doesn't need to check anything.
+;;
+;;  - A $label node, other than the body of an embedded lambda, can be
+;;    reached from more than one branch.  So we keep the facts in two
+;;    lists: INV is the ones that hold wherever the variables are visible
+;;    (from $let inits and loop variables), and FLOW is the ones that
+;;    hold because we've passed a test, e.g. the then clause of (pair? x).
+;;    Only INV is carried into a $label.
+;;
+;;  The pass modifies $asm nodes in place; the shape of the tree
+;;  doesn't change.
+
+(define (pass3/infer-types iform)
+  (let1 jumps (make-hash-table 'eq?)   ; embed $call -> list of jump $calls
+    (tinfer/scan-jumps iform jumps (make-label-dic #f))
+    (tinfer/rec iform '() '() (cons jumps (make-label-dic #f)))
+    iform))
+
+;; Collect jump calls for each embed call.
+(define/case (tinfer/scan-jumps iform jumps labels)
+  (iform-tag iform)
+  [($DEFINE) (tinfer/scan-jumps ($define-expr iform) jumps labels)]
+  [($LSET)   (tinfer/scan-jumps ($lset-expr iform) jumps labels)]
+  [($GSET)   (tinfer/scan-jumps ($gset-expr iform) jumps labels)]
+  [($IF)     (tinfer/scan-jumps ($if-test iform) jumps labels)
+             (tinfer/scan-jumps ($if-then iform) jumps labels)
+             (tinfer/scan-jumps ($if-else iform) jumps labels)]
+  [($LET)    (tinfer/scan-jumps* ($let-inits iform) jumps labels)
+             (tinfer/scan-jumps ($let-body iform) jumps labels)]
+  [($RECEIVE)(tinfer/scan-jumps ($receive-expr iform) jumps labels)
+             (tinfer/scan-jumps ($receive-body iform) jumps labels)]
+  [($LAMBDA) (tinfer/scan-jumps ($lambda-body iform) jumps labels)]
+  [($LABEL)  (unless (label-seen? labels iform)
+               (label-push! labels iform)
+               (tinfer/scan-jumps ($label-body iform) jumps labels))]
+  [($SEQ)    (tinfer/scan-jumps* ($seq-body iform) jumps labels)]
+  [($CALL)   (if (eq? ($call-flag iform) 'jump)
+               (hash-table-push! jumps ($call-proc iform) iform)
+               (tinfer/scan-jumps ($call-proc iform) jumps labels))
+             (tinfer/scan-jumps* ($call-args iform) jumps labels)]
+  [($ASM)    (tinfer/scan-jumps* ($asm-args iform) jumps labels)]
+  [($PROMISE)(tinfer/scan-jumps ($promise-expr iform) jumps labels)]
+  [($CONS $APPEND $MEMV $EQ? $EQV?)
+             (tinfer/scan-jumps ($*-arg0 iform) jumps labels)
+             (tinfer/scan-jumps ($*-arg1 iform) jumps labels)]
+  [($VECTOR $LIST $LIST*) (tinfer/scan-jumps* ($*-args iform) jumps labels)]
+  [($LIST->VECTOR) (tinfer/scan-jumps ($*-arg0 iform) jumps labels)]
+  [else #f])
+
+(define (tinfer/scan-jumps* iforms jumps labels)
+  (ifor-each (^[x] (tinfer/scan-jumps x jumps labels)) iforms))
+
+;; CTX is (<jump table> . <label-dic>)
+(define/case (tinfer/rec iform inv flow ctx)
+  (iform-tag iform)
+  [($DEFINE) (tinfer/rec ($define-expr iform) '() '() ctx)]
+  [($LSET)   (tinfer/rec ($lset-expr iform) inv flow ctx)]
+  [($GSET)   (tinfer/rec ($gset-expr iform) inv flow ctx)]
+  [($IF)     (let1 test ($if-test iform)
+               (tinfer/rec test inv flow ctx)
+               (receive (then-facts else-facts) (tinfer/test-facts test inv flow)
+                 (tinfer/rec ($if-then iform) inv (append then-facts flow) ctx)
+                 (tinfer/rec ($if-else iform) inv (append else-facts flow) ctx)))]
+  [($LET)    (tinfer/rec* ($let-inits iform) inv flow ctx)
+             (tinfer/rec ($let-body iform)
+                         (fold (^[lv init inv] (tinfer/init-facts lv init inv flow))
+                               inv ($let-lvars iform) ($let-inits iform))
+                         flow ctx)]
+  [($RECEIVE)(tinfer/rec ($receive-expr iform) inv flow ctx)
+             (tinfer/rec ($receive-body iform) inv flow ctx)]
+  [($LAMBDA) (tinfer/rec ($lambda-body iform) inv flow ctx)]
+  [($LABEL)  (unless (label-seen? (cdr ctx) iform)
+               (label-push! (cdr ctx) iform)
+               (tinfer/rec ($label-body iform) inv '() ctx))]
+  [($SEQ)    (tinfer/rec* ($seq-body iform) inv flow ctx)]
+  [($CALL)   (tinfer/rec* ($call-args iform) inv flow ctx)
+             (case ($call-flag iform)
+               [(jump)]
+               [(embed) (tinfer/embed iform inv flow ctx)]
+               [else (tinfer/rec ($call-proc iform) inv flow ctx)])]
+  [($ASM)    (tinfer/rec* ($asm-args iform) inv flow ctx)
+             (tinfer/asm iform inv flow)]
+  [($PROMISE)(tinfer/rec ($promise-expr iform) inv flow ctx)]
+  [($CONS $APPEND $MEMV $EQ? $EQV?)
+             (tinfer/rec ($*-arg0 iform) inv flow ctx)
+             (tinfer/rec ($*-arg1 iform) inv flow ctx)]
+  [($VECTOR $LIST $LIST*) (tinfer/rec* ($*-args iform) inv flow ctx)]
+  [($LIST->VECTOR) (tinfer/rec ($*-arg0 iform) inv flow ctx)]
+  [else #f])
+
+(define (tinfer/rec* iforms inv flow ctx)
+  (ifor-each (^[x] (tinfer/rec x inv flow ctx)) iforms))
+
+;; The body of an embedded lambda is only entered from this call and
+;; the jumps in itself, so it inherits FLOW as well.
+(define (tinfer/embed iform inv flow ctx)
+  (let* ([lm ($call-proc iform)]
+         [body ($lambda-body lm)]
+         [idx (tinfer/loop-indices lm ($call-args iform)
+                                   (hash-table-get (car ctx) iform '())
+                                   inv flow)]
+         [inv (fold (^[lv inv] (cons `(index ,lv) inv)) inv idx)])
+    (cond [(has-tag? body $LABEL)
+           (unless (label-seen? (cdr ctx) body)
+             (label-push! (cdr ctx) body)
+             (tinfer/rec ($label-body body) inv flow ctx))]
+          [else (tinfer/rec body inv flow ctx)])))
+
+;; Returns a list of the variables of the embedded lambda LM that are
+;; exact nonnegative integers on every entry.  We start from the ones
+;; whose initial value is such, and drop the ones a jump may pass
+;; something else, until it settles.  A jump argument may refer to the
+;; candidates themselves, e.g. (loop (+ i 1)).
+(define (tinfer/loop-indices lm args jumps inv flow)
+  (define (index-expr? iform cands)
+    (case/unquote
+     (iform-tag iform)
+     [($CONST) (let1 v ($const-value iform)
+                 (and (exact-integer? v) (>= v 0)))]
+     [($LREF)  (let1 lv ($lref-lvar iform)
+                 (or (memq lv cands)
+                     (tinfer/known? 'index lv inv flow)))]
+     [($ASM)   (and (eqv? (car ($asm-insn iform)) NUMADD2)
+                    (every (cut index-expr? <> cands) ($asm-args iform)))]
+     [else #f]))
+  (define (narrow cands)
+    (let loop ([cands cands] [js jumps])
+      (if (null? js)
+        cands
+        (loop (let scan ([lvs ($lambda-lvars lm)]
+                         [as ($call-args (car js))]
+                         [r '()])
+                (cond [(or (null? lvs) (null? as)) (reverse r)]
+                      [(and (memq (car lvs) cands)
+                            (index-expr? (car as) cands))
+                       (scan (cdr lvs) (cdr as) (cons (car lvs) r))]
+                      [else (scan (cdr lvs) (cdr as) r)]))
+              (cdr js)))))
+  (if (not (eqv? ($lambda-optarg lm) 0))
+    '()
+    (let loop ([cands (let scan ([lvs ($lambda-lvars lm)] [as args] [r '()])
+                        (cond [(or (null? lvs) (null? as)) r]
+                              [(and (lvar-immutable? (car lvs))
+                                    (index-expr? (car as) '()))
+                               (scan (cdr lvs) (cdr as) (cons (car lvs) r))]
+                              [else (scan (cdr lvs) (cdr as) r)]))])
+      (let1 cands2 (narrow cands)
+        (if (= (length cands2) (length cands))
+          cands
+          (loop cands2))))))
+
+(define (tinfer/known? kind lv inv flow)
+  (define (match? f) (and (eq? (car f) kind) (eq? (cadr f) lv)))
+  (or (find match? flow) (find match? inv)))
+
+(define (tinfer/known2? kind lv0 lv1 inv flow)
+  (define (match? f)
+    (and (eq? (car f) kind) (eq? (cadr f) lv0) (eq? (caddr f) lv1)))
+  (or (find match? flow) (find match? inv)))
+
+;; If IFORM is a reference to an immutable lvar, returns it.
+(define (tinfer/lvar iform)
+  (and ($lref? iform)
+       (let1 lv ($lref-lvar iform)
+         (and (lvar-immutable? lv) lv))))
+
+;; If IFORM yields (vector-length v) of an immutable v, returns v.
+(define (tinfer/length-of iform inv flow)
+  (cond [(tinfer/lvar iform)
+         => (^[n] (and-let1 f (or (find (^f (and (eq? (car f) 'length)
+                                                  (eq? (cadr f) n)))
+                                        flow)
+                                  (find (^f (and (eq? (car f) 'length)
+                                                 (eq? (cadr f) n)))
+                                        inv))
+                    (caddr f)))]
+        [(and (has-tag? iform $ASM)
+              (eqv? (car ($asm-insn iform)) VEC-LEN))
+         (tinfer/lvar (car ($asm-args iform)))]
+        [else #f]))
+
+;; Adds the facts about LV, bound to INIT by $let, to INV.
+(define (tinfer/init-facts lv init inv flow)
+  (if (not (lvar-immutable? lv))
+    inv
+    (case/unquote
+     (iform-tag init)
+     [($CONS $LIST $LIST*)
+      (if (initval-always-pair? init) (cons `(pair ,lv) inv) inv)]
+     [($VECTOR $LIST->VECTOR) (cons `(vector ,lv) inv)]
+     [($CONST) (let1 v ($const-value init)
+                 (if (and (exact-integer? v) (>= v 0))
+                   (cons `(index ,lv) inv)
+                   inv))]
+     [($ASM) (if-let1 v (tinfer/length-of init inv flow)
+               (list* `(length ,lv ,v) `(vector ,v) inv)
+               inv)]
+     [else inv])))
+
+;; Returns two lists of facts, which hold in the then clause and
+;; in the else clause of the test TEST, respectively.
+(define (tinfer/test-facts test inv flow)
+  (define (below i n)                   ; facts from i < n
+    (or (and-let* ([i (tinfer/lvar i)]
+                   [v (tinfer/length-of n inv flow)])
+          `((below ,i ,v) (vector ,v)))
+        '()))
+  (if (not (has-tag? test $ASM))
+    (values '() '())
+    (let ([code (car ($asm-insn test))]
+          [args ($asm-args test)])
+      (case/unquote
+       code
+       [(PAIRP)   (values (or (and-let1 x (tinfer/lvar (car args))
+                                `((pair ,x)))
+                              '())
+                          '())]
+       [(VECTORP) (values (or (and-let1 x (tinfer/lvar (car args))
+                                `((vector ,x)))
+                              '())
+                          '())]
+       [(NOT)     (receive (t e) (tinfer/test-facts (car args) inv flow)
+                    (values e t))]
+       ;; (below i v) is used only with (index i), so we can take
+       ;; (not (>= i n)) as i < n; i can't be NaN.
+       [(NUMLT2)  (values (below (car args) (cadr args)) '())]
+       [(NUMGT2)  (values (below (cadr args) (car args)) '())]
+       [(NUMGE2)  (values '() (below (car args) (cadr args)))]
+       [(NUMLE2)  (values '() (below (cadr args) (car args)))]
+       [else (values '() '())]))))
+
+(define (tinfer/asm iform inv flow)
+  (define (pair-arg? k)
+    (and-let1 x (tinfer/lvar (list-ref ($asm-args iform) k))
+      (tinfer/known? 'pair x inv flow)))
+  (define (index-args?)
+    (and-let* ([v (tinfer/lvar (car ($asm-args iform)))]
+               [i (tinfer/lvar (cadr ($asm-args iform)))])
+      (and (tinfer/known? 'index i inv flow)
+           (tinfer/known2? 'below i v inv flow))))
+  (case/unquote
+   (car ($asm-insn iform))
+   [(CAR)     (when (pair-arg? 0) ($asm-insn-set! iform `(,CAR-UNSAFE)))]
+   [(CDR)     (when (pair-arg? 0) ($asm-insn-set! iform `(,CDR-UNSAFE)))]
+   [(VEC-REF) (when (index-args?) ($asm-insn-set! iform `(,VEC-REF-UNSAFE)))]
+   [(VEC-SET) (when (index-args?) ($asm-insn-set! iform `(,VEC-SET-UNSAFE)))]
+   [else #f]))
+
 ;;===============================================================
 ;; Pass 4.  Lambda lifting
 ;;
@@ -4282,11 +4680,13 @@
   (if (or (memq lvar bound) (memq lvar free)) free (cons lvar free)))
 
 ;; Pass 4 entry point.  Returns IForm and list of lifted lvars
+;; NB: We run pass4/scan even if lifting is disabled, for pass5 needs
+;; lvar-captured to decide which mutable lvars to box.
 (define (pass4 iform module)
-  (if (vm-compiler-flag-no-lifting?)
-    iform
-    (let1 dic (make-label-dic '())
-      (pass4/scan iform '() '() #t dic) ; Mark free variables
+  (let1 dic (make-label-dic '())
+    (pass4/scan iform '() '() #t dic) ; Mark free variables
+    (if (vm-compiler-flag-no-lifting?)
+      iform
       (let1 lambda-nodes (label-dic-info dic)
         (if (or (null? lambda-nodes)
                 (and (null? (cdr lambda-nodes)) ; iform has only a toplevel lambda
@@ -4351,6 +4751,8 @@
                ;; We just mark it by setting lifted-var to #t so that
                ;; pass4/lift phase can treat it specially.
                (unless (eq? ($lambda-flag iform) 'dissolved)
+                 ;; mutable lvars closed by this lambda need boxing
+                 (dolist [lv inner-fs] (lvar-captured-set! lv #t))
                  (label-dic-info-push! labels iform) ;save the lambda node
                  (when t?                            ;mark this is toplevel
                    ($lambda-lifted-var-set! iform #t)))
@@ -4437,6 +4839,7 @@
                                                  (or ($lambda-name lm)
                                                      (lvar-name lvar))))
                      ($lambda-lifted-var-set! lm lvar)
+                     (compile-report 'lifted ($lambda-name lm) ($lambda-src lm))
                      (push! results lm)))
                  (loop (cdr lms)))])))))
 
@@ -4587,15 +4990,18 @@
   (receive (depth offset) (renv-lookup renv ($lref-lvar iform))
     (compiled-code-emit2i! ccb LREF depth offset
                            (lvar-name ($lref-lvar iform)))
-    (unless (lvar-immutable? ($lref-lvar iform))
+    (when (lvar-boxed? ($lref-lvar iform))
       (compiled-code-emit0! ccb UNBOX))
     0))
 
 (define (pass5/$LSET iform ccb renv ctx)
   (receive (depth offset) (renv-lookup renv ($lset-lvar iform))
     (rlet1 d (pass5/rec ($lset-expr iform) ccb renv (normal-context ctx))
-      (compiled-code-emit2i! ccb LSET depth offset
-                             (lvar-name ($lset-lvar iform))))))
+      (if (lvar-boxed? ($lset-lvar iform))
+        (compiled-code-emit2i! ccb LSET depth offset
+                               (lvar-name ($lset-lvar iform)))
+        (compiled-code-emit2i! ccb LSET-UNBOXED depth offset
+                               (lvar-name ($lset-lvar iform)))))))
 
 (define (pass5/$GREF iform ccb renv ctx)
   (let1 id ($gref-id iform)
@@ -4978,9 +5384,11 @@
     (let1 init (car inits)
       (cond
        [(has-tag? init $LAMBDA)
-        (partition-letrec-inits (cdr inits) ccb renv (+ cnt 1)
-                                (cons (pass5/lambda init ccb renv) closures)
-                                others)]
+        (let1 code (pass5/lambda init ccb renv)
+          (pass5/report-closure init code)
+          (partition-letrec-inits (cdr inits) ccb renv (+ cnt 1)
+                                  (cons code closures)
+                                  others))]
        [($const? init)
         (partition-letrec-inits (cdr inits) ccb renv (+ cnt 1)
                                 (cons ($const-value init) closures)
@@ -4995,7 +5403,7 @@
 (define (emit-letrec-boxers ccb lvars nlocals)
   (let loop ([lvars lvars] [cnt nlocals])
     (unless (null? lvars)
-      (unless (lvar-immutable? (car lvars))
+      (when (lvar-boxed? (car lvars))
         (compiled-code-emit1! ccb BOX cnt))
       (loop (cdr lvars) (- cnt 1)))))
        
@@ -5008,9 +5416,9 @@
     (let* ([off&expr (car init-alist)]
            [d (pass5/rec (cdr off&expr) ccb renv 'normal/bottom)]
            [lvar (list-ref lvars (car off&expr))])
-      (if (lvar-immutable? lvar)
-        (compiled-code-emit1! ccb ENV-SET (- nlocals 1 (car off&expr)))
-        (compiled-code-emit2! ccb LSET 0 (- nlocals 1 (car off&expr))))
+      (if (lvar-boxed? lvar)
+        (compiled-code-emit2! ccb LSET 0 (- nlocals 1 (car off&expr)))
+        (compiled-code-emit1! ccb ENV-SET (- nlocals 1 (car off&expr))))
       (emit-letrec-inits (cdr init-alist) lvars nlocals ccb renv
                          (imax depth d)))))
 
@@ -5044,9 +5452,18 @@
 (define (pass5/$LAMBDA iform ccb renv ctx)
   (let ([code (pass5/lambda iform ccb renv)]
         [info ($*-src iform)])
+    (pass5/report-closure iform code)
     (compiled-code-emit0oi! ccb CLOSURE code info))
   0)
 
+;; Closures created in the toplevel code are allocated only once,
+;; so we only report ones inside procedures.
+(define (pass5/report-closure iform code)
+  (let1 name (slot-ref code 'full-name)
+    (when (pair? name)
+      (compile-report 'closure name ($lambda-src iform)
+                      (map lvar-name ($lambda-free-lvars iform))))))
+
 (define (pass5/lambda iform ccb renv)
   (let* ([inliner (let1 v ($lambda-flag iform)
                    (and (vector? v) v))]
@@ -5062,7 +5479,7 @@
     (let loop ([lvs ($lambda-lvars iform)]
                [k (length ($lambda-lvars iform))])
       (unless (null? lvs)
-        (unless (lvar-immutable? (car lvs))
+        (when (lvar-boxed? (car lvs))
           (compiled-code-emit1i! ccb BOX k (lvar-name (car lvs))))
         (loop (cdr lvs) (- k 1))))
     (pass5 ($lambda-body iform)
@@ -5245,7 +5662,7 @@
   (let loop ([lvs lvars])
     (cond [(null? lvs)  ; no need of boxing.
            (compiled-code-emit1oi! ccb LOCAL-ENV-JUMP env-depth label src)]
-          [(not (lvar-immutable? (car lvs))) ; need boxing
+          [(lvar-boxed? (car lvs)) ; need boxing
            (compiled-code-emit1i! ccb LOCAL-ENV-SHIFT env-depth src)
            (pass5/box-mutable-lvars lvars ccb)
            (compiled-code-emit0oi! ccb JUMP label src)]
@@ -5613,7 +6030,7 @@
     (let loop ([lvars lvars]
                [k 0])
       (unless (null? lvars)
-        (unless (lvar-immutable? (car lvars))
+        (when (lvar-boxed? (car lvars))
           (compiled-code-emit1i! ccb BOX (- envsize k) (lvar-name (car lvars))))
         (loop (cdr lvars) (+ k 1))))))
 
@@ -6155,6 +6572,30 @@
        (exact? obj)
        (<= 0 obj #x7ffff)))
 
+;; Compile report (-fcompile-report).  Each record is written to the
+;; current error port in one line, in the form
+;;   (compile-report <kind> <name> <source> <detail> ...)
+;; where <source> is (<file> <line>) of the lambda form, or #f.
+;; <kind> and <detail>s are:
+;;   closure (<free-var> ...) - a closure is allocated at runtime
+;;   lifted                   - lifted to the toplevel; no closure allocated
+;;   embed <njumps>           - local function embedded in the sole call site,
+;;                              and <njumps> self calls became jumps
+;;   inline <ncalls>          - local function inlined at <ncalls> sites
+;;   local <reason>           - local function kept as a closure
+;;   no-inline <reason>       - define-inline form can't be inlined
+;;   guarded-inline           - small global procedure inlined with a guard
+(define (compile-report kind name src . details)
+  (when (vm-compiler-flag-is-set? SCM_COMPILE_REPORT)
+    (let ([port (current-error-port)]
+          [si (and (pair? src) (pair-attribute-get src 'source-info #f))])
+      (write (unwrap-syntax `(compile-report ,kind ,name
+                                             ,(and (pair? si) (pair? (cdr si))
+                                                   (list (car si) (cadr si)))
+                                             ,@details))
+             port)
+      (newline port))))
+
 (define (variable-name arg)
   (cond [(symbol? arg) arg]
         [(identifier? arg) (unwrap-syntax arg)]
@@ -6223,6 +6664,14 @@
                      (not (SCM_VM_COMPILER_FLAG_IS_SET
                            (Scm_VM) SCM_COMPILE_NOINLINE_GLOBALS)))
                 (set! SCM_RESULT0 gval SCM_RESULT1 'inline)]
+               ;; small procedure inlinable with a guard.
+               ;; see pass1/guarded-inline.
+               [(and (SCM_CLOSUREP gval)
+                     (SCM_PROCEDURE_INLINER gval)
+                     (SCM_VECTORP (SCM_PROCEDURE_INLINER gval))
+                     (not (SCM_VM_COMPILER_FLAG_IS_SET
+                           (Scm_VM) SCM_COMPILE_NOINLINE_GLOBALS)))
+                (set! SCM_RESULT0 gval SCM_RESULT1 'guarded)]
                [else (goto normal)])
          (.if "defined(RECORD_DEPENDED_MODULES)"
               (begin
@@ -6397,6 +6846,8 @@
  (define-enum SCM_COMPILE_NO_LIFTING)
  (define-enum SCM_COMPILE_INCLUDE_VERBOSE)
  (define-enum SCM_COMPILE_ENABLE_CEXPR)
+ (define-enum SCM_COMPILE_REPORT)
+ (define-enum SCM_COMPILE_PACK_SOURCE_INFO)
 
  ;; Set/get VM's current module info. (temporary)
  (define-cproc vm-current-module () (return (SCM_OBJ (-> (Scm_VM) module))))
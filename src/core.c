@@ -34,13 +34,24 @@
 #define LIBGAUCHE_BODY
 #include "gauche.h"
 #include "gauche/paths.h"
+#include "gauche/code.h"
 #include "gauche/priv/builtin-syms.h"
+#include "gauche/priv/probeP.h"
+
+/* See src/lazy.c for why we avoid native atomic ops on these platforms */
+#if defined(__SH4__) || defined(__ARMEL__)
+#define AO_USE_PTHREAD_DEFS 1
+#endif
+#include "atomic_ops.h"
+#include "gc_mark.h"
 
 /* GC_print_static_roots() is declared in private/gc_priv.h.  It is too much
    hassle to include it with other GC internal baggages, so we just declare
    it.  It's a private funciton of GC, so watch out the changes in GC. */
 extern void GC_print_static_roots(void);
 
+static void GC_CALLBACK gc_event_callback(GC_EventType ev);
+
 /*
  * out-of-memory handler.  this will be called by GC.
  */
@@ -66,6 +77,7 @@ static struct {
 extern void Scm__InitModule(void);
 extern void Scm__InitHash(void);
 extern void Scm__InitSymbol(void);
+extern void Scm__InitBits(void);
 extern void Scm__InitNumber(void);
 extern void Scm__InitChar(void);
 extern void Scm__InitClass(void);
@@ -85,6 +97,7 @@ extern void Scm__InitVM(void);
 extern void Scm__InitAutoloads(void);
 extern void Scm__InitCollection(void);
 extern void Scm__InitComparator(void);
+extern void Scm__InitCode(void);
 
 extern void Scm_Init_libalpha(void);
 extern void Scm_Init_libbool(void);
@@ -146,6 +159,7 @@ void Scm_Init(const char *signature)
     GC_oom_fn = oom_handler;
     GC_finalize_on_demand = TRUE;
     GC_finalizer_notifier = finalizable;
+    GC_set_on_collection_event(gc_event_callback);
 
     (void)SCM_INTERNAL_MUTEX_INIT(cond_features.mutex);
 
@@ -156,6 +170,7 @@ void Scm_Init(const char *signature)
     Scm__InitHash();
     Scm__InitSymbol();
     Scm__InitModule();
+    Scm__InitBits();
     Scm__InitNumber();
     Scm__InitChar();
     Scm__InitClass();
@@ -171,6 +186,7 @@ void Scm_Init(const char *signature)
     Scm__InitSignal();
     Scm__InitSystem();
     Scm__InitComparator();
+    Scm__InitCode();
 
     Scm_Init_libalpha();
     Scm_Init_libbool();
@@ -255,6 +271,825 @@ void Scm_RegisterDL(void *data_start, void *data_end,
     }
 }
 
+/*=============================================================
+ * GC event recording
+ *
+ *  The records of recent collections are kept in a ring buffer.
+ *  The GC calls gc_event_callback with its lock held, sometimes with
+ *  the world stopped, so the callback must not allocate nor take any
+ *  lock.  Since only one collection runs at a time, the callback is
+ *  the only writer.  Each slot has a sequence number, which is odd
+ *  while the slot is being written, so that the reader can copy the
+ *  slot without a lock and retry if it is changed under its feet.
+ *
+ *  If a handler is set, the thread that ran the collection calls it
+ *  at the next safe point, the same way as finalizers.
+ */
+
+#define GC_EVENT_RING_SIZE 64
+
+typedef struct gc_event_rec {
+    u_long serial;              /* n-th recorded event */
+    u_long gcNo;
+    int    full;                /* TRUE for a full collection */
+    double time;                /* wall clock time at the start */
+    double start;               /* monotonic clock at the start */
+    double pause;               /* start to end, in seconds */
+    double stopWorld;           /* time the world was stopped */
+    double interval;            /* since the end of the previous one */
+    u_long heapSize;            /* after the collection */
+    u_long freeBytes;           /* after the collection */
+    u_long allocated;           /* bytes allocated since the previous one */
+    u_long reclaimed;           /* bytes reclaimed immediately */
+} gc_event_rec;
+
+static struct {
+    ScmObj handler;             /* #f or a procedure */
+    gc_event_rec cur;           /* collection in progress */
+    int open;                   /* TRUE while cur is being filled */
+    int marked;                 /* TRUE if marking is completed */
+    double stopStart;
+    double lastEnd;
+    gc_event_rec ring[GC_EVENT_RING_SIZE];
+    AO_t seq[GC_EVENT_RING_SIZE];
+    AO_t count;                 /* # of recorded events */
+    AO_t dispatched;            /* # of events passed to the handler */
+    AO_t dispatching;           /* TRUE while some thread runs the handler */
+} gcev = { SCM_FALSE };
+
+static double gcev_monotonic(void)
+{
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec/1.0e9;
+#else
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double)tv.tv_sec + (double)tv.tv_usec/1.0e6;
+#endif
+}
+
+static void gcev_get_stats(struct GC_prof_stats_s *st)
+{
+    /* We're called with the GC lock held. */
+#if defined(GC_THREADS)
+    GC_get_prof_stats_unsafe(st, sizeof(*st));
+#else
+    GC_get_prof_stats(st, sizeof(*st));
+#endif
+}
+
+static void gcev_open(int full)
+{
+    struct GC_prof_stats_s st;
+    struct timeval tv;
+
+    gcev_get_stats(&st);
+    gettimeofday(&tv, NULL);
+    memset(&gcev.cur, 0, sizeof(gcev.cur));
+    gcev.cur.full = full;
+    gcev.cur.time = (double)tv.tv_sec + (double)tv.tv_usec/1.0e6;
+    gcev.cur.start = gcev_monotonic();
+    gcev.cur.allocated = st.bytes_allocd_since_gc;
+    if (gcev.lastEnd > 0) gcev.cur.interval = gcev.cur.start - gcev.lastEnd;
+    gcev.open = TRUE;
+    gcev.marked = FALSE;
+}
+
+static void gcev_close(void)
+{
+    struct GC_prof_stats_s st;
+    double now = gcev_monotonic();
+
+    gcev_get_stats(&st);
+    gcev.cur.gcNo = st.gc_no;
+    gcev.cur.pause = now - gcev.cur.start;
+    gcev.cur.heapSize = st.heapsize_full - st.unmapped_bytes;
+    gcev.cur.freeBytes = st.free_bytes_full - st.unmapped_bytes;
+    gcev.cur.reclaimed = st.bytes_reclaimed_since_gc;
+
+    AO_t n = AO_load(&gcev.count);
+    int i = (int)(n % GC_EVENT_RING_SIZE);
+    gcev.cur.serial = n;
+    AO_store_full(&gcev.seq[i], gcev.seq[i] + 1); /* odd: being written */
+    gcev.ring[i] = gcev.cur;
+    AO_store_full(&gcev.seq[i], gcev.seq[i] + 1);
+    AO_store_full(&gcev.count, n + 1);
+
+    gcev.lastEnd = now;
+    gcev.open = FALSE;
+
+    if (!SCM_FALSEP(gcev.handler)) {
+        ScmVM *vm = Scm_VM();
+        if (vm != NULL) {
+            vm->finalizerPending = TRUE;
+            vm->attentionRequest = TRUE;
+        }
+    }
+}
+
+static void GC_CALLBACK gc_event_callback(GC_EventType ev)
+{
+    switch (ev) {
+    case GC_EVENT_START:
+        SCM_PROBE0(gc__start);
+        gcev_open(TRUE);
+        break;
+    case GC_EVENT_PRE_STOP_WORLD:
+        /* A partial collection in incremental mode doesn't have START */
+        if (!gcev.open) gcev_open(FALSE);
+        gcev.stopStart = gcev_monotonic();
+        break;
+    case GC_EVENT_MARK_END:
+        gcev.marked = TRUE;
+        break;
+    case GC_EVENT_POST_START_WORLD:
+        if (gcev.open) {
+            gcev.cur.stopWorld += gcev_monotonic() - gcev.stopStart;
+            /* marking has been abandoned; we'll retry later */
+            if (!gcev.marked) gcev.open = FALSE;
+        }
+        break;
+    case GC_EVENT_RECLAIM_END:
+        if (gcev.open) gcev_close();
+        break;
+    case GC_EVENT_END:
+        SCM_PROBE0(gc__end);
+        break;
+    default:
+        break;
+    }
+}
+
+/* Copies the record of N-th event to *R.  Returns FALSE if it has
+   already been overwritten. */
+static int gcev_fetch(AO_t n, gc_event_rec *r)
+{
+    int i = (int)(n % GC_EVENT_RING_SIZE);
+    for (;;) {
+        AO_t s0 = AO_load_full(&gcev.seq[i]);
+        if (s0 & 1) continue;
+        *r = gcev.ring[i];
+        if (AO_load_full(&gcev.seq[i]) == s0) break;
+    }
+    return r->serial == n;
+}
+
+static ScmObj gcev_to_list(gc_event_rec *r)
+{
+    double rate = (r->interval > 0) ? (double)r->allocated/r->interval : 0.0;
+    return Scm_List(
+        SCM_LIST2(SCM_MAKE_KEYWORD("gc-no"), Scm_MakeIntegerU(r->gcNo)),
+        SCM_LIST2(SCM_MAKE_KEYWORD("full"), SCM_MAKE_BOOL(r->full)),
+        SCM_LIST2(SCM_MAKE_KEYWORD("time"), Scm_MakeFlonum(r->time)),
+        SCM_LIST2(SCM_MAKE_KEYWORD("pause"), Scm_MakeFlonum(r->pause)),
+        SCM_LIST2(SCM_MAKE_KEYWORD("stop-world"),
+                  Scm_MakeFlonum(r->stopWorld)),
+        SCM_LIST2(SCM_MAKE_KEYWORD("heap-size"),
+                  Scm_MakeIntegerU(r->heapSize)),
+        SCM_LIST2(SCM_MAKE_KEYWORD("free-bytes"),
+                  Scm_MakeIntegerU(r->freeBytes)),
+        SCM_LIST2(SCM_MAKE_KEYWORD("allocated"),
+                  Scm_MakeIntegerU(r->allocated)),
+        SCM_LIST2(SCM_MAKE_KEYWORD("reclaimed"),
+                  Scm_MakeIntegerU(r->reclaimed)),
+        SCM_LIST2(SCM_MAKE_KEYWORD("allocation-rate"), Scm_MakeFlonum(rate)),
+        NULL);
+}
+
+/* Returns the list of up to MAX recent events, the oldest first.
+   MAX < 0 means all the events in the buffer. */
+ScmObj Scm_GCEvents(int max)
+{
+    ScmObj h = SCM_NIL, t = SCM_NIL;
+    AO_t n = AO_load_full(&gcev.count);
+    AO_t from = (n > GC_EVENT_RING_SIZE) ? n - GC_EVENT_RING_SIZE : 0;
+    if (max >= 0 && n - from > (AO_t)max) from = n - max;
+
+    for (AO_t k = from; k < n; k++) {
+        gc_event_rec r;
+        if (gcev_fetch(k, &r)) SCM_APPEND1(h, t, gcev_to_list(&r));
+    }
+    return h;
+}
+
+ScmObj Scm_GCEventHandler(void)
+{
+    return gcev.handler;
+}
+
+void Scm_SetGCEventHandler(ScmObj handler)
+{
+    if (!SCM_FALSEP(handler) && !SCM_PROCEDUREP(handler)) {
+        SCM_TYPE_ERROR(handler, "procedure or #f");
+    }
+    /* Skip the events happened before the handler is set. */
+    AO_store_full(&gcev.dispatched, AO_load_full(&gcev.count));
+    gcev.handler = handler;
+}
+
+/* Called from Scm_VMFinalizerRun.  Passes undelivered events to the
+   handler.  Only one thread runs the handler at a time; if another
+   thread is doing it, it'll pick up our events as well. */
+static void gcev_dispatch(void)
+{
+    ScmObj handler = gcev.handler;
+    if (SCM_FALSEP(handler)) return;
+    if (!AO_compare_and_swap_full(&gcev.dispatching, 0, 1)) return;
+
+    for (;;) {
+        AO_t n = AO_load_full(&gcev.dispatched);
+        if (n >= AO_load_full(&gcev.count)) break;
+        AO_store_full(&gcev.dispatched, n + 1);
+
+        gc_event_rec r;
+        if (!gcev_fetch(n, &r)) continue; /* overwritten; skip */
+        ScmEvalPacket packet;
+        if (Scm_Apply(handler, SCM_LIST1(gcev_to_list(&r)), &packet) < 0) {
+            Scm_Warn("error in GC event handler: %S",
+                     Scm_ConditionMessage(packet.exception));
+        }
+    }
+    AO_store_full(&gcev.dispatching, 0);
+}
+
+/*=============================================================
+ * Heap census
+ *
+ *   We walk the objects marked by a full collection, using the
+ *   enumerator of GC.  The walk runs with the allocation lock held, so
+ *   we can't allocate from GC during it; the working tables are
+ *   malloc-ed.  The collection is disabled until we've converted the
+ *   result to Scheme objects, so the objects we've found won't go away.
+ *
+ *   An object's class is read from its header word, but we accept it
+ *   only if it's one of the classes bound in named modules, or a live
+ *   heap object whose own class is an accepted metaclass.  Objects
+ *   without a header, and atomic blocks, can have any bit pattern in
+ *   their first word.  Untagged objects of the size of a pair are
+ *   counted as pairs, which may include a few other two-word structures.
+ */
+
+#define HEAP_UNTAGGED  ((void*)1)   /* untagged object with pointers */
+#define HEAP_ATOMIC    ((void*)2)   /* untagged pointer-free block */
+#define HEAP_PAIR      ((void*)3)   /* untagged object of a pair's size */
+
+typedef struct heap_entry_rec {
+    void *key;                  /* NULL for an empty slot */
+    u_long count;
+    u_long bytes;
+} heap_entry;
+
+/* Open-addressing table keyed by address */
+typedef struct heap_table_rec {
+    heap_entry *entries;
+    size_t size;                /* power of 2 */
+    size_t used;
+} heap_table;
+
+static int heap_table_init(heap_table *t, size_t size)
+{
+    t->entries = (heap_entry*)calloc(size, sizeof(heap_entry));
+    t->size = size;
+    t->used = 0;
+    return t->entries != NULL;
+}
+
+static void heap_table_free(heap_table *t)
+{
+    free(t->entries);
+    t->entries = NULL;
+}
+
+static heap_entry *heap_table_probe(heap_entry *es, size_t size, void *key)
+{
+    size_t i = ((uintptr_t)key >> 3) * 2654435761UL;
+    for (;;) {
+        i &= size - 1;
+        if (es[i].key == key || es[i].key == NULL) return &es[i];
+        i++;
+    }
+}
+
+/* Returns the entry of KEY, or NULL if it doesn't exist and CREATE is
+   FALSE, or we can't extend the table. */
+static heap_entry *heap_table_get(heap_table *t, void *key, int create)
+{
+    heap_entry *e = heap_table_probe(t->entries, t->size, key);
+    if (e->key == key) return e;
+    if (!create) return NULL;
+    if (t->used*2 >= t->size) {
+        size_t nsize = t->size * 2;
+        heap_entry *es = (heap_entry*)calloc(nsize, sizeof(heap_entry));
+        if (es == NULL) return NULL;
+        for (size_t i=0; i<t->size; i++) {
+            if (t->entries[i].key == NULL) continue;
+            *heap_table_probe(es, nsize, t->entries[i].key) = t->entries[i];
+        }
+        free(t->entries);
+        t->entries = es;
+        t->size = nsize;
+        e = heap_table_probe(es, nsize, key);
+    }
+    e->key = key;
+    t->used++;
+    return e;
+}
+
+/* Registers the classes bound in the named modules, and their
+   metaclasses.  Called before the walk, so we can use Scheme API. */
+static int heap_collect_known_classes(heap_table *known)
+{
+    ScmObj mp;
+    SCM_FOR_EACH(mp, Scm_AllModules()) {
+        ScmModule *m = SCM_MODULE(SCM_CAR(mp));
+        ScmHashIter iter;
+        ScmDictEntry *e;
+        Scm_HashIterInit(&iter, SCM_HASH_TABLE_CORE(m->internal));
+        while ((e = Scm_HashIterNext(&iter)) != NULL) {
+            ScmObj v = SCM_GLOC(SCM_DICT_VALUE(e))->value;
+            if (!SCM_CLASSP(v)) continue;
+            if (heap_table_get(known, v, TRUE) == NULL) return FALSE;
+            if (heap_table_get(known, Scm_ClassOf(v), TRUE) == NULL) {
+                return FALSE;
+            }
+        }
+    }
+    return TRUE;
+}
+
+static int heap_class_acceptable(heap_table *known, void *k, int depth)
+{
+    if (heap_table_get(known, k, FALSE) != NULL) return TRUE;
+    if (depth == 0) return FALSE;
+    if (GC_base(k) != k || !GC_is_marked(k)) return FALSE;
+
+    size_t size;
+    if (GC_get_kind_and_size(k, &size) == GC_I_PTRFREE
+        || size < sizeof(ScmClass)) {
+        return FALSE;
+    }
+    ScmWord w = *(ScmWord*)k;
+    if ((w & 7) != 7) return FALSE;
+    void *meta = (void*)(w - 7);
+    if (!heap_class_acceptable(known, meta, depth-1)) return FALSE;
+    if (!Scm_SubtypeP((ScmClass*)meta, SCM_CLASS_CLASS)) return FALSE;
+    (void)heap_table_get(known, k, TRUE); /* cache it */
+    return TRUE;
+}
+
+/* Returns the class of OBJ, or one of HEAP_* */
+static void *heap_class_of(heap_table *known, void *obj, int kind,
+                           size_t bytes)
+{
+    if (bytes >= sizeof(ScmWord)) {
+        ScmWord w = *(ScmWord*)obj;
+        if ((w & 7) == 7 && heap_class_acceptable(known, (void*)(w-7), 3)) {
+            return (void*)(w - 7);
+        }
+    }
+    if (kind == GC_I_PTRFREE) return HEAP_ATOMIC;
+    if (bytes == sizeof(ScmPair)) return HEAP_PAIR;
+    return HEAP_UNTAGGED;
+}
+
+static ScmObj heap_class_obj(void *k)
+{
+    if (k == HEAP_UNTAGGED) return SCM_INTERN("*untagged*");
+    if (k == HEAP_ATOMIC)   return SCM_INTERN("*atomic*");
+    if (k == HEAP_PAIR)     return SCM_OBJ(SCM_CLASS_PAIR);
+    return SCM_OBJ(k);
+}
+
+/* Describes an object found in the walk: #(class bytes address obj),
+   where obj is #f unless the object has a class header. */
+static ScmObj heap_describe(void *obj, void *k, size_t bytes)
+{
+    ScmObj v = Scm_MakeVector(4, SCM_FALSE);
+    SCM_VECTOR_ELEMENT(v, 0) = heap_class_obj(k);
+    SCM_VECTOR_ELEMENT(v, 1) = Scm_MakeIntegerU(bytes);
+    SCM_VECTOR_ELEMENT(v, 2) = Scm_MakeIntegerU((uintptr_t)obj);
+    if (k != HEAP_UNTAGGED && k != HEAP_ATOMIC && k != HEAP_PAIR) {
+        SCM_VECTOR_ELEMENT(v, 3) = SCM_OBJ(obj);
+    }
+    return v;
+}
+
+typedef struct heap_census_rec {
+    heap_table known;
+    heap_table tally;           /* class -> count, bytes */
+    u_long count;
+    u_long bytes;
+    int nlargest;
+    int nlargestUsed;
+    heap_entry *largest;        /* key, count = class, bytes; sorted */
+    void **largestClass;
+    int oom;
+} heap_census;
+
+static void GC_CALLBACK heap_census_cb(void *obj, size_t bytes, void *data)
+{
+    heap_census *c = (heap_census*)data;
+    int kind = GC_get_kind_and_size(obj, NULL);
+    void *k = heap_class_of(&c->known, obj, kind, bytes);
+    heap_entry *e = heap_table_get(&c->tally, k, TRUE);
+
+    if (e == NULL) { c->oom = TRUE; return; }
+    e->count++;
+    e->bytes += bytes;
+    c->count++;
+    c->bytes += bytes;
+
+    if (c->nlargest > 0
+        && (c->nlargestUsed < c->nlargest
+            || c->largest[c->nlargestUsed-1].bytes < bytes)) {
+        int i = (c->nlargestUsed < c->nlargest)
+            ? c->nlargestUsed++ : c->nlargestUsed - 1;
+        for (; i > 0 && c->largest[i-1].bytes < bytes; i--) {
+            c->largest[i] = c->largest[i-1];
+            c->largestClass[i] = c->largestClass[i-1];
+        }
+        c->largest[i].key = obj;
+        c->largest[i].bytes = bytes;
+        c->largestClass[i] = k;
+    }
+}
+
+static void *heap_census_inner(void *data)
+{
+    GC_enumerate_reachable_objects_inner(heap_census_cb, data);
+    return NULL;
+}
+
+/* Returns (count bytes classes largest), where classes is a list of
+   (class count . bytes) in no particular order, and largest is a list
+   of #(class bytes addr obj) of the NLARGEST largest objects. */
+ScmObj Scm_HeapCensus(int nlargest)
+{
+    heap_census c;
+    ScmObj h = SCM_NIL, t = SCM_NIL, lh = SCM_NIL, lt = SCM_NIL;
+
+    memset(&c, 0, sizeof(c));
+    if (nlargest < 0) nlargest = 0;
+    c.nlargest = nlargest;
+    if (!heap_table_init(&c.known, 1024) || !heap_table_init(&c.tally, 1024)
+        || !(c.largest = (heap_entry*)calloc(nlargest+1, sizeof(heap_entry)))
+        || !(c.largestClass = (void**)calloc(nlargest+1, sizeof(void*)))
+        || !heap_collect_known_classes(&c.known)) {
+        c.oom = TRUE;
+    } else {
+        GC_gcollect();
+        GC_disable();
+        GC_call_with_alloc_lock(heap_census_inner, &c);
+        if (!c.oom) {
+            for (size_t i=0; i<c.tally.size; i++) {
+                heap_entry *e = &c.tally.entries[i];
+                if (e->key == NULL) continue;
+                SCM_APPEND1(h, t,
+                            Scm_Cons(heap_class_obj(e->key),
+                                     Scm_Cons(Scm_MakeIntegerU(e->count),
+                                              Scm_MakeIntegerU(e->bytes))));
+            }
+            for (int i=0; i<c.nlargestUsed; i++) {
+                SCM_APPEND1(lh, lt, heap_describe(c.largest[i].key,
+                                                  c.largestClass[i],
+                                                  c.largest[i].bytes));
+            }
+        }
+        GC_enable();
+    }
+    heap_table_free(&c.known);
+    heap_table_free(&c.tally);
+    free(c.largest);
+    free(c.largestClass);
+    if (c.oom) Scm_Error("heap census: couldn't allocate working memory");
+    return SCM_LIST4(Scm_MakeIntegerU(c.count), Scm_MakeIntegerU(c.bytes),
+                     h, lh);
+}
+
+/*
+ * Retention paths
+ *
+ *   Breadth-first search from the roots over the live objects, scanning
+ *   each object conservatively, as GC does.  We stop at the objects
+ *   that match the target so we find the shortest paths to
+ *   different instances.  We don't expand classes and modules, since
+ *   almost everything is reachable through them and the module globals
+ *   are given as roots.
+ */
+
+typedef struct heap_node_rec {
+    void *obj;
+    long parent;                /* index of the parent node, -1 for a root */
+    long root;                  /* index in the roots */
+} heap_node;
+
+typedef struct heap_search_rec {
+    heap_table known;
+    heap_table visited;
+    heap_node *nodes;
+    long nnodes;
+    long maxNodes;
+    void *targetClass;          /* if searching instances of a class */
+    void *targetObj;            /* if searching an object */
+    ScmWord **rootStart;        /* range of words for each root */
+    ScmWord **rootEnd;
+    long nroots;
+    long *found;                /* node indexes of the found paths */
+    int nfound;
+    int maxPaths;
+    int oom;
+} heap_search;
+
+static void heap_search_push(heap_search *s, ScmWord w, long parent,
+                             long root)
+{
+    void *b = GC_base((void*)w);
+    if (b == NULL || !GC_is_marked(b)) return;
+    if (heap_table_get(&s->visited, b, FALSE) != NULL) return;
+    if (s->nnodes >= s->maxNodes) return;
+    if (heap_table_get(&s->visited, b, TRUE) == NULL) {
+        s->oom = TRUE;
+        return;
+    }
+    s->nodes[s->nnodes].obj = b;
+    s->nodes[s->nnodes].parent = parent;
+    s->nodes[s->nnodes].root = root;
+    s->nnodes++;
+}
+
+static void *heap_search_inner(void *data)
+{
+    heap_search *s = (heap_search*)data;
+
+    for (long r=0; r<s->nroots; r++) {
+        for (ScmWord *p = s->rootStart[r]; p < s->rootEnd[r]; p++) {
+            heap_search_push(s, *p, -1, r);
+        }
+    }
+    for (long i=0; i<s->nnodes && s->nfound < s->maxPaths && !s->oom; i++) {
+        void *obj = s->nodes[i].obj;
+        size_t bytes;
+        int kind = GC_get_kind_and_size(obj, &bytes);
+        void *k = heap_class_of(&s->known, obj, kind, bytes);
+
+        if ((s->targetObj && obj == s->targetObj)
+            || (s->targetClass && k == s->targetClass)) {
+            s->found[s->nfound++] = i;
+            continue;
+        }
+        if (kind == GC_I_PTRFREE) continue;
+        if (k == SCM_CLASS_MODULE || k == HEAP_ATOMIC) continue;
+        if (k != HEAP_UNTAGGED && k != HEAP_PAIR
+            && Scm_SubtypeP((ScmClass*)k, SCM_CLASS_CLASS)) {
+            continue;
+        }
+        /* Skip the header word of a tagged object. */
+        size_t start = (k == HEAP_UNTAGGED || k == HEAP_PAIR) ? 0 : 1;
+        for (size_t j=start; j<bytes/sizeof(ScmWord); j++) {
+            heap_search_push(s, ((ScmWord*)obj)[j], i, s->nodes[i].root);
+        }
+    }
+    return NULL;
+}
+
+/* Finds up to MAXPATHS paths from the roots to TARGET, which is a class
+   (to find its instances) or any other heap object.  ROOTS is a list of
+   (label . obj), to which the global variables of the named modules,
+   and the stack, the parameters and the registers of each VM in VMS
+   are added.  Each path is (label #(class bytes addr obj) ...), from
+   the root to the target.  We visit at most MAXNODES objects. */
+ScmObj Scm_HeapRetentionPaths(ScmObj target, ScmObj roots, ScmObj vms,
+                              int maxPaths, long maxNodes)
+{
+    heap_search s;
+    ScmObj labels = SCM_NIL, lt = SCM_NIL, cp, mp;
+    ScmObj h = SCM_NIL, t = SCM_NIL;
+    long nroots = 0, r = 0;
+
+    if (maxPaths <= 0) return SCM_NIL;
+    if (maxNodes <= 0) maxNodes = 1;
+
+    /* Gather the roots.  Each root is a label and a word range. */
+    SCM_FOR_EACH(cp, roots) {
+        if (!SCM_PAIRP(SCM_CAR(cp))) {
+            Scm_Error("(label . obj) required, but got: %S", SCM_CAR(cp));
+        }
+        nroots++;
+    }
+    SCM_FOR_EACH(cp, vms) {
+        if (!SCM_VMP(SCM_CAR(cp))) {
+            Scm_Error("thread required, but got: %S", SCM_CAR(cp));
+        }
+        nroots += 3;
+    }
+    SCM_FOR_EACH(mp, Scm_AllModules()) {
+        ScmModule *m = SCM_MODULE(SCM_CAR(mp));
+        nroots += Scm_HashCoreNumEntries(SCM_HASH_TABLE_CORE(m->internal));
+    }
+
+    memset(&s, 0, sizeof(s));
+    s.maxNodes = maxNodes;
+    s.maxPaths = maxPaths;
+    s.rootStart = (ScmWord**)calloc(nroots+1, sizeof(ScmWord*));
+    s.rootEnd = (ScmWord**)calloc(nroots+1, sizeof(ScmWord*));
+    s.found = (long*)calloc(maxPaths, sizeof(long));
+    s.nodes = (heap_node*)malloc(sizeof(heap_node)*maxNodes);
+
+    /* The labels list keeps the root objects alive.  */
+#define ADD_ROOT(label, start, end)                                     \
+    do {                                                                \
+        if (r < nroots) {                                               \
+            SCM_APPEND1(labels, lt, label);                             \
+            s.rootStart[r] = (ScmWord*)(start);                         \
+            s.rootEnd[r] = (ScmWord*)(end);                             \
+            r++;                                                        \
+        }                                                               \
+    } while (0)
+
+    if (s.rootStart && s.rootEnd && s.found && s.nodes) {
+        SCM_FOR_EACH(cp, roots) {
+            ScmObj p = SCM_CAR(cp);
+            ADD_ROOT(p, &SCM_CDR(p), &SCM_CDR(p) + 1);
+        }
+        SCM_FOR_EACH(cp, vms) {
+            ScmVM *vm = SCM_VM(SCM_CAR(cp));
+            ADD_ROOT(SCM_LIST2(SCM_INTERN("stack"), SCM_OBJ(vm)),
+                     vm->stackBase, vm->sp);
+            ADD_ROOT(SCM_LIST2(SCM_INTERN("parameters"), SCM_OBJ(vm)),
+                     vm->parameters.vector,
+                     vm->parameters.vector + vm->parameters.size);
+            ADD_ROOT(SCM_LIST2(SCM_INTERN("vm"), SCM_OBJ(vm)),
+                     vm, (char*)vm + sizeof(ScmVM));
+        }
+        SCM_FOR_EACH(mp, Scm_AllModules()) {
+            ScmModule *m = SCM_MODULE(SCM_CAR(mp));
+            ScmHashIter iter;
+            ScmDictEntry *e;
+            Scm_HashIterInit(&iter, SCM_HASH_TABLE_CORE(m->internal));
+            while ((e = Scm_HashIterNext(&iter)) != NULL) {
+                ScmGloc *g = SCM_GLOC(SCM_DICT_VALUE(e));
+                ADD_ROOT(SCM_LIST3(SCM_INTERN("global"), SCM_OBJ(m->name),
+                                   SCM_DICT_KEY(e)),
+                         &g->value, &g->value + 1);
+            }
+        }
+        s.nroots = r;
+        if (!heap_table_init(&s.known, 1024)
+            || !heap_table_init(&s.visited, 4096)
+            || !heap_collect_known_classes(&s.known)) {
+            s.oom = TRUE;
+        }
+    } else {
+        s.oom = TRUE;
+    }
+#undef ADD_ROOT
+
+    if (!s.oom) {
+        if (SCM_CLASSP(target)) s.targetClass = target;
+        else s.targetObj = GC_base(target);
+        if (s.targetClass || s.targetObj) {
+            GC_gcollect();
+            GC_disable();
+            GC_call_with_alloc_lock(heap_search_inner, &s);
+            for (int i=0; i<s.nfound && !s.oom; i++) {
+                ScmObj path = SCM_NIL;
+                long n = s.found[i];
+                for (; n >= 0; n = s.nodes[n].parent) {
+                    void *obj = s.nodes[n].obj;
+                    size_t bytes;
+                    int kind = GC_get_kind_and_size(obj, &bytes);
+                    void *k = heap_class_of(&s.known, obj, kind, bytes);
+                    path = Scm_Cons(heap_describe(obj, k, bytes), path);
+                    if (s.nodes[n].parent < 0) {
+                        path = Scm_Cons(Scm_ListRef(labels, s.nodes[n].root,
+                                                    SCM_FALSE),
+                                        path);
+                    }
+                }
+                SCM_APPEND1(h, t, path);
+            }
+            GC_enable();
+        }
+    }
+    heap_table_free(&s.known);
+    heap_table_free(&s.visited);
+    free(s.rootStart);
+    free(s.rootEnd);
+    free(s.found);
+    free(s.nodes);
+    if (s.oom) {
+        Scm_Error("heap retention paths: couldn't allocate working memory");
+    }
+    return h;
+}
+
+/*
+ * Preparing the heap for fork
+ *
+ *   After fork, the children share the parent's pages until they write
+ *   into them.  GC doesn't move objects and keeps its mark bits out of
+ *   the objects, so the pages of the objects that are just read stay
+ *   shared.  The main writer into them is the VM, which memoizes the
+ *   global bindings in the code vectors on the first execution of GREF
+ *   instructions; so we resolve them all beforehand, and collect the
+ *   garbage so that each child needn't.
+ *
+ *   The compiled code in the heap is found by the walk of the marked
+ *   objects; the precompiled code is static, so we find it through the
+ *   closures and methods bound in the modules.  We only accept a block
+ *   as a compiled code if its header matches and it can hold one.
+ */
+
+typedef struct heap_freeze_rec {
+    ScmCompiledCode **codes;
+    size_t ncodes;
+    size_t size;
+    int oom;
+} heap_freeze;
+
+static void GC_CALLBACK heap_freeze_cb(void *obj, size_t bytes, void *data)
+{
+    heap_freeze *f = (heap_freeze*)data;
+    if (bytes < sizeof(ScmCompiledCode)
+        || GC_get_kind_and_size(obj, NULL) == GC_I_PTRFREE
+        || !SCM_XTYPEP(obj, SCM_CLASS_COMPILED_CODE)) {
+        return;
+    }
+    if (f->ncodes == f->size) {
+        size_t nsize = f->size * 2;
+        ScmCompiledCode **v =
+            (ScmCompiledCode**)realloc(f->codes, nsize*sizeof(void*));
+        if (v == NULL) { f->oom = TRUE; return; }
+        f->codes = v;
+        f->size = nsize;
+    }
+    f->codes[f->ncodes++] = (ScmCompiledCode*)obj;
+}
+
+static void *heap_freeze_inner(void *data)
+{
+    GC_enumerate_reachable_objects_inner(heap_freeze_cb, data);
+    return NULL;
+}
+
+static long heap_freeze_procedure(ScmObj v)
+{
+    long count = 0;
+    if (SCM_CLOSUREP(v)) {
+        count += Scm_CompiledCodeResolveGlobals(
+                     SCM_COMPILED_CODE(SCM_CLOSURE(v)->code));
+    } else if (SCM_GENERICP(v)) {
+        ScmObj mp;
+        SCM_FOR_EACH(mp, SCM_GENERIC(v)->methods) {
+            ScmMethod *m = SCM_METHOD(SCM_CAR(mp));
+            if (m->func == NULL && SCM_COMPILED_CODE_P(SCM_OBJ(m->data))) {
+                count += Scm_CompiledCodeResolveGlobals(
+                             SCM_COMPILED_CODE(m->data));
+            }
+        }
+    }
+    return count;
+}
+
+/* Returns the number of global references resolved. */
+long Scm_HeapFreeze(void)
+{
+    heap_freeze f;
+    long count = 0;
+    ScmObj mp;
+
+    SCM_FOR_EACH(mp, Scm_AllModules()) {
+        ScmModule *m = SCM_MODULE(SCM_CAR(mp));
+        ScmHashIter iter;
+        ScmDictEntry *e;
+        Scm_HashIterInit(&iter, SCM_HASH_TABLE_CORE(m->internal));
+        while ((e = Scm_HashIterNext(&iter)) != NULL) {
+            count += heap_freeze_procedure(SCM_GLOC(SCM_DICT_VALUE(e))->value);
+        }
+    }
+
+    memset(&f, 0, sizeof(f));
+    f.size = 1024;
+    if ((f.codes = (ScmCompiledCode**)malloc(f.size*sizeof(void*))) == NULL) {
+        Scm_Error("heap freeze: couldn't allocate working memory");
+    }
+    GC_gcollect();
+    GC_disable();
+    GC_call_with_alloc_lock(heap_freeze_inner, &f);
+    for (size_t i=0; i<f.ncodes; i++) {
+        count += Scm_CompiledCodeResolveGlobals(f.codes[i]);
+    }
+    GC_enable();
+    free(f.codes);
+    if (f.oom) Scm_Error("heap freeze: couldn't allocate working memory");
+    /* Return the pages freed by the collection to OS, if GC is
+       configured to do so, so that the children won't map them. */
+    GC_gcollect_and_unmap();
+    return count;
+}
+
 /*
  * Useful routine for debugging, to check if an object is inadvertently
  * collected.
@@ -302,6 +1137,7 @@ ScmObj Scm_VMFinalizerRun(ScmVM *vm)
 {
     GC_invoke_finalizers();
     vm->finalizerPending = FALSE;
+    gcev_dispatch();
     return SCM_UNDEFINED;
 }
 
@@ -475,12 +475,28 @@ typedef struct ScmInstanceRec {
 #define SCM_STRDUP(s)             GC_STRDUP(s)
 #define SCM_STRDUP_PARTIAL(s, n)  Scm_StrdupPartial(s, n)
 
-#define SCM_NEW(type)         ((type*)(SCM_MALLOC(sizeof(type))))
-#define SCM_NEW_ARRAY(type, nelts) ((type*)(SCM_MALLOC(sizeof(type)*(nelts))))
-#define SCM_NEW2(type, size)  ((type)(SCM_MALLOC(size)))
-#define SCM_NEW_ATOMIC(type)  ((type*)(SCM_MALLOC_ATOMIC(sizeof(type))))
-#define SCM_NEW_ATOMIC_ARRAY(type, nelts)  ((type*)(SCM_MALLOC_ATOMIC(sizeof(type)*(nelts))))
-#define SCM_NEW_ATOMIC2(type, size) ((type)(SCM_MALLOC_ATOMIC(size)))
+/* Allocation sampler hook (see prof.c).  Every allocation through
+   SCM_NEW* family subtracts its size from the countdown, and when it
+   becomes negative the profiler records the allocation site.  While
+   the allocation sampler isn't running, the countdown is so large
+   that it never goes below zero. */
+SCM_EXTERN ScmSmallInt Scm__AllocSampleCountdown;
+SCM_EXTERN void Scm__AllocSample(size_t size, const char *what);
+
+#define SCM__ALLOC_SAMPLE(size, what)                                   \
+    ((Scm__AllocSampleCountdown -= (ScmSmallInt)(size)) < 0             \
+     ? Scm__AllocSample((size), (what)) : (void)0)
+#define SCM__NEW_SAMPLED(size, what) \
+    (SCM__ALLOC_SAMPLE(size, what), SCM_MALLOC(size))
+#define SCM__NEW_ATOMIC_SAMPLED(size, what) \
+    (SCM__ALLOC_SAMPLE(size, what), SCM_MALLOC_ATOMIC(size))
+
+#define SCM_NEW(type)         ((type*)(SCM__NEW_SAMPLED(sizeof(type), #type)))
+#define SCM_NEW_ARRAY(type, nelts) ((type*)(SCM__NEW_SAMPLED(sizeof(type)*(nelts), #type)))
+#define SCM_NEW2(type, size)  ((type)(SCM__NEW_SAMPLED(size, #type)))
+#define SCM_NEW_ATOMIC(type)  ((type*)(SCM__NEW_ATOMIC_SAMPLED(sizeof(type), #type)))
+#define SCM_NEW_ATOMIC_ARRAY(type, nelts)  ((type*)(SCM__NEW_ATOMIC_SAMPLED(sizeof(type)*(nelts), #type)))
+#define SCM_NEW_ATOMIC2(type, size) ((type)(SCM__NEW_ATOMIC_SAMPLED(size, #type)))
 
 typedef void (*ScmFinalizerProc)(ScmObj z, void *data);
 SCM_EXTERN void Scm_RegisterFinalizer(ScmObj z, ScmFinalizerProc finalizer,
@@ -551,7 +567,8 @@ SCM_EXTERN ScmVM *Scm_VM(void);     /* Returns the current VM */
 /* The new APIs to run Scheme code from C.
    Returns # of results (>=0) if operation is successful, 
    -1 if an error is occurred and captured.
-   All result values are available in ScmEvalPacket.
+   The result values are available in ScmEvalPacket; if there are more
+   than SCM_VM_MAX_VALUES, only that many are stored.
    Exceptions are captured and returned in the ScmEvalPacket. */
 typedef struct ScmEvalPacketRec {
     ScmObj results[SCM_VM_MAX_VALUES];
@@ -579,6 +596,8 @@ SCM_EXTERN ScmObj Scm_ApplyRec4(ScmObj proc, ScmObj arg0, ScmObj arg1,
                                 ScmObj arg2, ScmObj arg3);
 SCM_EXTERN ScmObj Scm_ApplyRec5(ScmObj proc, ScmObj arg0, ScmObj arg1,
                                 ScmObj arg2, ScmObj arg3, ScmObj arg4);
+SCM_EXTERN void   Scm_ApplyRecBatch(ScmObj proc, int nargs, int ncalls,
+                                    ScmObj *argv, ScmObj *results);
 
 /* for compatibility */
 #define Scm_EvalCStringRec(f, e)  Scm_EvalRec(Scm_ReadFromCString(f), e)
@@ -607,7 +626,9 @@ SCM_EXTERN ScmObj Scm_VMCall(ScmObj *args, int argcnt, void *data);
 
 SCM_EXTERN ScmObj Scm_VMCallCC(ScmObj proc);
 SCM_EXTERN ScmObj Scm_VMCallPC(ScmObj proc);
+SCM_EXTERN ScmObj Scm_VMCallOneShotCC(ScmObj proc);
 SCM_EXTERN ScmObj Scm_VMDynamicWind(ScmObj pre, ScmObj body, ScmObj post);
+SCM_EXTERN ScmObj Scm_VMCallWithValues(ScmObj producer, ScmObj consumer);
 SCM_EXTERN ScmObj Scm_VMDynamicWindC(ScmSubrProc *before,
                                      ScmSubrProc *body,
                                      ScmSubrProc *after,
@@ -1415,6 +1436,14 @@ struct ScmSubrRec {
                                            to the subr.  This is added when
                                            the :fast-flonum flag is given to
                                            define-cproc. */
+#define SCM_SUBR_LEAF           (1L<<1) /* This subr never passes control to
+                                           the VM, e.g. by Scm_VMApply, so
+                                           that C code can call it directly
+                                           instead of going through the VM.
+                                           Scm_ApplyRec uses it to skip
+                                           setting up a boundary frame.
+                                           This is added when the :leaf flag
+                                           is given to define-cproc. */
 
 #define SCM__DEFINE_SUBR_INT(cvar, req, opt, cst, inf, flags, func, inliner, data) \
     ScmSubr cvar = {                                                        \
@@ -1445,6 +1474,8 @@ SCM_EXTERN ScmObj Scm_Setter(ScmObj proc);
 SCM_EXTERN int    Scm_HasSetter(ScmObj proc);
 
 /* Generic - Generic function */
+#define SCM_GENERIC_DISPATCH_CACHE_SIZE  4
+
 struct ScmGenericRec {
     ScmProcedure common;
     ScmObj methods;             /* list of methods */
@@ -1453,6 +1484,10 @@ struct ScmGenericRec {
     ScmObj (*fallback)(ScmObj *argv, int argc, ScmGeneric *gf);
     void *data;
     ScmInternalMutex lock;
+    void *dispatchCache[SCM_GENERIC_DISPATCH_CACHE_SIZE];
+                                /* sorted applicable methods for recently
+                                   seen argument classes; see class.c */
+    int dispatchNext;           /* next cache entry to replace */
 };
 
 SCM_CLASS_DECL(Scm_GenericClass);
@@ -1659,7 +1694,11 @@ SCM_EXTERN ScmObj Scm_Raise2(ScmObj exception, u_long flags);
 
 /* flags for Scm_Raise */
 enum {
-    SCM_RAISE_NON_CONTINUABLE = (1L<<0)
+    SCM_RAISE_NON_CONTINUABLE = (1L<<0),
+    SCM_RAISE_FROM_VM = (1L<<1) /* internal: the caller is a subr that
+                                   returns the result of Scm_Raise directly
+                                   to the VM, so that the VM may be set up
+                                   to call the handler instead. */
 };
 
 SCM_EXTERN ScmObj Scm_RaiseCondition(ScmObj conditionType, ...);
@@ -1711,6 +1750,10 @@ SCM_EXTERN ScmObj Scm_RegComp(ScmString *pattern, int flags);
 SCM_EXTERN ScmObj Scm_RegCompFromAST(ScmObj ast);
 SCM_EXTERN ScmObj Scm_RegOptimizeAST(ScmObj ast);
 SCM_EXTERN ScmObj Scm_RegExec(ScmRegexp *rx, ScmString *input);
+SCM_EXTERN ScmObj Scm_RegExecRange(ScmRegexp *rx, ScmString *input,
+                                   ScmObj start, ScmObj end);
+SCM_EXTERN int    Scm_RegMatchP(ScmRegexp *rx, ScmString *input,
+                                ScmObj start, ScmObj end);
 SCM_EXTERN void Scm_RegDump(ScmRegexp *rx);
 
 SCM_CLASS_DECL(Scm_RegMatchClass);
@@ -1723,6 +1766,8 @@ SCM_EXTERN ScmObj Scm_RegMatchStart(ScmRegMatch *rm, ScmObj obj);
 SCM_EXTERN ScmObj Scm_RegMatchEnd(ScmRegMatch *rm, ScmObj obj);
 SCM_EXTERN ScmObj Scm_RegMatchAfter(ScmRegMatch *rm, ScmObj obj);
 SCM_EXTERN ScmObj Scm_RegMatchBefore(ScmRegMatch *rm, ScmObj obj);
+SCM_EXTERN ScmObj Scm_RegMatchStartCursor(ScmRegMatch *rm, ScmObj obj);
+SCM_EXTERN ScmObj Scm_RegMatchEndCursor(ScmRegMatch *rm, ScmObj obj);
 SCM_EXTERN void Scm_RegMatchDump(ScmRegMatch *match);
 
 /*-------------------------------------------------------
@@ -1813,6 +1858,14 @@ SCM_EXTERN void Scm_PrintStaticRoots(void);
 SCM_EXTERN void Scm_RegisterDL(void *data_start, void *data_end,
                                void *bss_start, void *bss_end);
 SCM_EXTERN void Scm_GCSentinel(void *obj, const char *name);
+SCM_EXTERN ScmObj Scm_GCEvents(int max);
+SCM_EXTERN ScmObj Scm_GCEventHandler(void);
+SCM_EXTERN void   Scm_SetGCEventHandler(ScmObj handler);
+SCM_EXTERN ScmObj Scm_HeapCensus(int nlargest);
+SCM_EXTERN ScmObj Scm_HeapRetentionPaths(ScmObj target, ScmObj roots,
+                                         ScmObj vms, int maxPaths,
+                                         long maxNodes);
+SCM_EXTERN long   Scm_HeapFreeze(void);
 
 SCM_EXTERN ScmObj Scm_GetFeatures(void);
 SCM_EXTERN void   Scm_AddFeature(const char *feature, const char *mod);
@@ -46,6 +46,8 @@ SCM_EXTERN ScmObj Scm_MakeBignumFromDouble(double val);
 SCM_EXTERN ScmObj Scm_BignumCopy(const ScmBignum *b);
 SCM_EXTERN ScmObj Scm_BignumToString(const ScmBignum *b, int radix,
                                      int use_upper);
+SCM_EXTERN ScmObj Scm_DigitsToInteger(const unsigned char *digs, long len,
+                                      int radix);
 
 SCM_EXTERN long   Scm_BignumToSI(const ScmBignum *b, int clamp, int* oor);
 SCM_EXTERN u_long Scm_BignumToUI(const ScmBignum *b, int clamp, int* oor);
@@ -75,6 +77,7 @@ SCM_EXTERN ScmObj Scm_BignumMulSI(const ScmBignum *bx, long y);
 SCM_EXTERN ScmObj Scm_BignumDivSI(const ScmBignum *bx, long y, long *r);
 SCM_EXTERN ScmObj Scm_BignumDivRem(const ScmBignum *bx, const ScmBignum *by);
 SCM_EXTERN long   Scm_BignumRemSI(const ScmBignum *bx, long y);
+SCM_EXTERN ScmObj Scm_BignumGcd(const ScmBignum *bx, const ScmBignum *by);
 
 SCM_EXTERN ScmObj Scm_BignumLogAnd(const ScmBignum *bx, const ScmBignum *by);
 SCM_EXTERN ScmObj Scm_BignumLogIor(const ScmBignum *bx, const ScmBignum *by);
@@ -119,4 +119,9 @@ SCM_EXTERN int    Scm_BitsLowest0(const ScmBits *bits, int start, int end);
 SCM_EXTERN int    Scm_BitsHighest1(const ScmBits *bits, int start, int end);
 SCM_EXTERN int    Scm_BitsHighest0(const ScmBits *bits, int start, int end);
 
+SCM_EXTERN int    Scm_BitsSelect1(const ScmBits *bits, int start, int end,
+                                  int k);
+SCM_EXTERN int    Scm_BitsSelect0(const ScmBits *bits, int start, int end,
+                                  int k);
+
 #endif /*GAUCHE_BITS_H*/
@@ -48,7 +48,10 @@
 /* Counts '1' bits within a word */
 static inline u_long Scm__CountBitsInWord(u_long word)
 {
-#if SIZEOF_LONG == 4
+#if defined(__GNUC__) && (defined(__POPCNT__) || defined(__aarch64__))
+    /* the target has a popcount instruction */
+    return (u_long)__builtin_popcountl(word);
+#elif SIZEOF_LONG == 4
     word = (word&0x55555555UL) + ((word>>1)&0x55555555UL);
     word = (word&0x33333333UL) + ((word>>2)&0x33333333UL);
     word = (word&0x0f0f0f0fUL) + ((word>>4)&0x0f0f0f0fUL);
@@ -74,6 +77,9 @@ static inline u_long Scm__CountBitsBelow(u_long word, int n)
    there's at least one '1'. */
 static inline int Scm__LowestBitNumber(u_long word)
 {
+#if defined(__GNUC__)
+    return __builtin_ctzl(word);
+#else  /*!__GNUC__*/
     int n = 0;
     word ^= (word&(word-1));    /* leave the rightmost '1' only */
 
@@ -92,12 +98,16 @@ static inline int Scm__LowestBitNumber(u_long word)
     if (word&0xaaaaaaaaaaaaaaaa) n += 1;
 #endif
     return n;
+#endif /*!__GNUC__*/
 }
 
 /* Returns the bit number of the highest '1' bit in the word, assuming
    there's at least one '1'. */
 static inline int Scm__HighestBitNumber(u_long word)
 {
+#if defined(__GNUC__)
+    return SCM_WORD_BITS - 1 - __builtin_clzl(word);
+#else  /*!__GNUC__*/
     int n = 0;
     u_long z;
 
@@ -115,6 +125,7 @@ static inline int Scm__HighestBitNumber(u_long word)
     if ((z = word&0xcccccccccccccccc) != 0) { n += 2;  word = z; }
     return (word&0xaaaaaaaaaaaaaaaa)? n+1 : n;
 #endif
+#endif /*!__GNUC__*/
 }
 
 
@@ -46,6 +46,16 @@
  * the following entries:
  *   #x3040 => #x30ff, #x4e00 => #x9fbf.
  * Lookup is trivial using Scm_TreeCoreClosestEntries.
+ *
+ * A char-set can be made immutable ("frozen") by Scm_CharSetFreeze.
+ * Literal char-sets and predefined char-sets are frozen.  A frozen
+ * char-set keeps the same ranges in a sorted flat array,
+ *   [#x3040, #x30ff, #x4e00, #x9fbf]
+ * and, for the characters below #x10000, a two-level bitmap as well:
+ * bmpIndex[code>>8] is the index of the 256-bit page in bmpPages that
+ * holds the bits of the characters code&~0xff to code|0xff.  Pages
+ * with all bits clear or all bits set are shared.  Characters
+ * beyond that are looked up by binary search in the ranges.
  */
 
 #define SCM_CHAR_SET_SMALL_CHARS 128
@@ -53,7 +63,20 @@
 struct ScmCharSetRec {
     SCM_HEADER;
     ScmBits small[SCM_BITS_NUM_WORDS(SCM_CHAR_SET_SMALL_CHARS)];
-    ScmTreeCore large;
+    u_long flags;
+    union {
+        ScmTreeCore tree;       /* mutable char-set */
+        struct {                /* immutable char-set */
+            ScmSmallInt size;   /* # of ranges */
+            const ScmChar *ranges;
+            const unsigned short *bmpIndex;
+            const ScmBits *bmpPages;
+        } frozen;
+    } large;
+};
+
+enum {
+    SCM_CHAR_SET_IMMUTABLE = (1L<<0)
 };
 
 SCM_CLASS_DECL(Scm_CharSetClass);
@@ -61,8 +84,13 @@ SCM_CLASS_DECL(Scm_CharSetClass);
 #define SCM_CHAR_SET(obj)   ((ScmCharSet*)obj)
 #define SCM_CHAR_SET_P(obj) SCM_XTYPEP(obj, SCM_CLASS_CHAR_SET)
 
-#define SCM_CHAR_SET_SMALLP(obj) \
-    (Scm_TreeCoreNumEntries(&SCM_CHARSET(obj)->large) == 0)
+#define SCM_CHAR_SET_IMMUTABLE_P(obj) \
+    (SCM_CHAR_SET(obj)->flags & SCM_CHAR_SET_IMMUTABLE)
+
+#define SCM_CHAR_SET_SMALLP(obj)                                  \
+    (SCM_CHAR_SET_IMMUTABLE_P(obj)                                \
+     ? (SCM_CHAR_SET(obj)->large.frozen.size == 0)                \
+     : (Scm_TreeCoreNumEntries(&SCM_CHAR_SET(obj)->large.tree) == 0))
 
 /* for backward compatibility.  deprecated. */
 #define SCM_CLASS_CHARSET   SCM_CLASS_CHAR_SET
@@ -78,6 +106,7 @@ SCM_EXTERN ScmObj Scm_CharSetAddRange(ScmCharSet *cs,
 SCM_EXTERN ScmObj Scm_CharSetAdd(ScmCharSet *dest, ScmCharSet *src);
 SCM_EXTERN ScmObj Scm_CharSetComplement(ScmCharSet *cs);
 SCM_EXTERN ScmObj Scm_CharSetCaseFold(ScmCharSet *cs);
+SCM_EXTERN ScmObj Scm_CharSetFreeze(ScmCharSet *cs);
 SCM_EXTERN ScmObj Scm_CharSetRanges(ScmCharSet *cs);
 SCM_EXTERN ScmObj Scm_CharSetRead(ScmPort *input, int *complement_p,
                                   int error_p, int bracket_syntax);
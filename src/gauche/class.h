@@ -144,6 +144,13 @@ SCM_EXTERN ScmObj Scm_ComputeApplicableMethods(ScmGeneric *gf,
                                                int argc,
                                                int applyargs);
 SCM_EXTERN ScmObj Scm_SortMethods(ScmObj methods, ScmObj *argv, int argc);
+SCM_EXTERN u_long Scm__GenericDispatchEpoch(void);
+SCM_EXTERN ScmObj Scm__GenericDispatchCacheLookup(ScmGeneric *gf,
+                                                  ScmObj *argv, int argc);
+SCM_EXTERN void   Scm__GenericDispatchCacheStore(ScmGeneric *gf,
+                                                 ScmObj *argv, int argc,
+                                                 u_long epoch,
+                                                 ScmObj methods);
 SCM_EXTERN ScmObj Scm_MakeNextMethod(ScmGeneric *gf, ScmObj methods,
                                      ScmObj *argv, int argc,
                                      int copyargs, int applyargs);
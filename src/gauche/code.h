@@ -89,6 +89,9 @@ struct ScmCompiledCodeRec {
  *       <offset> is either an instruction offset or 'definition (for the
  *       entire closure).
  *       At this moment, only used <info> is (source-info . <source>).
+ *       If the code is compiled with SCM_COMPILE_PACK_SOURCE_INFO, this
+ *       is an incomplete string that holds the above in a serialized
+ *       form.  Use Scm_CompiledCodeDebugInfo() to get the list.
  *   *4) (<signature> <info> ...)
  *       <signature> is (<procedure-name> <formal> ...)
  *       <procedure-name> may be just a symbol, or a list (in case of internal
@@ -129,9 +132,17 @@ SCM_EXTERN void   Scm_CompiledCodeCopyX(ScmCompiledCode *dest,
                                         const ScmCompiledCode *src);
 SCM_EXTERN void   Scm_CompiledCodeDump(ScmCompiledCode *cc);
 SCM_EXTERN ScmObj Scm_CompiledCodeToList(ScmCompiledCode *cc);
+SCM_EXTERN long   Scm_CompiledCodeResolveGlobals(ScmCompiledCode *cc);
 SCM_EXTERN ScmObj Scm_CompiledCodeFullName(ScmCompiledCode *cc);
+SCM_EXTERN ScmObj Scm_CompiledCodeDebugInfo(ScmCompiledCode *cc);
+SCM_EXTERN ScmObj Scm_CompiledCodeMemoryUsage(ScmObj roots);
 SCM_EXTERN void   Scm_VMExecuteToplevels(ScmCompiledCode *cv[]);
 
+/* Serialization for the bytecode cache */
+SCM_EXTERN int    Scm_CodeCacheWrite(ScmObj obj, ScmPort *port);
+SCM_EXTERN ScmObj Scm_CodeCacheRead(ScmPort *port);
+SCM_EXTERN ScmObj Scm_CodeCacheDigest(ScmPort *port);
+
 /*
  * VM instructions
  */
@@ -102,6 +102,8 @@ SCM_EXTERN ScmObj Scm_ComparatorHashFunction(ScmComparator *);
 /* Other genreic utilities */
 SCM_EXTERN int    Scm_Compare(ScmObj x, ScmObj y);
 SCM_EXTERN void   Scm_SortArray(ScmObj *elts, int nelts, ScmObj cmpfn);
+SCM_EXTERN void   Scm_StableSortArray(ScmObj *elts, ScmObj *keys, int nelts);
+SCM_EXTERN void   Scm_UVectorSortX(ScmUVector *v);
 SCM_EXTERN ScmObj Scm_SortList(ScmObj objs, ScmObj fn);
 SCM_EXTERN ScmObj Scm_SortListX(ScmObj objs, ScmObj fn);
 
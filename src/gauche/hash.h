@@ -51,6 +51,19 @@ typedef enum {
     SCM_HASH_WORD
 } ScmHashType;
 
+/* Storage layout of ScmHashCore.
+   The chained layout keeps each entry in a separate cell and works with
+   all the hash types.  The open addressing layout keeps entries in a
+   flat array; it is faster and takes less memory, but is only available
+   for SCM_HASH_EQ, SCM_HASH_EQV, SCM_HASH_STRING and SCM_HASH_WORD.
+   Note that with the open addressing layout, an ScmDictEntry returned
+   from Scm_HashCoreSearch can be moved when another entry is added to
+   the same table.  Don't keep it across such operation. */
+typedef enum {
+    SCM_HASH_CHAINED,
+    SCM_HASH_OPEN_ADDRESSING
+} ScmHashLayout;
+
 typedef struct ScmHashCoreRec ScmHashCore;
 typedef struct ScmHashIterRec ScmHashIter;
 
@@ -72,6 +85,13 @@ struct ScmHashCoreRec {
     ScmHashProc          *hashfn;
     ScmHashCompareProc   *cmpfn;
     void *data;
+    ScmHashLayout layout;
+    int numDeleted;             /* open addressing: # of deleted slots */
+    void **oldBuckets;          /* chained: buckets being migrated */
+    int oldNumBuckets;
+    int oldNumBucketsLog2;
+    int migrated;               /* # of oldBuckets already migrated */
+    void *stats;                /* access statistics; NULL if disabled */
 };
 
 SCM_EXTERN void Scm_HashCoreInitSimple(ScmHashCore *core,
@@ -85,6 +105,12 @@ SCM_EXTERN void Scm_HashCoreInitGeneral(ScmHashCore *core,
                                         unsigned int initSize,
                                         void *data);
 
+SCM_EXTERN void Scm_HashCoreInitLayout(ScmHashCore *core,
+                                       ScmHashType type,
+                                       ScmHashLayout layout,
+                                       unsigned int initSize,
+                                       void *data);
+
 SCM_EXTERN int  Scm_HashCoreTypeToProcs(ScmHashType type,
                                         ScmHashProc **hashfn,
                                         ScmHashCompareProc **cmpfn);
@@ -96,8 +122,12 @@ SCM_EXTERN ScmDictEntry *Scm_HashCoreSearch(ScmHashCore *core,
                                             ScmDictOp op);
 
 SCM_EXTERN int  Scm_HashCoreNumEntries(ScmHashCore *core);
+SCM_EXTERN void Scm_HashCoreInstrument(ScmHashCore *core, int enable);
 
 SCM_EXTERN void Scm_HashCoreClear(ScmHashCore *core);
+SCM_EXTERN int  Scm_HashCoreSweep(ScmHashCore *core,
+                                  int (*pred)(ScmDictEntry*, void*),
+                                  void *data, int *cursor, int count);
 
 struct ScmHashIterRec {
     ScmHashCore *core;
@@ -111,11 +141,20 @@ SCM_EXTERN ScmDictEntry *Scm_HashIterNext(ScmHashIter *iter);
 /*
  * Hash functions
  */
+
+/* Default-hash looks into aggregates at most this deep, and at most
+   this many objects in total. */
+#define SCM_DEFAULT_HASH_MAX_DEPTH  16
+#define SCM_DEFAULT_HASH_MAX_NODES  1024
+
 SCM_EXTERN u_long Scm_EqHash(ScmObj obj);
 SCM_EXTERN u_long Scm_EqvHash(ScmObj obj);
 SCM_EXTERN u_long Scm_HashString(ScmString *str, u_long bound);
+SCM_EXTERN u_long Scm_HashBytes(const void *p, ScmSmallInt size, u_long seed);
 SCM_EXTERN u_long Scm_PortableHash(ScmObj obj, u_long salt);
 SCM_EXTERN ScmSmallInt Scm_DefaultHash(ScmObj obj);
+SCM_EXTERN ScmSmallInt Scm_DefaultHashBounded(ScmObj obj, int maxdepth,
+                                              long maxnodes);
 SCM_EXTERN u_long Scm_CombineHashValue(u_long a, u_long b);
 
 SCM_EXTERN ScmSmallInt Scm_HashSaltRef(void);
@@ -145,6 +184,9 @@ SCM_CLASS_DECL(Scm_HashTableClass);
 
 SCM_EXTERN ScmObj Scm_MakeHashTableSimple(ScmHashType type,
                                           unsigned int initSize);
+SCM_EXTERN ScmObj Scm_MakeHashTableLayout(ScmHashType type,
+                                          ScmHashLayout layout,
+                                          unsigned int initSize);
 SCM_EXTERN ScmObj Scm_MakeHashTableFull(ScmHashProc *hashfn,
                                         ScmHashCompareProc *cmpfn,
                                         unsigned int initSize,
@@ -69,6 +69,14 @@ struct ScmModuleRec {
     ScmObj info;                /* alist of metainfo; e.g.
                                    (source-info . <string>) */
     int    sealed;              /* if true, no modification is allowed */
+    ScmHashTable *cache;        /* Symbol -> GLoc or #f.  Caches the result
+                                   of Scm_FindBinding without flags.  Valid
+                                   while cacheEpoch matches the global
+                                   binding epoch.  See module.c. */
+    u_long cacheEpoch;
+    void *lazy;                 /* Bindings registered by
+                                   Scm_MakeLazyBinding and not yet
+                                   looked up.  See module.c. */
 };
 
 #define SCM_MODULE(obj)       ((ScmModule*)(obj))
@@ -102,6 +110,29 @@ SCM_EXTERN void   Scm_HideBinding(ScmModule *module, ScmSymbol *symbol);
 SCM_EXTERN int    Scm_AliasBinding(ScmModule *target, ScmSymbol *targetName,
                                    ScmModule *origin, ScmSymbol *originName);
 
+/* Lazy binding.  The stub generator registers the subrs of define-cproc
+   this way, so that loading a big extension doesn't create the symbols
+   and glocs of the procedures the program doesn't use.  The binding is
+   made, as if by Scm_MakeBinding, when the name is first looked up in
+   the module.  The record must be static; NAME is the Scheme name in
+   the native encoding, and FLAGS are passed to Scm_MakeBinding.
+   The other fields are used by module.c.  */
+typedef struct ScmLazyBindingRec {
+    const char *name;
+    ScmObj value;
+    int flags;
+    int nameSize;
+    struct ScmLazyBindingRec *next;
+} ScmLazyBinding;
+
+#define SCM_LAZY_BINDING_INITIALIZER(name, value, flags) \
+    { (name), (value), (flags), -1, NULL }
+
+SCM_EXTERN void   Scm_MakeLazyBinding(ScmModule *module,
+                                      ScmLazyBinding *binding);
+SCM_EXTERN void   Scm_MaterializeLazyBindings(ScmModule *module);
+SCM_EXTERN ScmObj Scm_ModuleLazyBindings(ScmModule *module);
+
 /* Convenience API.  Wrapper of Scm_MakeBinding. */
 SCM_EXTERN ScmObj Scm_Define(ScmModule *module,
                              ScmSymbol *symbol,
@@ -123,6 +154,7 @@ SCM_EXTERN void   Scm_SelectModule(ScmModule *mod);
 SCM_EXTERN ScmObj Scm_ModuleExports(ScmModule *mod);
 
 SCM_EXTERN void   Scm_ModuleSeal(ScmModule *mod);
+SCM_EXTERN ScmObj Scm_ModuleBindingCacheStat(void);
 
 /* Flags for Scm_FindModule
    NB: Scm_FindModule's second arg has been changed since 0.8.6;
@@ -244,6 +244,10 @@ SCM_EXTERN ScmObj Scm_ReduceRational(ScmObj rational);
 
 SCM_EXTERN ScmObj Scm_MakeFlonum(double d);
 SCM_EXTERN double Scm_GetDouble(ScmObj obj);
+/* Inlines the common case of Scm_GetDouble.  Used by stubs to unbox
+   <real> arguments.  OBJ is evaluated more than once. */
+#define SCM_GET_DOUBLE(obj) \
+    (SCM_FLONUMP(obj)? SCM_FLONUM_VALUE(obj) : Scm_GetDouble(obj))
 SCM_EXTERN ScmObj Scm_DecodeFlonum(double d, int *exp, int *sign);
 SCM_EXTERN int    Scm_FlonumSign(double d);
 SCM_EXTERN ScmObj Scm_MakeFlonumToNumber(double d, int exactp);
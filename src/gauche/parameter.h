@@ -75,7 +75,9 @@ SCM_EXTERN void   Scm_MakeParameterSlot(ScmVM *vm, ScmParameterLoc *location /*o
 
 typedef struct ScmVMParameterTableRec {
     int size;
-    int dummy_;                 /* for ABI */
+    int shared;                 /* TRUE if VECTOR may be shared with other
+                                   threads; it must be copied before
+                                   modification. */
     ScmObj *vector;
     void *dummy2_;              /* for ABI */
 } ScmVMParameterTable;
@@ -135,7 +135,7 @@ struct ScmPortRec {
     u_int closed    : 1;        /* TRUE if this port is closed */
     u_int error     : 1;        /* Error has been occurred */
 
-    u_int flags     : 5;        /* see ScmPortFlags below */
+    u_int flags     : 8;        /* see ScmPortFlags below */
 
     char scratch[SCM_CHAR_MAX_BYTES]; /* incomplete buffer */
 
@@ -146,6 +146,10 @@ struct ScmPortRec {
     ScmInternalFastlock lock;   /* for port mutex */
     ScmVM *lockOwner;           /* for port mutex; owner of the lock */
     int lockCount;              /* for port mutex; # of recursive locks */
+    struct ScmLockStatRec *lockStat; /* for lock contention profiler.
+                                        NULL unless it's enabled. */
+    struct ScmPortStatRec *ioStat;   /* for I/O statistics.  NULL unless
+                                        it's enabled. */
 
     ScmWriteState *writeState;  /* used internally */
 
@@ -172,6 +176,11 @@ struct ScmPortRec {
         ScmPortVTable vt;       /* virtual port */
     } src;
 
+    /* While the filler lends its data as the buffer of an input buffered
+       port (see Scm_PortLendBuffer), the port's own buffer is kept here. */
+    char *ownBuffer;
+    int ownBufferSize;
+
     /* Port attibutes.
      * NB: Before we release 0.9.4, we might merge this into port->data and/or
      * port->name.
@@ -227,8 +236,18 @@ enum ScmPortFlags {
                                    of two-pass writing. */
     SCM_PORT_PRIVATE = (1L<<2), /* this port is for 'private' use within
                                    a thread, so never need to be locked. */
-    SCM_PORT_CASE_FOLD = (1L<<3) /* read from or write to this port should
+    SCM_PORT_CASE_FOLD = (1L<<3), /* read from or write to this port should
                                     be case folding. */
+    SCM_PORT_MAPPED = (1L<<4),  /* input string port over a mapped file
+                                   image.  See Scm_OpenMappedInputFile. */
+    SCM_PORT_POOLED_BUFFER = (1L<<5), /* the buffer is taken from the buffer
+                                   pool, and returned on close. */
+    SCM_PORT_NONBLOCKING = (1L<<6), /* the underlying fd is in non-blocking
+                                   mode.  See Scm_SetPortNonblocking. */
+    SCM_PORT_WOULDBLOCK = (1L<<7), /* the last fill or flush stopped since
+                                   the fd would block. */
+    SCM_PORT_LENT_BUFFER = (1L<<8) /* the buffer is the filler's data, read
+                                   in place.  See Scm_PortLendBuffer. */
 };
 
 #if 0 /* not implemented */
@@ -259,6 +278,7 @@ enum ScmPortICPolicy {
 #define SCM_PORT_ICPOLICY(obj)  (SCM_PORT(obj)->icpolicy)
 
 #define SCM_PORT_CASE_FOLDING(obj) (SCM_PORT_FLAGS(obj)&SCM_PORT_CASE_FOLD)
+#define SCM_PORT_WOULDBLOCK_P(obj) (SCM_PORT_FLAGS(obj)&SCM_PORT_WOULDBLOCK)
 
 #define SCM_PORT_CLOSED_P(obj)  (SCM_PORT(obj)->closed)
 #define SCM_PORT_OWNER_P(obj)   (SCM_PORT(obj)->ownerp)
@@ -322,6 +342,41 @@ SCM_EXTERN ScmObj Scm_PortSeek(ScmPort *port, ScmObj off, int whence);
 SCM_EXTERN ScmObj Scm_PortSeekUnsafe(ScmPort *port, ScmObj off, int whence);
 SCM_EXTERN int    Scm_PortFileNo(ScmPort *port);
 SCM_EXTERN void   Scm_PortFdDup(ScmPort *dst, ScmPort *src);
+SCM_EXTERN void   Scm_WriteChunks(ScmObj chunks, ScmPort *port);
+SCM_EXTERN void   Scm_WriteTree(ScmObj tree, ScmPort *port, ScmObj fallback);
+SCM_EXTERN void   Scm_WriteHTMLEscaped(ScmString *s, ScmPort *port);
+SCM_EXTERN void   Scm_PortConfine(ScmPort *port);
+SCM_EXTERN int    Scm_PortConfinedP(ScmPort *port);
+SCM_EXTERN void   Scm_SetPortNonblocking(ScmPort *port, int flag);
+SCM_EXTERN int    Scm_PortNonblockingP(ScmPort *port);
+SCM_EXTERN int    Scm_PortWouldBlockP(ScmPort *port);
+SCM_EXTERN int    Scm_PortOutputPending(ScmPort *port);
+
+/* I/O statistics.  While enabled by Scm_PortStatStart, buffered ports
+   count the traffic between the buffer and the underlying device.
+   The record is allocated on the port when it first does such I/O
+   while enabled, and all records are chained for the report.
+   Syscalls and the time blocked in them are counted only for file
+   ports; other buffered ports (e.g. ones made by Scm_MakeBufferedPort)
+   count the filler/flusher calls instead. */
+typedef struct ScmPortStatRec {
+    struct ScmWeakBoxRec *port; /* the port itself */
+    ScmUInt64 bytesRead;        /* bytes filled to the buffer */
+    ScmUInt64 bytesWritten;     /* bytes flushed from the buffer */
+    u_long fills;               /* # of bufport_fill calls */
+    u_long flushes;             /* # of bufport_flush calls */
+    u_long syscalls;            /* # of read/write/writev calls */
+    double blockTime;           /* seconds spent in the syscalls */
+    u_long modeChanges;         /* # of buffering mode changes */
+    struct ScmPortStatRec *next;
+} ScmPortStat;
+
+SCM_EXTERN void   Scm_PortStatStart(void);
+SCM_EXTERN void   Scm_PortStatStop(void);
+SCM_EXTERN int    Scm_PortStatRunningP(void);
+SCM_EXTERN void   Scm_PortStatReset(void);
+SCM_EXTERN ScmObj Scm_PortStatistics(ScmPort *port);
+SCM_EXTERN ScmObj Scm_PortStatResult(void);
 SCM_EXTERN int    Scm_FdReady(int fd, int dir);
 SCM_EXTERN int    Scm_ByteReady(ScmPort *port);
 SCM_EXTERN int    Scm_ByteReadyUnsafe(ScmPort *port);
@@ -380,6 +435,14 @@ SCM_EXTERN ScmObj Scm_UngottenBytesUnsafe(ScmPort *port);
 
 SCM_EXTERN ScmObj Scm_ReadLine(ScmPort *port);
 SCM_EXTERN ScmObj Scm_ReadLineUnsafe(ScmPort *port);
+SCM_EXTERN const char *Scm_ReadLineView(ScmPort *port, ScmSmallInt *size);
+SCM_EXTERN const char *Scm_ReadLineViewUnsafe(ScmPort *port,
+                                              ScmSmallInt *size);
+SCM_EXTERN ScmObj Scm_ReadUntilDelimiter(ScmPort *port, ScmCharSet *cs);
+SCM_EXTERN ScmObj Scm_ReadUntilDelimiterUnsafe(ScmPort *port,
+                                               ScmCharSet *cs);
+SCM_EXTERN ScmObj Scm_ReadString(ScmPort *port, ScmSmallInt nchars);
+SCM_EXTERN ScmObj Scm_ReadStringUnsafe(ScmPort *port, ScmSmallInt nchars);
 
 #if 0
 #define SCM_PORT_CURIN  (1<<0)
@@ -396,6 +459,8 @@ SCM_EXTERN ScmObj Scm_WithPort(ScmPort *port[], ScmObj thunk,
 
 SCM_EXTERN ScmObj Scm_OpenFilePort(const char *path, int flags,
                                    int buffering, int perm);
+SCM_EXTERN ScmObj Scm_OpenFilePortFull(const char *path, int flags,
+                                       int buffering, int perm, int bufsize);
 
 SCM_EXTERN ScmObj Scm_Stdin(void);
 SCM_EXTERN ScmObj Scm_Stdout(void);
@@ -422,8 +487,13 @@ SCM_EXTERN ScmObj Scm_MakeOutputStringPort(int privatep);
 
 SCM_EXTERN ScmObj Scm_GetOutputString(ScmPort *port, int flags);
 SCM_EXTERN ScmObj Scm_GetOutputStringUnsafe(ScmPort *port, int flags);
+SCM_EXTERN ScmObj Scm_TakeOutputString(ScmPort *port, int flags);
 SCM_EXTERN ScmObj Scm_GetRemainingInputString(ScmPort *port, int flags);
 
+SCM_EXTERN ScmObj Scm_OpenMappedInputFile(const char *path, int privatep);
+SCM_EXTERN ScmObj Scm_PortMappedView(ScmPort *port, ScmSmallInt start,
+                                     ScmSmallInt end, int as_string);
+
 /*================================================================
  * Other type of ports
  */
@@ -440,6 +510,14 @@ SCM_EXTERN ScmObj Scm_MakePortWithFd(ScmObj name,
                                      int fd,
                                      int bufmode,
                                      int ownerp);
+SCM_EXTERN ScmObj Scm_MakePortWithFdFull(ScmObj name,
+                                         int direction,
+                                         int fd,
+                                         int bufmode,
+                                         int bufsize,
+                                         int ownerp);
+SCM_EXTERN int    Scm_PortBufferPoolCount(void);
+SCM_EXTERN int    Scm_PortLendBuffer(ScmPort *port, char *data, int size);
 SCM_EXTERN ScmObj Scm_MakeCodingAwarePort(ScmPort *iport);
 SCM_EXTERN ScmObj Scm_MakeWriterPort(ScmPort *port, ScmObj context);
 
@@ -60,13 +60,28 @@ typedef struct ScmSyntaxRuleBranchRec {
     ScmObj templat;             /* template to be expanded */
     int numPvars;               /* # of pattern variables */
     int maxLevel;               /* maximum # of nested subpatterns */
+    int minArgs;                /* minimum # of args the pattern accepts */
+    int maxArgs;                /* maximum # of args, or -1 if unlimited */
 } ScmSyntaxRuleBranch;
 
+/* Recent matches of syntax-rules.  See synrule_expand(). */
+typedef struct ScmSyntaxRulesMemoRec {
+    ScmObj form;
+    ScmObj mod;
+    ScmObj env;
+    u_long epoch;
+    int rule;                   /* index of the matched rule */
+    void *mvec;                 /* MatchVar*; see macro.c */
+} ScmSyntaxRulesMemo;
+
+#define SCM_SYNTAX_RULES_MEMO_SIZE  8
+
 typedef struct ScmSyntaxRules {
     SCM_HEADER;
     ScmObj name;                  /* name of the macro (for debug) */
     int numRules;                 /* # of rules */
     int maxNumPvars;              /* max # of pattern variables */
+    ScmSyntaxRulesMemo *memo[SCM_SYNTAX_RULES_MEMO_SIZE];
     ScmSyntaxRuleBranch rules[1]; /* variable length */
 } ScmSyntaxRules;
 
@@ -40,4 +40,7 @@ SCM_EXTERN ScmModule *Scm__RequireBaseModule(void);
 
 SCM_EXTERN ScmObj Scm__MakeWrapperModule(ScmModule *origin, ScmObj prefix);
 
+/* Incremented whenever global binding resolution may change */
+SCM_EXTERN u_long Scm__ModuleBindingEpoch(void);
+
 #endif /*GAUCHE_PRIV_MODULEP_H*/
@@ -35,6 +35,7 @@
 #define GAUCHE_PRIV_PORTP_H
 
 #include "gauche/priv/writerP.h"
+#include "gauche/prof.h"
 
 /*================================================================
  * Some private APIs
@@ -42,6 +43,10 @@
 
 SCM_EXTERN void Scm__InstallCodingAwarePortHook(ScmPort *(*)(ScmPort*, const char*));
 
+/* Pooled private output string ports.  See port.c */
+SCM_EXTERN ScmPort *Scm__AcquireOutputStringPort(void);
+SCM_EXTERN ScmObj   Scm__ReleaseOutputStringPort(ScmPort *port, int flags);
+
 /* Windows-specific initialization */
 #if defined(GAUCHE_WINDOWS)
 void Scm__SetupPortsForWindows(int has_console);
@@ -100,6 +105,7 @@ void Scm__SetupPortsForWindows(int has_console);
 #define PORT_LOCK(p, vm)                                        \
     do {                                                        \
       if (p->lockOwner != vm) {                                 \
+          double wait__ = 0;                                    \
           for (;;) {                                            \
               ScmVM* owner__;                                   \
               (void)SCM_INTERNAL_FASTLOCK_LOCK(p->lock);        \
@@ -111,8 +117,18 @@ void Scm__SetupPortsForWindows(int has_console);
               }                                                 \
               (void)SCM_INTERNAL_FASTLOCK_UNLOCK(p->lock);      \
               if (p->lockOwner == vm) break;                    \
+              if (p->flags & SCM_PORT_PRIVATE) {                \
+                  Scm__PortConfinementError(p);                 \
+              }                                                 \
+              if (SCM_LOCK_STAT_ENABLED() && wait__ == 0) {     \
+                  wait__ = Scm__LockStatNow();                  \
+              }                                                 \
               Scm_YieldCPU();                                   \
           }                                                     \
+          if (SCM_LOCK_STAT_ENABLED()) {                        \
+              Scm__LockStatAcquired(&p->lockStat, SCM_OBJ(p),   \
+                                    wait__);                    \
+          }                                                     \
       } else {                                                  \
           p->lockCount++;                                       \
       }                                                         \
@@ -122,6 +138,9 @@ void Scm__SetupPortsForWindows(int has_console);
 #define PORT_UNLOCK(p)                                  \
     do {                                                \
         if (--p->lockCount <= 0) {                      \
+            if (p->lockStat) {                          \
+                Scm__LockStatReleased(p->lockStat);     \
+            }                                           \
             SCM_INTERNAL_SYNC();                        \
             p->lockOwner = NULL;                        \
         } \
@@ -149,13 +168,19 @@ void Scm__SetupPortsForWindows(int has_console);
 
 /* Should be used in the constructor of private ports.
    Mark the port locked by vm, so that it can be used exclusively by
-   the vm. */
+   the vm.  The public API checks PORT_LOCKED first and goes directly
+   to the unsafe version, so the private ports never touch the lock.
+   Other threads trying to lock the port get an error, instead of
+   waiting forever. */
 
 #define PORT_PRELOCK(p, vm)                     \
    do {                                         \
      p->lockOwner = vm;                         \
      p->lockCount = 1;                          \
+     p->flags |= SCM_PORT_PRIVATE;              \
    } while (0)
 
+SCM_EXTERN void Scm__PortConfinementError(ScmPort *p);
+
 
 #endif /*GAUCHE_PRIV_PORTP_H*/
@@ -0,0 +1,115 @@
+/*
+ * probeP.h - Static tracing probes
+ *
+ *   Copyright (c) 2015  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef GAUCHE_PRIV_PROBEP_H
+#define GAUCHE_PRIV_PROBEP_H
+
+/*
+ * When configured with --enable-dtrace, we embed USDT probes of the
+ * provider 'gauche' using <sys/sdt.h>, so that SystemTap, bpftrace,
+ * perf etc. can attach to them.  A probe site is just a nop until
+ * a tracer attaches to it.
+ *
+ * Each probe has a semaphore, which the tracer increments while it is
+ * attached.  We check it with SCM_PROBE_ENABLED before computing
+ * arguments that aren't free, e.g. procedure names.  The semaphore must
+ * be defined, by SCM_PROBE_DEFINE_SEMAPHORE, in the same shared object
+ * as the probe site: the ones of libgauche are in vm.c.
+ *
+ * Probes (arguments in parentheses):
+ *   procedure__entry   (const char *name, ScmCompiledCode *code)
+ *   procedure__return  (const char *name, ScmCompiledCode *code)
+ *   gc__start          ()
+ *   gc__end            ()
+ *   load__start        (const char *path)
+ *   load__end          (const char *path)
+ *   exception__raise   (const char *class_name, ScmObj exception)
+ *   thread__start      (ScmVM *vm, const char *name)   -- gauche.threads
+ *   thread__stop       (ScmVM *vm, const char *name)   -- gauche.threads
+ *
+ * Without --enable-dtrace, all of these expand to nothing.
+ */
+
+#if defined(GAUCHE_USE_SDT)
+
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+#define SCM_PROBE_SEMAPHORE(name)  gauche_##name##_semaphore
+
+#define SCM_PROBE_DEFINE_SEMAPHORE(name)                        \
+    unsigned short SCM_PROBE_SEMAPHORE(name)                    \
+        __attribute__((unused)) __attribute__((section(".probes")))
+
+#define SCM_PROBE_DECLARE_SEMAPHORE(name)                       \
+    extern unsigned short SCM_PROBE_SEMAPHORE(name)
+
+#define SCM_PROBE_ENABLED(name) \
+    (__builtin_expect(SCM_PROBE_SEMAPHORE(name) != 0, 0))
+
+#define SCM_PROBE0(name)            STAP_PROBE(gauche, name)
+#define SCM_PROBE1(name, a)         STAP_PROBE1(gauche, name, a)
+#define SCM_PROBE2(name, a, b)      STAP_PROBE2(gauche, name, a, b)
+
+SCM_PROBE_DECLARE_SEMAPHORE(procedure__entry);
+SCM_PROBE_DECLARE_SEMAPHORE(procedure__return);
+SCM_PROBE_DECLARE_SEMAPHORE(gc__start);
+SCM_PROBE_DECLARE_SEMAPHORE(gc__end);
+SCM_PROBE_DECLARE_SEMAPHORE(load__start);
+SCM_PROBE_DECLARE_SEMAPHORE(load__end);
+SCM_PROBE_DECLARE_SEMAPHORE(exception__raise);
+
+/* Returns a printable name of the compiled code, for the probes.
+   Defined in vm.c. */
+SCM_EXTERN const char *Scm__ProbeCodeName(ScmCompiledCode *code);
+
+#define SCM_PROBE_PROCEDURE(name, code)                                 \
+    do {                                                                \
+        if (SCM_PROBE_ENABLED(name) && (code) != NULL) {               \
+            SCM_PROBE2(name, Scm__ProbeCodeName(code), (code));         \
+        }                                                               \
+    } while (0)
+
+#else  /*!GAUCHE_USE_SDT*/
+
+#define SCM_PROBE_DEFINE_SEMAPHORE(name)   /* nothing */
+#define SCM_PROBE_DECLARE_SEMAPHORE(name)  /* nothing */
+#define SCM_PROBE_ENABLED(name)            FALSE
+#define SCM_PROBE0(name)                   /* nothing */
+#define SCM_PROBE1(name, a)                /* nothing */
+#define SCM_PROBE2(name, a, b)             /* nothing */
+#define SCM_PROBE_PROCEDURE(name, code)    /* nothing */
+
+#endif /*!GAUCHE_USE_SDT*/
+
+#endif /*GAUCHE_PRIV_PROBEP_H*/
@@ -0,0 +1,129 @@
+/*
+ * sortP.h - Orderings shared by sort kernels
+ *
+ *   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef GAUCHE_PRIV_SORTP_H
+#define GAUCHE_PRIV_SORTP_H
+
+#include <string.h>
+
+/* Used by the sort kernels in compare.c, and by the parallel sort
+   in ext/threads.  Keys of these kinds can be compared without calling
+   back to Scheme, hence from any thread. */
+
+enum {
+    SORT_KEY_GENERIC,
+    SORT_KEY_FIXNUM,
+    SORT_KEY_FLONUM,
+    SORT_KEY_STRING,
+    SORT_KEY_SYMBOL
+};
+
+/* Examine keys.  We need every stride-th element starting from keys[0]. */
+static inline int sort_key_kind(ScmObj *keys, int nkeys, int stride)
+{
+    ScmObj k0 = keys[0];
+    int kind;
+    if (SCM_INTP(k0))         kind = SORT_KEY_FIXNUM;
+    else if (SCM_FLONUMP(k0)) kind = SORT_KEY_FLONUM;
+    else if (SCM_STRINGP(k0)) kind = SORT_KEY_STRING;
+    else if (SCM_SYMBOLP(k0)) kind = SORT_KEY_SYMBOL;
+    else return SORT_KEY_GENERIC;
+
+    for (int i=0; i<nkeys; i++) {
+        ScmObj k = keys[i*stride];
+        switch (kind) {
+        case SORT_KEY_FIXNUM:
+            if (!SCM_INTP(k)) return SORT_KEY_GENERIC;
+            break;
+        case SORT_KEY_FLONUM:
+            /* NaN doesn't have an order; leave it to Scm_Compare. */
+            if (!SCM_FLONUMP(k)) return SORT_KEY_GENERIC;
+            double d = SCM_FLONUM_VALUE(k);
+            if (d != d) return SORT_KEY_GENERIC;
+            break;
+        case SORT_KEY_STRING:
+            if (!SCM_STRINGP(k)) return SORT_KEY_GENERIC;
+            break;
+        case SORT_KEY_SYMBOL:
+            /* uninterned symbols need extra ordering rules */
+            if (!SCM_SYMBOLP(k) || !SCM_SYMBOL_INTERNED(k))
+                return SORT_KEY_GENERIC;
+            break;
+        }
+    }
+    return kind;
+}
+
+#define LESS_FIXNUM(x, y)  (SCM_INT_VALUE(x) < SCM_INT_VALUE(y))
+#define LESS_FLONUM(x, y)  (SCM_FLONUM_VALUE(x) < SCM_FLONUM_VALUE(y))
+#define LESS_STRING(x, y)  (Scm_StringCmp(SCM_STRING(x), SCM_STRING(y)) < 0)
+#define LESS_SYMBOL(x, y)  (Scm_StringCmp(SCM_SYMBOL_NAME(x),          \
+                                          SCM_SYMBOL_NAME(y)) < 0)
+#define LESS_GENERIC(x, y) (Scm_Compare(x, y) < 0)
+
+/* Key mappings.  Flipping the sign bit turns a two's complement integer
+   into an unsigned one of the same order.  For IEEE floating point
+   numbers, we also flip the other bits of negative numbers; it makes
+   -0.0 less than 0.0, and puts NaNs at either end depending on their
+   sign bits. */
+#define SIGNED_KEY(UT, v)   ((UT)(v) ^ ((UT)1 << (sizeof(UT)*8-1)))
+#define FLOAT_KEY(UT, u)                                                \
+    (((u) >> (sizeof(UT)*8-1))? ~(u) : (u) ^ ((UT)1 << (sizeof(UT)*8-1)))
+
+static inline ScmUInt32 f32_key(float f)
+{
+    ScmUInt32 u;
+    memcpy(&u, &f, sizeof(u));
+    return FLOAT_KEY(ScmUInt32, u);
+}
+
+static inline ScmUInt64 f64_key(double f)
+{
+    ScmUInt64 u;
+    memcpy(&u, &f, sizeof(u));
+    return FLOAT_KEY(ScmUInt64, u);
+}
+
+/* Fixnums keep their order as machine words, for they share the tag. */
+#define FIXNUM_KEY(v)  SIGNED_KEY(uintptr_t, SCM_WORD(v))
+#define S8_KEY(v)      SIGNED_KEY(u_char, v)
+#define U8_KEY(v)      (v)
+#define S16_KEY(v)     SIGNED_KEY(u_short, v)
+#define U16_KEY(v)     (v)
+#define S32_KEY(v)     SIGNED_KEY(ScmUInt32, v)
+#define U32_KEY(v)     (v)
+#define S64_KEY(v)     SIGNED_KEY(ScmUInt64, v)
+#define U64_KEY(v)     (v)
+#define F16_KEY(v)     FLOAT_KEY(u_short, (u_short)(v))
+
+#endif /*GAUCHE_PRIV_SORTP_H*/
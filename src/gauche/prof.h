@@ -38,10 +38,13 @@
  * Profiler
  */
 
-/* We have two types of profilers, a statistic sampler and call-counter.
+/* We have three types of profilers, a statistic sampler, call-counter
+ * and allocation sampler.
  *
  * The statistic sampler uses ITIMER_PROF and records the current code
- * base and PC for every SIGPROF.
+ * base and PC for every SIGPROF, together with the code bases saved in
+ * the continuation frames (up to SCM_PROF_STACK_DEPTH), so that we can
+ * reconstruct the call stacks.
  * (NB: in order for this to work, VM's PC must always be saved
  * in VM structure; in another word, vm.c must be compiled with
  * SMALL_REGS == 0).
@@ -50,6 +53,13 @@
  * execution on the thread.   Each entry just records the address of
  * the called object.
  *
+ * The allocation sampler is enabled by setting a non-zero sampling
+ * period in bytes.  Once every that many bytes allocated by SCM_NEW*
+ * family (see gauche.h), it records the code base being executed and
+ * the C type of the allocated object, together with the number of
+ * bytes the sample represents.  Allocations done by subrs are attributed
+ * to the Scheme code calling them.
+ *
  * TODO: It is not known if sampling profiler works when more than one
  * thread requests profiling.  Should be considrered later.
  *
@@ -81,14 +91,22 @@ enum {
     SCM_PROFILER_PAUSING
 };
 
+/* Max # of callers recorded for each sample */
+#define SCM_PROF_STACK_DEPTH  32
+
 /* A sample of statistic sampler */
 typedef struct ScmProfSampleRec {
     ScmObj func;                /* ScmCompiledCode or ScmSubr */
     ScmWord *pc;
+    int depth;                  /* # of valid entries in stack */
+    ScmObj stack[SCM_PROF_STACK_DEPTH]; /* callers' code, innermost first */
 } ScmProfSample;
 
 /* # of on-memory samples for the statistic sampler. */
-#define SCM_PROF_SAMPLES_IN_BUFFER  6000
+#define SCM_PROF_SAMPLES_IN_BUFFER  2000
+
+/* Default sampling period in microseconds */
+#define SCM_PROF_DEFAULT_SAMPLING_PERIOD  10000
 
 /* A record of call counter */
 typedef struct ScmProfCountRec {
@@ -98,6 +116,17 @@ typedef struct ScmProfCountRec {
 /* # of on-memory samples for the call counter. */
 #define SCM_PROF_COUNTER_IN_BUFFER  12000
 
+/* A record of allocation sampler */
+typedef struct ScmProfAllocRec {
+    ScmObj func;                /* ScmCompiledCode or #f */
+    const char *what;           /* C type name of the allocated object */
+    size_t size;                /* size of the allocated object */
+    size_t bytes;               /* # of bytes this sample represents */
+} ScmProfAlloc;
+
+/* # of on-memory samples for the allocation sampler. */
+#define SCM_PROF_ALLOCS_IN_BUFFER  4000
+
 /* Profiling buffer.
  * It is allocated when profiler-start is called on this thread
  * for the first time.
@@ -112,12 +141,31 @@ struct ScmVMProfilerRec {
     ScmHashTable* statHash;     /* hashtable for collected data.
                                    value is a pair of integers,
                                    (<call-count> . <sample-hits>) */
+    ScmHashTable* callTree;     /* collected call stacks, as a trie.
+                                   maps a code to a pair
+                                   (<sample-hits> . <callees>), where
+                                   <callees> is a hashtable of the same
+                                   structure, or #f. */
+    int currentAlloc;           /* index to the current alloc sample */
+    int allocSampling;          /* TRUE if alloc sampler is running */
+    ScmHashTable* allocHash;    /* allocation stats by code.  value is
+                                   a pair (<bytes> . <objects>) */
+    ScmHashTable* allocTypeHash; /* allocation stats by C type name
+                                    (symbol).  value is the same as
+                                    allocHash. */
 
     ScmProfSample samples[SCM_PROF_SAMPLES_IN_BUFFER];
     ScmProfCount  counts[SCM_PROF_COUNTER_IN_BUFFER];
+    ScmProfAlloc  allocs[SCM_PROF_ALLOCS_IN_BUFFER];
 };
 
 SCM_EXTERN ScmObj Scm_ProfilerRawResult(void);
+SCM_EXTERN ScmObj Scm_ProfilerRawCallTree(void);
+SCM_EXTERN long   Scm_ProfilerSamplingPeriod(void);
+SCM_EXTERN void   Scm_ProfilerSetSamplingPeriod(long usec);
+SCM_EXTERN ScmObj Scm_ProfilerRawAllocResult(void);
+SCM_EXTERN ScmSmallInt Scm_ProfilerAllocSamplingPeriod(void);
+SCM_EXTERN void   Scm_ProfilerSetAllocSamplingPeriod(ScmSmallInt bytes);
 
 /* Call Counter API */
 
@@ -137,5 +185,113 @@ SCM_EXTERN void Scm_ProfilerCountBufferFlush(ScmVM *vm);
 #define SCM_PROF_COUNT_CALL(vm, obj)  /*empty*/
 #endif /*!GAUCHE_PROFILE*/
 
+/*=============================================================
+ * Lock contention profiler
+ */
+
+/* When enabled by Scm_LockStatStart, ports and mutexes count how many
+ * times they're acquired, how long threads wait to acquire them and
+ * how long they are held.  The statistics record is allocated on the
+ * lock object when it's acquired for the first time while the profiler
+ * is enabled, and all records are chained to a global list for the
+ * report.  The records are updated only by the thread owning the lock,
+ * so they don't need extra locking.  While disabled, the cost is one
+ * global flag check on the lock path, and one pointer check on the
+ * unlock path of the objects that haven't been profiled.
+ *
+ * The records of the threads waited the longest are kept for each lock,
+ * up to SCM_LOCK_STAT_WAITERS.
+ */
+
+#define SCM_LOCK_STAT_WAITERS  4
+
+typedef struct ScmLockWaiterRec {
+    ScmVM *vm;                  /* waiting thread, or NULL */
+    u_long count;               /* # of waits */
+    double waitTime;            /* total time waited, in seconds */
+} ScmLockWaiter;
+
+typedef struct ScmLockStatRec {
+    ScmWeakBox *object;         /* the lock object (port or mutex) */
+    u_long acquisitions;
+    u_long contentions;         /* # of acquisitions that had to wait */
+    double waitTime;            /* total wait time in seconds */
+    double maxWaitTime;
+    double holdTime;            /* total hold time in seconds */
+    double maxHoldTime;
+    double holdStart;           /* when the current owner acquired it,
+                                   or 0 */
+    ScmLockWaiter waiters[SCM_LOCK_STAT_WAITERS];
+    struct ScmLockStatRec *next; /* chain of all records */
+} ScmLockStat;
+
+SCM_EXTERN int Scm__LockStatEnabled;
+#define SCM_LOCK_STAT_ENABLED()  (Scm__LockStatEnabled)
+
+/* Called by lock implementations.  WAITSTART is the time returned by
+   Scm__LockStatNow() when the caller found the lock busy, or 0 if it
+   got the lock immediately.  Acquired must be called after, and Released
+   must be called before the lock is actually released. */
+SCM_EXTERN double Scm__LockStatNow(void);
+SCM_EXTERN void   Scm__LockStatAcquired(ScmLockStat **pstat, ScmObj obj,
+                                        double waitStart);
+SCM_EXTERN void   Scm__LockStatReleased(ScmLockStat *stat);
+
+SCM_EXTERN void   Scm_LockStatStart(void);
+SCM_EXTERN void   Scm_LockStatStop(void);
+SCM_EXTERN void   Scm_LockStatReset(void);
+SCM_EXTERN ScmObj Scm_LockStatToList(ScmLockStat *stat);
+SCM_EXTERN ScmObj Scm_LockStatResult(void);
+
+/*=============================================================
+ * Perf map
+ */
+
+/* Gauche is an interpreter, so a native sampling profiler such as Linux
+ * perf sees the VM loop (run_loop) instead of Scheme procedures.  To
+ * let external tools symbolize Scheme frames, we can write a perf map
+ * file (/tmp/perf-<pid>.map by default), which maps the address range
+ * of each compiled code vector to the procedure name.  A code is recorded
+ * when it's called for the first time while the map is open.
+ *
+ * An unwinder (e.g. an eBPF program) can find the current VM of a thread
+ * through the thread-local Scm__PerfCurrentVM, and walk the Scheme
+ * frames: vm->pc points into the code vector of the running procedure,
+ * and each continuation frame (vm->cont, then frame->prev) keeps the
+ * pc of the caller.  The offsets of the relevant fields are exported
+ * in Scm__PerfUnwindInfo, so that the tool doesn't need our headers.
+ */
+
+typedef struct ScmPerfUnwindInfoRec {
+    int version;                /* layout version of this struct */
+    int vmPC;                   /* offsetof(ScmVM, pc) */
+    int vmBase;                 /* offsetof(ScmVM, base) */
+    int vmCont;                 /* offsetof(ScmVM, cont) */
+    int contPrev;               /* offsetof(ScmContFrame, prev) */
+    int contPC;                 /* offsetof(ScmContFrame, pc) */
+    int contBase;               /* offsetof(ScmContFrame, base) */
+    int codeCode;               /* offsetof(ScmCompiledCode, code) */
+    int codeSize;               /* offsetof(ScmCompiledCode, codeSize) */
+} ScmPerfUnwindInfo;
+
+SCM_EXTERN const ScmPerfUnwindInfo Scm__PerfUnwindInfo;
+
+#if defined(__GNUC__) && defined(GAUCHE_USE_PTHREADS)
+#define GAUCHE_HAS_PERF_CURRENT_VM 1
+SCM_EXTERN __thread ScmVM *Scm__PerfCurrentVM;
+#endif
+
+SCM_EXTERN int Scm__PerfMapEnabled;
+SCM_EXTERN void Scm__PerfMapRecord(ScmCompiledCode *code);
+
+#define SCM_PERF_MAP_NOTE(code)                                         \
+    do {                                                                \
+        if (Scm__PerfMapEnabled && (code) != NULL) {                   \
+            Scm__PerfMapRecord(code);                                   \
+        }                                                               \
+    } while (0)
+
+SCM_EXTERN ScmObj Scm_PerfMapStart(ScmObj path);
+SCM_EXTERN void   Scm_PerfMapStop(void);
 
 #endif  /*GAUCHE_PROF_H*/
@@ -54,6 +54,21 @@ struct ScmRegexpRec {
                             match at the beginning of the regexp.  It can be
                             used to skip input start position when regexp
                             isn't BOL_ANCHORED. */
+    const u_char *lamap; /* If not NULL, a table indexed by a byte, which
+                            is nonzero if a character in laset can begin
+                            with the byte.  Only set when the internal
+                            encoding allows us to scan input bytewise. */
+    u_char laprefix[2];  /* Literal bytes every match begins with. */
+    int laprefixLen;     /* # of valid bytes in laprefix (0, 1 or 2). */
+    struct ScmRegexpAutomatonRec *automaton;
+                         /* Non-backtracking matcher state, or NULL if the
+                            regexp uses features that require backtracking
+                            (backreferences, assertions, etc.)
+                            See regexp.c for the details. */
+    struct ScmStringSearcherRec *literals;
+                         /* If the regexp is an alternation of literal
+                            strings, a searcher that finds them at once.
+                            Otherwise NULL. */
 };
 
 struct ScmRegMatchRec {
@@ -75,6 +75,8 @@ typedef struct ScmStringBodyRec {
     unsigned int length;
     unsigned int size;
     const char *start;
+    const void *index;          /* character offset index of multibyte
+                                   string; lazily built.  See string.c. */
 } ScmStringBody;
 
 #if SIZEOF_LONG == 4
@@ -213,6 +215,7 @@ SCM_EXTERN ScmObj  Scm_ListToString(ScmObj chars);
 SCM_EXTERN int     Scm_StringEqual(ScmString *x, ScmString *y);
 SCM_EXTERN int     Scm_StringCmp(ScmString *x, ScmString *y);
 SCM_EXTERN int     Scm_StringCiCmp(ScmString *x, ScmString *y);
+SCM_EXTERN ScmObj  Scm__StringAsciiCase(ScmString *str, int upcase);
 
 /*
  * Accessors and modifiers
@@ -228,6 +231,10 @@ SCM_EXTERN ScmObj  Scm_Substring(ScmString *x,
                                  ScmSmallInt start,
                                  ScmSmallInt end,
                                  int byterange);
+SCM_EXTERN ScmObj  Scm_StringSlice(ScmString *x,
+                                   ScmSmallInt start,
+                                   ScmSmallInt end);
+SCM_EXTERN ScmObj  Scm_StringCopyContent(ScmString *x);
 SCM_EXTERN ScmObj  Scm_StringReplaceBody(ScmString *x, const ScmStringBody *b);
 
 /*
@@ -264,6 +271,16 @@ SCM_EXTERN ScmObj  Scm_StringScanChar(ScmString *s1, ScmChar ch, int retmode);
 SCM_EXTERN ScmObj  Scm_StringScanRight(ScmString *s1, ScmString *s2, int retmode);
 SCM_EXTERN ScmObj  Scm_StringScanCharRight(ScmString *s1, ScmChar ch, int retmode);
 
+/* Byte-level Boyer-Moore search, for the extensions that search
+   a fixed pattern (shorter than 256 bytes) in their own buffers. */
+SCM_EXTERN void Scm__BoyerMooreTable(const char *pat, ScmSmallInt patlen,
+                                     unsigned char shift[256]);
+SCM_EXTERN ScmSmallInt Scm__BoyerMooreSearch(const char *buf,
+                                             ScmSmallInt buflen,
+                                             const char *pat,
+                                             ScmSmallInt patlen,
+                                             const unsigned char shift[256]);
+
 /* "retmode" argument for string scan */
 enum {
     SCM_STRING_SCAN_INDEX,      /* return index */
@@ -271,9 +288,32 @@ enum {
     SCM_STRING_SCAN_AFTER,      /* return substring of s1 after s2 */
     SCM_STRING_SCAN_BEFORE2,    /* return substr of s1 before s2 and rest */
     SCM_STRING_SCAN_AFTER2,     /* return substr of s1 up to s2 and rest */
-    SCM_STRING_SCAN_BOTH        /* return substr of s1 before and after s2 */
+    SCM_STRING_SCAN_BOTH,       /* return substr of s1 before and after s2 */
+    SCM_STRING_SCAN_CURSOR      /* return string cursor */
 };
 
+/*
+ * Searching multiple strings at once (strsearch.c)
+ */
+typedef struct ScmStringSearcherRec ScmStringSearcher; /* opaque */
+
+SCM_CLASS_DECL(Scm_StringSearcherClass);
+#define SCM_CLASS_STRING_SEARCHER   (&Scm_StringSearcherClass)
+#define SCM_STRING_SEARCHER(obj)    ((ScmStringSearcher*)(obj))
+#define SCM_STRING_SEARCHER_P(obj)  SCM_XTYPEP(obj, SCM_CLASS_STRING_SEARCHER)
+
+SCM_EXTERN ScmObj  Scm_MakeStringSearcher(ScmObj needles);
+SCM_EXTERN ScmObj  Scm_StringSearcherNeedles(ScmStringSearcher *ss);
+SCM_EXTERN int     Scm_StringSearcherFind(ScmStringSearcher *ss,
+                                          const char *start, const char *end,
+                                          const char **mstart,
+                                          const char **mend);
+SCM_EXTERN ScmObj  Scm_StringSearcherSearch(ScmStringSearcher *ss,
+                                            ScmString *str,
+                                            ScmObj start, ScmObj end);
+SCM_EXTERN ScmObj  Scm_StringSearcherFold(ScmStringSearcher *ss, ScmObj src,
+                                          ScmObj proc, ScmObj seed);
+
 /*
  * Miscellaneous
  */
@@ -282,6 +322,8 @@ SCM_EXTERN int     Scm_MBLen(const char *str, const char *stop);
 /* INTERNAL */
 SCM_EXTERN const char *Scm_StringPosition(ScmString *str, ScmSmallInt k); /*DEPRECATED*/
 SCM_EXTERN const char *Scm_StringBodyPosition(const ScmStringBody *str, ScmSmallInt k);
+SCM_EXTERN void        Scm_StringBodyBuildIndex(const ScmStringBody *str);
+SCM_EXTERN int         Scm_StringBodyFastIndexableP(const ScmStringBody *str);
 SCM_EXTERN ScmObj  Scm_MaybeSubstring(ScmString *x, ScmObj start, ScmObj end);
 
 /*
@@ -296,7 +338,7 @@ SCM_EXTERN ScmObj  Scm_MaybeSubstring(ScmString *x, ScmObj start, ScmObj end);
 
 #define SCM_STRING_CONST_INITIALIZER(str, len, siz)             \
     { { SCM_CLASS_STATIC_TAG(Scm_StringClass) }, NULL,          \
-      { SCM_STRING_IMMUTABLE|SCM_STRING_TERMINATED, (len), (siz), (str) } }
+      { SCM_STRING_IMMUTABLE|SCM_STRING_TERMINATED, (len), (siz), (str), NULL } }
 
 #define SCM_DEFINE_STRING_CONST(name, str, len, siz)            \
     ScmString name = SCM_STRING_CONST_INITIALIZER(str, len, siz)
@@ -333,6 +375,7 @@ struct ScmDStringRec {
 SCM_EXTERN void        Scm_DStringInit(ScmDString *dstr);
 SCM_EXTERN int         Scm_DStringSize(ScmDString *dstr);
 SCM_EXTERN ScmObj      Scm_DStringGet(ScmDString *dstr, int flags);
+SCM_EXTERN ScmObj      Scm_DStringTake(ScmDString *dstr, int flags);
 SCM_EXTERN const char *Scm_DStringGetz(ScmDString *dstr);
 SCM_EXTERN const char *Scm_DStringPeek(ScmDString *dstr, int *size, int *len);
 SCM_EXTERN void        Scm_DStringPutz(ScmDString *dstr, const char *str,
@@ -340,6 +383,7 @@ SCM_EXTERN void        Scm_DStringPutz(ScmDString *dstr, const char *str,
 SCM_EXTERN void        Scm_DStringAdd(ScmDString *dstr, ScmString *str);
 SCM_EXTERN void        Scm_DStringPutb(ScmDString *dstr, char byte);
 SCM_EXTERN void        Scm_DStringPutc(ScmDString *dstr, ScmChar ch);
+SCM_EXTERN void        Scm_DStringRelease(ScmDString *dstr);
 
 #define SCM_DSTRING_SIZE(dstr)    Scm_DStringSize(dstr);
 
@@ -370,6 +414,74 @@ SCM_EXTERN void Scm__DStringRealloc(ScmDString *dstr, int min_incr);
  */
 SCM_EXTERN char *Scm_StrdupPartial(const char *src, size_t size);
 
+/*
+ * String cursors
+ *
+ *   A string cursor points to a character position of a string by
+ *   the byte offset from the beginning of the string body.  Unlike
+ *   an index, moving a cursor and accessing the character at a cursor
+ *   take constant time even on multibyte strings.
+ *
+ *   Most cursors are immediate values ("small cursors"), whose upper
+ *   bits hold the byte offset:
+ *
+ *      -------- -------- -------- 00011011
+ *
+ *   If the offset doesn't fit (it can only happen on 32bit platforms
+ *   with strings larger than 8MB), a heap-allocated "large cursor" is
+ *   used instead.  Both belong to <string-cursor>.
+ *
+ *   A cursor is only valid for the string body it is created from.
+ *   It is an error to use it with other strings, or after the string
+ *   is mutated.
+ */
+
+typedef struct ScmStringCursorLargeRec {
+    SCM_HEADER;
+    ScmSmallInt offset;
+} ScmStringCursorLarge;
+
+SCM_CLASS_DECL(Scm_StringCursorClass);
+#define SCM_CLASS_STRING_CURSOR   (&Scm_StringCursorClass)
+
+#define SCM_STRING_CURSOR_SMALL_TAG       0x1b
+#define SCM_STRING_CURSOR_SMALL_P(obj) \
+    (SCM_TAG8(obj) == SCM_STRING_CURSOR_SMALL_TAG)
+#define SCM_STRING_CURSOR_SMALL_OFFSET(obj) \
+    ((ScmSmallInt)(SCM_WORD(obj) >> 8))
+#define SCM_MAKE_STRING_CURSOR_SMALL(off) \
+    SCM_OBJ((SCM_WORD(off) << 8) + SCM_STRING_CURSOR_SMALL_TAG)
+#define SCM_STRING_CURSOR_SMALL_MAX \
+    ((ScmSmallInt)(((ScmWord)-1) >> 9))
+
+#define SCM_STRING_CURSOR_LARGE_P(obj) \
+    SCM_XTYPEP(obj, SCM_CLASS_STRING_CURSOR)
+#define SCM_STRING_CURSOR_LARGE(obj)       ((ScmStringCursorLarge*)(obj))
+#define SCM_STRING_CURSOR_LARGE_OFFSET(obj) \
+    (SCM_STRING_CURSOR_LARGE(obj)->offset)
+
+#define SCM_STRING_CURSOR_P(obj) \
+    (SCM_STRING_CURSOR_SMALL_P(obj) || SCM_STRING_CURSOR_LARGE_P(obj))
+
+SCM_EXTERN ScmObj  Scm_MakeStringCursorFromIndex(ScmString *src,
+                                                 ScmSmallInt index);
+SCM_EXTERN ScmObj  Scm_MakeStringCursorEnd(ScmString *src);
+SCM_EXTERN ScmObj  Scm_StringCursorIndex(ScmString *src, ScmObj sc);
+SCM_EXTERN ScmObj  Scm_StringCursorForward(ScmString *src, ScmObj sc,
+                                           ScmSmallInt nchars);
+SCM_EXTERN ScmObj  Scm_StringCursorBack(ScmString *src, ScmObj sc,
+                                        ScmSmallInt nchars);
+SCM_EXTERN ScmChar Scm_StringRefCursor(ScmString *src, ScmObj sc,
+                                       int range_error);
+SCM_EXTERN ScmObj  Scm_SubstringCursor(ScmString *src,
+                                       ScmObj start, ScmObj end);
+SCM_EXTERN int     Scm_StringCursorCompare(ScmObj sc1, ScmObj sc2);
+
+/* INTERNAL */
+SCM_EXTERN ScmObj  Scm__MakeStringCursor(ScmSmallInt offset);
+SCM_EXTERN ScmSmallInt Scm__StringCursorOffset(const ScmStringBody *srcb,
+                                               ScmObj sc);
+
 /*
  * String pointers (WILL BE OBSOLETED)
  */
@@ -73,6 +73,20 @@ SCM_EXTERN ScmObj Scm_SymbolSansPrefix(ScmSymbol *s, ScmSymbol *p);
 #define Scm_Intern(name)  Scm_MakeSymbol(name, TRUE)
 #define SCM_INTERN(cstr)  Scm_Intern(SCM_STRING(SCM_MAKE_STR_IMMUTABLE(cstr)))
 
+/* Interns SIZE bytes from NAME, without making a string unless a new
+   symbol is created. */
+SCM_EXTERN ScmObj Scm_InternBytes(const char *name, ScmSmallInt size);
+
+/* Symbol table control */
+SCM_EXTERN int    Scm_SymbolTableSetWeak(int weak);
+SCM_EXTERN ScmObj Scm_SymbolTableStat(void);
+
+/* internal; the content of NAME isn't retained */
+SCM_EXTERN ScmObj Scm__InternTransient(ScmString *name);
+/* internal; returns the interned symbol of NAME, or NULL if there's none */
+SCM_EXTERN ScmSymbol *Scm__FindSymbolBytes(const char *name,
+                                           ScmSmallInt size);
+
 SCM_EXTERN void Scm_WriteSymbolName(ScmString *snam, ScmPort *port,
                                     ScmWriteContext *ctx, u_int flags);
 
@@ -81,6 +81,10 @@ SCM_EXTERN ScmObj Scm_OffsetToInteger(off_t o);
  */
 
 SCM_EXTERN ScmObj Scm_ReadDirectory(ScmString *pathname);
+
+/* flags for Scm_ReadDirectoryWithTypes */
+#define SCM_READDIR_FOLLOW_LINK (1L<<0)
+SCM_EXTERN ScmObj Scm_ReadDirectoryWithTypes(ScmString *pathname, int flags);
 SCM_EXTERN ScmObj Scm_GetCwd(void);
 
 #define SCM_PATH_ABSOLUTE       (1L<<0)
@@ -278,6 +282,61 @@ typedef struct ScmHeaderRec ScmSysFdset;
 #define SCM_SYS_FDSET_P(obj)    (FALSE)
 #endif /*!HAVE_SELECT*/
 
+/* poller
+ *   A scalable alternative of select.  The interest set is kept
+ *   in the kernel (epoll or kqueue) if possible, so adding and deleting
+ *   descriptors are O(1) and waiting doesn't depend on the number of
+ *   registered descriptors.  poll() is used as a fallback.
+ */
+#if defined(HAVE_SELECT) && !defined(GAUCHE_WINDOWS)
+# if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_EPOLL_CREATE1)
+#  define GAUCHE_POLLER_EPOLL  1
+# elif defined(HAVE_SYS_EVENT_H) && defined(HAVE_KQUEUE)
+#  define GAUCHE_POLLER_KQUEUE 1
+# elif defined(HAVE_POLL_H) && defined(HAVE_POLL)
+#  define GAUCHE_POLLER_POLL   1
+# endif
+#endif
+
+#if defined(GAUCHE_POLLER_EPOLL) || defined(GAUCHE_POLLER_KQUEUE) \
+    || defined(GAUCHE_POLLER_POLL)
+#define GAUCHE_HAVE_POLLER 1
+
+/* event flags */
+enum {
+    SCM_SYS_POLLER_READ   = (1L<<0),
+    SCM_SYS_POLLER_WRITE  = (1L<<1),
+    SCM_SYS_POLLER_EXCEPT = (1L<<2),
+    SCM_SYS_POLLER_EDGE   = (1L<<3)  /* edge-triggered; registration only */
+};
+
+typedef struct ScmSysPollerRec {
+    SCM_HEADER;
+    int fd;                     /* epoll or kqueue descriptor.  -1 if
+                                   the poller is closed.  */
+#if defined(GAUCHE_POLLER_POLL)
+    void *pfds;                 /* array of struct pollfd */
+    int npfds;                  /* # of active entries in pfds */
+    int pfdsSize;               /* allocated size of pfds */
+    int *index;                 /* fd -> index in pfds + 1, or 0 */
+    int indexSize;
+#endif
+} ScmSysPoller;
+
+SCM_CLASS_DECL(Scm_SysPollerClass);
+#define SCM_CLASS_SYS_POLLER    (&Scm_SysPollerClass)
+#define SCM_SYS_POLLER(obj)     ((ScmSysPoller*)(obj))
+#define SCM_SYS_POLLER_P(obj)   (SCM_XTYPEP(obj, SCM_CLASS_SYS_POLLER))
+
+SCM_EXTERN ScmObj Scm_MakeSysPoller(void);
+SCM_EXTERN void   Scm_SysPollerAdd(ScmSysPoller *poller, int fd, u_long events);
+SCM_EXTERN void   Scm_SysPollerDelete(ScmSysPoller *poller, int fd);
+SCM_EXTERN ScmObj Scm_SysPollerWait(ScmSysPoller *poller, ScmObj timeout,
+                                    int maxevents);
+SCM_EXTERN void   Scm_SysPollerClose(ScmSysPoller *poller);
+SCM_EXTERN ScmObj Scm_SysPollerBackend(void);
+#endif /*GAUCHE_HAVE_POLLER*/
+
 /*==============================================================
  * Miscellaneous
  */
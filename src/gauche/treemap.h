@@ -34,8 +34,8 @@
 /* This file is included from gauche.h */
 
 /*
- * Provides ScmTreeCore, a raw red-black tree implementation,
- * and ScmTreeMap, ScmObj wrapper of ScmTreeCore.
+ * Provides ScmTreeCore, a raw balanced tree implementation (red-black
+ * tree or B+tree), and ScmTreeMap, ScmObj wrapper of ScmTreeCore.
  */
 
 #ifndef GAUCHE_TREEMAP_H
@@ -49,13 +49,28 @@ typedef struct ScmTreeCoreRec ScmTreeCore;
 
 typedef int ScmTreeCoreCompareProc(ScmTreeCore*, intptr_t, intptr_t);
 
+/* Storage layout of ScmTreeCore.
+   The red-black layout allocates a node for each entry.  The B+tree
+   layout keeps entries in wide leaf nodes in the key order; it takes
+   less memory per entry, and lookups and ordered scans touch fewer
+   cache lines.
+   Note that with the B+tree layout, an ScmDictEntry returned from
+   the core can be moved when another entry is added to or deleted
+   from the same tree, and iterators are invalidated by such operations.
+   Don't keep them across such operations. */
+typedef enum {
+    SCM_TREE_RED_BLACK,
+    SCM_TREE_BPLUS
+} ScmTreeLayout;
+
 /* A general tree map for internal use.  This is NOT a Scheme object. */
 
 struct ScmTreeCoreRec {
-    ScmDictEntry *root;
+    ScmDictEntry *root;         /* B+tree: the root node */
     ScmTreeCoreCompareProc *cmp;
     int   num_entries;
     void  *data;
+    ScmTreeLayout layout;
 };
 
 #define SCM_TREE_CORE_DATA(core)  ((core)->data)
@@ -64,17 +79,37 @@ typedef struct ScmTreeIterRec {
     ScmTreeCore  *t;
     ScmDictEntry *e;
     int at_end;
+    ScmDictEntry *first;        /* range iterator; NULL if unbounded */
+    ScmDictEntry *last;
+    void *leaf;                 /* B+tree: the leaves containing e, */
+    void *first_leaf;           /*   first and last */
+    void *last_leaf;
 } ScmTreeIter;
 
+/* Specifies how a range operation treats the given bound key */
+typedef enum ScmTreeCoreLimit {
+    SCM_TREE_CORE_NO_LIMIT,     /* the bound key is ignored */
+    SCM_TREE_CORE_INCLUSIVE,    /* the range includes the bound key */
+    SCM_TREE_CORE_EXCLUSIVE     /* the range excludes the bound key */
+} ScmTreeCoreLimit;
+
 /*
  * Initializers
  */
 SCM_EXTERN void Scm_TreeCoreInit(ScmTreeCore *tc,
                                  ScmTreeCoreCompareProc *cmp,
                                  void *data);
+SCM_EXTERN void Scm_TreeCoreInitLayout(ScmTreeCore *tc,
+                                       ScmTreeCoreCompareProc *cmp,
+                                       ScmTreeLayout layout,
+                                       void *data);
 SCM_EXTERN void Scm_TreeCoreCopy(ScmTreeCore *dst,
                                  const ScmTreeCore *src);
 SCM_EXTERN void Scm_TreeCoreClear(ScmTreeCore *tc);
+SCM_EXTERN int  Scm_TreeCoreBuildSorted(ScmTreeCore *tc,
+                                        const intptr_t *keys,
+                                        const intptr_t *values,
+                                        int n);
 
 /*
  * Accessors
@@ -105,12 +140,37 @@ SCM_EXTERN int           Scm_TreeCoreNumEntries(ScmTreeCore *tc);
 
 SCM_EXTERN int           Scm_TreeCoreEq(ScmTreeCore *a, ScmTreeCore *b);
 
+/*
+ * Order statistics and ranges
+ */
+SCM_EXTERN int           Scm_TreeCoreRank(ScmTreeCore *tc, intptr_t key,
+                                          ScmDictEntry **e);
+SCM_EXTERN ScmDictEntry *Scm_TreeCoreSelect(ScmTreeCore *tc, int index);
+SCM_EXTERN int           Scm_TreeCoreCountRange(ScmTreeCore *tc,
+                                                intptr_t lo,
+                                                ScmTreeCoreLimit lo_limit,
+                                                intptr_t hi,
+                                                ScmTreeCoreLimit hi_limit);
+
+/*
+ * Split and join
+ */
+SCM_EXTERN void          Scm_TreeCoreSplit(ScmTreeCore *tc, intptr_t key,
+                                           ScmTreeCore *dst);
+SCM_EXTERN void          Scm_TreeCoreJoin(ScmTreeCore *tc, ScmTreeCore *src);
+
 /*
  * Iterators
  */
 SCM_EXTERN void          Scm_TreeIterInit(ScmTreeIter *iter,
                                           ScmTreeCore *tc,
                                           ScmDictEntry *start);
+SCM_EXTERN void          Scm_TreeIterInitRange(ScmTreeIter *iter,
+                                               ScmTreeCore *tc,
+                                               intptr_t lo,
+                                               ScmTreeCoreLimit lo_limit,
+                                               intptr_t hi,
+                                               ScmTreeCoreLimit hi_limit);
 SCM_EXTERN ScmDictEntry *Scm_TreeIterNext(ScmTreeIter *iter);
 SCM_EXTERN ScmDictEntry *Scm_TreeIterPrev(ScmTreeIter *iter);
 SCM_EXTERN ScmDictEntry *Scm_TreeIterCurrent(ScmTreeIter *iter);
@@ -142,6 +202,9 @@ SCM_CLASS_DECL(Scm_TreeMapClass);
 
 SCM_EXTERN ScmObj    Scm_MakeTreeMap(ScmTreeCoreCompareProc *cmp,
                                      void *data);
+SCM_EXTERN ScmObj    Scm_MakeTreeMapLayout(ScmTreeCoreCompareProc *cmp,
+                                           ScmTreeLayout layout,
+                                           void *data);
 SCM_EXTERN ScmObj    Scm_TreeMapCopy(const ScmTreeMap *src);
 
 SCM_EXTERN ScmObj    Scm_TreeMapRef(ScmTreeMap *tm, ScmObj key,
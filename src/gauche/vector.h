@@ -67,6 +67,44 @@ SCM_EXTERN ScmObj Scm_VectorCopy(ScmVector *vec,
                                  ScmSmallInt start, ScmSmallInt end,
                                  ScmObj fill);
 
+/*
+ * Bitvectors
+ */
+
+typedef struct ScmBitvectorRec {
+    SCM_HEADER;
+    ScmWord size_flags;         /* (len<<1)|immutable */
+    ScmBits *bits;
+} ScmBitvector;
+
+SCM_CLASS_DECL(Scm_BitvectorClass);
+#define SCM_CLASS_BITVECTOR     (&Scm_BitvectorClass)
+#define SCM_BITVECTOR(obj)      ((ScmBitvector*)(obj))
+#define SCM_BITVECTORP(obj)     SCM_XTYPEP(obj, SCM_CLASS_BITVECTOR)
+#define SCM_BITVECTOR_SIZE(obj) (SCM_BITVECTOR(obj)->size_flags >> 1)
+#define SCM_BITVECTOR_BITS(obj) (SCM_BITVECTOR(obj)->bits)
+#define SCM_BITVECTOR_IMMUTABLE_P(obj) (SCM_BITVECTOR(obj)->size_flags & 1)
+
+#define SCM_BITVECTOR_CHECK_MUTABLE(obj)               \
+  do { if (SCM_BITVECTOR_IMMUTABLE_P(obj)) {           \
+    Scm_Error("bitvector is immutable: %S", obj);      \
+  }} while (0)
+
+SCM_EXTERN int    Scm_Bit2Int(ScmObj bit);
+SCM_EXTERN ScmObj Scm_MakeBitvector(ScmSmallInt numbits, ScmObj init);
+SCM_EXTERN ScmObj Scm_ListToBitvector(ScmObj lis);
+SCM_EXTERN ScmObj Scm_BitvectorCopy(ScmBitvector *src,
+                                    ScmSmallInt start, ScmSmallInt end);
+SCM_EXTERN ScmObj Scm_BitvectorCopyX(ScmBitvector *dst, ScmSmallInt dstart,
+                                     ScmBitvector *src,
+                                     ScmSmallInt sstart, ScmSmallInt send);
+SCM_EXTERN ScmObj Scm_BitvectorOperate(ScmBitvector *r, ScmBitOp op,
+                                       ScmBitvector *a, ScmBitvector *b);
+SCM_EXTERN ScmObj Scm_StringToBitvector(ScmString *s, int prefix);
+SCM_EXTERN ScmObj Scm_BitvectorToString(ScmBitvector *v, int prefix);
+SCM_EXTERN ScmSmallInt Scm_BitvectorSelect(ScmBitvector *v, int bit,
+                                           ScmSmallInt k);
+
 /*
  * Uniform vectors
  * NB: The Gauche core only includes basic uniform vector APIs, e.g.
@@ -34,15 +34,30 @@
 #ifndef GAUCHE_VM_H
 #define GAUCHE_VM_H
 
-/* Size of stack per VM (in words). */
+/* Default size of stack per VM (in words).  It can be changed by
+   GAUCHE_VM_STACK_SIZE environment variable, or per VM before it starts
+   running (see Scm_VMSetStackSize). */
 #define SCM_VM_STACK_SIZE      10000
 
-/* Maximum # of values allowed for multiple value return */
+/* Lower limit of the stack size */
+#define SCM_VM_MIN_STACK_SIZE  1000
+
+/* Default maximum number of the stacks of terminated threads kept for
+   reuse.  It can be changed by GAUCHE_VM_STACK_POOL_SIZE environment
+   variable, or by Scm_VMSetStackPoolSize. */
+#define SCM_VM_STACK_POOL_SIZE 16
+
+/* Number of value registers for multiple values.  There's no limit
+   on the number of values; ones that don't fit in the registers are
+   kept in an overflow buffer (see SCM_VM_VALS_REF below). */
 #define SCM_VM_MAX_VALUES      20
 
 /* Finalizer queue size */
 #define SCM_VM_FINQ_SIZE       32
 
+/* Number of private output string ports a VM keeps for reuse */
+#define SCM_VM_OSTR_POOL_SIZE  4
+
 #define SCM_PCTYPE ScmWord*
 
 #if defined(ITIMER_PROF) && defined(SIGPROF)
@@ -384,6 +399,10 @@ typedef struct ScmVMStatRec {
 
     /* Load statistics chain */
     ScmObj     loadStat;
+
+    /* Macro expansion statistics; #f or a hash table of
+       macro -> (count . microseconds) */
+    ScmObj     macroStat;
 } ScmVMStat;
 
 /* The profiler structure is defined in prof.h */
@@ -438,10 +457,12 @@ struct ScmVMRec {
     intptr_t signalPending;     /* Flag if there are pending signals.
                                    Turned on by sig_handle(), turned off
                                    by Scm_SigCheck(), both in signal.c. */
-    intptr_t finalizerPending;  /* Flag if there are pending finalizers.
-                                   Turned on by finalizable() callback,
-                                   and turned off by Scm_VMFinalizerRun(),
-                                   both in core.c */
+    intptr_t finalizerPending;  /* Flag if there are pending finalizers
+                                   or GC events to be handled.
+                                   Turned on by finalizable() and
+                                   gc_event_callback() callbacks, and
+                                   turned off by Scm_VMFinalizerRun(),
+                                   all in core.c */
     intptr_t stopRequest;       /* Flag if there is a pending stop request.
                                    See enum ScmThreadStopRequest below
                                    for the possible values.
@@ -455,6 +476,12 @@ struct ScmVMRec {
     ScmPort *curerr;            /* current error port */
     ScmVMParameterTable parameters; /* parameter table */
 
+    /* Pool of private output string ports, kept by
+       Scm__AcquireOutputStringPort and Scm__ReleaseOutputStringPort
+       in port.c. */
+    ScmPort *ostrPool[SCM_VM_OSTR_POOL_SIZE];
+    int numOstrPool;
+
     /* Registers */
     ScmCompiledCode *base;      /* Current executing closure's code packet. */
     SCM_PCTYPE pc;              /* Program pointer.  Points into the code
@@ -468,6 +495,9 @@ struct ScmVMRec {
     ScmObj val0;                /* Value register.                           */
     ScmObj vals[SCM_VM_MAX_VALUES]; /* Value register for multiple values */
     int    numVals;             /* # of values */
+    ScmObj *xvals;              /* Overflow area of vals.  Grown on demand
+                                   and reused. */
+    int    xvalsSize;           /* # of allocated entries in xvals */
 
     ScmObj handlers;            /* chain of active dynamic handlers          */
 
@@ -475,6 +505,8 @@ struct ScmVMRec {
     ScmObj *stack;              /* bottom of allocated stack area */
     ScmObj *stackBase;          /* base of current stack area  */
     ScmObj *stackEnd;           /* end of current stack area */
+    int    stackSize;           /* size of stack area in words.  the stack
+                                   may grow if a single frame doesn't fit */
 
 #if GAUCHE_FFX
     ScmFlonum *fpsp;            /* flonum stack pointer.  we call it 'stack'
@@ -535,7 +567,28 @@ struct ScmVMRec {
                                    Set by vm_register. */
 };
 
+/* Access to the I-th value (0-based) after val0, i.e. the (I+2)-th value.
+   Values beyond the registers live in xvals.  Before setting
+   more than SCM_VM_MAX_VALUES+1 values, call Scm__VMEnsureValues with
+   the total number of values to make room for them. */
+#define SCM_VM_VALS_REF(vm, i)                          \
+    (((i) < SCM_VM_MAX_VALUES)                          \
+     ? (vm)->vals[i]                                    \
+     : (vm)->xvals[(i)-SCM_VM_MAX_VALUES])
+#define SCM_VM_VALS_SET(vm, i, v)                               \
+    do {                                                        \
+        if ((i) < SCM_VM_MAX_VALUES) (vm)->vals[i] = (v);       \
+        else (vm)->xvals[(i)-SCM_VM_MAX_VALUES] = (v);          \
+    } while (0)
+
+SCM_EXTERN void   Scm__VMEnsureValues(ScmVM *vm, int nvals);
+
 SCM_EXTERN ScmVM *Scm_NewVM(ScmVM *proto, ScmObj name);
+SCM_EXTERN void   Scm_VMSetStackSize(ScmVM *vm, int size);
+SCM_EXTERN int    Scm_VMDefaultStackSize(void);
+SCM_EXTERN void   Scm_VMReleaseStack(ScmVM *vm);
+SCM_EXTERN void   Scm_VMSetStackPoolSize(int size);
+SCM_EXTERN int    Scm_VMStackPoolSize(void);
 SCM_EXTERN int    Scm_AttachVM(ScmVM *vm);
 SCM_EXTERN void   Scm_DetachVM(ScmVM *vm);
 SCM_EXTERN void   Scm_VMDump(ScmVM *vm);
@@ -666,8 +719,12 @@ enum {
                                            module */
     SCM_COLLECT_VM_STATS     = (1L<<5), /* enable statistics collection
                                            (incurs runtime overhead) */
-    SCM_COLLECT_LOAD_STATS   = (1L<<6)  /* log the stats of file load
+    SCM_COLLECT_LOAD_STATS   = (1L<<6), /* log the stats of file load
                                            timings (incurs runtime overhead) */
+    SCM_COLLECT_MACRO_STATS  = (1L<<7), /* count and time macro expansions
+                                           (incurs runtime overhead) */
+    SCM_COLLECT_LOAD_TIMES   = (1L<<8)  /* break down the load time by
+                                           phase (incurs runtime overhead) */
 };
 
 #define SCM_VM_RUNTIME_FLAG_IS_SET(vm, flag) ((vm)->runtimeFlags & (flag))
@@ -703,7 +760,11 @@ enum {
     SCM_COMPILE_NO_LIFTING = (1L<<7),      /* Do not run lambda lifting pass
                                               (pass4). */
     SCM_COMPILE_INCLUDE_VERBOSE = (1L<<8), /* Report expansion of 'include' */
-    SCM_COMPILE_ENABLE_CEXPR = (1L<<9)     /* Support C-expressions by reader */
+    SCM_COMPILE_ENABLE_CEXPR = (1L<<9),    /* Support C-expressions by reader */
+    SCM_COMPILE_REPORT = (1L<<10),         /* Report closure allocations and
+                                              local function optimizations */
+    SCM_COMPILE_PACK_SOURCE_INFO = (1L<<11) /* Keep debug info serialized,
+                                               out of GC's sight */
 };
 
 #define SCM_VM_COMPILER_FLAG_IS_SET(vm, flag) ((vm)->compilerFlags & (flag))
@@ -727,4 +788,10 @@ SCM_EXTERN ScmModule* Scm_GaucheInternalModule(void);
 
 SCM_EXTERN ScmObj Scm__VMInsnOffsets(void);
 
+/* Instruction frequency counting (vmstat.c) */
+SCM_EXTERN void   Scm_VMInsnStatStart(void);
+SCM_EXTERN void   Scm_VMInsnStatStop(void);
+SCM_EXTERN void   Scm_VMInsnStatReset(void);
+SCM_EXTERN ScmObj Scm_VMInsnStat(void);
+
 #endif /* GAUCHE_VM_H */
@@ -92,6 +92,8 @@ typedef struct ScmWeakHashTableRec {
     ScmHashProc        *hashfn;
     ScmHashCompareProc *cmpfn;
     u_int       goneEntries;
+    u_long      sweepGC;        /* GC count when the last sweep started */
+    int         sweepCursor;    /* next bucket to sweep; -1 if idle */
 } ScmWeakHashTable;
 
 typedef struct ScmWeakHashIterRec {
@@ -55,6 +55,14 @@ typedef struct EntryRec {
 #define MAX_AVG_CHAIN_LIMITS   3
 #define EXTEND_BITS            2
 
+/* Once a chained table has this many buckets, we extend it incrementally;
+   the old bucket array is kept while its chains are moved to the new
+   one, REHASH_STEP buckets per insertion.  Since the table grows by
+   2^EXTEND_BITS, the migration is always finished long before the next
+   extension is needed. */
+#define INCREMENTAL_REHASH_THRESHOLD 4096
+#define REHASH_STEP            4
+
 /* We limit portable hash value to 32bits */
 #define PORTABLE_HASHMASK  0xffffffffUL
 
@@ -63,6 +71,40 @@ typedef struct EntryRec {
 
 typedef Entry *SearchProc(ScmHashCore *core, intptr_t key, ScmDictOp op);
 
+/* Access statistics, kept only when the core is instrumented by
+   Scm_HashCoreInstrument.  A collision is an entry we had to compare
+   whose hash value is identical to the key's. */
+typedef struct HashStatsRec {
+    u_long lookups;
+    u_long probes;
+    u_long maxProbe;
+    u_long collisions;
+    u_long rehashes;
+    u_long rehashUsec;
+} HashStats;
+
+#define STATS(hc)  ((HashStats*)(hc)->stats)
+
+static inline void record_probe(ScmHashCore *table, u_long probes,
+                                u_long collisions)
+{
+    HashStats *st = STATS(table);
+    st->lookups++;
+    st->probes += probes;
+    st->collisions += collisions;
+    if (probes > st->maxProbe) st->maxProbe = probes;
+}
+
+/* T0 is the value of Scm_CurrentMicroseconds() when the rehash began.
+   COUNT is FALSE for the incremental steps after the first one. */
+static void record_rehash(ScmHashCore *table, long t0, int count)
+{
+    HashStats *st = STATS(table);
+    long t = Scm_CurrentMicroseconds() - t0;
+    if (t > 0) st->rehashUsec += t;
+    if (count) st->rehashes++;
+}
+
 static u_int round2up(unsigned int val);
 
 /*============================================================
@@ -130,6 +172,98 @@ ScmSmallInt Scm_HashSaltSet(ScmSmallInt newval) /* returns old value */
 #define SCM_DWSIPHASH_INTERFACE
 #include "gauche/priv/dws_adapter.h"
 
+/* For the non-portable string hash, which is used by string hash tables
+   and symbol interning, we use a faster word-at-a-time hash in the
+   style of wyhash by Wang Yi (released into the public domain).  It
+   consumes 16 bytes per step, or 48 bytes in three independent lanes
+   for long strings.  The portable hash keeps using siphash, since its
+   values must not change. */
+
+static const uint64_t fh_p0 = 0xa0761d6478bd642fULL;
+static const uint64_t fh_p1 = 0xe7037ed1a0b428dbULL;
+static const uint64_t fh_p2 = 0x8ebc6af09c88c6e3ULL;
+static const uint64_t fh_p3 = 0x589965cc75374cc3ULL;
+
+/* 64x64->128bit multiply, returning the low and high halves. */
+static inline void fh_mum(uint64_t *a, uint64_t *b)
+{
+#if defined(__SIZEOF_INT128__)
+    __uint128_t r = (__uint128_t)*a * *b;
+    *a = (uint64_t)r;
+    *b = (uint64_t)(r >> 64);
+#else
+    uint64_t ha = *a >> 32, hb = *b >> 32;
+    uint64_t la = (uint32_t)*a, lb = (uint32_t)*b;
+    uint64_t rh = ha*hb, rm0 = ha*lb, rm1 = hb*la, rl = la*lb;
+    uint64_t t = rl + (rm0 << 32), c = (t < rl);
+    uint64_t lo = t + (rm1 << 32);
+    c += (lo < t);
+    *a = lo;
+    *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static inline uint64_t fh_mix(uint64_t a, uint64_t b)
+{
+    fh_mum(&a, &b);
+    return a ^ b;
+}
+
+static inline uint64_t fh_r8(const uint8_t *p)
+{
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+static inline uint64_t fh_r4(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static uint64_t fast_string_hash(const uint8_t *p, size_t len, uint64_t seed)
+{
+    uint64_t a, b;
+    seed ^= fh_mix(seed ^ fh_p0, fh_p1);
+    if (len <= 16) {
+        if (len >= 4) {
+            a = (fh_r4(p) << 32) | fh_r4(p + ((len >> 3) << 2));
+            b = (fh_r4(p + len - 4) << 32) | fh_r4(p + len - 4 - ((len >> 3) << 2));
+        } else if (len > 0) {
+            a = ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) | p[len-1];
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        size_t i = len;
+        if (i > 48) {
+            uint64_t seed1 = seed, seed2 = seed;
+            do {
+                seed  = fh_mix(fh_r8(p) ^ fh_p1, fh_r8(p+8) ^ seed);
+                seed1 = fh_mix(fh_r8(p+16) ^ fh_p2, fh_r8(p+24) ^ seed1);
+                seed2 = fh_mix(fh_r8(p+32) ^ fh_p3, fh_r8(p+40) ^ seed2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= seed1 ^ seed2;
+        }
+        while (i > 16) {
+            seed = fh_mix(fh_r8(p) ^ fh_p1, fh_r8(p+8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        a = fh_r8(p + i - 16);
+        b = fh_r8(p + i - 8);
+    }
+    a ^= fh_p1;
+    b ^= seed;
+    fh_mum(&a, &b);
+    return fh_mix(a ^ fh_p0 ^ len, b ^ fh_p1);
+}
+
 u_long Scm_EqHash(ScmObj obj)
 {
     u_long hashval;
@@ -225,8 +359,8 @@ static u_long internal_string_hash(ScmString *str, u_long salt, int portable)
         return (u_long)Scm__DwSipPortableHash((uint8_t*)b->start, b->size,
                                               salt, salt);
     } else {
-        return Scm__DwSipDefaultHash((uint8_t*)b->start, b->size,
-                                     salt, salt);
+        return (u_long)fast_string_hash((const uint8_t*)b->start, b->size,
+                                        salt);
     }
 }
 
@@ -235,8 +369,11 @@ static u_long internal_string_hash(ScmString *str, u_long salt, int portable)
   
    Both default-hash and portable-hash have this property but their
    requirements are slightly different, so here's the common part.
+
+   equal_hash_atom handles everything but lists and vectors, which
+   equal_hash_common traverses with an explicit stack.
 */
-static u_long equal_hash_common(ScmObj obj, u_long salt, int portable)
+static u_long equal_hash_atom(ScmObj obj, u_long salt, int portable)
 {
     if (SCM_NUMBERP(obj)) {
         return number_hash(obj, salt, portable);
@@ -246,23 +383,6 @@ static u_long equal_hash_common(ScmObj obj, u_long salt, int portable)
         return hashval&PORTABLE_HASHMASK;
     } else if (SCM_STRINGP(obj)) {
         return internal_string_hash(SCM_STRING(obj), salt, portable);
-    } else if (SCM_PAIRP(obj)) {
-        u_long h = 0, h2;
-        ScmObj cp;
-        SCM_FOR_EACH(cp, obj) {
-            h2 = equal_hash_common(SCM_CAR(cp), salt, portable);
-            h = COMBINE(h, h2);
-        }
-        h2 = equal_hash_common(cp, salt, portable);
-        return COMBINE(h, h2);
-    } else if (SCM_VECTORP(obj)) {
-        int siz = SCM_VECTOR_SIZE(obj);
-        u_long h = 0, h2;
-        for (int i=0; i<siz; i++) {
-            h2 = equal_hash_common(SCM_VECTOR_ELEMENT(obj, i), salt, portable);
-            h = COMBINE(h, h2);
-        }
-        return h;
     } else if (SCM_SYMBOLP(obj)) {
         if (portable) {
             return internal_string_hash(SCM_SYMBOL_NAME(obj), salt, TRUE);
@@ -311,6 +431,103 @@ static u_long equal_hash_common(ScmObj obj, u_long salt, int portable)
     }
 }
 
+
+/* A traversal frame of equal_hash_common.  For a list, OBJ is the rest
+   of the list yet to be hashed and INDEX is HASH_LIST, or HASH_LIST_TAIL
+   once we've taken its last cdr.  For a vector, INDEX is the next
+   element to be hashed. */
+typedef struct hash_frame_rec {
+    ScmObj obj;
+    ScmSmallInt index;
+    u_long h;
+} hash_frame;
+
+#define HASH_LIST       (-1)
+#define HASH_LIST_TAIL  (-2)
+#define HASH_STACK_INIT 16
+
+/* The value is the same as the straightforward recursive definition,
+   i.e. the hash of a list is COMBINE of its elements' hashes folded
+   from 0, COMBINEd with the hash of the last cdr, and that of a vector
+   is its elements' hashes folded from 0; portable-hash relies on it.
+
+   If MAXDEPTH >= 0, aggregates nested MAXDEPTH deep or more are hashed
+   only by their type.  If MAXNODES >= 0, we stop after hashing that many objects
+   and fold what we have.  Either way the traversal only depends on the
+   structure, so equal objects still get the same hash value, and the
+   cost is bounded even for huge or circular keys. */
+static u_long equal_hash_common(ScmObj obj, u_long salt, int portable,
+                                int maxdepth, long maxnodes)
+{
+    if (!SCM_PAIRP(obj) && !SCM_VECTORP(obj)) {
+        return equal_hash_atom(obj, salt, portable);
+    }
+
+    hash_frame sbuf[HASH_STACK_INIT];
+    hash_frame *stack = sbuf, *f;
+    int sp = 0, size = HASH_STACK_INIT;
+    ScmObj elt = obj;
+    u_long v;
+
+    for (;;) {
+        /* Hash ELT into V, or push a frame to traverse it. */
+        if (maxnodes == 0) {
+            u_long h = 0;
+            while (sp > 0) h = COMBINE(stack[--sp].h, h);
+            return h;
+        }
+        if (maxnodes > 0) maxnodes--;
+        if (!SCM_PAIRP(elt) && !SCM_VECTORP(elt)) {
+            v = equal_hash_atom(elt, salt, portable);
+        } else if (maxdepth >= 0 && sp >= maxdepth) {
+            v = SCM_PAIRP(elt)? 1 : 2;
+        } else {
+            if (sp == size) {
+                hash_frame *ns = SCM_NEW_ARRAY(hash_frame, size*2);
+                memcpy(ns, stack, sizeof(hash_frame)*size);
+                stack = ns;
+                size *= 2;
+            }
+            f = &stack[sp++];
+            f->obj = elt;
+            f->index = SCM_PAIRP(elt)? HASH_LIST : 0;
+            f->h = 0;
+            goto fetch;
+        }
+
+        /* Combine V to the current frame, finishing lists whose last
+           cdr has been hashed. */
+    combine:
+        if (sp == 0) return v;
+        f = &stack[sp-1];
+        f->h = COMBINE(f->h, v);
+        if (f->index == HASH_LIST_TAIL) {
+            v = f->h;
+            sp--;
+            goto combine;
+        }
+
+        /* Pick the next element of the current frame. */
+    fetch:
+        f = &stack[sp-1];
+        if (f->index == HASH_LIST) {
+            if (SCM_PAIRP(f->obj)) {
+                elt = SCM_CAR(f->obj);
+                f->obj = SCM_CDR(f->obj);
+            } else {
+                elt = f->obj;
+                f->index = HASH_LIST_TAIL;
+            }
+        } else if (f->index < SCM_VECTOR_SIZE(f->obj)) {
+            elt = SCM_VECTOR_ELEMENT(f->obj, f->index++);
+        } else {
+            v = f->h;
+            sp--;
+            goto combine;
+        }
+    }
+}
+
 /* For recursive call to the current hash function - see call-object-hash
    and object-hash definitions in libomega.scm. */
 static ScmParameterLoc current_recursive_hash;
@@ -333,13 +550,23 @@ ScmObj Scm_CurrentRecursiveHash(ScmObj newval)
  */
 u_long Scm_PortableHash(ScmObj obj, u_long salt)
 {
-    return equal_hash_common(obj, salt, TRUE) & PORTABLE_HASHMASK;
+    return equal_hash_common(obj, salt, TRUE, -1, -1) & PORTABLE_HASHMASK;
 }
 
-/* 'Default' general hash function. */
+/* 'Default' general hash function.
+   The value doesn't need to persist, so we bound the traversal to keep
+   equal?-hashtables on huge keys fast; see equal_hash_common. */
 ScmSmallInt Scm_DefaultHash(ScmObj obj)
 {
-    return equal_hash_common(obj, Scm_HashSaltRef(), FALSE) & HASHMASK;
+    return Scm_DefaultHashBounded(obj, SCM_DEFAULT_HASH_MAX_DEPTH,
+                                  SCM_DEFAULT_HASH_MAX_NODES);
+}
+
+/* MAXDEPTH and/or MAXNODES can be -1 for unlimited. */
+ScmSmallInt Scm_DefaultHashBounded(ScmObj obj, int maxdepth, long maxnodes)
+{
+    return equal_hash_common(obj, Scm_HashSaltRef(), FALSE,
+                             maxdepth, maxnodes) & HASHMASK;
 }
 
 /* This is to expose string hash function.  Modulo is for the compatibility
@@ -351,6 +578,15 @@ u_long Scm_HashString(ScmString *str, u_long modulo)
     else return (hashval % modulo);
 }
 
+/* Hashes SIZE bytes from P with SEED, using the same function as the
+   non-portable string hash.  This is for the callers that want to hash
+   a string content without making a ScmString, e.g. symbol interning. */
+u_long Scm_HashBytes(const void *p, ScmSmallInt size, u_long seed)
+{
+    return (u_long)fast_string_hash((const uint8_t*)p, (size_t)size, seed)
+        & HASHMASK;
+}
+
 /* Expose COMBINE. */
 u_long Scm_CombineHashValue(u_long a, u_long b)
 {
@@ -391,45 +627,112 @@ u_long Scm_CombineHashValue(u_long a, u_long b)
  * throw Scheme error.  Be aware of that.
  */
 
+/*
+ * Returns the bucket where an entry with HASHVAL belongs.  While the
+ * table is being extended, the old bucket array holds the chains that
+ * haven't been migrated yet.
+ */
+static inline Entry **chain_bucket(ScmHashCore *table, u_long hashval)
+{
+    if (table->oldBuckets) {
+        u_long i = HASH2INDEX(table->oldNumBuckets, table->oldNumBucketsLog2,
+                              hashval);
+        if (i >= (u_long)table->migrated) {
+            return &((Entry**)table->oldBuckets)[i];
+        }
+    }
+    return &BUCKETS(table)[HASH2INDEX(table->numBuckets,
+                                      table->numBucketsLog2, hashval)];
+}
+
+/* Move up to COUNT chains from the old bucket array to the new one. */
+static void rehash_step(ScmHashCore *table, int count)
+{
+    long t0 = table->stats? Scm_CurrentMicroseconds() : 0;
+    Entry **oldb = (Entry**)table->oldBuckets;
+    Entry **newb = BUCKETS(table);
+    int i = table->migrated;
+    int limit = i + count;
+    if (limit > table->oldNumBuckets) limit = table->oldNumBuckets;
+
+    for (; i < limit; i++) {
+        Entry *f = oldb[i], *next;
+        for (; f; f = next) {
+            next = f->next;
+            int index = HASH2INDEX(table->numBuckets, table->numBucketsLog2,
+                                   f->hashval);
+            f->next = newb[index];
+            newb[index] = f;
+        }
+        oldb[i] = NULL;
+    }
+    if (table->stats) record_rehash(table, t0, table->migrated == 0);
+    table->migrated = i;
+    if (i == table->oldNumBuckets) {
+        table->oldBuckets = NULL;
+        table->oldNumBuckets = table->oldNumBucketsLog2 = 0;
+        table->migrated = 0;
+    }
+}
+
+static void extend_table(ScmHashCore *table)
+{
+    long t0 = table->stats? Scm_CurrentMicroseconds() : 0;
+    int newsize = (table->numBuckets << EXTEND_BITS);
+    int newbits = table->numBucketsLog2 + EXTEND_BITS;
+
+    /* SCM_NEW_ARRAY returns cleared memory */
+    Entry **newb = SCM_NEW_ARRAY(Entry*, newsize);
+
+    if (table->numBuckets >= INCREMENTAL_REHASH_THRESHOLD) {
+        table->oldBuckets = table->buckets;
+        table->oldNumBuckets = table->numBuckets;
+        table->oldNumBucketsLog2 = table->numBucketsLog2;
+        table->migrated = 0;
+        table->numBuckets = newsize;
+        table->numBucketsLog2 = newbits;
+        table->buckets = (void**)newb;
+        rehash_step(table, REHASH_STEP);
+        return;
+    }
+
+    ScmHashIter iter;
+    Entry *f;
+    Scm_HashIterInit(&iter, table);
+    while ((f = (Entry*)Scm_HashIterNext(&iter)) != NULL) {
+        int index = HASH2INDEX(newsize, newbits, f->hashval);
+        f->next = newb[index];
+        newb[index] = f;
+    }
+    /* gc friendliness */
+    for (int i=0; i<table->numBuckets; i++) table->buckets[i] = NULL;
+
+    table->numBuckets = newsize;
+    table->numBucketsLog2 = newbits;
+    table->buckets = (void**)newb;
+    if (table->stats) record_rehash(table, t0, TRUE);
+}
+
 /*
  * Common function called when the accessor function needs to add an entry.
  */
 static Entry *insert_entry(ScmHashCore *table,
                            intptr_t key,
                            u_long   hashval,
-                           int index)
+                           Entry  **bucket)
 {
     Entry *e = SCM_NEW(Entry);
-    Entry **buckets = BUCKETS(table);
     e->key = key;
     e->value = 0;
-    e->next = buckets[index];
+    e->next = *bucket;
     e->hashval = hashval;
-    buckets[index] = e;
+    *bucket = e;
     table->numEntries++;
 
-    if (table->numEntries > table->numBuckets*MAX_AVG_CHAIN_LIMITS) {
-        /* Extend the table */
-        int newsize = (table->numBuckets << EXTEND_BITS);
-        int newbits = table->numBucketsLog2 + EXTEND_BITS;
-
-        Entry **newb = SCM_NEW_ARRAY(Entry*, newsize);
-        for (int i=0; i<newsize; i++) newb[i] = NULL;
-
-        ScmHashIter iter;
-        Entry *f;
-        Scm_HashIterInit(&iter, table);
-        while ((f = (Entry*)Scm_HashIterNext(&iter)) != NULL) {
-            index = HASH2INDEX(newsize, newbits, f->hashval);
-            f->next = newb[index];
-            newb[index] = f;
-        }
-        /* gc friendliness */
-        for (int i=0; i<table->numBuckets; i++) table->buckets[i] = NULL;
-
-        table->numBuckets = newsize;
-        table->numBucketsLog2 = newbits;
-        table->buckets = (void**)newb;
+    if (table->oldBuckets) {
+        rehash_step(table, REHASH_STEP);
+    } else if (table->numEntries > table->numBuckets*MAX_AVG_CHAIN_LIMITS) {
+        extend_table(table);
     }
     return e;
 }
@@ -441,31 +744,47 @@ static Entry *insert_entry(ScmHashCore *table,
    are running on the same hash table. */
 static Entry *delete_entry(ScmHashCore *table,
                            Entry *entry, Entry *prev,
-                           int index)
+                           Entry **bucket)
 {
     if (prev) prev->next = entry->next;
-    else table->buckets[index] = (void*)entry->next;
+    else *bucket = entry->next;
     table->numEntries--;
     SCM_ASSERT(table->numEntries >= 0);
     entry->next = NULL;         /* GC friendliness */
     return entry;
 }
 
-#define FOUND(table, op, e, p, index)                   \
+/* Called when the table is instrumented.  We walk the chain again,
+   so that the search loops don't need to count. */
+static void chain_record(ScmHashCore *table, Entry *head, Entry *e,
+                         u_long hashval)
+{
+    u_long probes = 0, collisions = 0;
+    for (Entry *f = head; f; f = f->next) {
+        probes++;
+        if (f == e) break;
+        if (f->hashval == hashval) collisions++;
+    }
+    record_probe(table, probes, collisions);
+}
+
+#define FOUND(table, op, e, p, bucket)                  \
     do {                                                \
+        if (table->stats) chain_record(table, *bucket, e, e->hashval); \
         switch (op) {                                   \
         case SCM_DICT_GET:;                             \
         case SCM_DICT_CREATE:;                          \
             return e;                                   \
         case SCM_DICT_DELETE:;                          \
-            return delete_entry(table, e, p, index);    \
+            return delete_entry(table, e, p, bucket);   \
         }                                               \
     } while (0)
 
-#define NOTFOUND(table, op, key, hashval, index)                \
+#define NOTFOUND(table, op, key, hashval, bucket)               \
     do {                                                        \
+        if (table->stats) chain_record(table, *bucket, NULL, hashval); \
         if (op == SCM_DICT_CREATE) {                            \
-           return insert_entry(table, key, hashval, index);     \
+           return insert_entry(table, key, hashval, bucket);    \
         } else {                                                \
            return NULL;                                         \
         }                                                       \
@@ -478,16 +797,15 @@ static Entry *address_access(ScmHashCore *table,
                              intptr_t key,
                              ScmDictOp op)
 {
-    u_long hashval, index;
-    Entry **buckets = (Entry**)table->buckets;
+    u_long hashval;
 
     ADDRESS_HASH(hashval, key);
-    index = HASH2INDEX(table->numBuckets, table->numBucketsLog2, hashval);
+    Entry **bucket = chain_bucket(table, hashval);
 
-    for (Entry *e = buckets[index], *p = NULL; e; p = e, e = e->next) {
-        if (e->key == key) FOUND(table, op, e, p, index);
+    for (Entry *e = *bucket, *p = NULL; e; p = e, e = e->next) {
+        if (e->key == key) FOUND(table, op, e, p, bucket);
     }
-    NOTFOUND(table, op, key, hashval, index);
+    NOTFOUND(table, op, key, hashval, bucket);
 }
 
 static u_long address_hash(const ScmHashCore *ht, intptr_t obj)
@@ -538,22 +856,21 @@ static Entry *string_access(ScmHashCore *table, intptr_t k, ScmDictOp op)
         Scm_Error("Got non-string key %S to the string hashtable.", key);
     }
     u_long hashval = Scm_HashString(SCM_STRING(key), 0);
-    u_long index = HASH2INDEX(table->numBuckets, table->numBucketsLog2, hashval);
-    Entry **buckets = (Entry**)table->buckets;
+    Entry **bucket = chain_bucket(table, hashval);
 
     const ScmStringBody *keyb = SCM_STRING_BODY(key);
     long size = SCM_STRING_BODY_SIZE(keyb);
-    for (Entry *e = buckets[index], *p = NULL; e; p = e, e = e->next) {
+    for (Entry *e = *bucket, *p = NULL; e; p = e, e = e->next) {
         ScmObj ee = SCM_OBJ(e->key);
         const ScmStringBody *eeb = SCM_STRING_BODY(ee);
         int eesize = SCM_STRING_BODY_SIZE(eeb);
         if (size == eesize
             && memcmp(SCM_STRING_BODY_START(keyb),
                       SCM_STRING_BODY_START(eeb), eesize) == 0){
-            FOUND(table, op, e, p, index);
+            FOUND(table, op, e, p, bucket);
         }
     }
-    NOTFOUND(table, op, k, hashval, index);
+    NOTFOUND(table, op, k, hashval, bucket);
 }
 
 static u_long string_hash(const ScmHashCore *table, intptr_t key)
@@ -592,18 +909,16 @@ static u_long multiword_hash(const ScmHashCore *table, intptr_t key)
 #if 0
 static Entry *multiword_access(ScmHashCore *table, intptr_t k, ScmDictOp op)
 {
-    u_long hashval, index;
     ScmWord keysize = (ScmWord)table->data;
 
-    hashval = multiword_hash(table, k);
-    index = HASH2INDEX(table->numBuckets, table->numBucketsLog2, hashval);
-    Entry **buckets = (Entry**)table->buckets;
+    u_long hashval = multiword_hash(table, k);
+    Entry **bucket = chain_bucket(table, hashval);
 
-    for (Entry *e = buckets[index], *p = NULL; e; p = e, e = e->next) {
+    for (Entry *e = *bucket, *p = NULL; e; p = e, e = e->next) {
         if (memcmp((void*)k, (void*)e->key, keysize*sizeof(ScmWord)) == 0)
-            FOUND(table, op, e, p, index);
+            FOUND(table, op, e, p, bucket);
     }
-    NOTFOUND(table, op, k, hashval, index);
+    NOTFOUND(table, op, k, hashval, bucket);
 }
 #endif
 
@@ -614,16 +929,184 @@ static Entry *multiword_access(ScmHashCore *table, intptr_t k, ScmDictOp op)
  */
 static Entry *general_access(ScmHashCore *table, intptr_t key, ScmDictOp op)
 {
-    u_long hashval, index;
+    u_long hashval = table->hashfn(table, key);
+    Entry **bucket = chain_bucket(table, hashval);
+
+    for (Entry *e = *bucket, *p = NULL; e; p = e, e = e->next) {
+        if (table->cmpfn(table, key, e->key)) FOUND(table, op, e, p, bucket);
+    }
+    NOTFOUND(table, op, key, hashval, bucket);
+}
+
+/*============================================================
+ * Open addressing layout
+ */
+
+/* Entries are kept in a flat array of slots, followed by an array of
+ * control bytes, one for each slot.  A control byte is either OA_EMPTY,
+ * OA_DELETED, or 7 bits taken from the hash value of the entry in the
+ * slot, so that we rarely need to look at the slot of a different key.
+ * Collisions are resolved by linear probing.  numBuckets is the
+ * number of slots, always a power of two.
+ */
+
+/* The beginning of this structure must match ScmDictEntry. */
+typedef struct OAEntryRec {
+    intptr_t key;
+    intptr_t value;
+    u_long   hashval;
+} OAEntry;
+
+#define OA_EMPTY     0x80
+#define OA_DELETED   0xfe
+#define OA_FULLP(c)  ((c) < 0x80)
+#define OA_H2(hashval)  ((u_char)(((hashval) ^ ((hashval) >> 16)) & 0x7f))
+
+#define OA_SLOTS(hc)  ((OAEntry*)(hc)->buckets)
+#define OA_CTRL(hc)   ((u_char*)(OA_SLOTS(hc) + (hc)->numBuckets))
+
+#define OA_MIN_BUCKETS 8
+/* We keep at least 1/8 of slots empty, so that probing always ends. */
+#define OA_MAX_LOAD(n) ((n) - ((n) >> 3))
+
+static void oa_alloc(ScmHashCore *table, int size)
+{
+    OAEntry *slots = SCM_NEW2(OAEntry*, (sizeof(OAEntry)+1) * size);
+    u_char *ctrl = (u_char*)(slots + size);
+    for (int i=0; i<size; i++) {
+        slots[i].key = 0;
+        slots[i].value = 0;
+        ctrl[i] = OA_EMPTY;
+    }
+    table->buckets = (void**)slots;
+    table->numBuckets = size;
+    table->numBucketsLog2 = 0;
+    for (int i=size; i > 1; i /= 2) table->numBucketsLog2++;
+    table->numDeleted = 0;
+}
+
+static void oa_rehash(ScmHashCore *table, int newsize)
+{
+    long t0 = table->stats? Scm_CurrentMicroseconds() : 0;
+    OAEntry *oslots = OA_SLOTS(table);
+    u_char  *octrl  = OA_CTRL(table);
+    int osize = table->numBuckets;
+
+    oa_alloc(table, newsize);
+
+    OAEntry *slots = OA_SLOTS(table);
+    u_char  *ctrl  = OA_CTRL(table);
+    u_long mask = newsize - 1;
+    for (int i=0; i<osize; i++) {
+        if (!OA_FULLP(octrl[i])) continue;
+        u_long k = HASH2INDEX(newsize, table->numBucketsLog2,
+                              oslots[i].hashval);
+        while (ctrl[k] != OA_EMPTY) k = (k+1) & mask;
+        slots[k] = oslots[i];
+        ctrl[k] = octrl[i];
+        /* gc friendliness */
+        oslots[i].key = oslots[i].value = 0;
+    }
+    if (table->stats) record_rehash(table, t0, TRUE);
+}
+
+/* Called when the table is instrumented.  K is the slot where the
+   probing sequence for HASHVAL stopped. */
+static void oa_record(ScmHashCore *table, u_long hashval, u_long k)
+{
+    OAEntry *slots = OA_SLOTS(table);
+    u_char  *ctrl  = OA_CTRL(table);
+    u_long mask = table->numBuckets - 1;
+    u_long j = HASH2INDEX(table->numBuckets, table->numBucketsLog2, hashval);
+    u_long collisions = 0;
+    for (; j != k; j = (j+1) & mask) {
+        if (OA_FULLP(ctrl[j]) && slots[j].hashval == hashval) collisions++;
+    }
+    record_probe(table, ((k - HASH2INDEX(table->numBuckets,
+                                         table->numBucketsLog2, hashval))
+                         & mask) + 1,
+                 collisions);
+}
+
+static inline Entry *oa_search(ScmHashCore *table, intptr_t key,
+                               u_long hashval, ScmDictOp op,
+                               ScmHashCompareProc *cmp)
+{
+    int recorded = FALSE;       /* for stats; don't count retries */
+    for (;;) {
+        OAEntry *slots = OA_SLOTS(table);
+        u_char  *ctrl  = OA_CTRL(table);
+        u_long mask = table->numBuckets - 1;
+        u_long k = HASH2INDEX(table->numBuckets, table->numBucketsLog2,
+                              hashval);
+        u_char h2 = OA_H2(hashval);
+        long deleted = -1;
+
+        for (;; k = (k+1) & mask) {
+            u_char c = ctrl[k];
+            if (c == h2 && slots[k].hashval == hashval
+                && cmp(table, key, slots[k].key)) {
+                if (table->stats && !recorded) oa_record(table, hashval, k);
+                if (op != SCM_DICT_DELETE) return (Entry*)&slots[k];
+                /* The slot will be reused, so we return a copy. */
+                OAEntry *e = SCM_NEW(OAEntry);
+                *e = slots[k];
+                slots[k].key = slots[k].value = 0;
+                ctrl[k] = OA_DELETED;
+                table->numEntries--;
+                table->numDeleted++;
+                return (Entry*)e;
+            }
+            if (c == OA_EMPTY) break;
+            if (c == OA_DELETED && deleted < 0) deleted = (long)k;
+        }
+        if (table->stats && !recorded) oa_record(table, hashval, k);
+        recorded = TRUE;
+        if (op != SCM_DICT_CREATE) return NULL;
+
+        if (deleted >= 0) {
+            k = (u_long)deleted;
+            table->numDeleted--;
+        } else if (table->numEntries + table->numDeleted + 1
+                   > OA_MAX_LOAD(table->numBuckets)) {
+            /* Grow if the table is more than half full; otherwise
+               we just sweep the deleted slots. */
+            int newsize = table->numBuckets;
+            if ((table->numEntries + 1) * 2 > newsize) newsize *= 2;
+            oa_rehash(table, newsize);
+            continue;
+        }
+        slots[k].key = key;
+        slots[k].value = 0;
+        slots[k].hashval = hashval;
+        ctrl[k] = h2;
+        table->numEntries++;
+        return (Entry*)&slots[k];
+    }
+}
+
+static Entry *oa_address_access(ScmHashCore *table, intptr_t key,
+                                ScmDictOp op)
+{
+    u_long hashval;
+    ADDRESS_HASH(hashval, key);
+    return oa_search(table, key, hashval, op, address_cmp);
+}
 
-    hashval = table->hashfn(table, key);
-    index = HASH2INDEX(table->numBuckets, table->numBucketsLog2, hashval);
-    Entry **buckets = (Entry**)table->buckets;
+static Entry *oa_eqv_access(ScmHashCore *table, intptr_t key, ScmDictOp op)
+{
+    return oa_search(table, key, Scm_EqvHash(SCM_OBJ(key)), op, eqv_cmp);
+}
 
-    for (Entry *e = buckets[index], *p = NULL; e; p = e, e = e->next) {
-        if (table->cmpfn(table, key, e->key)) FOUND(table, op, e, p, index);
+static Entry *oa_string_access(ScmHashCore *table, intptr_t key,
+                               ScmDictOp op)
+{
+    if (!SCM_STRINGP(key)) {
+        Scm_Error("Got non-string key %S to the string hashtable.",
+                  SCM_OBJ(key));
     }
-    NOTFOUND(table, op, key, hashval, index);
+    return oa_search(table, key, Scm_HashString(SCM_STRING(key), 0), op,
+                     string_cmp);
 }
 
 /*============================================================
@@ -653,6 +1136,11 @@ static void hash_core_init(ScmHashCore *table,
         table->numBucketsLog2++;
     }
     for (u_int i=0; i<initSize; i++) table->buckets[i] = NULL;
+    table->layout = SCM_HASH_CHAINED;
+    table->numDeleted = 0;
+    table->oldBuckets = NULL;
+    table->oldNumBuckets = table->oldNumBucketsLog2 = table->migrated = 0;
+    table->stats = NULL;
 }
 
 /* choose appropriate procedures for predefined hash types. */
@@ -713,6 +1201,48 @@ void Scm_HashCoreInitGeneral(ScmHashCore *core,
                    cmpfn, initSize, data);
 }
 
+void Scm_HashCoreInitLayout(ScmHashCore *core,
+                            ScmHashType type,
+                            ScmHashLayout layout,
+                            unsigned int initSize,
+                            void *data)
+{
+    if (layout == SCM_HASH_CHAINED) {
+        Scm_HashCoreInitSimple(core, type, initSize, data);
+        return;
+    }
+
+    SearchProc  *accessfn, *dummy;
+    ScmHashProc *hashfn;
+    ScmHashCompareProc *cmpfn;
+
+    switch (type) {
+    case SCM_HASH_EQ:
+    case SCM_HASH_WORD:   accessfn = oa_address_access; break;
+    case SCM_HASH_EQV:    accessfn = oa_eqv_access; break;
+    case SCM_HASH_STRING: accessfn = oa_string_access; break;
+    default:
+        Scm_Error("open addressing layout isn't supported for the hash type: %d", type);
+        return;                 /* dummy */
+    }
+    (void)hash_core_predef_procs(type, &dummy, &hashfn, &cmpfn);
+
+    /* INITSIZE entries can be put without rehashing. */
+    u_int size = round2up(initSize + initSize/4 + 1);
+    if (size < OA_MIN_BUCKETS) size = OA_MIN_BUCKETS;
+
+    core->numEntries = 0;
+    core->accessfn = (void*)accessfn;
+    core->hashfn = hashfn;
+    core->cmpfn = cmpfn;
+    core->data = data;
+    core->layout = SCM_HASH_OPEN_ADDRESSING;
+    core->oldBuckets = NULL;
+    core->oldNumBuckets = core->oldNumBucketsLog2 = core->migrated = 0;
+    core->stats = NULL;
+    oa_alloc(core, size);
+}
+
 int Scm_HashCoreTypeToProcs(ScmHashType type,
                             ScmHashProc **hashfn,
                             ScmHashCompareProc **cmpfn)
@@ -723,9 +1253,17 @@ int Scm_HashCoreTypeToProcs(ScmHashType type,
 
 void Scm_HashCoreCopy(ScmHashCore *dst, const ScmHashCore *src)
 {
-    Entry **b = SCM_NEW_ARRAY(Entry*, src->numBuckets);
+    Entry **b;
+
+    if (src->layout == SCM_HASH_OPEN_ADDRESSING) {
+        size_t size = (sizeof(OAEntry)+1) * src->numBuckets;
+        b = SCM_NEW2(Entry**, size);
+        memcpy(b, src->buckets, size);
+    } else {
+        b = SCM_NEW_ARRAY(Entry*, src->numBuckets);
+    }
 
-    for (int i=0; i<src->numBuckets; i++) {
+    for (int i=0; src->layout == SCM_HASH_CHAINED && i<src->numBuckets; i++) {
         Entry *p = NULL;
         Entry *s = (Entry*)src->buckets[i];
         b[i] = NULL;
@@ -733,6 +1271,7 @@ void Scm_HashCoreCopy(ScmHashCore *dst, const ScmHashCore *src)
             Entry *e = SCM_NEW(Entry);
             e->key = s->key;
             e->value = s->value;
+            e->hashval = s->hashval;
             e->next = NULL;
             if (p) p->next = e;
             else   b[i] = e;
@@ -740,6 +1279,22 @@ void Scm_HashCoreCopy(ScmHashCore *dst, const ScmHashCore *src)
             s = s->next;
         }
     }
+    /* If SRC is being extended, the copy gets the unmigrated entries
+       directly in the new bucket array. */
+    if (src->oldBuckets) {
+        for (int i=src->migrated; i<src->oldNumBuckets; i++) {
+            for (Entry *s = (Entry*)src->oldBuckets[i]; s; s = s->next) {
+                int index = HASH2INDEX(src->numBuckets, src->numBucketsLog2,
+                                       s->hashval);
+                Entry *e = SCM_NEW(Entry);
+                e->key = s->key;
+                e->value = s->value;
+                e->hashval = s->hashval;
+                e->next = b[index];
+                b[index] = e;
+            }
+        }
+    }
 
     /* A little trick to avoid hazard in careless race condition */
     dst->numBuckets = dst->numEntries = 0;
@@ -751,17 +1306,84 @@ void Scm_HashCoreCopy(ScmHashCore *dst, const ScmHashCore *src)
     dst->data     = src->data;
     dst->numEntries = src->numEntries;
     dst->numBucketsLog2 = src->numBucketsLog2;
+    dst->layout = src->layout;
+    dst->numDeleted = src->numDeleted;
+    dst->oldBuckets = NULL;
+    dst->oldNumBuckets = dst->oldNumBucketsLog2 = dst->migrated = 0;
+    dst->stats = NULL;
     dst->numBuckets = src->numBuckets;
 }
 
 void Scm_HashCoreClear(ScmHashCore *table)
 {
-    for (int i=0; i<table->numBuckets; i++) {
-        table->buckets[i] = NULL;
+    if (table->layout == SCM_HASH_OPEN_ADDRESSING) {
+        OAEntry *slots = OA_SLOTS(table);
+        u_char  *ctrl  = OA_CTRL(table);
+        for (int i=0; i<table->numBuckets; i++) {
+            slots[i].key = slots[i].value = 0;
+            ctrl[i] = OA_EMPTY;
+        }
+        table->numDeleted = 0;
+    } else {
+        for (int i=0; i<table->numBuckets; i++) {
+            table->buckets[i] = NULL;
+        }
+        table->oldBuckets = NULL;
+        table->oldNumBuckets = table->oldNumBucketsLog2 = table->migrated = 0;
     }
     table->numEntries = 0;
 }
 
+/* Removes the entries for which PRED returns TRUE, looking at up to
+   COUNT buckets from *CURSOR, which is advanced for the next call;
+   a negative COUNT scans the rest of the table.  Returns TRUE when the
+   scan reaches the end of the table, in which case *CURSOR is reset
+   to 0.  This is for weak hash tables, whose entries can die without
+   the table knowing.  Only the chained layout is supported.
+
+   The sweep can run while an iterator is on the table, e.g. when
+   the table is modified in the loop.  The iterator may hold any entry
+   as the next one to visit, so unlike delete_entry we keep the "next"
+   link of the removed entries, and the iterator can follow it back to
+   the chain.  The caller must make PRED true only for the entries the
+   iterator skips.  For the same reason we don't finish the migration
+   of the old bucket array here; the buckets are counted in the same
+   way as the iterator does, i.e. the old array follows the current
+   one. */
+int Scm_HashCoreSweep(ScmHashCore *table,
+                      int (*pred)(ScmDictEntry*, void*), void *data,
+                      int *cursor, int count)
+{
+    SCM_ASSERT(table->layout == SCM_HASH_CHAINED);
+    int total = table->numBuckets + table->oldNumBuckets;
+    int i = *cursor;
+    int limit = (count < 0)? total : i + count;
+    if (limit > total) limit = total;
+
+    for (; i < limit; i++) {
+        Entry **b = (i < table->numBuckets)
+            ? &BUCKETS(table)[i]
+            : &((Entry**)table->oldBuckets)[i - table->numBuckets];
+        for (Entry *e = *b, *p = NULL; e; e = e->next) {
+            if (pred((ScmDictEntry*)e, data)) {
+                if (p) p->next = e->next;
+                else *b = e->next;
+                table->numEntries--;
+                SCM_ASSERT(table->numEntries >= 0);
+            } else {
+                p = e;
+            }
+        }
+    }
+    if (i >= total) {
+        *cursor = 0;
+        return TRUE;
+    } else {
+        *cursor = i;
+        return FALSE;
+    }
+}
+
 ScmDictEntry *Scm_HashCoreSearch(ScmHashCore *table, intptr_t key,
                                  ScmDictOp op)
 {
@@ -774,40 +1396,84 @@ int Scm_HashCoreNumEntries(ScmHashCore *table)
     return table->numEntries;
 }
 
+/* Start or stop collecting access statistics.  Starting always
+   resets the counters. */
+void Scm_HashCoreInstrument(ScmHashCore *table, int enable)
+{
+    if (enable) {
+        HashStats *st = SCM_NEW_ATOMIC(HashStats);
+        memset(st, 0, sizeof(HashStats));
+        table->stats = st;
+    } else {
+        table->stats = NULL;
+    }
+}
+
 /*
  * NB: It is important to keep the pointer to the "next" entry,
  * not the "current", since the current entry may be deleted,
  * erasing its next pointer.
  */
-void Scm_HashIterInit(ScmHashIter *iter, ScmHashCore *table)
+
+/* For the chained layout, iter->bucket counts the buckets of the
+   current array first, then those of the old array if the table is
+   being extended.  Set up ITER to point to the first entry of the
+   first nonempty bucket at or after I. */
+static void chain_iter_seek(ScmHashIter *iter, int i)
 {
-    iter->core = table;
-    for (int i=0; i<table->numBuckets; i++) {
-        if (table->buckets[i]) {
+    ScmHashCore *core = iter->core;
+    for (; i < core->numBuckets; i++) {
+        if (core->buckets[i]) {
             iter->bucket = i;
-            iter->next = table->buckets[i];
+            iter->next = core->buckets[i];
             return;
         }
     }
+    if (core->oldBuckets) {
+        int j = i - core->numBuckets;
+        if (j < core->migrated) j = core->migrated;
+        for (; j < core->oldNumBuckets; j++) {
+            if (core->oldBuckets[j]) {
+                iter->bucket = core->numBuckets + j;
+                iter->next = core->oldBuckets[j];
+                return;
+            }
+        }
+    }
     iter->next = NULL;
 }
 
+void Scm_HashIterInit(ScmHashIter *iter, ScmHashCore *table)
+{
+    iter->core = table;
+    if (table->layout == SCM_HASH_OPEN_ADDRESSING) {
+        /* we use iter->bucket as the index of the next slot to look at. */
+        iter->bucket = 0;
+        iter->next = NULL;
+        return;
+    }
+    chain_iter_seek(iter, 0);
+}
+
 ScmDictEntry *Scm_HashIterNext(ScmHashIter *iter)
 {
+    if (iter->core->layout == SCM_HASH_OPEN_ADDRESSING) {
+        ScmHashCore *core = iter->core;
+        u_char *ctrl = OA_CTRL(core);
+        for (int i = iter->bucket; i < core->numBuckets; i++) {
+            if (OA_FULLP(ctrl[i])) {
+                iter->bucket = i+1;
+                return (ScmDictEntry*)&OA_SLOTS(core)[i];
+            }
+        }
+        iter->bucket = core->numBuckets;
+        return NULL;
+    }
+
     Entry *e = (Entry*)iter->next;
     if (e != NULL) {
         if (e->next) iter->next = e->next;
-        else {
-            int i = iter->bucket + 1;
-            for (; i < iter->core->numBuckets; i++) {
-                if (iter->core->buckets[i]) {
-                    iter->bucket = i;
-                    iter->next = iter->core->buckets[i];
-                    return (ScmDictEntry*)e;
-                }
-            }
-            iter->next = NULL;
-        }
+        else chain_iter_seek(iter, iter->bucket + 1);
     }
     return (ScmDictEntry*)e;
 }
@@ -834,6 +1500,19 @@ ScmObj Scm_MakeHashTableSimple(ScmHashType type, unsigned int initSize)
     return SCM_OBJ(z);
 }
 
+ScmObj Scm_MakeHashTableLayout(ScmHashType type, ScmHashLayout layout,
+                               unsigned int initSize)
+{
+    if (type > SCM_HASH_GENERAL) {
+        Scm_Error("Scm_MakeHashTableLayout: wrong type arg: %d", type);
+    }
+    ScmHashTable *z = SCM_NEW(ScmHashTable);
+    SCM_SET_CLASS(z, SCM_CLASS_HASH_TABLE);
+    Scm_HashCoreInitLayout(&z->core, type, layout, initSize, NULL);
+    z->type = type;
+    return SCM_OBJ(z);
+}
+
 ScmObj Scm_MakeHashTableFull(ScmHashProc hashfn,
                              ScmHashCompareProc cmpfn,
                              unsigned int initSize, void *data)
@@ -915,6 +1594,19 @@ ScmObj Scm_HashTableValues(ScmHashTable *table)
     return h;
 }
 
+/* Returns a vector whose I-th element is the number of I in COUNTS. */
+static ScmObj make_histogram(const u_long *counts, int n)
+{
+    u_long maxval = 0;
+    for (int i=0; i<n; i++) if (counts[i] > maxval) maxval = counts[i];
+    ScmObj v = Scm_MakeVector((int)maxval+1, SCM_MAKE_INT(0));
+    for (int i=0; i<n; i++) {
+        ScmObj *p = &SCM_VECTOR_ELEMENT(v, counts[i]);
+        *p = SCM_MAKE_INT(SCM_INT_VALUE(*p) + 1);
+    }
+    return v;
+}
+
 ScmObj Scm_HashTableStat(ScmHashTable *table)
 {
     ScmObj h = SCM_NIL, t = SCM_NIL;
@@ -925,16 +1617,98 @@ ScmObj Scm_HashTableStat(ScmHashTable *table)
     SCM_APPEND1(h, t, Scm_MakeInteger(c->numBuckets));
     SCM_APPEND1(h, t, SCM_MAKE_KEYWORD("num-buckets-log2"));
     SCM_APPEND1(h, t, Scm_MakeInteger(c->numBucketsLog2));
+    SCM_APPEND1(h, t, SCM_MAKE_KEYWORD("layout"));
+    if (c->layout == SCM_HASH_OPEN_ADDRESSING) {
+        SCM_APPEND1(h, t, SCM_INTERN("open-addressing"));
+        SCM_APPEND1(h, t, SCM_MAKE_KEYWORD("num-deleted"));
+        SCM_APPEND1(h, t, Scm_MakeInteger(c->numDeleted));
+    } else {
+        SCM_APPEND1(h, t, SCM_INTERN("chained"));
+        if (c->oldBuckets) {
+            SCM_APPEND1(h, t, SCM_MAKE_KEYWORD("pending-buckets"));
+            SCM_APPEND1(h, t, Scm_MakeInteger(c->oldNumBuckets - c->migrated));
+        }
+    }
+    SCM_APPEND1(h, t, SCM_MAKE_KEYWORD("load-factor"));
+    SCM_APPEND1(h, t, Scm_MakeFlonum((double)c->numEntries/c->numBuckets));
 
-    Entry** b = BUCKETS(c);
+    /* For the chained layout, COUNTS[i] is the length of the i-th
+       chain.  For open addressing, it's the number of probes needed
+       to reach the entry in the i-th slot (0 if the slot is not used). */
     ScmVector *v = SCM_VECTOR(Scm_MakeVector(c->numBuckets, SCM_NIL));
     ScmObj *vp = SCM_VECTOR_ELEMENTS(v);
-    for (int i = 0; i<c->numBuckets; i++, vp++) {
-        Entry *e = b[i];
-        for (; e; e = e->next) {
-            *vp = Scm_Acons(SCM_DICT_KEY(e), SCM_DICT_VALUE(e), *vp);
+    u_long *counts = SCM_NEW_ATOMIC_ARRAY(u_long, c->numBuckets);
+    int used = 0;
+    if (c->layout == SCM_HASH_OPEN_ADDRESSING) {
+        OAEntry *slots = OA_SLOTS(c);
+        u_char *ctrl = OA_CTRL(c);
+        u_long mask = c->numBuckets - 1;
+        for (int i = 0; i<c->numBuckets; i++, vp++) {
+            counts[i] = 0;
+            if (OA_FULLP(ctrl[i])) {
+                *vp = Scm_Acons(SCM_DICT_KEY(&slots[i]),
+                                SCM_DICT_VALUE(&slots[i]), *vp);
+                u_long home = HASH2INDEX(c->numBuckets, c->numBucketsLog2,
+                                         slots[i].hashval);
+                counts[i] = ((i - home) & mask) + 1;
+                used++;
+            }
         }
+    } else {
+        Entry** b = BUCKETS(c);
+        for (int i = 0; i<c->numBuckets; i++, vp++) {
+            Entry *e = b[i];
+            counts[i] = 0;
+            for (; e; e = e->next) {
+                *vp = Scm_Acons(SCM_DICT_KEY(e), SCM_DICT_VALUE(e), *vp);
+                counts[i]++;
+            }
+        }
+        /* Unmigrated entries are shown in the buckets they'll move to. */
+        for (int i = c->migrated; c->oldBuckets && i<c->oldNumBuckets; i++) {
+            for (Entry *e = (Entry*)c->oldBuckets[i]; e; e = e->next) {
+                int k = HASH2INDEX(c->numBuckets, c->numBucketsLog2,
+                                   e->hashval);
+                vp = SCM_VECTOR_ELEMENTS(v) + k;
+                *vp = Scm_Acons(SCM_DICT_KEY(e), SCM_DICT_VALUE(e), *vp);
+                counts[k]++;
+            }
+        }
+        for (int i = 0; i<c->numBuckets; i++) if (counts[i]) used++;
+    }
+    SCM_APPEND1(h, t, SCM_MAKE_KEYWORD("used-buckets"));
+    SCM_APPEND1(h, t, Scm_MakeInteger(used));
+    if (c->layout == SCM_HASH_OPEN_ADDRESSING) {
+        /* Exclude unused slots from the histogram. */
+        int j = 0;
+        for (int i = 0; i<c->numBuckets; i++) {
+            if (counts[i]) counts[j++] = counts[i];
+        }
+        SCM_APPEND1(h, t, SCM_MAKE_KEYWORD("probe-length-histogram"));
+        SCM_APPEND1(h, t, make_histogram(counts, j));
+    } else {
+        SCM_APPEND1(h, t, SCM_MAKE_KEYWORD("chain-length-histogram"));
+        SCM_APPEND1(h, t, make_histogram(counts, c->numBuckets));
     }
+
+    HashStats *st = STATS(c);
+    if (st) {
+        SCM_APPEND1(h, t, SCM_MAKE_KEYWORD("lookups"));
+        SCM_APPEND1(h, t, Scm_MakeIntegerU(st->lookups));
+        SCM_APPEND1(h, t, SCM_MAKE_KEYWORD("average-probe-length"));
+        SCM_APPEND1(h, t, Scm_MakeFlonum(st->lookups
+                                         ? (double)st->probes/st->lookups
+                                         : 0.0));
+        SCM_APPEND1(h, t, SCM_MAKE_KEYWORD("max-probe-length"));
+        SCM_APPEND1(h, t, Scm_MakeIntegerU(st->maxProbe));
+        SCM_APPEND1(h, t, SCM_MAKE_KEYWORD("collisions"));
+        SCM_APPEND1(h, t, Scm_MakeIntegerU(st->collisions));
+        SCM_APPEND1(h, t, SCM_MAKE_KEYWORD("rehashes"));
+        SCM_APPEND1(h, t, Scm_MakeIntegerU(st->rehashes));
+        SCM_APPEND1(h, t, SCM_MAKE_KEYWORD("rehash-time"));
+        SCM_APPEND1(h, t, Scm_MakeFlonum(st->rehashUsec/1.0e6));
+    }
+
     SCM_APPEND1(h, t, SCM_MAKE_KEYWORD("contents"));
     SCM_APPEND1(h, t, SCM_OBJ(v));
     return h;
@@ -1152,8 +1926,7 @@ u_long Scm_Hash(ScmObj obj)
         goto string_hash;
     } else {
         /* Call specialized object-hash method */
-        ScmObj r = Scm_ApplyRec(SCM_OBJ(&Scm_GenericObjectHash),
-                                SCM_LIST1(obj));
+        ScmObj r = Scm_ApplyRec1(SCM_OBJ(&Scm_GenericObjectHash), obj);
         if (SCM_INTP(r)) {
             return ((u_long)SCM_INT_VALUE(r))&PORTABLE_HASHMASK;
         }
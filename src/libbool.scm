@@ -42,11 +42,12 @@
 ;;
 
 (select-module scheme)
-(define-cproc eqv? (obj1 obj2) ::<boolean> :fast-flonum :constant
+(define-cproc eqv? (obj1 obj2) ::<boolean> :fast-flonum :constant :leaf
   (inliner EQV) Scm_EqvP)
-(define-cproc eq? (obj1 obj2)  ::<boolean> :fast-flonum :constant
+(define-cproc eq? (obj1 obj2)  ::<boolean> :fast-flonum :constant :leaf
   (inliner EQ) SCM_EQ)
-(define-cproc equal? (obj1 obj2) ::<boolean> :fast-flonum Scm_EqualP)
+(define-cproc equal? (obj1 obj2) ::<boolean> :fast-flonum :leaf
+  Scm_EqualP)
 
 ;;
 ;; Booleans
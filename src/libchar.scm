@@ -62,15 +62,15 @@
  )
 
 (define-cproc char=? (c1::<char> c2::<char> :rest chars)
-  ::<boolean> :constant (char-cmp ==))
+  ::<boolean> :constant :leaf (char-cmp ==))
 (define-cproc char<? (c1::<char> c2::<char> :rest chars)
-  ::<boolean> :constant (char-cmp <))
+  ::<boolean> :constant :leaf (char-cmp <))
 (define-cproc char>? (c1::<char> c2::<char> :rest chars)
-  ::<boolean> :constant (char-cmp >))
+  ::<boolean> :constant :leaf (char-cmp >))
 (define-cproc char<=? (c1::<char> c2::<char> :rest chars)
-  ::<boolean> :constant (char-cmp <=))
+  ::<boolean> :constant :leaf (char-cmp <=))
 (define-cproc char>=? (c1::<char> c2::<char> :rest chars)
-  ::<boolean> :constant (char-cmp >=))
+  ::<boolean> :constant :leaf (char-cmp >=))
 
 (inline-stub
  (define-cise-expr char-ci-cmp
@@ -91,15 +91,15 @@
  )
 
 (define-cproc char-ci=? (c1::<char> c2::<char> :rest chars)
-  ::<boolean> :constant (char-ci-cmp ==))
+  ::<boolean> :constant :leaf (char-ci-cmp ==))
 (define-cproc char-ci<? (c1::<char> c2::<char> :rest chars)
-  ::<boolean> :constant (char-ci-cmp <))
+  ::<boolean> :constant :leaf (char-ci-cmp <))
 (define-cproc char-ci>? (c1::<char> c2::<char> :rest chars)
-  ::<boolean> :constant (char-ci-cmp >))
+  ::<boolean> :constant :leaf (char-ci-cmp >))
 (define-cproc char-ci<=? (c1::<char> c2::<char> :rest chars)
-  ::<boolean> :constant (char-ci-cmp <=))
+  ::<boolean> :constant :leaf (char-ci-cmp <=))
 (define-cproc char-ci>=? (c1::<char> c2::<char> :rest chars)
-  ::<boolean> :constant (char-ci-cmp >=))
+  ::<boolean> :constant :leaf (char-ci-cmp >=))
 
 (define-cproc char-alphabetic? (c::<char>) ::<boolean> Scm_CharAlphabeticP)
 (define-cproc char-numeric? (c::<char>) ::<boolean> Scm_CharNumericP)
@@ -214,6 +214,9 @@
 
 (define-cproc char-set-copy (cs::<char-set>) Scm_CharSetCopy)
 
+(define-cproc char-set-immutable? (cs::<char-set>) ::<boolean>
+  (return (SCM_CHAR_SET_IMMUTABLE_P cs)))
+
 (define (char-set-size cs)
   (rlet1 count 0
     (for-each (^[range] (inc! count (- (cdr range) (car range) -1)))
@@ -258,6 +261,7 @@
 
 (define-cproc %char-set-add! (dst::<char-set> src::<char-set>) Scm_CharSetAdd)
 (define-cproc %char-set-ranges (cs::<char-set>) Scm_CharSetRanges)
+(define-cproc %char-set-freeze! (cs::<char-set>) Scm_CharSetFreeze)
 (define-cproc %char-set-predefined (num::<fixnum>) Scm_GetStandardCharSet)
 
 (define-cproc %char-set-dump (cs::<char-set>) ::<void>
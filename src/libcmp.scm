@@ -284,6 +284,13 @@
          (let* ([r (Scm_VectorCopy (SCM_VECTOR seq) 0 -1 SCM_UNDEFINED)])
            (Scm_SortArray (SCM_VECTOR_ELEMENTS r) (SCM_VECTOR_SIZE r) '#f)
            (return r))]
+        [(SCM_UVECTORP seq)
+         (let* ([r (Scm_MakeUVector (SCM_CLASS_OF seq) (SCM_UVECTOR_SIZE seq)
+                                    NULL)])
+           (memcpy (SCM_UVECTOR_ELEMENTS r) (SCM_UVECTOR_ELEMENTS seq)
+                   (Scm_UVectorSizeInBytes (SCM_UVECTOR seq)))
+           (Scm_UVectorSortX (SCM_UVECTOR r))
+           (return r))]
         [(>= (Scm_Length seq) 0) (return (Scm_SortList seq '#f))]
         [else (SCM_TYPE_ERROR seq "proper list or vector")
               (return SCM_UNDEFINED)]))
@@ -292,7 +299,33 @@
   (cond [(SCM_VECTORP seq)
          (Scm_SortArray (SCM_VECTOR_ELEMENTS seq) (SCM_VECTOR_SIZE seq) '#f)
          (return seq)]
+        [(SCM_UVECTORP seq)
+         (Scm_UVectorSortX (SCM_UVECTOR seq))
+         (return seq)]
         [(>= (Scm_Length seq) 0) (return (Scm_SortListX seq '#f))]
         [else (SCM_TYPE_ERROR seq "proper list or vector")
               (return SCM_UNDEFINED)]))
 
+;; Stable sort with the default compare.  If KEYS is given, it must
+;; be a vector of the same length as SEQ, and the elements of SEQ are
+;; ordered by the corresponding keys.  SEQ is sorted in place, by
+;; replacing cars if it is a list.
+(define-cproc %stable-sort! (seq :optional (keys::<vector>? #f))
+  (let* ([len::int 0]
+         [v::ScmObj* NULL])
+    (cond [(SCM_VECTORP seq)
+           (set! len (SCM_VECTOR_SIZE seq)
+                 v (SCM_VECTOR_ELEMENTS seq))]
+          [(>= (Scm_Length seq) 0)
+           (set! v (Scm_ListToArray seq (& len) NULL TRUE))]
+          [else (SCM_TYPE_ERROR seq "proper list or vector")])
+    (when (and keys (!= (SCM_VECTOR_SIZE keys) len))
+      (Scm_Error "key vector length mismatch: %S" (SCM_OBJ keys)))
+    (Scm_StableSortArray v (?: keys (SCM_VECTOR_ELEMENTS keys) NULL) len)
+    (unless (SCM_VECTORP seq)
+      (let* ([cp seq])
+        (dotimes [i len]
+          (SCM_SET_CAR cp (aref v i))
+          (set! cp (SCM_CDR cp)))))
+    (return seq)))
+
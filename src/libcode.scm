@@ -179,6 +179,10 @@
            src))))
 
 (select-module gauche.internal)
+;; Autoloaded code-memory-usage uses this.
+;; See lib/gauche/vm/profiler.scm
+(define-cproc %code-memory-usage (roots::<list>) Scm_CompiledCodeMemoryUsage)
+
 ;; Standard way to extract source code from <compiled-code>
 (define (compiled-code-definition code)
   (and-let1 def (assq-ref (~ code'debug-info) 'definition)
@@ -209,7 +213,7 @@
    (c "SCM_CLASS_DEFAULT_CPL")
    ((parent :setter #f)
     (signature-info :c-name "signatureInfo")
-    (debug-info :c-name "debugInfo" :setter #f)
+    (debug-info :c-spec "Scm_CompiledCodeDebugInfo(obj)" :setter #f)
     (required-args :type <fixnum> :c-name "requiredArgs" :setter #f)
     (optional-args :type <fixnum> :c-name "optionalArgs" :setter #f)
     (name :setter #f)
@@ -218,7 +222,7 @@
     (max-stack :type <fixnum> :c-name "maxstack" :setter #f)
     (intermediate-form :c-name "intermediateForm" :setter #f)
     ;; TRANSIENT: For the backward compatibility - will be gone soon
-    (info :c-name "debugInfo" :setter #f)
+    (info :c-spec "Scm_CompiledCodeDebugInfo(obj)" :setter #f)
     (arg-info :c-name "signatureInfo" :setter #f))
    (printer (Scm_Printf port "#<compiled-code %S@%p>"
                         (Scm_CompiledCodeFullName (SCM_COMPILED_CODE obj))
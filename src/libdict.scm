@@ -55,7 +55,7 @@
  (define-cise-stmt dict-update!
    [(_ dict searcher xtractor cc) ;; assumes key, proc, and fallback
     `(let* ([e::ScmDictEntry*]
-            [data::(.array void* (1))])
+            [data::(.array void* (3))])
        (cond [(SCM_UNBOUNDP fallback)
               (set! e (,searcher (,xtractor ,dict) (cast intptr_t key)
                                  SCM_DICT_GET))
@@ -65,8 +65,10 @@
                                  SCM_DICT_CREATE))
               (unless (-> e value)
                 (cast void (SCM_DICT_SET_VALUE e fallback)))])
-       (set! (aref data 0) (cast void* e))
-       (Scm_VMPushCC ,cc data 1)
+       (set! (aref data 0) (cast void* e)
+             (aref data 1) (cast void* ,dict)
+             (aref data 2) (cast void* key))
+       (Scm_VMPushCC ,cc data 3)
        (return (Scm_VMApply1 proc (SCM_DICT_VALUE e))))])
 
  (define-cise-stmt dict-push!
@@ -131,12 +133,13 @@
 (select-module gauche)
 (define-cproc hash-salt () ::<fixnum> Scm_HashSaltRef)
 
-(define-cproc eq-hash (obj)  ::<ulong> :fast-flonum Scm_EqHash)
-(define-cproc eqv-hash (obj) ::<ulong> :fast-flonum Scm_EqvHash)
-(define-cproc legacy-hash (obj) ::<ulong> :fast-flonum Scm_Hash)
+(define-cproc eq-hash (obj)  ::<ulong> :fast-flonum :leaf Scm_EqHash)
+(define-cproc eqv-hash (obj) ::<ulong> :fast-flonum :leaf Scm_EqvHash)
+(define-cproc legacy-hash (obj) ::<ulong> :fast-flonum :leaf Scm_Hash)
 (define-cproc portable-hash (obj salt::<fixnum>) ::<ulong>
-  :fast-flonum Scm_PortableHash)
-(define-cproc default-hash (obj) ::<fixnum> :fast-flonum Scm_DefaultHash)
+  :fast-flonum :leaf Scm_PortableHash)
+(define-cproc default-hash (obj) ::<fixnum> :fast-flonum :leaf
+  Scm_DefaultHash)
 (define-cproc combine-hash-value (a::<ulong> b::<ulong>) ::<ulong>
   Scm_CombineHashValue)
 
@@ -147,10 +150,19 @@
 
 (define-cproc hash-table? (obj) ::<boolean> :fast-flonum SCM_HASH_TABLE_P)
 
-(define-cproc %make-hash-table-simple (type init-size::<int>)
-  (let* ([ctype::int 0])
+(define-cproc %make-hash-table-simple (type init-size::<int>
+                                            :optional (layout #f))
+  (let* ([ctype::int 0]
+         [clayout::ScmHashLayout SCM_HASH_CHAINED])
     (set-hash-type! ctype type)
-    (return (Scm_MakeHashTableSimple ctype init-size))))
+    (cond [(or (SCM_FALSEP layout) (SCM_EQ layout 'chained))]
+          [(SCM_EQ layout 'open-addressing)
+           (when (== ctype SCM_HASH_EQUAL)
+             (Scm_Error "open-addressing layout isn't supported for \
+                         equal? hash table"))
+           (set! clayout SCM_HASH_OPEN_ADDRESSING)]
+          [else (Scm_Error "unsupported hash table layout: %S" layout)])
+    (return (Scm_MakeHashTableLayout ctype clayout init-size))))
 
 (inline-stub
 (define-cfn generic-hashtable-hash (h::(const ScmHashCore*) key::intptr_t)
@@ -209,10 +221,12 @@
 
 ;; Comparator argument can be <comparator> or one of the symbols
 ;; eq?, eqv?, equal? or string=?.
-(define (make-hash-table :optional (comparator 'eq?) (init-size 0))
+;; Layout can be #f, chained or open-addressing.
+(define (make-hash-table :optional (comparator 'eq?) (init-size 0)
+                                   (layout #f))
   (case comparator
     [(eq? eqv? equal? string=?)
-     (%make-hash-table-simple comparator init-size)]
+     (%make-hash-table-simple comparator init-size layout)]
     [else
      (unless (comparator? comparator)
        (error "make-hash-table requires a comparator or \
@@ -220,14 +234,17 @@
               comparator))
      (cond
       [(eq? comparator eq-comparator)
-       (make-hash-table 'eq? init-size)]
+       (make-hash-table 'eq? init-size layout)]
       [(eq? comparator eqv-comparator)
-       (make-hash-table 'eqv? init-size)]
+       (make-hash-table 'eqv? init-size layout)]
       [(eq? comparator equal-comparator)
-       (make-hash-table 'equal? init-size)]
+       (make-hash-table 'equal? init-size layout)]
       [(eq? comparator string-comparator)
-       (make-hash-table 'string=? init-size)]
+       (make-hash-table 'string=? init-size layout)]
       [else
+       (when (eq? layout 'open-addressing)
+         (error "open-addressing layout isn't supported for the comparator:"
+                comparator))
        (unless (comparator-hashable? comparator)
          (error "make-hash-table requires a comparator with hash function, \
                  but got:" comparator))
@@ -281,7 +298,13 @@
 
 (inline-stub
  (define-cfn hash-table-update-cc (result (data :: void**)) :static
-   (let* ([e::ScmDictEntry* (cast ScmDictEntry* (aref data 0))])
+   (let* ([e::ScmDictEntry* (cast ScmDictEntry* (aref data 0))]
+          [core::ScmHashCore* (SCM_HASH_TABLE_CORE (aref data 1))])
+     ;; With the open addressing layout, the entry may have been moved
+     ;; while proc is running, so we look it up again.
+     (when (== (-> core layout) SCM_HASH_OPEN_ADDRESSING)
+       (set! e (Scm_HashCoreSearch core (cast intptr_t (aref data 2))
+                                   SCM_DICT_CREATE)))
      (cast void (SCM_DICT_SET_VALUE e result))
      (return result)))
  )
@@ -316,6 +339,10 @@
 (define-cproc hash-table-keys (hash::<hash-table>)   Scm_HashTableKeys)
 (define-cproc hash-table-values (hash::<hash-table>) Scm_HashTableValues)
 (define-cproc hash-table-stat (hash::<hash-table>)   Scm_HashTableStat)
+(define-cproc hash-table-instrument! (hash::<hash-table>
+                                      :optional (enable::<boolean> #t))
+  ::<void>
+  (Scm_HashCoreInstrument (SCM_HASH_TABLE_CORE hash) enable))
 
 ;; conversion to/from hash-table
 (define (alist->hash-table a . opt-cmpr)
@@ -325,6 +352,92 @@
 (define (hash-table->alist h)
   (hash-table-map h cons))
 
+;;;
+;;; Weak hash tables
+;;;
+
+(select-module gauche)
+
+;; WEAKNESS is one of key, value or both.  An entry whose key is collected
+;; disappears; an entry whose value is collected returns DEFAULT-VALUE.
+(define-cproc make-weak-hash-table (type weakness
+                                         :optional (default-value #f)
+                                                   (init-size::<int> 0))
+  (let* ([ctype::int 0]
+         [cweakness::int 0])
+    (set-hash-type! ctype type)
+    (cond [(SCM_EQ weakness 'key)   (set! cweakness SCM_WEAK_KEY)]
+          [(SCM_EQ weakness 'value) (set! cweakness SCM_WEAK_VALUE)]
+          [(SCM_EQ weakness 'both)  (set! cweakness SCM_WEAK_BOTH)]
+          [else (Scm_Error "weakness must be one of key, value or both, \
+                            but got: %S" weakness)])
+    (return (Scm_MakeWeakHashTableSimple ctype cweakness init-size
+                                         default-value))))
+
+(define-cproc weak-hash-table-type (hash::<weak-hash-table>)
+  (get-hash-type (-> hash type)))
+
+(define-cproc weak-hash-table-weakness (hash::<weak-hash-table>)
+  (case (-> hash weakness)
+    [(SCM_WEAK_KEY)   (return 'key)]
+    [(SCM_WEAK_VALUE) (return 'value)]
+    [else             (return 'both)]))
+
+;; The count includes the entries whose key has been collected but
+;; not yet swept.
+(define-cproc weak-hash-table-num-entries (hash::<weak-hash-table>) ::<int>
+  (return (Scm_HashCoreNumEntries (SCM_WEAK_HASH_TABLE_CORE hash))))
+
+(define-cproc weak-hash-table-get (hash::<weak-hash-table> key
+                                                           :optional fallback)
+  (dict-get hash Scm_WeakHashTableRef))
+
+(define-cproc weak-hash-table-put! (hash::<weak-hash-table> key value)
+  ::<void>
+  (Scm_WeakHashTableSet hash key value 0))
+
+(define-cproc weak-hash-table-delete! (hash::<weak-hash-table> key)
+  ::<boolean>
+  (return (not (SCM_UNBOUNDP (Scm_WeakHashTableDelete hash key)))))
+
+(define-cproc weak-hash-table-exists? (hash::<weak-hash-table> key)
+  ::<boolean>
+  (return (dict-exists? hash Scm_WeakHashTableRef)))
+
+(define-cproc weak-hash-table-copy (hash::<weak-hash-table>)
+  Scm_WeakHashTableCopy)
+(define-cproc weak-hash-table-keys (hash::<weak-hash-table>)
+  Scm_WeakHashTableKeys)
+(define-cproc weak-hash-table-values (hash::<weak-hash-table>)
+  Scm_WeakHashTableValues)
+
+(inline-stub
+ (define-cfn weak-hash-table-iter (args::ScmObj* nargs::int data::void*)
+   :static
+   (let* ([iter::ScmWeakHashIter* (cast ScmWeakHashIter* data)]
+          [key::ScmObj] [value::ScmObj]
+          [eofval (aref args 0)])
+     (if (Scm_WeakHashIterNext iter (& key) (& value))
+       (return (values key value))
+       (return (values eofval eofval)))))
+ )
+
+(define-cproc %weak-hash-table-iter (hash::<weak-hash-table>)
+  (let* ([iter::ScmWeakHashIter* (SCM_NEW ScmWeakHashIter)])
+    (Scm_WeakHashIterInit iter hash)
+    (return (Scm_MakeSubr weak_hash_table_iter iter 1 0
+                          '"weak-hash-table-iterator"))))
+
+;; PROC may put to or delete the entry it is given.  The entries whose
+;; key has been collected are skipped.
+(define (weak-hash-table-for-each hash proc)
+  (let ([eof (cons #f #f)]
+        [i (%weak-hash-table-iter hash)])
+    (let loop ()
+      (receive [k v] (i eof)
+        (unless (eq? k eof)
+          (proc k v) (loop))))))
+
 ;;;
 ;;; TreeMap
 ;;;
@@ -345,10 +458,13 @@
        (return (SCM_INT_VALUE r)))))
  )
 
-(define-cproc %make-tree-map (comparator)
-  (begin
+(define-cproc %make-tree-map (comparator :optional (layout #f))
+  (let* ([clayout::ScmTreeLayout SCM_TREE_RED_BLACK])
     (SCM_ASSERT (SCM_COMPARATORP comparator))
-    (return (Scm_MakeTreeMap tree_map_cmp comparator))))
+    (cond [(or (SCM_FALSEP layout) (SCM_EQ layout 'red-black))]
+          [(SCM_EQ layout 'b+tree) (set! clayout SCM_TREE_BPLUS)]
+          [else (Scm_Error "unsupported tree map layout: %S" layout)])
+    (return (Scm_MakeTreeMapLayout tree_map_cmp clayout comparator))))
 
 ;; TODO: We do want to return something even for tree-maps that aren't
 ;; created from the Scheme world.  But how?
@@ -376,7 +492,13 @@
 
 (inline-stub
  (define-cfn tree-map-update-cc (result data::void**) :static
-   (let* ([e::ScmDictEntry* (cast ScmDictEntry* (aref data 0))])
+   (let* ([e::ScmDictEntry* (cast ScmDictEntry* (aref data 0))]
+          [core::ScmTreeCore* (SCM_TREE_MAP_CORE (aref data 1))])
+     ;; With the B+tree layout, the entry may have been moved while
+     ;; proc is running, so we look it up again.
+     (when (== (-> core layout) SCM_TREE_BPLUS)
+       (set! e (Scm_TreeCoreSearch core (cast intptr_t (aref data 2))
+                                   SCM_DICT_CREATE)))
      (cast void (SCM_DICT_SET_VALUE e result))
      (return result)))
  )
@@ -422,6 +544,66 @@
     (Scm_TreeIterInit iter (SCM_TREE_MAP_CORE tm) NULL)
     (return (Scm_MakeSubr tree_map_iter iter 2 0 '"tree-map-iterator"))))
 
+;; Iterates over the entries whose keys are in [lo, hi)
+(define-cproc %tree-map-range-iter (tm::<tree-map> lo hi)
+  (let* ([iter::ScmTreeIter* (SCM_NEW ScmTreeIter)])
+    (Scm_TreeIterInitRange iter (SCM_TREE_MAP_CORE tm)
+                           (cast intptr_t lo) SCM_TREE_CORE_INCLUSIVE
+                           (cast intptr_t hi) SCM_TREE_CORE_EXCLUSIVE)
+    (return (Scm_MakeSubr tree_map_iter iter 2 0 '"tree-map-iterator"))))
+
+;; Replaces the content of TM with ALIST in O(n) if its keys are
+;; strictly increasing.  Returns #f and leaves TM intact otherwise.
+(define-cproc %tree-map-bulk-load! (tm::<tree-map> alist) ::<boolean>
+  (let* ([len::int (Scm_Length alist)])
+    (when (< len 0) (Scm_Error "proper list required, but got %S" alist))
+    (let* ([keys::intptr_t* (SCM_NEW_ARRAY intptr_t len)]
+           [vals::intptr_t* (SCM_NEW_ARRAY intptr_t len)]
+           [n::int 0])
+      (for-each (lambda (p)
+                  (unless (SCM_PAIRP p)
+                    (Scm_Error "pair required, but got %S" p))
+                  (set! (aref keys n) (cast intptr_t (SCM_CAR p))
+                        (aref vals n) (cast intptr_t (SCM_CDR p)))
+                  (post++ n))
+                alist)
+      (return (Scm_TreeCoreBuildSorted (SCM_TREE_MAP_CORE tm) keys vals n)))))
+
+(define-cproc tree-map-rank (tm::<tree-map> key :optional (fallback #f))
+  (let* ([e::ScmDictEntry* NULL]
+         [r::int (Scm_TreeCoreRank (SCM_TREE_MAP_CORE tm) (cast intptr_t key)
+                                   (& e))])
+    (if e
+      (return (SCM_MAKE_INT r))
+      (return fallback))))
+
+(define-cproc tree-map-select (tm::<tree-map> index::<int>)
+  (let* ([e::ScmDictEntry* (Scm_TreeCoreSelect (SCM_TREE_MAP_CORE tm) index)])
+    (if e
+      (return (Scm_Cons (SCM_DICT_KEY e) (SCM_DICT_VALUE e)))
+      (return '#f))))
+
+(define-cproc tree-map-count-range (tm::<tree-map> lo hi) ::<int>
+  (return (Scm_TreeCoreCountRange (SCM_TREE_MAP_CORE tm)
+                                  (cast intptr_t lo) SCM_TREE_CORE_INCLUSIVE
+                                  (cast intptr_t hi) SCM_TREE_CORE_EXCLUSIVE)))
+
+(define-cproc tree-map-split! (tm::<tree-map> key)
+  (let* ([r (Scm_MakeTreeMap NULL NULL)])
+    (Scm_TreeCoreSplit (SCM_TREE_MAP_CORE tm) (cast intptr_t key)
+                       (SCM_TREE_MAP_CORE r))
+    (return r)))
+
+(define-cproc tree-map-join! (tm::<tree-map> other::<tree-map>) ::<void>
+  (let* ([a::ScmTreeCore* (SCM_TREE_MAP_CORE tm)]
+         [b::ScmTreeCore* (SCM_TREE_MAP_CORE other)])
+    (unless (and (== (-> a cmp) (-> b cmp)) (== (-> a data) (-> b data)))
+      (Scm_Error "tree-map-join!: tree maps have different comparators: %S and %S"
+                 tm other))
+    (when (== a b)
+      (Scm_Error "tree-map-join!: can't join a tree map to itself: %S" tm))
+    (Scm_TreeCoreJoin a b)))
+
 (define-cproc %tree-map-check-consistency (tm::<tree-map>)
   (Scm_TreeCoreCheckConsistency (SCM_TREE_MAP_CORE tm))
   (return '#t))
@@ -36,8 +36,10 @@
 (inline-stub
  (declcode (.include <gauche/vminsn.h>
                      <gauche/class.h>
+                     <gauche/code.h>
                      <gauche/priv/macroP.h>
-                     <gauche/priv/readerP.h>)))
+                     <gauche/priv/readerP.h>
+                     <gauche/priv/probeP.h>)))
 
 (declare (keep-private-macro autoload add-load-path
                              define-compiler-macro))
@@ -87,11 +89,11 @@
                 (if hooked? " (hooked) " "")))
       (if (not (input-port? port))
         (and error-if-not-found (raise port))
-        (load-from-port (if ignore-coding
-                          port
-                          (open-coding-aware-port port))
-                        :environment environment
-                        :paths remaining-paths)))))
+        (%load-from-port (if ignore-coding
+                           port
+                           (open-coding-aware-port port))
+                         remaining-paths environment
+                         (and (not hooked?) (%code-cache-for path)))))))
 
 
 (select-module gauche.internal)
@@ -100,6 +102,11 @@
 (define-in-module gauche (load-from-port port
                                          :key (paths #f)
                                               (environment #f))
+  (%load-from-port port paths environment #f))
+
+;; CACHE is #f, or (<cache-file> . <source-path>) if we use the bytecode
+;; cache or an image for loading; see below.
+(define (%load-from-port port paths environment cache)
   (unless (input-port? port)
     (error "input port required, but got:" port))
   (unless (or (module? environment) (not environment))
@@ -110,7 +117,9 @@
         [prev-next    (current-load-next)]
         [prev-reader-lexical-mode (reader-lexical-mode)]
         [prev-eval-situation (vm-eval-situation)]
-        [prev-read-context (current-read-context)])
+        [prev-read-context (current-read-context)]
+        [prev-effect-record (%compile-effect-record)]
+        [load-time-token #f])
 
     (define (setup-load-context)
       (when (port-closed? port) (error "port alrady closed:" port))
@@ -125,9 +134,17 @@
              prev-history))
       (vm-eval-situation SCM_VM_LOADING)
       (current-read-context (%new-read-context-for-load))
-      (%record-load-stat (or (current-load-path) "(unnamed source)")))
+      ;; If we're loaded during compiling a form, the form depends on us.
+      (%note-compile-effect! 'load (current-load-path))
+      (%compile-effect-record (and cache (list 0)))
+      (%record-load-stat (or (current-load-path) "(unnamed source)"))
+      (%probe-load (current-load-path) #t)
+      (set! load-time-token
+            (%load-time-enter (or (current-load-path) "(unnamed source)")
+                              'load)))
 
     (define (restore-load-context)
+      (%probe-load (current-load-path) #f)
       (vm-set-current-module prev-module)
       (current-load-port prev-port)
       (current-load-history prev-history)
@@ -135,8 +152,10 @@
       (reader-lexical-mode prev-reader-lexical-mode)
       (vm-eval-situation prev-eval-situation)
       (current-read-context prev-read-context)
+      (%compile-effect-record prev-effect-record)
       (close-port port)
       (%record-load-stat #f)
+      (%load-time-leave load-time-token)
       (%port-unlock! port))
 
     (guard (e [else (let1 e2 (if (condition? e)
@@ -149,13 +168,332 @@
                       (restore-load-context)
                       (raise e2))])
       (setup-load-context)
-      (do ([s (read port) (read port)])
-          [(eof-object? s)]
-        (eval s #f)))
+      (if cache
+        (%load-with-code-cache port (car cache) (cdr cache))
+        (%load-forms port)))
     (restore-load-context)
     #t))
 
+;;;
+;;; Bytecode cache
+;;;
+
+;; If the bytecode cache is enabled, `load' saves the compiled code of
+;; each toplevel form of the loaded file in the cache directory, and uses
+;; it instead of compiling the file next time.  A cache file is valid
+;; while the source file has the same path, mtime and content digest,
+;; and the files it depended on during compilation (the ones it required
+;; or included) have the same mtime.
+;;
+;; Some forms do their job while being compiled---they bind macros,
+;; create or alter modules, or require other files.  Replaying their
+;; compiled code doesn't redo that, so we save the source of such forms
+;; and evaluate it again.  The compiler tells us about those forms by
+;; %note-compile-effect!.
+;;
+;; A cache file is a sequence of records written by Scm_CodeCacheWrite.
+;; The first one is the header:
+;;   (gauche-bytecode-cache <format> <gauche-version>
+;;                          <source-path> <mtime> <digest>)
+;; Then follows either a <compiled-code> to execute, or (eval . <form>)
+;; to evaluate, for each toplevel form.  The last record is
+;;   (end (<path> . <mtime>) ...)
+;; which lists the dependencies, and marks the file complete.
+
+(define-constant *code-cache-format* 1)
+
+(define-cproc %code-cache-write (obj oport::<output-port>) ::<boolean>
+  Scm_CodeCacheWrite)
+(define-cproc %code-cache-read (iport::<input-port>) Scm_CodeCacheRead)
+(define-cproc %code-cache-digest (iport::<input-port>) Scm_CodeCacheDigest)
+
+;; API
+;; Returns the directory of the bytecode cache, or #f if the cache is
+;; disabled.  With an argument, sets it.  The initial value is taken from
+;; the environment variable GAUCHE_BYTECODE_CACHE.
+(define-in-module gauche bytecode-cache-directory
+  (let1 dir #f
+    (^ maybe-arg
+      (when (not dir)
+        ;; NB: libsys isn't initialized when this file is, so we look
+        ;; at the environment lazily.
+        (set! dir (or (sys-getenv "GAUCHE_BYTECODE_CACHE") "")))
+      (rlet1 old (and (not (equal? dir "")) dir)
+        (when (pair? maybe-arg)
+          (let1 new (car maybe-arg)
+            (unless (or (not new) (string? new))
+              (error "string or #f required, but got:" new))
+            (set! dir (or new ""))))))))
+
+;; The record of the compile-time effects, kept per thread.  It is #f if
+;; no bytecode cache is being written, or (<count> <dependency> ...).
+(define %compile-effect-record
+  (let1 index (%vm-make-parameter-slot)
+    (^ maybe-arg
+      (rlet1 old (%vm-parameter-ref index #f)
+        (when (pair? maybe-arg)
+          (%vm-parameter-set! index #f (car maybe-arg)))))))
+
+;; Called by the compiler when it processes a form that has an effect
+;; at compile time.  KIND is one of the following, and determines what
+;; DEP is:
+;;   #f       - DEP is ignored.
+;;   require  - DEP is a feature, the form depends on the file providing it.
+;;   include, load - DEP is the path of the file the form depends on, or #f.
+(define (%note-compile-effect! :optional (kind #f) (dep #f))
+  (and-let* ([rec (%compile-effect-record)])
+    (set-car! rec (+ (car rec) 1))
+    (and-let* ([path (case kind
+                       [(require)
+                        (and (string? dep)
+                             (and-let1 r (find-load-file dep *load-path*
+                                                         *load-suffixes*)
+                               (car r)))]
+                       [(include load) (and (string? dep) dep)]
+                       [else #f])])
+      (set-cdr! rec (cons path (cdr rec))))))
+
+;; Returns (<cache-file> . <source-path>) if PATH should be loaded via
+;; the bytecode cache, #f otherwise.  <cache-file> is #f if the cache
+;; directory isn't set but an image is loaded or being saved.
+(define (%code-cache-for path)
+  (let1 dir (bytecode-cache-directory)
+    (and (or dir *image-sections* (%image-recorder))
+         (file-is-regular? path)
+         (let1 abs (sys-normalize-pathname path :absolute #t
+                                           :canonicalize #t)
+           (cons (and dir (%code-cache-file dir abs)) abs)))))
+
+;; The cache file name is the absolute pathname, with '%' doubled
+;; and the separators replaced by '%'.
+(define (%code-cache-file dir abs)
+  (let1 o (open-output-string)
+    (display dir o)
+    (display "/" o)
+    (dolist [c (string->list abs)]
+      (case c
+        [(#\%) (display "%%" o)]
+        [(#\/ #\\ #\:) (write-char #\% o)]
+        [else (write-char c o)]))
+    (display ".gbc" o)
+    (get-output-string o)))
+
+(define (%code-cache-header src)
+  `(gauche-bytecode-cache ,*code-cache-format* ,(gauche-version)
+                          ,src ,(~ (sys-stat src)'mtime)
+                          ,(call-with-input-file src %code-cache-digest)))
+
+(define (%file-mtime path)
+  (and (file-exists? path) (~ (sys-stat path)'mtime)))
+
+;; Reads the content of a cache file from IN.  Returns
+;; (<header> <end-record> <record> ...), or #f if it's incomplete.
+(define (%code-cache-read-section in)
+  (let1 h (%code-cache-read in)
+    (and (not (eof-object? h))
+         (let loop ([rs '()])
+           (let1 r (%code-cache-read in)
+             (cond [(eof-object? r) #f]
+                   [(and (pair? r) (eq? (car r) 'end))
+                    (list* h r (reverse rs))]
+                   [else (loop (cons r rs))]))))))
+
+;; Returns the records of SECTION to replay if it is valid for SRC,
+;; #f otherwise.
+(define (%code-cache-valid-records section src)
+  (and section
+       (equal? (car section) (%code-cache-header src))
+       (every (^[dep] (eqv? (%file-mtime (car dep)) (cdr dep)))
+              (cdadr section))
+       (cddr section)))
+
+(define (%code-cache-records cache-file src)
+  (and (file-is-regular? cache-file)
+       (guard (e [else #f])
+         (%code-cache-valid-records
+          (call-with-input-file cache-file %code-cache-read-section)
+          src))))
+
+(define (%code-cache-execute r)
+  (if (is-a? r <compiled-code>)
+    (%load-time-exec r)
+    (eval (cdr r) #f)))
+
+(define (%load-forms port)
+  (if (%collect-load-times?)
+    (do ([s (%load-time-read port) (%load-time-read port)])
+        [(eof-object? s)]
+      (%load-time-exec (compile s #f)))
+    (do ([s (read port) (read port)])
+        [(eof-object? s)]
+      (eval s #f))))
+
+;; Read and execution steps of loading, timed if -ptime-load is given.
+(define (%load-time-read port)
+  (if (%collect-load-times?)
+    (%with-load-time-phase 'read (cut read port))
+    (read port)))
+
+(define (%load-time-exec code)
+  (if (%collect-load-times?)
+    (%with-load-time-phase 'exec (make-toplevel-closure code))
+    ((make-toplevel-closure code))))
+
+(define (%load-with-code-cache port cache-file src)
+  (let1 recording? (%image-recorder)
+    (cond [(and (not recording?)
+                (or (%image-records src)
+                    (and cache-file (%code-cache-records cache-file src))))
+           => (cut for-each %code-cache-execute <>)]
+          [(or cache-file recording?)
+           (%load-and-write-code-cache port cache-file src)]
+          [else (%load-forms port)])))
+
+;; Load from PORT as usual, while collecting the records of the cache.
+;; Only when the whole file is loaded successfully, we write them into
+;; CACHE-FILE (via a temporary file, then renaming it) if it isn't #f,
+;; and hand them to the image being saved, if any.  Failure of writing
+;; the cache doesn't affect the loading.
+(define (%load-and-write-code-cache port cache-file src)
+  (define out (open-output-string))
+  (define ok?
+    (guard (e [else #f])
+      (%code-cache-write (%code-cache-header src) out)))
+  (define (save! r)
+    (when (and ok? (not (guard (e [else #f]) (%code-cache-write r out))))
+      (set! ok? #f)))
+  (let1 rec (%compile-effect-record)
+    (do ([s (%load-time-read port) (%load-time-read port)])
+        [(eof-object? s)]
+      (let* ([n (car rec)]
+             [code (compile s #f)])
+        (when (and ok?
+                   (not (and (= n (car rec))
+                             (guard (e [else #f])
+                               (%code-cache-write code out)))))
+          (save! `(eval . ,s)))
+        (%load-time-exec code)))
+    (save! `(end ,@(filter-map (^[path]
+                                 (and-let1 t (%file-mtime path)
+                                   (cons path t)))
+                               (delete-duplicates (cdr rec))))))
+  (when ok?
+    (let1 bytes (get-output-byte-string out)
+      (when cache-file (%write-code-cache-file cache-file bytes))
+      (and-let1 r (%image-recorder)
+        (set-cdr! r (acons src bytes (cdr r)))))))
+
+(define (%write-code-cache-file cache-file bytes)
+  (define tmp (string-append cache-file "."
+                             (number->string (sys-getpid)) ".tmp"))
+  (guard (e [else (guard (e [else #f]) (sys-unlink tmp))])
+    (let1 dir (sys-dirname cache-file)
+      (unless (file-is-directory? dir) (sys-mkdir dir #o755)))
+    (call-with-output-file tmp (cut display bytes <>))
+    (sys-rename tmp cache-file)))
+
+;;;
+;;; Images
+;;;
+
+;; An image bundles the cache records of the files that make up a set of
+;; features into one file, so that a program needing them can start
+;; without reading and compiling their source.  (save-image <file>
+;; <feature> ...) requires the features, recording every file loaded
+;; meanwhile.  (load-image <file>) reads the records in memory, then
+;; requires the features; loading of each file replays the records
+;; instead, as long as they are valid in the same sense as the cache files.
+;; Since features go through `require' as usual, it doesn't matter if
+;; some of them are already loaded, or the source has been changed.
+;;
+;; An image file begins with a record written by Scm_CodeCacheWrite:
+;;   (gauche-image <format> <gauche-version> <feature> ...)
+;; Then, for each recorded file, a record
+;;   (file <source-path> <size>)
+;; is followed by <size> bytes of the content of its cache file.  We
+;; decode the content only when the file is loaded, for the code may
+;; refer to the bindings made by the files loaded before it.
+
+;; A hash table from the source path to the content of its cache file,
+;; or #f if no image has been loaded.
+(define *image-sections* #f)
+
+;; Per thread.  #f, or (image (<source-path> . <cache-content>) ...)
+;; while saving an image.
+(define %image-recorder
+  (let1 index (%vm-make-parameter-slot)
+    (^ maybe-arg
+      (rlet1 old (%vm-parameter-ref index #f)
+        (when (pair? maybe-arg)
+          (%vm-parameter-set! index #f (car maybe-arg)))))))
+
+(define (%image-records src)
+  (and-let* ([ *image-sections* ]
+             [bytes (hash-table-get *image-sections* src #f)])
+    (guard (e [else #f])
+      (%code-cache-valid-records
+       (%code-cache-read-section (open-input-string bytes)) src))))
+
+;; API
+(define-in-module gauche (save-image file . features)
+  (dolist [f features]
+    (unless (string? f) (error "feature must be a string, but got:" f)))
+  (let ([rec (list 'image)]            ; (image (<src> . <bytes>) ...)
+        [prev (%image-recorder)])
+    (unwind-protect
+        (begin (%image-recorder rec)
+               (for-each %require features))
+      (%image-recorder prev))
+    (call-with-output-file file
+      (^[out]
+        (%code-cache-write `(gauche-image ,*code-cache-format*
+                                          ,(gauche-version) ,@features)
+                           out)
+        (dolist [s (reverse (cdr rec))]
+          (%code-cache-write `(file ,(car s) ,(string-size (cdr s))) out)
+          (display (cdr s) out))))))
+
+;; API
+(define-in-module gauche (load-image file)
+  (let1 features
+      (call-with-input-file file
+        (^[in]
+          (let1 h (guard (e [else #f]) (%code-cache-read in))
+            (unless (and (pair? h) (eq? (car h) 'gauche-image)
+                         (list? h) (>= (length h) 3))
+              (error "not an image file:" file))
+            (unless (and (eqv? (cadr h) *code-cache-format*)
+                         (equal? (caddr h) (gauche-version)))
+              (errorf "image file ~a is made by an incompatible Gauche ~a"
+                      file (caddr h)))
+            (unless *image-sections*
+              (set! *image-sections* (make-hash-table 'equal?)))
+            (let loop ()
+              (let1 r (%code-cache-read in)
+                (unless (eof-object? r)
+                  (unless (and (list? r) (= (length r) 3) (eq? (car r) 'file)
+                               (string? (cadr r)) (fixnum? (caddr r)))
+                    (error "corrupted image file:" file))
+                  (let1 bytes (read-block (caddr r) in)
+                    (unless (and (string? bytes)
+                                 (= (string-size bytes) (caddr r)))
+                      (error "corrupted image file:" file))
+                    (hash-table-put! *image-sections* (cadr r) bytes))
+                  (loop))))
+            (cdddr h))))
+    (for-each %require features)))
+
 ;; A few helper procedures
+;; Fires load__start / load__end USDT probes; see gauche/priv/probeP.h.
+(define-cproc %probe-load (path start::<boolean>) ::<void>
+  (when (SCM_STRINGP path)
+    (cond [start
+           (when (SCM_PROBE_ENABLED load__start)
+             (SCM_PROBE1 load__start (Scm_GetStringConst (SCM_STRING path))))]
+          [else
+           (when (SCM_PROBE_ENABLED load__end)
+             (SCM_PROBE1 load__end (Scm_GetStringConst (SCM_STRING path))))])))
+
 (define-cproc %record-load-stat (path) ::<void>
   (.if "defined(HAVE_GETTIMEOFDAY)"
        (let* ([vm::ScmVM* (Scm_VM)])
@@ -169,6 +507,97 @@
                       (?: (SCM_FALSEP path) t (Scm_Cons path t))
                       (ref (-> vm stat) loadStat)))))))))
 
+;; Load time breakdown, enabled by -ptime-load.
+;; We keep a tree of loaded files per thread.  Each node is
+;;   #(<name> <kind> <times> <children>)
+;; where <kind> is either load or dso, <times> is a vector of the
+;; microseconds spent in each phase in *load-time-phases* directly by
+;; this node, and <children> is a list of the nodes loaded from this
+;; one, in reverse order.  The time is charged to the current phase of
+;; the current node whenever we switch phases or nodes, so that each
+;; moment is counted exactly once.
+(define-cproc %collect-load-times? () ::<boolean>
+  (return (SCM_VM_RUNTIME_FLAG_IS_SET (Scm_VM) SCM_COLLECT_LOAD_TIMES)))
+
+(define *load-time-phases*
+  '#(other read expand pass1 pass2 pass3 pass4 pass5 exec dso))
+
+(define (%load-time-phase-index phase)
+  (case phase
+    [(other) 0] [(read) 1] [(expand) 2] [(pass1) 3] [(pass2) 4]
+    [(pass3) 5] [(pass4) 6] [(pass5) 7] [(exec) 8] [(dso) 9]
+    [else (error "unknown load time phase:" phase)]))
+
+(define (%make-load-time-node name kind)
+  (vector name kind (make-vector (vector-length *load-time-phases*) 0) '()))
+
+;; Per thread.  #f, or #(<current-node> <phase-index> <timestamp>
+;; <root-node> <thread>).  A new thread inherits the parent's value,
+;; so we check the owner and start a separate tree if it isn't us.
+(define %load-time-state
+  (let1 index (%vm-make-parameter-slot)
+    (^ maybe-arg
+      (rlet1 old (%vm-parameter-ref index #f)
+        (when (pair? maybe-arg)
+          (%vm-parameter-set! index #f (car maybe-arg)))))))
+
+(define (%load-time-current)
+  (let1 s (%load-time-state)
+    (if (and s (eq? (vector-ref s 4) (current-thread)))
+      s
+      (and (%collect-load-times?)
+           (let1 root (%make-load-time-node "(toplevel)" 'load)
+             (rlet1 s (vector root 0 (%macro-stat-clock) root (current-thread))
+               (%load-time-state s)))))))
+
+;; Charges the time since the last switch to the current phase of the
+;; current node, then makes PHASE-INDEX current.  Returns the previous
+;; phase index.
+(define (%load-time-switch! s phase-index)
+  (let* ([now (%macro-stat-clock)]
+         [times (vector-ref (vector-ref s 0) 2)]
+         [prev (vector-ref s 1)])
+    (vector-set! times prev (+ (vector-ref times prev)
+                               (- now (vector-ref s 2))))
+    (vector-set! s 1 phase-index)
+    (vector-set! s 2 now)
+    prev))
+
+;; Calls THUNK, charging the time spent in it to PHASE of the current
+;; node, except the time spent in nested phases and nodes.
+(define (%with-load-time-phase phase thunk)
+  (if-let1 s (%load-time-current)
+    (let1 prev (%load-time-switch! s (%load-time-phase-index phase))
+      (unwind-protect (thunk)
+        (%load-time-switch! s prev)))
+    (thunk)))
+
+;; Starts a new node as a child of the current one.  Returns a token
+;; to be passed to %load-time-leave, or #f if we're not collecting.
+(define (%load-time-enter name kind)
+  (and-let* ([s (%load-time-current)])
+    (let* ([prev (%load-time-switch! s 0)]
+           [parent (vector-ref s 0)]
+           [node (%make-load-time-node name kind)])
+      (vector-set! parent 3 (cons node (vector-ref parent 3)))
+      (vector-set! s 0 node)
+      (cons parent prev))))
+
+(define (%load-time-leave token)
+  (and-let* ([ token ]
+             [s (%load-time-state)])
+    (%load-time-switch! s 0)
+    (vector-set! s 0 (car token))
+    (vector-set! s 1 (cdr token))))
+
+;; Returns the root node of the calling thread, after charging the
+;; time so far.  Called by the report procedures in gauche.vm.profiler.
+(define (%load-time-root)
+  (and-let* ([s (%load-time-state)]
+             [ (eq? (vector-ref s 4) (current-thread)) ])
+    (%load-time-switch! s (vector-ref s 1))
+    (vector-ref s 3)))
+
 (define-cproc %new-read-context-for-load ()
   (let* ([ctx::ScmReadContext* (Scm_MakeReadContext NULL)])
     (set! (-> ctx flags)
@@ -181,13 +610,21 @@
   (return (SCM_VM_RUNTIME_FLAG_IS_SET (Scm_VM) SCM_LOAD_VERBOSE)))
 
 
-(select-module gauche)
+(select-module gauche.internal)
+(define-cproc %dynamic-load (file::<string> init-function)
+  (return (Scm_DynLoad file init_function 0)))
 
 ;; API
-(define-cproc dynamic-load (file::<string>
-                            :key (init-function #f)
-                            (export-symbols #f)); for backward compatibility
-  (return (Scm_DynLoad file init_function 0)))
+(define-in-module gauche (dynamic-load file
+                                       :key (init-function #f)
+                                       (export-symbols #f)) ; for backward compatibility
+  (if-let1 token (%load-time-enter file 'dso)
+    (unwind-protect
+        (%with-load-time-phase 'dso (cut %dynamic-load file init-function))
+      (%load-time-leave token))
+    (%dynamic-load file init-function)))
+
+(select-module gauche)
 
 ;; API
 (define-cproc provide (feature)   Scm_Provide)
@@ -399,8 +836,55 @@
 
 (define-cproc macro-transformer (mac::<macro>) Scm_MacroTransformer)
 
+;; Macro expansion statistics, enabled by -pmacro.  The time includes
+;; expansions the transformer triggers by itself.
+(define-cproc %collect-macro-stats? () ::<boolean>
+  (return (SCM_VM_RUNTIME_FLAG_IS_SET (Scm_VM) SCM_COLLECT_MACRO_STATS)))
+
+(define-cproc %macro-stat-clock () ;; microseconds
+  (.if "defined(HAVE_GETTIMEOFDAY)"
+       (let* ([t0::(struct timeval)])
+         (gettimeofday (& t0) NULL)
+         (return (Scm_MakeIntegerU (+ (* (ref t0 tv_sec) 1000000)
+                                      (ref t0 tv_usec)))))
+       (return (SCM_MAKE_INT 0))))
+
+(define-cproc %record-macro-stat (mac::<macro> usec::<ulong>) ::<void>
+  (let* ([vm::ScmVM* (Scm_VM)])
+    (when (SCM_FALSEP (ref (-> vm stat) macroStat))
+      (set! (ref (-> vm stat) macroStat)
+            (Scm_MakeHashTableSimple SCM_HASH_EQ 0)))
+    (let* ([tab::ScmHashTable* (SCM_HASH_TABLE (ref (-> vm stat) macroStat))]
+           [p (Scm_HashTableRef tab (SCM_OBJ mac) SCM_FALSE)])
+      (if (SCM_FALSEP p)
+        (Scm_HashTableSet tab (SCM_OBJ mac)
+                          (Scm_Cons (SCM_MAKE_INT 1) (Scm_MakeIntegerU usec))
+                          0)
+        (begin
+          (SCM_SET_CAR p (Scm_Add (SCM_CAR p) (SCM_MAKE_INT 1)))
+          (SCM_SET_CDR p (Scm_Add (SCM_CDR p) (Scm_MakeIntegerU usec))))))))
+
+(define-cproc %macro-stat-table () (return (ref (-> (Scm_VM) stat) macroStat)))
+
+;; Returns ((<macro> <count> . <microseconds>) ...)
+(define (%macro-stats)
+  (if-let1 tab (%macro-stat-table)
+    (hash-table->alist tab)
+    '()))
+
+(define (%expand-macro mac expr cenv)
+  (if (%collect-macro-stats?)
+    (let* ([t0 (%macro-stat-clock)]
+           [r ((macro-transformer mac) expr cenv)])
+      (%record-macro-stat mac (- (%macro-stat-clock) t0))
+      r)
+    ((macro-transformer mac) expr cenv)))
+
 (define (call-macro-expander mac expr cenv)
-  (let1 r ((macro-transformer mac) expr cenv)
+  (let1 r (if (%collect-load-times?)
+            (%with-load-time-phase 'expand
+                                   (^[] (%expand-macro mac expr cenv)))
+            (%expand-macro mac expr cenv))
     (if (and (pair? r) (not (eq? expr r)))
       (rlet1 p (if (extended-pair? r)
                  r
@@ -477,12 +961,101 @@
     (list ':bytes-since-gc
           (Scm_MakeIntegerFromUI (cast u_long (GC_get_bytes_since_gc))))
     (list ':total-bytes
-          (Scm_MakeIntegerFromUI (cast u_long (GC_get_total_bytes)))))))
+          (Scm_MakeIntegerFromUI (cast u_long (GC_get_total_bytes))))
+    (list ':gc-count
+          (Scm_MakeIntegerFromUI (cast u_long (GC_get_gc_no)))))))
+
+;; API
+;; Tunes GC parameters that can be changed at runtime, and returns the
+;; current settings in the same format as gc-stat.  The parameters that
+;; can only be set before GC is initialized (e.g. the number of marker
+;; threads) are taken from environment variables by GC itself.
+(inline-stub
+ ;; GC_incremental is declared in private/gc_priv.h.  See the comment
+ ;; on GC_print_static_roots in core.c.
+ "extern int GC_incremental;"
+ "static u_long gc_max_heap_size = 0; /* 0 for unlimited */"
+
+ (define-cproc gc-configure (:key incremental free-space-divisor
+                                  pause-target full-frequency
+                                  max-heap-size expand-heap)
+   (unless (SCM_UNBOUNDP incremental)
+     (cond [(not (SCM_FALSEP incremental))
+            (unless GC_incremental (GC_enable_incremental))]
+           [GC_incremental
+            (Scm_Error "incremental GC can't be turned off once enabled")]))
+   (unless (SCM_UNBOUNDP free-space-divisor)
+     (unless (and (SCM_INTP free-space-divisor)
+                  (> (SCM_INT_VALUE free-space-divisor) 0))
+       (SCM_TYPE_ERROR free-space-divisor "positive fixnum"))
+     (GC_set_free_space_divisor (SCM_INT_VALUE free-space-divisor)))
+   (unless (SCM_UNBOUNDP pause-target)
+     (cond [(SCM_FALSEP pause-target) (GC_set_time_limit GC_TIME_UNLIMITED)]
+           [(and (SCM_INTP pause-target) (> (SCM_INT_VALUE pause-target) 0))
+            (GC_set_time_limit (SCM_INT_VALUE pause-target))]
+           [else
+            (SCM_TYPE_ERROR pause-target "positive fixnum or #f")]))
+   (unless (SCM_UNBOUNDP full-frequency)
+     (unless (and (SCM_INTP full-frequency)
+                  (>= (SCM_INT_VALUE full-frequency) 0))
+       (SCM_TYPE_ERROR full-frequency "non-negative fixnum"))
+     (GC_set_full_freq (SCM_INT_VALUE full-frequency)))
+   (unless (SCM_UNBOUNDP max-heap-size)
+     (cond [(SCM_FALSEP max-heap-size) (set! gc_max_heap_size 0)]
+           [(and (SCM_INTEGERP max-heap-size)
+                 (> (Scm_Sign max-heap-size) 0))
+            (set! gc_max_heap_size (Scm_GetIntegerU max-heap-size))]
+           [else
+            (SCM_TYPE_ERROR max-heap-size "positive integer or #f")])
+     (GC_set_max_heap_size gc_max_heap_size))
+   (unless (SCM_UNBOUNDP expand-heap)
+     (unless (and (SCM_INTEGERP expand-heap) (>= (Scm_Sign expand-heap) 0))
+       (SCM_TYPE_ERROR expand-heap "non-negative integer"))
+     (unless (GC_expand_hp (Scm_GetIntegerU expand-heap))
+       (Scm_Error "couldn't expand the heap by %S bytes" expand-heap)))
+   (let* ([markers::int 1]
+          [limit::u_long (GC_get_time_limit)])
+     (.if "defined(GC_THREADS)"
+          (set! markers (+ (GC_get_parallel) 1)))
+     (return
+      (list
+       (list ':markers (SCM_MAKE_INT markers))
+       (list ':incremental (SCM_MAKE_BOOL GC_incremental))
+       (list ':free-space-divisor
+             (Scm_MakeIntegerFromUI (GC_get_free_space_divisor)))
+       (list ':pause-target
+             (?: (== limit GC_TIME_UNLIMITED)
+                 SCM_FALSE
+                 (Scm_MakeIntegerFromUI limit)))
+       (list ':full-frequency (SCM_MAKE_INT (GC_get_full_freq)))
+       (list ':max-heap-size
+             (?: (== gc_max_heap_size 0)
+                 SCM_FALSE
+                 (Scm_MakeIntegerFromUI gc_max_heap_size)))))))
+ )
+
+;; API
+;; Makes the heap ready to be shared by the children of a pre-forking
+;; server.  See Scm_HeapFreeze in core.c.
+(define-cproc gc-prepare-fork () ::<long> Scm_HeapFreeze)
+
+(define-cproc gc-events (:optional (max::<fixnum> -1)) Scm_GCEvents)
+
+(define-cproc gc-event-handler ()
+  (setter (handler) ::<void> (Scm_SetGCEventHandler handler))
+  (return (Scm_GCEventHandler)))
 
 (select-module gauche.internal)
 ;; for diagnostics
 (define-cproc gc-print-static-roots () ::<void> Scm_PrintStaticRoots)
 
+;; Autoloaded heap-census and heap-retention-paths use these.
+;; See lib/gauche/vm/profiler.scm
+(define-cproc %heap-census (max-largest::<fixnum>) Scm_HeapCensus)
+(define-cproc %heap-retention-paths (target roots threads
+                                     max-paths::<fixnum> max-nodes::<long>)
+  Scm_HeapRetentionPaths)
+
 ;;;
 ;;; Some system introspection
 ;;;
@@ -567,6 +1140,20 @@
 
 (select-module gauche.internal)
 (define-cproc %vm-get-insn-offsets () Scm__VMInsnOffsets)
+(define-cproc %vm-insn-stat () Scm_VMInsnStat)
+
+;; Instruction frequency counting
+(select-module gauche)
+(define-cproc vm-insn-stat-start () ::<void> Scm_VMInsnStatStart)
+(define-cproc vm-insn-stat-stop () ::<void> Scm_VMInsnStatStop)
+(define-cproc vm-insn-stat-reset () ::<void> Scm_VMInsnStatReset)
+(define (vm-insn-stat)
+  (define (by-count alist) (sort alist (^[a b] (> (cdr a) (cdr b)))))
+  (let1 r ((with-module gauche.internal %vm-insn-stat))
+    `(:instructions ,(by-count (get-keyword :instructions r))
+      :pairs ,(by-count (get-keyword :pairs r))
+      :lref ,(get-keyword :lref r)
+      :lset ,(get-keyword :lset r))))
 
 ;; This is also called from C's Scm_ShowStackTrace
 ;; TRACE is what vm-get-stack-trace-lite returns.
@@ -55,6 +55,14 @@
     (result (Scm_VMWithGuardHandler handler thunk))
     (result (Scm_VMWithErrorHandler handler thunk))))
 
+
+;; Used by guard.  Same as (with-error-handler handler thunk
+;; :rewind-before #t), without the overhead of keyword arguments.
+(select-module gauche.internal)
+(define-cproc %with-guard-handler (handler thunk)
+  (result (Scm_VMWithGuardHandler handler thunk)))
+
+(select-module gauche)
 (define-cproc report-error (exception :optional port)
   ;; TRANSIENT: change this to Scm_ReportError when switching API to 0.95.
   Scm_ReportError2)
@@ -93,7 +101,7 @@
 (define-cproc %raise (exception :optional (non-continuable? #f))
   (let* ([flags::u_long
           (?: (SCM_FALSEP non-continuable?) 0 SCM_RAISE_NON_CONTINUABLE)])
-    (result (Scm_Raise2 exception flags))))
+    (result (Scm_Raise2 exception (logior flags SCM_RAISE_FROM_VM)))))
 
 ;; srfi-18 raise
 (define-in-module gauche (raise c) (%raise c))
@@ -328,6 +328,7 @@
 ;; ~S and ~A
 (define (make-format-expr fmtstr params flags printer)
   (if (null? params)
+    ;; Fast path: print the argument directly to the port.
     (^[argptr port ctrl]
       (let1 arg (fr-next-arg! fmtstr argptr)
         (if ctrl
@@ -367,12 +368,18 @@
 
 ;; ~D, ~B, ~O, ~X, ~nR
 (define (make-format-num fmtstr params flags radix upcase)
-  (if (and (null? params) (no-flag? flags))
+  (cond
+   [(and (null? params) (no-flag? flags) (= radix 10))
+    ;; Fast path for the plain ~d; the printer writes decimal numbers
+    ;; directly to the port.
+    (^[argptr port ctrl] (display (fr-next-arg! fmtstr argptr) port))]
+   [(and (null? params) (no-flag? flags))
     (^[argptr port ctrl]
       (let1 arg (fr-next-arg! fmtstr argptr)
         (if (exact? arg)
           (display (number->string arg radix upcase) port)
-          (display arg port))))
+          (display arg port))))]
+   [else
     ($ with-format-params ([mincol 0]
                            [padchar #\space]
                            [comma #\,]
@@ -392,7 +399,7 @@
          (let1 len (string-length sarg)
            (when (< len mincol)
              (dotimes [_ (- mincol len)] (write-char padchar port)))
-           (display sarg port))))))
+           (display sarg port))))]))
            
 (define (insert-comma-in-digits str comma interval point)
   (define (insert s)
@@ -473,14 +480,35 @@
         [locking? (with-port-locking port formatter args port ctrl)]
         [else (formatter args port ctrl)]))
 
+;; Formatter cache
+;; Compiled formatters are cached by the identity of the format string.
+;; Only immutable strings (e.g. literals) are cached, for a mutable
+;; string may be altered after it's compiled.  The cache is a direct-mapped
+;; table of (string . formatter); replacing an entry is a single
+;; vector-set!, so it's safe to share among threads without locking.
+(define-constant *formatter-cache-size* 256)
+(define *formatter-cache* (make-vector *formatter-cache-size* #f))
+
+(define (formatter-lookup fmtstr)
+  (if (string-immutable? fmtstr)
+    ;; The low bits of eq-hash don't spread well for aligned objects.
+    (let* ([i (logand (ash (eq-hash fmtstr) -12)
+                      (- *formatter-cache-size* 1))]
+           [e (vector-ref *formatter-cache* i)])
+      (if (and e (eq? (car e) fmtstr))
+        (cdr e)
+        (rlet1 f (formatter-compile fmtstr)
+          (vector-set! *formatter-cache* i (cons fmtstr f)))))
+    (formatter-compile fmtstr)))
+
 (define (format-2 shared? out control fmtstr args)
-  (let1 formatter (formatter-compile fmtstr)
+  (let1 formatter (formatter-lookup fmtstr)
     (case out
       [(#t)
        (call-formatter shared? #t formatter (current-output-port) control args)]
       [(#f) (let1 out (open-output-string)
               (call-formatter shared? #f formatter out control args)
-              (get-output-string out))]
+              ((with-module gauche.internal %take-output-string) out))]
       [else (call-formatter shared? #t formatter out control args)])))
 
 ;; handle optional destination arg
@@ -508,3 +536,30 @@
 ;; API
 (define-in-module gauche (format . args) (format-1 #f args))
 (define-in-module gauche (format/ss . args) (format-1 #t args))
+
+;; Compiler macro
+;; (format "literal" arg ...) and (format dest "literal" arg ...) are
+;; turned into a call of %format/cached.  The literal is compiled when the
+;; call site is compiled, so the first call finds it in the cache as well.
+;; If the literal has an error, we leave the form as is, so that
+;; the error is reported at runtime as usual.
+;; This is attached to format in libomega.scm, since it needs the compiler.
+(define (%format/cached dest fmtstr . args)
+  (cond [(or (port? dest) (boolean? dest))
+         (format-2 #f dest #f fmtstr args)]
+        [(is-a? dest <write-controls>) (format-2 #f #f dest fmtstr args)]
+        ;; DEST is in fact a format string, and FMTSTR is an argument.
+        [else (format-1 #f (list* dest fmtstr args))]))
+
+(define (format-transformer form rename compare)
+  (define (literal? s)
+    (and (string? s)
+         (string-immutable? s)
+         (guard (e [else #f]) (formatter-lookup s) #t)))
+  (match form
+    [(_ (? literal? s) . args) `(,(rename '%format/cached) #f ,s ,@args)]
+    [(_ dest (? literal? s) . args)
+     (if (string? dest)
+       form
+       `(,(rename '%format/cached) ,dest ,s ,@args))]
+    [_ form]))
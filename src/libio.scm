@@ -111,6 +111,18 @@
     (return (?: (< i 0) SCM_FALSE (Scm_MakeInteger i)))))
 (define-cproc port-fd-dup! (dst::<port> src::<port>) ::<void> Scm_PortFdDup)
 
+(define-cproc port-confine! (port::<port>) ::<void> Scm_PortConfine)
+(define-cproc port-confined? (port::<port>) ::<boolean> Scm_PortConfinedP)
+
+(define-cproc port-nonblocking! (port::<port> flag::<boolean>) ::<void>
+  Scm_SetPortNonblocking)
+(define-cproc port-nonblocking? (port::<port>) ::<boolean>
+  Scm_PortNonblockingP)
+(define-cproc port-would-block? (port::<port>) ::<boolean>
+  Scm_PortWouldBlockP)
+(define-cproc port-output-pending (port::<port>) ::<fixnum>
+  Scm_PortOutputPending)
+
 (define-cproc port-attribute-set! (port::<port> key val)
   Scm_PortAttrSet)
 (define-cproc port-attribute-ref (port::<port> key :optional fallback)
@@ -140,6 +152,18 @@
            port (Scm_BufferingMode mode (-> port direction) -1)))
   (return (Scm_GetPortBufferingModeAsKeyword port)))
 
+(define-cproc port-statistics (port::<port>) Scm_PortStatistics)
+(define-cproc port-statistics-start () ::<void> Scm_PortStatStart)
+(define-cproc port-statistics-stop  () ::<void> Scm_PortStatStop)
+(define-cproc port-statistics-reset () ::<void> Scm_PortStatReset)
+(define-cproc port-statistics-running? () ::<boolean> Scm_PortStatRunningP)
+
+(select-module gauche.internal)
+;; Autoloaded port-statistics-result will use this.
+;; See lib/gauche/vm/profiler.scm
+(define-cproc port-statistics-raw-result () Scm_PortStatResult)
+(select-module gauche)
+
 (define-cproc port-case-fold-set! (port::<port> flag::<boolean>) ::<void>
   (if flag
     (logior= (SCM_PORT_FLAGS port) SCM_PORT_CASE_FOLD)
@@ -185,6 +209,7 @@
 (define-cproc %open-input-file (path::<string>
                                 :key (if-does-not-exist :error)
                                 (buffering #f)
+                                (buffer-size::<fixnum> 0)
                                 (element-type :character))
   (let* ([ignerr::int FALSE])
     (cond [(SCM_FALSEP if-does-not-exist) (set! ignerr TRUE)]
@@ -193,8 +218,8 @@
                           if-does-not-exist)])
     (let* ([bufmode::int (Scm_BufferingMode buffering SCM_PORT_INPUT
                                             SCM_PORT_BUFFER_FULL)]
-           [o (Scm_OpenFilePort (Scm_GetStringConst path)
-                                O_RDONLY bufmode 0)])
+           [o (Scm_OpenFilePortFull (Scm_GetStringConst path)
+                                    O_RDONLY bufmode 0 buffer-size)])
       (when (and (SCM_FALSEP o) (not (%open/allow-noexist? ignerr)))
         (Scm_SysError "couldn't open input file: %S" path))
       (return o))))
@@ -205,6 +230,7 @@
                                  (if-does-not-exist :create)
                                  (mode::<fixnum> #o666)
                                  (buffering #f)
+                                 (buffer-size::<fixnum> 0)
                                  (element-type :character))
   (let* ([ignerr-noexist::int FALSE]
          [ignerr-exist::int FALSE]
@@ -230,8 +256,8 @@
                           if-does-not-exist)])
     (let* ([bufmode::int
             (Scm_BufferingMode buffering SCM_PORT_OUTPUT SCM_PORT_BUFFER_FULL)]
-           [o (Scm_OpenFilePort (Scm_GetStringConst path)
-                                flags bufmode mode)])
+           [o (Scm_OpenFilePortFull (Scm_GetStringConst path)
+                                    flags bufmode mode buffer-size)])
       (when (and (SCM_FALSEP o)
                  (not (%open/allow-noexist? ignerr-noexist))
                  (not (%open/allow-exist? ignerr-exist)))
@@ -345,6 +371,30 @@
 (define-cproc get-remaining-input-string (iport::<input-port>)
   (return (Scm_GetRemainingInputString iport 0)))
 
+(select-module gauche.internal)
+;; Like get-output-string, but the buffer can become the result without
+;; copying.  Used by the procedures that create a string port and are
+;; usually done with it once they have the string.  The port keeps its
+;; content, in case it has escaped.
+(define-cproc %take-output-string (oport::<output-port>)
+  (return (Scm_TakeOutputString oport 0)))
+(select-module gauche)
+
+;; Mapped input file port
+(define-cproc open-mapped-input-file (path::<const-cstring>
+                                      :key (private?::<boolean> #f))
+  Scm_OpenMappedInputFile)
+
+(define-cproc port-mapped-view (iport::<input-port>
+                                :optional (start::<fixnum> 0)
+                                          (end::<fixnum> -1))
+  (return (Scm_PortMappedView iport start end FALSE)))
+
+(define-cproc port-mapped-string (iport::<input-port>
+                                  :optional (start::<fixnum> 0)
+                                            (end::<fixnum> -1))
+  (return (Scm_PortMappedView iport start end TRUE)))
+
 ;; Coding aware port
 (select-module gauche)
 
@@ -470,12 +520,16 @@
   (inliner READ-CHAR)
   (let* ([ch::int])
     (SCM_GETC ch port)
-    (return (?: (== ch EOF) SCM_EOF (SCM_MAKE_CHAR ch)))))
+    (return (?: (== ch EOF)
+                (?: (SCM_PORT_WOULDBLOCK_P port) SCM_FALSE SCM_EOF)
+                (SCM_MAKE_CHAR ch)))))
 
 (define-cproc peek-char (:optional (port::<input-port> (current-input-port)))
   (inliner PEEK-CHAR)
   (let* ([ch::ScmChar (Scm_Peekc port)])
-    (return (?: (== ch SCM_CHAR_INVALID) SCM_EOF (SCM_MAKE_CHAR ch)))))
+    (return (?: (== ch SCM_CHAR_INVALID)
+                (?: (SCM_PORT_WOULDBLOCK_P port) SCM_FALSE SCM_EOF)
+                (SCM_MAKE_CHAR ch)))))
 
 (define-cproc eof-object? (obj) ::<boolean> :fast-flonum
   (inliner EOFP) SCM_EOFP)
@@ -494,11 +548,15 @@
 (define-cproc read-byte (:optional (port::<input-port> (current-input-port)))
   (let* ([b::int])
     (SCM_GETB b port)
-    (return (?: (< b 0) SCM_EOF (SCM_MAKE_INT b)))))
+    (return (?: (< b 0)
+                (?: (SCM_PORT_WOULDBLOCK_P port) SCM_FALSE SCM_EOF)
+                (SCM_MAKE_INT b)))))
 
 (define-cproc peek-byte (:optional (port::<input-port> (current-input-port)))
   (let* ([b::int (Scm_Peekb port)])
-    (return (?: (< b 0) SCM_EOF (SCM_MAKE_INT b)))))
+    (return (?: (< b 0)
+                (?: (SCM_PORT_WOULDBLOCK_P port) SCM_FALSE SCM_EOF)
+                (SCM_MAKE_INT b)))))
 
 (define-cproc read-line (:optional (port::<input-port> (current-input-port))
                                    (allowbytestr #f))
@@ -507,19 +565,24 @@
                (SCM_STRINGP r)
                (SCM_STRING_INCOMPLETE_P r))
       (Scm_ReadError port "read-line: encountered illegal byte sequence: %S" r))
+    (when (and (SCM_EOFP r) (SCM_PORT_WOULDBLOCK_P port))
+      (return SCM_FALSE))
     (return r)))
 
-(define (read-string n :optional (port (current-input-port)))
-  (define o (open-output-string :private? #t))
-  (let loop ([i 0])
-    (if (>= i n)
-      (get-output-string o)
-      (let1 c (read-char port)
-        (if (eof-object? c)
-          (if (= i 0)
-            (eof-object)
-            (get-output-string o))
-          (begin (write-char c o) (loop (+ i 1))))))))
+(define-cproc read-until-delimiter (delims::<char-set>
+                                   :optional (port::<input-port>
+                                              (current-input-port)))
+  (let* ([r (Scm_ReadUntilDelimiter port delims)])
+    (when (and (SCM_EOFP r) (SCM_PORT_WOULDBLOCK_P port))
+      (return SCM_FALSE))
+    (return r)))
+
+(define-cproc read-string (n::<fixnum>
+                           :optional (port::<input-port> (current-input-port)))
+  (let* ([r (Scm_ReadString port n)])
+    (when (and (SCM_EOFP r) (SCM_PORT_WOULDBLOCK_P port))
+      (return SCM_FALSE))
+    (return r)))
 
 ;; Consume trailing whiespaces up to (including) first EOL.
 ;; This is mainly intended for interactive REPL,
@@ -553,7 +616,8 @@
     (return (Scm_MakeString "" 0 0 0))
     (let* ([buf::char* (SCM_NEW_ATOMIC2 (C: char*) (+ bytes 1))]
            [nread::int (Scm_Getz buf bytes port)])
-      (cond [(<= nread 0) (return SCM_EOF)]
+      (cond [(<= nread 0)
+             (return (?: (SCM_PORT_WOULDBLOCK_P port) SCM_FALSE SCM_EOF))]
             [else
              (SCM_ASSERT (<= nread bytes))
              (set! (aref buf nread) #\x00)
@@ -721,6 +785,21 @@
   (SCM_PUTB byte port)
   (return 1))
 
+(define-cproc write-chunks (chunks
+                            :optional (port::<output-port> (current-output-port)))
+  ::<void> (Scm_WriteChunks chunks port))
+
+(select-module gauche.internal)
+;; Used by text.tree.  FALLBACK is called on nodes other than lists,
+;; strings, characters, symbols and fixnums.
+(define-cproc %write-tree (tree port::<output-port> fallback) ::<void>
+  Scm_WriteTree)
+
+;; Used by text.html-lite.
+(define-cproc %write-html-escaped (str::<string> port::<output-port>) ::<void>
+  Scm_WriteHTMLEscaped)
+
+(select-module gauche)
 (define-cproc write-limited (obj limit::<fixnum>
                                  :optional (port (current-output-port)))
   ::<int> (return (Scm_WriteLimited obj port SCM_WRITE_WRITE limit)))
@@ -897,7 +976,7 @@
 (define-in-module gauche (with-output-to-string thunk)
   (let1 out (open-output-string)
     (with-output-to-port out thunk)
-    (get-output-string out)))
+    (%take-output-string out)))
 
 (define-in-module gauche (with-input-from-string str thunk)
   (with-input-from-port (open-input-string str) thunk))
@@ -905,7 +984,7 @@
 (define-in-module gauche (call-with-output-string proc)
   (let1 out (open-output-string)
     (proc out)
-    (get-output-string out)))
+    (%take-output-string out)))
 
 (define-in-module gauche (call-with-input-string str proc)
   (proc (open-input-string str)))
@@ -914,7 +993,7 @@
   (let ([out (open-output-string)]
         [in  (open-input-string str)])
     (proc in out)
-    (get-output-string out)))
+    (%take-output-string out)))
 
 (define-in-module gauche (with-string-io str thunk)
   (with-output-to-string (cut with-input-from-string str thunk)))
@@ -51,7 +51,9 @@
 (define-cproc module-precedence-list (mod::<module>) (return (-> mod mpl)))
 (define-cproc module-imports (mod::<module>) (return (-> mod imported)))
 (define-cproc module-exports (mod::<module>) Scm_ModuleExports)
-(define-cproc module-table (mod::<module>) (return (SCM_OBJ (-> mod internal))))
+(define-cproc module-table (mod::<module>)
+  (Scm_MaterializeLazyBindings mod)
+  (return (SCM_OBJ (-> mod internal))))
 
 (define-cproc find-module (name::<symbol>) ::<module>?
   (return (Scm_FindModule name SCM_FIND_MODULE_QUIET)))
@@ -143,9 +145,12 @@
 (define-in-module gauche (symbol-bound? name :optional (module #f)) ; Deprecated
   (global-variable-bound? module name))
 
+(define-cproc module-binding-cache-stat () Scm_ModuleBindingCacheStat)
+
 ;; Module import/export internal APIs.  Not public.
 (select-module gauche.internal)
 (define-cproc %export-all (module::<module>) Scm_ExportAll)
+(define-cproc %module-lazy-bindings (module::<module>) Scm_ModuleLazyBindings)
 (define-cproc %extend-module (module::<module> supers::<list>)
   Scm_ExtendModule)
 (define-cproc %insert-binding (mod::<module> name::<symbol> value
@@ -143,15 +143,15 @@
  )
 
 (define-cproc =  (arg0 arg1 :optarray (oarg optcnt 2) :rest args)
-  ::<boolean> :fast-flonum :constant (numcmp Scm_NumEq))
+  ::<boolean> :fast-flonum :constant :leaf (numcmp Scm_NumEq))
 (define-cproc <  (arg0 arg1 :optarray (oarg optcnt 2) :rest args)
-  ::<boolean> :fast-flonum :constant (numcmp Scm_NumLT))
+  ::<boolean> :fast-flonum :constant :leaf (numcmp Scm_NumLT))
 (define-cproc <= (arg0 arg1 :optarray (oarg optcnt 2) :rest args)
-  ::<boolean> :fast-flonum :constant (numcmp Scm_NumLE))
+  ::<boolean> :fast-flonum :constant :leaf (numcmp Scm_NumLE))
 (define-cproc >  (arg0 arg1 :optarray (oarg optcnt 2) :rest args)
-  ::<boolean> :fast-flonum :constant (numcmp Scm_NumGT))
+  ::<boolean> :fast-flonum :constant :leaf (numcmp Scm_NumGT))
 (define-cproc >= (arg0 arg1 :optarray (oarg optcnt 2) :rest args)
-  ::<boolean> :fast-flonum :constant (numcmp Scm_NumGE))
+  ::<boolean> :fast-flonum :constant :leaf (numcmp Scm_NumGE))
 
 (define-cproc max (arg0 :rest args) ::<number> :constant
   (Scm_MinMax arg0 args NULL (& SCM_RESULT)))
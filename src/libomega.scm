@@ -73,6 +73,12 @@
               (car src-info) (cadr src-info) expr)
       (format port "    While compiling: ~,,,,90:s\n" expr))))
 
+;; Compiler macro of format.  This is here instead of libfmt.scm, for it
+;; needs the compiler.
+((with-module gauche.internal %bind-inline-er-transformer)
+ (find-module 'gauche.format) 'format
+ (with-module gauche.format format-transformer))
+
 ;; Built-in comparators.  These are here instead of libcmp.scm, for
 ;; hash functions need to be defined before this.
 ;; NB: These are in srfi-114 but not in srfi-128.  We provide them
@@ -65,11 +65,12 @@
 (define-cproc values (:rest args) :constant (inliner VALUES) Scm_Values)
 (define-cproc dynamic-wind (pre body post) Scm_VMDynamicWind)
 
-(define-in-module scheme (call-with-values producer consumer)
-  (receive vals (producer) (apply consumer vals)))
+(define-cproc call-with-values (producer consumer) Scm_VMCallWithValues)
 
 (define-in-module scheme call/cc call-with-current-continuation)
 
+(define-cproc call/1cc (proc) Scm_VMCallOneShotCC)
+
 (select-module gauche.internal)
 ;; for partial continuation.  See lib/gauche/partcont.scm
 (define-cproc %call/pc (proc) (return (Scm_VMCallPC proc)))
@@ -214,11 +215,33 @@
 (define-cproc profiler-start () ::<void> Scm_ProfilerStart)
 (define-cproc profiler-stop  () ::<int>  Scm_ProfilerStop)
 (define-cproc profiler-reset () ::<void> Scm_ProfilerReset)
+(define-cproc profiler-sampling-period () ::<long> Scm_ProfilerSamplingPeriod)
+(define-cproc profiler-set-sampling-period! (usec::<long>) ::<void>
+  Scm_ProfilerSetSamplingPeriod)
+(define-cproc profiler-alloc-sampling-period () ::<long>
+  Scm_ProfilerAllocSamplingPeriod)
+(define-cproc profiler-set-alloc-sampling-period! (bytes::<long>) ::<void>
+  Scm_ProfilerSetAllocSamplingPeriod)
+
+(define-cproc lock-stat-start () ::<void> Scm_LockStatStart)
+(define-cproc lock-stat-stop  () ::<void> Scm_LockStatStop)
+(define-cproc lock-stat-reset () ::<void> Scm_LockStatReset)
+(define-cproc lock-stat-running? () ::<boolean> SCM_LOCK_STAT_ENABLED)
+(define-cproc port-lock-stat (port::<port>)
+  (return (Scm_LockStatToList (-> port lockStat))))
+
+(define-cproc perf-map-start (:optional (path #f)) Scm_PerfMapStart)
+(define-cproc perf-map-stop () ::<void> Scm_PerfMapStop)
+(define-cproc perf-map-running? () ::<boolean> (return Scm__PerfMapEnabled))
 
 (select-module gauche.internal)
 ;; Autoloaded profiler-get-result will use this.
 ;; See lib/gauche/vm/profiler.scm
 (define-cproc profiler-raw-result () Scm_ProfilerRawResult)
+(define-cproc profiler-raw-call-tree () Scm_ProfilerRawCallTree)
+(define-cproc profiler-raw-alloc-result () Scm_ProfilerRawAllocResult)
+;; Autoloaded lock-stat-result will use this.
+(define-cproc lock-stat-raw-result () Scm_LockStatResult)
 
 ;;;
 ;;; Introspection
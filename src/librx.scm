@@ -57,13 +57,26 @@
 (define-cproc regexp-named-groups (regexp::<regexp>)
   (return (-> regexp grpNames)))
 
-(define-cproc rxmatch (regexp str::<string>)
+(define-cproc rxmatch (regexp str::<string> :optional start end)
   (let* ([rx::ScmRegexp* NULL])
     (cond [(SCM_STRINGP regexp) (set! rx (SCM_REGEXP (Scm_RegComp
                                                       (SCM_STRING regexp) 0)))]
           [(SCM_REGEXPP regexp) (set! rx (SCM_REGEXP regexp))]
           [else (SCM_TYPE_ERROR regexp "regexp")])
-    (return (Scm_RegExec rx str))))
+    (if (and (SCM_UNBOUNDP start) (SCM_UNBOUNDP end))
+      (return (Scm_RegExec rx str))
+      (return (Scm_RegExecRange rx str start end)))))
+
+;; Same as (boolean (rxmatch regexp str start end)), but doesn't create
+;; a match object.
+(define-cproc regexp-matches? (regexp str::<string> :optional start end)
+  ::<boolean>
+  (let* ([rx::ScmRegexp* NULL])
+    (cond [(SCM_STRINGP regexp) (set! rx (SCM_REGEXP (Scm_RegComp
+                                                      (SCM_STRING regexp) 0)))]
+          [(SCM_REGEXPP regexp) (set! rx (SCM_REGEXP regexp))]
+          [else (SCM_TYPE_ERROR regexp "regexp")])
+    (return (Scm_RegMatchP rx str start end))))
 
 (inline-stub
  (define-cise-stmt rxmatchop
@@ -87,6 +100,10 @@
   (rxmatchop Scm_RegMatchBefore))
 (define-cproc rxmatch-after (match :optional (obj 0))
   (rxmatchop Scm_RegMatchAfter))
+(define-cproc rxmatch-start-cursor (match :optional (obj 0))
+  (rxmatchop Scm_RegMatchStartCursor))
+(define-cproc rxmatch-end-cursor (match :optional (obj 0))
+  (rxmatchop Scm_RegMatchEndCursor))
 (define-cproc rxmatch-num-matches (match)
   (if (SCM_FALSEP match)
     (return (SCM_MAKE_INT 0))
@@ -196,6 +213,21 @@
       (rlet1 s (regexp-unparse (regexp-ast rx))
         (set! (%regexp-pattern rx) s))))
 
+;; Each of PATTERNS is a string, which matches literally, or a regexp.
+;; The alternatives are tried in order, as in #/a|b/.  If all of them are
+;; strings, the resulting regexp is matched by a string searcher (see
+;; rc3_setup_literals in regexp.c), so it is fine to pass many of them.
+(define-in-module gauche (regexp-union patterns)
+  (define (->pattern p)
+    (cond [(string? p) (regexp-quote p)]
+          [(regexp? p)
+           (string-append (if (regexp-case-fold? p) "(?i:" "(?:")
+                          (regexp->string p) ")")]
+          [else (error "string or regexp required, but got:" p)]))
+  (when (null? patterns)
+    (error "regexp-union requires at least one pattern"))
+  (string->regexp (string-join (map ->pattern patterns) "|")))
+
 (define-in-module gauche (rxmatch->string rx str . sel)
   (cond [(null? sel) (rxmatch-substring (rxmatch rx str))]
         [(eq? (car sel) 'after)
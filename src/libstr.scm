@@ -60,7 +60,7 @@
   Scm_MakeFillString)
 (define-cproc string (:rest chars) Scm_ListToString)
 (define-cproc string-copy (str::<string> :optional start end)
-  (return (Scm_CopyString (SCM_STRING (Scm_MaybeSubstring str start end)))))
+  (return (Scm_StringCopyContent (SCM_STRING (Scm_MaybeSubstring str start end)))))
 
 (define-cproc string-append (:rest args) Scm_StringAppend)
 
@@ -105,9 +105,19 @@
   (return (Scm_Substring str start end FALSE)))
 
 (select-module gauche)
+(define-cproc string-slice (str::<string> start::<fixnum>
+                            :optional (end::<fixnum> -1))
+  Scm_StringSlice)
+
 (define-cproc string-size (str::<string>) ::<fixnum> :constant
   (return (SCM_STRING_BODY_SIZE (SCM_STRING_BODY str))))
 
+(define-cproc string-build-index! (str::<string>)
+  (Scm_StringBodyBuildIndex (SCM_STRING_BODY str))
+  (return (SCM_OBJ str)))
+(define-cproc string-fast-indexable? (str::<string>) ::<boolean>
+  (return (Scm_StringBodyFastIndexableP (SCM_STRING_BODY str))))
+
 (select-module gauche.internal)
 ;; see lib/gauche/stringutil.scm for generic string-split
 (define-cproc %string-split-by-char (s::<string> ch::<char>
@@ -140,8 +150,10 @@
       [(SCM_EQ mode 'before*) (set! rmode SCM_STRING_SCAN_BEFORE2)]
       [(SCM_EQ mode 'after*)  (set! rmode SCM_STRING_SCAN_AFTER2)]
       [(SCM_EQ mode 'both)    (set! rmode SCM_STRING_SCAN_BOTH)]
+      [(SCM_EQ mode 'cursor)  (set! rmode SCM_STRING_SCAN_CURSOR)]
       [else (Scm_Error "bad value in mode argumet: %S, must be one of \
-                 'index, 'before, 'after, 'before*, 'after* or 'both." mode)])
+                 'index, 'before, 'after, 'before*, 'after*, 'both \
+                 or 'cursor." mode)])
      (return rmode))))
 
 ;; primitive scanner
@@ -165,6 +177,25 @@
                        either string or character" s2)
            (return SCM_UNDEFINED)])))
 
+;;
+;; Searching multiple strings
+;;
+
+(inline-stub
+ (define-type <string-searcher> "ScmStringSearcher*" "string searcher"
+   "SCM_STRING_SEARCHER_P" "SCM_STRING_SEARCHER")
+ )
+
+(define-cproc make-string-searcher (needles::<list>) Scm_MakeStringSearcher)
+(define-cproc string-searcher? (obj) ::<boolean> SCM_STRING_SEARCHER_P)
+(define-cproc string-searcher-needles (ss::<string-searcher>)
+  Scm_StringSearcherNeedles)
+(define-cproc string-searcher-search (ss::<string-searcher> s::<string>
+                                      :optional start end)
+  Scm_StringSearcherSearch)
+(define-cproc string-searcher-fold (ss::<string-searcher> src proc seed)
+  Scm_StringSearcherFold)
+
 ;;
 ;; Modifying string
 ;;  They are just for backward compatibility, and they are expensive
@@ -244,35 +275,35 @@
  )
 
 (define-cproc string=? (s1::<string> s2::<string> :rest ss)
-  ::<boolean> :constant
+  ::<boolean> :constant :leaf
   (strcmp-multiarg (Scm_StringEqual s1 s2)))
 (define-cproc string<? (s1::<string> s2::<string> :rest ss)
-  ::<boolean> :constant
+  ::<boolean> :constant :leaf
   (strcmp-multiarg (strcmp <)))
 (define-cproc string>? (s1::<string> s2::<string> :rest ss)
-  ::<boolean> :constant
+  ::<boolean> :constant :leaf
   (strcmp-multiarg (strcmp >)))
 (define-cproc string<=? (s1::<string> s2::<string> :rest ss)
-  ::<boolean> :constant
+  ::<boolean> :constant :leaf
   (strcmp-multiarg (strcmp <=)))
 (define-cproc string>=? (s1::<string> s2::<string> :rest ss)
-  ::<boolean> :constant
+  ::<boolean> :constant :leaf
   (strcmp-multiarg (strcmp >=)))
 
 (define-cproc string-ci=? (s1::<string> s2::<string> :rest ss)
-  ::<boolean> :constant
+  ::<boolean> :constant :leaf
   (strcmp-multiarg (strcmpi ==)))
 (define-cproc string-ci<? (s1::<string> s2::<string> :rest ss)
-  ::<boolean> :constant
+  ::<boolean> :constant :leaf
   (strcmp-multiarg (strcmpi <)))
 (define-cproc string-ci>? (s1::<string> s2::<string> :rest ss)
-  ::<boolean> :constant
+  ::<boolean> :constant :leaf
   (strcmp-multiarg (strcmpi >)))
 (define-cproc string-ci<=? (s1::<string> s2::<string> :rest ss)
-  ::<boolean> :constant
+  ::<boolean> :constant :leaf
   (strcmp-multiarg (strcmpi <=)))
 (define-cproc string-ci>=? (s1::<string> s2::<string> :rest ss)
-  ::<boolean> :constant
+  ::<boolean> :constant :leaf
   (strcmp-multiarg (strcmpi >=)))
 
 ;;
@@ -317,6 +348,54 @@
 (define-cproc byte-substring (str::<string> start::<fixnum> end::<fixnum>)
   (return (Scm_Substring str start end TRUE)))
 
+;;
+;; String cursors
+;;
+
+(select-module gauche)
+(define-cproc string-cursor? (obj) ::<boolean> SCM_STRING_CURSOR_P)
+(define-cproc string-cursor-start (str::<string>)
+  (return (Scm_MakeStringCursorFromIndex str 0)))
+(define-cproc string-cursor-end (str::<string>) Scm_MakeStringCursorEnd)
+(define-cproc string-index->cursor (str::<string> index)
+  (if (SCM_INTP index)
+    (return (Scm_MakeStringCursorFromIndex str (SCM_INT_VALUE index)))
+    (return (Scm__MakeStringCursor
+             (Scm__StringCursorOffset (SCM_STRING_BODY str) index)))))
+(define-cproc string-cursor->index (str::<string> cursor)
+  Scm_StringCursorIndex)
+(define-cproc string-cursor-next (str::<string> cursor)
+  (return (Scm_StringCursorForward str cursor 1)))
+(define-cproc string-cursor-prev (str::<string> cursor)
+  (return (Scm_StringCursorBack str cursor 1)))
+(define-cproc string-cursor-forward (str::<string> cursor nchars::<fixnum>)
+  Scm_StringCursorForward)
+(define-cproc string-cursor-back (str::<string> cursor nchars::<fixnum>)
+  Scm_StringCursorBack)
+(define-cproc string-cursor-ref (str::<string> cursor :optional fallback)
+  (let* ([r::ScmChar (Scm_StringRefCursor str cursor (SCM_UNBOUNDP fallback))])
+    (return (?: (== r SCM_CHAR_INVALID) fallback (SCM_MAKE_CHAR r)))))
+(define-cproc substring/cursors (str::<string> start end)
+  Scm_SubstringCursor)
+(define-cproc string-cursor-diff (str::<string> start end) ::<fixnum>
+  (let* ([s::ScmObj (Scm_SubstringCursor str start end)])
+    (return (SCM_STRING_BODY_LENGTH (SCM_STRING_BODY s)))))
+
+(inline-stub
+ (define-cise-stmt string-cursor-compare
+   [(_ op) `(return (,op (Scm_StringCursorCompare sc1 sc2) 0))])
+ )
+(define-cproc string-cursor=? (sc1 sc2) ::<boolean>
+  (string-cursor-compare ==))
+(define-cproc string-cursor<? (sc1 sc2) ::<boolean>
+  (string-cursor-compare <))
+(define-cproc string-cursor>? (sc1 sc2) ::<boolean>
+  (string-cursor-compare >))
+(define-cproc string-cursor<=? (sc1 sc2) ::<boolean>
+  (string-cursor-compare <=))
+(define-cproc string-cursor>=? (sc1 sc2) ::<boolean>
+  (string-cursor-compare >=))
+
 ;;
 ;; String pointers
 ;;
@@ -54,6 +54,10 @@
 (define-cproc symbol-sans-prefix (s::<symbol> p::<symbol>)
   Scm_SymbolSansPrefix)
 
+(define-cproc symbol-table-weak! (flag::<boolean>) ::<boolean>
+  Scm_SymbolTableSetWeak)
+(define-cproc symbol-table-stat () Scm_SymbolTableStat)
+
 ;; Bigloo has symbol-append symbol ... -> symbol
 ;; We enhance it a bit.
 (select-module gauche.internal)
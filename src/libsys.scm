@@ -58,7 +58,13 @@
 ;;   we don't have correspoinding functions, but provide these:
 
 (select-module gauche)
-(define-cproc sys-readdir (pathname::<string>) Scm_ReadDirectory)
+(define-cproc sys-readdir (pathname::<string>
+                           :optional (with-types::<boolean> #f)
+                                     (follow-link::<boolean> #t))
+  (if with-types
+    (return (Scm_ReadDirectoryWithTypes
+             pathname (?: follow-link SCM_READDIR_FOLLOW_LINK 0)))
+    (return (Scm_ReadDirectory pathname))))
 
 ;; Bonus
 
@@ -1295,6 +1301,52 @@
    ) ;; when defined(HAVE_SELECT)
  )
 
+;;---------------------------------------------------------------------
+;; poller
+
+;; The poller is a scalable alternative to select.  The interest set is
+;; kept in the kernel (epoll or kqueue) where available, so a wait only
+;; costs for the ready descriptors.  The backend is chosen at build time.
+(inline-stub
+ (when "defined(GAUCHE_HAVE_POLLER)"
+   (define-type <sys-poller> "ScmSysPoller*")
+
+   (define-cproc make-sys-poller () Scm_MakeSysPoller)
+
+   ;; FLAGS is a list of r, w, x and edge.
+   (define-cproc sys-poller-add! (p::<sys-poller> pf flags::<list>) ::<void>
+     (let* ([fd::int (Scm_GetPortFd pf TRUE)]
+            [mask::u_long 0])
+       (dolist [f flags]
+         (cond [(or (SCM_EQ f 'r) (SCM_EQ f 'read))
+                (logior= mask SCM_SYS_POLLER_READ)]
+               [(or (SCM_EQ f 'w) (SCM_EQ f 'write))
+                (logior= mask SCM_SYS_POLLER_WRITE)]
+               [(or (SCM_EQ f 'x) (SCM_EQ f 'exception))
+                (logior= mask SCM_SYS_POLLER_EXCEPT)]
+               [(SCM_EQ f 'edge)
+                (logior= mask SCM_SYS_POLLER_EDGE)]
+               [else (Scm_Error "invalid poller flag %S, must be one of \
+                                 r, w, x or edge" f)]))
+       (Scm_SysPollerAdd p fd mask)))
+
+   (define-cproc sys-poller-delete! (p::<sys-poller> pf) ::<void>
+     (Scm_SysPollerDelete p (Scm_GetPortFd pf TRUE)))
+
+   (define-cproc sys-poller-wait (p::<sys-poller>
+                                  :optional (timeout #f)
+                                            (max-events::<fixnum> 64))
+     (return (Scm_SysPollerWait p timeout max-events)))
+
+   (define-cproc sys-poller-close (p::<sys-poller>) ::<void>
+     Scm_SysPollerClose)
+
+   (define-cproc sys-poller-backend () Scm_SysPollerBackend)
+
+   (initcode (Scm_AddFeature "gauche.sys.poller" NULL))
+   ) ;; when defined(GAUCHE_HAVE_POLLER)
+ )
+
 ;;---------------------------------------------------------------------
 ;; miscellaneous
 
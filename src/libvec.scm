@@ -138,6 +138,201 @@
 (define (string->vector s :optional (start 0) (end -1)) ;;R7RS
   (list->vector (string->list s start end))) ; TOOD: can be more efficient
 
+;;;
+;;; Bitvectors
+;;;
+
+;; SRFI-178 compatible API.  The core operations are in C; bulk boolean
+;; operations go through %bitvector-operate!, which works a word (or a
+;; SIMD register) at a time.
+
+(select-module gauche)
+(inline-stub
+ (define-type <bitvector> "ScmBitvector*" "bitvector"
+   "SCM_BITVECTORP" "SCM_BITVECTOR")
+
+ (define-cfn bitvector-check-index (v::ScmBitvector* i::ScmSmallInt) ::void
+   (unless (and (<= 0 i) (< i (SCM_BITVECTOR_SIZE v)))
+     (Scm_Error "bitvector index out of range: %ld" i)))
+ )
+
+(define-cproc bitvector? (obj) ::<boolean> :constant SCM_BITVECTORP)
+
+(define-cproc make-bitvector (len::<fixnum> :optional init)
+  Scm_MakeBitvector)
+
+(define-cproc bitvector (:rest bits) Scm_ListToBitvector)
+
+(define-cproc bitvector-length (v::<bitvector>) ::<fixnum> :constant
+  SCM_BITVECTOR_SIZE)
+
+(define-cproc bitvector-ref/int (v::<bitvector> i::<fixnum>) ::<int>
+  (bitvector-check-index v i)
+  (return (SCM_BITS_TEST (SCM_BITVECTOR_BITS v) i)))
+
+(define-cproc bitvector-ref/bool (v::<bitvector> i::<fixnum>) ::<boolean>
+  (bitvector-check-index v i)
+  (return (SCM_BITS_TEST (SCM_BITVECTOR_BITS v) i)))
+
+(define-cproc bitvector-set! (v::<bitvector> i::<fixnum> bit) ::<void>
+  (SCM_BITVECTOR_CHECK_MUTABLE v)
+  (bitvector-check-index v i)
+  (if (Scm_Bit2Int bit)
+    (SCM_BITS_SET (SCM_BITVECTOR_BITS v) i)
+    (SCM_BITS_RESET (SCM_BITVECTOR_BITS v) i)))
+
+(define-cproc bitvector-copy
+  (v::<bitvector> :optional (start::<fixnum> 0) (end::<fixnum> -1))
+  Scm_BitvectorCopy)
+
+(define-cproc bitvector-copy!
+  (dst::<bitvector> dstart::<fixnum> src::<bitvector>
+   :optional (sstart::<fixnum> 0) (send::<fixnum> -1))
+  ::<void>
+  (Scm_BitvectorCopyX dst dstart src sstart send))
+
+(define-cproc bitvector-fill!
+  (v::<bitvector> bit :optional (start::<fixnum> 0) (end::<fixnum> -1))
+  ::<void>
+  (SCM_BITVECTOR_CHECK_MUTABLE v)
+  (SCM_CHECK_START_END start end (SCM_BITVECTOR_SIZE v))
+  (Scm_BitsFill (SCM_BITVECTOR_BITS v) start end (Scm_Bit2Int bit)))
+
+(define-cproc list->bitvector (lis::<list>) Scm_ListToBitvector)
+
+(define-cproc bitvector->list/int
+  (v::<bitvector> :optional (start::<fixnum> 0) (end::<fixnum> -1))
+  (SCM_CHECK_START_END start end (SCM_BITVECTOR_SIZE v))
+  (let* ([h SCM_NIL] [t SCM_NIL] [i::ScmSmallInt start])
+    (for [() (< i end) (post++ i)]
+      (SCM_APPEND1 h t (SCM_MAKE_INT (SCM_BITS_TEST (SCM_BITVECTOR_BITS v) i))))
+    (return h)))
+
+(define-cproc bitvector->list/bool
+  (v::<bitvector> :optional (start::<fixnum> 0) (end::<fixnum> -1))
+  (SCM_CHECK_START_END start end (SCM_BITVECTOR_SIZE v))
+  (let* ([h SCM_NIL] [t SCM_NIL] [i::ScmSmallInt start])
+    (for [() (< i end) (post++ i)]
+      (SCM_APPEND1 h t (SCM_MAKE_BOOL (SCM_BITS_TEST (SCM_BITVECTOR_BITS v) i))))
+    (return h)))
+
+;; SRFI-178 string representation has "#*" prefix.
+(define-cproc string->bitvector (s::<string>)
+  (return (Scm_StringToBitvector s TRUE)))
+(define-cproc bitvector->string (v::<bitvector>)
+  (return (Scm_BitvectorToString v TRUE)))
+
+(define-cproc bitvector-count
+  (bit v::<bitvector> :optional (start::<fixnum> 0) (end::<fixnum> -1))
+  ::<fixnum>
+  (SCM_CHECK_START_END start end (SCM_BITVECTOR_SIZE v))
+  (if (Scm_Bit2Int bit)
+    (return (Scm_BitsCount1 (SCM_BITVECTOR_BITS v) start end))
+    (return (Scm_BitsCount0 (SCM_BITVECTOR_BITS v) start end))))
+
+;; Number of BITs in [0, i).
+(define-cproc bitvector-rank (bit v::<bitvector> i::<fixnum>) ::<fixnum>
+  (unless (and (<= 0 i) (<= i (SCM_BITVECTOR_SIZE v)))
+    (Scm_Error "bitvector index out of range: %ld" i))
+  (if (Scm_Bit2Int bit)
+    (return (Scm_BitsCount1 (SCM_BITVECTOR_BITS v) 0 i))
+    (return (Scm_BitsCount0 (SCM_BITVECTOR_BITS v) 0 i))))
+
+;; Index of K-th (0-based) BIT, or #f.
+(define-cproc bitvector-select (bit v::<bitvector> k::<fixnum>)
+  (let* ([r::ScmSmallInt (Scm_BitvectorSelect v (Scm_Bit2Int bit) k)])
+    (return (?: (< r 0) SCM_FALSE (SCM_MAKE_INT r)))))
+
+(define-cproc bitvector-first-bit (bit v::<bitvector>) ::<fixnum>
+  (if (Scm_Bit2Int bit)
+    (return (Scm_BitsLowest1 (SCM_BITVECTOR_BITS v) 0 (SCM_BITVECTOR_SIZE v)))
+    (return (Scm_BitsLowest0 (SCM_BITVECTOR_BITS v) 0 (SCM_BITVECTOR_SIZE v)))))
+
+;; Index of the first BIT at or after START, or -1.
+(define-cproc bitvector-next-bit (bit v::<bitvector> start::<fixnum>)
+  ::<fixnum>
+  (let* ([len::ScmSmallInt (SCM_BITVECTOR_SIZE v)])
+    (unless (and (<= 0 start) (<= start len))
+      (Scm_Error "bitvector index out of range: %ld" start))
+    (if (Scm_Bit2Int bit)
+      (return (Scm_BitsLowest1 (SCM_BITVECTOR_BITS v) start len))
+      (return (Scm_BitsLowest0 (SCM_BITVECTOR_BITS v) start len)))))
+
+(define (bitvector-for-each-index proc bit v)
+  (let loop ([i (bitvector-next-bit bit v 0)])
+    (when (>= i 0)
+      (proc i)
+      (loop (bitvector-next-bit bit v (+ i 1))))))
+
+(define (bitvector=? v . vs)
+  (let loop ([vs vs])
+    (cond [(null? vs) #t]
+          [(equal? v (car vs)) (loop (cdr vs))]
+          [else #f])))
+
+;; Bulk operations
+(select-module gauche.internal)
+(inline-stub
+ (define-enum SCM_BIT_AND)
+ (define-enum SCM_BIT_IOR)
+ (define-enum SCM_BIT_XOR)
+ (define-enum SCM_BIT_EQV)
+ (define-enum SCM_BIT_NAND)
+ (define-enum SCM_BIT_NOR)
+ (define-enum SCM_BIT_ANDC1)
+ (define-enum SCM_BIT_ANDC2)
+ (define-enum SCM_BIT_IORC1)
+ (define-enum SCM_BIT_IORC2)
+ (define-enum SCM_BIT_NOT1)
+ )
+
+(define-cproc %bitvector-operate! (r::<bitvector> op::<int> a::<bitvector>
+                                                  :optional (b #f))
+  (unless (or (SCM_FALSEP b) (SCM_BITVECTORP b))
+    (SCM_TYPE_ERROR b "bitvector"))
+  (return (Scm_BitvectorOperate r op a (?: (SCM_FALSEP b)
+                                           NULL
+                                           (SCM_BITVECTOR b)))))
+
+(define (%bv-nary op)
+  (^[v . vs]
+    (rlet1 r (bitvector-copy v)
+      (dolist [b vs] (%bitvector-operate! r op r b)))))
+(define (%bv-nary! op)
+  (^[v . vs]
+    (dolist [b vs] (%bitvector-operate! v op v b))
+    v))
+(define (%bv-dyadic op)
+  (^[a b] (%bitvector-operate! (make-bitvector (bitvector-length a)) op a b)))
+(define (%bv-dyadic! op)
+  (^[a b] (%bitvector-operate! a op a b)))
+
+(define-in-module gauche (bitvector-not v)
+  (%bitvector-operate! (make-bitvector (bitvector-length v)) SCM_BIT_NOT1 v))
+(define-in-module gauche (bitvector-not! v)
+  (%bitvector-operate! v SCM_BIT_NOT1 v))
+
+(define-in-module gauche bitvector-and   (%bv-nary SCM_BIT_AND))
+(define-in-module gauche bitvector-and!  (%bv-nary! SCM_BIT_AND))
+(define-in-module gauche bitvector-ior   (%bv-nary SCM_BIT_IOR))
+(define-in-module gauche bitvector-ior!  (%bv-nary! SCM_BIT_IOR))
+(define-in-module gauche bitvector-xor   (%bv-nary SCM_BIT_XOR))
+(define-in-module gauche bitvector-xor!  (%bv-nary! SCM_BIT_XOR))
+(define-in-module gauche bitvector-eqv   (%bv-nary SCM_BIT_EQV))
+(define-in-module gauche bitvector-eqv!  (%bv-nary! SCM_BIT_EQV))
+(define-in-module gauche bitvector-nand  (%bv-dyadic SCM_BIT_NAND))
+(define-in-module gauche bitvector-nand! (%bv-dyadic! SCM_BIT_NAND))
+(define-in-module gauche bitvector-nor   (%bv-dyadic SCM_BIT_NOR))
+(define-in-module gauche bitvector-nor!  (%bv-dyadic! SCM_BIT_NOR))
+(define-in-module gauche bitvector-andc1 (%bv-dyadic SCM_BIT_ANDC1))
+(define-in-module gauche bitvector-andc1! (%bv-dyadic! SCM_BIT_ANDC1))
+(define-in-module gauche bitvector-andc2 (%bv-dyadic SCM_BIT_ANDC2))
+(define-in-module gauche bitvector-andc2! (%bv-dyadic! SCM_BIT_ANDC2))
+(define-in-module gauche bitvector-orc1  (%bv-dyadic SCM_BIT_IORC1))
+(define-in-module gauche bitvector-orc1! (%bv-dyadic! SCM_BIT_IORC1))
+(define-in-module gauche bitvector-orc2  (%bv-dyadic SCM_BIT_IORC2))
+(define-in-module gauche bitvector-orc2! (%bv-dyadic! SCM_BIT_IORC2))
+
 ;;;
 ;;; Weak vectors
 ;;;
@@ -171,6 +366,11 @@
     (Scm_TypeError "vec" (Scm_UVectorTypeName t) (SCM_OBJ v)))
   (return (Scm_VMUVectorRef v t k fallback)))
 
+;; Returns the type tag of V, to be passed to %uvector-ref.  Used by
+;; generic code that walks any kind of uvector.
+(define-cproc %uvector-type (v::<uvector>) ::<int> :constant
+  (return (Scm_UVectorType (SCM_CLASS_OF v))))
+
 (select-module gauche)
 (inline-stub
  (define-enum SCM_UVECTOR_S8)
@@ -586,13 +586,111 @@ ScmObj Scm_AssocDeleteX(ScmObj elt, ScmObj alist, int cmpmode)
     return alist;
 }
 
-/* DeleteDuplicates.  preserve the order of original list.   N^2 algorithm */
+/* DeleteDuplicates.  preserve the order of original list.
+
+   For short lists we just scan the result so far, which is N^2 but
+   doesn't allocate anything extra.  Once the number of distinct elements
+   exceeds DELDUP_HASH_THRESHOLD, we switch to a hash table.  For equal?
+   comparison we only do so while every element can be hashed without
+   calling object-hash, which may be unavailable or expensive for
+   user-defined classes; if we see such an element we go back to the
+   linear scan. */
+
+#define DELDUP_HASH_THRESHOLD 16
+
+static int deldup_hashable_p(ScmObj obj, int cmpmode, int depth)
+{
+    if (cmpmode != SCM_CMP_EQUAL) return TRUE;
+    if (!SCM_PTRP(obj) || SCM_NUMBERP(obj) || SCM_STRINGP(obj)
+        || SCM_SYMBOLP(obj) || SCM_KEYWORDP(obj)) {
+        return TRUE;
+    }
+    if (depth <= 0) return FALSE;
+    if (SCM_PAIRP(obj)) {
+        /* the length limit also keeps us away from circular lists */
+        ScmObj cp;
+        int n = 0;
+        SCM_FOR_EACH(cp, obj) {
+            if (++n > 64) return FALSE;
+            if (!deldup_hashable_p(SCM_CAR(cp), cmpmode, depth-1)) {
+                return FALSE;
+            }
+        }
+        return deldup_hashable_p(cp, cmpmode, depth-1);
+    }
+    if (SCM_VECTORP(obj)) {
+        ScmSmallInt siz = SCM_VECTOR_SIZE(obj);
+        if (siz > 64) return FALSE;
+        for (ScmSmallInt i=0; i<siz; i++) {
+            if (!deldup_hashable_p(SCM_VECTOR_ELEMENT(obj, i),
+                                   cmpmode, depth-1)) {
+                return FALSE;
+            }
+        }
+        return TRUE;
+    }
+    return FALSE;
+}
+
+static ScmHashType deldup_hash_type(int cmpmode)
+{
+    switch (cmpmode) {
+    case SCM_CMP_EQ:  return SCM_HASH_EQ;
+    case SCM_CMP_EQV: return SCM_HASH_EQV;
+    default:          return SCM_HASH_EQUAL;
+    }
+}
+
+/* Returns TRUE if OBJ is in the elements of RESULT before END, i.e.
+   it has been seen; otherwise records it and returns FALSE.  *HASHEDP
+   tells whether SEEN is in use; it is set up lazily from the elements of
+   RESULT when *COUNTP crosses the threshold. */
+static int deldup_seen(ScmObj obj, ScmObj result, ScmObj end, int cmpmode,
+                       ScmHashCore *seen, int *hashedp, int *countp)
+{
+    if (*hashedp && !deldup_hashable_p(obj, cmpmode, 4)) {
+        *hashedp = -1;          /* give up hashing */
+    }
+    if (*hashedp > 0) {
+        ScmDictEntry *e = Scm_HashCoreSearch(seen, (intptr_t)obj,
+                                             SCM_DICT_CREATE);
+        if (e->value) return TRUE;
+        (void)SCM_DICT_SET_VALUE(e, SCM_TRUE);
+        return FALSE;
+    }
+    for (ScmObj cp = result; cp != end; cp = SCM_CDR(cp)) {
+        if (Scm_EqualM(obj, SCM_CAR(cp), cmpmode)) return TRUE;
+    }
+    if (*hashedp == 0 && ++(*countp) > DELDUP_HASH_THRESHOLD) {
+        Scm_HashCoreInitSimple(seen, deldup_hash_type(cmpmode),
+                               DELDUP_HASH_THRESHOLD*4, NULL);
+        *hashedp = 1;
+        for (ScmObj cp = result; cp != end; cp = SCM_CDR(cp)) {
+            if (!deldup_hashable_p(SCM_CAR(cp), cmpmode, 4)) {
+                *hashedp = -1;
+                break;
+            }
+            ScmDictEntry *e = Scm_HashCoreSearch(seen, (intptr_t)SCM_CAR(cp),
+                                                 SCM_DICT_CREATE);
+            (void)SCM_DICT_SET_VALUE(e, SCM_TRUE);
+        }
+        if (*hashedp > 0) {
+            ScmDictEntry *e = Scm_HashCoreSearch(seen, (intptr_t)obj,
+                                                 SCM_DICT_CREATE);
+            (void)SCM_DICT_SET_VALUE(e, SCM_TRUE);
+        }
+    }
+    return FALSE;
+}
 
 ScmObj Scm_DeleteDuplicates(ScmObj list, int cmpmode)
 {
     ScmObj result = SCM_NIL, tail = SCM_NIL, lp;
+    ScmHashCore seen;
+    int hashed = 0, count = 0;
     SCM_FOR_EACH(lp, list) {
-        if (SCM_FALSEP(Scm_Member(SCM_CAR(lp), result, cmpmode))) {
+        if (!deldup_seen(SCM_CAR(lp), result, SCM_NIL, cmpmode,
+                         &seen, &hashed, &count)) {
             SCM_APPEND1(result, tail, SCM_CAR(lp));
         }
     }
@@ -602,12 +700,19 @@ ScmObj Scm_DeleteDuplicates(ScmObj list, int cmpmode)
 
 ScmObj Scm_DeleteDuplicatesX(ScmObj list, int cmpmode)
 {
-    ScmObj lp;
+    ScmObj lp, prev = SCM_NIL;
+    ScmHashCore seen;
+    int hashed = 0, count = 0;
 
-    SCM_FOR_EACH(lp, list) {
-        ScmObj obj = SCM_CAR(lp);
-        ScmObj tail = Scm_DeleteX(obj, SCM_CDR(lp), cmpmode);
-        if (SCM_CDR(lp) != tail) SCM_SET_CDR(lp, tail);
+    /* The cells of LIST before LP are already unique, so they serve as
+       the 'result so far'. */
+    for (lp = list; SCM_PAIRP(lp); lp = SCM_CDR(lp)) {
+        if (deldup_seen(SCM_CAR(lp), list, lp, cmpmode,
+                        &seen, &hashed, &count)) {
+            SCM_SET_CDR(prev, SCM_CDR(lp));
+        } else {
+            prev = lp;
+        }
     }
     return list;
 }
@@ -36,6 +36,7 @@
 #include "gauche/code.h"
 #include "gauche/vminsn.h"
 #include "gauche/priv/macroP.h"
+#include "gauche/priv/moduleP.h"
 #include "gauche/priv/builtin-syms.h"
 
 /* avoid C++ reserved name conflict.
@@ -169,6 +170,7 @@ ScmSyntaxRules *make_syntax_rules(int nr)
                                  sizeof(ScmSyntaxRules)+(nr-1)*sizeof(ScmSyntaxRuleBranch));
     SCM_SET_CLASS(r, SCM_CLASS_SYNTAX_RULES);
     r->numRules = nr;
+    for (int i=0; i<SCM_SYNTAX_RULES_MEMO_SIZE; i++) r->memo[i] = NULL;
     return r;
 }
 
@@ -510,6 +512,25 @@ static ScmObj compile_rule1(ScmObj form,
     return form;
 }
 
+/* Figure out the range of the number of arguments a compiled pattern
+   (the part after the macro keyword) can accept, so that the expander
+   can skip rules without running the matcher. */
+static void pattern_arity(ScmObj pat, int *minArgs, int *maxArgs)
+{
+    int n = 0;
+    for (; SCM_PAIRP(pat); pat = SCM_CDR(pat)) {
+        if (SCM_SYNTAX_PATTERN_P(SCM_CAR(pat))) {
+            /* numFollowingItems is counted by the following elements */
+            *maxArgs = -1;
+        } else {
+            n++;
+        }
+    }
+    *minArgs = n;
+    if (!SCM_NULLP(pat)) *maxArgs = -1;
+    else if (*maxArgs != -1) *maxArgs = n;
+}
+
 /* compile rules into ScmSyntaxRules structure
    NB: We use ScmSyntaxPattern for the toplevel node of pattern and template;
    they are just a placeholders and they don't represent repetition. */
@@ -559,6 +580,9 @@ static ScmSyntaxRules *compile_rules(ScmObj name,
         sr->rules[i].template = SCM_OBJ(tmpl->pattern);
         sr->rules[i].numPvars = ctx.pvcnt;
         sr->rules[i].maxLevel = ctx.maxlev;
+        sr->rules[i].maxArgs = 0;
+        pattern_arity(pat->pattern, &sr->rules[i].minArgs,
+                      &sr->rules[i].maxArgs);
         if (ctx.pvcnt > sr->maxNumPvars) sr->maxNumPvars = ctx.pvcnt;
     }
     return sr;
@@ -750,20 +774,26 @@ static inline int match_subpattern(ScmObj form, ScmSyntaxPattern *pat,
                                    ScmObj rest, ScmObj mod, ScmObj env,
                                    MatchVar *mvec)
 {
-    /* TODO: If pat->numFollowingItems == 0, we don't need to calculate
-       length beforehand.  Some optimization opportunity. */
-    int limit = 0;
-    for (ScmObj p = form; SCM_PAIRP(p); p = SCM_CDR(p)) {
-        limit++;
-    }
-    limit -= pat->numFollowingItems;
-
     enter_subpattern(pat, mvec);
-    while (limit > 0) {
-        if (!match_synrule(SCM_CAR(form), pat->pattern, mod, env, mvec))
-            return FALSE;
-        form = SCM_CDR(form);
-        limit--;
+    if (pat->numFollowingItems == 0) {
+        /* The repetition consumes the whole list; no need to count. */
+        while (SCM_PAIRP(form)) {
+            if (!match_synrule(SCM_CAR(form), pat->pattern, mod, env, mvec))
+                return FALSE;
+            form = SCM_CDR(form);
+        }
+    } else {
+        int limit = 0;
+        for (ScmObj p = form; SCM_PAIRP(p); p = SCM_CDR(p)) {
+            limit++;
+        }
+        limit -= pat->numFollowingItems;
+        while (limit > 0) {
+            if (!match_synrule(SCM_CAR(form), pat->pattern, mod, env, mvec))
+                return FALSE;
+            form = SCM_CDR(form);
+            limit--;
+        }
     }
     exit_subpattern(pat, mvec);
     return match_synrule(form, rest, mod, env, mvec);
@@ -943,14 +973,72 @@ static ScmObj realize_template(ScmSyntaxRuleBranch *branch,
     return realize_template_rec(branch->template, mvec, 0, indices, &idlist, &exlev);
 }
 
+/* Memo of recent matches.
+ *   A macro that uses its argument more than once in the template, e.g.
+ *   (begin e e), hands the very same form to the compiler more than once,
+ *   and so do macros generating code in bulk.  Matching the same form
+ *   (eq?) in the same environment gives the same result as long as
+ *   the bindings the literals are matched against don't change, so we
+ *   keep a few recent matches per macro, keyed by the form, the module,
+ *   the local environment and the module binding epoch.
+ *   We only keep the matched rule and the match vector, which isn't
+ *   modified once matching is done.  The template is instantiated for
+ *   each expansion, for each one needs fresh identifiers; sharing them
+ *   between two expansions would break hygiene.
+ *   We don't memoize by equal?-ness, since the comparison costs as much
+ *   as matching.  An entry is replaced as a whole, so concurrent
+ *   expanders may miss but never see a torn entry.
+ */
+static inline u_long memo_index(ScmObj form)
+{
+    return (SCM_WORD(form) >> 4) & (SCM_SYNTAX_RULES_MEMO_SIZE-1);
+}
+
+static ScmSyntaxRulesMemo *memo_lookup(ScmSyntaxRules *sr, ScmObj form,
+                                       ScmObj mod, ScmObj env, u_long epoch)
+{
+    ScmSyntaxRulesMemo *m = sr->memo[memo_index(form)];
+    if (m && m->form == form && m->mod == mod && m->env == env
+        && m->epoch == epoch) {
+        return m;
+    }
+    return NULL;
+}
+
+static void memo_store(ScmSyntaxRules *sr, ScmObj form, ScmObj mod,
+                       ScmObj env, u_long epoch, int rule, MatchVar *mvec)
+{
+    ScmSyntaxRulesMemo *m = SCM_NEW(ScmSyntaxRulesMemo);
+    m->form = form;
+    m->mod = mod;
+    m->env = env;
+    m->epoch = epoch;
+    m->rule = rule;
+    m->mvec = mvec;
+    sr->memo[memo_index(form)] = m;
+}
+
 static ScmObj synrule_expand(ScmObj form, ScmObj mod, ScmObj env, ScmSyntaxRules *sr)
 {
+    u_long epoch = Scm__ModuleBindingEpoch();
+    ScmSyntaxRulesMemo *memo = memo_lookup(sr, form, mod, env, epoch);
+    if (memo) {
+        return realize_template(&sr->rules[memo->rule],
+                                (MatchVar*)memo->mvec);
+    }
+
     MatchVar *mvec = alloc_matchvec(sr->maxNumPvars);
+    int nargs = 0;
+    for (ScmObj cp = SCM_CDR(form); SCM_PAIRP(cp); cp = SCM_CDR(cp)) nargs++;
 
 #ifdef DEBUG_SYNRULE
     Scm_Printf(SCM_CUROUT, "**** synrule_transform: %S\n", form);
 #endif
     for (int i=0; i<sr->numRules; i++) {
+        if (nargs < sr->rules[i].minArgs
+            || (sr->rules[i].maxArgs >= 0 && nargs > sr->rules[i].maxArgs)) {
+            continue;
+        }
 #ifdef DEBUG_SYNRULE
         Scm_Printf(SCM_CUROUT, "pattern #%d: %S\n", i, sr->rules[i].pattern);
 #endif
@@ -964,6 +1052,7 @@ static ScmObj synrule_expand(ScmObj form, ScmObj mod, ScmObj env, ScmSyntaxRules
 #ifdef DEBUG_SYNRULE
             Scm_Printf(SCM_CUROUT, "result: %S\n", expanded);
 #endif
+            memo_store(sr, form, mod, env, epoch, i, mvec);
             return expanded;
         }
     }
@@ -32,6 +32,7 @@
  */
 
 #include "gauche.h"
+#include "gauche/prof.h"
 
 #include <signal.h>
 #include <ctype.h>
@@ -69,12 +70,14 @@ ScmModule *default_toplevel_module = NULL;
 void usage(void)
 {
     fprintf(stderr,
-            "Usage: gosh [-biqV][-I<path>][-A<path>][-u<module>][-m<module>][-l<file>][-L<file>][-e<expr>][-E<expr>][-p<type>][-F<feature>][-r<standard>][-f<flag>][--] [file]\n"
+            "Usage: gosh [-biqV][-j<image>][-I<path>][-A<path>][-u<module>][-m<module>][-l<file>][-L<file>][-e<expr>][-E<expr>][-p<type>][-F<feature>][-r<standard>][-f<flag>][--] [file]\n"
             "options:\n"
             "  -V       Prints version and exits.\n"
             "  -b       Batch mode.  Doesn't print prompts.  Supersedes -i.\n"
             "  -i       Interactive mode.  Forces to print prompts.\n"
             "  -q       Doesn't read the default initialization file.\n"
+            "  -j<image> Loads the image file <image> made by save-image, and\n"
+            "           requires the features it contains.\n"
             "  -I<path> Adds <path> to the head of the load path list.\n"
             "  -A<path> Adds <path> to the tail of the load path list.\n"
             "  -u<module> (use) load and import <module>\n"
@@ -90,7 +93,8 @@ void usage(void)
             "           By default, the 'main' procedure in the user module is called\n"
             "           after loading the script (srfi-22).  This option allows to call\n"
             "           a main procedure in the different module.\n"
-            "  -p<type> Turns on the profiler.  <Type> can be 'time' or 'load'.\n"
+            "  -p<type> Turns on the profiler.  <Type> can be 'time', 'load', 'macro',\n"
+            "           'time-load' or 'perf-map'.\n"
             "  -F<feature> Makes <feature> available in cond-expand forms\n"
             "  -r<standard>  Starts gosh with the default environment defined\n"
             "           in RnRS, where n is determined by <standard>.  The following\n"
@@ -100,6 +104,8 @@ void usage(void)
             "      case-fold       uses case-insensitive reader (as in R5RS)\n"
             "      load-verbose    report while loading files\n"
             "      include-verbose report while including files\n"
+            "      compile-report  report closure allocations and local function\n"
+            "                      optimizations to stderr\n"
             "      warn-legacy-syntax\n"
             "                      print warning when legacy Gauche syntax is encountered\n"
             "      no-inline       don't inline procedures & constants (combined\n"
@@ -116,6 +122,8 @@ void usage(void)
             "      no-post-inline-pass\n"
             "                      don't run post-inline optimization pass.\n"
             "      no-source-info  don't preserve source information for debugging\n"
+            "      pack-source-info\n"
+            "                      keep source information serialized, to save memory.\n"
             "      test            test mode, to run gosh inside the build tree\n"
             );
     exit(1);
@@ -163,12 +171,18 @@ void further_options(const char *optarg)
     else if (strcmp(optarg, "no-source-info") == 0) {
         SCM_VM_COMPILER_FLAG_SET(vm, SCM_COMPILE_NOSOURCE);
     }
+    else if (strcmp(optarg, "pack-source-info") == 0) {
+        SCM_VM_COMPILER_FLAG_SET(vm, SCM_COMPILE_PACK_SOURCE_INFO);
+    }
     else if (strcmp(optarg, "load-verbose") == 0) {
         SCM_VM_RUNTIME_FLAG_SET(vm, SCM_LOAD_VERBOSE);
     }
     else if (strcmp(optarg, "include-verbose") == 0) {
         SCM_VM_COMPILER_FLAG_SET(vm, SCM_COMPILE_INCLUDE_VERBOSE);
     }
+    else if (strcmp(optarg, "compile-report") == 0) {
+        SCM_VM_COMPILER_FLAG_SET(vm, SCM_COMPILE_REPORT);
+    }
     else if (strcmp(optarg, "case-fold") == 0) {
         SCM_VM_RUNTIME_FLAG_SET(vm, SCM_CASE_FOLD);
     }
@@ -201,7 +215,7 @@ void further_options(const char *optarg)
     }
     else {
         fprintf(stderr, "unknown -f option: %s\n", optarg);
-        fprintf(stderr, "supported options are: -fcase-fold, -fload-verbose, -finclude-verbose, -fno-inline, -fno-inline-globals, -fno-inline-locals, -fno-inline-constants, -fno-source-info, -fno-post-inline-pass, -fno-lambda-lifting-pass, -fwarn-legacy-syntax, or -ftest\n");
+        fprintf(stderr, "supported options are: -fcase-fold, -fload-verbose, -finclude-verbose, -fno-inline, -fno-inline-globals, -fno-inline-locals, -fno-inline-constants, -fno-source-info, -fpack-source-info, -fno-post-inline-pass, -fno-lambda-lifting-pass, -fcompile-report, -fwarn-legacy-syntax, or -ftest\n");
         exit(1);
     }
 }
@@ -216,9 +230,18 @@ void profiler_options(const char *optarg)
     else if (strcmp(optarg, "load") == 0) {
         SCM_VM_RUNTIME_FLAG_SET(vm, SCM_COLLECT_LOAD_STATS);
     }
+    else if (strcmp(optarg, "macro") == 0) {
+        SCM_VM_RUNTIME_FLAG_SET(vm, SCM_COLLECT_MACRO_STATS);
+    }
+    else if (strcmp(optarg, "time-load") == 0) {
+        SCM_VM_RUNTIME_FLAG_SET(vm, SCM_COLLECT_LOAD_TIMES);
+    }
+    else if (strcmp(optarg, "perf-map") == 0) {
+        Scm_PerfMapStart(SCM_FALSE);
+    }
     else {
         fprintf(stderr, "unknown -p option: %s\n", optarg);
-        fprintf(stderr, "supported profiling options are: -ptime or -pload\n");
+        fprintf(stderr, "supported profiling options are: -ptime, -pload, -pmacro, -ptime-load or -pperf-map\n");
     }
 }
 
@@ -230,7 +253,7 @@ void feature_options(const char *optarg)
 int parse_options(int argc, char *argv[])
 {
     int c;
-    while ((c = getopt(argc, argv, "+be:E:ip:ql:L:m:u:Vr:F:f:I:A:-")) >= 0) {
+    while ((c = getopt(argc, argv, "+be:E:ij:p:ql:L:m:u:Vr:F:f:I:A:-")) >= 0) {
         switch (c) {
         case 'b': batch_mode = TRUE; break;
         case 'i': interactive_mode = TRUE; break;
@@ -243,6 +266,7 @@ int parse_options(int argc, char *argv[])
             main_module = Scm_Intern(SCM_STRING(SCM_MAKE_STR_COPYING(optarg)));
             break;
         case 'r': /*FALLTHROUGH*/;
+        case 'j': /*FALLTHROUGH*/;
         case 'u': /*FALLTHROUGH*/;
         case 'l': /*FALLTHROUGH*/;
         case 'L': /*FALLTHROUGH*/;
@@ -353,6 +377,19 @@ void cleanup_main(void *data)
                  SCM_OBJ(Scm_GaucheModule()),
                  NULL);    /* ignore errors */
     }
+
+    /* EXPERIMENTAL */
+    if (SCM_VM_RUNTIME_FLAG_IS_SET(vm, SCM_COLLECT_MACRO_STATS)) {
+        Scm_Eval(SCM_LIST1(SCM_INTERN("profiler-show-macro-stats")),
+                 SCM_OBJ(Scm_GaucheModule()),
+                 NULL);    /* ignore errors */
+    }
+
+    if (SCM_VM_RUNTIME_FLAG_IS_SET(vm, SCM_COLLECT_LOAD_TIMES)) {
+        Scm_Eval(SCM_LIST1(SCM_INTERN("profiler-show-load-times")),
+                 SCM_OBJ(Scm_GaucheModule()),
+                 NULL);    /* ignore errors */
+    }
 }
 
 /* Error handling */
@@ -424,6 +461,14 @@ static void process_command_args(ScmObj cmd_args)
         case 'A':
             Scm_AddLoadPath(Scm_GetStringConst(SCM_STRING(v)), TRUE);
             break;
+        case 'j': {
+            ScmObj loader = Scm_GlobalVariableRef(Scm_GaucheModule(),
+                                                  SCM_SYMBOL(SCM_INTERN("load-image")),
+                                                  0);
+            if (Scm_Apply(loader, SCM_LIST1(v), &epak) < 0)
+                error_exit(epak.exception);
+            break;
+        }
         case 'l':
             if (Scm_Load(Scm_GetStringConst(SCM_STRING(v)), 0, &lpak) < 0)
                 error_exit(lpak.exception);
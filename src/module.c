@@ -126,6 +126,34 @@ static struct {
                                lookup_module may hold the lock. */
 } modules;
 
+/* Resolved binding cache
+ *
+ * Scm_FindBinding walks the imported modules and the module precedence
+ * list, which can be long.  The compiler caches the result in the code
+ * once it resolves a global reference, but eval, global-variable-ref and
+ * the modules being loaded repeatedly need to resolve the same names
+ * again and again.  So each module caches the results, including
+ * negative ones.
+ *
+ * Any change that may affect the result of a search from any module,
+ * i.e. creating a new binding, defining a phantom binding, or altering
+ * imports, exports or inheritance, bumps the global epoch.  A module's
+ * cache is discarded when it is used with an old epoch.  All of these
+ * are done while holding modules.mutex.
+ */
+static struct {
+    u_long epoch;
+    u_long lookups;
+    u_long hits;
+    u_long invalidations;
+} bcache = { 1, 0, 0, 0 };
+
+/* Must be called while holding modules.mutex */
+static inline void bcache_invalidate(void)
+{
+    bcache.epoch++;
+}
+
 /* Predefined modules - slots will be initialized by Scm__InitModule */
 #define DEFINE_STATIC_MODULE(cname) \
     static ScmModule cname = { { NULL } }
@@ -157,11 +185,16 @@ static void init_module(ScmModule *m, ScmObj name, ScmHashTable *internal)
     if (internal) {
         m->internal = internal;
     } else {
-        m->internal = SCM_HASH_TABLE(Scm_MakeHashTableSimple(SCM_HASH_EQ, 0));
+        m->internal = SCM_HASH_TABLE(Scm_MakeHashTableLayout(SCM_HASH_EQ,
+                                    SCM_HASH_OPEN_ADDRESSING, 0));
     }
-    m->external = SCM_HASH_TABLE(Scm_MakeHashTableSimple(SCM_HASH_EQ, 0));
+    m->external = SCM_HASH_TABLE(Scm_MakeHashTableLayout(SCM_HASH_EQ,
+                                    SCM_HASH_OPEN_ADDRESSING, 0));
     m->origin = m->prefix = SCM_FALSE;
     m->sealed = FALSE;
+    m->cache = NULL;
+    m->cacheEpoch = 0;
+    m->lazy = NULL;
 }
 
 /* Internal */
@@ -296,6 +329,115 @@ static inline void module_add_visited(module_cache *c, ScmObj m)
     }
 }
 
+/*
+ * Lazy bindings
+ *
+ *  An extension may define hundreds of subrs, most of which a program
+ *  never uses.  Scm_MakeLazyBinding only records the static
+ *  ScmLazyBinding in the module; the symbol and the gloc are created
+ *  when the name is first looked up in the module's table, by
+ *  binding_ref below.  The records are pushed to the pending list, and
+ *  moved into the index, keyed by the name, at the next lookup.  So the
+ *  registration at initialization only costs a few stores.
+ *
+ *  All of these must be done while holding modules.mutex.
+ */
+typedef struct lazy_table_rec {
+    ScmLazyBinding *pending;
+    ScmHashCore index;          /* name -> ScmLazyBinding* */
+} lazy_table;
+
+static u_long lazy_hash(const ScmHashCore *hc, intptr_t key)
+{
+    ScmLazyBinding *b = (ScmLazyBinding*)key;
+    return Scm_HashBytes(b->name, b->nameSize, 0);
+}
+
+static int lazy_compare(const ScmHashCore *hc, intptr_t key, intptr_t ekey)
+{
+    ScmLazyBinding *x = (ScmLazyBinding*)key, *y = (ScmLazyBinding*)ekey;
+    return (x->nameSize == y->nameSize
+            && memcmp(x->name, y->name, x->nameSize) == 0);
+}
+
+static void lazy_flush_pending(lazy_table *lt)
+{
+    while (lt->pending) {
+        ScmLazyBinding *b = lt->pending;
+        lt->pending = b->next;
+        b->next = NULL;
+        b->nameSize = (int)strlen(b->name);
+        /* If the same name is registered again, the later one wins,
+           as Scm_MakeBinding does. */
+        ScmDictEntry *e = Scm_HashCoreSearch(&lt->index, (intptr_t)b,
+                                             SCM_DICT_CREATE);
+        e->value = (intptr_t)b;
+    }
+}
+
+static int lazy_kind(int flags)
+{
+    return ((flags&SCM_BINDING_CONST)
+            ? SCM_BINDING_CONST
+            : ((flags&SCM_BINDING_INLINABLE) ? SCM_BINDING_INLINABLE : 0));
+}
+
+/* If MODULE has a lazy binding for NAME, makes it real and returns the
+   gloc.  G is the phantom gloc of NAME in MODULE, if any, and it is
+   filled.  Otherwise a new gloc is created.  Returns G if there's no
+   lazy binding for NAME. */
+static ScmGloc *lazy_materialize(ScmModule *module, ScmSymbol *name,
+                                 ScmGloc *g)
+{
+    lazy_table *lt = (lazy_table*)module->lazy;
+    if (!SCM_SYMBOL_INTERNED(name)) return g;
+    lazy_flush_pending(lt);
+    if (lt->index.numEntries == 0) return g;
+
+    const ScmStringBody *sb = SCM_STRING_BODY(SCM_SYMBOL_NAME(name));
+    ScmLazyBinding key;
+    key.name = SCM_STRING_BODY_START(sb);
+    key.nameSize = (int)SCM_STRING_BODY_SIZE(sb);
+    ScmDictEntry *e = Scm_HashCoreSearch(&lt->index, (intptr_t)&key,
+                                         SCM_DICT_DELETE);
+    if (e == NULL) return g;
+
+    ScmLazyBinding *b = (ScmLazyBinding*)e->value;
+    if (g == NULL) {
+        g = SCM_GLOC(Scm_MakeGloc(name, module));
+        Scm_HashTableSet(module->internal, SCM_OBJ(name), SCM_OBJ(g), 0);
+        if (module->exportAll) {
+            Scm_HashTableSet(module->external, SCM_OBJ(name), SCM_OBJ(g), 0);
+        }
+    }
+    g->value = b->value;
+    Scm_GlocMark(g, lazy_kind(b->flags));
+    return g;
+}
+
+/* Looks up SYMBOL in the internal or external table of MODULE,
+   making the lazy binding real if necessary.  Returns a gloc or
+   SCM_FALSE.  The result can be a phantom gloc. */
+static ScmObj binding_ref(ScmModule *module, ScmSymbol *symbol, int external)
+{
+    ScmObj v = Scm_HashTableRef(external? module->external : module->internal,
+                                SCM_OBJ(symbol), SCM_FALSE);
+    if (SCM_GLOCP(v)) {
+        ScmGloc *g = SCM_GLOC(v);
+        /* The phantom gloc may be of a lazy binding in the module it
+           belongs to, even if it is found through another module. */
+        if (SCM_GLOC_PHANTOM_BINDING_P(g) && g->module->lazy && !g->hidden) {
+            lazy_materialize(g->module, g->name, g);
+        }
+        return v;
+    }
+    if (module->lazy && (!external || module->exportAll)) {
+        ScmGloc *g = lazy_materialize(module, symbol, NULL);
+        if (g) return SCM_OBJ(g);
+    }
+    return v;
+}
+
 /* The main logic of global binding search.  We factored this out since
    we need recursive searching in case of phantom binding (see gloc.h
    about phantom bindings).  The flags stay_in_module and external_only
@@ -311,9 +453,7 @@ static ScmGloc *search_binding(ScmModule *module, ScmSymbol *symbol,
     /* First, search from the specified module.  In this phase, we just ignore
        phantom bindings, for we'll search imported bindings later anyway. */
     if (!exclude_self) {
-        ScmObj v = Scm_HashTableRef(
-            external_only? module->external : module->internal,
-            SCM_OBJ(symbol), SCM_FALSE);
+        ScmObj v = binding_ref(module, symbol, external_only);
         if (SCM_GLOCP(v)) {
             if (SCM_GLOC_PHANTOM_BINDING_P(SCM_GLOC(v))) {
                 /* If we're here, the symbol is external to MODULE but
@@ -351,7 +491,7 @@ static ScmGloc *search_binding(ScmModule *module, ScmSymbol *symbol,
                 if (!SCM_SYMBOLP(sym)) break;
             }
 
-            ScmObj v = Scm_HashTableRef(m->external, SCM_OBJ(sym), SCM_FALSE);
+            ScmObj v = binding_ref(m, SCM_SYMBOL(sym), TRUE);
             if (SCM_GLOCP(v)) {
                 g = SCM_GLOC(v);
                 if (g->hidden) break;
@@ -377,8 +517,7 @@ static ScmGloc *search_binding(ScmModule *module, ScmSymbol *symbol,
             if (!SCM_SYMBOLP(sym)) return NULL;
             symbol = SCM_SYMBOL(sym);
         }
-        ScmObj v = Scm_HashTableRef(external_only?m->external:m->internal,
-                                    SCM_OBJ(symbol), SCM_FALSE);
+        ScmObj v = binding_ref(m, symbol, external_only);
         if (SCM_GLOCP(v)) {
             if (SCM_GLOC_PHANTOM_BINDING_P(SCM_GLOC(v))) {
                 external_only = FALSE; /* See above comment */
@@ -390,6 +529,32 @@ static ScmGloc *search_binding(ScmModule *module, ScmSymbol *symbol,
     return NULL;
 }
 
+/* Must be called while holding modules.mutex */
+static ScmGloc *cached_search_binding(ScmModule *module, ScmSymbol *symbol)
+{
+    bcache.lookups++;
+    if (module->cache == NULL) {
+        module->cache = SCM_HASH_TABLE(Scm_MakeHashTableLayout(SCM_HASH_EQ,
+                                       SCM_HASH_OPEN_ADDRESSING, 0));
+    } else if (module->cacheEpoch != bcache.epoch) {
+        Scm_HashCoreClear(SCM_HASH_TABLE_CORE(module->cache));
+        bcache.invalidations++;
+    }
+    module->cacheEpoch = bcache.epoch;
+
+    ScmDictEntry *e = Scm_HashCoreSearch(SCM_HASH_TABLE_CORE(module->cache),
+                                         (intptr_t)symbol, SCM_DICT_GET);
+    if (e) {
+        bcache.hits++;
+        ScmObj v = SCM_DICT_VALUE(e);
+        return SCM_GLOCP(v)? SCM_GLOC(v) : NULL;
+    }
+    ScmGloc *g = search_binding(module, symbol, FALSE, FALSE, FALSE);
+    Scm_HashTableSet(module->cache, SCM_OBJ(symbol),
+                     g? SCM_OBJ(g) : SCM_FALSE, 0);
+    return g;
+}
+
 ScmGloc *Scm_FindBinding(ScmModule *module, ScmSymbol *symbol, int flags)
 {
     int stay_in_module = flags&SCM_BINDING_STAY_IN_MODULE;
@@ -397,11 +562,50 @@ ScmGloc *Scm_FindBinding(ScmModule *module, ScmSymbol *symbol, int flags)
     ScmGloc *gloc = NULL;
 
     SCM_INTERNAL_MUTEX_SAFE_LOCK_BEGIN(modules.mutex);
-    gloc = search_binding(module, symbol, stay_in_module, external_only, FALSE);
+    if (stay_in_module || external_only) {
+        /* These are either a single table lookup or rare. */
+        gloc = search_binding(module, symbol, stay_in_module, external_only,
+                              FALSE);
+    } else {
+        gloc = cached_search_binding(module, symbol);
+    }
     SCM_INTERNAL_MUTEX_SAFE_LOCK_END();
     return gloc;
 }
 
+u_long Scm__ModuleBindingEpoch(void)
+{
+    u_long e;
+    (void)SCM_INTERNAL_MUTEX_LOCK(modules.mutex);
+    e = bcache.epoch;
+    (void)SCM_INTERNAL_MUTEX_UNLOCK(modules.mutex);
+    return e;
+}
+
+/* Returns statistics of the resolved binding cache. */
+ScmObj Scm_ModuleBindingCacheStat(void)
+{
+    ScmObj h = SCM_NIL, t = SCM_NIL;
+    u_long lookups, hits, invalidations, epoch;
+    (void)SCM_INTERNAL_MUTEX_LOCK(modules.mutex);
+    lookups = bcache.lookups;
+    hits = bcache.hits;
+    invalidations = bcache.invalidations;
+    epoch = bcache.epoch;
+    (void)SCM_INTERNAL_MUTEX_UNLOCK(modules.mutex);
+    SCM_APPEND1(h, t, SCM_MAKE_KEYWORD("lookups"));
+    SCM_APPEND1(h, t, Scm_MakeIntegerU(lookups));
+    SCM_APPEND1(h, t, SCM_MAKE_KEYWORD("hits"));
+    SCM_APPEND1(h, t, Scm_MakeIntegerU(hits));
+    SCM_APPEND1(h, t, SCM_MAKE_KEYWORD("misses"));
+    SCM_APPEND1(h, t, Scm_MakeIntegerU(lookups - hits));
+    SCM_APPEND1(h, t, SCM_MAKE_KEYWORD("invalidations"));
+    SCM_APPEND1(h, t, Scm_MakeIntegerU(invalidations));
+    SCM_APPEND1(h, t, SCM_MAKE_KEYWORD("epoch"));
+    SCM_APPEND1(h, t, Scm_MakeIntegerU(epoch));
+    return h;
+}
+
 ScmObj Scm_GlobalVariableRef(ScmModule *module,
                              ScmSymbol *symbol,
                              int flags)
@@ -428,20 +632,18 @@ ScmGloc *Scm_MakeBinding(ScmModule *module, ScmSymbol *symbol,
     ScmGloc *g;
     ScmObj oldval = SCM_UNDEFINED;
     int prev_kind = 0;
-    int kind = ((flags&SCM_BINDING_CONST)
-                ? SCM_BINDING_CONST
-                : ((flags&SCM_BINDING_INLINABLE)
-                   ? SCM_BINDING_INLINABLE
-                   : 0));
+    int kind = lazy_kind(flags);
 
     SCM_INTERNAL_MUTEX_SAFE_LOCK_BEGIN(modules.mutex);
-    ScmObj v = Scm_HashTableRef(module->internal, SCM_OBJ(symbol), SCM_FALSE);
+    ScmObj v = binding_ref(module, symbol, FALSE);
     /* NB: this function bypasses check of gloc setter */
     if (SCM_GLOCP(v)) {
         g = SCM_GLOC(v);
         if (Scm_GlocConstP(g))          prev_kind = SCM_BINDING_CONST;
         else if (Scm_GlocInlinableP(g)) prev_kind = SCM_BINDING_INLINABLE;
         oldval = g->value;
+        /* Defining a phantom binding changes the search result. */
+        if (SCM_UNBOUNDP(oldval)) bcache_invalidate();
     } else {
         g = SCM_GLOC(Scm_MakeGloc(symbol, module));
         Scm_HashTableSet(module->internal, SCM_OBJ(symbol), SCM_OBJ(g), 0);
@@ -449,10 +651,11 @@ ScmGloc *Scm_MakeBinding(ScmModule *module, ScmSymbol *symbol,
         if (module->exportAll && SCM_SYMBOL_INTERNED(symbol)) {
             Scm_HashTableSet(module->external, SCM_OBJ(symbol), SCM_OBJ(g), 0);
         }
+        bcache_invalidate();
     }
+    g->value = value;
     SCM_INTERNAL_MUTEX_SAFE_LOCK_END();
 
-    g->value = value;
     Scm_GlocMark(g, kind);
 
     if (prev_kind != 0) {
@@ -467,6 +670,84 @@ ScmGloc *Scm_MakeBinding(ScmModule *module, ScmSymbol *symbol,
     return g;
 }
 
+/* Registers a lazy binding.  See the comment of "Lazy bindings" above.
+   If NAME already has a real binding in MODULE, we just rebind it,
+   for the lazy one would never be looked up. */
+void Scm_MakeLazyBinding(ScmModule *module, ScmLazyBinding *binding)
+{
+    if (module->sealed) err_sealed(SCM_MAKE_STR_IMMUTABLE(binding->name),
+                                   module);
+
+    ScmSymbol *name = Scm__FindSymbolBytes(binding->name,
+                                           strlen(binding->name));
+    int bound = FALSE;
+
+    SCM_INTERNAL_MUTEX_SAFE_LOCK_BEGIN(modules.mutex);
+    if (name) {
+        ScmObj v = Scm_HashTableRef(module->internal, SCM_OBJ(name),
+                                    SCM_FALSE);
+        bound = (SCM_GLOCP(v) && !SCM_GLOC_PHANTOM_BINDING_P(SCM_GLOC(v)));
+    }
+    if (!bound) {
+        lazy_table *lt = (lazy_table*)module->lazy;
+        if (lt == NULL) {
+            lt = SCM_NEW(lazy_table);
+            lt->pending = NULL;
+            Scm_HashCoreInitGeneral(&lt->index, lazy_hash, lazy_compare,
+                                    0, NULL);
+            module->lazy = lt;
+        }
+        binding->next = lt->pending;
+        lt->pending = binding;
+        /* It hides the bindings of the same name in the modules searched
+           after this one. */
+        bcache_invalidate();
+    }
+    SCM_INTERNAL_MUTEX_SAFE_LOCK_END();
+
+    if (bound) {
+        Scm_MakeBinding(module, name, binding->value, binding->flags);
+    }
+}
+
+/* Makes all the lazy bindings of MODULE real, for the operations that
+   need to see the whole table. */
+void Scm_MaterializeLazyBindings(ScmModule *module)
+{
+    if (module->lazy == NULL) return;
+    ScmObj names = Scm_ModuleLazyBindings(module);
+    ScmObj cp;
+    SCM_FOR_EACH(cp, names) {
+        ScmSymbol *name = SCM_SYMBOL(Scm_Intern(SCM_STRING(SCM_CAR(cp))));
+        SCM_INTERNAL_MUTEX_SAFE_LOCK_BEGIN(modules.mutex);
+        (void)binding_ref(module, name, FALSE);
+        SCM_INTERNAL_MUTEX_SAFE_LOCK_END();
+    }
+}
+
+/* Returns a list of the names of the lazy bindings in MODULE that are
+   not made real yet.  The names are returned as strings, so that this
+   doesn't intern them. */
+ScmObj Scm_ModuleLazyBindings(ScmModule *module)
+{
+    ScmObj h = SCM_NIL, t = SCM_NIL;
+    SCM_INTERNAL_MUTEX_SAFE_LOCK_BEGIN(modules.mutex);
+    lazy_table *lt = (lazy_table*)module->lazy;
+    if (lt) {
+        lazy_flush_pending(lt);
+        ScmHashIter iter;
+        Scm_HashIterInit(&iter, &lt->index);
+        ScmDictEntry *e;
+        while ((e = Scm_HashIterNext(&iter)) != NULL) {
+            ScmLazyBinding *b = (ScmLazyBinding*)e->value;
+            SCM_APPEND1(h, t, Scm_MakeString(b->name, b->nameSize, -1,
+                                             SCM_STRING_IMMUTABLE));
+        }
+    }
+    SCM_INTERNAL_MUTEX_SAFE_LOCK_END();
+    return h;
+}
+
 /* Convenience wrapper (return value is ScmObj for the backward compatibility)*/
 ScmObj Scm_Define(ScmModule *module, ScmSymbol *symbol, ScmObj value)
 {
@@ -504,6 +785,7 @@ void Scm_HideBinding(ScmModule *module, ScmSymbol *symbol)
         ScmGloc *g = SCM_GLOC(Scm_MakeGloc(symbol, module));
         g->hidden = TRUE;
         Scm_HashTableSet(module->external, SCM_OBJ(symbol), SCM_OBJ(g), 0);
+        bcache_invalidate();
     }
     (void)SCM_INTERNAL_MUTEX_UNLOCK(modules.mutex);
 
@@ -547,6 +829,7 @@ int Scm_AliasBinding(ScmModule *target, ScmSymbol *targetName,
     SCM_INTERNAL_MUTEX_SAFE_LOCK_BEGIN(modules.mutex);
     Scm_HashTableSet(target->external, SCM_OBJ(targetName), SCM_OBJ(g), 0);
     Scm_HashTableSet(target->internal, SCM_OBJ(targetName), SCM_OBJ(g), 0);
+    bcache_invalidate();
     SCM_INTERNAL_MUTEX_SAFE_LOCK_END();
     return TRUE;
 }
@@ -601,6 +884,7 @@ ScmObj Scm_ImportModule(ScmModule *module,
         }
         module->imported = p;
     }
+    bcache_invalidate();
     (void)SCM_INTERNAL_MUTEX_UNLOCK(modules.mutex);
 
     return module->imported;
@@ -684,6 +968,7 @@ ScmObj Scm_ExportSymbols(ScmModule *module, ScmObj specs)
                              SCM_DICT_VALUE(e), 0);
         }
     }
+    bcache_invalidate();
     (void)SCM_INTERNAL_MUTEX_UNLOCK(modules.mutex);
 
     /* Now, if this export changes the meaning of exported symbols, we
@@ -723,6 +1008,7 @@ ScmObj Scm_ExportAll(ScmModule *module)
                 (void)SCM_DICT_SET_VALUE(ee, SCM_DICT_VALUE(e));
             }
         }
+        bcache_invalidate();
     }
     (void)SCM_INTERNAL_MUTEX_UNLOCK(modules.mutex);
     return SCM_OBJ(module);
@@ -735,6 +1021,7 @@ ScmObj Scm_ModuleExports(ScmModule *module)
 {
     ScmObj h = SCM_NIL, t = SCM_NIL;
 
+    if (module->exportAll) Scm_MaterializeLazyBindings(module);
     (void)SCM_INTERNAL_MUTEX_LOCK(modules.mutex);
     ScmHashIter iter;
     Scm_HashIterInit(&iter, SCM_HASH_TABLE_CORE(module->external));
@@ -776,7 +1063,10 @@ ScmObj Scm_ExtendModule(ScmModule *module, ScmObj supers)
     if (SCM_FALSEP(mpl)) {
         Scm_Error("can't extend those modules simultaneously because of inconsistent precedence lists: %S", supers);
     }
+    (void)SCM_INTERNAL_MUTEX_LOCK(modules.mutex);
     module->mpl = Scm_Cons(SCM_OBJ(module), mpl);
+    bcache_invalidate();
+    (void)SCM_INTERNAL_MUTEX_UNLOCK(modules.mutex);
     return module->mpl;
 }
 
@@ -933,7 +1223,8 @@ void Scm__InitModule(void)
     const char **modname;
 
     (void)SCM_INTERNAL_MUTEX_INIT(modules.mutex);
-    modules.table = SCM_HASH_TABLE(Scm_MakeHashTableSimple(SCM_HASH_EQ, 64));
+    modules.table = SCM_HASH_TABLE(Scm_MakeHashTableLayout(SCM_HASH_EQ,
+                                    SCM_HASH_OPEN_ADDRESSING, 64));
 
     /* standard module chain */
     ScmObj mpl = SCM_NIL;
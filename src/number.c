@@ -36,6 +36,7 @@
 #include "gauche/scmconst.h"
 #include "gauche/bits.h"
 #include "gauche/bits_inline.h"
+#include "gauche/priv/portP.h"
 #include "gauche/priv/builtin-syms.h"
 #include "gauche/priv/arith.h"
 
@@ -699,47 +700,56 @@ ScmObj Scm_ReduceRational(ScmObj rational)
     }
 }
 
-/* x, y must be exact numbers */
+/* Returns N/D, where N and D are integers, D > 0 and N/D is known to be
+   in lowest terms. */
+static ScmObj make_reduced_rational(ScmObj numer, ScmObj denom)
+{
+    if (SCM_EXACT_ONE_P(denom)) return numer;
+    if (SCM_EXACT_ZERO_P(numer)) return SCM_MAKE_INT(0);
+    return Scm_MakeRatnum(numer, denom);
+}
+
+/* x, y must be exact numbers.
+   Since ratnums are always in lowest terms, we don't need gcd of
+   the whole result (Knuth TAOCP 4.5.1).  Let g = gcd(dx, dy).  If g = 1,
+   nx*dy + ny*dx over dx*dy is already in lowest terms.  Otherwise,
+   t = nx*(dy/g) + ny*(dx/g) can only share factors with g, so the result
+   is (t/g2) / ((dx/g)*(dy/g2)) where g2 = gcd(t, g). */
 ScmObj Scm_RatnumAddSub(ScmObj x, ScmObj y, int subtract)
 {
     ScmObj nx = SCM_RATNUMP(x)? SCM_RATNUM_NUMER(x) : x;
     ScmObj dx = SCM_RATNUMP(x)? SCM_RATNUM_DENOM(x) : SCM_MAKE_INT(1);
     ScmObj ny = SCM_RATNUMP(y)? SCM_RATNUM_NUMER(y) : y;
     ScmObj dy = SCM_RATNUMP(y)? SCM_RATNUM_DENOM(y) : SCM_MAKE_INT(1);
-    ScmObj gcd, dr, nr;
+    ScmObj g, nr, dr;
 
-    /* shortcut */
-    if (Scm_NumEq(dx, dy)) {
-        dr = dx;
-        goto finish;
-    }
-
-    if (SCM_EXACT_ONE_P(dx)||SCM_EXACT_ONE_P(dx)) gcd = SCM_MAKE_INT(1);
-    else gcd = Scm_Gcd(dx, dy);
-    if (Scm_NumEq(dx, gcd)) {
-        /* only factor x */
-        nx = Scm_Mul(Scm_Quotient(dy, dx, NULL), nx);
-        dr = dy;
-        goto finish;
-    }
-    if (Scm_NumEq(dy, gcd)) {
-        /* only factor y */
-        ny = Scm_Mul(Scm_Quotient(dx, dy, NULL), ny);
-        dr = dx;
-        goto finish;
-    }
+    if (SCM_EXACT_ONE_P(dx)||SCM_EXACT_ONE_P(dy)) g = SCM_MAKE_INT(1);
+    else g = Scm_Gcd(dx, dy);
 
-    /* general case */
-    ScmObj fx = Scm_Quotient(dx, gcd, NULL);
-    ScmObj fy = Scm_Quotient(dy, gcd, NULL);
-    nx = Scm_Mul(nx, fy);
-    ny = Scm_Mul(ny, fx);
-    dr = Scm_Mul(dx, fy);
-  finish:
-    nr = (subtract? Scm_Sub(nx, ny) : Scm_Add(nx, ny));
-    return Scm_MakeRational(nr, dr);
+    if (SCM_EXACT_ONE_P(g)) {
+        nx = Scm_Mul(nx, dy);
+        ny = Scm_Mul(ny, dx);
+        nr = (subtract? Scm_Sub(nx, ny) : Scm_Add(nx, ny));
+        dr = Scm_Mul(dx, dy);
+    } else {
+        ScmObj fx = Scm_Quotient(dx, g, NULL);
+        ScmObj fy = Scm_Quotient(dy, g, NULL);
+        nx = Scm_Mul(nx, fy);
+        ny = Scm_Mul(ny, fx);
+        nr = (subtract? Scm_Sub(nx, ny) : Scm_Add(nx, ny));
+        ScmObj g2 = Scm_Gcd(nr, g);
+        if (!SCM_EXACT_ONE_P(g2)) {
+            nr = Scm_Quotient(nr, g2, NULL);
+            dy = Scm_Quotient(dy, g2, NULL);
+        }
+        dr = Scm_Mul(fx, dy);
+    }
+    return make_reduced_rational(nr, dr);
 }
 
+/* x, y must be exact numbers.  We cancel common factors crosswise before
+   multiplication, so that the product is in lowest terms and we don't
+   need gcd of the (larger) products. */
 ScmObj Scm_RatnumMulDiv(ScmObj x, ScmObj y, int divide)
 {
     ScmObj nx = SCM_RATNUMP(x)? SCM_RATNUM_NUMER(x) : x;
@@ -749,9 +759,29 @@ ScmObj Scm_RatnumMulDiv(ScmObj x, ScmObj y, int divide)
 
     if (divide) {
         ScmObj t = ny; ny = dy; dy = t;
+        if (SCM_EXACT_ZERO_P(dy)) {
+            Scm_Error("attempt to calculate a division by zero");
+        }
+        if (Scm_Sign(dy) < 0) {
+            ny = Scm_Negate(ny);
+            dy = Scm_Negate(dy);
+        }
+    }
+    if (!SCM_EXACT_ONE_P(dy)) {
+        ScmObj g = Scm_Gcd(nx, dy);
+        if (!SCM_EXACT_ONE_P(g)) {
+            nx = Scm_Quotient(nx, g, NULL);
+            dy = Scm_Quotient(dy, g, NULL);
+        }
     }
-    return Scm_MakeRational(Scm_Mul(nx, ny),
-                            Scm_Mul(dx, dy));
+    if (!SCM_EXACT_ONE_P(dx)) {
+        ScmObj g = Scm_Gcd(ny, dx);
+        if (!SCM_EXACT_ONE_P(g)) {
+            ny = Scm_Quotient(ny, g, NULL);
+            dx = Scm_Quotient(dx, g, NULL);
+        }
+    }
+    return make_reduced_rational(Scm_Mul(nx, ny), Scm_Mul(dx, dy));
 }
 
 #define Scm_RatnumAdd(x, y)  Scm_RatnumAddSub(x, y, FALSE)
@@ -2143,6 +2173,7 @@ scm_div(ScmObj arg0, ScmObj arg1, int inexact, int compat, int vmp)
             goto ratnum_return;
         }
         if (SCM_RATNUMP(arg1)) {
+            if (!compat && !inexact) return Scm_RatnumDiv(arg0, arg1);
             arg0 = Scm_Mul(arg0, SCM_RATNUM_DENOM(arg1));
             arg1 = SCM_RATNUM_NUMER(arg1);
             goto ratnum_return;
@@ -2169,6 +2200,7 @@ scm_div(ScmObj arg0, ScmObj arg1, int inexact, int compat, int vmp)
             goto ratnum_return;
         }
         if (SCM_RATNUMP(arg1)) {
+            if (!compat && !inexact) return Scm_RatnumDiv(arg0, arg1);
             arg0 = Scm_Mul(arg0, SCM_RATNUM_DENOM(arg1));
             arg1 = SCM_RATNUM_NUMER(arg1);
             goto ratnum_return;
@@ -2189,11 +2221,13 @@ scm_div(ScmObj arg0, ScmObj arg1, int inexact, int compat, int vmp)
                 else goto div_by_zero;
             }
             if (SCM_EXACT_ONE_P(arg1)) SIMPLE_RETURN(arg0);
+            if (!compat && !inexact) return Scm_RatnumDiv(arg0, arg1);
             arg1 = Scm_Mul(SCM_RATNUM_DENOM(arg0), arg1);
             arg0 = SCM_RATNUM_NUMER(arg0);
             goto ratnum_return;
         }
         if (SCM_BIGNUMP(arg1)) {
+            if (!compat && !inexact) return Scm_RatnumDiv(arg0, arg1);
             arg1 = Scm_Mul(SCM_RATNUM_DENOM(arg0), arg1);
             arg0 = SCM_RATNUM_NUMER(arg0);
             goto ratnum_return;
@@ -2576,15 +2610,19 @@ ScmObj Scm_Modulo(ScmObj x, ScmObj y, int remp)
  * Gcd
  */
 
-/* assumes x > y >= 0 */
+/* Binary gcd (Stein's algorithm).  Shifts and subtractions are much
+   faster than division.  Assumes x > y >= 0. */
 static u_long gcd_fixfix(u_long x, u_long y)
 {
-    while (y > 0) {
-        u_long r = x % y;
-        x = y;
-        y = r;
-    }
-    return x;
+    if (y == 0) return x;
+    int k = Scm__LowestBitNumber(x|y);
+    x >>= Scm__LowestBitNumber(x);
+    do {
+        y >>= Scm__LowestBitNumber(y);
+        if (x > y) { u_long t = x; x = y; y = t; }
+        y -= x;
+    } while (y != 0);
+    return x << k;
 }
 
 static double gcd_floflo(double x, double y)
@@ -2656,19 +2694,9 @@ ScmObj Scm_Gcd(ScmObj x, ScmObj y)
         return Scm_MakeIntegerU(ur);
     }
 
-    /* Now we need to treat both args as bignums.  We could use
-       Algorithm L in Knuth's TAOCP 4.5.2, but we assume this path
-       is rarely executed, so we don't bother for now. */
-    x = Scm_Abs(x);
-    y = Scm_Abs(y);
-    if (Scm_NumCmp(x, y) < 0) {ScmObj t = x; x = y; y = t;}
-
-    while (!SCM_EXACT_ZERO_P(y)) {
-        ScmObj r = Scm_Modulo(x, y, TRUE);
-        x = y;
-        y = r;
-    }
-    return x;
+    /* Now both args are bignums. */
+    SCM_ASSERT(SCM_BIGNUMP(x) && SCM_BIGNUMP(y));
+    return Scm_BignumGcd(SCM_BIGNUM(x), SCM_BIGNUM(y));
 }
 
 /*===============================================================
@@ -3300,7 +3328,7 @@ static double dexpt2_minus_53  = 0.0;  /* 2.0^-53 */
 
 /* max N where 10.0^N can be representable exactly in double.
    it is max N where N * log2(5) < 53. */
-#define MAX_EXACT_10_EXP  23
+#define MAX_EXACT_10_EXP  22
 
 /* fast 10^n for limited cases */
 static inline ScmObj iexpt10(int e)
@@ -3331,7 +3359,7 @@ static inline u_long ipow(int r, int n)
 
 /* X * 10.0^N by double.
    10.0^N can be represented _exactly_ in double-precision floating point
-   number in the range 0 <= N <= 23.
+   number in the range 0 <= N <= 22.
    If N is out of this range, a rounding error occurs, which will be
    corrected in the algorithmR routine below. */
 static double raise_pow10(double x, int n)
@@ -3381,6 +3409,187 @@ static inline int numcmp3(ScmObj x, ScmObj d, ScmObj y)
     }
 }
 
+/* Fast path of print_double.
+
+   When the quantities r, s, m+ and m- of Burger&Dybvig algorithm fit in
+   a 128bit integer, which is the case for most doubles of moderate
+   magnitudes (roughly from 1e-17 to 1e20), we run the same algorithm
+   with native 128bit arithmetic instead of bignums.  It is a
+   step-by-step transliteration of the bignum version below, so the
+   output is identical.  Returns FALSE without touching BUF if the
+   values don't fit; the caller should use the bignum version then.
+   VAL must be positive and finite. */
+#if defined(__SIZEOF_INT128__) && !defined(DOUBLE_ARMENDIAN)
+#define PRINT_DOUBLE_U128 1
+typedef unsigned __int128 pd_u128;
+
+/* Every initial value is kept below 2^122.  During the digit generation
+   r < s, m- < 10s and m+ < 20s holds, so r+m+ never overflows. */
+#define PD_U128_LIMIT  (((pd_u128)1)<<122)
+
+static inline int pd_mul(pd_u128 *x, pd_u128 y)
+{
+    if (y != 0 && *x > PD_U128_LIMIT / y) return FALSE;
+    *x *= y;
+    return (*x < PD_U128_LIMIT);
+}
+
+static inline int pd_pow10(pd_u128 *x, int n)
+{
+    for (; n > 0; n--) {
+        if (!pd_mul(x, 10)) return FALSE;
+    }
+    return TRUE;
+}
+
+static int print_double_u128(char *buf, int buflen, double val,
+                             int precision, int exp_lo, int exp_hi)
+{
+    pd_u128 r, s, mm, f;
+    u_long mant1, mant0;
+    int exp, exp0, sign0;
+    int mp2 = FALSE, fixup = FALSE;
+    int fracdigs = 0;
+
+    decode_double(val, &mant1, &mant0, &exp0, &sign0);
+    exp = (exp0? exp0 - 0x3ff - 52 : -0x3fe - 52);
+#if SIZEOF_LONG >= 8
+    f = mant0;
+#else
+    f = ((pd_u128)mant1 << 32) | mant0;
+#endif
+    if (exp0 > 0) f += ((pd_u128)1) << 52;
+    int round = !(f & 1);
+
+    /* initialize r, s, m+ and m- */
+    if (exp >= 0) {
+        if (exp + 2 + 53 >= 122) return FALSE;
+        if (f != ((pd_u128)1)<<52) {
+            r = f << (exp+1);
+            s = 2;
+            mp2 = FALSE;
+        } else {
+            r = f << (exp+2);
+            s = 4;
+            mp2 = TRUE;
+        }
+        mm = ((pd_u128)1) << exp;
+    } else {
+        if (-exp + 2 >= 122) return FALSE;
+        if (exp == -1023 || f != ((pd_u128)1)<<52) {
+            r = f << 1;
+            s = ((pd_u128)1) << (-exp+1);
+            mp2 = FALSE;
+        } else {
+            r = f << 2;
+            s = ((pd_u128)1) << (-exp+2);
+            mp2 = TRUE;
+        }
+        mm = 1;
+    }
+
+    /* estimate scale */
+    int est = (int)ceil(log10(val) - 0.1);
+    if (est >= 0) {
+        if (!pd_pow10(&s, est)) return FALSE;
+    } else {
+        if (!pd_pow10(&r, -est) || !pd_pow10(&mm, -est)) return FALSE;
+    }
+
+    /* fixup */
+    if (r >= s) {
+        fixup = TRUE;
+    } else {
+        pd_u128 mp = (mp2? mm << 1 : mm);
+        if (round) fixup = (r + mp >= s);
+        else       fixup = (r + mp > s);
+    }
+    if (fixup) {
+        if (!pd_mul(&s, 10)) return FALSE;
+        est++;
+    }
+    if (r >= PD_U128_LIMIT || mm >= PD_U128_LIMIT) return FALSE;
+
+    /* From here, we do exactly the same thing as print_double. */
+    int point;
+    if (est < exp_hi && est > exp_lo) { point = est; est = 1; }
+    else { point = 1; }
+
+    if (point <= 0) {
+        *buf++ = '0'; buflen--;
+        *buf++ = '.', buflen--;
+        for (int digs=point;digs<0 && buflen>5;digs++) {
+            *buf++ = '0'; buflen--; fracdigs++;
+        }
+    }
+
+    int digs;
+    for (digs=1;buflen>5;digs++, fracdigs++) {
+        pd_u128 r10 = r * 10;
+        int q = (int)(r10 / s);
+        pd_u128 mp;
+        r = r10 - s * q;
+
+        if (fracdigs == precision) {
+            mm = mp = s >> 1;
+        } else {
+            mm = mm * 10;
+            mp = (mp2? mm << 1 : mm);
+        }
+
+        int tc1, tc2;
+        if (round) {
+            tc1 = (r <= mm);
+            tc2 = (r + mp >= s);
+        } else {
+            tc1 = (r < mm);
+            tc2 = (r + mp > s);
+        }
+        if (!tc1) {
+            if (!tc2) {
+                *buf++ = (char)q + '0';
+                if (digs == point) *buf++ = '.', buflen--;
+                continue;
+            } else {
+                *buf++ = (char)q + '1';
+                break;
+            }
+        } else {
+            if (!tc2) {
+                *buf++ = (char)q + '0';
+                break;
+            } else {
+                /* r*2 <=> s */
+                if ((round && r + r <= s) || (!round && r + r < s)) {
+                    *buf++ = (char)q + '0';
+                    break;
+                } else {
+                    *buf++ = (char)q + '1';
+                    break;
+                }
+            }
+        }
+    }
+
+    if (digs <= point) {
+        for (;digs<point&&buflen>5;digs++) {
+            *buf++ = '0', buflen--;
+        }
+        *buf++ = '.';
+        *buf++ = '0';
+    }
+
+    est--;
+    if (est != 0) {
+        *buf++ = 'e';
+        sprintf(buf, "%d", (int)est);
+    } else {
+        *buf++ = 0;
+    }
+    return TRUE;
+}
+#endif /*__SIZEOF_INT128__ && !DOUBLE_ARMENDIAN*/
+
 /* The main routine to get string representation of double.
    Convert VAL to a string and store to BUF, which must have at least FLT_BUF
    bytes long.
@@ -3415,6 +3624,12 @@ static void print_double(char *buf, int buflen, double val, int plus_sign,
 
     if (val < 0.0) *buf++ = '-', buflen--;
     else if (plus_sign) *buf++ = '+', buflen--;
+#if PRINT_DOUBLE_U128
+    if (print_double_u128(buf, buflen, (val < 0.0)? -val : val,
+                          precision, exp_lo, exp_hi)) {
+        return;
+    }
+#endif
     {
         /* variable names follows Burger&Dybvig paper. mp, mm for m+, m-.
            note that m+ == m- for most cases, and m+ == 2*m- for the rest.
@@ -3627,6 +3842,32 @@ print_number(ScmPort *port, ScmObj obj, u_long flags, ScmNumberFormat *fmt)
             value = -value;     /* this won't overflow */
         }
         int i;
+        if (radix == 10) {
+            /* The most common case.  Division by a constant is cheap,
+               and we emit two digits at a time. */
+            static const char digit_pairs[] =
+            "0001020304050607080910111213141516171819"
+            "2021222324252627282930313233343536373839"
+            "4041424344454647484950515253545556575859"
+            "6061626364656667686970717273747576777879"
+            "8081828384858687888990919293949596979899";
+            u_long v = (u_long)value;
+            i = FLT_BUF;
+            while (v >= 100) {
+                int k = (int)(v % 100) * 2;
+                v /= 100;
+                buf[--i] = digit_pairs[k+1];
+                buf[--i] = digit_pairs[k];
+            }
+            if (v >= 10) {
+                buf[--i] = digit_pairs[v*2+1];
+                buf[--i] = digit_pairs[v*2];
+            } else {
+                buf[--i] = (char)v + '0';
+            }
+            Scm_Putz(buf+i, FLT_BUF-i, port);
+            return nchars + FLT_BUF - i;
+        }
         for (i = FLT_BUF-1; i >= 0 && value > 0; i--) {
             int c = value % radix;
             buf[i] = (c<10)?(c+'0'):(use_upper?(c-10+'A'):(c-10+'a'));
@@ -3683,13 +3924,13 @@ ScmObj Scm_NumberToString(ScmObj obj, int radix, u_long flags)
 {
     if (radix < 2 || radix > SCM_RADIX_MAX)
         Scm_Error("radix out of range: %d", radix);
-    ScmPort *p = SCM_PORT(Scm_MakeOutputStringPort(TRUE));
+    ScmPort *p = Scm__AcquireOutputStringPort();
     ScmNumberFormat fmt;
     Scm_NumberFormatInit(&fmt);
     fmt.flags = flags;
     fmt.radix = radix;
     Scm_PrintNumber(p, obj, &fmt);
-    return Scm_GetOutputString(p, 0);
+    return Scm__ReleaseOutputStringPort(p, 0);
 }
 
 /* API.  FMT can be NULL. */
@@ -3786,6 +4027,10 @@ static u_long bigdig[RADIX_MAX-RADIX_MIN+1] = { 0 };
 
 static ScmObj numread_error(const char *msg, struct numread_packet *context);
 
+/* Numbers longer than this many characters are read by
+   Scm_DigitsToInteger. */
+#define READ_UINT_BUFFER_DIGITS 500
+
 /* Returns either small integer or bignum.
    initval may be a Scheme integer that will be 'concatenated' before
    the integer to be read; it is used to read floating-point number.
@@ -3802,6 +4047,8 @@ static ScmObj read_uint(const char **strp, int *lenp,
     u_long limit = longlimit[radix-RADIX_MIN], bdig = bigdig[radix-RADIX_MIN];
     u_long value_int = 0;
     ScmBignum *value_big = NULL;
+    unsigned char *digbuf = NULL; /* digit values, if len is large */
+    long ndig = 0;
     static const char tab[] = "0123456789abcdefghijklmnopqrstuvwxyz";
 
     if (!SCM_FALSEP(initval)) {
@@ -3821,6 +4068,13 @@ static ScmObj read_uint(const char **strp, int *lenp,
         digread = TRUE;
     }
 
+    /* For a long sequence of digits, we collect them first and convert
+       at once, which is subquadratic.  LEN is an upper bound of
+       the number of digits. */
+    if (len > READ_UINT_BUFFER_DIGITS) {
+        digbuf = SCM_NEW_ATOMIC2(unsigned char*, len);
+    }
+
     while (len--) {
         int digval = -1;
         char c = tolower(*str++);
@@ -3838,8 +4092,13 @@ static ScmObj read_uint(const char **strp, int *lenp,
             if (ctx->exactness == NOEXACT) {
                 ctx->exactness = INEXACT;
             }
+        } else if (c >= '0' && c <= '9') {
+            if (c - '0' < radix) {
+                digval = c - '0';
+                digread = TRUE;
+            }
         } else {
-            for (const char *ptab = tab; ptab < tab+radix; ptab++) {
+            for (const char *ptab = tab+10; ptab < tab+radix; ptab++) {
                 if (c == *ptab) {
                     digval = (int)(ptab-tab);
                     digread = TRUE;
@@ -3848,6 +4107,10 @@ static ScmObj read_uint(const char **strp, int *lenp,
             }
         }
         if (digval < 0) break;
+        if (digbuf) {
+            digbuf[ndig++] = (unsigned char)digval;
+            continue;
+        }
         value_int = value_int * radix + digval;
         digits++;
         if (value_big == NULL) {
@@ -3863,6 +4126,14 @@ static ScmObj read_uint(const char **strp, int *lenp,
     *strp = str-1;
     *lenp = len+1;
 
+    if (digbuf) {
+        ScmObj v = Scm_DigitsToInteger(digbuf, ndig, radix);
+        if (SCM_FALSEP(initval)) return v;
+        return Scm_Add(Scm_Mul(initval,
+                               Scm_ExactIntegerExpt(SCM_MAKE_INT(radix),
+                                                    Scm_MakeInteger(ndig))),
+                       v);
+    }
     if (value_big == NULL) return Scm_MakeInteger(value_int);
     if (digits > 0) {
         value_big = Scm_BignumAccMultAddUI(value_big,
@@ -3985,6 +4256,152 @@ static double algorithmR(ScmObj f, int e, double z)
     /*NOTREACHED*/
 }
 
+/*
+ * Fast path to find a double nearest to W * 10^Q, where W is a 64-bit
+ * unsigned integer, by the Eisel-Lemire algorithm (Daniel Lemire,
+ * "Number Parsing at a Gigabyte per Second", Software: Practice and
+ * Experience 51(8), 2021).  We multiply normalized W by the 128-bit
+ * approximation of 5^Q in pow5_128, and the upper bits of the product
+ * give the mantissa; the power of 2 is computed from Q directly.
+ *
+ * Returns FALSE if the truncation error of the table may affect the
+ * rounding; the caller must fall back to algorithmR.  It rarely happens.
+ */
+#include "number_pow5.c"
+
+/* 64x64 -> 128 bit multiplication */
+static inline void umul128(uint64_t a, uint64_t b, uint64_t *hi, uint64_t *lo)
+{
+#if defined(__SIZEOF_INT128__)
+    unsigned __int128 r = (unsigned __int128)a * b;
+    *hi = (uint64_t)(r >> 64);
+    *lo = (uint64_t)r;
+#else
+    uint64_t a0 = a & 0xffffffffUL, a1 = a >> 32;
+    uint64_t b0 = b & 0xffffffffUL, b1 = b >> 32;
+    uint64_t p00 = a0*b0, p01 = a0*b1, p10 = a1*b0, p11 = a1*b1;
+    uint64_t mid = (p00 >> 32) + (p01 & 0xffffffffUL) + (p10 & 0xffffffffUL);
+    *lo = (mid << 32) | (p00 & 0xffffffffUL);
+    *hi = p11 + (p01 >> 32) + (p10 >> 32) + (mid >> 32);
+#endif
+}
+
+static inline int clz64(uint64_t x) /* x must not be 0 */
+{
+#if defined(__GNUC__)
+    return __builtin_clzll(x);
+#else
+    int n = 0;
+    for (; !(x & ((uint64_t)1 << 63)); x <<= 1) n++;
+    return n;
+#endif
+}
+
+static inline double encode_double64(uint64_t mant, int exp, int signbit)
+{
+#if SIZEOF_LONG >= 8
+    return Scm__EncodeDouble(0, (u_long)mant, exp, signbit);
+#else
+    return Scm__EncodeDouble((u_long)(mant & 0xffffffffUL),
+                             (u_long)(mant >> 32), exp, signbit);
+#endif
+}
+
+static int eisel_lemire(uint64_t w, int q, int minusp, double *result)
+{
+    if (w == 0 || q < POW5_128_MIN_EXP) {
+        /* w * 10^q < 2^64 * 10^-343 is less than half of the smallest
+           denormal. */
+        *result = minusp? -0.0 : 0.0;
+        return TRUE;
+    }
+    if (q > POW5_128_MAX_EXP) {
+        *result = minusp? SCM_DBL_NEGATIVE_INFINITY : SCM_DBL_POSITIVE_INFINITY;
+        return TRUE;
+    }
+
+    int lz = clz64(w);
+    w <<= lz;
+    const uint64_t *p5 = pow5_128[q - POW5_128_MIN_EXP];
+    uint64_t hi, lo;
+    umul128(w, p5[0], &hi, &lo);
+    /* We need the upper 55 bits (52 bits of mantissa, the hidden bit,
+       the rounding bit, and one more since the product may be less than
+       2^127).  If the bits below them are all 1, the lower half of
+       the table entry may carry into them; take it into account. */
+    if ((hi & 0x1ff) == 0x1ff) {
+        uint64_t hi2, lo2;
+        umul128(w, p5[1], &hi2, &lo2);
+        lo += hi2;
+        if (hi2 > lo) hi++;
+    }
+    /* The table entry is exact for 0 <= q <= 55, and the reciprocal has
+       enough precision for -27 <= q < 0.  Otherwise, we can't be sure
+       the carry from the truncated part. */
+    if (lo == UINT64_MAX && (q < -27 || q > 55)) return FALSE;
+
+    int upperbit = (int)(hi >> 63);
+    uint64_t mant = hi >> (upperbit + 9);
+    /* (217706 * q) >> 16 is floor(q * log2(10)) for |q| < 1500 */
+    int power2 = ((217706 * q) >> 16) + 63 + upperbit - lz + 1023;
+
+    if (power2 <= 0) {
+        /* denormalized range.  Rounding to even doesn't matter here,
+           for it only happens when |q| is small. */
+        if (-power2 + 1 >= 64) {
+            *result = minusp? -0.0 : 0.0;
+            return TRUE;
+        }
+        mant >>= -power2 + 1;
+        mant += (mant & 1);
+        mant >>= 1;
+        /* rounding up may carry into the normalized range */
+        power2 = (mant < ((uint64_t)1 << 52))? 0 : 1;
+        *result = encode_double64(mant & ~((uint64_t)1 << 52), power2, minusp);
+        return TRUE;
+    }
+
+    /* If we're exactly in the middle of two doubles, round to even.
+       It can only happen when 5^q fits in the product, i.e. -4 <= q <= 23. */
+    if (lo <= 1 && q >= -4 && q <= 23 && (mant & 3) == 1
+        && (mant << (upperbit + 9)) == hi) {
+        mant &= ~(uint64_t)1;
+    }
+    mant += (mant & 1);
+    mant >>= 1;
+    if (mant >= ((uint64_t)2 << 52)) {
+        mant = (uint64_t)1 << 52;
+        power2++;
+    }
+    if (power2 >= 0x7ff) {
+        *result = minusp? SCM_DBL_NEGATIVE_INFINITY : SCM_DBL_POSITIVE_INFINITY;
+        return TRUE;
+    }
+    *result = encode_double64(mant & ~((uint64_t)1 << 52), power2, minusp);
+    return TRUE;
+}
+
+/* If an exact nonnegative integer F fits in 64 bits, set it to *W and
+   returns TRUE. */
+static int integer_to_u64(ScmObj f, uint64_t *w)
+{
+    if (SCM_INTP(f)) {
+        *w = (uint64_t)SCM_INT_VALUE(f);
+        return TRUE;
+    }
+    if (SCM_BIGNUMP(f) && SCM_BIGNUM_SIGN(f) > 0
+        && SCM_BIGNUM_SIZE(f) <= 64/SCM_WORD_BITS) {
+        uint64_t r = 0;
+        for (int i = (int)SCM_BIGNUM_SIZE(f) - 1; i >= 0; i--) {
+            /* two shifts to avoid shifting by 64 */
+            r = ((r << (SCM_WORD_BITS-1)) << 1) | SCM_BIGNUM(f)->values[i];
+        }
+        *w = r;
+        return TRUE;
+    }
+    return FALSE;
+}
+
 static ScmObj read_real(const char **strp, int *lenp,
                         struct numread_packet *ctx)
 {
@@ -4136,12 +4553,29 @@ static ScmObj read_real(const char **strp, int *lenp,
         if (minusp) return Scm_Negate(e);
         else        return e;
     } 
+
+    /* Common case: the digits fit in 64 bits. */
+    int raise_factor = exponent - fracdigs;
+    uint64_t w;
+    if (integer_to_u64(fraction, &w)) {
+        double d;
+        if (w <= ((uint64_t)1 << 53)
+            && raise_factor >= -MAX_EXACT_10_EXP
+            && raise_factor <= MAX_EXACT_10_EXP) {
+            /* Both w and 10^|raise_factor| are exact, so a single
+               operation gives the correctly rounded result. */
+            d = raise_pow10((double)w, raise_factor);
+            return Scm_MakeFlonum(minusp? -d : d);
+        }
+        if (eisel_lemire(w, raise_factor, minusp, &d)) {
+            return Scm_MakeFlonum(d);
+        }
+    }
       
     /* Get double approximaiton of fraction.  If fraction >= 2^53 we'll
        only get approximation, but the error will be corrected in
        AlgorithmR.  We have to be careful, however, not to overflow
        the following GetDouble call. */
-    int raise_factor = exponent - fracdigs;
     double realnum = Scm_GetDouble(fraction);
 
     if (SCM_IS_INF(realnum)) {
@@ -4261,6 +4695,21 @@ static ScmObj read_number(const char *str, int len, int radix,
     }
     if (len <= 0) return SCM_FALSE;
 
+    /* Fast path: a decimal integer short enough to fit in a long, which
+       is what we read most of the time. */
+    if (ctx.radix == 10 && ctx.exactness != INEXACT) {
+        const char *p = str;
+        int n = len, neg = FALSE;
+        if (*p == '+' || *p == '-') { neg = (*p == '-'); p++; n--; }
+        if (n > 0 && n <= longdigs[10-RADIX_MIN]) {
+            long v = 0;
+            for (; n > 0 && *p >= '0' && *p <= '9'; p++, n--) {
+                v = v*10 + (*p - '0');
+            }
+            if (n == 0) return Scm_MakeInteger(neg? -v : v);
+        }
+    }
+
     /* number body.  need to check the special case of pure imaginary,
        and also eliminates some confusing cases. */
     if (*str == '+' || *str == '-') {
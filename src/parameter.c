@@ -54,6 +54,12 @@
  * thread.  Since thread creation in Gauche is already heavy anyway,
  * I take Guile's approach.
  *
+ * However, we delay the copy.  A new thread shares its creator's vector,
+ * and both tables are marked 'shared'.  Whoever modifies a shared table
+ * first copies the vector and owns the copy; the shared vector itself
+ * is never modified again, so reading it needs no lock.  Threads that
+ * only read parameters don't copy at all.
+ *
  * TODO: We now need to allocate a parameter slot to every thread (although
  * allocation is done lazily).  We may be able to use a tree instead of
  * a flat vector so that we can avoid allocation of leaf nodes until
@@ -78,38 +84,42 @@ void Scm__VMParameterTableInit(ScmVMParameterTable *table,
 {
     if (base) {
         /* NB: In this case, the caller is the owner thread of BASE,
-           so we don't need to worry about base->parameters being
-           modified during copying. */
-        table->vector = SCM_NEW_ARRAY(ScmObj, base->parameters.size);
+           so we can safely mark base->parameters shared. */
+        table->vector = base->parameters.vector;
         table->size = base->parameters.size;
-        for (int i=0; i<table->size; i++) {
-            table->vector[i] = base->parameters.vector[i];
-        }
+        table->shared = base->parameters.shared = TRUE;
     } else {
         table->vector = SCM_NEW_ARRAY(ScmObj, PARAMETER_INIT_SIZE);
         table->size = PARAMETER_INIT_SIZE;
+        table->shared = FALSE;
         for (int i=0; i<table->size; i++) {
             table->vector[i] = SCM_UNBOUND;
         }
     }
 }
 
+/* Make P writable and large enough to have INDEX.  Must be called by
+   the owner thread of P. */
 static void ensure_parameter_slot(ScmVMParameterTable *p, int index)
 {
-    if (index >= p->size) {
-        int newsiz = ((index+PARAMETER_GROW)/PARAMETER_GROW)*PARAMETER_GROW;
+    if (index >= p->size || p->shared) {
+        int newsiz = p->size;
+        if (index >= newsiz) {
+            newsiz = ((index+PARAMETER_GROW)/PARAMETER_GROW)*PARAMETER_GROW;
+        }
         ScmObj *newvec = SCM_NEW_ARRAY(ScmObj, newsiz);
 
         int i;
         for (i=0; i < p->size; i++) {
             newvec[i] = p->vector[i];
-            p->vector[i] = SCM_FALSE; /*be friendly to GC*/
+            if (!p->shared) p->vector[i] = SCM_FALSE; /*be friendly to GC*/
         }
         for (; i < newsiz; i++) {
             newvec[i] = SCM_UNBOUND;
         }
         p->vector = newvec;
         p->size = newsiz;
+        p->shared = FALSE;
     }
 }
 
@@ -122,7 +132,9 @@ void Scm_InitParameterLoc(ScmVM *vm, ScmParameterLoc *location, ScmObj initval)
     int index = next_parameter_index++;
     SCM_INTERNAL_MUTEX_UNLOCK(parameter_mutex);
 
-    ensure_parameter_slot(&(vm->parameters), index);
+    if (index >= vm->parameters.size) {
+        ensure_parameter_slot(&(vm->parameters), index);
+    }
     location->index = index;
     location->initialValue = initval;
 }
@@ -145,7 +157,8 @@ ScmObj Scm_ParameterRef(ScmVM *vm, const ScmParameterLoc *loc)
     if (loc->index >= p->size) return loc->initialValue;
     ScmObj v = p->vector[loc->index];
     if (SCM_UNBOUNDP(v)) {
-        v = p->vector[loc->index] = loc->initialValue;
+        v = loc->initialValue;
+        if (!p->shared) p->vector[loc->index] = v;
     }
     return v;
 }
@@ -155,14 +168,10 @@ ScmObj Scm_ParameterSet(ScmVM *vm, const ScmParameterLoc *loc, ScmObj value)
     ScmObj oldval;
     ScmVMParameterTable *p = &(vm->parameters);
 
-    if (loc->index >= p->size) {
-        ensure_parameter_slot(p, loc->index);
+    ensure_parameter_slot(p, loc->index);
+    oldval = p->vector[loc->index];
+    if (SCM_UNBOUNDP(oldval)) {
         oldval = loc->initialValue;
-    } else {
-        oldval = p->vector[loc->index];
-        if (SCM_UNBOUNDP(oldval)) {
-            oldval = loc->initialValue;
-        }
     }
     p->vector[loc->index] = value;
     return oldval;
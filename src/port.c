@@ -41,6 +41,18 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <ctype.h>
+#if defined(HAVE_SYS_UIO_H) && defined(HAVE_WRITEV)
+#include <sys/uio.h>
+#include <limits.h>
+#define USE_WRITEV 1
+#ifndef IOV_MAX
+#define IOV_MAX 16              /* minimum guaranteed by POSIX */
+#endif
+#endif
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP)
+#include <sys/mman.h>
+#define USE_MMAP 1
+#endif
 
 #undef MAX
 #undef MIN
@@ -56,6 +68,9 @@
    ports inherit. */
 static ScmParameterLoc readerLexicalMode;
 
+/* Attribute key that holds the mapped region of a mapped input port. */
+static ScmObj sym_mapped_region = SCM_FALSE;
+
 /*================================================================
  * Class stuff
  */
@@ -64,8 +79,14 @@ static void port_print(ScmObj obj, ScmPort *port, ScmWriteContext *ctx);
 static void port_finalize(ScmObj obj, void* data);
 static void register_buffered_port(ScmPort *port);
 static void unregister_buffered_port(ScmPort *port);
+static void pool_put_buffer(char *buf);
+static void set_fd_nonblocking(ScmPort *port, int fd, int flag);
 static void bufport_flush(ScmPort*, int, int);
 static void file_closer(ScmPort *p);
+static int  file_flusher(ScmPort *p, int cnt, int forcep);
+#ifdef USE_WRITEV
+static void file_writev(ScmPort *p, struct iovec *iov, int iovcnt);
+#endif
 
 static ScmObj get_port_name(ScmPort *port)
 {
@@ -90,6 +111,12 @@ static void set_port_buffering(ScmPort *port, ScmObj val)
     Scm_SetPortBufferingMode(port,Scm_BufferingMode(val,port->direction,-1));
 }
 
+static ScmObj get_port_buffer_size(ScmPort *port)
+{
+    if (SCM_PORT_TYPE(port) != SCM_PORT_FILE) return SCM_FALSE;
+    return SCM_MAKE_INT(port->src.buf.size);
+}
+
 static ScmObj get_port_sigpipe_sensitive(ScmPort *port)
 {
     return SCM_MAKE_BOOL(Scm_GetPortBufferSigpipeSensitive(port));
@@ -104,6 +131,7 @@ static ScmClassStaticSlotSpec port_slots[] = {
     SCM_CLASS_SLOT_SPEC("name", get_port_name, NULL),
     SCM_CLASS_SLOT_SPEC("buffering", get_port_buffering,
                         set_port_buffering),
+    SCM_CLASS_SLOT_SPEC("buffer-size", get_port_buffer_size, NULL),
     SCM_CLASS_SLOT_SPEC("sigpipe-sensitive?", get_port_sigpipe_sensitive,
                         set_port_sigpipe_sensitive),
     SCM_CLASS_SLOT_SPEC("current-line", get_port_current_line, NULL),
@@ -128,6 +156,136 @@ SCM_DEFINE_BASE_CLASS(Scm_LimitedLengthPortClass,
                       ScmPort, /* instance type */
                       port_print, NULL, NULL, NULL, port_cpl);
 
+/*================================================================
+ * I/O statistics
+ */
+
+static int port_stat_enabled = FALSE;
+
+static struct {
+    ScmPortStat *head;
+    ScmInternalMutex mutex;     /* protects head */
+} port_stats = { NULL, SCM_INTERNAL_MUTEX_INITIALIZER };
+
+/* Returns the statistics record of P, allocating it if necessary,
+   or NULL if the statistics is disabled.  The record is only updated
+   by the thread that has P locked. */
+#define PORT_STAT(p)  (port_stat_enabled? port_stat_get(p) : NULL)
+
+static ScmPortStat *port_stat_get(ScmPort *p)
+{
+    ScmPortStat *st = p->ioStat;
+    if (st == NULL) {
+        st = SCM_NEW(ScmPortStat);
+        memset(st, 0, sizeof(ScmPortStat));
+        st->port = Scm_MakeWeakBox(p);
+        (void)SCM_INTERNAL_MUTEX_LOCK(port_stats.mutex);
+        st->next = port_stats.head;
+        port_stats.head = st;
+        (void)SCM_INTERNAL_MUTEX_UNLOCK(port_stats.mutex);
+        p->ioStat = st;
+    }
+    return st;
+}
+
+static double port_stat_now(void)
+{
+    u_long sec, nsec;
+    if (!Scm_ClockGetTimeMonotonic(&sec, &nsec)) {
+        u_long usec;
+        Scm_GetTimeOfDay(&sec, &usec);
+        nsec = usec * 1000;
+    }
+    return (double)sec + (double)nsec/1.0e9;
+}
+
+/* Issues a syscall, counting it in ST unless it's NULL. */
+#define PORT_STAT_SYSCALL(st, result, expr)                     \
+    do {                                                        \
+        if (st) {                                               \
+            double t0__ = port_stat_now();                      \
+            SCM_SYSCALL(result, expr);                          \
+            (st)->syscalls++;                                   \
+            (st)->blockTime += port_stat_now() - t0__;          \
+        } else {                                                \
+            SCM_SYSCALL(result, expr);                          \
+        }                                                       \
+    } while (0)
+
+void Scm_PortStatStart(void)
+{
+    port_stat_enabled = TRUE;
+}
+
+void Scm_PortStatStop(void)
+{
+    port_stat_enabled = FALSE;
+}
+
+int Scm_PortStatRunningP(void)
+{
+    return port_stat_enabled;
+}
+
+/* Clears the counters.  The records are kept, for the ports keep
+   pointers to them. */
+void Scm_PortStatReset(void)
+{
+    (void)SCM_INTERNAL_MUTEX_LOCK(port_stats.mutex);
+    for (ScmPortStat *st = port_stats.head; st; st = st->next) {
+        st->bytesRead = st->bytesWritten = 0;
+        st->fills = st->flushes = st->syscalls = st->modeChanges = 0;
+        st->blockTime = 0.0;
+    }
+    (void)SCM_INTERNAL_MUTEX_UNLOCK(port_stats.mutex);
+}
+
+static ScmObj port_stat_to_list(ScmPort *port, ScmPortStat *st)
+{
+    ScmObj h = SCM_NIL, t = SCM_NIL;
+#define ADD(key, val)                                   \
+    do {                                                \
+        SCM_APPEND1(h, t, SCM_MAKE_KEYWORD(key));       \
+        SCM_APPEND1(h, t, val);                         \
+    } while (0)
+    ADD("bytes-read",    Scm_MakeIntegerU64(st->bytesRead));
+    ADD("bytes-written", Scm_MakeIntegerU64(st->bytesWritten));
+    ADD("fills",         Scm_MakeIntegerU(st->fills));
+    ADD("flushes",       Scm_MakeIntegerU(st->flushes));
+    ADD("syscalls",      Scm_MakeIntegerU(st->syscalls));
+    ADD("block-time",    Scm_MakeFlonum(st->blockTime));
+    ADD("buffering-changes", Scm_MakeIntegerU(st->modeChanges));
+    ADD("buffering",     Scm_GetPortBufferingModeAsKeyword(port));
+#undef ADD
+    return h;
+}
+
+/* Returns the statistics of PORT as a plist, or #f if it doesn't have
+   any. */
+ScmObj Scm_PortStatistics(ScmPort *port)
+{
+    if (port->ioStat == NULL) return SCM_FALSE;
+    return port_stat_to_list(port, port->ioStat);
+}
+
+/* Returns ((port . plist) ...) of the ports still alive. */
+ScmObj Scm_PortStatResult(void)
+{
+    ScmObj h = SCM_NIL, t = SCM_NIL;
+
+    (void)SCM_INTERNAL_MUTEX_LOCK(port_stats.mutex);
+    ScmPortStat *st = port_stats.head;
+    (void)SCM_INTERNAL_MUTEX_UNLOCK(port_stats.mutex);
+    /* Records are only pushed at the head, so we can walk the rest
+       without the lock. */
+    for (; st; st = st->next) {
+        if (Scm_WeakBoxEmptyP(st->port)) continue;
+        ScmPort *p = SCM_PORT(Scm_WeakBoxRef(st->port));
+        SCM_APPEND1(h, t, Scm_Cons(SCM_OBJ(p), port_stat_to_list(p, st)));
+    }
+    return h;
+}
+
 /*================================================================
  * Common
  */
@@ -148,10 +306,31 @@ static void port_cleanup(ScmPort *port)
         if (SCM_PORT_DIR(port) == SCM_PORT_OUTPUT) {
             if (!SCM_PORT_ERROR_OCCURRED_P(port)) {
                 bufport_flush(port, 0, TRUE);
+                if ((port->flags & SCM_PORT_NONBLOCKING)
+                    && SCM_PORT_BUFFER_AVAIL(port) > 0
+                    && Scm_PortFileNo(port) >= 0) {
+                    /* We can't drop the pending output; wait for it. */
+                    set_fd_nonblocking(port, Scm_PortFileNo(port), FALSE);
+                    port->flags &= ~SCM_PORT_NONBLOCKING;
+                    bufport_flush(port, 0, TRUE);
+                }
             }
             unregister_buffered_port(port);
         }
         if (port->ownerp && port->src.buf.closer) port->src.buf.closer(port);
+        if (port->flags & SCM_PORT_LENT_BUFFER) {
+            port->src.buf.buffer = port->ownBuffer;
+            port->src.buf.size = port->ownBufferSize;
+            port->ownBuffer = NULL;
+            port->flags &= ~SCM_PORT_LENT_BUFFER;
+        }
+        if (port->flags & SCM_PORT_POOLED_BUFFER) {
+            pool_put_buffer(port->src.buf.buffer);
+            port->flags &= ~SCM_PORT_POOLED_BUFFER;
+            port->src.buf.buffer = NULL;
+            port->src.buf.current = port->src.buf.end = NULL;
+            port->src.buf.size = 0;
+        }
         break;
     case SCM_PORT_PROC:
         if (port->src.vt.Close) port->src.vt.Close(port);
@@ -195,7 +374,11 @@ static ScmPort *make_port(ScmClass *klass, int dir, int type)
     (void)SCM_INTERNAL_FASTLOCK_INIT(port->lock);
     port->lockOwner = NULL;
     port->lockCount = 0;
+    port->lockStat = NULL;
+    port->ioStat = NULL;
     port->writeState = NULL;
+    port->ownBuffer = NULL;
+    port->ownBufferSize = 0;
     port->attrs = SCM_NIL;
     port->line = 1;
 
@@ -228,6 +411,27 @@ void Scm_ClosePort(ScmPort *port)
  * Locking ports
  */
 
+/* Makes PORT private to the calling thread (see PORT_PRELOCK).  It's
+   the caller's responsibility not to pass the port to other threads;
+   they'll get an error if they try to use it. */
+void Scm_PortConfine(ScmPort *port)
+{
+    ScmVM *vm = Scm_VM();
+    if ((port->flags & SCM_PORT_PRIVATE) && PORT_LOCKED(port, vm)) return;
+    PORT_LOCK(port, vm);        /* never unlocked */
+    port->flags |= SCM_PORT_PRIVATE;
+}
+
+int Scm_PortConfinedP(ScmPort *port)
+{
+    return (port->flags & SCM_PORT_PRIVATE) != 0;
+}
+
+void Scm__PortConfinementError(ScmPort *port)
+{
+    Scm_Error("port %S is confined to another thread", SCM_OBJ(port));
+}
+
 /* OBSOLETED */
 /* C routines can use PORT_SAFE_CALL, so we reimplemented this in libio.scm.
    Kept here for ABI compatibility; will be gone by 1.0.  */
@@ -315,6 +519,253 @@ void Scm_PortFdDup(ScmPort *dst, ScmPort *src)
     dst->src.buf.data = (void*)(intptr_t)r;
 }
 
+/* Non-blocking mode:
+ *   A file port whose fd is in non-blocking mode doesn't raise an error
+ *   when read(2) or write(2) returns EAGAIN.  The filler returns 0 and
+ *   the flusher leaves the unwritten data in the buffer; in both cases
+ *   SCM_PORT_WOULDBLOCK is set, so that the caller can tell it from EOF
+ *   (it is cleared at the next fill or flush).  The output buffer of
+ *   a non-blocking port grows instead of blocking when it's full, so
+ *   writing never blocks; Scm_PortOutputPending tells how much is left.
+ *   A port notices EAGAIN even if the fd is set non-blocking behind
+ *   its back (e.g. by sys-fcntl), and switches to this mode.
+ */
+static int wouldblock_errno(int e)
+{
+#if defined(EWOULDBLOCK) && EWOULDBLOCK != EAGAIN
+    if (e == EWOULDBLOCK) return TRUE;
+#endif
+    return (e == EAGAIN);
+}
+
+static void set_fd_nonblocking(ScmPort *port, int fd, int flag)
+{
+#if defined(F_GETFL) && defined(O_NONBLOCK)
+    int r, fl;
+    SCM_SYSCALL(fl, fcntl(fd, F_GETFL));
+    if (fl < 0) Scm_SysError("fcntl(F_GETFL) failed on %S", port);
+    if (flag) fl |= O_NONBLOCK;
+    else      fl &= ~O_NONBLOCK;
+    SCM_SYSCALL(r, fcntl(fd, F_SETFL, fl));
+    if (r < 0) Scm_SysError("fcntl(F_SETFL) failed on %S", port);
+#else  /*!(F_GETFL && O_NONBLOCK)*/
+    Scm_Error("non-blocking mode is not supported on this platform: %S",
+              port);
+#endif /*!(F_GETFL && O_NONBLOCK)*/
+}
+
+void Scm_SetPortNonblocking(ScmPort *port, int flag)
+{
+    int fd = Scm_PortFileNo(port);
+    if (fd < 0) Scm_Error("file port required, but got %S", port);
+    set_fd_nonblocking(port, fd, flag);
+    if (flag) port->flags |= SCM_PORT_NONBLOCKING;
+    else      port->flags &= ~(SCM_PORT_NONBLOCKING|SCM_PORT_WOULDBLOCK);
+}
+
+int Scm_PortNonblockingP(ScmPort *port)
+{
+    return (port->flags & SCM_PORT_NONBLOCKING) != 0;
+}
+
+int Scm_PortWouldBlockP(ScmPort *port)
+{
+    return SCM_PORT_WOULDBLOCK_P(port) != 0;
+}
+
+/* Returns the number of bytes buffered in the output port but not
+   written out yet. */
+int Scm_PortOutputPending(ScmPort *port)
+{
+    if (SCM_PORT_TYPE(port) != SCM_PORT_FILE
+        || SCM_PORT_DIR(port) != SCM_PORT_OUTPUT) return 0;
+    return SCM_PORT_BUFFER_AVAIL(port);
+}
+
+static const char *chunk_body(ScmObj chunk, u_int *size)
+{
+    if (SCM_STRINGP(chunk)) {
+        return Scm_GetStringContent(SCM_STRING(chunk), size, NULL, NULL);
+    } else if (SCM_UVECTORP(chunk)) {
+        *size = Scm_UVectorSizeInBytes(SCM_UVECTOR(chunk));
+        return (const char*)SCM_UVECTOR_ELEMENTS(chunk);
+    } else {
+        Scm_TypeError("chunk", "string or uniform vector", chunk);
+        *size = 0;              /* dummy */
+        return NULL;
+    }
+}
+
+#ifdef USE_WRITEV
+/* Writes out the pending buffer content followed by CHUNKS with as few
+   writev(2) calls as possible.  Port must be locked. */
+static void file_write_chunks(ScmPort *p, ScmObj chunks)
+{
+    int len = Scm_Length(chunks);
+    int niov = MIN(len + 1, IOV_MAX);
+    struct iovec *iov = SCM_NEW_ARRAY(struct iovec, niov);
+    int i = 0;
+
+    iov[i].iov_base = p->src.buf.buffer;
+    iov[i].iov_len = SCM_PORT_BUFFER_AVAIL(p);
+    if (iov[i].iov_len > 0) i++;
+    ScmObj cp;
+    SCM_FOR_EACH(cp, chunks) {
+        u_int size;
+        const char *body = chunk_body(SCM_CAR(cp), &size);
+        if (size == 0) continue;
+        if (i == niov) {
+            file_writev(p, iov, i);
+            p->src.buf.current = p->src.buf.buffer;
+            i = 0;
+        }
+        iov[i].iov_base = (void*)body;
+        iov[i].iov_len = size;
+        i++;
+    }
+    if (i > 0) file_writev(p, iov, i);
+    p->src.buf.current = p->src.buf.buffer;
+}
+#endif /*USE_WRITEV*/
+
+/* Writes each element of CHUNKS, a list or a vector of strings and
+   uniform vectors, to the port.  On file ports, if the chunks don't fit
+   in the buffer, they are handed to the kernel directly with the
+   buffered data, without being copied into the buffer. */
+void Scm_WriteChunks(ScmObj chunks, ScmPort *p)
+{
+    ScmObj cp;
+    u_long total = 0;
+
+    if (SCM_VECTORP(chunks)) {
+        chunks = Scm_VectorToList(SCM_VECTOR(chunks), 0, -1);
+    } else if (!SCM_LISTP(chunks)) {
+        Scm_TypeError("chunks", "list or vector", chunks);
+    }
+    SCM_FOR_EACH(cp, chunks) {
+        u_int size;
+        (void)chunk_body(SCM_CAR(cp), &size);
+        total += size;
+    }
+
+#ifdef USE_WRITEV
+    if (SCM_PORT_TYPE(p) == SCM_PORT_FILE
+        && p->src.buf.flusher == file_flusher
+        && !(p->flags & SCM_PORT_NONBLOCKING)
+        && total > (u_long)(p->src.buf.end - p->src.buf.current)) {
+        ScmVM *vm = Scm_VM();
+        PORT_LOCK(p, vm);
+        if (SCM_PORT_CLOSED_P(p)) {
+            PORT_UNLOCK(p);
+            Scm_PortError(p, SCM_PORT_ERROR_CLOSED,
+                          "I/O attempted on closed port: %S", p);
+        }
+        PORT_SAFE_CALL(p, file_write_chunks(p, chunks), /*no cleanup*/);
+        PORT_UNLOCK(p);
+        return;
+    }
+#endif /*USE_WRITEV*/
+    SCM_FOR_EACH(cp, chunks) {
+        u_int size;
+        const char *body = chunk_body(SCM_CAR(cp), &size);
+        if (size > 0) Scm_Putz(body, size, p);
+    }
+}
+
+/* Writes TREE to P in the way text.tree's write-tree does.  Strings,
+   characters, symbols and fixnums are written directly into the port
+   buffer, and lists are walked in C.  Other objects are given to
+   FALLBACK, which is called with the object and the port; text.tree
+   passes the generic function write-tree.  The port is locked only
+   once for the whole tree.  */
+static void write_tree_rec(ScmObj tree, ScmPort *p, ScmObj fallback)
+{
+    for (;;) {
+        if (SCM_PAIRP(tree)) {
+            ScmObj car = SCM_CAR(tree);
+            if (SCM_STRINGP(car)) Scm_PutsUnsafe(SCM_STRING(car), p);
+            else write_tree_rec(car, p, fallback);
+            tree = SCM_CDR(tree);
+            continue;
+        }
+        if (SCM_NULLP(tree)) return;
+        if (SCM_STRINGP(tree)) {
+            Scm_PutsUnsafe(SCM_STRING(tree), p);
+        } else if (SCM_CHARP(tree)) {
+            Scm_PutcUnsafe(SCM_CHAR_VALUE(tree), p);
+        } else if (SCM_SYMBOLP(tree) && !SCM_KEYWORDP(tree)) {
+            Scm_PutsUnsafe(SCM_SYMBOL_NAME(tree), p);
+        } else if (SCM_INTP(tree)) {
+            char buf[50];
+            int n = snprintf(buf, sizeof(buf), "%ld", SCM_INT_VALUE(tree));
+            Scm_PutzUnsafe(buf, n, p);
+        } else {
+            Scm_ApplyRec2(fallback, tree, SCM_OBJ(p));
+        }
+        return;
+    }
+}
+
+void Scm_WriteTree(ScmObj tree, ScmPort *p, ScmObj fallback)
+{
+    ScmVM *vm = Scm_VM();
+    PORT_LOCK(p, vm);
+    PORT_SAFE_CALL(p, write_tree_rec(tree, p, fallback), /*no cleanup*/);
+    PORT_UNLOCK(p);
+}
+
+/* Writes the content of S to P, replacing the characters that are unsafe
+   in HTML, i.e. '<', '>', '&' and '"', with the character entities.
+   None of the supported encodings uses these bytes in a multibyte
+   character, so we can scan bytes.  The scan checks 8 bytes at a time;
+   most text has no such characters and is written in one run. */
+#define HTML_ONES   ((uint64_t)0x0101010101010101ULL)
+#define HTML_HIGHS  ((uint64_t)0x8080808080808080ULL)
+#define HTML_HASBYTE(w, c) \
+    ((((w)^(HTML_ONES*(c))) - HTML_ONES) & ~((w)^(HTML_ONES*(c))) & HTML_HIGHS)
+
+static const char *html_scan(const char *s, const char *end)
+{
+    while (end - s >= 8) {
+        uint64_t w;
+        memcpy(&w, s, 8);
+        if (HTML_HASBYTE(w, '<') | HTML_HASBYTE(w, '>')
+            | HTML_HASBYTE(w, '&') | HTML_HASBYTE(w, '"')) break;
+        s += 8;
+    }
+    for (; s < end; s++) {
+        if (*s == '<' || *s == '>' || *s == '&' || *s == '"') break;
+    }
+    return s;
+}
+
+static void write_html_escaped(const char *s, const char *end, ScmPort *p)
+{
+    const char *run = s;
+    while ((s = html_scan(s, end)) < end) {
+        if (s > run) Scm_PutzUnsafe(run, (int)(s - run), p);
+        switch (*s) {
+        case '<': Scm_PutzUnsafe("&lt;", 4, p); break;
+        case '>': Scm_PutzUnsafe("&gt;", 4, p); break;
+        case '&': Scm_PutzUnsafe("&amp;", 5, p); break;
+        default:  Scm_PutzUnsafe("&quot;", 6, p); break;
+        }
+        run = ++s;
+    }
+    if (end > run) Scm_PutzUnsafe(run, (int)(end - run), p);
+}
+
+void Scm_WriteHTMLEscaped(ScmString *s, ScmPort *p)
+{
+    ScmVM *vm = Scm_VM();
+    const ScmStringBody *b = SCM_STRING_BODY(s);
+    const char *start = SCM_STRING_BODY_START(b);
+    const char *end = start + SCM_STRING_BODY_SIZE(b);
+    PORT_LOCK(p, vm);
+    PORT_SAFE_CALL(p, write_html_escaped(start, end, p), /*no cleanup*/);
+    PORT_UNLOCK(p);
+}
+
 /* Low-level function to find if the file descriptor is ready or not.
    DIR specifies SCM_PORT_INPUT or SCM_PORT_OUTPUT.
    If the system doesn't have select(), this function returns
@@ -555,6 +1006,126 @@ int Scm_FdReady(int fd, int dir)
 
 #define SCM_PORT_DEFAULT_BUFSIZ 8192
 
+/* Buffer pool:
+ *   Buffers of the default size are recycled.  When a port that took
+ *   its buffer from the pool is closed (explicitly or by the finalizer),
+ *   the buffer goes back to the pool, so that servers that open and
+ *   close many short-lived ports don't keep the GC busy.  We keep up to
+ *   PORT_BUFFER_POOL_SIZE idle buffers; the rest are left to the GC.
+ *   The pool array is a static root, so idle buffers are kept alive.
+ */
+#define PORT_BUFFER_POOL_SIZE 64
+
+static struct {
+    char *buffers[PORT_BUFFER_POOL_SIZE];
+    int count;
+    ScmInternalMutex mutex;
+} buffer_pool;
+
+static char *pool_get_buffer(void)
+{
+    char *buf = NULL;
+    (void)SCM_INTERNAL_MUTEX_LOCK(buffer_pool.mutex);
+    if (buffer_pool.count > 0) {
+        buf = buffer_pool.buffers[--buffer_pool.count];
+        buffer_pool.buffers[buffer_pool.count] = NULL;
+    }
+    (void)SCM_INTERNAL_MUTEX_UNLOCK(buffer_pool.mutex);
+    if (buf == NULL) buf = SCM_NEW_ATOMIC2(char*, SCM_PORT_DEFAULT_BUFSIZ);
+    return buf;
+}
+
+static void pool_put_buffer(char *buf)
+{
+    (void)SCM_INTERNAL_MUTEX_LOCK(buffer_pool.mutex);
+    if (buffer_pool.count < PORT_BUFFER_POOL_SIZE) {
+        buffer_pool.buffers[buffer_pool.count++] = buf;
+    }
+    (void)SCM_INTERNAL_MUTEX_UNLOCK(buffer_pool.mutex);
+}
+
+/* Returns the number of idle buffers in the pool.  For diagnostics. */
+int Scm_PortBufferPoolCount(void)
+{
+    return buffer_pool.count;
+}
+
+/* Lets an input buffered port read SIZE bytes at DATA in place, instead
+   of copying them into its buffer.  This is called from a filler, which
+   then returns SIZE.  The port goes back to its own buffer at the next
+   fill, carrying over the unread data; until then, the caller must keep
+   the data intact.  The data is never written by the port.
+   If the buffer has any unread data, this returns FALSE without changing
+   anything, and the filler should copy the data as usual. */
+int Scm_PortLendBuffer(ScmPort *p, char *data, int size)
+{
+    if (SCM_PORT_TYPE(p) != SCM_PORT_FILE
+        || SCM_PORT_DIR(p) != SCM_PORT_INPUT
+        || (p->flags & SCM_PORT_LENT_BUFFER)
+        || size <= 0
+        || p->src.buf.end != p->src.buf.buffer) {
+        return FALSE;
+    }
+    p->ownBuffer = p->src.buf.buffer;
+    p->ownBufferSize = p->src.buf.size;
+    p->src.buf.buffer = p->src.buf.current = p->src.buf.end = data;
+    p->src.buf.size = size;
+    p->flags |= SCM_PORT_LENT_BUFFER;
+    return TRUE;
+}
+
+/* Goes back from the lent buffer to the port's own buffer, moving the
+   unread data to it. */
+static void bufport_return_buffer(ScmPort *p)
+{
+    int cursiz = (int)(p->src.buf.end - p->src.buf.current);
+    char *buf = p->ownBuffer;
+    int size = p->ownBufferSize;
+
+    if (cursiz >= size) {
+        if (p->flags & SCM_PORT_POOLED_BUFFER) {
+            pool_put_buffer(buf);
+            p->flags &= ~SCM_PORT_POOLED_BUFFER;
+        }
+        size += cursiz;
+        buf = SCM_NEW_ATOMIC2(char*, size);
+    }
+    if (cursiz > 0) memcpy(buf, p->src.buf.current, cursiz);
+    p->src.buf.buffer = p->src.buf.current = buf;
+    p->src.buf.end = buf + cursiz;
+    p->src.buf.size = size;
+    p->ownBuffer = NULL;
+    p->ownBufferSize = 0;
+    p->flags &= ~SCM_PORT_LENT_BUFFER;
+}
+
+/* Enlarges the buffer of a non-blocking port so that it has at least
+   NEED bytes of room, keeping the content. */
+static void bufport_grow(ScmPort *p, int need)
+{
+    if (p->flags & SCM_PORT_LENT_BUFFER) bufport_return_buffer(p);
+    int size = p->src.buf.size;
+    int curoff = (int)(p->src.buf.current - p->src.buf.buffer);
+    int endoff = (int)(p->src.buf.end - p->src.buf.buffer);
+    int newsize = size*2;
+    if (newsize - size < need) newsize = size + need;
+
+    char *buf = SCM_NEW_ATOMIC2(char*, newsize);
+    memcpy(buf, p->src.buf.buffer, size);
+    if (p->flags & SCM_PORT_POOLED_BUFFER) {
+        pool_put_buffer(p->src.buf.buffer);
+        p->flags &= ~SCM_PORT_POOLED_BUFFER;
+    }
+    p->src.buf.buffer = buf;
+    p->src.buf.size = newsize;
+    p->src.buf.current = buf + curoff;
+    if (SCM_PORT_DIR(p) == SCM_PORT_INPUT) {
+        p->src.buf.end = buf + endoff;
+    } else {
+        p->src.buf.end = buf + newsize;
+    }
+}
+
 ScmObj Scm_MakeBufferedPort(ScmClass *klass,
                             ScmObj name,
                             int dir,     /* direction */
@@ -563,10 +1134,19 @@ ScmObj Scm_MakeBufferedPort(ScmClass *klass,
 {
     int size = bufrec->size;
     char *buf = bufrec->buffer;
+    int pooled = FALSE;
 
     if (size <= 0) size = SCM_PORT_DEFAULT_BUFSIZ;
-    if (buf == NULL) buf = SCM_NEW_ATOMIC2(char*, size);
+    if (buf == NULL) {
+        if (size == SCM_PORT_DEFAULT_BUFSIZ) {
+            buf = pool_get_buffer();
+            pooled = TRUE;
+        } else {
+            buf = SCM_NEW_ATOMIC2(char*, size);
+        }
+    }
     ScmPort *p = make_port(klass, dir, SCM_PORT_FILE);
+    if (pooled) p->flags |= SCM_PORT_POOLED_BUFFER;
     p->name = name;
     p->ownerp = ownerp;
     p->src.buf.buffer = buf;
@@ -598,6 +1178,10 @@ int Scm_GetPortBufferingMode(ScmPort *port)
 
 void Scm_SetPortBufferingMode(ScmPort *port, int mode)
 {
+    if ((mode & SCM_PORT_BUFFER_MODE_MASK) != SCM_PORT_BUFFER_MODE(port)) {
+        ScmPortStat *st = PORT_STAT(port);
+        if (st) st->modeChanges++;
+    }
     port->src.buf.mode =
         (port->src.buf.mode & ~SCM_PORT_BUFFER_MODE_MASK)
         | (mode & SCM_PORT_BUFFER_MODE_MASK);
@@ -693,6 +1277,11 @@ static void bufport_flush(ScmPort *p, int cnt, int forcep)
     if (cursiz == 0) return;
     if (cnt <= 0)  { cnt = cursiz; }
     int nwrote = p->src.buf.flusher(p, cnt, forcep);
+    ScmPortStat *st = PORT_STAT(p);
+    if (st) {
+        st->flushes++;
+        if (nwrote > 0) st->bytesWritten += nwrote;
+    }
     if (nwrote < 0) {
         p->src.buf.current = p->src.buf.buffer; /* for safety */
         p->error = TRUE;
@@ -708,12 +1297,38 @@ static void bufport_flush(ScmPort *p, int cnt, int forcep)
     } else {
         p->src.buf.current = p->src.buf.buffer;
     }
+    /* A non-blocking port may not have made any room.  The callers
+       need room for at least one character, so we grow the buffer. */
+    if (!forcep && (p->flags & SCM_PORT_NONBLOCKING)
+        && p->src.buf.end - p->src.buf.current < SCM_CHAR_MAX_BYTES) {
+        bufport_grow(p, MAX(cnt, SCM_CHAR_MAX_BYTES));
+    }
 }
 
 /* Writes siz bytes in src to the buffered port.  siz may be larger than
    the port's buffer.  Won't return until entire siz bytes are written. */
 static void bufport_write(ScmPort *p, const char *src, int siz)
 {
+#ifdef USE_WRITEV
+    /* If the data won't fit in the buffer anyway, don't copy it;
+       write it out along with the pending data in one syscall. */
+    if (siz >= p->src.buf.size && p->src.buf.flusher == file_flusher
+        && !(p->flags & SCM_PORT_NONBLOCKING)) {
+        struct iovec iov[2];
+        iov[0].iov_base = p->src.buf.buffer;
+        iov[0].iov_len = SCM_PORT_BUFFER_AVAIL(p);
+        iov[1].iov_base = (void*)src;
+        iov[1].iov_len = siz;
+        ScmPortStat *st = PORT_STAT(p);
+        if (st) {
+            st->flushes++;
+            st->bytesWritten += iov[0].iov_len + iov[1].iov_len;
+        }
+        file_writev(p, iov, 2);
+        p->src.buf.current = p->src.buf.buffer;
+        return;
+    }
+#endif /*USE_WRITEV*/
     do {
         int room = (int)(p->src.buf.end - p->src.buf.current);
         if (room >= siz) {
@@ -737,6 +1352,8 @@ static void bufport_write(ScmPort *p, const char *src, int siz)
  */
 static int bufport_fill(ScmPort *p, int min, int allow_less)
 {
+    if (p->flags & SCM_PORT_LENT_BUFFER) bufport_return_buffer(p);
+
     int cursiz = (int)(p->src.buf.end - p->src.buf.current);
     int nread = 0, toread;
     if (cursiz > 0) {
@@ -758,7 +1375,15 @@ static int bufport_fill(ScmPort *p, int min, int allow_less)
         if (r <= 0) break;
         nread += r;
         p->src.buf.end += r;
+        /* The filler gave its data as the buffer; there's no room to
+           fill any more.  Callers can deal with a short fill. */
+        if (p->flags & SCM_PORT_LENT_BUFFER) break;
     } while (!allow_less && nread < min);
+    ScmPortStat *st = PORT_STAT(p);
+    if (st) {
+        st->fills++;
+        st->bytesRead += nread;
+    }
     return nread;
 }
 
@@ -1028,12 +1653,18 @@ static int file_filler(ScmPort *p, int cnt)
     int nread = 0;
     int fd = (int)(intptr_t)p->src.buf.data;
     char *datptr = p->src.buf.end;
+    ScmPortStat *st = PORT_STAT(p);
     SCM_ASSERT(fd >= 0);
+    p->flags &= ~SCM_PORT_WOULDBLOCK;
     while (nread == 0) {
         int r;
         errno = 0;
-        SCM_SYSCALL(r, read(fd, datptr, cnt-nread));
+        PORT_STAT_SYSCALL(st, r, read(fd, datptr, cnt-nread));
         if (r < 0) {
+            if (wouldblock_errno(errno)) {
+                p->flags |= (SCM_PORT_NONBLOCKING|SCM_PORT_WOULDBLOCK);
+                break;
+            }
             p->error = TRUE;
             Scm_SysError("read failed on %S", p);
         } else if (r == 0) {
@@ -1053,14 +1684,21 @@ static int file_flusher(ScmPort *p, int cnt, int forcep)
     int datsiz = SCM_PORT_BUFFER_AVAIL(p);
     int fd = (int)(intptr_t)p->src.buf.data;
     char *datptr = p->src.buf.buffer;
+    ScmPortStat *st = PORT_STAT(p);
 
     SCM_ASSERT(fd >= 0);
+    p->flags &= ~SCM_PORT_WOULDBLOCK;
     while ((!forcep && nwrote == 0)
            || (forcep && nwrote < cnt)) {
         int r;
         errno = 0;
-        SCM_SYSCALL(r, write(fd, datptr, datsiz-nwrote));
+        PORT_STAT_SYSCALL(st, r, write(fd, datptr, datsiz-nwrote));
         if (r < 0) {
+            if (wouldblock_errno(errno)) {
+                /* Keep the rest in the buffer; see bufport_flush. */
+                p->flags |= (SCM_PORT_NONBLOCKING|SCM_PORT_WOULDBLOCK);
+                break;
+            }
             if (SCM_PORT_BUFFER_SIGPIPE_SENSITIVE_P(p)) {
                 /* (sort of) emulate termination by SIGPIPE.
                    NB: The difference is visible from the outside world
@@ -1080,6 +1718,39 @@ static int file_flusher(ScmPort *p, int cnt, int forcep)
     return nwrote;
 }
 
+#ifdef USE_WRITEV
+/* Writes out all the data in IOV, bypassing the buffer.  IOV is
+   modified to keep track of partial writes. */
+static void file_writev(ScmPort *p, struct iovec *iov, int iovcnt)
+{
+    int fd = (int)(intptr_t)p->src.buf.data;
+    ScmPortStat *st = PORT_STAT(p);
+
+    SCM_ASSERT(fd >= 0);
+    while (iovcnt > 0) {
+        ssize_t r;
+        if (iov->iov_len == 0) { iov++; iovcnt--; continue; }
+        PORT_STAT_SYSCALL(st, r, writev(fd, iov, iovcnt));
+        if (r < 0) {
+            if (SCM_PORT_BUFFER_SIGPIPE_SENSITIVE_P(p)) {
+                Scm_Exit(1);    /* see file_flusher */
+            }
+            p->error = TRUE;
+            Scm_SysError("write failed on %S", p);
+        }
+        while (iovcnt > 0 && (size_t)r >= iov->iov_len) {
+            r -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char*)iov->iov_base + r;
+            iov->iov_len -= r;
+        }
+    }
+}
+#endif /*USE_WRITEV*/
+
 static void file_closer(ScmPort *p)
 {
     int fd = (int)(intptr_t)p->src.buf.data;
@@ -1105,6 +1776,13 @@ static off_t file_seeker(ScmPort *p, off_t offset, int whence)
 }
 
 ScmObj Scm_OpenFilePort(const char *path, int flags, int buffering, int perm)
+{
+    return Scm_OpenFilePortFull(path, flags, buffering, perm, 0);
+}
+
+/* BUFSIZE <= 0 means the default size. */
+ScmObj Scm_OpenFilePortFull(const char *path, int flags, int buffering,
+                            int perm, int bufsize)
 {
     int dir = 0;
 
@@ -1133,7 +1811,7 @@ ScmObj Scm_OpenFilePort(const char *path, int flags, int buffering, int perm)
     ScmPortBuffer bufrec;
     bufrec.mode = buffering;
     bufrec.buffer = NULL;
-    bufrec.size = 0;
+    bufrec.size = bufsize;
     bufrec.filler = file_filler;
     bufrec.flusher = file_flusher;
     bufrec.closer = file_closer;
@@ -1155,11 +1833,19 @@ ScmObj Scm_OpenFilePort(const char *path, int flags, int buffering, int perm)
  */
 ScmObj Scm_MakePortWithFd(ScmObj name, int direction,
                           int fd, int bufmode, int ownerp)
+{
+    return Scm_MakePortWithFdFull(name, direction, fd, bufmode, 0, ownerp);
+}
+
+/* Like Scm_MakePortWithFd, but allows to specify the buffer size.
+   BUFSIZE <= 0 means the default size. */
+ScmObj Scm_MakePortWithFdFull(ScmObj name, int direction,
+                              int fd, int bufmode, int bufsize, int ownerp)
 {
     ScmPortBuffer bufrec;
 
     bufrec.buffer = NULL;
-    bufrec.size = 0;
+    bufrec.size = bufsize;
     bufrec.mode = bufmode;
     bufrec.filler = file_filler;
     bufrec.flusher =file_flusher;
@@ -1197,6 +1883,142 @@ ScmObj Scm_MakeInputStringPort(ScmString *str, int privatep)
     return SCM_OBJ(p);
 }
 
+/*
+ * Mapped input file port
+ *
+ *   It is an input string port whose content is the file image mapped
+ *   by mmap(2).  The mapped region is represented by an immutable
+ *   u8vector, which is kept in the port's mapped-region attribute and
+ *   unmapped when it is garbage-collected.  Views taken by
+ *   Scm_PortMappedView have the region as the owner, so the mapping
+ *   survives as long as the port or any of its views is alive.
+ *   On systems without mmap, we simply read the whole file into memory.
+ */
+
+#ifdef USE_MMAP
+static void unmap_region(ScmObj obj, void *data)
+{
+    ScmUVector *v = SCM_UVECTOR(obj);
+    if (SCM_UVECTOR_SIZE(v) > 0) {
+        (void)munmap(SCM_UVECTOR_ELEMENTS(v), SCM_UVECTOR_SIZE(v));
+    }
+}
+#endif /*USE_MMAP*/
+
+static ScmObj map_file(const char *path)
+{
+    int fd, r;
+    struct stat st;
+    void *addr;
+
+#if defined(GAUCHE_WINDOWS)
+    SCM_SYSCALL(fd, open(path, O_RDONLY|O_BINARY));
+#else  /*!GAUCHE_WINDOWS*/
+    SCM_SYSCALL(fd, open(path, O_RDONLY));
+#endif /*!GAUCHE_WINDOWS*/
+    if (fd < 0) Scm_SysError("couldn't open %s", path);
+    SCM_SYSCALL(r, fstat(fd, &st));
+    if (r < 0) {
+        int e = errno;
+        close(fd);
+        errno = e;
+        Scm_SysError("fstat failed on %s", path);
+    }
+    if (!S_ISREG(st.st_mode)) {
+        close(fd);
+        Scm_Error("can't map %s: not a regular file", path);
+    }
+    if (st.st_size > (off_t)SCM_SMALL_INT_MAX) {
+        close(fd);
+        Scm_Error("can't map %s: file too large", path);
+    }
+    ScmSmallInt size = (ScmSmallInt)st.st_size;
+    if (size == 0) {
+        /* mmap rejects zero-length mapping */
+        close(fd);
+        return Scm_MakeUVectorFull(SCM_CLASS_U8VECTOR, 0, NULL, TRUE, NULL);
+    }
+#ifdef USE_MMAP
+    addr = mmap(NULL, (size_t)size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED) {
+        int e = errno;
+        close(fd);
+        errno = e;
+        Scm_SysError("mmap failed on %s", path);
+    }
+    close(fd);
+    ScmObj v = Scm_MakeUVectorFull(SCM_CLASS_U8VECTOR, size, addr, TRUE, NULL);
+    Scm_RegisterFinalizer(v, unmap_region, NULL);
+    return v;
+#else  /*!USE_MMAP*/
+    addr = SCM_NEW_ATOMIC2(void*, size);
+    ScmSmallInt nread = 0;
+    while (nread < size) {
+        SCM_SYSCALL(r, read(fd, (char*)addr + nread, size - nread));
+        if (r < 0) {
+            int e = errno;
+            close(fd);
+            errno = e;
+            Scm_SysError("read failed on %s", path);
+        }
+        if (r == 0) break;      /* file shrunk */
+        nread += r;
+    }
+    close(fd);
+    return Scm_MakeUVectorFull(SCM_CLASS_U8VECTOR, nread, addr, TRUE, NULL);
+#endif /*!USE_MMAP*/
+}
+
+ScmObj Scm_OpenMappedInputFile(const char *path, int privatep)
+{
+    ScmObj region = map_file(path);
+    ScmPort *p = make_port(SCM_CLASS_PORT, SCM_PORT_INPUT, SCM_PORT_ISTR);
+    const char *s = (const char*)SCM_UVECTOR_ELEMENTS(region);
+    p->src.istr.start = s;
+    p->src.istr.current = s;
+    p->src.istr.end = s + SCM_UVECTOR_SIZE(region);
+    p->flags |= SCM_PORT_MAPPED;
+    p->name = SCM_MAKE_STR_COPYING(path);
+    Scm_PortAttrSetUnsafe(p, sym_mapped_region, region);
+    if (privatep) PORT_PRELOCK(p, Scm_VM());
+    return SCM_OBJ(p);
+}
+
+/* Returns a view of [start, end) bytes of the mapped file image.
+   If AS_STRING is true, an incomplete string is returned.  It has to
+   copy the content, since a string body can't keep the mapping alive.
+   Otherwise it returns an immutable u8vector sharing the mapping.
+   The range is in bytes from the beginning of the file, no matter
+   where the port's current position is.  END < 0 means the end of the
+   file. */
+ScmObj Scm_PortMappedView(ScmPort *port, ScmSmallInt start, ScmSmallInt end,
+                          int as_string)
+{
+    if (!(port->flags & SCM_PORT_MAPPED)) {
+        Scm_Error("mapped input port required, but got %S", port);
+    }
+    ScmObj region = Scm_PortAttrGet(port, sym_mapped_region, SCM_FALSE);
+    if (!SCM_UVECTORP(region)) {
+        Scm_Error("mapped region of the port %S has been lost", port);
+    }
+    ScmSmallInt size = SCM_UVECTOR_SIZE(region);
+    if (end < 0) end = size;
+    if (start < 0 || start > size) {
+        Scm_Error("start argument out of range: %ld", start);
+    }
+    if (end < start || end > size) {
+        Scm_Error("end argument out of range: %ld", end);
+    }
+    char *s = (char*)SCM_UVECTOR_ELEMENTS(region) + start;
+    if (as_string) {
+        return Scm_MakeString(s, end - start, end - start,
+                              SCM_STRING_INCOMPLETE|SCM_STRING_COPYING);
+    } else {
+        return Scm_MakeUVectorFull(SCM_CLASS_U8VECTOR, end - start, s,
+                                   TRUE, region);
+    }
+}
+
 ScmObj Scm_MakeOutputStringPort(int privatep)
 {
     ScmPort *p = make_port(SCM_CLASS_PORT, SCM_PORT_OUTPUT, SCM_PORT_OSTR);
@@ -1224,6 +2046,54 @@ ScmObj Scm_GetOutputStringUnsafe(ScmPort *port, int flags)
     return Scm_DStringGet(&SCM_PORT(port)->src.ostr, flags);
 }
 
+/* Like Scm_GetOutputString, but the accumulated buffer can become the
+   string body without copying (see Scm_DStringTake).  The port keeps
+   its content; if it is written to again, the buffer is copied first.
+   So this is the one to use when you don't expect to use the port
+   anymore, but it is still correct if you do. */
+ScmObj Scm_TakeOutputString(ScmPort *port, int flags)
+{
+    if (SCM_PORT_TYPE(port) != SCM_PORT_OSTR)
+        Scm_Error("output string port required, but got %S", port);
+    ScmVM *vm = Scm_VM();
+    PORT_LOCK(port, vm);
+    ScmObj r = Scm_DStringTake(&SCM_PORT(port)->src.ostr, flags);
+    PORT_UNLOCK(port);
+    return r;
+}
+
+/* For C routines that need a temporary string port which never escapes
+   to Scheme, e.g. number->string.  We keep a few private ports per VM,
+   so that we don't need to allocate one every time.
+   Scm__ReleaseOutputStringPort returns the accumulated string and puts
+   the port back to the pool; the caller must not use the port after
+   that.  If an error is raised between acquiring and releasing, the port
+   is simply left for GC. */
+ScmPort *Scm__AcquireOutputStringPort(void)
+{
+    ScmVM *vm = Scm_VM();
+    if (vm->numOstrPool > 0) {
+        ScmPort *p = vm->ostrPool[--vm->numOstrPool];
+        vm->ostrPool[vm->numOstrPool] = NULL;
+        return p;
+    }
+    return SCM_PORT(Scm_MakeOutputStringPort(TRUE));
+}
+
+ScmObj Scm__ReleaseOutputStringPort(ScmPort *port, int flags)
+{
+    ScmVM *vm = Scm_VM();
+    ScmObj r = Scm_DStringTake(&port->src.ostr, flags);
+    Scm_DStringInit(&port->src.ostr);
+    if (vm->numOstrPool < SCM_VM_OSTR_POOL_SIZE
+        && PORT_LOCKED(port, vm) && !PORT_RECURSIVE_P(port)
+        && !port->closed && !port->error) {
+        port->attrs = SCM_NIL;
+        vm->ostrPool[vm->numOstrPool++] = port;
+    }
+    return r;
+}
+
 /* TRANSIENT: Pre-0.9 Compatibility routine.  Kept for the binary compatibility.
    Will be removed on 1.0 */
 ScmObj Scm__GetOutputStringCompat(ScmPort *port)
@@ -1251,6 +2121,9 @@ ScmObj Scm_GetRemainingInputString(ScmPort *port, int flags)
        the port is pointing won't be changed. */
     const char *ep = port->src.istr.end;
     const char *cp = port->src.istr.current;
+    /* The string body can't share the mapped file image, for it doesn't
+       keep the mapping alive. */
+    if (port->flags & SCM_PORT_MAPPED) flags |= SCM_STRING_COPYING;
     /* Things gets complicated if there's an ungotten char or bytes.
        We want to share the string body whenever possible, so we
        first check the ungotten stuff matches the content of the
@@ -1799,12 +2672,15 @@ void Scm__InitPort(void)
 {
     (void)SCM_INTERNAL_MUTEX_INIT(active_buffered_ports.mutex);
     active_buffered_ports.ports = SCM_WEAK_VECTOR(Scm_MakeWeakVector(PORT_VECTOR_SIZE));
+    (void)SCM_INTERNAL_MUTEX_INIT(buffer_pool.mutex);
 
     Scm_InitStaticClass(&Scm_PortClass, "<port>",
                         Scm_GaucheModule(), port_slots, 0);
     Scm_InitStaticClass(&Scm_CodingAwarePortClass, "<coding-aware-port>",
                         Scm_GaucheModule(), port_slots, 0);
 
+    sym_mapped_region = SCM_INTERN("mapped-region");
+
     /* This must be done before *any* port is created. */
     Scm_DefinePrimitiveParameter(Scm_GaucheModule(), "reader-lexical-mode",
                                  SCM_OBJ(SCM_SYM_PERMISSIVE),
@@ -565,6 +565,12 @@ static int getc_scratch_unsafe(ScmPort *p)
         int r = EOF;
         SAFE_CALL(p, r = Scm_Getb(p));
         if (r == EOF) {
+            if (SCM_PORT_WOULDBLOCK_P(p)) {
+                /* keep what we've got for the next try */
+                memcpy(p->scratch, tbuf, i);
+                p->scrcnt = i;
+                return EOF;
+            }
             UNLOCK(p);
             Scm_PortError(p, SCM_PORT_ERROR_INPUT,
                           "encountered EOF in middle of a multibyte character from port %S", p);
@@ -634,6 +640,12 @@ int Scm_GetcUnsafe(ScmPort *p)
                 rest = nb + 1 - p->scrcnt;
                 for (;;) {
                     SAFE_CALL(p, filled = bufport_fill(p, rest, FALSE));
+                    if (filled <= 0 && SCM_PORT_WOULDBLOCK_P(p)) {
+                        /* The partial character stays in the scratch
+                           buffer; getc_scratch picks it up later. */
+                        UNLOCK(p);
+                        return EOF;
+                    }
                     if (filled <= 0) {
                         /* TODO: make this behavior customizable */
                         UNLOCK(p);
@@ -734,6 +746,7 @@ static int getz_scratch_unsafe(char *buf, int buflen, ScmPort *p)
         p->scrcnt = 0;
         int n = 0;
         SAFE_CALL(p, n = Scm_Getz(buf+i, buflen-i, p));
+        if (n < 0) n = 0;       /* EOF; we've got i bytes anyway */
         return i + n;
     }
 }
@@ -819,13 +832,6 @@ int Scm_GetzUnsafe(char *buf, int buflen, ScmPort *p)
 
 /* Auxiliary procedures */
 
-/* NB: it may be further optimized by scanning the contents of buffer
-   when the port is a buffered port or an input string, which allows
-   us to avoid mb->wc->mb conversion.   See port.c, v 1.69 for some
-   attempt to do so.  The problem there is that if I have to take
-   into account the cases of the ungotten char and the scratch buffer,
-   code becomes ugly.  There might be some better approach. */
-
 #ifndef READLINE_AUX
 #define READLINE_AUX
 /* Assumes the port is locked, and the caller takes care of unlocking
@@ -833,27 +839,289 @@ int Scm_GetzUnsafe(char *buf, int buflen, ScmPort *p)
 /* NB: this routine reads bytes, not chars.  It allows to readline
    from a port in unknown character encoding (e.g. reading the first
    line of xml doc to find out charset parameter). */
-ScmObj readline_body(ScmPort *p)
+
+/* Puts back N bytes in S in front of the buffered input. */
+static void bufport_unshift(ScmPort *p, const char *s, int n)
+{
+    if (p->flags & SCM_PORT_LENT_BUFFER) bufport_return_buffer(p);
+    int avail = (int)(p->src.buf.end - p->src.buf.current);
+    if (p->src.buf.current - p->src.buf.buffer >= n) {
+        p->src.buf.current -= n;
+        memcpy(p->src.buf.current, s, n);
+        return;
+    }
+    if (p->src.buf.size - avail < n) bufport_grow(p, n);
+    memmove(p->src.buf.buffer + n, p->src.buf.current, avail);
+    memcpy(p->src.buf.buffer, s, n);
+    p->src.buf.current = p->src.buf.buffer;
+    p->src.buf.end = p->src.buf.buffer + n + avail;
+}
+
+/* Readline on a non-blocking file port.  We scan the line in the buffer
+   and consume it only when the whole line is there, so that nothing is
+   lost if the fd would block in the middle of a line; in that case we
+   return EOF with SCM_PORT_WOULDBLOCK set, leaving the partial line in
+   the buffer (which grows if the line doesn't fit). */
+static ScmObj readline_nonblock(ScmPort *p)
+{
+    /* The ungotten char and the scratch bytes precede the buffer
+       content; put them back into the buffer so that we can scan
+       the line in place. */
+    if (p->ungotten != SCM_CHAR_INVALID) {
+        char tbuf[SCM_CHAR_MAX_BYTES];
+        int n = SCM_CHAR_NBYTES(p->ungotten);
+        SCM_CHAR_PUT(tbuf, p->ungotten);
+        p->ungotten = SCM_CHAR_INVALID;
+        bufport_unshift(p, tbuf, n);
+    }
+    if (p->scrcnt > 0) {
+        bufport_unshift(p, p->scratch, p->scrcnt);
+        p->scrcnt = 0;
+    }
+
+    int scanned = 0;
+    for (;;) {
+        char *start = p->src.buf.current;
+        char *s = start + scanned, *e = p->src.buf.end;
+        while (s < e && *s != '\n' && *s != '\r') s++;
+        /* NB: If CR is the last byte, we need the next one to see
+           whether it's CRLF. */
+        if (s < e && (*s == '\n' || s+1 < e)) {
+            int skip = (*s == '\r' && s[1] == '\n')? 2 : 1;
+            ScmObj r = Scm_MakeString(start, s - start, -1,
+                                      SCM_STRING_COPYING);
+            p->src.buf.current = s + skip;
+            p->bytes += (s - start) + skip;
+            p->line++;
+            return r;
+        }
+        scanned = (int)(s - start);
+        if (e - start >= p->src.buf.size) bufport_grow(p, p->src.buf.size);
+        if (bufport_fill(p, 0, TRUE) > 0) continue;
+        if (SCM_PORT_WOULDBLOCK_P(p)) return SCM_EOF;
+
+        /* EOF.  Return the rest, if any, as the last line. */
+        start = p->src.buf.current;
+        e = p->src.buf.end;
+        if (start == e) return SCM_EOF;
+        p->src.buf.current = e;
+        p->bytes += e - start;
+        if (e[-1] == '\r') {
+            p->line++;
+            e--;
+        }
+        return Scm_MakeString(start, e - start, -1, SCM_STRING_COPYING);
+    }
+}
+
+/* Returns the first EOL byte in [S, E), or E. */
+static inline const char *scan_eol(const char *s, const char *e)
+{
+    const char *q = memchr(s, '\n', e - s);
+    if (q == NULL) q = e;
+    const char *r = memchr(s, '\r', q - s);
+    return r? r : q;
+}
+
+/* Returns the first character in [S, E) that is in CS, or E.  If we hit
+   a multibyte character that straddles E, returns its beginning and
+   sets *PARTIAL.  SMALLP is TRUE if CS has no characters beyond ASCII.
+   We step by characters, for a trailing byte of a multibyte character
+   may look like an ASCII character in some encodings. */
+static const char *scan_charset(const char *s, const char *e,
+                                ScmCharSet *cs, int smallp, int *partial)
+{
+    while (s < e) {
+        u_char b = (u_char)*s;
+        if (b < 0x80) {
+            if (SCM_BITS_TEST(cs->small, b)) return s;
+            s++;
+            continue;
+        }
+        int n = SCM_CHAR_NFOLLOWS(b) + 1;
+        if (n > e - s) {
+            *partial = TRUE;
+            return s;
+        }
+        if (!smallp) {
+            ScmChar ch;
+            SCM_CHAR_GET(s, ch);
+            if (Scm_CharSetContains(cs, ch)) return s;
+        }
+        s += n;
+    }
+    return e;
+}
+
+static void count_newlines(ScmPort *p, const char *s, const char *e)
+{
+    while ((s = memchr(s, '\n', e - s)) != NULL) {
+        p->line++;
+        s++;
+    }
+}
+
+/* The scanning kernel of read-line and read-until-delimiter.
+   Reads P up to a delimiter, which is left in the port, or EOF.
+   The delimiters are EOL bytes if CS is NULL, or characters in CS.
+
+   If P is a buffered port or an input string port, we scan its buffer
+   directly instead of fetching bytes one at a time.  When the whole
+   result is in the buffer, we return a pointer into it and set
+   *FRESH to FALSE; no copying is done, but the content is only valid
+   until the next input operation on P.  Otherwise the result is
+   gathered into a freshly allocated, NUL-terminated memory and *FRESH
+   is set to TRUE.  The size of the result is set to *SIZE, and *EOFP
+   is set to TRUE if we stopped at EOF instead of a delimiter.
+   Returns NULL if we're at EOF from the beginning.
+
+   Assumes the port is locked, as readline_body. */
+static const char *scan_input(ScmPort *p, ScmCharSet *cs,
+                              ScmSmallInt *size, int *fresh, int *eofp)
 {
     ScmDString ds;
+    int gathering = FALSE;      /* TRUE once we've started using DS */
+    int nread = FALSE;          /* TRUE if we've consumed anything */
+    int slow = FALSE;           /* handle next char without the buffer */
+    int smallp = (cs && SCM_CHAR_SET_SMALLP(cs));
 
-    Scm_DStringInit(&ds);
-    int b1 = Scm_GetbUnsafe(p);
-    if (b1 == EOF) return SCM_EOF;
+    *eofp = FALSE;
     for (;;) {
-        if (b1 == EOF) return Scm_DStringGet(&ds, 0);
-        if (b1 == '\n') break;
-        if (b1 == '\r') {
-            int b2 = Scm_GetbUnsafe(p);
-            if (b2 == EOF || b2 == '\n') break;
-            Scm_UngetbUnsafe(b2, p);
-            break;
+        const char *s = NULL, *e = NULL;
+        if (!slow && p->scrcnt == 0 && p->ungotten == SCM_CHAR_INVALID) {
+            if (SCM_PORT_TYPE(p) == SCM_PORT_FILE) {
+                if (p->src.buf.current >= p->src.buf.end
+                    && bufport_fill(p, 1, FALSE) == 0) {
+                    goto eof;
+                }
+                s = p->src.buf.current;
+                e = p->src.buf.end;
+            } else if (SCM_PORT_TYPE(p) == SCM_PORT_ISTR) {
+                if (p->src.istr.current >= p->src.istr.end) goto eof;
+                s = p->src.istr.current;
+                e = p->src.istr.end;
+            }
         }
-        SCM_DSTRING_PUTB(&ds, b1);
-        b1 = Scm_GetbUnsafe(p);
+
+        if (s != NULL) {
+            const char *q = cs? scan_charset(s, e, cs, smallp, &slow)
+                              : scan_eol(s, e);
+            ScmSmallInt n = q - s;
+            if (SCM_PORT_TYPE(p) == SCM_PORT_FILE) p->src.buf.current += n;
+            else p->src.istr.current += n;
+            p->bytes += n;
+            if (cs) count_newlines(p, s, q);
+            if (q < e && !slow) {
+                /* found a delimiter */
+                if (!gathering) {
+                    *size = n;
+                    *fresh = FALSE;
+                    return s;
+                }
+                Scm_DStringPutz(&ds, s, n);
+                break;
+            }
+            if (!gathering) {
+                Scm_DStringInit(&ds);
+                gathering = TRUE;
+            }
+            Scm_DStringPutz(&ds, s, n);
+            if (n > 0) nread = TRUE;
+            continue;
+        }
+
+        /* We have a pushed back char or bytes, or the port isn't of
+           a type we can scan directly, or a character straddles
+           the end of the buffer.  Go one by one. */
+        slow = FALSE;
+        if (!gathering) {
+            Scm_DStringInit(&ds);
+            gathering = TRUE;
+        }
+        int b = Scm_PeekbUnsafe(p);
+        if (b == EOF) goto eof;
+        if (cs == NULL) {
+            if (b == '\n' || b == '\r') break;
+        } else if (b < 0x80) {
+            if (SCM_BITS_TEST(cs->small, b)) break;
+        } else {
+            ScmChar ch = Scm_PeekcUnsafe(p);
+            if (ch != EOF) {
+                if (Scm_CharSetContains(cs, ch)) break;
+                Scm_GetcUnsafe(p);
+                SCM_DSTRING_PUTC(&ds, ch);
+                nread = TRUE;
+                continue;
+            }
+            /* incomplete character at EOF; take it as bytes */
+        }
+        Scm_GetbUnsafe(p);
+        if (cs && b == '\n') p->line++;
+        SCM_DSTRING_PUTB(&ds, b);
+        nread = TRUE;
+    }
+    /* found a delimiter, and the result is in DS */
+    *size = Scm_DStringSize(&ds);
+    *fresh = TRUE;
+    return Scm_DStringGetz(&ds);
+
+  eof:
+    *eofp = TRUE;
+    if (!nread) return NULL;
+    *size = Scm_DStringSize(&ds);
+    *fresh = TRUE;
+    return Scm_DStringGetz(&ds);
+}
+
+/* Reads a line and returns its content without EOL, as scan_input.
+   Returns NULL at EOF. */
+static const char *readline_view(ScmPort *p, ScmSmallInt *size, int *fresh)
+{
+    int eofp;
+    const char *s = scan_input(p, NULL, size, fresh, &eofp);
+    if (s == NULL || eofp) return s;
+
+    /* Consume EOL.  If it's CR at the end of the buffer, we need to
+       fill the buffer to see if LF follows, which overwrites the
+       content; save it first. */
+    int b = Scm_GetbUnsafe(p);
+    if (b == '\r') {
+        if (!*fresh && SCM_PORT_TYPE(p) == SCM_PORT_FILE
+            && p->src.buf.current >= p->src.buf.end) {
+            char *c = SCM_NEW_ATOMIC2(char *, *size + 1);
+            memcpy(c, s, *size);
+            c[*size] = '\0';
+            s = c;
+            *fresh = TRUE;
+        }
+        if (Scm_PeekbUnsafe(p) == '\n') Scm_GetbUnsafe(p);
     }
     p->line++;
-    return Scm_DStringGet(&ds, 0);
+    return s;
+}
+
+ScmObj readline_body(ScmPort *p)
+{
+    if (SCM_PORT_TYPE(p) == SCM_PORT_FILE
+        && (p->flags & SCM_PORT_NONBLOCKING)) {
+        return readline_nonblock(p);
+    }
+
+    ScmSmallInt size;
+    int fresh;
+    const char *s = readline_view(p, &size, &fresh);
+    if (s == NULL) return SCM_EOF;
+    return Scm_MakeString(s, size, -1, fresh? 0 : SCM_STRING_COPYING);
+}
+
+/* Assumes the port is locked, as readline_body. */
+static ScmObj read_until_body(ScmPort *p, ScmCharSet *cs)
+{
+    ScmSmallInt size;
+    int fresh, eofp;
+    const char *s = scan_input(p, cs, &size, &fresh, &eofp);
+    if (s == NULL) return SCM_EOF;
+    return Scm_MakeString(s, size, -1, fresh? 0 : SCM_STRING_COPYING);
 }
 #endif /* READLINE_AUX */
 
@@ -868,11 +1136,116 @@ ScmObj Scm_ReadLineUnsafe(ScmPort *p)
     SHORTCUT(p, return Scm_ReadLineUnsafe(p));
 
     LOCK(p);
+    CLOSE_CHECK(p);
     SAFE_CALL(p, r = readline_body(p));
     UNLOCK(p);
     return r;
 }
 
+/* Reads a line from P without creating a string.  Returns a pointer to
+   the content of the line, excluding EOL, and sets its size in *SIZE;
+   or returns NULL at EOF.  The content may be in the port's buffer,
+   so it is only valid until the next operation on P, and it must not
+   be modified.  Handy to parse a line immediately, e.g. a log record.
+   If other threads may read from P, the caller must lock P while it
+   uses the content. */
+#ifdef SAFE_PORT_OP
+const char *Scm_ReadLineView(ScmPort *p, ScmSmallInt *size)
+#else
+const char *Scm_ReadLineViewUnsafe(ScmPort *p, ScmSmallInt *size)
+#endif
+{
+    const char *r = NULL;
+    int fresh;
+    VMDECL;
+    SHORTCUT(p, return Scm_ReadLineViewUnsafe(p, size));
+
+    LOCK(p);
+    CLOSE_CHECK(p);
+    if (SCM_PORT_TYPE(p) == SCM_PORT_FILE
+        && (p->flags & SCM_PORT_NONBLOCKING)) {
+        ScmObj s = SCM_FALSE;
+        SAFE_CALL(p, s = readline_nonblock(p));
+        if (SCM_STRINGP(s)) {
+            r = Scm_GetStringContent(SCM_STRING(s), NULL, NULL, NULL);
+            *size = SCM_STRING_BODY_SIZE(SCM_STRING_BODY(s));
+        }
+    } else {
+        SAFE_CALL(p, r = readline_view(p, size, &fresh));
+    }
+    UNLOCK(p);
+    return r;
+}
+
+/*=================================================================
+ * ReadUntilDelimiter
+ *   Reads up to a character in the given char-set, or EOF.  The
+ *   delimiter is left in the port.  Shares the scanning kernel with
+ *   ReadLine.
+ */
+
+#ifdef SAFE_PORT_OP
+ScmObj Scm_ReadUntilDelimiter(ScmPort *p, ScmCharSet *cs)
+#else
+ScmObj Scm_ReadUntilDelimiterUnsafe(ScmPort *p, ScmCharSet *cs)
+#endif
+{
+    ScmObj r = SCM_UNDEFINED;
+    VMDECL;
+    SHORTCUT(p, return Scm_ReadUntilDelimiterUnsafe(p, cs));
+
+    LOCK(p);
+    CLOSE_CHECK(p);
+    SAFE_CALL(p, r = read_until_body(p, cs));
+    UNLOCK(p);
+    return r;
+}
+
+/*=================================================================
+ * ReadString
+ *   Reads up to NCHARS characters.  The port is locked once for
+ *   the whole string, instead of once per character.
+ */
+
+#ifndef READSTRING_AUX
+#define READSTRING_AUX
+/* Assumes the port is locked, as readline_body. */
+static ScmObj readstring_body(ScmPort *p, ScmSmallInt nchars)
+{
+    ScmDString ds;
+
+    Scm_DStringInit(&ds);
+    for (ScmSmallInt i=0; i<nchars; i++) {
+        ScmChar c = Scm_GetcUnsafe(p);
+        if (c == EOF) {
+            if (i == 0) return SCM_EOF;
+            break;
+        }
+        SCM_DSTRING_PUTC(&ds, c);
+    }
+    ScmObj s = Scm_DStringGet(&ds, 0);
+    Scm_DStringRelease(&ds);
+    return s;
+}
+#endif /* READSTRING_AUX */
+
+#ifdef SAFE_PORT_OP
+ScmObj Scm_ReadString(ScmPort *p, ScmSmallInt nchars)
+#else
+ScmObj Scm_ReadStringUnsafe(ScmPort *p, ScmSmallInt nchars)
+#endif
+{
+    ScmObj r = SCM_UNDEFINED;
+    VMDECL;
+    SHORTCUT(p, return Scm_ReadStringUnsafe(p, nchars));
+
+    if (nchars <= 0) return SCM_MAKE_STR("");
+    LOCK(p);
+    SAFE_CALL(p, r = readstring_body(p, nchars));
+    UNLOCK(p);
+    return r;
+}
+
 /*=================================================================
  * ByteReady
  */
@@ -38,6 +38,15 @@
 #include "gauche/vminsn.h"
 #include "gauche/prof.h"
 
+#include <stddef.h>
+
+/* Countdown for the allocation sampler; see SCM__ALLOC_SAMPLE in gauche.h.
+   It is process-wide and not protected, since it's decremented on every
+   allocation; the result of allocation sampling is approximate anyway. */
+#define ALLOC_COUNTDOWN_MAX  LONG_MAX
+
+ScmSmallInt Scm__AllocSampleCountdown = ALLOC_COUNTDOWN_MAX;
+
 #ifdef GAUCHE_PROFILE
 
 /* WARNING: duplicated code - see signal.c; we should integrate them later */
@@ -51,16 +60,16 @@
  * Interval timer operation
  */
 
-#define SAMPLING_PERIOD 10000
+/* The interval timer is process-wide, so is the period (usec). */
+static long sampling_period = SCM_PROF_DEFAULT_SAMPLING_PERIOD;
 
-#define ITIMER_START()                                  \
-    do {                                                \
-        struct itimerval tval, oval;                    \
-        tval.it_interval.tv_sec = 0;                    \
-        tval.it_interval.tv_usec = SAMPLING_PERIOD;     \
-        tval.it_value.tv_sec = 0;                       \
-        tval.it_value.tv_usec = SAMPLING_PERIOD;        \
-        setitimer(ITIMER_PROF, &tval, &oval);           \
+#define ITIMER_START()                                          \
+    do {                                                        \
+        struct itimerval tval, oval;                            \
+        tval.it_interval.tv_sec = sampling_period / 1000000;    \
+        tval.it_interval.tv_usec = sampling_period % 1000000;   \
+        tval.it_value = tval.it_interval;                       \
+        setitimer(ITIMER_PROF, &tval, &oval);                   \
     } while (0)
 
 #define ITIMER_STOP()                           \
@@ -128,9 +137,55 @@ static void sampler_sample(int sig)
         vm->prof->samples[i].func = SCM_FALSE;
         vm->prof->samples[i].pc = NULL;
     }
+
+    /* Record the callers.  We may be interrupted while a continuation
+       frame is being pushed; a frame on the stack is trusted only if
+       it's below SP.  Frames in the heap are complete. */
+    int depth = 0;
+    ScmContFrame *c = vm->cont;
+    while (c && depth < SCM_PROF_STACK_DEPTH) {
+        ScmObj *p = (ScmObj*)c;
+        if (p >= vm->stack && p < vm->stackEnd
+            && p + CONT_FRAME_SIZE > vm->sp) break;
+        if (c->base) vm->prof->samples[i].stack[depth++] = SCM_OBJ(c->base);
+        c = c->prev;
+    }
+    vm->prof->samples[i].depth = depth;
     vm->prof->totalSamples++;
 }
 
+/* Returns the object in the stat table whose address is FUNC, or #f.
+   Samples only have addresses, which we can't dereference unless
+   we know the object is alive. */
+static ScmObj known_func(ScmVMProfiler *prof, ScmObj func)
+{
+    ScmDictEntry *e = Scm_HashCoreSearch(SCM_HASH_TABLE_CORE(prof->statHash),
+                                         (intptr_t)func, SCM_DICT_GET);
+    return e? SCM_DICT_KEY(e) : SCM_FALSE;
+}
+
+/* Add the call stack of sample S to the call tree. */
+static void add_to_call_tree(ScmVMProfiler *prof, ScmProfSample *s)
+{
+    ScmHashTable *node = prof->callTree;
+    ScmObj e = SCM_FALSE;
+    for (int k = s->depth; k >= 0; k--) {
+        ScmObj f = known_func(prof, (k > 0)? s->stack[k-1] : s->func);
+        if (!SCM_FALSEP(e)) {
+            if (SCM_FALSEP(SCM_CDR(e))) {
+                SCM_SET_CDR(e, Scm_MakeHashTableSimple(SCM_HASH_EQ, 0));
+            }
+            node = SCM_HASH_TABLE(SCM_CDR(e));
+        }
+        e = Scm_HashTableRef(node, f, SCM_UNBOUND);
+        if (SCM_UNBOUNDP(e)) {
+            e = Scm_Cons(SCM_MAKE_INT(0), SCM_FALSE);
+            Scm_HashTableSet(node, f, e, 0);
+        }
+    }
+    SCM_SET_CAR(e, SCM_MAKE_INT(SCM_INT_VALUE(SCM_CAR(e)) + 1));
+}
+
 /* register samples into the stat table.  Called from Scm_ProfilerResult */
 void collect_samples(ScmVMProfiler *prof)
 {
@@ -146,6 +201,7 @@ void collect_samples(ScmVMProfiler *prof)
             int cnt = SCM_INT_VALUE(SCM_CDR(e)) + 1;
             SCM_SET_CDR(e, SCM_MAKE_INT(cnt));
         }
+        add_to_call_tree(prof, &prof->samples[i]);
     }
 }
 
@@ -201,6 +257,105 @@ void Scm_ProfilerCountBufferFlush(ScmVM *vm)
     SIGPROCMASK(SIG_UNBLOCK, &set, NULL);
 }
 
+/*=============================================================
+ * Allocation sampler
+ */
+
+/* Sampling period in bytes; 0 disables the allocation sampler.
+   Like the sampling period of the statistic sampler, it's process-wide. */
+static ScmSmallInt alloc_sampling_period = 0;
+
+/* # of VMs whose allocation sampler is running. */
+static int alloc_samplers = 0;
+
+static void alloc_countdown_reset(void)
+{
+    if (alloc_samplers > 0 && alloc_sampling_period > 0) {
+        Scm__AllocSampleCountdown = alloc_sampling_period;
+    } else {
+        Scm__AllocSampleCountdown = ALLOC_COUNTDOWN_MAX;
+    }
+}
+
+static void alloc_sampler_switch(ScmVMProfiler *prof, int on)
+{
+    if (on && !prof->allocSampling) alloc_samplers++;
+    if (!on && prof->allocSampling) alloc_samplers--;
+    prof->allocSampling = on;
+    alloc_countdown_reset();
+}
+
+static void alloc_add(ScmHashTable *h, intptr_t key, size_t bytes, size_t objs)
+{
+    ScmDictEntry *e = Scm_HashCoreSearch(SCM_HASH_TABLE_CORE(h), key,
+                                         SCM_DICT_CREATE);
+    if (!e->value) {
+        (void)SCM_DICT_SET_VALUE(e, Scm_Cons(SCM_MAKE_INT(0),
+                                             SCM_MAKE_INT(0)));
+    }
+    ScmObj p = SCM_DICT_VALUE(e);
+    SCM_SET_CAR(p, Scm_Add(SCM_CAR(p), Scm_MakeIntegerU(bytes)));
+    SCM_SET_CDR(p, Scm_Add(SCM_CDR(p), Scm_MakeIntegerU(objs)));
+}
+
+/* Move the alloc samples into allocHash and allocTypeHash.  This itself
+   allocates, so we suspend the sampler while we're at it.
+   NB: This can be called in the middle of allocation, where the caller
+   may hold a lock (e.g. the symbol table's).  So we only touch our own
+   tables here; allocTypeHash is keyed by the address of the C type name,
+   and converted to symbols in Scm_ProfilerRawAllocResult. */
+static void alloc_flush(ScmVMProfiler *prof)
+{
+    if (prof->currentAlloc == 0) return;
+
+    int sampling = prof->allocSampling;
+    prof->allocSampling = FALSE;
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGPROF);
+    SIGPROCMASK(SIG_BLOCK, &set, NULL);
+
+    for (int i=0; i<prof->currentAlloc; i++) {
+        ScmProfAlloc *a = &prof->allocs[i];
+        /* Each sample stands for a->bytes bytes of allocations of objects
+           of the same size. */
+        size_t objs = (a->size > 0)? a->bytes / a->size : 0;
+        if (objs == 0) objs = 1;
+        alloc_add(prof->allocHash, (intptr_t)a->func, a->bytes, objs);
+        alloc_add(prof->allocTypeHash, (intptr_t)a->what, a->bytes, objs);
+        a->func = SCM_FALSE;
+    }
+    prof->currentAlloc = 0;
+
+    SIGPROCMASK(SIG_UNBLOCK, &set, NULL);
+    prof->allocSampling = sampling;
+}
+
+/* Called from SCM__ALLOC_SAMPLE when the countdown gets negative. */
+void Scm__AllocSample(size_t size, const char *what)
+{
+    ScmSmallInt period = alloc_sampling_period;
+    if (alloc_samplers <= 0 || period <= 0) {
+        Scm__AllocSampleCountdown = ALLOC_COUNTDOWN_MAX;
+        return;
+    }
+    /* A large object may cross more than one sampling point. */
+    ScmSmallInt n = 1 + (-Scm__AllocSampleCountdown - 1) / period;
+    Scm__AllocSampleCountdown += n * period;
+
+    ScmVM *vm = Scm_VM();
+    if (vm == NULL || vm->prof == NULL || !vm->prof->allocSampling) return;
+    ScmVMProfiler *prof = vm->prof;
+    if (prof->currentAlloc >= SCM_PROF_ALLOCS_IN_BUFFER) {
+        alloc_flush(prof);
+    }
+    ScmProfAlloc *a = &prof->allocs[prof->currentAlloc++];
+    a->func = vm->base? SCM_OBJ(vm->base) : SCM_FALSE;
+    a->what = what;
+    a->size = size;
+    a->bytes = (size_t)(n * period);
+}
+
 /*=============================================================
  * External API
  */
@@ -221,6 +376,14 @@ void Scm_ProfilerStart(void)
         vm->prof->currentCount = 0;
         vm->prof->statHash =
             SCM_HASH_TABLE(Scm_MakeHashTableSimple(SCM_HASH_EQ, 0));
+        vm->prof->callTree =
+            SCM_HASH_TABLE(Scm_MakeHashTableSimple(SCM_HASH_EQ, 0));
+        vm->prof->currentAlloc = 0;
+        vm->prof->allocSampling = FALSE;
+        vm->prof->allocHash =
+            SCM_HASH_TABLE(Scm_MakeHashTableSimple(SCM_HASH_EQ, 0));
+        vm->prof->allocTypeHash =
+            SCM_HASH_TABLE(Scm_MakeHashTableSimple(SCM_HASH_WORD, 0));
         unlink(templat_buf);       /* keep anonymous tmpfile */
     } else if (vm->prof->samplerFd < 0) {
         vm->prof->samplerFd = Scm_Mkstemp(templat_buf);
@@ -241,6 +404,7 @@ void Scm_ProfilerStart(void)
     }
 
     ITIMER_START();
+    alloc_sampler_switch(vm->prof, alloc_sampling_period > 0);
 }
 
 int Scm_ProfilerStop(void)
@@ -249,6 +413,7 @@ int Scm_ProfilerStop(void)
     if (vm->prof == NULL) return 0;
     if (vm->prof->state != SCM_PROFILER_RUNNING) return 0;
     ITIMER_STOP();
+    alloc_sampler_switch(vm->prof, FALSE);
     vm->prof->state = SCM_PROFILER_PAUSING;
     vm->profilerRunning = FALSE;
     return vm->prof->totalSamples;
@@ -272,16 +437,63 @@ void Scm_ProfilerReset(void)
     vm->prof->currentCount = 0;
     vm->prof->statHash =
         SCM_HASH_TABLE(Scm_MakeHashTableSimple(SCM_HASH_EQ, 0));
+    vm->prof->callTree =
+        SCM_HASH_TABLE(Scm_MakeHashTableSimple(SCM_HASH_EQ, 0));
+    for (int i=0; i<vm->prof->currentAlloc; i++) {
+        vm->prof->allocs[i].func = SCM_FALSE;
+    }
+    vm->prof->currentAlloc = 0;
+    vm->prof->allocHash =
+        SCM_HASH_TABLE(Scm_MakeHashTableSimple(SCM_HASH_EQ, 0));
+    vm->prof->allocTypeHash =
+        SCM_HASH_TABLE(Scm_MakeHashTableSimple(SCM_HASH_WORD, 0));
     vm->prof->state = SCM_PROFILER_INACTIVE;
 }
 
-/* Returns the statHash */
-ScmObj Scm_ProfilerRawResult(void)
+long Scm_ProfilerSamplingPeriod(void)
+{
+    return sampling_period;
+}
+
+void Scm_ProfilerSetSamplingPeriod(long usec)
 {
+    if (usec < 100) {
+        Scm_Error("profiler sampling period must be at least 100 "
+                  "microseconds, but got: %ld", usec);
+    }
+    sampling_period = usec;
     ScmVM *vm = Scm_VM();
+    if (vm->prof && vm->prof->state == SCM_PROFILER_RUNNING) {
+        ITIMER_START();
+    }
+}
+
+ScmSmallInt Scm_ProfilerAllocSamplingPeriod(void)
+{
+    return alloc_sampling_period;
+}
 
-    if (vm->prof == NULL) return SCM_FALSE;
-    if (vm->prof->state == SCM_PROFILER_INACTIVE) return SCM_FALSE;
+void Scm_ProfilerSetAllocSamplingPeriod(ScmSmallInt bytes)
+{
+    if (bytes < 0) {
+        Scm_Error("profiler allocation sampling period must be "
+                  "a nonnegative integer, but got: %ld", bytes);
+    }
+    alloc_sampling_period = bytes;
+    ScmVM *vm = Scm_VM();
+    if (vm->prof && vm->prof->state == SCM_PROFILER_RUNNING) {
+        alloc_sampler_switch(vm->prof, bytes > 0);
+    } else {
+        alloc_countdown_reset();
+    }
+}
+
+/* Move all the samples and counts into statHash and callTree.
+   Returns FALSE if there's no profiling data. */
+static int collect_all(ScmVM *vm)
+{
+    if (vm->prof == NULL) return FALSE;
+    if (vm->prof->state == SCM_PROFILER_INACTIVE) return FALSE;
     if (vm->prof->state == SCM_PROFILER_RUNNING) Scm_ProfilerStop();
 
     if (vm->prof->errorOccurred > 0) {
@@ -289,6 +501,7 @@ ScmObj Scm_ProfilerRawResult(void)
     }
 
     Scm_ProfilerCountBufferFlush(vm);
+    alloc_flush(vm->prof);
 
     /* collect samples in the current buffer */
     collect_samples(vm->prof);
@@ -311,11 +524,52 @@ ScmObj Scm_ProfilerRawResult(void)
     if (ftruncate(vm->prof->samplerFd, 0) < 0) {
         Scm_SysError("profiler: failed to truncate temporary file");
     }
+    return TRUE;
+}
 
+/* Returns the statHash */
+ScmObj Scm_ProfilerRawResult(void)
+{
+    ScmVM *vm = Scm_VM();
+    if (!collect_all(vm)) return SCM_FALSE;
     return SCM_OBJ(vm->prof->statHash);
 }
 
+/* Returns the callTree.  Its keys are the objects in statHash, or #f
+   for the code we haven't seen called during profiling. */
+ScmObj Scm_ProfilerRawCallTree(void)
+{
+    ScmVM *vm = Scm_VM();
+    if (!collect_all(vm)) return SCM_FALSE;
+    return SCM_OBJ(vm->prof->callTree);
+}
+
+/* Returns (<allocHash> . <types>), where <types> is an eq-hashtable
+   that maps C type names (symbols) to (<bytes> . <objects>). */
+ScmObj Scm_ProfilerRawAllocResult(void)
+{
+    ScmVM *vm = Scm_VM();
+    if (!collect_all(vm)) return SCM_FALSE;
+
+    ScmObj types = Scm_MakeHashTableSimple(SCM_HASH_EQ, 0);
+    ScmHashIter iter;
+    ScmDictEntry *e;
+    Scm_HashIterInit(&iter, SCM_HASH_TABLE_CORE(vm->prof->allocTypeHash));
+    while ((e = Scm_HashIterNext(&iter)) != NULL) {
+        ScmObj v = SCM_DICT_VALUE(e);
+        Scm_HashTableSet(SCM_HASH_TABLE(types),
+                         SCM_INTERN((const char*)e->key),
+                         Scm_Cons(SCM_CAR(v), SCM_CDR(v)), 0);
+    }
+    return Scm_Cons(SCM_OBJ(vm->prof->allocHash), types);
+}
+
 #else  /* !GAUCHE_PROFILE */
+void Scm__AllocSample(size_t size, const char *what)
+{
+    Scm__AllocSampleCountdown = ALLOC_COUNTDOWN_MAX;
+}
+
 void Scm_ProfilerStart(void)
 {
     Scm_Error("profiler is not supported.");
@@ -337,4 +591,297 @@ ScmObj Scm_ProfilerRawResult(void)
     Scm_Error("profiler is not supported.");
     return SCM_FALSE;
 }
+
+ScmObj Scm_ProfilerRawCallTree(void)
+{
+    Scm_Error("profiler is not supported.");
+    return SCM_FALSE;
+}
+
+long Scm_ProfilerSamplingPeriod(void)
+{
+    Scm_Error("profiler is not supported.");
+    return 0;
+}
+
+void Scm_ProfilerSetSamplingPeriod(long usec)
+{
+    Scm_Error("profiler is not supported.");
+}
+
+ScmObj Scm_ProfilerRawAllocResult(void)
+{
+    Scm_Error("profiler is not supported.");
+    return SCM_FALSE;
+}
+
+ScmSmallInt Scm_ProfilerAllocSamplingPeriod(void)
+{
+    Scm_Error("profiler is not supported.");
+    return 0;
+}
+
+void Scm_ProfilerSetAllocSamplingPeriod(ScmSmallInt bytes)
+{
+    Scm_Error("profiler is not supported.");
+}
 #endif /* !GAUCHE_PROFILE */
+
+/*=============================================================
+ * Lock contention profiler
+ *
+ *   This doesn't depend on SIGPROF, so it's available on all platforms.
+ */
+
+int Scm__LockStatEnabled = FALSE;
+
+static struct {
+    ScmLockStat *head;
+    ScmInternalMutex mutex;     /* protects head */
+} lock_stats = { NULL, SCM_INTERNAL_MUTEX_INITIALIZER };
+
+double Scm__LockStatNow(void)
+{
+    u_long sec, nsec;
+    if (!Scm_ClockGetTimeMonotonic(&sec, &nsec)) {
+        u_long usec;
+        Scm_GetTimeOfDay(&sec, &usec);
+        nsec = usec * 1000;
+    }
+    return (double)sec + (double)nsec/1.0e9;
+}
+
+/* Keeps the waiters who waited the longest.  If VM isn't in the table
+   and the table is full, we replace the entry with the least wait time. */
+static void lock_stat_add_waiter(ScmLockStat *stat, ScmVM *vm, double t)
+{
+    int i, victim = 0;
+    for (i=0; i<SCM_LOCK_STAT_WAITERS; i++) {
+        ScmLockWaiter *w = &stat->waiters[i];
+        if (w->vm == vm) {
+            w->count++;
+            w->waitTime += t;
+            return;
+        }
+        if (w->vm == NULL) { victim = i; break; }
+        if (w->waitTime < stat->waiters[victim].waitTime) victim = i;
+    }
+    if (stat->waiters[victim].vm != NULL
+        && stat->waiters[victim].waitTime >= t) {
+        return;
+    }
+    stat->waiters[victim].vm = vm;
+    stat->waiters[victim].count = 1;
+    stat->waiters[victim].waitTime = t;
+}
+
+void Scm__LockStatAcquired(ScmLockStat **pstat, ScmObj obj, double waitStart)
+{
+    ScmLockStat *stat = *pstat;
+    double now = Scm__LockStatNow();
+
+    if (stat == NULL) {
+        stat = SCM_NEW(ScmLockStat);
+        memset(stat, 0, sizeof(ScmLockStat));
+        stat->object = Scm_MakeWeakBox(obj);
+        (void)SCM_INTERNAL_MUTEX_LOCK(lock_stats.mutex);
+        stat->next = lock_stats.head;
+        lock_stats.head = stat;
+        (void)SCM_INTERNAL_MUTEX_UNLOCK(lock_stats.mutex);
+        *pstat = stat;
+    }
+    stat->acquisitions++;
+    if (waitStart > 0) {
+        double t = now - waitStart;
+        stat->contentions++;
+        stat->waitTime += t;
+        if (t > stat->maxWaitTime) stat->maxWaitTime = t;
+        lock_stat_add_waiter(stat, Scm_VM(), t);
+    }
+    stat->holdStart = now;
+}
+
+void Scm__LockStatReleased(ScmLockStat *stat)
+{
+    if (stat->holdStart > 0) {
+        double t = Scm__LockStatNow() - stat->holdStart;
+        stat->holdTime += t;
+        if (t > stat->maxHoldTime) stat->maxHoldTime = t;
+        stat->holdStart = 0;
+    }
+}
+
+void Scm_LockStatStart(void)
+{
+    Scm__LockStatEnabled = TRUE;
+}
+
+void Scm_LockStatStop(void)
+{
+    Scm__LockStatEnabled = FALSE;
+}
+
+/* Clears the counters.  The records themselves are kept, since the
+   lock objects keep pointers to them.  A lock currently held keeps
+   its holdStart, but the time it's been held before reset is counted. */
+void Scm_LockStatReset(void)
+{
+    ScmLockStat *s;
+    (void)SCM_INTERNAL_MUTEX_LOCK(lock_stats.mutex);
+    for (s = lock_stats.head; s; s = s->next) {
+        s->acquisitions = s->contentions = 0;
+        s->waitTime = s->maxWaitTime = 0.0;
+        s->holdTime = s->maxHoldTime = 0.0;
+        memset(s->waiters, 0, sizeof(s->waiters));
+    }
+    (void)SCM_INTERNAL_MUTEX_UNLOCK(lock_stats.mutex);
+}
+
+ScmObj Scm_LockStatToList(ScmLockStat *stat)
+{
+    ScmObj h = SCM_NIL, t = SCM_NIL, ws = SCM_NIL, wt = SCM_NIL;
+    if (stat == NULL) return SCM_FALSE;
+
+    for (int i=0; i<SCM_LOCK_STAT_WAITERS; i++) {
+        ScmLockWaiter *w = &stat->waiters[i];
+        if (w->vm == NULL) break;
+        SCM_APPEND1(ws, wt, Scm_Cons(SCM_OBJ(w->vm),
+                                     Scm_Cons(Scm_MakeIntegerU(w->count),
+                                              Scm_MakeFlonum(w->waitTime))));
+    }
+#define ADD(key, val)                                                   \
+    do {                                                                \
+        SCM_APPEND1(h, t, SCM_MAKE_KEYWORD(key));                       \
+        SCM_APPEND1(h, t, val);                                         \
+    } while (0)
+    ADD("acquisitions", Scm_MakeIntegerU(stat->acquisitions));
+    ADD("contentions",  Scm_MakeIntegerU(stat->contentions));
+    ADD("wait-time",    Scm_MakeFlonum(stat->waitTime));
+    ADD("max-wait-time", Scm_MakeFlonum(stat->maxWaitTime));
+    ADD("hold-time",    Scm_MakeFlonum(stat->holdTime));
+    ADD("max-hold-time", Scm_MakeFlonum(stat->maxHoldTime));
+    ADD("waiters",      ws);
+#undef ADD
+    return h;
+}
+
+/* Returns ((object . plist) ...) of the lock objects that are still
+   alive and have been acquired since the last reset. */
+ScmObj Scm_LockStatResult(void)
+{
+    ScmObj h = SCM_NIL, t = SCM_NIL;
+    ScmLockStat *s;
+
+    (void)SCM_INTERNAL_MUTEX_LOCK(lock_stats.mutex);
+    s = lock_stats.head;
+    (void)SCM_INTERNAL_MUTEX_UNLOCK(lock_stats.mutex);
+    /* Records are only pushed at the head, so we can walk the rest
+       without the lock. */
+    for (; s; s = s->next) {
+        if (s->acquisitions == 0) continue;
+        if (Scm_WeakBoxEmptyP(s->object)) continue;
+        SCM_APPEND1(h, t, Scm_Cons(SCM_OBJ(Scm_WeakBoxRef(s->object)),
+                                   Scm_LockStatToList(s)));
+    }
+    return h;
+}
+
+/*=============================================================
+ * Perf map
+ *
+ *   See gauche/prof.h for the overview.
+ */
+
+const ScmPerfUnwindInfo Scm__PerfUnwindInfo = {
+    1,
+    offsetof(ScmVM, pc),
+    offsetof(ScmVM, base),
+    offsetof(ScmVM, cont),
+    offsetof(ScmContFrame, prev),
+    offsetof(ScmContFrame, pc),
+    offsetof(ScmContFrame, base),
+    offsetof(ScmCompiledCode, code),
+    offsetof(ScmCompiledCode, codeSize),
+};
+
+#if defined(GAUCHE_HAS_PERF_CURRENT_VM)
+__thread ScmVM *Scm__PerfCurrentVM = NULL;
+#endif
+
+int Scm__PerfMapEnabled = FALSE;
+
+static struct {
+    FILE *out;
+    ScmObj path;                /* path of the map file, or #f */
+    ScmObj recorded;            /* weak hash table of recorded codes */
+    ScmInternalMutex mutex;
+} perf_map = { NULL, SCM_FALSE, SCM_FALSE, SCM_INTERNAL_MUTEX_INITIALIZER };
+
+void Scm__PerfMapRecord(ScmCompiledCode *code)
+{
+    /* Some codes, e.g. the dummy code Scm_Apply uses, has no code vector. */
+    if (code->code == NULL || code->codeSize <= 0) return;
+
+    (void)SCM_INTERNAL_MUTEX_LOCK(perf_map.mutex);
+    if (perf_map.out != NULL
+        && SCM_UNBOUNDP(Scm_WeakHashTableRef(SCM_WEAK_HASH_TABLE(perf_map.recorded),
+                                             SCM_OBJ(code), SCM_UNBOUND))) {
+        Scm_WeakHashTableSet(SCM_WEAK_HASH_TABLE(perf_map.recorded),
+                             SCM_OBJ(code), SCM_TRUE, 0);
+        ScmObj name = Scm_Sprintf("%S", Scm_CompiledCodeFullName(code));
+        fprintf(perf_map.out, "%lx %lx %s\n",
+                (unsigned long)code->code,
+                (unsigned long)(code->codeSize * sizeof(ScmWord)),
+                Scm_GetStringConst(SCM_STRING(name)));
+        fflush(perf_map.out);
+    }
+    (void)SCM_INTERNAL_MUTEX_UNLOCK(perf_map.mutex);
+}
+
+/* Opens the map file and starts recording.  PATH may be #f or unbound
+   to use the default /tmp/perf-<pid>.map.  If the map is already open,
+   this does nothing.  Returns the path of the map file. */
+ScmObj Scm_PerfMapStart(ScmObj path)
+{
+    ScmObj r;
+
+    if (SCM_UNBOUNDP(path) || SCM_FALSEP(path)) {
+        path = Scm_Sprintf("/tmp/perf-%d.map", (int)getpid());
+    } else if (!SCM_STRINGP(path)) {
+        Scm_Error("string or #f required for a perf map path, but got %S",
+                  path);
+    }
+
+    (void)SCM_INTERNAL_MUTEX_LOCK(perf_map.mutex);
+    if (perf_map.out == NULL) {
+        /* Append, since the map may have been written by a previous
+           session of this process. */
+        perf_map.out = fopen(Scm_GetStringConst(SCM_STRING(path)), "a");
+        if (perf_map.out != NULL) {
+            perf_map.path = path;
+            perf_map.recorded =
+                Scm_MakeWeakHashTableSimple(SCM_HASH_EQ, SCM_WEAK_KEY,
+                                            0, SCM_FALSE);
+            Scm__PerfMapEnabled = TRUE;
+        }
+    }
+    r = perf_map.path;
+    (void)SCM_INTERNAL_MUTEX_UNLOCK(perf_map.mutex);
+    if (SCM_FALSEP(r)) {
+        Scm_SysError("couldn't open perf map file %S", path);
+    }
+    return r;
+}
+
+void Scm_PerfMapStop(void)
+{
+    (void)SCM_INTERNAL_MUTEX_LOCK(perf_map.mutex);
+    Scm__PerfMapEnabled = FALSE;
+    if (perf_map.out != NULL) {
+        fclose(perf_map.out);
+        perf_map.out = NULL;
+    }
+    perf_map.path = SCM_FALSE;
+    perf_map.recorded = SCM_FALSE;
+    (void)SCM_INTERNAL_MUTEX_UNLOCK(perf_map.mutex);
+}
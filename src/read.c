@@ -51,6 +51,7 @@ static ScmObj read_item(ScmPort *port, ScmReadContext *ctx);
 static ScmObj read_list(ScmPort *port, ScmChar closer, ScmReadContext *ctx);
 static ScmObj read_vector(ScmPort *port, ScmChar closer, ScmReadContext *ctx);
 static ScmObj read_string(ScmPort *port, int incompletep, ScmReadContext *ctx);
+static ScmObj read_bitvector(ScmPort *port, ScmChar c, ScmReadContext *ctx);
 static ScmObj read_quoted(ScmPort *port, ScmObj quoter, ScmReadContext *ctx);
 static ScmObj read_char(ScmPort *port, ScmReadContext *ctx);
 static ScmObj read_word(ScmPort *port, ScmChar initial, ScmReadContext *ctx,
@@ -461,9 +462,203 @@ static void read_comment(ScmPort *port) /* leading semicolon is already read */
     }
 }
 
+/*----------------------------------------------------------------
+ * Fast path
+ *
+ *  Most of the input of plain data consists of ASCII whitespaces,
+ *  numbers, symbols and escape-free strings.  If the port has no
+ *  pushed-back data, we scan such tokens directly in the port's buffer,
+ *  avoiding per-character port calls and a temporary string for each
+ *  token.  Whenever the token isn't entirely in the buffer, or contains
+ *  anything unusual, we leave the port untouched and take the regular
+ *  path, so the fast path doesn't change what we read.
+ */
+
+/* Sets the range of readily available bytes in the port buffer,
+   or returns FALSE if we can't scan the buffer directly. */
+static inline int buffer_window(ScmPort *p, const char **cur,
+                                const char **end)
+{
+    if (p->scrcnt > 0 || p->ungotten != SCM_CHAR_INVALID) return FALSE;
+    switch (SCM_PORT_TYPE(p)) {
+    case SCM_PORT_FILE:
+        *cur = p->src.buf.current;
+        *end = p->src.buf.end;
+        return TRUE;
+    case SCM_PORT_ISTR:
+        *cur = p->src.istr.current;
+        *end = p->src.istr.end;
+        return TRUE;
+    default:
+        return FALSE;
+    }
+}
+
+/* Consumes bytes up to TO, which is within the window. */
+static inline void buffer_advance(ScmPort *p, const char *to)
+{
+    if (SCM_PORT_TYPE(p) == SCM_PORT_FILE) {
+        p->bytes += to - p->src.buf.current;
+        p->src.buf.current = (char*)to;
+    } else {
+        p->bytes += to - p->src.istr.current;
+        p->src.istr.current = to;
+    }
+}
+
+/* If the window ends at the window end, is it the end of input?
+   Only input string ports can tell without reading further. */
+#define BUFFER_END_IS_EOF(p)  (SCM_PORT_TYPE(p) == SCM_PORT_ISTR)
+
+static void skipws_fast(ScmPort *port)
+{
+    const char *cur, *end;
+    if (!buffer_window(port, &cur, &end)) return;
+    const char *q = cur;
+    for (; q < end; q++) {
+        if (*q == '\n') port->line++;
+        else if (!(*q == ' ' || *q == '\t' || *q == '\r'
+                   || *q == '\f' || *q == '\v')) break;
+    }
+    if (q != cur) buffer_advance(port, q);
+}
+
+/* Maximum length of a word scanned by the fast path. */
+#define FAST_WORD_MAX  128
+
+/* Scans a word starting with INITIAL (already read) into BUF, which
+   must have FAST_WORD_MAX+1 bytes.  Returns the size of the word,
+   or -1 if the fast path can't be used; in that case nothing is
+   consumed. */
+static int scan_word_fast(ScmPort *port, ScmChar initial, char *buf)
+{
+    const char *cur, *end, *q;
+    int case_fold = SCM_PORT_CASE_FOLDING(port);
+    int n = 0;
+
+    if (initial < 0 || initial >= 0x80) return -1;
+    if (!buffer_window(port, &cur, &end)) return -1;
+    if (case_fold && char_word_case_fold(initial)) initial = tolower(initial);
+    buf[n++] = (char)initial;
+    for (q = cur; q < end; q++) {
+        unsigned char b = (unsigned char)*q;
+        if (b >= 0x80) return -1;
+        if (!char_word_constituent(b, TRUE)) break;
+        if (n >= FAST_WORD_MAX) return -1;
+        if (case_fold && char_word_case_fold(b)) b = tolower(b);
+        buf[n++] = (char)b;
+    }
+    if (q == end && !BUFFER_END_IS_EOF(port)) return -1;
+    buffer_advance(port, q);
+    buf[n] = '\0';
+    return n;
+}
+
+/* Parses a decimal fixnum or a simple flonum in BUF.  Returns
+   SCM_UNBOUND if we can't decide; the caller should use the full
+   parser then.  For flonums, we only handle the case that the mantissa
+   and the power of 10 are both exact in double, so a single
+   multiplication or division gives correctly rounded result---the
+   same as the full parser does for such cases. */
+#if SIZEOF_LONG >= 8
+#define FAST_INT_DIGITS  18
+#else
+#define FAST_INT_DIGITS  9
+#endif
+#define FAST_FLO_DIGITS  15
+#define FAST_FLO_EXP     22
+
+static ScmObj parse_number_fast(const char *buf, int size)
+{
+    static const double pow10[] = {
+        1.0, 1.0e1, 1.0e2, 1.0e3, 1.0e4, 1.0e5, 1.0e6, 1.0e7,
+        1.0e8, 1.0e9, 1.0e10, 1.0e11, 1.0e12, 1.0e13, 1.0e14, 1.0e15,
+        1.0e16, 1.0e17, 1.0e18, 1.0e19, 1.0e20, 1.0e21, 1.0e22
+    };
+    const char *p = buf, *e = buf + size;
+    u_long m = 0;
+    int minusp = FALSE, seen = FALSE, flonump = FALSE;
+    int ndigits = 0, scale = 0;
+
+    if (*p == '+' || *p == '-') minusp = (*p++ == '-');
+    for (; p < e && isdigit((unsigned char)*p); p++) {
+        seen = TRUE;
+        if (m == 0 && *p == '0') continue;
+        if (++ndigits > FAST_INT_DIGITS) return SCM_UNBOUND;
+        m = m*10 + (*p - '0');
+    }
+    if (p < e && *p == '.') {
+        flonump = TRUE;
+        for (p++; p < e && isdigit((unsigned char)*p); p++) {
+            seen = TRUE;
+            scale--;
+            if (m == 0 && *p == '0') continue;
+            if (++ndigits > FAST_INT_DIGITS) return SCM_UNBOUND;
+            m = m*10 + (*p - '0');
+        }
+    }
+    if (!seen) return SCM_UNBOUND;
+    if (p < e && (*p == 'e' || *p == 'E')) {
+        int eminusp = FALSE, eseen = FALSE, x = 0;
+        flonump = TRUE;
+        p++;
+        if (p < e && (*p == '+' || *p == '-')) eminusp = (*p++ == '-');
+        for (; p < e && isdigit((unsigned char)*p); p++) {
+            eseen = TRUE;
+            if (x < 10000) x = x*10 + (*p - '0');
+        }
+        if (!eseen) return SCM_UNBOUND;
+        scale += eminusp? -x : x;
+    }
+    if (p != e) return SCM_UNBOUND;
+
+    if (!flonump) {
+        return Scm_MakeInteger(minusp? -(long)m : (long)m);
+    }
+    if (ndigits > FAST_FLO_DIGITS
+        || scale > FAST_FLO_EXP || scale < -FAST_FLO_EXP) {
+        return SCM_UNBOUND;
+    }
+    double d = (double)m;
+    if (scale >= 0) d *= pow10[scale];
+    else            d /= pow10[-scale];
+    return Scm_MakeFlonum(minusp? -d : d);
+}
+
+/* Reads the rest of a string literal after the opening quote, if it
+   has no escapes and is entirely in the buffer.  Returns the string,
+   or NULL if we should take the regular path (nothing is consumed in
+   that case).  In Shift_JIS, the second byte of a multibyte character
+   may be a backslash, so we don't bother. */
+static ScmObj read_string_fast(ScmPort *port)
+{
+#if !defined(GAUCHE_CHAR_ENCODING_SJIS)
+    const char *cur, *end;
+    if (!buffer_window(port, &cur, &end)) return NULL;
+    const char *q = cur;
+    int lines = 0;
+    for (; q < end; q++) {
+        if (*q == '"') break;
+        if (*q == '\\') return NULL;
+        if (*q == '\n') lines++;
+    }
+    if (q == end) return NULL;
+    ScmObj s = Scm_MakeString(cur, (ScmSmallInt)(q - cur), -1,
+                              SCM_STRING_IMMUTABLE|SCM_STRING_COPYING);
+    /* Invalid multibyte sequence; let the regular path deal with it. */
+    if (SCM_STRING_INCOMPLETE_P(s)) return NULL;
+    port->line += lines;
+    buffer_advance(port, q+1);
+    return s;
+#else
+    return NULL;
+#endif
+}
+
 static int skipws(ScmPort *port, ScmReadContext *ctx)
 {
     for (;;) {
+        skipws_fast(port);
         int c = Scm_GetcUnsafe(port);
         if (c == EOF) return c;
         if (c <= 127) {
@@ -580,10 +775,10 @@ static ScmObj read_internal(ScmPort *port, ScmReadContext *ctx)
             case '*': {
                 reject_in_r7(port, ctx, "#*");
                 /* #*"...." byte string
-                   #*01001001 for bit vector, maybe in future. */
+                   #*01001001 bitvector */
                 int c2 = Scm_GetcUnsafe(port);
                 if (c2 == '"') return read_string(port, TRUE, ctx);
-                Scm_ReadError(port, "unsupported #*-syntax: #*%C", c2);
+                return read_bitvector(port, c2, ctx);
             }
             case ':': {
                 reject_in_r7(port, ctx, "#:");
@@ -1036,11 +1231,39 @@ static void read_string_xdigits(ScmPort *port, int key,
     }
 }
 
+/* #*0101 - called after '#*' is read.  C is the character after it.
+   "#*" followed by a delimiter is an empty bitvector. */
+static ScmObj read_bitvector(ScmPort *port, ScmChar c, ScmReadContext *ctx)
+{
+    ScmDString ds;
+    Scm_DStringInit(&ds);
+    for (; c == '0' || c == '1'; c = Scm_GetcUnsafe(port)) {
+        SCM_DSTRING_PUTC(&ds, c);
+    }
+    if (c != EOF && char_word_constituent(c, TRUE)) {
+        Scm_ReadError(port, "invalid bitvector literal: #*%s%C",
+                      Scm_DStringGetz(&ds), c);
+    }
+    Scm_UngetcUnsafe(c, port);
+    ScmObj v = Scm_StringToBitvector(SCM_STRING(Scm_DStringGet(&ds, 0)),
+                                     FALSE);
+    if (Scm_ReadContextLiteralImmutable(ctx)) {
+        SCM_BITVECTOR(v)->size_flags |= 1;
+    }
+    return v;
+}
+
 static ScmObj read_string(ScmPort *port, int incompletep,
                           ScmReadContext *ctx)
 {
     int c = 0;
     ScmDString ds;
+
+    if (!incompletep) {
+        ScmObj s = read_string_fast(port);
+        if (s != NULL) return s;
+    }
+
     Scm_DStringInit(&ds);
 
 #define FETCH(var)                                      \
@@ -1139,7 +1362,9 @@ static ScmObj read_string(ScmPort *port, int incompletep,
                   Scm_DStringGet(&ds, 0));
  finish:;
     int flags = ((incompletep? SCM_STRING_INCOMPLETE:0) | SCM_STRING_IMMUTABLE);
-    return Scm_DStringGet(&ds, flags);
+    ScmObj s = Scm_DStringGet(&ds, flags);
+    Scm_DStringRelease(&ds);
+    return s;
 }
 
 /*----------------------------------------------------------------
@@ -1276,7 +1501,9 @@ static ScmObj read_word(ScmPort *port, ScmChar initial, ScmReadContext *ctx,
         int c = Scm_GetcUnsafe(port);
         if (c == EOF || !char_word_constituent(c, include_hash_sign)) {
             Scm_UngetcUnsafe(c, port);
-            return Scm_DStringGet(&ds, 0);
+            ScmObj s = Scm_DStringGet(&ds, 0);
+            Scm_DStringRelease(&ds);
+            return s;
         }
         if (case_fold && char_word_case_fold(c)) c = tolower(c);
         SCM_DSTRING_PUTC(&ds, c);
@@ -1296,9 +1523,24 @@ static void check_valid_symbol(ScmString *s)
     }
 }
 
+/* Interns a word scanned by scan_word_fast. */
+static ScmObj intern_word(const char *buf, int size)
+{
+    ScmString s = SCM_STRING_CONST_INITIALIZER(buf, size, size);
+    if (memchr(buf, '#', size) != NULL) {
+        Scm_Error("invalid symbol name: %S",
+                  Scm_MakeString(buf, size, size, SCM_STRING_COPYING));
+    }
+    return Scm__InternTransient(&s);
+}
+
 /* Read a symbol starting with INITIAL (assuming unescaped), interned. */
 static ScmObj read_symbol(ScmPort *port, ScmChar initial, ScmReadContext *ctx)
 {
+    char buf[FAST_WORD_MAX+1];
+    int n = scan_word_fast(port, initial, buf);
+    if (n >= 0) return intern_word(buf, n);
+
     ScmString *s = SCM_STRING(read_word(port, initial, ctx, FALSE, TRUE));
     check_valid_symbol(s);
     return Scm_Intern(s);
@@ -1353,6 +1595,18 @@ static ScmObj read_number(ScmPort *port, ScmChar initial, int radix,
 
 static ScmObj read_symbol_or_number(ScmPort *port, ScmChar initial, ScmReadContext *ctx)
 {
+    char buf[FAST_WORD_MAX+1];
+    int n = scan_word_fast(port, initial, buf);
+    if (n >= 0) {
+        ScmObj num = parse_number_fast(buf, n);
+        if (SCM_UNBOUNDP(num)) {
+            ScmString w = SCM_STRING_CONST_INITIALIZER(buf, n, n);
+            num = Scm_StringToNumber(&w, 10, 0);
+        }
+        if (!SCM_FALSEP(num)) return num;
+        return intern_word(buf, n);
+    }
+
     ScmString *s = SCM_STRING(read_word(port, initial, ctx, FALSE, TRUE));
     ScmObj num = Scm_StringToNumber(s, 10, 0);
     if (num != SCM_FALSE) return num;
@@ -1387,6 +1641,7 @@ static ScmObj read_escaped_symbol(ScmPort *port, ScmChar delim, int interned,
             goto err;
         } else if (c == delim) {
             ScmString *s = SCM_STRING(Scm_DStringGet(&ds, 0));
+            Scm_DStringRelease(&ds);
             return Scm_MakeSymbol(s, interned);
         } else if (c == '\\') {
             /* CL-style single escape */
@@ -1458,7 +1713,9 @@ static ScmObj read_regexp(ScmPort *port)
             c = Scm_GetcUnsafe(port);
             if (c == 'i') flags |= SCM_REGEXP_CASE_FOLD;
             else          Scm_UngetcUnsafe(c, port);
-            return Scm_RegComp(SCM_STRING(Scm_DStringGet(&ds, 0)), flags);
+            ScmString *s = SCM_STRING(Scm_DStringGet(&ds, 0));
+            Scm_DStringRelease(&ds);
+            return Scm_RegComp(s, flags);
         } else {
             SCM_DSTRING_PUTC(&ds, c);
         }
@@ -1468,7 +1725,8 @@ static ScmObj read_regexp(ScmPort *port)
 /* gauche extension :  #[charset] */
 static ScmObj read_charset(ScmPort *port)
 {
-    return Scm_CharSetRead(port, NULL, TRUE, FALSE);
+    ScmObj cs = Scm_CharSetRead(port, NULL, TRUE, FALSE);
+    return Scm_CharSetFreeze(SCM_CHAR_SET(cs));
 }
 
 /*----------------------------------------------------------------
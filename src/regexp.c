@@ -241,6 +241,10 @@ static ScmRegexp *make_regexp(void)
     rx->flags = 0;
     rx->pattern = SCM_FALSE;
     rx->ast = SCM_FALSE;
+    rx->lamap = NULL;
+    rx->laprefixLen = 0;
+    rx->automaton = NULL;
+    rx->literals = NULL;
     return rx;
 }
 
@@ -1874,12 +1878,162 @@ static ScmObj calculate_lasetn(ScmObj ast)
 }
 
 /* pass 3 */
+/* To find the possible start position of a match quickly, we scan the
+   input bytewise using a byte table derived from laset, or memchr()
+   if we know the literal bytes the match should begin with.  It is only
+   valid if we never mistake a trailing byte of a multibyte character
+   for the beginning of a character, which is the case with utf-8 and
+   single-byte encodings.  See scan_laset(). */
+#if !defined(GAUCHE_CHAR_ENCODING_EUC_JP) && !defined(GAUCHE_CHAR_ENCODING_SJIS)
+#define RX_BYTEWISE_SCAN 1
+#endif
+
+#ifdef RX_BYTEWISE_SCAN
+static int calculate_laprefix(ScmObj seq, u_char *buf, int n, int max,
+                              int *stop)
+{
+    ScmObj cp;
+    SCM_FOR_EACH(cp, seq) {
+        ScmObj item = SCM_CAR(cp);
+        if (SCM_CHARP(item)) {
+            char chbuf[SCM_CHAR_MAX_BYTES];
+            ScmChar ch = SCM_CHAR_VALUE(item);
+            int nb = SCM_CHAR_NBYTES(ch);
+            SCM_CHAR_PUT(chbuf, ch);
+            for (int i = 0; i < nb && n < max; i++) buf[n++] = chbuf[i];
+        } else if (SCM_PAIRP(item) && SCM_INTP(SCM_CAR(item))) {
+            n = calculate_laprefix(SCM_CDDR(item), buf, n, max, stop);
+        } else if (SCM_PAIRP(item) && SCM_EQ(SCM_CAR(item), SCM_SYM_SEQ)) {
+            n = calculate_laprefix(SCM_CDR(item), buf, n, max, stop);
+        } else {
+            *stop = TRUE;
+        }
+        if (*stop || n >= max) {
+            *stop = TRUE;
+            break;
+        }
+    }
+    return n;
+}
+#endif /*RX_BYTEWISE_SCAN*/
+
+static void rc3_setup_lamap(ScmRegexp *rx, ScmObj ast)
+{
+#ifdef RX_BYTEWISE_SCAN
+    if (SCM_FALSEP(rx->laset) || (rx->flags & SCM_REGEXP_CASE_FOLD)) return;
+    ScmCharSet *cs = SCM_CHAR_SET(rx->laset);
+    u_char *map = SCM_NEW_ATOMIC2(u_char*, 256);
+    int count = 0, firstb = 0;
+
+    for (int b = 0; b < 128; b++) {
+        map[b] = Scm_CharSetContains(cs, b);
+        if (map[b]) { count++; firstb = b; }
+    }
+    memset(map+128, 0, 128);
+    if (!SCM_CHAR_SET_SMALLP(cs)) {
+        /* The first byte of a multibyte char is monotonic to the
+           character code, so we can mark the range of bytes. */
+        ScmObj rp;
+        SCM_FOR_EACH(rp, Scm_CharSetRanges(cs)) {
+            ScmChar lo = SCM_INT_VALUE(SCM_CAAR(rp));
+            ScmChar hi = SCM_INT_VALUE(SCM_CDAR(rp));
+            char lb[SCM_CHAR_MAX_BYTES], hb[SCM_CHAR_MAX_BYTES];
+            if (hi < 128) continue;
+            if (lo < 128) lo = 128;
+            SCM_CHAR_PUT(lb, lo);
+            SCM_CHAR_PUT(hb, hi);
+            for (int b = (u_char)lb[0]; b <= (u_char)hb[0]; b++) map[b] = 1;
+        }
+        count = -1;
+    }
+    rx->lamap = map;
+
+    int stop = FALSE;
+    rx->laprefixLen = calculate_laprefix(SCM_LIST1(ast), rx->laprefix, 0, 2,
+                                         &stop);
+    if (rx->laprefixLen == 0 && count == 1) {
+        rx->laprefix[0] = firstb;
+        rx->laprefixLen = 1;
+    }
+#endif /*RX_BYTEWISE_SCAN*/
+}
+
+static struct ScmRegexpAutomatonRec *rx_automaton_build(ScmRegexp *rx);
+
+/* Once the code refers to the charsets by index, we replace them with
+   immutable ones, whose lookup is faster.  Charsets in the AST may be
+   given by the user, so we freeze copies of them unless they're
+   already immutable. */
+static void rc3_freeze_charsets(ScmRegexp *rx)
+{
+    for (int i=0; i<rx->numSets; i++) {
+        ScmCharSet *cs = rx->sets[i];
+        if (!SCM_CHAR_SET_IMMUTABLE_P(cs)) {
+            cs = SCM_CHAR_SET(Scm_CharSetCopy(cs));
+            rx->sets[i] = SCM_CHAR_SET(Scm_CharSetFreeze(cs));
+        }
+    }
+    if (SCM_CHAR_SET_P(rx->laset)) {
+        Scm_CharSetFreeze(SCM_CHAR_SET(rx->laset)); /* laset is fresh */
+    }
+}
+
+/* If the regexp is just an alternation of literal strings, such as
+   #/foo|bar|baz|qux/, we find the leftmost match with a string searcher
+   (strsearch.c) instead of trying each alternative at every position.
+   The searcher prefers the earliest needle among the ones that begin
+   at the same position, which is what the backtracking matcher does.
+   It pays off only with a handful of alternatives; regexp-union is
+   the typical source of such regexps. */
+#define RX_LITERAL_ALT_MIN  4
+
+/* Returns a string if AST is a char or a sequence of chars, #f otherwise. */
+static ScmObj rx_literal_string(ScmObj ast)
+{
+    ScmDString ds;
+    Scm_DStringInit(&ds);
+    if (SCM_CHARP(ast)) {
+        Scm_DStringPutc(&ds, SCM_CHAR_VALUE(ast));
+    } else if (SCM_PAIRP(ast) && SCM_EQ(SCM_CAR(ast), SCM_SYM_SEQ)
+               && SCM_PAIRP(SCM_CDR(ast))) {
+        ScmObj cp;
+        SCM_FOR_EACH(cp, SCM_CDR(ast)) {
+            if (!SCM_CHARP(SCM_CAR(cp))) return SCM_FALSE;
+            Scm_DStringPutc(&ds, SCM_CHAR_VALUE(SCM_CAR(cp)));
+        }
+    } else {
+        return SCM_FALSE;
+    }
+    return Scm_DStringGet(&ds, 0);
+}
+
+static void rc3_setup_literals(ScmRegexp *rx, ScmObj ast)
+{
+    /* We look for (0 #f (alt <literal> ...)) */
+    if (rx->numGroups != 1) return;
+    if (!SCM_PAIRP(ast) || !SCM_EQ(SCM_CAR(ast), SCM_MAKE_INT(0))) return;
+    ScmObj body = SCM_CDDR(ast);
+    if (!SCM_PAIRP(body) || !SCM_NULLP(SCM_CDR(body))) return;
+    ScmObj alt = SCM_CAR(body);
+    if (!SCM_PAIRP(alt) || !SCM_EQ(SCM_CAR(alt), SCM_SYM_ALT)) return;
+    if (Scm_Length(SCM_CDR(alt)) < RX_LITERAL_ALT_MIN) return;
+
+    ScmObj h = SCM_NIL, t = SCM_NIL, ap;
+    SCM_FOR_EACH(ap, SCM_CDR(alt)) {
+        ScmObj s = rx_literal_string(SCM_CAR(ap));
+        if (SCM_FALSEP(s)) return;
+        SCM_APPEND1(h, t, s);
+    }
+    rx->literals = SCM_STRING_SEARCHER(Scm_MakeStringSearcher(h));
+}
+
 static ScmObj rc3(regcomp_ctx *ctx, ScmObj ast)
 {
     /* set flags and laset */
     if (is_bol_anchored(ast)) ctx->rx->flags |= SCM_REGEXP_BOL_ANCHORED;
     else if (is_simple_prefixed(ast)) ctx->rx->flags |= SCM_REGEXP_SIMPLE_PREFIX;
     ctx->rx->laset = calculate_laset(ast, SCM_NIL);
+    rc3_setup_lamap(ctx->rx, ast);
 
     /* pass 3-1 : count # of insns */
     ctx->codemax = 1;
@@ -1893,8 +2047,11 @@ static ScmObj rc3(regcomp_ctx *ctx, ScmObj ast)
     rc3_emit(ctx, RE_SUCCESS);
     ctx->rx->code = ctx->code;
     ctx->rx->numCodes = ctx->codep;
+    rc3_freeze_charsets(ctx->rx);
 
     ctx->rx->ast = ast;
+    ctx->rx->automaton = rx_automaton_build(ctx->rx);
+    rc3_setup_literals(ctx->rx, ast);
     return SCM_OBJ(ctx->rx);
 }
 
@@ -2234,12 +2391,110 @@ static ScmObj rc_setup_context_seq(regcomp_ctx *ctx, ScmObj seq)
 /*--------------------------------------------------------------
  * Compiler entry point
  */
+/*
+ * Compiled regexp cache
+ *
+ *   Programs tend to compile the same pattern over and over, e.g. by
+ *   (rxmatch "pattern" str) or string->regexp in a loop.  We keep
+ *   recently compiled regexps keyed by the pattern string and the
+ *   case-fold flag, and reuse them.  It's safe since a regexp isn't
+ *   modified once compiled (the DFA of the automaton grows lazily, but
+ *   it has its own lock).  The cache holds RX_CACHE_SIZE patterns at
+ *   most; the least recently used one is dropped when it's full.
+ */
+#define RX_CACHE_SIZE  64
+
+typedef struct rx_cache_entry_rec {
+    ScmString *pattern;         /* immutable copy of the pattern; the key */
+    ScmObj rx[2];               /* compiled regexp w/o and w/ case-fold,
+                                   or #f */
+    struct rx_cache_entry_rec *prev; /* LRU list.  rx_cache.head is the */
+    struct rx_cache_entry_rec *next; /* most recently used one. */
+} rx_cache_entry;
+
+static struct {
+    ScmHashCore table;          /* pattern -> rx_cache_entry* */
+    rx_cache_entry *head;
+    rx_cache_entry *tail;
+    ScmInternalMutex mutex;
+} rx_cache;
+
+static void rx_cache_unlink(rx_cache_entry *e)
+{
+    if (e->prev) e->prev->next = e->next;
+    else rx_cache.head = e->next;
+    if (e->next) e->next->prev = e->prev;
+    else rx_cache.tail = e->prev;
+    e->prev = e->next = NULL;
+}
+
+static void rx_cache_push(rx_cache_entry *e)
+{
+    e->prev = NULL;
+    e->next = rx_cache.head;
+    if (rx_cache.head) rx_cache.head->prev = e;
+    rx_cache.head = e;
+    if (rx_cache.tail == NULL) rx_cache.tail = e;
+}
+
+static ScmObj rx_cache_get(ScmString *pattern, int foldp)
+{
+    ScmObj rx = SCM_FALSE;
+    (void)SCM_INTERNAL_MUTEX_LOCK(rx_cache.mutex);
+    ScmDictEntry *d = Scm_HashCoreSearch(&rx_cache.table, (intptr_t)pattern,
+                                         SCM_DICT_GET);
+    if (d) {
+        rx_cache_entry *e = (rx_cache_entry*)d->value;
+        rx = e->rx[foldp];
+        if (!SCM_FALSEP(rx) && e != rx_cache.head) {
+            rx_cache_unlink(e);
+            rx_cache_push(e);
+        }
+    }
+    (void)SCM_INTERNAL_MUTEX_UNLOCK(rx_cache.mutex);
+    return rx;
+}
+
+static void rx_cache_put(ScmString *pattern, int foldp, ScmObj rx)
+{
+    ScmString *key = SCM_STRING(Scm_CopyStringWithFlags(pattern,
+                                                        SCM_STRING_IMMUTABLE,
+                                                        SCM_STRING_IMMUTABLE));
+    (void)SCM_INTERNAL_MUTEX_LOCK(rx_cache.mutex);
+    ScmDictEntry *d = Scm_HashCoreSearch(&rx_cache.table, (intptr_t)key,
+                                         SCM_DICT_CREATE);
+    rx_cache_entry *e = (rx_cache_entry*)d->value;
+    if (e == NULL) {
+        e = SCM_NEW(rx_cache_entry);
+        e->pattern = key;
+        e->rx[0] = e->rx[1] = SCM_FALSE;
+        d->value = (intptr_t)e;
+    } else {
+        rx_cache_unlink(e);
+    }
+    e->rx[foldp] = rx;
+    rx_cache_push(e);
+    if (Scm_HashCoreNumEntries(&rx_cache.table) > RX_CACHE_SIZE) {
+        rx_cache_entry *old = rx_cache.tail;
+        rx_cache_unlink(old);
+        Scm_HashCoreSearch(&rx_cache.table, (intptr_t)old->pattern,
+                           SCM_DICT_DELETE);
+    }
+    (void)SCM_INTERNAL_MUTEX_UNLOCK(rx_cache.mutex);
+}
+
 ScmObj Scm_RegComp(ScmString *pattern, int flags)
 {
     if (SCM_STRING_INCOMPLETE_P(pattern)) {
         Scm_Error("incomplete string is not allowed: %S", pattern);
     }
 
+    int foldp = (flags & SCM_REGEXP_CASE_FOLD)? 1 : 0;
+    if (!(flags & SCM_REGEXP_PARSE_ONLY)) {
+        ScmObj cached = rx_cache_get(pattern, foldp);
+        if (!SCM_FALSEP(cached)) return cached;
+    }
+
     ScmRegexp *rx = make_regexp();
     regcomp_ctx cctx;
     rc_ctx_init(&cctx, rx, pattern);
@@ -2255,7 +2510,9 @@ ScmObj Scm_RegComp(ScmString *pattern, int flags)
     ast = rc2_optimize(ast, SCM_NIL);
 
     /* pass 3 : generate bytecode */
-    return rc3(&cctx, ast);
+    ScmObj r = rc3(&cctx, ast);
+    rx_cache_put(pattern, foldp, r);
+    return r;
 }
 
 /* alternative entry that compiles from AST */
@@ -2781,34 +3038,62 @@ static ScmObj make_match(ScmRegexp *rx, ScmString *orig,
     return SCM_OBJ(rm);
 }
 
-static ScmObj rex(ScmRegexp *rx, ScmString *orig,
-                  const char *start, const char *end)
+/* Set up N submatch records in SUBS, and pointers to them in M. */
+static void init_submatches(struct ScmRegMatchSub **m,
+                            struct ScmRegMatchSub *subs, int n)
 {
-    struct match_ctx ctx;
-    sigjmp_buf cont;
+    for (int i = 0; i < n; i++) {
+        m[i] = &subs[i];
+        subs[i].start = -1;
+        subs[i].length = -1;
+        subs[i].after = -1;
+        subs[i].startp = NULL;
+        subs[i].endp = NULL;
+    }
+}
 
-    ctx.rx = rx;
-    ctx.codehead = rx->code;
-    ctx.input = SCM_STRING_BODY_START(SCM_STRING_BODY(orig));
-    ctx.stop = end;
-    ctx.begin_stack = (void*)&ctx;
-    ctx.cont = &cont;
-    ctx.matches = SCM_NEW_ARRAY(struct ScmRegMatchSub *, rx->numGroups);
+/* Allocates submatch records for a match object.  We allocate all of
+   them in one chunk, instead of one by one. */
+static struct ScmRegMatchSub **alloc_submatches(int n)
+{
+    struct ScmRegMatchSub **m = SCM_NEW_ARRAY(struct ScmRegMatchSub *, n);
+    init_submatches(m, SCM_NEW_ARRAY(struct ScmRegMatchSub, n), n);
+    return m;
+}
 
-    for (int i = 0; i < rx->numGroups; i++) {
-        ctx.matches[i] = SCM_NEW(struct ScmRegMatchSub);
-        ctx.matches[i]->start = -1;
-        ctx.matches[i]->length = -1;
-        ctx.matches[i]->after = -1;
-        ctx.matches[i]->startp = NULL;
-        ctx.matches[i]->endp = NULL;
+/* INPUT and END delimits the region we're looking at; the
+   assertions such as ^ and \b sees INPUT as the beginning of the input.
+   MATCHES must have rx->numGroups submatches; it is reused for every
+   position we try. */
+static void rex_init(struct match_ctx *ctx, ScmRegexp *rx,
+                     const char *input, const char *end,
+                     struct ScmRegMatchSub **matches)
+{
+    ctx->rx = rx;
+    ctx->codehead = rx->code;
+    ctx->input = input;
+    ctx->stop = end;
+    ctx->matches = matches;
+}
+
+/* START is the position to try the match.  Returns TRUE if matched,
+   leaving the submatches in ctx->matches. */
+static int rex(struct match_ctx *ctx, const char *start)
+{
+    sigjmp_buf cont;
+
+    ctx->begin_stack = (void*)&cont;
+    ctx->cont = &cont;
+    for (int i = 0; i < ctx->rx->numGroups; i++) {
+        ctx->matches[i]->startp = NULL;
+        ctx->matches[i]->endp = NULL;
     }
 
     if (sigsetjmp(cont, FALSE) == 0) {
-        rex_rec(ctx.codehead, start, &ctx);
-        return SCM_FALSE;
+        rex_rec(ctx->codehead, start, ctx);
+        return FALSE;
     }
-    return make_match(rx, orig, &ctx);
+    return TRUE;
 }
 
 /* advance start pointer while the character matches (skip_match=TRUE) or does
@@ -2829,21 +3114,673 @@ static inline const char *skip_input(const char *start, const char *limit,
     return limit;
 }
 
+/* Returns the first position in [start, limit) where a match can begin,
+   or LIMIT if there's none.  Must be called only if rx->lamap is set. */
+static inline const char *scan_laset(ScmRegexp *rx, const char *start,
+                                     const char *limit)
+{
+    if (rx->laprefixLen > 0) {
+        while (start < limit) {
+            const char *p = memchr(start, rx->laprefix[0], limit - start);
+            if (p == NULL) return limit;
+            if (rx->laprefixLen == 1 || p+1 == limit
+                || (u_char)p[1] == rx->laprefix[1]) {
+                return p;
+            }
+            start = p+1;
+        }
+        return limit;
+    }
+
+    const u_char *map = rx->lamap;
+    while (start < limit) {
+        u_char b = (u_char)*start;
+        if (!map[b]) {
+            start++;
+        } else if (b < 128) {
+            return start;
+        } else {
+            ScmChar ch;
+            SCM_CHAR_GET(start, ch);
+            if (Scm_CharSetContains(SCM_CHAR_SET(rx->laset), ch)) return start;
+            start += SCM_CHAR_NFOLLOWS(b) + 1;
+        }
+    }
+    return limit;
+}
+
+/*----------------------------------------------------------------------
+ * Non-backtracking matcher
+ */
+
+/* If the compiled code doesn't use backreferences, assertions,
+   conditional patterns, standalone patterns or word boundaries, the
+   backtracking matcher isn't necessary.  For such regexps we run the
+   code as an NFA, Thompson-style, instead.  It takes time proportional
+   to the length of the input times the size of the code, regardless
+   of the pattern; patterns like #/(a|aa)*c/ would take exponential
+   time with rex_rec.
+
+   A state of the NFA is a position in the code.  The literal string
+   instructions (MATCH, MATCH_CI and MATCHR) have a state for each
+   character boundary in their argument; the state of matching K bytes
+   into the literal of the instruction at PC is represented by PC+2+K,
+   which is the position of the K-th byte of the literal and never used
+   by other instructions.  The `owner' table maps a state to the
+   position of the instruction it belongs to.
+
+   The *R instructions are treated as greedy loops.  They're only
+   generated when the optimizer determines the following pattern can't
+   start with the character the loop consumes, in which case the
+   greedy loop and the possessive loop match the same.
+
+   Searching is done in two steps.  First we run a lazily constructed
+   DFA, whose states are sets of NFA states, to see if there's any
+   match at all.  DFA states and transitions on ASCII characters are
+   cached in the automaton, so after warming up, rejecting an input
+   costs one table lookup per character.  If there's a match, we run
+   the NFA with submatch tracking (so called Pike VM) to find the
+   leftmost match with the same priority rules as rex_rec.
+*/
+
+#define DFA_MAX_STATES  256
+#define DFA_HASH_SIZE   64
+
+typedef struct dfa_state_rec {
+    struct dfa_state_rec *next[128]; /* transition cache for ASCII chars */
+    struct dfa_state_rec *chain;     /* hash chain */
+    u_long hashval;
+    int accept;                 /* TRUE if the set contains SUCCESS */
+    int eolAccept;              /* TRUE/FALSE if we accept at the end of
+                                   input, -1 if not computed yet. */
+    int numIds;
+    int ids[1];                 /* sorted NFA state ids */
+} dfa_state;
+
+typedef struct ScmRegexpAutomatonRec {
+    int numIds;                 /* == rx->numCodes */
+    int *owner;                 /* state id -> insn position */
+    int maxThreads;             /* max # of states a thread can be in */
+    int unanchored;             /* TRUE unless BOL_ANCHORED */
+
+    /* DFA.  The following slots are protected by mutex, except that
+       readers can peek next[] of existing states without locking. */
+    ScmInternalMutex mutex;
+    int overflow;               /* TRUE if we gave up building DFA */
+    int numStates;
+    dfa_state *start;
+    dfa_state *idle;            /* the state where no match is in progress;
+                                   we can skip input with scan_laset(). */
+    dfa_state *buckets[DFA_HASH_SIZE];
+    int *mark;                  /* work area to compute closures */
+    int gen;
+    int *buf;
+    int nbuf;
+} ScmRegexpAutomaton;
+
+#define RX_OFFSET(code, pc)  ((code)[(pc)+1]*256 + (code)[(pc)+2])
+
+static ScmRegexpAutomaton *rx_automaton_build(ScmRegexp *rx)
+{
+    const u_char *code = rx->code;
+    int numCodes = rx->numCodes, maxThreads = 0;
+    int *owner = SCM_NEW_ATOMIC_ARRAY(int, numCodes);
+
+    for (int pc = 0; pc < numCodes;) {
+        int len;
+        switch (code[pc]) {
+        case RE_MATCH: case RE_MATCH_CI: case RE_MATCHR:
+            len = code[pc+1] + 2;
+            maxThreads += code[pc+1];
+            break;
+        case RE_MATCH1: case RE_MATCH1_CI: case RE_MATCH1R:
+        case RE_SET: case RE_NSET: case RE_SET1: case RE_NSET1:
+        case RE_SETR: case RE_NSETR: case RE_SET1R: case RE_NSET1R:
+            len = 2; maxThreads++; break;
+        case RE_ANY: case RE_ANYR: case RE_SUCCESS: case RE_EOL:
+            len = 1; maxThreads++; break;
+        case RE_BEGIN: case RE_END:
+            len = 2; break;
+        case RE_TRY: case RE_JUMP:
+            len = 3; break;
+        case RE_BOL: case RE_FAIL:
+            len = 1; break;
+        default:
+            return NULL;        /* we need backtracking */
+        }
+        for (int i = 0; i < len; i++) owner[pc+i] = pc;
+        pc += len;
+    }
+
+    ScmRegexpAutomaton *a = SCM_NEW(ScmRegexpAutomaton);
+    a->numIds = numCodes;
+    a->owner = owner;
+    a->maxThreads = maxThreads;
+    a->unanchored = !(rx->flags & SCM_REGEXP_BOL_ANCHORED);
+    SCM_INTERNAL_MUTEX_INIT(a->mutex);
+    a->overflow = FALSE;
+    a->numStates = 0;
+    a->start = NULL;
+    a->idle = NULL;
+    for (int i = 0; i < DFA_HASH_SIZE; i++) a->buckets[i] = NULL;
+    a->mark = SCM_NEW_ATOMIC_ARRAY(int, numCodes);
+    for (int i = 0; i < numCodes; i++) a->mark[i] = 0;
+    a->gen = 0;
+    a->buf = SCM_NEW_ATOMIC_ARRAY(int, numCodes);
+    a->nbuf = 0;
+    return a;
+}
+
+/* Consumes a character CH, whose byte sequence is [p, p+len), at state ID.
+   Returns the state to proceed, or -1 if the state can't accept CH.
+   ID must be a state that consumes input. */
+static int nfa_step(ScmRegexp *rx, int id, ScmChar ch, const char *p, int len)
+{
+    const u_char *code = rx->code;
+    int pc = rx->automaton->owner[id];
+    int k = (id == pc)? 0 : id - pc - 2;
+
+    switch (code[pc]) {
+    case RE_MATCH1:
+        return (len == 1 && code[pc+1] == (u_char)*p)? pc+2 : -1;
+    case RE_MATCH1_CI:
+        return (len == 1 && code[pc+1] == SCM_CHAR_DOWNCASE((u_char)*p))
+            ? pc+2 : -1;
+    case RE_MATCH1R:
+        return (len == 1 && code[pc+1] == (u_char)*p)? pc : -1;
+    case RE_MATCH: case RE_MATCHR: {
+        int n = code[pc+1];
+        if (k + len > n || memcmp(code+pc+2+k, p, len) != 0) return -1;
+        k += len;
+        if (k < n) return pc+2+k;
+        return (code[pc] == RE_MATCH)? pc+2+n : pc;
+    }
+    case RE_MATCH_CI: {
+        int n = code[pc+1];
+        ScmChar c;
+        SCM_CHAR_GET(code+pc+2+k, c);
+        if (Scm_CharDowncase(ch) != c) return -1;
+        k += SCM_CHAR_NBYTES(c);
+        return (k < n)? pc+2+k : pc+2+n;
+    }
+    case RE_ANY:
+        return pc+1;
+    case RE_ANYR:
+        return pc;
+    case RE_SET1:
+        return (ch < 128 && Scm_CharSetContains(rx->sets[code[pc+1]], ch))
+            ? pc+2 : -1;
+    case RE_SET1R:
+        return (ch < 128 && Scm_CharSetContains(rx->sets[code[pc+1]], ch))
+            ? pc : -1;
+    case RE_NSET1:
+        return (ch >= 128 || !Scm_CharSetContains(rx->sets[code[pc+1]], ch))
+            ? pc+2 : -1;
+    case RE_NSET1R:
+        return (ch >= 128 || !Scm_CharSetContains(rx->sets[code[pc+1]], ch))
+            ? pc : -1;
+    case RE_SET:
+        return Scm_CharSetContains(rx->sets[code[pc+1]], ch)? pc+2 : -1;
+    case RE_SETR:
+        return Scm_CharSetContains(rx->sets[code[pc+1]], ch)? pc : -1;
+    case RE_NSET:
+        return Scm_CharSetContains(rx->sets[code[pc+1]], ch)? -1 : pc+2;
+    case RE_NSETR:
+        return Scm_CharSetContains(rx->sets[code[pc+1]], ch)? -1 : pc;
+    default:
+        return -1;              /* SUCCESS, or pending EOL */
+    }
+}
+
+/* Collects the states reachable from ID without consuming input into
+   a->buf.  EOL states are kept in the set unless ATEOL, so that we can
+   check them when we reach the end of input.  Must be called with
+   a->mutex held. */
+static void dfa_closure(ScmRegexp *rx, int id, int atbol, int ateol)
+{
+    ScmRegexpAutomaton *a = rx->automaton;
+    const u_char *code = rx->code;
+
+    for (;;) {
+        if (a->mark[id] == a->gen) return;
+        a->mark[id] = a->gen;
+        if (a->owner[id] != id) {
+            a->buf[a->nbuf++] = id;
+            return;
+        }
+        switch (code[id]) {
+        case RE_JUMP:
+            id = RX_OFFSET(code, id);
+            continue;
+        case RE_TRY:
+            dfa_closure(rx, id+3, atbol, ateol);
+            id = RX_OFFSET(code, id);
+            continue;
+        case RE_BEGIN: case RE_END:
+            id += 2;
+            continue;
+        case RE_BOL:
+            if (!atbol) return;
+            id++;
+            continue;
+        case RE_EOL:
+            if (!ateol) { a->buf[a->nbuf++] = id; return; }
+            id++;
+            continue;
+        case RE_FAIL:
+            return;
+        case RE_SET1R: case RE_NSET1R: case RE_SETR: case RE_NSETR:
+        case RE_MATCH1R:
+            a->buf[a->nbuf++] = id;
+            id += 2;
+            continue;
+        case RE_ANYR:
+            a->buf[a->nbuf++] = id;
+            id++;
+            continue;
+        case RE_MATCHR:
+            a->buf[a->nbuf++] = id;
+            id += code[id+1] + 2;
+            continue;
+        default:
+            a->buf[a->nbuf++] = id;
+            return;
+        }
+    }
+}
+
+static int dfa_id_compare(const void *x, const void *y)
+{
+    return *(const int*)x - *(const int*)y;
+}
+
+/* Returns the DFA state for the NFA state set in a->buf, creating one
+   if necessary.  Returns NULL if we have too many DFA states.
+   Must be called with a->mutex held. */
+static dfa_state *dfa_intern(ScmRegexp *rx)
+{
+    ScmRegexpAutomaton *a = rx->automaton;
+    int n = a->nbuf;
+    u_long h = n;
+
+    qsort(a->buf, n, sizeof(int), dfa_id_compare);
+    for (int i = 0; i < n; i++) h = h*31 + a->buf[i];
+    for (dfa_state *s = a->buckets[h % DFA_HASH_SIZE]; s; s = s->chain) {
+        if (s->hashval == h && s->numIds == n
+            && memcmp(s->ids, a->buf, n*sizeof(int)) == 0) {
+            return s;
+        }
+    }
+    if (a->numStates >= DFA_MAX_STATES) {
+        a->overflow = TRUE;
+        return NULL;
+    }
+
+    dfa_state *s = SCM_NEW2(dfa_state*, sizeof(dfa_state)+n*sizeof(int));
+    for (int i = 0; i < 128; i++) s->next[i] = NULL;
+    s->hashval = h;
+    s->accept = FALSE;
+    s->eolAccept = -1;
+    s->numIds = n;
+    for (int i = 0; i < n; i++) {
+        s->ids[i] = a->buf[i];
+        if (a->owner[s->ids[i]] == s->ids[i]
+            && rx->code[s->ids[i]] == RE_SUCCESS) {
+            s->accept = TRUE;
+        }
+    }
+    s->chain = a->buckets[h % DFA_HASH_SIZE];
+    a->buckets[h % DFA_HASH_SIZE] = s;
+    a->numStates++;
+    return s;
+}
+
+/* Must be called with a->mutex held. */
+static dfa_state *dfa_transit(ScmRegexp *rx, dfa_state *s,
+                              ScmChar ch, const char *p, int len)
+{
+    ScmRegexpAutomaton *a = rx->automaton;
+
+    a->gen++;
+    a->nbuf = 0;
+    for (int i = 0; i < s->numIds; i++) {
+        int nid = nfa_step(rx, s->ids[i], ch, p, len);
+        if (nid >= 0) dfa_closure(rx, nid, FALSE, FALSE);
+    }
+    if (a->unanchored) dfa_closure(rx, 0, FALSE, FALSE);
+    return dfa_intern(rx);
+}
+
+/* Must be called with a->mutex held. */
+static int dfa_accept_at_end(ScmRegexp *rx, dfa_state *s, int atbol)
+{
+    ScmRegexpAutomaton *a = rx->automaton;
+
+    if (s->accept) return TRUE;
+    if (!atbol && s->eolAccept >= 0) return s->eolAccept;
+
+    int r = FALSE;
+    a->gen++;
+    a->nbuf = 0;
+    for (int i = 0; i < s->numIds; i++) {
+        int id = s->ids[i];
+        if (a->owner[id] == id && rx->code[id] == RE_EOL) {
+            dfa_closure(rx, id+1, atbol, TRUE);
+        }
+    }
+    for (int i = 0; i < a->nbuf; i++) {
+        if (a->owner[a->buf[i]] == a->buf[i]
+            && rx->code[a->buf[i]] == RE_SUCCESS) {
+            r = TRUE;
+            break;
+        }
+    }
+    if (!atbol) s->eolAccept = r;
+    return r;
+}
+
+/* Returns 1 if RX matches somewhere in [start, end), 0 if it doesn't,
+   or -1 if the DFA grew too large and we can't tell. */
+static int dfa_search(ScmRegexp *rx, const char *start, const char *end)
+{
+    ScmRegexpAutomaton *a = rx->automaton;
+    dfa_state *s, *next;
+    const char *p = start;
+    int r;
+
+    if (a->overflow) return -1;
+    if ((s = a->start) == NULL) {
+        (void)SCM_INTERNAL_MUTEX_LOCK(a->mutex);
+        if ((s = a->start) == NULL) {
+            a->gen++;
+            a->nbuf = 0;
+            dfa_closure(rx, 0, TRUE, FALSE);
+            s = dfa_intern(rx);
+            if (s && a->unanchored && rx->lamap) {
+                a->gen++;
+                a->nbuf = 0;
+                dfa_closure(rx, 0, FALSE, FALSE);
+                a->idle = dfa_intern(rx);
+            }
+            a->start = s;
+        }
+        (void)SCM_INTERNAL_MUTEX_UNLOCK(a->mutex);
+        if (s == NULL) return -1;
+    }
+
+    while (p < end) {
+        if (s->accept) return 1;
+        if (s->numIds == 0) return 0;
+        if (s == a->idle) {
+            p = scan_laset(rx, p, end);
+            if (p == end) break;
+        }
+        u_char b = (u_char)*p;
+        if (b < 128) {
+            if ((next = s->next[b]) == NULL) {
+                (void)SCM_INTERNAL_MUTEX_LOCK(a->mutex);
+                if ((next = s->next[b]) == NULL) {
+                    next = dfa_transit(rx, s, b, p, 1);
+                    s->next[b] = next;
+                }
+                (void)SCM_INTERNAL_MUTEX_UNLOCK(a->mutex);
+                if (next == NULL) return -1;
+            }
+            p++;
+        } else {
+            ScmChar ch;
+            int len = SCM_CHAR_NFOLLOWS(b) + 1;
+            if (len > end - p) len = (int)(end - p);
+            SCM_CHAR_GET(p, ch);
+            (void)SCM_INTERNAL_MUTEX_LOCK(a->mutex);
+            next = dfa_transit(rx, s, ch, p, len);
+            (void)SCM_INTERNAL_MUTEX_UNLOCK(a->mutex);
+            if (next == NULL) return -1;
+            p += len;
+        }
+        s = next;
+    }
+    (void)SCM_INTERNAL_MUTEX_LOCK(a->mutex);
+    r = dfa_accept_at_end(rx, s, p == start);
+    (void)SCM_INTERNAL_MUTEX_UNLOCK(a->mutex);
+    return r;
+}
+
+/* Pike VM.  Each thread carries its own submatch positions.  Threads
+   are kept in the order of priority; the thread earlier in the list
+   corresponds to the choice rex_rec would try first. */
+struct pike_thread {
+    int id;
+    const char **caps;          /* startp and endp of each group */
+};
+
+struct pike_list {
+    int n;
+    struct pike_thread *threads;
+};
+
+struct pike_ctx {
+    ScmRegexp *rx;
+    const char *input;
+    const char *stop;
+    int ncaps;
+    int *mark;
+    int gen;
+};
+
+static void pike_list_init(struct pike_ctx *ctx, struct pike_list *l)
+{
+    int nt = ctx->rx->automaton->maxThreads;
+    const char **caps = SCM_NEW_ATOMIC_ARRAY(const char *, nt*ctx->ncaps);
+    l->n = 0;
+    l->threads = SCM_NEW_ATOMIC_ARRAY(struct pike_thread, nt);
+    for (int i = 0; i < nt; i++) l->threads[i].caps = caps + i*ctx->ncaps;
+}
+
+static void pike_push(struct pike_ctx *ctx, struct pike_list *l,
+                      int id, const char **caps)
+{
+    struct pike_thread *t = &l->threads[l->n++];
+    t->id = id;
+    memcpy(t->caps, caps, ctx->ncaps * sizeof(const char *));
+}
+
+/* Adds the states reachable from ID at input position POS to L.
+   CAPS is modified during the call but restored on return. */
+static void pike_add(struct pike_ctx *ctx, struct pike_list *l, int id,
+                     const char **caps, const char *pos)
+{
+    ScmRegexpAutomaton *a = ctx->rx->automaton;
+    const u_char *code = ctx->rx->code;
+
+    for (;;) {
+        if (ctx->mark[id] == ctx->gen) return;
+        ctx->mark[id] = ctx->gen;
+        if (a->owner[id] != id) {
+            pike_push(ctx, l, id, caps);
+            return;
+        }
+        switch (code[id]) {
+        case RE_JUMP:
+            id = RX_OFFSET(code, id);
+            continue;
+        case RE_TRY:
+            pike_add(ctx, l, id+3, caps, pos);
+            id = RX_OFFSET(code, id);
+            continue;
+        case RE_BEGIN: case RE_END: {
+            int slot = code[id+1]*2 + (code[id] == RE_END);
+            const char *saved = caps[slot];
+            caps[slot] = pos;
+            pike_add(ctx, l, id+2, caps, pos);
+            caps[slot] = saved;
+            return;
+        }
+        case RE_BOL:
+            if (pos != ctx->input) return;
+            id++;
+            continue;
+        case RE_EOL:
+            if (pos != ctx->stop) return;
+            id++;
+            continue;
+        case RE_FAIL:
+            return;
+        case RE_SET1R: case RE_NSET1R: case RE_SETR: case RE_NSETR:
+        case RE_MATCH1R:
+            pike_push(ctx, l, id, caps);
+            id += 2;
+            continue;
+        case RE_ANYR:
+            pike_push(ctx, l, id, caps);
+            id++;
+            continue;
+        case RE_MATCHR:
+            pike_push(ctx, l, id, caps);
+            id += code[id+1] + 2;
+            continue;
+        default:
+            pike_push(ctx, l, id, caps);
+            return;
+        }
+    }
+}
+
+static ScmObj pike_search(ScmRegexp *rx, ScmString *orig,
+                          const char *start, const char *end)
+{
+    ScmRegexpAutomaton *a = rx->automaton;
+    struct pike_ctx ctx;
+    struct pike_list l0, l1, *clist = &l0, *nlist = &l1;
+    const char *sp = start;
+    int matched = FALSE;
+
+    ctx.rx = rx;
+    ctx.input = start;
+    ctx.stop = end;
+    ctx.ncaps = rx->numGroups * 2;
+    ctx.mark = SCM_NEW_ATOMIC_ARRAY(int, a->numIds);
+    for (int i = 0; i < a->numIds; i++) ctx.mark[i] = 0;
+    ctx.gen = 1;
+    pike_list_init(&ctx, &l0);
+    pike_list_init(&ctx, &l1);
+
+    const char **work = SCM_NEW_ATOMIC_ARRAY(const char *, ctx.ncaps);
+    const char **found = SCM_NEW_ATOMIC_ARRAY(const char *, ctx.ncaps);
+    for (int i = 0; i < ctx.ncaps; i++) work[i] = NULL;
+
+    pike_add(&ctx, clist, 0, work, sp);
+    for (;;) {
+        ScmChar ch = 0;
+        const char *nsp = sp;
+        int len = 0;
+
+        if (sp < end) {
+            len = SCM_CHAR_NFOLLOWS(*sp) + 1;
+            if (len > end - sp) len = (int)(end - sp);
+            SCM_CHAR_GET(sp, ch);
+            nsp = sp + len;
+        }
+        ctx.gen++;
+        nlist->n = 0;
+        for (int i = 0; i < clist->n; i++) {
+            struct pike_thread *t = &clist->threads[i];
+            if (a->owner[t->id] == t->id && rx->code[t->id] == RE_SUCCESS) {
+                /* Found a match.  Threads with lower priority are
+                   discarded. */
+                memcpy(found, t->caps, ctx.ncaps * sizeof(const char *));
+                matched = TRUE;
+                break;
+            }
+            if (sp < end) {
+                int nid = nfa_step(rx, t->id, ch, sp, len);
+                if (nid >= 0) pike_add(&ctx, nlist, nid, t->caps, nsp);
+            }
+        }
+        if (sp >= end) break;
+        if (!matched && a->unanchored) {
+            /* If no thread is alive, we can skip to the next position
+               where a match can begin. */
+            if (nlist->n == 0 && rx->lamap) nsp = scan_laset(rx, nsp, end);
+            pike_add(&ctx, nlist, 0, work, nsp);
+        }
+        if (nlist->n == 0 && (matched || !a->unanchored)) break;
+        struct pike_list *tmp = clist; clist = nlist; nlist = tmp;
+        sp = nsp;
+    }
+    if (!matched) return SCM_FALSE;
+
+    struct match_ctx mctx;
+    mctx.rx = rx;
+    mctx.matches = alloc_submatches(rx->numGroups);
+    for (int i = 0; i < rx->numGroups; i++) {
+        mctx.matches[i]->startp = found[i*2];
+        mctx.matches[i]->endp = found[i*2+1];
+    }
+    return make_match(rx, orig, &mctx);
+}
+
+/*----------------------------------------------------------------------
+ * literal alternation (see rc3_setup_literals)
+ */
+static ScmObj literals_search(ScmRegexp *rx, ScmString *orig,
+                              const char *start, const char *end,
+                              int matchp)
+{
+    const char *mstart, *mend;
+    if (Scm_StringSearcherFind(rx->literals, start, end,
+                               &mstart, &mend) < 0) {
+        return SCM_FALSE;
+    }
+    if (matchp) return SCM_TRUE;
+    struct match_ctx mctx;
+    mctx.rx = rx;
+    mctx.matches = alloc_submatches(1);
+    mctx.matches[0]->startp = mstart;
+    mctx.matches[0]->endp = mend;
+    return make_match(rx, orig, &mctx);
+}
+
 /*----------------------------------------------------------------------
  * entry point
  */
-ScmObj Scm_RegExec(ScmRegexp *rx, ScmString *str)
+/* Max # of groups for which we keep submatches on the stack when we
+   don't need a match object. */
+#define REX_LOCAL_GROUPS  8
+
+/* Returns a match object or #f.  If MATCHP is TRUE, we're only
+   interested in whether RX matches or not; we return #t or #f,
+   and avoid allocating a match object as much as possible. */
+static ScmObj rex_search(ScmRegexp *rx, ScmString *str,
+                         const char *start, const char *end, int matchp)
 {
-    const ScmStringBody *b = SCM_STRING_BODY(str);
-    const char *start = SCM_STRING_BODY_START(b);
-    const char *end = start + SCM_STRING_BODY_SIZE(b);
+    const char *input = start;
     const ScmStringBody *mb = rx->mustMatch? SCM_STRING_BODY(rx->mustMatch) : NULL;
     int mustMatchLen = mb? SCM_STRING_BODY_SIZE(mb) : 0;
     const char *start_limit = end - mustMatchLen;
 
-    if (SCM_STRING_INCOMPLETE_P(str)) {
-        Scm_Error("incomplete string is not allowed: %S", str);
+    if (rx->literals) {
+        return literals_search(rx, str, start, end, matchp);
+    }
+    if (rx->automaton) {
+        int r = dfa_search(rx, start, end);
+        if (r == 0) return SCM_FALSE;
+        if (matchp && r > 0) return SCM_TRUE;
+        ScmObj m = pike_search(rx, str, start, end);
+        if (matchp) return SCM_MAKE_BOOL(!SCM_FALSEP(m));
+        return m;
     }
+
+    struct match_ctx ctx;
+    struct ScmRegMatchSub *lmatches[REX_LOCAL_GROUPS];
+    struct ScmRegMatchSub lsubs[REX_LOCAL_GROUPS];
+    if (matchp && rx->numGroups <= REX_LOCAL_GROUPS) {
+        init_submatches(lmatches, lsubs, rx->numGroups);
+        rex_init(&ctx, rx, input, end, lmatches);
+    } else {
+        rex_init(&ctx, rx, input, end, alloc_submatches(rx->numGroups));
+    }
+
 #if 0
     /* Disabled for now; we need to use more heuristics to determine
        when we should apply mustMatch.  For example, if the regexp
@@ -2861,25 +3798,28 @@ ScmObj Scm_RegExec(ScmRegexp *rx, ScmString *str)
     /* short cut : if rx matches only at the beginning of the string,
        we only run from the beginning of the string */
     if (rx->flags & SCM_REGEXP_BOL_ANCHORED) {
-        return rex(rx, str, start, end);
+        if (rex(&ctx, start)) goto found;
+        return SCM_FALSE;
     }
 
     /* if we have lookahead-set, we may be able to skip input efficiently. */
     if (!SCM_FALSEP(rx->laset)) {
         if (rx->flags & SCM_REGEXP_SIMPLE_PREFIX) {
             while (start <= start_limit) {
-                ScmObj r = rex(rx, str, start, end);
-                if (!SCM_FALSEP(r)) return r;
+                if (rex(&ctx, start)) goto found;
                 const char *next = skip_input(start, start_limit, rx->laset,
                                               TRUE);
                 if (start != next) start = next;
                 else start = next + SCM_CHAR_NFOLLOWS(*start) + 1;
+                if (rx->lamap && start < start_limit) {
+                    start = scan_laset(rx, start, start_limit);
+                }
             }
         } else {
             while (start <= start_limit) {
-                start = skip_input(start, start_limit, rx->laset, FALSE);
-                ScmObj r = rex(rx, str, start, end);
-                if (!SCM_FALSEP(r)) return r;
+                if (rx->lamap) start = scan_laset(rx, start, start_limit);
+                else start = skip_input(start, start_limit, rx->laset, FALSE);
+                if (rex(&ctx, start)) goto found;
                 start += SCM_CHAR_NFOLLOWS(*start)+1;
             }
         }
@@ -2888,11 +3828,67 @@ ScmObj Scm_RegExec(ScmRegexp *rx, ScmString *str)
 
     /* normal matching */
     while (start <= start_limit) {
-        ScmObj r = rex(rx, str, start, end);
-        if (!SCM_FALSEP(r)) return r;
+        if (rex(&ctx, start)) goto found;
         start += SCM_CHAR_NFOLLOWS(*start)+1;
     }
     return SCM_FALSE;
+
+ found:
+    if (matchp) return SCM_TRUE;
+    return make_match(rx, str, &ctx);
+}
+
+ScmObj Scm_RegExec(ScmRegexp *rx, ScmString *str)
+{
+    const ScmStringBody *b = SCM_STRING_BODY(str);
+    const char *start = SCM_STRING_BODY_START(b);
+    const char *end = start + SCM_STRING_BODY_SIZE(b);
+
+    if (SCM_STRING_BODY_INCOMPLETE_P(b)) {
+        Scm_Error("incomplete string is not allowed: %S", str);
+    }
+    return rex_search(rx, str, start, end, FALSE);
+}
+
+/* Match against a region of STR.  START and END can be an index,
+   a string cursor, or #f/unbound/undefined to indicate the default.
+   The region is treated as if it is the entire input as far as
+   assertions are concerned, but the positions of the match are
+   relative to the entire STR. */
+static ScmObj rex_search_range(ScmRegexp *rx, ScmString *str,
+                               ScmObj start, ScmObj end, int matchp)
+{
+    const ScmStringBody *b = SCM_STRING_BODY(str);
+    const char *sp = SCM_STRING_BODY_START(b);
+    const char *ep = sp + SCM_STRING_BODY_SIZE(b);
+
+    if (SCM_STRING_BODY_INCOMPLETE_P(b)) {
+        Scm_Error("incomplete string is not allowed: %S", str);
+    }
+    if (!(SCM_UNBOUNDP(end) || SCM_UNDEFINEDP(end) || SCM_FALSEP(end))) {
+        ep = sp + Scm__StringCursorOffset(b, end);
+    }
+    if (!(SCM_UNBOUNDP(start) || SCM_UNDEFINEDP(start) || SCM_FALSEP(start))) {
+        sp += Scm__StringCursorOffset(b, start);
+    }
+    if (sp > ep) {
+        Scm_Error("start position %S is greater than end position %S",
+                  start, end);
+    }
+    return rex_search(rx, str, sp, ep, matchp);
+}
+
+ScmObj Scm_RegExecRange(ScmRegexp *rx, ScmString *str,
+                        ScmObj start, ScmObj end)
+{
+    return rex_search_range(rx, str, start, end, FALSE);
+}
+
+/* Returns TRUE iff RX matches STR, without creating a match object.
+   START and END are the same as Scm_RegExecRange. */
+int Scm_RegMatchP(ScmRegexp *rx, ScmString *str, ScmObj start, ScmObj end)
+{
+    return !SCM_FALSEP(rex_search_range(rx, str, start, end, TRUE));
 }
 
 /*=======================================================================
@@ -3057,6 +4053,22 @@ ScmObj Scm_RegMatchAfter(ScmRegMatch *rm, ScmObj obj)
                           sub->after, 0);
 }
 
+/* Returns string cursors instead of indexes.  They don't need to count
+   characters. */
+ScmObj Scm_RegMatchStartCursor(ScmRegMatch *rm, ScmObj obj)
+{
+    struct ScmRegMatchSub *sub = regmatch_ref(rm, obj);
+    if (sub == NULL) return SCM_FALSE;
+    return Scm__MakeStringCursor(MSUB_BEFORE_SIZE(rm, sub));
+}
+
+ScmObj Scm_RegMatchEndCursor(ScmRegMatch *rm, ScmObj obj)
+{
+    struct ScmRegMatchSub *sub = regmatch_ref(rm, obj);
+    if (sub == NULL) return SCM_FALSE;
+    return Scm__MakeStringCursor(sub->endp - rm->input);
+}
+
 /* for debug */
 void Scm_RegMatchDump(ScmRegMatch *rm)
 {
@@ -3084,4 +4096,7 @@ void Scm_RegMatchDump(ScmRegMatch *rm)
 
 void Scm__InitRegexp(void)
 {
+    Scm_HashCoreInitSimple(&rx_cache.table, SCM_HASH_STRING, 0, NULL);
+    rx_cache.head = rx_cache.tail = NULL;
+    (void)SCM_INTERNAL_MUTEX_INIT(rx_cache.mutex);
 }
@@ -767,3 +767,13 @@ The module @code{data.ideque} is compatible to srfi-134.
 変更不可な両端キュー
 モジュール@code{data.ideque}がsrfi-134と互換です。
 @ref{変更不可な両端キュー}参照。
+
+
+srfi-171, srfi-171
+()
+
+Transducers
+Supported by the module @code{srfi-171}.  @xref{Transducers}.
+
+トランスデューサ
+モジュール@code{srfi-171}でサポートされます。 @ref{トランスデューサ}参照。
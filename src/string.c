@@ -72,6 +72,7 @@ static ScmString *make_str(ScmSmallInt len, ScmSmallInt siz,
     s->initialBody.length = len;
     s->initialBody.size = siz;
     s->initialBody.start = p;
+    s->initialBody.index = NULL;
     return s;
 }
 
@@ -318,7 +319,10 @@ ScmObj Scm_CopyStringWithFlags(ScmString *x, int flags, int mask)
     int newflags = ((SCM_STRING_BODY_FLAGS(b) & ~mask)
                     | (flags & mask));
 
-    return SCM_OBJ(make_str(len, size, start, newflags));
+    ScmString *s = make_str(len, size, start, newflags);
+    /* The copy shares the content, so it can share the index as well. */
+    s->initialBody.index = b->index;
+    return SCM_OBJ(s);
 }
 
 ScmObj Scm_StringCompleteToIncomplete(ScmString *x)
@@ -429,10 +433,174 @@ int Scm_StringCmp(ScmString *x, ScmString *y)
     }
 }
 
+/*
+ * Word-at-a-time ASCII operations
+ *
+ *   Text is often mostly ASCII, so case insensitive comparison and
+ *   case conversion look at a machine word of the string body at a time.
+ *   A word without high bits consists of ASCII characters in every
+ *   supported encoding, as long as it starts at a character boundary.
+ *   The letters in it can be found by adding a constant to each byte,
+ *   since an ASCII byte never carries into the next one.
+ */
+#define WORD_SIZE   sizeof(u_long)
+#define WORD_ONES   (~0UL/0xff)         /* 0x01 in every byte */
+#define WORD_HIGHS  (WORD_ONES*0x80)    /* 0x80 in every byte */
+
+static inline u_long load_word(const char *p)
+{
+    u_long w;
+    memcpy(&w, p, WORD_SIZE);
+    return w;
+}
+
+/* Returns a word that has 0x80 in the bytes of W which are ASCII
+   characters between LO and HI, and 0 in other bytes. */
+static inline u_long word_range_mask(u_long w, int lo, int hi)
+{
+    u_long h = w & ~WORD_HIGHS;
+    u_long ge = h + WORD_ONES*(0x80 - lo);  /* high bit set if h >= lo */
+    u_long gt = h + WORD_ONES*(0x7f - hi);  /* high bit set if h > hi */
+    return ge & ~gt & ~w & WORD_HIGHS;
+}
+
+static inline u_long word_downcase(u_long w)
+{
+    return w | (word_range_mask(w, 'A', 'Z') >> 2);
+}
+
+static inline u_long word_upcase(u_long w)
+{
+    return w & ~(word_range_mask(w, 'a', 'z') >> 2);
+}
+
+#define ASCII_UPCASE(c)    (((c)>='a' && (c)<='z')? (c)-('a'-'A') : (c))
+#define ASCII_DOWNCASE(c)  (((c)>='A' && (c)<='Z')? (c)+('a'-'A') : (c))
+
+/*
+ * Vector versions
+ *
+ *   With SSE2 (always there on x86_64) or NEON (AArch64), the same
+ *   operations are done 16 bytes at a time, before the word loops
+ *   take over the rest.  Both are in the baseline instruction sets,
+ *   so we don't need the runtime dispatch of ext/uvector/uvsimd.c.
+ *   The bytes beyond ASCII are never taken as letters.
+ */
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define VEC_ASCII_SSE2 1
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define VEC_ASCII_NEON 1
+#endif
+
+#if defined(VEC_ASCII_SSE2) || defined(VEC_ASCII_NEON)
+#define VEC_ASCII   1
+#define VEC_SIZE    16
+
+#if defined(VEC_ASCII_SSE2)
+typedef __m128i vec_t;
+
+static inline vec_t vec_load(const char *p)
+{
+    return _mm_loadu_si128((const __m128i*)p);
+}
+
+static inline void vec_store(char *p, vec_t v)
+{
+    _mm_storeu_si128((__m128i*)p, v);
+}
+
+/* 0x20 in the bytes of V between LO and HI.  The bytes beyond ASCII are
+   negative in the signed comparison. */
+static inline vec_t vec_case_bit(vec_t v, char lo, char hi)
+{
+    vec_t m = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(lo-1)),
+                            _mm_cmpgt_epi8(_mm_set1_epi8(hi+1), v));
+    return _mm_and_si128(m, _mm_set1_epi8(0x20));
+}
+
+static inline vec_t vec_downcase(vec_t v)
+{
+    return _mm_or_si128(v, vec_case_bit(v, 'A', 'Z'));
+}
+
+static inline vec_t vec_upcase(vec_t v)
+{
+    return _mm_andnot_si128(vec_case_bit(v, 'a', 'z'), v);
+}
+
+static inline int vec_ascii_p(vec_t v)
+{
+    return _mm_movemask_epi8(v) == 0;
+}
+
+static inline int vec_eq(vec_t x, vec_t y)
+{
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) == 0xffff;
+}
+#endif /*VEC_ASCII_SSE2*/
+
+#if defined(VEC_ASCII_NEON)
+typedef uint8x16_t vec_t;
+
+static inline vec_t vec_load(const char *p)
+{
+    return vld1q_u8((const uint8_t*)p);
+}
+
+static inline void vec_store(char *p, vec_t v)
+{
+    vst1q_u8((uint8_t*)p, v);
+}
+
+static inline vec_t vec_case_bit(vec_t v, char lo, char hi)
+{
+    vec_t m = vandq_u8(vcgeq_u8(v, vdupq_n_u8(lo)),
+                       vcleq_u8(v, vdupq_n_u8(hi)));
+    return vandq_u8(m, vdupq_n_u8(0x20));
+}
+
+static inline vec_t vec_downcase(vec_t v)
+{
+    return vorrq_u8(v, vec_case_bit(v, 'A', 'Z'));
+}
+
+static inline vec_t vec_upcase(vec_t v)
+{
+    return vbicq_u8(v, vec_case_bit(v, 'a', 'z'));
+}
+
+static inline int vec_ascii_p(vec_t v)
+{
+    return vmaxvq_u8(v) < 0x80;
+}
+
+static inline int vec_eq(vec_t x, vec_t y)
+{
+    return vminvq_u8(vceqq_u8(x, y)) == 0xff;
+}
+#endif /*VEC_ASCII_NEON*/
+#endif /*VEC_ASCII_SSE2 || VEC_ASCII_NEON*/
+
 /* single-byte case insensitive comparison */
 static int sb_strcasecmp(const char *px, ScmSmallInt sizx,
                          const char *py, ScmSmallInt sizy)
 {
+    /* skip the common prefix.  The bytes beyond ASCII have to be the
+       same to pass, so this doesn't depend on the locale. */
+#if defined(VEC_ASCII)
+    while (sizx >= VEC_SIZE && sizy >= VEC_SIZE
+           && vec_eq(vec_downcase(vec_load(px)), vec_downcase(vec_load(py)))) {
+        px += VEC_SIZE; sizx -= VEC_SIZE;
+        py += VEC_SIZE; sizy -= VEC_SIZE;
+    }
+#endif
+    while (sizx >= (ScmSmallInt)WORD_SIZE && sizy >= (ScmSmallInt)WORD_SIZE
+           && word_downcase(load_word(px)) == word_downcase(load_word(py))) {
+        px += WORD_SIZE; sizx -= WORD_SIZE;
+        py += WORD_SIZE; sizy -= WORD_SIZE;
+    }
     for (; sizx > 0 && sizy > 0; sizx--, sizy--, px++, py++) {
         char cx = tolower((u_char)*px);
         char cy = tolower((u_char)*py);
@@ -445,19 +613,48 @@ static int sb_strcasecmp(const char *px, ScmSmallInt sizx,
 }
 
 /* multi-byte case insensitive comparison */
-static int mb_strcasecmp(const char *px, ScmSmallInt lenx,
-                         const char *py, ScmSmallInt leny)
-{
-    int ix, iy;
-    for (; lenx > 0 && leny > 0; lenx--, leny--, px+=ix, py+=iy) {
-        int cx, cy;
+static int mb_strcasecmp(const char *px, ScmSmallInt lenx, ScmSmallInt sizx,
+                         const char *py, ScmSmallInt leny, ScmSmallInt sizy)
+{
+    const char *ex = px + sizx, *ey = py + sizy;
+    while (lenx > 0 && leny > 0) {
+#if defined(VEC_ASCII)
+        if (ex - px >= VEC_SIZE && ey - py >= VEC_SIZE) {
+            vec_t vx = vec_load(px), vy = vec_load(py);
+            if (vec_ascii_p(vx) && vec_ascii_p(vy)
+                && vec_eq(vec_upcase(vx), vec_upcase(vy))) {
+                px += VEC_SIZE; lenx -= VEC_SIZE;
+                py += VEC_SIZE; leny -= VEC_SIZE;
+                continue;
+            }
+        }
+#endif
+        if (ex - px >= (ScmSmallInt)WORD_SIZE
+            && ey - py >= (ScmSmallInt)WORD_SIZE) {
+            u_long wx = load_word(px), wy = load_word(py);
+            if (((wx|wy) & WORD_HIGHS) == 0
+                && word_upcase(wx) == word_upcase(wy)) {
+                px += WORD_SIZE; lenx -= WORD_SIZE;
+                py += WORD_SIZE; leny -= WORD_SIZE;
+                continue;
+            }
+        }
+        int cx = (u_char)*px, cy = (u_char)*py;
+        if (cx < 0x80 && cy < 0x80) {
+            int ccx = ASCII_UPCASE(cx);
+            int ccy = ASCII_UPCASE(cy);
+            if (ccx != ccy) return (ccx - ccy);
+            px++; lenx--;
+            py++; leny--;
+            continue;
+        }
         SCM_CHAR_GET(px, cx);
         SCM_CHAR_GET(py, cy);
         int ccx = SCM_CHAR_UPCASE(cx);
         int ccy = SCM_CHAR_UPCASE(cy);
         if (ccx != ccy) return (ccx - ccy);
-        ix = SCM_CHAR_NBYTES(cx);
-        iy = SCM_CHAR_NBYTES(cy);
+        px += SCM_CHAR_NBYTES(cx); lenx--;
+        py += SCM_CHAR_NBYTES(cy); leny--;
     }
     if (lenx > 0) return 1;
     if (leny > 0) return -1;
@@ -483,10 +680,45 @@ int Scm_StringCiCmp(ScmString *x, ScmString *y)
     if (sizx == lenx && sizy == leny) {
         return sb_strcasecmp(px, sizx, py, sizy);
     } else {
-        return mb_strcasecmp(px, lenx, py, leny);
+        return mb_strcasecmp(px, lenx, sizx, py, leny, sizy);
     }
 }
 
+/* If STR consists only of ASCII characters, returns a new string
+   with its letters converted to upper case (UPCASE is true) or lower
+   case.  Otherwise returns #f.  This is the fast path of the full
+   Unicode case conversion in gauche.unicode. */
+ScmObj Scm__StringAsciiCase(ScmString *str, int upcase)
+{
+    const ScmStringBody *b = SCM_STRING_BODY(str);
+    ScmSmallInt size = SCM_STRING_BODY_SIZE(b), i = 0;
+    if (SCM_STRING_BODY_INCOMPLETE_P(b)
+        || size != SCM_STRING_BODY_LENGTH(b)) return SCM_FALSE;
+
+    const char *s = SCM_STRING_BODY_START(b);
+    char *d = SCM_NEW_ATOMIC2(char*, size+1);
+#if defined(VEC_ASCII)
+    for (; i + VEC_SIZE <= size; i += VEC_SIZE) {
+        vec_t v = vec_load(s+i);
+        if (!vec_ascii_p(v)) return SCM_FALSE;
+        vec_store(d+i, upcase? vec_upcase(v) : vec_downcase(v));
+    }
+#endif
+    for (; i + (ScmSmallInt)WORD_SIZE <= size; i += WORD_SIZE) {
+        u_long w = load_word(s+i);
+        if (w & WORD_HIGHS) return SCM_FALSE;
+        w = upcase? word_upcase(w) : word_downcase(w);
+        memcpy(d+i, &w, WORD_SIZE);
+    }
+    for (; i < size; i++) {
+        int c = (u_char)s[i];
+        if (c >= 0x80) return SCM_FALSE;
+        d[i] = (char)(upcase? ASCII_UPCASE(c) : ASCII_DOWNCASE(c));
+    }
+    d[size] = '\0';
+    return Scm_MakeString(d, size, size, 0);
+}
+
 /*----------------------------------------------------------------
  * Reference
  */
@@ -501,6 +733,98 @@ static const char *forward_pos(const char *current, ScmSmallInt offset)
     return current;
 }
 
+/*
+ * String index
+ *
+ *   Indexed access to a multibyte string needs to walk from the beginning
+ *   of the string, which makes a loop of string-ref quadratic.  For long
+ *   multibyte strings, we build a sparse table that records the byte offset
+ *   of every STRING_INDEX_INTERVAL-th character, and attach it to the
+ *   string body.  Then the index -> position conversion only needs to walk
+ *   less than STRING_INDEX_INTERVAL characters.
+ *
+ *   The index is built lazily, when a long multibyte string is accessed at
+ *   a position which is far enough from the beginning.  Since the string
+ *   body is immutable, the index never gets stale.  Two threads may build
+ *   the index of the same body simultaneously; it is harmless, for both
+ *   compute the same table and the pointer assignment is atomic (we use
+ *   the same trick as get_string_from_body).
+ *
+ *   Single-byte strings and incomplete strings never need an index.
+ */
+
+#define STRING_INDEX_SHIFT     6
+#define STRING_INDEX_INTERVAL  (1L<<STRING_INDEX_SHIFT)
+#define STRING_INDEX_MASK      (STRING_INDEX_INTERVAL-1)
+
+/* We don't bother to create an index for short strings. */
+#define STRING_INDEX_THRESHOLD (4*STRING_INDEX_INTERVAL)
+
+typedef struct string_index_rec {
+    unsigned int count;         /* # of entries */
+    unsigned int offsets[1];    /* offsets[k] is the byte offset of
+                                   (k*STRING_INDEX_INTERVAL)-th character.
+                                   variable length. */
+} string_index;
+
+static inline int string_index_worthy_p(const ScmStringBody *b)
+{
+    return (SCM_STRING_BODY_LENGTH(b) >= STRING_INDEX_THRESHOLD
+            && !SCM_STRING_BODY_SINGLE_BYTE_P(b));
+}
+
+static const string_index *string_build_index(const ScmStringBody *b)
+{
+    const string_index *ix = (const string_index*)b->index;
+    if (ix != NULL) return ix;
+
+    ScmSmallInt len = SCM_STRING_BODY_LENGTH(b);
+    unsigned int count = (unsigned int)(len >> STRING_INDEX_SHIFT) + 1;
+    string_index *nix =
+        SCM_NEW_ATOMIC2(string_index*,
+                        sizeof(string_index)+sizeof(unsigned int)*(count-1));
+    const char *start = SCM_STRING_BODY_START(b);
+    const char *p = start;
+    nix->count = count;
+    for (unsigned int k = 0; k < count; k++) {
+        nix->offsets[k] = (unsigned int)(p - start);
+        if (k < count-1) p = forward_pos(p, STRING_INDEX_INTERVAL);
+    }
+    ((ScmStringBody*)b)->index = nix; /* discard const qualifier */
+    return nix;
+}
+
+/* Returns the pointer to the POS-th character of multibyte string body B.
+   Uses and creates the index if appropriate.  POS is assumed in range
+   (POS == length is allowed). */
+static const char *body_pos(const ScmStringBody *b, ScmSmallInt pos)
+{
+    if (pos >= STRING_INDEX_INTERVAL && string_index_worthy_p(b)) {
+        const string_index *ix = string_build_index(b);
+        const char *p = SCM_STRING_BODY_START(b)
+            + ix->offsets[pos >> STRING_INDEX_SHIFT];
+        return forward_pos(p, pos & STRING_INDEX_MASK);
+    } else {
+        return forward_pos(SCM_STRING_BODY_START(b), pos);
+    }
+}
+
+/* Build the index explicitly.  It is no-op if the string doesn't need
+   the index. */
+void Scm_StringBodyBuildIndex(const ScmStringBody *b)
+{
+    if (string_index_worthy_p(b)) (void)string_build_index(b);
+}
+
+/* Returns TRUE if indexed access to the string body doesn't need
+   to walk from the beginning. */
+int Scm_StringBodyFastIndexableP(const ScmStringBody *b)
+{
+    return (SCM_STRING_BODY_SINGLE_BYTE_P(b)
+            || SCM_STRING_BODY_LENGTH(b) < STRING_INDEX_THRESHOLD
+            || b->index != NULL);
+}
+
 /* string-ref.
  * If POS is out of range,
  *   - returns SCM_CHAR_INVALID if range_error is FALSE
@@ -529,7 +853,7 @@ ScmChar Scm_StringRef(ScmString *str, ScmSmallInt pos, int range_error)
     if (SCM_STRING_BODY_SINGLE_BYTE_P(b)) {
         return (ScmChar)(((unsigned char *)SCM_STRING_BODY_START(b))[pos]);
     } else {
-        const char *p = forward_pos(SCM_STRING_BODY_START(b), pos);
+        const char *p = body_pos(b, pos);
         ScmChar c;
         SCM_CHAR_GET(p, c);
         return c;
@@ -567,7 +891,7 @@ const char *Scm_StringBodyPosition(const ScmStringBody *b, ScmSmallInt offset)
     if (SCM_STRING_BODY_INCOMPLETE_P(b)) {
         return (SCM_STRING_BODY_START(b)+offset);
     } else {
-        return (forward_pos(SCM_STRING_BODY_START(b), offset));
+        return body_pos(b, offset);
     }
 }
 
@@ -792,9 +1116,48 @@ ScmObj Scm_StringReplaceBody(ScmString *str, const ScmStringBody *newbody)
  * Substring
  */
 
+/* A substring shares the body of the original string by default.
+   However, if the original is large and the substring is a small part
+   of it, we copy the content, so that a few short substrings don't
+   keep a huge original alive.  Scm_StringSlice always shares, and
+   Scm_StringCopyContent always copies. */
+#define SUBSTRING_SHARE_MIN    4096 /* always share if the original is
+                                       smaller than this */
+#define SUBSTRING_SHARE_RATIO  8    /* share if the substring is at least
+                                       1/SUBSTRING_SHARE_RATIO of the
+                                       original */
+enum {
+    SUBSTRING_AUTO,
+    SUBSTRING_SHARE,
+    SUBSTRING_COPY
+};
+
+static ScmObj make_substring(const ScmStringBody *xb, ScmSmallInt len,
+                             const char *s, ScmSmallInt siz, int flags,
+                             int mode)
+{
+    ScmSmallInt xsiz = SCM_STRING_BODY_SIZE(xb);
+    if (mode == SUBSTRING_AUTO) {
+        if (xsiz < SUBSTRING_SHARE_MIN
+            || siz >= xsiz / SUBSTRING_SHARE_RATIO) {
+            mode = SUBSTRING_SHARE;
+        } else {
+            mode = SUBSTRING_COPY;
+        }
+    }
+    if (mode == SUBSTRING_SHARE) {
+        return SCM_OBJ(make_str(len, siz, s, flags));
+    } else {
+        char *p = SCM_NEW_ATOMIC2(char *, siz+1);
+        memcpy(p, s, siz);
+        p[siz] = '\0';
+        return SCM_OBJ(make_str(len, siz, p, flags|SCM_STRING_TERMINATED));
+    }
+}
+
 static ScmObj substring(const ScmStringBody *xb,
                         ScmSmallInt start, ScmSmallInt end,
-                        int byterange)
+                        int byterange, int mode)
 {
     ScmSmallInt len = byterange? SCM_STRING_BODY_SIZE(xb) : SCM_STRING_BODY_LENGTH(xb);
     int flags = SCM_STRING_BODY_FLAGS(xb) & ~SCM_STRING_IMMUTABLE;
@@ -803,28 +1166,50 @@ static ScmObj substring(const ScmStringBody *xb,
     if (SCM_STRING_BODY_SINGLE_BYTE_P(xb) || byterange) {
         if (end != len) flags &= ~SCM_STRING_TERMINATED;
         if (byterange)  flags |= SCM_STRING_INCOMPLETE;
-        return SCM_OBJ(make_str(end-start,
-                                end-start,
-                                SCM_STRING_BODY_START(xb) + start,
-                                flags));
+        return make_substring(xb, end-start,
+                              SCM_STRING_BODY_START(xb) + start,
+                              end-start, flags, mode);
     } else {
         const char *s, *e;
-        if (start) s = forward_pos(SCM_STRING_BODY_START(xb), start);
+        if (start) s = body_pos(xb, start);
         else s = SCM_STRING_BODY_START(xb);
         if (len == end) {
             e = SCM_STRING_BODY_START(xb) + SCM_STRING_BODY_SIZE(xb);
         } else {
-            e = forward_pos(s, end - start);
+            if (end - start < STRING_INDEX_INTERVAL) {
+                e = forward_pos(s, end - start);
+            } else {
+                e = body_pos(xb, end);
+            }
             flags &= ~SCM_STRING_TERMINATED;
         }
-        return SCM_OBJ(make_str((int)(end - start), (int)(e - s), s, flags));
+        return make_substring(xb, end - start, s, e - s, flags, mode);
     }
 }
 
 ScmObj Scm_Substring(ScmString *x, ScmSmallInt start, ScmSmallInt end,
                      int byterangep)
 {
-    return substring(SCM_STRING_BODY(x), start, end, byterangep);
+    return substring(SCM_STRING_BODY(x), start, end, byterangep,
+                     SUBSTRING_AUTO);
+}
+
+/* Returns an immutable substring that always shares the body of X.
+   It's cheap, but the whole content of X is kept as long as the slice
+   is alive. */
+ScmObj Scm_StringSlice(ScmString *x, ScmSmallInt start, ScmSmallInt end)
+{
+    ScmObj s = substring(SCM_STRING_BODY(x), start, end, FALSE,
+                         SUBSTRING_SHARE);
+    SCM_STRING(s)->initialBody.flags |= SCM_STRING_IMMUTABLE;
+    return s;
+}
+
+/* Returns a copy of X that has its own content, detached from whatever
+   body X shares. */
+ScmObj Scm_StringCopyContent(ScmString *x)
+{
+    return substring(SCM_STRING_BODY(x), 0, -1, FALSE, SUBSTRING_COPY);
 }
 
 /* Auxiliary procedure to support optional start/end parameter specified
@@ -850,22 +1235,32 @@ ScmObj Scm_MaybeSubstring(ScmString *x, ScmObj start, ScmObj end)
             Scm_Error("exact integer required for start, but got %S", end);
         iend = SCM_INT_VALUE(end);
     }
-    return substring(xb, istart, iend, FALSE);
+    return substring(xb, istart, iend, FALSE, SUBSTRING_AUTO);
 }
 
 /*----------------------------------------------------------------
  * Search & parse
  */
 
-/* Boyer-Moore string search.  assuming siz1 > siz2, siz2 < 256. */
-static ScmSmallInt boyer_moore(const char *ss1, ScmSmallInt siz1,
-                               const char *ss2, ScmSmallInt siz2)
+/* Boyer-Moore(-Horspool) string search.  assuming siz2 < 256.
+   The shift table and the search are separated, so that a caller
+   that looks for the same pattern in many buffers (e.g. the MIME
+   boundary scanner in ext/rfc) can build the table just once. */
+void Scm__BoyerMooreTable(const char *ss2, ScmSmallInt siz2,
+                          unsigned char shift[256])
 {
-    unsigned char shift[256];
     for (ScmSmallInt i=0; i<256; i++) { shift[i] = siz2; }
     for (ScmSmallInt j=0; j<siz2-1; j++) {
         shift[(unsigned char)ss2[j]] = siz2-j-1;
     }
+}
+
+/* Returns the byte offset of the first occurrence of ss2 in ss1,
+   or -1. */
+ScmSmallInt Scm__BoyerMooreSearch(const char *ss1, ScmSmallInt siz1,
+                                  const char *ss2, ScmSmallInt siz2,
+                                  const unsigned char shift[256])
+{
     for (ScmSmallInt i=siz2-1; i<siz1; i+=shift[(unsigned char)ss1[i]]) {
         ScmSmallInt j, k;
         for (j=siz2-1, k = i; j>=0 && ss1[k] == ss2[j]; j--, k--)
@@ -875,6 +1270,14 @@ static ScmSmallInt boyer_moore(const char *ss1, ScmSmallInt siz1,
     return -1;
 }
 
+static ScmSmallInt boyer_moore(const char *ss1, ScmSmallInt siz1,
+                               const char *ss2, ScmSmallInt siz2)
+{
+    unsigned char shift[256];
+    Scm__BoyerMooreTable(ss2, siz2, shift);
+    return Scm__BoyerMooreSearch(ss1, siz1, ss2, siz2, shift);
+}
+
 static ScmSmallInt boyer_moore_reverse(const char *ss1, ScmSmallInt siz1,
                                        const char *ss2, ScmSmallInt siz2)
 {
@@ -1090,7 +1493,7 @@ static ScmObj string_scan(ScmString *ss1, const char *s2,
     ScmSmallInt siz1 = SCM_STRING_BODY_SIZE(sb);
     ScmSmallInt len1 = SCM_STRING_BODY_LENGTH(sb);
 
-    if (retmode < 0 || retmode > SCM_STRING_SCAN_BOTH) {
+    if (retmode < 0 || retmode > SCM_STRING_SCAN_CURSOR) {
         Scm_Error("return mode out fo range: %d", retmode);
     }
 
@@ -1110,6 +1513,11 @@ static ScmObj string_scan(ScmString *ss1, const char *s2,
         return SCM_FALSE;
     }
 
+    /* Cursor doesn't need character index. */
+    if (retmode == SCM_STRING_SCAN_CURSOR) {
+        return Scm__MakeStringCursor(bi);
+    }
+
     if (retcode == FOUND_BYTE_INDEX && !incomplete) {
         ci = count_length(s1, bi);
     }
@@ -1137,6 +1545,10 @@ static ScmObj string_scan(ScmString *ss1, const char *s2,
     return SCM_UNDEFINED;       /* dummy */
 }
 
+/* whether string_scan's retmode produces two values */
+#define SCAN_MULTIPLE_VALUES_P(retmode) \
+    ((retmode) >= SCM_STRING_SCAN_BEFORE2 && (retmode) <= SCM_STRING_SCAN_BOTH)
+
 ScmObj Scm_StringScan(ScmString *s1, ScmString *s2, int retmode)
 {
     ScmObj v1, v2;
@@ -1147,7 +1559,7 @@ ScmObj Scm_StringScan(ScmString *s1, ScmString *s2, int retmode)
                      SCM_STRING_BODY_LENGTH(s2b),
                      SCM_STRING_BODY_INCOMPLETE_P(s2b),
                      retmode, string_search, &v2);
-    if (retmode <= SCM_STRING_SCAN_AFTER) return v1;
+    if (!SCAN_MULTIPLE_VALUES_P(retmode)) return v1;
     else return Scm_Values2(v1, v2);
 }
 
@@ -1158,7 +1570,7 @@ ScmObj Scm_StringScanChar(ScmString *s1, ScmChar ch, int retmode)
     SCM_CHAR_PUT(buf, ch);
     v1 = string_scan(s1, buf, SCM_CHAR_NBYTES(ch), 1, FALSE, retmode,
                      string_search, &v2);
-    if (retmode <= SCM_STRING_SCAN_AFTER) return v1;
+    if (!SCAN_MULTIPLE_VALUES_P(retmode)) return v1;
     else return Scm_Values2(v1, v2);
 }
 
@@ -1172,7 +1584,7 @@ ScmObj Scm_StringScanRight(ScmString *s1, ScmString *s2, int retmode)
                      SCM_STRING_BODY_LENGTH(s2b),
                      SCM_STRING_BODY_INCOMPLETE_P(s2b),
                      retmode, string_search_reverse, &v2);
-    if (retmode <= SCM_STRING_SCAN_AFTER) return v1;
+    if (!SCAN_MULTIPLE_VALUES_P(retmode)) return v1;
     else return Scm_Values2(v1, v2);
 }
 
@@ -1183,7 +1595,7 @@ ScmObj Scm_StringScanCharRight(ScmString *s1, ScmChar ch, int retmode)
     SCM_CHAR_PUT(buf, ch);
     v1 = string_scan(s1, buf, SCM_CHAR_NBYTES(ch), 1, FALSE, retmode,
                      string_search_reverse, &v2);
-    if (retmode <= SCM_STRING_SCAN_AFTER) return v1;
+    if (!SCAN_MULTIPLE_VALUES_P(retmode)) return v1;
     else return Scm_Values2(v1, v2);
 }
 
@@ -1427,12 +1839,12 @@ ScmObj Scm_MakeStringPointer(ScmString *src, ScmSmallInt index,
         ptr = sptr + index;
         effective_size = end - start;
     } else {
-        sptr = forward_pos(SCM_STRING_BODY_START(srcb), start);
-        ptr = forward_pos(sptr, index);
+        sptr = body_pos(srcb, start);
+        ptr = body_pos(srcb, start + index);
         if (end == len) {
             eptr = SCM_STRING_BODY_START(srcb) + SCM_STRING_BODY_SIZE(srcb);
         } else {
-            eptr = forward_pos(sptr, end - start);
+            eptr = body_pos(srcb, end);
         }
         effective_size = (int)(eptr - ptr);
     }
@@ -1560,6 +1972,212 @@ void Scm_StringPointerDump(ScmStringPointer *sp1)
                sp1->current);
 }
 
+/*==================================================================
+ *
+ * String cursor
+ *
+ */
+
+static void cursor_print(ScmObj obj, ScmPort *port, ScmWriteContext *ctx)
+{
+    Scm_Printf(port, "#<string-cursor %ld>", SCM_STRING_CURSOR_LARGE_OFFSET(obj));
+}
+
+SCM_DEFINE_BUILTIN_CLASS_SIMPLE(Scm_StringCursorClass, cursor_print);
+
+ScmObj Scm__MakeStringCursor(ScmSmallInt offset)
+{
+    if (offset <= SCM_STRING_CURSOR_SMALL_MAX) {
+        return SCM_MAKE_STRING_CURSOR_SMALL(offset);
+    }
+    ScmStringCursorLarge *sc = SCM_NEW(ScmStringCursorLarge);
+    SCM_SET_CLASS(sc, SCM_CLASS_STRING_CURSOR);
+    sc->offset = offset;
+    return SCM_OBJ(sc);
+}
+
+/* Returns the byte offset of the position SC in SRCB.  SC can be
+   a string cursor or an index.  Range is checked. */
+ScmSmallInt Scm__StringCursorOffset(const ScmStringBody *srcb, ScmObj sc)
+{
+    ScmSmallInt offset;
+    if (SCM_STRING_CURSOR_SMALL_P(sc)) {
+        offset = SCM_STRING_CURSOR_SMALL_OFFSET(sc);
+    } else if (SCM_STRING_CURSOR_LARGE_P(sc)) {
+        offset = SCM_STRING_CURSOR_LARGE_OFFSET(sc);
+    } else if (SCM_INTP(sc)) {
+        return Scm_StringBodyPosition(srcb, SCM_INT_VALUE(sc))
+            - SCM_STRING_BODY_START(srcb);
+    } else {
+        Scm_Error("string cursor or index required, but got %S", sc);
+        return 0;               /* dummy */
+    }
+    if (offset < 0 || offset > SCM_STRING_BODY_SIZE(srcb)) {
+        Scm_Error("string cursor out of range: %S", sc);
+    }
+    return offset;
+}
+
+ScmObj Scm_MakeStringCursorFromIndex(ScmString *src, ScmSmallInt index)
+{
+    const ScmStringBody *srcb = SCM_STRING_BODY(src);
+    const char *p = Scm_StringBodyPosition(srcb, index);
+    return Scm__MakeStringCursor(p - SCM_STRING_BODY_START(srcb));
+}
+
+ScmObj Scm_MakeStringCursorEnd(ScmString *src)
+{
+    return Scm__MakeStringCursor(SCM_STRING_BODY_SIZE(SCM_STRING_BODY(src)));
+}
+
+/* Returns the character index of the position SC.  If SC is already
+   an index, it is returned after range check. */
+ScmObj Scm_StringCursorIndex(ScmString *src, ScmObj sc)
+{
+    const ScmStringBody *srcb = SCM_STRING_BODY(src);
+    if (SCM_INTP(sc)) {
+        ScmSmallInt k = SCM_INT_VALUE(sc);
+        if (k < 0 || k > SCM_STRING_BODY_LENGTH(srcb)) {
+            Scm_Error("argument out of range: %ld", k);
+        }
+        return sc;
+    }
+    ScmSmallInt offset = Scm__StringCursorOffset(srcb, sc);
+    if (SCM_STRING_BODY_SINGLE_BYTE_P(srcb)) {
+        return SCM_MAKE_INT(offset);
+    }
+    ScmSmallInt len = count_length(SCM_STRING_BODY_START(srcb), offset);
+    if (len < 0) {
+        Scm_Error("string cursor doesn't point to a character boundary: %S",
+                  sc);
+    }
+    return SCM_MAKE_INT(len);
+}
+
+ScmObj Scm_StringCursorForward(ScmString *src, ScmObj sc, ScmSmallInt nchars)
+{
+    const ScmStringBody *srcb = SCM_STRING_BODY(src);
+    ScmSmallInt offset = Scm__StringCursorOffset(srcb, sc);
+    ScmSmallInt size = SCM_STRING_BODY_SIZE(srcb);
+
+    if (nchars < 0) return Scm_StringCursorBack(src, sc, -nchars);
+    if (SCM_STRING_BODY_SINGLE_BYTE_P(srcb)) {
+        offset += nchars;
+    } else {
+        const char *start = SCM_STRING_BODY_START(srcb);
+        while (nchars-- > 0 && offset < size) {
+            offset += SCM_CHAR_NFOLLOWS(start[offset]) + 1;
+        }
+        nchars++;
+    }
+    if (nchars > 0 || offset > size) {
+        Scm_Error("string cursor out of range: %S", sc);
+    }
+    return Scm__MakeStringCursor(offset);
+}
+
+ScmObj Scm_StringCursorBack(ScmString *src, ScmObj sc, ScmSmallInt nchars)
+{
+    const ScmStringBody *srcb = SCM_STRING_BODY(src);
+    ScmSmallInt offset = Scm__StringCursorOffset(srcb, sc);
+
+    if (nchars < 0) return Scm_StringCursorForward(src, sc, -nchars);
+    if (SCM_STRING_BODY_SINGLE_BYTE_P(srcb)) {
+        offset -= nchars;
+        if (offset < 0) Scm_Error("string cursor out of range: %S", sc);
+    } else {
+        const char *start = SCM_STRING_BODY_START(srcb);
+        const char *p = start + offset, *prev;
+        while (nchars-- > 0) {
+            SCM_CHAR_BACKWARD(p, start, prev);
+            if (prev == NULL) {
+                Scm_Error("string cursor out of range: %S", sc);
+            }
+            p = prev;
+        }
+        offset = p - start;
+    }
+    return Scm__MakeStringCursor(offset);
+}
+
+/* The meaning of range_error is the same as Scm_StringRef. */
+ScmChar Scm_StringRefCursor(ScmString *src, ScmObj sc, int range_error)
+{
+    const ScmStringBody *srcb = SCM_STRING_BODY(src);
+    if (SCM_STRING_BODY_INCOMPLETE_P(srcb)) {
+        Scm_Error("incomplete string not allowed : %S", src);
+    }
+    if (SCM_INTP(sc)) {
+        return Scm_StringRef(src, SCM_INT_VALUE(sc), range_error);
+    }
+    ScmSmallInt offset = Scm__StringCursorOffset(srcb, sc);
+    if (offset == SCM_STRING_BODY_SIZE(srcb)) {
+        if (range_error) {
+            Scm_Error("string cursor out of range: %S", sc);
+        }
+        return SCM_CHAR_INVALID;
+    }
+    const char *p = SCM_STRING_BODY_START(srcb) + offset;
+    ScmChar ch;
+    SCM_CHAR_GET(p, ch);
+    return ch;
+}
+
+ScmObj Scm_SubstringCursor(ScmString *src, ScmObj start, ScmObj end)
+{
+    const ScmStringBody *srcb = SCM_STRING_BODY(src);
+    ScmSmallInt soff = Scm__StringCursorOffset(srcb, start);
+    ScmSmallInt eoff = Scm__StringCursorOffset(srcb, end);
+    ScmSmallInt size = SCM_STRING_BODY_SIZE(srcb);
+
+    if (soff > eoff) {
+        Scm_Error("start cursor %S is greater than end cursor %S", start, end);
+    }
+    int flags = SCM_STRING_BODY_FLAGS(srcb) & ~SCM_STRING_IMMUTABLE;
+    if (eoff != size) flags &= ~SCM_STRING_TERMINATED;
+    ScmSmallInt len;
+    if (SCM_STRING_BODY_SINGLE_BYTE_P(srcb)) {
+        len = eoff - soff;
+    } else {
+        len = count_length(SCM_STRING_BODY_START(srcb) + soff, eoff - soff);
+        if (len < 0) {
+            Scm_Error("string cursors don't point to character boundaries: "
+                      "%S and %S", start, end);
+        }
+    }
+    return SCM_OBJ(make_str(len, eoff - soff,
+                            SCM_STRING_BODY_START(srcb) + soff, flags));
+}
+
+/* Compare two cursors.  Both must be cursors, or both must be indexes.
+   Returns negative, zero, or positive integer. */
+int Scm_StringCursorCompare(ScmObj sc1, ScmObj sc2)
+{
+    ScmSmallInt i1, i2;
+    if (SCM_INTP(sc1) && SCM_INTP(sc2)) {
+        i1 = SCM_INT_VALUE(sc1);
+        i2 = SCM_INT_VALUE(sc2);
+    } else {
+        if (SCM_STRING_CURSOR_SMALL_P(sc1)) {
+            i1 = SCM_STRING_CURSOR_SMALL_OFFSET(sc1);
+        } else if (SCM_STRING_CURSOR_LARGE_P(sc1)) {
+            i1 = SCM_STRING_CURSOR_LARGE_OFFSET(sc1);
+        } else {
+            Scm_Error("string cursor required, but got %S", sc1);
+            return 0;           /* dummy */
+        }
+        if (SCM_STRING_CURSOR_SMALL_P(sc2)) {
+            i2 = SCM_STRING_CURSOR_SMALL_OFFSET(sc2);
+        } else if (SCM_STRING_CURSOR_LARGE_P(sc2)) {
+            i2 = SCM_STRING_CURSOR_LARGE_OFFSET(sc2);
+        } else {
+            Scm_Error("string cursor required, but got %S", sc2);
+            return 0;           /* dummy */
+        }
+    }
+    return (i1 < i2)? -1 : (i1 > i2)? 1 : 0;
+}
+
 /*==================================================================
  *
  * Dynamic strings
@@ -1569,8 +2187,12 @@ void Scm_StringPointerDump(ScmStringPointer *sp1)
 /* I used to use realloc() to grow the storage; now I avoid it, for
    Boehm GC's realloc almost always copies the original content and
    we don't get any benefit.
-   The growing string is kept in the chained chunks.  The size of
-   chunk getting bigger as the string grows, until a certain threshold.
+   While the content is small, it is kept in a single chunk; when it
+   overflows, we allocate a chunk twice as large and copy the content
+   over.  So Scm_DStringTake can usually share the chunk with the
+   string it returns, without copying.  Beyond DSTRING_SINGLE_CHUNK_LIMIT we
+   stop copying and chain chunks, each twice as large as the previous
+   one up to DSTRING_MAX_CHUNK_SIZE.
    The memory for actual chunks and the chain is allocated separately,
    in order to use SCM_NEW_ATOMIC.
  */
@@ -1580,8 +2202,11 @@ void Scm_StringPointerDump(ScmStringPointer *sp1)
  * mutex code in other parts relies on that fact.
  */
 
+/* the content is moved to a larger chunk up to this size */
+#define DSTRING_SINGLE_CHUNK_LIMIT  (64*1024)
+
 /* maximum chunk size */
-#define DSTRING_MAX_CHUNK_SIZE  8180
+#define DSTRING_MAX_CHUNK_SIZE      (1024*1024)
 
 void Scm_DStringInit(ScmDString *dstr)
 {
@@ -1620,12 +2245,40 @@ void Scm__DStringRealloc(ScmDString *dstr, int minincr)
         dstr->init.bytes = (int)(dstr->current - dstr->init.data);
     }
 
-    /* determine the size of the new chunk.  the increase factor 3 is
-       somewhat arbitrary, determined by rudimental benchmarking. */
-    ScmSmallInt newsize = dstr->lastChunkSize * 3;
+    ScmSmallInt newsize = (ScmSmallInt)dstr->lastChunkSize * 2;
     if (newsize > DSTRING_MAX_CHUNK_SIZE) {
         newsize = DSTRING_MAX_CHUNK_SIZE;
     }
+
+    /* If the content is in one place, either the initial buffer or
+       a single chunk, move it to a larger chunk. */
+    if (dstr->anchor == dstr->tail
+        && (dstr->tail == NULL || dstr->init.bytes == 0)) {
+        ScmDStringChunk *old = dstr->tail? dstr->tail->chunk : &dstr->init;
+        ScmSmallInt used = old->bytes;
+        if (used + minincr <= DSTRING_SINGLE_CHUNK_LIMIT) {
+            if (newsize < used + minincr) newsize = used + minincr;
+            ScmDStringChunk *newchunk = SCM_NEW_ATOMIC2(
+                ScmDStringChunk*,
+                sizeof(ScmDStringChunk)+newsize-SCM_DSTRING_INIT_CHUNK_SIZE);
+            memcpy(newchunk->data, old->data, used);
+            newchunk->bytes = 0;
+            if (dstr->tail) {
+                dstr->tail->chunk = newchunk;
+            } else {
+                ScmDStringChain *newchain = SCM_NEW(ScmDStringChain);
+                newchain->next = NULL;
+                newchain->chunk = newchunk;
+                dstr->anchor = dstr->tail = newchain;
+            }
+            dstr->init.bytes = 0;
+            dstr->current = newchunk->data + used;
+            dstr->end = newchunk->data + newsize;
+            dstr->lastChunkSize = (int)newsize;
+            return;
+        }
+    }
+
     if (newsize < minincr) {
         newsize = minincr;
     }
@@ -1650,20 +2303,51 @@ void Scm__DStringRealloc(ScmDString *dstr, int minincr)
     dstr->lastChunkSize = newsize;
 }
 
+/* Gives the extra chunks back to GC right away, and resets DSTR to
+   the initial state.  A caller that has got the content with
+   Scm_DStringGet can call this when it's done with DSTR, sparing GC
+   from tracing the chunks later.  It is also safe not to call this;
+   the chunks are collected as usual.  The pointer returned by
+   Scm_DStringPeek becomes invalid, though.
+   Don't call this after Scm_DStringTake, for the chunk may be shared
+   by the string it returned; use Scm_DStringInit instead. */
+void Scm_DStringRelease(ScmDString *dstr)
+{
+    ScmDStringChain *chain = dstr->anchor;
+    while (chain) {
+        ScmDStringChain *next = chain->next;
+        GC_FREE(chain->chunk);
+        GC_FREE(chain);
+        chain = next;
+    }
+    Scm_DStringInit(dstr);
+}
+
+/* Returns the chunk if the whole content is in it, or NULL. */
+static ScmDStringChunk *dstring_single_chunk(ScmDString *dstr)
+{
+    if (dstr->anchor == NULL) return &dstr->init;
+    if (dstr->anchor == dstr->tail && dstr->init.bytes == 0) {
+        return dstr->tail->chunk;
+    }
+    return NULL;
+}
+
 /* Retrieve accumulated string. */
 static const char *dstring_getz(ScmDString *dstr, int *psiz, int *plen, int noalloc)
 {
     ScmSmallInt size, len;
     char *buf;
-    if (dstr->anchor == NULL) {
+    ScmDStringChunk *single = dstring_single_chunk(dstr);
+    if (single) {
         /* we only have one chunk */
-        size = dstr->current - dstr->init.data;
+        size = dstr->current - single->data;
         CHECK_SIZE(size);
         len = dstr->length;
         if (noalloc) {
-            buf = dstr->init.data;
+            buf = single->data;
         } else {
-            buf = SCM_STRDUP_PARTIAL(dstr->init.data, size);
+            buf = SCM_STRDUP_PARTIAL(single->data, size);
         }
     } else {
         ScmDStringChain *chain = dstr->anchor;
@@ -1695,6 +2379,31 @@ ScmObj Scm_DStringGet(ScmDString *dstr, int flags)
     return SCM_OBJ(make_str(len, size, str, flags|SCM_STRING_TERMINATED));
 }
 
+/* Like Scm_DStringGet, but if the content is in a single chunk that is
+   at least half full, the chunk becomes the string body, without
+   copying.  DSTR keeps its content.  We mark the chunk full, so the
+   next write to DSTR moves the content to a new chunk (or chains one)
+   and never touches the shared bytes. */
+ScmObj Scm_DStringTake(ScmDString *dstr, int flags)
+{
+    ScmDStringChunk *single = dstring_single_chunk(dstr);
+    if (single && single != &dstr->init) {
+        ScmSmallInt size = dstr->current - single->data;
+        if (size*2 >= dstr->end - single->data) {
+            CHECK_SIZE(size);
+            ScmSmallInt len = dstr->length;
+            if (len < 0) len = count_length(single->data, size);
+            if (dstr->current < dstr->end) {
+                *dstr->current = '\0';
+                flags |= SCM_STRING_TERMINATED;
+            }
+            dstr->end = dstr->current;
+            return SCM_OBJ(make_str(len, size, single->data, flags));
+        }
+    }
+    return Scm_DStringGet(dstr, flags);
+}
+
 /* For conveninence.   Note that dstr may already contain NUL byte in it,
    in that case you'll get chopped string. */
 const char *Scm_DStringGetz(ScmDString *dstr)
@@ -0,0 +1,576 @@
+/*
+ * strsearch.c - searching multiple strings at once
+ *
+ *   Copyright (c) 2016  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define LIBGAUCHE_BODY
+#include "gauche.h"
+
+#include <string.h>
+
+/*
+ * String searcher
+ *
+ *   A string searcher finds the occurrences of a fixed set of strings,
+ *   which we call needles, in a single pass over the input, using the
+ *   Aho-Corasick automaton.  The automaton works on bytes; since a
+ *   needle is a complete string, a match in a utf-8 or single-byte
+ *   input always falls on character boundaries.  With EUC-JP and
+ *   Shift_JIS, a match may begin in the middle of a multibyte
+ *   character, so we track the character boundaries and discard
+ *   such matches (SS_CHECK_BOUNDARY).
+ *
+ *   The states are numbered in breadth-first order, so the children
+ *   of a state have consecutive ids, sorted by the byte of the edge.
+ *   The transitions from the root state are kept in a full table,
+ *   which also serves as a prefilter: while we're in the root state,
+ *   we skip the bytes that can't begin a needle, with memchr() if
+ *   there's only one such byte.
+ */
+
+#if defined(GAUCHE_CHAR_ENCODING_EUC_JP) || defined(GAUCHE_CHAR_ENCODING_SJIS)
+#define SS_CHECK_BOUNDARY 1
+#endif
+
+struct ScmStringSearcherRec {
+    SCM_HEADER;
+    ScmObj needles;             /* vector of needle strings */
+    int numNeedles;
+    int numStates;
+    int *kidFirst;              /* id of the first child of the state */
+    u_short *kidCount;          /* # of children of the state */
+    u_char *edge;               /* byte of the edge into the state */
+    int *fail;                  /* failure link */
+    int *out;                   /* the needle ending at the state, or -1 */
+    int *dict;                  /* nearest state with output on the suffix
+                                   chain, or 0 (the root has no output) */
+    int *sameNext;              /* next needle identical to this, or -1 */
+    int *needleSize;            /* # of bytes of each needle */
+    int *needleLen;             /* # of characters of each needle */
+    int maxSize;                /* size of the longest needle */
+    int numFirstBytes;          /* # of bytes that can begin a needle */
+    u_char firstByte;           /* the one, if numFirstBytes == 1 */
+    int root[256];              /* transitions from the root */
+};
+
+static void searcher_print(ScmObj obj, ScmPort *port, ScmWriteContext *ctx)
+{
+    Scm_Printf(port, "#<string-searcher %d needles>",
+               SCM_STRING_SEARCHER(obj)->numNeedles);
+}
+
+SCM_DEFINE_BUILTIN_CLASS_SIMPLE(Scm_StringSearcherClass, searcher_print);
+
+static inline int ss_child(const ScmStringSearcher *ss, int s, u_char b)
+{
+    int lo = ss->kidFirst[s], hi = lo + ss->kidCount[s];
+    int lim = hi;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (ss->edge[mid] < b) lo = mid + 1;
+        else hi = mid;
+    }
+    return (lo < lim && ss->edge[lo] == b)? lo : 0;
+}
+
+static inline int ss_step(const ScmStringSearcher *ss, int s, u_char b)
+{
+    while (s != 0) {
+        int k = ss_child(ss, s, b);
+        if (k) return k;
+        s = ss->fail[s];
+    }
+    return ss->root[b];
+}
+
+/*
+ * Construction
+ */
+ScmObj Scm_MakeStringSearcher(ScmObj needles)
+{
+    ScmObj vec = Scm_ListToVector(needles, 0, -1);
+    int n = SCM_VECTOR_SIZE(vec);
+    int total = 1;              /* # of states, at most */
+
+    if (n == 0) Scm_Error("at least one needle is required");
+    for (int i = 0; i < n; i++) {
+        ScmObj s = SCM_VECTOR_ELEMENT(vec, i);
+        if (!SCM_STRINGP(s)) Scm_Error("string required, but got %S", s);
+        const ScmStringBody *b = SCM_STRING_BODY(s);
+        if (SCM_STRING_BODY_INCOMPLETE_P(b)) {
+            Scm_Error("incomplete string is not allowed: %S", s);
+        }
+        if (SCM_STRING_BODY_SIZE(b) == 0) {
+            Scm_Error("empty string can't be a needle");
+        }
+        if (SCM_STRING_BODY_SIZE(b) > INT_MAX - total) {
+            Scm_Error("needles too large");
+        }
+        total += (int)SCM_STRING_BODY_SIZE(b);
+    }
+
+    ScmStringSearcher *ss = SCM_NEW(ScmStringSearcher);
+    SCM_SET_CLASS(ss, SCM_CLASS_STRING_SEARCHER);
+    ss->needles = vec;
+    ss->numNeedles = n;
+    ss->sameNext = SCM_NEW_ATOMIC_ARRAY(int, n);
+    ss->needleSize = SCM_NEW_ATOMIC_ARRAY(int, n);
+    ss->needleLen = SCM_NEW_ATOMIC_ARRAY(int, n);
+    ss->maxSize = 0;
+
+    /* Build a plain trie first.  Children are kept in sibling lists;
+       0 means none, since the root isn't anyone's child. */
+    int *tchild = SCM_NEW_ATOMIC_ARRAY(int, total);
+    int *tsib   = SCM_NEW_ATOMIC_ARRAY(int, total);
+    int *tout   = SCM_NEW_ATOMIC_ARRAY(int, total);
+    u_char *tbyte = SCM_NEW_ATOMIC_ARRAY(u_char, total);
+    int nstates = 1;
+    tchild[0] = 0;
+    tout[0] = -1;
+
+    for (int i = 0; i < n; i++) {
+        const ScmStringBody *b = SCM_STRING_BODY(SCM_VECTOR_ELEMENT(vec, i));
+        const u_char *p = (const u_char*)SCM_STRING_BODY_START(b);
+        int size = (int)SCM_STRING_BODY_SIZE(b);
+        int s = 0;
+        for (int j = 0; j < size; j++) {
+            int c;
+            for (c = tchild[s]; c != 0; c = tsib[c]) {
+                if (tbyte[c] == p[j]) break;
+            }
+            if (c == 0) {
+                c = nstates++;
+                tbyte[c] = p[j];
+                tchild[c] = 0;
+                tout[c] = -1;
+                tsib[c] = tchild[s];
+                tchild[s] = c;
+            }
+            s = c;
+        }
+        ss->needleSize[i] = size;
+        ss->needleLen[i] = (int)SCM_STRING_BODY_LENGTH(b);
+        ss->sameNext[i] = -1;
+        if (size > ss->maxSize) ss->maxSize = size;
+        if (tout[s] < 0) {
+            tout[s] = i;
+        } else {
+            int k = tout[s];
+            while (ss->sameNext[k] >= 0) k = ss->sameNext[k];
+            ss->sameNext[k] = i;
+        }
+    }
+
+    /* Renumber the states in breadth-first order, and compute the
+       failure links.  The failure link of a state points to a shallower
+       state, which has been processed when we get there. */
+    ss->numStates = nstates;
+    ss->kidFirst = SCM_NEW_ATOMIC_ARRAY(int, nstates);
+    ss->kidCount = SCM_NEW_ATOMIC_ARRAY(u_short, nstates);
+    ss->edge = SCM_NEW_ATOMIC_ARRAY(u_char, nstates);
+    ss->fail = SCM_NEW_ATOMIC_ARRAY(int, nstates);
+    ss->out = SCM_NEW_ATOMIC_ARRAY(int, nstates);
+    ss->dict = SCM_NEW_ATOMIC_ARRAY(int, nstates);
+    int *f2t = SCM_NEW_ATOMIC_ARRAY(int, nstates);
+
+    f2t[0] = 0;
+    ss->edge[0] = 0;
+    ss->fail[0] = 0;
+    ss->out[0] = -1;
+    ss->dict[0] = 0;
+    for (int b = 0; b < 256; b++) ss->root[b] = 0;
+
+    int next = 1;
+    for (int s = 0; s < next; s++) {
+        int kids[256], nk = 0;
+        for (int c = tchild[f2t[s]]; c != 0; c = tsib[c]) {
+            /* insertion sort by the edge byte */
+            int j = nk++;
+            while (j > 0 && tbyte[kids[j-1]] > tbyte[c]) {
+                kids[j] = kids[j-1];
+                j--;
+            }
+            kids[j] = c;
+        }
+        ss->kidFirst[s] = next;
+        ss->kidCount[s] = (u_short)nk;
+        for (int j = 0; j < nk; j++) {
+            int id = next++;
+            u_char b = tbyte[kids[j]];
+            f2t[id] = kids[j];
+            ss->edge[id] = b;
+            ss->out[id] = tout[kids[j]];
+            if (s == 0) {
+                ss->root[b] = id;
+                ss->fail[id] = 0;
+            } else {
+                ss->fail[id] = ss_step(ss, ss->fail[s], b);
+            }
+            int f = ss->fail[id];
+            ss->dict[id] = (ss->out[f] >= 0)? f : ss->dict[f];
+        }
+    }
+    SCM_ASSERT(next == nstates);
+
+    ss->numFirstBytes = 0;
+    ss->firstByte = 0;
+    for (int b = 0; b < 256; b++) {
+        if (ss->root[b]) {
+            ss->numFirstBytes++;
+            ss->firstByte = (u_char)b;
+        }
+    }
+    return SCM_OBJ(ss);
+}
+
+ScmObj Scm_StringSearcherNeedles(ScmStringSearcher *ss)
+{
+    return Scm_VectorToList(SCM_VECTOR(ss->needles), 0, -1);
+}
+
+/*
+ * Scanning
+ *
+ *   ss_scan feeds the bytes of [P, END) to the automaton, and calls
+ *   REPORT for each match with the needle and the pointer just past the
+ *   end of the match.  The matches that end at the same position are
+ *   reported from the longest.  If REPORT returns TRUE, or we reach
+ *   LIMIT, we stop.  The scanner keeps the state between calls, so
+ *   the input can be given in chunks.
+ */
+typedef struct ss_scanner_rec ss_scanner;
+
+struct ss_scanner_rec {
+    ScmStringSearcher *ss;
+    int state;
+    const u_char *limit;        /* stop before this, if not NULL */
+    int (*report)(ss_scanner *sc, int needle, const u_char *endp);
+    void *data;
+#ifdef SS_CHECK_BOUNDARY
+    int track;                  /* track character boundaries? */
+    int follows;                /* # of bytes left in the current char */
+    ScmSmallInt nbytes;         /* # of bytes fed so far */
+    ScmSmallInt nchars;         /* # of chars begun so far */
+    u_char *starts;             /* ring buffer of flags, indexed by byte
+                                   position: TRUE if a char begins there */
+    ScmSmallInt mask;
+#endif
+};
+
+static void ss_scanner_init(ss_scanner *sc, ScmStringSearcher *ss,
+                            int (*report)(ss_scanner*, int, const u_char*),
+                            void *data, int track)
+{
+    sc->ss = ss;
+    sc->state = 0;
+    sc->limit = NULL;
+    sc->report = report;
+    sc->data = data;
+#ifdef SS_CHECK_BOUNDARY
+    sc->track = track;
+    sc->follows = 0;
+    sc->nbytes = sc->nchars = 0;
+    if (track) {
+        ScmSmallInt size = 1;
+        while (size < ss->maxSize) size <<= 1;
+        sc->starts = SCM_NEW_ATOMIC_ARRAY(u_char, size);
+        sc->mask = size - 1;
+    }
+#endif
+}
+
+/* Returns TRUE if the match of NEEDLE that ends here begins at
+   a character boundary. */
+static inline int ss_aligned(ss_scanner *sc, int needle)
+{
+#ifdef SS_CHECK_BOUNDARY
+    if (sc->track) {
+        ScmSmallInt b = sc->nbytes - sc->ss->needleSize[needle];
+        return sc->follows == 0 && sc->starts[b & sc->mask];
+    }
+#endif
+    return TRUE;
+}
+
+static inline const u_char *ss_skip(const ScmStringSearcher *ss,
+                                    const u_char *p, const u_char *end)
+{
+    if (ss->numFirstBytes == 1) {
+        const u_char *z = memchr(p, ss->firstByte, end - p);
+        return z? z : end;
+    }
+    while (p < end && ss->root[*p] == 0) p++;
+    return p;
+}
+
+/* Returns TRUE if REPORT stopped the scan. */
+static int ss_scan(ss_scanner *sc, const u_char *p, const u_char *end)
+{
+    const ScmStringSearcher *ss = sc->ss;
+    int s = sc->state;
+
+    while (p < end) {
+        if (sc->limit && p >= sc->limit) break;
+        u_char b;
+#ifdef SS_CHECK_BOUNDARY
+        if (sc->track) {
+            b = *p++;
+            sc->starts[sc->nbytes & sc->mask] = (sc->follows == 0);
+            if (sc->follows == 0) {
+                sc->nchars++;
+                sc->follows = SCM_CHAR_NFOLLOWS(b);
+            } else {
+                sc->follows--;
+            }
+            sc->nbytes++;
+        } else
+#endif
+        {
+            if (s == 0) {
+                p = ss_skip(ss, p, end);
+                if (p == end) break;
+                if (sc->limit && p >= sc->limit) break;
+            }
+            b = *p++;
+        }
+        s = ss_step(ss, s, b);
+        int o = ss->out[s] >= 0 ? s : ss->dict[s];
+        if (o) {
+            sc->state = s;
+            for (; o; o = ss->dict[o]) {
+                for (int k = ss->out[o]; k >= 0; k = ss->sameNext[k]) {
+                    if (!ss_aligned(sc, k)) continue;
+                    if (sc->report(sc, k, p)) return TRUE;
+                }
+            }
+        }
+    }
+    sc->state = s;
+    return FALSE;
+}
+
+/*
+ * Leftmost match
+ *
+ *   We want the match that begins first, and among those that begin
+ *   at the same position, the one that comes first in the needle list,
+ *   as the regexp of the alternation of the needles would find.
+ *   Once we find a match, a match beginning no later can only end
+ *   within maxSize bytes from its beginning, so we scan up to there.
+ */
+struct ss_find {
+    const u_char *start;        /* start of the best match so far */
+    int needle;
+};
+
+static int ss_find_report(ss_scanner *sc, int needle, const u_char *endp)
+{
+    struct ss_find *f = (struct ss_find *)sc->data;
+    const u_char *start = endp - sc->ss->needleSize[needle];
+    if (f->needle < 0 || start < f->start
+        || (start == f->start && needle < f->needle)) {
+        f->start = start;
+        f->needle = needle;
+        sc->limit = start + sc->ss->maxSize;
+    }
+    return FALSE;
+}
+
+/* Returns the index of the needle of the leftmost match in [START, END),
+   and sets its beginning and end in *MSTART and *MEND.  Returns -1
+   if there's no match. */
+int Scm_StringSearcherFind(ScmStringSearcher *ss,
+                           const char *start, const char *end,
+                           const char **mstart, const char **mend)
+{
+    ss_scanner sc;
+    struct ss_find f;
+    f.start = NULL;
+    f.needle = -1;
+#ifdef SS_CHECK_BOUNDARY
+    ss_scanner_init(&sc, ss, ss_find_report, &f, TRUE);
+#else
+    ss_scanner_init(&sc, ss, ss_find_report, &f, FALSE);
+#endif
+    ss_scan(&sc, (const u_char*)start, (const u_char*)end);
+    if (f.needle >= 0) {
+        *mstart = (const char*)f.start;
+        *mend = *mstart + ss->needleSize[f.needle];
+    }
+    return f.needle;
+}
+
+/* Scheme interface.  Returns the character index of the leftmost match
+   and the index of the needle, or #f and #f. */
+ScmObj Scm_StringSearcherSearch(ScmStringSearcher *ss, ScmString *str,
+                                ScmObj start, ScmObj end)
+{
+    const ScmStringBody *b = SCM_STRING_BODY(str);
+    const char *sp = SCM_STRING_BODY_START(b);
+    const char *ep = sp + SCM_STRING_BODY_SIZE(b);
+    const char *bp = sp, *mp, *mq;
+
+    if (SCM_STRING_BODY_INCOMPLETE_P(b)) {
+        Scm_Error("incomplete string is not allowed: %S", str);
+    }
+    if (!(SCM_UNBOUNDP(end) || SCM_UNDEFINEDP(end) || SCM_FALSEP(end))) {
+        ep = sp + Scm__StringCursorOffset(b, end);
+    }
+    if (!(SCM_UNBOUNDP(start) || SCM_UNDEFINEDP(start) || SCM_FALSEP(start))) {
+        bp = sp + Scm__StringCursorOffset(b, start);
+    }
+    if (bp > ep) {
+        Scm_Error("start position %S is greater than end position %S",
+                  start, end);
+    }
+    int k = Scm_StringSearcherFind(ss, bp, ep, &mp, &mq);
+    if (k < 0) return Scm_Values2(SCM_FALSE, SCM_FALSE);
+    ScmSmallInt ci = (SCM_STRING_BODY_SIZE(b) == SCM_STRING_BODY_LENGTH(b))
+        ? (mp - sp) : Scm_MBLen(sp, mp);
+    return Scm_Values2(Scm_MakeInteger(ci), SCM_MAKE_INT(k));
+}
+
+/*
+ * Fold over all matches
+ *
+ *   The character position of a match is computed from its end, which
+ *   never goes back: we count the characters from MARK, up to which
+ *   we've counted, to the end, then subtract the length of the needle.
+ *   When the input comes in chunks, a character may straddle the chunk
+ *   boundary; CARRY is the number of its bytes in the next chunk.
+ */
+struct ss_fold {
+    ScmObj proc;
+    ScmObj seed;
+    int singlebyte;             /* byte index == char index */
+    const u_char *chunk;        /* beginning of the current chunk */
+    ScmSmallInt chunkBytes;     /* # of bytes before CHUNK */
+    const u_char *mark;
+    ScmSmallInt nchars;         /* # of chars before MARK */
+};
+
+/* Counts the characters that begin in [P, END).  Sets *CARRY to the
+   number of the bytes of the last character that lie beyond END. */
+static ScmSmallInt ss_count_chars(const u_char *p, const u_char *end,
+                                  int *carry)
+{
+    ScmSmallInt n = 0;
+    while (p < end) {
+        p += SCM_CHAR_NFOLLOWS(*p) + 1;
+        n++;
+    }
+    *carry = (int)(p - end);
+    return n;
+}
+
+static int ss_fold_report(ss_scanner *sc, int needle, const u_char *endp)
+{
+    struct ss_fold *f = (struct ss_fold *)sc->data;
+    ScmSmallInt pos;
+#ifdef SS_CHECK_BOUNDARY
+    if (sc->track) {
+        pos = sc->nchars - sc->ss->needleLen[needle];
+    } else
+#endif
+    if (f->singlebyte) {
+        pos = f->chunkBytes + (endp - f->chunk) - sc->ss->needleSize[needle];
+    } else {
+        if (endp > f->mark) {
+            int carry;
+            f->nchars += ss_count_chars(f->mark, endp, &carry);
+            f->mark = endp + carry;
+        }
+        pos = f->nchars - sc->ss->needleLen[needle];
+    }
+    f->seed = Scm_ApplyRec3(f->proc, SCM_MAKE_INT(needle),
+                            Scm_MakeInteger(pos), f->seed);
+    return FALSE;
+}
+
+#define SS_CHUNK_SIZE 8192
+
+/* Calls PROC with the needle index, the character position, and the
+   accumulated value for each match in SRC, which is a string or an
+   input port.  With a port, positions are counted from where we start
+   reading. */
+ScmObj Scm_StringSearcherFold(ScmStringSearcher *ss, ScmObj src,
+                              ScmObj proc, ScmObj seed)
+{
+    ss_scanner sc;
+    struct ss_fold f;
+    f.proc = proc;
+    f.seed = seed;
+    f.nchars = 0;
+    f.chunkBytes = 0;
+
+    if (SCM_STRINGP(src)) {
+        const ScmStringBody *b = SCM_STRING_BODY(src);
+        const u_char *sp = (const u_char*)SCM_STRING_BODY_START(b);
+        if (SCM_STRING_BODY_INCOMPLETE_P(b)) {
+            Scm_Error("incomplete string is not allowed: %S", src);
+        }
+        f.singlebyte =
+            (SCM_STRING_BODY_SIZE(b) == SCM_STRING_BODY_LENGTH(b));
+        f.chunk = f.mark = sp;
+#ifdef SS_CHECK_BOUNDARY
+        ss_scanner_init(&sc, ss, ss_fold_report, &f, !f.singlebyte);
+#else
+        ss_scanner_init(&sc, ss, ss_fold_report, &f, FALSE);
+#endif
+        ss_scan(&sc, sp, sp + SCM_STRING_BODY_SIZE(b));
+    } else if (SCM_IPORTP(src)) {
+        u_char *buf = SCM_NEW_ATOMIC_ARRAY(u_char, SS_CHUNK_SIZE);
+        int carry = 0;
+        f.singlebyte = FALSE;
+#ifdef SS_CHECK_BOUNDARY
+        ss_scanner_init(&sc, ss, ss_fold_report, &f, TRUE);
+#else
+        ss_scanner_init(&sc, ss, ss_fold_report, &f, FALSE);
+#endif
+        for (;;) {
+            int n = Scm_Getz((char*)buf, SS_CHUNK_SIZE, SCM_PORT(src));
+            if (n <= 0) break;
+            f.chunk = buf;
+            f.mark = buf + (carry < n ? carry : n);
+            carry -= (int)(f.mark - buf);
+            ss_scan(&sc, buf, buf + n);
+            if (f.mark < buf + n) {
+                int c;
+                f.nchars += ss_count_chars(f.mark, buf + n, &c);
+                carry += c;
+            }
+            f.chunkBytes += n;
+        }
+    } else {
+        Scm_Error("string or input port required, but got %S", src);
+    }
+    return f.seed;
+}
@@ -36,6 +36,12 @@
 #include "gauche/priv/builtin-syms.h"
 #include "gauche/priv/moduleP.h"
 
+/* See src/lazy.c for why we avoid native atomic ops on these platforms */
+#if defined(__SH4__) || defined(__ARMEL__)
+#define AO_USE_PTHREAD_DEFS 1
+#endif
+#include "atomic_ops.h"
+
 /*-----------------------------------------------------------
  * Symbols
  */
@@ -55,9 +61,240 @@ static ScmClass *keyword_cpl[] = {
 SCM_DEFINE_BUILTIN_CLASS(Scm_KeywordClass, symbol_print, symbol_compare,
                          NULL, NULL, keyword_cpl);
 
-/* name -> symbol mapper */
-static ScmInternalMutex obtable_mutex = SCM_INTERNAL_MUTEX_INITIALIZER;
-static ScmHashTable *obtable = NULL;
+/* name -> symbol mapper
+ *
+ *  Lookups don't take a lock.  Each bucket is a chain of entries that
+ *  are never modified once published; a new entry is pushed in front
+ *  of the chain with a release store, so a reader sees either the old
+ *  chain or the new one.
+ *
+ *  Writers lock one of SYMTAB_NSTRIPES mutexes chosen by the low bits
+ *  of the hash value.  Since the number of buckets is a power of two
+ *  and no less than SYMTAB_NSTRIPES, all the entries in a bucket belong
+ *  to the same stripe.  When the table gets crowded, the writer takes
+ *  all the stripe locks and builds a new bucket array with new entries,
+ *  then swaps the table.  Readers that are still looking at the old
+ *  table see a consistent snapshot of it; if they miss a symbol added
+ *  after the swap, they'll find it again under the lock before adding it.
+ *
+ *  In the weak mode, an entry refers to the symbol through a weak box,
+ *  so a symbol that isn't referenced from anywhere else (code, modules,
+ *  data) can be collected.  Such a dead entry is skipped by lookups and
+ *  dropped when the table is rebuilt.  Statically allocated symbols are
+ *  never collected.
+ */
+#define SYMTAB_NSTRIPES   16
+#define SYMTAB_INIT_SIZE  4096  /* must be a power of two */
+
+typedef struct symtab_entry_rec {
+    struct symtab_entry_rec *next;
+    u_long hashval;
+    ScmSymbol *sym;             /* strong reference, or NULL if weak */
+    ScmWeakBox *wsym;           /* weak reference, or NULL if strong */
+} symtab_entry;
+
+typedef struct symtab_rec {
+    u_long mask;                /* # of buckets - 1 */
+    AO_t buckets[1];            /* symtab_entry*; variable length */
+} symtab;
+
+static struct {
+    AO_t table;                 /* symtab* */
+    AO_t count;                 /* # of entries, including dead ones */
+    u_long seed;
+    int weak;                   /* TRUE if we're in the weak mode */
+    /* statistics */
+    AO_t interned;              /* # of symbols ever added */
+    u_long collected;           /* # of dead entries dropped */
+    u_long rebuilds;            /* # of rebuilds of the table */
+    ScmInternalMutex stripes[SYMTAB_NSTRIPES];
+} obtable;
+
+static symtab *make_symtab(u_long nbuckets)
+{
+    symtab *t = SCM_NEW2(symtab*, sizeof(symtab) + (nbuckets-1)*sizeof(AO_t));
+    t->mask = nbuckets - 1;
+    for (u_long i = 0; i < nbuckets; i++) t->buckets[i] = 0;
+    return t;
+}
+
+static symtab_entry *make_entry(ScmSymbol *sym, u_long hashval,
+                                symtab_entry *next)
+{
+    symtab_entry *e = SCM_NEW(symtab_entry);
+    e->next = next;
+    e->hashval = hashval;
+    if (obtable.weak) {
+        e->sym = NULL;
+        e->wsym = Scm_MakeWeakBox(sym);
+    } else {
+        e->sym = sym;
+        e->wsym = NULL;
+    }
+    return e;
+}
+
+/* Returns NULL if the symbol has been collected.  The caller should keep
+   the returned pointer in a local variable while using it. */
+static inline ScmSymbol *entry_sym(symtab_entry *e)
+{
+    if (e->sym) return e->sym;
+    return (ScmSymbol*)Scm_WeakBoxRef(e->wsym);
+}
+
+static inline u_long symtab_hash(const char *name, ScmSmallInt size)
+{
+    return Scm_HashBytes(name, size, obtable.seed);
+}
+
+static ScmSymbol *symtab_lookup(const char *name, ScmSmallInt size,
+                                u_long hashval)
+{
+    symtab *t = (symtab*)AO_load_acquire(&obtable.table);
+    symtab_entry *e =
+        (symtab_entry*)AO_load_acquire(&t->buckets[hashval & t->mask]);
+    for (; e; e = e->next) {
+        if (e->hashval != hashval) continue;
+        ScmSymbol *sym = entry_sym(e);
+        if (sym == NULL) continue;
+        const ScmStringBody *b = SCM_STRING_BODY(SCM_SYMBOL_NAME(sym));
+        if (SCM_STRING_BODY_SIZE(b) == size
+            && memcmp(SCM_STRING_BODY_START(b), name, size) == 0) {
+            return sym;
+        }
+    }
+    return NULL;
+}
+
+static void lock_all(void)
+{
+    for (int i = 0; i < SYMTAB_NSTRIPES; i++) {
+        SCM_INTERNAL_MUTEX_LOCK(obtable.stripes[i]);
+    }
+}
+
+static void unlock_all(void)
+{
+    for (int i = SYMTAB_NSTRIPES - 1; i >= 0; i--) {
+        SCM_INTERNAL_MUTEX_UNLOCK(obtable.stripes[i]);
+    }
+}
+
+/* Builds a new table with the live entries, which are made strong or
+   weak according to the current mode.  The table grows so that the load
+   factor doesn't exceed 1.  Must be called with all the stripe locks. */
+static void symtab_rebuild(void)
+{
+    symtab *t = (symtab*)AO_load(&obtable.table);
+    u_long live = 0, dead = 0;
+    for (u_long i = 0; i <= t->mask; i++) {
+        symtab_entry *e = (symtab_entry*)t->buckets[i];
+        for (; e; e = e->next) {
+            if (entry_sym(e)) live++;
+            else dead++;
+        }
+    }
+    u_long nbuckets = t->mask + 1;
+    while (live > nbuckets) nbuckets *= 2;
+
+    symtab *nt = make_symtab(nbuckets);
+    for (u_long i = 0; i <= t->mask; i++) {
+        symtab_entry *e = (symtab_entry*)t->buckets[i];
+        for (; e; e = e->next) {
+            ScmSymbol *sym = entry_sym(e);
+            if (sym == NULL) continue;
+            AO_t *b = &nt->buckets[e->hashval & nt->mask];
+            *b = (AO_t)make_entry(sym, e->hashval, (symtab_entry*)*b);
+        }
+    }
+    AO_store(&obtable.count, live);
+    obtable.collected += dead;
+    obtable.rebuilds++;
+    AO_store_release(&obtable.table, (AO_t)nt);
+}
+
+static void symtab_grow(void)
+{
+    lock_all();
+    symtab *t = (symtab*)AO_load(&obtable.table);
+    /* Another thread may have done the job while we're waiting. */
+    if (AO_load(&obtable.count) > 2*(t->mask+1)) symtab_rebuild();
+    unlock_all();
+}
+
+/* Registers SYM.  If another thread has registered the symbol of the same
+   name in the meantime, returns that one. */
+static ScmSymbol *symtab_add(ScmSymbol *sym, u_long hashval)
+{
+    const ScmStringBody *b = SCM_STRING_BODY(SCM_SYMBOL_NAME(sym));
+    const char *name = SCM_STRING_BODY_START(b);
+    ScmSmallInt size = SCM_STRING_BODY_SIZE(b);
+    int stripe = (int)(hashval & (SYMTAB_NSTRIPES - 1));
+    u_long nbuckets = 0;
+
+    SCM_INTERNAL_MUTEX_LOCK(obtable.stripes[stripe]);
+    ScmSymbol *r = symtab_lookup(name, size, hashval);
+    if (r == NULL) {
+        symtab *t = (symtab*)AO_load(&obtable.table);
+        AO_t *bucket = &t->buckets[hashval & t->mask];
+        symtab_entry *e = make_entry(sym, hashval,
+                                     (symtab_entry*)AO_load(bucket));
+        AO_store_release(bucket, (AO_t)e);
+        nbuckets = t->mask + 1;
+        r = sym;
+    }
+    SCM_INTERNAL_MUTEX_UNLOCK(obtable.stripes[stripe]);
+
+    if (r == sym) {
+        AO_fetch_and_add1(&obtable.interned);
+        if (AO_fetch_and_add1(&obtable.count) > 2*nbuckets) symtab_grow();
+    }
+    return r;
+}
+
+/* Switches the weak mode.  Existing entries are converted as well.
+   Returns the previous mode. */
+int Scm_SymbolTableSetWeak(int weak)
+{
+    lock_all();
+    int prev = obtable.weak;
+    if (!prev != !weak) {
+        obtable.weak = !!weak;
+        symtab_rebuild();
+    }
+    unlock_all();
+    return prev;
+}
+
+/* Returns a plist of statistics.  The numbers are a snapshot; they can
+   be slightly off if other threads are adding symbols. */
+ScmObj Scm_SymbolTableStat(void)
+{
+    symtab *t = (symtab*)AO_load_acquire(&obtable.table);
+    u_long live = 0;
+    for (u_long i = 0; i <= t->mask; i++) {
+        symtab_entry *e = (symtab_entry*)AO_load_acquire(&t->buckets[i]);
+        for (; e; e = e->next) {
+            if (entry_sym(e)) live++;
+        }
+    }
+    ScmObj h = SCM_NIL, tail = SCM_NIL;
+    SCM_APPEND1(h, tail, SCM_MAKE_KEYWORD("num-entries"));
+    SCM_APPEND1(h, tail, Scm_MakeIntegerU(AO_load(&obtable.count)));
+    SCM_APPEND1(h, tail, SCM_MAKE_KEYWORD("num-live-entries"));
+    SCM_APPEND1(h, tail, Scm_MakeIntegerU(live));
+    SCM_APPEND1(h, tail, SCM_MAKE_KEYWORD("num-buckets"));
+    SCM_APPEND1(h, tail, Scm_MakeIntegerU(t->mask + 1));
+    SCM_APPEND1(h, tail, SCM_MAKE_KEYWORD("weak"));
+    SCM_APPEND1(h, tail, SCM_MAKE_BOOL(obtable.weak));
+    SCM_APPEND1(h, tail, SCM_MAKE_KEYWORD("interned"));
+    SCM_APPEND1(h, tail, Scm_MakeIntegerU(AO_load(&obtable.interned)));
+    SCM_APPEND1(h, tail, SCM_MAKE_KEYWORD("collected"));
+    SCM_APPEND1(h, tail, Scm_MakeIntegerU(obtable.collected));
+    SCM_APPEND1(h, tail, SCM_MAKE_KEYWORD("rebuilds"));
+    SCM_APPEND1(h, tail, Scm_MakeIntegerU(obtable.rebuilds));
+    return h;
+}
 
 #if GAUCHE_KEEP_DISJOINT_KEYWORD_OPTION
 /* Global keyword table. */
@@ -69,15 +306,19 @@ static struct {
 static int keyword_disjoint_p = FALSE;
 #endif /*!GAUCHE_KEEP_DISJOINT_KEYWORD_OPTION*/
 
+
 /* internal constructor.  NAME must be an immutable string. */
 static ScmSymbol *make_sym(ScmClass *klass, ScmString *name, int interned)
 {
+    u_long hashval = 0;
     if (interned) {
         /* fast path */
-        SCM_INTERNAL_MUTEX_LOCK(obtable_mutex);
-        ScmObj e = Scm_HashTableRef(obtable, SCM_OBJ(name), SCM_FALSE);
-        SCM_INTERNAL_MUTEX_UNLOCK(obtable_mutex);
-        if (!SCM_FALSEP(e)) return SCM_SYMBOL(e);
+        const ScmStringBody *b = SCM_STRING_BODY(name);
+        hashval = symtab_hash(SCM_STRING_BODY_START(b),
+                              SCM_STRING_BODY_SIZE(b));
+        ScmSymbol *e = symtab_lookup(SCM_STRING_BODY_START(b),
+                                     SCM_STRING_BODY_SIZE(b), hashval);
+        if (e) return e;
     }
 
     ScmSymbol *sym = SCM_NEW(ScmSymbol);
@@ -88,14 +329,7 @@ static ScmSymbol *make_sym(ScmClass *klass, ScmString *name, int interned)
     if (!interned) {
         return sym;
     } else {
-        /* Using SCM_DICT_NO_OVERWRITE ensures that if another thread interns
-           the same name symbol between above HashTableRef and here, we'll
-           get the already interned symbol. */
-        SCM_INTERNAL_MUTEX_LOCK(obtable_mutex);
-        ScmObj e = Scm_HashTableSet(obtable, SCM_OBJ(name), SCM_OBJ(sym),
-                                    SCM_DICT_NO_OVERWRITE);
-        SCM_INTERNAL_MUTEX_UNLOCK(obtable_mutex);
-        return SCM_SYMBOL(e);
+        return symtab_add(sym, hashval);
     }
 }
 
@@ -107,6 +341,47 @@ ScmObj Scm_MakeSymbol(ScmString *name, int interned)
     return SCM_OBJ(make_sym(SCM_CLASS_SYMBOL, SCM_STRING(sname), interned));
 }
 
+/* Intern a symbol whose name is given as SIZE bytes from NAME, e.g. in
+   a parser's buffer.  The bytes are copied only when a new symbol is
+   created, so looking up an existing symbol doesn't allocate. */
+ScmObj Scm_InternBytes(const char *name, ScmSmallInt size)
+{
+    u_long hashval = symtab_hash(name, size);
+    ScmSymbol *e = symtab_lookup(name, size, hashval);
+    if (e) return SCM_OBJ(e);
+
+    ScmObj sname = Scm_MakeString(name, size, -1,
+                                  SCM_STRING_IMMUTABLE|SCM_STRING_COPYING);
+    ScmSymbol *sym = SCM_NEW(ScmSymbol);
+    SCM_SET_CLASS(sym, SCM_CLASS_SYMBOL);
+    sym->name = SCM_STRING(sname);
+    sym->flags = SCM_SYMBOL_FLAG_INTERNED;
+    return SCM_OBJ(symtab_add(sym, hashval));
+}
+
+/* Intern a symbol whose name is in a transient buffer, e.g. the scan
+   buffer of the reader.  NAME needs to be valid only during this call. */
+ScmObj Scm__InternTransient(ScmString *name)
+{
+    const ScmStringBody *b = SCM_STRING_BODY(name);
+    return Scm_InternBytes(SCM_STRING_BODY_START(b), SCM_STRING_BODY_SIZE(b));
+}
+
+/* Looks up an interned symbol without creating one. */
+ScmSymbol *Scm__FindSymbolBytes(const char *name, ScmSmallInt size)
+{
+    return symtab_lookup(name, size, symtab_hash(name, size));
+}
+
+/* Registers a statically allocated symbol.  Called from
+   init_builtin_syms(). */
+static void intern_builtin(ScmSymbol *sym)
+{
+    const ScmStringBody *b = SCM_STRING_BODY(SCM_SYMBOL_NAME(sym));
+    symtab_add(sym, symtab_hash(SCM_STRING_BODY_START(b),
+                                SCM_STRING_BODY_SIZE(b)));
+}
+
 /* Keyword prefix. */
 static SCM_DEFINE_STRING_CONST(keyword_prefix, ":", 1, 1);
 
@@ -420,12 +695,21 @@ ScmObj Scm_DeleteKeywordX(ScmObj key, ScmObj list)
 
 void Scm__InitSymbol(void)
 {
-    SCM_INTERNAL_MUTEX_INIT(obtable_mutex);
-    obtable = SCM_HASH_TABLE(Scm_MakeHashTableSimple(SCM_HASH_STRING, 4096));
+    for (int i = 0; i < SYMTAB_NSTRIPES; i++) {
+        SCM_INTERNAL_MUTEX_INIT(obtable.stripes[i]);
+    }
+    obtable.seed = (u_long)Scm_HashSaltRef();
+    obtable.count = 0;
+    obtable.weak = FALSE;
+    obtable.interned = 0;
+    obtable.collected = 0;
+    obtable.rebuilds = 0;
+    obtable.table = (AO_t)make_symtab(SYMTAB_INIT_SIZE);
     init_builtin_syms();
 #if GAUCHE_KEEP_DISJOINT_KEYWORD_OPTION
     (void)SCM_INTERNAL_MUTEX_INIT(keywords.mutex);
-    keywords.table = SCM_HASH_TABLE(Scm_MakeHashTableSimple(SCM_HASH_STRING, 256));
+    keywords.table = SCM_HASH_TABLE(Scm_MakeHashTableLayout(SCM_HASH_STRING,
+                                    SCM_HASH_OPEN_ADDRESSING, 256));
     /* Preset keyword class precedence list, depending on the value of
        GAUCHE_KEYWORD_DISJOINT or GAUCHE_KEYWORD_IS_SYMBOL */
     const char *disjoint = Scm_GetEnv("GAUCHE_KEYWORD_DISJOINT");
@@ -76,6 +76,22 @@ static int win_wait_for_handles(HANDLE *handles, int nhandles, int options,
 #ifdef HAVE_SCHED_H
 #include <sched.h>
 #endif
+#if !defined(GAUCHE_WINDOWS) && defined(HAVE_SPAWN_H) && defined(HAVE_POSIX_SPAWNP)
+#include <spawn.h>
+#define USE_POSIX_SPAWN 1
+# if defined(HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCHDIR_NP)
+/* glibc declares this only with _GNU_SOURCE. */
+extern int posix_spawn_file_actions_addchdir_np(posix_spawn_file_actions_t *,
+                                                const char *);
+# endif
+#endif
+#if defined(GAUCHE_POLLER_EPOLL)
+#include <sys/epoll.h>
+#elif defined(GAUCHE_POLLER_KQUEUE)
+#include <sys/event.h>
+#elif defined(GAUCHE_POLLER_POLL)
+#include <poll.h>
+#endif
 
 /*
  * Auxiliary system interface functions.   See syslib.stub for
@@ -187,15 +203,80 @@ int Scm_GetPortFd(ScmObj port_or_fd, int needfd)
  *   reads entire directory.
  */
 
-/* Returns a list of directory entries.  If pathname is not a directory,
-   or can't be opened by some reason, an error is signalled. */
-ScmObj Scm_ReadDirectory(ScmString *pathname)
+/* Returns a symbol that tells the file type of MODE, as the type slot
+   of <sys-stat>. */
+static ScmObj file_type_symbol(mode_t mode)
+{
+    if (S_ISDIR(mode)) return (SCM_SYM_DIRECTORY);
+    if (S_ISREG(mode)) return (SCM_SYM_REGULAR);
+    if (S_ISCHR(mode)) return (SCM_SYM_CHARACTER);
+    if (S_ISBLK(mode)) return (SCM_SYM_BLOCK);
+    if (S_ISFIFO(mode)) return (SCM_SYM_FIFO);
+#ifdef S_ISLNK
+    if (S_ISLNK(mode)) return (SCM_SYM_SYMLINK);
+#endif
+#ifdef S_ISSOCK
+    if (S_ISSOCK(mode)) return (SCM_SYM_SOCKET);
+#endif
+    return (SCM_FALSE);
+}
+
+#if !defined(GAUCHE_WINDOWS)
+/* Find the type of directory entry NAME in DIRP, whose pathname is DIR.
+   Most filesystems tell the type in d_type, so we can avoid stat(2)
+   except symlinks to follow and entries of unknown type.  When we do
+   need stat, fstatat on the directory fd saves path lookup. */
+static ScmObj dirent_type(DIR *dirp, const char *dir, struct dirent *dire,
+                          int followlink)
+{
+#if defined(HAVE_STRUCT_DIRENT_D_TYPE)
+    switch (dire->d_type) {
+    case DT_DIR:  return SCM_SYM_DIRECTORY;
+    case DT_REG:  return SCM_SYM_REGULAR;
+    case DT_CHR:  return SCM_SYM_CHARACTER;
+    case DT_BLK:  return SCM_SYM_BLOCK;
+    case DT_FIFO: return SCM_SYM_FIFO;
+    case DT_SOCK: return SCM_SYM_SOCKET;
+    case DT_LNK:  if (!followlink) return SCM_SYM_SYMLINK; break;
+    default: break;
+    }
+#endif /*HAVE_STRUCT_DIRENT_D_TYPE*/
+    struct stat st;
+    int r;
+#if defined(HAVE_FSTATAT)
+    r = fstatat(dirfd(dirp), dire->d_name, &st,
+                followlink? 0 : AT_SYMLINK_NOFOLLOW);
+    if (r < 0 && followlink) {
+        /* a dangling symlink is reported as a symlink */
+        r = fstatat(dirfd(dirp), dire->d_name, &st, AT_SYMLINK_NOFOLLOW);
+    }
+#else  /*!HAVE_FSTATAT*/
+    ScmDString ds;
+    Scm_DStringInit(&ds);
+    Scm_DStringPutz(&ds, dir, -1);
+    Scm_DStringPutc(&ds, SCM_CHAR('/'));
+    Scm_DStringPutz(&ds, dire->d_name, -1);
+    const char *path = Scm_DStringGetz(&ds);
+    r = followlink? stat(path, &st) : lstat(path, &st);
+    if (r < 0 && followlink) r = lstat(path, &st);
+#endif /*!HAVE_FSTATAT*/
+    (void)dir;
+    if (r < 0) return SCM_FALSE; /* the entry has gone */
+    return file_type_symbol(st.st_mode);
+}
+#endif /*!GAUCHE_WINDOWS*/
+
+/* Common routine for Scm_ReadDirectory and Scm_ReadDirectoryWithTypes.
+   If TYPED is true, each element is (name . type); see below. */
+static ScmObj read_directory(ScmString *pathname, int typed, int flags)
 {
     ScmObj head = SCM_NIL, tail = SCM_NIL;
 #if !defined(GAUCHE_WINDOWS)
     ScmVM *vm = Scm_VM();
     struct dirent *dire;
-    DIR *dirp = opendir(Scm_GetStringConst(pathname));
+    const char *dir = Scm_GetStringConst(pathname);
+    int followlink = flags & SCM_READDIR_FOLLOW_LINK;
+    DIR *dirp = opendir(dir);
 
     if (dirp == NULL) {
         SCM_SIGCHECK(vm);
@@ -203,6 +284,9 @@ ScmObj Scm_ReadDirectory(ScmString *pathname)
     }
     while ((dire = readdir(dirp)) != NULL) {
         ScmObj ent = SCM_MAKE_STR_COPYING(dire->d_name);
+        if (typed) {
+            ent = Scm_Cons(ent, dirent_type(dirp, dir, dire, followlink));
+        }
         SCM_APPEND1(head, tail, ent);
     }
     SCM_SIGCHECK(vm);
@@ -225,17 +309,23 @@ ScmObj Scm_ReadDirectory(ScmString *pathname)
     }
     const char *path = Scm_GetStringConst(SCM_STRING(pattern));
 
+#define WIN_DIRENT(fdata)                                               \
+    (typed                                                              \
+     ? Scm_Cons(SCM_MAKE_STR_COPYING(SCM_WCS2MBS((fdata).cFileName)),   \
+                (((fdata).dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)  \
+                 ? SCM_SYM_DIRECTORY : SCM_SYM_REGULAR))                \
+     : SCM_MAKE_STR_COPYING(SCM_WCS2MBS((fdata).cFileName)))
+
     HANDLE dirp = FindFirstFile(SCM_MBS2WCS(path), &fdata);
     if (dirp == INVALID_HANDLE_VALUE) {
         if ((winerrno = GetLastError()) != ERROR_FILE_NOT_FOUND) goto err;
         return head;
     }
-    const char *tpath = SCM_WCS2MBS(fdata.cFileName);
-    SCM_APPEND1(head, tail, SCM_MAKE_STR_COPYING(tpath));
+    SCM_APPEND1(head, tail, WIN_DIRENT(fdata));
     while (FindNextFile(dirp, &fdata) != 0) {
-        tpath = SCM_WCS2MBS(fdata.cFileName);
-        SCM_APPEND1(head, tail, SCM_MAKE_STR_COPYING(tpath));
+        SCM_APPEND1(head, tail, WIN_DIRENT(fdata));
     }
+#undef WIN_DIRENT
     winerrno = GetLastError();
     FindClose(dirp);
     if (winerrno != ERROR_NO_MORE_FILES) goto err;
@@ -247,6 +337,23 @@ ScmObj Scm_ReadDirectory(ScmString *pathname)
 #endif
 }
 
+/* Returns a list of directory entries.  If pathname is not a directory,
+   or can't be opened by some reason, an error is signalled. */
+ScmObj Scm_ReadDirectory(ScmString *pathname)
+{
+    return read_directory(pathname, FALSE, 0);
+}
+
+/* Like Scm_ReadDirectory, but each element is (name . type), where
+   type is the same symbol as the type slot of <sys-stat>, or #f if
+   the entry vanished before we could know its type.  Symlinks are
+   followed if SCM_READDIR_FOLLOW_LINK is given, in which case only
+   dangling links are reported as symlink. */
+ScmObj Scm_ReadDirectoryWithTypes(ScmString *pathname, int flags)
+{
+    return read_directory(pathname, TRUE, flags);
+}
+
 /* getcwd compatibility layer.
    Some implementations of getcwd accepts NULL as buffer to allocate
    enough buffer memory in it, but that's not standardized and we avoid
@@ -816,18 +923,7 @@ ScmObj Scm_MakeSysStat(void)
 
 static ScmObj stat_type_get(ScmSysStat *stat)
 {
-    if (S_ISDIR(SCM_SYS_STAT_STAT(stat)->st_mode)) return (SCM_SYM_DIRECTORY);
-    if (S_ISREG(SCM_SYS_STAT_STAT(stat)->st_mode)) return (SCM_SYM_REGULAR);
-    if (S_ISCHR(SCM_SYS_STAT_STAT(stat)->st_mode)) return (SCM_SYM_CHARACTER);
-    if (S_ISBLK(SCM_SYS_STAT_STAT(stat)->st_mode)) return (SCM_SYM_BLOCK);
-    if (S_ISFIFO(SCM_SYS_STAT_STAT(stat)->st_mode)) return (SCM_SYM_FIFO);
-#ifdef S_ISLNK
-    if (S_ISLNK(SCM_SYS_STAT_STAT(stat)->st_mode)) return (SCM_SYM_SYMLINK);
-#endif
-#ifdef S_ISSOCK
-    if (S_ISSOCK(SCM_SYS_STAT_STAT(stat)->st_mode)) return (SCM_SYM_SOCKET);
-#endif
-    return (SCM_FALSE);
+    return file_type_symbol(SCM_SYS_STAT_STAT(stat)->st_mode);
 }
 
 static ScmObj stat_perm_get(ScmSysStat *stat)
@@ -1612,6 +1708,136 @@ char *win_create_command_line(ScmObj args)
 }
 #endif /*GAUCHE_WINDOWS*/
 
+#if defined(USE_POSIX_SPAWN)
+/* posix_spawn support for Scm_SysExec.
+ *
+ *   Fork-and-exec from a process with a large heap pays for duplicating
+ *   the whole address space (page tables, and copy-on-write faults until
+ *   the child execs), which makes spawning latency proportional to the
+ *   heap size.  When we can express what the child needs to do in terms
+ *   of posix_spawn file actions, we use posix_spawnp instead, which
+ *   modern libcs implement with vfork-like clone.
+ *
+ *   The file actions replicate Scm_SysSwapFds: dup2 each fromfd to tofd,
+ *   preserving sources that would be overwritten by an earlier dup2, then
+ *   close every other open fd.
+ */
+
+/* Returns TRUE iff FD is one of the destinations of the fd map. */
+static int fdmap_dest_p(int *fds, int fd)
+{
+    int nfds = fds[0];
+    for (int j=0; j<nfds; j++) if (fds[1+j] == fd) return TRUE;
+    return FALSE;
+}
+
+/* Schedule closing all open fds except the destinations of the fd map.
+   On Linux we can list the open fds from /proc; otherwise we probe
+   each fd up to OPEN_MAX (in the parent, but it's still cheaper than
+   a fork). */
+static int spawn_add_closes(posix_spawn_file_actions_t *fa, int *fds)
+{
+    int r;
+#if defined(__linux__)
+    DIR *d = opendir("/proc/self/fd");
+    if (d != NULL) {
+        int dfd = dirfd(d);
+        struct dirent *e;
+        r = 0;
+        while (r == 0 && (e = readdir(d)) != NULL) {
+            char *end;
+            long fd = strtol(e->d_name, &end, 10);
+            if (end == e->d_name || *end != '\0') continue; /* "." etc. */
+            if (fd == dfd || fdmap_dest_p(fds, (int)fd)) continue;
+            r = posix_spawn_file_actions_addclose(fa, (int)fd);
+        }
+        closedir(d);
+        return r;
+    }
+#endif /*__linux__*/
+    long maxfd = sysconf(_SC_OPEN_MAX);
+    if (maxfd < 0) return EINVAL;
+    for (int fd=0; fd<maxfd; fd++) {
+        if (fdmap_dest_p(fds, fd) || fcntl(fd, F_GETFD) < 0) continue;
+        if ((r = posix_spawn_file_actions_addclose(fa, fd)) != 0) return r;
+    }
+    return 0;
+}
+
+/* Starts PROGRAM by posix_spawnp.  Returns 0 and sets *PID on success.
+   Returns an errno value on failure, in which case the caller falls back
+   to fork-and-exec; that way the failure is reported in the same way
+   as before (the child panics with "exec failed"). */
+static int spawn_process(const char *program, char **argv, int *fds,
+                         const char *cdir, pid_t *pid)
+{
+    posix_spawn_file_actions_t fa;
+    int r, ntmp = 0, *tmpfds = NULL;
+
+    if ((r = posix_spawn_file_actions_init(&fa)) != 0) return r;
+#if defined(HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCHDIR_NP)
+    if (cdir != NULL
+        && (r = posix_spawn_file_actions_addchdir_np(&fa, cdir)) != 0) {
+        goto out;
+    }
+#else
+    SCM_ASSERT(cdir == NULL);
+#endif
+
+    if (fds != NULL) {
+        int nfds = fds[0];
+        int *tofd = fds + 1;
+        /* We don't modify FDS, for the caller may need it to fall back. */
+        int *from = SCM_NEW_ATOMIC_ARRAY(int, nfds);
+        memcpy(from, fds + 1 + nfds, nfds * sizeof(int));
+        tmpfds = SCM_NEW_ATOMIC_ARRAY(int, nfds);
+
+        /* Temporary fds must not collide with anything in the map. */
+        int minfd = 0;
+        for (int i=0; i<nfds; i++) {
+            if (tofd[i] >= minfd) minfd = tofd[i] + 1;
+            if (from[i] >= minfd) minfd = from[i] + 1;
+        }
+
+        for (int i=0; i<nfds; i++) {
+            if (tofd[i] == from[i]) continue;
+            int tmp = -1;
+            for (int j=i+1; j<nfds; j++) {
+                if (tofd[i] != from[j]) continue;
+                if (tmp < 0) {
+                    /* The child's tofd[i] at this point is whatever the
+                       last earlier action put there, if any. */
+                    int cur = tofd[i];
+                    for (int k=0; k<i; k++) if (tofd[k] == tofd[i]) cur = from[k];
+                    if ((tmp = fcntl(cur, F_DUPFD, minfd)) < 0) {
+                        r = errno;
+                        goto out;
+                    }
+                    tmpfds[ntmp++] = tmp;
+                    /* close-on-exec, so the program never sees it */
+                    (void)fcntl(tmp, F_SETFD, FD_CLOEXEC);
+                }
+                from[j] = tmp;
+            }
+            if ((r = posix_spawn_file_actions_adddup2(&fa, from[i], tofd[i])) != 0)
+                goto out;
+        }
+        if ((r = spawn_add_closes(&fa, fds)) != 0) goto out;
+    }
+
+#if defined(HAVE_CRT_EXTERNS_H)
+    char **envp = *_NSGetEnviron();
+#else
+    char **envp = environ;
+#endif
+    r = posix_spawnp(pid, program, &fa, NULL, argv, envp);
+  out:
+    for (int i=0; i<ntmp; i++) close(tmpfds[i]);
+    posix_spawn_file_actions_destroy(&fa);
+    return r;
+}
+#endif /*USE_POSIX_SPAWN*/
+
 /* Scm_SysExec
  *   execvp(), with optionally setting stdios correctly.
  *
@@ -1629,6 +1855,12 @@ char *win_create_command_line(ScmObj args)
  *   show the children's pid.   If fork arg is FALSE, this procedure
  *   of course never returns.
  *
+ *   When forking without detaching and without a signal mask on a system
+ *   with posix_spawn, we spawn the child by posix_spawnp instead, so that
+ *   the cost doesn't depend on the size of our address space.  A signal
+ *   mask needs Scm_ResetSignalHandlers in the child, which file actions
+ *   can't express, so it still takes the fork path.
+ *
  *   On Windows port, this returns a process handle obejct instead of
  *   pid of the child process in fork mode.  We need to keep handle, or
  *   the process exit status will be lost when the child process terminates.
@@ -1662,6 +1894,19 @@ ScmObj Scm_SysExec(ScmString *file, ScmObj args, ScmObj iomap,
     const char *cdir = NULL;
     if (dir != NULL) cdir = Scm_GetStringConst(dir);
 
+#if defined(USE_POSIX_SPAWN)
+    if (forkp && !detachp && mask == NULL
+# if !defined(HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCHDIR_NP)
+        && cdir == NULL
+# endif
+        ) {
+        if (spawn_process(program, argv, fds, cdir, &pid) == 0) {
+            return Scm_MakeInteger(pid);
+        }
+        /* Fall back to fork to report the error as usual. */
+    }
+#endif /*USE_POSIX_SPAWN*/
+
     /* When requested, call fork() here. */
     if (forkp) {
         SCM_SYSCALL(pid, fork());
@@ -2248,6 +2493,300 @@ ScmObj Scm_SysSelectX(ScmObj rfds, ScmObj wfds, ScmObj efds, ScmObj timeout)
 
 #endif /* HAVE_SELECT */
 
+/*===============================================================
+ * poller
+ */
+
+#ifdef GAUCHE_HAVE_POLLER
+
+static ScmObj sym_r;
+static ScmObj sym_w;
+static ScmObj sym_x;
+
+static void poller_print(ScmObj obj, ScmPort *port, ScmWriteContext *ctx)
+{
+    Scm_Printf(port, "#<sys-poller %S%s>", Scm_SysPollerBackend(),
+               (SCM_SYS_POLLER(obj)->fd < 0 ? " (closed)" : ""));
+}
+
+SCM_DEFINE_BUILTIN_CLASS_SIMPLE(Scm_SysPollerClass, poller_print);
+
+static void poller_finalize(ScmObj obj, void *data)
+{
+    Scm_SysPollerClose(SCM_SYS_POLLER(obj));
+}
+
+ScmObj Scm_SysPollerBackend(void)
+{
+#if defined(GAUCHE_POLLER_EPOLL)
+    return SCM_INTERN("epoll");
+#elif defined(GAUCHE_POLLER_KQUEUE)
+    return SCM_INTERN("kqueue");
+#else
+    return SCM_INTERN("poll");
+#endif
+}
+
+ScmObj Scm_MakeSysPoller(void)
+{
+    ScmSysPoller *p = SCM_NEW(ScmSysPoller);
+    SCM_SET_CLASS(p, SCM_CLASS_SYS_POLLER);
+#if defined(GAUCHE_POLLER_EPOLL)
+    SCM_SYSCALL(p->fd, epoll_create1(EPOLL_CLOEXEC));
+    if (p->fd < 0) Scm_SysError("epoll_create1 failed");
+#elif defined(GAUCHE_POLLER_KQUEUE)
+    SCM_SYSCALL(p->fd, kqueue());
+    if (p->fd < 0) Scm_SysError("kqueue failed");
+    (void)fcntl(p->fd, F_SETFD, FD_CLOEXEC);
+#else
+    p->fd = 0;                  /* not used, except the closed flag */
+    p->pfds = NULL;
+    p->npfds = p->pfdsSize = 0;
+    p->index = NULL;
+    p->indexSize = 0;
+#endif
+    Scm_RegisterFinalizer(SCM_OBJ(p), poller_finalize, NULL);
+    return SCM_OBJ(p);
+}
+
+static void poller_check(ScmSysPoller *p, int fd)
+{
+    if (p->fd < 0) Scm_Error("poller is already closed: %S", SCM_OBJ(p));
+    if (fd < 0) Scm_Error("invalid file descriptor: %d", fd);
+}
+
+/* Register FD with EVENTS, or change the events if FD is already
+   registered.  */
+void Scm_SysPollerAdd(ScmSysPoller *p, int fd, u_long events)
+{
+    poller_check(p, fd);
+#if defined(GAUCHE_POLLER_EPOLL)
+    struct epoll_event ev;
+    int r;
+    ev.events = 0;
+    if (events & SCM_SYS_POLLER_READ)   ev.events |= EPOLLIN;
+    if (events & SCM_SYS_POLLER_WRITE)  ev.events |= EPOLLOUT;
+    if (events & SCM_SYS_POLLER_EXCEPT) ev.events |= EPOLLPRI;
+    if (events & SCM_SYS_POLLER_EDGE)   ev.events |= EPOLLET;
+    /* We keep the interest in the upper half, to filter the result. */
+    ev.data.u64 = ((uint64_t)events << 32) | (uint32_t)fd;
+    SCM_SYSCALL(r, epoll_ctl(p->fd, EPOLL_CTL_ADD, fd, &ev));
+    if (r < 0 && errno == EEXIST) {
+        SCM_SYSCALL(r, epoll_ctl(p->fd, EPOLL_CTL_MOD, fd, &ev));
+    }
+    if (r < 0) Scm_SysError("epoll_ctl failed on fd %d", fd);
+#elif defined(GAUCHE_POLLER_KQUEUE)
+    struct kevent ch;
+    u_short flags = EV_ADD | ((events & SCM_SYS_POLLER_EDGE)? EV_CLEAR : 0);
+    int r;
+    int filters[2] = { EVFILT_READ, EVFILT_WRITE };
+    u_long masks[2] = { SCM_SYS_POLLER_READ, SCM_SYS_POLLER_WRITE };
+    for (int i=0; i<2; i++) {
+        if (events & masks[i]) {
+            EV_SET(&ch, fd, filters[i], flags, 0, 0, 0);
+            SCM_SYSCALL(r, kevent(p->fd, &ch, 1, NULL, 0, NULL));
+            if (r < 0) Scm_SysError("kevent failed on fd %d", fd);
+        } else {
+            EV_SET(&ch, fd, filters[i], EV_DELETE, 0, 0, 0);
+            SCM_SYSCALL(r, kevent(p->fd, &ch, 1, NULL, 0, NULL));
+            if (r < 0 && errno != ENOENT) {
+                Scm_SysError("kevent failed on fd %d", fd);
+            }
+        }
+    }
+#else  /* GAUCHE_POLLER_POLL */
+    struct pollfd *pfds;
+    short ev = 0;
+    if (events & SCM_SYS_POLLER_READ)   ev |= POLLIN;
+    if (events & SCM_SYS_POLLER_WRITE)  ev |= POLLOUT;
+    if (events & SCM_SYS_POLLER_EXCEPT) ev |= POLLPRI;
+
+    if (fd >= p->indexSize) {
+        int nsize = (p->indexSize? p->indexSize : 64);
+        while (nsize <= fd) nsize *= 2;
+        int *nindex = SCM_NEW_ATOMIC_ARRAY(int, nsize);
+        memset(nindex, 0, nsize * sizeof(int));
+        if (p->index) memcpy(nindex, p->index, p->indexSize * sizeof(int));
+        p->index = nindex;
+        p->indexSize = nsize;
+    }
+    if (p->index[fd] == 0) {
+        if (p->npfds == p->pfdsSize) {
+            int nsize = (p->pfdsSize? p->pfdsSize*2 : 16);
+            struct pollfd *npfds = SCM_NEW_ATOMIC_ARRAY(struct pollfd, nsize);
+            if (p->pfds) {
+                memcpy(npfds, p->pfds, p->npfds * sizeof(struct pollfd));
+            }
+            p->pfds = npfds;
+            p->pfdsSize = nsize;
+        }
+        pfds = (struct pollfd*)p->pfds;
+        pfds[p->npfds].fd = fd;
+        pfds[p->npfds].revents = 0;
+        p->index[fd] = ++p->npfds;
+    }
+    pfds = (struct pollfd*)p->pfds;
+    pfds[p->index[fd]-1].events = ev;
+#endif
+}
+
+/* Unregister FD.  It is not an error if FD isn't registered, or has
+   already been closed. */
+void Scm_SysPollerDelete(ScmSysPoller *p, int fd)
+{
+    poller_check(p, fd);
+#if defined(GAUCHE_POLLER_EPOLL)
+    struct epoll_event ev;      /* old kernels require non-NULL */
+    int r;
+    SCM_SYSCALL(r, epoll_ctl(p->fd, EPOLL_CTL_DEL, fd, &ev));
+    if (r < 0 && errno != ENOENT && errno != EBADF) {
+        Scm_SysError("epoll_ctl failed on fd %d", fd);
+    }
+#elif defined(GAUCHE_POLLER_KQUEUE)
+    struct kevent ch;
+    int r;
+    int filters[2] = { EVFILT_READ, EVFILT_WRITE };
+    for (int i=0; i<2; i++) {
+        EV_SET(&ch, fd, filters[i], EV_DELETE, 0, 0, 0);
+        SCM_SYSCALL(r, kevent(p->fd, &ch, 1, NULL, 0, NULL));
+        if (r < 0 && errno != ENOENT && errno != EBADF) {
+            Scm_SysError("kevent failed on fd %d", fd);
+        }
+    }
+#else  /* GAUCHE_POLLER_POLL */
+    if (fd < p->indexSize && p->index[fd] > 0) {
+        struct pollfd *pfds = (struct pollfd*)p->pfds;
+        int i = p->index[fd] - 1;
+        int last = --p->npfds;
+        if (i != last) {
+            pfds[i] = pfds[last];
+            p->index[pfds[i].fd] = i + 1;
+        }
+        p->index[fd] = 0;
+    }
+#endif
+}
+
+static ScmObj poller_event(int fd, u_long events)
+{
+    ScmObj h = SCM_NIL;
+    if (events & SCM_SYS_POLLER_EXCEPT) h = Scm_Cons(sym_x, h);
+    if (events & SCM_SYS_POLLER_WRITE)  h = Scm_Cons(sym_w, h);
+    if (events & SCM_SYS_POLLER_READ)   h = Scm_Cons(sym_r, h);
+    return Scm_Cons(SCM_MAKE_INT(fd), h);
+}
+
+#if !defined(GAUCHE_POLLER_KQUEUE)
+static int poller_timeout_ms(struct timeval *tv)
+{
+    if (tv == NULL) return -1;
+    if (tv->tv_sec >= INT_MAX/1000 - 1) return INT_MAX;
+    return (int)(tv->tv_sec * 1000 + (tv->tv_usec + 999) / 1000);
+}
+#endif
+
+#define POLLER_PREALLOC_EVENTS 64
+
+/* Wait for events up to MAXEVENTS.  Returns a list of (fd flag ...),
+   where flags are r, w and x.  Errors and hang-ups are reported as
+   both readable and writable, as select does, so that the handler
+   notices them by the subsequent i/o. */
+ScmObj Scm_SysPollerWait(ScmSysPoller *p, ScmObj timeout, int maxevents)
+{
+    struct timeval tv, *tvp;
+    ScmObj h = SCM_NIL, t = SCM_NIL;
+    int n;
+
+    if (p->fd < 0) Scm_Error("poller is already closed: %S", SCM_OBJ(p));
+    if (maxevents <= 0) {
+        Scm_Error("maxevents must be a positive integer, but got %d",
+                  maxevents);
+    }
+    tvp = select_timeval(timeout, &tv);
+
+#if defined(GAUCHE_POLLER_EPOLL)
+    struct epoll_event evs_s[POLLER_PREALLOC_EVENTS], *evs = evs_s;
+    if (maxevents > POLLER_PREALLOC_EVENTS) {
+        evs = SCM_NEW_ATOMIC_ARRAY(struct epoll_event, maxevents);
+    }
+    SCM_SYSCALL(n, epoll_wait(p->fd, evs, maxevents, poller_timeout_ms(tvp)));
+    if (n < 0) Scm_SysError("epoll_wait failed");
+    for (int i=0; i<n; i++) {
+        int fd = (int)(uint32_t)evs[i].data.u64;
+        u_long interest = (u_long)(evs[i].data.u64 >> 32);
+        u_long e = 0;
+        if (evs[i].events & EPOLLIN)  e |= SCM_SYS_POLLER_READ;
+        if (evs[i].events & EPOLLOUT) e |= SCM_SYS_POLLER_WRITE;
+        if (evs[i].events & EPOLLPRI) e |= SCM_SYS_POLLER_EXCEPT;
+        if (evs[i].events & (EPOLLERR|EPOLLHUP)) {
+            e |= SCM_SYS_POLLER_READ|SCM_SYS_POLLER_WRITE;
+        }
+        e &= interest;
+        if (e) SCM_APPEND1(h, t, poller_event(fd, e));
+    }
+#elif defined(GAUCHE_POLLER_KQUEUE)
+    struct kevent evs_s[POLLER_PREALLOC_EVENTS], *evs = evs_s;
+    struct timespec ts, *tsp = NULL;
+    if (maxevents > POLLER_PREALLOC_EVENTS) {
+        evs = SCM_NEW_ATOMIC_ARRAY(struct kevent, maxevents);
+    }
+    if (tvp) {
+        ts.tv_sec = tvp->tv_sec;
+        ts.tv_nsec = tvp->tv_usec * 1000;
+        tsp = &ts;
+    }
+    SCM_SYSCALL(n, kevent(p->fd, NULL, 0, evs, maxevents, tsp));
+    if (n < 0) Scm_SysError("kevent failed");
+    for (int i=0; i<n; i++) {
+        u_long e = 0;
+        if (evs[i].flags & EV_ERROR) {
+            e = SCM_SYS_POLLER_READ|SCM_SYS_POLLER_WRITE;
+        } else if (evs[i].filter == EVFILT_READ) {
+            e = SCM_SYS_POLLER_READ;
+        } else if (evs[i].filter == EVFILT_WRITE) {
+            e = SCM_SYS_POLLER_WRITE;
+        }
+        if (e) SCM_APPEND1(h, t, poller_event((int)evs[i].ident, e));
+    }
+#else  /* GAUCHE_POLLER_POLL */
+    struct pollfd *pfds = (struct pollfd*)p->pfds;
+    SCM_SYSCALL(n, poll(pfds, p->npfds, poller_timeout_ms(tvp)));
+    if (n < 0) Scm_SysError("poll failed");
+    for (int i=0, k=0; i<p->npfds && k<n && k<maxevents; i++) {
+        short re = pfds[i].revents;
+        u_long e = 0;
+        if (re == 0) continue;
+        k++;
+        if (re & POLLIN)  e |= SCM_SYS_POLLER_READ;
+        if (re & POLLOUT) e |= SCM_SYS_POLLER_WRITE;
+        if (re & POLLPRI) e |= SCM_SYS_POLLER_EXCEPT;
+        if (re & (POLLERR|POLLHUP|POLLNVAL)) {
+            e |= SCM_SYS_POLLER_READ|SCM_SYS_POLLER_WRITE;
+        }
+        if (!(pfds[i].events & POLLIN))  e &= ~SCM_SYS_POLLER_READ;
+        if (!(pfds[i].events & POLLOUT)) e &= ~SCM_SYS_POLLER_WRITE;
+        if (e) SCM_APPEND1(h, t, poller_event(pfds[i].fd, e));
+    }
+#endif
+    return h;
+}
+
+void Scm_SysPollerClose(ScmSysPoller *p)
+{
+    if (p->fd < 0) return;
+#if defined(GAUCHE_POLLER_EPOLL) || defined(GAUCHE_POLLER_KQUEUE)
+    close(p->fd);
+#else
+    p->pfds = NULL;
+    p->npfds = p->pfdsSize = 0;
+    p->index = NULL;
+    p->indexSize = 0;
+#endif
+    p->fd = -1;
+}
+
+#endif /* GAUCHE_HAVE_POLLER */
+
 /*===============================================================
  * Environment
  */
@@ -3116,6 +3655,12 @@ void Scm__InitSystem(void)
     Scm_InitStaticClass(&Scm_SysPasswdClass, "<sys-passwd>", mod, pwd_slots, 0);
 #ifdef HAVE_SELECT
     Scm_InitStaticClass(&Scm_SysFdsetClass, "<sys-fdset>", mod, NULL, 0);
+#endif
+#ifdef GAUCHE_HAVE_POLLER
+    Scm_InitStaticClass(&Scm_SysPollerClass, "<sys-poller>", mod, NULL, 0);
+    sym_r = SCM_INTERN("r");
+    sym_w = SCM_INTERN("w");
+    sym_x = SCM_INTERN("x");
 #endif
     SCM_INTERNAL_MUTEX_INIT(env_mutex);
     Scm_HashCoreInitSimple(&env_strings, SCM_HASH_STRING, 0, NULL);
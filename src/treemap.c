@@ -40,11 +40,13 @@
  */
 
 /* The actual node structure.  The first two elements must match
-   ScmDictEntry. */
+   ScmDictEntry.  SIZE is the number of nodes in the subtree rooted
+   by this node, which makes rank/select queries O(log n). */
 typedef struct NodeRec {
     intptr_t     key;
     intptr_t     value;
     int          color;
+    int          size;
     struct NodeRec *parent;
     struct NodeRec *left;
     struct NodeRec *right;
@@ -66,6 +68,8 @@ enum TreeOp {
 
 #define PAINT(n, c)      (n->color = c)
 
+#define SIZE(n)          ((n)? (n)->size : 0)
+
 /* The following three macros assume N has a parent. */
 #define LEFTP(n)         (n == n->parent->left)
 #define RIGHTP(n)        (n == n->parent->right)
@@ -87,6 +91,75 @@ static Node *next_node(Node *n);
 static Node *prev_node(Node *n);
 static Node *delete_node(ScmTreeCore *tc, Node *n);
 static Node *copy_tree(Node *parent, Node *self);
+static Node *build_sorted(Node *parent, const intptr_t *keys,
+                          const intptr_t *values, int start, int end,
+                          int depth, int red_depth);
+static void split_tree(ScmTreeCore *tc, Node *n, intptr_t key,
+                       Node **lo, Node **hi);
+static Node *join_tree(Node *l, Node *k, Node *r);
+
+/* B+tree layout; see below for the details. */
+#define BT_MAX    32            /* max # of entries/children in a node;
+                                   must be at least 4 */
+#define BT_MIN    (BT_MAX/2)    /* min # of them, except the root */
+#define BT_DEPTH  16            /* max depth, enough for int entries */
+
+typedef struct BNodeRec {
+    int leafp;
+    int n;                      /* # of entries or children */
+} BNode;
+
+/* Entries of a leaf.  Must match ScmDictEntry. */
+typedef struct BEntryRec {
+    intptr_t key;
+    intptr_t value;
+} BEntry;
+
+typedef struct BLeafRec {
+    BNode hdr;
+    struct BLeafRec *prev;
+    struct BLeafRec *next;
+    BEntry entries[BT_MAX];
+} BLeaf;
+
+typedef struct BInnerRec {
+    BNode hdr;
+    intptr_t keys[BT_MAX];      /* keys[0] is unused */
+    int sizes[BT_MAX];
+    BNode *children[BT_MAX];
+} BInner;
+
+/* A position in a leaf.  LEAF is NULL if there's no such entry. */
+typedef struct BPosRec {
+    BLeaf *leaf;
+    int i;
+} BPos;
+
+#define BROOT(tc)        ((BNode*)tc->root)
+#define BPOS_ENTRY(pos) \
+    ((pos).leaf? (ScmDictEntry*)&(pos).leaf->entries[(pos).i] : NULL)
+
+#define BPLUSP(tc)       ((tc)->layout == SCM_TREE_BPLUS)
+
+static ScmDictEntry *bt_search(ScmTreeCore *tc, intptr_t key, ScmDictOp op);
+static int bt_near(ScmTreeCore *tc, intptr_t key,
+                   BPos *lo, BPos *eq, BPos *hi);
+static void bt_bound(ScmTreeCore *tc, ScmTreeCoreBoundOp op, BPos *pos);
+static ScmDictEntry *bt_pop_bound(ScmTreeCore *tc, ScmTreeCoreBoundOp op);
+static int bt_rank(ScmTreeCore *tc, intptr_t key, ScmDictEntry **e);
+static ScmDictEntry *bt_select(ScmTreeCore *tc, int index);
+static BNode *bt_copy(BNode *n, BLeaf **last);
+static BNode *bt_build(const intptr_t *keys, const intptr_t *values, int n);
+static ScmDictEntry *bt_step(BLeaf **leaf, ScmDictEntry *e, int forward);
+static void bt_check_consistency(ScmTreeCore *tc);
+static void bt_dump(BNode *n, int depth, ScmPort *out, int scmobj);
+
+/* Compares keys as core_ref does.  Negative if A < B. */
+static int key_cmp(ScmTreeCore *tc, intptr_t a, intptr_t b)
+{
+    if (tc->cmp) return tc->cmp(tc, a, b);
+    return (a < b)? -1 : (a > b)? 1 : 0;
+}
 
 /*
  * Public API
@@ -95,23 +168,36 @@ static Node *copy_tree(Node *parent, Node *self);
 void Scm_TreeCoreInit(ScmTreeCore *tc,
                       ScmTreeCoreCompareProc *cmp,
                       void *data)
+{
+    Scm_TreeCoreInitLayout(tc, cmp, SCM_TREE_RED_BLACK, data);
+}
+
+void Scm_TreeCoreInitLayout(ScmTreeCore *tc,
+                            ScmTreeCoreCompareProc *cmp,
+                            ScmTreeLayout layout,
+                            void *data)
 {
     tc->root = NULL;
     tc->cmp = cmp;
     tc->num_entries = 0;
     tc->data = data;
+    tc->layout = layout;
 }
 
 void Scm_TreeCoreCopy(ScmTreeCore *dst, const ScmTreeCore *src)
 {
-    if (ROOT(src)) {
-        SET_ROOT(dst, copy_tree(NULL, ROOT(src)));
-    } else {
+    if (src->root == NULL) {
         SET_ROOT(dst, NULL);
+    } else if (BPLUSP(src)) {
+        BLeaf *last = NULL;
+        dst->root = (ScmDictEntry*)bt_copy(BROOT(src), &last);
+    } else {
+        SET_ROOT(dst, copy_tree(NULL, ROOT(src)));
     }
     dst->cmp = src->cmp;
     dst->num_entries = src->num_entries;
     dst->data = src->data;
+    dst->layout = src->layout;
 }
 
 void Scm_TreeCoreClear(ScmTreeCore *tc)
@@ -124,6 +210,7 @@ ScmDictEntry *Scm_TreeCoreSearch(ScmTreeCore *tc,
                                  intptr_t key,
                                  ScmDictOp op)
 {
+    if (BPLUSP(tc)) return bt_search(tc, key, op);
     return (ScmDictEntry*)core_ref(tc, key, (enum TreeOp)op, NULL, NULL);
 }
 
@@ -132,6 +219,13 @@ ScmDictEntry *Scm_TreeCoreClosestEntries(ScmTreeCore *tc,
                                          ScmDictEntry **lo,
                                          ScmDictEntry **hi)
 {
+    if (BPLUSP(tc)) {
+        BPos l, e, h;
+        bt_near(tc, key, &l, &e, &h);
+        *lo = BPOS_ENTRY(l);
+        *hi = BPOS_ENTRY(h);
+        return BPOS_ENTRY(e);
+    }
     Node *l, *h;
     Node *r = core_ref(tc, key, TREE_NEAR, &l, &h);
     *lo = (ScmDictEntry*)l;
@@ -141,16 +235,16 @@ ScmDictEntry *Scm_TreeCoreClosestEntries(ScmTreeCore *tc,
 
 ScmDictEntry *Scm_TreeCoreNextEntry(ScmTreeCore *tc, intptr_t key)
 {
-    Node *l, *h;
-    core_ref(tc, key, TREE_NEAR, &l, &h);
-    return (ScmDictEntry*)h;
+    ScmDictEntry *l, *h;
+    Scm_TreeCoreClosestEntries(tc, key, &l, &h);
+    return h;
 }
 
 ScmDictEntry *Scm_TreeCorePrevEntry(ScmTreeCore *tc, intptr_t key)
 {
-    Node *l, *h;
-    core_ref(tc, key, TREE_NEAR, &l, &h);
-    return (ScmDictEntry*)l;
+    ScmDictEntry *l, *h;
+    Scm_TreeCoreClosestEntries(tc, key, &l, &h);
+    return l;
 }
 
 static Node *core_bound(ScmTreeCore *tc, ScmTreeCoreBoundOp op, int pop)
@@ -170,11 +264,17 @@ static Node *core_bound(ScmTreeCore *tc, ScmTreeCoreBoundOp op, int pop)
 
 ScmDictEntry *Scm_TreeCoreGetBound(ScmTreeCore *tc, ScmTreeCoreBoundOp op)
 {
+    if (BPLUSP(tc)) {
+        BPos pos;
+        bt_bound(tc, op, &pos);
+        return BPOS_ENTRY(pos);
+    }
     return (ScmDictEntry*)core_bound(tc, op, FALSE);
 }
 
 ScmDictEntry *Scm_TreeCorePopBound(ScmTreeCore *tc, ScmTreeCoreBoundOp op)
 {
+    if (BPLUSP(tc)) return bt_pop_bound(tc, op);
     return (ScmDictEntry*)core_bound(tc, op, TRUE);
 }
 
@@ -201,6 +301,255 @@ int Scm_TreeCoreEq(ScmTreeCore *a, ScmTreeCore *b)
     }
 }
 
+/* Replaces the content of TC with N entries in the given arrays,
+   which must be sorted. */
+static void rebuild_sorted(ScmTreeCore *tc,
+                           const intptr_t *keys,
+                           const intptr_t *values,
+                           int n)
+{
+    if (BPLUSP(tc)) {
+        tc->root = (ScmDictEntry*)bt_build(keys, values, n);
+    } else {
+        /* Splitting at the midpoint fills all levels but the deepest one.
+           If the deepest level isn't full, we paint its nodes red so that
+           every path has the same number of black nodes. */
+        int red_depth = 0;
+        while ((2L << red_depth) - 1 <= n) red_depth++;
+        SET_ROOT(tc, build_sorted(NULL, keys, values, 0, n, 0, red_depth));
+    }
+    tc->num_entries = n;
+}
+
+/* Stores the keys and the values of TC in KEYS and VALUES from the
+   index START.  Returns the index after the last one. */
+static int collect_entries(ScmTreeCore *tc, intptr_t *keys,
+                           intptr_t *values, int start)
+{
+    ScmTreeIter iter;
+    ScmDictEntry *e;
+    Scm_TreeIterInit(&iter, tc, NULL);
+    while ((e = Scm_TreeIterNext(&iter)) != NULL) {
+        keys[start] = e->key;
+        values[start] = e->value;
+        start++;
+    }
+    return start;
+}
+
+/* Replaces the content of TC with N entries given by KEYS and VALUES.
+   The keys must be in strictly increasing order; if they aren't,
+   FALSE is returned and TC is left untouched.  VALUES can be NULL,
+   in which case all values are initialized to 0.
+   This builds a balanced tree in O(n), instead of n insertions with
+   rebalancing. */
+int Scm_TreeCoreBuildSorted(ScmTreeCore *tc,
+                            const intptr_t *keys,
+                            const intptr_t *values,
+                            int n)
+{
+    for (int i=1; i<n; i++) {
+        if (key_cmp(tc, keys[i-1], keys[i]) >= 0) return FALSE;
+    }
+    rebuild_sorted(tc, keys, values, n);
+    return TRUE;
+}
+
+/*
+ * Order statistics
+ */
+
+/* Returns the number of entries whose keys are smaller than KEY.
+   If E isn't NULL, the entry with KEY is stored in it, or NULL
+   if there's no such entry. */
+int Scm_TreeCoreRank(ScmTreeCore *tc, intptr_t key, ScmDictEntry **e)
+{
+    if (BPLUSP(tc)) return bt_rank(tc, key, e);
+    Node *n = ROOT(tc);
+    int rank = 0;
+    while (n) {
+        int r = key_cmp(tc, n->key, key);
+        if (r == 0) {
+            if (e) *e = (ScmDictEntry*)n;
+            return rank + SIZE(n->left);
+        }
+        if (r < 0) {
+            rank += SIZE(n->left) + 1;
+            n = n->right;
+        } else {
+            n = n->left;
+        }
+    }
+    if (e) *e = NULL;
+    return rank;
+}
+
+/* Returns INDEX-th entry (0-based) in the key order, or NULL if INDEX
+   is out of range. */
+ScmDictEntry *Scm_TreeCoreSelect(ScmTreeCore *tc, int index)
+{
+    if (index < 0 || index >= tc->num_entries) return NULL;
+    if (BPLUSP(tc)) return bt_select(tc, index);
+    Node *n = ROOT(tc);
+    while (n) {
+        int l = SIZE(n->left);
+        if (index == l) return (ScmDictEntry*)n;
+        if (index < l) {
+            n = n->left;
+        } else {
+            index -= l + 1;
+            n = n->right;
+        }
+    }
+    return NULL;                /* dummy */
+}
+
+/*
+ * Ranges
+ */
+
+/* Returns the first node within the lower limit. */
+static Node *range_first(ScmTreeCore *tc, intptr_t key,
+                         ScmTreeCoreLimit limit)
+{
+    if (limit == SCM_TREE_CORE_NO_LIMIT) {
+        return ROOT(tc)? leftmost(ROOT(tc)) : NULL;
+    }
+    Node *lo, *hi;
+    Node *eq = core_ref(tc, key, TREE_NEAR, &lo, &hi);
+    if (eq && limit == SCM_TREE_CORE_INCLUSIVE) return eq;
+    return hi;
+}
+
+/* Returns the last node within the upper limit. */
+static Node *range_last(ScmTreeCore *tc, intptr_t key,
+                        ScmTreeCoreLimit limit)
+{
+    if (limit == SCM_TREE_CORE_NO_LIMIT) {
+        return ROOT(tc)? rightmost(ROOT(tc)) : NULL;
+    }
+    Node *lo, *hi;
+    Node *eq = core_ref(tc, key, TREE_NEAR, &lo, &hi);
+    if (eq && limit == SCM_TREE_CORE_INCLUSIVE) return eq;
+    return lo;
+}
+
+/* B+tree version of range_first and range_last. */
+static void bt_range_end(ScmTreeCore *tc, intptr_t key,
+                         ScmTreeCoreLimit limit, int upper, BPos *pos)
+{
+    if (limit == SCM_TREE_CORE_NO_LIMIT) {
+        bt_bound(tc, upper? SCM_TREE_CORE_MAX : SCM_TREE_CORE_MIN, pos);
+        return;
+    }
+    BPos lo, eq, hi;
+    bt_near(tc, key, &lo, &eq, &hi);
+    if (eq.leaf && limit == SCM_TREE_CORE_INCLUSIVE) *pos = eq;
+    else *pos = upper? lo : hi;
+}
+
+/* Returns the number of entries below the limit.  For the lower limit
+   the entry with KEY counts as below when it's excluded; for the upper
+   limit, when it's included. */
+static int range_rank(ScmTreeCore *tc, intptr_t key,
+                      ScmTreeCoreLimit limit, int upper)
+{
+    if (limit == SCM_TREE_CORE_NO_LIMIT) {
+        return upper? tc->num_entries : 0;
+    }
+    ScmDictEntry *e;
+    int rank = Scm_TreeCoreRank(tc, key, &e);
+    if (e && (limit == SCM_TREE_CORE_INCLUSIVE) == upper) rank++;
+    return rank;
+}
+
+/* Counts the entries within the range, in O(log n). */
+int Scm_TreeCoreCountRange(ScmTreeCore *tc,
+                           intptr_t lo, ScmTreeCoreLimit lo_limit,
+                           intptr_t hi, ScmTreeCoreLimit hi_limit)
+{
+    int l = range_rank(tc, lo, lo_limit, FALSE);
+    int h = range_rank(tc, hi, hi_limit, TRUE);
+    return (h > l)? h - l : 0;
+}
+
+/*
+ * Split and join
+ */
+
+/* Moves the entries whose keys are greater than or equal to KEY
+   from TC to DST.  DST's previous content is discarded, and it gets
+   the same comparison and layout as TC.  Takes O(log^2 n) and allocates
+   nothing; the nodes are moved as they are.  Iterators on TC are
+   invalidated.  With the B+tree layout, both trees are rebuilt in O(n). */
+void Scm_TreeCoreSplit(ScmTreeCore *tc, intptr_t key, ScmTreeCore *dst)
+{
+    if (BPLUSP(tc)) {
+        int n = tc->num_entries;
+        int k = Scm_TreeCoreRank(tc, key, NULL);
+        intptr_t *keys = SCM_NEW_ARRAY(intptr_t, n);
+        intptr_t *vals = SCM_NEW_ARRAY(intptr_t, n);
+        collect_entries(tc, keys, vals, 0);
+        Scm_TreeCoreInitLayout(dst, tc->cmp, tc->layout, tc->data);
+        rebuild_sorted(tc, keys, vals, k);
+        rebuild_sorted(dst, keys+k, vals+k, n-k);
+        return;
+    }
+
+    /* The comparison procedure may raise an error.  Splitting compares
+       KEY with the same nodes as searching does, so we search first
+       not to leave the tree half-split. */
+    (void)Scm_TreeCoreRank(tc, key, NULL);
+
+    Node *lo, *hi;
+    split_tree(tc, ROOT(tc), key, &lo, &hi);
+    SET_ROOT(tc, lo);
+    tc->num_entries = SIZE(lo);
+    SET_ROOT(dst, hi);
+    dst->cmp = tc->cmp;
+    dst->num_entries = SIZE(hi);
+    dst->data = tc->data;
+    dst->layout = tc->layout;
+}
+
+/* Moves all the entries of SRC to TC, leaving SRC empty.  All keys in
+   SRC must be greater than the keys in TC; otherwise an error is
+   signaled and both trees are left untouched.  Takes O(log n) if both
+   are red-black trees; otherwise TC is rebuilt in O(n). */
+void Scm_TreeCoreJoin(ScmTreeCore *tc, ScmTreeCore *src)
+{
+    if (src->root == NULL) return;
+    if (BPLUSP(tc) || BPLUSP(src)) {
+        ScmDictEntry *lmax = Scm_TreeCoreGetBound(tc, SCM_TREE_CORE_MAX);
+        ScmDictEntry *rmin = Scm_TreeCoreGetBound(src, SCM_TREE_CORE_MIN);
+        if (lmax && key_cmp(tc, lmax->key, rmin->key) >= 0) {
+            Scm_Error("Scm_TreeCoreJoin: the key ranges of the trees overlap");
+        }
+        int n = tc->num_entries + src->num_entries;
+        intptr_t *keys = SCM_NEW_ARRAY(intptr_t, n);
+        intptr_t *vals = SCM_NEW_ARRAY(intptr_t, n);
+        collect_entries(src, keys, vals,
+                        collect_entries(tc, keys, vals, 0));
+        rebuild_sorted(tc, keys, vals, n);
+        Scm_TreeCoreClear(src);
+        return;
+    }
+    if (ROOT(tc)) {
+        Node *lmax = rightmost(ROOT(tc));
+        Node *rmin = leftmost(ROOT(src));
+        if (key_cmp(tc, lmax->key, rmin->key) >= 0) {
+            Scm_Error("Scm_TreeCoreJoin: the key ranges of the trees overlap");
+        }
+        Node *k = delete_node(src, rmin);
+        SET_ROOT(tc, join_tree(ROOT(tc), k, ROOT(src)));
+    } else {
+        SET_ROOT(tc, ROOT(src));
+    }
+    tc->num_entries = SIZE(ROOT(tc));
+    SET_ROOT(src, NULL);
+    src->num_entries = 0;
+}
+
 /* START can be NULL; in which case, if next call is TreeIterNext,
    it iterates from the minimum node; if next call is TreeIterPrev,
    it iterates from the maximum node. */
@@ -208,21 +557,101 @@ void Scm_TreeIterInit(ScmTreeIter *iter,
                       ScmTreeCore *tc,
                       ScmDictEntry *start)
 {
-    if (start && Scm_TreeCoreSearch(tc, start->key, SCM_DICT_GET) != start) {
-        Scm_Error("Scm_TreeIterInit: iteration start point is not a part of the tree.");
+    iter->leaf = NULL;
+    if (start) {
+        ScmDictEntry *e;
+        if (BPLUSP(tc)) {
+            BPos lo, eq, hi;
+            bt_near(tc, start->key, &lo, &eq, &hi);
+            e = BPOS_ENTRY(eq);
+            iter->leaf = eq.leaf;
+        } else {
+            e = Scm_TreeCoreSearch(tc, start->key, SCM_DICT_GET);
+        }
+        if (e != start) {
+            Scm_Error("Scm_TreeIterInit: iteration start point is not a part of the tree.");
+        }
     }
     iter->t = tc;
     iter->e = start;
     iter->at_end = FALSE;
+    iter->first = iter->last = NULL;
+    iter->first_leaf = iter->last_leaf = NULL;
+}
+
+/* Initializes ITER to iterate over the entries between LO and HI.
+   If the next call is TreeIterNext, it iterates from the lower end;
+   if it is TreeIterPrev, from the upper end.  The iteration stops
+   at the other end. */
+void Scm_TreeIterInitRange(ScmTreeIter *iter,
+                           ScmTreeCore *tc,
+                           intptr_t lo, ScmTreeCoreLimit lo_limit,
+                           intptr_t hi, ScmTreeCoreLimit hi_limit)
+{
+    ScmDictEntry *first, *last;
+    BPos bfirst = {NULL, 0}, blast = {NULL, 0};
+
+    if (BPLUSP(tc)) {
+        bt_range_end(tc, lo, lo_limit, FALSE, &bfirst);
+        bt_range_end(tc, hi, hi_limit, TRUE, &blast);
+        first = BPOS_ENTRY(bfirst);
+        last = BPOS_ENTRY(blast);
+    } else {
+        first = (ScmDictEntry*)range_first(tc, lo, lo_limit);
+        last = (ScmDictEntry*)range_last(tc, hi, hi_limit);
+    }
+
+    iter->t = tc;
+    iter->e = NULL;
+    iter->leaf = NULL;
+    if (first == NULL || last == NULL
+        || key_cmp(tc, first->key, last->key) > 0) {
+        iter->at_end = TRUE;
+        iter->first = iter->last = NULL;
+        iter->first_leaf = iter->last_leaf = NULL;
+    } else {
+        iter->at_end = FALSE;
+        iter->first = first;
+        iter->last = last;
+        iter->first_leaf = bfirst.leaf;
+        iter->last_leaf = blast.leaf;
+    }
+}
+
+/* Moves ITER to the bound of the tree. */
+static void iter_bound(ScmTreeIter *iter, ScmTreeCoreBoundOp op)
+{
+    if (BPLUSP(iter->t)) {
+        BPos pos;
+        bt_bound(iter->t, op, &pos);
+        iter->e = BPOS_ENTRY(pos);
+        iter->leaf = pos.leaf;
+    } else {
+        iter->e = Scm_TreeCoreGetBound(iter->t, op);
+    }
+}
+
+/* Returns the entry next to (or previous to) the current one. */
+static ScmDictEntry *iter_step(ScmTreeIter *iter, int forward)
+{
+    if (BPLUSP(iter->t)) {
+        return bt_step((BLeaf**)&iter->leaf, iter->e, forward);
+    }
+    Node *n = (Node*)iter->e;
+    return (ScmDictEntry*)(forward? next_node(n) : prev_node(n));
 }
 
 ScmDictEntry *Scm_TreeIterNext(ScmTreeIter *iter)
 {
     if (iter->at_end) return NULL;
     if (iter->e) {
-        iter->e = (ScmDictEntry*)next_node((Node*)iter->e);
+        if (iter->e == iter->last) iter->e = NULL;
+        else iter->e = iter_step(iter, TRUE);
+    } else if (iter->first) {
+        iter->e = iter->first;
+        iter->leaf = iter->first_leaf;
     } else {
-        iter->e = Scm_TreeCoreGetBound(iter->t, SCM_TREE_CORE_MIN);
+        iter_bound(iter, SCM_TREE_CORE_MIN);
     }
     if (iter->e == NULL) iter->at_end = TRUE;
     return iter->e;
@@ -232,9 +661,13 @@ ScmDictEntry *Scm_TreeIterPrev(ScmTreeIter *iter)
 {
     if (iter->at_end) return NULL;
     if (iter->e) {
-        iter->e = (ScmDictEntry*)prev_node((Node*)iter->e);
+        if (iter->e == iter->first) iter->e = NULL;
+        else iter->e = iter_step(iter, FALSE);
+    } else if (iter->last) {
+        iter->e = iter->last;
+        iter->leaf = iter->last_leaf;
     } else {
-        iter->e = Scm_TreeCoreGetBound(iter->t, SCM_TREE_CORE_MAX);
+        iter_bound(iter, SCM_TREE_CORE_MAX);
     }
     if (iter->e == NULL) iter->at_end = TRUE;
     return iter->e;
@@ -280,11 +713,19 @@ static int check_traverse(Node *node, int depth, int *count)
     if (ld != rd) {
         Scm_Error("[internal] tree map has different black-node depth (L:%d vs R:%d)", ld, rd);
     }
+    if (node->size != SIZE(node->left) + SIZE(node->right) + 1) {
+        Scm_Error("[internal] tree map has wrong subtree size: %d (expected %d)",
+                  node->size, SIZE(node->left) + SIZE(node->right) + 1);
+    }
     return ld;
 }
 
 void Scm_TreeCoreCheckConsistency(ScmTreeCore *tc)
 {
+    if (BPLUSP(tc)) {
+        bt_check_consistency(tc);
+        return;
+    }
     Node *r = ROOT(tc);
     int cnt = 0;
 
@@ -314,11 +755,18 @@ SCM_DEFINE_BUILTIN_CLASS(Scm_TreeMapClass, treemap_print, NULL, NULL, NULL,
  */
 
 ScmObj Scm_MakeTreeMap(ScmTreeCoreCompareProc *cmp, void *data)
+{
+    return Scm_MakeTreeMapLayout(cmp, SCM_TREE_RED_BLACK, data);
+}
+
+ScmObj Scm_MakeTreeMapLayout(ScmTreeCoreCompareProc *cmp,
+                             ScmTreeLayout layout,
+                             void *data)
 {
     ScmTreeMap *tm = SCM_NEW(ScmTreeMap);
     SCM_SET_CLASS(tm, SCM_CLASS_TREE_MAP);
     /* TODO: default cmp should be different from TreeCore */
-    Scm_TreeCoreInit(SCM_TREE_MAP_CORE(tm), cmp, data);
+    Scm_TreeCoreInitLayout(SCM_TREE_MAP_CORE(tm), cmp, layout, data);
     return SCM_OBJ(tm);
 }
 
@@ -381,23 +829,22 @@ static void dump_traverse(Node *node, int depth, ScmPort *out, int scmobj)
     if (node->right) dump_traverse(node->right, depth+1, out, scmobj);
 }
 
-void Scm_TreeMapDump(ScmTreeMap *tm, ScmPort *out)
+static void core_dump(ScmTreeCore *tc, ScmPort *out, int scmobj)
 {
-    ScmTreeCore *tc = SCM_TREE_MAP_CORE(tm);
-    Node *r = ROOT(tc);
     Scm_Printf(out, "Entries=%d\n", tc->num_entries);
-    if (r) {
-        dump_traverse(r, 0, out, TRUE);
-    }
+    if (tc->root == NULL) return;
+    if (BPLUSP(tc)) bt_dump(BROOT(tc), 0, out, scmobj);
+    else            dump_traverse(ROOT(tc), 0, out, scmobj);
+}
+
+void Scm_TreeMapDump(ScmTreeMap *tm, ScmPort *out)
+{
+    core_dump(SCM_TREE_MAP_CORE(tm), out, TRUE);
 }
 
 void Scm_TreeCoreDump(ScmTreeCore *tc, ScmPort *out)
 {
-    Node *r = ROOT(tc);
-    Scm_Printf(out, "Entries=%d\n", tc->num_entries);
-    if (r) {
-        dump_traverse(r, 0, out, FALSE);
-    }
+    core_dump(tc, out, FALSE);
 }
 
 /*=============================================================
@@ -446,11 +893,18 @@ static Node *new_node(Node *parent, intptr_t key)
     n->key = key;
     n->value = 0;
     n->color = RED;             /* default is red */
+    n->size = 1;
     n->parent = parent;
     n->left = n->right = NULL;
     return n;
 }
 
+/* add DELTA to the size of N and all its ancestors */
+static void adjust_size(Node *n, int delta)
+{
+    for (; n; n = n->parent) n->size += delta;
+}
+
 /* clear node (for Weak-GC safeness) */
 static void clear_node(Node *node)
 {
@@ -487,6 +941,8 @@ static void rotate_right(ScmTreeCore *tc, Node *n)
     replace_node(tc, n, l);
     l->right = n;  n->parent = l;
     n->left = gr;  if (gr) gr->parent = n;
+    l->size = n->size;
+    n->size = SIZE(gr) + SIZE(n->right) + 1;
 }
 
 /* rotate_left:
@@ -506,6 +962,8 @@ static void rotate_left(ScmTreeCore *tc, Node *n)
     replace_node(tc, n, r);
     r->left = n;   n->parent = r;
     n->right = gl; if (gl) gl->parent = n;
+    r->size = n->size;
+    n->size = SIZE(n->left) + SIZE(gl) + 1;
 }
 
 #if 0 /* for debug */
@@ -663,6 +1121,7 @@ static void swap_node(ScmTreeCore *tc, Node *x, Node *y)
 
     int c;
     SWAP(x->color, y->color, c);
+    SWAP(x->size, y->size, c);
     if (x == ROOT(tc)) SET_ROOT(tc, y);
     else if (y == ROOT(tc)) SET_ROOT(tc, x);
 #undef SWAP
@@ -679,6 +1138,7 @@ static Node *delete_node(ScmTreeCore *tc, Node *n)
     }
 
     /* we have at most one child */
+    adjust_size(n->parent, -1);
     if (n->left) {
         delete_node1(tc, n, n->left);
     } else {
@@ -734,6 +1194,7 @@ Node *core_ref(ScmTreeCore *tc, intptr_t key, enum TreeOp op,
                 if (op == TREE_CREATE) {
                     n = new_node(e, key);
                     e->right = n;
+                    adjust_size(e, 1);
                     balance_tree(tc, n);
                     tc->num_entries++;
                     return n;
@@ -752,6 +1213,7 @@ Node *core_ref(ScmTreeCore *tc, intptr_t key, enum TreeOp op,
                 if (op == TREE_CREATE) {
                     n = new_node(e, key);
                     e->left = n;
+                    adjust_size(e, 1);
                     balance_tree(tc, n);
                     tc->num_entries++;
                     return n;
@@ -772,7 +1234,786 @@ static Node *copy_tree(Node *parent, Node *self)
     Node *n = new_node(parent, self->key);
     n->value = self->value;
     n->color = self->color;
+    n->size = self->size;
     if (self->left)  n->left = copy_tree(n, self->left);
     if (self->right) n->right = copy_tree(n, self->right);
     return n;
 }
+
+/* bulk construction from sorted arrays; see Scm_TreeCoreBuildSorted */
+static Node *build_sorted(Node *parent, const intptr_t *keys,
+                          const intptr_t *values, int start, int end,
+                          int depth, int red_depth)
+{
+    if (start >= end) return NULL;
+    int mid = start + (end - start)/2;
+    Node *n = new_node(parent, keys[mid]);
+    n->value = values? values[mid] : 0;
+    n->color = (depth == red_depth)? RED : BLACK;
+    n->size = end - start;
+    n->left = build_sorted(n, keys, values, start, mid, depth+1, red_depth);
+    n->right = build_sorted(n, keys, values, mid+1, end, depth+1, red_depth);
+    return n;
+}
+
+/* # of black nodes from N to a leaf */
+static int black_height(Node *n)
+{
+    int h = 0;
+    for (; n; n = n->left) {
+        if (BLACKP(n)) h++;
+    }
+    return h;
+}
+
+/* Joins two trees L and R with a node K, where all keys in L are
+   smaller than K and all keys in R are greater than K.  Returns the
+   root of the joined tree.  Both L and R must have black roots.
+
+   If the black heights differ, we walk down the spine of the taller
+   tree until we find a black node C whose black height equals the
+   other's, then replace C with a red K having C and the shorter tree
+   as its children.  It may leave adjacent red nodes, which is fixed
+   up just like an insertion.
+*/
+static Node *join_tree(Node *l, Node *k, Node *r)
+{
+    int lh = black_height(l), rh = black_height(r);
+    ScmTreeCore tmp;            /* to receive the root while rebalancing */
+
+    k->parent = NULL;
+    if (lh == rh) {
+        k->left = l;  if (l) l->parent = k;
+        k->right = r; if (r) r->parent = k;
+        k->color = BLACK;
+        k->size = SIZE(l) + SIZE(r) + 1;
+        return k;
+    }
+
+    Node *c, *p = NULL;
+    if (lh > rh) {
+        int h = lh;
+        for (c = l; c && !(BLACKP(c) && h == rh); c = c->right) {
+            if (BLACKP(c)) h--;
+            p = c;
+        }
+        SCM_ASSERT(p != NULL);
+        k->left = c;  if (c) c->parent = k;
+        k->right = r; if (r) r->parent = k;
+        p->right = k;
+        SET_ROOT((&tmp), l);
+    } else {
+        int h = rh;
+        for (c = r; c && !(BLACKP(c) && h == lh); c = c->left) {
+            if (BLACKP(c)) h--;
+            p = c;
+        }
+        SCM_ASSERT(p != NULL);
+        k->left = l;  if (l) l->parent = k;
+        k->right = c; if (c) c->parent = k;
+        p->left = k;
+        SET_ROOT((&tmp), r);
+    }
+    k->parent = p;
+    k->color = RED;
+    k->size = SIZE(k->left) + SIZE(k->right) + 1;
+    adjust_size(p, SIZE(k) - SIZE(c));
+    balance_tree(&tmp, k);
+    return ROOT((&tmp));
+}
+
+/* Detaches N from its parent to make it a root of a valid tree. */
+static Node *detach_subtree(Node *n)
+{
+    if (n) {
+        n->parent = NULL;
+        PAINT(n, BLACK);
+    }
+    return n;
+}
+
+/* Splits the subtree N into the nodes with keys smaller than KEY (LO)
+   and the rest (HI).  Each node on the search path is put back by
+   join_tree with the pieces on its side, so the work is bounded by
+   the sum of the black height differences. */
+static void split_tree(ScmTreeCore *tc, Node *n, intptr_t key,
+                       Node **lo, Node **hi)
+{
+    if (n == NULL) { *lo = *hi = NULL; return; }
+    Node *l = detach_subtree(n->left);
+    Node *r = detach_subtree(n->right);
+    Node *a, *b;
+    if (key_cmp(tc, n->key, key) < 0) {
+        split_tree(tc, r, key, &a, &b);
+        *lo = detach_subtree(join_tree(l, n, a));
+        *hi = b;
+    } else {
+        split_tree(tc, l, key, &a, &b);
+        *lo = a;
+        *hi = detach_subtree(join_tree(b, n, r));
+    }
+}
+
+/*=============================================================
+ * Internal stuff (B+tree implementation)
+ */
+
+/* Entries are kept in the leaves in the key order, and the leaves are
+   doubly linked for scanning.  An inner node has N children, and
+   KEYS[i] (0 < i < N) separates CHILDREN[i-1] and CHILDREN[i]: the keys
+   under the former are smaller than it, and the ones under the latter
+   are greater than or equal to it.  SIZES[i] is the number of entries
+   under CHILDREN[i], for rank/select queries.  All leaves are at the
+   same depth, and every node but the root has at least BT_MIN entries
+   or children.
+
+   The comparison procedure may raise an error.  So each update first
+   finds the path from the root down to the position, comparing keys,
+   and then modifies the nodes on the path without comparing keys.  */
+
+/* The path from the root to a position in a leaf.  NODES[d] is the node
+   at depth d, and IDX[d] is the index of the child we took in it, or
+   the index of the entry in the leaf. */
+typedef struct BPathRec {
+    int depth;                  /* depth of the leaf */
+    BNode *nodes[BT_DEPTH];
+    int idx[BT_DEPTH];
+} BPath;
+
+#define BLEAF(n)         ((BLeaf*)(n))
+#define BINNER(n)        ((BInner*)(n))
+#define BENTRY(l, i)     ((ScmDictEntry*)&(l)->entries[i])
+
+static BLeaf *bt_new_leaf(void)
+{
+    BLeaf *l = SCM_NEW(BLeaf);
+    l->hdr.leafp = TRUE;
+    l->hdr.n = 0;
+    l->prev = l->next = NULL;
+    return l;
+}
+
+static BInner *bt_new_inner(void)
+{
+    BInner *in = SCM_NEW(BInner);
+    in->hdr.leafp = FALSE;
+    in->hdr.n = 0;
+    return in;
+}
+
+/* # of entries under N */
+static int bt_count(BNode *n)
+{
+    if (n->leafp) return n->n;
+    int c = 0;
+    for (int i=0; i<n->n; i++) c += BINNER(n)->sizes[i];
+    return c;
+}
+
+/* Returns the index of the child of IN that can contain KEY. */
+static int bt_child_index(ScmTreeCore *tc, BInner *in, intptr_t key)
+{
+    int lo = 1, hi = in->hdr.n;
+    while (lo < hi) {
+        int mid = (lo + hi)/2;
+        if (key_cmp(tc, in->keys[mid], key) <= 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo - 1;
+}
+
+/* Returns the index of the first entry in L whose key isn't smaller
+   than KEY.  *FOUND is set to TRUE iff it's KEY. */
+static int bt_leaf_index(ScmTreeCore *tc, BLeaf *l, intptr_t key, int *found)
+{
+    int lo = 0, hi = l->hdr.n;
+    *found = FALSE;
+    while (lo < hi) {
+        int mid = (lo + hi)/2;
+        int r = key_cmp(tc, l->entries[mid].key, key);
+        if (r < 0) {
+            lo = mid + 1;
+        } else {
+            if (r == 0) *found = TRUE;
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/* Fills P with the path to the position of KEY.  The tree must not be
+   empty.  Returns TRUE iff KEY is found. */
+static int bt_locate(ScmTreeCore *tc, intptr_t key, BPath *p)
+{
+    BNode *n = BROOT(tc);
+    int d = 0, found;
+    while (!n->leafp) {
+        int i = bt_child_index(tc, BINNER(n), key);
+        p->nodes[d] = n;
+        p->idx[d] = i;
+        d++;
+        n = BINNER(n)->children[i];
+    }
+    p->nodes[d] = n;
+    p->idx[d] = bt_leaf_index(tc, BLEAF(n), key, &found);
+    p->depth = d;
+    return found;
+}
+
+/* Fills P with the path to the minimum or maximum entry.  The tree
+   must not be empty. */
+static void bt_locate_bound(ScmTreeCore *tc, ScmTreeCoreBoundOp op, BPath *p)
+{
+    BNode *n = BROOT(tc);
+    int d = 0;
+    while (!n->leafp) {
+        int i = (op == SCM_TREE_CORE_MIN)? 0 : n->n - 1;
+        p->nodes[d] = n;
+        p->idx[d] = i;
+        d++;
+        n = BINNER(n)->children[i];
+    }
+    p->nodes[d] = n;
+    p->idx[d] = (op == SCM_TREE_CORE_MIN)? 0 : n->n - 1;
+    p->depth = d;
+}
+
+/* Inserts CHILD with separator SEP at index I of IN, which has a room. */
+static void bt_inner_insert(BInner *in, int i, intptr_t sep, BNode *child)
+{
+    int n = in->hdr.n;
+    memmove(in->keys+i+1, in->keys+i, (n-i)*sizeof(intptr_t));
+    memmove(in->sizes+i+1, in->sizes+i, (n-i)*sizeof(int));
+    memmove(in->children+i+1, in->children+i, (n-i)*sizeof(BNode*));
+    in->keys[i] = sep;
+    in->sizes[i] = bt_count(child);
+    in->children[i] = child;
+    in->hdr.n++;
+}
+
+/* Removes the child at index I of IN. */
+static void bt_inner_remove(BInner *in, int i)
+{
+    int n = --in->hdr.n;
+    memmove(in->keys+i, in->keys+i+1, (n-i)*sizeof(intptr_t));
+    memmove(in->sizes+i, in->sizes+i+1, (n-i)*sizeof(int));
+    memmove(in->children+i, in->children+i+1, (n-i)*sizeof(BNode*));
+    in->keys[n] = 0;            /* for GC */
+    in->children[n] = NULL;
+}
+
+/* Inserts an entry with KEY at the position P, which bt_locate has
+   found.  Full nodes on the path are split. */
+static ScmDictEntry *bt_insert(ScmTreeCore *tc, BPath *p, intptr_t key)
+{
+    BLeaf *leaf = BLEAF(p->nodes[p->depth]);
+    int pos = p->idx[p->depth];
+    BNode *right = NULL;        /* new right sibling of the node below */
+    intptr_t sep = 0;           /* and its separator */
+
+    if (leaf->hdr.n == BT_MAX) {
+        BLeaf *r = bt_new_leaf();
+        int k = BT_MAX/2;
+        memcpy(r->entries, leaf->entries+k, (BT_MAX-k)*sizeof(BEntry));
+        memset(leaf->entries+k, 0, (BT_MAX-k)*sizeof(BEntry));
+        r->hdr.n = BT_MAX-k;
+        leaf->hdr.n = k;
+        r->next = leaf->next;
+        if (r->next) r->next->prev = r;
+        r->prev = leaf;
+        leaf->next = r;
+        right = (BNode*)r;
+        sep = r->entries[0].key;
+        if (pos > k) {
+            leaf = r;
+            pos -= k;
+        }
+    }
+    int n = leaf->hdr.n;
+    memmove(leaf->entries+pos+1, leaf->entries+pos, (n-pos)*sizeof(BEntry));
+    leaf->entries[pos].key = key;
+    leaf->entries[pos].value = 0;
+    leaf->hdr.n++;
+
+    for (int d = p->depth-1; d >= 0; d--) {
+        BInner *in = BINNER(p->nodes[d]);
+        int i = p->idx[d];
+        if (right == NULL) {
+            in->sizes[i]++;
+            continue;
+        }
+        in->sizes[i] = bt_count(in->children[i]);
+        if (in->hdr.n < BT_MAX) {
+            bt_inner_insert(in, i+1, sep, right);
+            right = NULL;
+            continue;
+        }
+        /* Split IN.  The left half stays in IN. */
+        BInner *r = bt_new_inner();
+        int k = (BT_MAX+1)/2;
+        if (i+1 < k) {
+            /* RIGHT goes to the left half */
+            int m = BT_MAX - (k-1);
+            memcpy(r->keys, in->keys+k-1, m*sizeof(intptr_t));
+            memcpy(r->sizes, in->sizes+k-1, m*sizeof(int));
+            memcpy(r->children, in->children+k-1, m*sizeof(BNode*));
+            r->hdr.n = m;
+            in->hdr.n = k-1;
+            bt_inner_insert(in, i+1, sep, right);
+        } else {
+            int m = BT_MAX - k;
+            memcpy(r->keys, in->keys+k, m*sizeof(intptr_t));
+            memcpy(r->sizes, in->sizes+k, m*sizeof(int));
+            memcpy(r->children, in->children+k, m*sizeof(BNode*));
+            r->hdr.n = m;
+            in->hdr.n = k;
+            bt_inner_insert(r, i+1-k, sep, right);
+        }
+        memset(in->keys+in->hdr.n, 0, (BT_MAX-in->hdr.n)*sizeof(intptr_t));
+        memset(in->children+in->hdr.n, 0, (BT_MAX-in->hdr.n)*sizeof(BNode*));
+        sep = r->keys[0];
+        r->keys[0] = 0;
+        right = (BNode*)r;
+    }
+    if (right) {
+        /* The root is split */
+        BInner *root = bt_new_inner();
+        SCM_ASSERT(p->depth+1 < BT_DEPTH);
+        root->children[0] = BROOT(tc);
+        root->sizes[0] = bt_count(BROOT(tc));
+        root->hdr.n = 1;
+        bt_inner_insert(root, 1, sep, right);
+        tc->root = (ScmDictEntry*)root;
+    }
+    return BENTRY(leaf, pos);
+}
+
+/* Moves the last element of the I-1th child of IN to the front of
+   the Ith child. */
+static void bt_borrow_left(BInner *in, int i)
+{
+    BNode *l = in->children[i-1], *c = in->children[i];
+    int m;
+    if (c->leafp) {
+        BLeaf *ll = BLEAF(l), *cl = BLEAF(c);
+        memmove(cl->entries+1, cl->entries, c->n*sizeof(BEntry));
+        cl->entries[0] = ll->entries[l->n-1];
+        memset(&ll->entries[l->n-1], 0, sizeof(BEntry));
+        in->keys[i] = cl->entries[0].key;
+        m = 1;
+    } else {
+        BInner *li = BINNER(l), *ci = BINNER(c);
+        int j = l->n-1;
+        memmove(ci->keys+1, ci->keys, c->n*sizeof(intptr_t));
+        memmove(ci->sizes+1, ci->sizes, c->n*sizeof(int));
+        memmove(ci->children+1, ci->children, c->n*sizeof(BNode*));
+        ci->keys[1] = in->keys[i];
+        ci->keys[0] = 0;
+        ci->sizes[0] = li->sizes[j];
+        ci->children[0] = li->children[j];
+        in->keys[i] = li->keys[j];
+        li->keys[j] = 0;
+        li->children[j] = NULL;
+        m = li->sizes[j];
+    }
+    l->n--;
+    c->n++;
+    in->sizes[i-1] -= m;
+    in->sizes[i] += m;
+}
+
+/* Moves the first element of the I+1th child of IN to the end of
+   the Ith child. */
+static void bt_borrow_right(BInner *in, int i)
+{
+    BNode *c = in->children[i], *r = in->children[i+1];
+    int m;
+    if (c->leafp) {
+        BLeaf *cl = BLEAF(c), *rl = BLEAF(r);
+        cl->entries[c->n] = rl->entries[0];
+        memmove(rl->entries, rl->entries+1, (r->n-1)*sizeof(BEntry));
+        memset(&rl->entries[r->n-1], 0, sizeof(BEntry));
+        in->keys[i+1] = rl->entries[0].key;
+        m = 1;
+    } else {
+        BInner *ci = BINNER(c), *ri = BINNER(r);
+        ci->keys[c->n] = in->keys[i+1];
+        ci->sizes[c->n] = ri->sizes[0];
+        ci->children[c->n] = ri->children[0];
+        in->keys[i+1] = ri->keys[1];
+        m = ri->sizes[0];
+        int n = r->n-1;
+        memmove(ri->keys, ri->keys+1, n*sizeof(intptr_t));
+        memmove(ri->sizes, ri->sizes+1, n*sizeof(int));
+        memmove(ri->children, ri->children+1, n*sizeof(BNode*));
+        ri->keys[0] = 0;
+        ri->keys[n] = 0;
+        ri->children[n] = NULL;
+    }
+    r->n--;
+    c->n++;
+    in->sizes[i+1] -= m;
+    in->sizes[i] += m;
+}
+
+/* Merges the I+1th child of IN into the Ith child. */
+static void bt_merge(BInner *in, int i)
+{
+    BNode *l = in->children[i], *r = in->children[i+1];
+    if (l->leafp) {
+        BLeaf *ll = BLEAF(l), *rl = BLEAF(r);
+        memcpy(ll->entries+l->n, rl->entries, r->n*sizeof(BEntry));
+        ll->next = rl->next;
+        if (ll->next) ll->next->prev = ll;
+    } else {
+        BInner *li = BINNER(l), *ri = BINNER(r);
+        memcpy(li->keys+l->n, ri->keys, r->n*sizeof(intptr_t));
+        memcpy(li->sizes+l->n, ri->sizes, r->n*sizeof(int));
+        memcpy(li->children+l->n, ri->children, r->n*sizeof(BNode*));
+        li->keys[l->n] = in->keys[i+1];
+    }
+    l->n += r->n;
+    in->sizes[i] += in->sizes[i+1];
+    bt_inner_remove(in, i+1);
+}
+
+/* Deletes the entry at the position P.  Nodes on the path that get
+   less than BT_MIN elements borrow from or are merged with a sibling. */
+static void bt_delete(ScmTreeCore *tc, BPath *p)
+{
+    BLeaf *leaf = BLEAF(p->nodes[p->depth]);
+    int pos = p->idx[p->depth];
+    int n = --leaf->hdr.n;
+    memmove(leaf->entries+pos, leaf->entries+pos+1, (n-pos)*sizeof(BEntry));
+    memset(&leaf->entries[n], 0, sizeof(BEntry));
+
+    for (int d = p->depth-1; d >= 0; d--) {
+        BInner *in = BINNER(p->nodes[d]);
+        int i = p->idx[d];
+        in->sizes[i]--;
+        if (in->children[i]->n >= BT_MIN) continue;
+        if (i > 0 && in->children[i-1]->n > BT_MIN) {
+            bt_borrow_left(in, i);
+        } else if (i < in->hdr.n-1 && in->children[i+1]->n > BT_MIN) {
+            bt_borrow_right(in, i);
+        } else if (i > 0) {
+            bt_merge(in, i-1);
+        } else {
+            bt_merge(in, i);
+        }
+    }
+
+    BNode *root = BROOT(tc);
+    if (root->leafp) {
+        if (root->n == 0) tc->root = NULL;
+    } else if (root->n == 1) {
+        tc->root = (ScmDictEntry*)BINNER(root)->children[0];
+    }
+}
+
+/* Removes the entry at P and returns a copy of it. */
+static ScmDictEntry *bt_remove(ScmTreeCore *tc, BPath *p)
+{
+    BEntry *e = SCM_NEW(BEntry);
+    *e = BLEAF(p->nodes[p->depth])->entries[p->idx[p->depth]];
+    bt_delete(tc, p);
+    tc->num_entries--;
+    return (ScmDictEntry*)e;
+}
+
+static ScmDictEntry *bt_search(ScmTreeCore *tc, intptr_t key, ScmDictOp op)
+{
+    if (tc->root == NULL) {
+        if (op != SCM_DICT_CREATE) return NULL;
+        tc->root = (ScmDictEntry*)bt_new_leaf();
+    }
+    BPath p;
+    int found = bt_locate(tc, key, &p);
+    BLeaf *leaf = BLEAF(p.nodes[p.depth]);
+    int pos = p.idx[p.depth];
+    switch (op) {
+    case SCM_DICT_GET:
+        return found? BENTRY(leaf, pos) : NULL;
+    case SCM_DICT_CREATE:
+        if (found) return BENTRY(leaf, pos);
+        tc->num_entries++;
+        return bt_insert(tc, &p, key);
+    case SCM_DICT_DELETE:
+        return found? bt_remove(tc, &p) : NULL;
+    }
+    return NULL;                /* dummy */
+}
+
+/* Finds the entries closest to KEY.  EQ gets the one with KEY, and
+   LO and HI get the ones right before and after KEY.  Returns TRUE
+   iff KEY is found. */
+static int bt_near(ScmTreeCore *tc, intptr_t key,
+                   BPos *lo, BPos *eq, BPos *hi)
+{
+    lo->leaf = eq->leaf = hi->leaf = NULL;
+    if (tc->root == NULL) return FALSE;
+    BPath p;
+    int found = bt_locate(tc, key, &p);
+    BLeaf *leaf = BLEAF(p.nodes[p.depth]);
+    int pos = p.idx[p.depth];
+
+    if (pos > 0) {
+        lo->leaf = leaf; lo->i = pos-1;
+    } else if (leaf->prev) {
+        lo->leaf = leaf->prev; lo->i = leaf->prev->hdr.n-1;
+    }
+    if (found) {
+        eq->leaf = leaf; eq->i = pos;
+        pos++;
+    }
+    if (pos < leaf->hdr.n) {
+        hi->leaf = leaf; hi->i = pos;
+    } else if (leaf->next) {
+        hi->leaf = leaf->next; hi->i = 0;
+    }
+    return found;
+}
+
+static void bt_bound(ScmTreeCore *tc, ScmTreeCoreBoundOp op, BPos *pos)
+{
+    if (tc->root == NULL) {
+        pos->leaf = NULL;
+        return;
+    }
+    BPath p;
+    bt_locate_bound(tc, op, &p);
+    pos->leaf = BLEAF(p.nodes[p.depth]);
+    pos->i = p.idx[p.depth];
+}
+
+static ScmDictEntry *bt_pop_bound(ScmTreeCore *tc, ScmTreeCoreBoundOp op)
+{
+    if (tc->root == NULL) return NULL;
+    BPath p;
+    bt_locate_bound(tc, op, &p);
+    return bt_remove(tc, &p);
+}
+
+static int bt_rank(ScmTreeCore *tc, intptr_t key, ScmDictEntry **e)
+{
+    if (e) *e = NULL;
+    if (tc->root == NULL) return 0;
+    BPath p;
+    int found = bt_locate(tc, key, &p);
+    int rank = 0;
+    for (int d = 0; d < p.depth; d++) {
+        BInner *in = BINNER(p.nodes[d]);
+        for (int i = 0; i < p.idx[d]; i++) rank += in->sizes[i];
+    }
+    rank += p.idx[p.depth];
+    if (found && e) *e = BENTRY(BLEAF(p.nodes[p.depth]), p.idx[p.depth]);
+    return rank;
+}
+
+/* INDEX must be in range. */
+static ScmDictEntry *bt_select(ScmTreeCore *tc, int index)
+{
+    BNode *n = BROOT(tc);
+    while (!n->leafp) {
+        BInner *in = BINNER(n);
+        int i = 0;
+        while (index >= in->sizes[i]) index -= in->sizes[i++];
+        n = in->children[i];
+    }
+    return BENTRY(BLEAF(n), index);
+}
+
+/* Returns the entry next to (or previous to) E in *LEAF, updating *LEAF
+   if we move to another leaf. */
+static ScmDictEntry *bt_step(BLeaf **leaf, ScmDictEntry *e, int forward)
+{
+    BLeaf *l = *leaf;
+    int i = (int)((BEntry*)e - l->entries);
+    if (forward) {
+        if (i+1 < l->hdr.n) return BENTRY(l, i+1);
+        *leaf = l->next;
+        return l->next? BENTRY(l->next, 0) : NULL;
+    } else {
+        if (i > 0) return BENTRY(l, i-1);
+        *leaf = l->prev;
+        return l->prev? BENTRY(l->prev, l->prev->hdr.n-1) : NULL;
+    }
+}
+
+/* copy.  LAST keeps the last leaf copied so far, to link the leaves. */
+static BNode *bt_copy(BNode *n, BLeaf **last)
+{
+    if (n->leafp) {
+        BLeaf *l = bt_new_leaf();
+        *l = *BLEAF(n);
+        l->prev = *last;
+        l->next = NULL;
+        if (*last) (*last)->next = l;
+        *last = l;
+        return (BNode*)l;
+    } else {
+        BInner *in = bt_new_inner();
+        *in = *BINNER(n);
+        for (int i=0; i<n->n; i++) {
+            in->children[i] = bt_copy(BINNER(n)->children[i], last);
+        }
+        return (BNode*)in;
+    }
+}
+
+/* Bulk construction from sorted arrays; see Scm_TreeCoreBuildSorted.
+   We make the leaves first, dividing the entries as evenly as possible,
+   then the levels above them in the same way. */
+static BNode *bt_build(const intptr_t *keys, const intptr_t *values, int n)
+{
+    if (n == 0) return NULL;
+    int m = (n + BT_MAX - 1)/BT_MAX;    /* # of nodes in the level */
+    BNode **level = SCM_NEW_ARRAY(BNode*, m);
+    intptr_t *mins = SCM_NEW_ARRAY(intptr_t, m);
+    int *counts = SCM_NEW_ATOMIC_ARRAY(int, m);
+    BLeaf *prev = NULL;
+
+    for (int i=0, k=0; i<m; i++) {
+        BLeaf *l = bt_new_leaf();
+        int c = n/m + (i < n%m);
+        for (int j=0; j<c; j++, k++) {
+            l->entries[j].key = keys[k];
+            l->entries[j].value = values? values[k] : 0;
+        }
+        l->hdr.n = c;
+        l->prev = prev;
+        if (prev) prev->next = l;
+        prev = l;
+        level[i] = (BNode*)l;
+        mins[i] = l->entries[0].key;
+        counts[i] = c;
+    }
+    while (m > 1) {
+        int pm = (m + BT_MAX - 1)/BT_MAX;
+        /* We overwrite the arrays from the front, which is safe since
+           the Ith parent never precedes its children. */
+        for (int i=0, k=0; i<pm; i++) {
+            BInner *in = bt_new_inner();
+            int c = m/pm + (i < m%pm);
+            intptr_t min = mins[k];
+            int total = 0;
+            for (int j=0; j<c; j++, k++) {
+                in->keys[j] = j? mins[k] : 0;
+                in->sizes[j] = counts[k];
+                in->children[j] = level[k];
+                total += counts[k];
+            }
+            in->hdr.n = c;
+            level[i] = (BNode*)in;
+            mins[i] = min;
+            counts[i] = total;
+        }
+        m = pm;
+    }
+    return level[0];
+}
+
+/* consistency check.  Returns the number of entries under N, and sets
+   the minimum and maximum keys in *MIN and *MAX. */
+static int bt_check(ScmTreeCore *tc, BNode *n, int depth, int *leaf_depth,
+                    BLeaf **prev, intptr_t *min, intptr_t *max)
+{
+    if (n->n > BT_MAX) {
+        Scm_Error("[internal] B+tree node has too many elements: %d", n->n);
+    }
+    if (depth > 0 && n->n < BT_MIN) {
+        Scm_Error("[internal] B+tree node has too few elements: %d", n->n);
+    }
+    if (n->leafp) {
+        BLeaf *l = BLEAF(n);
+        if (*leaf_depth < 0) *leaf_depth = depth;
+        else if (*leaf_depth != depth) {
+            Scm_Error("[internal] B+tree leaves at different depths: %d vs %d",
+                      *leaf_depth, depth);
+        }
+        if (l->prev != *prev || (*prev && (*prev)->next != l)) {
+            Scm_Error("[internal] B+tree leaves are not linked properly");
+        }
+        if (n->n == 0) Scm_Error("[internal] B+tree has an empty leaf");
+        for (int i=1; i<n->n; i++) {
+            if (key_cmp(tc, l->entries[i-1].key, l->entries[i].key) >= 0) {
+                Scm_Error("[internal] B+tree leaf entries are out of order");
+            }
+        }
+        if (*prev && key_cmp(tc, (*prev)->entries[(*prev)->hdr.n-1].key,
+                             l->entries[0].key) >= 0) {
+            Scm_Error("[internal] B+tree leaves are out of order");
+        }
+        *prev = l;
+        *min = l->entries[0].key;
+        *max = l->entries[n->n-1].key;
+        return n->n;
+    } else {
+        BInner *in = BINNER(n);
+        int total = 0;
+        if (n->n < 2) {
+            Scm_Error("[internal] B+tree inner node has only %d child", n->n);
+        }
+        for (int i=0; i<n->n; i++) {
+            intptr_t cmin, cmax;
+            int c = bt_check(tc, in->children[i], depth+1, leaf_depth,
+                             prev, &cmin, &cmax);
+            if (c != in->sizes[i]) {
+                Scm_Error("[internal] B+tree has wrong subtree size: %d (expected %d)",
+                          in->sizes[i], c);
+            }
+            if (i > 0 && (key_cmp(tc, in->keys[i], cmin) > 0
+                          || key_cmp(tc, *max, in->keys[i]) >= 0)) {
+                Scm_Error("[internal] B+tree has a wrong separator");
+            }
+            if (i == 0) *min = cmin;
+            *max = cmax;
+            total += c;
+        }
+        return total;
+    }
+}
+
+static void bt_check_consistency(ScmTreeCore *tc)
+{
+    int cnt = 0;
+    if (tc->root) {
+        int leaf_depth = -1;
+        BLeaf *prev = NULL;
+        intptr_t min, max;
+        if (BROOT(tc)->leafp && BROOT(tc)->n == 0) {
+            Scm_Error("[internal] B+tree has an empty root");
+        }
+        cnt = bt_check(tc, BROOT(tc), 0, &leaf_depth, &prev, &min, &max);
+        if (prev->next != NULL) {
+            Scm_Error("[internal] B+tree leaves are not linked properly");
+        }
+    }
+    if (cnt != tc->num_entries) {
+        Scm_Error("[internal] tree map node count mismatch: record %d vs actual %d", tc->num_entries, cnt);
+    }
+}
+
+/* for debug */
+static void bt_dump(BNode *n, int depth, ScmPort *out, int scmobj)
+{
+    for (int i=0; i<n->n; i++) {
+        if (n->leafp) {
+            BEntry *e = &BLEAF(n)->entries[i];
+            for (int j=0; j<depth; j++) Scm_Printf(out, "  ");
+            if (scmobj) {
+                Scm_Printf(out, "%S => %S\n", SCM_OBJ(e->key), SCM_OBJ(e->value));
+            } else {
+                Scm_Printf(out, "%08x => %08x\n", e->key, e->value);
+            }
+        } else {
+            BInner *in = BINNER(n);
+            if (i > 0) {
+                for (int j=0; j<depth; j++) Scm_Printf(out, "  ");
+                if (scmobj) Scm_Printf(out, "[%S]\n", SCM_OBJ(in->keys[i]));
+                else        Scm_Printf(out, "[%08x]\n", in->keys[i]);
+            }
+            bt_dump(in->children[i], depth+1, out, scmobj);
+        }
+    }
+}
@@ -185,6 +185,185 @@ ScmObj Scm_VectorCopy(ScmVector *vec,
     return SCM_OBJ(v);
 }
 
+/*=====================================================================
+ * Bitvectors
+ */
+
+/* A bitvector is a fixed-length array of bits on ScmBits.  The unused
+   bits in the last word are kept zero, so that whole-word operations
+   (count, compare, hash) don't need to mask them. */
+
+static void bitvector_print(ScmObj obj, ScmPort *port, ScmWriteContext *ctx)
+{
+    ScmBitvector *v = SCM_BITVECTOR(obj);
+    SCM_PUTZ("#*", -1, port);
+    for (ScmSmallInt i=0; i<SCM_BITVECTOR_SIZE(v); i++) {
+        SCM_PUTC(SCM_BITS_TEST(v->bits, i)? '1' : '0', port);
+    }
+}
+
+static int bitvector_compare(ScmObj x, ScmObj y, int equalp)
+{
+    ScmSmallInt xlen = SCM_BITVECTOR_SIZE(x);
+    ScmSmallInt ylen = SCM_BITVECTOR_SIZE(y);
+    if (equalp) {
+        if (xlen != ylen) return 1;
+        return Scm_BitsEqual(SCM_BITVECTOR_BITS(x), SCM_BITVECTOR_BITS(y),
+                             0, (int)xlen)? 0 : 1;
+    }
+    /* Like uvectors, shorter one comes first, then lexicographic order */
+    if (xlen < ylen) return -1;
+    if (xlen > ylen) return 1;
+    for (ScmSmallInt i=0; i<xlen; i++) {
+        int xb = SCM_BITS_TEST(SCM_BITVECTOR_BITS(x), i);
+        int yb = SCM_BITS_TEST(SCM_BITVECTOR_BITS(y), i);
+        if (xb != yb) return xb? 1 : -1;
+    }
+    return 0;
+}
+
+SCM_DEFINE_BUILTIN_CLASS_FLAGS(Scm_BitvectorClass, bitvector_print,
+                               bitvector_compare, NULL, NULL,
+                               SCM_CLASS_SEQUENCE_CPL, SCM_CLASS_AGGREGATE);
+
+static ScmBitvector *make_bitvector(ScmSmallInt numbits)
+{
+    if (numbits < 0) {
+        Scm_Error("bitvector size must be a positive integer, but got %ld",
+                  numbits);
+    }
+    if (numbits > INT_MAX) {
+        Scm_Error("bitvector size too big: %ld", numbits);
+    }
+    ScmBitvector *v = SCM_NEW(ScmBitvector);
+    SCM_SET_CLASS(v, SCM_CLASS_BITVECTOR);
+    v->size_flags = (numbits << 1);
+    v->bits = Scm_MakeBits((int)numbits);
+    return v;
+}
+
+/* Converts a Scheme bit, 0, 1, #f or #t, to 0 or 1. */
+int Scm_Bit2Int(ScmObj bit)
+{
+    if (SCM_EQ(bit, SCM_MAKE_INT(0)) || SCM_FALSEP(bit)) return 0;
+    if (SCM_EQ(bit, SCM_MAKE_INT(1)) || SCM_TRUEP(bit)) return 1;
+    Scm_Error("bit (0, 1, #t or #f) required, but got: %S", bit);
+    return 0;                   /* dummy */
+}
+
+ScmObj Scm_MakeBitvector(ScmSmallInt numbits, ScmObj init)
+{
+    ScmBitvector *v = make_bitvector(numbits);
+    if (numbits > 0 && !SCM_UNBOUNDP(init) && Scm_Bit2Int(init)) {
+        Scm_BitsFill(v->bits, 0, (int)numbits, TRUE);
+    }
+    return SCM_OBJ(v);
+}
+
+ScmObj Scm_ListToBitvector(ScmObj lis)
+{
+    ScmSmallInt len = Scm_Length(lis);
+    if (len < 0) Scm_Error("proper list required, but got: %S", lis);
+    ScmBitvector *v = make_bitvector(len);
+    ScmSmallInt i = 0;
+    ScmObj cp;
+    SCM_FOR_EACH(cp, lis) {
+        if (Scm_Bit2Int(SCM_CAR(cp))) SCM_BITS_SET(v->bits, i);
+        i++;
+    }
+    return SCM_OBJ(v);
+}
+
+ScmObj Scm_BitvectorCopy(ScmBitvector *src, ScmSmallInt start,
+                         ScmSmallInt end)
+{
+    ScmSmallInt len = SCM_BITVECTOR_SIZE(src);
+    SCM_CHECK_START_END(start, end, len);
+    ScmBitvector *v = make_bitvector(end - start);
+    Scm_BitsCopyX(v->bits, 0, src->bits, (int)start, (int)end);
+    return SCM_OBJ(v);
+}
+
+ScmObj Scm_BitvectorCopyX(ScmBitvector *dst, ScmSmallInt dstart,
+                          ScmBitvector *src,
+                          ScmSmallInt sstart, ScmSmallInt send)
+{
+    SCM_BITVECTOR_CHECK_MUTABLE(dst);
+    ScmSmallInt dlen = SCM_BITVECTOR_SIZE(dst);
+    ScmSmallInt slen = SCM_BITVECTOR_SIZE(src);
+    SCM_CHECK_START_END(sstart, send, slen);
+    if (dstart < 0 || dstart > dlen) {
+        Scm_Error("destination index out of range: %ld", dstart);
+    }
+    if (dlen - dstart < send - sstart) {
+        Scm_Error("source (%ld bits) doesn't fit in the destination "
+                  "(%ld bits from %ld)", send - sstart, dlen - dstart, dstart);
+    }
+    Scm_BitsCopyX(dst->bits, (int)dstart, src->bits, (int)sstart, (int)send);
+    return SCM_OBJ(dst);
+}
+
+/* R := A op B.  A and/or B can be the same as R.  B may be NULL
+   for the unary operations (SCM_BIT_NOT1, SCM_BIT_SRC1). */
+ScmObj Scm_BitvectorOperate(ScmBitvector *r, ScmBitOp op,
+                            ScmBitvector *a, ScmBitvector *b)
+{
+    ScmSmallInt len = SCM_BITVECTOR_SIZE(a);
+    SCM_BITVECTOR_CHECK_MUTABLE(r);
+    if (SCM_BITVECTOR_SIZE(r) != len
+        || (b != NULL && SCM_BITVECTOR_SIZE(b) != len)) {
+        Scm_Error("bitvector lengths differ: %S, %S%s%S",
+                  SCM_OBJ(r), SCM_OBJ(a), (b? ", " : ""),
+                  (b? SCM_OBJ(b) : SCM_MAKE_STR("")));
+    }
+    Scm_BitsOperate(r->bits, op, a->bits, (b? b->bits : NULL), 0, (int)len);
+    return SCM_OBJ(r);
+}
+
+/* Parses a string of '0's and '1's.  If PREFIX is true, the string must
+   begin with "#*".  Returns #f if the string isn't a valid bitvector
+   representation. */
+ScmObj Scm_StringToBitvector(ScmString *s, int prefix)
+{
+    const ScmStringBody *b = SCM_STRING_BODY(s);
+    const char *p = SCM_STRING_BODY_START(b);
+    ScmSmallInt size = SCM_STRING_BODY_SIZE(b);
+    if (prefix) {
+        if (size < 2 || p[0] != '#' || p[1] != '*') return SCM_FALSE;
+        p += 2;
+        size -= 2;
+    }
+    ScmBitvector *v = make_bitvector(size);
+    for (ScmSmallInt i=0; i<size; i++) {
+        if (p[i] == '1') SCM_BITS_SET(v->bits, i);
+        else if (p[i] != '0') return SCM_FALSE;
+    }
+    return SCM_OBJ(v);
+}
+
+ScmObj Scm_BitvectorToString(ScmBitvector *v, int prefix)
+{
+    ScmSmallInt len = SCM_BITVECTOR_SIZE(v);
+    ScmSmallInt off = prefix? 2 : 0;
+    char *buf = SCM_NEW_ATOMIC_ARRAY(char, len + off + 1);
+    if (prefix) { buf[0] = '#'; buf[1] = '*'; }
+    for (ScmSmallInt i=0; i<len; i++) {
+        buf[i+off] = SCM_BITS_TEST(v->bits, i)? '1' : '0';
+    }
+    buf[len+off] = '\0';
+    return Scm_MakeString(buf, len+off, len+off, 0);
+}
+
+/* The K-th (0-based) BIT in V, or -1 if not found.*/
+ScmSmallInt Scm_BitvectorSelect(ScmBitvector *v, int bit, ScmSmallInt k)
+{
+    ScmSmallInt len = SCM_BITVECTOR_SIZE(v);
+    if (k < 0 || k >= len) return -1;
+    return bit
+        ? Scm_BitsSelect1(v->bits, 0, (int)len, (int)k)
+        : Scm_BitsSelect0(v->bits, 0, (int)len, (int)k);
+}
+
 /*=====================================================================
  * Uniform vectors
  */
@@ -582,13 +761,20 @@ DEF_PRINT(F64, f64, double, fpr)
 
 /* comparer */
 
-#define DEF_CMP(TAG, tag, T, eq, lt)                                    \
+/* For integer element types, equality is the same as identity of bytes,
+   so we can use memcmp.  Not for flonums, for 0.0 = -0.0 and NaN != NaN. */
+#define DEF_CMP(TAG, tag, T, eq, lt, bytewise)                          \
 static int SCM_CPP_CAT3(compare_,tag,vector)(ScmObj x, ScmObj y, int equalp) \
 {                                                                       \
     ScmSmallInt xlen = SCM_CPP_CAT3(SCM_,TAG,VECTOR_SIZE)(x);           \
     ScmSmallInt ylen = SCM_CPP_CAT3(SCM_,TAG,VECTOR_SIZE)(y);           \
     if (equalp) {                                                       \
         if (xlen != ylen) return -1;                                    \
+        if (bytewise) {                                                 \
+            return memcmp(SCM_CPP_CAT3(SCM_,TAG,VECTOR_ELEMENTS)(x),    \
+                          SCM_CPP_CAT3(SCM_,TAG,VECTOR_ELEMENTS)(y),    \
+                          xlen*sizeof(T)) == 0 ? 0 : -1;                \
+        }                                                               \
         for (ScmSmallInt i=0; i<xlen; i++) {                            \
             T xx = SCM_CPP_CAT3(SCM_,TAG,VECTOR_ELEMENTS)(x)[i];        \
             T yy = SCM_CPP_CAT3(SCM_,TAG,VECTOR_ELEMENTS)(y)[i];        \
@@ -649,14 +835,14 @@ static inline int uint64lt(ScmUInt64 x, ScmUInt64 y)
 #define f16eqv(a, b) SCM_HALF_FLOAT_CMP(==, a, b)
 #define f16lt(a, b)  SCM_HALF_FLOAT_CMP(<, a, b)
 
-DEF_CMP(S8, s8, signed char, common_eqv, common_lt)
-DEF_CMP(U8, u8, unsigned char, common_eqv, common_lt)
-DEF_CMP(S16, s16, short, common_eqv, common_lt)
-DEF_CMP(U16, u16, u_short, common_eqv, common_lt)
-DEF_CMP(S32, s32, ScmInt32, common_eqv, common_lt)
-DEF_CMP(U32, u32, ScmUInt32, common_eqv, common_lt)
-DEF_CMP(S64, s64, ScmInt64, int64eqv, int64lt)
-DEF_CMP(U64, u64, ScmUInt64, uint64eqv, uint64lt)
-DEF_CMP(F16, f16, ScmHalfFloat, f16eqv, f16lt)
-DEF_CMP(F32, f32, float, common_eqv, common_lt)
-DEF_CMP(F64, f64, double, common_eqv, common_lt)
+DEF_CMP(S8, s8, signed char, common_eqv, common_lt, TRUE)
+DEF_CMP(U8, u8, unsigned char, common_eqv, common_lt, TRUE)
+DEF_CMP(S16, s16, short, common_eqv, common_lt, TRUE)
+DEF_CMP(U16, u16, u_short, common_eqv, common_lt, TRUE)
+DEF_CMP(S32, s32, ScmInt32, common_eqv, common_lt, TRUE)
+DEF_CMP(U32, u32, ScmUInt32, common_eqv, common_lt, TRUE)
+DEF_CMP(S64, s64, ScmInt64, int64eqv, int64lt, TRUE)
+DEF_CMP(U64, u64, ScmUInt64, uint64eqv, uint64lt, TRUE)
+DEF_CMP(F16, f16, ScmHalfFloat, f16eqv, f16lt, FALSE)
+DEF_CMP(F32, f32, float, common_eqv, common_lt, FALSE)
+DEF_CMP(F64, f64, double, common_eqv, common_lt, FALSE)
@@ -39,6 +39,8 @@
 #include "gauche/code.h"
 #include "gauche/vminsn.h"
 #include "gauche/prof.h"
+#include "gauche/priv/arith.h"
+#include "gauche/priv/probeP.h"
 
 
 /* Experimental code to use custom mark procedure for stack gc.
@@ -125,7 +127,45 @@ static DWORD vm_key;
 static ScmVM *theVM;
 #endif /* !GAUCHE_USE_PTHREADS */
 
-static void save_stack(ScmVM *vm);
+static void save_stack(ScmVM *vm, int need);
+static void alloc_stack(ScmVM *vm, int size);
+#if GAUCHE_FFX
+static void alloc_fpstack(ScmVM *vm, int size);
+#endif /* GAUCHE_FFX */
+
+/* The stack size of newly created VMs.  Can be overridden by
+   GAUCHE_VM_STACK_SIZE environment variable.  */
+static int vm_default_stack_size = SCM_VM_STACK_SIZE;
+
+/* Pool of VM stacks.  A VM outlives its thread---it is the thread
+   object, which thread-join! and others look at after the thread is
+   terminated---but its stack is of no use by then.  We keep the
+   default-sized stacks of terminated threads and give them to new VMs,
+   so that a program that spawns many short-lived threads doesn't
+   allocate (and the GC doesn't clear) a fresh stack each time.
+
+   A pooled stack is cleared, except that stack[0] chains the next
+   pooled stack and stack[1] holds the flonum stack that goes with it.
+   The pool doesn't work with the custom stack marker, which only marks
+   a stack while its VM uses it.
+
+   The maximum number of pooled stacks is SCM_VM_STACK_POOL_SIZE by
+   default, and can be changed by GAUCHE_VM_STACK_POOL_SIZE environment
+   variable or Scm_VMSetStackPoolSize.  Zero disables pooling. */
+static struct {
+    ScmObj *stacks;
+    int count;
+    int max;
+    ScmInternalMutex mutex;
+} vm_stack_pool = { NULL, 0, SCM_VM_STACK_POOL_SIZE };
+
+#if defined(USE_CUSTOM_STACK_MARKER)
+#define VM_STACK_POOL_USABLE FALSE
+#else
+#define VM_STACK_POOL_USABLE TRUE
+#endif
+
+static int take_pooled_stack(ScmVM *vm);
 
 static ScmSubr default_exception_handler_rec;
 #define DEFAULT_EXCEPTION_HANDLER  SCM_OBJ(&default_exception_handler_rec)
@@ -140,9 +180,33 @@ static ScmEnvFrame *get_env(ScmVM *vm);
 static void   call_error_reporter(ScmObj e);
 
 /*#define COUNT_INSN_FREQUENCY*/
-#ifdef COUNT_INSN_FREQUENCY
 #include "vmstat.c"
-#endif /*COUNT_INSN_FREQUENCY*/
+
+/*
+ * Static probes (see gauche/priv/probeP.h)
+ */
+#if defined(GAUCHE_USE_SDT)
+SCM_PROBE_DEFINE_SEMAPHORE(procedure__entry);
+SCM_PROBE_DEFINE_SEMAPHORE(procedure__return);
+SCM_PROBE_DEFINE_SEMAPHORE(gc__start);
+SCM_PROBE_DEFINE_SEMAPHORE(gc__end);
+SCM_PROBE_DEFINE_SEMAPHORE(load__start);
+SCM_PROBE_DEFINE_SEMAPHORE(load__end);
+SCM_PROBE_DEFINE_SEMAPHORE(exception__raise);
+
+/* Only called while a tracer is attached, so we don't mind allocating. */
+const char *Scm__ProbeCodeName(ScmCompiledCode *code)
+{
+    ScmObj name = Scm_CompiledCodeFullName(code);
+    if (SCM_SYMBOLP(name)) {
+        return Scm_GetStringConst(SCM_SYMBOL_NAME(name));
+    } else if (SCM_FALSEP(name)) {
+        return "#f";
+    } else {
+        return Scm_GetStringConst(SCM_STRING(Scm_Sprintf("%S", name)));
+    }
+}
+#endif /*GAUCHE_USE_SDT*/
 
 /*
  * Constructor
@@ -190,6 +254,7 @@ ScmVM *Scm_NewVM(ScmVM *proto, ScmObj name)
     v->curin  = proto? proto->curin  : SCM_PORT(Scm_Stdin());
     v->curout = proto? proto->curout : SCM_PORT(Scm_Stdout());
     v->curerr = proto? proto->curerr : SCM_PORT(Scm_Stderr());
+    v->numOstrPool = 0;
 
     Scm__VMParameterTableInit(&(v->parameters), proto);
 
@@ -200,21 +265,12 @@ ScmVM *Scm_NewVM(ScmVM *proto, ScmObj name)
     v->finalizerPending = 0;
     v->stopRequest = 0;
 
-#ifdef USE_CUSTOM_STACK_MARKER
-    v->stack = (ScmObj*)GC_generic_malloc((SCM_VM_STACK_SIZE+1)*sizeof(ScmObj),
-                                          vm_stack_kind);
-    *v->stack++ = SCM_OBJ(v);
-#else  /*!USE_CUSTOM_STACK_MARKER*/
-    v->stack = SCM_NEW_ARRAY(ScmObj, SCM_VM_STACK_SIZE);
-#endif /*!USE_CUSTOM_STACK_MARKER*/
-    v->sp = v->stack;
-    v->stackBase = v->stack;
-    v->stackEnd = v->stack + SCM_VM_STACK_SIZE;
+    if (!take_pooled_stack(v)) {
+        alloc_stack(v, vm_default_stack_size);
 #if GAUCHE_FFX
-    v->fpstack = SCM_NEW_ATOMIC_ARRAY(ScmFlonum, SCM_VM_STACK_SIZE);
-    v->fpstackEnd = v->fpstack + SCM_VM_STACK_SIZE;
-    v->fpsp = v->fpstack;
+        alloc_fpstack(v, vm_default_stack_size);
 #endif /* GAUCHE_FFX */
+    }
 
     v->env = NULL;
     v->argp = v->stack;
@@ -224,6 +280,8 @@ ScmVM *Scm_NewVM(ScmVM *proto, ScmObj name)
     v->val0 = SCM_UNDEFINED;
     for (int i=0; i<SCM_VM_MAX_VALUES; i++) v->vals[i] = SCM_UNDEFINED;
     v->numVals = 1;
+    v->xvals = NULL;
+    v->xvalsSize = 0;
 
     v->handlers = SCM_NIL;
 
@@ -243,6 +301,7 @@ ScmVM *Scm_NewVM(ScmVM *proto, ScmObj name)
     v->stat.sovCount = 0;
     v->stat.sovTime = 0;
     v->stat.loadStat = SCM_NIL;
+    v->stat.macroStat = SCM_FALSE;
     v->profilerRunning = FALSE;
     v->prof = NULL;
 
@@ -260,6 +319,153 @@ ScmVM *Scm_NewVM(ScmVM *proto, ScmObj name)
     return v;
 }
 
+/* Allocates a fresh stack of SIZE words for VM. */
+static void alloc_stack(ScmVM *v, int size)
+{
+#ifdef USE_CUSTOM_STACK_MARKER
+    v->stack = (ScmObj*)GC_generic_malloc((size+1)*sizeof(ScmObj),
+                                          vm_stack_kind);
+    *v->stack++ = SCM_OBJ(v);
+#else  /*!USE_CUSTOM_STACK_MARKER*/
+    v->stack = SCM_NEW_ARRAY(ScmObj, size);
+#endif /*!USE_CUSTOM_STACK_MARKER*/
+    v->sp = v->stack;
+    v->stackBase = v->stack;
+    v->stackEnd = v->stack + size;
+    v->stackSize = size;
+}
+
+#if GAUCHE_FFX
+static void alloc_fpstack(ScmVM *v, int size)
+{
+    v->fpstack = SCM_NEW_ATOMIC_ARRAY(ScmFlonum, size);
+    v->fpstackEnd = v->fpstack + size;
+    v->fpsp = v->fpstack;
+}
+#endif /* GAUCHE_FFX */
+
+/* Changes the stack size of a VM that hasn't started running.
+   A small stack saves memory when you have many threads; a large
+   stack reduces the times the frames are moved to the heap in
+   deep recursion. */
+void Scm_VMSetStackSize(ScmVM *vm, int size)
+{
+    if (size < SCM_VM_MIN_STACK_SIZE) {
+        Scm_Error("VM stack size must be at least %d, but got %d",
+                  SCM_VM_MIN_STACK_SIZE, size);
+    }
+    if (vm->state != SCM_VM_NEW) {
+        Scm_Error("can't change the stack size of a running VM: %S",
+                  SCM_OBJ(vm));
+    }
+    Scm_VMReleaseStack(vm);
+    alloc_stack(vm, size);
+#if GAUCHE_FFX
+    alloc_fpstack(vm, size);
+#endif /* GAUCHE_FFX */
+    vm->argp = vm->stack;
+}
+
+int Scm_VMDefaultStackSize(void)
+{
+    return vm_default_stack_size;
+}
+
+/* If the stack pool has a stack, let VM use it and returns TRUE.
+   Otherwise returns FALSE. */
+static int take_pooled_stack(ScmVM *vm)
+{
+    ScmObj *stack = NULL;
+    if (!VM_STACK_POOL_USABLE || vm_stack_pool.count == 0) return FALSE;
+
+    (void)SCM_INTERNAL_MUTEX_LOCK(vm_stack_pool.mutex);
+    if (vm_stack_pool.stacks != NULL) {
+        stack = vm_stack_pool.stacks;
+        vm_stack_pool.stacks = (ScmObj*)stack[0];
+        vm_stack_pool.count--;
+    }
+    (void)SCM_INTERNAL_MUTEX_UNLOCK(vm_stack_pool.mutex);
+    if (stack == NULL) return FALSE;
+
+    int size = vm_default_stack_size;
+#if GAUCHE_FFX
+    vm->fpstack = (ScmFlonum*)stack[1];
+    vm->fpstackEnd = vm->fpstack + size;
+    vm->fpsp = vm->fpstack;
+#endif /* GAUCHE_FFX */
+    stack[0] = stack[1] = NULL;
+    vm->stack = stack;
+    vm->sp = vm->stackBase = stack;
+    vm->stackEnd = stack + size;
+    vm->stackSize = size;
+    return TRUE;
+}
+
+/* Detaches the stack from VM, which will never run again (it is
+   terminated, or its stack is being replaced before it starts), and
+   puts it into the stack pool if the pool has room.  The VM is left
+   without a stack. */
+void Scm_VMReleaseStack(ScmVM *vm)
+{
+    ScmObj *stack = vm->stack;
+    if (stack == NULL) return;
+
+    vm->stack = vm->sp = vm->stackBase = vm->stackEnd = NULL;
+    vm->argp = NULL;
+    vm->env = NULL;
+    vm->cont = NULL;
+    /* Value registers may refer to the flonum stack. */
+    vm->val0 = SCM_UNDEFINED;
+    for (int i=0; i<SCM_VM_MAX_VALUES; i++) vm->vals[i] = SCM_UNDEFINED;
+    vm->numVals = 1;
+#if GAUCHE_FFX
+    ScmFlonum *fpstack = vm->fpstack;
+    vm->fpstack = vm->fpsp = vm->fpstackEnd = NULL;
+#endif /* GAUCHE_FFX */
+
+    if (!VM_STACK_POOL_USABLE) return;
+    /* grow_stack may have left a larger stack, which we don't keep. */
+    if (vm->stackSize != vm_default_stack_size) return;
+    if (vm_stack_pool.count >= vm_stack_pool.max) return; /* quick path */
+
+    /* Clear it outside the lock, so that the stale pointers won't
+       retain garbage while the stack is pooled. */
+    memset(stack, 0, vm->stackSize * sizeof(ScmObj));
+#if GAUCHE_FFX
+    stack[1] = (ScmObj)fpstack;
+#endif /* GAUCHE_FFX */
+    (void)SCM_INTERNAL_MUTEX_LOCK(vm_stack_pool.mutex);
+    if (vm_stack_pool.count < vm_stack_pool.max) {
+        stack[0] = (ScmObj)vm_stack_pool.stacks;
+        vm_stack_pool.stacks = stack;
+        vm_stack_pool.count++;
+    }
+    (void)SCM_INTERNAL_MUTEX_UNLOCK(vm_stack_pool.mutex);
+}
+
+/* Changes the maximum number of pooled stacks.  The excess stacks
+   are dropped. */
+void Scm_VMSetStackPoolSize(int size)
+{
+    if (size < 0) {
+        Scm_Error("VM stack pool size must be a nonnegative integer, "
+                  "but got %d", size);
+    }
+    (void)SCM_INTERNAL_MUTEX_LOCK(vm_stack_pool.mutex);
+    vm_stack_pool.max = size;
+    while (vm_stack_pool.count > size) {
+        ScmObj *stack = vm_stack_pool.stacks;
+        vm_stack_pool.stacks = (ScmObj*)stack[0];
+        vm_stack_pool.count--;
+    }
+    (void)SCM_INTERNAL_MUTEX_UNLOCK(vm_stack_pool.mutex);
+}
+
+int Scm_VMStackPoolSize(void)
+{
+    return vm_stack_pool.max;
+}
+
 /* Attach the thread to the current thread.
    See the notes of Scm_NewVM above.
    Returns TRUE on success, FALSE on failure. */
@@ -274,6 +480,9 @@ int Scm_AttachVM(ScmVM *vm)
        thread or not. */
 
     if (!SCM_INTERNAL_THREAD_SETSPECIFIC(Scm_VMKey(), vm)) return FALSE;
+#if defined(GAUCHE_HAS_PERF_CURRENT_VM)
+    Scm__PerfCurrentVM = vm;
+#endif
 
     if (!SCM_INTERNAL_THREAD_INITIALIZED_P(vm->thread)) {
 #ifdef GAUCHE_USE_WTHREADS
@@ -312,6 +521,9 @@ void Scm_DetachVM(ScmVM *vm)
 #ifdef GAUCHE_HAS_THREADS
     if (vm != NULL) {
         (void)SCM_INTERNAL_THREAD_SETSPECIFIC(Scm_VMKey(), NULL);
+#if defined(GAUCHE_HAS_PERF_CURRENT_VM)
+        Scm__PerfCurrentVM = NULL;
+#endif
         vm_unregister(vm);
     }
 #endif /* GAUCHE_HAS_THREADS */
@@ -328,11 +540,28 @@ ScmObj Scm_VMGetResult(ScmVM *vm)
     if (vm->numVals == 0) return SCM_NIL;
     SCM_APPEND1(head, tail, vm->val0);
     for (int i=1; i<vm->numVals; i++) {
-        SCM_APPEND1(head, tail, vm->vals[i-1]);
+        SCM_APPEND1(head, tail, SCM_VM_VALS_REF(vm, i-1));
     }
     return head;
 }
 
+/* Makes sure VM can hold NVALS values.  The overflow buffer is only
+   allocated when more values than the registers are returned, and kept
+   for the later use. */
+void Scm__VMEnsureValues(ScmVM *vm, int nvals)
+{
+    int nx = nvals - 1 - SCM_VM_MAX_VALUES;
+    if (nx <= vm->xvalsSize) return;
+    int newsize = (vm->xvalsSize > 0)? vm->xvalsSize : 16;
+    while (newsize < nx) newsize *= 2;
+    ScmObj *xv = SCM_NEW_ARRAY(ScmObj, newsize);
+    if (vm->xvalsSize > 0) {
+        memcpy(xv, vm->xvals, sizeof(ScmObj)*vm->xvalsSize);
+    }
+    vm->xvals = xv;
+    vm->xvalsSize = newsize;
+}
+
 void Scm_VMSetResult(ScmObj obj)
 {
     ScmVM *vm = theVM;
@@ -420,11 +649,7 @@ static void vm_unregister(ScmVM *vm)
 #define FETCH_OPERAND(var)      ((var) = SCM_OBJ(*PC))
 #define FETCH_OPERAND_PUSH      (*SP++ = SCM_OBJ(*PC))
 
-#ifndef COUNT_INSN_FREQUENCY
 #define FETCH_INSN(var)         ((var) = *PC++)
-#else
-#define FETCH_INSN(var)         ((var) = fetch_insn_counting(vm, var))
-#endif
 
 /* For sanity check in debugging mode */
 #ifdef PARANOIA
@@ -477,13 +702,13 @@ static void vm_unregister(ScmVM *vm)
 
 /* return true if ptr points into the stack area */
 #define IN_STACK_P(ptr)                         \
-      ((unsigned long)((ptr) - vm->stackBase) < SCM_VM_STACK_SIZE)
+      ((unsigned long)((ptr) - vm->stackBase) < (unsigned long)vm->stackSize)
 
-/* Check if stack has room at least size bytes. */
+/* Check if stack has room at least size words. */
 #define CHECK_STACK(size)                                       \
     do {                                                        \
         if (MOSTLY_FALSE(SP >= vm->stackEnd - (size))) {        \
-            save_stack(vm);                                     \
+            save_stack(vm, (size));                             \
         }                                                       \
     } while (0)
 
@@ -554,6 +779,7 @@ static void vm_unregister(ScmVM *vm)
 /* return operation. */
 #define RETURN_OP()                                     \
     do {                                                \
+        SCM_PROBE_PROCEDURE(procedure__return, vm->base); \
         if (CONT == NULL || BOUNDARY_FRAME_P(CONT)) {   \
             return; /* no more continuations */         \
         }                                               \
@@ -730,6 +956,9 @@ static void vm_unregister(ScmVM *vm)
    the combination is very frequent - but for the less frequent
    instructions, NEXT_PUSHCHECK proved effective without introducing
    new fused vm insns.
+   When instruction counting is on, dispatch_table points to
+   counting_table (see vmstat.c); NEXT_PUSHCHECK doesn't take the
+   shortcut then, so that PUSH is counted as well.
 */
 #ifdef __GNUC__
 #define SWITCH(val) goto *dispatch_table[val];
@@ -744,7 +973,8 @@ static void vm_unregister(ScmVM *vm)
 #define NEXT_PUSHCHECK                                  \
     do {                                                \
         FETCH_INSN(code);                               \
-        if (code == SCM_VM_PUSH) {                      \
+        if (code == SCM_VM_PUSH                         \
+            && dispatch_table == insn_table) {          \
             PUSH_ARG(VAL0);                             \
             FETCH_INSN(code);                           \
         }                                               \
@@ -859,12 +1089,15 @@ static void run_loop()
     ScmWord code = 0;
 
 #ifdef __GNUC__
-    static void *dispatch_table[256] = {
+    static void *insn_table[256] = {
 #define DEFINSN(insn, name, nargs, type, flags)   && SCM_CPP_CAT(LABEL_, insn),
 #include "vminsn.c"
 #undef DEFINSN
     };
+    static void *counting_table[256] = { [0 ... 255] = &&counting_dispatch };
+    void **dispatch_table = insn_counting? counting_table : insn_table;
 #endif /* __GNUC__ */
+    int prev_insn = -1;         /* for instruction counting */
 
     /* Records the offset of each instruction handler from run_loop entry
        address.  They can be retrieved by gauche.internal#%vm-get-insn-offsets.
@@ -874,7 +1107,7 @@ static void run_loop()
            the first time, which is in Scm_Init(). */
         for (int i=0; i<SCM_VM_NUM_INSNS; i++) {
             vminsn_offsets[i] =
-                (unsigned long)((char*)dispatch_table[i] - (char*)run_loop);
+                (unsigned long)((char*)insn_table[i] - (char*)run_loop);
         }
     }
 
@@ -883,6 +1116,12 @@ static void run_loop()
         /*VM_DUMP("");*/
         if (vm->attentionRequest) goto process_queue;
         FETCH_INSN(code);
+#ifndef __GNUC__
+        if (insn_counting) {
+            count_insn(prev_insn, code);
+            prev_insn = SCM_VM_INSN_CODE(code);
+        }
+#endif
         SWITCH(SCM_VM_INSN_CODE(code)) {
 #define VMLOOP
 #include "vminsn.c"
@@ -898,7 +1137,16 @@ static void run_loop()
         PUSH_CONT(PC);
         process_queued_requests(vm);
         POP_CONT();
+#ifdef __GNUC__
+        dispatch_table = insn_counting? counting_table : insn_table;
+#endif
         NEXT;
+#ifdef __GNUC__
+      counting_dispatch:
+        count_insn(prev_insn, code);
+        prev_insn = SCM_VM_INSN_CODE(code);
+        goto *insn_table[SCM_VM_INSN_CODE(code)];
+#endif
     }
 }
 /* End of run_loop */
@@ -982,14 +1230,27 @@ static inline ScmEnvFrame *save_env(ScmVM *vm, ScmEnvFrame *env_begin)
    After save_cont, the only thing possibly left in the stack is the argument
    frame pointed by vm->argp.
  */
+static void save_cont_upto(ScmVM *vm, ScmContFrame *limit);
+static void unforward_env(ScmVM *vm, ScmEnvFrame **loc);
+
 static void save_cont(ScmVM *vm)
+{
+    save_cont_upto(vm, NULL);
+}
+
+/* Save the continuation frames above LIMIT (exclusive).  If LIMIT is NULL,
+   saves all the frames.  Otherwise, the frames from LIMIT and below are
+   left in the stack.  Call it only if you cut the saved frames from the
+   chain before executing any of them; the VM assumes no frame in the
+   stack is below a frame in the heap. */
+static void save_cont_upto(ScmVM *vm, ScmContFrame *limit)
 {
     ScmContFrame *c = vm->cont, *prev = NULL;
 
     /* Save the environment chain first. */
     vm->env = save_env(vm, vm->env);
 
-    if (!IN_STACK_P((ScmObj*)c)) return;
+    if (!IN_STACK_P((ScmObj*)c) || c == limit) goto fix_remaining;
 
     /* First pass */
     do {
@@ -1034,7 +1295,7 @@ static void save_cont(ScmVM *vm)
         c->prev = csave;
         c->size = -1;
         c = tmp;
-    } while (IN_STACK_P((ScmObj*)c));
+    } while (IN_STACK_P((ScmObj*)c) && c != limit);
 
     /* Second pass */
     if (FORWARDED_CONT_P(vm->cont)) {
@@ -1055,9 +1316,48 @@ static void save_cont(ScmVM *vm)
             ep->cont = FORWARDED_CONT(ep->cont);
         }
     }
+
+  fix_remaining:
+    /* The frames left in the stack may share env frames we've just moved.
+       Redirect them.  No copying is needed. */
+    for (c = limit; IN_STACK_P((ScmObj*)c); c = c->prev) {
+        unforward_env(vm, &c->env);
+    }
 }
 
-static void save_stack(ScmVM *vm)
+/* If the in-stack env chain starting from *LOC reaches a forwarded frame,
+   make the chain point to the moved frame. */
+static void unforward_env(ScmVM *vm, ScmEnvFrame **loc)
+{
+    ScmEnvFrame *e;
+    while ((e = *loc) != NULL && IN_STACK_P((ScmObj*)e)) {
+        if (FORWARDED_ENV_P(e)) {
+            *loc = FORWARDED_ENV(e);
+            return;
+        }
+        loc = &e->up;
+    }
+}
+
+/* Move all frames to the heap so that the stack has room for NEED words.
+   It only fails if the arguments being pushed alone don't fit; then we
+   switch to a larger stack.  Since no frames are left in the stack at
+   that point, we only need to copy the pending arguments. */
+static void grow_stack(ScmVM *vm, int need)
+{
+    int used = (int)(vm->sp - vm->stackBase);
+    int argpoff = (int)((ScmObj*)vm->argp - vm->stackBase);
+    int size = vm->stackSize;
+    while (size - used <= need) size *= 2;
+
+    ScmObj *ostack = vm->stackBase;
+    alloc_stack(vm, size);
+    memcpy(vm->stackBase, ostack, used * sizeof(ScmObj));
+    vm->sp = vm->stackBase + used;
+    vm->argp = vm->stackBase + argpoff;
+}
+
+static void save_stack(ScmVM *vm, int need)
 {
 #if HAVE_GETTIMEOFDAY
     int stats = SCM_VM_RUNTIME_FLAG_IS_SET(vm, SCM_COLLECT_VM_STATS);
@@ -1075,6 +1375,7 @@ static void save_stack(ScmVM *vm)
     vm->argp = vm->stackBase;
     /* Clear the stack.  This removes bogus pointers and accelerates GC */
     for (ScmObj *p = vm->sp; p < vm->stackEnd; p++) *p = NULL;
+    if (MOSTLY_FALSE(vm->sp >= vm->stackEnd - need)) grow_stack(vm, need);
 
 #if HAVE_GETTIMEOFDAY
     if (stats) {
@@ -1181,6 +1482,9 @@ void Scm_VMFlushFPStack(ScmVM *vm)
     for (int i=0; i<SCM_VM_MAX_VALUES; i++) {
         SCM_FLONUM_ENSURE_MEM(vm->vals[i]);
     }
+    for (int i=SCM_VM_MAX_VALUES; i<vm->numVals-1; i++) {
+        SCM_FLONUM_ENSURE_MEM(vm->xvals[i-SCM_VM_MAX_VALUES]);
+    }
     if (IN_STACK_P(ARGP)) {
         for (ScmObj *p = ARGP; p < SP; p++) SCM_FLONUM_ENSURE_MEM(*p);
     }
@@ -1444,7 +1748,21 @@ void Scm_VMPushCC(ScmCContinuationProc *after,
  *   frame pointer) in cstack.cont.
  */
 
-static ScmObj user_eval_inner(ScmObj program, ScmWord *codevec)
+/* State of Scm_ApplyRecBatch.  INDEX is the call being executed; it is
+   kept in memory so that it survives siglongjmp. */
+typedef struct apply_batch_rec {
+    ScmObj proc;
+    int nargs;
+    int ncalls;
+    int index;
+    ScmObj *argv;
+    ScmObj *results;
+} apply_batch;
+
+/* If BATCH is not NULL, the code vector is run for each call in the
+   batch within a single boundary frame and C stack record. */
+static ScmObj user_eval_inner(ScmObj program, ScmWord *codevec,
+                              apply_batch *batch)
 {
     ScmCStack cstack;
     ScmVM * volatile vm = theVM;
@@ -1476,21 +1794,35 @@ static ScmObj user_eval_inner(ScmObj program, ScmWord *codevec)
   restart:
     vm->escapeReason = SCM_VM_ESCAPE_NONE;
     if (sigsetjmp(cstack.jbuf, FALSE) == 0) {
-        run_loop();             /* VM loop */
-        if (vm->cont == cstack.cont) {
-            POP_CONT();
-            PC = prev_pc;
-        } else if (vm->cont == NULL) {
-            /* we're finished with executing partial continuation.*/
-            vm->cont = cstack.cont;
+        for (;;) {
+            run_loop();         /* VM loop */
+            if (vm->cont == NULL) {
+                /* we're finished with executing partial continuation.*/
+                vm->cont = cstack.cont;
+            } else if (vm->cont != cstack.cont) {
+                /* If we come here, we've been executing a ghost
+                   continuation.  The C world the ghost should return no
+                   longer exists, so we raise an error. */
+                Scm_Error("attempt to return from a ghost continuation.");
+            }
+            if (batch == NULL) break;
+
+            SCM_FLONUM_ENSURE_MEM(vm->val0);
+            batch->results[batch->index] = vm->val0;
+            if (++batch->index >= batch->ncalls) break;
+            /* Rewind to a fresh boundary frame for the next call. */
             POP_CONT();
-            PC = prev_pc;
-        } else {
-            /* If we come here, we've been executing a ghost continuation.
-               The C world the ghost should return no longer exists, so we
-               raise an error. */
-            Scm_Error("attempt to return from a ghost continuation.");
+            CHECK_STACK(CONT_FRAME_SIZE);
+            PUSH_CONT(&boundaryFrameMark);
+            cstack.cont = vm->cont;
+            ScmObj *ap = batch->argv + batch->index * batch->nargs;
+            for (int i=0; i<batch->nargs; i++) vm->vals[i] = ap[i];
+            vm->val0 = batch->proc;
+            vm->base = SCM_COMPILED_CODE(program);
+            PC = codevec;
         }
+        POP_CONT();
+        PC = prev_pc;
     } else {
         /* An escape situation happened. */
         if (vm->escapeReason == SCM_VM_ESCAPE_CONT) {
@@ -1551,7 +1883,7 @@ ScmObj Scm_EvalRec(ScmObj expr, ScmObj e)
     if (SCM_VM_COMPILER_FLAG_IS_SET(theVM, SCM_COMPILE_SHOWRESULT)) {
         Scm_CompiledCodeDump(SCM_COMPILED_CODE(v));
     }
-    return user_eval_inner(v, NULL);
+    return user_eval_inner(v, NULL, NULL);
 }
 
 /* NB: The ApplyRec family can be called in an inner loop (e.g. the display
@@ -1560,8 +1892,43 @@ ScmObj Scm_EvalRec(ScmObj expr, ScmObj e)
    user_eval_inner returns it would never be reused.   However, tools
    that want to keep a pointer to a code vector would need to be aware
    of this case. */
+
+/* A SUBR flagged with SCM_SUBR_LEAF never passes control to the VM
+   (see gauche.h), so we can call it directly, without a boundary frame
+   nor sigsetjmp.  Comparators and hash functions are mostly such SUBRs.
+   We only take this path if the arguments need no folding beyond
+   an empty rest list. */
+static inline int leaf_subr_p(ScmObj proc, int nargs)
+{
+    if (!SCM_SUBRP(proc) || !(SCM_SUBR_FLAGS(proc) & SCM_SUBR_LEAF)) {
+        return FALSE;
+    }
+    int reqargs = SCM_PROCEDURE_REQUIRED(proc);
+    int optargs = SCM_PROCEDURE_OPTIONAL(proc);
+    if (optargs) return (nargs >= reqargs && nargs < reqargs + optargs);
+    else         return (nargs == reqargs);
+}
+
+/* ARGV must have a room for one more element than NARGS. */
+static ScmObj call_leaf_subr(ScmVM *vm, ScmObj proc, ScmObj *argv, int nargs)
+{
+    if (SCM_PROCEDURE_OPTIONAL(proc)) argv[nargs++] = SCM_NIL;
+    SCM_PROF_COUNT_CALL(vm, proc);
+    vm->numVals = 1;
+    ScmObj r = SCM_SUBR_FUNC(proc)(argv, nargs, SCM_SUBR_DATA(proc));
+    SCM_FLONUM_ENSURE_MEM(r);
+    vm->val0 = r;
+    return r;
+}
+
 static ScmObj apply_rec(ScmVM *vm, ScmObj proc, int nargs)
 {
+    if (leaf_subr_p(proc, nargs) && nargs < SCM_VM_MAX_VALUES) {
+        ScmObj argv[SCM_VM_MAX_VALUES+1];
+        for (int i=0; i<nargs; i++) argv[i] = vm->vals[i];
+        return call_leaf_subr(vm, proc, argv, nargs);
+    }
+
     ScmWord code[2];
     code[0] = SCM_WORD(SCM_VM_INSN1(SCM_VM_VALUES_APPLY, nargs));
     code[1] = SCM_WORD(SCM_VM_INSN(SCM_VM_RET));
@@ -1569,7 +1936,7 @@ static ScmObj apply_rec(ScmVM *vm, ScmObj proc, int nargs)
     vm->val0 = proc;
     ScmObj program = vm->base?
             SCM_OBJ(vm->base) : SCM_OBJ(&internal_apply_compiled_code);
-    return user_eval_inner(program, code);
+    return user_eval_inner(program, code, NULL);
 }
 
 ScmObj Scm_ApplyRec(ScmObj proc, ScmObj args)
@@ -1644,6 +2011,51 @@ ScmObj Scm_ApplyRec5(ScmObj proc, ScmObj arg0, ScmObj arg1, ScmObj arg2,
     return apply_rec(vm, proc, 5);
 }
 
+/* Batched callback.  Calls PROC NCALLS times; the i-th call receives
+   NARGS arguments ARGV[i*NARGS] ... ARGV[i*NARGS+NARGS-1], and its
+   primary result is stored to RESULTS[i].  The boundary frame and the
+   C stack record are set up only once for the whole batch, so this is
+   cheaper than calling Scm_ApplyRec repeatedly.  As the ApplyRec family,
+   exceptions are not captured; an error in any call aborts the batch. */
+void Scm_ApplyRecBatch(ScmObj proc, int nargs, int ncalls,
+                       ScmObj *argv, ScmObj *results)
+{
+    ScmVM *vm = theVM;
+
+    if (nargs < 0 || nargs >= SCM_VM_MAX_VALUES) {
+        Scm_Error("Scm_ApplyRecBatch: too many arguments: %d", nargs);
+    }
+    if (ncalls <= 0) return;
+
+    if (leaf_subr_p(proc, nargs)) {
+        ScmObj args[SCM_VM_MAX_VALUES+1];
+        for (int k=0; k<ncalls; k++) {
+            ScmObj *ap = argv + k*nargs;
+            for (int i=0; i<nargs; i++) args[i] = ap[i];
+            results[k] = call_leaf_subr(vm, proc, args, nargs);
+        }
+        return;
+    }
+
+    apply_batch batch;
+    batch.proc = proc;
+    batch.nargs = nargs;
+    batch.ncalls = ncalls;
+    batch.index = 0;
+    batch.argv = argv;
+    batch.results = results;
+
+    ScmWord code[2];
+    code[0] = SCM_WORD(SCM_VM_INSN1(SCM_VM_VALUES_APPLY, nargs));
+    code[1] = SCM_WORD(SCM_VM_INSN(SCM_VM_RET));
+
+    for (int i=0; i<nargs; i++) vm->vals[i] = argv[i];
+    vm->val0 = proc;
+    ScmObj program = vm->base?
+            SCM_OBJ(vm->base) : SCM_OBJ(&internal_apply_compiled_code);
+    user_eval_inner(program, code, &batch);
+}
+
 /*
  * Safe version of user-level Eval, Apply and Load.
  * Exceptions are caught and stored in ScmEvalPacket.
@@ -1716,9 +2128,11 @@ static int safe_eval_wrap(int kind, ScmObj arg0, ScmObj args,
     if (SCM_UNBOUNDP(epak.exception)) {
         /* normal termination */
         if (result) {
-            result->numResults = vm->numVals;
+            int nres = (vm->numVals > SCM_VM_MAX_VALUES)
+                ? SCM_VM_MAX_VALUES : vm->numVals;
+            result->numResults = nres;
             result->results[0] = r;
-            for (int i=1; i<vm->numVals; i++) {
+            for (int i=1; i<nres; i++) {
                 result->results[i] = vm->vals[i-1];
             }
             result->exception = SCM_FALSE;
@@ -1801,6 +2215,13 @@ int check_arglist_tail_for_apply(ScmVM *vm, ScmObj z)
  * Dynamic handlers
  */
 
+/* The continuation frames pushed here live on the VM stack, and are
+   moved to the heap only when a continuation is captured within the
+   extent.  What we allocate per call is just the handler entry.
+   We skip calling the before/after thunks if they're the null procedure,
+   which is common in the C wrapper, and we save multiple values of
+   the body directly in the continuation frame. */
+
 static ScmCContinuationProc dynwind_before_cc;
 static ScmCContinuationProc dynwind_body_cc;
 static ScmCContinuationProc dynwind_after_cc;
@@ -1815,6 +2236,9 @@ ScmObj Scm_VMDynamicWind(ScmObj before, ScmObj body, ScmObj after)
     data[1] = (void*)body;
     data[2] = (void*)after;
 
+    if (SCM_EQ(before, Scm_NullProc())) {
+        return dynwind_before_cc(SCM_UNDEFINED, data);
+    }
     Scm_VMPushCC(dynwind_before_cc, data, 3);
     return Scm_VMApply0(before);
 }
@@ -1830,7 +2254,7 @@ static ScmObj dynwind_before_cc(ScmObj result, void **data)
 
     d[0] = (void*)after;
     d[1] = (void*)prev;
-    vm->handlers = Scm_Cons(Scm_Cons(before, after), prev);
+    vm->handlers = Scm_Acons(before, after, prev);
     Scm_VMPushCC(dynwind_body_cc, d, 2);
     return Scm_VMApply0(body);
 }
@@ -1839,18 +2263,27 @@ static ScmObj dynwind_body_cc(ScmObj result, void **data)
 {
     ScmObj after = SCM_OBJ(data[0]);
     ScmObj prev  = SCM_OBJ(data[1]);
-    void *d[3];
+    void *d[SCM_VM_MAX_VALUES+2];
     ScmVM *vm = theVM;
+    int nvals = vm->numVals;
 
     vm->handlers = prev;
+    /* If there's nothing to do after, the body's results (including
+       vm->vals) are returned as they are. */
+    if (SCM_EQ(after, Scm_NullProc())) return result;
+
     d[0] = (void*)result;
-    d[1] = (void*)(intptr_t)vm->numVals;
-    if (vm->numVals > 1) {
-        ScmObj *array = SCM_NEW_ARRAY(ScmObj, (vm->numVals-1));
-        memcpy(array, vm->vals, sizeof(ScmObj)*(vm->numVals-1));
+    d[1] = (void*)(intptr_t)nvals;
+    if (nvals-1 <= SCM_VM_MAX_VALUES) {
+        for (int i=0; i<nvals-1; i++) d[i+2] = (void*)vm->vals[i];
+        Scm_VMPushCC(dynwind_after_cc, d, (nvals > 1)? nvals+1 : 2);
+    } else {
+        /* Too many to keep in the frame */
+        ScmObj *array = SCM_NEW_ARRAY(ScmObj, nvals-1);
+        for (int i=0; i<nvals-1; i++) array[i] = SCM_VM_VALS_REF(vm, i);
         d[2] = (void*)array;
+        Scm_VMPushCC(dynwind_after_cc, d, 3);
     }
-    Scm_VMPushCC(dynwind_after_cc, d, 3);
     return Scm_VMApply0(after);
 }
 
@@ -1861,26 +2294,55 @@ static ScmObj dynwind_after_cc(ScmObj result, void **data)
     ScmVM *vm = theVM;
 
     vm->numVals = nvals;
-    if (nvals > 1) {
-        SCM_ASSERT(nvals <= SCM_VM_MAX_VALUES);
-        memcpy(vm->vals, data[2], sizeof(ScmObj)*(nvals-1));
+    if (nvals-1 <= SCM_VM_MAX_VALUES) {
+        for (int i=0; i<nvals-1; i++) vm->vals[i] = SCM_OBJ(data[i+2]);
+    } else {
+        ScmObj *array = (ScmObj*)data[2];
+        Scm__VMEnsureValues(vm, nvals);
+        for (int i=0; i<nvals-1; i++) SCM_VM_VALS_SET(vm, i, array[i]);
     }
     return val0;
 }
 
+/* Initializes a subr embedded in another record.  C routines that need
+   a few procedures to put in the dynamic handlers use this to get them
+   with a single allocation. */
+static void init_embedded_subr(ScmSubr *s, ScmSubrProc *func, void *data)
+{
+    SCM_SET_CLASS(s, SCM_CLASS_PROCEDURE);
+    SCM_PROCEDURE_INIT(s, 0, 0, SCM_PROC_SUBR, SCM_FALSE);
+    s->func = func;
+    s->data = data;
+}
+
 /* C-friendly wrapper */
+typedef struct DynWindCRec {
+    ScmSubr before;
+    ScmSubr body;
+    ScmSubr after;
+} DynWindC;
+
 ScmObj Scm_VMDynamicWindC(ScmSubrProc *before,
                           ScmSubrProc *body,
                           ScmSubrProc *after,
                           void *data)
 {
-    ScmObj beforeproc =
-        before ? Scm_MakeSubr(before, data, 0, 0, SCM_FALSE) : Scm_NullProc();
-    ScmObj afterproc =
-        after ? Scm_MakeSubr(after, data, 0, 0, SCM_FALSE) : Scm_NullProc();
-    ScmObj bodyproc =
-        body ? Scm_MakeSubr(body, data, 0, 0, SCM_FALSE) : Scm_NullProc();
+    DynWindC *w = SCM_NEW(DynWindC);
+    ScmObj beforeproc = Scm_NullProc(), bodyproc = Scm_NullProc();
+    ScmObj afterproc = Scm_NullProc();
 
+    if (before) {
+        init_embedded_subr(&w->before, before, data);
+        beforeproc = SCM_OBJ(&w->before);
+    }
+    if (body) {
+        init_embedded_subr(&w->body, body, data);
+        bodyproc = SCM_OBJ(&w->body);
+    }
+    if (after) {
+        init_embedded_subr(&w->after, after, data);
+        afterproc = SCM_OBJ(&w->after);
+    }
     return Scm_VMDynamicWind(beforeproc, bodyproc, afterproc);
 }
 
@@ -1986,7 +2448,8 @@ void Scm_VMDefaultExceptionHandler(ScmObj e)
     if (ep) {
         /* There's an escape point defined by with-error-handler. */
         ScmObj target, current;
-        ScmObj result = SCM_FALSE, rvals[SCM_VM_MAX_VALUES];
+        ScmObj result = SCM_FALSE, rvals_s[SCM_VM_MAX_VALUES];
+        ScmObj *rvals = rvals_s;
         int numVals = 0;
 
         /* To conform SRFI-34, the error handler (clauses in 'guard' form)
@@ -2021,7 +2484,12 @@ void Scm_VMDefaultExceptionHandler(ScmObj e)
         SCM_UNWIND_PROTECT {
             result = Scm_ApplyRec(ep->ehandler, SCM_LIST1(e));
             if ((numVals = vm->numVals) > 1) {
-                for (int i=0; i<numVals-1; i++) rvals[i] = vm->vals[i];
+                if (numVals-1 > SCM_VM_MAX_VALUES) {
+                    rvals = SCM_NEW_ARRAY(ScmObj, numVals-1);
+                }
+                for (int i=0; i<numVals-1; i++) {
+                    rvals[i] = SCM_VM_VALS_REF(vm, i);
+                }
             }
             if (!ep->rewindBefore) {
                 target = ep->handlers;
@@ -2043,7 +2511,8 @@ void Scm_VMDefaultExceptionHandler(ScmObj e)
         SCM_END_PROTECT;
 
         /* Install the continuation */
-        for (int i=0; i<numVals; i++) vm->vals[i] = rvals[i];
+        Scm__VMEnsureValues(vm, numVals);
+        for (int i=0; i<numVals-1; i++) SCM_VM_VALS_SET(vm, i, rvals[i]);
         vm->numVals = numVals;
         vm->val0 = result;
         vm->cont = ep->cont;
@@ -2126,6 +2595,36 @@ static SCM_DEFINE_SUBR(default_exception_handler_rec, 1, 0,
                        SCM_OBJ(&default_exception_handler_name),
                        default_exception_handler_body, NULL, NULL);
 
+/*
+ * Transfer control to the guard handler EP, when the exception is raised
+ * from Scheme (the caller is a subr that returns our value directly to
+ * the VM) and EP belongs to the same VM loop.  Since there's no C code
+ * to skip, we don't need to longjmp; we rewind the dynamic handlers,
+ * replace the continuation with the one of the guard form, and let the
+ * VM call the handler in it.  The result is the same as going through
+ * Scm_VMDefaultExceptionHandler with ep->rewindBefore; only the handler
+ * runs in the current VM loop instead of a nested one.
+ */
+static ScmObj raise_to_guard(ScmVM *vm, ScmEscapePoint *ep, ScmObj e)
+{
+    /* This includes the after thunk of the guard itself, which pops EP
+       from vm->escapePoint.  An error in the after thunks is handled
+       by EP, as in Scm_VMDefaultExceptionHandler. */
+    ScmObj target = ep->handlers;
+    for (ScmObj hp=vm->handlers; SCM_PAIRP(hp) && (hp!=target);
+         hp=SCM_CDR(hp)) {
+        ScmObj proc = SCM_CDAR(hp);
+        vm->handlers = SCM_CDR(hp);
+        Scm_ApplyRec(proc, SCM_NIL);
+    }
+    vm->escapePoint = ep->prev;
+    vm->cont = ep->cont;
+    if (ep->errorReporting) {
+        SCM_VM_RUNTIME_FLAG_SET(vm, SCM_ERROR_BEING_REPORTED);
+    }
+    return Scm_VMApply1(ep->ehandler, e);
+}
+
 /*
  * Entry point of throwing exception.
  *
@@ -2148,6 +2647,16 @@ ScmObj Scm_VMThrowException2(ScmVM *vm, ScmObj exception, u_long raise_flags)
 {
     ScmEscapePoint *ep = vm->escapePoint;
 
+#if defined(GAUCHE_USE_SDT)
+    if (SCM_PROBE_ENABLED(exception__raise)) {
+        ScmObj cname = Scm_ClassOf(exception)->name;
+        SCM_PROBE2(exception__raise,
+                   (SCM_SYMBOLP(cname)
+                    ? Scm_GetStringConst(SCM_SYMBOL_NAME(cname))
+                    : "?"),
+                   exception);
+    }
+#endif /*GAUCHE_USE_SDT*/
     SCM_VM_RUNTIME_FLAG_CLEAR(vm, SCM_ERROR_BEING_HANDLED);
 
     if (vm->exceptionHandler != DEFAULT_EXCEPTION_HANDLER) {
@@ -2171,6 +2680,11 @@ ScmObj Scm_VMThrowException2(ScmVM *vm, ScmObj exception, u_long raise_flags)
                 return Scm_ApplyRec(ep->xhandler, SCM_LIST1(exception));
             }
         }
+        ep = vm->escapePoint;
+    }
+    if ((raise_flags&SCM_RAISE_FROM_VM)
+        && ep && ep->rewindBefore && ep->cstack == vm->cstack) {
+        return raise_to_guard(vm, ep, exception);
     }
     Scm_VMDefaultExceptionHandler(exception);
     /* this never returns */
@@ -2179,7 +2693,21 @@ ScmObj Scm_VMThrowException2(ScmVM *vm, ScmObj exception, u_long raise_flags)
 
 /*
  * with-error-handler
+ *
+ * The escape point and the before/after procedures of its dynamic extent
+ * live in one record, so setting up a handler costs a single allocation
+ * besides the dynamic handler entry.  We don't go through
+ * Scm_VMDynamicWind; the before thunk only sets a few VM fields, so we
+ * do it directly and push a C continuation that undoes it.  The subrs
+ * are still needed in vm->handlers for when the extent is left or
+ * reentered by a continuation.
  */
+typedef struct EHandlerRec {
+    ScmEscapePoint ep;
+    ScmSubr before;             /* install_ehandler */
+    ScmSubr after;              /* discard_ehandler */
+} EHandler;
+
 static ScmObj install_ehandler(ScmObj *args, int nargs, void *data)
 {
     ScmEscapePoint *ep = (ScmEscapePoint*)data;
@@ -2202,10 +2730,20 @@ static ScmObj discard_ehandler(ScmObj *args, int nargs, void *data)
     return SCM_UNDEFINED;
 }
 
+static ScmObj ehandler_body_cc(ScmObj result, void **data)
+{
+    ScmVM *vm = theVM;
+    vm->handlers = SCM_OBJ(data[1]);
+    /* This doesn't touch vm->vals, so multiple values pass through. */
+    discard_ehandler(NULL, 0, data[0]);
+    return result;
+}
+
 static ScmObj with_error_handler(ScmVM *vm, ScmObj handler,
                                  ScmObj thunk, int rewindBefore)
 {
-    ScmEscapePoint *ep = SCM_NEW(ScmEscapePoint);
+    EHandler *eh = SCM_NEW(EHandler);
+    ScmEscapePoint *ep = &eh->ep;
 
     /* NB: we can save pointer to the stack area (vm->cont) to ep->cont,
      * since such ep is always accessible via vm->escapePoint chain and
@@ -2223,12 +2761,18 @@ static ScmObj with_error_handler(ScmVM *vm, ScmObj handler,
         SCM_VM_RUNTIME_FLAG_IS_SET(vm, SCM_ERROR_BEING_REPORTED);
     ep->rewindBefore = rewindBefore;
 
-    vm->escapePoint = ep; /* This will be done in install_ehandler, but
-                             make sure ep is visible from save_cont
-                             to redirect ep->cont */
-    ScmObj before = Scm_MakeSubr(install_ehandler, ep, 0, 0, SCM_FALSE);
-    ScmObj after  = Scm_MakeSubr(discard_ehandler, ep, 0, 0, SCM_FALSE);
-    return Scm_VMDynamicWind(before, thunk, after);
+    init_embedded_subr(&eh->before, install_ehandler, ep);
+    init_embedded_subr(&eh->after, discard_ehandler, ep);
+
+    install_ehandler(NULL, 0, ep);
+    void *data[2];
+    data[0] = ep;
+    data[1] = vm->handlers;
+    vm->handlers = Scm_Cons(Scm_Cons(SCM_OBJ(&eh->before),
+                                     SCM_OBJ(&eh->after)),
+                            vm->handlers);
+    Scm_VMPushCC(ehandler_body_cc, data, 2);
+    return Scm_VMApply0(thunk);
 }
 
 ScmObj Scm_VMWithErrorHandler(ScmObj handler, ScmObj thunk)
@@ -2258,9 +2802,10 @@ static ScmObj install_xhandler(ScmObj *args, int nargs, void *data)
 ScmObj Scm_VMWithExceptionHandler(ScmObj handler, ScmObj thunk)
 {
     ScmObj current = theVM->exceptionHandler;
-    ScmObj before = Scm_MakeSubr(install_xhandler, handler, 0, 0, SCM_FALSE);
-    ScmObj after  = Scm_MakeSubr(install_xhandler, current, 0, 0, SCM_FALSE);
-    return Scm_VMDynamicWind(before, thunk, after);
+    ScmSubr *subrs = SCM_NEW_ARRAY(ScmSubr, 2);
+    init_embedded_subr(&subrs[0], install_xhandler, handler);
+    init_embedded_subr(&subrs[1], install_xhandler, current);
+    return Scm_VMDynamicWind(SCM_OBJ(&subrs[0]), thunk, SCM_OBJ(&subrs[1]));
 }
 
 /*==============================================================
@@ -2346,13 +2891,12 @@ static ScmObj throw_cont_body(ScmObj handlers,    /* after/before thunks
     } else if (nargs < 1) {
         vm->numVals = 0;
         return SCM_UNDEFINED;
-    } else if (nargs >= SCM_VM_MAX_VALUES) {
-        Scm_Error("too many values passed to the continuation");
     }
 
+    Scm__VMEnsureValues(vm, nargs);
     ap = SCM_CDR(args);
     for (int i=0; SCM_PAIRP(ap); i++, ap=SCM_CDR(ap)) {
-        vm->vals[i] = SCM_CAR(ap);
+        SCM_VM_VALS_SET(vm, i, SCM_CAR(ap));
     }
     vm->numVals = nargs;
     return SCM_CAR(args);
@@ -2428,6 +2972,81 @@ ScmObj Scm_VMCallCC(ScmObj proc)
     return Scm_VMApply1(proc, contproc);
 }
 
+/* One-shot continuation
+ *   call/1cc captures an escaping continuation without copying the stack.
+ *   We push a C continuation frame that carries the continuation object,
+ *   and when the continuation is invoked, we look for the frame in the
+ *   current continuation chain.  Frames may have been moved to the heap
+ *   in the meantime, but the chain from vm->cont is always valid.
+ *   If the frame isn't in the chain, the extent of call/1cc has been exited
+ *   and the continuation can't be invoked.  It can be invoked only once,
+ *   and not after call/1cc has returned.
+ */
+typedef struct OneShotContRec {
+    ScmEscapePoint ep;
+    int valid;
+} OneShotCont;
+
+static ScmObj oneshot_cont_cc(ScmObj result, void **data)
+{
+    ((OneShotCont*)data[0])->valid = FALSE;
+    return result;
+}
+
+static ScmContFrame *find_oneshot_frame(ScmVM *vm, OneShotCont *k)
+{
+    for (ScmContFrame *c = vm->cont; c; c = c->prev) {
+        if (C_CONTINUATION_P(c) && c->pc == (ScmWord*)oneshot_cont_cc
+            && (((void**)c) - c->size)[0] == (void*)k) {
+            return c;
+        }
+    }
+    return NULL;
+}
+
+static ScmObj throw_oneshot_continuation(ScmObj *argframe, int nargs,
+                                         void *data)
+{
+    OneShotCont *k = (OneShotCont*)data;
+    ScmVM *vm = theVM;
+
+    ScmContFrame *c = k->valid? find_oneshot_frame(vm, k) : NULL;
+    if (c == NULL) {
+        Scm_Error("one-shot continuation invoked outside of its extent "
+                  "or more than once");
+    }
+    /* If we're going to run dynamic handlers or to rewind the C stack
+       before reaching the target, the frame may be moved in the meantime.
+       Move it to the heap beforehand, so that ep->cont stays valid. */
+    if (k->ep.cstack != vm->cstack || !SCM_EQ(vm->handlers, k->ep.handlers)) {
+        save_cont(vm);
+        c = find_oneshot_frame(vm, k);
+        SCM_ASSERT(c != NULL);
+    }
+    k->valid = FALSE;
+    k->ep.cont = c;
+    return throw_continuation(argframe, nargs, &k->ep);
+}
+
+ScmObj Scm_VMCallOneShotCC(ScmObj proc)
+{
+    ScmVM *vm = theVM;
+    OneShotCont *k = SCM_NEW(OneShotCont);
+    k->ep.prev = NULL;
+    k->ep.ehandler = SCM_FALSE;
+    k->ep.cont = NULL;
+    k->ep.handlers = vm->handlers;
+    k->ep.cstack = vm->cstack;
+    k->valid = TRUE;
+
+    void *data[1];
+    data[0] = k;
+    Scm_VMPushCC(oneshot_cont_cc, data, 1);
+    ScmObj contproc = Scm_MakeSubr(throw_oneshot_continuation, k, 0, 1,
+                                   SCM_MAKE_STR("one-shot continuation"));
+    return Scm_VMApply1(proc, contproc);
+}
+
 /* call with partial continuation.  this corresponds to the 'shift' operator
    in shift/reset controls (Gasbichler&Sperber, "Final Shift for Call/cc",
    ICFP02.)   Note that we treat the boundary frame as the bottom of
@@ -2436,17 +3055,19 @@ ScmObj Scm_VMCallPC(ScmObj proc)
 {
     ScmVM *vm = theVM;
 
-    /* save the continuation.  we only need to save the portion above the
-       latest boundary frame (+environmentns pointed from them), but for now,
-       we save everything to make things easier.  If we want to squeeze
-       performance we'll optimize it later. */
-    save_cont(vm);
-
     /* find the latest boundary frame */
     ScmContFrame *c, *cp;
-    for (c = vm->cont, cp = NULL;
-         c && !BOUNDARY_FRAME_P(c);
-         cp = c, c = c->prev)
+    for (c = vm->cont; c && !BOUNDARY_FRAME_P(c); c = c->prev)
+        /*empty*/;
+
+    /* save the continuation.  we only need to save the portion above the
+       latest boundary frame (+environments pointed from them); the frames
+       below it stay in the stack.  If there's no boundary frame, we've
+       been executing a partial continuation, and we save everything. */
+    save_cont_upto(vm, c);
+
+    /* find the frame right above the boundary in the saved chain */
+    for (cp = NULL, c = vm->cont; c && !BOUNDARY_FRAME_P(c); cp = c, c = c->prev)
         /*empty*/;
 
     if (cp != NULL) cp->prev = NULL; /* cut the dynamic chain */
@@ -2509,15 +3130,52 @@ ScmObj Scm_VMValues(ScmVM *vm, ScmObj args)
     int nvals = 1;
     ScmObj cp;
     SCM_FOR_EACH(cp, SCM_CDR(args)) {
-        vm->vals[nvals-1] = SCM_CAR(cp);
-        if (nvals++ >= SCM_VM_MAX_VALUES) {
-            Scm_Error("too many values: %S", args);
+        if (nvals-1 == SCM_VM_MAX_VALUES) {
+            Scm__VMEnsureValues(vm, nvals + Scm_Length(cp));
         }
+        SCM_VM_VALS_SET(vm, nvals-1, SCM_CAR(cp));
+        nvals++;
     }
     vm->numVals = nvals;
     return SCM_CAR(args);
 }
 
+/*
+ * call-with-values
+ *   The consumer is called directly with the value registers for
+ *   a small number of values, so that we don't need to make a list.
+ */
+static ScmObj call_with_values_cc(ScmObj result, void **data)
+{
+    ScmObj consumer = SCM_OBJ(data[0]);
+    ScmVM *vm = theVM;
+
+    switch (vm->numVals) {
+    case 0: return Scm_VMApply0(consumer);
+    case 1: return Scm_VMApply1(consumer, result);
+    case 2: return Scm_VMApply2(consumer, result, vm->vals[0]);
+    case 3: return Scm_VMApply3(consumer, result, vm->vals[0], vm->vals[1]);
+    case 4: return Scm_VMApply4(consumer, result, vm->vals[0], vm->vals[1],
+                                vm->vals[2]);
+    default: {
+        ScmObj h = SCM_NIL, t = SCM_NIL;
+        SCM_APPEND1(h, t, result);
+        for (int i=0; i<vm->numVals-1; i++) {
+            SCM_APPEND1(h, t, SCM_VM_VALS_REF(vm, i));
+        }
+        return Scm_VMApply(consumer, h);
+    }
+    }
+}
+
+ScmObj Scm_VMCallWithValues(ScmObj producer, ScmObj consumer)
+{
+    void *data[1];
+    data[0] = (void*)consumer;
+    Scm_VMPushCC(call_with_values_cc, data, 1);
+    return Scm_VMApply0(producer);
+}
+
 ScmObj Scm_Values(ScmObj args)
 {
     return Scm_VMValues(theVM, args);
@@ -2609,8 +3267,9 @@ static ScmObj process_queued_requests_cc(ScmObj result, void **data)
     vm->val0 = data[1];
     if (vm->numVals > 1) {
         ScmObj cp = SCM_OBJ(data[2]);
+        Scm__VMEnsureValues(vm, vm->numVals);
         for (int i=0; i<vm->numVals-1; i++) {
-            vm->vals[i] = SCM_CAR(cp);
+            SCM_VM_VALS_SET(vm, i, SCM_CAR(cp));
             cp = SCM_CDR(cp);
         }
     }
@@ -2628,7 +3287,7 @@ static void process_queued_requests(ScmVM *vm)
         ScmObj h = SCM_NIL, t = SCM_NIL;
 
         for (int i=0; i<vm->numVals-1; i++) {
-            SCM_APPEND1(h, t, vm->vals[i]);
+            SCM_APPEND1(h, t, SCM_VM_VALS_REF(vm, i));
         }
         data[2] = h;
     } else {
@@ -2782,7 +3441,7 @@ static ScmObj get_debug_info(ScmCompiledCode *base, SCM_PCTYPE pc)
     }
     int off = (int)(pc - base->code);
     ScmObj ip;
-    SCM_FOR_EACH(ip, base->debugInfo) {
+    SCM_FOR_EACH(ip, Scm_CompiledCodeDebugInfo(base)) {
         ScmObj p = SCM_CAR(ip);
         if (!SCM_PAIRP(p) || !SCM_INTP(SCM_CAR(p))) continue;
         /* PC points to the next instruction,
@@ -2890,9 +3549,11 @@ struct GC_ms_entry *vm_stack_mark(GC_word *addr,
     struct GC_ms_entry *e = mark_sp;
     ScmObj *vmsb = ((ScmObj*)addr)+1;
     ScmVM *vm = (ScmVM*)*addr;
+    /* The stack may have been abandoned by grow_stack. */
+    if (vmsb != vm->stackBase) return e;
     int limit = vm->sp - vm->stackBase + 5;
     void *spb = (void *)vm->stackBase;
-    void *sbe = (void *)(vm->stackBase + SCM_VM_STACK_SIZE);
+    void *sbe = (void *)(vm->stackBase + vm->stackSize);
     void *hb = GC_least_plausible_heap_addr;
     void *he = GC_greatest_plausible_heap_addr;
 
@@ -2934,6 +3595,24 @@ void Scm__InitVM(void)
     Scm_HashCoreInitSimple(&vm_table, SCM_HASH_EQ, 8, NULL);
     SCM_INTERNAL_MUTEX_INIT(vm_table_mutex);
     SCM_INTERNAL_MUTEX_INIT(vm_id_mutex);
+    SCM_INTERNAL_MUTEX_INIT(vm_stack_pool.mutex);
+
+    /* We can't use Scm_GetEnv yet, for the system module isn't
+       initialized at this point. */
+    const char *ss = getenv("GAUCHE_VM_STACK_SIZE");
+    if (ss != NULL) {
+        long n = strtol(ss, NULL, 10);
+        if (n >= SCM_VM_MIN_STACK_SIZE && n <= INT_MAX) {
+            vm_default_stack_size = (int)n;
+        }
+    }
+    const char *ps = getenv("GAUCHE_VM_STACK_POOL_SIZE");
+    if (ps != NULL) {
+        long n = strtol(ps, NULL, 10);
+        if (n >= 0 && n <= INT_MAX) {
+            vm_stack_pool.max = (int)n;
+        }
+    }
 
     /* Create root VM */
     rootVM = Scm_NewVM(NULL, SCM_MAKE_STR_IMMUTABLE("root"));
@@ -2946,6 +3625,9 @@ void Scm__InitVM(void)
         Scm_Panic("pthread_setspecific failed.");
     }
     rootVM->thread = pthread_self();
+#if defined(GAUCHE_HAS_PERF_CURRENT_VM)
+    Scm__PerfCurrentVM = rootVM;
+#endif
 #elif  GAUCHE_USE_WTHREADS
     vm_key = TlsAlloc();
     if (vm_key == TLS_OUT_OF_INDEXES) {
@@ -2960,6 +3642,7 @@ void Scm__InitVM(void)
 #endif  /* no threads */
 
 #ifdef COUNT_INSN_FREQUENCY
+    insn_counting = TRUE;
     Scm_AddCleanupHandler(dump_insn_frequency, NULL);
 #endif /*COUNT_INSN_FREQUENCY*/
 
@@ -203,6 +203,8 @@
         PC = vm->base->code;
         CHECK_STACK(vm->base->maxstack);
         SCM_PROF_COUNT_CALL(vm, SCM_OBJ(vm->base));
+        SCM_PROBE_PROCEDURE(procedure__entry, vm->base);
+        SCM_PERF_MAP_NOTE(vm->base);
         VAL0 = SCM_MAKE_INT(argc); /* keep argc to VAL0. */
         NEXT;
     }
@@ -248,13 +250,39 @@
         }
       GENERIC_ENTRY:
         /* pure generic application.  we implement MOP in C. */
+#if !defined(APPLY_CALL)
+        /* In normal call all args are on the stack, so we can consult
+           the dispatch cache, which already holds sorted methods. */
+        mm = Scm__GenericDispatchCacheLookup(SCM_GENERIC(VAL0), ARGP, argc);
+        if (SCM_FALSEP(mm)) {
+            u_long epoch = Scm__GenericDispatchEpoch();
+            mm = Scm_ComputeApplicableMethods(SCM_GENERIC(VAL0),
+                                              ARGP, argc, FALSE);
+            if (!SCM_NULLP(mm)) {
+                mm = Scm_SortMethods(mm, ARGP, argc);
+                Scm__GenericDispatchCacheStore(SCM_GENERIC(VAL0), ARGP, argc,
+                                               epoch, mm);
+            }
+        }
+        if (!SCM_NULLP(mm)) {
+#if GAUCHE_FFX
+            {
+                ScmObj *ap = ARGP;
+                for (int i=0;i<argc; i++, ap++) SCM_FLONUM_ENSURE_MEM(*ap);
+            }
+#endif /*GAUCHE_FFX*/
+            nm = Scm_MakeNextMethod(SCM_GENERIC(VAL0), SCM_CDR(mm),
+                                    ARGP, argc, TRUE, APP);
+            VAL0 = SCM_CAR(mm);
+            proctype = SCM_PROC_METHOD;
+        }
+#else  /*APPLY_CALL*/
         mm = Scm_ComputeApplicableMethods(SCM_GENERIC(VAL0), ARGP, argc, APP);
         if (!SCM_NULLP(mm)) {
             /* sort methods.  we only need as many args as
                gf->maxReqargs to order methods, so we only unfold that
                many args if applyargs.
             */
-#if defined(APPLY_CALL)
             if (argc-1<SCM_GENERIC(VAL0)->maxReqargs) {
                 ScmObj args;
                 POP_ARG(args);
@@ -267,7 +295,6 @@
                 }
                 PUSH_ARG(args);
             }
-#endif /*APPLY_CALL*/
 #if GAUCHE_FFX
             {
                 ScmObj *ap = ARGP;
@@ -280,6 +307,7 @@
             VAL0 = SCM_CAR(mm);
             proctype = SCM_PROC_METHOD;
         }
+#endif /*APPLY_CALL*/
     } else if (proctype == SCM_PROC_NEXT_METHOD) {
         ScmNextMethod *n = SCM_NEXT_METHOD(VAL0);
         int use_saved_args = FALSE;
@@ -377,6 +405,8 @@
         PC = vm->base->code;
         CHECK_STACK(vm->base->maxstack);
         SCM_PROF_COUNT_CALL(vm, SCM_OBJ(vm->base));
+        SCM_PROBE_PROCEDURE(procedure__entry, vm->base);
+        SCM_PERF_MAP_NOTE(vm->base);
         VAL0 = SCM_MAKE_INT(argc); /* keep argc to VAL0. */
     }
     NEXT;
@@ -272,7 +272,8 @@
 ;;
 ;; ($w/numcmp r op . body)
 ;;   Compare arg (default stack top) and VAL0 with OP, and places the result
-;;   in r.
+;;   in r.  OP is one of =, <, <=, > and >=.  Fixnums and flonums are
+;;   compared inline.
 (define-cise-stmt $w/numcmp
   [(_ r op . body)
    (let ([x (gensym)] [y (gensym)]
@@ -280,14 +281,15 @@
                 [(=) 'Scm_NumEq]
                 [(<) 'Scm_NumLT] [(<=) 'Scm_NumLE]
                 [(>) 'Scm_NumGT] [(>=) 'Scm_NumGE]
-                [else (error "[internal] invalid op for $w/numcmp" op)])])
+                [else (error "[internal] invalid op for $w/numcmp" op)])]
+         [cop (if (eq? op '=) '== op)])
      `($w/argp ,x
         (let* ((,y VAL0) (,r :: int))
           (cond [(and (SCM_INTP ,x) (SCM_INTP ,y))
-                 (set! ,r (,op (cast (signed long) (cast intptr_t ,x))
-                               (cast (signed long) (cast intptr_t ,y))))]
+                 (set! ,r (,cop (cast (signed long) (cast intptr_t ,x))
+                                (cast (signed long) (cast intptr_t ,y))))]
                 [(and (SCM_FLONUMP ,x) (SCM_FLONUMP ,y))
-                 (set! ,r (,op (SCM_FLONUM_VALUE ,x) (SCM_FLONUM_VALUE ,y)))]
+                 (set! ,r (,cop (SCM_FLONUM_VALUE ,x) (SCM_FLONUM_VALUE ,y)))]
                 [else
                  (set! ,r (,cmp ,x ,y))])
           ,@body)))])
@@ -328,11 +330,12 @@
    '(let* ([nargs::int (SCM_VM_INSN_ARG code)]
            [i::int (- nargs 1)]
            [v VAL0])
-      (when (>= nargs SCM_VM_MAX_VALUES) ($vm-err "values got too many args"))
       (VM-ASSERT (<= (- nargs 1) (- SP (-> vm stackBase))))
+      (when (> nargs (+ SCM_VM_MAX_VALUES 1))
+        (Scm__VMEnsureValues vm nargs))
       (when (> nargs 0)
         (for [() (> i 0) (post-- i)]
-             (set! (aref (-> vm vals) (- i 1)) v)
+             (SCM_VM_VALS_SET vm (- i 1) v)
              (POP-ARG v)))
       (set! VAL0 v)
       (set! (-> vm numVals) nargs))])
@@ -554,6 +557,8 @@
     (CHECK-STACK (-> vm base maxstack))
     CHECK-INTR
     (SCM_PROF_COUNT_CALL vm (SCM_OBJ (-> vm base)))
+    (SCM_PROBE_PROCEDURE procedure__entry (-> vm base))
+    (SCM_PERF_MAP_NOTE (-> vm base))
     NEXT))
 
 (define-insn LOCAL-ENV-TAIL-CALL 1 none #f
@@ -589,8 +594,7 @@
 (define-insn BNEQV   0 addr #f ($w/argp z ($branch* (not (Scm_EqvP VAL0 z)))))
 (define-insn BNNULL  0 addr #f ($branch* (not (SCM_NULLP VAL0))))
 
-(define-insn BNUMNE  0 addr #f (let* ((y VAL0))
-                                 ($w/argp x ($branch* (not (Scm_NumEq x y))))))
+(define-insn BNUMNE  0 addr #f ($w/numcmp r =  ($branch* (not r))))
 (define-insn BNLT    0 addr #f ($w/numcmp r <  ($branch* (not r))))
 (define-insn BNLE    0 addr #f ($w/numcmp r <= ($branch* (not r))))
 (define-insn BNGT    0 addr #f ($w/numcmp r >  ($branch* (not r))))
@@ -658,10 +662,10 @@
              (SCM_APPEND1 rest tail VAL0)
              (post++ i)])
       (for [() (< i reqargs) (post++ i)]
-           (PUSH-ARG (aref (-> vm vals) (- i 1))))
+           (PUSH-ARG (SCM_VM_VALS_REF vm (- i 1))))
       (when restarg
         (for [() (< i (-> vm numVals)) (post++ i)]
-             (SCM_APPEND1 rest tail (aref (-> vm vals) (- i 1))))
+             (SCM_APPEND1 rest tail (SCM_VM_VALS_REF vm (- i 1))))
         (PUSH-ARG rest))
       (FINISH-ENV SCM_FALSE ENV)
       (set! (-> vm numVals) 1) ; we already processed extra vals, so reset it
@@ -707,10 +711,12 @@
 ;; TAIL-RECEIVE-ALL
 ;;  Tail version of RECEIVE-ALL.
 (define-insn TAIL-RECEIVE-ALL 0 none #f
-  (begin (CHECK-STACK-PARANOIA (ENV-SIZE (+ (-> vm numVals) 1)))
+  (begin (if (> (-> vm numVals) SCM_VM_MAX_VALUES)
+           (CHECK-STACK (ENV-SIZE (+ (-> vm numVals) 1)))
+           (CHECK-STACK-PARANOIA (ENV-SIZE (+ (-> vm numVals) 1))))
          (PUSH-ARG VAL0)
          (dotimes [i (- (-> vm numVals) 1)]
-           (PUSH-ARG (aref (-> vm vals) i)))
+           (PUSH-ARG (SCM_VM_VALS_REF vm i)))
          (FINISH-ENV SCM_FALSE ENV)
          NEXT))
 
@@ -723,8 +729,10 @@
     (VM-ASSERT ENV)
     (let* ([nvals::int (cast int (-> ENV size))] [v])
       (set! (-> vm numVals) nvals)
+      (Scm__VMEnsureValues vm nvals)
       (for [() (> nvals 1) (post-- nvals)]
-           (POP-ARG (aref (-> vm vals) (- nvals 1))))
+           (POP-ARG v)
+           (SCM_VM_VALS_SET vm (- nvals 2) v))
       (POP-ARG VAL0)
       NEXT)))
 
@@ -747,6 +755,26 @@
     (set! (-> vm numVals) 1)
     NEXT))
 
+;; LSET-UNBOXED(depth, offset)
+;;  Local set to a mutable variable that isn't captured by closures,
+;;  hence the compiler didn't box it.  While the target frame is in
+;;  the stack we can keep a flonum register in it, for the frame is
+;;  scanned by Scm_VMFlushFPStack and save_env.
+(define-insn LSET-UNBOXED 2 none #f
+  (let* ([dep::int (SCM_VM_INSN_ARG0 code)]
+         [off::int (SCM_VM_INSN_ARG1 code)]
+         [e::ScmEnvFrame* ENV])
+    (for [() (> dep 0) (post-- dep)]
+         (VM-ASSERT (!= e NULL))
+         (set! e (-> e up)))
+    (VM-ASSERT (!= e NULL))
+    (VM-ASSERT (> (-> e size) off))
+    (unless (IN_STACK_P (cast ScmObj* e))
+      (SCM_FLONUM_ENSURE_MEM VAL0))
+    (set! (ENV-DATA e off) VAL0)
+    (set! (-> vm numVals) 1)
+    NEXT))
+
 ;; GSET <location>
 ;;  LOCATION may be a symbol or gloc
 ;;
@@ -900,6 +928,15 @@
 (define-insn CDR-PUSH    0 none   (CDR PUSH))
 (define-insn-lref+ LREF-CDR 0 none (LREF CDR))
 
+;; Unchecked CAR and CDR.  The compiler emits these only when it has
+;; proven the argument is a pair (see pass3/infer-types).
+(define-insn CAR-UNSAFE  0 none #f ($w/argr v ($result (SCM_CAR v))))
+(define-insn CAR-UNSAFE-PUSH 0 none (CAR-UNSAFE PUSH))
+(define-insn LREF-CAR-UNSAFE 2 none (LREF CAR-UNSAFE) #f :fold-lref)
+(define-insn CDR-UNSAFE  0 none #f ($w/argr v ($result (SCM_CDR v))))
+(define-insn CDR-UNSAFE-PUSH 0 none (CDR-UNSAFE PUSH))
+(define-insn LREF-CDR-UNSAFE 2 none (LREF CDR-UNSAFE) #f :fold-lref)
+
 (define-cise-stmt $cxxr
   [(_ a b)
    `($w/argr obj
@@ -1113,6 +1150,23 @@
       (set! (SCM_VECTOR_ELEMENT vec k) v)
       ($result SCM_UNDEFINED))))
 
+;; Unchecked VEC-REF and VEC-SET.  The compiler emits these only when
+;; it has proven the vector is a vector and the index is a fixnum within
+;; its range (see pass3/infer-types).
+(define-insn VEC-REF-UNSAFE 0 none #f
+  (let* ([k VAL0])
+    ($w/argp vec
+      ($result (SCM_VECTOR_ELEMENT vec (SCM_INT_VALUE k))))))
+
+(define-insn VEC-SET-UNSAFE 0 none #f
+  (let* ([vec] [ind])
+    (POP-ARG ind)
+    (POP-ARG vec)
+    (let* ([v VAL0])
+      (SCM_FLONUM_ENSURE_MEM v)
+      (set! (SCM_VECTOR_ELEMENT vec (SCM_INT_VALUE ind)) v)
+      ($result SCM_UNDEFINED))))
+
 ;; VEC-REF and VEC-SET with immediate index.  VAL0 must be a vector.
 (define-insn VEC-REFI    1 none #f
   ($w/argr vec
@@ -1190,13 +1244,22 @@
 
 (define-insn NUMMUL2 0 none #f          ; *
   ($w/argp arg
-    ;; we take a shortcut if either one is flonum and the
-    ;; other is real.  (if both are integers, the overflow check
-    ;; would be cumbersome so we just call Scm_Mul).
-    (if (or (and (SCM_FLONUMP arg) (SCM_REALP VAL0))
-            (and (SCM_FLONUMP VAL0) (SCM_REALP arg)))
-      ($result:f (* (Scm_GetDouble arg) (Scm_GetDouble VAL0)))
-      ($result (Scm_Mul arg VAL0)))))
+    ;; we take a shortcut if both are fixnums and the result doesn't
+    ;; overflow, or either one is flonum and the other is real.
+    (cond
+     [(and (SCM_INTP arg) (SCM_INTP VAL0))
+      (let* ([x::long (SCM_INT_VALUE arg)]
+             [y::long (SCM_INT_VALUE VAL0)]
+             [r::long 0]
+             [v::int 0])
+        (SMULOV r v x y)
+        (if v
+          ($result (Scm_Mul arg VAL0))
+          ($result:n r)))]
+     [(or (and (SCM_FLONUMP arg) (SCM_REALP VAL0))
+          (and (SCM_FLONUMP VAL0) (SCM_REALP arg)))
+      ($result:f (* (Scm_GetDouble arg) (Scm_GetDouble VAL0)))]
+     [else ($result (Scm_Mul arg VAL0))])))
 
 (define-insn NUMDIV2 0 none #f          ; / (binary)
   ($w/argp arg
@@ -1207,6 +1270,14 @@
 
 (define-insn LREF-VAL0-NUMADD2 2 none #f ($arg-source lref ($insn-body NUMADD2)))
 
+;; Arithmetic results are often pushed right away, as the arguments of
+;; a call or of a loop, e.g. (loop (+ i 1) (* a b)).  These save the
+;; dispatch of PUSH.
+(define-insn NUMADD2-PUSH 0 none (NUMADD2 PUSH))
+(define-insn NUMSUB2-PUSH 0 none (NUMSUB2 PUSH))
+(define-insn NUMMUL2-PUSH 0 none (NUMMUL2 PUSH))
+(define-insn LREF-VAL0-NUMADD2-PUSH 2 none (LREF-VAL0-NUMADD2 PUSH))
+
 (define-insn NEGATE  0 none #f          ; -  (unary)
   ($w/argr v
     (cond
@@ -1247,6 +1318,7 @@
              ($result:f (+ (SCM_FLONUM_VALUE arg) (cast double imm)))]
             [else           ($result (Scm_Add (SCM_MAKE_INT imm) arg))]))))
 
+(define-insn NUMADDI-PUSH 1 none (NUMADDI PUSH))
 (define-insn-lref+ LREF-NUMADDI 1 none (LREF NUMADDI))
 (define-insn-lref+ LREF-NUMADDI-PUSH 1 none (LREF NUMADDI PUSH))
 
@@ -1285,7 +1357,9 @@
           [else
            (set! port SCM_CURIN)])
     (set! ch (Scm_Getc port))
-    ($result (?: (< ch 0) SCM_EOF (SCM_MAKE_CHAR ch)))))
+    ($result (?: (< ch 0)
+                 (?: (SCM_PORT_WOULDBLOCK_P port) SCM_FALSE SCM_EOF)
+                 (SCM_MAKE_CHAR ch)))))
 
 (define-insn PEEK-CHAR   1 none #f      ; peek-char
   (let* ([nargs::int (SCM_VM_INSN_ARG code)] [ch::int 0] [port::ScmPort*])
@@ -1295,7 +1369,9 @@
           [else
            (set! port SCM_CURIN)])
     (set! ch (Scm_Peekc port))
-    ($result (?: (< ch 0) SCM_EOF (SCM_MAKE_CHAR ch)))))
+    ($result (?: (< ch 0)
+                 (?: (SCM_PORT_WOULDBLOCK_P port) SCM_FALSE SCM_EOF)
+                 (SCM_MAKE_CHAR ch)))))
 
 (define-insn WRITE-CHAR  1 none #f      ; write-char
   (let* ([nargs::int (SCM_VM_INSN_ARG code)] [ch] [port::ScmPort*])
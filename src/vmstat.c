@@ -33,8 +33,23 @@
 
 /* This file is included from vm.c */
 
-#ifdef COUNT_INSN_FREQUENCY
-/* for statistics */
+/* Instruction frequency counting.
+
+   run_loop has a second dispatch table whose entries all jump to the
+   code that updates the counters below and then goes on to the real
+   instruction handler.  While counting is off the ordinary table is
+   used, so there's no cost.  run_loop picks up the table when it's
+   entered and whenever it handles the attention request, so switching
+   takes effect on the current VM immediately, and on other threads
+   when their VM loops get to it.  The counters are shared among
+   threads and are not locked, so the numbers can be slightly off when
+   multiple threads are counting.
+
+   If COUNT_INSN_FREQUENCY is defined in vm.c, counting is turned on
+   from the start and the result is dumped at exit.
+*/
+static int insn_counting = FALSE;
+
 static u_long insn1_freq[SCM_VM_NUM_INSNS];
 static u_long insn2_freq[SCM_VM_NUM_INSNS][SCM_VM_NUM_INSNS];
 
@@ -42,24 +57,23 @@ static u_long insn2_freq[SCM_VM_NUM_INSNS][SCM_VM_NUM_INSNS];
 static u_long lref_freq[LREF_FREQ_COUNT_MAX][LREF_FREQ_COUNT_MAX];
 static u_long lset_freq[LREF_FREQ_COUNT_MAX][LREF_FREQ_COUNT_MAX];
 
-static ScmWord fetch_insn_counting(ScmVM *vm, ScmWord code)
+/* PREV is the previously executed instruction, or -1 */
+static inline void count_insn(int prev, ScmWord code)
 {
-    if (vm->base && vm->pc != vm->base->code) {
-        insn2_freq[SCM_VM_INSN_CODE(code)][SCM_VM_INSN_CODE(*vm->pc)]++;
-    }
-    code = *vm->pc++;
-    insn1_freq[SCM_VM_INSN_CODE(code)]++;
-    switch (SCM_VM_INSN_CODE(code)) {
-    case SCM_VM_LREF0: lref_freq[0][0]++; break;
-    case SCM_VM_LREF1: lref_freq[0][1]++; break;
-    case SCM_VM_LREF2: lref_freq[0][2]++; break;
-    case SCM_VM_LREF3: lref_freq[0][3]++; break;
-    case SCM_VM_LREF4: lref_freq[0][4]++; break;
+    int c = SCM_VM_INSN_CODE(code);
+    if (prev >= 0) insn2_freq[prev][c]++;
+    insn1_freq[c]++;
+    switch (c) {
+    case SCM_VM_LREF0:  lref_freq[0][0]++; break;
+    case SCM_VM_LREF1:  lref_freq[0][1]++; break;
+    case SCM_VM_LREF2:  lref_freq[0][2]++; break;
+    case SCM_VM_LREF3:  lref_freq[0][3]++; break;
     case SCM_VM_LREF10: lref_freq[1][0]++; break;
     case SCM_VM_LREF11: lref_freq[1][1]++; break;
     case SCM_VM_LREF12: lref_freq[1][2]++; break;
-    case SCM_VM_LREF13: lref_freq[1][3]++; break;
-    case SCM_VM_LREF14: lref_freq[1][4]++; break;
+    case SCM_VM_LREF20: lref_freq[2][0]++; break;
+    case SCM_VM_LREF21: lref_freq[2][1]++; break;
+    case SCM_VM_LREF30: lref_freq[3][0]++; break;
     case SCM_VM_LREF:
     {
         int dep = SCM_VM_INSN_ARG0(code);
@@ -69,11 +83,6 @@ static ScmWord fetch_insn_counting(ScmVM *vm, ScmWord code)
         lref_freq[dep][off]++;
         break;
     }
-    case SCM_VM_LSET0: lset_freq[0][0]++; break;
-    case SCM_VM_LSET1: lset_freq[0][1]++; break;
-    case SCM_VM_LSET2: lset_freq[0][2]++; break;
-    case SCM_VM_LSET3: lset_freq[0][3]++; break;
-    case SCM_VM_LSET4: lset_freq[0][4]++; break;
     case SCM_VM_LSET:
     {
         int dep = SCM_VM_INSN_ARG0(code);
@@ -84,16 +93,86 @@ static ScmWord fetch_insn_counting(ScmVM *vm, ScmWord code)
         break;
     }
     }
-    return code;
 }
 
+void Scm_VMInsnStatStart(void)
+{
+    insn_counting = TRUE;
+    Scm_VM()->attentionRequest = TRUE; /* let run_loop switch the table */
+}
+
+void Scm_VMInsnStatStop(void)
+{
+    insn_counting = FALSE;
+    Scm_VM()->attentionRequest = TRUE;
+}
+
+void Scm_VMInsnStatReset(void)
+{
+    memset(insn1_freq, 0, sizeof(insn1_freq));
+    memset(insn2_freq, 0, sizeof(insn2_freq));
+    memset(lref_freq, 0, sizeof(lref_freq));
+    memset(lset_freq, 0, sizeof(lset_freq));
+}
+
+static ScmObj insn_name(int code)
+{
+    return SCM_INTERN(Scm_VMInsnName(code));
+}
+
+static ScmObj freq_matrix(u_long (*freq)[LREF_FREQ_COUNT_MAX])
+{
+    ScmObj m = Scm_MakeVector(LREF_FREQ_COUNT_MAX, SCM_FALSE);
+    for (int i=0; i<LREF_FREQ_COUNT_MAX; i++) {
+        ScmObj row = Scm_MakeVector(LREF_FREQ_COUNT_MAX, SCM_FALSE);
+        for (int j=0; j<LREF_FREQ_COUNT_MAX; j++) {
+            SCM_VECTOR_ELEMENT(row, j) = Scm_MakeIntegerU(freq[i][j]);
+        }
+        SCM_VECTOR_ELEMENT(m, i) = row;
+    }
+    return m;
+}
+
+/* Returns the counts so far, as
+   (:instructions ((insn . count) ...)
+    :pairs (((insn1 . insn2) . count) ...)
+    :lref #(#(count ...) ...)
+    :lset #(#(count ...) ...))
+   The first two only include instructions (and pairs) seen at least
+   once; vm-insn-stat sorts them.  In :pairs, insn2 is the one
+   executed right after insn1.  Element [depth][offset] of :lref
+   and :lset are the counts of local variable references and
+   assignments; the last row and column gather greater depths and
+   offsets. */
+ScmObj Scm_VMInsnStat(void)
+{
+    ScmObj insns = SCM_NIL, pairs = SCM_NIL;
+    for (int i=0; i<SCM_VM_NUM_INSNS; i++) {
+        if (insn1_freq[i] == 0) continue;
+        insns = Scm_Acons(insn_name(i), Scm_MakeIntegerU(insn1_freq[i]),
+                          insns);
+        for (int j=0; j<SCM_VM_NUM_INSNS; j++) {
+            if (insn2_freq[i][j] == 0) continue;
+            pairs = Scm_Acons(Scm_Cons(insn_name(i), insn_name(j)),
+                              Scm_MakeIntegerU(insn2_freq[i][j]),
+                              pairs);
+        }
+    }
+    return Scm_List(SCM_MAKE_KEYWORD("instructions"), insns,
+                    SCM_MAKE_KEYWORD("pairs"), pairs,
+                    SCM_MAKE_KEYWORD("lref"), freq_matrix(lref_freq),
+                    SCM_MAKE_KEYWORD("lset"), freq_matrix(lset_freq),
+                    NULL);
+}
+
+#ifdef COUNT_INSN_FREQUENCY
 static void dump_insn_frequency(void *data)
 {
     Scm_Printf(SCM_CUROUT, "(:instruction-frequencies (");
     for (int i=0; i<SCM_VM_NUM_INSNS; i++) {
-        Scm_Printf(SCM_CUROUT, "(%s %d", Scm_VMInsnName(i), insn1_freq[i]);
+        Scm_Printf(SCM_CUROUT, "(%s %lu", Scm_VMInsnName(i), insn1_freq[i]);
         for (int j=0; j<SCM_VM_NUM_INSNS; j++) {
-            Scm_Printf(SCM_CUROUT, " %d", insn2_freq[i][j]);
+            Scm_Printf(SCM_CUROUT, " %lu", insn2_freq[i][j]);
         }
         Scm_Printf(SCM_CUROUT, ")\n");
     }
@@ -101,7 +180,7 @@ static void dump_insn_frequency(void *data)
     for (int i=0; i<LREF_FREQ_COUNT_MAX; i++) {
         Scm_Printf(SCM_CUROUT, "(");
         for (int j=0; j<LREF_FREQ_COUNT_MAX; j++) {
-            Scm_Printf(SCM_CUROUT, "%d ", lref_freq[i][j]);
+            Scm_Printf(SCM_CUROUT, "%lu ", lref_freq[i][j]);
         }
         Scm_Printf(SCM_CUROUT, ")\n");
     }
@@ -109,12 +188,11 @@ static void dump_insn_frequency(void *data)
     for (int i=0; i<LREF_FREQ_COUNT_MAX; i++) {
         Scm_Printf(SCM_CUROUT, "(");
         for (int j=0; j<LREF_FREQ_COUNT_MAX; j++) {
-            Scm_Printf(SCM_CUROUT, "%d ", lset_freq[i][j]);
+            Scm_Printf(SCM_CUROUT, "%lu ", lset_freq[i][j]);
         }
         Scm_Printf(SCM_CUROUT, ")\n");
     }
     Scm_Printf(SCM_CUROUT, ")\n");
     Scm_Printf(SCM_CUROUT, ")\n");
 }
-
 #endif /*COUNT_INSN_FREQUENCY*/
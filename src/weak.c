@@ -184,6 +184,15 @@ void Scm_WeakBoxSet(ScmWeakBox *wbox, void *newvalue)
     wbox_setvalue(wbox, newvalue);
 }
 
+/* For the weak hash table.  Returns the target and sets *GONE if it has
+   been GCed, with the same caveat as Scm_WeakBoxRef. */
+static inline void *wbox_ref(ScmWeakBox *wbox, int *gone)
+{
+    void *p = wbox->ptr;
+    *gone = (wbox->registered && p == NULL);
+    return p;
+}
+
 void *Scm_WeakBoxRef(ScmWeakBox *wbox)
 {
     return wbox->ptr;           /* NB: if NULL is retured, you can't know
@@ -212,8 +221,18 @@ void *Scm_WeakBoxRef(ScmWeakBox *wbox)
  * If a key is GC-ed, the entry becomes inaccessible---from outside it
  * looks as if the entry is deleted.  We don't immediately delete the entry
  * at the time we found its key has been GC-ed, since the caller may not
- * expect the table is modified.  Instead we flag the table and delete
- * those entries when the table is modified.
+ * expect the table is modified.  Instead, when the table is modified
+ * and a GC has happened since the last sweep, we sweep a few buckets
+ * for such entries (weak_hash_cleanup).  The cost of cleanup is thus
+ * spread over modifications, and we don't bother if no GC has run.
+ * The table may be modified while an iterator is on it; the swept
+ * entries are only the ones the iterator skips anyway, and they keep
+ * their link to the chain (see Scm_HashCoreSweep).
+ *
+ * For the key-weak table, the hash core keeps a weak box in the key of
+ * each entry, while Scm_HashCoreSearch is always called with the real
+ * key.  So the hash function sees the real key, while the compare
+ * function unwraps the entry key.
  */
 
 #define MARK_GONE_ENTRY(ht, e)  (ht->goneEntries++)
@@ -241,43 +260,55 @@ SCM_DEFINE_BUILTIN_CLASS(Scm_WeakHashTableClass, weakhash_print,
                          SCM_CLASS_DICTIONARY_CPL);
 
 /* Custom hasher & comparer for key-weak table, in which we insert
-   one indirection to the real key via WeakBox. */
+   one indirection to the real key via WeakBox.  The entry's hash value
+   is kept in the hash core, so the hasher is only called with the key
+   given to Scm_HashCoreSearch. */
 static u_long weak_key_hash(const ScmHashCore *hc, intptr_t key)
 {
     ScmWeakHashTable *wh = SCM_WEAK_HASH_TABLE(hc->data);
-    ScmWeakBox *box = (ScmWeakBox *)key;
-    intptr_t realkey = (intptr_t)Scm_WeakBoxRef(box);
-    if (Scm_WeakBoxEmptyP(box)) {
-        /* There IS a small possibility that the real key has already been
-           GCed.  We return an arbitrary value (0 here); the entry won't
-           match anyway. */
-        return 0;
-    } else {
-        u_long k= wh->hashfn(hc, realkey);
-        return k;
-    }
+    return wh->hashfn(hc, key);
 }
 
-
 static int weak_key_compare(const ScmHashCore *hc, intptr_t key,
                             intptr_t entrykey)
 {
     ScmWeakHashTable *wh = SCM_WEAK_HASH_TABLE(hc->data);
-    ScmWeakBox *box = (ScmWeakBox *)entrykey;
-    intptr_t realkey = (intptr_t)Scm_WeakBoxRef(box);
-    if (Scm_WeakBoxEmptyP(box)) {
+    int gone;
+    intptr_t realkey = (intptr_t)wbox_ref((ScmWeakBox *)entrykey, &gone);
+    if (gone) {
+        MARK_GONE_ENTRY(wh, entrykey);
         return FALSE;
     } else {
         return wh->cmpfn(hc, key, realkey);
     }
 }
 
-/* Scan through  */
-#if 0
+/* # of buckets to sweep per modification of the table. */
+#define WEAK_SWEEP_STEP  32
+
+static int weak_key_gone_p(ScmDictEntry *e, void *data)
+{
+    return Scm_WeakBoxEmptyP((ScmWeakBox*)e->key);
+}
+
+/* Sweep some buckets for entries whose key has been GCed.  We start
+   a new round of sweep only when a GC has happened since the last one
+   started; until then no more keys can have gone. */
 static void weak_hash_cleanup(ScmWeakHashTable *wh)
 {
+    if (!(wh->weakness & SCM_WEAK_KEY)) return;
+    if (wh->sweepCursor < 0) {
+        u_long gcno = (u_long)GC_get_gc_no();
+        if (gcno == wh->sweepGC) return;
+        wh->sweepGC = gcno;
+        wh->sweepCursor = 0;
+    }
+    if (Scm_HashCoreSweep(SCM_WEAK_HASH_TABLE_CORE(wh), weak_key_gone_p,
+                          NULL, &wh->sweepCursor, WEAK_SWEEP_STEP)) {
+        wh->sweepCursor = -1;
+        wh->goneEntries = 0;
+    }
 }
-#endif
 
 
 ScmObj Scm_MakeWeakHashTableSimple(ScmHashType type,
@@ -291,6 +322,8 @@ ScmObj Scm_MakeWeakHashTableSimple(ScmHashType type,
     wh->type = type;
     wh->defaultValue = defaultValue;
     wh->goneEntries = 0;
+    wh->sweepGC = (u_long)GC_get_gc_no();
+    wh->sweepCursor = -1;
 
     if (weakness & SCM_WEAK_KEY) {
         if (!Scm_HashCoreTypeToProcs(type, &wh->hashfn, &wh->cmpfn)) {
@@ -315,6 +348,8 @@ ScmObj Scm_WeakHashTableCopy(ScmWeakHashTable *src)
     wh->hashfn = src->hashfn;
     wh->cmpfn = src->cmpfn;
     wh->goneEntries = 0;
+    wh->sweepGC = src->sweepGC;
+    wh->sweepCursor = -1;
     Scm_HashCoreCopy(&wh->core, &src->core);
     return SCM_OBJ(wh);
 }
@@ -325,8 +360,9 @@ ScmObj Scm_WeakHashTableRef(ScmWeakHashTable *ht, ScmObj key, ScmObj fallback)
                                          (intptr_t)key, SCM_DICT_GET);
     if (!e) return fallback;
     if (ht->weakness & SCM_WEAK_VALUE) {
-        void *val = Scm_WeakBoxRef((ScmWeakBox*)e->value);
-        if (Scm_WeakBoxEmptyP((ScmWeakBox*)e->value)) return ht->defaultValue;
+        int gone;
+        void *val = wbox_ref((ScmWeakBox*)e->value, &gone);
+        if (gone) return ht->defaultValue;
         SCM_ASSERT(val != NULL);
         return SCM_OBJ(val);
     } else {
@@ -337,18 +373,19 @@ ScmObj Scm_WeakHashTableRef(ScmWeakHashTable *ht, ScmObj key, ScmObj fallback)
 ScmObj Scm_WeakHashTableSet(ScmWeakHashTable *ht, ScmObj key, ScmObj value,
                             int flags)
 {
-    intptr_t proxy;
-
-    if (ht->weakness&SCM_WEAK_KEY) {
-        proxy = (intptr_t)Scm_MakeWeakBox(key);
-    } else {
-        proxy = (intptr_t)key;
-    }
+    weak_hash_cleanup(ht);
 
     ScmDictEntry *e = Scm_HashCoreSearch(
-        SCM_WEAK_HASH_TABLE_CORE(ht), proxy,
+        SCM_WEAK_HASH_TABLE_CORE(ht), (intptr_t)key,
         (flags&SCM_DICT_NO_CREATE)?SCM_DICT_GET:SCM_DICT_CREATE);
     if (!e) return SCM_UNBOUND;
+    /* A new entry has the real key; replace it with the weak box.
+       Existing entries always have a box. */
+    if ((ht->weakness&SCM_WEAK_KEY) && e->key == (intptr_t)key) {
+        /* The key is const to the users of the hash core; we're its
+           owner here, and the hash value stays the same. */
+        *(intptr_t*)&e->key = (intptr_t)Scm_MakeWeakBox(key);
+    }
     if (ht->weakness&SCM_WEAK_VALUE) {
         if (flags&SCM_DICT_NO_OVERWRITE) {
             if (e->value) {
@@ -370,6 +407,7 @@ ScmObj Scm_WeakHashTableSet(ScmWeakHashTable *ht, ScmObj key, ScmObj value,
 
 ScmObj Scm_WeakHashTableDelete(ScmWeakHashTable *ht, ScmObj key)
 {
+    weak_hash_cleanup(ht);
     ScmDictEntry *e = Scm_HashCoreSearch(SCM_WEAK_HASH_TABLE_CORE(ht),
                                          (intptr_t)key, SCM_DICT_DELETE);
     if (e && e->value) {
@@ -460,6 +460,13 @@ ScmObj Scm__WritePrimitive(ScmObj obj, ScmPort *port, ScmWriteContext *ctx)
         if (wp->printRadix) fmt.flags |= SCM_NUMBER_FORMAT_ALT_RADIX;
         return SCM_MAKE_INT(Scm_PrintNumber(port, obj, &fmt));
     }
+    else if (SCM_STRING_CURSOR_SMALL_P(obj)) {
+        char buf[SPBUFSIZ];
+        int k = snprintf(buf, SPBUFSIZ, "#<string-cursor %ld>",
+                         SCM_STRING_CURSOR_SMALL_OFFSET(obj));
+        Scm_PutzUnsafe(buf, -1, port);
+        return SCM_MAKE_INT(k);
+    }
     /* PVREF only appears in pattern temlate in the current macro expander.
        It will be go away once we rewrite the expander. */
     else if (SCM_PVREF_P(obj)) {
@@ -762,6 +769,72 @@ static void write_rec(ScmObj obj, ScmPort *port, ScmWriteContext *ctx)
 #undef CHECK_DEPTH
 }
 
+/* Quick acyclicity check.
+   When we're writing in circular-only mode (i.e. plain 'write'), the walk
+   pass is needed only to find cycles, yet it traverses the whole graph
+   in Scheme and records every aggregate in the hash table.  Most data
+   written out are freshly built trees, for which that's wasted work.
+   So we first traverse the structure in C, without allocation.  Cdr chains
+   are followed with tortoise-and-hare, so a circular list is noticed
+   early.  Cars and vector elements are recursed into, up to
+   ACYCLIC_CHECK_DEPTH.  We give up if we see anything other than pairs,
+   vectors and simple leaves (other objects may have write-object methods
+   that recurse), if the nesting is too deep, or if we've visited
+   ACYCLIC_CHECK_BUDGET nodes (shared substructures are visited each time
+   they are referenced, so a dag can be exponentially large when unfolded).
+   Returns TRUE only if the structure is known to be acyclic; FALSE just
+   means we don't know, and the caller falls back to the full walk. */
+#define ACYCLIC_CHECK_DEPTH   256
+#define ACYCLIC_CHECK_BUDGET  (1L<<25)
+
+#define ACYCLIC_LEAF_P(obj)                                             \
+    (!SCM_PTRP(obj) || SCM_NUMBERP(obj) || SCM_STRINGP(obj)             \
+     || SCM_SYMBOLP(obj) || SCM_KEYWORDP(obj))
+
+static int acyclic_check_rec(ScmObj obj, int depth, long *budget)
+{
+    for (;;) {
+        if (ACYCLIC_LEAF_P(obj)) return TRUE;
+        if (depth >= ACYCLIC_CHECK_DEPTH) return FALSE;
+        if (SCM_PAIRP(obj)) {
+            ScmObj slow = obj;
+            int step = FALSE;
+            do {
+                if (--*budget < 0) return FALSE;
+                ScmObj car = SCM_CAR(obj);
+                if (!ACYCLIC_LEAF_P(car)
+                    && !acyclic_check_rec(car, depth+1, budget)) {
+                    return FALSE;
+                }
+                obj = SCM_CDR(obj);
+                if (step) slow = SCM_CDR(slow);
+                step = !step;
+                if (SCM_EQ(obj, slow)) return FALSE;
+            } while (SCM_PAIRP(obj));
+            continue;           /* check the tail of improper list */
+        }
+        if (SCM_VECTORP(obj)) {
+            int len = SCM_VECTOR_SIZE(obj);
+            if ((*budget -= len) < 0) return FALSE;
+            for (int i = 0; i < len; i++) {
+                ScmObj e = SCM_VECTOR_ELEMENT(obj, i);
+                if (!ACYCLIC_LEAF_P(e)
+                    && !acyclic_check_rec(e, depth+1, budget)) {
+                    return FALSE;
+                }
+            }
+            return TRUE;
+        }
+        return FALSE;
+    }
+}
+
+static int acyclic_p(ScmObj obj)
+{
+    long budget = ACYCLIC_CHECK_BUDGET;
+    return acyclic_check_rec(obj, 0, &budget);
+}
+
 /* Write/ss main driver
    This should never be called recursively.
    We modify port->flags and port->writeState; they are cleaned up
@@ -774,11 +847,16 @@ static void write_ss(ScmObj obj, ScmPort *port, ScmWriteContext *ctx)
     port->flags |= SCM_PORT_WALKING;
     if (SCM_WRITE_MODE(ctx)==SCM_WRITE_SHARED) port->flags |= SCM_PORT_WRITESS;
     ScmWriteState *s = Scm_MakeWriteState(NULL);
-    s->sharedTable = SCM_HASH_TABLE(Scm_MakeHashTableSimple(SCM_HASH_EQ, 0));
     s->controls = ctx->controls;
     port->writeState = s;
 
-    write_walk(obj, port);
+    /* If we only need to detect cycles and OBJ turns out to have none,
+       we can skip the walk; write_rec works without the table. */
+    if (SCM_WRITE_MODE(ctx) == SCM_WRITE_SHARED || !acyclic_p(obj)) {
+        s->sharedTable =
+            SCM_HASH_TABLE(Scm_MakeHashTableSimple(SCM_HASH_EQ, 0));
+        write_walk(obj, port);
+    }
     port->flags &= ~(SCM_PORT_WALKING|SCM_PORT_WRITESS);
 
     /* pass 2 */
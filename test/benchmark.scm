@@ -0,0 +1,101 @@
+;;
+;; testing gauche.benchmark
+;;
+
+(use gauche.test)
+(use srfi-1)
+
+(test-start "gauche.benchmark")
+(use gauche.benchmark)
+(test-module 'gauche.benchmark)
+
+;; NB: write-benchmark-results-json uses rfc.json, so this is run
+;; after the extensions are built.
+(use rfc.json)
+
+(let1 r (benchmark (^[] (make-vector 10)) :name 'vec :samples 5
+                   :iterations 10 :warmup 0)
+  (test* "benchmark" '(#t vec 10 5)
+         (list (benchmark-result? r)
+               (benchmark-result-name r)
+               (benchmark-result-iterations r)
+               (+ (length (benchmark-result-samples r))
+                  (benchmark-result-outliers r))))
+  (test* "benchmark statistics" '(#t #t #t 0.95)
+         (list (<= (benchmark-result-min r)
+                   (benchmark-result-median r)
+                   (benchmark-result-max r))
+               (<= (benchmark-result-ci-low r)
+                   (benchmark-result-mean r)
+                   (benchmark-result-ci-high r))
+               (and (>= (benchmark-result-stddev r) 0)
+                    (>= (benchmark-result-bytes r) 0)
+                    (>= (benchmark-result-gcs r) 0))
+               (benchmark-result-confidence r))))
+
+(test* "benchmark (samples)" (test-error)
+       (benchmark (^[] #f) :samples 4))
+(test* "benchmark (confidence)" (test-error)
+       (benchmark (^[] #f) :confidence 1))
+
+(test* "benchmarks" '(a b)
+       (map benchmark-result-name
+            (benchmarks `((a . ,(^[] #f)) (b . ,(^[] #t)))
+                        :samples 5 :iterations 5 :warmup 0)))
+(test* "benchmarks/report" '(#t 4)
+       (let1 rs #f
+         (let1 out (with-output-to-string
+                     (^[] (set! rs (benchmarks/report
+                                    `((a . ,(^[] #f)) (b . ,(^[] #t)))
+                                    :samples 5 :iterations 5 :warmup 0))))
+           (list (every benchmark-result? rs)
+                 (length (filter (cut eqv? <> #\newline)
+                                 (string->list out)))))))
+
+;; Output format, with results of known values.
+(define %make-result (with-module gauche.benchmark %make-benchmark-result))
+
+(let ([r1 (%make-result 'foo 1000 '(1.4e-6 1.5e-6 1.6e-6) 2 1.5e-6 1e-7
+                        1.4e-6 1.4e-6 1.6e-6 0.95 1.4e-6 1.6e-6 32.0 0.001)]
+      [r2 (%make-result #f 10 '(-2e-3 -1e-3 0.0) 0 -1.5e-3 1e-3 -1e-3
+                        -2e-3 0.0 0.9 -2.75e-3 -0.25e-3 0.0 0.0)]
+      [r3 (%make-result "a\"b\n" 1 '(1.0) 0 1.0 0.0 1.0
+                        1.0 1.0 0.95 -inf.0 +inf.0 0.0 0.0)])
+  (test* "write benchmark-result"
+         '("#<benchmark-result foo 1.50us +-100.00ns>"
+           "#<benchmark-result #f -1.50ms +-1.25ms>")
+         (map write-to-string (list r1 r2)))
+  (test* "report-benchmark-results"
+         (string-append
+          "  foo:     1.50us +-100.00ns (6.7%, 95%CI)  median 1.40us  n=3x1000 (2 outliers)\n"
+          "       32.0 bytes, 0.0010 GCs per iteration\n"
+          "     :    -1.50ms +-1.25ms (-83.3%, 90%CI)  median -1.00ms  n=3x10\n"
+          "       0.0 bytes, 0.0000 GCs per iteration\n")
+         (call-with-output-string
+           (cut report-benchmark-results (list r1 r2) <>)))
+
+  (let1 json (parse-json-string
+              (call-with-output-string
+                (cut write-benchmark-results-json (list r1 r2 r3) <>)))
+    (test* "write-benchmark-results-json"
+           `(,(gauche-version) #t 3)
+           (list (assoc-ref json "gauche-version")
+                 (exact-integer? (assoc-ref json "timestamp"))
+                 (vector-length (assoc-ref json "benchmarks"))))
+    (test* "write-benchmark-results-json (fields)"
+           '(("name" . "foo") ("iterations" . 1000) ("samples" . 3)
+             ("outliers" . 2) ("mean" . 1.5e-6) ("stddev" . 1e-7)
+             ("median" . 1.4e-6) ("min" . 1.4e-6) ("max" . 1.6e-6)
+             ("confidence" . 0.95) ("ci-low" . 1.4e-6) ("ci-high" . 1.6e-6)
+             ("bytes-per-iteration" . 32.0) ("gcs-per-iteration" . 0.001))
+           (vector-ref (assoc-ref json "benchmarks") 0))
+    (test* "write-benchmark-results-json (null)"
+           '(null null null)
+           (map (cut assoc-ref (vector-ref (assoc-ref json "benchmarks") <>)
+                     <>)
+                '(1 2 2)
+                '("name" "ci-low" "ci-high")))
+    (test* "write-benchmark-results-json (escape)" "a\"b\n"
+           (assoc-ref (vector-ref (assoc-ref json "benchmarks") 2) "name"))))
+
+(test-end)
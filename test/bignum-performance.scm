@@ -0,0 +1,47 @@
+;;
+;; a short test program to measure bignum multiplication and division
+;;
+;;  gosh bignum-performance.scm
+;;
+;; Prints seconds per operation for operands of N 64-bit words.  With
+;; the schoolbook methods the time grows as N^2; Karatsuba (N > 32),
+;; Toom-3 (N > 250) and recursive division (divisor N > 100) should make
+;; the last column decrease as N grows.  The thresholds are defined in
+;; src/bignum.c.
+;;
+
+(use gauche.time)
+
+(define (rand-integer nwords)
+  (let loop ([i 0] [r 1])
+    (if (= i nwords)
+      r
+      (loop (+ i 1) (+ (ash r 64) (random-integer-64))))))
+
+(define random-integer-64
+  (let1 x 88172645463325252
+    (^[] (set! x (modulo (+ (* x 6364136223846793005) 1442695040888963407)
+                         (expt 2 64)))
+         x)))
+
+(define (measure thunk)
+  (let loop ([count 1])
+    (let* ([t (make <real-time-counter>)]
+           [_ (with-time-counter t (dotimes [i count] (thunk)))]
+           [sec (time-counter-value t)])
+      (if (< sec 0.2)
+        (loop (* count 2))
+        (/. sec count)))))
+
+(define (report name n sec)
+  (format #t "~10a ~6d ~12a ~12a\n" name n
+          (/. (round (* sec 1e7)) 1e7)
+          (/. (round (* (/. sec (* n n)) 1e12)) 1e12)))
+
+(format #t "~10a ~6a ~12a ~12a\n" "op" "words" "sec/op" "sec/words^2")
+(dolist [n '(16 32 64 128 250 500 1000 2000 4000)]
+  (let ([x (rand-integer n)] [y (rand-integer n)])
+    (report "*" n (measure (^[] (* x y))))))
+(dolist [n '(50 100 200 400 800 1600)]
+  (let* ([d (rand-integer n)] [x (+ (* d (rand-integer n)) (rand-integer n))])
+    (report "quotient" n (measure (^[] (quotient&remainder x d))))))
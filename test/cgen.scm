@@ -376,11 +376,81 @@ some_trick();
 (use gauche.cgen.stub)
 (test-module 'gauche.cgen.stub)
 
+(let ()
+  (define (emit-cproc form)
+    (sys-unlink "tmp.o.c")
+    (parameterize ([cgen-current-unit
+                    (make <cgen-stub-unit> :name "tmp.o" :c-name-prefix "tmp_")]
+                   [cise-emit-source-line #f])
+      (cgen-stub-parse-form form)
+      (cgen-emit-c (cgen-current-unit))
+      (begin0 (file->string "tmp.o.c")
+        (sys-unlink "tmp.o.c"))))
+
+  (let1 c (emit-cproc '(define-cproc foo (a::<real> :optional b) (result a)))
+    (test* "cproc args are fetched directly" '(#t #t #f)
+           (list (boolean (#/a_scm = SCM_ARGREF\(0\);/ c))
+                 (boolean (#/SCM_GET_DOUBLE\(a_scm\)/ c))
+                 (boolean (#/SCM_SUBRARGS/ c)))))
+  (let1 c (emit-cproc '(define-cproc bar (a :key (c 1)) (result c)))
+    (test* "cproc keyword args" '(#f #t)
+           (list (boolean (#/Scm_Length/ c))
+                 (boolean (#/keyword list not even/ c)))))
+  (let1 c (emit-cproc '(define-cproc baz (:optarray (v n 4)) (result n)))
+    (test* "cproc optarray" #t
+           (boolean (#/SCM_SUBRARGS/ c))))
+  )
+
 ;;====================================================================
 (test-section "gauche.cgen.precomp")
 (use gauche.cgen.precomp)
 (test-module 'gauche.cgen.precomp)
 
+;;====================================================================
+(test-section "gauche.cgen.native")
+(use gauche.cgen.native)
+(test-module 'gauche.cgen.native)
+
+(let ()
+  (define (compile-native forms)
+    (sys-unlink "tmp.o.c")
+    (parameterize ([cgen-current-unit
+                    (make <cgen-stub-unit> :name "tmp.o" :c-name-prefix "tmp_")]
+                   [cise-emit-source-line #f])
+      (dolist [f forms] (native-compile-define (cdr f) 'user))
+      (cgen-emit-c (cgen-current-unit))
+      (begin0 (file->string "tmp.o.c")
+        (sys-unlink "tmp.o.c"))))
+
+  (let1 c (compile-native
+           '((define-native (fib n::<fixnum>) :: <fixnum>
+               (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))
+             (define-native (sum-to n::<fixnum>) :: <real>
+               (let loop ([i::<fixnum> 0] [s::<real> 0.0])
+                 (if (> i n) s (loop (+ i 1) (+ s i)))))
+             (define-native (call-fib x)
+               (fib x))))
+    (test* "define-native: direct call" #t
+           (boolean (#/n_fib_\d+\(native_fixnum\(n_x_/ (regexp-replace-all #/\s+/ c ""))))
+    (test* "define-native: loop" #t
+           (boolean (#/goto n_loop_\d+;/ c)))
+    (test* "define-native: unboxed" #f
+           (boolean (#/Scm_ApplyRec|Scm_Add|Scm_MakeFlonum/ c)))
+    (test* "define-native: subr" #t
+           (boolean (#/"sum-to"/ c))))
+
+  (let1 c (compile-native
+           '((define-native (show x) (print (car x) 'a))))
+    (test* "define-native: generic call" #t
+           (boolean (#/Scm_ApplyRec2\(native_gref/ (regexp-replace-all #/\s+/ c "")))))
+
+  (test* "define-native: unsupported form" (test-error)
+         (compile-native '((define-native (f x) (lambda () x)))))
+  (test* "define-native: loop in non-tail position" (test-error)
+         (compile-native '((define-native (f x)
+                             (let loop ([i 0]) (+ 1 (loop i)))))))
+  )
+
 ;;====================================================================
 (test-section "gauche.cgen")
 (use gauche.cgen)
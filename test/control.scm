@@ -67,6 +67,63 @@
   ]
  [else])
 
+;;--------------------------------------------------------------------
+;; control.timer-wheel
+;;
+
+(test-section "control.timer-wheel")
+(use control.timer-wheel)
+(test-module 'control.timer-wheel)
+
+(let* ([now 100]
+       [wheel (make-timer-wheel :resolution 1 :levels 2 :clock (^[] now))]
+       [fired '()])
+  (define (sched delay tag)
+    (timer-wheel-schedule! wheel delay (^[] (push! fired tag))))
+  (define (advance-to t)
+    (set! now t)
+    (timer-wheel-advance! wheel)
+    (reverse (begin0 fired (set! fired '()))))
+
+  (let ([t1 (sched 3 'a)]
+        [t2 (sched 10 'b)]
+        [t3 (sched 100 'c)]                ;level 1
+        [t4 (sched 5000 'd)]               ;beyond the wheel
+        [t5 (sched 3 'e)])
+    (test* "schedule" '(#t 5) (list (timer? t1) (timer-wheel-num-timers wheel)))
+    (test* "next-timeout" 3 (timer-wheel-next-timeout wheel))
+    (test* "advance (nothing due)" '() (advance-to 102))
+    (test* "advance (coalesced)" '(a e) (advance-to 103))
+    (test* "pending?" '(#f #t) (map timer-pending? (list t1 t2)))
+    (test* "cancel" '(#t #f) (list (timer-cancel! t2) (timer-cancel! t2)))
+    (test* "advance (cancelled)" '() (advance-to 150))
+    (test* "reschedule" '(a) (begin (timer-reschedule! t1 10)
+                                    (advance-to 160)))
+    (test* "advance (cascade)" '() (advance-to 199))
+    (test* "advance (cascade)" '(c) (advance-to 200))
+    (test* "advance (long jump)" '() (advance-to 5099))
+    (test* "advance (beyond the wheel)" '(d) (advance-to 5100))
+    (test* "next-timeout (empty)" '(#f 0)
+           (list (timer-wheel-next-timeout wheel)
+                 (timer-wheel-num-timers wheel))))
+
+  (test* "many timers" '(1000 0)
+         (let1 ts (map (^i (sched (+ 1 (modulo (* i 7919) 20000)) i))
+                       (iota 2000))
+           (for-each (^[t i] (when (odd? i) (timer-cancel! t))) ts (iota 2000))
+           (list (length (advance-to 30000))
+                 (timer-wheel-num-timers wheel))))
+
+  (test* "order of firing" '(1 2 3 4)
+         (begin (sched 4 4) (sched 2 2) (sched 3 3) (sched 1 1)
+                (advance-to (+ now 10))))
+
+  (test* "schedule from a timer" '(x y)
+         (begin (timer-wheel-schedule! wheel 1
+                                       (^[] (push! fired 'x) (sched 1 'y)))
+                (append (advance-to (+ now 1)) (advance-to (+ now 1)))))
+  )
+
 ;;--------------------------------------------------------------------
 ;; control.thread-pool
 ;;
@@ -75,6 +132,7 @@
  [gauche.sys.threads
   (test-section "control.thread-pool")
   (use control.thread-pool)
+  (use gauche.threads)
   (test-module 'control.thread-pool)
 
   (let ([pool (make-thread-pool 5)]
@@ -174,6 +232,66 @@
                    [else (sys-nanosleep #e1e8) (retry (+ n 1))])))
     )
 
+  ;; work-stealing mode
+  (let ([pool (make-thread-pool 4 :work-stealing #t)]
+        [count (atom 0)])
+    (define (spawn depth)
+      (atomic-update! count (cut + <> 1))
+      (when (> depth 0)
+        (add-job! pool (cut spawn (- depth 1)))
+        (add-job! pool (cut spawn (- depth 1)))))
+    (test* "work-stealing: nested jobs" (- (expt 2 11) 1)
+           (begin (add-job! pool (cut spawn 10))
+                  (and (wait-all pool #f #e1e7) (atom-ref count))))
+    (test* "work-stealing: affinity" '(a b c d)
+           (begin (for-each (^[i v] (add-job! pool (^[] v) #t #f i))
+                            (iota 4) '(a b c d))
+                  (and (wait-all pool #f #e1e7)
+                       (sort (map job-result
+                                  (dequeue-all! (thread-pool-results pool)))
+                             (^[x y] (string<? (symbol->string x)
+                                               (symbol->string y)))))))
+    (test* "work-stealing: bad affinity" (test-error)
+           (add-job! pool (^[] #t) #f #f 4))
+    (terminate-all! pool)
+    (test* "work-stealing: shut down" #t
+           (every (^t (eq? (thread-state t) 'terminated)) (~ pool'pool))))
+
+  ;; worker placement
+  (test* "placement: parse-cpulist" '(0 1 2 3 8 10 11)
+         ((with-module control.thread-pool parse-cpulist) "0-3,8,10-11"))
+  (test* "placement: interleave" '(0 4 1 5 2 3)
+         ((with-module control.thread-pool interleave) '((0 1 2 3) (4 5))))
+  (dolist [placement '(cpu node)]
+    (let1 pool (make-thread-pool 3 :placement placement
+                                 :thread-options '(:os-stack-size 1048576))
+      (test* #"placement: ~placement" '(0 1 2)
+             (begin (dotimes [k 3] (add-job! pool (^[] k) #t))
+                    (and (wait-all pool #f #e1e7)
+                         (sort (map job-result
+                                    (dequeue-all! (thread-pool-results pool)))))))
+      (terminate-all! pool)))
+  (test* "placement: bad" (test-error)
+         (make-thread-pool 1 :placement 'numa))
+
+  ;; delayed jobs
+  (let ([pool (make-thread-pool 2)])
+    (test* "add-delayed-job!" '(b a)
+           (begin (add-delayed-job! pool 0.2 (^[] 'a) #t)
+                  (add-delayed-job! pool 0.05 (^[] 'b) #t)
+                  (let* ([j1 (dequeue/wait! (thread-pool-results pool) 5)]
+                         [j2 (dequeue/wait! (thread-pool-results pool) 5)])
+                    (map job-result (list j1 j2)))))
+    (test* "add-delayed-job! cancel" '(#t d)
+           (let* ([t1 (add-delayed-job! pool 0.05 (^[] 'c) #t)]
+                  [t2 (add-delayed-job! pool 0.1 (^[] 'd) #t)])
+             (list (timer-cancel! t1)
+                   (job-result (dequeue/wait! (thread-pool-results pool) 5)))))
+    (test* "add-delayed-job! after shutdown" (test-error <thread-pool-shut-down>)
+           (begin (add-delayed-job! pool 10 (^[] 'e))
+                  (terminate-all! pool)
+                  (add-delayed-job! pool 0 (^[] 'f)))))
+
   ;; now, test forcible termination
   (let ([pool (make-thread-pool 1)]
         [gate #f])
@@ -193,6 +311,94 @@
   ] ; gauche.sys.pthreads
  [else])
 
+;;--------------------------------------------------------------------
+;; control.fiber
+;;
+
+(cond-expand
+ [gauche.sys.threads
+  (test-section "control.fiber")
+  (use control.fiber)
+  (test-module 'control.fiber)
+
+  (fiber-scheduler-start! 2)
+
+  (test* "spawn and join" '(1 2)
+         (receive r (fiber-join! (spawn-fiber (^[] (values 1 2)))) r))
+  (test* "many fibers" 10000
+         (let* ([count (atom 0)]
+                [fs (list-tabulate 1000
+                                   (^_ (spawn-fiber
+                                        (^[] (dotimes [i 10]
+                                               (atomic-update! count
+                                                               (cut + <> 1))
+                                               (fiber-yield!))))))])
+           (for-each fiber-join! fs)
+           (atom-ref count)))
+  (test* "join from a fiber" 'inner
+         (fiber-join!
+          (spawn-fiber (^[] (fiber-join! (spawn-fiber (^[] (fiber-sleep! 0.05)
+                                                          'inner)))))))
+  (test* "error" 'oops
+         (guard (e [(symbol? e) e])
+           (fiber-join! (spawn-fiber (^[] (fiber-yield!) (raise 'oops))))))
+  (test* "fiber-read" "hello"
+         (receive (in out) (sys-pipe)
+           (let1 f (spawn-fiber (^[] (fiber-read in read-line)) 'reader)
+             (sys-nanosleep #e5e7)
+             (display "hello\n" out)
+             (flush out)
+             (begin0 (fiber-join! f)
+               (close-port in)
+               (close-port out)))))
+  ]
+ [else])
+
+;;--------------------------------------------------------------------
+;; control.future
+;;
+
+(cond-expand
+ [gauche.sys.threads
+  (test-section "control.future")
+  (use control.future)
+  (test-module 'control.future)
+
+  (test* "future and touch" '(3 3)
+         (let1 f (future (+ 1 2))
+           (list (touch f) (touch f))))
+  (test* "future-done?" #t
+         (let1 f (make-future (^[] 'x))
+           (touch f)
+           (boolean (future-done? f))))
+  (test* "future multiple values" '(1 2)
+         (receive r (touch (future (values 1 2))) r))
+  (test* "future error" 'boom
+         (guard (e [(symbol? e) e])
+           (touch (future (raise 'boom)))))
+  (test* "nested futures" 832040
+         (let fib ([n 25])
+           (if (< n 15)
+             (let loop ([n n]) (if (< n 2) n (+ (loop (- n 1)) (loop (- n 2)))))
+             (let1 f (future (fib (- n 1)))
+               (+ (fib (- n 2)) (touch f))))))
+  (test* "parallel-map" (map (cut * <> <>) (iota 1000))
+         (parallel-map (^x (* x x)) (iota 1000)))
+  (test* "parallel-map (chunk-size)" (map (cut * <> 2) (iota 10))
+         (parallel-map (cut * <> 2) (iota 10) :chunk-size 3))
+  (test* "parallel-map (empty)" '() (parallel-map list '()))
+  (test* "parallel-for-each" 499500
+         (let1 sum (atom 0)
+           (parallel-for-each (^x (atomic-update! sum (cut + <> x)))
+                              (iota 1000))
+           (atom-ref sum)))
+  (test* "parallel-reduce" 49995000
+         (parallel-reduce + 0 (iota 10000)))
+  (test* "parallel-reduce (non-commutative)" (iota 100)
+         (parallel-reduce append '() (map list (iota 100)) :chunk-size 7))
+  ]
+ [else])
+
 (test-end)
 
 
@@ -104,10 +104,7 @@
                  (cache-check! c 'd)
                  (cache-check! c 'e)
                  (cache-check! c 'f))))
-  ;; To test renumber, we forcibly change the counter value - do not do this
-  ;; in the actual code!
-  (set! (~ c'counter) (- (greatest-fixnum) 1))
-  (test* "LRU renumber" '((a . 11) #f (c . 13) (d . 12) #f (f . 9))
+  (test* "LRU update" '((a . 11) #f (c . 13) (d . 12) #f (f . 9))
          (begin
            (cache-write! c 'a '11)
            (cache-write! c 'd '12)
@@ -289,6 +286,82 @@
            (cache-through! c 'd symbol->string)  ; hit
            (cache-stats c))))
 
+;; W-TinyLFU cache
+;; The identity hash makes the frequency sketch deterministic.
+(define *int-comparator* (make-comparator exact-integer? = #f (^x x)))
+
+(let ([c (make-counting-cache
+          (make-tinylfu-cache 10 :comparator *int-comparator*))])
+  (test* "TinyLFU basic" '((a . 1) #f (a . 2))
+         (let1 c (make-tinylfu-cache 4)
+           (cache-write! c 'a 1)
+           (list (cache-check! c 'a)
+                 (cache-check! c 'b)
+                 (begin (cache-write! c 'a 2) (cache-check! c 'a)))))
+  (test* "TinyLFU scan resistance" '(:hits 36 :misses 109 :evictions 99)
+         (begin
+           (dotimes [k 9]
+             (dotimes [_ 5] (cache-through! c k identity)))
+           (do ([k 100 (+ k 1)]) [(= k 200)]
+             (cache-through! c k identity))
+           (cache-stats c)))
+  (test* "TinyLFU frequent entries survive" '(0 1 2 3 4 5 6 7 8)
+         (map cdr (filter-map (cut cache-check! c <>) (iota 9))))
+  (test* "TinyLFU evict" '(#f (1 . 1))
+         (begin
+           (cache-evict! c 0)
+           (list (cache-check! c 0) (cache-check! c 1))))
+  (test* "TinyLFU clear" '(#f #f)
+         (begin
+           (cache-clear! c)
+           (list (cache-check! c 1) (cache-check! c 199)))))
+
+;; LRU eviction statistics
+(let ([c (make-counting-cache (make-lru-cache 2))])
+  (test* "LRU stats" '(:hits 1 :misses 3 :evictions 1)
+         (begin
+           (cache-through! c 'a symbol->string)  ; miss
+           (cache-through! c 'b symbol->string)  ; miss
+           (cache-through! c 'a symbol->string)  ; hit
+           (cache-through! c 'c symbol->string)  ; miss, spills b
+           (cache-stats c))))
+
+;; Sharded cache
+;; With the identity hash, key k goes to the shard (modulo k 4).
+(let ([c (make-sharded-cache 4 (cut make-lru-cache 2
+                                    :comparator *int-comparator*))])
+  (test* "sharded fill" (iota 8)
+         (map (^k (cache-through! c k identity)) (iota 8)))
+  (test* "sharded spill" '(#f (1 . 1) (4 . 4) (8 . 8))
+         (begin
+           (cache-write! c 8 8)                  ; spills 0 from shard 0
+           (map (cut cache-check! c <>) '(0 1 4 8))))
+  (test* "sharded stats" '(:hits 3 :misses 9 :evictions 1)
+         (cache-stats c))
+  (test* "sharded evict and clear" '(#f #f)
+         (begin
+           (cache-evict! c 1)
+           (let1 r (cache-check! c 1)
+             (cache-clear! c)
+             (list r (cache-check! c 4))))))
+
+(cond-expand
+ [gauche.sys.threads
+  (use gauche.threads)
+  (let ([c (make-sharded-cache 8 (cut make-lru-cache 16))])
+    (test* "sharded cache with threads" '(#t 4000)
+           (let* ([ts (map (^_ (thread-start!
+                                (make-thread
+                                 (^[] (every (^k (= (cache-through! c k (cut * <> 2))
+                                                    (* k 2)))
+                                             (iota 1000))))))
+                           (iota 4))]
+                  [rs (map thread-join! ts)]
+                  [st (cache-stats c)])
+             (list (every identity rs)
+                   (+ (get-keyword :hits st) (get-keyword :misses st))))))]
+ [else])
+
 ;;;========================================================================
 (test-section "data.ideque")
 (use data.ideque)
@@ -540,6 +613,93 @@
                (max 1 1 1 1)))
   )
 
+;; Heaps on flat storage with default or real comparator use native
+;; operations; they should behave the same as the generic ones.
+(use data.sparse)
+(let ((rs (make-random-source)))
+  (define (run storage comparator nums)
+    (let1 hp (make-binary-heap :storage storage :comparator comparator)
+      (let loop ([nums nums] [r '()])
+        (cond [(null? nums)
+               (binary-heap-check hp)
+               (append (reverse r)
+                       (map-in-order (^_ (binary-heap-pop-max! hp))
+                                     (iota (binary-heap-num-entries hp))))]
+              [(zero? (modulo (car nums) 3))
+               (binary-heap-push! hp (car nums))
+               (binary-heap-check hp)
+               (loop (cdr nums)
+                     (cons (if (odd? (car nums))
+                             (binary-heap-pop-min! hp)
+                             (binary-heap-pop-max! hp))
+                           r))]
+              [else
+               (binary-heap-push! hp (car nums))
+               (loop (cdr nums) r)]))))
+  (let* ([nums (shuffle (iota 200) rs)]
+         [expected (run (make-sparse-vector) default-comparator nums)])
+    (test* "native heap (vector)" expected
+           (run (make-vector 200) default-comparator nums))
+    (test* "native heap (u16vector)" expected
+           (run (make-u16vector 200) default-comparator nums))
+    (test* "native heap (s32vector, real-comparator)" expected
+           (run (make-s32vector 200) real-comparator nums))
+    (test* "native heap (f64vector)" (map inexact expected)
+           (run (make-f64vector 200) default-comparator (map inexact nums)))
+    (test* "native heap (mixed numbers)" (map (^x (/ x 2)) expected)
+           (run (make-vector 200) default-comparator (map (^x (/ x 2)) nums)))
+    ))
+
+(let ((rs (make-random-source)))
+  (define (suck-all heap)
+    (do ([r '() (cons (binary-heap-pop-min! heap) r)])
+        [(binary-heap-empty? heap) (reverse r)]
+      ))
+  (define (do-handles storage)
+    (let* ([hp (make-binary-heap :storage storage :handles #t)]
+           [hs (map (^n (binary-heap-push! hp (* n 10)))
+                    (shuffle (iota 50) rs))])
+      (test* "handle item" 0
+             (binary-heap-handle-item (find (^h (= (binary-heap-handle-item h)
+                                                   0))
+                                            hs)))
+      (test* "find-min, find-max with handles" '(0 490)
+             (list (binary-heap-find-min hp) (binary-heap-find-max hp)))
+      ;; decrease/increase keys
+      (dolist [h hs]
+        (let1 n (binary-heap-handle-item h)
+          (case (modulo n 30)
+            [(0)  (binary-heap-update! hp h (- n 6))]
+            [(10) (binary-heap-update! hp h (+ n 1005))]))
+        (binary-heap-check hp))
+      (test* "find-min, find-max after update" '(-6 1495)
+             (list (binary-heap-find-min hp) (binary-heap-find-max hp)))
+      ;; delete by handles
+      (dolist [h hs]
+        (when (odd? (binary-heap-handle-item h))
+          (binary-heap-delete! hp h)
+          (binary-heap-check hp)))
+      (test* "num-entries after delete" 33 (binary-heap-num-entries hp))
+      (test* "update deleted handle" (test-error)
+             (binary-heap-update! hp (find (^h (odd? (binary-heap-handle-item h)))
+                                           hs)
+                                  0))
+      (test* "pop with handles"
+             (sort (filter-map (^n (case (modulo n 30)
+                                     [(0) (- n 6)]
+                                     [(10) #f]
+                                     [else n]))
+                               (iota 50 0 10)))
+             (suck-all hp))
+      (test* "handles are invalidated after pop" (test-error)
+             (binary-heap-delete! hp (car hs)))))
+
+  (do-handles (make-vector 50))
+  (do-handles (make-sparse-vector))
+  (test* "handles with uvector storage" (test-error)
+         (make-binary-heap :storage (make-u8vector 10) :handles #t))
+  )
+
 ;;;========================================================================
 ;; ring-buffer
 (test-section "data.ring-buffer")
@@ -627,6 +787,42 @@
 (test-ring-buffer (make-vector 4))
 (test-ring-buffer (make-u8vector 5))
 
+;; sliding window over a wrapped-around storage
+(let1 rb (make-ring-buffer (make-f64vector 4) :overflow-handler 'overwrite)
+  (dotimes [i 10] (ring-buffer-add-back! rb (* i 1.5)))
+  (test* "f64 window" '(9.0 10.5 12.0 13.5)
+         (map (cut ring-buffer-ref rb <>) (iota 4)))
+  (ring-buffer-set! rb 3 -1.0)
+  (test* "f64 window set!" '(9.0 -1.0 4)
+         (list (ring-buffer-front rb) (ring-buffer-back rb)
+               (ring-buffer-num-entries rb)))
+  (test* "ref fallback" 'none (ring-buffer-ref rb 4 'none))
+  (test* "ref out of range" (test-error) (ring-buffer-ref rb -1))
+  (test* "set! out of range" (test-error) (ring-buffer-set! rb 4 0.0)))
+
+(let1 rb (make-ring-buffer (make-u8vector 2))
+  (test* "u8 storage rejects bad value" (test-error)
+         (ring-buffer-add-back! rb 256))
+  (test* "u8 storage after rejection" '(0 #t)
+         (list (ring-buffer-num-entries rb) (ring-buffer-empty? rb)))
+  (dotimes [i 3] (ring-buffer-add-front! rb i))
+  (test* "u8 storage grown" '(4 (2 1 0))
+         (list (ring-buffer-capacity rb)
+               (map (cut ring-buffer-ref rb <>) '(0 1 2)))))
+
+(let1 rb (make-ring-buffer (make-vector 2)
+                           :overflow-handler (^[rb v] (make-vector 1)))
+  (ring-buffer-add-back! rb 'a)
+  (ring-buffer-add-back! rb 'b)
+  (test* "overflow handler returning small storage" (test-error)
+         (ring-buffer-add-back! rb 'c))
+  (test* "overflow handler returning different type" (test-error)
+         (let1 rb2 (make-ring-buffer (make-vector 1)
+                                     :overflow-handler
+                                     (^[rb v] (make-u8vector 4)))
+           (ring-buffer-add-back! rb2 1)
+           (ring-buffer-add-back! rb2 2))))
+
 ;;;========================================================================
 ;; trie
 (test-section "data.trie")
@@ -4,6 +4,8 @@
 
 (use gauche.test)
 (use gauche.sequence)
+(use gauche.generator)
+(use srfi-1)
 
 (test-start "dbi/dbd")
 (use dbi)
@@ -70,6 +72,71 @@
                       4))
   )
 
+(test-section "prepared query cache")
+
+(let1 conn (dbi-connect "dbi:null")
+  (test* "cached" #t
+         (eq? (ref (dbi-prepare conn "select * from foo where x = ?") 'prepared)
+              (ref (dbi-prepare conn "select * from foo where x = ?") 'prepared)))
+  (test* "cached query works" '("select * from foo where x = 3")
+         (coerce-to <list>
+                    (dbi-execute (dbi-prepare conn "select * from foo where x = ?")
+                                 3)))
+  (test* "different sql" #f
+         (eq? (ref (dbi-prepare conn "select * from foo where x = ?") 'prepared)
+              (ref (dbi-prepare conn "select * from bar where x = ?") 'prepared)))
+  (test* "clear" #f
+         (let1 q (dbi-prepare conn "select * from foo where x = ?")
+           (dbi-clear-prepared-cache! conn)
+           (eq? (ref q 'prepared)
+                (ref (dbi-prepare conn "select * from foo where x = ?")
+                     'prepared))))
+  (test* "lru" '(#t #f #t)
+         (let* ([c (rlet1 c (dbi-connect "dbi:null")
+                     (set! (ref c 'prepared-cache-size) 2))]
+                [p (^[sql] (ref (dbi-prepare c sql) 'prepared))]
+                [a (p "select a")]
+                [b (p "select b")])
+           (p "select a")
+           (p "select c")                ; evicts "select b"
+           (list (eq? a (p "select a"))
+                 (eq? b (p "select b"))
+                 (eq? (p "select b") (p "select b")))))
+  (test* "cache disabled" #f
+         (begin
+           (set! (ref conn 'prepared-cache-size) 0)
+           (dbi-clear-prepared-cache! conn)
+           (eq? (ref (dbi-prepare conn "select * from foo") 'prepared)
+                (ref (dbi-prepare conn "select * from foo") 'prepared))))
+  )
+
+(test-section "streaming result set")
+
+(define-class <test-stream-result> (<dbi-streaming-result-set>)
+  ((rows :init-keyword :rows)
+   (fetches :init-value 0)))
+
+(define-method dbi-fetch-batch ((r <test-stream-result>) n)
+  (inc! (ref r 'fetches))
+  (let1 rows (ref r 'rows)
+    (receive (h t) (split-at rows (min n (length rows)))
+      (set! (ref r 'rows) t)
+      h)))
+
+(let1 r (make <test-stream-result> :rows (iota 10) :batch-size 4)
+  (test* "iterate" '((0 1 2 3 4 5 6 7 8 9) 4)
+         (let1 rows (map identity r)
+           (list rows (ref r 'fetches)))))
+
+(let1 r (make <test-stream-result> :rows (iota 10))
+  (test* "generator" '((0 1 2 3 4 5 6 7 8 9) 5)
+         (let1 g (dbi-result->generator r 3)
+           (list (generator->list g) (ref r 'fetches)))))
+
+(test* "generator (non-streaming)" '("select 1")
+       (generator->list (dbi-result->generator
+                         (dbi-do (dbi-connect "dbi:null") "select 1"))))
+
 (test-section "testing conditions")
 
 (test* "<dbi-nonexistent-driver-error>" "nosuchdriver"
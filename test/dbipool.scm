@@ -0,0 +1,59 @@
+;;
+;; Test dbi.pool
+;;
+
+(use gauche.test)
+(use gauche.sequence)
+
+(test-start "dbi.pool")
+(use dbi)
+
+(test* "autoload via dbi" #t
+       (is-a? (make-dbi-connection-pool "dbi:null") <dbi-connection-pool>))
+
+(use dbi.pool)
+(test-module 'dbi.pool)
+
+(test-section "connection pool")
+
+(let1 pool (make-dbi-connection-pool "dbi:null:pooled"
+                                     :max-connections 2 :max-idle 1
+                                     :username "anonymous")
+  (define c0 #f)
+  (define c1 #f)
+  (test* "acquire" '(<null-connection> "pooled" (:username "anonymous"))
+         (begin (set! c0 (dbi-pool-acquire pool))
+                (list (class-name (class-of c0))
+                      (ref c0 'attr-string)
+                      (ref c0 'options))))
+  (test* "acquire another" #f
+         (begin (set! c1 (dbi-pool-acquire pool))
+                (eq? c0 c1)))
+  (test* "acquire timeout" #f
+         (dbi-pool-acquire pool 0.01))
+  (test* "release and reuse" #t
+         (begin (dbi-pool-release! pool c0)
+                (eq? c0 (dbi-pool-acquire pool))))
+  (test* "max-idle" '(#t #f)
+         (begin (dbi-pool-release! pool c0)
+                (dbi-pool-release! pool c1)  ; exceeds max-idle
+                (list (dbi-open? c0) (dbi-open? c1))))
+  (test* "health check" #f
+         (begin (dbi-close c0)              ; the idle one becomes bad
+                (eq? c0 (dbi-pool-acquire pool))))
+  (test* "call-with-dbi-connection" '("insert into foo values(1)")
+         (call-with-dbi-connection pool
+           (^[conn] (coerce-to <list>
+                               (dbi-do conn "insert into foo values (?)"
+                                       '() 1)))))
+  (test* "close" '(#f #f)
+         (let1 c (dbi-pool-acquire pool)
+           (dbi-pool-release! pool c)
+           (dbi-close pool)
+           (list (dbi-open? pool) (dbi-open? c))))
+  (test* "closed pool" (test-error <dbi-error>)
+         (dbi-pool-acquire pool))
+  )
+
+
+(test-end)
@@ -33,4 +33,22 @@
                      [_ #f])
                    (call/cc (^x (ra x) #f))))
 
+;;----------------------------------------------------------
+(test-section "instruction counting")
+
+(test* "vm-insn-stat" #t
+       (begin
+         (vm-insn-stat-reset)
+         (vm-insn-stat-start)
+         (let loop ([i 0]) (when (< i 100) (loop (+ i 1))))
+         (vm-insn-stat-stop)
+         (let ([insns (get-keyword :instructions (vm-insn-stat))])
+           (and (pair? insns)
+                (every (^p (and (symbol? (car p)) (exact-integer? (cdr p))))
+                       insns)))))
+
+(test* "vm-insn-stat-reset" '()
+       (begin (vm-insn-stat-reset)
+              (get-keyword :instructions (vm-insn-stat))))
+
 (test-end)
@@ -258,6 +258,38 @@
                    (^[] #f))
              x)))
 
+;; Calling dynamic-wind through apply bypasses the compiler inlining
+;; and exercises the runtime version.
+(test* "dynamic-wind via apply (multival)" '((a b c d e f g h i j) (after before))
+       (let1 r '()
+         (receive x (apply dynamic-wind
+                           (list (^[] (push! r 'before))
+                                 (^[] (values 'a 'b 'c 'd 'e 'f 'g 'h 'i 'j))
+                                 (^[] (push! r 'after))))
+           (list x r))))
+
+(test* "dynamic-wind via apply (values)" '()
+       (receive x (apply dynamic-wind (list (^[] #f) values (^[] #f))) x))
+
+(test* "dynamic-wind via apply (escape)" '(out after body before)
+       (let1 r '()
+         (call/cc
+          (^k (apply dynamic-wind
+                     (list (^[] (push! r 'before))
+                           (^[] (push! r 'body) (k #f) (push! r 'never))
+                           (^[] (push! r 'after))))))
+         (cons 'out r)))
+
+(test* "dynamic-wind via apply (reentry)" '(a b a b)
+       (let ([r '()] [k #f] [n 0])
+         (apply dynamic-wind
+                (list (^[] (push! r 'b))
+                      (^[] (call/cc (^c (set! k c))))
+                      (^[] (push! r 'a))))
+         (inc! n)
+         (when (< n 2) (k #f))
+         r))
+
 ;; Test for error handling with dynamic-wind
 (test "dynamic-wind - error in before thunk"
       '(a b c d h)
@@ -422,6 +454,38 @@
 (test "Al's call/cc test" 1
       (^[] (call/cc (^c (0 (c 1))))))
 
+;; one-shot continuation
+
+(test* "call/1cc (return)" 3 (+ 1 (call/1cc (^k 2))))
+(test* "call/1cc (escape)" 13
+       (+ 1 (call/1cc (^k (for-each (^x (when (> x 5) (k (* x 2)))) '(1 6 7))
+                          0))))
+(test* "call/1cc (values)" '(1 2 3)
+       (receive x (call/1cc (^k (k 1 2 3))) x))
+(test* "call/1cc (nested)" '(a b)
+       (call/1cc (^k1 (list (call/1cc (^k2 (k2 'a))) 'b))))
+(test* "call/1cc (escape from inner extent)" 'out
+       (call/1cc (^k1 (call/1cc (^k2 (k1 'out))) 'not-reached)))
+(test* "call/1cc and dynamic-wind" '(out after before)
+       (let1 r '()
+         (call/1cc (^k (dynamic-wind
+                           (^[] (push! r 'before))
+                           (^[] (k #f))
+                           (^[] (push! r 'after)))))
+         (cons 'out r)))
+(test* "call/1cc escaping across C stack" 'escaped
+       (call/1cc (^k (sort '(3 1 2) (^[a b] (k 'escaped))))))
+(test* "call/1cc (invoked after exit)" (test-error)
+       (let1 kk (call/1cc (^k k)) (kk 1)))
+(test* "call/1cc (invoked after escaping out)" (test-error)
+       (let1 kk #f
+         (call/cc (^c (call/1cc (^k (set! kk k) (c #f)))))
+         (kk 1)))
+(test* "call/1cc (invoked twice)" (test-error)
+       (let1 k2 #f
+         (call/1cc (^k (set! k2 k) (k 'first)))
+         (k2 'second)))
+
 ;;-----------------------------------------------------------------------
 ;; Partial continuations
 
@@ -444,6 +508,15 @@
 (test "calling pc" '(1 3 2 4)
       (^[] (cons 1 (reset (cons 2 (shift k (cons 3 (k (cons 4 '())))))))))
 
+;; frames below reset stay in the stack when k is captured
+(test "shift with outer variables" 4
+      (^[] (let1 x 1 (+ x (reset (+ x (shift k (+ x (k x)))))))))
+(test "shift in a loop" '(3 2 1 0)
+      (^[] (let loop ([i 0] [r '()])
+             (if (= i 4)
+               r
+               (loop (+ i 1) (cons (reset (shift k (k i))) r))))))
+
 (test "calling pc multi" 14
       (^[] (+ 1 (reset (+ 2 (shift k (+ 3 (k 5) (k 1))))))))
 (test "calling pc multi" '(1 3 2 2 4)
@@ -243,6 +243,40 @@
          (let1 x (guard (e (else aaa)) (foo))
            (list x aaa))))
 
+(test* "guard passes multiple values" '(1 2 3)
+       (receive r (guard (e (else 'oops)) (values 1 2 3)) r))
+
+(test* "guard re-raise to outer guard" '(outer . foo)
+       (guard (e ((symbol? e) (cons 'outer e)))
+         (guard (e ((string? e) 'inner))
+           (raise 'foo))))
+
+(test* "guard error inside with-exception-handler" '(caught "bang")
+       (with-exception-handler
+        (lambda (e) '(handler))
+        (lambda ()
+          (guard (e ((<error> e) (list 'caught (condition-message e))))
+            (error "bang")))))
+
+(test* "guard in a loop" '(5000 5000)
+       (let loop ([i 0] [caught 0] [passed 0])
+         (if (= i 10000)
+           (list caught passed)
+           (let1 r (guard (e (else 'caught))
+                     (if (even? i) (raise i) 'passed))
+             (if (eq? r 'caught)
+               (loop (+ i 1) (+ caught 1) passed)
+               (loop (+ i 1) caught (+ passed 1)))))))
+
+(test* "guard body re-entered via continuation" '(3 caught)
+       (let ([k #f] [n 0] [r '()])
+         (let1 v (guard (e (else 'caught))
+                   (call/cc (lambda (c) (set! k c)))
+                   (inc! n)
+                   (if (< n 3) 'again (raise 'done)))
+           (push! r v)
+           (when (eq? v 'again) (k #f))
+           (list n (car r)))))
 
 ;;--------------------------------------------------------------------
 (test-section "unwind-protect")
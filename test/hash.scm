@@ -57,6 +57,30 @@
                         (hash (car p))))
               data)))
 
+(let ()
+  (define (nest n)
+    (let loop ([i 0] [r '()])
+      (if (= i n) r (loop (+ i 1) (if (odd? i) (list r i) (vector i r))))))
+  (define (cdr-cycle . lis)
+    (set-cdr! (last-pair lis) lis)
+    lis)
+  (test* "portable-hash of deep structure" #t
+         (= (portable-hash (nest 100000) 0) (portable-hash (nest 100000) 0)))
+  (test* "default-hash of deep structure" #t
+         (= (default-hash (nest 100000)) (default-hash (nest 100000))))
+  (test* "default-hash of large list" #t
+         (= (default-hash (iota 100000)) (default-hash (iota 100000))))
+  (test* "default-hash of circular list" #t
+         (integer? (default-hash (cdr-cycle 1 2 3))))
+  (test* "equal?-hashtable with large keys" '(a b #f)
+         (let1 h (make-hash-table 'equal?)
+           (hash-table-put! h (iota 10000) 'a)
+           (hash-table-put! h (nest 1000) 'b)
+           (list (hash-table-get h (iota 10000) #f)
+                 (hash-table-get h (nest 1000) #f)
+                 (hash-table-get h (iota 10001) #f))))
+  )
+
 ;;------------------------------------------------------------------
 (test-section "eq?-hash")
 
@@ -327,6 +351,21 @@
          (hash-table-delete! h-string "d")
          (hash-table-get h-string "d" #f)))
 
+;; String hash reads the string in chunks; check keys of various lengths
+;; differing only at the first or last byte.
+(let ([h (make-hash-table 'string=?)]
+      [keys (append-map (^n (if (zero? n)
+                              '("")
+                              (list (make-string n #\a)
+                                    (string-append "b" (make-string (- n 1) #\a))
+                                    (string-append (make-string (- n 1) #\a) "b"))))
+                        (iota 120))])
+  (for-each (^[k i] (hash-table-put! h k i)) keys (iota (length keys)))
+  (test* "string keys of various lengths" (iota (length keys))
+         (map (cut hash-table-get h <> #f) keys))
+  (test* "string hash of equal strings" #t
+         (every (^k (= (string-hash k) (string-hash (string-copy k)))) keys)))
+
 ;;------------------------------------------------------------------
 (test-section "generic hash")
 
@@ -411,6 +450,121 @@
          (list (assoc "a" a)
                (assoc "b" a))))
 
+;;------------------------------------------------------------------
+(test-section "open addressing layout")
+
+(define (oa-test type keys)
+  (let ([h (make-hash-table type 0 'open-addressing)]
+        [n (length keys)])
+    (test* #"~type: layout" 'open-addressing
+           (get-keyword :layout (hash-table-stat h)))
+    (for-each (^[k i] (hash-table-put! h k i)) keys (iota n))
+    (test* #"~type: put/get" (iota n)
+           (map (cut hash-table-get h <>) keys))
+    (test* #"~type: num-entries" n (hash-table-num-entries h))
+    ;; delete every other key
+    (for-each (^[k i] (when (even? i) (hash-table-delete! h k)))
+              keys (iota n))
+    (test* #"~type: delete" (map (^i (if (even? i) 'none i)) (iota n))
+           (map (cut hash-table-get h <> 'none) keys))
+    ;; reinsert, reusing deleted slots
+    (for-each (^[k i] (when (even? i) (hash-table-put! h k (- i))))
+              keys (iota n))
+    (test* #"~type: reinsert" (map (^i (if (even? i) (- i) i)) (iota n))
+           (map (cut hash-table-get h <>) keys))
+    (test* #"~type: iterate" (sort (map (^i (if (even? i) (- i) i)) (iota n)))
+           (sort (hash-table-values h)))
+    (let1 h2 (hash-table-copy h)
+      (hash-table-clear! h)
+      (test* #"~type: clear" 0 (hash-table-num-entries h))
+      (test* #"~type: copy" n (hash-table-num-entries h2))
+      (test* #"~type: copy contents" (- (- n 2))
+             (hash-table-get h2 (list-ref keys (- n 2)))
+             =))))
+
+(oa-test 'eq? (map (^i (string->symbol #"k~i")) (iota 1000)))
+(oa-test 'eqv? (map (^i (* i 1.5)) (iota 1000)))
+(oa-test 'string=? (map (^i #"k~i") (iota 1000)))
+
+(test* "open addressing: update! inserting entries" '(1000 100)
+       (let1 h (make-hash-table 'eq? 0 'open-addressing)
+         (hash-table-update! h 'x
+                             (^v (dotimes [i 999] (hash-table-put! h i i))
+                                 (+ v 99))
+                             1)
+         (list (hash-table-num-entries h) (hash-table-get h 'x))))
+
+(test* "open addressing: equal? hash" (test-error)
+       (make-hash-table 'equal? 0 'open-addressing))
+(test* "chained layout" 'chained
+       (get-keyword :layout
+                    (hash-table-stat (make-hash-table 'eq? 0 'chained))))
+
+;;------------------------------------------------------------------
+(test-section "incremental extension")
+
+;; A chained table with 4096 or more buckets is extended incrementally.
+;; With the default initial size, the table is being extended right
+;; after the 49152nd entry is added.
+(let ([h (make-hash-table 'eqv?)]
+      [n 60000])
+  (dotimes [i 49160] (hash-table-put! h i (* i 2)))
+  (test* "extension in progress" #t
+         (integer? (get-keyword :pending-buckets (hash-table-stat h) #f)))
+  (test* "lookup while extending" #t
+         (every (^i (eqv? (hash-table-get h i #f) (* i 2))) (iota 49160)))
+  (test* "iterate while extending" 49160
+         (length (delete-duplicates (hash-table-keys h))))
+  (test* "copy while extending" 49160
+         (let1 h2 (hash-table-copy h)
+           (count (^i (eqv? (hash-table-get h2 i #f) (* i 2))) (iota 49160))))
+  (test* "delete while extending" 24580
+         (begin
+           (dotimes [i 49160] (when (even? i) (hash-table-delete! h i)))
+           (hash-table-num-entries h)))
+  (do ([i 49160 (+ i 1)]) [(= i n)] (hash-table-put! h i (* i 2)))
+  (test* "extension finished" #f
+         (get-keyword :pending-buckets (hash-table-stat h) #f))
+  (test* "lookup after extension" #t
+         (every (^i (eqv? (hash-table-get h i #f)
+                          (and (or (odd? i) (>= i 49160)) (* i 2))))
+                (iota n)))
+  )
+
+;;------------------------------------------------------------------
+(test-section "statistics")
+
+(define (stat-test layout)
+  (let ([h (make-hash-table 'eq? 0 layout)]
+        [keys (map (^i (string->symbol #"stat~i")) (iota 100))])
+    (hash-table-instrument! h)
+    (for-each (^k (hash-table-put! h k k)) keys)
+    (for-each (^k (hash-table-get h k)) keys)
+    (hash-table-get h 'none #f)
+    (let1 st (hash-table-stat h)
+      (test* #"stat ~layout: lookups" 201 (get-keyword :lookups st))
+      (test* #"stat ~layout: probe length" #t
+             (<= 1 (get-keyword :average-probe-length st)
+                 (get-keyword :max-probe-length st)))
+      (test* #"stat ~layout: rehashes" #t
+             (positive? (get-keyword :rehashes st)))
+      (test* #"stat ~layout: collisions" 0 (get-keyword :collisions st))
+      (test* #"stat ~layout: histogram" 100
+             (let1 hist (get-keyword (if (eq? layout 'chained)
+                                       :chain-length-histogram
+                                       :probe-length-histogram)
+                                     st)
+               (if (eq? layout 'chained)
+                 (apply + (map * (vector->list hist)
+                               (iota (vector-length hist))))
+                 (apply + (vector->list hist))))))
+    (hash-table-instrument! h #f)
+    (test* #"stat ~layout: uninstrumented" #f
+           (get-keyword :lookups (hash-table-stat h) #f))))
+
+(stat-test 'chained)
+(stat-test 'open-addressing)
+
 (test-module 'gauche.hashutil) ; autoloaded module
 
 (test-end)
@@ -190,6 +190,127 @@
              (port-fd-dup! (open-input-string "") p1))))
   )) ; !gauche.os.windows
 
+;;-------------------------------------------------------------------
+(test-section "write-chunks")
+
+(test* "write-chunks (string port)" "abc\x01;\x02;def"
+       (call-with-output-string
+         (cut write-chunks `("abc" #u8(1 2) "" "def") <>)))
+
+(test* "write-chunks (vector)" "abcdef"
+       (call-with-output-string (cut write-chunks '#("abc" "def") <>)))
+
+(test* "write-chunks (bad chunk)" (test-error)
+       (call-with-output-string (cut write-chunks '("abc" abc) <>)))
+
+(let ([big (make-string 100000 #\z)])
+  (test* "write-chunks (file port, large)" #t
+         (begin
+           (call-with-output-file "tmp1.o"
+             (^p (display "head" p)
+                 (write-chunks `("[" ,big #u8(93)) p)
+                 (display "tail" p)))
+           (equal? (call-with-input-file "tmp1.o" port->string)
+                   (string-append "head[" big "]tail"))))
+  (test* "write-chunks (file port, many)" #t
+         (let1 chunks (map (^i (number->string i)) (iota 3000))
+           (call-with-output-file "tmp1.o" (cut write-chunks chunks <>))
+           (equal? (call-with-input-file "tmp1.o" port->string)
+                   (apply string-append chunks))))
+  (test* "large write-string bypassing buffer" #t
+         (begin
+           (call-with-output-file "tmp1.o"
+             (^p (display "head" p) (display big p) (display "tail" p)))
+           (equal? (call-with-input-file "tmp1.o" port->string)
+                   (string-append "head" big "tail")))))
+
+(sys-unlink "tmp1.o")
+
+;;-------------------------------------------------------------------
+(test-section "port confinement")
+
+(test* "port-confined? (private string port)" '(#t #f)
+       (list (port-confined? (open-output-string :private? #t))
+             (port-confined? (open-output-string))))
+
+(test* "port-confine!" '(#t "abc")
+       (let1 p (open-output-string)
+         (port-confine! p)
+         (port-confine! p)              ; idempotent
+         (write-string "abc" p)
+         (list (port-confined? p) (get-output-string p))))
+
+(test* "read-string on confined port" '("ab" "cd" "e" #t)
+       (let1 p (open-input-string "abcde")
+         (port-confine! p)
+         (list (read-string 2 p) (read-string 2 p) (read-string 2 p)
+               (eof-object? (read-string 2 p)))))
+
+;;-------------------------------------------------------------------
+(test-section "output string ports")
+
+;; Exercise the growth of the buffer across the single-chunk limit
+;; and the chained chunks.
+(let ()
+  (define (t size)
+    (let1 s (make-string size #\a)
+      (test* #"with-output-to-string (~size)" size
+             (string-length
+              (with-output-to-string
+                (^[] (dotimes [i size] (write-char #\a))))))
+      (test* #"call-with-output-string (~size)" s
+             (call-with-output-string
+               (^p (dotimes [i (quotient size 10)] (write-string "aaaaaaaaaa" p))
+                   (dotimes [i (remainder size 10)] (write-char #\a p)))))))
+  (for-each t '(0 1 31 32 33 100 4000 70000 200000 3000000)))
+
+(test* "get-output-string doesn't empty the port" '("abc" "abcdef")
+       (let1 p (open-output-string)
+         (write-string "abc" p)
+         (let1 s1 (get-output-string p)
+           (write-string "def" p)
+           (list s1 (get-output-string p)))))
+
+(test* "result of with-output-to-string is independent" '("xyz" "xyz" "12345")
+       (let* ([s1 (with-output-to-string (^[] (display "xyz")))]
+              [s2 (string-copy s1)]
+              [s3 (with-output-to-string (^[] (display 12345)))])
+         (list s1 s2 s3)))
+
+;; The port passed to the thunk may escape.  Taking the result must
+;; not empty it, nor let later output clobber the result.
+(let ()
+  (define (t size)
+    (let* ([q #f]
+           [s (call-with-output-string
+                (^p (set! q p) (write-string (make-string size #\a) p)))])
+      (test* #"escaped call-with-output-string port (~size)"
+             (list #t #t (+ size 3))
+             (let1 s1 (get-output-string q)
+               (write-string "bcd" q)
+               (list (equal? s (make-string size #\a))
+                     (equal? s1 s)
+                     (string-length (get-output-string q)))))))
+  (for-each t '(0 3 100 4000 70000)))
+
+(test* "escaped with-output-to-string port" '("abc" "abc" "abcdef")
+       (let* ([q #f]
+              [s (with-output-to-string
+                   (^[] (set! q (current-output-port)) (display "abc")))])
+         (let1 s1 (get-output-string q)
+           (write-string "def" q)
+           (list s s1 (get-output-string q)))))
+
+(test* "multibyte content" (make-string 5000 #\u3042)
+       (with-output-to-string
+         (^[] (dotimes [i 5000] (write-char #\u3042)))))
+
+(test* "number->string (pooled port)" '("123" "-7b" "1.5" "abc1.5")
+       (list (number->string 123)
+             (number->string -123 16)
+             (number->string 1.5)
+             (format #f "abc~a" (number->string 1.5))))
+
 ;;-------------------------------------------------------------------
 (test-section "input ports")
 
@@ -281,6 +402,18 @@
                     [c3 (peek-char _)])
                (list l1 l2 l3 (eof-object? c3))))))
 
+;; long lines span several DString chunks, which are released after use.
+(let1 lines (map (^c (make-string 20000 c)) '(#\a #\b #\c))
+  (with-output-to-file "tmp1.o" (^[] (for-each print lines)))
+  (test* "read-line (long lines)" lines
+         (call-with-input-file "tmp1.o"
+           (^p (let loop ([r '()])
+                 (gc)
+                 (let1 l (read-line p)
+                   (if (eof-object? l) (reverse r) (loop (cons l r))))))))
+  (test* "read (long string literals)" lines
+         (read (open-input-string (write-to-string lines)))))
+
 (with-output-to-file "tmp1.o"
   (cut for-each write-byte '(#x80 #xff #x80 #xff #x80 #x0d #x0a #x0d #x0a)))
 (test* "read-line (bad sequence)" '(5 0)
@@ -413,6 +546,187 @@
                  (write-char (read-char) (current-error-port))))))
          (list (get-output-string o0) (get-output-string o1))))
 
+;;-------------------------------------------------------------------
+(test-section "buffer size")
+
+(sys-unlink "test.o")
+
+(test* "default buffer size" '(8192 #f)
+       (list (call-with-output-file "test.o" (cut slot-ref <> 'buffer-size))
+             (slot-ref (open-input-string "") 'buffer-size)))
+
+(test* "small output buffer" '(16 "0123456789012345678901234567890123456789")
+       (let1 n (call-with-output-file "test.o"
+                 (^p (dotimes [i 40] (display (modulo i 10) p))
+                     (slot-ref p 'buffer-size))
+                 :buffer-size 16)
+         (list n (call-with-input-file "test.o" port->string))))
+
+(test* "small input buffer" '(7 "0123456789012345678901234567890123456789")
+       (call-with-input-file "test.o"
+         (^p (list (slot-ref p 'buffer-size) (port->string p)))
+         :buffer-size 7))
+
+(test* "recycled buffers" #t
+       (let loop ([i 0])
+         (or (= i 100)
+             (and (equal? (call-with-input-file "test.o" read-line)
+                          "0123456789012345678901234567890123456789")
+                  (loop (+ i 1))))))
+
+;; With a small buffer, lines and CRLFs straddle the buffer boundary.
+(let ([data "ab\r\ncdefgh\rijklmnopqrst\r\n\r\nuv\r"]
+      [lines '("ab" "cdefgh" "ijklmnopqrst" "" "uv")])
+  (with-output-to-file "test.o" (cut display data))
+  (dolist [bs '(1 2 3 7 64)]
+    (test* #"read-line (buffer-size ~bs)" (list lines 6)
+           (call-with-input-file "test.o"
+             (^p (let loop ([r '()])
+                   (let1 l (read-line p)
+                     (if (eof-object? l)
+                       (list (reverse r) (port-current-line p))
+                       (loop (cons l r))))))
+             :buffer-size bs)))
+  (test* "read-line (string port)" lines
+         (port->list read-line (open-input-string data))))
+
+(test* "read-line (multibyte, small buffer)" '("いろは" "にほへと" "ち")
+       (begin
+         (with-output-to-file "test.o" (cut display "いろは\nにほへと\nち"))
+         (call-with-input-file "test.o" (cut port->list read-line <>)
+           :buffer-size 2)))
+
+(sys-unlink "test.o")
+
+(test-section "read-until-delimiter")
+
+(let ()
+  (define (tokens port)
+    (let loop ([r '()])
+      (let1 s (read-until-delimiter #[,;] port)
+        (if (eof-object? s)
+          (reverse r)
+          (let1 d (read-char port)
+            (loop (cons (if (eof-object? d) s (list s d)) r)))))))
+  (test* "read-until-delimiter (string)" '(("a" #\,) ("bc" #\;) ("" #\,) "d")
+         (tokens (open-input-string "a,bc;,d")))
+  (test* "read-until-delimiter (empty)" '() (tokens (open-input-string "")))
+  (with-output-to-file "test.o" (cut display "abc,defgh;ijk\nlm,"))
+  (dolist [bs '(1 2 5 64)]
+    (test* #"read-until-delimiter (buffer-size ~bs)"
+           '(("abc" #\,) ("defgh" #\;) ("ijk\nlm" #\,))
+           (call-with-input-file "test.o" tokens :buffer-size bs)))
+  (test* "read-until-delimiter (line count)" 2
+         (call-with-input-file "test.o"
+           (^p (tokens p) (port-current-line p))))
+  (test* "read-until-delimiter (ungotten)" '("abc" #\,)
+         (call-with-input-file "test.o"
+           (^p (peek-char p)
+               (let1 s (read-until-delimiter #[,] p)
+                 (list s (read-char p))))))
+  (with-output-to-file "test.o" (cut display "いろは、にほへと。ちりぬ"))
+  (dolist [bs '(1 2 64)]
+    (test* #"read-until-delimiter (multibyte, buffer-size ~bs)"
+           '(("いろは" #\、) ("にほへと" #\。) "ちりぬ")
+           (call-with-input-file "test.o"
+             (^p (let loop ([r '()])
+                   (let1 s (read-until-delimiter #[、。] p)
+                     (if (eof-object? s)
+                       (reverse r)
+                       (let1 d (read-char p)
+                         (loop (cons (if (eof-object? d) s (list s d))
+                                     r)))))))
+             :buffer-size bs)))
+  (test* "read-until-delimiter (complement)" "  "
+         (read-until-delimiter #[^\s] (open-input-string "  x ")))
+  (sys-unlink "test.o"))
+
+;;-------------------------------------------------------------------
+(test-section "port statistics")
+
+(test* "port-statistics (disabled)" #f
+       (call-with-output-file "test.o"
+         (^p (display "abc" p) (flush p) (port-statistics p))))
+
+(let ()
+  (define (stat-of thunk . keys)
+    (port-statistics-start)
+    (let1 s (unwind-protect (port-statistics (thunk)) (port-statistics-stop))
+      (map (cut get-keyword <> s) keys)))
+  (define (writer buffering)
+    (^[] (call-with-output-file "test.o"
+           (^p (dotimes [i 40] (display (modulo i 10) p)) p)
+           :buffering buffering)))
+  (test* "port-statistics (output, full)" '(40 1 :full)
+         (stat-of (writer :full) :bytes-written :syscalls :buffering))
+  (test* "port-statistics (output, none)" '(40 40)
+         (stat-of (writer :none) :bytes-written :syscalls))
+  (test* "port-statistics (input)" '(40)
+         (stat-of (^[] (call-with-input-file "test.o"
+                         (^p (port->string p) p)
+                         :buffer-size 7))
+                  :bytes-read))
+  (test* "port-statistics (buffering change)" 1
+         (car (stat-of (^[] (call-with-output-file "test.o"
+                              (^p (display "x" p)
+                                  (set! (port-buffering p) :none)
+                                  (display "y" p)
+                                  p)))
+                       :buffering-changes))))
+
+(sys-unlink "test.o")
+
+;;-------------------------------------------------------------------
+(test-section "non-blocking ports")
+
+(cond-expand
+ (gauche.os.windows #f)
+ (else
+  (receive (in out) (sys-pipe)
+    (port-nonblocking! in #t)
+    (test* "no data" '(#t #f #f #f #t)
+           (list (port-nonblocking? in)
+                 (read-char in) (read-line in) (read-block 10 in)
+                 (port-would-block? in)))
+    (display "ab\ncd" out)
+    (flush out)
+    (test* "read-line" "ab" (read-line in))
+    (test* "read-line (partial line)" #f (read-line in))
+    (display "e\r\nf" out)
+    (flush out)
+    (test* "read-line (continued)" "cde" (read-line in))
+    (test* "peek-char, read-char" '(#\f #\f #f)
+           (list (peek-char in) (read-char in) (read-char in)))
+    (display "xyz" out)
+    (flush out)
+    (test* "read-block (short read)" #*"xyz" (read-block 10 in))
+    (when (eq? (gauche-character-encoding) 'utf-8)
+      (write-byte #xe3 out)
+      (flush out)
+      (test* "partial multibyte char" #f (read-char in))
+      (write-byte #x81 out)
+      (write-byte #x82 out)
+      (flush out)
+      (test* "partial multibyte char (completed)" #\u3042 (read-char in)))
+
+    (port-nonblocking! out #t)
+    (test* "output doesn't block" '(#t 200000)
+           (let* ([_ (display (make-string 200000 #\a) out)]
+                  [_ (flush out)]
+                  [pending (port-output-pending out)])
+             (list (> pending 0)
+                   (let loop ([n 0])
+                     (let1 r (read-block 65536 in)
+                       (cond [(string? r) (loop (+ n (string-size r)))]
+                             [(zero? (port-output-pending out)) n]
+                             [else (flush out) (loop n)]))))))
+    (display "end" out)
+    (close-output-port out)
+    (test* "EOF" `("end" ,(eof-object))
+           (let1 l (read-line in) (list l (read-line in))))
+    (close-input-port in))
+  )) ; !gauche.os.windows
+
 ;;-------------------------------------------------------------------
 (test-section "seeking")
 
@@ -634,6 +948,46 @@
 
 (sys-unlink "test.o")
 
+;;-------------------------------------------------------------------
+(test-section "mapped input file port")
+
+(sys-unlink "test.o")
+(with-output-to-file "test.o" (cut display "abc\ndef\nghi"))
+
+(let1 p (open-mapped-input-file "test.o")
+  (test* "mapped port read-line" '("abc" "def")
+         (let* ([a (read-line p)] [b (read-line p)]) (list a b)))
+  (test* "mapped port get-remaining-input-string" "ghi"
+         (get-remaining-input-string p))
+  (test* "mapped port seek" #\b
+         (begin (port-seek p 1) (read-char p)))
+  (test* "mapped port view" #u8(100 101 102)
+         (port-mapped-view p 4 7))
+  (test* "mapped port view (default range)" 11
+         (string-size (port-mapped-string p)))
+  (test* "mapped port string" #*"def"
+         (port-mapped-string p 4 7))
+  (test* "mapped port view range check" (test-error)
+         (port-mapped-view p 7 4))
+  (test* "mapped port view survives close" #u8(103 104 105)
+         (let1 v (port-mapped-view p 8)
+           (close-input-port p)
+           (gc)
+           v))
+  (test* "mapped port view on non-mapped port" (test-error)
+         (port-mapped-view (open-input-string "abc"))))
+
+(test* "mapped port (empty file)" #t
+       (begin
+         (sys-unlink "test.o")
+         (with-output-to-file "test.o" (^[] #f))
+         (eof-object? (read-char (open-mapped-input-file "test.o")))))
+
+(test* "mapped port (nonexistent file)" (test-error)
+       (begin
+         (sys-unlink "test.o")
+         (open-mapped-input-file "test.o")))
+
 ;;-------------------------------------------------------------------
 (test-section "format")
 
@@ -781,6 +1135,27 @@
 ;; regression check for format/ss
 (test* "format/ss" "z  " (format/ss "~v,a" 3 'z))
 
+;; compiled format strings and the compiler macro
+(define (format-fn . args) (apply format args))
+(test* "format literal, cached" '("a1" "a2")
+       (list (format "a~d" 1) (format "a~d" 2)))
+(test* "format dest + literal" "x=3" (format #f "x=~a" 3))
+(test* "format port + literal" "x=3"
+       (call-with-output-string (cut format <> "x=~a" 3)))
+(test* "format variable control string" "3"
+       (let1 s "~a" (format s 3)))
+(test* "format variable string + literal arg" "[x]"
+       (let1 s "[~a]" (format s "x")))
+(test* "format controls + literal" "(1 2 ...)"
+       (format (make-write-controls :print-length 2) "~s" '(1 2 3 4)))
+(test* "format mutable control string" '("x" "\"x\"")
+       (let1 s (string-copy "~a")
+         (list (format-fn s "x")
+               (begin (string-set! s 1 #\s)
+                      (format-fn s "x")))))
+(test* "format invalid literal" (test-error) (format "~q" 1))
+(test* "format ~d non-number" "abc" (format "~d" "abc"))
+
 ;;-------------------------------------------------------------------
 (test-section "some corner cases in list reader")
 
@@ -795,6 +1170,59 @@
 (dot-reader-tester "((). .)"  (test-error <read-error>))
 
 
+;;-------------------------------------------------------------------
+(test-section "reader fast path")
+
+;; Tokens that are entirely in the port buffer are scanned directly.
+;; Reading with tiny buffers makes tokens straddle buffer boundaries,
+;; so both paths must agree.
+(define *fast-path-data*
+  "(0 -1 +12 123456789012345678 1234567890123456789012 1.5 -0.25 .5 1.
+    1e3 -2.5e-3 12345678901234567e10 1/3 #x1f +inf.0 -nan.0
+    abc a.b ->x ... + - 1+ |a b| \"\" \"abc\" \"a\\nb\" \"x\ny\"
+    #(a \"b\" 3) (a . b)) ;; comment
+   end")
+
+(define (read-all port)
+  (let loop ([r '()])
+    (let1 x (read port)
+      (if (eof-object? x) (reverse r) (loop (cons x r))))))
+
+(let1 expected (read-all (open-input-string *fast-path-data*))
+  (test* "fast path data" '(0 -1 12 123456789012345678 1234567890123456789012
+                            1.5 -0.25 0.5 1.0 1000.0 -0.0025
+                            1.2345678901234567e26 1/3 31)
+         (take (car expected) 14))
+  (test* "fast path symbols" '(abc a.b ->x ... + - 1+ |a b|)
+         (take (drop (car expected) 16) 8))
+  (test* "fast path strings" '("" "abc" "a\nb" "x\ny" #(a "b" 3) (a . b))
+         (drop (car expected) 24))
+  (sys-unlink "test.o")
+  (with-output-to-file "test.o" (cut display *fast-path-data*))
+  (dolist [bufsiz '(1 2 3 7 8192)]
+    (test* #"buffer size ~bufsiz" expected
+           (call-with-input-file "test.o" read-all :buffer-size bufsiz)
+           (^[a b] (and (equal? (take (car a) 15) (take (car b) 15))
+                        (equal? (drop (car a) 16) (drop (car b) 16))
+                        (nan? (list-ref (car b) 15))
+                        (equal? (cdr a) (cdr b))))))
+  (sys-unlink "test.o"))
+
+(test* "fast path line count" '(foo "a\nb" bar 4)
+       (let1 p (open-input-string "foo\n\"a\nb\"\n\n  bar\n")
+         (let* ([a (read p)] [b (read p)] [c (read p)])
+           (list a b c (port-current-line p)))))
+
+(test* "fast path long word" (make-string 300 #\z)
+       (symbol->string (read-from-string (make-string 300 #\z))))
+
+(test* "fast path case folding" '(abc Abc)
+       (let1 p (open-input-string "#!fold-case ABC #!no-fold-case Abc")
+         (list (read p) (read p))))
+
+(test* "fast path invalid symbol" (test-error)
+       (read-from-string "abc#def"))
+
 ;;-------------------------------------------------------------------
 (test-section "nested multi-line comments")
 
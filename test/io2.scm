@@ -229,6 +229,42 @@
            (loop (+ cnt 1) (list ls))
            (string-length (write-to-string ls)))))
 
+;; 'write' only labels circular structure.  It first tries a cheap
+;; acyclicity check and falls back to the full walk when it fails.
+(test* "write - shared but not circular" "((a b) (a b) #((a b)))"
+       (let1 x '(a b)
+         (write-to-string (list x x (vector x)))))
+(test* "write - long circular cdr" "#0=(0 1 2 3 4 5 6 7 8 9 . #0#)"
+       (let1 x (iota 10)
+         (set-cdr! (last-pair x) x)
+         (write-to-string x)))
+(test* "write - circular cdr after a long prefix" 10018
+       (let* ([y (list 'a 'b)]
+              [x (append (make-list 5000 'x) y)])
+         (set-cdr! (cdr y) y)
+         (string-length (write-to-string x))))
+(test* "write - circular car" "(x #0=(#0# b))"
+       (let1 x (list #f 'b)
+         (set-car! x x)
+         (write-to-string (list 'x x))))
+(test* "write - circular vector" "#0=#(1 (2 #0#))"
+       (let1 v (vector 1 #f)
+         (vector-set! v 1 (list 2 v))
+         (write-to-string v)))
+(test* "write - circular beneath deep nesting" "#0=(((((#0#)))))"
+       (let1 x (list #f)
+         (set-car! x (list (list (list (list x)))))
+         (write-to-string x)))
+(test* "write - circular beneath very deep nesting" 2008
+       (let* ([x (list #f)]
+              [y (let loop ([cnt 0] [ls x])
+                   (if (< cnt 1000) (loop (+ cnt 1) (list ls)) ls))])
+         (set-car! x y)
+         (string-length (write-to-string y))))
+(test* "write - uninterned symbols" "(#:foo #:foo)"
+       (let1 s (string->uninterned-symbol "foo")
+         (write-to-string (list s s))))
+
 ;;---------------------------------------------------------------
 (test-section "format/ss")
 
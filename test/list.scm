@@ -257,6 +257,33 @@
 (test* "delete-duplicates!" '("A" "b" "c" "d" "e")
        (delete-duplicates! '("A" "b" "a" "B" "c" "d" "a" "e") string-ci=?))
 
+;; Longer lists take the hashed path; compare with the linear one.
+(let* ([base (append (iota 50) (map number->string (iota 30))
+                     '((a b) #(1 2) (a b) 3.0 :k :k)
+                     (iota 50 25) (map number->string (iota 30 10)))]
+       [expected (delete-duplicates base (^[a b] (equal? a b)))])
+  (test* "delete-duplicates (long)" expected (delete-duplicates base))
+  (test* "delete-duplicates (long, eqv?)"
+         (delete-duplicates (iota 100 0 1/4)
+                            (^[a b] (eqv? a b)))
+         (delete-duplicates (append (iota 100 0 1/4) (iota 50 0 1/2)) eqv?))
+  (test* "delete-duplicates (long, dotted)" (append (iota 20) 'z)
+         (delete-duplicates (append (list-tabulate 60 (cut modulo <> 20)) 'z)
+                            eqv?))
+  (test* "delete-duplicates! (long)" expected
+         (delete-duplicates! (list-copy base)))
+  (test* "delete-duplicates! (long, eq?)" '(a b c)
+         (delete-duplicates! (list-tabulate 40 (^i (list-ref '(a b c)
+                                                              (modulo i 3))))
+                             eq?)))
+
+;; Equal? on an object without object-hash method falls back to the
+;; linear scan.
+(let ([objs (list-tabulate 30 (^_ (make <object>)))])
+  (test* "delete-duplicates (long, unhashable)" 51
+         (length (delete-duplicates (append (iota 20 0) objs objs
+                                            (iota 20 0) '(z z))))))
+
 (test* "any" #f (any even? '()))
 
 (test* "any" #f (any even? '(1 3)))
@@ -295,6 +322,50 @@
 (test* "every" #t
        (every string->number '("1" "2") '()))
 
+;;--------------------------------------------------------------------------
+(test-section "lists as sets")
+
+(use srfi-1)
+
+;; The set operations use hash tables for long inputs with the
+;; standard equivalence predicates.  Results must be identical to the
+;; linear version, which we get by wrapping the predicate.
+(let ()
+  (define a (append (iota 40) (map number->string (iota 20)) '((x y) #(z))))
+  (define b (append (iota 30 20) (map number->string (iota 10 15)) '((x y))))
+  (define c (iota 25 10 2))
+  (define (lin =) (^[x y] (= x y)))
+  (define-syntax t
+    (syntax-rules ()
+      [(_ name expr =) (test* name (expr (lin =)) (expr =))]))
+
+  (t "lset<=" (cut lset<= <> c (iota 100)) eqv?)
+  (t "lset<=" (cut lset<= <> a b) equal?)
+  (t "lset=" (cut lset= <> a (reverse a)) equal?)
+  (t "lset-adjoin" (cut lset-adjoin <> c 1 2 3 4 5 100 101 100) eqv?)
+  (t "lset-union" (cut lset-union <> a b c) equal?)
+  (t "lset-union!" (^= (lset-union! = (list-copy a) (list-copy b))) equal?)
+  (t "lset-intersection" (cut lset-intersection <> a b c) equal?)
+  (t "lset-intersection!" (^= (lset-intersection! = (list-copy a) b)) equal?)
+  (t "lset-difference" (cut lset-difference <> a b c) equal?)
+  (t "lset-difference!" (^= (lset-difference! = (list-copy a) b c)) equal?)
+  (t "lset-xor" (cut lset-xor <> a b c) equal?)
+  (t "lset-xor!" (^= (lset-xor! = (list-copy a) (list-copy b))) equal?)
+  (t "lset-diff+intersection"
+     (^= (values->list (lset-diff+intersection = a b c))) equal?)
+  (t "lset-union (string=?)"
+     (cut lset-union <> (map number->string (iota 20))
+          (map number->string (iota 20 10)))
+     string=?)
+  (t "lset-intersection (eq?)"
+     (cut lset-intersection <> '(a b c d e f g h i j k l m n o p q r)
+          '(r q p o n m l k z y x))
+     eq?)
+  )
+
+(test* "lset-intersection (long, eqv?)" (iota 40)
+       (lset-intersection eqv? (iota 40) (iota 100)))
+
 ;;--------------------------------------------------------------------------
 (test-section "take and drop")
 
@@ -539,6 +610,23 @@
                  (cdr-cycle (car-cycle 1 2 3) (car-cycle 1 2 3 1 2 3 1))))
   )
 
+;; Deeply nested structures shouldn't consume C stack.
+(let ()
+  (define (nest n leaf)
+    (let loop ([i 0] [r leaf])
+      (if (= i n) r (loop (+ i 1) (if (odd? i) (list r i) (vector i r))))))
+
+  (test* "equal? deep nesting" #t (equal? (nest 50000 'a) (nest 50000 'a)))
+  (test* "equal? deep nesting" #f (equal? (nest 50000 'a) (nest 50000 'b)))
+  (test* "equal? deep nesting" #f (equal? (nest 50000 'a) (nest 49999 'a)))
+  (test* "equal? deep nesting (long)" #t
+         (equal? (nest 300000 "a") (nest 300000 "a")))
+  (test* "equal? uvectors" '(#t #f #t)
+         (list (equal? '#u8(1 2 3) '#u8(1 2 3))
+               (equal? '#s32(1 2 3) '#s32(1 2 4))
+               (equal? '#f64(0.0) '#f64(-0.0))))
+  )
+
 ;;--------------------------------------------------------------------------
 
 (test-section "monotonic-merge")
@@ -391,6 +391,146 @@
 
 (rmrf "test.o")
 
+;; Bytecode cache -----------------------------------
+
+(test-section "bytecode cache")
+
+(sys-mkdir "test.o" #o777)
+(sys-mkdir "test.o/cache" #o777)
+
+(define *bc-expansions* 0)
+(define-macro (bc-expand x) (inc! *bc-expansions*) x)
+
+(define (bc-write-source val . extra)
+  (with-output-to-file "test.o/bc.scm"
+    (^[]
+      (write '(define-module bc-test (export bc-twice)))
+      (write '(select-module bc-test))
+      (write '(define-syntax twice (syntax-rules () [(_ x) (* 2 x)])))
+      (write '(define (bc-twice x) (twice x)))
+      (write '(select-module user))
+      (write `(define bc-data (list (bc-expand ,val) 2.5 1/3 #\a "str"
+                                    '#(1 sym) :key #/a.c/i ,(expt 2 100))))
+      (for-each write extra)
+      (newline))))
+
+(define (bc-load)
+  (load "./test.o/bc.scm")
+  (list *bc-expansions*
+        ((with-module bc-test bc-twice) 21)
+        (map (^x (if (regexp? x) (regexp->string x) x)) bc-data)))
+
+(define (bc-cache-files)
+  (filter #/\.gbc$/ (sys-readdir "test.o/cache")))
+
+(test* "bytecode-cache-directory" "test.o/cache"
+       (begin (bytecode-cache-directory "test.o/cache")
+              (bytecode-cache-directory)))
+
+(bc-write-source 1)
+(test* "load and write cache"
+       `(1 42 (1 2.5 1/3 #\a "str" #(1 sym) :key "a.c" ,(expt 2 100)))
+       (bc-load))
+(test* "cache file" 1 (length (bc-cache-files)))
+(test* "load from cache"
+       `(1 42 (1 2.5 1/3 #\a "str" #(1 sym) :key "a.c" ,(expt 2 100)))
+       (bc-load))
+
+(bc-write-source 2)
+(test* "source changed"
+       `(2 42 (2 2.5 1/3 #\a "str" #(1 sym) :key "a.c" ,(expt 2 100)))
+       (bc-load))
+(test* "load from updated cache" 2 (car (bc-load)))
+
+(bc-write-source 3 '(car '()))
+(test* "error during load" (test-error) (bc-load))
+(test* "reload after failed load" 4
+       (begin (bc-write-source 3) (car (bc-load))))
+(test* "no leftover files" 1
+       (length (remove #/^\.\.?$/ (sys-readdir "test.o/cache"))))
+
+(bytecode-cache-directory #f)
+(rmrf "test.o")
+
+(test-section "image")
+
+(sys-mkdir "test.o" #o777)
+
+(define (img-write-source file . forms)
+  (with-output-to-file file (^[] (for-each write forms) (newline))))
+
+(img-write-source "test.o/img-a.scm"
+                  '(require "test.o/img-b")
+                  '(define img-a (bc-expand 'a)))
+(img-write-source "test.o/img-b.scm"
+                  '(define img-b (bc-expand 'b)))
+
+(test* "save-image" '(2 a b)
+       (begin (set! *bc-expansions* 0)
+              (save-image "test.o/test.img" "test.o/img-a")
+              (list *bc-expansions* img-a img-b)))
+(test* "load-image" '(0 b)
+       (begin (set! *bc-expansions* 0)
+              (set! img-b #f)
+              (load-image "test.o/test.img")
+              (load "./test.o/img-b.scm")
+              (list *bc-expansions* img-b)))
+(test* "image with a modified source" '(1 c)
+       (begin (set! *bc-expansions* 0)
+              (img-write-source "test.o/img-b.scm"
+                                '(define img-b (bc-expand 'c)))
+              (load "./test.o/img-b.scm")
+              (list *bc-expansions* img-b)))
+(test* "not an image" (test-error)
+       (load-image "test.o/img-b.scm"))
+
+(rmrf "test.o")
+
+;;----------------------------------------------------------------
+(test-section "parallel loading")
+
+(cond-expand
+ [gauche.sys.threads
+  (use gauche.preload)
+  (use srfi-1)
+  (define *preload-order* '())
+  (define (preload-module name) (string->symbol #"test-preload.~name"))
+
+  (rmrf "test-preload")
+  (sys-mkdir "test-preload" #o777)
+  ;; a uses b and c, both of which use d.  e is independent.
+  (for-each (^[name deps]
+              (with-output-to-file #"test-preload/~|name|.scm"
+                (^[]
+                  (write `(define-module ,(preload-module name)
+                            ,@(map (^d `(use ,(preload-module d))) deps)))
+                  (write `(with-module user
+                            (push! *preload-order* ,name)))
+                  (when (equal? name "f") (write '(car '())))
+                  (newline))))
+            '("a" "b" "c" "d" "e" "f")
+            '(("b" "c") ("d") ("d") () () ()))
+
+  (test* "module-dependencies" '(test-preload.b test-preload.c)
+         (module-dependencies 'test-preload.a))
+  (test* "module-dependencies (not found)" #f
+         (module-dependencies 'test-preload.nonexistent))
+  (test* "preload-modules" '("a" "b" "c" "d" "e")
+         (let1 r (preload-modules '(test-preload.a test-preload.e)
+                                  :threads 3)
+           (sort (map (^m (string-copy (symbol->string m) 13)) r))))
+  (test* "preload-modules order" #t
+         (let1 order (reverse *preload-order*)
+           (define (pos x) (list-index (cut equal? x <>) order))
+           (and (< (pos "d") (pos "b") (pos "a"))
+                (< (pos "d") (pos "c") (pos "a")))))
+  (test* "preload-modules (loaded)" '()
+         (preload-modules '(test-preload.a)))
+  (test* "preload-modules (error)" (test-error)
+         (preload-modules '(test-preload.f)))
+  (rmrf "test-preload")]
+ [else])
+
 ;; Load-path hook -----------------------------------
 
 (test-section "load-path hook")
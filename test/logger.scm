@@ -79,4 +79,49 @@
       (lambda ()
         (call-with-input-file "test.o" port->string-list)))
 
+(sys-system "rm -f test.o")
+
+;;-------------------------------------------------------------------------
+(test-section "async drain")
+
+(let1 drain (make <async-log-drain> :path "test.o" :prefix ""
+                  :flush-interval #f :batch-size 3)
+  (log-format drain "line ~a" 1)
+  (log-format drain "line ~a" 2)
+  (log-flush drain)
+  (test* "log-flush" '("line 1" "line 2")
+         (call-with-input-file "test.o" port->string-list))
+  (dotimes [i 10] (log-format drain "more ~a" i))
+  (log-close drain)
+  (test* "log-close" 12
+         (length (call-with-input-file "test.o" port->string-list)))
+  (log-format drain "after close")
+  (test* "log-format after log-close" "after close"
+         (last (call-with-input-file "test.o" port->string-list))))
+
+(sys-system "rm -f test.o")
+
+(let1 drain (make <async-log-drain> :path "test.o" :prefix ""
+                  :flush-interval 0.05)
+  (log-format drain "timed")
+  (sys-nanosleep #e5e8)
+  (test* "periodic flush" '("timed")
+         (call-with-input-file "test.o" port->string-list))
+  (log-close drain))
+
+(sys-system "rm -f test.o")
+
+(let1 drain (make <async-log-drain> :path "test.o" :prefix ""
+                  :buffer-size 4 :overflow 'drop)
+  (dotimes [i 1000] (log-format drain "~a" i))
+  (log-close drain)
+  (test* "drop policy" 1000
+         (+ (~ drain'dropped-count)
+            (length (call-with-input-file "test.o" port->string-list)))))
+
+(test* "bad overflow policy" (test-error)
+       (make <async-log-drain> :overflow 'ignore))
+
+(sys-system "rm -f test.o")
+
 (test-end)
@@ -467,6 +467,52 @@
 (test "qq1" '()  (lambda () (qq1 '())))
 (test "qq2" '#() (lambda () (qq2 '())))
 
+;; rules are preselected by the number of arguments
+(define-syntax arity-select
+  (syntax-rules ()
+    [(_) 'zero]
+    [(_ a) 'one]
+    [(_ a b c ...) 'two-or-more]
+    [(_ . rest) 'dotted]))
+
+(test "arity-select" '(zero one two-or-more two-or-more dotted)
+      (lambda ()
+        (list (arity-select) (arity-select 1) (arity-select 1 2)
+              (arity-select 1 2 3) (arity-select 1 . 2))))
+
+;; the same form passed to the expander more than once
+(define-syntax dup-arg
+  (syntax-rules ()
+    [(_ e) (list e e)]))
+(define-syntax swap-inc!
+  (syntax-rules ()
+    [(_ a b) (let ((tmp a)) (set! a b) (set! b (+ tmp 1)))]))
+
+(test "duplicated macro use" '(2 . 3)
+      (lambda ()
+        (let ((x 1) (y 2))
+          (dup-arg (swap-inc! x y))
+          (cons x y))))
+(test "duplicated macro use in different scopes" '(1 2)
+      (lambda ()
+        (list (let ((tmp 1)) (dup-arg tmp) tmp)
+              (let ((tmp 2)) (dup-arg tmp) tmp))))
+
+;; each expansion of the same form introduces its own identifiers
+(define-syntax intro-tmp
+  (syntax-rules ()
+    [(_ e) (let ((tmp e)) tmp)]))
+
+(test "same form expanded twice" '(#t #t #f #f)
+      (lambda ()
+        (let* ([form '(intro-tmp 1)]
+               [x1 (macroexpand-1 form)]
+               [x2 (macroexpand-1 form)]
+               [tmp1 (caar (cadr x1))]
+               [tmp2 (caar (cadr x2))])
+          (list (identifier? tmp1) (identifier? tmp2)
+                (eq? tmp1 tmp2) (eq? (car x1) (car x2))))))
+
 ;; R7RS style alternative ellipsis
 (test-section "alternative ellipsis")
 
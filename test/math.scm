@@ -17,6 +17,22 @@
 (test* "selected prime numbers" *nth-primes*
        (map (^[i] (cons (car i) (list-ref *primes* (car i)))) *nth-primes*))
 
+(test* "primes below 10^6" 78498
+       (length (take-while (cut < <> 1000000) (primes))))
+(test* "small-prime? around 10^12"
+       '(1000000000039 1000000000061 1000000000063 1000000000091)
+       (filter small-prime? (iota 100 1000000000000)))
+
+(test* "small-prime? near the bound"
+       '(#t #f #f #f #t #f)
+       (map small-prime?
+            '(18446744073709551557   ; largest prime below 2^64
+              18446744073709551559
+              3215031751             ; strong pseudoprime to 2, 3, 5, 7
+              3825123056546413051    ; strong pseudoprime to bases up to 37
+              4294967291
+              18446744073709551616)))
+
 (let ([source (make-random-source)])
   (random-source-pseudo-randomize! source 10 20)
   (let1 samples (list-ec (: n 20)
@@ -514,6 +514,63 @@
 
 (test* "builtin inliner bug" 64
        ((with-module builtin-inliner-bug-C ash-3) 7 2))
+
+;;-------------------------------------------------------------------
+(test-section "binding cache")
+
+(define-module bcache-A (export bca) (define bca 'a))
+(define-module bcache-B)
+(define-module bcache-C (extend bcache-B))
+
+(define (bcache-stat key) (get-keyword key (module-binding-cache-stat)))
+
+(test* "cache hit" '(#t #t)
+       (let* ([h0 (bcache-stat :hits)]
+              [v1 (global-variable-ref 'bcache-C 'bcb #f)]
+              [v2 (global-variable-ref 'bcache-C 'bcb #f)])
+         (list (not (or v1 v2)) ((cut > <> h0) (bcache-stat :hits)))))
+(test* "invalidated by define" 'b
+       (let1 e (bcache-stat :epoch)
+         (global-variable-ref 'bcache-C 'bcb #f)
+         (eval '(define bcb 'b) (find-module 'bcache-B))
+         (and (> (bcache-stat :epoch) e)
+              (global-variable-ref 'bcache-C 'bcb #f))))
+(test* "invalidated by import" 'a
+       (begin
+         (global-variable-ref 'bcache-C 'bca #f)
+         (eval '(import bcache-A) (find-module 'bcache-C))
+         (global-variable-ref 'bcache-C 'bca #f)))
+(test* "invalidated by extend" 'a
+       (begin
+         (global-variable-ref 'bcache-B 'bca #f)
+         (eval '(extend bcache-A) (find-module 'bcache-B))
+         (global-variable-ref 'bcache-B 'bca #f)))
+(test* "stat" #t
+       (let1 s (module-binding-cache-stat)
+         (= (get-keyword :lookups s)
+            (+ (get-keyword :hits s) (get-keyword :misses s)))))
+
+;;------------------------------------------------------------------
+(test-section "lazy binding")
+
+;; The subrs defined by define-cproc are bound when the name is first
+;; looked up.  We use gauche.internal, whose table is seldom walked.
+
+(define lazy-bindings
+  (with-module gauche.internal %module-lazy-bindings))
+(define lazy-mod (find-module 'gauche.internal))
+
+(test* "some stubs aren't bound yet" #t
+       (pair? (lazy-bindings lazy-mod)))
+(let1 name (car (lazy-bindings lazy-mod))
+  (test* "bound on first reference" #t
+         (procedure? (global-variable-ref lazy-mod (string->symbol name))))
+  (test* "no longer pending" #f
+         (member name (lazy-bindings lazy-mod)))
+  (test* "module-table binds all" '(#t ())
+         (let1 tab (module-table lazy-mod)
+           (list (hash-table-exists? tab (string->symbol name))
+                 (lazy-bindings lazy-mod)))))
   
 
 
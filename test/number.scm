@@ -46,6 +46,17 @@
          -18446744073709551617)
        (i-tester (exp2 63)))
 
+(test* "decimal fixnums"
+       '("0" "7" "10" "99" "100" "-1" "-10" "-99" "-100" "12345678" "-1234567")
+       (map number->string '(0 7 10 99 100 -1 -10 -99 -100 12345678 -1234567)))
+
+(test* "decimal fixnums roundtrip" #t
+       (every (^n (and (eqv? n (string->number (number->string n)))
+                       (eqv? (- n) (string->number (number->string (- n))))))
+              (list (greatest-fixnum) (least-fixnum)
+                    (quotient (greatest-fixnum) 10)
+                    (* (quotient (greatest-fixnum) 100) 99))))
+
 (test* "around 2^127"
        '(170141183460469231731687303715884105728
          340282366920938463463374607431768211455
@@ -316,6 +327,30 @@
 (test* "flonum reader (zero with big exponent)" '(#t #t)
        (list (= 0.0 (string->number "0e324"))
              (= 0.0 (string->number "0e325"))))
+
+;; Correct rounding in the fast path.  We compare bit patterns.
+(let ()
+  (define (t str mant exp sign)
+    (test* #"flonum reader (rounding) ~str" (vector mant exp sign)
+           (decode-float (string->number str))))
+  (t "0.30000000000000004"      5404319552844596 -54 1)
+  (t "1e23"                     5960464477539062 24 1)
+  (t "8.41e21"                  8020401000976562 20 1)
+  (t "9007199254740993."        4503599627370496 1 1)
+  (t "123456789012345678e-5"    5056790077945679 -12 1)
+  (t "18446744073709551615e-20" 6646139978924579 -55 1)
+  (t "7.038531e-26"             6131425250115584 -136 1)
+  (t "-1.2345678901234567e-100" 4864445165651410 -384 -1)
+  (t "1.7976931348623157e308"   9007199254740991 971 1)
+  (t "2.2250738585072014e-308"  4503599627370496 -1074 1)
+  (t "2.2250738585072011e-308"  4503599627370495 -1074 1)
+  (t "4.9e-324"                 1 -1074 1)
+  (t "2.4703282292062328e-324"  1 -1074 1)
+  )
+(test* "flonum reader (underflow to zero)" '(0.0 #t)
+       (flonum-test "2.4703282292062327e-324"))
+(test* "flonum reader (overflow)" '(+inf.0 #t)
+       (flonum-test "1.7976931348623159e308"))
        
 ;; We used to allow 1#1 to be read as a symbol.  As of 0.9.4, it is an error.
 (test* "padding" '(10.0 #t) (flonum-test "1#"))
@@ -366,6 +401,42 @@
 (test* "no integral part" -0.5 (read-from-string "-.5"))
 (test* "no integral part" 0.5 (read-from-string "+.5"))
 
+;;------------------------------------------------------------------
+(test-section "flonum writer")
+
+;; Values of moderate magnitude are printed with fixed-width integer
+;; arithmetic, others with bignums.  The results must be the same.
+(define (flonum-writer-test name expected x)
+  (test* (format "flonum writer ~a" name) expected (number->string x)))
+
+(flonum-writer-test "0.1" "0.1" 0.1)
+(flonum-writer-test "1/3" "0.3333333333333333" (/. 1 3))
+(flonum-writer-test "2^-60" "8.673617379884035e-19" (expt 2.0 -60))
+(flonum-writer-test "2^70" "1.1805916207174113e21" (expt 2.0 70))
+(flonum-writer-test "2^52" "4.503599627370496e15" (expt 2.0 52))
+(flonum-writer-test "1e21" "1.0e21" 1e21)
+(flonum-writer-test "1e-7" "1.0e-7" 1e-7)
+(flonum-writer-test "123456789012.5" "1.234567890125e11" 123456789012.5)
+(flonum-writer-test "min denormal" "5.0e-324" (expt 2.0 -1074))
+(flonum-writer-test "min normal" "2.2250738585072014e-308" (expt 2.0 -1022))
+(flonum-writer-test "max" "1.7976931348623157e308" 1.7976931348623157e308)
+;; Two shortest candidates are equally close.  We choose the lower one
+;; if the mantissa is even, the upper one otherwise.
+(flonum-writer-test "tie (even)" "9.975914793431517e14"
+                    (inexact 3990365917372607/4))
+(flonum-writer-test "tie (odd)" "1.5993163581683123e15"
+                    (inexact 6397265432673249/4))
+
+(test* "flonum writer roundtrip" '()
+       (let loop ([i 0] [x 1] [r '()])
+         (if (= i 3000)
+           r
+           (let* ([e (- (modulo x 90) 45)]
+                  [v (* (/. (modulo x 1000003) 1000003) (expt 10.0 e))]
+                  [s (number->string v)])
+             (loop (+ i 1) (modulo (+ (* x 69069) 1) 4294967296)
+                   (if (eqv? v (string->number s)) r (cons s r)))))))
+
 ;;------------------------------------------------------------------
 (test-section "exact fractional number")
 
@@ -491,6 +562,41 @@
         "-340282366920938463463374607431768211457")
       (i-tester2 (exp2 127)))
 
+;; large numbers are converted by divide-and-conquer
+(let ()
+  (define (digits n c) (make-string n c))
+  (test* "10^5000" (string-append "1" (digits 5000 #\0))
+         (number->string (expt 10 5000)))
+  (test* "10^5000-1" (digits 5000 #\9)
+         (number->string (- (expt 10 5000) 1)))
+  (test* "-(10^5000+1)" (string-append "-1" (digits 4999 #\0) "1")
+         (number->string (- (+ (expt 10 5000) 1))))
+  (test* "2^20000 in hex" (string-append "1" (digits 5000 #\0))
+         (number->string (expt 2 20000) 16))
+  (test* "7^3000 in radix 7" (string-append "1" (digits 3000 #\0))
+         (number->string (expt 7 3000) 7))
+  (test* "read 10^5000" (expt 10 5000)
+         (string->number (string-append "1" (digits 5000 #\0))))
+  (test* "read 10^5000-1" (- (expt 10 5000) 1)
+         (string->number (digits 5000 #\9)))
+  (test* "read 2^20000-1 in hex" (- (expt 2 20000) 1)
+         (string->number (digits 5000 #\f) 16))
+  (test* "read long decimal" (+ (expt 10 1000) 1/2)
+         (exact (string->number (string-append "#e1" (digits 1000 #\0)
+                                               ".5"))))
+  (dolist [radix '(2 3 10 16 36)]
+    (let loop ([i 0] [x 1] [r '()])
+      (if (< i 3000)
+        (loop (+ i 1) (+ (* x 7919) i) r)
+        (test* (format "roundtrip in radix ~a" radix) #t
+               (every (^x (and (= x (string->number (number->string x radix)
+                                                    radix))
+                               (= (- x) (string->number
+                                         (number->string (- x) radix)
+                                         radix))))
+                      (list x (quotient x 3) (* x x)))))))
+  )
+
 ;;==================================================================
 ;; Conversions
 ;;
@@ -861,6 +967,17 @@
 (test-nan-cmp >)
 (test-nan-cmp >=)
 
+;; comparison in the branch context.  the arguments are local variables,
+;; so these go through LREF-VAL0-BNUMNE and friends.
+(test* "= (branch)" '(#t #f #t #t #f #f #f #f)
+       (map (^[x y] (if (= x y) #t #f))
+            '(1 1 1.0 2 1/2 +nan.0 +nan.0 0)
+            '(1 2 1   2.0 1/3 +nan.0 0 +nan.0)))
+(test* "< (branch)" '(#f #t #f #f #f #t #f)
+       (map (^[x y] (if (< x y) #t #f))
+            '(1 1 1.0 2 1/2 1/3 +nan.0)
+            '(1 2 1   2.0 1/3 0.5 0)))
+
 ;; the following tests combine instructions for comparison.
 (let ((zz #f))
   (set! zz 3.14)  ;; prevent the compiler from optimizing constants
@@ -1184,6 +1301,56 @@
        (list (apply * '(1 11/13)) (apply * '(11/13 1))))
 (test* "ratnum / 1" 11/13
        (apply / '(11/13 1)))
+
+;; results must be in lowest terms
+(test* "ratnum + (common factor)" '(4/15 1/2 1/3 -1/6)
+       (list (+ 1/6 1/10) (- 5/6 1/3) (+ 1/6 1/6) (- 1/6 1/3)))
+(test* "ratnum + (cancel to integer)" '(1 0 3)
+       (list (+ 1/6 5/6) (- 7/10 7/10) (+ 5/4 7/4)))
+(test* "ratnum * (cross cancellation)" '(12 4/3 -1 5)
+       (list (* (/ (expt 2 70) 3) (/ 9 (expt 2 68)))
+             (/ (/ (expt 2 70) 9) (/ (expt 2 68) 3))
+             (* -3/7 7/3)
+             (/ 10 2/1)))
+(test* "ratnum / (negative divisor)" '(-3/2 3/2 -2/3)
+       (list (/ 3/4 -1/2) (/ -3/4 -1/2) (/ -2 3)))
+(test* "ratnum arithmetic (bignum)"
+       '(12157665459056928801/21305403638035851550955090772754432
+         15411671916547527940062634888554533226518912434176/30226801971775055948247051683954096612865741943
+         #t)
+       (let ([x (/ (expt 3 40) (expt 7 30))]
+             [y (/ (expt 7 25) (expt 2 100))])
+         (list (* x y) (/ x y)
+               (= (+ x y) (/ (+ (* (expt 3 40) (expt 2 100)) (expt 7 55))
+                             (* (expt 7 30) (expt 2 100)))))))
+(test* "ratnum / 0" (test-error) (/ 1/2 0))
+
+;;------------------------------------------------------------------
+(test-section "gcd and lcm")
+
+(test* "gcd fixnum" '(6 6 6 1 5 0)
+       (list (gcd 12 18) (gcd -12 18) (gcd 12 -18) (gcd 17 4) (gcd 0 5)
+             (gcd 0 0)))
+(test* "gcd fixnum (powers of 2)" '(64 1024 1)
+       (list (gcd 192 320) (gcd 1024 (* 1024 3)) (gcd 1024 1023)))
+(test* "gcd bignum & fixnum" '(10007 1)
+       (list (gcd (* (expt 3 100) 10007) 10007)
+             (gcd (expt 2 100) 3)))
+(test* "gcd bignum"
+       136597209033761347291753264992985648229247809641387877854699735269383590594939234550668251365376
+       (gcd (* (expt 3 200) (expt 2 70) 10007)
+            (* (expt 3 150) (expt 5 90) (expt 2 65) 10007)))
+(test* "gcd bignum (large common factor)" (- (expt 2 127) 1)
+       (gcd (* (+ (expt 2 200) 1) (- (expt 2 127) 1))
+            (* (- (expt 2 127) 1) (- (expt 2 89) 1))))
+(test* "gcd bignum (consecutive fibonacci)" 1
+       (let loop ([a 1] [b 1] [n 1000])
+         (if (zero? n) (gcd b a) (loop b (+ a b) (- n 1)))))
+(test* "gcd bignum (same abs)" (expt 10 30)
+       (gcd (expt 10 30) (- (expt 10 30))))
+(test* "lcm" '(36 0 #t)
+       (list (lcm 12 18) (lcm 0 5)
+             (= (lcm (expt 2 40) (expt 3 40)) (expt 6 40))))
  
 ;;------------------------------------------------------------------
 (test-section "promotions in addition")
@@ -1247,6 +1414,29 @@
 (test* "big[1]*big[1]->big[2]" (m-result 1345585795375391817)
       (m-tester 1194726677 1126270821))
 
+;; fixnum multiplication around the overflow boundary
+(test* "fix*fix at boundary" (m-result (greatest-fixnum))
+       (m-tester (greatest-fixnum) 1))
+(test* "fix*fix at boundary" (m-result (* 2 (+ (greatest-fixnum) 1)))
+       (m-tester (+ (ash (greatest-fixnum) -1) 1) 4))
+(test* "fix*fix->big at boundary" (- (least-fixnum))
+       (let1 x (least-fixnum) (* x -1)))
+(test* "fix*fix->big at boundary" (expt (least-fixnum) 2)
+       (let1 x (least-fixnum) (* x x)))
+
+;; arithmetic results pushed as arguments (NUMADD2-PUSH etc.)
+(define (arith-args x y)
+  (list (+ x y) (- x y) (* x y) (+ (car (list x)) 1) (- y x) (* y y)))
+(test* "arithmetic in argument position" '(5 -1 6 3 1 9)
+       (arith-args 2 3))
+(test* "arithmetic in argument position" '(5.5 -0.5 7.5 3.5 0.5 9.0)
+       (arith-args 2.5 3.0))
+(test* "arithmetic in argument position"
+       (let1 g (greatest-fixnum)
+         (list (apply + `(,g ,g)) 0 (apply * `(,g ,g))
+               (apply + `(,g 1)) 0 (apply * `(,g ,g))))
+       (let1 g (greatest-fixnum) (arith-args g g)))
+
 ;; Large number multiplication test using Fermat's number
 ;; The decomposition of Fermat's number is taken from
 ;;   http://www.dd.iij4u.or.jp/~okuyamak/Information/Fermat.html
@@ -1273,6 +1463,59 @@
            173462447179147555430258970864309778377421844723664084649347019061363579192879108857591038330408837177983810868451546421940712978306134189864280826014542758708589243873685563973118948869399158545506611147420216132557017260564139394366945793220968665108959685482705388072645828554151936401912464931182546092879815733057795573358504982279280090942872567591518912118622751714319229788100979251036035496917279912663527358783236647193154777091427745377038294584918917590325110939381322486044298573971650711059244462177542540706913047034664643603491382441723306598834177
            ))
 
+;; Karatsuba and Toom-3 multiplication, and recursive division, are
+;; checked against the schoolbook method by multiplying digit by digit.
+(let ()
+  (define (rand-integer nbits seed)   ; deterministic
+    (let loop ([n 0] [x seed] [r 0])
+      (if (>= n nbits)
+        (+ (ash 1 (- nbits 1)) (logand r (- (ash 1 (- nbits 1)) 1)))
+        (let1 x (modulo (+ (* x 6364136223846793005) 1442695040888963407)
+                        (expt 2 64))
+          (loop (+ n 32) x (+ (ash r 32) (ash x -32)))))))
+  (define (mul-by-digits x y)
+    (let loop ([y y] [shift 0] [r 0])
+      (if (zero? y)
+        r
+        (loop (ash y -28) (+ shift 28)
+              (+ r (ash (* x (logand y #xfffffff)) shift))))))
+  (define (check-mul xbits ybits seed)
+    (let ([x (rand-integer xbits seed)]
+          [y (rand-integer ybits (+ seed 1))])
+      (test* (format "large multiplication ~a x ~a bits" xbits ybits)
+             (mul-by-digits x y) (* x y))))
+  (define (check-div qbits dbits seed)
+    (let* ([q (rand-integer qbits seed)]
+           [d (rand-integer dbits (+ seed 1))]
+           [r (quotient (rand-integer dbits (+ seed 2)) 3)])
+      (test* (format "large division ~a / ~a bits" (+ qbits dbits) dbits)
+             (list q r (- q) (- r))
+             (receive (q0 r0) (quotient&remainder (+ (* q d) r) d)
+               (receive (q1 r1) (quotient&remainder (- (+ (* q d) r)) d)
+                 (list q0 r0 q1 r1))))))
+
+  (check-mul 3000 3000 1)
+  (check-mul 2500 7000 3)
+  (check-mul 20000 20000 5)
+  (check-mul 20000 4000 7)
+  (check-mul 70000 70000 9)
+  (check-mul 100003 40009 11)
+  (let1 m (- (expt 2 20000) 1)
+    (test* "large multiplication (carries)"
+           (+ (- (expt 2 40000) (expt 2 20001)) 1)
+           (* m m)))
+
+  (check-div 8000 8000 13)
+  (check-div 20000 9000 15)
+  (check-div 60000 12000 17)
+  (check-div 5000 30000 19)
+  (let1 d (- (expt 2 20000) 1)
+    (test* "large division (carries)"
+           (list (+ (expt 2 20000) 1) 0)
+           (receive (q r) (quotient&remainder (- (expt 2 40000) 1) d)
+             (list q r))))
+  )
+
 ;;------------------------------------------------------------------
 (test-section "multiplication short cuts")
 
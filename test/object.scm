@@ -288,6 +288,69 @@
 (test* "method sorting" 2 (ms-1 "a" "a"))
 (test* "method sorting" 1 (ms-1 "a"))
 
+;;----------------------------------------------------------------
+(test-section "dispatch cache")
+
+;; Generic functions cache sorted applicable methods.  Make sure changes
+;; of the method set after the cache is filled are honored.
+(define-method dc-1 ((x <number>)) 'number)
+(define-method dc-1 ((x <string>)) 'string)
+
+(test* "dispatch cache" '(number string number string)
+       (map dc-1 '(1 "a" 2 "b")))
+(test* "dispatch cache (more args)" '(number 1 2)
+       (begin (define-method dc-1 ((x <number>) y) (list 'number x y))
+              (list (dc-1 3) (cadr (dc-1 1 2)) (caddr (dc-1 1 2)))))
+(test* "dispatch cache (add method)" '(integer string)
+       (begin (define-method dc-1 ((x <integer>)) 'integer)
+              (list (dc-1 1) (dc-1 "a"))))
+(test* "dispatch cache (replace method)" '(int string)
+       (begin (define-method dc-1 ((x <integer>)) 'int)
+              (list (dc-1 1) (dc-1 "a"))))
+(test* "dispatch cache (delete method)" '(number string)
+       (begin (delete-method! dc-1
+                              (find (^m (equal? (~ m'specializers)
+                                                (list <integer>)))
+                                    (~ dc-1'methods)))
+              (list (dc-1 1) (dc-1 "a"))))
+(test* "dispatch cache (many classes)" '(number string number symbol #t)
+       (begin (define-method dc-1 ((x <symbol>)) 'symbol)
+              (define-method dc-1 ((x <boolean>)) x)
+              (map dc-1 '(1 "a" 1.5 a #t))))
+
+;;----------------------------------------------------------------
+(test-section "slot accessor cache")
+
+;; Slot lookup is cached per class; the same slot name may be at
+;; different positions in different classes.
+(define-class <sc-a> () ((p :init-value 'a-p) (q :init-value 'a-q)))
+(define-class <sc-b> () ((q :init-value 'b-q) (r :init-value 'b-r)))
+(define-class <sc-c> (<sc-b> <sc-a>) ((s :accessor s-of :init-value 0)))
+
+(test* "slot accessor cache" '(a-q b-q b-q a-q b-q b-q)
+       (let1 objs (list (make <sc-a>) (make <sc-b>) (make <sc-c>))
+         (append (map (^o (slot-ref o 'q)) objs)
+                 (map (^o (slot-ref o 'q)) objs))))
+(test* "slot accessor cache (set)" '(1 2 3)
+       (let1 objs (list (make <sc-a>) (make <sc-b>) (make <sc-c>))
+         (for-each (^[o v] (slot-set! o 'q v)) objs '(1 2 3))
+         (map (^o (slot-ref o 'q)) objs)))
+(test* "slot accessor cache (accessor)" '(0 5)
+       (let1 c (make <sc-c>)
+         (let1 v (s-of c)
+           (set! (s-of c) 5)
+           (list v (s-of c)))))
+(test* "slot accessor cache (unbound)" (test-error)
+       (let1 c (make <sc-c>)
+         (slot-set! c 's (undefined))
+         (s-of c)))
+
+(define *sc-a* (make <sc-a>))
+(test* "slot accessor cache (before redefinition)" 'a-q (slot-ref *sc-a* 'q))
+(define-class <sc-a> () ((p :init-value 'a-p)))
+(test* "slot accessor cache (redefinition)" 'missing
+       (guard (e [else 'missing]) (slot-ref *sc-a* 'q)))
+
 
 ;;----------------------------------------------------------------
 (test-section "setter method definition")
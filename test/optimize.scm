@@ -64,6 +64,215 @@
 (test* "constant closure identity" #t
        (eq? (make-constant-closure) (make-constant-closure)))
 
+(test-section "guarded inlining")
+
+(define-module guarded-inline-test
+  (export gi-car gi-twice)
+  (define (gi-car p) (car p))
+  (define (gi-twice x) (* x 2)))
+(import guarded-inline-test)
+
+(define (gi-user p) (gi-twice (gi-car p)))
+
+(test* "small procedure is inlined" #t
+       (any (^i (string-scan (symbol->string (caar i)) "CAR"))
+            (proc->insn/split gi-user)))
+(test* "small procedure is inlined (result)" 6 (gi-user '(3)))
+(test* "redefinition is honored" 4
+       (begin (with-module guarded-inline-test
+                (define (gi-car p) (cadr p)))
+              (gi-user '(3 2))))
+(test* "set! is honored" '(2 2)
+       (begin (with-module guarded-inline-test
+                (set! gi-twice (^x (list x 2))))
+              (gi-user '(3 2))))
+
+(test-section "boxing")
+
+;; Mutable local variables are boxed only if closures capture them.
+(test* "uncaptured mutable lvar isn't boxed" '()
+       (filter-insn (^n (let ([s 0.0])
+                          (dotimes [i n] (set! s (+ s 1.5)))
+                          s))
+                    'BOX))
+(test* "uncaptured mutable lvar isn't boxed (result)" 15.0
+       (let ([s 0.0])
+         (dotimes [i 10] (set! s (+ s 1.5)))
+         s))
+(test* "captured mutable lvar is boxed" #t
+       (pair? (filter-insn (^n (let ([s 0.0])
+                                 (for-each (^i (set! s (+ s i))) n)
+                                 s))
+                           'BOX)))
+(test* "captured mutable lvar is boxed (result)" 6.0
+       (let ([s 0.0])
+         (for-each (^i (set! s (+ s i))) '(1 2 3))
+         s))
+(test* "uncaptured mutable lvar and call/cc" '(1.5 3.0 4.5)
+       (let ([s 0.0] [r '()] [k #f])
+         (call/cc (^c (set! k c)))
+         (set! s (+ s 1.5))
+         (set! r (cons s r))
+         (if (< s 4.0) (k #f) (reverse r))))
+(test* "uncaptured mutable lvar in a frame saved by a closure" '(3.0 2.5)
+       (let* ([x 1.0]
+              [f (^[] x)])            ; captures x, but not y
+         (let loop ([y 0.5] [i 0])
+           (if (= i 2)
+             (list (+ (f) 2.0) y)
+             (begin (set! y (+ y 1.0))
+                    (set! x (f))
+                    (loop y (+ i 1)))))))
+
+(test-section "type inference")
+
+(define (unsafe-insns proc)
+  (append-map (cut filter-insn proc <>)
+              '(CAR-UNSAFE CAR-UNSAFE-PUSH LREF-CAR-UNSAFE
+                CDR-UNSAFE CDR-UNSAFE-PUSH LREF-CDR-UNSAFE
+                VEC-REF-UNSAFE VEC-SET-UNSAFE)))
+
+(test* "car after pair? test" #t
+       (pair? (unsafe-insns (^x (if (pair? x) (car x) #f)))))
+(test* "car without test" '()
+       (unsafe-insns (^x (car x))))
+(test* "car in else clause of pair? test" '()
+       (unsafe-insns (^x (if (pair? x) #f (car x)))))
+(test* "car after (not (pair? x))" #t
+       (pair? (unsafe-insns (^x (if (not (pair? x)) #f (car x))))))
+
+(let ()
+  (define (sum-list lis)
+    (let loop ([l lis] [s 0])
+      (if (pair? l) (loop (cdr l) (+ s (car l))) s)))
+  (test* "list loop" #t (pair? (unsafe-insns sum-list)))
+  (test* "list loop (result)" 10 (sum-list '(1 2 3 4)))
+  (test* "list loop (improper)" 3 (sum-list '(1 2 . 3))))
+
+(let ()
+  (define (sum-vec v)
+    (let loop ([i 0] [s 0])
+      (if (< i (vector-length v))
+        (loop (+ i 1) (+ s (vector-ref v i)))
+        s)))
+  (define (fill-vec! v x)
+    (let1 n (vector-length v)
+      (let loop ([i 0])
+        (unless (>= i n)
+          (vector-set! v i x)
+          (loop (+ i 1))))
+      v))
+  (test* "counted vector loop" #t (pair? (unsafe-insns sum-vec)))
+  (test* "counted vector loop (result)" 15 (sum-vec '#(1 2 3 4 5)))
+  (test* "counted vector loop (empty)" 0 (sum-vec '#()))
+  (test* "counted vector loop (not a vector)" (test-error)
+         (sum-vec '(1 2 3)))
+  (test* "counted vector loop with vector-set!" #t
+         (pair? (unsafe-insns fill-vec!)))
+  (test* "counted vector loop with vector-set! (result)" '#(z z z)
+         (fill-vec! (make-vector 3 #f) 'z)))
+
+(test* "index may be negative" '()
+       (unsafe-insns (^(v i) (if (< i (vector-length v)) (vector-ref v i) #f))))
+(test* "index may be negative (result)" (test-error)
+       ((^(v i) (if (< i (vector-length v)) (vector-ref v i) #f))
+        '#(1 2 3) -1))
+(test* "index may be a flonum" (test-error)
+       ((^v (let loop ([i 0.0])
+              (if (< i (vector-length v))
+                (vector-ref v i)
+                #f)))
+        '#(1 2 3)))
+(test* "loop index decremented" '()
+       (unsafe-insns
+        (^v (let loop ([i 0])
+              (when (< i (vector-length v))
+                (vector-ref v i)
+                (loop (- i 1)))))))
+(test* "loop index passed from outside" '()
+       (unsafe-insns
+        (^(v k) (let loop ([i 0])
+                  (when (< i (vector-length v))
+                    (vector-ref v i)
+                    (loop k))))))
+
+(test-section "compile report")
+
+(define (compile-report-of form)
+  (define flag (with-module gauche.internal SCM_COMPILE_REPORT))
+  (define out
+    (call-with-output-string
+      (^p (with-error-to-port p
+            (^[]
+              (unwind-protect
+                  (begin
+                    ((with-module gauche.internal vm-compiler-flag-set!) flag)
+                    ((with-module gauche.internal compile) form
+                     (current-module)))
+                ((with-module gauche.internal vm-compiler-flag-clear!)
+                 flag)))))))
+  (filter (^r (and (pair? r) (eq? (car r) 'compile-report)))
+          (call-with-input-string out (cut port->list read <>))))
+
+(test* "compile report (embed)" '((embed loop #f 1))
+       (map cdr (compile-report-of
+                 '(define (cr-len xs)
+                    (let loop ([xs xs] [n 0])
+                      (if (null? xs) n (loop (cdr xs) (+ n 1))))))))
+(test* "compile report (closure)" '((n))
+       (filter-map (^r (and (eq? (cadr r) 'closure) (list-ref r 4)))
+                   (compile-report-of
+                    '(define (cr-add xs n) (map (^x (+ x n)) xs)))))
+(test* "compile report (lifted)" '(lifted)
+       (filter-map (^r (and (eq? (cadr r) 'lifted) 'lifted))
+                   (compile-report-of
+                    '(define (cr-sq xs) (map (^k (* k k)) xs)))))
+(test* "compile report (local)" '((local f used-as-value))
+       (filter-map (^r (and (eq? (cadr r) 'local) (list (cadr r) (caddr r)
+                                                         (list-ref r 4))))
+                   (compile-report-of
+                    '(define (cr-val n)
+                       (let ([f (^[] n)]) (list f (f)))))))
+
+;;-------------------------------------------------------------------
+(test-section "code memory")
+
+(define (lp-str1) "literal pool test")
+(define (lp-str2) "literal pool test")
+(define (lp-big1) 123456789012345678901234567890)
+(define (lp-big2) 123456789012345678901234567890)
+(define (lp-zero) 0.0)
+(define (lp-negzero) -0.0)
+
+(test* "literal pool (string)" #t (eq? (lp-str1) (lp-str2)))
+(test* "literal pool (bignum)" #t (eq? (lp-big1) (lp-big2)))
+(test* "literal pool (zeros)" '(+inf.0 -inf.0)
+       (list (/ 1 (lp-zero)) (/ 1 (lp-negzero))))
+
+(let* ([flag (with-module gauche.internal SCM_COMPILE_PACK_SOURCE_INFO)]
+       [form '(lambda (x) (if (pair? x) (car x) (list x)))]
+       [plain (eval form (current-module))]
+       [packed (unwind-protect
+                   (begin
+                     ((with-module gauche.internal vm-compiler-flag-set!) flag)
+                     (eval form (current-module)))
+                 ((with-module gauche.internal vm-compiler-flag-clear!) flag))])
+  (test* "pack-source-info" #t
+         (and (pair? (~ (closure-code packed)'debug-info))
+              (equal? (~ (closure-code plain)'debug-info)
+                      (~ (closure-code packed)'debug-info))))
+  (test* "pack-source-info (definition)"
+         ((with-module gauche.internal compiled-code-definition)
+          (closure-code plain))
+         ((with-module gauche.internal compiled-code-definition)
+          (closure-code packed))))
+
+(test* "code-memory-usage" '(user #t)
+       (match (code-memory-usage (list (current-module)))
+         [((name codes . bytes)) (list name (and (positive? codes)
+                                                 (every positive? bytes)))]
+         [x x]))
+
 (test-section "transformation")
 
 ;; pass2 intermediate lref elimination
@@ -312,6 +312,45 @@
       (lambda ()  (call-with-values (lambda () (values 1 2 3)) list)))
 (prim-test "call-with-values" '()
       (lambda ()  (call-with-values (lambda () (values)) list)))
+(prim-test "call-with-values" '(1 2 3 4 5)
+      (lambda ()  (call-with-values (lambda () (values 1 2 3 4 5)) list)))
+(prim-test "call-with-values" '(3 . 4)
+      (lambda ()  (call-with-values (lambda () (values 3 4)) cons)))
+
+;; More values than the value registers
+(define (many-values-list n)
+  (let loop ((i (- n 1)) (r '()))
+    (if (< i 0) r (loop (- i 1) (cons i r)))))
+
+(prim-test "values (many)" (many-values-list 100)
+      (lambda ()  (receive x (apply values (many-values-list 100)) x)))
+(prim-test "values (many, inlined)" '(0 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15
+                                      16 17 18 19 20 21 22 23 24 25)
+      (lambda ()
+        (receive x (values 0 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15
+                           16 17 18 19 20 21 22 23 24 25)
+          x)))
+(prim-test "values (many, fixed arity)" '(0 21 29)
+      (lambda ()
+        (receive (a b c d e f g h i j k l m n o p q r s t u v w x y z aa bb cc dd)
+            (apply values (many-values-list 30))
+          (list a v dd))))
+(prim-test "call-with-values (many)" 1000
+      (lambda ()
+        (call-with-values (lambda () (apply values (many-values-list 1000)))
+          (lambda args (length args)))))
+(prim-test "call/cc (many values)" (many-values-list 50)
+      (lambda ()
+        (receive x (call-with-current-continuation
+                    (lambda (k) (apply k (many-values-list 50))))
+          x)))
+(prim-test "dynamic-wind (many values)" (many-values-list 40)
+      (lambda ()
+        (receive x (apply dynamic-wind
+                          (list (lambda () #f)
+                                (lambda () (apply values (many-values-list 40)))
+                                (lambda () (values 'a 'b))))
+          x)))
 
 ;; This is not 'right' in R5RS sense---for now, I just tolerate it
 ;; by CommonLisp way, i.e. if more than one value is passed to an
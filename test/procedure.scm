@@ -567,4 +567,24 @@
                                              (cut read x) (cut read y)))
                  (^_ r)))
 
+;;-----------------------------------------------------------------------
+;; perf map
+
+(test-section "perf map")
+
+(define (perf-map-test-proc x) (+ x 1))
+
+(let ([file "tmp.perf-map"])
+  (when (file-exists? file) (sys-unlink file))
+  (test* "perf-map-start" file (perf-map-start file))
+  (test* "perf-map-running?" #t (perf-map-running?))
+  (test* "call" 2 (perf-map-test-proc 1))
+  (perf-map-stop)
+  (test* "perf-map-running?" #f (perf-map-running?))
+  (test* "recorded" #t
+         (and (any #/^[0-9a-f]+ [0-9a-f]+ perf-map-test-proc$/
+                   (with-input-from-file file port->string-list))
+              #t))
+  (sys-unlink file))
+
 (test-end)
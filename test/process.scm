@@ -206,6 +206,34 @@
               )
          (equal? s s1)))
 
+(test* "run-process (swapping fds)" #t
+       (let* ((p  (run-process (cmd cat "NoSuchFile")
+                               :redirects '((> 1 out) (>& 2 1))))
+              (s  (port->string (process-output p 'out))))
+         (process-wait p)
+         (and (string? s) (not (string-null? s)))))
+
+(cond-expand
+ [gauche.os.windows]
+ [else
+  (test* "run-process (directory)" "test.o.d\n"
+         (begin
+           (rmrf "test.o.d")
+           (sys-mkdir "test.o.d" #o755)
+           (touch "test.o.d/test.o.d")
+           (unwind-protect
+               (let* ((p (run-process (cmd ls) :directory "test.o.d"
+                                      :output :pipe))
+                      (s (port->string (process-output p))))
+                 (process-wait p)
+                 s)
+             (rmrf "test.o.d"))))
+
+  (test* "run-process (nonexistent program)" #f
+         (let1 p (run-process '("./no-such-program.o") :error *nulldev*)
+           (process-wait p)
+           (eqv? (process-exit-status p) 0)))])
+
 ;; NB: how to test :wait and :fork?
 
 (test* "process-kill" SIGKILL
@@ -253,6 +281,33 @@
 (test* "process-list" '()
        (process-list))
 
+(test* "process-reap" '(0 0 0 ())
+       (let1 ps (list-tabulate 3 (^_ (run-process (cmd ls) :output *nulldev*)))
+         (let loop ([reaped '()])
+           (if (= (length reaped) 3)
+             (append (map process-exit-status ps) (list (process-list)))
+             (begin (sys-nanosleep #e1e7)
+                    (loop (append (process-reap) reaped)))))))
+
+(cond-expand
+ [gauche.os.windows]
+ [else
+  (test* "process-exit-port" '(#t 0)
+         (let* ([port (process-exit-port)]
+                [p (run-process (cmd ls) :output *nulldev*)]
+                [fds (make <sys-fdset>)])
+           (sys-fdset-set! fds port #t)
+           ;; the SIGCHLD handler makes the port ready
+           (let loop ()
+             (receive (n r w x) (sys-select fds #f #f 5000000)
+               (if (zero? n)
+                 (list #f #f)
+                 (let1 reaped (process-reap)
+                   (if (null? reaped)
+                     (loop)
+                     (list (and (memq p reaped) #t)
+                           (process-exit-status p)))))))))])
+
 ;;-------------------------------
 (test-section "pipeline")
 
@@ -890,6 +890,93 @@
        (list (match 'after) (match 'after 1) (match 'after 'int)
              (match 'before) (match 'before 2) (match 'before 'frac)))
 
+;;-------------------------------------------------------------------------
+(test-section "regexp with range")
+
+(test* "rxmatch with start" '("34" 2 4)
+       (let1 m (rxmatch #/\d+/ "1a34b" 1)
+         (list (rxmatch-substring m) (rxmatch-start m) (rxmatch-end m))))
+(test* "rxmatch with start and end" "3"
+       (rxmatch-substring (rxmatch #/\d+/ "1a34b" 1 3)))
+(test* "rxmatch with range (anchors)" '("34" #f)
+       (list (rxmatch-substring (rxmatch #/^\d+$/ "1a34b" 2 4))
+             (rxmatch #/^\d+/ "1a34b" 1)))
+(test* "rxmatch with cursors" '("bc" "d")
+       (let* ([s "abcd"]
+              [m (rxmatch #/b./ s (string-cursor-start s))])
+         (list (rxmatch-substring m)
+               (substring/cursors s (rxmatch-end-cursor m)
+                                  (string-cursor-end s)))))
+(test* "rxmatch-start-cursor" 1
+       (let1 s "abcd"
+         (string-cursor->index s (rxmatch-start-cursor (rxmatch #/b/ s)))))
+(test* "rxmatch with range (out of range)" (test-error)
+       (rxmatch #/a/ "abc" 4))
+
+;;-------------------------------------------------------------------------
+(test-section "non-backtracking matcher")
+
+;; These would take exponential time with the backtracking matcher.
+(test* "pathological (a|aa)*c" #f
+       (rxmatch #/(a|aa)*c/ (make-string 100 #\a)))
+(test* "pathological (a|aa)*c" '("aaaac" "a")
+       (rxmatch-substrings (rxmatch #/(a|aa)*c/ "baaaac")))
+(test* "pathological (x+x+)+y" #f
+       (rxmatch #/(x+x+)+y/ (make-string 100 #\x)))
+(test* "pathological, replace-all" "-b-b"
+       (regexp-replace-all #/(a|aa)*b/ "aaaaabaab" "-b"))
+
+;; Prepending a lookahead assertion forces the backtracking matcher;
+;; both matchers should agree on submatches.
+(let ()
+  (define (check pat str)
+    (let ([rx1 (string->regexp pat)]
+          [rx2 (string->regexp #"(?=.*)(?:~|pat|)")])
+      (test* #"~|pat| ~|str|"
+             (cond [(rxmatch rx2 str) => rxmatch-positions] [else #f])
+             (cond [(rxmatch rx1 str) => rxmatch-positions] [else #f]))))
+  (check "(a|ab)(c|bcd)(d*)" "abcd")
+  (check "(a|ab)(c|bcd)(d*)" "xxabcdd")
+  (check "(a*)(b|abc)" "aabcx")
+  (check "(a+?)(a*)" "aaa")
+  (check "((a)|b)*" "abab")
+  (check "x(\\d{2,3})*?y" "x12345y")
+  (check "^ab|b$" "abab")
+  (check "a$|b" "xa$ba")
+  (check "(?i:ab)c" "xABcABC")
+  (check "[^a-c]+" "aaxyzb")
+  (check "(?i)い+ろ" "いいいろは")
+  (check "[あ-う]*え" "あいうえお")
+  (check "" "abc")
+  )
+
+;;-------------------------------------------------------------------------
+(test-section "skipping input")
+
+;; Exercise the paths that skip input by the first characters
+;; of the match.  Patterns with a backreference use the backtracking
+;; matcher.
+(let ([pad (make-string 1000 #\z)])
+  (test* "literal prefix" 1001
+         (rxmatch-start (rxmatch #/xyz*/ #"~|pad|xxyzz")))
+  (test* "literal prefix (no match)" #f
+         (rxmatch #/xyz*/ #"~|pad|xxzy"))
+  (test* "literal prefix, last char" 1000
+         (rxmatch-start (rxmatch #/xy?/ #"~|pad|x")))
+  (test* "single char laset" '(1000 "aab")
+         (let1 m (rxmatch #/a+b/ #"~|pad|aab")
+           (list (rxmatch-start m) (rxmatch-substring m))))
+  (test* "charset laset" '(1000 "1x")
+         (let1 m (rxmatch #/[0-9]x|[a-c]y/ #"~|pad|1x")
+           (list (rxmatch-start m) (rxmatch-substring m))))
+  (test* "charset laset, backtracking" "b1b"
+         (rxmatch-substring (rxmatch #/([a-c])1\1/ #"~|pad|a1cb1b")))
+  (test* "simple prefix, backtracking" "xxx1aa"
+         (rxmatch-substring (rxmatch #/x+1(a)\1/ #"xx2x~|pad|xxx1aa")))
+  (test* "replace-all" "zz-zz-"
+         (regexp-replace-all #/ab(c)?/ "zzabzzabc" "-"))
+  )
+
 ;;-------------------------------------------------------------------------
 (test-section "regexp quote")
 
@@ -897,6 +984,108 @@
        (let ((str "^(#$%#}{)\\-+?^$"))
          (regmatch? (rxmatch (string->regexp (regexp-quote str)) str))))
 
+;;-------------------------------------------------------------------------
+(test-section "literal alternation")
+
+;; Alternations of four or more literal strings are matched by
+;; a string searcher.  They must behave just like the other matchers.
+(let ()
+  (define (t rx str)
+    (cond [(rxmatch rx str)
+           => (^m (list (rxmatch-start m) (rxmatch-substring m)))]
+          [else #f]))
+  (test* "literal alternation" '(3 "bar")
+         (t #/foo|bar|baz|qux/ "xx bar baz"))
+  (test* "literal alternation (no match)" #f
+         (t #/foo|bar|baz|qux/ "fo ba qu"))
+  (test* "literal alternation (earlier alternative)" '(0 "foo")
+         (t #/foo|foobar|fo|f/ "foobar"))
+  (test* "literal alternation (earlier alternative)" '(0 "foobar")
+         (t #/foobar|foo|fo|f/ "foobar"))
+  (test* "literal alternation (leftmost)" '(1 "o")
+         (t #/foobar|bar|o|a/ "xoobar"))
+  (test* "literal alternation (single chars)" '(2 "c")
+         (t #/a|b|c|d/ "xyc"))
+  (test* "literal alternation (multibyte)" '(2 "うえ")
+         (t #/うえ|かき|さし|たち/ "あいうえお"))
+  (test* "literal alternation (range)" '(4 "baz")
+         (let1 m (rxmatch #/foo|bar|baz|qux/ "bar baz" 1)
+           (list (rxmatch-start m) (rxmatch-substring m))))
+  (test* "literal alternation (case fold)" '(3 "BAR")
+         (t #/foo|bar|baz|qux/i "xx BAR"))
+  (test* "literal alternation (replace-all)" "<a> <b> <c> <d> e"
+         (regexp-replace-all #/a|b|c|d/ "a b c d e" "<\\0>"))
+  )
+
+(test-section "regexp-union")
+
+(test* "regexp-union (strings)" '("banana" "a.b")
+       (list (rxmatch-substring
+              (rxmatch (regexp-union '("apple" "banana" "cherry" "a.b"))
+                       "I like a banana."))
+             (rxmatch-substring
+              (rxmatch (regexp-union '("apple" "banana" "cherry" "a.b"))
+                       "axb or a.b"))))
+(test* "regexp-union (regexps)" '("123" "abc")
+       (let1 rx (regexp-union (list #/\d+/ "abc" #/x(y)z/))
+         (list (rxmatch-substring (rxmatch rx "-123-"))
+               (rxmatch-substring (rxmatch rx "--abc-123")))))
+(test* "regexp-union (case fold)" "ABC"
+       (rxmatch-substring (rxmatch (regexp-union (list "foo" #/abc/i))
+                                   "xABC")))
+(test* "regexp-union (empty)" (test-error) (regexp-union '()))
+
+;;-------------------------------------------------------------------------
+(test-section "regexp cache")
+
+(test* "cached" #t
+       (eq? (string->regexp "ca(ch)+e") (string->regexp "ca(ch)+e")))
+(test* "cached (case-fold)" '(#t #f)
+       (let ([rx1 (string->regexp "cache" :case-fold #t)]
+             [rx2 (string->regexp "cache")])
+         (list (eq? rx1 (string->regexp "cache" :case-fold #t))
+               (eq? rx1 rx2))))
+(test* "cached (mutated pattern)" '("cache" #f)
+       (let* ([pat (string-copy "cache")]
+              [rx1 (string->regexp pat)])
+         (string-set! pat 0 #\n)
+         (list (rxmatch-substring (rxmatch rx1 "a cache"))
+               (rxmatch (string->regexp pat) "a cache"))))
+(test* "cache overflow" #t
+       (every (^i (let1 pat (format "x~ay" i)
+                    (regmatch? (rxmatch (string->regexp pat)
+                                        (format "--x~ay--" i)))))
+              (append (iota 200) (iota 200))))
+
+(test-section "regexp-matches?")
+
+(let ()
+  (define (t rx str . opts)
+    (list (apply regexp-matches? rx str opts)
+          (boolean (apply rxmatch rx str opts))))
+  (test* "matches? (automaton)" '((#t #t) (#f #f))
+         (list (t #/a[bc]+d/ "xxabcbd") (t #/a[bc]+d/ "xxabcb")))
+  (test* "matches? (backtracking)" '((#t #t) (#f #f))
+         (list (t #/(a+)b\1/ "xaabaa") (t #/(a+)b\1/ "xaabc")))
+  (test* "matches? (anchored)" '((#t #t) (#f #f))
+         (list (t #/^(?=ab)a/ "abc") (t #/^(?=ab)a/ "acb")))
+  (test* "matches? (many groups)" '((#t #t) (#f #f))
+         (list (t #/(a)(b)(c)(d)(e)(f)(g)(h)(i)\9/ "abcdefghii")
+               (t #/(a)(b)(c)(d)(e)(f)(g)(h)(i)\9/ "abcdefghih")))
+  (test* "matches? (literals)" '((#t #t) (#f #f))
+         (list (t #/foo|bar|baz|qux/ "xbaz") (t #/foo|bar|baz|qux/ "xba")))
+  (test* "matches? (range)" '((#t #t) (#f #f))
+         (list (t #/^b\w+/ "abcd" 1) (t #/^b\w+/ "abcd" 0 3)))
+  (test* "matches? (string pattern)" '((#t #t) (#f #f))
+         (list (t "b+c" "abbbc") (t "b+c" "abbb")))
+  (test* "matches? (bad arg)" (test-error) (regexp-matches? 'x "abc"))
+  )
+
+(test* "submatches are independent" '("aa" "bbb")
+       (let ([m1 (rxmatch #/(a+|b+)c/ "aac")]
+             [m2 (rxmatch #/(a+|b+)c/ "bbbc")])
+         (list (rxmatch-substring m1 1) (rxmatch-substring m2 1))))
+
 ;;-------------------------------------------------------------------------
 (test-section "regexp comparison")
 
@@ -97,4 +97,38 @@
          (selector-select *sel* 0)
          (list *x* *y*)))
 
+;; Edge-triggered handlers are only notified when new data arrives.
+;; Without epoll/kqueue, the edge flag is ignored.
+(test* "selector-add! (edge)" '(1 0 1)
+       (let* ([sel (make <selector>)]
+              [n 0]
+              [edge? (cond-expand
+                      [gauche.sys.poller
+                       (memq (sys-poller-backend) '(epoll kqueue))]
+                      [else #f])])
+         (receive (in out) (sys-pipe :buffering :none)
+           (selector-add! sel in (^[p f] (inc! n) (read-char p)) '(r edge))
+           (display "ab" out)
+           (let* ([a (selector-select sel 0)]
+                  [b (if edge? (selector-select sel 0) 0)])
+             (display "c" out)
+             (list a b (selector-select sel 0))))))
+
+;; Timers in the selector's timer wheel fire within selector-select,
+;; which doesn't wait longer than the next timer.
+(use control.timer-wheel)
+(test* "selector with timer-wheel" '(0 (a b) #t)
+       (let* ([wheel (make-timer-wheel)]
+              [sel (make <selector> :timer-wheel wheel)]
+              [fired '()]
+              [start (timer-wheel-now wheel)])
+         (receive (in out) (sys-pipe)
+           (selector-add! sel in (^[p f] (read-char p)) '(r))
+           (timer-wheel-schedule! wheel 0.05 (^[] (push! fired 'a)))
+           (timer-wheel-schedule! wheel 0.1 (^[] (push! fired 'b)))
+           (let1 n (selector-select sel '(5 0))
+             (until (= (length fired) 2) (selector-select sel '(5 0)))
+             (list n (reverse fired)
+                   (< (- (timer-wheel-now wheel) start) 4))))))
+
 (test-end)
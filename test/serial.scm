@@ -4,6 +4,7 @@
 
 (use gauche.serializer)
 (use gauche.serializer.aserializer)
+(use gauche.serializer.bserializer)
 (use gauche.test)
 
 (test-start "serializer")
@@ -173,6 +174,47 @@
          (lambda () (sys-remove "test.s"))
          )))
 
+;;----------------------------------------------------------------------
+(test-section "bserializer")
+
+(test "primitives" *primitive-types*
+      (lambda ()
+        (read-from-string-with-serializer
+         <bserializer>
+         (write-to-string-with-serializer <bserializer> *primitive-types*))))
+
+(test "shared/circular component" #t
+      (lambda ()
+        (let* ((data *shared-substructure*)
+               (serialized (write-to-string-with-serializer <bserializer> data))
+               (retrieved (read-from-string-with-serializer <bserializer>
+                                                            serialized)))
+          (topological-equal? data retrieved))))
+
+(test "objects" #t
+      (lambda ()
+        (let* ((data *object-instances*)
+               (serialized (write-to-string-with-serializer <bserializer> data))
+               (retrieved (read-from-string-with-serializer <bserializer>
+                                                            serialized)))
+          (topological-equal? data retrieved))))
+
+(test "file i/o" #t
+      (lambda ()
+        (dynamic-wind
+         (lambda () #f)
+         (lambda ()
+           (let ((data (list *primitive-types*
+                             *shared-substructure*
+                             *object-instances*)))
+             (write-to-file-with-serializer <bserializer> data "test.s")
+             (topological-equal? data
+                                 (read-from-file-with-serializer <bserializer>
+                                                                 "test.s"))
+             ))
+         (lambda () (sys-remove "test.s"))
+         )))
+
 ;(test "dserializer"
 ;      (lambda ()
 ;        (let* ((data *primitive-types*)
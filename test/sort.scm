@@ -127,6 +127,71 @@
            '("bbb" "CCC" "AAA" "aaa" "BBB" "ccc")
            '("CCC" "ccc" "bbb" "BBB" "AAA" "aaa"))
 
+;; homogeneous keys are sorted by specialized kernels.  Compare the
+;; results with the ones using an explicit comparison procedure.
+
+(let ()
+  (define (gen n f) (list-tabulate n (^i (f (modulo (* i 7919) 1009)))))
+  (define (t name lis less?)
+    (let1 exp (stable-sort lis less?)
+      (test* #"~name sort" exp (sort lis))
+      (test* #"~name sort!" exp (sort! (list-copy lis)))
+      (test* #"~name stable-sort" exp (stable-sort lis))
+      (test* #"~name vector" (list->vector exp) (sort (list->vector lis)))
+      (test* #"~name vector!" (list->vector exp)
+             (let1 v (list->vector lis) (sort! v) v))))
+  (t "fixnum" (gen 1000 (^i (- i 500))) <)
+  (t "fixnum small" (gen 20 (^i (- i 500))) <)
+  (t "fixnum wide" (gen 1000 (^i (* (- i 500) (ash 1 (if (even? i) 3 40))))) <)
+  (t "flonum" (gen 1000 (^i (/ (- i 500) 7.0))) <)
+  (t "flonum inf" '(0.5 1.0 -2.5 -1.0 +inf.0 -inf.0 0.0) <)
+  (t "string" (gen 1000 number->string) string<?)
+  (t "symbol" (gen 1000 (^i (string->symbol (number->string i))))
+     (^[a b] (string<? (symbol->string a) (symbol->string b))))
+  (t "mixed" (gen 1000 (^i (if (odd? i) i (+ i 0.5)))) <)
+
+  (let1 lis (gen 1000 (^i (cons (modulo i 10) i)))
+    (test* "stable sort-by fixnum keys"
+           (stable-sort lis (^[a b] (< (car a) (car b))))
+           (stable-sort-by lis car))
+    (test* "stable sort-by! fixnum keys (vector)"
+           (list->vector (stable-sort lis (^[a b] (< (car a) (car b)))))
+           (stable-sort-by! (list->vector lis) car))
+    (test* "stable sort-by string keys"
+           (stable-sort lis (^[a b] (string<? (x->string (cdr a))
+                                              (x->string (cdr b)))))
+           (stable-sort-by lis (.$ x->string cdr))))
+  )
+
+(use gauche.uvector)
+(test* "sort uvector" #s16(-300 -1 0 2 7 32767)
+       (sort #s16(7 32767 -1 0 -300 2)))
+(test* "sort uvector (source intact)" #s16(7 32767 -1 0 -300 2)
+       (let1 v #s16(7 32767 -1 0 -300 2) (sort v) v))
+(test* "sort! uvector" #u32(0 1 2 3 4294967295)
+       (let1 v (u32vector 4294967295 3 0 2 1) (sort! v) v))
+(test* "sort uvector (flonum)" #f64(-inf.0 -1.5 0.0 0.25 1e300)
+       (sort #f64(0.25 1e300 -inf.0 0.0 -1.5)))
+(test* "sort uvector (f16)" #f16(-2.0 -0.5 0.0 1.0 3.0)
+       (sort #f16(1.0 -0.5 3.0 -2.0 0.0)))
+(test* "sort uvector (large)" #t
+       (let1 v (make-s64vector 1000)
+         (dotimes [i 1000]
+           (s64vector-set! v i (* (- (modulo (* i 7919) 1009) 500)
+                                   (ash 1 50))))
+         (sort! v)
+         (sorted? (s64vector->list v))))
+
+;; Builtin comparators are called directly from the sort routine, while
+;; closures go through the VM.
+(test* "sort with subr comparator" '(1 2 3 4 5) (sort '(3 1 5 2 4) <))
+(test* "sort with subr comparator" '("a" "B" "c")
+       (sort '("c" "a" "B") string-ci<?))
+(test* "sort with subr comparator (error)" (test-error)
+       (sort '(3 a 1) <))
+(test* "sort with a comparator catching errors" '(1 2 3 x)
+       (sort '(3 x 1 2) (^[a b] (guard (e [else (number? a)]) (< a b)))))
+
 (test-section "sort-by")
 
 (define (sort-by-nocmp key . in&exps)
@@ -1784,6 +1784,74 @@
                (g)
                (generator->vector! v 3 g))))
 
+;;-----------------------------------------------------------------------
+(test-section "srfi-171")
+(use srfi-171)
+(test-module 'srfi-171)
+
+(test* "list-transduce" '(1 9 25)
+       (list-transduce (compose (tfilter odd?) (tmap square) (ttake 3))
+                       rcons '(1 2 3 4 5 6 7 8 9)))
+(test* "list-transduce (empty)" '()
+       (list-transduce (tmap square) rcons '()))
+(test* "vector-transduce" 6
+       (vector-transduce (tfilter-map (^x (and (even? x) x))) + #(1 2 3 4)))
+(test* "string-transduce" 3
+       (string-transduce (tfilter char-upper-case?) rcount "aBcDeF"))
+(test* "bytevector-u8-transduce" '(3 2 1)
+       (bytevector-u8-transduce (tremove zero?) reverse-rcons
+                                #u8(1 0 2 0 3)))
+(test* "port-transduce" '(a b c)
+       (port-transduce (tmap identity) rcons read
+                       (open-input-string "a b c")))
+(test* "generator-transduce" '(0 2 4)
+       (generator-transduce (compose (tdrop 2) (ttake 3))
+                            rcons (list->generator '(x y 0 2 4 6))))
+(test* "rany" 4 (list-transduce (tmap identity) (rany (^x (and (even? x) x)))
+                                '(1 3 4 5 6)))
+(test* "revery" #f (list-transduce (tmap identity) (revery odd?) '(1 3 4)))
+(test* "revery" 5 (list-transduce (tmap identity) (revery (^x (and (odd? x) x)))
+                                  '(1 3 5)))
+(test* "treplace" '(a 2 c)
+       (list-transduce (treplace '((1 . a) (3 . c))) rcons '(1 2 3)))
+(test* "tdrop-while/ttake-while" '(3 4)
+       (list-transduce (compose (tdrop-while (cut < <> 3))
+                                (ttake-while (cut < <> 5)))
+                       rcons '(1 2 3 4 5 1 2)))
+(test* "ttake-while retf" '(9 2 1)
+       (list-transduce (ttake-while (cut < <> 3) (^[r x] (cons (* x x) r)))
+                       reverse-rcons '(1 2 3 4)))
+(test* "tconcatenate" '(1 2 3 4)
+       (list-transduce tconcatenate rcons '((1 2) () (3 4))))
+(test* "tappend-map + ttake" '(1 1 2)
+       (list-transduce (compose (tappend-map (^x (list x x))) (ttake 3))
+                       rcons '(1 2 3)))
+(test* "tflatten" '(1 2 3 4 5)
+       (list-transduce tflatten rcons '(1 (2 (3 4)) 5)))
+(test* "tdelete-neighbor-duplicates" '(1 2 1 3)
+       (list-transduce (tdelete-neighbor-duplicates) rcons '(1 1 2 2 1 3 3)))
+(test* "tdelete-duplicates" '(1 2 3)
+       (list-transduce (tdelete-duplicates) rcons '(1 2 1 3 2 1)))
+(test* "tdelete-duplicates (custom)" '("a" "b")
+       (list-transduce (tdelete-duplicates string-ci=?) rcons
+                       '("a" "b" "A" "B")))
+(test* "tsegment" '((1 2) (3 4) (5))
+       (list-transduce (tsegment 2) rcons '(1 2 3 4 5)))
+(test* "tpartition" '((1 3) (2 4) (5))
+       (list-transduce (tpartition odd?) rcons '(1 3 2 4 5)))
+(test* "tadd-between" '(a - b - c)
+       (list-transduce (tadd-between '-) rcons '(a b c)))
+(test* "tenumerate" '((1 . a) (2 . b))
+       (list-transduce (tenumerate 1) rcons '(a b)))
+(test* "tlog" '((1 2) 3)
+       (let* ([logged '()]
+              [r (list-transduce (tlog (^[r x] (push! logged x))) + '(1 2))])
+         (list (reverse logged) r)))
+(test* "transducer state is per transduction" '((1 2) (1 2))
+       (let1 xf (ttake 2)
+         (list (list-transduce xf rcons '(1 2 3))
+               (list-transduce xf rcons '(1 2 3)))))
+
 (test-end)
 
 ;;-----------------------------------------------------------------------
@@ -38,6 +38,22 @@
          (list y (eq? x y))))
 (test* "string-copy" "cde" (string-copy "abcde" 2))
 (test* "string-copy" "cd"  (string-copy "abcde" 2 4))
+(test* "string-copy" #*"cd" (string-copy #*"abcde" 2 4))
+
+(test* "string-slice" '("cde" "cd" "")
+       (list (string-slice "abcde" 2) (string-slice "abcde" 2 4)
+             (string-slice "abcde" 5)))
+(test* "string-slice" #t (string-immutable? (string-slice "abcde" 1 3)))
+(test* "string-slice" (test-error) (string-slice "abcde" 3 2))
+;; A short substring of a large string is copied instead of shared;
+;; the results should be the same either way.
+(let1 big (make-string 10000 #\a)
+  (string-set! big 5000 #\b)
+  (test* "substring of large string" '("aba" "aba" "aba")
+         (list (substring big 4999 5002)
+               (string-slice big 4999 5002)
+               (string-copy big 4999 5002)))
+  (test* "substring of large string" 9000 (string-length (substring big 1000 10000))))
 
 (test* "string-ref" #\b (string-ref "abc" 1))
 (define x (string-copy "abcde"))
@@ -171,6 +187,24 @@
   (test-string-scan2 #*"abcd" #*"fghi" #*"abcdefghi" #\e 'both)
   )
 
+;; case-insensitive comparison; the strings are long enough to be
+;; compared a word at a time
+(let ([s "The Quick Brown Fox Jumps Over The Lazy Dog [_@`{]"]
+      [u "THE QUICK BROWN FOX JUMPS OVER THE LAZY DOG [_@`{]"]
+      [d "the quick brown fox jumps over the lazy dog [_@`{]"])
+  (test* "string-ci=?" #t (string-ci=? s u))
+  (test* "string-ci=?" #t (string-ci=? d u))
+  (test* "string-ci=?" #f (string-ci=? s (string-append s "x")))
+  (test* "string-ci=?" #f (string-ci=? s (string-copy s 1)))
+  (dotimes [i (string-length s)]
+    (let1 t (string-copy s)
+      (string-set! t i #\~)
+      (test* #"string-ci<? ~i" #t (string-ci<? s t))
+      (test* #"string-ci>? ~i" #t (string-ci>? t u))))
+  ;; between 'Z' and 'a'
+  (test* "string-ci<?" #t (string-ci<? "ABCDEFGHIJ_" "abcdefghijk"))
+  (test* "string-ci>?" #t (string-ci>? "abcdefghijk" "ABCDEFGHIJ_")))
+
 ;;-------------------------------------------------------------------
 (test-section "string-split")
 
@@ -226,6 +260,50 @@
 (test* "string-split (predicate)" '("" "---" "***" "&" "")
        (string-split "aa---bbb***c&d" char-alphabetic?))
 
+;;-------------------------------------------------------------------
+(test-section "string-searcher")
+
+(let ([ss (make-string-searcher '("he" "she" "his" "hers"))])
+  (define (all src)
+    (reverse (string-searcher-fold ss src (^[k pos seed] (acons k pos seed))
+                                   '())))
+  (test* "string-searcher?" '(#t #f)
+         (list (string-searcher? ss) (string-searcher? "he")))
+  (test* "string-searcher-needles" '("he" "she" "his" "hers")
+         (string-searcher-needles ss))
+  (test* "string-searcher-search" '(1 1)
+         (values->list (string-searcher-search ss "ushers")))
+  (test* "string-searcher-search (no match)" '(#f #f)
+         (values->list (string-searcher-search ss "abcdef")))
+  (test* "string-searcher-search (range)" '(2 0)
+         (values->list (string-searcher-search ss "ushers" 2)))
+  (test* "string-searcher-search (range)" '(#f #f)
+         (values->list (string-searcher-search ss "ushers" 0 3)))
+  (test* "string-searcher-search (cursor)" '(2 0)
+         (values->list (string-searcher-search ss "ushers"
+                                               (string-index->cursor "ushers" 2))))
+  (test* "string-searcher-fold" '((1 . 1) (0 . 2) (3 . 2))
+         (all "ushers"))
+  (test* "string-searcher-fold (multibyte)" '((2 . 3) (0 . 7))
+         (all "あいうhisかhe"))
+  (test* "string-searcher-fold (port)" '((1 . 1) (0 . 2) (3 . 2) (2 . 7))
+         (all (open-input-string "ushers his")))
+  (test* "string-searcher-fold (empty)" '() (all ""))
+  )
+
+(let ([ss (make-string-searcher '("a" "ab" "abc" "c"))])
+  (test* "string-searcher-search (same start)" '(0 0)
+         (values->list (string-searcher-search ss "abc")))
+  (test* "string-searcher-fold (overlaps)" 5
+         (string-searcher-fold ss "abcc" (^[k pos n] (+ n 1)) 0)))
+
+(test* "make-string-searcher (no needles)" (test-error)
+       (make-string-searcher '()))
+(test* "make-string-searcher (empty needle)" (test-error)
+       (make-string-searcher '("a" "")))
+(test* "make-string-searcher (non-string)" (test-error)
+       (make-string-searcher '("a" b)))
+
 (test-section "string-split(with limit)")
 
 (test* "string-split (char)" '("aa*bbb*c**")
@@ -451,6 +529,70 @@
        (list (string-pointer-substring sp)
              (string-pointer-substring sp :after #t)))
 
+;;-------------------------------------------------------------------
+(test-section "string-cursor")
+
+(let ([s "abcdefg"])
+  (test* "string-cursor?" '(#t #t #f #f)
+         (list (string-cursor? (string-cursor-start s))
+               (string-cursor? (string-cursor-end s))
+               (string-cursor? 0)
+               (string-cursor? s)))
+  (test* "string-cursor-ref" '(#\a #\b #\g)
+         (let1 c (string-cursor-start s)
+           (list (string-cursor-ref s c)
+                 (string-cursor-ref s (string-cursor-next s c))
+                 (string-cursor-ref s (string-cursor-prev
+                                       s (string-cursor-end s))))))
+  (test* "string-cursor-ref (end)" (test-error)
+         (string-cursor-ref s (string-cursor-end s)))
+  (test* "string-cursor-ref (fallback)" 'z
+         (string-cursor-ref s (string-cursor-end s) 'z))
+  (test* "string-cursor-prev (out of range)" (test-error)
+         (string-cursor-prev s (string-cursor-start s)))
+  (test* "string-cursor-next (out of range)" (test-error)
+         (string-cursor-next s (string-cursor-end s)))
+  (test* "string-cursor-forward/back" '(#\d #\b)
+         (let1 c (string-cursor-forward s (string-cursor-start s) 3)
+           (list (string-cursor-ref s c)
+                 (string-cursor-ref s (string-cursor-back s c 2)))))
+  (test* "string-index->cursor, string-cursor->index" '(4 7)
+         (list (string-cursor->index s (string-index->cursor s 4))
+               (string-cursor->index s (string-cursor-end s))))
+  (test* "string-cursor->index (index)" 3
+         (string-cursor->index s 3))
+  (test* "substring/cursors" '("cde" "abcdefg" "" "bc")
+         (list (substring/cursors s (string-index->cursor s 2)
+                                  (string-index->cursor s 5))
+               (substring/cursors s (string-cursor-start s)
+                                  (string-cursor-end s))
+               (substring/cursors s (string-cursor-end s)
+                                  (string-cursor-end s))
+               (substring/cursors s 1 3)))
+  (test* "substring/cursors (reversed)" (test-error)
+         (substring/cursors s (string-cursor-end s) (string-cursor-start s)))
+  (test* "string-cursor-diff" 5
+         (string-cursor-diff s (string-index->cursor s 1)
+                             (string-cursor-end s)))
+  (test* "string-cursor compare" '(#t #f #t #t #f #t)
+         (let ([a (string-index->cursor s 1)]
+               [b (string-index->cursor s 3)])
+           (list (string-cursor<? a b) (string-cursor>? a b)
+                 (string-cursor<=? a a) (string-cursor>=? b a)
+                 (string-cursor=? a b)
+                 (string-cursor=? a (string-cursor-next
+                                     s (string-cursor-start s))))))
+  (test* "string-scan (cursor)" '("cde" #f)
+         (list (substring/cursors s (string-scan s "cd" 'cursor) 5)
+               (string-scan s "x" 'cursor)))
+  (test* "string-scan-right (cursor)" "fg"
+         (let1 s2 (string-append s s)
+           (substring/cursors s2 (string-scan-right s2 #\f 'cursor)
+                              (string-cursor-end s2))))
+  (test* "write string-cursor" "#<string-cursor 2>"
+         (write-to-string (string-index->cursor s 2)))
+  )
+
 ;;-------------------------------------------------------------------
 (test-section "input string port")
 
@@ -89,6 +89,42 @@
 (test* "symbol-append" '|| (symbol-append))
 (test* "symbol-append" '|| (symbol-append #t))
 
+(test* "symbol-table-stat" #t
+       (let* ([st0 (symbol-table-stat)]
+              [s (string->symbol "symbol-table-stat-test-foo")]
+              [st1 (symbol-table-stat)])
+         (and (= (+ (get-keyword :interned st0) 1) (get-keyword :interned st1))
+              (<= (get-keyword :num-live-entries st1)
+                  (get-keyword :num-entries st1)))))
+
+;; In the weak mode, symbols that are still referenced must keep their
+;; identity, and unreferenced ones may go away.  We can't test the latter
+;; reliably with a conservative GC, so we just create garbage and check
+;; the consistency.
+(let1 keep (map (^i (string->symbol (format "weak-symtab-keep-~a" i)))
+                (iota 100))
+  (test* "symbol-table-weak!" '(#f #t)
+         (list (symbol-table-weak! #t)
+               (get-keyword :weak (symbol-table-stat))))
+  (dotimes [i 20000]
+    (string->symbol (format "weak-symtab-garbage-~a" i)))
+  (gc)
+  (test* "symbol identity in weak mode" #t
+         (every (^[s i] (eq? s (string->symbol
+                                (format "weak-symtab-keep-~a" i))))
+                keep (iota 100)))
+  (test* "symbol-table-stat in weak mode" #t
+         (let1 st (symbol-table-stat)
+           (<= (get-keyword :num-live-entries st)
+               (get-keyword :num-entries st))))
+  (test* "symbol-table-weak!" #t (symbol-table-weak! #f))
+  (test* "symbol identity after weak mode" #t
+         (every (^[s i] (eq? s (string->symbol
+                                (format "weak-symtab-keep-~a" i))))
+                keep (iota 100)))
+  (test* "builtin symbol after weak mode" 'define
+         (string->symbol "define") eq?))
+
 ;;----------------------------------------------------------------
 (test-section "keywords")
 
@@ -286,6 +286,11 @@
 (test* "readdir" '("." ".." "zzZzz")
        (sort (sys-readdir "test.dir")))
 
+(test* "readdir with types"
+       '(("." . directory) (".." . directory) ("zzZzz" . regular))
+       (sort (sys-readdir "test.dir" #t)
+             (^[a b] (string<? (car a) (car b)))))
+
 (test* "link" '("." ".." "xyzzy" "zzZzz")
        (begin
          (sys-link "test.dir/zzZzz" "test.dir/xyzzy")
@@ -761,6 +766,40 @@
   ]
  [else]) ; cond-expand gauche.sys.select
 
+(cond-expand
+ [gauche.sys.poller
+  (test* "poller backend" #t
+         (memq (sys-poller-backend) '(epoll kqueue poll)))
+  (receive (in out) (sys-pipe :buffering :none)
+    (let ([poller (make-sys-poller)]
+          [ifd (port-file-number in)]
+          [ofd (port-file-number out)])
+      (test* "poller (nothing registered)" '()
+             (sys-poller-wait poller 0))
+      (test* "poller (writable)" `((,ofd w))
+             (begin (sys-poller-add! poller in '(r))
+                    (sys-poller-add! poller out '(w))
+                    (sys-poller-wait poller 0)))
+      (test* "poller (readable)" `((,ifd r))
+             (begin (sys-poller-delete! poller out)
+                    (display "a" out)
+                    (sys-poller-wait poller '(1 0))))
+      (test* "poller (modify)" '()
+             (begin (sys-poller-add! poller in '(w))
+                    (sys-poller-wait poller 0)))
+      (test* "poller (delete)" '()
+             (begin (sys-poller-delete! poller in)
+                    (sys-poller-delete! poller in) ; not an error
+                    (sys-poller-wait poller 0)))
+      (test* "poller (close)" (test-error)
+             (begin (sys-poller-close poller)
+                    (sys-poller-close poller)
+                    (sys-poller-wait poller 0)))
+      (test* "poller (bad flag)" (test-error)
+             (sys-poller-add! (make-sys-poller) in '(z)))
+      ))]
+ [else])
+
 ;;-------------------------------------------------------------------
 (test-section "signal handling")
 
@@ -969,5 +1008,77 @@
   ] 
  [else]) ; gauche.os.windows
 
+;;-------------------------------------------------------------------
+(test-section "gc")
+
+(test* "gc-stat" '(:total-heap-size :free-bytes :bytes-since-gc :total-bytes
+                   :gc-count)
+       (map car (gc-stat)))
+(test* "gc-configure" '(:markers :incremental :free-space-divisor
+                        :pause-target :full-frequency :max-heap-size)
+       (map car (gc-configure)))
+(let1 orig (cadr (assq :free-space-divisor (gc-configure)))
+  (test* "gc-configure :free-space-divisor" 7
+         (cadr (assq :free-space-divisor (gc-configure :free-space-divisor 7))))
+  (gc-configure :free-space-divisor orig))
+(test* "gc-configure :free-space-divisor (error)" (test-error)
+       (gc-configure :free-space-divisor 0))
+(test* "gc-configure :max-heap-size" #f
+       (cadr (assq :max-heap-size (gc-configure :max-heap-size #f))))
+
+(gc)
+(test* "gc-events" '(:gc-no :full :time :pause :stop-world :heap-size
+                     :free-bytes :allocated :reclaimed :allocation-rate)
+       (map car (last (gc-events))))
+(test* "gc-events max" 1 (length (gc-events 1)))
+(test* "gc-event-handler" #t
+       (let1 gcnos '()
+         (set! (gc-event-handler) (^[ev] (push! gcnos (cadr (assq :gc-no ev)))))
+         (dotimes [i 3] (gc) (list i))
+         (set! (gc-event-handler) #f)
+         (and (pair? gcnos) (apply > gcnos))))
+(test* "gc-event-handler (error)" (test-error)
+       (set! (gc-event-handler) 'foo))
+
+;; heap census
+(define-class <heap-census-test> () ((a :init-keyword :a)))
+(define *heap-census-test* (list (make <heap-census-test> :a 1)
+                                 (make <heap-census-test> :a 2)))
+
+(let1 c (heap-census)
+  (test* "heap-census count" 2
+         (cond [(assq <heap-census-test> (get-keyword :classes c)) => cadr]
+               [else #f]))
+  (test* "heap-census totals" #t
+         (and (>= (get-keyword :count c)
+                  (fold (^(e s) (+ (cadr e) s)) 0 (get-keyword :classes c)))
+              (positive? (get-keyword :bytes c))))
+  (test* "heap-snapshot-diff" '((<heap-census-test> 1))
+         (let1 f "tmp.heap-snapshot"
+           (heap-snapshot-save f c)
+           (push! *heap-census-test* (make <heap-census-test> :a 3))
+           (begin0 (filter-map (^e (and (eq? (car e) '<heap-census-test>)
+                                        (list (car e) (cadr e))))
+                               (heap-snapshot-diff f (heap-census)))
+             (sys-unlink f)))))
+
+(test* "heap-retention-paths" '((global user *heap-census-test*))
+       (map car (heap-retention-paths <heap-census-test> :max-paths 1)))
+
+;; gc-prepare-fork
+(define *gc-prepare-fork-test* 1)
+(define (gc-prepare-fork-test) *gc-prepare-fork-test*)
+
+(let1 code-operands
+    (^[] (filter (^x (not (pair? x)))
+                 ((with-module gauche.internal vm-code->list)
+                  (closure-code gc-prepare-fork-test))))
+  (test* "gc-prepare-fork (before)" #t
+         (any identifier? (code-operands)))
+  (test* "gc-prepare-fork" #t (positive? (gc-prepare-fork)))
+  (test* "gc-prepare-fork (after)" #f
+         (any identifier? (code-operands)))
+  (test* "gc-prepare-fork (run)" 1 (gc-prepare-fork-test)))
+
 (test-end)
 
@@ -50,6 +50,67 @@
        (eof-object?
         (call-with-input-string "" (make-csv-reader #\,))))
 
+(test* "csv-reader (crlf)" '(("abc" "def") ("gh\r\ni" "") ("x"))
+       (call-with-input-string "abc,def\r\n\"gh\r\ni\",\r\nx"
+         (^p (port->list (make-csv-reader #\,) p))))
+
+(test* "csv-reader (pushed back char)" '(("abc" "def"))
+       (call-with-input-string "abc,def"
+         (^p (peek-char p) (port->list (make-csv-reader #\,) p))))
+
+(cond-expand
+ [(not gauche.ces.none)
+  (test* "csv-reader (non-ascii whitespace)" '("abc" "def\u3000 g" "")
+         (call-with-input-string "\u3000abc\u3000, def\u3000 g \u3000,\u3000"
+           (make-csv-reader #\,)))
+
+  (test* "csv-reader (non-ascii separator)" '("abc" "de,f" "gh")
+         (call-with-input-string "abc \u3001 \"de,f\"\u3001gh"
+           (make-csv-reader #\x3001)))
+
+  (test* "csv-batch-reader (non-ascii separator)" '#(#("a" "b") #("c"))
+         (call-with-input-string "a\u3001b\nc"
+           (cut (make-csv-batch-reader #\x3001) 10 <>)))]
+ [else])
+
+;; Delimiters at every offset within and across the blocks scanned
+;; by the vector kernels
+(test* "csv-reader (delimiter offsets)" #t
+       (every (^n (let ([a (make-string n #\a)]
+                        [b (make-string (- 70 n) #\b)])
+                    (equal? (call-with-input-string
+                                #"~|a|,~|b|\n\"~|a|\"\"~|b|\",x\n"
+                              (^p (port->list (make-csv-reader #\,) p)))
+                            `((,a ,b) (,#"~|a|\"~|b|" "x")))))
+              (iota 71)))
+
+;; Long fields cross the buffer boundary of file ports
+(let ([rows (map (^i (list (number->string i)
+                           (make-string (* i 10) #\x)
+                           (string-append "q\"" (make-string i #\y) "\ny")))
+                 (iota 200))]
+      [file "test-csv.o"])
+  (with-output-to-file file
+    (^[] (for-each (cut (make-csv-writer #\,) (current-output-port) <>)
+                   rows)))
+  (test* "csv-reader (file port)" rows
+         (with-input-from-file file
+           (^[] (port->list (make-csv-reader #\,) (current-input-port)))))
+  (test* "csv-batch-reader (file port)" (map list->vector (take rows 64))
+         (with-input-from-file file
+           (^[] (vector->list ((make-csv-batch-reader #\,) 64)))))
+  (sys-unlink file))
+
+(test* "csv-batch-reader" '(#(#("a" "b") #("c")) #(#("d" "e")) #t)
+       (let1 r (make-csv-batch-reader #\,)
+         (call-with-input-string "a,b\nc\nd,e\n"
+           (^p (let* ([x (r 2 p)] [y (r 2 p)] [z (r 2 p)])
+                 (list x y (eof-object? z)))))))
+
+(test* "csv-batch-reader (shared)" '#(#("abc" "d\"e") #("" "f"))
+       (call-with-input-string "abc , \"d\"\"e\"\n,f"
+         (cut (make-csv-batch-reader #\, :shared? #t) 10 <>)))
+
 (test* "csv-writer"
        "abc,def,123,\"what's up?\",\"he said, \"\"nothing new.\"\"\"\n"
        (call-with-output-string
@@ -169,6 +230,10 @@ fuga
        (with-output-to-string
          (lambda () (diff-report diff-a diff-b))))
 
+(test* "diff (patience)"
+       '(((- 2 "bar")) ((- 4 "baz") (+ 3 "fuga")) ((+ 5 "fuga")))
+       (diff diff-a diff-b :algorithm 'patience))
+
 ;;-------------------------------------------------------------------
 (test-section "gap-buffer")
 (use text.gap-buffer)
@@ -337,6 +402,48 @@ fuga
          (flatten (html:img :src "foo" :alt "bar baz")))
   )
 
+(test* "html-escape-string (no special chars)" "abc def"
+       (html-escape-string "abc def"))
+(test* "html-escape-string (long)"
+       (string-append (make-string 20 #\a) "&lt;" (make-string 9 #\b)
+                      "&amp;&amp;" (make-string 7 #\c) "&quot;&gt;")
+       (html-escape-string
+        (string-append (make-string 20 #\a) "<" (make-string 9 #\b)
+                       "&&" (make-string 7 #\c) "\">")))
+
+(let ()
+  (define (run tmpl) (call-with-output-string tmpl))
+
+  (test* "html-template (static)"
+         "<p class=\"x&amp;y\">a&lt;b<br /></p\n>"
+         (run (html-template (p :class "x&y" "a<b" (br)))))
+  (test* "html-template vs html-lite"
+         (call-with-output-string
+           (cut write-tree
+                (html:a :href "http://foo/bar?a&b" :id "aabb" "zzdd") <>))
+         (run (html-template (a :href "http://foo/bar?a&b" :id "aabb" "zzdd"))))
+  (test* "html-template (dynamic)"
+         "<ul><li>1&amp;2</li\n><li></li\n><li>x<y/></li\n></ul\n>"
+         (let ([a "1&2"] [b #f] [c "x<y/>"])
+           (run (html-template (ul (li ,a) (li ,b) (li ,@c))))))
+  (test* "html-template (attributes)"
+         "<input type=\"checkbox\" checked value=\"&quot;v&quot;\" />"
+         (let ([on #t] [off #f] [v "\"v\""])
+           (run (html-template
+                 (input :type "checkbox" :checked ,on :disabled ,off
+                        :value ,v)))))
+  (test* "html-template (nested)"
+         "<div><b>1</b\n><b>2</b\n></div\n>"
+         (let ([items (map (^i (html-template (b ,i))) '(1 2))])
+           (run (html-template (div ,items)))))
+
+  (define-html-template (greet name) (span "Hello, " ,name))
+  (test* "define-html-template" "<span>Hello, &lt;you&gt;</span\n>"
+         (with-output-to-string (cut greet "<you>")))
+  (test* "html-template (bad empty element)" (test-error)
+         (eval '(html-template (br "x")) (find-module 'text.html-lite)))
+  )
+
 ;;-------------------------------------------------------------------
 (test-section "parse")
 (use text.parse)
@@ -506,6 +613,61 @@ fuga
 
 ;; WRITEME
 
+;;-------------------------------------------------------------------
+(test-section "rope")
+(use text.rope)
+(use text.tree)
+(test-module 'text.rope)
+
+(let ([r (rope-append "abc" #\d (string->rope "efg"))])
+  (test* "rope-append" "abcdefg" (rope->string r))
+  (test* "rope?" '(#t #f) (list (rope? r) (rope? "abcdefg")))
+  (test* "rope-length" 7 (rope-length r))
+  (test* "rope-ref" '(#\a #\d #\g) (map (cut rope-ref r <>) '(0 3 6)))
+  (test* "rope-ref" (test-error) (rope-ref r 7))
+  (test* "rope-substring" "cde" (rope->string (rope-substring r 2 5)))
+  (test* "rope-substring" "efg" (rope->string (rope-substring r 4)))
+  (test* "rope-substring" "" (rope->string (rope-substring r 3 3)))
+  (test* "rope-substring" (test-error) (rope-substring r 3 8))
+  (test* "display" "abcdefg" (with-output-to-string (cut display r)))
+  (test* "write-rope" "abcdefg" (with-output-to-string (cut write-rope r)))
+  (test* "write" "#<rope \"abcdefg\">" (write-to-string r))
+  (test* "equal?" #t (equal? r (rope-append "abcd" "efg")))
+  (test* "equal?" #f (equal? r (rope-append "abcd" "efh")))
+  (test* "tree->string" "<abcdefg>" (tree->string `("<" ,r ">")))
+  (test* "x->string" "abcdefg" (x->string r))
+  )
+
+(test* "rope, multibyte" '(5 "いろは" #\ろ)
+       (let1 r (rope-append "い" "ろ" "はに" "ほ")
+         (list (rope-length r)
+               (rope->string (rope-substring r 0 3))
+               (rope-ref r 1))))
+
+;; Build a large rope in several ways and compare with plain strings.
+(let* ([pieces (map (^i (number->string i)) (iota 5000))]
+       [expected (string-concatenate pieces)]
+       [by-char (fold (^[s r] (string-fold (^[c r] (rope-append r c)) r s))
+                      (string->rope "") pieces)]
+       [by-prepend (fold (^[s r] (rope-append s r)) (string->rope "")
+                         (reverse pieces))]
+       [bulk (rope-concatenate pieces)])
+  (test* "rope, built by chars" expected (rope->string by-char))
+  (test* "rope, built by prepending" expected (rope->string by-prepend))
+  (test* "rope-concatenate" expected (rope->string bulk))
+  (test* "rope-size" (string-size expected) (rope-size bulk))
+  (test* "rope chunks merged" #t (< (length (rope-chunks by-char)) 100))
+  (test* "rope-chunks" expected (string-concatenate (rope-chunks by-char)))
+  (test* "rope-substring, large"
+         (map (^[s e] (substring expected s e))
+              '(0 17 1000 9000 18000) '(18889 9000 1001 9000 18889))
+         (map (^[s e] (rope->string (rope-substring by-prepend s e)))
+              '(0 17 1000 9000 18000) '(18889 9000 1001 9000 18889)))
+  (test* "rope-ref, large"
+         (map (cut string-ref expected <>) '(0 1234 18888))
+         (map (cut rope-ref by-char <>) '(0 1234 18888)))
+  )
+
 ;;-------------------------------------------------------------------
 (test-section "sql")
 (use text.sql)
@@ -634,6 +796,21 @@ fuga
 (test* "tree->string"
        (if (symbol? :b) "A:b" "Ab") ; transient during symbol-keyword integration
        (tree->string '(|A| . :b)))
+(test* "tree->string" "a1#x-2.5b"
+       (tree->string `(a 1 #\# "x" -2.5 ,(string->symbol "b"))))
+(test* "tree->string" "#(1 2)" (tree->string '#(1 2)))
+
+(define-class <tree-test-node> () ((tag :init-keyword :tag)))
+(define-method write-tree ((n <tree-test-node>) out)
+  (write-tree `("<" ,(~ n'tag) ">") out))
+(test* "tree->string (user-defined node)" "x<p>y<q>"
+       (tree->string `("x" ,(make <tree-test-node> :tag 'p)
+                       ("y" ,(make <tree-test-node> :tag "q")))))
+(test* "write-tree" "ab<c>"
+       (with-output-to-string
+         (cut write-tree `(a ("b" ,(make <tree-test-node> :tag 'c))))))
+(test* "write-tree (to port)" "ab"
+       (call-with-output-string (cut write-tree '("a" . b) <>)))
 
 ;;-------------------------------------------------------------------
 (test-section "unicode.ucd")
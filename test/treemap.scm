@@ -91,6 +91,11 @@
 (do-tree-map (cut make-tree-map = <))
 (do-tree-map (cut make-tree-map (^[a b] (cond [(< a b) -1][(= a b) 0][else 1]))))
 (do-tree-map (cut make-tree-map))
+(do-tree-map (cut make-tree-map :layout 'b+tree))
+(do-tree-map (cut make-tree-map = < :layout 'b+tree))
+
+(test* "make-tree-map (bad layout)" (test-error)
+       (make-tree-map :layout 'no-such-layout))
 
 ;; Min, max, iterators
 (let ((empty (make-tree-map = <))
@@ -446,5 +451,134 @@
          (tree-map-put! tmap 3 'z))
   )
 
+;; Bulk construction, order statistics, ranges, split and join
+(let ()
+  (define (make-sorted n) (alist->tree-map (map (^i (cons i (* i 10))) (iota n))))
+
+  (dolist [n '(0 1 2 3 4 7 8 100 1000)]
+    (test* #"alist->tree-map sorted (~n)" (list #t n (map (^i (cons i (* i 10))) (iota n)))
+           (let1 t (make-sorted n)
+             (list (%tree-map-check-consistency t)
+                   (tree-map-num-entries t)
+                   (tree-map->alist t)))))
+
+  (test* "alist->tree-map unsorted" '((1 . b) (2 . c) (3 . a))
+         (tree-map->alist (alist->tree-map '((3 . a) (1 . b) (2 . c)))))
+  (test* "alist->tree-map duplicate keys" '((1 . c) (2 . b))
+         (tree-map->alist (alist->tree-map '((1 . a) (2 . b) (1 . c)))))
+  (test* "alist->tree-map duplicate adjacent keys" '((1 . b) (2 . c))
+         (tree-map->alist (alist->tree-map '((1 . a) (1 . b) (2 . c)))))
+
+  (let1 t (make-sorted 100)
+    (dotimes [i 50] (tree-map-delete! t (* i 2)))
+    (test* "tree-map-rank" '(0 1 49 #f none)
+           (list (tree-map-rank t 1) (tree-map-rank t 3) (tree-map-rank t 99)
+                 (tree-map-rank t 4) (tree-map-rank t 100 'none)))
+    (test* "tree-map-select" '((1 . 10) (51 . 510) (99 . 990) #f #f)
+           (list (tree-map-select t 0) (tree-map-select t 25)
+                 (tree-map-select t 49) (tree-map-select t 50)
+                 (tree-map-select t -1)))
+    (test* "tree-map-count-range" '(5 5 0 0 50)
+           (list (tree-map-count-range t 10 20) (tree-map-count-range t 11 21)
+                 (tree-map-count-range t 20 10) (tree-map-count-range t 200 300)
+                 (tree-map-count-range t -1 100)))
+    (test* "tree-map-fold-range" '(19 17 15 13 11)
+           (tree-map-fold-range t 10 20 (^[k v s] (cons k s)) '()))
+    (test* "tree-map-fold-right-range" '(11 13 15 17 19)
+           (tree-map-fold-right-range t 11 21 (^[k v s] (cons k s)) '()))
+    (test* "tree-map-fold-range (empty)" '()
+           (tree-map-fold-range t 20 20 (^[k v s] (cons k s)) '()))
+    (test* "tree-map-fold-range (reversed)" '()
+           (tree-map-fold-range t 20 10 (^[k v s] (cons k s)) '()))
+    )
+
+  (dolist [k '(-1 0 1 50 51 99 100)]
+    (test* #"tree-map-split!/join! (~k)"
+           (list #t #t (filter (cut < <> k) (iota 100))
+                 (filter (cut >= <> k) (iota 100))
+                 (iota 100) 0)
+           (let* ([t (make-sorted 100)]
+                  [u (tree-map-split! t k)]
+                  [r (list (%tree-map-check-consistency t)
+                           (%tree-map-check-consistency u)
+                           (tree-map-keys t) (tree-map-keys u))])
+             (tree-map-join! t u)
+             (%tree-map-check-consistency t)
+             (append r (list (tree-map-keys t) (tree-map-num-entries u))))))
+
+  (test* "tree-map-join! (different heights)" (iota 1001)
+         (let ([t (make-sorted 1000)]
+               [u (alist->tree-map '((1000 . #t)))])
+           (tree-map-join! t u)
+           (%tree-map-check-consistency t)
+           (tree-map-keys t)))
+  (test* "tree-map-join! (overlap)" (test-error)
+         (tree-map-join! (make-sorted 10) (make-sorted 10)))
+  (test* "tree-map-join! (comparator)" (test-error)
+         (tree-map-join! (make-sorted 10)
+                         (alist->tree-map '((20 . 0)) = <)))
+  )
+
+;; B+tree layout, compared with red-black trees
+(let ()
+  (define (check-same label rb bp)
+    (test* #"b+tree ~label" (list #t (tree-map->alist rb))
+           (list (%tree-map-check-consistency bp) (tree-map->alist bp))))
+  (define (random-ops! rb bp n range)
+    (dotimes [i n]
+      (let ([k (modulo (* i 7919) range)]
+            [op (modulo (* i 104729) 5)])
+        (case op
+          [(0 1 2) (tree-map-put! rb k i) (tree-map-put! bp k i)]
+          [(3) (tree-map-delete! rb k) (tree-map-delete! bp k)]
+          [(4) (tree-map-update! rb k (cut + 1 <>) 0)
+               (tree-map-update! bp k (cut + 1 <>) 0)]))))
+
+  (let ([rb (make-tree-map)]
+        [bp (make-tree-map :layout 'b+tree)])
+    (dolist [range '(10 100 3000)]
+      (random-ops! rb bp 5000 range)
+      (check-same #"random ops (~range)" rb bp))
+    (test* "b+tree rank/select/count-range"
+           (list (map (cut tree-map-rank rb <>) (iota 20 0 150))
+                 (map (cut tree-map-select rb <>) (iota 20 0 50))
+                 (tree-map-count-range rb 100 2000))
+           (list (map (cut tree-map-rank bp <>) (iota 20 0 150))
+                 (map (cut tree-map-select bp <>) (iota 20 0 50))
+                 (tree-map-count-range bp 100 2000)))
+    (test* "b+tree fold-range"
+           (tree-map-fold-range rb 500 1500 list* '())
+           (tree-map-fold-range bp 500 1500 list* '()))
+    (test* "b+tree floor/ceiling"
+           (map (^k (list (tree-map-floor-key rb k) (tree-map-ceiling-key rb k)
+                          (tree-map-predecessor-key rb k)
+                          (tree-map-successor-key rb k)))
+                (iota 30 -5 111))
+           (map (^k (list (tree-map-floor-key bp k) (tree-map-ceiling-key bp k)
+                          (tree-map-predecessor-key bp k)
+                          (tree-map-successor-key bp k)))
+                (iota 30 -5 111)))
+    (check-same "copy" rb (tree-map-copy bp))
+    (test* "b+tree pop-min!/pop-max!"
+           (list (tree-map-pop-min! rb) (tree-map-pop-max! rb))
+           (list (tree-map-pop-min! bp) (tree-map-pop-max! bp)))
+    (let ([u (tree-map-split! rb 1000)]
+          [v (tree-map-split! bp 1000)])
+      (check-same "split! (lower)" rb bp)
+      (check-same "split! (upper)" u v)
+      (tree-map-join! rb u)
+      (tree-map-join! bp v)
+      (check-same "join!" rb bp))
+    (until (tree-map-empty? bp)
+      (tree-map-delete! bp (car (tree-map-min bp)))
+      (tree-map-delete! rb (car (tree-map-min rb))))
+    (check-same "delete all" rb bp))
+
+  (dolist [n '(0 1 31 32 33 1000)]
+    (let1 t (alist->tree-map (map (^i (cons i i)) (iota n)) :layout 'b+tree)
+      (test* #"b+tree alist->tree-map sorted (~n)" (list #t (iota n))
+             (list (%tree-map-check-consistency t) (tree-map-keys t)))))
+  )
+
 (test-end)
 
@@ -89,6 +89,109 @@
   (test-string-scan #f "あえいうえおあおあいうえお" "おい")
   )
 
+;; case-insensitive comparison of multibyte strings skips ASCII runs
+;; a word at a time
+(let ([s "Hello, World! こんにちは Gauche Scheme"])
+  (test* "string-ci=? (mb)" #t (string-ci=? s "HELLO, world! こんにちは gauche SCHEME"))
+  (test* "string-ci=? (mb)" #f (string-ci=? s "HELLO, world! こんばんは gauche SCHEME"))
+  (test* "string-ci<? (mb)" #t (string-ci<? s "HELLO, world! こんにちは gauche SCHEMF"))
+  (test* "string-ci>? (mb)" #t (string-ci>? s "HELLO, world! こんにちは gauche SCHEM"))
+  (test* "string-ci<? (mb)" #t (string-ci<? "ABCDEFGHIJあ" "abcdefghijい")))
+
+;; a multibyte character at every offset of the 16-byte blocks
+(test* "string-ci=? (mb, offsets)" '()
+       (filter (^i (let ([a (make-string i #\a)]
+                         [b (make-string (- 40 i) #\b)]
+                         [A (make-string i #\A)]
+                         [B (make-string (- 40 i) #\B)])
+                     (not (and (string-ci=? #"~|a|あ~|b|z" #"~|A|あ~|B|Z")
+                               (string-ci<? #"~|a|あ~|b|y" #"~|A|あ~|B|Z")
+                               (not (string-ci=? #"~|a|あ~|b|z"
+                                                 #"~|A|い~|B|Z"))))))
+               (iota 41)))
+
+;;-------------------------------------------------------------------
+(test-section "string index")
+
+(let* ([src (apply string-append
+                   (map (^i (string (integer->char (+ #x3041 (modulo i 80)))
+                                    (integer->char (+ #x61 (modulo i 26)))))
+                        (iota 1000)))]
+       [chars (string->list src)]
+       [vec (list->vector chars)])
+  (test* "string-fast-indexable? (short)" #t
+         (string-fast-indexable? "いろはにほへと"))
+  (test* "string-fast-indexable? (ascii)" #t
+         (string-fast-indexable? (make-string 1000 #)))
+  (test* "string-fast-indexable? (before)" #f
+         (string-fast-indexable? (string-copy src)))
+  (test* "string-ref (indexed)" #t
+         (let1 s (string-copy src)
+           (every (^i (eqv? (string-ref s i) (vector-ref vec i)))
+                  (iota (string-length s)))))
+  (test* "string-build-index!" #t
+         (string-fast-indexable? (string-build-index! (string-copy src))))
+  (test* "string-ref (indexed, descending)" #t
+         (let1 s (string-build-index! (string-copy src))
+           (every (^i (eqv? (string-ref s i) (vector-ref vec i)))
+                  (reverse (iota (string-length s))))))
+  (test* "substring (indexed)" #t
+         (let1 s (string-build-index! (string-copy src))
+           (every (^[b e] (equal? (substring s b e)
+                                  (list->string (take (drop chars b) (- e b)))))
+                  '(0   1 63 64 65  127 500 1000 1999 1234)
+                  '(2000 64 64 65 200 1000 501 2000 2000 1999))))
+  (test* "string-copy shares index" #t
+         (string-fast-indexable?
+          (string-copy (string-build-index! (string-copy src)))))
+  (test* "string-set! drops index" "xg"
+         (let1 s (string-build-index! (string-copy src))
+           (string-set! s 1000 #\x)
+           (substring s 1000 1002)))
+  )
+
+;;-------------------------------------------------------------------
+(test-section "string-cursor")
+
+(let ([s "いろhにほへt"])
+  (test* "string-cursor-ref" '(#\い #\ろ #\t #\へ)
+         (let1 c (string-cursor-start s)
+           (list (string-cursor-ref s c)
+                 (string-cursor-ref s (string-cursor-next s c))
+                 (string-cursor-ref s (string-cursor-prev
+                                       s (string-cursor-end s)))
+                 (string-cursor-ref s (string-cursor-back
+                                       s (string-cursor-end s) 2)))))
+  (test* "string-cursor->index" '(0 3 5 7)
+         (map (^c (string-cursor->index s c))
+              (list (string-cursor-start s)
+                    (string-cursor-forward s (string-cursor-start s) 3)
+                    (string-index->cursor s 5)
+                    (string-cursor-end s))))
+  (test* "substring/cursors" '("hにほ" "いろhにほへt" "t")
+         (list (substring/cursors s (string-index->cursor s 2)
+                                  (string-index->cursor s 5))
+               (substring/cursors s (string-cursor-start s)
+                                  (string-cursor-end s))
+               (substring/cursors s (string-cursor-prev
+                                     s (string-cursor-end s))
+                                  (string-cursor-end s))))
+  (test* "string-cursor-diff" 4
+         (string-cursor-diff s (string-index->cursor s 1)
+                             (string-index->cursor s 5)))
+  (test* "string-scan (cursor)" "ほへt"
+         (substring/cursors s (string-scan s "ほ" 'cursor)
+                            (string-cursor-end s)))
+  (test* "rxmatch with cursors" '("にほへ" 3 6 "t")
+         (let* ([c (string-index->cursor s 2)]
+                [m (rxmatch #/[^a-z]+/ s c)])
+           (list (rxmatch-substring m)
+                 (rxmatch-start m)
+                 (rxmatch-end m)
+                 (substring/cursors s (rxmatch-end-cursor m)
+                                    (string-cursor-end s)))))
+  )
+
 ;;-------------------------------------------------------------------
 (test-section "string-pointer")
 (define sp #f)
@@ -259,6 +362,47 @@
                    (integer-range->char-set (char->integer #\ぁ)
                                             (char->integer #\お)))))
 
+;; literal char-sets are frozen, and kept in a flat range table.
+(let* ([lit #[ぁ-んァ-ヶ一-龠\U0001F600-\U0001F64F]]
+       [mut (char-set-copy lit)]
+       [chars (map integer->char
+                   '(#x41 #x80 #x3040 #x3041 #x3093 #x3094 #x30a0 #x30a1
+                     #x30f6 #x30f7 #x4dff #x4e00 #x4eff #x4f00 #x9fa0 #x9fa1
+                     #xffff #x10000 #x1f5ff #x1f600 #x1f620 #x1f64f #x1f650
+                     #x10ffff))])
+  (test* "char-set-immutable?" '(#t #f)
+         (list (char-set-immutable? lit) (char-set-immutable? mut)))
+  (test* "immutable char-set lookup"
+         (map (cut char-set-contains? mut <>) chars)
+         (map (cut char-set-contains? lit <>) chars))
+  (test* "immutable char-set lookup" '(#f #t #t #f #t #f #t #f)
+         (map (cut char-set-contains? lit <>)
+              '(#\ゟ #\ぁ #\ん #\ゔ #\一 #\〇 #\😀 #\🙐)))
+  (test* "immutable char-set equality" #t (char-set= lit mut))
+  (test* "immutable char-set equality" #f
+         (char-set= lit (char-set-adjoin mut #\〇)))
+  (test* "immutable char-set inclusion" '(#t #t #f)
+         (list (char-set<= lit mut) (char-set<= mut lit)
+               (char-set<= (char-set-adjoin mut #\〇) lit)))
+  (test* "immutable char-set printer" (write-to-string mut)
+         (write-to-string lit))
+  (test* "immutable char-set mutation" (test-error)
+         (char-set-adjoin! lit #\〇))
+  (test* "immutable char-set mutation" (test-error)
+         (char-set-complement! lit))
+  (test* "immutable char-set copy"  #t
+         (char-set-contains? (char-set-adjoin! (char-set-copy lit) #\〇)
+                             #\〇))
+  (test* "predefined char-set is immutable" (test-error)
+         (char-set-adjoin! char-set:empty #\あ)))
+
+(let* ([cs (char-set #\あ #\い)]
+       [rx (regexp-compile `(0 #f ,cs))])
+  (test* "regexp with user charset" '("い" #f)
+         (list (rxmatch-substring (rx "うい")) (char-set-immutable? cs))))
+(test* "regexp with large charset" "ひらがな"
+       (rxmatch-substring (#/[ぁ-ん]+/ "カタカナひらがなカタ")))
+
 ;;-------------------------------------------------------------------
 (test-section "ports")
 
@@ -596,6 +740,15 @@
               => rxmatch-substring)
              (else #f)))
 
+(test* "regexp (skipping input)" '(3 "いろは")
+       (let1 m (rxmatch #/いろは/ "いろいいろは")
+         (list (rxmatch-start m) (rxmatch-substring m))))
+(test* "regexp (skipping input)" '(4 "えa")
+       (let1 m (rxmatch #/[え-お]a|zz/ "あいaええa")
+         (list (rxmatch-start m) (rxmatch-substring m))))
+(test* "regexp (skipping input)" "はは"
+       (rxmatch-substring (rxmatch #/([は-ほ])\1/ "aはひはは")))
+
 ;; The following tests are tailored to cover all paths
 ;; introduced at regexp.c,v 1.63 to minimize counting
 ;; string length.
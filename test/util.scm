@@ -443,6 +443,30 @@
        '(((+ 1 b)))
        (lcs-edit-list '(a) '(a b)))
 
+;; large inputs go through the linear space refinement
+(let* ([a (iota 3000)]
+       [b (append-map (^i (cond [(zero? (modulo i 7)) '()]
+                                [(zero? (modulo i 11)) (list 'x i)]
+                                [else (list i)]))
+                      a)]
+       [expected (remove symbol? b)])
+  (test* "lcs (large)" #t (equal? expected (lcs a b)))
+  (test* "lcs (large, custom eq)" #t
+         (equal? expected (lcs a b (^[x y] (eqv? x y)))))
+  (test* "lcs (large, reversed)" 1 (length (lcs (reverse a) a)))
+  (test* "lcs-edit-list (large)" (- (length a) (length expected))
+         (count (^c (eq? (car c) '-)) (concatenate (lcs-edit-list a b))))
+  (test* "lcs (large, patience)" #t
+         (equal? expected (lcs a b equal? 'patience))))
+
+(let ([a '("int f()" "{" "  return 1;" "}" "" "int g()" "{" "  return 2;" "}")]
+      [b '("int g()" "{" "  return 2;" "}" "" "int f()" "{" "  return 1;" "}")])
+  (test* "lcs (myers)" '("{" "}" "" "{" "}") (lcs a b))
+  (test* "lcs (patience)" '("int g()" "{" "  return 2;" "}")
+         (lcs a b equal? 'patience))
+  (test* "lcs (patience, custom eq)" '("{" "}" "" "{" "}")
+         (lcs a b (^[x y] (string=? x y)) 'patience)))
+
 ;;-----------------------------------------------
 (test-section "util.rbtree")
 (use util.rbtree)
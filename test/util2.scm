@@ -52,5 +52,146 @@
   (test-algo "Restricted edit" re-distances caddr)
   (test-algo "Damerau-Levenshtein" dl-distances cadddr))
 
+;; Strings are handled by native code; compare it with the generic
+;; version (with a comparator the native code doesn't take over), on
+;; both sides of the 64 character boundary of the bit-parallel algorithm.
+(let ()
+  (define (generic A Bs :optional (cutoff #f))
+    (l-distances A Bs :elt= (^[a b] (char=? a b)) :cutoff cutoff))
+  (define (rand-string len alphabet)
+    (with-output-to-string
+      (^[] (dotimes [i len]
+             (write-char (string-ref alphabet
+                                     (modulo (* (+ i len 7) 7919)
+                                             (string-length alphabet))))))))
+  (define (mutate s k)
+    (let loop ([s s] [k k])
+      (if (zero? k)
+        s
+        (let1 p (modulo (* k 37) (+ (string-length s) 1))
+          (loop (case (modulo k 3)
+                  [(0) (string-append (substring s 0 p) "x"
+                                      (substring s p (string-length s)))]
+                  [(1) (if (< p (string-length s))
+                         (string-append (substring s 0 p)
+                                        (substring s (+ p 1) (string-length s)))
+                         s)]
+                  [else (if (< p (string-length s))
+                          (string-append (substring s 0 p) "\u3042"
+                                         (substring s (+ p 1)
+                                                    (string-length s)))
+                          s)])
+                (- k 1))))))
+  (dolist [len '(0 1 10 63 64 65 100 200)]
+    (let* ([A (rand-string len "abcde\u3042\u3044")]
+           [Bs (map (cut mutate A <>) '(0 1 2 5 10 30))])
+      (test* #"native Levenshtein, length ~len"
+             (generic A (cons "" Bs))
+             (l-distances A (cons "" Bs)))
+      (test* #"native Levenshtein, length ~len (swapped)"
+             (map (^B (car (generic B (list A)))) Bs)
+             (map (^B (l-distance B A)) Bs))
+      (dolist [c '(0 2 5 20)]
+        (test* #"native Levenshtein, length ~len, cutoff ~c"
+               (generic A Bs c)
+               (l-distances A Bs :cutoff c)))))
+
+  (test* "native Levenshtein, batch with vector"
+         '#(0 1 3 #f)
+         (l-distances "kitten" '#("kitten" "sitten" "sitting" "sit") :cutoff 3))
+  (test* "generic Levenshtein, batch with vector"
+         '#(2 3 4)
+         (l-distances "cat" '#("Cathy" "scathe" "stack") :elt= char-ci=?))
+  (test* "Restricted edit, batch with vector"
+         '#(2 2 4 4 #f 1)
+         (re-distances "pepper"
+                       '#("peter" "piper" "picked" "peck" "pickled" "peppers")
+                       :cutoff 4))
+  (test* "Levenshtein, mixed sequences"
+         '(1 1)
+         (l-distances "abc" '("abd" (#\a #\b))))
+  )
+
+
+;;-----------------------------------------------
+(test-section "util.kvdump")
+(use util.kvdump)
+(test-module 'util.kvdump)
+
+(let ()
+  (define data
+    `(("abc" . "def") ("" . "empty key") ("\x00;\x7f;" . "x")
+      (sym . (1 2.5 "three")) (#u8(1 2 3) . #u8()) (12345 . 67890)))
+  (define (roundtrip data . opts)
+    (let* ([s (call-with-output-string
+                (^o (apply write-kvdump o
+                           (^[p] (for-each (^e (p (car e) (cdr e))) data))
+                           :block-size 2 opts)))]
+           [r '()])
+      (list (kvdump-port? (open-input-string s))
+            (read-kvdump (open-input-string s) (^[k v] (push! r (cons k v))))
+            (reverse r))))
+
+  (test* "write-kvdump/read-kvdump" `(#t ,(length data) ,data)
+         (roundtrip data))
+  (test* "write-kvdump/read-kvdump (empty)" '(#t 0 ())
+         (roundtrip '()))
+  (when (library-exists? 'rfc.zlib)
+    (test* "write-kvdump/read-kvdump (compressed)" `(#t ,(length data) ,data)
+           (roundtrip data :compress #t)))
+  (cond-expand
+   [gauche.sys.threads
+    (test* "write-kvdump/read-kvdump (threads)" `(#t ,(length data) ,data)
+           (roundtrip data :threads 3))]
+   [else])
+
+  (test* "read-kvdump header" '(3 (foo bar))
+         (let ([s (call-with-output-string
+                    (^o (write-kvdump o (^[p] (p 1 2) (p 3 4) (p 5 6))
+                                      :count 3 :meta '(foo bar))))]
+               [r #f])
+           (read-kvdump (open-input-string s) (^[k v] #f)
+                        :header-handler (^[c m] (set! r (list c m))))
+           r))
+  (test* "read-kvdump (not a kvdump)" (test-error)
+         (read-kvdump (open-input-string "(\"a\" . \"b\")") (^[k v] #f)))
+  (test* "read-kvdump (truncated)" (test-error)
+         (let1 s (call-with-output-string
+                   (^o (write-kvdump o (^[p] (p "key" "value")))))
+           (read-kvdump (open-input-string
+                         (substring s 0 (- (string-size s) 4)))
+                        (^[k v] #f))))
+  )
+
+(let ()
+  (define (test-hash-table-save type . opts)
+    (test* #"hash-table-save/load (~type)" '(#t ok)
+           (let1 h (make-hash-table type)
+             (dotimes [i 1000]
+               (hash-table-put! h (if (eq? type 'string=?)
+                                    (number->string i)
+                                    i)
+                                (list i (* i i))))
+             (apply hash-table-save h "test.o" opts)
+             (let1 h2 (hash-table-load "test.o")
+               (list (eq? (hash-table-type h2) type)
+                     (if (and (= (hash-table-num-entries h2) 1000)
+                              (every (^k (equal? (hash-table-get h k)
+                                                 (hash-table-get h2 k #f)))
+                                     (hash-table-keys h)))
+                       'ok
+                       'ng))))))
+  (test-hash-table-save 'eqv?)
+  (test-hash-table-save 'string=?)
+  (when (library-exists? 'rfc.zlib)
+    (test-hash-table-save 'equal? :compress #t))
+  (test* "hash-table-load (general)" (test-error)
+         (begin
+           (hash-table-save (make-hash-table (make-comparator #t eq? #f
+                                                              eq-hash))
+                            "test.o")
+           (hash-table-load "test.o")))
+  (sys-unlink "test.o")
+  )
 
 (test-end)
@@ -95,5 +95,97 @@
               (vector-append))
 (test* "vector-append 4" (test-error) (vector-append '#() 'b 'c))
 
+;;-------------------------------------------------------------------
+(test-section "bitvectors")
+
+(test* "reader" '(#t 4 (1 0 1 1))
+       (let1 v '#*1011
+         (list (bitvector? v) (bitvector-length v) (bitvector->list/int v))))
+(test* "reader empty" 0 (bitvector-length '#*))
+(test* "reader error" (test-error) (read-from-string "#*10a"))
+(test* "printer" "#*0110" (write-to-string (bitvector 0 #t 1 #f)))
+(test* "equal?" #t (equal? (make-bitvector 70 1) (make-bitvector 70 #t)))
+(test* "equal? diff" #f (equal? '#*110 '#*111))
+(test* "equal? length" #f (equal? '#*110 '#*1100))
+(test* "bitvector=?" #t (bitvector=? '#*0101 (bitvector 0 1 0 1) '#*0101))
+
+(test* "ref/set" '(1 #t 0)
+       (let1 v (make-bitvector 100 0)
+         (bitvector-set! v 77 #t)
+         (list (bitvector-ref/int v 77) (bitvector-ref/bool v 77)
+               (bitvector-ref/int v 76))))
+(test* "ref range" (test-error) (bitvector-ref/int '#*01 2))
+(test* "set! immutable" (test-error) (bitvector-set! '#*01 0 1))
+
+(test* "string" '("#*1001" #*1001 #f)
+       (list (bitvector->string '#*1001)
+             (string->bitvector "#*1001")
+             (string->bitvector "1001")))
+
+(test* "copy" '#*110 (bitvector-copy '#*0110110 4))
+(test* "copy!" '#*0011100
+       (rlet1 v (make-bitvector 7 0)
+         (bitvector-copy! v 2 '#*01110 1 4)))
+(test* "copy! overlap" '#*1011101100
+       (rlet1 v (string->bitvector "#*1011011000")
+         (bitvector-copy! v 3 v 2 9)))
+(test* "fill!" '#*0011110000
+       (rlet1 v (make-bitvector 10 0)
+         (bitvector-fill! v 1 2 6)))
+
+;; Exercise word-wise paths with lengths across word boundaries
+(let ()
+  (define (rand-bv n seed)
+    (let1 v (make-bitvector n 0)
+      (dotimes [i n]
+        (set! seed (modulo (+ (* seed 1103515245) 12345) 2147483648))
+        (when (odd? (quotient seed 65536)) (bitvector-set! v i 1)))
+      v))
+  (define (lref v) (bitvector->list/int v))
+  (define (ref-op f a b) (list->bitvector (map f (lref a) (lref b))))
+  (define (b-and x y) (if (and (= x 1) (= y 1)) 1 0))
+  (define (b-ior x y) (if (or (= x 1) (= y 1)) 1 0))
+  (define (b-xor x y) (if (= x y) 0 1))
+  (define (b-not x) (- 1 x))
+  (dolist [n '(1 63 64 65 300 1031)]
+    (let ([a (rand-bv n 1)] [b (rand-bv n 7)])
+      (test* #"and ~n" (ref-op b-and a b) (bitvector-and a b))
+      (test* #"ior ~n" (ref-op b-ior a b) (bitvector-ior a b))
+      (test* #"xor ~n" (ref-op b-xor a b) (bitvector-xor a b))
+      (test* #"eqv ~n" (ref-op (^[x y] (b-not (b-xor x y))) a b)
+             (bitvector-eqv a b))
+      (test* #"andc2 ~n" (ref-op (^[x y] (b-and x (b-not y))) a b)
+             (bitvector-andc2 a b))
+      (test* #"not ~n" (list->bitvector (map b-not (lref a)))
+             (bitvector-not a))
+      (test* #"xor! ~n" (ref-op b-xor a b)
+             (bitvector-xor! (bitvector-copy a) b))
+      (test* #"count ~n" (length (filter (cut = 1 <>) (lref a)))
+             (bitvector-count 1 a))
+      (test* #"count0 ~n" (length (filter zero? (lref a)))
+             (bitvector-count #f a))
+      (test* #"rank/select ~n" #t
+             (let1 c (bitvector-count 1 a)
+               (and (not (bitvector-select 1 a c))
+                    (let loop ([k 0])
+                      (or (= k c)
+                          (let1 i (bitvector-select 1 a k)
+                            (and (= (bitvector-ref/int a i) 1)
+                                 (= (bitvector-rank 1 a i) k)
+                                 (loop (+ k 1)))))))))
+      (test* #"for-each-index ~n"
+             (filter-map (^[b i] (and (= b 1) i)) (lref a) (iota n))
+             (rlet1 r '()
+               (bitvector-for-each-index (^i (push! r i)) 1 a)
+               (set! r (reverse r))))
+      )))
+
+(test* "length mismatch" (test-error) (bitvector-and '#*01 '#*011))
+(test* "next-bit" '(1 4 -1 0)
+       (list (bitvector-first-bit 1 '#*01001)
+             (bitvector-next-bit 1 '#*01001 2)
+             (bitvector-next-bit 1 '#*01001 5)
+             (bitvector-first-bit 0 '#*01001)))
+
 (test-end)
 
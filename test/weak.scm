@@ -43,83 +43,140 @@
        (map (cut weak-vector-ref x <>) '(0 1 2 3 4)))
 
 
-; (test-section "weak hash table")
-
-; (define x (make-weak-hash-table 'eqv? 'value 'gone))
-
-; (test* "make-weak-hash-table (value-weak)" <weak-hash-table>
-;        (class-of x))
-
-; (test* "weak-hash-table-type" 'eqv? (weak-hash-table-type x))
-; (test* "weak-hash-table-weakness" 'value (weak-hash-table-weakness x))
-
-; (test* "weak-hash-table-get (nonexistent)" (test-error)
-;        (weak-hash-table-get x 123))
-; (test* "weak-hash-table-get (nonexistent)" 'foo
-;        (weak-hash-table-get x 123 'foo))
-
-; (test* "weak-hash-table-put!/get" '(1 2 3)
-;        (begin
-;          (weak-hash-table-put! x 123 (list 1 2 3))
-;          (weak-hash-table-get x 123)))
-; (test* "weak-hash-table-put!/get" '(4 5 6)
-;        (begin
-;          (weak-hash-table-put! x 456 (list 4 5 6))
-;          (weak-hash-table-get x 456)))
-
-; (clear-references)
-
-; (test* "weak-hash-table-get (after gc)" '(gone gone)
-;        (map (cut weak-hash-table-get x <>) '(123 456)))
-
-; (test* "weak-hash-table-keys & values" '((111 222 123 456)
-;                                          ((1 1 1) (2 2 2) gone gone))
-;        (let ((ones (list 1 1 1))
-;              (twos (list 2 2 2)))
-;          (weak-hash-table-put! x 111 ones)
-;          (weak-hash-table-put! x 222 twos)
-;          (list (weak-hash-table-keys x)
-;                (weak-hash-table-values x)))
-;        (lambda (expected got)
-;          (and (lset= equal? (car expected) (car got))
-;               (lset= equal? (cadr expected) (cadr got)))))
-         
-; (define x (make-weak-hash-table 'equal? 'key 'gone))
-
-; (test* "make-weak-hash-table (key-weak)" <weak-hash-table>
-;        (class-of x))
-
-; (test* "weak-hash-table-weakness" 'key (weak-hash-table-weakness x))
-
-; (test* "weak-hash-table-get (nonexistent)" (test-error)
-;        (weak-hash-table-get x (list 1 2 3)))
-; (test* "weak-hash-table-get (nonexistent)" 'foo
-;        (weak-hash-table-get x (list 1 2 3) 'foo))
-
-
-; (define y (list 7 8 9))
-
-; (test* "weak-hash-table-put!/get" 123
-;        (begin
-;          (weak-hash-table-put! x (list 1 2 3) 123)
-;          (weak-hash-table-get x '(1 2 3) 'huh?)))
-; (test* "weak-hash-table-put!/get" 456
-;        (begin
-;          (weak-hash-table-put! x (list 4 5 6) 456)
-;          (weak-hash-table-get x '(4 5 6) 'huh?)))
-; (test* "weak-hash-table-put!/get" 789
-;        (begin
-;          (weak-hash-table-put! x y 789)
-;          (weak-hash-table-get x '(7 8 9) 'huh?)))
-
-; (clear-references)
-
-; (test* "weak-hash-table-get (after gc)" '(foo foo 789)
-;        (map (cut weak-hash-table-get x <> 'foo) '((1 2 3) (4 5 6) (7 8 9))))
-
-; (test* "weak-hash-table-keys&values" '(((7 8 9)) (789))
-;        (list (weak-hash-table-keys x)
-;              (weak-hash-table-values x)))
+;; NB: The keys and values the tests expect to be collected must be
+;; freshly allocated, and must not be held by the test results.
+
+(test-section "weak hash table")
+
+(define x (make-weak-hash-table 'eqv? 'value 'gone))
+
+(test* "make-weak-hash-table (value-weak)" <weak-hash-table>
+       (class-of x))
+
+(test* "weak-hash-table-type" 'eqv? (weak-hash-table-type x))
+(test* "weak-hash-table-weakness" 'value (weak-hash-table-weakness x))
+
+(test* "weak-hash-table-get (nonexistent)" (test-error)
+       (weak-hash-table-get x 123))
+(test* "weak-hash-table-get (nonexistent)" 'foo
+       (weak-hash-table-get x 123 'foo))
+
+(test* "weak-hash-table-put!/get" '(1 2 3)
+       (begin
+         (weak-hash-table-put! x 123 (list 1 2 3))
+         (weak-hash-table-get x 123)))
+(test* "weak-hash-table-put!/get" '(4 5 6)
+       (begin
+         (weak-hash-table-put! x 456 (list 4 5 6))
+         (weak-hash-table-get x 456)))
+
+(clear-references)
+
+(test* "weak-hash-table-get (after gc)" '(gone gone)
+       (map (cut weak-hash-table-get x <>) '(123 456)))
+
+(test* "weak-hash-table-keys & values" '((111 222 123 456)
+                                         ((1 1 1) (2 2 2) gone gone))
+       (let ((ones (list 1 1 1))
+             (twos (list 2 2 2)))
+         (weak-hash-table-put! x 111 ones)
+         (weak-hash-table-put! x 222 twos)
+         (list (weak-hash-table-keys x)
+               (weak-hash-table-values x)))
+       (lambda (expected got)
+         (and (lset= equal? (car expected) (car got))
+              (lset= equal? (cadr expected) (cadr got)))))
+
+(define x (make-weak-hash-table 'equal? 'key 'gone))
+
+(test* "make-weak-hash-table (key-weak)" <weak-hash-table>
+       (class-of x))
+
+(test* "weak-hash-table-weakness" 'key (weak-hash-table-weakness x))
+
+(test* "weak-hash-table-get (nonexistent)" (test-error)
+       (weak-hash-table-get x (list 1 2 3)))
+(test* "weak-hash-table-get (nonexistent)" 'foo
+       (weak-hash-table-get x (list 1 2 3) 'foo))
+
+(define y (list 7 8 9))
+
+(test* "weak-hash-table-put!/get" 123
+       (begin
+         (weak-hash-table-put! x (list 1 2 3) 123)
+         (weak-hash-table-get x '(1 2 3) 'huh?)))
+(test* "weak-hash-table-put!/get" 456
+       (begin
+         (weak-hash-table-put! x (list 4 5 6) 456)
+         (weak-hash-table-get x '(4 5 6) 'huh?)))
+(test* "weak-hash-table-put!/get" 789
+       (begin
+         (weak-hash-table-put! x y 789)
+         (weak-hash-table-get x '(7 8 9) 'huh?)))
+(test* "weak-hash-table-put! (overwrite)" '(790 3)
+       (begin
+         (weak-hash-table-put! x (list 7 8 9) 790)
+         (list (weak-hash-table-get x y)
+               (weak-hash-table-num-entries x))))
+(test* "weak-hash-table-delete!" '(#t #f 2)
+       (let1 r (weak-hash-table-delete! x (list 4 5 6))
+         (list r
+               (weak-hash-table-exists? x '(4 5 6))
+               (weak-hash-table-num-entries x))))
+
+(clear-references)
+
+(test* "weak-hash-table-get (after gc)" '(foo foo 790)
+       (map (cut weak-hash-table-get x <> 'foo) '((1 2 3) (4 5 6) (7 8 9))))
+
+(test* "weak-hash-table-keys&values" '(((7 8 9)) (790))
+       (list (weak-hash-table-keys x)
+             (weak-hash-table-values x)))
+
+(test-section "weak hash table sweep")
+
+;; Entries with collected keys are swept while the table is modified.
+(define z (make-weak-hash-table 'eq? 'key))
+(define zkeep (list-tabulate 10 (^i (list i))))
+
+(test* "populate" 1010
+       (begin
+         (dotimes (i 1000) (weak-hash-table-put! z (list i) i))
+         (dolist (k zkeep) (weak-hash-table-put! z k (car k)))
+         (weak-hash-table-num-entries z)))
+
+(clear-references)
+
+(test* "swept after gc" '(#t 10)
+       (let1 k (list 'dummy)
+         (dotimes (i 1000)
+           (weak-hash-table-put! z k i)
+           (weak-hash-table-delete! z k))
+         (list (< (weak-hash-table-num-entries z) 1010)
+               (length (filter (cut weak-hash-table-exists? z <>) zkeep)))))
+
+;; The table is modified, hence swept, while we're iterating over it.
+;; The iteration must still visit every live entry exactly once.
+(define (sweep-during-iteration delete?)
+  (let ([w (make-weak-hash-table 'eq? 'key)]
+        [keep (list-tabulate 200 (^i (list i)))])
+    (dotimes (i 2000) (weak-hash-table-put! w (list i) 'dead))
+    (dolist (k keep) (weak-hash-table-put! w k (car k)))
+    (clear-references)
+    (let1 seen '()
+      (weak-hash-table-for-each w
+        (^[k v]
+          (when (integer? v) (push! seen v))
+          (if delete?
+            (weak-hash-table-delete! w k)
+            (weak-hash-table-put! w k v))))
+      (list (equal? (sort seen) (iota 200))
+            (length (filter (cut weak-hash-table-exists? w <>) keep))))))
+
+(test* "put! during iteration" '(#t 200)
+       (sweep-during-iteration #f))
+(test* "delete! during iteration" '(#t 0)
+       (sweep-during-iteration #t))
 
 (test-end)
 